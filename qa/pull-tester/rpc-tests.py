@@ -96,11 +96,19 @@ BASE_SCRIPTS= [
     'wallet_zip317_default.py',
     'listtransactions.py',
     'mempool_resurrect_test.py',
+    'mempool_persist.py',
+    'mempool_changes.py',
     'txn_doublespend.py',
     'txn_doublespend.py --mineblock',
     'getchaintips.py',
     'rawtransactions.py',
     'getrawtransaction_insight.py',
+    'txlocationindex.py',
+    'shieldedblockindex.py',
+    'getlockstats.py',
+    'getcachestats.py',
+    'gettxouts.py',
+    'getrpcinfo.py',
     'rest.py',
     'mempool_spendcoinbase.py',
     'mempool_reorg.py',
@@ -132,6 +140,9 @@ BASE_SCRIPTS= [
     'p2p_txexpiry_dos.py',
     'p2p_txexpiringsoon.py',
     'p2p_node_bloom.py',
+    'p2p_feefilter.py',
+    'p2p_compactblocks.py',
+    'p2p_sendheaders.py',
     'regtest_signrawtransaction.py',
     'shorter_block_times.py',
     'mining_shielded_coinbase.py',
@@ -182,6 +193,7 @@ EXTENDED_SCRIPTS = [
     'p2p-acceptblock.py',
     'maxuploadtarget.py',
     'wallet_db_flush.py',
+    'p2p_relay_benchmark.py',
 ]
 
 ALL_SCRIPTS = SERIAL_SCRIPTS + FLAKY_SCRIPTS + BASE_SCRIPTS + ZMQ_SCRIPTS + EXTENDED_SCRIPTS
@@ -14,10 +14,12 @@
 #   getaddressmempool
 
 
+from test_framework.authproxy import JSONRPCException
 from test_framework.test_framework import BitcoinTestFramework
 
 from test_framework.util import (
     assert_equal,
+    assert_raises_message,
     start_nodes,
     stop_nodes,
     connect_nodes,
@@ -345,6 +347,43 @@ class AddressIndexTest(BitcoinTestFramework):
         block_hash = self.nodes[1].getblockhash(111)
         assert_equal(deltas_info['end']['hash'], block_hash)
 
+        # Page through the deltas, following the cursor
+        def getaddressdeltas_paged(node_index, addresses, limit):
+            result = []
+            cursor = None
+            while True:
+                params = {'addresses': addresses, 'limit': limit}
+                if cursor is not None:
+                    params['cursor'] = cursor
+                page = self.nodes[node_index].getaddressdeltas(params)
+                assert(len(page['deltas']) <= limit)
+                result += page['deltas']
+                if 'cursor' not in page:
+                    return result
+                cursor = page['cursor']
+
+        assert_equal(getaddressdeltas_paged(1, [addr1], 2), deltas)
+        assert_equal(getaddressdeltas_paged(1, [addr1], len(deltas)), deltas)
+
+        # The deltas of several addresses are merged in chain order
+        merged = getaddressdeltas_paged(1, [addr1, addr_p2pkh, addr1], 1)
+        separate = deltas + self.nodes[1].getaddressdeltas({'addresses': [addr_p2pkh]})
+        assert_equal(len(merged), len(separate))
+        assert_equal(
+            sorted([(d['txid'], d['index'], d['satoshis']) for d in merged]),
+            sorted([(d['txid'], d['index'], d['satoshis']) for d in separate]))
+        heights = [d['height'] for d in merged]
+        assert_equal(heights, sorted(heights))
+
+        assert_raises_message(JSONRPCException, "Invalid cursor",
+            self.nodes[1].getaddressdeltas, {'addresses': [addr1], 'cursor': '00'})
+        assert_raises_message(JSONRPCException, "Limit must be positive",
+            self.nodes[1].getaddressdeltas, {'addresses': [addr1], 'limit': 0})
+
+        # The balance summary counts the transactions of the address
+        bal = self.nodes[1].getaddressbalance(addr1)
+        assert_equal(bal['txcount'], len(self.nodes[1].getaddresstxids(addr1)))
+
         # Test getaddressutxos by comparing results with deltas
         utxos = self.nodes[3].getaddressutxos(addr1)
 
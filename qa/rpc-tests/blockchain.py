@@ -12,8 +12,10 @@
 import decimal
 
 from test_framework.test_framework import BitcoinTestFramework
+from test_framework.authproxy import JSONRPCException
 from test_framework.util import (
     assert_equal,
+    assert_raises_message,
     start_nodes,
     connect_nodes_bi,
 )
@@ -23,6 +25,7 @@ class BlockchainTest(BitcoinTestFramework):
     Test blockchain-related RPC calls:
 
         - gettxoutsetinfo
+        - getblockchaininfo
 
     """
 
@@ -44,9 +47,29 @@ class BlockchainTest(BitcoinTestFramework):
         assert_equal(res['transactions'], 200)
         assert_equal(res['height'], 200)
         assert_equal(res['txouts'], 343) # 144*2 + 55
-        assert_equal(res['bytes_serialized'], 14819), # 32*199 + 48*90 + 49*54 + 27*55
+        assert(res['bogosize'] > 50 * res['txouts'])
         assert_equal(len(res['bestblock']), 64)
-        assert_equal(len(res['hash_serialized']), 64)
+        assert_equal(len(res['lthash']), 64)
+
+        # The statistics as of earlier blocks are kept.
+        node.generate(1)
+        self.sync_all()
+        assert_equal(node.gettxoutsetinfo(200), res)
+        res2 = node.gettxoutsetinfo()
+        assert_equal(res2['height'], 201)
+        assert(res2['lthash'] != res['lthash'])
+        assert_equal(self.nodes[1].gettxoutsetinfo(), res2)
+        assert_raises_message(JSONRPCException, "Block height out of range",
+                              node.gettxoutsetinfo, 202)
+
+        sync = node.getblockchaininfo()['sync']
+        assert sync['bottleneck'] in ['none', 'unknown', 'download', 'validation', 'flush']
+        assert sync['dbcache_limit'] > 0
+        assert sync['dbcache_usage'] > 0
+        assert 0 <= sync['validation_busy']
+        assert 0 <= sync['flush_busy']
+        assert_equal(sync['blocks_in_flight'], 0)
+        assert_equal(sync['blocks_waiting'], 0)
 
 
 if __name__ == '__main__':
@@ -4,8 +4,14 @@
 # Distributed under the MIT software license, see the accompanying
 # file COPYING or https://www.opensource.org/licenses/mit-license.php .
 
+from test_framework.authproxy import JSONRPCException
 from test_framework.test_framework import BitcoinTestFramework
-from test_framework.util import get_rpc_proxy, random_transaction
+from test_framework.util import (
+    assert_equal,
+    assert_raises_message,
+    get_rpc_proxy,
+    random_transaction,
+)
 
 from decimal import Decimal
 
@@ -88,6 +94,26 @@ class GetBlockTemplateLPTest(BitcoinTestFramework):
         thr.join(60 + 20)
         assert(not thr.is_alive())
 
+        # Test 5: given the id of a template it has, the caller only gets the
+        # transactions that are not in it
+        node = self.nodes[0]
+        base = node.getblocktemplate()
+        base_txids = [tx['hash'] for tx in base['transactions']]
+        (txid, txhex, fee) = random_transaction([node], Decimal("1.1"), Decimal("0.0"), Decimal("0.001"), 20)
+        # the template changes as soon as it holds the new transaction
+        diff = node.getblocktemplate({'longpollid': base['longpollid'], 'templateid': base['templateid']})
+        assert_equal(diff['basetemplateid'], base['templateid'])
+        assert(diff['templateid'] != base['templateid'])
+        assert(txid in diff['txids'])
+        assert_equal(diff['removed'], [])
+        assert_equal([tx['hash'] for tx in diff['transactions']],
+                     [h for h in diff['txids'] if h not in base_txids])
+        full = node.getblocktemplate({'templateid': '0'})
+        assert('basetemplateid' not in full)
+        assert_equal([tx['hash'] for tx in full['transactions']], diff['txids'])
+        assert_raises_message(JSONRPCException, "Invalid templateid",
+            node.getblocktemplate, {'templateid': 'x'})
+
 if __name__ == '__main__':
     GetBlockTemplateLPTest().main()
 
@@ -0,0 +1,76 @@
+#!/usr/bin/env python3
+# Copyright (c) 2026 The Zcash developers
+# Distributed under the MIT software license, see the accompanying
+# file COPYING or https://www.opensource.org/licenses/mit-license.php .
+
+#
+# Test that getcachestats reports the use of the internal caches.
+#
+
+from test_framework.test_framework import BitcoinTestFramework
+from test_framework.util import (
+    assert_equal,
+    start_nodes,
+)
+
+
+CACHES = [
+    'signatures',
+    'script_executions',
+    'equihash_solutions',
+    'tree_states',
+    'filterable_blocks',
+    'filtered_blocks',
+    'sapling_bundles',
+    'orchard_bundles',
+    'sprout_bundles',
+    'coins',
+    'nullifiers',
+    'anchors',
+    'recent_rejects',
+    'invalid_txs',
+]
+
+
+class GetCacheStatsTest(BitcoinTestFramework):
+
+    def __init__(self):
+        super().__init__()
+        self.num_nodes = 1
+
+    def setup_network(self):
+        self.nodes = start_nodes(self.num_nodes, self.options.tmpdir,
+            extra_args=[['-allowdeprecated=getnewaddress']])
+        self.is_network_split = False
+
+    def run_test(self):
+        node = self.nodes[0]
+        stats = node.getcachestats()
+        assert_equal(sorted(stats.keys()), sorted(CACHES))
+        for name in CACHES:
+            cache = stats[name]
+            for key in ['hits', 'misses', 'insertions', 'evictions', 'entries']:
+                assert(cache[key] >= 0)
+        assert(stats['signatures']['max_entries'] > 0)
+        assert(stats['coins']['memory_usage'] > 0)
+
+        # The signatures of a transaction are cached when it is accepted to
+        # the mempool, and the coins it spends are looked up in the cache.
+        node.sendtoaddress(node.getnewaddress(), 1)
+        node.generate(1)
+        after = node.getcachestats()
+        assert(after['signatures']['insertions'] > stats['signatures']['insertions'])
+        lookups = lambda cache: cache['hits'] + cache['misses']
+        assert(lookups(after['coins']) > lookups(stats['coins']))
+
+        # A repeated z_gettreestate request is answered from the cache.
+        treestate = node.z_gettreestate('1')
+        assert_equal(node.z_gettreestate('1'), treestate)
+        assert_equal(node.z_gettreestate(treestate['hash']), treestate)
+        final = node.getcachestats()
+        assert_equal(final['tree_states']['insertions'], after['tree_states']['insertions'] + 1)
+        assert_equal(final['tree_states']['hits'], after['tree_states']['hits'] + 2)
+
+
+if __name__ == '__main__':
+    GetCacheStatsTest().main()
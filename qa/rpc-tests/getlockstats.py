@@ -0,0 +1,54 @@
+#!/usr/bin/env python3
+# Copyright (c) 2026 The Zcash developers
+# Distributed under the MIT software license, see the accompanying
+# file COPYING or https://www.opensource.org/licenses/mit-license.php .
+
+#
+# Test that getlockstats reports the locks taken while -lockstats is set.
+#
+
+from test_framework.test_framework import BitcoinTestFramework
+from test_framework.util import (
+    assert_equal,
+    start_nodes,
+)
+
+
+class GetLockStatsTest(BitcoinTestFramework):
+
+    def __init__(self):
+        super().__init__()
+        self.num_nodes = 2
+
+    def setup_network(self):
+        self.nodes = start_nodes(self.num_nodes, self.options.tmpdir,
+            extra_args=[['-lockstats'], []])
+        self.is_network_split = False
+
+    def run_test(self):
+        self.nodes[0].generate(1)
+
+        stats = self.nodes[0].getlockstats()
+        assert_equal(stats['enabled'], True)
+        locks = dict((lock['name'], lock) for lock in stats['locks'])
+        assert('cs_main' in locks)
+        cs_main = locks['cs_main']
+        assert(cs_main['acquisitions'] > 0)
+        assert_equal(cs_main['acquisitions'], sum(site['acquisitions'] for site in cs_main['sites']))
+        assert(all(':' in site['site'] for site in cs_main['sites']))
+
+        # Resetting returns the statistics one last time, and only what
+        # happens afterwards is counted.
+        assert(len(self.nodes[0].getlockstats(True)['locks']) > 0)
+        locks = dict((lock['name'], lock) for lock in self.nodes[0].getlockstats()['locks'])
+        assert(locks.get('cs_main', {'acquisitions': 0})['acquisitions'] < cs_main['acquisitions'])
+
+        # Nothing is recorded without -lockstats.
+        self.nodes[1].generate(1)
+        stats = self.nodes[1].getlockstats()
+        assert_equal(stats['enabled'], False)
+        assert_equal(stats['locks'], [])
+
+
+if __name__ == '__main__':
+    GetLockStatsTest().main()
@@ -0,0 +1,43 @@
+#!/usr/bin/env python3
+# Copyright (c) 2026 The Zcash developers
+# Distributed under the MIT software license, see the accompanying
+# file COPYING or https://www.opensource.org/licenses/mit-license.php .
+
+#
+# Test that getrpcinfo lists the calls that are running.
+#
+
+from test_framework.test_framework import BitcoinTestFramework
+from test_framework.util import (
+    assert_equal,
+    start_nodes,
+)
+
+
+class GetRPCInfoTest(BitcoinTestFramework):
+
+    def __init__(self):
+        super().__init__()
+        self.num_nodes = 1
+
+    def setup_network(self):
+        self.nodes = start_nodes(self.num_nodes, self.options.tmpdir)
+        self.is_network_split = False
+
+    def run_test(self):
+        node = self.nodes[0]
+        info = node.getrpcinfo()
+        assert_equal(list(info.keys()), ['active_commands'])
+        active = info['active_commands']
+        assert_equal(len(active), 1)
+        assert_equal(active[0]['method'], 'getrpcinfo')
+        assert(active[0]['duration'] >= 0)
+
+        # Finished calls are no longer listed.
+        node.getblockcount()
+        active = node.getrpcinfo()['active_commands']
+        assert_equal([c['method'] for c in active], ['getrpcinfo'])
+
+
+if __name__ == '__main__':
+    GetRPCInfoTest().main()
@@ -0,0 +1,81 @@
+#!/usr/bin/env python3
+# Copyright (c) 2026 The Zcash developers
+# Distributed under the MIT software license, see the accompanying
+# file COPYING or https://www.opensource.org/licenses/mit-license.php .
+
+#
+# Test gettxout and gettxouts, which read from a snapshot of the chain state
+# that is published after each block.
+#
+
+from test_framework.authproxy import JSONRPCException
+from test_framework.test_framework import BitcoinTestFramework
+from test_framework.util import (
+    assert_equal,
+    assert_raises_message,
+    start_nodes,
+)
+
+from decimal import Decimal
+
+
+class GetTxOutsTest(BitcoinTestFramework):
+
+    def __init__(self):
+        super().__init__()
+        self.num_nodes = 1
+
+    def setup_network(self):
+        self.nodes = start_nodes(self.num_nodes, self.options.tmpdir,
+            extra_args=[['-allowdeprecated=getnewaddress']])
+        self.is_network_split = False
+
+    def run_test(self):
+        node = self.nodes[0]
+        address = node.getnewaddress()
+        txid = node.sendtoaddress(address, Decimal('1'))
+        tx = node.getrawtransaction(txid, 1)
+        spent = tx['vin'][0]
+        n = [out['n'] for out in tx['vout'] if out['value'] == Decimal('1')][0]
+        outputs = [
+            {'txid': txid, 'vout': n},
+            {'txid': spent['txid'], 'vout': spent['vout']},
+            {'txid': txid, 'vout': 99},
+        ]
+
+        # The new output is only in the mempool, and the one it spends is
+        # spent there.
+        results = node.gettxouts(outputs)
+        assert_equal(len(results), 3)
+        assert_equal(results[0]['confirmations'], 0)
+        assert_equal(results[0]['value'], Decimal('1'))
+        assert_equal(results[1], None)
+        assert_equal(results[2], None)
+        assert_equal(results[0], node.gettxout(txid, n))
+        assert_equal(node.gettxout(txid, n, False), None)
+        unconfirmed = node.gettxouts(outputs, False)
+        assert_equal(unconfirmed[0], None)
+        assert_equal(unconfirmed[1], node.gettxout(spent['txid'], spent['vout'], False))
+        assert(unconfirmed[1] is not None)
+
+        # Once mined, the outputs are answered as of the new block.
+        blockhash = node.generate(1)[0]
+        for include_mempool in [True, False]:
+            results = node.gettxouts(outputs, include_mempool)
+            assert_equal(results[0]['confirmations'], 1)
+            assert_equal(results[0]['bestblock'], blockhash)
+            assert_equal(results[1], None)
+            assert_equal(results[0], node.gettxout(txid, n, include_mempool))
+
+        node.generate(1)
+        assert_equal(node.gettxouts(outputs)[0]['confirmations'], 2)
+
+        assert_equal(node.gettxouts([]), [])
+        assert_raises_message(JSONRPCException, "vout must be positive",
+            node.gettxouts, [{'txid': txid, 'vout': -1}])
+        assert_raises_message(JSONRPCException, "Too many outputs",
+            node.gettxouts, [{'txid': txid, 'vout': 0}] * 1001)
+
+
+if __name__ == '__main__':
+    GetTxOutsTest().main()
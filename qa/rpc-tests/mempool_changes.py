@@ -0,0 +1,111 @@
+#!/usr/bin/env python3
+# Copyright (c) 2026 The Zcash developers
+# Distributed under the MIT software license, see the accompanying
+# file COPYING or https://www.opensource.org/licenses/mit-license.php .
+
+#
+# Test that getmempoolchanges follows the transactions entering and leaving
+# the mempool from the sequence number returned by getrawmempool, and that it
+# waits for a change when there is none yet.
+#
+
+from test_framework.authproxy import JSONRPCException
+from test_framework.test_framework import BitcoinTestFramework
+from test_framework.util import (
+    assert_equal,
+    assert_raises_message,
+    get_rpc_proxy,
+    start_node,
+)
+from test_framework.zip317 import conventional_fee
+
+from decimal import Decimal
+import threading
+import time
+
+
+class MempoolChangesTest(BitcoinTestFramework):
+
+    def __init__(self):
+        super().__init__()
+        self.num_nodes = 1
+
+    def setup_network(self):
+        self.nodes = [start_node(0, self.options.tmpdir, [
+            '-mempoolfeedsize=4',
+            '-allowdeprecated=getnewaddress',
+        ])]
+        self.is_network_split = False
+
+    def create_tx(self, from_txid, to_address, amount):
+        inputs = [{ "txid" : from_txid, "vout" : 0}]
+        outputs = { to_address : amount }
+        rawtx = self.nodes[0].createrawtransaction(inputs, outputs)
+        signresult = self.nodes[0].signrawtransaction(rawtx)
+        assert_equal(signresult["complete"], True)
+        return signresult["hex"]
+
+    def run_test(self):
+        node = self.nodes[0]
+        address = node.getnewaddress()
+        fee = conventional_fee(1)
+
+        start = node.getrawmempool(False, True)
+        assert_equal(start['txids'], [])
+        sequence = start['mempool_sequence']
+
+        # Nothing has changed yet.
+        changes = node.getmempoolchanges(sequence)
+        assert_equal(changes, {'mempool_sequence': sequence, 'changes': []})
+
+        coinbase_txid = node.getblock(node.getblockhash(1))['tx'][0]
+        txid = node.sendrawtransaction(self.create_tx(coinbase_txid, address, Decimal('10') - fee))
+
+        changes = node.getmempoolchanges(sequence, 0, True)
+        assert_equal(changes['mempool_sequence'], sequence + 1)
+        assert_equal(changes['changes'], [{
+            'sequence': sequence + 1,
+            'txid': txid,
+            'type': 'added',
+            'hex': node.getrawtransaction(txid),
+        }])
+        sequence = changes['mempool_sequence']
+
+        # A call that waits returns as soon as the transaction is mined.
+        result = {}
+        def wait():
+            proxy = get_rpc_proxy(node.url, 0, timeout=600)
+            result['changes'] = proxy.getmempoolchanges(sequence, 60)
+        waiter = threading.Thread(target=wait)
+        start_time = time.time()
+        waiter.start()
+        time.sleep(1)
+        assert(waiter.is_alive())
+        node.generate(1)
+        waiter.join()
+        assert(time.time() - start_time < 30)
+        assert_equal(result['changes']['changes'], [{
+            'sequence': sequence + 1,
+            'txid': txid,
+            'type': 'removed',
+            'reason': 'block',
+        }])
+        sequence = result['changes']['mempool_sequence']
+
+        # Only the last four changes are kept.
+        for n in range(2, 5):
+            coinbase_txid = node.getblock(node.getblockhash(n))['tx'][0]
+            node.sendrawtransaction(self.create_tx(coinbase_txid, address, Decimal('10') - fee))
+        node.generate(1)
+        assert_equal(node.getrawmempool(), [])
+        changes = node.getmempoolchanges(sequence + 2)
+        assert_equal(len(changes['changes']), 4)
+        assert_equal([c['type'] for c in changes['changes']], ['added', 'removed', 'removed', 'removed'])
+        assert_raises_message(JSONRPCException, "are not kept",
+            node.getmempoolchanges, sequence)
+        assert_raises_message(JSONRPCException, "are not kept",
+            node.getmempoolchanges, sequence + 100)
+
+
+if __name__ == '__main__':
+    MempoolChangesTest().main()
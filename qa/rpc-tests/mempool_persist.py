@@ -0,0 +1,112 @@
+#!/usr/bin/env python3
+# Copyright (c) 2014-2016 The Bitcoin Core developers
+# Copyright (c) 2026 The Zcash developers
+# Distributed under the MIT software license, see the accompanying
+# file COPYING or https://www.opensource.org/licenses/mit-license.php .
+
+#
+# Test that the mempool is saved on shutdown and loaded on restart, along
+# with the times at which its transactions entered it and their
+# prioritisation, unless -persistmempool=0 is set, and that the signature
+# cache is too, unless -persistsigcache=0 is set.
+#
+
+from test_framework.test_framework import BitcoinTestFramework
+from test_framework.util import (
+    assert_equal,
+    assert_greater_than,
+    start_node,
+    stop_node,
+)
+from test_framework.zip317 import conventional_fee
+
+from decimal import Decimal
+import os
+import time
+
+
+class MempoolPersistTest(BitcoinTestFramework):
+
+    def __init__(self):
+        super().__init__()
+        self.num_nodes = 1
+
+    def node_args(self, extra_args=[]):
+        return [
+            '-debug=mempool',
+            '-walletbroadcast=0',
+            '-allowdeprecated=getnewaddress',
+        ] + extra_args
+
+    def setup_network(self):
+        self.nodes = [start_node(0, self.options.tmpdir, self.node_args())]
+        self.is_network_split = False
+
+    def create_tx(self, from_txid, to_address, amount):
+        inputs = [{ "txid" : from_txid, "vout" : 0}]
+        outputs = { to_address : amount }
+        rawtx = self.nodes[0].createrawtransaction(inputs, outputs)
+        signresult = self.nodes[0].signrawtransaction(rawtx)
+        assert_equal(signresult["complete"], True)
+        return signresult["hex"]
+
+    def restart_node(self, extra_args=[]):
+        stop_node(self.nodes[0], 0)
+        self.nodes[0] = start_node(0, self.options.tmpdir, self.node_args(extra_args))
+        # Wait for the saved mempool to be loaded.
+        for _ in range(100):
+            if self.nodes[0].getmempoolinfo()['loaded']:
+                return
+            time.sleep(0.1)
+        raise AssertionError("the mempool was not loaded")
+
+    def run_test(self):
+        node0_address = self.nodes[0].getnewaddress()
+        fee = conventional_fee(1)
+
+        # A chain of two transactions for each of three coinbase outputs.
+        b = [ self.nodes[0].getblockhash(n) for n in range(1, 4) ]
+        coinbase_txids = [ self.nodes[0].getblock(h)['tx'][0] for h in b ]
+        spends1_id = [ self.nodes[0].sendrawtransaction(self.create_tx(txid, node0_address, Decimal('10') - fee))
+                       for txid in coinbase_txids ]
+        spends2_id = [ self.nodes[0].sendrawtransaction(self.create_tx(txid, node0_address, Decimal('10') - 2*fee))
+                       for txid in spends1_id ]
+        txids = spends1_id + spends2_id
+        self.nodes[0].prioritisetransaction(spends2_id[0], 0, 1000)
+        mempool = self.nodes[0].getrawmempool(True)
+        assert_equal(set(mempool.keys()), set(txids))
+
+        print("Restart the node, and check that the mempool is restored")
+        self.restart_node()
+        restored = self.nodes[0].getrawmempool(True)
+        assert_equal(set(restored.keys()), set(txids))
+        for txid in txids:
+            assert_equal(restored[txid]['time'], mempool[txid]['time'])
+        assert_equal(
+            restored[spends2_id[0]]['modifiedfee'] - restored[spends2_id[0]]['fee'],
+            Decimal('0.00001000'))
+
+        print("Restart the node with -persistmempool=0, and check that the mempool is empty")
+        self.restart_node(['-persistmempool=0'])
+        assert_equal(self.nodes[0].getrawmempool(), [])
+
+        print("The signatures of the transactions are still in the signature cache")
+        assert_greater_than(self.nodes[0].getcachestats()['signatures']['entries'], 0)
+
+        print("Restart the node with -persistsigcache=0, and check that the signature cache is empty")
+        self.restart_node(['-persistmempool=0', '-persistsigcache=0'])
+        assert_equal(self.nodes[0].getcachestats()['signatures']['entries'], 0)
+
+        print("The mempool saved before is still loaded on the next restart")
+        self.restart_node()
+        assert_equal(set(self.nodes[0].getrawmempool()), set(txids))
+
+        print("savemempool writes mempool.dat")
+        mempooldat = os.path.join(self.options.tmpdir, 'node0', 'regtest', 'mempool.dat')
+        os.remove(mempooldat)
+        self.nodes[0].savemempool()
+        assert(os.path.isfile(mempooldat))
+
+
+if __name__ == '__main__':
+    MempoolPersistTest().main()
@@ -0,0 +1,184 @@
+#!/usr/bin/env python3
+# Copyright (c) 2016 The Bitcoin Core developers
+# Copyright (c) 2026 The Zcash developers
+# Distributed under the MIT software license, see the accompanying
+# file COPYING or https://www.opensource.org/licenses/mit-license.php .
+
+#
+# Test that the node serves compact blocks ("cmpctblock" and "getblocktxn"),
+# and announces new blocks with them to peers that asked for it with
+# "sendcmpct".
+#
+
+from test_framework.mininode import NodeConn, NodeConnCB, NetworkThread, \
+    CBlockHeader, CInv, msg_getdata, msg_getblocktxn, msg_headers, msg_ping, \
+    msg_pong, msg_sendcmpct, mininode_lock, SHORT_IDS_BLOCKS_PROTO_VERSION
+from test_framework.test_framework import BitcoinTestFramework
+from test_framework.util import assert_equal, fail, hex_str_to_bytes, \
+    p2p_port, start_nodes
+
+from decimal import Decimal
+from io import BytesIO
+import time
+
+MSG_CMPCT_BLOCK = 4
+
+
+class TestNode(NodeConnCB):
+    def __init__(self):
+        NodeConnCB.__init__(self)
+        self.create_callback_map()
+        self.connection = None
+        self.ping_counter = 1
+        self.last_pong = msg_pong()
+        self.last_sendcmpct = None
+        self.last_cmpctblock = None
+        self.last_blocktxn = None
+        self.last_block = None
+
+    def add_connection(self, conn):
+        self.connection = conn
+
+    def wait_for_verack(self):
+        while True:
+            with mininode_lock:
+                if self.verack_received:
+                    return
+            time.sleep(0.05)
+
+    def send_message(self, message):
+        self.connection.send_message(message)
+
+    # Blocks are fetched explicitly by the test.
+    def on_inv(self, conn, message):
+        pass
+
+    def on_sendcmpct(self, conn, message):
+        self.last_sendcmpct = message
+
+    def on_cmpctblock(self, conn, message):
+        self.last_cmpctblock = message.header_and_shortids
+        self.last_cmpctblock.header.calc_sha256()
+
+    def on_blocktxn(self, conn, message):
+        self.last_blocktxn = message
+
+    def on_block(self, conn, message):
+        self.last_block = message.block
+        self.last_block.calc_sha256()
+
+    def on_pong(self, conn, message):
+        self.last_pong = message
+
+    def sync_with_ping(self, timeout=30, waiting_for=None):
+        self.connection.send_message(msg_ping(nonce=self.ping_counter))
+        sleep_time = 0.05
+        while timeout > 0:
+            with mininode_lock:
+                ready = True if waiting_for is None else waiting_for(self)
+                if ready and self.last_pong.nonce == self.ping_counter:
+                    self.ping_counter += 1
+                    return
+            time.sleep(sleep_time)
+            timeout -= sleep_time
+        fail("Should have received pong")
+
+
+class CompactBlocksTest(BitcoinTestFramework):
+
+    def __init__(self):
+        super().__init__()
+        self.num_nodes = 1
+
+    def setup_network(self):
+        self.nodes = start_nodes(self.num_nodes, self.options.tmpdir, extra_args=[[
+            '-allowdeprecated=getnewaddress',
+        ]])
+        self.is_network_split = False
+
+    def request_cmpctblock(self, testnode, blockhash):
+        with mininode_lock:
+            testnode.last_cmpctblock = None
+            testnode.last_block = None
+            testnode.send_message(msg_getdata([CInv(MSG_CMPCT_BLOCK, int(blockhash, 16))]))
+        testnode.sync_with_ping(waiting_for=lambda x: x.last_cmpctblock is not None or x.last_block is not None)
+
+    def run_test(self):
+        testnode = TestNode()
+        connection = NodeConn('127.0.0.1', p2p_port(0), self.nodes[0],
+                              testnode, "regtest", SHORT_IDS_BLOCKS_PROTO_VERSION)
+        testnode.add_connection(connection)
+        NetworkThread().start()
+        testnode.wait_for_verack()
+
+        print("The node offers low-bandwidth compact blocks")
+        testnode.sync_with_ping(waiting_for=lambda x: x.last_sendcmpct is not None)
+        with mininode_lock:
+            assert_equal(testnode.last_sendcmpct.announce, False)
+            assert_equal(testnode.last_sendcmpct.version, 1)
+
+        # Mine a block with a transaction besides the coinbase.
+        node0_address = self.nodes[0].getnewaddress()
+        coinbase_txid = self.nodes[0].getblock(self.nodes[0].getblockhash(1))['tx'][0]
+        rawtx = self.nodes[0].createrawtransaction(
+            [{"txid": coinbase_txid, "vout": 0}], {node0_address: Decimal('10') - Decimal('0.0001')})
+        signresult = self.nodes[0].signrawtransaction(rawtx)
+        assert_equal(signresult["complete"], True)
+        txid = self.nodes[0].sendrawtransaction(signresult["hex"])
+        blockhash = self.nodes[0].generate(1)[0]
+        block_txids = self.nodes[0].getblock(blockhash)['tx']
+        assert_equal(block_txids[1], txid)
+
+        print("A cmpctblock carries the coinbase and short IDs for the other transactions")
+        self.request_cmpctblock(testnode, blockhash)
+        with mininode_lock:
+            assert(testnode.last_block is None)
+            cmpctblock = testnode.last_cmpctblock
+            assert_equal(cmpctblock.header.hash, blockhash)
+            assert_equal(len(cmpctblock.shortids), 1)
+            assert_equal(len(cmpctblock.prefilled_txn), 1)
+            assert_equal(cmpctblock.prefilled_txn[0].index, 0)
+            cmpctblock.prefilled_txn[0].tx.calc_sha256()
+            assert_equal(cmpctblock.prefilled_txn[0].tx.hash, block_txids[0])
+
+        print("Missing transactions are sent in response to getblocktxn")
+        with mininode_lock:
+            testnode.send_message(msg_getblocktxn(int(blockhash, 16), [0, 1]))
+        testnode.sync_with_ping(waiting_for=lambda x: x.last_blocktxn is not None)
+        with mininode_lock:
+            assert_equal(testnode.last_blocktxn.blockhash, int(blockhash, 16))
+            for tx in testnode.last_blocktxn.transactions:
+                tx.calc_sha256()
+            assert_equal([tx.hash for tx in testnode.last_blocktxn.transactions], block_txids)
+
+        print("New blocks are announced with cmpctblock in high-bandwidth mode")
+        # Tell the node that we have its tip, so that it knows we can
+        # connect the next block.
+        header = CBlockHeader()
+        header.deserialize(BytesIO(hex_str_to_bytes(self.nodes[0].getblockheader(blockhash, False))))
+        headers = msg_headers()
+        headers.headers = [header]
+        with mininode_lock:
+            testnode.last_cmpctblock = None
+            testnode.send_message(headers)
+            testnode.send_message(msg_sendcmpct(True, 1))
+        testnode.sync_with_ping()
+        blockhash = self.nodes[0].generate(1)[0]
+        testnode.sync_with_ping(waiting_for=lambda x: x.last_cmpctblock is not None)
+        with mininode_lock:
+            assert_equal(testnode.last_cmpctblock.header.hash, blockhash)
+
+        print("Old blocks are sent in full")
+        # Leave high-bandwidth mode, so that these are announced with inv.
+        testnode.send_message(msg_sendcmpct(False, 1))
+        testnode.sync_with_ping()
+        self.nodes[0].generate(6)
+        oldhash = self.nodes[0].getblockhash(self.nodes[0].getblockcount() - 6)
+        self.request_cmpctblock(testnode, oldhash)
+        with mininode_lock:
+            assert(testnode.last_cmpctblock is None)
+            assert_equal(testnode.last_block.hash, oldhash)
+
+
+if __name__ == '__main__':
+    CompactBlocksTest().main()
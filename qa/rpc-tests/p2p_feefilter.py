@@ -0,0 +1,158 @@
+#!/usr/bin/env python3
+# Copyright (c) 2016 The Bitcoin Core developers
+# Copyright (c) 2026 The Zcash developers
+# Distributed under the MIT software license, see the accompanying
+# file COPYING or https://www.opensource.org/licenses/mit-license.php .
+
+#
+# Test that the node tells its peers which transactions it would accept with
+# a "feefilter" message, and does not announce to a peer the transactions that
+# pay less than the fee rate, or have more unpaid actions, than its filter.
+#
+
+from test_framework.mininode import NodeConn, NodeConnCB, NetworkThread, \
+    msg_feefilter, msg_mempool, msg_ping, msg_pong, mininode_lock, \
+    FEEFILTER_PROTO_VERSION
+from test_framework.test_framework import BitcoinTestFramework
+from test_framework.util import assert_equal, fail, p2p_port, start_nodes
+
+from decimal import Decimal
+import time
+
+
+class TestNode(NodeConnCB):
+    def __init__(self):
+        NodeConnCB.__init__(self)
+        self.create_callback_map()
+        self.connection = None
+        self.ping_counter = 1
+        self.last_pong = msg_pong()
+        self.last_inv = None
+        self.last_feefilter = None
+
+    def add_connection(self, conn):
+        self.connection = conn
+
+    def wait_for_verack(self):
+        while True:
+            with mininode_lock:
+                if self.verack_received:
+                    return
+            time.sleep(0.05)
+
+    def send_message(self, message):
+        self.connection.send_message(message)
+
+    def on_inv(self, conn, message):
+        self.last_inv = message
+
+    def on_feefilter(self, conn, message):
+        self.last_feefilter = message
+
+    def on_pong(self, conn, message):
+        self.last_pong = message
+
+    def sync_with_ping(self, timeout=30, waiting_for=None):
+        self.connection.send_message(msg_ping(nonce=self.ping_counter))
+        sleep_time = 0.05
+        while timeout > 0:
+            with mininode_lock:
+                ready = True if waiting_for is None else waiting_for(self)
+                if ready and self.last_pong.nonce == self.ping_counter:
+                    self.ping_counter += 1
+                    return
+            time.sleep(sleep_time)
+            timeout -= sleep_time
+        fail("Should have received pong")
+
+
+class FeeFilterTest(BitcoinTestFramework):
+
+    def __init__(self):
+        super().__init__()
+        self.num_nodes = 1
+
+    def setup_network(self):
+        self.nodes = start_nodes(self.num_nodes, self.options.tmpdir, extra_args=[[
+            '-txunpaidactionlimit=2',
+            '-allowdeprecated=getnewaddress',
+        ]])
+        self.is_network_split = False
+
+    def create_tx(self, from_txid, to_address, amount):
+        inputs = [{ "txid" : from_txid, "vout" : 0}]
+        outputs = { to_address : amount }
+        rawtx = self.nodes[0].createrawtransaction(inputs, outputs)
+        signresult = self.nodes[0].signrawtransaction(rawtx)
+        assert_equal(signresult["complete"], True)
+        return signresult["hex"]
+
+    def mempool_inv(self, testnode):
+        with mininode_lock:
+            testnode.last_inv = None
+            testnode.send_message(msg_mempool())
+        testnode.sync_with_ping(waiting_for=lambda x: x.last_inv is not None)
+        with mininode_lock:
+            return set(inv.hash for inv in testnode.last_inv.inv)
+
+    def set_filter(self, testnode, feerate, unpaid_action_limit):
+        testnode.send_message(msg_feefilter(feerate, unpaid_action_limit))
+        testnode.sync_with_ping()
+
+    def run_test(self):
+        testnode = TestNode()
+        connection = NodeConn('127.0.0.1', p2p_port(0), self.nodes[0],
+                              testnode, "regtest", FEEFILTER_PROTO_VERSION)
+        testnode.add_connection(connection)
+        NetworkThread().start()
+        testnode.wait_for_verack()
+
+        # Leave initial block download, during which the node asks not to be
+        # sent any transactions.
+        self.nodes[0].generate(1)
+
+        print("The node sends its relay fee and unpaid action limit")
+        relayfee = self.nodes[0].getnetworkinfo()['relayfee']
+        expected = (int(relayfee * 100000000), 2)
+        testnode.sync_with_ping(waiting_for=lambda x: x.last_feefilter is not None and
+                                (x.last_feefilter.feerate, x.last_feefilter.unpaid_action_limit) == expected)
+
+        # Three transactions with no, one and two unpaid actions. The last
+        # one also pays less than the relay fee at a rate of 10000 zatoshis
+        # per 1000 bytes.
+        node0_address = self.nodes[0].getnewaddress()
+        b = [ self.nodes[0].getblockhash(n) for n in range(1, 4) ]
+        coinbase_txids = [ self.nodes[0].getblock(h)['tx'][0] for h in b ]
+        fees = [ Decimal('0.0001'), Decimal('0.00005'), Decimal('0.000005') ]
+        txids = [ self.nodes[0].sendrawtransaction(self.create_tx(txid, node0_address, Decimal('10') - fee))
+                  for (txid, fee) in zip(coinbase_txids, fees) ]
+        hashes = [ int(txid, 16) for txid in txids ]
+        assert_equal(set(self.nodes[0].getrawmempool()), set(txids))
+
+        # Wait for the transactions to be announced as they are relayed, so
+        # that only the responses to "mempool" are seen below.
+        testnode.sync_with_ping(waiting_for=lambda x: x.last_inv is not None and
+                                set(inv.hash for inv in x.last_inv.inv) == set(hashes))
+
+        print("Without a filter, every transaction is announced")
+        assert_equal(self.mempool_inv(testnode), set(hashes))
+
+        print("Transactions with more unpaid actions than the filter are not announced")
+        self.set_filter(testnode, 0, 1)
+        assert_equal(self.mempool_inv(testnode), set(hashes[:2]))
+        self.set_filter(testnode, 0, 0)
+        assert_equal(self.mempool_inv(testnode), set(hashes[:1]))
+
+        print("Transactions below the relay fee of the filter are not announced")
+        self.set_filter(testnode, 10000, 2)
+        assert_equal(self.mempool_inv(testnode), set(hashes[:2]))
+
+        print("The filter is shown by getpeerinfo")
+        peerinfo = self.nodes[0].getpeerinfo()
+        assert_equal(len(peerinfo), 1)
+        assert_equal(peerinfo[0]['minfeefilter'], Decimal('0.00010000'))
+        assert_equal(peerinfo[0]['unpaidactionfilter'], 2)
+
+
+if __name__ == '__main__':
+    FeeFilterTest().main()
@@ -0,0 +1,155 @@
+#!/usr/bin/env python3
+# Copyright (c) 2026 The Zcash developers
+# Distributed under the MIT software license, see the accompanying
+# file COPYING or https://www.opensource.org/licenses/mit-license.php .
+
+#
+# Measure how transactions and blocks propagate across a line of regtest
+# nodes on loopback: the latency from submission at the first node until the
+# last node has them, the bytes sent per relayed transaction, and the time
+# and CPU time the nodes spent processing each type of message, from the
+# per-message statistics of getpeerinfo.
+#
+# With the defaults it runs quickly enough to check the harness. For a
+# benchmark, raise the workload, for example:
+#
+#   ./p2p_relay_benchmark.py --nodes=8 --txs=2000 --blocks=20
+#
+
+from test_framework.test_framework import BitcoinTestFramework
+from test_framework.util import (
+    assert_equal,
+    assert_greater_than,
+    connect_nodes_bi,
+    initialize_chain_clean,
+    start_nodes,
+    sync_blocks,
+)
+
+from collections import defaultdict
+from decimal import Decimal
+import time
+
+POLL_INTERVAL = 0.01
+TIMEOUT = 600
+
+
+def percentile(values, fraction):
+    values = sorted(values)
+    return values[min(len(values) - 1, int(fraction * len(values)))]
+
+
+class P2PRelayBenchmark(BitcoinTestFramework):
+
+    def add_options(self, parser):
+        parser.add_option("--nodes", dest="nodes", default=4, type='int',
+                          help="Nodes in the line (default: %default)")
+        parser.add_option("--txs", dest="txs", default=100, type='int',
+                          help="Transactions to flood (default: %default)")
+        parser.add_option("--blocks", dest="blocks", default=5, type='int',
+                          help="Blocks to propagate (default: %default)")
+
+    def setup_chain(self):
+        print("Initializing test directory "+self.options.tmpdir)
+        initialize_chain_clean(self.options.tmpdir, self.options.nodes)
+
+    def setup_network(self):
+        self.num_nodes = self.options.nodes
+        self.nodes = start_nodes(self.num_nodes, self.options.tmpdir, extra_args=[[
+            '-allowdeprecated=getnewaddress',
+        ]] * self.num_nodes)
+        # A line, so that the last node is as many hops away as possible.
+        for i in range(self.num_nodes - 1):
+            connect_nodes_bi(self.nodes, i, i + 1)
+        self.is_network_split = False
+
+    def message_stats(self):
+        """Per-command totals over the peers of every node."""
+        totals = {
+            'bytessent_per_msg': defaultdict(int),
+            'processtime_per_msg': defaultdict(int),
+            'processcpu_per_msg': defaultdict(int),
+        }
+        for node in self.nodes:
+            for peer in node.getpeerinfo():
+                for key, total in totals.items():
+                    for command, value in peer[key].items():
+                        total[command] += value
+        return totals
+
+    def report(self, title, before, after, count):
+        print(title)
+        for key, unit in [('bytessent_per_msg', 'bytes'), ('processtime_per_msg', 'us'), ('processcpu_per_msg', 'cpuus')]:
+            deltas = {
+                command: after[key][command] - before[key].get(command, 0)
+                for command in after[key]
+            }
+            for command, delta in sorted(deltas.items(), key=lambda x: -x[1]):
+                if delta > 0:
+                    print('  %-12s %12d %-5s %12.1f %s per item' % (command, delta, unit, delta / count, unit))
+
+    def wait_for(self, predicate):
+        start = time.time()
+        while not predicate():
+            assert time.time() - start < TIMEOUT, "Timed out waiting for propagation"
+            time.sleep(POLL_INTERVAL)
+
+    def run_test(self):
+        first, last = self.nodes[0], self.nodes[-1]
+        first.generate(101 + self.options.txs // 10)
+        sync_blocks(self.nodes)
+
+        # Transactions: submit them all at the first node, then note when
+        # each one reaches the mempool of the last node.
+        addresses = [node.getnewaddress() for node in self.nodes[1:]]
+        before = self.message_stats()
+        submitted = {}
+        start = time.time()
+        for i in range(self.options.txs):
+            txid = first.sendtoaddress(addresses[i % len(addresses)], Decimal('0.01'))
+            submitted[txid] = time.time()
+        submit_time = time.time() - start
+
+        latencies = {}
+        def all_arrived():
+            now = time.time()
+            for txid in set(last.getrawmempool()) - set(latencies):
+                if txid in submitted:
+                    latencies[txid] = now - submitted[txid]
+            return len(latencies) == len(submitted)
+        self.wait_for(all_arrived)
+        relay_time = time.time() - start
+
+        after = self.message_stats()
+        relayed = self.options.txs * (self.num_nodes - 1)
+        print('%d transactions across %d hops: submitted in %.2fs, all relayed in %.2fs' %
+              (self.options.txs, self.num_nodes - 1, submit_time, relay_time))
+        print('Transaction latency to the last node: p50 %.3fs, p90 %.3fs, max %.3fs' %
+              (percentile(latencies.values(), 0.5), percentile(latencies.values(), 0.9), max(latencies.values())))
+        self.report('Per relayed transaction:', before, after, relayed)
+        assert_equal(len(latencies), self.options.txs)
+        assert_greater_than(after['bytessent_per_msg']['tx'], before['bytessent_per_msg'].get('tx', 0))
+
+        # Blocks: mine each one at the first node, then note when the last
+        # node has it as its tip. The latency includes mining the block.
+        before = after
+        block_latencies = []
+        for i in range(self.options.blocks):
+            if i > 0:
+                for j in range(self.options.txs // self.options.blocks):
+                    first.sendtoaddress(addresses[j % len(addresses)], Decimal('0.01'))
+            start = time.time()
+            blockhash = first.generate(1)[0]
+            self.wait_for(lambda: last.getbestblockhash() == blockhash)
+            block_latencies.append(time.time() - start)
+
+        after = self.message_stats()
+        print('%d blocks across %d hops: latency p50 %.3fs, max %.3fs' %
+              (self.options.blocks, self.num_nodes - 1,
+               percentile(block_latencies, 0.5), max(block_latencies)))
+        self.report('Per relayed block:', before, after, self.options.blocks * (self.num_nodes - 1))
+        sync_blocks(self.nodes)
+
+
+if __name__ == '__main__':
+    P2PRelayBenchmark().main()
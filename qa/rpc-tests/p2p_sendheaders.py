@@ -0,0 +1,144 @@
+#!/usr/bin/env python3
+# Copyright (c) 2014-2016 The Bitcoin Core developers
+# Copyright (c) 2026 The Zcash developers
+# Distributed under the MIT software license, see the accompanying
+# file COPYING or https://www.opensource.org/licenses/mit-license.php .
+
+#
+# Test that the node asks its peers for "sendheaders" announcements, and
+# announces new blocks with "headers" to peers that asked for it and that
+# have the blocks the new ones build on, falling back to "inv" otherwise.
+#
+
+from test_framework.mininode import NodeConn, NodeConnCB, NetworkThread, \
+    msg_getheaders, msg_ping, msg_pong, msg_sendheaders, mininode_lock, \
+    SENDHEADERS_PROTO_VERSION
+from test_framework.test_framework import BitcoinTestFramework
+from test_framework.util import assert_equal, fail, p2p_port, start_nodes
+
+import time
+
+
+class TestNode(NodeConnCB):
+    def __init__(self):
+        NodeConnCB.__init__(self)
+        self.create_callback_map()
+        self.connection = None
+        self.ping_counter = 1
+        self.last_pong = msg_pong()
+        self.sendheaders_received = False
+        self.block_invs = []
+        self.headers = []
+
+    def add_connection(self, conn):
+        self.connection = conn
+
+    def wait_for_verack(self):
+        while True:
+            with mininode_lock:
+                if self.verack_received:
+                    return
+            time.sleep(0.05)
+
+    def send_message(self, message):
+        self.connection.send_message(message)
+
+    def clear_announcements(self):
+        with mininode_lock:
+            self.block_invs = []
+            self.headers = []
+
+    def on_sendheaders(self, conn, message):
+        self.sendheaders_received = True
+
+    # Announcements are recorded, not acted on.
+    def on_inv(self, conn, message):
+        self.block_invs.extend(inv.hash for inv in message.inv if inv.type == 2)
+
+    def on_headers(self, conn, message):
+        for header in message.headers:
+            header.calc_sha256()
+            self.headers.append(header.sha256)
+
+    def on_pong(self, conn, message):
+        self.last_pong = message
+
+    def sync_with_ping(self, timeout=30, waiting_for=None):
+        self.connection.send_message(msg_ping(nonce=self.ping_counter))
+        sleep_time = 0.05
+        while timeout > 0:
+            with mininode_lock:
+                ready = True if waiting_for is None else waiting_for(self)
+                if ready and self.last_pong.nonce == self.ping_counter:
+                    self.ping_counter += 1
+                    return
+            time.sleep(sleep_time)
+            timeout -= sleep_time
+        fail("Should have received pong")
+
+
+class SendHeadersTest(BitcoinTestFramework):
+
+    def __init__(self):
+        super().__init__()
+        self.num_nodes = 1
+
+    def setup_network(self):
+        self.nodes = start_nodes(self.num_nodes, self.options.tmpdir)
+        self.is_network_split = False
+
+    def run_test(self):
+        testnode = TestNode()
+        connection = NodeConn('127.0.0.1', p2p_port(0), self.nodes[0],
+                              testnode, "regtest", SENDHEADERS_PROTO_VERSION)
+        testnode.add_connection(connection)
+        NetworkThread().start()
+        testnode.wait_for_verack()
+
+        print("The node asks for headers announcements")
+        testnode.sync_with_ping(waiting_for=lambda x: x.sendheaders_received)
+
+        # Leave initial block download, during which no blocks are announced.
+        self.nodes[0].generate(1)
+        testnode.sync_with_ping(waiting_for=lambda x: len(x.block_invs) > 0)
+
+        print("Without sendheaders, new blocks are announced with inv")
+        testnode.clear_announcements()
+        tip = int(self.nodes[0].generate(1)[0], 16)
+        testnode.sync_with_ping(waiting_for=lambda x: tip in x.block_invs)
+        with mininode_lock:
+            assert_equal(testnode.headers, [])
+
+        print("With sendheaders, blocks that the peer cannot connect are announced with inv")
+        testnode.send_message(msg_sendheaders())
+        testnode.sync_with_ping()
+        testnode.clear_announcements()
+        tip = int(self.nodes[0].generate(1)[0], 16)
+        testnode.sync_with_ping(waiting_for=lambda x: tip in x.block_invs)
+        with mininode_lock:
+            assert_equal(testnode.headers, [])
+
+        print("Once the node has sent us its tip, new blocks are announced with headers")
+        getheaders = msg_getheaders()
+        getheaders.locator.vHave = [tip]
+        testnode.send_message(getheaders)
+        testnode.sync_with_ping()
+        testnode.clear_announcements()
+        for i in range(3):
+            tip = int(self.nodes[0].generate(1)[0], 16)
+            testnode.sync_with_ping(waiting_for=lambda x: len(x.headers) > 0 and x.headers[-1] == tip)
+        with mininode_lock:
+            assert_equal(len(testnode.headers), 3)
+            assert_equal(testnode.block_invs, [])
+
+        print("Several new blocks are announced in one headers message")
+        testnode.clear_announcements()
+        hashes = [int(h, 16) for h in self.nodes[0].generate(4)]
+        testnode.sync_with_ping(waiting_for=lambda x: len(x.headers) > 0 and x.headers[-1] == hashes[-1])
+        with mininode_lock:
+            assert_equal(testnode.headers, hashes)
+            assert_equal(testnode.block_invs, [])
+
+
+if __name__ == '__main__':
+    SendHeadersTest().main()
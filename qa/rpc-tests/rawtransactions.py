@@ -91,6 +91,22 @@ class RawTransactionsTest(BitcoinTestFramework):
         # We should have hex for the transaction from the getblock and getrawtransaction calls.
         blk = self.nodes[0].getblock(block1, 2)
         assert_equal(gottx['hex'], blk['tx'][1]['hex'])
+        # getblock can leave out the fields that are not asked for.
+        blk_transparent = self.nodes[0].getblock(block1, 2, ["transparent"])
+        assert_equal(blk_transparent['tx'][1]['vout'], blk['tx'][1]['vout'])
+        for field in ['hex', 'vjoinsplit', 'vShieldedSpend', 'orchard']:
+            assert field not in blk_transparent['tx'][1]
+        for field in ['chainSupply', 'valuePools', 'trees']:
+            assert field not in blk_transparent
+        blk_summary = self.nodes[0].getblock(block1, 2, ["shieldedSummary", "valuePools"])
+        assert 'vin' not in blk_summary['tx'][1]
+        assert_equal(blk_summary['tx'][1]['shieldedSummary']['saplingOutputs'], 0)
+        assert_equal(blk_summary['valuePools'], blk['valuePools'])
+        blk_txids = self.nodes[0].getblock(block1, 1, [])
+        assert_equal(blk_txids['tx'][1], tx)
+        assert 'valuePools' not in blk_txids
+        assert_raises(JSONRPCException, self.nodes[0].getblock, block1, 1, ["transparent"])
+        assert_raises(JSONRPCException, self.nodes[0].getblock, block1, 2, ["nosuchfield"])
         # We should not get the tx if we provide an unrelated block
         assert_raises(JSONRPCException, self.nodes[0].getrawtransaction, tx, 1, block2)
         # An invalid block hash should raise errors
@@ -289,6 +289,34 @@ class RESTTest (BitcoinTestFramework):
         json_obj = json.loads(response_header_json_str)
         assert_equal(len(json_obj), 5) # now we should have 5 header objects
 
+        # get a range of blocks in one response
+        bb_height = self.nodes[0].getblock(bb_hash)['height']
+        response = http_get_call(url.hostname, url.port, '/rest/blocks/'+str(bb_height)+'/2'+self.FORMAT_SEPARATOR+"bin", True)
+        assert_equal(response.status, 200)
+        response_blocks_str = response.read()
+        next_hash = self.nodes[0].getblockhash(bb_height + 1)
+        next_block_str = http_get_call(url.hostname, url.port, '/rest/block/'+next_hash+self.FORMAT_SEPARATOR+"bin", True).read()
+        assert_equal(response_blocks_str, response_str + next_block_str)
+
+        # the range is cut at the tip
+        tip_height = self.nodes[0].getblockcount()
+        response = http_get_call(url.hostname, url.port, '/rest/blocks/'+str(tip_height)+'/5'+self.FORMAT_SEPARATOR+"hex", True)
+        assert_equal(response.status, 200)
+        tip_block_str = http_get_call(url.hostname, url.port, '/rest/block/'+self.nodes[0].getbestblockhash()+self.FORMAT_SEPARATOR+"bin", True).read()
+        assert_equal(response.read().rstrip(), encode(tip_block_str, "hex_codec"))
+        response = http_get_call(url.hostname, url.port, '/rest/blocks/'+str(tip_height + 1)+'/1'+self.FORMAT_SEPARATOR+"bin", True)
+        assert_equal(response.status, 404)
+
+        # shielded compact blocks of blocks without shielded transactions
+        # hold only the height, hash, previous hash, time and an empty list
+        response = http_get_call(url.hostname, url.port, '/rest/shieldedblocks/'+str(bb_height)+'/2'+self.FORMAT_SEPARATOR+"bin", True)
+        assert_equal(response.status, 200)
+        response_str = response.read()
+        assert_equal(len(response_str), 2 * 73)
+        f = BytesIO(response_str)
+        assert_equal(struct.unpack("<I", f.read(4))[0], bb_height)
+        assert_equal(deser_uint256(f), int(bb_hash, 16))
+
         # do tx test
         tx_hash = block_json_obj['tx'][0]['txid'];
         json_string = http_get_call(url.hostname, url.port, '/rest/tx/'+tx_hash+self.FORMAT_SEPARATOR+"json")
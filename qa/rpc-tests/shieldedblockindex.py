@@ -0,0 +1,81 @@
+#!/usr/bin/env python3
+# Copyright (c) 2026 The Zcash developers
+# Distributed under the MIT software license, see the accompanying
+# file COPYING or https://www.opensource.org/licenses/mit-license.php .
+
+#
+# Test that /rest/shieldedblocks serves the same compact blocks from
+# -shieldedblockindex as a node without the index builds from disk, across a
+# reorg and a restart.
+#
+
+from test_framework.test_framework import BitcoinTestFramework
+from test_framework.util import (
+    assert_equal,
+    connect_nodes_bi,
+    start_node,
+    start_nodes,
+    stop_node,
+    sync_blocks,
+)
+
+import http.client
+import urllib.parse
+
+
+def shielded_blocks(node, start, count):
+    url = urllib.parse.urlparse(node.url)
+    conn = http.client.HTTPConnection(url.hostname, url.port)
+    conn.request('GET', '/rest/shieldedblocks/%d/%d.bin' % (start, count))
+    response = conn.getresponse()
+    assert_equal(response.status, 200)
+    return response.read()
+
+
+class ShieldedBlockIndexTest(BitcoinTestFramework):
+
+    def __init__(self):
+        super().__init__()
+        self.num_nodes = 2
+
+    def setup_network(self):
+        self.nodes = start_nodes(self.num_nodes, self.options.tmpdir, extra_args=[
+            ['-shieldedblockindex'],
+            [],
+        ])
+        connect_nodes_bi(self.nodes, 0, 1)
+        self.is_network_split = False
+
+    def check_range(self):
+        height = self.nodes[0].getblockcount()
+        assert_equal(height, self.nodes[1].getblockcount())
+        assert_equal(
+            shielded_blocks(self.nodes[0], 0, height + 1),
+            shielded_blocks(self.nodes[1], 0, height + 1))
+
+    def run_test(self):
+        # The index catches up with the cached chain in the background, and
+        # indexes new blocks as they are connected.
+        self.nodes[0].generate(5)
+        sync_blocks(self.nodes)
+        self.check_range()
+
+        # After a reorg, the blocks of the new chain are served.
+        tip = self.nodes[0].getbestblockhash()
+        self.nodes[0].invalidateblock(self.nodes[0].getblockhash(self.nodes[0].getblockcount() - 1))
+        self.nodes[0].generate(3)
+        sync_blocks(self.nodes)
+        assert(self.nodes[1].getbestblockhash() != tip)
+        self.check_range()
+
+        # The index is kept across a restart.
+        stop_node(self.nodes[0], 0)
+        self.nodes[0] = start_node(0, self.options.tmpdir, ['-shieldedblockindex'])
+        connect_nodes_bi(self.nodes, 0, 1)
+        self.nodes[1].generate(2)
+        sync_blocks(self.nodes)
+        self.check_range()
+
+
+if __name__ == '__main__':
+    ShieldedBlockIndexTest().main()
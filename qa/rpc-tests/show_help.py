@@ -44,10 +44,35 @@ Options:
        "getrawchangeaddress", "legacy_privacy", "wallettxvjoinsplit",
        "z_getbalance", "z_getnewaddress", "z_listaddresses"}
 
+  -assumevalid=<hex>
+       If this block is in the chain assume that it and its ancestors are valid
+       and potentially skip their script and proof verification (0 to verify
+       all, default: a recent block on the selected network)
+
+  -blockcompression
+       Compress blocks as they are written to the block files (default: 0)
+
+  -blockfilterindex=<type>
+       Maintain an index of compact filters by block (default: 0, values:
+       basic, shielded). If <type> is not supplied or if <type> = 1, indexes
+       for all known types are enabled.
+
+  -blockindexsnapshot
+       Save a snapshot of the block index at shutdown, and load the block index
+       from it at the next startup if it is still current (default: 1)
+
   -blocknotify=<cmd>
        Execute command when the best block changes (%s in cmd is replaced by
        block hash)
 
+  -blockprealloc=<n>
+       Pre-allocate block files in chunks of <n> MiB, and undo files in chunks
+       of a sixteenth of that (1 to 128, default: 16)
+
+  -blockreadcache=<n>
+       Keep up to <n> MiB of recently read blocks in memory (0 to disable,
+       default: 32)
+
 |  -blocksonly
 |       Whether to reject transactions from network peers. Automatic broadcast
 |       and rebroadcast of any transactions from inbound peers is disabled,
@@ -61,6 +86,10 @@ Options:
   -checklevel=<n>
        How thorough the block verification of -checkblocks is (0-4, default: 3)
 
+  -compressblockfiles
+       Compress the blocks already in the block files at startup, keeping them
+       where they are on disk (default: 0)
+
   -conf=<file>
        Specify configuration file. Relative paths will be prefixed by datadir
        location. (default: zcash.conf)
@@ -74,9 +103,24 @@ Options:
   -paramsdir=<dir>
        Specify Zcash network parameters directory
 
+  -dbasyncflush
+       Write the chainstate to disk from a background thread (default: 1)
+
+  -dbblockcachepercent=<n>
+       Percentage of each database cache used to cache reads; the rest buffers
+       writes (10 to 90, default: 50)
+
+  -dbbloombits=<n>
+       Bits per key of the bloom filters of the chain state and block index
+       databases (0 to disable, default: 10)
+
   -dbcache=<n>
        Set database cache size in megabytes (4 to 16384, default: 450)
 
+  -dbcompactafteribd
+       Compact the chain state and block index databases in the background
+       once initial block download ends (default: 1)
+
   -debuglogfile=<file>
        Specify location of debug log file. Relative paths will be prefixed by a
        net-specific datadir location. (default: debug.log)
@@ -84,6 +128,16 @@ Options:
   -exportdir=<dir>
        Specify directory to be used when exporting data
 
+  -fastheadersync
+       Check the Equihash solutions of headers up to the last checkpoint height
+       only when their blocks are downloaded, so that header sync finishes
+       sooner. Incompatible with flags that disable checkpoints. (default = 0)
+
+  -ibdproofwindow=<n>
+       Batch-validate the Sapling and Orchard proofs of up to <n> blocks ahead
+       of the tip together during initial block download (0 to disable, max:
+       256, default: 32)
+
   -ibdskiptxverification
        Skip transaction verification during initial block download up to the
        last checkpoint height. Incompatible with flags that disable
@@ -92,12 +146,55 @@ Options:
   -loadblock=<file>
        Imports blocks from external blk000??.dat file on startup
 
+  -mallocarenas=<n>
+       Limit the heap allocator to <n> arenas, which reduces fragmentation at
+       the cost of contention between threads. Not supported by jemalloc, which
+       reads MALLOC_CONF instead (0 = the allocator's default, default: 0)
+
+  -mallocpurge
+       Ask the heap allocator to return free memory to the operating system
+       after flushing the coins cache (default: 1)
+
   -maxorphantx=<n>
        Keep at most <n> unconnectable transactions in memory (default: 100)
 
+  -maxorphanmemory=<n>
+       Keep unconnectable transactions using at most <n> megabytes of memory
+       (default: 20)
+
+  -maxorphanpeermemory=<n>
+       Keep unconnectable transactions from one peer using at most <n>
+       kilobytes of memory (default: 5000)
+
+  -maxrejectmemory=<n>
+       Remember transactions that are invalid whatever the chain tip using at
+       most <n> megabytes of memory (default: 8)
+
+  -nullifierfilter
+       Keep an in-memory filter of spent nullifiers, so that most nullifier
+       lookups skip the database (default: 1)
+
+  -numanode=<n>
+       Run all threads on the CPUs of NUMA node <n>, so that the caches they
+       share are kept in the memory of that node (Linux only, default: any
+       node)
+
+  -persistmempool
+       Whether to save the mempool on shutdown and load on restart (default: 1)
+
+  -persistsigcache
+       Whether to save the signature and proof validity caches on shutdown and
+       load them on restart (default: 1)
+
   -par=<n>
-       Set the number of script verification threads (IGNORE_NONDETERMINISTIC, 0 = auto, <0 =
-       leave that many cores free, default: 0)
+       Set the number of threads verifying scripts and proofs, and scanning
+       blocks for the wallet (IGNORE_NONDETERMINISTIC, 0 = auto, <0 = leave that many cores
+       free, default: 0)
+
+  -txacceptthreads=<n>
+       Set the number of threads that check transactions received from peers,
+       at most the number of cores (0 to 16, 0 = check them while receiving,
+       default: 4)
 
   -pid=<file>
        Specify pid file. Relative paths will be prefixed by a net-specific
@@ -117,6 +214,10 @@ Options:
        Rebuild chain state and block index from the blk*.dat files on disk
        (implies -rescan)
 
+  -shieldedblockindex
+       Maintain an index of the shielded compact blocks served by
+       /rest/shieldedblocks, built in the background (default: 0)
+
   -sysperms
        Create new files with system default permissions, instead of umask 077
        (only effective with disabled wallet functionality)
@@ -125,10 +226,19 @@ Options:
        Execute command when transaction expires (%s in cmd is replaced by
        transaction id)
 
+  -txoutsetstats
+       Keep statistics of the UTXO set up to date as blocks are connected, so
+       that gettxoutsetinfo answers without reading the whole chain state
+       (default: 1)
+
   -txindex
        Maintain a full transaction index, used by the getrawtransaction rpc
        call (default: 0)
 
+  -txlocationindex
+       Maintain a compact index of the blocks holding each transaction, built
+       in the background, used by the getrawtransaction rpc call (default: 0)
+
 Connection options:
 
   -addnode=<ip>
@@ -163,6 +273,10 @@ Connection options:
   -externalip=<ip>
        Specify your own public address
 
+  -feefilter
+       Tell peers not to announce transactions below our minimum relay fee or
+       over our unpaid action limit (default: 1)
+
   -forcednsseed
        Always query for peer addresses via DNS lookup (default: 0)
 
@@ -173,6 +287,11 @@ Connection options:
   -listenonion
        Automatically create Tor hidden service (default: 1)
 
+  -maxblocksendbuffer=<n>
+       Only send blocks to peers with data already queued while the send
+       buffers of all connections hold less than <n>*1000 bytes (default:
+       64000)
+
   -maxconnections=<n>
        Maintain at most <n> connections to peers (default: 125)
 
@@ -182,14 +301,27 @@ Connection options:
   -maxsendbuffer=<n>
        Maximum per-connection send buffer, <n>*1000 bytes (default: 1000)
 
+  -maxtxmsgsperround=<n>
+       Process at most <n> transactions from peers per message handler round,
+       so that blocks are not delayed by transaction spam (0 = no limit,
+       default: 32)
+
   -mempoolevictionmemoryminutes=<n>
        The number of minutes before allowing rejected transactions to re-enter
        the mempool. (default: 60)
 
+  -mempoolfeedsize=<n>
+       Keep the last <n> transactions to enter or leave the mempool for
+       getmempoolchanges (default: 100000)
+
   -mempooltxcostlimit=<n>
        An upper bound on the maximum size in bytes of all transactions in the
        mempool. (default: 80000000)
 
+  -msghandthreads=<n>
+       Set the number of threads that process messages from peers (1 to 16,
+       default: 4)
+
   -onion=<ip:port>
        Use separate SOCKS5 proxy to reach peers via Tor hidden services
        (default: -proxy)
@@ -200,6 +332,9 @@ Connection options:
   -permitbaremultisig
        Relay non-P2SH multisig (default: 1)
 
+  -peerblockfilters
+       Serve compact block filters to peers per BIP 157 (default: 0)
+
   -peerbloomfilters
        Support filtering of blocks and transaction with bloom filters (default:
        1)
@@ -231,6 +366,10 @@ Connection options:
   -torpassword=<pass>
        Tor control port password (default: empty)
 
+  -txreconciliation
+       Announce transactions to peers that support it by set reconciliation
+       rather than inv (default: 1)
+
   -whitebind=<addr>
        Bind to given address and whitelist peers connecting to it. Use
        [host]:port notation for IPv6
@@ -255,6 +394,22 @@ Connection options:
 
 Wallet options:
 
+  -consolidation
+       Periodically merge the Sapling notes of each spending key into fewer
+       notes while the wallet is idle
+
+  -consolidationfeebudget=<amt>
+       Maximum total fee (in ZEC) paid by the transactions of one consolidation
+       run (default: 0.01)
+
+  -consolidationmaxnotes=<n>
+       Maximum number of notes spent by a consolidation transaction (default:
+       50)
+
+  -consolidationmaxtxs=<n>
+       Maximum number of transactions created by one consolidation run
+       (default: 5)
+
   -disablewallet
        Do not load the wallet and disable wallet RPC calls
 
@@ -285,6 +440,11 @@ Wallet options:
        Attempt to recover private keys from a corrupt wallet on startup
        (implies -rescan)
 
+  -scanmempoolwatchonly
+       Look for notes to watch-only Sapling viewing keys in mempool
+       transactions; if disabled, they are found once the transaction is mined
+       (default: 1)
+
   -spendzeroconfchange
        Spend unconfirmed change when sending transactions (default: 1)
 
@@ -303,6 +463,11 @@ Wallet options:
   -walletbroadcast
        Make the wallet broadcast transactions (default: 1)
 
+  -walletevicttxbodies
+       Keep the shielded data of old wallet transactions whose notes are all
+       spent only in the wallet file, and read it from there when needed
+       (default: 0)
+
   -walletnotify=<cmd>
        Execute command when a wallet transaction changes (%s in cmd is replaced
        by TxID)
@@ -336,15 +501,36 @@ ZeroMQ notification options:
   -zmqpubhashblock=<address>
        Enable publish hash block in <address>
 
+  -zmqpubhashblockhwm=<n>
+       Set publish hash block outbound message high water mark (default: 1000)
+
   -zmqpubhashtx=<address>
        Enable publish hash transaction in <address>
 
+  -zmqpubhashtxhwm=<n>
+       Set publish hash transaction outbound message high water mark (default:
+       1000)
+
   -zmqpubrawblock=<address>
        Enable publish raw block in <address>
 
+  -zmqpubrawblockhwm=<n>
+       Set publish raw block outbound message high water mark (default: 1000)
+
   -zmqpubrawtx=<address>
        Enable publish raw transaction in <address>
 
+  -zmqpubrawtxhwm=<n>
+       Set publish raw transaction outbound message high water mark (default:
+       1000)
+
+  -zmqpubsequence=<address>
+       Enable publish hash block and hash transaction sequence in <address>
+
+  -zmqpubsequencehwm=<n>
+       Set publish hash block and hash transaction sequence outbound message
+       high water mark (default: 1000)
+
 Monitoring options:
 
   -metricsallowip=<ip>
@@ -375,9 +561,17 @@ Debugging/Testing options:
 |       Do a full consistency check for mapBlockIndex, setBlockIndexCandidates,
 |       chainActive and mapBlocksUnlinked occasionally. (default: 0)
 |
+|  -checkblockreads
+|       Check the Equihash solution of each block that is read from disk, even
+|       if its header was checked when it was accepted (default: 0)
+|
 |  -checkmempool=<n>
 |       Run checks every <n> transactions (default: 0)
 |
+|  -checkmempoolsample=<n>
+|       Check <n> random mempool transactions, and those that changed, whenever
+|       the whole mempool is not checked (default: 0)
+|
 |  -checkpoints
 |       Disable expensive verification for known chain history (default: 1)
 |
@@ -426,11 +620,11 @@ Debugging/Testing options:
   -debug=<category>
        Output debugging information (default: 0, supplying <category> is
        optional). If <category> is not supplied or if <category> = 1, output
-       all debugging information. <category> can be: addrman, bench, coindb,
-       db, http, libevent, lock, mempool, mempoolrej, net, partitioncheck, pow,
-       proxy, prune, rand, receiveunsafe, reindex, rpc, selectcoins, tor,
-       valuepool, zmq, zrpc, zrpcunsafe (implies zrpc). For multiple specific
-       categories use -debug=<category> multiple times.
+       all debugging information. <category> can be: addrman, bench,
+       cmpctblock, coindb, db, http, libevent, lock, mempool, mempoolrej, net,
+       partitioncheck, pow, proxy, prune, rand, receiveunsafe, reindex, rpc,
+       selectcoins, tor, valuepool, zmq, zrpc, zrpcunsafe (implies zrpc). For
+       multiple specific categories use -debug=<category> multiple times.
 
   -experimentalfeatures
        Enable use of experimental features
@@ -447,6 +641,10 @@ Debugging/Testing options:
   -logtimestamps
        Prepend debug output with timestamp (default: 1)
 
+  -logratelimit=<n>
+       Log at most <n> debugging messages per second from each place that logs
+       them, and log how many were dropped (0 = no limit, default: 0)
+
 |  -clockoffset=<n>
 |       Applies offset of <n> seconds to the actual time. Incompatible with
 |       -mocktime (default: 0)
@@ -527,6 +725,10 @@ Mining options:
   -equihashsolver=<name>
        Specify the Equihash solver to be used if enabled (default: "default")
 
+  -equihashsolverthreads=<n>
+       Set the number of threads that the "tromp" Equihash solver of each coin
+       generation thread uses (default: 1)
+
   -mineraddress=<addr>
        Send mined coins to a specific single address
 
@@ -576,12 +778,25 @@ RPC server options:
   -rpcthreads=<n>
        Set the number of threads to service RPC calls (default: 4)
 
+  -rpcmaxthreads=<n>
+       Set the maximum number of threads to service RPC calls. Threads beyond
+       -rpcthreads are started when all of them are busy (default: 16)
+
+  -rpcmethodlimit=<method>:<n>
+       Allow at most <n> calls of an RPC method, or of the methods in a
+       category such as wallet, to run at once. Other calls fail until one
+       finishes. This option can be specified multiple times
+
 |  -rpcworkqueue=<n>
 |       Set the depth of the work queue to service RPC calls (default: 16)
 |
 |  -rpcservertimeout=<n>
 |       Timeout during HTTP requests (default: 30)
 |
+  -rpcasyncthreads=<n>
+       Set the number of threads to service Async RPC calls, such as z_sendmany
+       (1 to 8, 0 = one for every 4 cores, default: 0)
+
 Metrics Options (only if -daemon and -printtoconsole are not set):
 
   -showmetrics
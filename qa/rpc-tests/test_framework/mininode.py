@@ -54,6 +54,10 @@ OVERWINTER_PROTO_VERSION = 170003
 SAPLING_PROTO_VERSION = 170006
 BLOSSOM_PROTO_VERSION = 170008
 NU5_PROTO_VERSION = 170050
+FEEFILTER_PROTO_VERSION = 170150
+SHORT_IDS_BLOCKS_PROTO_VERSION = 170160
+SENDHEADERS_PROTO_VERSION = 170170
+TXRECONCILIATION_PROTO_VERSION = 170180
 # NU6_PROTO_VERSION = 170110
 
 MY_SUBVERSION = b"/python-mininode-tester:0.0.3/"
@@ -355,6 +359,7 @@ class CInv(object):
         0: b"Error",
         1: b"TX",
         2: b"Block",
+        4: b"CompactBlock",
         5: b"WTX",
     }
 
@@ -1760,6 +1765,200 @@ class msg_filterclear(object):
         return "msg_filterclear()"
 
 
+class msg_feefilter(object):
+    command = b"feefilter"
+
+    def __init__(self, feerate=0, unpaid_action_limit=0):
+        self.feerate = feerate
+        self.unpaid_action_limit = unpaid_action_limit
+
+    def deserialize(self, f):
+        self.feerate = struct.unpack("<q", f.read(8))[0]
+        self.unpaid_action_limit = struct.unpack("<q", f.read(8))[0]
+
+    def serialize(self):
+        r = b""
+        r += struct.pack("<q", self.feerate)
+        r += struct.pack("<q", self.unpaid_action_limit)
+        return r
+
+    def __repr__(self):
+        return "msg_feefilter(feerate=%d, unpaid_action_limit=%d)" % (
+            self.feerate, self.unpaid_action_limit)
+
+
+class msg_sendheaders(object):
+    command = b"sendheaders"
+
+    def __init__(self):
+        pass
+
+    def deserialize(self, f):
+        pass
+
+    def serialize(self):
+        return b""
+
+    def __repr__(self):
+        return "msg_sendheaders()"
+
+
+class msg_sendcmpct(object):
+    command = b"sendcmpct"
+
+    def __init__(self, announce=False, version=1):
+        self.announce = announce
+        self.version = version
+
+    def deserialize(self, f):
+        self.announce = struct.unpack("<?", f.read(1))[0]
+        self.version = struct.unpack("<Q", f.read(8))[0]
+
+    def serialize(self):
+        r = b""
+        r += struct.pack("<?", self.announce)
+        r += struct.pack("<Q", self.version)
+        return r
+
+    def __repr__(self):
+        return "msg_sendcmpct(announce=%s, version=%d)" % (self.announce, self.version)
+
+
+def deser_compact_size(f):
+    nit = struct.unpack("<B", f.read(1))[0]
+    if nit == 253:
+        nit = struct.unpack("<H", f.read(2))[0]
+    elif nit == 254:
+        nit = struct.unpack("<I", f.read(4))[0]
+    elif nit == 255:
+        nit = struct.unpack("<Q", f.read(8))[0]
+    return nit
+
+
+class PrefilledTransaction(object):
+    def __init__(self, index=0, tx=None):
+        self.index = index
+        self.tx = tx
+
+    def deserialize(self, f):
+        self.index = deser_compact_size(f)
+        self.tx = CTransaction()
+        self.tx.deserialize(f)
+
+    def serialize(self):
+        r = b""
+        r += ser_compact_size(self.index)
+        r += self.tx.serialize()
+        return r
+
+    def __repr__(self):
+        return "PrefilledTransaction(index=%d, tx=%r)" % (self.index, self.tx)
+
+
+# The short IDs of a cmpctblock are 6-byte SipHash digests of the wtxid; they
+# are kept here as integers read from the wire.
+class HeaderAndShortIDs(object):
+    def __init__(self):
+        self.header = CBlockHeader()
+        self.nonce = 0
+        self.shortids = []
+        self.prefilled_txn = []
+
+    def deserialize(self, f):
+        self.header.deserialize(f)
+        self.nonce = struct.unpack("<Q", f.read(8))[0]
+        shortids_length = deser_compact_size(f)
+        for i in range(shortids_length):
+            # shortids are defined to be 6 bytes in the spec, so append
+            # two zero bytes and read it in as an 8-byte number
+            self.shortids.append(struct.unpack("<Q", f.read(6) + b'\x00\x00')[0])
+        self.prefilled_txn = deser_vector(f, PrefilledTransaction)
+
+    def serialize(self):
+        r = b""
+        r += self.header.serialize()
+        r += struct.pack("<Q", self.nonce)
+        r += ser_compact_size(len(self.shortids))
+        for x in self.shortids:
+            # We only want the first 6 bytes
+            r += struct.pack("<Q", x)[0:6]
+        r += ser_vector(self.prefilled_txn)
+        return r
+
+    def __repr__(self):
+        return "HeaderAndShortIDs(header=%r, nonce=%d, shortids=%r, prefilled_txn=%r)" % (
+            self.header, self.nonce, self.shortids, self.prefilled_txn)
+
+
+class msg_cmpctblock(object):
+    command = b"cmpctblock"
+
+    def __init__(self, header_and_shortids=None):
+        self.header_and_shortids = header_and_shortids
+
+    def deserialize(self, f):
+        self.header_and_shortids = HeaderAndShortIDs()
+        self.header_and_shortids.deserialize(f)
+
+    def serialize(self):
+        return self.header_and_shortids.serialize()
+
+    def __repr__(self):
+        return "msg_cmpctblock(header_and_shortids=%r)" % self.header_and_shortids
+
+
+# The indexes of a getblocktxn are differentially encoded on the wire, and
+# kept here as absolute indexes.
+class msg_getblocktxn(object):
+    command = b"getblocktxn"
+
+    def __init__(self, blockhash=0, indexes=None):
+        self.blockhash = blockhash
+        self.indexes = indexes if indexes is not None else []
+
+    def deserialize(self, f):
+        self.blockhash = deser_uint256(f)
+        self.indexes = []
+        last_index = -1
+        for i in range(deser_compact_size(f)):
+            last_index += deser_compact_size(f) + 1
+            self.indexes.append(last_index)
+
+    def serialize(self):
+        r = b""
+        r += ser_uint256(self.blockhash)
+        r += ser_compact_size(len(self.indexes))
+        last_index = -1
+        for x in self.indexes:
+            r += ser_compact_size(x - last_index - 1)
+            last_index = x
+        return r
+
+    def __repr__(self):
+        return "msg_getblocktxn(blockhash=%064x, indexes=%r)" % (self.blockhash, self.indexes)
+
+
+class msg_blocktxn(object):
+    command = b"blocktxn"
+
+    def __init__(self, blockhash=0, transactions=None):
+        self.blockhash = blockhash
+        self.transactions = transactions if transactions is not None else []
+
+    def deserialize(self, f):
+        self.blockhash = deser_uint256(f)
+        self.transactions = deser_vector(f, CTransaction)
+
+    def serialize(self):
+        r = b""
+        r += ser_uint256(self.blockhash)
+        r += ser_vector(self.transactions)
+        return r
+
+    def __repr__(self):
+        return "msg_blocktxn(blockhash=%064x, transactions=%r)" % (self.blockhash, self.transactions)
+
+
 # This is what a callback should look like for NodeConn
 # Reimplement the on_* functions to provide handling for events
 class NodeConnCB(object):
@@ -1785,7 +1984,13 @@ class NodeConnCB(object):
             b"headers": self.on_headers,
             b"getheaders": self.on_getheaders,
             b"reject": self.on_reject,
-            b"mempool": self.on_mempool
+            b"mempool": self.on_mempool,
+            b"feefilter": self.on_feefilter,
+            b"sendheaders": self.on_sendheaders,
+            b"sendcmpct": self.on_sendcmpct,
+            b"cmpctblock": self.on_cmpctblock,
+            b"getblocktxn": self.on_getblocktxn,
+            b"blocktxn": self.on_blocktxn
         }
 
     def deliver(self, conn, message):
@@ -1831,6 +2036,12 @@ class NodeConnCB(object):
     def on_close(self, conn): pass
     def on_mempool(self, conn): pass
     def on_pong(self, conn, message): pass
+    def on_feefilter(self, conn, message): pass
+    def on_sendheaders(self, conn, message): pass
+    def on_sendcmpct(self, conn, message): pass
+    def on_cmpctblock(self, conn, message): pass
+    def on_getblocktxn(self, conn, message): pass
+    def on_blocktxn(self, conn, message): pass
 
 
 # The actual NodeConn class
@@ -1852,7 +2063,13 @@ class NodeConn(asyncore.dispatcher):
         b"headers": msg_headers,
         b"getheaders": msg_getheaders,
         b"reject": msg_reject,
-        b"mempool": msg_mempool
+        b"mempool": msg_mempool,
+        b"feefilter": msg_feefilter,
+        b"sendheaders": msg_sendheaders,
+        b"sendcmpct": msg_sendcmpct,
+        b"cmpctblock": msg_cmpctblock,
+        b"getblocktxn": msg_getblocktxn,
+        b"blocktxn": msg_blocktxn
     }
     MAGIC_BYTES = {
         "mainnet": b"\x24\xe9\x27\x64",   # mainnet
@@ -87,6 +87,20 @@ class TimestampIndexTest(BitcoinTestFramework):
                 firsttime+10+1, firsttime,
                 {'logicalTimes': True, 'noOrphans': True}))
 
+        # the hashes can be read a page at a time, from the index or, for
+        # the main chain only, from the block index
+        for no_orphans in [False, True]:
+            pages = []
+            options = {'limit': 3, 'noOrphans': no_orphans}
+            while True:
+                page = self.nodes[1].getblockhashes(firsttime+10+1, firsttime, options)
+                pages.extend(page['blockhashes'])
+                if 'cursor' not in page:
+                    break
+                assert_equal(len(page['blockhashes']), 3)
+                options['cursor'] = page['cursor']
+            assert_equal(blockhashes, pages)
+
 
 if __name__ == '__main__':
     TimestampIndexTest().main()
@@ -0,0 +1,98 @@
+#!/usr/bin/env python3
+# Copyright (c) 2026 The Zcash developers
+# Distributed under the MIT software license, see the accompanying
+# file COPYING or https://www.opensource.org/licenses/mit-license.php .
+
+#
+# Test that getrawtransaction finds blockchain transactions with
+# -txlocationindex, one at a time or several at once, across a reorg and a
+# restart.
+#
+
+from test_framework.authproxy import JSONRPCException
+from test_framework.test_framework import BitcoinTestFramework
+from test_framework.util import (
+    assert_equal,
+    assert_raises_message,
+    start_node,
+    stop_node,
+)
+from test_framework.comptool import wait_until
+
+
+class TxLocationIndexTest(BitcoinTestFramework):
+
+    def __init__(self):
+        super().__init__()
+        self.num_nodes = 1
+
+    def node_args(self):
+        return [
+            '-txlocationindex',
+            '-allowdeprecated=getnewaddress',
+        ]
+
+    def setup_network(self):
+        self.nodes = [start_node(0, self.options.tmpdir, self.node_args())]
+        self.is_network_split = False
+
+    def found(self, txid):
+        try:
+            self.nodes[0].getrawtransaction(txid)
+            return True
+        except JSONRPCException:
+            return False
+
+    def run_test(self):
+        node = self.nodes[0]
+        unknown = '00' * 32
+
+        address = node.getnewaddress()
+        txid = node.sendtoaddress(address, 1)
+        coinbase_txid = node.getrawtransaction(txid, 1)['vin'][0]['txid']
+        node.generate(1)
+        blockhash = node.getbestblockhash()
+
+        # The index catches up with the cached chain in the background.
+        assert wait_until(lambda: self.found(coinbase_txid), timeout=30)
+        tx = node.getrawtransaction(txid, 1)
+        assert_equal(tx['txid'], txid)
+        assert_equal(tx['blockhash'], blockhash)
+
+        # Several transactions at once, from the mempool and the chain.
+        mempool_txid = node.sendtoaddress(address, 1)
+        results = node.getrawtransaction([txid, unknown, mempool_txid, coinbase_txid], 1)
+        assert_equal(len(results), 4)
+        assert_equal(results[0]['txid'], txid)
+        assert_equal(results[0]['blockhash'], blockhash)
+        assert_equal(results[1], None)
+        assert_equal(results[2]['txid'], mempool_txid)
+        assert('blockhash' not in results[2])
+        assert_equal(results[3]['txid'], coinbase_txid)
+        assert_equal(node.getrawtransaction([txid]), [tx['hex']])
+
+        assert_raises_message(JSONRPCException, "A blockhash cannot be given",
+            node.getrawtransaction, [txid], 1, blockhash)
+
+        # After a reorg, the transaction is back in the mempool, and then in
+        # a block at the same height.
+        node.invalidateblock(blockhash)
+        assert('blockhash' not in node.getrawtransaction(txid, 1))
+        node.generate(1)
+        new_blockhash = node.getbestblockhash()
+        assert(new_blockhash != blockhash)
+        assert_equal(node.getrawtransaction(txid, 1)['blockhash'], new_blockhash)
+        assert_equal(node.getrawtransaction([mempool_txid], 1)[0]['blockhash'], new_blockhash)
+
+        # The index is kept across a restart.
+        stop_node(node, 0)
+        self.nodes[0] = node = start_node(0, self.options.tmpdir, self.node_args())
+        assert wait_until(lambda: self.found(coinbase_txid), timeout=30)
+        results = node.getrawtransaction([coinbase_txid, txid, unknown], 1)
+        assert_equal(results[0]['txid'], coinbase_txid)
+        assert_equal(results[1]['blockhash'], new_blockhash)
+        assert_equal(results[2], None)
+
+
+if __name__ == '__main__':
+    TxLocationIndexTest().main()
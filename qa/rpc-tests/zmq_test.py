@@ -21,6 +21,7 @@ class ZMQTest(BitcoinTestFramework):
         self.num_nodes = 4
 
     port = 28332
+    sequencePort = 28333
 
     def setup_nodes(self):
         self.zmqContext = zmq.Context()
@@ -28,10 +29,15 @@ class ZMQTest(BitcoinTestFramework):
         self.zmqSubSocket.setsockopt(zmq.SUBSCRIBE, b"hashblock")
         self.zmqSubSocket.setsockopt(zmq.SUBSCRIBE, b"hashtx")
         self.zmqSubSocket.connect("tcp://127.0.0.1:%i" % self.port)
+        self.zmqSequenceSocket = self.zmqContext.socket(zmq.SUB)
+        self.zmqSequenceSocket.setsockopt(zmq.SUBSCRIBE, b"sequence")
+        self.zmqSequenceSocket.connect("tcp://127.0.0.1:%i" % self.sequencePort)
         return start_nodes(self.num_nodes, self.options.tmpdir, extra_args=[
             [
                 '-zmqpubhashtx=tcp://127.0.0.1:'+str(self.port),
                 '-zmqpubhashblock=tcp://127.0.0.1:'+str(self.port),
+                '-zmqpubsequence=tcp://127.0.0.1:'+str(self.sequencePort),
+                '-zmqpubsequencehwm=100',
                 '-allowdeprecated=getnewaddress',
             ],
             [],
@@ -99,6 +105,53 @@ class ZMQTest(BitcoinTestFramework):
 
         assert_equal(hashRPC, hashZMQ) #blockhash from generate must be equal to the hash received over zmq
 
+        self.test_sequence(genhashes, hashRPC)
+
+    def recv_sequence(self):
+        msg = self.zmqSequenceSocket.recv_multipart()
+        assert_equal(msg[0], b"sequence")
+        body = msg[1]
+        hash = bytes_to_hex_str(body[:32])
+        label = chr(body[32])
+        mempoolSequence = None
+        reason = None
+        if label in "AR":
+            mempoolSequence = struct.unpack('<Q', body[33:41])[0]
+            reason = body[41:].decode()
+        else:
+            assert_equal(len(body), 33)
+        msgSequence = struct.unpack('<I', msg[-1])[-1]
+        return (hash, label, mempoolSequence, reason, msgSequence)
+
+    def test_sequence(self, genhashes, hashRPC):
+        # Node 0 connected the block it mined and then those of node 1.
+        (hash, label, mempoolSequence, reason, msgSequence) = self.recv_sequence()
+        assert_equal(label, "C")
+        assert_equal(msgSequence, 0)
+        for x in range(0, len(genhashes)):
+            (hash, label, mempoolSequence, reason, msgSequence) = self.recv_sequence()
+            assert_equal((hash, label, msgSequence), (genhashes[x], "C", x + 1))
+
+        # The transaction from node 1 entered the mempool.
+        nextMsgSequence = len(genhashes) + 1
+        assert_equal(self.recv_sequence(), (hashRPC, "A", 1, "", nextMsgSequence))
+        assert_equal(self.nodes[0].getrawmempool(False, True), {"txids": [hashRPC], "mempool_sequence": 1})
+
+        # Mining it removes it from the mempool before the block is connected.
+        blockhash = self.nodes[0].generate(1)[0]
+        self.sync_all()
+        assert_equal(self.recv_sequence(), (hashRPC, "R", 2, "block", nextMsgSequence + 1))
+        assert_equal(self.recv_sequence(), (blockhash, "C", None, None, nextMsgSequence + 2))
+        assert_equal(self.nodes[0].getrawmempool(False, True), {"txids": [], "mempool_sequence": 2})
+
+        # Invalidating the block disconnects it and returns the transaction
+        # to the mempool.
+        self.nodes[0].invalidateblock(blockhash)
+        assert_equal(self.recv_sequence(), (blockhash, "D", None, None, nextMsgSequence + 3))
+        assert_equal(self.recv_sequence(), (hashRPC, "A", 3, "", nextMsgSequence + 4))
+        assert_equal(self.nodes[0].getrawmempool(False, True), {"txids": [hashRPC], "mempool_sequence": 3})
+        self.nodes[0].reconsiderblock(blockhash)
+
 
 if __name__ == '__main__':
     ZMQTest ().main ()
@@ -0,0 +1,137 @@
+#!/usr/bin/env python3
+# Copyright (c) 2026 The Zcash developers
+# Distributed under the MIT software license, see the accompanying
+# file COPYING or https://www.opensource.org/licenses/mit-license.php .
+
+#
+# Create a wallet with a long transaction history, many Sapling notes and
+# many imported viewing keys, for the wallet benchmarks in
+# qa/zcash/performance-measurements.sh.
+#
+# The wallet of node 1 receives --txs transparent transactions and --notes
+# Sapling notes in account 0, and imports --viewingkeys Sapling viewing keys.
+# The defaults are the scale the benchmarks are specified at; smaller values
+# make a quicker baseline.
+#
+# To use:
+# - Copy to qa/rpc-tests/wallet_scale.py
+# - cd qa/rpc-tests
+# - ./wallet_scale.py --nocleanup --tmpdir=/tmp/benchmark-wallet-scale
+# - tar cJf benchmark-wallet-scale.tar.xz -C /tmp benchmark-wallet-scale
+# - Place the archive in the base directory of the repository
+#
+
+from test_framework.test_framework import BitcoinTestFramework
+from test_framework.util import (
+    BLOSSOM_BRANCH_ID,
+    CANOPY_BRANCH_ID,
+    HEARTWOOD_BRANCH_ID,
+    NU5_BRANCH_ID,
+    OVERWINTER_BRANCH_ID,
+    SAPLING_BRANCH_ID,
+    assert_equal,
+    connect_nodes_bi,
+    initialize_chain_clean,
+    nuparams,
+    start_nodes,
+    wait_and_assert_operationid_status,
+)
+
+from decimal import Decimal
+import os
+
+# Sapling outputs per z_sendmany, each to a different diversified address.
+NOTES_PER_TX = 50
+TX_AMOUNT = Decimal("0.0001")
+NOTE_AMOUNT = Decimal("0.0001")
+
+NODE_ARGS = [
+    nuparams(OVERWINTER_BRANCH_ID, 1),
+    nuparams(SAPLING_BRANCH_ID, 1),
+    nuparams(BLOSSOM_BRANCH_ID, 1),
+    nuparams(HEARTWOOD_BRANCH_ID, 1),
+    nuparams(CANOPY_BRANCH_ID, 1),
+    nuparams(NU5_BRANCH_ID, 1),
+    '-allowdeprecated=getnewaddress',
+    '-allowdeprecated=z_getnewaddress',
+]
+
+
+class WalletScaleTest(BitcoinTestFramework):
+
+    def add_options(self, parser):
+        parser.add_option("--txs", dest="txs", default=1000000, type='int',
+                          help="Transparent transactions received by the wallet (default: %default)")
+        parser.add_option("--notes", dest="notes", default=100000, type='int',
+                          help="Sapling notes received by the wallet (default: %default)")
+        parser.add_option("--viewingkeys", dest="viewingkeys", default=10000, type='int',
+                          help="Sapling viewing keys imported into the wallet (default: %default)")
+
+    def setup_chain(self):
+        print("Initializing test directory "+self.options.tmpdir)
+        initialize_chain_clean(self.options.tmpdir, 2)
+
+    def setup_network(self):
+        self.nodes = start_nodes(2, self.options.tmpdir, extra_args=[NODE_ARGS] * 2)
+        connect_nodes_bi(self.nodes, 0, 1)
+        self.is_network_split = False
+        self.sync_all()
+
+    def run_test(self):
+        self.nodes[0].generate(400)
+        self.sync_all()
+
+        print('Importing %d viewing keys' % self.options.viewingkeys)
+        for i in range(self.options.viewingkeys):
+            zaddr = self.nodes[0].z_getnewaddress('sapling')
+            vkey = self.nodes[0].z_exportviewingkey(zaddr)
+            self.nodes[1].z_importviewingkey(vkey, 'no')
+
+        print('Sending %d transactions' % self.options.txs)
+        for i in range(self.options.txs):
+            taddr = self.nodes[1].getnewaddress()
+            self.nodes[0].sendtoaddress(taddr, TX_AMOUNT)
+            if i % 1000 == 999:
+                self.nodes[0].generate(1)
+                self.sync_all()
+
+        self.nodes[0].generate(1)
+        self.sync_all()
+
+        print('Sending %d Sapling notes' % self.options.notes)
+        account = self.nodes[1].z_getnewaccount()['account']
+        assert_equal(account, 0)
+        recipients = [
+            self.nodes[1].z_getaddressforaccount(account, ['sapling'])['address']
+            for i in range(min(NOTES_PER_TX, self.options.notes))
+        ]
+        zaddr = self.nodes[0].z_getnewaddress('sapling')
+        opid = self.nodes[0].z_shieldcoinbase('*', zaddr, None, 10)['opid']
+        wait_and_assert_operationid_status(self.nodes[0], opid)
+        self.nodes[0].generate(1)
+
+        remaining = self.options.notes
+        while remaining > 0:
+            outputs = [{'address': addr, 'amount': NOTE_AMOUNT} for addr in recipients[:remaining]]
+            opid = self.nodes[0].z_sendmany(zaddr, outputs, 1)
+            wait_and_assert_operationid_status(self.nodes[0], opid, timeout=3600)
+            # The change note must be mined before it can be spent.
+            self.nodes[0].generate(1)
+            remaining -= len(outputs)
+
+        self.sync_all()
+        print('Node 1: %d transactions, %d UTXOs, %d Sapling notes' %
+              (len(self.nodes[1].listtransactions("*", 9999999)),
+               len(self.nodes[1].listunspent()),
+               len(self.nodes[1].z_listunspent(1, 9999999))))
+
+        # Let zcashd start from the archived data directories with the same
+        # network upgrades.
+        for i in range(2):
+            with open(os.path.join(self.options.tmpdir, 'node%d' % i, 'zcash.conf'), 'a') as f:
+                for arg in NODE_ARGS:
+                    f.write(arg.lstrip('-') + '\n')
+
+
+if __name__ == '__main__':
+    WalletScaleTest().main()
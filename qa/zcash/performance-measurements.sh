@@ -56,6 +56,23 @@ function use_200k_benchmark {
     DATADIR="./benchmark-200k-UTXOs/node$1"
 }
 
+function use_wallet_scale_benchmark {
+    # Generated locally by qa/zcash/create_wallet_scale.py, so the archive
+    # has no fixed hash.
+    if [ ! -f benchmark-wallet-scale.tar.xz ]; then
+        echo "benchmark-wallet-scale.tar.xz not found."
+        echo
+        echo "Please generate it using qa/zcash/create_wallet_scale.py"
+        echo "and place it in the base directory of the repository."
+        echo "Usage details are inside the Python script."
+        exit 1
+    fi
+    rm -rf benchmark-wallet-scale
+    mkdir benchmark-wallet-scale
+    xzcat benchmark-wallet-scale.tar.xz | tar x -C benchmark-wallet-scale --strip-components=1
+    DATADIR="./benchmark-wallet-scale/node1"
+}
+
 function zcashd_start {
     case "$1" in
         sendtoaddress|loadwallet|listunspent)
@@ -66,11 +83,25 @@ function zcashd_start {
                 200k-send)
                     use_200k_benchmark 1
                     ;;
+                scale)
+                    use_wallet_scale_benchmark
+                    ;;
                 *)
                     echo "Bad arguments to zcashd_start."
                     exit 1
             esac
             ;;
+        getbalance|zlistunspent|selectnotes|rescan|walletwitnesses)
+            use_wallet_scale_benchmark
+            ;;
+        acceptmempool)
+            rm -rf "$DATADIR"
+            mkdir -p "$DATADIR/regtest"
+            # The transaction mixes need Sapling and NU5 to be active.
+            for branch in 5ba81b19 76b809bb 2bb40e60 f5b9230b e9ff75a6 c2d6d0b4; do
+                echo "nuparams=$branch:1" >> "$DATADIR/zcash.conf"
+            done
+            ;;
         *)
             rm -rf "$DATADIR"
             mkdir -p "$DATADIR/regtest"
@@ -99,11 +130,18 @@ function zcashd_heaptrack_start {
                     use_200k_benchmark 1
                     TEST_NAME="${TEST_NAME}-200k-send"
                     ;;
+                scale)
+                    use_wallet_scale_benchmark
+                    TEST_NAME="${TEST_NAME}-scale"
+                    ;;
                 *)
                     echo "Bad arguments to zcashd_heaptrack_start."
                     exit 1
             esac
             ;;
+        getbalance|zlistunspent|selectnotes|rescan|walletwitnesses)
+            use_wallet_scale_benchmark
+            ;;
         *)
             rm -rf "$DATADIR"
             mkdir -p "$DATADIR/regtest"
@@ -227,6 +265,12 @@ case "$1" in
             trydecryptnotes)
                 zcash_rpc zcbenchmark trydecryptnotes 1000 "${@:3}"
                 ;;
+            trydecryptsaplingnotes)
+                zcash_rpc zcbenchmark trydecryptsaplingnotes 10 "${@:3}"
+                ;;
+            batchscansaplingnotes)
+                zcash_rpc zcbenchmark batchscansaplingnotes 10 "${@:3}"
+                ;;
             incnotewitnesses)
                 zcash_rpc zcbenchmark incnotewitnesses 100 "${@:3}"
                 ;;
@@ -251,6 +295,24 @@ case "$1" in
             listunspent)
                 zcash_rpc zcbenchmark listunspent 10
                 ;;
+            acceptmempool)
+                zcash_rpc_slow zcbenchmark acceptmempool 10 "${@:3}"
+                ;;
+            getbalance)
+                zcash_rpc zcbenchmark getbalance 10 "${@:3}"
+                ;;
+            zlistunspent)
+                zcash_rpc zcbenchmark zlistunspent 10
+                ;;
+            selectnotes)
+                zcash_rpc zcbenchmark selectnotes 10 "${@:3}"
+                ;;
+            rescan)
+                zcash_rpc_slow zcbenchmark rescan 3
+                ;;
+            walletwitnesses)
+                zcash_rpc zcbenchmark walletwitnesses 10
+                ;;
             *)
                 zcashd_stop
                 echo "Bad arguments to time."
@@ -297,6 +359,12 @@ case "$1" in
             trydecryptnotes)
                 zcash_rpc zcbenchmark trydecryptnotes 1 "${@:3}"
                 ;;
+            trydecryptsaplingnotes)
+                zcash_rpc zcbenchmark trydecryptsaplingnotes 1 "${@:3}"
+                ;;
+            batchscansaplingnotes)
+                zcash_rpc zcbenchmark batchscansaplingnotes 1 "${@:3}"
+                ;;
             incnotewitnesses)
                 zcash_rpc zcbenchmark incnotewitnesses 1 "${@:3}"
                 ;;
@@ -321,6 +389,21 @@ case "$1" in
             listunspent)
                 zcash_rpc zcbenchmark listunspent 1
                 ;;
+            getbalance)
+                zcash_rpc zcbenchmark getbalance 1 "${@:3}"
+                ;;
+            zlistunspent)
+                zcash_rpc zcbenchmark zlistunspent 1
+                ;;
+            selectnotes)
+                zcash_rpc zcbenchmark selectnotes 1 "${@:3}"
+                ;;
+            rescan)
+                zcash_rpc_slow zcbenchmark rescan 1
+                ;;
+            walletwitnesses)
+                zcash_rpc zcbenchmark walletwitnesses 1
+                ;;
             *)
                 zcashd_heaptrack_stop
                 echo "Bad arguments to memory."
@@ -364,6 +447,12 @@ case "$1" in
             trydecryptnotes)
                 zcash_rpc zcbenchmark trydecryptnotes 1 "${@:3}"
                 ;;
+            trydecryptsaplingnotes)
+                zcash_rpc zcbenchmark trydecryptsaplingnotes 1 "${@:3}"
+                ;;
+            batchscansaplingnotes)
+                zcash_rpc zcbenchmark batchscansaplingnotes 1 "${@:3}"
+                ;;
             incnotewitnesses)
                 zcash_rpc zcbenchmark incnotewitnesses 1 "${@:3}"
                 ;;
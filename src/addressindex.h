@@ -223,6 +223,43 @@ struct CAddressIndexIteratorHeightKey {
     }
 };
 
+/**
+ * Totals of the address index entries of one address, kept up to date as
+ * blocks are connected and disconnected, so that its balance can be looked up
+ * without reading all of its entries.
+ */
+struct CAddressSummary {
+    //! Sum of all deltas
+    CAmount balance;
+    //! Sum of the positive deltas
+    CAmount received;
+    //! Number of transactions with at least one delta
+    uint64_t txCount;
+
+    ADD_SERIALIZE_METHODS;
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream& s, Operation ser_action) {
+        READWRITE(balance);
+        READWRITE(received);
+        READWRITE(VARINT(txCount));
+    }
+
+    CAddressSummary() {
+        SetNull();
+    }
+
+    void SetNull() {
+        balance = 0;
+        received = 0;
+        txCount = 0;
+    }
+
+    bool IsNull() const {
+        return txCount == 0;
+    }
+};
+
 struct CMempoolAddressDelta
 {
     int64_t time;
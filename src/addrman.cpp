@@ -8,6 +8,19 @@
 #include "serialize.h"
 #include "streams.h"
 
+#include <limits>
+
+SaltedNetAddrHasher::SaltedNetAddrHasher() : k0(GetRand(std::numeric_limits<uint64_t>::max())), k1(GetRand(std::numeric_limits<uint64_t>::max())) {}
+
+size_t SaltedNetAddrHasher::operator()(const CNetAddr& addr) const
+{
+    unsigned char vch[16];
+    for (int i = 0; i < 16; i++) {
+        vch[i] = addr.GetByte(15 - i);
+    }
+    return CSipHasher(k0, k1).Write(vch, sizeof(vch)).Finalize();
+}
+
 int CAddrInfo::GetTriedBucket(const uint256& nKey) const
 {
     uint64_t hash1 = (CHashWriter(SER_GETHASH, 0) << nKey << GetKey()).GetHash().GetCheapHash();
@@ -71,14 +84,44 @@ double CAddrInfo::GetChance(int64_t nNow) const
     return fChance;
 }
 
+void CAddrMan::UpdateSlots(std::vector<int>& vSlots, std::vector<int>& vSlotPos, int nSlot, bool fOccupied)
+{
+    if (fOccupied == (vSlotPos[nSlot] != -1))
+        return;
+
+    if (fOccupied) {
+        vSlotPos[nSlot] = vSlots.size();
+        vSlots.push_back(nSlot);
+    } else {
+        // move the last position into the freed place
+        int nPos = vSlotPos[nSlot];
+        vSlots[nPos] = vSlots.back();
+        vSlotPos[vSlots[nPos]] = nPos;
+        vSlots.pop_back();
+        vSlotPos[nSlot] = -1;
+    }
+}
+
+void CAddrMan::SetTried(int nKBucket, int nKBucketPos, int nId)
+{
+    vvTried[nKBucket][nKBucketPos] = nId;
+    UpdateSlots(vTriedSlots, vTriedSlotPos, nKBucket * ADDRMAN_BUCKET_SIZE + nKBucketPos, nId != -1);
+}
+
+void CAddrMan::SetNew(int nUBucket, int nUBucketPos, int nId)
+{
+    vvNew[nUBucket][nUBucketPos] = nId;
+    UpdateSlots(vNewSlots, vNewSlotPos, nUBucket * ADDRMAN_BUCKET_SIZE + nUBucketPos, nId != -1);
+}
+
 CAddrInfo* CAddrMan::Find(const CNetAddr& addr, int* pnId)
 {
-    std::map<CNetAddr, int>::iterator it = mapAddr.find(addr);
+    std::unordered_map<CNetAddr, int, SaltedNetAddrHasher>::iterator it = mapAddr.find(addr);
     if (it == mapAddr.end())
         return NULL;
     if (pnId)
         *pnId = (*it).second;
-    std::map<int, CAddrInfo>::iterator it2 = mapInfo.find((*it).second);
+    std::unordered_map<int, CAddrInfo>::iterator it2 = mapInfo.find((*it).second);
     if (it2 != mapInfo.end())
         return &(*it2).second;
     return NULL;
@@ -138,7 +181,7 @@ void CAddrMan::ClearNew(int nUBucket, int nUBucketPos)
         CAddrInfo& infoDelete = mapInfo[nIdDelete];
         assert(infoDelete.nRefCount > 0);
         infoDelete.nRefCount--;
-        vvNew[nUBucket][nUBucketPos] = -1;
+        SetNew(nUBucket, nUBucketPos, -1);
         if (infoDelete.nRefCount == 0) {
             Delete(nIdDelete);
         }
@@ -151,7 +194,7 @@ void CAddrMan::MakeTried(CAddrInfo& info, int nId)
     for (int bucket = 0; bucket < ADDRMAN_NEW_BUCKET_COUNT; bucket++) {
         int pos = info.GetBucketPosition(nKey, true, bucket);
         if (vvNew[bucket][pos] == nId) {
-            vvNew[bucket][pos] = -1;
+            SetNew(bucket, pos, -1);
             info.nRefCount--;
         }
     }
@@ -172,7 +215,7 @@ void CAddrMan::MakeTried(CAddrInfo& info, int nId)
 
         // Remove the to-be-evicted item from the tried set.
         infoOld.fInTried = false;
-        vvTried[nKBucket][nKBucketPos] = -1;
+        SetTried(nKBucket, nKBucketPos, -1);
         nTried--;
 
         // find which new bucket it belongs to
@@ -183,12 +226,12 @@ void CAddrMan::MakeTried(CAddrInfo& info, int nId)
 
         // Enter it into the new set again.
         infoOld.nRefCount = 1;
-        vvNew[nUBucket][nUBucketPos] = nIdEvict;
+        SetNew(nUBucket, nUBucketPos, nIdEvict);
         nNew++;
     }
     assert(vvTried[nKBucket][nKBucketPos] == -1);
 
-    vvTried[nKBucket][nKBucketPos] = nId;
+    SetTried(nKBucket, nKBucketPos, nId);
     nTried++;
     info.fInTried = true;
 }
@@ -300,7 +343,7 @@ bool CAddrMan::Add_(const CAddress& addr, const CNetAddr& source, int64_t nTimeP
         if (fInsert) {
             ClearNew(nUBucket, nUBucketPos);
             pinfo->nRefCount++;
-            vvNew[nUBucket][nUBucketPos] = nId;
+            SetNew(nUBucket, nUBucketPos, nId);
         } else {
             if (pinfo->nRefCount == 0) {
                 Delete(nId);
@@ -334,54 +377,31 @@ CAddrInfo CAddrMan::Select_(bool newOnly)
     if (size() == 0)
         return CAddrInfo();
 
-    // Track number of attempts to find a table entry, before giving up to avoid infinite loop
-    const int kMaxRetries = 200000;         // magic number so unit tests can pass
-    const int kRetriesBetweenSleep = 1000;
-    const int kRetrySleepInterval = 100;    // milliseconds
-
-    if (newOnly && nNew == 0)
+    if (newOnly && vNewSlots.empty())
         return CAddrInfo();
 
     // Use a 50% chance for choosing between tried and new table entries.
+    // Positions are drawn from the lists of occupied ones, so every draw
+    // finds an entry.
     if (!newOnly &&
-       (nTried > 0 && (nNew == 0 || RandomInt(2) == 0))) {
+       (!vTriedSlots.empty() && (vNewSlots.empty() || RandomInt(2) == 0))) {
         // use a tried node
         double fChanceFactor = 1.0;
         while (1) {
-            int i = 0;
-            int nKBucket = RandomInt(ADDRMAN_TRIED_BUCKET_COUNT);
-            int nKBucketPos = RandomInt(ADDRMAN_BUCKET_SIZE);
-            while (vvTried[nKBucket][nKBucketPos] == -1) {
-                nKBucket = (nKBucket + insecure_rand.randbits(ADDRMAN_TRIED_BUCKET_COUNT_LOG2)) % ADDRMAN_TRIED_BUCKET_COUNT;
-                nKBucketPos = (nKBucketPos + insecure_rand.randbits(ADDRMAN_BUCKET_SIZE_LOG2)) % ADDRMAN_BUCKET_SIZE;
-                if (i++ > kMaxRetries)
-                    return CAddrInfo();
-                if (i % kRetriesBetweenSleep == 0 && !nKey.IsNull())
-                    MilliSleep(kRetrySleepInterval);
-            }
-            int nId = vvTried[nKBucket][nKBucketPos];
+            int nSlot = vTriedSlots[RandomInt(vTriedSlots.size())];
+            int nId = vvTried[nSlot / ADDRMAN_BUCKET_SIZE][nSlot % ADDRMAN_BUCKET_SIZE];
             assert(mapInfo.count(nId) == 1);
             CAddrInfo& info = mapInfo[nId];
             if (RandomInt(1 << 30) < fChanceFactor * info.GetChance() * (1 << 30))
                 return info;
             fChanceFactor *= 1.2;
         }
-    } else {
+    } else if (!vNewSlots.empty()) {
         // use a new node
         double fChanceFactor = 1.0;
         while (1) {
-            int i = 0;
-            int nUBucket = RandomInt(ADDRMAN_NEW_BUCKET_COUNT);
-            int nUBucketPos = RandomInt(ADDRMAN_BUCKET_SIZE);
-            while (vvNew[nUBucket][nUBucketPos] == -1) {
-                nUBucket = (nUBucket + insecure_rand.randbits(ADDRMAN_NEW_BUCKET_COUNT_LOG2)) % ADDRMAN_NEW_BUCKET_COUNT;
-                nUBucketPos = (nUBucketPos + insecure_rand.randbits(ADDRMAN_BUCKET_SIZE_LOG2)) % ADDRMAN_BUCKET_SIZE;
-                if (i++ > kMaxRetries)
-                    return CAddrInfo();
-                if (i % kRetriesBetweenSleep == 0 && !nKey.IsNull())
-                    MilliSleep(kRetrySleepInterval);
-            }
-            int nId = vvNew[nUBucket][nUBucketPos];
+            int nSlot = vNewSlots[RandomInt(vNewSlots.size())];
+            int nId = vvNew[nSlot / ADDRMAN_BUCKET_SIZE][nSlot % ADDRMAN_BUCKET_SIZE];
             assert(mapInfo.count(nId) == 1);
             CAddrInfo& info = mapInfo[nId];
             if (RandomInt(1 << 30) < fChanceFactor * info.GetChance() * (1 << 30))
@@ -402,7 +422,7 @@ int CAddrMan::Check_()
     if (vRandom.size() != nTried + nNew)
         return -7;
 
-    for (std::map<int, CAddrInfo>::iterator it = mapInfo.begin(); it != mapInfo.end(); it++) {
+    for (std::unordered_map<int, CAddrInfo>::iterator it = mapInfo.begin(); it != mapInfo.end(); it++) {
         int n = (*it).first;
         CAddrInfo& info = (*it).second;
         if (info.fInTried) {
@@ -460,6 +480,17 @@ int CAddrMan::Check_()
         }
     }
 
+    if (vTriedSlots.size() != (size_t)nTried)
+        return -20;
+    for (size_t n = 0; n < vTriedSlots.size(); n++) {
+        if (vTriedSlotPos[vTriedSlots[n]] != (int)n || vvTried[vTriedSlots[n] / ADDRMAN_BUCKET_SIZE][vTriedSlots[n] % ADDRMAN_BUCKET_SIZE] == -1)
+            return -21;
+    }
+    for (size_t n = 0; n < vNewSlots.size(); n++) {
+        if (vNewSlotPos[vNewSlots[n]] != (int)n || vvNew[vNewSlots[n] / ADDRMAN_BUCKET_SIZE][vNewSlots[n] % ADDRMAN_BUCKET_SIZE] == -1)
+            return -22;
+    }
+
     if (setTried.size())
         return -13;
     if (mapNew.size())
@@ -508,8 +539,10 @@ void CAddrMan::Connected_(const CService& addr, int64_t nTime)
 
     // update info
     int64_t nUpdateInterval = 20 * 60;
-    if (nTime - info.nTime > nUpdateInterval)
+    if (nTime - info.nTime > nUpdateInterval) {
         info.nTime = nTime;
+        fDirty = true;
+    }
 }
 
 int CAddrMan::RandomInt(int nMax){
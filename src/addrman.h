@@ -15,6 +15,7 @@
 #include <map>
 #include <set>
 #include <stdint.h>
+#include <unordered_map>
 #include <vector>
 
 /**
@@ -104,6 +105,20 @@ public:
 
 };
 
+/** Hashes network addresses for the address index of CAddrMan, under a
+ *  random key so that peers cannot pick addresses that collide. */
+class SaltedNetAddrHasher
+{
+private:
+    /** Salt */
+    const uint64_t k0, k1;
+
+public:
+    SaltedNetAddrHasher();
+
+    size_t operator()(const CNetAddr& addr) const;
+};
+
 /** Stochastic address manager
  *
  * Design goals:
@@ -128,6 +143,8 @@ public:
  *      be observable by adversaries.
  *    * Several indexes are kept for high performance. Defining DEBUG_ADDRMAN will introduce frequent (and expensive)
  *      consistency checks for the entire data structure.
+ *    * The occupied positions of both tables are kept in a list as well, so that an address can be selected in
+ *      constant time however sparse the tables are.
  */
 
 //! total number of buckets for tried addresses
@@ -184,10 +201,10 @@ private:
     int nIdCount;
 
     //! table with information about all nIds
-    std::map<int, CAddrInfo> mapInfo;
+    std::unordered_map<int, CAddrInfo> mapInfo;
 
     //! find an nId based on its network address
-    std::map<CNetAddr, int> mapAddr;
+    std::unordered_map<CNetAddr, int, SaltedNetAddrHasher> mapAddr;
 
     //! randomly-ordered vector of all nIds
     std::vector<int> vRandom;
@@ -204,6 +221,27 @@ private:
     //! list of "new" buckets
     int vvNew[ADDRMAN_NEW_BUCKET_COUNT][ADDRMAN_BUCKET_SIZE];
 
+    //! occupied positions (bucket * ADDRMAN_BUCKET_SIZE + position) in
+    //! vvTried and vvNew, in no particular order
+    std::vector<int> vTriedSlots;
+    std::vector<int> vNewSlots;
+
+    //! index of each position in vTriedSlots and vNewSlots, or -1
+    std::vector<int> vTriedSlotPos;
+    std::vector<int> vNewSlotPos;
+
+    //! whether the tables changed since they were last serialized
+    bool fDirty;
+
+    //! Add or remove a position in a list of occupied positions.
+    static void UpdateSlots(std::vector<int>& vSlots, std::vector<int>& vSlotPos, int nSlot, bool fOccupied);
+
+    //! Set a position in a "tried" bucket, -1 clearing it.
+    void SetTried(int nKBucket, int nKBucketPos, int nId);
+
+    //! Set a position in a "new" bucket, -1 clearing it.
+    void SetNew(int nUBucket, int nUBucketPos, int nId);
+
 protected:
     //! secret key to randomize bucket select with
     uint256 nKey;
@@ -300,9 +338,10 @@ public:
 
         int nUBuckets = ADDRMAN_NEW_BUCKET_COUNT ^ (1 << 30);
         s << nUBuckets;
-        std::map<int, int> mapUnkIds;
+        std::unordered_map<int, int> mapUnkIds;
+        mapUnkIds.reserve(mapInfo.size());
         int nIds = 0;
-        for (std::map<int, CAddrInfo>::const_iterator it = mapInfo.begin(); it != mapInfo.end(); it++) {
+        for (std::unordered_map<int, CAddrInfo>::const_iterator it = mapInfo.begin(); it != mapInfo.end(); it++) {
             mapUnkIds[(*it).first] = nIds;
             const CAddrInfo &info = (*it).second;
             if (info.nRefCount) {
@@ -312,7 +351,7 @@ public:
             }
         }
         nIds = 0;
-        for (std::map<int, CAddrInfo>::const_iterator it = mapInfo.begin(); it != mapInfo.end(); it++) {
+        for (std::unordered_map<int, CAddrInfo>::const_iterator it = mapInfo.begin(); it != mapInfo.end(); it++) {
             const CAddrInfo &info = (*it).second;
             if (info.fInTried) {
                 assert(nIds != nTried); // this means nTried was wrong, oh ow
@@ -364,6 +403,8 @@ public:
         if (nTried > ADDRMAN_TRIED_BUCKET_COUNT * ADDRMAN_BUCKET_SIZE) {
             throw std::ios_base::failure("Corrupt CAddrMan serialization, nTried exceeds limit.");
         }
+        mapInfo.reserve(nNew + nTried);
+        mapAddr.reserve(nNew + nTried);
 
         // Deserialize entries from the new table.
         for (int n = 0; n < nNew; n++) {
@@ -378,7 +419,7 @@ public:
                 int nUBucket = info.GetNewBucket(nKey);
                 int nUBucketPos = info.GetBucketPosition(nKey, true, nUBucket);
                 if (vvNew[nUBucket][nUBucketPos] == -1) {
-                    vvNew[nUBucket][nUBucketPos] = n;
+                    SetNew(nUBucket, nUBucketPos, n);
                     info.nRefCount++;
                 }
             }
@@ -398,7 +439,7 @@ public:
                 vRandom.push_back(nIdCount);
                 mapInfo[nIdCount] = info;
                 mapAddr[info] = nIdCount;
-                vvTried[nKBucket][nKBucketPos] = nIdCount;
+                SetTried(nKBucket, nKBucketPos, nIdCount);
                 nIdCount++;
             } else {
                 nLost++;
@@ -418,7 +459,7 @@ public:
                     int nUBucketPos = info.GetBucketPosition(nKey, true, bucket);
                     if (nVersion == 1 && nUBuckets == ADDRMAN_NEW_BUCKET_COUNT && vvNew[bucket][nUBucketPos] == -1 && info.nRefCount < ADDRMAN_NEW_BUCKETS_PER_ADDRESS) {
                         info.nRefCount++;
-                        vvNew[bucket][nUBucketPos] = nIndex;
+                        SetNew(bucket, nUBucketPos, nIndex);
                     }
                 }
             }
@@ -426,9 +467,9 @@ public:
 
         // Prune new entries with refcount 0 (as a result of collisions).
         int nLostUnk = 0;
-        for (std::map<int, CAddrInfo>::const_iterator it = mapInfo.begin(); it != mapInfo.end(); ) {
+        for (std::unordered_map<int, CAddrInfo>::const_iterator it = mapInfo.begin(); it != mapInfo.end(); ) {
             if (it->second.fInTried == false && it->second.nRefCount == 0) {
-                std::map<int, CAddrInfo>::const_iterator itCopy = it++;
+                std::unordered_map<int, CAddrInfo>::const_iterator itCopy = it++;
                 Delete(itCopy->first);
                 nLostUnk++;
             } else {
@@ -440,12 +481,15 @@ public:
         }
 
         Check();
+        fDirty = false;
     }
 
     void Clear()
     {
         LOCK(cs);
         std::vector<int>().swap(vRandom);
+        std::unordered_map<int, CAddrInfo>().swap(mapInfo);
+        mapAddr.clear();
         nKey = GetRandHash();
         for (size_t bucket = 0; bucket < ADDRMAN_NEW_BUCKET_COUNT; bucket++) {
             for (size_t entry = 0; entry < ADDRMAN_BUCKET_SIZE; entry++) {
@@ -457,10 +501,15 @@ public:
                 vvTried[bucket][entry] = -1;
             }
         }
+        std::vector<int>().swap(vTriedSlots);
+        std::vector<int>().swap(vNewSlots);
+        vTriedSlotPos.assign(ADDRMAN_TRIED_BUCKET_COUNT * ADDRMAN_BUCKET_SIZE, -1);
+        vNewSlotPos.assign(ADDRMAN_NEW_BUCKET_COUNT * ADDRMAN_BUCKET_SIZE, -1);
 
         nIdCount = 0;
         nTried = 0;
         nNew = 0;
+        fDirty = true;
     }
 
     CAddrMan()
@@ -480,6 +529,20 @@ public:
         return vRandom.size();
     }
 
+    //! Whether anything changed since the tables were last loaded or
+    //! marked clean. Serializing them does not mark them clean.
+    bool IsDirty() const
+    {
+        LOCK(cs);
+        return fDirty;
+    }
+
+    void SetDirty(bool fDirtyIn = true)
+    {
+        LOCK(cs);
+        fDirty = fDirtyIn;
+    }
+
     //! Consistency check
     void Check()
     {
@@ -500,6 +563,7 @@ public:
         bool fRet = false;
         Check();
         fRet |= Add_(addr, source, nTimePenalty);
+        fDirty = true;
         Check();
         if (fRet)
             LogPrint("addrman", "Added %s from %s: %i tried, %i new\n", addr.ToStringIPPort(), source.ToString(), nTried, nNew);
@@ -514,6 +578,7 @@ public:
         Check();
         for (std::vector<CAddress>::const_iterator it = vAddr.begin(); it != vAddr.end(); it++)
             nAdd += Add_(*it, source, nTimePenalty) ? 1 : 0;
+        fDirty = true;
         Check();
         if (nAdd)
             LogPrint("addrman", "Added %i addresses from %s: %i tried, %i new\n", nAdd, source.ToString(), nTried, nNew);
@@ -526,6 +591,7 @@ public:
         LOCK(cs);
         Check();
         Good_(addr, nTime);
+        fDirty = true;
         Check();
     }
 
@@ -535,6 +601,7 @@ public:
         LOCK(cs);
         Check();
         Attempt_(addr, nTime);
+        fDirty = true;
         Check();
     }
 
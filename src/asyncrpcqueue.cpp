@@ -35,26 +35,33 @@ void AsyncRPCQueue::run(size_t workerId) {
         std::shared_ptr<AsyncRPCOperation> operation;
         {
             std::unique_lock<std::mutex> guard(lock_);
-            while (operation_id_queue_.empty() && !isClosed() && !isFinishing()) {
+            while (queues_empty() && !isClosed() && !isFinishing()) {
                 this->condition_.wait(guard);
             }
 
             // Exit if the queue is empty and we are finishing up
-            if (isFinishing() && operation_id_queue_.empty()) {
+            if (isFinishing() && queues_empty()) {
                 break;
             }
 
             // Exit if the queue is closing.
             if (isClosed()) {
-                while (!operation_id_queue_.empty()) {
-                    operation_id_queue_.pop();
+                for (auto& q : operation_id_queues_) {
+                    while (!q.empty()) {
+                        q.pop();
+                    }
                 }
                 break;
             }
 
-            // Get operation id
-            key = operation_id_queue_.front();
-            operation_id_queue_.pop();
+            // Get the id of the first operation of the highest priority
+            for (auto& q : operation_id_queues_) {
+                if (!q.empty()) {
+                    key = q.front();
+                    q.pop();
+                    break;
+                }
+            }
 
             // Search operation map
             AsyncRPCOperationMap::const_iterator iter = operation_map_.find(key);
@@ -84,7 +91,7 @@ void AsyncRPCQueue::run(size_t workerId) {
  *
  * Don't use std::make_shared<AsyncRPCOperation>().
  */
-void AsyncRPCQueue::addOperation(const std::shared_ptr<AsyncRPCOperation> &ptrOperation) {
+void AsyncRPCQueue::addOperation(const std::shared_ptr<AsyncRPCOperation> &ptrOperation, AsyncRPCPriority priority) {
     std::lock_guard<std::mutex> guard(lock_);
 
     // Don't add if queue is closed or finishing
@@ -94,7 +101,7 @@ void AsyncRPCQueue::addOperation(const std::shared_ptr<AsyncRPCOperation> &ptrOp
 
     AsyncRPCOperationId id = ptrOperation->getId();
     operation_map_.emplace(id, ptrOperation);
-    operation_id_queue_.push(id);
+    operation_id_queues_[static_cast<size_t>(priority)].push(id);
     this->condition_.notify_one();
 }
 
@@ -171,7 +178,23 @@ void AsyncRPCQueue::cancelAllOperations() {
  */
 size_t AsyncRPCQueue::getOperationCount() const {
     std::lock_guard<std::mutex> guard(lock_);
-    return operation_id_queue_.size();
+    size_t count = 0;
+    for (const auto& q : operation_id_queues_) {
+        count += q.size();
+    }
+    return count;
+}
+
+/**
+ * Return true if no operation is waiting to be started. Requires lock_.
+ */
+bool AsyncRPCQueue::queues_empty() const {
+    for (const auto& q : operation_id_queues_) {
+        if (!q.empty()) {
+            return false;
+        }
+    }
+    return true;
 }
 
 /**
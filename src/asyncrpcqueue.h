@@ -21,6 +21,24 @@
 
 typedef std::unordered_map<AsyncRPCOperationId, std::shared_ptr<AsyncRPCOperation> > AsyncRPCOperationMap; 
 
+//! -rpcasyncthreads default, 0 = one thread for every 4 cores
+static const int DEFAULT_RPC_ASYNC_THREADS = 0;
+//! Maximum number of async RPC worker threads. Each operation's prover
+//! already uses several cores.
+static const int MAX_RPC_ASYNC_THREADS = 8;
+
+/**
+ * Operations waiting in the queue are started in order of priority, and in
+ * the order they were added within a priority. Operations the wallet starts
+ * on its own, such as Sapling migration, are run in the background, so that
+ * they do not hold up the operations requested by RPC clients.
+ */
+enum class AsyncRPCPriority {
+    NORMAL = 0,
+    BACKGROUND = 1,
+};
+static const size_t NUM_ASYNC_RPC_PRIORITIES = 2;
+
 
 class AsyncRPCQueue {
 public:
@@ -47,13 +65,14 @@ public:
     size_t getOperationCount() const;
     std::shared_ptr<AsyncRPCOperation> getOperationForId(AsyncRPCOperationId) const;
     std::shared_ptr<AsyncRPCOperation> popOperationForId(AsyncRPCOperationId);
-    void addOperation(const std::shared_ptr<AsyncRPCOperation> &ptrOperation);
+    void addOperation(const std::shared_ptr<AsyncRPCOperation> &ptrOperation, AsyncRPCPriority priority = AsyncRPCPriority::NORMAL);
     std::vector<AsyncRPCOperationId> getAllOperationIds() const;
 
 private:
     // addWorker() will spawn a new thread on run())
     void run(size_t workerId);
     void wait_for_worker_threads();
+    bool queues_empty() const;
 
     // Why this is not a recursive lock: http://www.zaval.org/resources/library/butenhof1.html
     mutable std::mutex lock_;
@@ -61,7 +80,8 @@ private:
     std::atomic<bool> closed_;
     std::atomic<bool> finish_;
     AsyncRPCOperationMap operation_map_;
-    std::queue <AsyncRPCOperationId> operation_id_queue_;
+    // One queue of operation ids for each priority
+    std::queue <AsyncRPCOperationId> operation_id_queues_[NUM_ASYNC_RPC_PRIORITIES];
     std::vector<std::thread> workers_;
 };
 
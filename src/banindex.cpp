@@ -0,0 +1,77 @@
+// Copyright (c) 2026 The Zcash developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or https://www.opensource.org/licenses/mit-license.php .
+
+#include "banindex.h"
+
+#include "hash.h"
+#include "random.h"
+
+#include <limits>
+
+SaltedNetAddrHasher::SaltedNetAddrHasher() : k0(GetRand(std::numeric_limits<uint64_t>::max())), k1(GetRand(std::numeric_limits<uint64_t>::max())) {}
+
+size_t SaltedNetAddrHasher::operator()(const CNetAddr& addr) const
+{
+    unsigned char vch[16];
+    for (int n = 0; n < 16; n++)
+        vch[n] = addr.GetByte(15 - n);
+    return CSipHasher(k0, k1).Write(vch, sizeof(vch)).Finalize();
+}
+
+void CBanIndex::Set(const CSubNet& subNet, int64_t nBanUntil)
+{
+    if (!subNet.IsValid())
+        return;
+    int nBits = subNet.GetPrefixLength();
+    if (nBits < 0) {
+        mapOtherBans[subNet] = nBanUntil;
+    } else {
+        mapPrefixBans[nBits][subNet.GetBaseAddress()] = nBanUntil;
+    }
+}
+
+void CBanIndex::Remove(const CSubNet& subNet)
+{
+    int nBits = subNet.GetPrefixLength();
+    if (nBits < 0) {
+        mapOtherBans.erase(subNet);
+        return;
+    }
+    auto it = mapPrefixBans.find(nBits);
+    if (it == mapPrefixBans.end())
+        return;
+    it->second.erase(subNet.GetBaseAddress());
+    if (it->second.empty())
+        mapPrefixBans.erase(it);
+}
+
+void CBanIndex::Clear()
+{
+    mapPrefixBans.clear();
+    mapOtherBans.clear();
+}
+
+void CBanIndex::Rebuild(const banmap_t& banmap)
+{
+    Clear();
+    for (const auto& entry : banmap) {
+        Set(entry.first, entry.second.nBanUntil);
+    }
+}
+
+bool CBanIndex::IsBanned(const CNetAddr& addr, int64_t nNow) const
+{
+    if (!addr.IsValid())
+        return false;
+    for (const auto& [nBits, table] : mapPrefixBans) {
+        auto it = table.find(CSubNet(addr, nBits).GetBaseAddress());
+        if (it != table.end() && nNow < it->second)
+            return true;
+    }
+    for (const auto& [subNet, nBanUntil] : mapOtherBans) {
+        if (subNet.Match(addr) && nNow < nBanUntil)
+            return true;
+    }
+    return false;
+}
@@ -0,0 +1,56 @@
+// Copyright (c) 2026 The Zcash developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or https://www.opensource.org/licenses/mit-license.php .
+
+#ifndef ZCASH_BANINDEX_H
+#define ZCASH_BANINDEX_H
+
+#include "addrdb.h"
+#include "netbase.h"
+
+#include <map>
+#include <unordered_map>
+
+class SaltedNetAddrHasher
+{
+private:
+    /** Salt */
+    const uint64_t k0, k1;
+
+public:
+    SaltedNetAddrHasher();
+
+    size_t operator()(const CNetAddr& addr) const;
+};
+
+/**
+ * An index of the banned subnets for matching addresses against them without
+ * walking the ban list. Subnets whose netmask is a prefix, which are all of
+ * those that can be written as <address>/<bits>, are kept in a hash table per
+ * prefix length, so that matching an address takes a lookup for each length
+ * in use. Subnets with other netmasks are matched one by one.
+ */
+class CBanIndex
+{
+private:
+    typedef std::unordered_map<CNetAddr, int64_t, SaltedNetAddrHasher> CBanTable;
+
+    //! The ban expiry times of the prefix subnets by their base address, by
+    //! prefix length.
+    std::map<int, CBanTable> mapPrefixBans;
+    //! The ban expiry times of the other subnets.
+    std::map<CSubNet, int64_t> mapOtherBans;
+
+public:
+    //! Set the time the ban of the subnet expires.
+    void Set(const CSubNet& subNet, int64_t nBanUntil);
+    void Remove(const CSubNet& subNet);
+    void Clear();
+    //! Replace the index with the subnets of the ban list.
+    void Rebuild(const banmap_t& banmap);
+
+    //! Whether the address is in a subnet whose ban expires after nNow.
+    bool IsBanned(const CNetAddr& addr, int64_t nNow) const;
+};
+
+#endif // ZCASH_BANINDEX_H
@@ -0,0 +1,121 @@
+// Copyright (c) 2026 The Zcash developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or https://www.opensource.org/licenses/mit-license.php .
+
+#include "bench.h"
+#include "addrman.h"
+#include "clientversion.h"
+#include "random.h"
+#include "streams.h"
+#include "util/time.h"
+
+#include <vector>
+
+// Enough addresses from enough sources to fill a good part of the tables of
+// a long-running node.
+static const int NUM_SOURCES = 64;
+static const int NUM_ADDRESSES_PER_SOURCE = 256;
+
+static CNetAddr RandomIPv4(FastRandomContext& rng)
+{
+    struct in_addr addr;
+    // Mostly routable; Add ignores the few addresses that are not.
+    uint32_t nIP = ((11 + rng.randrange(212)) << 24) | rng.randbits(24);
+    addr.s_addr = htonl(nIP);
+    return CNetAddr(addr);
+}
+
+static void CreateAddresses(std::vector<CNetAddr>& vSources, std::vector<std::vector<CAddress>>& vAddresses)
+{
+    FastRandomContext rng(true);
+    int64_t nNow = GetTime();
+    for (int i = 0; i < NUM_SOURCES; i++) {
+        vSources.push_back(RandomIPv4(rng));
+        vAddresses.emplace_back();
+        for (int j = 0; j < NUM_ADDRESSES_PER_SOURCE; j++) {
+            CAddress addr(CService(RandomIPv4(rng), 8233));
+            addr.nTime = nNow - rng.randrange(24 * 60 * 60);
+            vAddresses.back().push_back(addr);
+        }
+    }
+}
+
+static void FillAddrMan(CAddrMan& addrman, const std::vector<CNetAddr>& vSources, const std::vector<std::vector<CAddress>>& vAddresses)
+{
+    for (size_t i = 0; i < vSources.size(); i++) {
+        addrman.Add(vAddresses[i], vSources[i]);
+    }
+    // Move some of them to the tried table, as outbound connections would.
+    for (size_t i = 0; i < vAddresses.size(); i += 4) {
+        for (const CAddress& addr : vAddresses[i]) {
+            addrman.Good(addr);
+        }
+    }
+}
+
+// Processes addr messages from many peers into an empty addrman.
+static void AddrManAdd(benchmark::State& state)
+{
+    std::vector<CNetAddr> vSources;
+    std::vector<std::vector<CAddress>> vAddresses;
+    CreateAddresses(vSources, vAddresses);
+
+    while (state.KeepRunning()) {
+        CAddrMan addrman;
+        for (size_t i = 0; i < vSources.size(); i++) {
+            addrman.Add(vAddresses[i], vSources[i]);
+        }
+    }
+}
+
+// Chooses an address for an outbound connection.
+static void AddrManSelect(benchmark::State& state)
+{
+    std::vector<CNetAddr> vSources;
+    std::vector<std::vector<CAddress>> vAddresses;
+    CreateAddresses(vSources, vAddresses);
+    CAddrMan addrman;
+    FillAddrMan(addrman, vSources, vAddresses);
+
+    while (state.KeepRunning()) {
+        CAddrInfo addr = addrman.Select();
+        assert(addr.IsValid());
+    }
+}
+
+// Answers a getaddr message.
+static void AddrManGetAddr(benchmark::State& state)
+{
+    std::vector<CNetAddr> vSources;
+    std::vector<std::vector<CAddress>> vAddresses;
+    CreateAddresses(vSources, vAddresses);
+    CAddrMan addrman;
+    FillAddrMan(addrman, vSources, vAddresses);
+
+    while (state.KeepRunning()) {
+        std::vector<CAddress> vAddr = addrman.GetAddr();
+        assert(!vAddr.empty());
+    }
+}
+
+// Writes and reads back the tables, as for peers.dat.
+static void AddrManSerialize(benchmark::State& state)
+{
+    std::vector<CNetAddr> vSources;
+    std::vector<std::vector<CAddress>> vAddresses;
+    CreateAddresses(vSources, vAddresses);
+    CAddrMan addrman;
+    FillAddrMan(addrman, vSources, vAddresses);
+
+    while (state.KeepRunning()) {
+        CDataStream ss(SER_DISK, CLIENT_VERSION);
+        ss << addrman;
+        CAddrMan addrman2;
+        ss >> addrman2;
+    }
+}
+
+BENCHMARK(AddrManAdd);
+BENCHMARK(AddrManSelect);
+BENCHMARK(AddrManGetAddr);
+BENCHMARK(AddrManSerialize);
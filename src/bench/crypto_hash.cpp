@@ -13,6 +13,9 @@
 #include "crypto/sha1.h"
 #include "crypto/sha256.h"
 #include "crypto/sha512.h"
+#include "hash.h"
+
+#include <rust/blake2b.h>
 
 /* Number of bytes to hash per iteration */
 static const uint64_t BUFFER_SIZE = 1000*1000;
@@ -49,6 +52,40 @@ static void SHA256D64_1024(benchmark::State& state)
     }
 }
 
+static const unsigned char BENCH_PERSONALIZATION[blake2b::PERSONALBYTES] =
+    {'Z','c','a','s','h','_','B','e','n','c','h','m','a','r','k'};
+
+static void BLAKE2b(benchmark::State& state)
+{
+    std::vector<uint8_t> in(BUFFER_SIZE,0);
+    while (state.KeepRunning()) {
+        CBLAKE2bWriter ss(SER_GETHASH, 0, BENCH_PERSONALIZATION);
+        ss.write_u8(in.data(), in.size());
+        ss.GetHash();
+    }
+}
+
+static void BLAKE2b64_1024(benchmark::State& state)
+{
+    std::vector<uint8_t> in(64 * 1024, 0);
+    while (state.KeepRunning()) {
+        for (size_t i = 0; i < 1024; i++) {
+            CBLAKE2bWriter ss(SER_GETHASH, 0, BENCH_PERSONALIZATION);
+            ss.write_u8(in.data() + i * 64, 64);
+            ss.GetHash();
+        }
+    }
+}
+
+static void BLAKE2b64Many_1024(benchmark::State& state)
+{
+    std::vector<uint8_t> in(64 * 1024, 0);
+    std::vector<uint8_t> out(32 * 1024);
+    while (state.KeepRunning()) {
+        blake2b::hash_many(32, {BENCH_PERSONALIZATION, blake2b::PERSONALBYTES}, 64, {in.data(), in.size()}, {out.data(), out.size()});
+    }
+}
+
 static void SHA512(benchmark::State& state)
 {
     uint8_t hash[CSHA512::OUTPUT_SIZE];
@@ -83,6 +120,10 @@ BENCHMARK(RIPEMD160);
 BENCHMARK(SHA1);
 BENCHMARK(SHA256);
 BENCHMARK(SHA512);
+BENCHMARK(BLAKE2b);
+
+BENCHMARK(BLAKE2b64_1024);
+BENCHMARK(BLAKE2b64Many_1024);
 
 BENCHMARK(SHA256D64_1024); // 7400
 BENCHMARK(FastRandom_32bit);
@@ -0,0 +1,65 @@
+// Copyright (c) 2026 The Zcash developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or https://www.opensource.org/licenses/mit-license.php .
+
+#include "bench.h"
+#include "mempool_limit.h"
+#include "random.h"
+#include "util/time.h"
+
+#include <vector>
+
+// The number of transactions in a full mempool.
+static const size_t MEMPOOL_TXS = 8000;
+
+// Adds a transaction to a full mempool, so that one is evicted.
+static void MempoolEviction(benchmark::State& state)
+{
+    FastRandomContext rng(true);
+    MempoolLimitTxSet limitSet(MEMPOOL_TXS * MIN_TX_COST);
+    for (size_t i = 0; i < MEMPOOL_TXS; i++) {
+        limitSet.add(rng.rand256(), MIN_TX_COST, MIN_TX_COST + (i % 2) * LOW_FEE_PENALTY);
+    }
+    uint64_t i = 0;
+    while (state.KeepRunning()) {
+        limitSet.add(rng.rand256(), MIN_TX_COST, MIN_TX_COST + (i++ % 2) * LOW_FEE_PENALTY);
+        limitSet.maybeDropRandom();
+    }
+}
+
+// Removes a transaction from a full mempool, as though it had been mined,
+// and adds another in its place.
+static void MempoolLimitRemove(benchmark::State& state)
+{
+    FastRandomContext rng(true);
+    MempoolLimitTxSet limitSet(MEMPOOL_TXS * MIN_TX_COST);
+    std::vector<uint256> txids;
+    for (size_t i = 0; i < MEMPOOL_TXS; i++) {
+        txids.push_back(rng.rand256());
+        limitSet.add(txids.back(), MIN_TX_COST, MIN_TX_COST + (i % 2) * LOW_FEE_PENALTY);
+    }
+    while (state.KeepRunning()) {
+        size_t index = rng.randrange(txids.size());
+        limitSet.remove(txids[index]);
+        txids[index] = rng.rand256();
+        limitSet.add(txids[index], MIN_TX_COST, MIN_TX_COST + (index % 2) * LOW_FEE_PENALTY);
+    }
+}
+
+// Records evicted transactions, and checks transactions against them.
+static void RecentlyEvicted(benchmark::State& state)
+{
+    FastRandomContext rng(true);
+    RecentlyEvictedList recentlyEvicted(SystemClock::Instance(), DEFAULT_MEMPOOL_EVICTION_MEMORY_MINUTES * 60);
+    for (size_t i = 0; i < EVICTION_MEMORY_ENTRIES; i++) {
+        recentlyEvicted.add(rng.rand256());
+    }
+    while (state.KeepRunning()) {
+        recentlyEvicted.add(rng.rand256());
+        recentlyEvicted.contains(rng.rand256());
+    }
+}
+
+BENCHMARK(MempoolEviction);
+BENCHMARK(MempoolLimitRemove);
+BENCHMARK(RecentlyEvicted);
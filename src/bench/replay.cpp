@@ -0,0 +1,310 @@
+// Copyright (c) 2026 The Zcash developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or https://www.opensource.org/licenses/mit-license.php .
+
+#include "chainparams.h"
+#include "consensus/validation.h"
+#include "crypto/sha256.h"
+#include "fs.h"
+#include "key.h"
+#include "main.h"
+#include "script/sigcache.h"
+#include "txdb.h"
+#include "util/system.h"
+#include "util/time.h"
+
+#include <algorithm>
+#include <deque>
+#include <map>
+#include <stdio.h>
+#include <vector>
+
+#include <boost/thread.hpp>
+
+#include <rust/bridge.h>
+#include <rust/init.h>
+
+const std::function<std::string(const char*)> G_TRANSLATION_FUN = nullptr;
+
+extern void SetChainPoolValues(
+    const CChainParams& chainparams,
+    const CBlock &block,
+    CBlockIndex *pindex);
+
+static const char* USAGE =
+    "Usage: bench_replay -datadir=<dir> -blocks=<file> [options]\n"
+    "\n"
+    "Connects the blocks of <file> on top of the chain state in <dir>, and reports\n"
+    "how fast they were connected. <dir> is a copy of the data directory of a node\n"
+    "that was stopped at the block before the range; it is opened like a node's,\n"
+    "so do not point this at the data directory of a node in use. <file> holds the\n"
+    "blocks of the range, each preceded by the network magic and its size, as\n"
+    "written by contrib/linearize. Blocks of the file that are already in the\n"
+    "active chain of <dir> are skipped. The chain state is never written: the\n"
+    "blocks are connected in a view that is discarded afterwards.\n"
+    "\n"
+    "Options:\n"
+    "  -testnet, -regtest    Use the test network or regression test chain\n"
+    "  -par=<n>              Number of script and proof verification threads (0 = auto,\n"
+    "                        default: 0)\n"
+    "  -dbcache=<n>          Database cache size in MiB (default: 450)\n"
+    "  -maxsigcachesize=<n>  Limit the validity caches to <n> MiB (default: 32)\n"
+    "  -warmup=<mode>        Replay the blocks once before timing them: \"none\", \"coins\"\n"
+    "                        to load the coins they spend into the chain state cache,\n"
+    "                        or \"all\" to also fill the signature, script and proof\n"
+    "                        validity caches, as when the transactions were relayed\n"
+    "                        before they were mined (default: none)\n"
+    "  -checkpoints          Skip the proofs and signatures of blocks before the last\n"
+    "                        checkpoint, as a node does (default: 0)\n";
+
+/** What was replayed, and how long it took. */
+struct ReplayTotals
+{
+    int nFirstHeight = 0;
+    int nBlocks = 0;
+    uint64_t nTransactions = 0;
+    uint64_t nProofs = 0;
+    int64_t nMicros = 0;
+    std::map<std::string, int64_t> mapStageMicros;
+};
+
+/** The Sprout JoinSplits, Sapling spends and outputs and Orchard actions of a block. */
+static uint64_t CountProofs(const CBlock& block)
+{
+    uint64_t nProofs = 0;
+    for (const CTransaction& tx : block.vtx) {
+        nProofs += tx.vJoinSplit.size() +
+            tx.GetSaplingSpendsCount() +
+            tx.GetSaplingOutputsCount() +
+            tx.GetOrchardBundle().GetNumActions();
+    }
+    return nProofs;
+}
+
+/**
+ * Connect the blocks of the file in order on top of the chain tip, in a view
+ * of the chain state that is discarded afterwards. Returns false if a block
+ * does not follow the previous one, or is invalid.
+ */
+static bool ReplayBlocks(const CChainParams& chainparams, const fs::path& pathBlocks,
+                         CheckAs blockChecks, ReplayTotals& totals)
+{
+    FILE* file = fsbridge::fopen(pathBlocks, "rb");
+    if (!file) {
+        fprintf(stderr, "Error: Cannot open %s\n", pathBlocks.string().c_str());
+        return false;
+    }
+
+    LOCK(cs_main);
+    CCoinsViewCache view(pcoinsTip);
+    // The block index entries of the replayed blocks, which are not added to
+    // mapBlockIndex. Deques, so that the entries stay where they are.
+    std::deque<uint256> vHashes;
+    std::deque<CBlockIndex> vIndex;
+    CBlockIndex* pindexPrev = chainActive.Tip();
+    bool fOk = true;
+
+    pConnectBlockStageTimes = &totals.mapStageMicros;
+    ScanExternalBlockFile(chainparams, file, [&](CBlock& block, unsigned int nBlockPos) {
+        uint256 hash = block.GetHash();
+        if (vIndex.empty()) {
+            BlockMap::iterator it = mapBlockIndex.find(hash);
+            if (it != mapBlockIndex.end() && chainActive.Contains(it->second)) {
+                return true;
+            }
+        }
+        if (block.hashPrevBlock != pindexPrev->GetBlockHash()) {
+            fprintf(stderr, "Error: Block %s does not follow block %s at height %d\n",
+                hash.GetHex().c_str(), pindexPrev->GetBlockHash().GetHex().c_str(), pindexPrev->nHeight);
+            fOk = false;
+            return false;
+        }
+
+        vHashes.push_back(hash);
+        vIndex.emplace_back(block);
+        CBlockIndex* pindex = &vIndex.back();
+        pindex->phashBlock = &vHashes.back();
+        pindex->pprev = pindexPrev;
+        pindex->nHeight = pindexPrev->nHeight + 1;
+        pindex->BuildSkip();
+        SetChainPoolValues(chainparams, block, pindex);
+
+        CValidationState state;
+        int64_t nTimeStart = GetTimeMicros();
+        bool fValid = ContextualCheckBlock(block, state, chainparams, pindexPrev, true);
+        int64_t nTimeContextual = GetTimeMicros();
+        fValid = fValid && ConnectBlock(block, state, pindex, view, chainparams, true, blockChecks);
+        int64_t nTimeEnd = GetTimeMicros();
+        if (!fValid) {
+            fprintf(stderr, "Error: Block %s at height %d is invalid: %s\n",
+                hash.GetHex().c_str(), pindex->nHeight, FormatStateMessage(state).c_str());
+            fOk = false;
+            return false;
+        }
+        // ConnectBlock does not move the view to a block that it only checks.
+        view.SetBestBlock(hash);
+
+        if (totals.nBlocks == 0) {
+            totals.nFirstHeight = pindex->nHeight;
+        }
+        totals.nBlocks++;
+        totals.nTransactions += block.vtx.size();
+        totals.nProofs += CountProofs(block);
+        totals.nMicros += nTimeEnd - nTimeStart;
+        totals.mapStageMicros["contextual_check"] += nTimeContextual - nTimeStart;
+        pindexPrev = pindex;
+        return true;
+    });
+    pConnectBlockStageTimes = NULL;
+
+    if (fOk && totals.nBlocks == 0) {
+        fprintf(stderr, "Error: %s holds no blocks after the chain tip\n", pathBlocks.string().c_str());
+        return false;
+    }
+    return fOk;
+}
+
+static void PrintTotals(const ReplayTotals& totals)
+{
+    double nSeconds = std::max<int64_t>(totals.nMicros, 1) * 0.000001;
+    printf("Replayed %d blocks (heights %d to %d) with %u transactions and %u proofs in %.3fs\n",
+        totals.nBlocks, totals.nFirstHeight, totals.nFirstHeight + totals.nBlocks - 1,
+        (unsigned int)totals.nTransactions, (unsigned int)totals.nProofs, nSeconds);
+    printf("  blocks/s:       %.2f\n", totals.nBlocks / nSeconds);
+    printf("  transactions/s: %.2f\n", totals.nTransactions / nSeconds);
+    printf("  proofs/s:       %.2f\n", totals.nProofs / nSeconds);
+
+    // Stages overlap where verification runs in parallel, so their shares
+    // need not add up to the total.
+    std::vector<std::pair<std::string, int64_t>> vStages(totals.mapStageMicros.begin(), totals.mapStageMicros.end());
+    std::sort(vStages.begin(), vStages.end(), [](const auto& a, const auto& b) { return a.second > b.second; });
+    printf("Time by stage:\n");
+    for (const auto& [strStage, nMicros] : vStages) {
+        printf("  %-18s %10.3fs %6.1f%% %10.3fms/block\n", strStage.c_str(), nMicros * 0.000001,
+            100.0 * nMicros / std::max<int64_t>(totals.nMicros, 1), 0.001 * nMicros / totals.nBlocks);
+    }
+}
+
+int main(int argc, char** argv)
+{
+    SHA256AutoDetect();
+    ECC_Start();
+    SetupEnvironment();
+    fPrintToDebugLog = false;
+
+    ParseParameters(argc, argv);
+    if (mapArgs.count("-?") || mapArgs.count("-h") || mapArgs.count("-help") ||
+        !mapArgs.count("-datadir") || !mapArgs.count("-blocks")) {
+        fprintf(stdout, "%s", USAGE);
+        return mapArgs.count("-datadir") && mapArgs.count("-blocks") ? EXIT_SUCCESS : EXIT_FAILURE;
+    }
+    if (!fs::is_directory(GetDataDir(false))) {
+        fprintf(stderr, "Error: Specified data directory \"%s\" does not exist.\n", mapArgs["-datadir"].c_str());
+        return EXIT_FAILURE;
+    }
+    try {
+        SelectParams(ChainNameFromCommandLine());
+    } catch (const std::exception& e) {
+        fprintf(stderr, "Error: %s\n", e.what());
+        return EXIT_FAILURE;
+    }
+    const CChainParams& chainparams = Params();
+
+    CheckAs warmupChecks = CheckAs::Block;
+    bool fWarmup = true;
+    std::string strWarmup = GetArg("-warmup", "none");
+    if (strWarmup == "none") {
+        fWarmup = false;
+    } else if (strWarmup == "coins") {
+        // Unlike CheckAs::Block, does not store validity results in the caches.
+        warmupChecks = CheckAs::SlowBenchmark;
+    } else if (strWarmup == "all") {
+    } else {
+        fprintf(stderr, "Error: Unknown -warmup mode \"%s\"\n", strWarmup.c_str());
+        return EXIT_FAILURE;
+    }
+    fCheckpointsEnabled = GetBoolArg("-checkpoints", false);
+
+    fs::path sprout_groth16 = ZC_GetParamsDir() / "sprout-groth16.params";
+    static_assert(
+        sizeof(fs::path::value_type) == sizeof(codeunit),
+        "librustzcash not configured correctly");
+    auto sprout_groth16_str = sprout_groth16.native();
+    init::zksnark_params(
+        rust::String(
+            reinterpret_cast<const codeunit*>(sprout_groth16_str.data()),
+            sprout_groth16_str.size()),
+        false
+    );
+    init::rayon_threadpool(0);
+
+    // Split the caches as the node does, without the optional indexes.
+    size_t nMaxCacheSize = std::max<int64_t>(GetArg("-maxsigcachesize", DEFAULT_MAX_SIG_CACHE_SIZE), 1) * ((size_t) 1 << 20);
+    InitSignatureCache(nMaxCacheSize / 2 - nMaxCacheSize / 16);
+    InitScriptExecutionCache(nMaxCacheSize / 16);
+    bundlecache::init(nMaxCacheSize / 4);
+
+    int64_t nTotalCache = std::clamp(GetArg("-dbcache", nDefaultDbCache), nMinDbCache, nMaxDbCache) << 20;
+    int64_t nBlockTreeDBCache = nTotalCache / 8;
+    nTotalCache -= nBlockTreeDBCache;
+    int64_t nCoinDBCache = std::min(nTotalCache / 2, (nTotalCache / 4) + (1 << 23));
+    nCoinCacheUsage = nTotalCache - nCoinDBCache;
+
+    nScriptCheckThreads = GetArg("-par", DEFAULT_SCRIPTCHECK_THREADS);
+    if (nScriptCheckThreads <= 0)
+        nScriptCheckThreads += GetNumCores();
+    if (nScriptCheckThreads <= 1)
+        nScriptCheckThreads = 0;
+    else if (nScriptCheckThreads > MAX_SCRIPTCHECK_THREADS)
+        nScriptCheckThreads = MAX_SCRIPTCHECK_THREADS;
+    boost::thread_group threadGroup;
+    for (int i = 0; i < nScriptCheckThreads - 1; i++) {
+        threadGroup.create_thread(&ThreadScriptCheck);
+        threadGroup.create_thread(&ThreadProofCheck);
+        threadGroup.create_thread(&ThreadCoinsPrefetch);
+        threadGroup.create_thread(&ThreadHeaderCheck);
+    }
+
+    int nRet = EXIT_FAILURE;
+    try {
+        pblocktree = new CBlockTreeDB(nBlockTreeDBCache, false, false);
+        pcoinsdbview = new CCoinsViewDB(nCoinDBCache, false, false);
+        pcoinsTip = new CCoinsViewCache(pcoinsdbview);
+        if (!LoadBlockIndex() || chainActive.Tip() == NULL) {
+            fprintf(stderr, "Error: Cannot load the block index and chain state of %s\n", GetDataDir().string().c_str());
+        } else {
+            printf("Chain tip: %s at height %d; using %d verification threads\n",
+                chainActive.Tip()->GetBlockHash().GetHex().c_str(), chainActive.Height(), std::max(nScriptCheckThreads, 1));
+
+            fs::path pathBlocks = GetArg("-blocks", "");
+            ReplayTotals warmup, totals;
+            if ((!fWarmup || ReplayBlocks(chainparams, pathBlocks, warmupChecks, warmup)) &&
+                // Checked as for a benchmark, so that the timed replay does
+                // not store its results in the validity caches.
+                ReplayBlocks(chainparams, pathBlocks, CheckAs::SlowBenchmark, totals)) {
+                if (fWarmup) {
+                    printf("Warmed up (%s) in %.3fs\n", strWarmup.c_str(), warmup.nMicros * 0.000001);
+                }
+                PrintTotals(totals);
+                nRet = EXIT_SUCCESS;
+            }
+        }
+    } catch (const std::exception& e) {
+        fprintf(stderr, "Error: %s\n", e.what());
+    }
+
+    threadGroup.interrupt_all();
+    threadGroup.join_all();
+    {
+        LOCK(cs_main);
+        UnloadBlockIndex();
+        delete pcoinsTip;
+        pcoinsTip = NULL;
+        delete pcoinsdbview;
+        pcoinsdbview = NULL;
+        delete pblocktree;
+        pblocktree = NULL;
+    }
+    ECC_Stop();
+    return nRet;
+}
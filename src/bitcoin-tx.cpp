@@ -20,6 +20,8 @@
 #include "util/strencodings.h"
 
 #include <stdio.h>
+#include <atomic>
+#include <thread>
 
 #include <boost/algorithm/string.hpp>
 #include <boost/assign/list_of.hpp>
@@ -27,6 +29,8 @@
 static bool fCreateBlank;
 static std::map<std::string,UniValue> registers;
 static const int CONTINUE_EXECUTION=-1;
+//! The number of transaction specs that -batch reads before building them.
+static const size_t BATCH_CHUNK_SIZE = 256;
 
 const std::function<std::string(const char*)> G_TRANSLATION_FUN = nullptr;
 
@@ -58,12 +62,14 @@ static int AppInitRawTx(int argc, char* argv[])
             _("Usage:") + "\n" +
               "  zcash-tx [options] <hex-tx> [commands]  " + _("Update hex-encoded zcash transaction") + "\n" +
               "  zcash-tx [options] -create [commands]   " + _("Create hex-encoded zcash transaction") + "\n" +
+              "  zcash-tx [options] -batch [register commands]  " + _("Build zcash transactions read from standard input") + "\n" +
               "\n";
 
         fprintf(stdout, "%s", strUsage.c_str());
 
         strUsage = HelpMessageGroup(_("Options:"));
         strUsage += HelpMessageOpt("-?", _("This help message"));
+        strUsage += HelpMessageOpt("-batch", _("Read transaction specs from standard input, one JSON object per line with the \"commands\" to apply and optionally the \"hex\" of the TX to apply them to (default: a new, empty TX). Each TX is written on a line of its own, in the order of the specs, or \"error: \" and the reason it failed. Only register commands may be given on the command line; their registers are shared by all specs."));
         strUsage += HelpMessageOpt("-create", _("Create new, empty TX."));
         strUsage += HelpMessageOpt("-json", _("Select JSON output"));
         strUsage += HelpMessageOpt("-txid", _("Output only the hex-encoded transaction id of the resultant transaction."));
@@ -100,7 +106,7 @@ static int AppInitRawTx(int argc, char* argv[])
     return CONTINUE_EXECUTION;
 }
 
-static void RegisterSetJson(const std::string& key, const std::string& rawJson)
+static void RegisterSetJson(std::map<std::string,UniValue>& registers, const std::string& key, const std::string& rawJson)
 {
     UniValue val;
     if (!val.read(rawJson)) {
@@ -111,7 +117,7 @@ static void RegisterSetJson(const std::string& key, const std::string& rawJson)
     registers[key] = val;
 }
 
-static void RegisterSet(const std::string& strInput)
+static void RegisterSet(std::map<std::string,UniValue>& registers, const std::string& strInput)
 {
     // separate NAME:VALUE in string
     size_t pos = strInput.find(':');
@@ -123,10 +129,10 @@ static void RegisterSet(const std::string& strInput)
     std::string key = strInput.substr(0, pos);
     std::string valStr = strInput.substr(pos + 1, std::string::npos);
 
-    RegisterSetJson(key, valStr);
+    RegisterSetJson(registers, key, valStr);
 }
 
-static void RegisterLoad(const std::string& strInput)
+static void RegisterLoad(std::map<std::string,UniValue>& registers, const std::string& strInput)
 {
     // separate NAME:FILENAME in string
     size_t pos = strInput.find(':');
@@ -164,7 +170,7 @@ static void RegisterLoad(const std::string& strInput)
     }
 
     // evaluate as JSON buffer register
-    RegisterSetJson(key, valStr);
+    RegisterSetJson(registers, key, valStr);
 }
 
 static void MutateTxVersion(CMutableTransaction& tx, const std::string& cmdVal)
@@ -346,7 +352,7 @@ static CAmount AmountFromValue(const UniValue& value)
     return amount;
 }
 
-static void MutateTxSign(CMutableTransaction& tx, const std::string& strInput)
+static void MutateTxSign(CMutableTransaction& tx, const std::map<std::string,UniValue>& registers, const std::string& strInput)
 {
     // separate HEIGHT:SIGHASH-FLAGS in string
     size_t pos = strInput.find(':');
@@ -385,7 +391,7 @@ static void MutateTxSign(CMutableTransaction& tx, const std::string& strInput)
         throw std::runtime_error("privatekeys register variable must be set.");
     bool fGivenKeys = false;
     CBasicKeyStore tempKeystore;
-    UniValue keysObj = registers["privatekeys"];
+    UniValue keysObj = registers.at("privatekeys");
     fGivenKeys = true;
 
     KeyIO keyIO(Params());
@@ -403,7 +409,7 @@ static void MutateTxSign(CMutableTransaction& tx, const std::string& strInput)
     // Add previous txouts given in the RPC call:
     if (!registers.count("prevtxs"))
         throw std::runtime_error("prevtxs register variable must be set.");
-    UniValue prevtxsObj = registers["prevtxs"];
+    UniValue prevtxsObj = registers.at("prevtxs");
     {
         for (size_t previdx = 0; previdx < prevtxsObj.size(); previdx++) {
             UniValue prevOut = prevtxsObj[previdx];
@@ -508,8 +514,9 @@ public:
     }
 };
 
-static void MutateTx(CMutableTransaction& tx, const std::string& command,
-                     const std::string& commandVal)
+static void MutateTx(CMutableTransaction& tx, std::map<std::string,UniValue>& registers,
+                     const std::string& command, const std::string& commandVal,
+                     bool fECCStarted = false)
 {
     boost::scoped_ptr<Secp256k1Init> ecc;
 
@@ -533,15 +540,15 @@ static void MutateTx(CMutableTransaction& tx, const std::string& command,
         MutateTxAddOutScript(tx, commandVal);
 
     else if (command == "sign") {
-        if (!ecc) { ecc.reset(new Secp256k1Init()); }
-        MutateTxSign(tx, commandVal);
+        if (!ecc && !fECCStarted) { ecc.reset(new Secp256k1Init()); }
+        MutateTxSign(tx, registers, commandVal);
     }
 
     else if (command == "load")
-        RegisterLoad(commandVal);
+        RegisterLoad(registers, commandVal);
 
     else if (command == "set")
-        RegisterSet(commandVal);
+        RegisterSet(registers, commandVal);
 
     else
         throw std::runtime_error("unknown command");
@@ -570,6 +577,20 @@ static void OutputTxHex(const CTransaction& tx)
     fprintf(stdout, "%s\n", strHex.c_str());
 }
 
+/** The transaction as -batch writes it, on a single line. */
+static std::string FormatBatchTx(const CTransaction& tx)
+{
+    if (GetBoolArg("-json", false)) {
+        UniValue entry(UniValue::VOBJ);
+        TxToUniv(tx, uint256(), entry);
+        return entry.write();
+    } else if (GetBoolArg("-txid", false)) {
+        return tx.GetHash().GetHex();
+    } else {
+        return EncodeHexTx(tx);
+    }
+}
+
 static void OutputTx(const CTransaction& tx)
 {
     if (GetBoolArg("-json", false))
@@ -600,6 +621,118 @@ static std::string readStdin()
     return ret;
 }
 
+static void SplitCommand(const std::string& arg, std::string& key, std::string& value)
+{
+    size_t eqpos = arg.find('=');
+    if (eqpos == std::string::npos)
+        key = arg;
+    else {
+        key = arg.substr(0, eqpos);
+        value = arg.substr(eqpos + 1);
+    }
+}
+
+/**
+ * Build the transaction described by a line of -batch input, starting from
+ * the registers set on the command line, and return the line to write for
+ * it.
+ */
+static std::string BatchRawTx(const std::string& strSpec)
+{
+    try {
+        UniValue spec;
+        if (!spec.read(strSpec) || !spec.isObject())
+            throw std::runtime_error("transaction spec is not a JSON object");
+
+        CTransaction txDecodeTmp;
+        const UniValue& hex = find_value(spec, "hex");
+        if (!hex.isNull()) {
+            if (!hex.isStr() || !DecodeHexTx(txDecodeTmp, hex.get_str()))
+                throw std::runtime_error("invalid transaction encoding");
+        }
+        CMutableTransaction tx(txDecodeTmp);
+
+        const UniValue& commands = find_value(spec, "commands");
+        if (!commands.isNull() && !commands.isArray())
+            throw std::runtime_error("commands is not an array");
+        std::map<std::string,UniValue> specRegisters(registers);
+        for (size_t i = 0; i < commands.size(); i++) {
+            if (!commands[i].isStr())
+                throw std::runtime_error("command is not a string");
+            std::string key, value;
+            SplitCommand(commands[i].get_str(), key, value);
+            MutateTx(tx, specRegisters, key, value, true);
+        }
+
+        return FormatBatchTx(tx);
+    } catch (const std::exception& e) {
+        return std::string("error: ") + e.what();
+    }
+}
+
+/**
+ * Build the transactions read from standard input on all cores, a chunk of
+ * specs at a time, and write them out in the order they were read.
+ */
+static int CommandLineBatchRawTx(int argc, char* argv[])
+{
+    for (int i = 1; i < argc; i++) {
+        std::string key, value;
+        SplitCommand(argv[i], key, value);
+        if (key == "load")
+            RegisterLoad(registers, value);
+        else if (key == "set")
+            RegisterSet(registers, value);
+        else
+            throw std::runtime_error("only register commands may be given with -batch");
+    }
+
+    // The signing context is set up once for all the transactions.
+    Secp256k1Init ecc;
+    const size_t nThreads = std::max(1, GetNumCores());
+    int nRet = 0;
+    bool fEOF = false;
+    while (!fEOF) {
+        std::vector<std::string> vSpecs;
+        std::string strLine;
+        while (vSpecs.size() < BATCH_CHUNK_SIZE) {
+            if (!std::getline(std::cin, strLine)) {
+                fEOF = true;
+                break;
+            }
+            boost::algorithm::trim(strLine);
+            if (!strLine.empty())
+                vSpecs.push_back(strLine);
+        }
+
+        std::vector<std::string> vResults(vSpecs.size());
+        std::atomic<size_t> nNext(0);
+        auto build = [&]() {
+            for (size_t i = nNext++; i < vSpecs.size(); i = nNext++) {
+                vResults[i] = BatchRawTx(vSpecs[i]);
+            }
+        };
+        std::vector<std::thread> vThreads;
+        for (size_t i = 1; i < std::min(nThreads, vSpecs.size()); i++) {
+            vThreads.emplace_back(build);
+        }
+        build();
+        for (std::thread& thread : vThreads) {
+            thread.join();
+        }
+
+        for (const std::string& strResult : vResults) {
+            if (boost::algorithm::starts_with(strResult, "error: "))
+                nRet = EXIT_FAILURE;
+            fprintf(stdout, "%s\n", strResult.c_str());
+        }
+        fflush(stdout);
+    }
+    if (std::cin.bad())
+        throw std::runtime_error("error reading stdin");
+    return nRet;
+}
+
 static int CommandLineRawTx(int argc, char* argv[])
 {
     std::string strPrint;
@@ -612,6 +745,9 @@ static int CommandLineRawTx(int argc, char* argv[])
             argv++;
         }
 
+        if (GetBoolArg("-batch", false))
+            return CommandLineBatchRawTx(argc, argv);
+
         CTransaction txDecodeTmp;
         int startArg;
 
@@ -635,17 +771,10 @@ static int CommandLineRawTx(int argc, char* argv[])
         CMutableTransaction tx(txDecodeTmp);
 
         for (int i = startArg; i < argc; i++) {
-            std::string arg = argv[i];
             std::string key, value;
-            size_t eqpos = arg.find('=');
-            if (eqpos == std::string::npos)
-                key = arg;
-            else {
-                key = arg.substr(0, eqpos);
-                value = arg.substr(eqpos + 1);
-            }
+            SplitCommand(argv[i], key, value);
 
-            MutateTx(tx, key, value);
+            MutateTx(tx, registers, key, value);
         }
 
         OutputTx(tx);
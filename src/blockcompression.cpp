@@ -0,0 +1,161 @@
+// Copyright (c) 2026 The Zcash developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or https://www.opensource.org/licenses/mit-license.php .
+
+#include "blockcompression.h"
+
+#include "clientversion.h"
+#include "consensus/consensus.h"
+#include "crypto/common.h"
+#include "primitives/block.h"
+#include "streams.h"
+#include "util/system.h"
+
+#include <algorithm>
+#include <string.h>
+
+#include <rust/compression.h>
+
+bool fBlockCompression = DEFAULT_BLOCK_COMPRESSION;
+
+namespace {
+
+//! The DEFLATE level blocks are compressed at. Higher levels barely shrink
+//! blocks further, most of which is hashes, signatures and proofs.
+static const uint8_t BLOCK_COMPRESSION_LEVEL = 6;
+
+bool IsZero(const unsigned char* pch, size_t nSize)
+{
+    return std::all_of(pch, pch + nSize, [](unsigned char c) { return c == 0; });
+}
+
+}
+
+CStoredBlock::CStoredBlock(const CBlock& block, bool fCompress)
+{
+    CDataStream ss(SER_DISK, CLIENT_VERSION);
+    ss << block;
+    const unsigned char* pch = reinterpret_cast<const unsigned char*>(ss.data());
+    if (fCompress && CompressBlockData(pch, ss.size(), vData)) {
+        nSizeField = vData.size() | BLOCK_COMPRESSED_FLAG;
+    } else {
+        vData.assign(pch, pch + ss.size());
+        nSizeField = vData.size();
+    }
+}
+
+bool CompressBlockData(const unsigned char* pch, size_t nSize, std::vector<uint8_t>& vOut)
+{
+    rust::Vec<uint8_t> vCompressed = compression::deflate(rust::Slice<const uint8_t>(pch, nSize), BLOCK_COMPRESSION_LEVEL);
+    if (sizeof(uint32_t) + vCompressed.size() >= nSize) {
+        return false;
+    }
+    vOut.resize(sizeof(uint32_t) + vCompressed.size());
+    WriteLE32(vOut.data(), nSize);
+    std::copy(vCompressed.begin(), vCompressed.end(), vOut.begin() + sizeof(uint32_t));
+    return true;
+}
+
+bool DecompressBlockData(const unsigned char* pch, size_t nSize, std::vector<uint8_t>& vOut)
+{
+    if (nSize < sizeof(uint32_t)) {
+        return false;
+    }
+    uint32_t nBlockSize = ReadLE32(pch);
+    if (nBlockSize > MAX_BLOCK_SIZE) {
+        return false;
+    }
+    try {
+        rust::Vec<uint8_t> vBlock = compression::inflate(rust::Slice<const uint8_t>(pch + sizeof(uint32_t), nSize - sizeof(uint32_t)), nBlockSize);
+        if (vBlock.size() != nBlockSize) {
+            return false;
+        }
+        vOut.assign(vBlock.begin(), vBlock.end());
+    } catch (const rust::Error& e) {
+        return error("%s: %s", __func__, e.what());
+    }
+    return true;
+}
+
+int CompressBlockFile(const fs::path& path, const fs::path& pathOut, const CMessageHeader::MessageStartChars& messageStart)
+{
+    std::vector<unsigned char> vFile;
+    {
+        FILE* file = fsbridge::fopen(path, "rb");
+        if (!file) {
+            return -1;
+        }
+        bool fRead = fseek(file, 0, SEEK_END) == 0;
+        long nFileSize = fRead ? ftell(file) : -1;
+        if (nFileSize >= 0) {
+            vFile.resize(nFileSize);
+            fRead = fseek(file, 0, SEEK_SET) == 0 && fread(vFile.data(), 1, vFile.size(), file) == vFile.size();
+        }
+        fclose(file);
+        if (!fRead || nFileSize < 0) {
+            return -1;
+        }
+    }
+
+    FILE* fileOut = fsbridge::fopen(pathOut, "wb");
+    if (!fileOut) {
+        return -1;
+    }
+    // Skipping over a range leaves a hole in the file.
+    auto write = [&](size_t nOffset, const unsigned char* pch, size_t nSize) {
+        return fseek(fileOut, nOffset, SEEK_SET) == 0 && fwrite(pch, 1, nSize, fileOut) == nSize;
+    };
+    // Copies what lies between blocks, unless it is all zeros, such as the
+    // space allocated ahead of writes.
+    auto copy = [&](size_t nBegin, size_t nEnd) {
+        return nBegin >= nEnd || IsZero(&vFile[nBegin], nEnd - nBegin) || write(nBegin, &vFile[nBegin], nEnd - nBegin);
+    };
+
+    const size_t nHeaderSize = CMessageHeader::MESSAGE_START_SIZE + sizeof(uint32_t);
+    bool fOk = true;
+    int nCompressed = 0;
+    size_t nCopied = 0;
+    size_t nPos = 0;
+    while (fOk && nPos + nHeaderSize <= vFile.size()) {
+        if (memcmp(&vFile[nPos], messageStart, CMessageHeader::MESSAGE_START_SIZE) != 0) {
+            const void* pNext = memchr(vFile.data() + nPos + 1, messageStart[0], vFile.size() - nPos - 1);
+            nPos = pNext ? static_cast<const unsigned char*>(pNext) - vFile.data() : vFile.size();
+            continue;
+        }
+        uint32_t nSizeField = ReadLE32(&vFile[nPos + CMessageHeader::MESSAGE_START_SIZE]);
+        size_t nSize = nSizeField & ~BLOCK_COMPRESSED_FLAG;
+        if (nSize < ((nSizeField & BLOCK_COMPRESSED_FLAG) ? sizeof(uint32_t) : 80) ||
+            nSize > MAX_BLOCK_SIZE || nPos + nHeaderSize + nSize > vFile.size()) {
+            nPos++;
+            continue;
+        }
+
+        fOk = copy(nCopied, nPos);
+        const unsigned char* pchBlock = &vFile[nPos + nHeaderSize];
+        std::vector<uint8_t> vCompressed;
+        if (fOk && !(nSizeField & BLOCK_COMPRESSED_FLAG) && CompressBlockData(pchBlock, nSize, vCompressed)) {
+            unsigned char header[nHeaderSize];
+            memcpy(header, messageStart, CMessageHeader::MESSAGE_START_SIZE);
+            WriteLE32(header + CMessageHeader::MESSAGE_START_SIZE, vCompressed.size() | BLOCK_COMPRESSED_FLAG);
+            fOk = write(nPos, header, nHeaderSize) && write(nPos + nHeaderSize, vCompressed.data(), vCompressed.size());
+            nCompressed++;
+        } else if (fOk) {
+            fOk = write(nPos, &vFile[nPos], nHeaderSize + nSize);
+        }
+        nPos += nHeaderSize + nSize;
+        nCopied = nPos;
+    }
+    fOk = fOk && copy(nCopied, vFile.size());
+
+    // Extend the copy to the size of the file, in case it ends in a hole.
+    fOk = fOk && fflush(fileOut) == 0 && TruncateFile(fileOut, vFile.size());
+    if (fOk) {
+        FileCommit(fileOut);
+    }
+    fclose(fileOut);
+    if (!fOk) {
+        fs::remove(pathOut);
+        return -1;
+    }
+    return nCompressed;
+}
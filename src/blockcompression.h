@@ -0,0 +1,76 @@
+// Copyright (c) 2026 The Zcash developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or https://www.opensource.org/licenses/mit-license.php .
+
+#ifndef ZCASH_BLOCKCOMPRESSION_H
+#define ZCASH_BLOCKCOMPRESSION_H
+
+#include "fs.h"
+#include "protocol.h"
+
+#include <stdint.h>
+#include <vector>
+
+class CBlock;
+
+//! -blockcompression default
+static const bool DEFAULT_BLOCK_COMPRESSION = false;
+//! -compressblockfiles default
+static const bool DEFAULT_COMPRESS_BLOCK_FILES = false;
+
+/**
+ * Set in the size written before a block in the block files when the block
+ * is stored compressed. The stored bytes are then the size of the serialized
+ * block, as a little-endian 32-bit integer, followed by the serialization
+ * compressed as a raw DEFLATE stream.
+ *
+ * Each block is compressed on its own, so that a block is still read by
+ * going to its position in the block index, and a block file may hold both
+ * compressed and uncompressed blocks.
+ */
+static const uint32_t BLOCK_COMPRESSED_FLAG = 0x80000000;
+
+/** Whether blocks are compressed as they are written (-blockcompression). */
+extern bool fBlockCompression;
+
+/** A block as it is written to the block files, after the message start. */
+class CStoredBlock
+{
+public:
+    //! The size written before the block, with BLOCK_COMPRESSED_FLAG set if
+    //! the block is compressed.
+    uint32_t nSizeField;
+    std::vector<uint8_t> vData;
+
+    //! Serialize block, and compress it if fCompress is set and that makes
+    //! it smaller.
+    CStoredBlock(const CBlock& block, bool fCompress);
+
+    bool IsCompressed() const { return nSizeField & BLOCK_COMPRESSED_FLAG; }
+};
+
+/**
+ * Compress the serialization of a block for storage. Returns false if that
+ * does not make it smaller.
+ */
+bool CompressBlockData(const unsigned char* pch, size_t nSize, std::vector<uint8_t>& vOut);
+
+/**
+ * Decompress a block stored compressed. Returns false if the stored bytes
+ * are corrupt.
+ */
+bool DecompressBlockData(const unsigned char* pch, size_t nSize, std::vector<uint8_t>& vOut);
+
+/**
+ * Write a copy of the block file at path to pathOut with its uncompressed
+ * blocks compressed. Every block stays where it was, so that the block
+ * index, the transaction index and the undo data still point at it; the
+ * space a block no longer takes is left as a hole in the file, which takes
+ * no disk space on file systems that support sparse files.
+ *
+ * Returns the number of blocks compressed, or -1 if the file could not be
+ * read or the copy written.
+ */
+int CompressBlockFile(const fs::path& path, const fs::path& pathOut, const CMessageHeader::MessageStartChars& messageStart);
+
+#endif // ZCASH_BLOCKCOMPRESSION_H
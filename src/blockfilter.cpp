@@ -0,0 +1,300 @@
+// Copyright (c) 2026 The Zcash developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or https://www.opensource.org/licenses/mit-license.php .
+
+#include "blockfilter.h"
+
+#include "hash.h"
+#include "int128.h"
+#include "primitives/block.h"
+#include "script/script.h"
+#include "streams.h"
+#include "undo.h"
+#include "version.h"
+
+#include <algorithm>
+
+namespace {
+
+/** Appends bits to a byte vector, most significant bit first. */
+class BitWriter
+{
+private:
+    std::vector<unsigned char>& vch;
+    unsigned char buffer = 0;
+    int nBits = 0;
+
+public:
+    explicit BitWriter(std::vector<unsigned char>& vchIn) : vch(vchIn) {}
+
+    void Write(uint64_t value, int nCount)
+    {
+        while (nCount > 0) {
+            int nTake = std::min(8 - nBits, nCount);
+            unsigned char bits = (value >> (nCount - nTake)) & ((1 << nTake) - 1);
+            buffer |= bits << (8 - nBits - nTake);
+            nBits += nTake;
+            nCount -= nTake;
+            if (nBits == 8) {
+                vch.push_back(buffer);
+                buffer = 0;
+                nBits = 0;
+            }
+        }
+    }
+
+    void Flush()
+    {
+        if (nBits > 0) {
+            vch.push_back(buffer);
+            buffer = 0;
+            nBits = 0;
+        }
+    }
+};
+
+/** Reads the bits written by BitWriter. */
+class BitReader
+{
+private:
+    const std::vector<unsigned char>& vch;
+    size_t nPos;
+    int nBit = 0;
+
+public:
+    BitReader(const std::vector<unsigned char>& vchIn, size_t nPosIn) : vch(vchIn), nPos(nPosIn) {}
+
+    bool ReadBit()
+    {
+        if (nPos >= vch.size()) {
+            throw std::ios_base::failure("end of block filter");
+        }
+        bool fBit = (vch[nPos] >> (7 - nBit)) & 1;
+        if (++nBit == 8) {
+            nBit = 0;
+            nPos++;
+        }
+        return fBit;
+    }
+
+    uint64_t Read(int nCount)
+    {
+        uint64_t value = 0;
+        for (int i = 0; i < nCount; i++) {
+            value = (value << 1) | ReadBit();
+        }
+        return value;
+    }
+};
+
+void GolombRiceEncode(BitWriter& writer, uint8_t p, uint64_t delta)
+{
+    uint64_t q = delta >> p;
+    while (q > 0) {
+        int nCount = std::min<uint64_t>(q, 64);
+        writer.Write(~0ULL, nCount);
+        q -= nCount;
+    }
+    writer.Write(0, 1);
+    writer.Write(delta, p);
+}
+
+uint64_t GolombRiceDecode(BitReader& reader, uint8_t p)
+{
+    uint64_t q = 0;
+    while (reader.ReadBit()) {
+        q++;
+    }
+    return (q << p) + reader.Read(p);
+}
+
+const std::string strBasicName = "basic";
+const std::string strShieldedName = "shielded";
+const std::string strUnknownName;
+
+}
+
+GCSFilter::GCSFilter(const uint256& hashBlock, const ElementSet& elements) :
+    k0(hashBlock.GetUint64(0)), k1(hashBlock.GetUint64(1)),
+    nElements(elements.size()), nRange(elements.size() * M)
+{
+    CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
+    WriteCompactSize(ss, nElements);
+    encoded.assign(ss.begin(), ss.end());
+    if (nElements == 0) {
+        return;
+    }
+
+    std::vector<uint64_t> vHashed;
+    vHashed.reserve(elements.size());
+    for (const Element& element : elements) {
+        vHashed.push_back(HashToRange(element));
+    }
+    std::sort(vHashed.begin(), vHashed.end());
+
+    BitWriter writer(encoded);
+    uint64_t nLast = 0;
+    for (uint64_t value : vHashed) {
+        GolombRiceEncode(writer, P, value - nLast);
+        nLast = value;
+    }
+    writer.Flush();
+}
+
+GCSFilter::GCSFilter(const uint256& hashBlock, std::vector<unsigned char> encodedIn) :
+    k0(hashBlock.GetUint64(0)), k1(hashBlock.GetUint64(1)), encoded(std::move(encodedIn))
+{
+    CDataStream ss(encoded, SER_NETWORK, PROTOCOL_VERSION);
+    nElements = ReadCompactSize(ss);
+    nRange = nElements * M;
+}
+
+uint64_t GCSFilter::HashToRange(const Element& element) const
+{
+    uint64_t hash = CSipHasher(k0, k1).Write(element.data(), element.size()).Finalize();
+    // Map the hash onto [0, nRange) by multiplying instead of taking the
+    // remainder, which is cheaper and just as uniform.
+    return (static_cast<uint128_t>(hash) * nRange) >> 64;
+}
+
+bool GCSFilter::MatchInternal(std::vector<uint64_t> vQuery) const
+{
+    if (nElements == 0 || vQuery.empty()) {
+        return false;
+    }
+    std::sort(vQuery.begin(), vQuery.end());
+
+    BitReader reader(encoded, GetSizeOfCompactSize(nElements));
+    uint64_t value = 0;
+    auto itQuery = vQuery.begin();
+    for (uint64_t i = 0; i < nElements; i++) {
+        value += GolombRiceDecode(reader, P);
+        while (*itQuery < value) {
+            if (++itQuery == vQuery.end()) {
+                return false;
+            }
+        }
+        if (*itQuery == value) {
+            return true;
+        }
+    }
+    return false;
+}
+
+bool GCSFilter::Match(const Element& element) const
+{
+    return MatchInternal(std::vector<uint64_t>{HashToRange(element)});
+}
+
+bool GCSFilter::MatchAny(const ElementSet& elements) const
+{
+    std::vector<uint64_t> vQuery;
+    vQuery.reserve(elements.size());
+    for (const Element& element : elements) {
+        vQuery.push_back(HashToRange(element));
+    }
+    return MatchInternal(std::move(vQuery));
+}
+
+const std::string& BlockFilterTypeName(BlockFilterType type)
+{
+    switch (type) {
+    case BlockFilterType::BASIC:
+        return strBasicName;
+    case BlockFilterType::SHIELDED:
+        return strShieldedName;
+    }
+    return strUnknownName;
+}
+
+bool BlockFilterTypeByName(const std::string& name, BlockFilterType& type)
+{
+    for (BlockFilterType candidate : AllBlockFilterTypes()) {
+        if (BlockFilterTypeName(candidate) == name) {
+            type = candidate;
+            return true;
+        }
+    }
+    return false;
+}
+
+const std::vector<BlockFilterType>& AllBlockFilterTypes()
+{
+    static const std::vector<BlockFilterType> vTypes = {BlockFilterType::BASIC, BlockFilterType::SHIELDED};
+    return vTypes;
+}
+
+namespace {
+
+GCSFilter::ElementSet BasicFilterElements(const CBlock& block, const CBlockUndo& blockundo)
+{
+    GCSFilter::ElementSet elements;
+    for (const CTransaction& tx : block.vtx) {
+        for (const CTxOut& out : tx.vout) {
+            const CScript& script = out.scriptPubKey;
+            if (script.empty() || script[0] == OP_RETURN) continue;
+            elements.emplace(script.begin(), script.end());
+        }
+    }
+    // The genesis block has no undo data, and spends nothing.
+    for (const CTxUndo& txundo : blockundo.vtxundo) {
+        for (const CTxInUndo& prevout : txundo.vprevout) {
+            const CScript& script = prevout.txout.scriptPubKey;
+            if (script.empty()) continue;
+            elements.emplace(script.begin(), script.end());
+        }
+    }
+    return elements;
+}
+
+GCSFilter::ElementSet ShieldedFilterElements(const CBlock& block)
+{
+    GCSFilter::ElementSet elements;
+    for (const CTransaction& tx : block.vtx) {
+        for (const JSDescription& joinsplit : tx.vJoinSplit) {
+            for (const uint256& nf : joinsplit.nullifiers) {
+                elements.emplace(nf.begin(), nf.end());
+            }
+        }
+        for (const auto& spend : tx.GetSaplingSpends()) {
+            uint256 nf = uint256::FromRawBytes(spend.nullifier());
+            elements.emplace(nf.begin(), nf.end());
+        }
+        for (const uint256& nf : tx.GetOrchardBundle().GetNullifiers()) {
+            elements.emplace(nf.begin(), nf.end());
+        }
+    }
+    return elements;
+}
+
+}
+
+BlockFilter::BlockFilter(BlockFilterType filterTypeIn, const CBlock& block, const CBlockUndo& blockundo) :
+    filterType(filterTypeIn), hashBlock(block.GetHash())
+{
+    switch (filterType) {
+    case BlockFilterType::BASIC:
+        filter = GCSFilter(hashBlock, BasicFilterElements(block, blockundo));
+        break;
+    case BlockFilterType::SHIELDED:
+        filter = GCSFilter(hashBlock, ShieldedFilterElements(block));
+        break;
+    }
+}
+
+BlockFilter::BlockFilter(BlockFilterType filterTypeIn, const uint256& hashBlockIn, std::vector<unsigned char> encoded) :
+    filterType(filterTypeIn), hashBlock(hashBlockIn), filter(hashBlockIn, std::move(encoded))
+{
+}
+
+uint256 BlockFilter::GetHash() const
+{
+    const std::vector<unsigned char>& encoded = filter.GetEncoded();
+    return Hash(encoded.begin(), encoded.end());
+}
+
+uint256 BlockFilter::ComputeHeader(const uint256& prevHeader) const
+{
+    uint256 hashFilter = GetHash();
+    return Hash(hashFilter.begin(), hashFilter.end(), prevHeader.begin(), prevHeader.end());
+}
@@ -0,0 +1,145 @@
+// Copyright (c) 2026 The Zcash developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or https://www.opensource.org/licenses/mit-license.php .
+
+#ifndef ZCASH_BLOCKFILTER_H
+#define ZCASH_BLOCKFILTER_H
+
+#include "serialize.h"
+#include "uint256.h"
+
+#include <set>
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+class CBlock;
+class CBlockUndo;
+
+/**
+ * A Golomb-coded set, as specified by BIP 158: a compact probabilistic
+ * filter over a set of byte strings that can be tested for membership with
+ * a false positive rate of about 1/M.
+ *
+ * Each element is hashed with SipHash under a key taken from the block hash,
+ * mapped to [0, N * M), and the sorted differences between the results are
+ * Golomb-Rice coded with parameter P.
+ */
+class GCSFilter
+{
+public:
+    typedef std::vector<unsigned char> Element;
+    typedef std::set<Element> ElementSet;
+
+    //! The BIP 158 parameters of the basic filter type, which all our filter
+    //! types share.
+    static const uint8_t P = 19;
+    static const uint32_t M = 784931;
+
+private:
+    uint64_t k0, k1;
+    uint64_t nElements;
+    uint64_t nRange;
+    std::vector<unsigned char> encoded;
+
+    uint64_t HashToRange(const Element& element) const;
+    bool MatchInternal(std::vector<uint64_t> vQuery) const;
+
+public:
+    GCSFilter() : k0(0), k1(0), nElements(0), nRange(0) {}
+
+    //! Build a filter over elements, keyed by the hash of a block.
+    GCSFilter(const uint256& hashBlock, const ElementSet& elements);
+
+    //! Reconstruct a filter from its encoding. Throws std::ios_base::failure
+    //! if the encoding does not start with a valid element count.
+    GCSFilter(const uint256& hashBlock, std::vector<unsigned char> encodedIn);
+
+    uint64_t GetN() const { return nElements; }
+    const std::vector<unsigned char>& GetEncoded() const { return encoded; }
+
+    //! Whether element may be in the set. False positives are possible,
+    //! false negatives are not.
+    bool Match(const Element& element) const;
+
+    //! Whether any of the elements may be in the set. This decodes the
+    //! filter only once, however many elements are queried.
+    bool MatchAny(const ElementSet& elements) const;
+};
+
+/** The kinds of block filter we can build and serve. */
+enum class BlockFilterType : uint8_t
+{
+    //! The output scripts of a block and the scripts of the outputs it spends.
+    BASIC = 0,
+    //! The Sprout, Sapling and Orchard nullifiers revealed by a block. Not
+    //! part of BIP 158; lets a light wallet see when its notes are spent.
+    SHIELDED = 1,
+};
+
+/** The name of a filter type, as used by -blockfilterindex and the RPC. */
+const std::string& BlockFilterTypeName(BlockFilterType type);
+
+/** Find the filter type with the given name. */
+bool BlockFilterTypeByName(const std::string& name, BlockFilterType& type);
+
+/** All the filter types we know of. */
+const std::vector<BlockFilterType>& AllBlockFilterTypes();
+
+/**
+ * The filter of one type for one block. The basic filter of a block needs
+ * the undo data written when it was connected, which holds the scripts of
+ * the outputs it spends.
+ */
+class BlockFilter
+{
+private:
+    BlockFilterType filterType;
+    uint256 hashBlock;
+    GCSFilter filter;
+
+public:
+    BlockFilter() : filterType(BlockFilterType::BASIC) {}
+
+    BlockFilter(BlockFilterType filterTypeIn, const CBlock& block, const CBlockUndo& blockundo);
+
+    //! Reconstruct a filter from its encoding, as read from the index or
+    //! received from a peer.
+    BlockFilter(BlockFilterType filterTypeIn, const uint256& hashBlockIn, std::vector<unsigned char> encoded);
+
+    BlockFilterType GetType() const { return filterType; }
+    const uint256& GetBlockHash() const { return hashBlock; }
+    const GCSFilter& GetFilter() const { return filter; }
+    const std::vector<unsigned char>& GetEncodedFilter() const { return filter.GetEncoded(); }
+
+    //! The hash of the encoded filter.
+    uint256 GetHash() const;
+
+    //! The header of the filter, which commits to the filters of all the
+    //! blocks before it: the hash of the filter hash and the previous header.
+    //! The genesis block filter commits to a header of zero.
+    uint256 ComputeHeader(const uint256& prevHeader) const;
+
+    ADD_SERIALIZE_METHODS;
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream& s, Operation ser_action) {
+        uint8_t nType = static_cast<uint8_t>(filterType);
+        READWRITE(nType);
+        READWRITE(hashBlock);
+        std::vector<unsigned char> encoded;
+        if (!ser_action.ForRead()) {
+            encoded = filter.GetEncoded();
+        }
+        READWRITE(encoded);
+        if (ser_action.ForRead()) {
+            filterType = static_cast<BlockFilterType>(nType);
+            if (BlockFilterTypeName(filterType).empty()) {
+                throw std::ios_base::failure("unknown block filter type");
+            }
+            filter = GCSFilter(hashBlock, std::move(encoded));
+        }
+    }
+};
+
+#endif // ZCASH_BLOCKFILTER_H
@@ -0,0 +1,274 @@
+// Copyright (c) 2026 The Zcash developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or https://www.opensource.org/licenses/mit-license.php .
+
+#include "blockfilterindex.h"
+
+#include "chain.h"
+#include "chainparams.h"
+#include "init.h"
+#include "main.h"
+#include "primitives/block.h"
+#include "undo.h"
+#include "util/system.h"
+#include "util/time.h"
+
+std::map<BlockFilterType, CBlockFilterIndex*> mapBlockFilterIndexes;
+
+namespace {
+
+static const char DB_FILTER_HEADER = 'h';
+static const char DB_FILTER = 'f';
+static const char DB_BEST_BLOCK = 'B';
+
+//! Write the filters collected by the sync thread once they take this many bytes.
+static const size_t SYNC_BATCH_SIZE = 16 << 20;
+//! Write the filters of connected blocks before the next flush once they
+//! take this many bytes.
+static const size_t MAX_UNFLUSHED_SIZE = 16 << 20;
+
+}
+
+CBlockFilterIndex::CBlockFilterIndex(BlockFilterType filterTypeIn, size_t nCacheSize, bool fMemory, bool fWipe, const CDBOptions& dbOptions) :
+    filterType(filterTypeIn),
+    db(GetDataDir() / "indexes" / "blockfilter" / BlockFilterTypeName(filterTypeIn), nCacheSize, fMemory, fWipe, dbOptions)
+{
+}
+
+CBlockFilterIndex::~CBlockFilterIndex()
+{
+    Stop();
+}
+
+void CBlockFilterIndex::Init()
+{
+    AssertLockHeld(cs_main);
+    uint256 hashBest;
+    if (db.Read(DB_BEST_BLOCK, hashBest)) {
+        BlockMap::const_iterator it = mapBlockIndex.find(hashBest);
+        if (it != mapBlockIndex.end()) {
+            pindexBest = it->second;
+        }
+    }
+    syncThread = std::thread(&CBlockFilterIndex::ThreadSync, this);
+}
+
+bool CBlockFilterIndex::ReadHeader(const uint256& hashBlock, CBlockFilterHeader& entry) const
+{
+    return db.Read(std::make_pair(DB_FILTER_HEADER, hashBlock), entry);
+}
+
+void CBlockFilterIndex::ThreadSync()
+{
+    RenameThread("zc-blockfilter");
+    const std::string& strName = BlockFilterTypeName(filterType);
+    const Consensus::Params& consensusParams = Params().GetConsensus();
+    try {
+        const CBlockIndex* pindex;
+        {
+            LOCK(cs_main);
+            pindex = pindexBest;
+        }
+        // The header of the filter of pindex, which the next filter commits to.
+        uint256 prevHeader;
+        const CBlockIndex* pindexPrevHeader = NULL;
+        CDBBatch batch(db);
+        int nBlocks = 0;
+        int64_t nStart = GetTimeMillis();
+
+        while (true) {
+            if (fStopSync || ShutdownRequested()) {
+                if (pindex != NULL) {
+                    batch.Write(DB_BEST_BLOCK, pindex->GetBlockHash());
+                }
+                db.WriteBatch(batch);
+                return;
+            }
+
+            const CBlockIndex* pindexNext;
+            CDiskBlockPos blockPos;
+            CDiskBlockPos undoPos;
+            {
+                LOCK(cs_main);
+                if (pindex != NULL && !chainActive.Contains(pindex)) {
+                    pindex = chainActive.FindFork(pindex);
+                }
+                if (pindex == chainActive.Tip()) {
+                    if (pindex != NULL) {
+                        batch.Write(DB_BEST_BLOCK, pindex->GetBlockHash());
+                    }
+                    if (!db.WriteBatch(batch)) {
+                        LogPrintf("%s: failed to write %s block filters\n", __func__, strName);
+                        return;
+                    }
+                    pindexBest = pindex;
+                    fSynced = true;
+                    LogPrintf("Indexed %s filters of %d blocks in %dms\n", strName, nBlocks, GetTimeMillis() - nStart);
+                    return;
+                }
+                pindexNext = pindex == NULL ? chainActive.Genesis() : chainActive.Next(pindex);
+                if (!(pindexNext->nStatus & BLOCK_HAVE_DATA) ||
+                    (pindexNext->pprev != NULL && !(pindexNext->nStatus & BLOCK_HAVE_UNDO))) {
+                    LogPrintf("%s: data of block %s is not available, stopped indexing %s filters\n",
+                        __func__, pindexNext->GetBlockHash().ToString(), strName);
+                    return;
+                }
+                blockPos = pindexNext->GetBlockPos();
+                undoPos = pindexNext->GetUndoPos();
+            }
+
+            if (pindex != pindexPrevHeader) {
+                // Moved back to a fork point, whose header may have been
+                // collected but not written yet.
+                if (!db.WriteBatch(batch)) {
+                    LogPrintf("%s: failed to write %s block filters\n", __func__, strName);
+                    return;
+                }
+                batch.Clear();
+                CBlockFilterHeader entry;
+                if (pindex != NULL && !ReadHeader(pindex->GetBlockHash(), entry)) {
+                    LogPrintf("%s: header of %s filter of block %s is missing\n",
+                        __func__, strName, pindex->GetBlockHash().ToString());
+                    return;
+                }
+                prevHeader = entry.header;
+                pindexPrevHeader = pindex;
+            }
+
+            CBlock block;
+            CBlockUndo blockundo;
+            if (!ReadBlockFromDisk(block, blockPos, consensusParams) ||
+                (pindexNext->pprev != NULL && !UndoReadFromDisk(blockundo, undoPos, pindexNext->pprev->GetBlockHash()))) {
+                LogPrintf("%s: failed to read block %s, stopped indexing %s filters\n",
+                    __func__, pindexNext->GetBlockHash().ToString(), strName);
+                return;
+            }
+
+            BlockFilter filter(filterType, block, blockundo);
+            CBlockFilterHeader entry(filter.GetHash(), filter.ComputeHeader(prevHeader));
+            batch.Write(std::make_pair(DB_FILTER_HEADER, filter.GetBlockHash()), entry);
+            batch.Write(std::make_pair(DB_FILTER, filter.GetBlockHash()), filter.GetEncodedFilter());
+            prevHeader = entry.header;
+            pindex = pindexPrevHeader = pindexNext;
+            nBlocks++;
+
+            if (batch.SizeEstimate() > SYNC_BATCH_SIZE) {
+                batch.Write(DB_BEST_BLOCK, pindex->GetBlockHash());
+                if (!db.WriteBatch(batch)) {
+                    LogPrintf("%s: failed to write %s block filters\n", __func__, strName);
+                    return;
+                }
+                batch.Clear();
+                LogPrint("blockfilter", "Indexed %s filters up to height %d\n", strName, pindex->nHeight);
+            }
+        }
+    } catch (const std::exception& e) {
+        LogPrintf("%s: %s\n", __func__, e.what());
+    }
+}
+
+void CBlockFilterIndex::BlockConnected(const CBlock& block, const CBlockUndo& blockundo, const CBlockIndex* pindex)
+{
+    AssertLockHeld(cs_main);
+    // Until the sync thread has caught up, it indexes connected blocks itself.
+    if (!fSynced) {
+        return;
+    }
+    CBlockFilterHeader prevEntry;
+    if (pindex->pprev != NULL && !LookupFilterHeader(pindex->pprev, prevEntry)) {
+        LogPrintf("%s: header of %s filter of block %s is missing\n",
+            __func__, BlockFilterTypeName(filterType), pindex->pprev->GetBlockHash().ToString());
+        return;
+    }
+    BlockFilter filter(filterType, block, blockundo);
+    CBlockFilterHeader entry(filter.GetHash(), filter.ComputeHeader(prevEntry.header));
+    nUnflushedBytes += filter.GetEncodedFilter().size();
+    mapUnflushed[pindex->GetBlockHash()] = std::make_pair(entry, filter.GetEncodedFilter());
+    pindexBest = pindex;
+    fBestDirty = true;
+
+    if (nUnflushedBytes > MAX_UNFLUSHED_SIZE) {
+        WriteUnflushed();
+    }
+}
+
+void CBlockFilterIndex::BlockDisconnected(const CBlockIndex* pindex)
+{
+    AssertLockHeld(cs_main);
+    // The filter of the block stays in the index, in case it is connected
+    // again.
+    if (fSynced && pindexBest == pindex) {
+        pindexBest = pindex->pprev;
+        fBestDirty = true;
+    }
+}
+
+bool CBlockFilterIndex::WriteUnflushed()
+{
+    CDBBatch batch(db);
+    for (const auto& entry : mapUnflushed) {
+        batch.Write(std::make_pair(DB_FILTER_HEADER, entry.first), entry.second.first);
+        batch.Write(std::make_pair(DB_FILTER, entry.first), entry.second.second);
+    }
+    if (fBestDirty && pindexBest != NULL) {
+        batch.Write(DB_BEST_BLOCK, pindexBest->GetBlockHash());
+    }
+    if (!db.WriteBatch(batch)) {
+        return error("%s: failed to write %s block filters", __func__, BlockFilterTypeName(filterType));
+    }
+    mapUnflushed.clear();
+    nUnflushedBytes = 0;
+    fBestDirty = false;
+    return true;
+}
+
+bool CBlockFilterIndex::Flush()
+{
+    AssertLockHeld(cs_main);
+    // While the sync thread runs, it writes what it has indexed itself.
+    if (!fSynced || (mapUnflushed.empty() && !fBestDirty)) {
+        return true;
+    }
+    return WriteUnflushed();
+}
+
+void CBlockFilterIndex::Stop()
+{
+    fStopSync = true;
+    if (syncThread.joinable()) {
+        syncThread.join();
+    }
+}
+
+bool CBlockFilterIndex::LookupFilter(const CBlockIndex* pindex, BlockFilter& filter) const
+{
+    AssertLockHeld(cs_main);
+    uint256 hash = pindex->GetBlockHash();
+    std::vector<unsigned char> encoded;
+    auto it = mapUnflushed.find(hash);
+    if (it != mapUnflushed.end()) {
+        encoded = it->second.second;
+    } else if (!db.Read(std::make_pair(DB_FILTER, hash), encoded)) {
+        return false;
+    }
+    filter = BlockFilter(filterType, hash, std::move(encoded));
+    return true;
+}
+
+bool CBlockFilterIndex::LookupFilterHeader(const CBlockIndex* pindex, CBlockFilterHeader& entry) const
+{
+    AssertLockHeld(cs_main);
+    uint256 hash = pindex->GetBlockHash();
+    auto it = mapUnflushed.find(hash);
+    if (it != mapUnflushed.end()) {
+        entry = it->second.first;
+        return true;
+    }
+    return ReadHeader(hash, entry);
+}
+
+CBlockFilterIndex* GetBlockFilterIndex(BlockFilterType filterType)
+{
+    auto it = mapBlockFilterIndexes.find(filterType);
+    return it == mapBlockFilterIndexes.end() ? NULL : it->second;
+}
@@ -0,0 +1,123 @@
+// Copyright (c) 2026 The Zcash developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or https://www.opensource.org/licenses/mit-license.php .
+
+#ifndef ZCASH_BLOCKFILTERINDEX_H
+#define ZCASH_BLOCKFILTERINDEX_H
+
+#include "blockfilter.h"
+#include "dbwrapper.h"
+#include "serialize.h"
+#include "uint256.h"
+
+#include <atomic>
+#include <map>
+#include <stdint.h>
+#include <thread>
+#include <vector>
+
+class CBlock;
+class CBlockIndex;
+class CBlockUndo;
+
+//! -peerblockfilters default
+static const bool DEFAULT_PEERBLOCKFILTERS = false;
+//! Maximum cache of the block filter databases, in MiB, shared between them
+static const int64_t MAX_BLOCK_FILTER_DB_CACHE = 1024;
+
+/** The hash of a block filter and its header, as kept in the index. */
+struct CBlockFilterHeader
+{
+    uint256 hashFilter;
+    uint256 header;
+
+    CBlockFilterHeader() {}
+    CBlockFilterHeader(const uint256& hashFilterIn, const uint256& headerIn) : hashFilter(hashFilterIn), header(headerIn) {}
+
+    ADD_SERIALIZE_METHODS;
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream& s, Operation ser_action) {
+        READWRITE(hashFilter);
+        READWRITE(header);
+    }
+};
+
+/**
+ * Keeps the filters of one type of the blocks of the active chain, along
+ * with their hashes and headers, in its own database under
+ * indexes/blockfilter.
+ *
+ * Entries are keyed by block hash and do not depend on which chain the
+ * block is in, so a reorg only moves the best indexed block back. Blocks
+ * connected while the index is behind the active chain, because it has just
+ * been enabled or the node was not shut down cleanly, are indexed by a
+ * background thread that reads them from disk; once it has caught up, the
+ * filters are built as blocks are connected.
+ *
+ * All methods except Stop() must be called with cs_main held.
+ */
+class CBlockFilterIndex
+{
+private:
+    const BlockFilterType filterType;
+    CDBWrapper db;
+
+    //! The last block of the active chain whose filter is indexed.
+    const CBlockIndex* pindexBest = nullptr;
+    bool fBestDirty = false;
+    //! Whether the background thread has caught up with the active chain.
+    bool fSynced = false;
+
+    //! Filters of blocks connected since the last write to the database.
+    std::map<uint256, std::pair<CBlockFilterHeader, std::vector<unsigned char>>> mapUnflushed;
+    size_t nUnflushedBytes = 0;
+
+    std::thread syncThread;
+    std::atomic<bool> fStopSync{false};
+
+    void ThreadSync();
+    bool ReadHeader(const uint256& hashBlock, CBlockFilterHeader& entry) const;
+    bool WriteUnflushed();
+
+    CBlockFilterIndex(const CBlockFilterIndex&) = delete;
+    CBlockFilterIndex& operator=(const CBlockFilterIndex&) = delete;
+
+public:
+    CBlockFilterIndex(BlockFilterType filterTypeIn, size_t nCacheSize, bool fMemory = false, bool fWipe = false, const CDBOptions& dbOptions = CDBOptions());
+    ~CBlockFilterIndex();
+
+    BlockFilterType GetFilterType() const { return filterType; }
+
+    //! Load the best indexed block and start catching up with the active
+    //! chain in the background.
+    void Init();
+
+    void BlockConnected(const CBlock& block, const CBlockUndo& blockundo, const CBlockIndex* pindex);
+    void BlockDisconnected(const CBlockIndex* pindex);
+
+    //! Write the filters of recent blocks to the database.
+    bool Flush();
+
+    //! Stop catching up with the active chain, if that is in progress.
+    void Stop();
+
+    bool IsSynced() const { return fSynced; }
+    const CBlockIndex* GetBestBlock() const { return pindexBest; }
+
+    //! Look up the filter of a block. Returns false if it has not been
+    //! indexed yet.
+    bool LookupFilter(const CBlockIndex* pindex, BlockFilter& filter) const;
+
+    //! Look up the hash and header of the filter of a block.
+    bool LookupFilterHeader(const CBlockIndex* pindex, CBlockFilterHeader& entry) const;
+};
+
+/** The enabled filter indexes, by type. Kept up to date by ConnectTip and
+ *  DisconnectTip. */
+extern std::map<BlockFilterType, CBlockFilterIndex*> mapBlockFilterIndexes;
+
+/** The index of the given filter type, or NULL if it is not enabled. */
+CBlockFilterIndex* GetBlockFilterIndex(BlockFilterType filterType);
+
+#endif // ZCASH_BLOCKFILTERINDEX_H
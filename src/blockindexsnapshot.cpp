@@ -0,0 +1,328 @@
+// Copyright (c) 2026 The Zcash developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or https://www.opensource.org/licenses/mit-license.php .
+
+#include "blockindexsnapshot.h"
+
+#include "arith_uint256.h"
+#include "blockreader.h"
+#include "clientversion.h"
+#include "hash.h"
+#include "streams.h"
+#include "util/system.h"
+
+#include <algorithm>
+#include <atomic>
+#include <optional>
+#include <thread>
+#include <unordered_map>
+
+bool fBlockIndexSnapshot = DEFAULT_BLOCK_INDEX_SNAPSHOT;
+
+namespace {
+
+static const uint32_t SNAPSHOT_MAGIC = 0x78696b62;
+static const uint32_t SNAPSHOT_VERSION = 1;
+//! How many records are hashed together, and handed to a thread at a time.
+static const size_t RECORDS_PER_CHUNK = 16384;
+//! The record number of a missing parent or skip entry.
+static const uint32_t NO_RECORD = 0xffffffff;
+
+struct SnapshotHeader
+{
+    uint32_t nMagic = SNAPSHOT_MAGIC;
+    uint32_t nVersion = SNAPSHOT_VERSION;
+    uint32_t nRecordSize = 0;
+    uint32_t nRecords = 0;
+    uint256 hashBestBlock;
+
+    ADD_SERIALIZE_METHODS;
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream& s, Operation ser_action) {
+        READWRITE(nMagic);
+        READWRITE(nVersion);
+        READWRITE(nRecordSize);
+        READWRITE(nRecords);
+        READWRITE(hashBestBlock);
+    }
+};
+
+// Optional values are written with a value even when they are missing, so
+// that every record has the same size.
+template <typename Stream, typename T>
+void WriteFixed(Stream& s, const std::optional<T>& value)
+{
+    s << (uint8_t)(value ? 1 : 0) << (value ? *value : T());
+}
+
+template <typename Stream, typename T>
+void ReadFixed(Stream& s, std::optional<T>& value)
+{
+    uint8_t fPresent;
+    T v;
+    s >> fPresent >> v;
+    if (fPresent) {
+        value = v;
+    } else {
+        value = std::nullopt;
+    }
+}
+
+template <typename Stream>
+void WriteFixed(Stream& s, const OptionalAmount& value)
+{
+    WriteFixed(s, std::optional<CAmount>(value));
+}
+
+template <typename Stream>
+void ReadFixed(Stream& s, OptionalAmount& value)
+{
+    std::optional<CAmount> v;
+    ReadFixed(s, v);
+    value = v;
+}
+
+void WriteRecord(CDataStream& s, const CBlockIndex& index, uint32_t nPrev, uint32_t nSkip)
+{
+    s << index.GetBlockHash() << nPrev << nSkip;
+    s << index.nHeight << index.nFile << index.nDataPos << index.nUndoPos << index.nStatus;
+    s << ArithToUint256(index.nChainWork) << index.nTx << index.nChainTx;
+    WriteFixed(s, index.nCachedBranchId);
+    s << index.nVersion << index.hashMerkleRoot << index.hashBlockCommitments;
+    s << index.nTime << index.nBits << index.nNonce;
+    s << index.hashSproutAnchor << index.hashFinalSaplingRoot << index.hashFinalOrchardRoot;
+    s << index.hashChainHistoryRoot << index.hashAuthDataRoot;
+    WriteFixed(s, index.nChainSupplyDelta);
+    WriteFixed(s, index.nChainTotalSupply);
+    WriteFixed(s, index.nTransparentValue);
+    WriteFixed(s, index.nChainTransparentValue);
+    WriteFixed(s, index.nSproutValue);
+    WriteFixed(s, index.nChainSproutValue);
+    s << index.nSaplingValue;
+    WriteFixed(s, index.nChainSaplingValue);
+    s << index.nOrchardValue;
+    WriteFixed(s, index.nChainOrchardValue);
+    s << index.nLockboxValue;
+    WriteFixed(s, index.nChainLockboxValue);
+}
+
+//! Read record nRecord into index, and its block hash into hash. Parent and
+//! skip entries must come before the entry.
+void ReadRecord(SpanReader& s, uint32_t nRecord, const std::vector<CBlockIndex*>& vIndex, CBlockIndex& index, uint256& hash)
+{
+    uint32_t nPrev, nSkip;
+    s >> hash >> nPrev >> nSkip;
+    if ((nPrev != NO_RECORD && nPrev >= nRecord) || (nSkip != NO_RECORD && nSkip >= nRecord)) {
+        throw std::ios_base::failure("ReadRecord(): invalid parent or skip record");
+    }
+    index.pprev = nPrev == NO_RECORD ? nullptr : vIndex[nPrev];
+    index.pskip = nSkip == NO_RECORD ? nullptr : vIndex[nSkip];
+
+    uint256 nChainWork;
+    s >> index.nHeight >> index.nFile >> index.nDataPos >> index.nUndoPos >> index.nStatus;
+    s >> nChainWork >> index.nTx >> index.nChainTx;
+    index.nChainWork = UintToArith256(nChainWork);
+    ReadFixed(s, index.nCachedBranchId);
+    s >> index.nVersion >> index.hashMerkleRoot >> index.hashBlockCommitments;
+    s >> index.nTime >> index.nBits >> index.nNonce;
+    s >> index.hashSproutAnchor >> index.hashFinalSaplingRoot >> index.hashFinalOrchardRoot;
+    s >> index.hashChainHistoryRoot >> index.hashAuthDataRoot;
+    ReadFixed(s, index.nChainSupplyDelta);
+    ReadFixed(s, index.nChainTotalSupply);
+    ReadFixed(s, index.nTransparentValue);
+    ReadFixed(s, index.nChainTransparentValue);
+    ReadFixed(s, index.nSproutValue);
+    ReadFixed(s, index.nChainSproutValue);
+    s >> index.nSaplingValue;
+    ReadFixed(s, index.nChainSaplingValue);
+    s >> index.nOrchardValue;
+    ReadFixed(s, index.nChainOrchardValue);
+    s >> index.nLockboxValue;
+    ReadFixed(s, index.nChainLockboxValue);
+}
+
+}
+
+bool WriteBlockIndexSnapshot(const fs::path& path, const BlockMap& mapBlockIndexIn, const uint256& hashBestBlock, uint256& hashSnapshot)
+{
+    if (mapBlockIndexIn.empty()) {
+        return false;
+    }
+
+    // Parents come before their children, and skip entries before the
+    // entries that skip to them, so that records only refer back.
+    std::vector<const CBlockIndex*> vSorted;
+    vSorted.reserve(mapBlockIndexIn.size());
+    for (const auto& entry : mapBlockIndexIn) {
+        vSorted.push_back(entry.second);
+    }
+    std::sort(vSorted.begin(), vSorted.end(), [](const CBlockIndex* a, const CBlockIndex* b) {
+        return a->nHeight < b->nHeight;
+    });
+    std::unordered_map<const CBlockIndex*, uint32_t> mapRecords;
+    mapRecords.reserve(vSorted.size());
+    for (size_t i = 0; i < vSorted.size(); i++) {
+        mapRecords.emplace(vSorted[i], i);
+    }
+    auto record = [&](const CBlockIndex* pindex) {
+        return pindex == nullptr ? NO_RECORD : mapRecords.at(pindex);
+    };
+
+    SnapshotHeader header;
+    header.nRecords = vSorted.size();
+    header.hashBestBlock = hashBestBlock;
+    {
+        CDataStream ss(SER_DISK, CLIENT_VERSION);
+        WriteRecord(ss, *vSorted[0], NO_RECORD, NO_RECORD);
+        header.nRecordSize = ss.size();
+    }
+
+    fs::path pathTmp = path;
+    pathTmp += ".new";
+    CAutoFile fileout(fsbridge::fopen(pathTmp, "wb"), SER_DISK, CLIENT_VERSION);
+    if (fileout.IsNull()) {
+        return error("%s: failed to open %s", __func__, pathTmp.string());
+    }
+    try {
+        CHashWriter hasher(SER_GETHASH, 0);
+        fileout << header;
+        hasher << header;
+        for (size_t nBegin = 0; nBegin < vSorted.size(); nBegin += RECORDS_PER_CHUNK) {
+            size_t nEnd = std::min(nBegin + RECORDS_PER_CHUNK, vSorted.size());
+            CDataStream ss(SER_DISK, CLIENT_VERSION);
+            ss.reserve((nEnd - nBegin) * header.nRecordSize);
+            for (size_t i = nBegin; i < nEnd; i++) {
+                WriteRecord(ss, *vSorted[i], record(vSorted[i]->pprev), record(vSorted[i]->pskip));
+            }
+            assert(ss.size() == (nEnd - nBegin) * header.nRecordSize);
+            hasher << Hash(ss.begin(), ss.end());
+            fileout.write(ss.data(), ss.size());
+        }
+        FileCommit(fileout.Get());
+        fileout.fclose();
+        hashSnapshot = hasher.GetHash();
+    } catch (const std::exception& e) {
+        fileout.fclose();
+        fs::remove(pathTmp);
+        return error("%s: failed to write %s: %s", __func__, pathTmp.string(), e.what());
+    }
+    if (!RenameOver(pathTmp, path)) {
+        fs::remove(pathTmp);
+        return error("%s: failed to rename %s", __func__, pathTmp.string());
+    }
+    return true;
+}
+
+bool ReadBlockIndexSnapshot(const fs::path& path, const uint256& hashSnapshot, const uint256& hashBestBlock, int nThreads, BlockMap& mapBlockIndexIn, std::vector<CBlockIndex*>& vSortedByHeight)
+{
+    assert(mapBlockIndexIn.empty());
+    if (!fs::exists(path)) {
+        return false;
+    }
+    CBlockFileMapping mapping(path);
+    if (mapping.IsNull()) {
+        return error("%s: failed to map %s", __func__, path.string());
+    }
+
+    SnapshotHeader header;
+    size_t nHeaderSize;
+    try {
+        SpanReader s(SER_DISK, CLIENT_VERSION, mapping.data(), mapping.size());
+        s >> header;
+        nHeaderSize = mapping.size() - s.size();
+    } catch (const std::exception& e) {
+        return error("%s: failed to read the header of %s: %s", __func__, path.string(), e.what());
+    }
+    if (header.nMagic != SNAPSHOT_MAGIC || header.nVersion != SNAPSHOT_VERSION || header.nRecordSize == 0 ||
+        mapping.size() != nHeaderSize + (size_t)header.nRecords * header.nRecordSize) {
+        return error("%s: %s is not a block index snapshot this version can read", __func__, path.string());
+    }
+    if (header.hashBestBlock != hashBestBlock) {
+        LogPrintf("%s: %s was written for another best block\n", __func__, path.string());
+        return false;
+    }
+
+    const size_t nRecords = header.nRecords;
+    const size_t nChunks = (nRecords + RECORDS_PER_CHUNK - 1) / RECORDS_PER_CHUNK;
+    std::vector<CBlockIndex*> vIndex(nRecords);
+    for (size_t i = 0; i < nRecords; i++) {
+        vIndex[i] = new CBlockIndex();
+    }
+    std::vector<uint256> vHashes(nRecords);
+    std::vector<uint256> vChunkHashes(nChunks);
+    std::atomic<size_t> nNextChunk{0};
+    std::atomic<bool> fFailed{false};
+
+    auto readChunks = [&]() {
+        for (size_t nChunk = nNextChunk++; nChunk < nChunks && !fFailed; nChunk = nNextChunk++) {
+            size_t nBegin = nChunk * RECORDS_PER_CHUNK;
+            size_t nEnd = std::min(nBegin + RECORDS_PER_CHUNK, nRecords);
+            const unsigned char* pchBegin = mapping.data() + nHeaderSize + nBegin * header.nRecordSize;
+            const unsigned char* pchEnd = pchBegin + (nEnd - nBegin) * header.nRecordSize;
+            vChunkHashes[nChunk] = Hash(pchBegin, pchEnd);
+            try {
+                for (size_t i = nBegin; i < nEnd; i++) {
+                    SpanReader s(SER_DISK, CLIENT_VERSION, pchBegin + (i - nBegin) * header.nRecordSize, header.nRecordSize);
+                    ReadRecord(s, i, vIndex, *vIndex[i], vHashes[i]);
+                    if (!s.empty()) {
+                        throw std::ios_base::failure("record size mismatch");
+                    }
+                }
+            } catch (const std::exception& e) {
+                LogPrintf("%s: failed to read %s: %s\n", __func__, path.string(), e.what());
+                fFailed = true;
+            }
+        }
+    };
+    std::vector<std::thread> threads;
+    for (int i = 1; i < nThreads; i++) {
+        threads.emplace_back([&]() {
+            RenameThread("zc-loadindex");
+            readChunks();
+        });
+    }
+    readChunks();
+    for (std::thread& thread : threads) {
+        thread.join();
+    }
+
+    if (!fFailed) {
+        CHashWriter hasher(SER_GETHASH, 0);
+        hasher << header;
+        for (const uint256& hash : vChunkHashes) {
+            hasher << hash;
+        }
+        if (hasher.GetHash() != hashSnapshot) {
+            LogPrintf("%s: %s does not match the block index database\n", __func__, path.string());
+            fFailed = true;
+        }
+    }
+
+    // Only now that the records are known to be good are they added to the
+    // block index.
+    if (!fFailed) {
+        mapBlockIndexIn.reserve(nRecords);
+        for (size_t i = 0; i < nRecords; i++) {
+            auto ret = mapBlockIndexIn.emplace(vHashes[i], vIndex[i]);
+            if (!ret.second) {
+                LogPrintf("%s: %s holds block %s twice\n", __func__, path.string(), vHashes[i].ToString());
+                for (size_t j = 0; j < i; j++) {
+                    mapBlockIndexIn.erase(vHashes[j]);
+                }
+                fFailed = true;
+                break;
+            }
+            vIndex[i]->phashBlock = &ret.first->first;
+        }
+    }
+    if (fFailed) {
+        for (CBlockIndex* pindex : vIndex) {
+            delete pindex;
+        }
+        return false;
+    }
+
+    vSortedByHeight = std::move(vIndex);
+    return true;
+}
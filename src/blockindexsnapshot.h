@@ -0,0 +1,55 @@
+// Copyright (c) 2026 The Zcash developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or https://www.opensource.org/licenses/mit-license.php .
+
+#ifndef ZCASH_BLOCKINDEXSNAPSHOT_H
+#define ZCASH_BLOCKINDEXSNAPSHOT_H
+
+#include "chain.h"
+#include "fs.h"
+#include "main.h"
+#include "uint256.h"
+
+#include <vector>
+
+//! -blockindexsnapshot default
+static const bool DEFAULT_BLOCK_INDEX_SNAPSHOT = true;
+
+/**
+ * A copy of the in-memory block index in a flat file, written at shutdown so
+ * that the next startup does not have to read every entry of the block index
+ * database and recompute what was derived from it.
+ *
+ * Each block index entry takes a record of the same size, in order of
+ * height, and refers to its parent and skip entries by their record numbers,
+ * so that records can be deserialized on several threads. Records also hold
+ * the values that are only kept in memory: the chain work, the number of
+ * transactions in the chain and the value pool totals. Equihash solutions
+ * are left out; they are read from the block index database when needed.
+ *
+ * The records are hashed in chunks, and the snapshot hash covers the header
+ * and the hashes of the chunks. The block index database records the hash
+ * of the snapshot it matches, so that a snapshot is only used if the
+ * database has not been written since the snapshot was.
+ */
+
+/** Whether the block index is loaded from and saved to a snapshot (-blockindexsnapshot). */
+extern bool fBlockIndexSnapshot;
+
+/**
+ * Write the entries of mapBlockIndexIn to path. hashBestBlock is the best
+ * block of the coins database, which the snapshot is only read back with.
+ * Sets hashSnapshot to the hash of the snapshot. Requires cs_main.
+ */
+bool WriteBlockIndexSnapshot(const fs::path& path, const BlockMap& mapBlockIndexIn, const uint256& hashBestBlock, uint256& hashSnapshot);
+
+/**
+ * Read the snapshot at path into mapBlockIndexIn, which must be empty, using
+ * nThreads threads. Fails without changing mapBlockIndexIn if the snapshot
+ * is missing, its hash is not hashSnapshot or it was not written for
+ * hashBestBlock. On success, vSortedByHeight holds the loaded entries in
+ * order of height.
+ */
+bool ReadBlockIndexSnapshot(const fs::path& path, const uint256& hashSnapshot, const uint256& hashBestBlock, int nThreads, BlockMap& mapBlockIndexIn, std::vector<CBlockIndex*>& vSortedByHeight);
+
+#endif // ZCASH_BLOCKINDEXSNAPSHOT_H
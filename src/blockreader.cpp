@@ -0,0 +1,299 @@
+// Copyright (c) 2026 The Zcash developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or https://www.opensource.org/licenses/mit-license.php .
+
+#include "blockreader.h"
+
+#include "blockcompression.h"
+#include "clientversion.h"
+#include "consensus/consensus.h"
+#include "core_memusage.h"
+#include "crypto/common.h"
+#include "main.h"
+#include "protocol.h"
+#include "streams.h"
+
+#include <algorithm>
+
+#include <fcntl.h>
+#ifndef WIN32
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+CBlockReader blockReader;
+CRecentBlocks recentBlocks;
+
+namespace {
+
+//! How many block files to keep mapped.
+static const size_t MAX_BLOCK_FILE_MAPPINGS = 64;
+//! A read that starts at most this far after the previous one is taken to
+//! be part of a sequential scan, such as a rescan.
+static const size_t SEQUENTIAL_READ_GAP = 1 << 20;
+//! How far ahead of a sequential scan to ask the kernel to read.
+static const size_t READ_AHEAD_SIZE = 8 << 20;
+
+}
+
+CBlockFileMapping::CBlockFileMapping(const fs::path& path)
+{
+#ifndef WIN32
+    int fd = open(path.string().c_str(), O_RDONLY);
+    if (fd == -1) {
+        return;
+    }
+    struct stat st;
+    if (fstat(fd, &st) == 0 && st.st_size > 0) {
+        void* p = mmap(nullptr, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+        if (p != MAP_FAILED) {
+            pData = static_cast<const unsigned char*>(p);
+            nSize = st.st_size;
+        }
+    }
+    // The mapping stays valid after the file is closed.
+    close(fd);
+#endif
+}
+
+CBlockFileMapping::~CBlockFileMapping()
+{
+#ifndef WIN32
+    if (pData != nullptr) {
+        munmap(const_cast<unsigned char*>(pData), nSize);
+    }
+#endif
+}
+
+void CBlockFileMapping::WillRead(size_t nBegin, size_t nEnd)
+{
+#ifndef WIN32
+    size_t nLast = nLastEnd.exchange(nEnd);
+    if (nBegin < nLast || nBegin - nLast > SEQUENTIAL_READ_GAP || nEnd >= nSize) {
+        return;
+    }
+    // Keep at least half of the read-ahead window in front of the reads,
+    // without asking for the same range twice.
+    size_t nAdvised = nAdvisedEnd;
+    if (nAdvised >= nEnd + READ_AHEAD_SIZE / 2) {
+        return;
+    }
+    static const size_t nPageSize = sysconf(_SC_PAGESIZE);
+    size_t nStart = std::max(nAdvised, nEnd) & ~(nPageSize - 1);
+    size_t nStop = std::min(nEnd + READ_AHEAD_SIZE, nSize);
+    nAdvisedEnd = nStop;
+    madvise(const_cast<unsigned char*>(pData) + nStart, nStop - nStart, MADV_WILLNEED);
+#endif
+}
+
+std::shared_ptr<CBlockFileMapping> CBlockReader::Map(int nFile, size_t nMinSize)
+{
+#ifdef WIN32
+    return nullptr;
+#else
+    LOCK(cs);
+    for (auto it = listMappings.begin(); it != listMappings.end(); ++it) {
+        if (it->first != nFile) {
+            continue;
+        }
+        if (it->second->size() >= nMinSize) {
+            listMappings.splice(listMappings.begin(), listMappings, it);
+            return it->second;
+        }
+        // Blocks were written to the file after it was mapped. Readers of
+        // the old mapping keep it alive until they are done.
+        listMappings.erase(it);
+        break;
+    }
+
+    std::shared_ptr<CBlockFileMapping> mapping = std::make_shared<CBlockFileMapping>(GetBlockPosFilename(CDiskBlockPos(nFile, 0), "blk"));
+    if (mapping->IsNull() || mapping->size() < nMinSize) {
+        return nullptr;
+    }
+    listMappings.emplace_front(nFile, mapping);
+    if (listMappings.size() > MAX_BLOCK_FILE_MAPPINGS) {
+        listMappings.pop_back();
+    }
+    return mapping;
+#endif
+}
+
+std::shared_ptr<CBlockFileMapping> CBlockReader::MapBlock(const CDiskBlockPos& pos, const unsigned char*& pch, unsigned int& nSize, bool& fCompressed)
+{
+    // The block is preceded by the message start and its size, as written
+    // by WriteBlockToDisk.
+    const size_t nHeaderSize = CMessageHeader::MESSAGE_START_SIZE + sizeof(unsigned int);
+    if (pos.IsNull() || pos.nPos < nHeaderSize) {
+        return nullptr;
+    }
+    std::shared_ptr<CBlockFileMapping> mapping = Map(pos.nFile, pos.nPos);
+    if (!mapping) {
+        return nullptr;
+    }
+    uint32_t nSizeField = ReadLE32(mapping->data() + pos.nPos - sizeof(unsigned int));
+    fCompressed = nSizeField & BLOCK_COMPRESSED_FLAG;
+    nSize = nSizeField & ~BLOCK_COMPRESSED_FLAG;
+    if (nSize > MAX_BLOCK_SIZE) {
+        return nullptr;
+    }
+    if (pos.nPos + nSize > mapping->size()) {
+        mapping = Map(pos.nFile, pos.nPos + nSize);
+        if (!mapping) {
+            return nullptr;
+        }
+    }
+    mapping->WillRead(pos.nPos - nHeaderSize, pos.nPos + nSize);
+    pch = mapping->data() + pos.nPos;
+    return mapping;
+}
+
+std::shared_ptr<const CBlock> CBlockReader::GetCached(const CDiskBlockPos& pos)
+{
+    LOCK(cs);
+    auto it = mapBlocks.find(BlockKey(pos.nFile, pos.nPos));
+    if (it == mapBlocks.end()) {
+        return nullptr;
+    }
+    listBlocks.splice(listBlocks.begin(), listBlocks, it->second.itLRU);
+    return it->second.pblock;
+}
+
+void CBlockReader::AddToCache(const CDiskBlockPos& pos, const CBlock& block)
+{
+    {
+        LOCK(cs);
+        if (nMaxCacheUsage == 0 || mapBlocks.count(BlockKey(pos.nFile, pos.nPos))) {
+            return;
+        }
+    }
+
+    // Copy the block outside the lock.
+    CachedBlock entry;
+    entry.pblock = std::make_shared<const CBlock>(block);
+    entry.nUsage = sizeof(CBlock) + RecursiveDynamicUsage(block);
+
+    LOCK(cs);
+    BlockKey key(pos.nFile, pos.nPos);
+    if (mapBlocks.count(key)) {
+        return;
+    }
+    listBlocks.push_front(key);
+    entry.itLRU = listBlocks.begin();
+    nCacheUsage += entry.nUsage;
+    mapBlocks.emplace(key, std::move(entry));
+    EvictBlocks(nMaxCacheUsage);
+}
+
+void CBlockReader::EvictBlocks(size_t nMaxUsage)
+{
+    AssertLockHeld(cs);
+    while (nCacheUsage > nMaxUsage && !listBlocks.empty()) {
+        auto it = mapBlocks.find(listBlocks.back());
+        nCacheUsage -= it->second.nUsage;
+        mapBlocks.erase(it);
+        listBlocks.pop_back();
+    }
+}
+
+void CBlockReader::SetMaxCacheUsage(size_t nMaxCacheUsageIn)
+{
+    LOCK(cs);
+    nMaxCacheUsage = nMaxCacheUsageIn;
+    EvictBlocks(nMaxCacheUsage);
+}
+
+void CBlockReader::ForgetFile(int nFile)
+{
+    LOCK(cs);
+    listMappings.remove_if([nFile](const std::pair<int, std::shared_ptr<CBlockFileMapping>>& entry) {
+        return entry.first == nFile;
+    });
+    auto it = mapBlocks.lower_bound(BlockKey(nFile, 0));
+    while (it != mapBlocks.end() && it->first.first == nFile) {
+        nCacheUsage -= it->second.nUsage;
+        listBlocks.erase(it->second.itLRU);
+        it = mapBlocks.erase(it);
+    }
+}
+
+size_t CBlockReader::GetCacheUsage() const
+{
+    LOCK(cs);
+    return nCacheUsage;
+}
+
+void CRecentBlocks::Add(const uint256& hash, const std::shared_ptr<const CBlock>& pblock)
+{
+    LOCK(cs);
+    for (const Entry& entry : entries) {
+        if (entry.hash == hash) {
+            return;
+        }
+    }
+    entries.push_back({hash, pblock, nullptr});
+    if (entries.size() > MAX_RECENT_BLOCKS) {
+        entries.pop_front();
+    }
+}
+
+std::shared_ptr<const CBlock> CRecentBlocks::Get(const uint256& hash) const
+{
+    LOCK(cs);
+    for (const Entry& entry : entries) {
+        if (entry.hash == hash) {
+            return entry.pblock;
+        }
+    }
+    return nullptr;
+}
+
+std::shared_ptr<const std::vector<uint8_t>> CRecentBlocks::GetRaw(const uint256& hash)
+{
+    std::shared_ptr<const CBlock> pblock;
+    {
+        LOCK(cs);
+        for (const Entry& entry : entries) {
+            if (entry.hash == hash) {
+                if (entry.pvRaw) {
+                    return entry.pvRaw;
+                }
+                pblock = entry.pblock;
+                break;
+            }
+        }
+    }
+    if (!pblock) {
+        return nullptr;
+    }
+
+    // Serialize the block outside the lock. If several threads ask at once,
+    // the first serialization to be stored is kept.
+    CPublicDataStream ss(SER_DISK, CLIENT_VERSION);
+    ss << *pblock;
+    std::shared_ptr<const std::vector<uint8_t>> pvRaw = std::make_shared<const std::vector<uint8_t>>(ss.begin(), ss.end());
+
+    LOCK(cs);
+    for (Entry& entry : entries) {
+        if (entry.hash == hash) {
+            if (!entry.pvRaw) {
+                entry.pvRaw = pvRaw;
+            }
+            return entry.pvRaw;
+        }
+    }
+    return pvRaw;
+}
+
+void CRecentBlocks::Clear()
+{
+    LOCK(cs);
+    entries.clear();
+}
+
+void AdviseSequentialRead(FILE* file)
+{
+#if defined(POSIX_FADV_SEQUENTIAL)
+    posix_fadvise(fileno(file), 0, 0, POSIX_FADV_SEQUENTIAL);
+#endif
+}
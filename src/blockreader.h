@@ -0,0 +1,161 @@
+// Copyright (c) 2026 The Zcash developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or https://www.opensource.org/licenses/mit-license.php .
+
+#ifndef ZCASH_BLOCKREADER_H
+#define ZCASH_BLOCKREADER_H
+
+#include "chain.h"
+#include "fs.h"
+#include "primitives/block.h"
+#include "sync.h"
+
+#include <atomic>
+#include <deque>
+#include <list>
+#include <map>
+#include <memory>
+#include <stdint.h>
+#include <stdio.h>
+#include <utility>
+#include <vector>
+
+//! -blockreadcache default, in MiB
+static const int64_t DEFAULT_BLOCK_READ_CACHE = 32;
+//! How many of the most recently connected blocks to keep in memory
+static const size_t MAX_RECENT_BLOCKS = 16;
+
+/** A read-only memory mapping of the whole of a block file. */
+class CBlockFileMapping
+{
+private:
+    const unsigned char* pData = nullptr;
+    size_t nSize = 0;
+    //! The end of the last read from the mapping, to detect sequential
+    //! reads, and the end of the range the kernel was asked to read ahead.
+    std::atomic<size_t> nLastEnd{0};
+    std::atomic<size_t> nAdvisedEnd{0};
+
+    CBlockFileMapping(const CBlockFileMapping&) = delete;
+    CBlockFileMapping& operator=(const CBlockFileMapping&) = delete;
+
+public:
+    //! Map the file at path. The mapping is null if that fails.
+    explicit CBlockFileMapping(const fs::path& path);
+    ~CBlockFileMapping();
+
+    bool IsNull() const { return pData == nullptr; }
+    const unsigned char* data() const { return pData; }
+    size_t size() const { return nSize; }
+
+    //! Note that [nBegin, nEnd) is about to be read. If that follows the
+    //! previous read, as when blocks are read in order, ask the kernel to
+    //! read ahead what comes after it.
+    void WillRead(size_t nBegin, size_t nEnd);
+};
+
+/**
+ * Reads blocks out of the block files through memory mappings, so that
+ * reading a block that is in the page cache takes neither a system call nor
+ * a copy into a stdio buffer. The most recently read blocks are also kept
+ * deserialized, so that a block that is asked for again, by peers, RPC
+ * clients or indexes, is neither deserialized nor checked again.
+ *
+ * Block files are not mapped on Windows, where MapBlock returns null and
+ * blocks are read with fread instead.
+ */
+class CBlockReader
+{
+private:
+    typedef std::pair<int, unsigned int> BlockKey;
+
+    struct CachedBlock
+    {
+        std::shared_ptr<const CBlock> pblock;
+        size_t nUsage;
+        std::list<BlockKey>::iterator itLRU;
+    };
+
+    mutable Mutex cs;
+
+    //! Mappings of recently read files, most recently used first.
+    std::list<std::pair<int, std::shared_ptr<CBlockFileMapping>>> listMappings;
+
+    //! Recently read blocks, by position, and their positions, most recently
+    //! used first.
+    std::map<BlockKey, CachedBlock> mapBlocks;
+    std::list<BlockKey> listBlocks;
+    size_t nCacheUsage = 0;
+    size_t nMaxCacheUsage;
+
+    std::shared_ptr<CBlockFileMapping> Map(int nFile, size_t nMinSize);
+    void EvictBlocks(size_t nMaxUsage);
+
+public:
+    explicit CBlockReader(size_t nMaxCacheUsageIn = DEFAULT_BLOCK_READ_CACHE << 20) : nMaxCacheUsage(nMaxCacheUsageIn) {}
+
+    //! Set the memory the cached blocks may take. 0 disables the cache.
+    void SetMaxCacheUsage(size_t nMaxCacheUsageIn);
+
+    //! Map the block that starts at pos, as written by WriteBlockToDisk, and
+    //! set pch to the bytes stored for it, nSize to their number and
+    //! fCompressed to whether they are compressed. The bytes stay valid while
+    //! the returned mapping is held. Returns null if the block file cannot be
+    //! mapped.
+    std::shared_ptr<CBlockFileMapping> MapBlock(const CDiskBlockPos& pos, const unsigned char*& pch, unsigned int& nSize, bool& fCompressed);
+
+    //! The block read from pos earlier, if it is still cached.
+    std::shared_ptr<const CBlock> GetCached(const CDiskBlockPos& pos);
+
+    //! Cache a block that was read and checked.
+    void AddToCache(const CDiskBlockPos& pos, const CBlock& block);
+
+    //! Forget the mapping and the cached blocks of a block file that is
+    //! about to be deleted.
+    void ForgetFile(int nFile);
+
+    size_t GetCacheUsage() const;
+};
+
+extern CBlockReader blockReader;
+
+/**
+ * The blocks most recently connected to the active chain, kept by ConnectTip
+ * for the wallet notification thread, ZMQ, RPC, REST and peers, which all
+ * read those blocks soon after they are connected. Blocks are shared rather
+ * than copied, and so are their serializations, which are only made when
+ * first asked for.
+ */
+class CRecentBlocks
+{
+private:
+    struct Entry
+    {
+        uint256 hash;
+        std::shared_ptr<const CBlock> pblock;
+        std::shared_ptr<const std::vector<uint8_t>> pvRaw;
+    };
+
+    mutable Mutex cs;
+    //! Oldest first.
+    std::deque<Entry> entries;
+
+public:
+    void Add(const uint256& hash, const std::shared_ptr<const CBlock>& pblock);
+
+    //! The block with the given hash, if it was connected recently.
+    std::shared_ptr<const CBlock> Get(const uint256& hash) const;
+
+    //! The serialization of the block with the given hash, as it is stored
+    //! on disk, if the block was connected recently.
+    std::shared_ptr<const std::vector<uint8_t>> GetRaw(const uint256& hash);
+
+    void Clear();
+};
+
+extern CRecentBlocks recentBlocks;
+
+/** Tell the kernel that a file is going to be read from start to end. */
+void AdviseSequentialRead(FILE* file);
+
+#endif // ZCASH_BLOCKREADER_H
@@ -16,6 +16,7 @@
 #include <stdlib.h>
 
 #include <algorithm>
+#include <limits>
 
 #define LN2SQUARED 0.4804530139182014246671025263266649717305529515945455
 #define LN2 0.6931471805599453094172321214581765680755001343602552
@@ -171,6 +172,84 @@ bool CBloomFilter::IsRelevantAndUpdate(const CTransaction& tx)
     return false;
 }
 
+//! The non-empty data pushes of a script, up to the first invalid opcode.
+static void AppendPushes(const CScript& script, std::vector<std::vector<unsigned char>>& vPushes)
+{
+    CScript::const_iterator pc = script.begin();
+    std::vector<unsigned char> data;
+    while (pc < script.end())
+    {
+        opcodetype opcode;
+        if (!script.GetOp(pc, opcode, data))
+            break;
+        if (data.size() != 0)
+            vPushes.push_back(data);
+    }
+}
+
+CBloomFilterableTx::CBloomFilterableTx(const CTransaction& tx) : hash(tx.GetHash())
+{
+    vout.reserve(tx.vout.size());
+    for (const CTxOut& txout : tx.vout) {
+        Output output;
+        AppendPushes(txout.scriptPubKey, output.vPushes);
+        txnouttype type;
+        std::vector<std::vector<unsigned char> > vSolutions;
+        output.fPubKeyOrMultisig = Solver(txout.scriptPubKey, type, vSolutions) &&
+            (type == TX_PUBKEY || type == TX_MULTISIG);
+        vout.push_back(std::move(output));
+    }
+    vPrevouts.reserve(tx.vin.size());
+    for (const CTxIn& txin : tx.vin) {
+        vPrevouts.push_back(txin.prevout);
+        AppendPushes(txin.scriptSig, vInputPushes);
+    }
+}
+
+bool CBloomFilter::IsRelevantAndUpdate(const CBloomFilterableTx& tx)
+{
+    // This must match exactly what IsRelevantAndUpdate(const CTransaction&)
+    // matches, and update the filter in the same way.
+    bool fFound = false;
+    if (vData.empty()) // zero-size = "match-all" filter
+        return true;
+    if (contains(tx.hash))
+        fFound = true;
+
+    for (unsigned int i = 0; i < tx.vout.size(); i++)
+    {
+        const CBloomFilterableTx::Output& output = tx.vout[i];
+        for (const auto& data : output.vPushes)
+        {
+            if (contains(data))
+            {
+                fFound = true;
+                if ((nFlags & BLOOM_UPDATE_MASK) == BLOOM_UPDATE_ALL)
+                    insert(COutPoint(tx.hash, i));
+                else if ((nFlags & BLOOM_UPDATE_MASK) == BLOOM_UPDATE_P2PUBKEY_ONLY && output.fPubKeyOrMultisig)
+                    insert(COutPoint(tx.hash, i));
+                break;
+            }
+        }
+    }
+
+    if (fFound)
+        return true;
+
+    for (const COutPoint& prevout : tx.vPrevouts)
+    {
+        if (contains(prevout))
+            return true;
+    }
+    for (const auto& data : tx.vInputPushes)
+    {
+        if (contains(data))
+            return true;
+    }
+
+    return false;
+}
+
 CRollingBloomFilter::CRollingBloomFilter(const unsigned int nElements, const double fpRate)
 {
     double logFpRate = log(fpRate);
@@ -284,3 +363,86 @@ void CRollingBloomFilter::initialize()
     nGeneration = 1;
     std::fill(data.begin(), data.end(), 0);
 }
+
+CExpandingBloomFilter::CExpandingBloomFilter() : k0(GetRand(std::numeric_limits<uint64_t>::max())), k1(GetRand(std::numeric_limits<uint64_t>::max())) {}
+
+uint64_t CExpandingBloomFilter::Hash(const unsigned char* pch, size_t nSize) const
+{
+    return CSipHasher(k0, k1).Write(pch, nSize).Finalize();
+}
+
+void CExpandingBloomFilter::Set(uint64_t nHash)
+{
+    // Derive the positions from the two halves of the hash; the number of
+    // bits is a power of two.
+    const uint64_t nMask = data.size() * 64 - 1;
+    const uint32_t h1 = nHash;
+    const uint32_t h2 = (nHash >> 32) | 1;
+    for (int n = 0; n < HASH_FUNCS; n++) {
+        uint64_t nBit = (h1 + (uint64_t)n * h2) & nMask;
+        data[nBit >> 6] |= (uint64_t)1 << (nBit & 63);
+    }
+}
+
+void CExpandingBloomFilter::Insert(uint64_t nHash)
+{
+    vHashes.push_back(nHash);
+    size_t nBits = data.size() * 64;
+    if (vHashes.size() * BITS_PER_ELEMENT <= nBits) {
+        Set(nHash);
+        return;
+    }
+
+    nBits = std::max(nBits * 2, MIN_FILTER_BITS);
+    data.assign(nBits / 64, 0);
+    for (uint64_t nOldHash : vHashes) {
+        Set(nOldHash);
+    }
+}
+
+bool CExpandingBloomFilter::Contains(uint64_t nHash) const
+{
+    if (data.empty()) {
+        return false;
+    }
+    const uint64_t nMask = data.size() * 64 - 1;
+    const uint32_t h1 = nHash;
+    const uint32_t h2 = (nHash >> 32) | 1;
+    for (int n = 0; n < HASH_FUNCS; n++) {
+        uint64_t nBit = (h1 + (uint64_t)n * h2) & nMask;
+        if (!((data[nBit >> 6] >> (nBit & 63)) & 1)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+void CExpandingBloomFilter::insert(const std::vector<unsigned char>& vKey)
+{
+    Insert(Hash(vKey.data(), vKey.size()));
+}
+
+void CExpandingBloomFilter::insert(const uint256& hash)
+{
+    Insert(Hash(hash.begin(), hash.size()));
+}
+
+void CExpandingBloomFilter::insert(const CScript& script)
+{
+    Insert(Hash(script.empty() ? nullptr : &script[0], script.size()));
+}
+
+bool CExpandingBloomFilter::contains(const std::vector<unsigned char>& vKey) const
+{
+    return Contains(Hash(vKey.data(), vKey.size()));
+}
+
+bool CExpandingBloomFilter::contains(const uint256& hash) const
+{
+    return Contains(Hash(hash.begin(), hash.size()));
+}
+
+bool CExpandingBloomFilter::contains(const CScript& script) const
+{
+    return Contains(Hash(script.empty() ? nullptr : &script[0], script.size()));
+}
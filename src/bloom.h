@@ -6,13 +6,13 @@
 #ifndef BITCOIN_BLOOM_H
 #define BITCOIN_BLOOM_H
 
+#include "primitives/transaction.h"
 #include "serialize.h"
+#include "uint256.h"
 
 #include <vector>
 
-class COutPoint;
-class CTransaction;
-class uint256;
+class CScript;
 
 //! 20,000 items with fp rate < 0.1% or 10,000 items and <0.0001%
 static const unsigned int MAX_BLOOM_FILTER_SIZE = 36000; // bytes
@@ -31,6 +31,31 @@ enum bloomflags
     BLOOM_UPDATE_MASK = 3,
 };
 
+/**
+ * The parts of a transaction that CBloomFilter::IsRelevantAndUpdate looks
+ * at, with the scripts already split into their data pushes, so that the
+ * transaction can be matched against the filters of many peers without
+ * parsing its scripts for each of them.
+ */
+struct CBloomFilterableTx
+{
+    struct Output
+    {
+        //! The non-empty data pushes of the scriptPubKey, in order.
+        std::vector<std::vector<unsigned char>> vPushes;
+        //! Whether the scriptPubKey pays to a public key or is a multisig.
+        bool fPubKeyOrMultisig;
+    };
+
+    uint256 hash;
+    std::vector<Output> vout;
+    std::vector<COutPoint> vPrevouts;
+    //! The non-empty data pushes of the scriptSigs of all of the inputs.
+    std::vector<std::vector<unsigned char>> vInputPushes;
+
+    explicit CBloomFilterableTx(const CTransaction& tx);
+};
+
 /**
  * BloomFilter is a probabilistic filter which SPV clients provide
  * so that we can filter the transactions we send them.
@@ -89,6 +114,8 @@ public:
 
     //! Also adds any outputs which match the filter to the filter (to match their spending txes)
     bool IsRelevantAndUpdate(const CTransaction& tx);
+    //! The same as above, for a transaction whose scripts were parsed beforehand.
+    bool IsRelevantAndUpdate(const CBloomFilterableTx& tx);
 };
 
 /**
@@ -146,4 +173,47 @@ private:
     int nHashFuncs;
 };
 
+/**
+ * ExpandingBloomFilter is a probabilistic set that never forgets an element.
+ * It doubles in size as elements are inserted, to keep a false positive rate
+ * of about 0.2% (16 bits and 4 hash functions per element) however many
+ * there are. The 64-bit salted hash of each inserted element is kept, so that
+ * the filter can be resized without the elements themselves.
+ *
+ * It is meant for sets, such as the scripts that a wallet watches, that are
+ * queried much more often than they are added to, and whose elements would be
+ * costly to enumerate again.
+ */
+class CExpandingBloomFilter
+{
+public:
+    // A random bloom filter calls GetRand() at creation time.
+    // Don't create global CExpandingBloomFilter objects, as they may be
+    // constructed before the randomizer is properly initialized.
+    CExpandingBloomFilter();
+
+    void insert(const std::vector<unsigned char>& vKey);
+    void insert(const uint256& hash);
+    void insert(const CScript& script);
+    bool contains(const std::vector<unsigned char>& vKey) const;
+    bool contains(const uint256& hash) const;
+    bool contains(const CScript& script) const;
+
+    size_t size() const { return vHashes.size(); }
+
+private:
+    static const size_t BITS_PER_ELEMENT = 16;
+    static const size_t MIN_FILTER_BITS = 1024;
+    static const int HASH_FUNCS = 4;
+
+    uint64_t Hash(const unsigned char* pch, size_t nSize) const;
+    void Insert(uint64_t nHash);
+    bool Contains(uint64_t nHash) const;
+    void Set(uint64_t nHash);
+
+    const uint64_t k0, k1;
+    std::vector<uint64_t> vHashes;
+    std::vector<uint64_t> data;
+};
+
 #endif // BITCOIN_BLOOM_H
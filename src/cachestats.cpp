@@ -0,0 +1,78 @@
+// Copyright (c) 2026 The Zcash developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or https://www.opensource.org/licenses/mit-license.php .
+
+#include "cachestats.h"
+
+#include "filteredblockcache.h"
+#include "main.h"
+#include "pow.h"
+#include "rpc/treestatecache.h"
+#include "script/sigcache.h"
+#include "sync.h"
+#include "txdb.h"
+#include "zcash/cache.h"
+
+#include <map>
+
+#include <boost/algorithm/string/case_conv.hpp>
+
+#include <rust/metrics.h>
+
+std::vector<std::pair<std::string, CCacheStats>> GetCacheStats()
+{
+    std::vector<std::pair<std::string, CCacheStats>> vStats;
+    vStats.emplace_back("signatures", GetSignatureCacheStats());
+    vStats.emplace_back("script_executions", GetScriptExecutionCacheStats());
+    vStats.emplace_back("equihash_solutions", GetEquihashCacheStats());
+    vStats.emplace_back("tree_states", GetTreeStateCacheStats());
+    vStats.emplace_back("filterable_blocks", filteredBlockCache.GetBlockStats());
+    vStats.emplace_back("filtered_blocks", filteredBlockCache.GetResultStats());
+    for (const auto& [strKind, pcache] : libzcash::GetBundleValidityCaches()) {
+        vStats.emplace_back(boost::to_lower_copy(strKind) + "_bundles", pcache->GetStats());
+    }
+
+    LOCK(cs_main);
+    if (pcoinsTip) {
+        vStats.emplace_back("coins", pcoinsTip->GetCoinsCacheStats());
+        vStats.emplace_back("nullifiers", pcoinsTip->GetNullifiersCacheStats());
+        vStats.emplace_back("anchors", pcoinsTip->GetAnchorsCacheStats());
+    }
+    if (fSpentIndex && pinsightdb) {
+        vStats.emplace_back("spent_index", pinsightdb->GetSpentIndexCacheStats());
+    }
+    vStats.emplace_back("recent_rejects", GetRecentRejectsStats());
+    vStats.emplace_back("invalid_txs", GetTxRejectCacheStats());
+    return vStats;
+}
+
+static Mutex cs_cacheMetrics;
+//! The counters as they were last exported, by cache.
+static std::map<std::string, CCacheStats> mapExported GUARDED_BY(cs_cacheMetrics);
+
+//! The increase of a counter since it was last exported. A counter that
+//! went down belongs to a cache that was created again.
+static uint64_t Increase(uint64_t nValue, uint64_t nExported)
+{
+    return nValue >= nExported ? nValue - nExported : nValue;
+}
+
+void UpdateCacheMetrics()
+{
+    auto vStats = GetCacheStats();
+
+    LOCK(cs_cacheMetrics);
+    for (const auto& [strName, stats] : vStats) {
+        const char* pszName = strName.c_str();
+        CCacheStats& exported = mapExported[strName];
+        MetricsCounter("zcash.cache.hits", Increase(stats.nHits, exported.nHits), "cache", pszName);
+        MetricsCounter("zcash.cache.misses", Increase(stats.nMisses, exported.nMisses), "cache", pszName);
+        MetricsCounter("zcash.cache.insertions", Increase(stats.nInsertions, exported.nInsertions), "cache", pszName);
+        MetricsCounter("zcash.cache.evictions", Increase(stats.nEvictions, exported.nEvictions), "cache", pszName);
+        MetricsGauge("zcash.cache.entries", stats.nEntries, "cache", pszName);
+        if (stats.nMemoryUsage > 0) {
+            MetricsGauge("zcash.cache.memory.bytes", stats.nMemoryUsage, "cache", pszName);
+        }
+        exported = stats;
+    }
+}
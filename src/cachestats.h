@@ -0,0 +1,61 @@
+// Copyright (c) 2026 The Zcash developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or https://www.opensource.org/licenses/mit-license.php .
+
+#ifndef ZCASH_CACHESTATS_H
+#define ZCASH_CACHESTATS_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string>
+#include <utility>
+#include <vector>
+
+//! How often the cache statistics are exported as metrics, in seconds.
+static const int64_t CACHE_METRICS_INTERVAL = 10;
+
+/** How much one of the internal caches has been used, and how full it is. */
+struct CCacheStats
+{
+    uint64_t nHits = 0;
+    uint64_t nMisses = 0;
+    uint64_t nInsertions = 0;
+    uint64_t nEvictions = 0;
+    //! The number of entries the cache holds.
+    uint64_t nEntries = 0;
+    //! The number of entries the cache can hold, or 0 if it is bounded by
+    //! its memory usage instead.
+    uint64_t nMaxEntries = 0;
+    //! The memory used by the cache, in bytes, or 0 if it is not known.
+    size_t nMemoryUsage = 0;
+};
+
+/** The statistics of a CuckooCache::cache of the given element type. */
+template <typename Element, typename Cache>
+CCacheStats CuckooCacheStats(const Cache& cache)
+{
+    auto stats = cache.get_stats();
+    CCacheStats result;
+    result.nHits = stats.hits;
+    result.nMisses = stats.misses;
+    result.nInsertions = stats.insertions;
+    result.nEvictions = stats.evictions;
+    result.nEntries = stats.elements;
+    result.nMaxEntries = stats.size;
+    result.nMemoryUsage = (size_t)stats.size * sizeof(Element);
+    return result;
+}
+
+/**
+ * The statistics of every internal cache, by name: the signature, Equihash
+ * solution and bundle validity caches, the z_gettreestate results, the coins, nullifier and anchor maps
+ * of the chainstate cache, the filter of recently rejected transactions and
+ * the cache of invalid transactions.
+ * Takes cs_main.
+ */
+std::vector<std::pair<std::string, CCacheStats>> GetCacheStats();
+
+/** Export the statistics of every cache as metrics. */
+void UpdateCacheMetrics();
+
+#endif // ZCASH_CACHESTATS_H
@@ -0,0 +1,248 @@
+// Copyright (c) 2026 The Zcash developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or https://www.opensource.org/licenses/mit-license.php .
+
+#include "candidateblock.h"
+
+#include "chain.h"
+#include "chainparams.h"
+#include "main.h"
+#include "txmempool.h"
+#include "util/system.h"
+#include "util/time.h"
+
+#include <chrono>
+
+CandidateBlockBuilder* pcandidateblock = NULL;
+
+CandidateBlockBuilder::CandidateBlockBuilder(const CChainParams& chainparamsIn) :
+    chainparams(chainparamsIn), assembler(chainparamsIn)
+{
+}
+
+CandidateBlockBuilder::~CandidateBlockBuilder()
+{
+    Stop();
+}
+
+bool CandidateBlockBuilder::CanKeep(const MinerAddress& minerAddress)
+{
+    return std::holds_alternative<boost::shared_ptr<CReserveScript>>(minerAddress);
+}
+
+void CandidateBlockBuilder::Start()
+{
+    connAdded = mempool.NotifyEntryAdded.connect([this](const CTransaction& tx, uint64_t) { TransactionAdded(tx); });
+    connRemoved = mempool.NotifyEntryRemoved.connect([this](const CTransaction& tx, MemPoolRemovalReason, uint64_t) { TransactionRemoved(tx); });
+    RegisterValidationInterface(this);
+    updateThread = std::thread(&CandidateBlockBuilder::ThreadUpdate, this);
+}
+
+void CandidateBlockBuilder::Stop()
+{
+    {
+        LOCK(cs_candidate);
+        fStop = true;
+    }
+    condUpdate.notify_all();
+    if (updateThread.joinable()) {
+        updateThread.join();
+    }
+    if (connAdded.connected()) {
+        UnregisterValidationInterface(this);
+        connAdded.disconnect();
+        connRemoved.disconnect();
+    }
+}
+
+void CandidateBlockBuilder::TransactionAdded(const CTransaction& tx)
+{
+    LOCK(cs_candidate);
+    // A stale template is built again from the whole mempool.
+    if (minerAddress && !fStale) {
+        vAdded.push_back(tx.GetHash());
+        condUpdate.notify_one();
+    }
+}
+
+void CandidateBlockBuilder::TransactionRemoved(const CTransaction& tx)
+{
+    LOCK(cs_candidate);
+    if (setInCandidate.count(tx.GetHash())) {
+        fStale = true;
+        vAdded.clear();
+    }
+}
+
+void CandidateBlockBuilder::UpdatedBlockTip(const CBlockIndex *pindex)
+{
+    LOCK(cs_candidate);
+    fTipChanged = true;
+    condUpdate.notify_one();
+}
+
+uint64_t CandidateBlockBuilder::GetUpdateCount()
+{
+    LOCK(cs_candidate);
+    return nUpdates;
+}
+
+void CandidateBlockBuilder::MarkStale()
+{
+    LOCK(cs_candidate);
+    fStale = true;
+    vAdded.clear();
+}
+
+void CandidateBlockBuilder::Rebuild()
+{
+    // The template is stale until it has been built.
+    fStale = true;
+    pindexCandidate = chainActive.Tip();
+    nLastRebuild = GetTime();
+    vAdded.clear();
+    setInCandidate.clear();
+    candidate.reset();
+
+    candidate.reset(assembler.CreateNewBlock(*minerAddress));
+    for (size_t i = 1; i < candidate->block.vtx.size(); i++) {
+        setInCandidate.insert(candidate->block.vtx[i].GetHash());
+    }
+    nUpdates++;
+    fEmpty = false;
+    fStale = false;
+}
+
+void CandidateBlockBuilder::RebuildEmpty()
+{
+    pindexCandidate = chainActive.Tip();
+    vAdded.clear();
+    setInCandidate.clear();
+    candidate.reset();
+
+    // A coinbase transaction without fees leaves the mempool out.
+    CMutableTransaction coinbase = CreateCoinbaseTransaction(
+        chainparams, CAmount{0}, *minerAddress, pindexCandidate->nHeight + 1);
+    candidate.reset(assembler.CreateNewBlock(*minerAddress, coinbase));
+    nUpdates++;
+    // The update thread fills it.
+    fEmpty = true;
+    condUpdate.notify_one();
+}
+
+void CandidateBlockBuilder::Update()
+{
+    LOCK2(cs_main, mempool.cs);
+    LOCK(cs_candidate);
+    fTipChanged = false;
+    if (!minerAddress) {
+        return;
+    }
+    if (pindexCandidate != chainActive.Tip() || fEmpty) {
+        Rebuild();
+        return;
+    }
+    if (fStale) {
+        if (GetTime() - nLastRebuild >= CANDIDATE_REBUILD_INTERVAL) {
+            Rebuild();
+        }
+        return;
+    }
+
+    std::vector<CTxMemPool::txiter> vNew;
+    for (const uint256& txid : vAdded) {
+        auto it = mempool.mapTx.find(txid);
+        if (it != mempool.mapTx.end()) {
+            vNew.push_back(it);
+        }
+    }
+    vAdded.clear();
+    if (vNew.empty()) {
+        return;
+    }
+
+    fStale = true;
+    std::unique_ptr<CBlockTemplate> updated(assembler.UpdateNewBlock(*candidate, *minerAddress, vNew));
+    if (!updated) {
+        LogPrint("pow", "%s: could not add %d transactions to the candidate block, building it again\n",
+            __func__, vNew.size());
+        return;
+    }
+    for (CTxMemPool::txiter it : vNew) {
+        setInCandidate.insert(it->GetTx().GetHash());
+    }
+    candidate = std::move(updated);
+    nUpdates++;
+    fStale = false;
+}
+
+void CandidateBlockBuilder::ThreadUpdate()
+{
+    RenameThread("zc-candidate");
+    while (true) {
+        {
+            WAIT_LOCK(cs_candidate, lock);
+            // Wake up now and then to rebuild a stale template.
+            condUpdate.wait_for(lock, std::chrono::seconds(1), [this] {
+                return fStop || fTipChanged || fEmpty || !vAdded.empty();
+            });
+            if (fStop) {
+                return;
+            }
+            if (!fTipChanged && !fEmpty && vAdded.empty() && !fStale) {
+                continue;
+            }
+            if (!fTipChanged && !fEmpty) {
+                // Let more transactions arrive before updating the template.
+                condUpdate.wait_for(lock, std::chrono::milliseconds(CANDIDATE_UPDATE_INTERVAL), [this] {
+                    return fStop || fTipChanged;
+                });
+                if (fStop) {
+                    return;
+                }
+            }
+        }
+        uint64_t nUpdatesBefore = GetUpdateCount();
+        try {
+            Update();
+        } catch (const std::exception& e) {
+            LogPrintf("%s: %s\n", __func__, e.what());
+        }
+        if (GetUpdateCount() != nUpdatesBefore) {
+            // Wake up the getblocktemplate long polls, which wait for the
+            // template to change as well as for a new chain tip.
+            {
+                LOCK(g_best_block_mutex);
+            }
+            g_best_block_cv.notify_all();
+        }
+    }
+}
+
+CBlockTemplate* CandidateBlockBuilder::GetBlockTemplate(const MinerAddress& minerAddressIn, bool fAllowEmpty)
+{
+    AssertLockHeld(cs_main);
+    LOCK(mempool.cs);
+    LOCK(cs_candidate);
+    if (!CanKeep(minerAddressIn)) {
+        return NULL;
+    }
+    if (!minerAddress) {
+        minerAddress = minerAddressIn;
+        // Mark script as important because it will be used for coinbase outputs
+        std::visit(KeepMinerAddress(), *minerAddress);
+    }
+    if (pindexCandidate != chainActive.Tip()) {
+        if (fAllowEmpty) {
+            RebuildEmpty();
+        } else {
+            Rebuild();
+        }
+    } else if (fEmpty && !fAllowEmpty) {
+        Rebuild();
+    }
+    if (!candidate) {
+        return NULL;
+    }
+    return new CBlockTemplate(*candidate);
+}
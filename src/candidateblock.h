@@ -0,0 +1,126 @@
+// Copyright (c) 2026 The Zcash developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or https://www.opensource.org/licenses/mit-license.php .
+
+#ifndef ZCASH_CANDIDATEBLOCK_H
+#define ZCASH_CANDIDATEBLOCK_H
+
+#include "miner.h"
+#include "sync.h"
+#include "uint256.h"
+#include "validationinterface.h"
+
+#include <condition_variable>
+#include <memory>
+#include <optional>
+#include <set>
+#include <stdint.h>
+#include <thread>
+#include <vector>
+
+#include <boost/signals2/connection.hpp>
+
+class CBlockIndex;
+class CChainParams;
+class CTransaction;
+
+/** Minimum time between rebuilds of a stale candidate block, in seconds */
+static const int64_t CANDIDATE_REBUILD_INTERVAL = 5;
+/** Time for which new mempool transactions are collected before they are added to the candidate block, in milliseconds */
+static const int64_t CANDIDATE_UPDATE_INTERVAL = 100;
+
+/**
+ * Keeps a block template up to date as transactions enter and leave the
+ * mempool and the chain tip changes, so that getblocktemplate can return it
+ * instead of assembling a new one on each call.
+ *
+ * Transactions that enter the mempool are added to the template as long as
+ * CreateNewBlock would also have added them. A new chain tip makes it build
+ * the template again at once. Any other change, such as the removal of a
+ * transaction in the template, marks it stale; a stale template is still
+ * served, and is built again at most every CANDIDATE_REBUILD_INTERVAL
+ * seconds.
+ *
+ * A caller that wants work at once after the chain tip changes, such as a
+ * long poll, may instead be given an empty template on the new tip, which
+ * takes no time to assemble; the full template follows as an update.
+ *
+ * Each change wakes up the threads waiting on g_best_block_cv, so that
+ * getblocktemplate long polls return the new template at once.
+ *
+ * Only templates paying to a transparent address are kept, because the
+ * coinbase transaction of any other would have to be proven again on every
+ * update. The template pays to the address of the first call to
+ * GetBlockTemplate.
+ */
+class CandidateBlockBuilder : public CValidationInterface
+{
+private:
+    const CChainParams& chainparams;
+
+    Mutex cs_candidate;
+    std::condition_variable condUpdate;
+    BlockAssembler assembler;
+    std::optional<MinerAddress> minerAddress;
+    std::unique_ptr<CBlockTemplate> candidate;
+    const CBlockIndex* pindexCandidate = nullptr;
+    //! The transactions in candidate.
+    std::set<uint256> setInCandidate;
+    //! Transactions that entered the mempool since candidate was updated.
+    std::vector<uint256> vAdded;
+    //! The number of times candidate has changed.
+    uint64_t nUpdates = 0;
+    //! Whether candidate is an empty template on a new tip, to be filled.
+    bool fEmpty = false;
+    bool fStale = false;
+    bool fTipChanged = false;
+    int64_t nLastRebuild = 0;
+    bool fStop = false;
+    std::thread updateThread;
+    boost::signals2::connection connAdded;
+    boost::signals2::connection connRemoved;
+
+    void ThreadUpdate();
+    void Update();
+    void Rebuild();
+    void RebuildEmpty();
+    void TransactionAdded(const CTransaction& tx);
+    void TransactionRemoved(const CTransaction& tx);
+
+    CandidateBlockBuilder(const CandidateBlockBuilder&) = delete;
+    CandidateBlockBuilder& operator=(const CandidateBlockBuilder&) = delete;
+
+protected:
+    void UpdatedBlockTip(const CBlockIndex *pindex) override;
+
+public:
+    CandidateBlockBuilder(const CChainParams& chainparams);
+    ~CandidateBlockBuilder();
+
+    void Start();
+    void Stop();
+
+    //! Whether a template paying to minerAddress can be kept.
+    static bool CanKeep(const MinerAddress& minerAddress);
+
+    /**
+     * Return a copy of the template, building it first if the chain tip has
+     * changed. If fAllowEmpty is set and the template on the new tip has not
+     * been built yet, an empty one is returned. Returns NULL if no template
+     * paying to minerAddress is kept. Must be called with cs_main held.
+     */
+    CBlockTemplate* GetBlockTemplate(const MinerAddress& minerAddress, bool fAllowEmpty = false);
+
+    //! The number of times the template has changed, so that callers can tell
+    //! whether to ask for it again.
+    uint64_t GetUpdateCount();
+
+    //! Build the template again, because the priority of a transaction has
+    //! changed.
+    void MarkStale();
+};
+
+/** Used by getblocktemplate, if set. */
+extern CandidateBlockBuilder* pcandidateblock;
+
+#endif // ZCASH_CANDIDATEBLOCK_H
@@ -17,8 +17,11 @@
 void CChain::SetTip(CBlockIndex *pindex) {
     if (pindex == NULL) {
         vChain.clear();
+        std::atomic_store(&tipSnapshot, std::shared_ptr<const CChainTip>());
         return;
     }
+    std::atomic_store(&tipSnapshot, std::shared_ptr<const CChainTip>(new CChainTip{
+        pindex, pindex->GetBlockHash(), pindex->nHeight, pindex->GetBlockTime(), pindex->GetMedianTimePast()}));
     vChain.resize(pindex->nHeight + 1);
     while (pindex && vChain[pindex->nHeight] != pindex) {
         vChain[pindex->nHeight] = pindex;
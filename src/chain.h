@@ -7,6 +7,7 @@
 #ifndef BITCOIN_CHAIN_H
 #define BITCOIN_CHAIN_H
 
+#include "amount.h"
 #include "arith_uint256.h"
 #include "primitives/block.h"
 #include "pow.h"
@@ -14,6 +15,8 @@
 #include "uint256.h"
 #include "util/strencodings.h"
 
+#include <limits>
+#include <memory>
 #include <optional>
 #include <vector>
 
@@ -189,6 +192,62 @@ enum BlockStatus: uint32_t {
 //! Blocks with this validity are assumed to satisfy all consensus rules.
 static const BlockStatus BLOCK_VALID_CONSENSUS = BLOCK_VALID_SCRIPTS;
 
+/**
+ * An optional amount that takes the space of an amount, where
+ * std::optional<CAmount> takes twice as much for its flag and padding. Block
+ * index entries hold nine of them. No amount is ever the lowest value of
+ * CAmount, which marks a missing amount. Serialized as std::optional<CAmount>
+ * is.
+ */
+class OptionalAmount
+{
+private:
+    static constexpr CAmount NONE = std::numeric_limits<CAmount>::min();
+    CAmount nValue = NONE;
+
+public:
+    constexpr OptionalAmount() {}
+    constexpr OptionalAmount(std::nullopt_t) {}
+    constexpr OptionalAmount(CAmount nValueIn) : nValue(nValueIn) {}
+    OptionalAmount(const std::optional<CAmount>& value) : nValue(value ? *value : NONE) {}
+
+    bool has_value() const { return nValue != NONE; }
+    explicit operator bool() const { return has_value(); }
+    const CAmount& operator*() const { return nValue; }
+
+    CAmount value() const
+    {
+        if (!has_value()) {
+            throw std::bad_optional_access();
+        }
+        return nValue;
+    }
+
+    CAmount value_or(CAmount nDefault) const { return has_value() ? nValue : nDefault; }
+
+    operator std::optional<CAmount>() const
+    {
+        return has_value() ? std::optional<CAmount>(nValue) : std::nullopt;
+    }
+
+    friend bool operator==(const OptionalAmount& a, const OptionalAmount& b) { return a.nValue == b.nValue; }
+    friend bool operator!=(const OptionalAmount& a, const OptionalAmount& b) { return a.nValue != b.nValue; }
+
+    template<typename Stream>
+    void Serialize(Stream& s) const
+    {
+        ::Serialize(s, std::optional<CAmount>(*this));
+    }
+
+    template<typename Stream>
+    void Unserialize(Stream& s)
+    {
+        std::optional<CAmount> value;
+        ::Unserialize(s, value);
+        *this = value;
+    }
+};
+
 /** The block chain is a tree shaped structure starting with the
  * genesis block at the root, with each block potentially having multiple
  * candidates to be the next block. A blockindex may have multiple pprev pointing
@@ -197,6 +256,9 @@ static const BlockStatus BLOCK_VALID_CONSENSUS = BLOCK_VALID_SCRIPTS;
 class CBlockIndex
 {
 public:
+    // The fields that walks through the index and the search for the best
+    // chain read come first, up to nChainWork, and take 64 bytes.
+
     //! pointer to the hash of the block, if any. Memory is owned by this CBlockIndex
     const uint256* phashBlock;
 
@@ -209,6 +271,12 @@ public:
     //! height of the entry in the chain. The genesis block has height 0
     int nHeight;
 
+    //! Verification status of this block. See enum BlockStatus
+    unsigned int nStatus;
+
+    //! (memory only) Total amount of work (expected number of hashes) in the chain up to and including this block
+    arith_uint256 nChainWork;
+
     //! Which # file this block is stored in (blk?????.dat)
     int nFile;
 
@@ -218,9 +286,6 @@ public:
     //! Byte offset within rev?????.dat where this block's undo data is stored
     unsigned int nUndoPos;
 
-    //! (memory only) Total amount of work (expected number of hashes) in the chain up to and including this block
-    arith_uint256 nChainWork;
-
     //! Number of transactions in this block.
     //! Note: in a potential headers-first mode, this number cannot be relied upon
     unsigned int nTx;
@@ -230,8 +295,12 @@ public:
     //! Change to 64-bit type when necessary; won't happen before 2030
     unsigned int nChainTx;
 
-    //! Verification status of this block. See enum BlockStatus
-    unsigned int nStatus;
+    //! (memory only) Sequential id assigned to distinguish order in which blocks are received.
+    uint32_t nSequenceId;
+
+    //! (memory only) Whether the scripts, proofs and signatures of this block's
+    //! transactions were verified when it was last connected.
+    bool fExpensiveChecksDone;
 
     //! Branch ID corresponding to the consensus rules used to validate this block.
     //! Only cached if block validity is BLOCK_VALID_CONSENSUS.
@@ -259,36 +328,36 @@ public:
     //! Will be std::nullopt under the following conditions:
     //! - if the block has never been connected to a chain tip
     //! - for older blocks until a reindex has taken place
-    std::optional<CAmount> nChainSupplyDelta;
+    OptionalAmount nChainSupplyDelta;
 
     //! (memory only) Total chain supply up to and including this block.
     //!
     //! Will be std::nullopt until a reindex has taken place.
     //! Will be std::nullopt if nChainTx is zero, or if the block has never been
     //! connected to a chain tip.
-    std::optional<CAmount> nChainTotalSupply;
+    OptionalAmount nChainTotalSupply;
 
     //! Change in value in the transparent pool produced by the action of the
     //! transparent inputs to and outputs from transactions in this block.
     //!
     //! Will be std::nullopt for older blocks until a reindex has taken place.
-    std::optional<CAmount> nTransparentValue;
+    OptionalAmount nTransparentValue;
 
     //! (memory only) Total value of the transparent value pool up to and
     //! including this block.
     //!
     //! Will be std::nullopt until a reindex has taken place.
     //! Will be std::nullopt if nChainTx is zero.
-    std::optional<CAmount> nChainTransparentValue;
+    OptionalAmount nChainTransparentValue;
 
     //! Change in value held by the Sprout circuit over this block.
     //! Will be std::nullopt for older blocks on old nodes until a reindex has taken place.
-    std::optional<CAmount> nSproutValue;
+    OptionalAmount nSproutValue;
 
     //! (memory only) Total value held by the Sprout circuit up to and including this block.
     //! Will be std::nullopt for on old nodes until a reindex has taken place.
     //! Will be std::nullopt if nChainTx is zero.
-    std::optional<CAmount> nChainSproutValue;
+    OptionalAmount nChainSproutValue;
 
     //! Change in value held by the Sapling circuit over this block.
     //! Not a std::optional because this was added before Sapling activated, so we can
@@ -297,7 +366,7 @@ public:
 
     //! (memory only) Total value held by the Sapling circuit up to and including this block.
     //! Will be std::nullopt if nChainTx is zero.
-    std::optional<CAmount> nChainSaplingValue;
+    OptionalAmount nChainSaplingValue;
 
     //! Change in value held by the Orchard circuit over this block.
     //! Not a std::optional because this was added before Orchard activated, so we can
@@ -306,7 +375,7 @@ public:
 
     //! (memory only) Total value held by the Orchard circuit up to and including this block.
     //! Will be std::nullopt if and only if nChainTx is zero.
-    std::optional<CAmount> nChainOrchardValue;
+    OptionalAmount nChainOrchardValue;
 
     //! Change in value held by the development fund lockbox over this block.
     //!
@@ -317,7 +386,7 @@ public:
     //! (memory only) Total value held by the development fund lockbox up to
     //! and including this block. Will be std::nullopt if and only if nChainTx
     //! is zero.
-    std::optional<CAmount> nChainLockboxValue;
+    OptionalAmount nChainLockboxValue;
 
     //! Root of the Sapling commitment tree as of the end of this block.
     //!
@@ -360,9 +429,6 @@ protected:
     std::vector<unsigned char> nSolution;
 
 public:
-    //! (memory only) Sequential id assigned to distinguish order in which blocks are received.
-    uint32_t nSequenceId;
-
     void SetNull()
     {
         phashBlock = NULL;
@@ -384,6 +450,7 @@ public:
         hashFinalOrchardRoot = uint256();
         hashChainHistoryRoot = uint256();
         nSequenceId = 0;
+        fExpensiveChecksDone = false;
 
         nChainSupplyDelta = std::nullopt;
         nChainTotalSupply = std::nullopt;
@@ -683,10 +750,27 @@ private:
     }
 };
 
+/**
+ * The tip of a chain as it was when it was set. Its fields do not change, so
+ * it can be read without the lock that guards the chain.
+ */
+struct CChainTip
+{
+    //! Only fields of the entry that are fixed once it is in mapBlockIndex,
+    //! such as its header fields and pprev, may be read without cs_main.
+    const CBlockIndex* pindex;
+    uint256 hash;
+    int nHeight;
+    int64_t nTime;
+    int64_t nMedianTimePast;
+};
+
 /** An in-memory indexed chain of blocks. */
 class CChain {
 private:
     std::vector<CBlockIndex*> vChain;
+    //! Read and written with std::atomic_load and std::atomic_store.
+    std::shared_ptr<const CChainTip> tipSnapshot;
 
 public:
     /** Returns the index entry for the genesis block of this chain, or NULL if none. */
@@ -730,6 +814,15 @@ public:
         return int(vChain.size()) - 1;
     }
 
+    /**
+     * Returns the tip as of the last SetTip(), or null if the chain is empty.
+     * Unlike the other methods, this may be called without holding the lock
+     * that guards the chain.
+     */
+    std::shared_ptr<const CChainTip> TipSnapshot() const {
+        return std::atomic_load(&tipSnapshot);
+    }
+
     /** Set/initialize a chain with a given tip. */
     void SetTip(CBlockIndex *pindex);
 
@@ -315,6 +315,11 @@ public:
         // The best chain should have at least this much work.
         consensus.nMinimumChainWork = uint256S("0x0000000000000000000000000000000000000000000000001517f0d837f57259");
 
+        // By default assume that the signatures and proofs in ancestors of this block are valid.
+        // This is the last checkpoint, below which they are not checked anyway, so the default
+        // has no effect until it is moved to a block above the last checkpoint.
+        consensus.defaultAssumeValid = uint256S("0x0000000000573729e4db33678233e5dc0cc721c9c09977c64dcaa3f6344de8e9"); // 3000000
+
         /**
          * The message start string should be awesome! ⓩ❤
          */
@@ -706,6 +711,11 @@ public:
         // The best chain should have at least this much work.
         consensus.nMinimumChainWork = uint256S("000000000000000000000000000000000000000000000000000000263c0984a2");
 
+        // By default assume that the signatures and proofs in ancestors of this block are valid.
+        // This is the last checkpoint, below which they are not checked anyway, so the default
+        // has no effect until it is moved to a block above the last checkpoint.
+        consensus.defaultAssumeValid = uint256S("0x001e9a2d2e2892b88e9998cf7b079b41d59dd085423a921fe8386cecc42287b8"); // 38000
+
         pchMessageStart[0] = 0xfa;
         pchMessageStart[1] = 0x1a;
         pchMessageStart[2] = 0xf9;
@@ -862,6 +872,9 @@ public:
         // The best chain should have at least this much work.
         consensus.nMinimumChainWork = uint256S("0x00");
 
+        // By default assume that the signatures and proofs in ancestors of this block are valid.
+        consensus.defaultAssumeValid = uint256S("0x00");
+
         pchMessageStart[0] = 0xaa;
         pchMessageStart[1] = 0xe8;
         pchMessageStart[2] = 0x3f;
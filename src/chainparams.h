@@ -35,6 +35,15 @@ struct CCheckpointData {
     double fTransactionsPerDay;
 };
 
+/** A chain state snapshot that loadtxoutset accepts, keyed by height in MapAssumeutxo. */
+struct CAssumeutxoData {
+    uint256 hashBlock;
+    //! Hash of the snapshot contents, as reported by dumptxoutset.
+    uint256 hashSnapshot;
+};
+
+typedef std::map<int, CAssumeutxoData> MapAssumeutxo;
+
 /**
  * CChainParams defines various tweakable parameters of a given instance of the
  * Bitcoin system. There are three: the main network on which people trade goods
@@ -100,6 +109,11 @@ public:
     }
     const std::vector<SeedSpec6>& FixedSeeds() const { return vFixedSeeds; }
     const CCheckpointData& Checkpoints() const { return checkpointData; }
+    /** Return the snapshot that may be loaded at the given height, or nullptr if there is none. */
+    const CAssumeutxoData* AssumeutxoForHeight(int nHeight) const {
+        auto it = mapAssumeutxo.find(nHeight);
+        return it == mapAssumeutxo.end() ? nullptr : &it->second;
+    }
     /** Return the founder's reward address and script for a given block height */
     std::string GetFoundersRewardAddressAtHeight(int height) const;
     CScript GetFoundersRewardScriptAtHeight(int height) const;
@@ -124,6 +138,7 @@ protected:
     bool fMineBlocksOnDemand = false;
     bool fTestnetToBeDeprecatedFieldRPC = false;
     CCheckpointData checkpointData;
+    MapAssumeutxo mapAssumeutxo;
     std::vector<std::string> vFoundersRewardAddress;
 
     CAmount nSproutValuePoolCheckpointHeight = 0;
@@ -0,0 +1,128 @@
+// Copyright (c) 2026 The Zcash developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or https://www.opensource.org/licenses/mit-license.php .
+
+#include "chainstats.h"
+
+#include "chain.h"
+
+#include <algorithm>
+
+CChainStats chainStats;
+
+void CChainStats::PushBack(uint32_t nTime, const arith_uint256& nChainWork)
+{
+    AssertLockHeld(cs);
+    vChainWork.push_back(nChainWork);
+    if (vMinTimes.empty()) {
+        vMinTimes.emplace_back();
+        vMaxTimes.emplace_back();
+    }
+    vMinTimes[0].push_back(nTime);
+    vMaxTimes[0].push_back(nTime);
+    // The runs of each length that end with the new block.
+    for (size_t k = 1; ((size_t)1 << k) <= vChainWork.size(); k++) {
+        if (vMinTimes.size() == k) {
+            vMinTimes.emplace_back();
+            vMaxTimes.emplace_back();
+        }
+        size_t i = vChainWork.size() - ((size_t)1 << k);
+        size_t nHalf = (size_t)1 << (k - 1);
+        vMinTimes[k].push_back(std::min(vMinTimes[k - 1][i], vMinTimes[k - 1][i + nHalf]));
+        vMaxTimes[k].push_back(std::max(vMaxTimes[k - 1][i], vMaxTimes[k - 1][i + nHalf]));
+    }
+}
+
+void CChainStats::PopBack()
+{
+    AssertLockHeld(cs);
+    vChainWork.pop_back();
+    // Every run of each length that is not empty ends with the last block.
+    for (size_t k = 0; k < vMinTimes.size(); k++) {
+        if (!vMinTimes[k].empty()) {
+            vMinTimes[k].pop_back();
+            vMaxTimes[k].pop_back();
+        }
+    }
+}
+
+void CChainStats::Update(const CChain& chain)
+{
+    LOCK(cs);
+    const CBlockIndex* pindexFork = pindexTip ? chain.FindFork(pindexTip) : nullptr;
+    int nForkHeight = pindexFork ? pindexFork->nHeight : -1;
+    while (!vChainWork.empty() && nBaseHeight + (int)vChainWork.size() - 1 > nForkHeight) {
+        PopBack();
+    }
+    if (vChainWork.empty()) {
+        nBaseHeight = std::max(0, chain.Height() - MAX_CHAIN_STATS_BLOCKS + 1);
+    }
+    for (int nHeight = nBaseHeight + vChainWork.size(); nHeight <= chain.Height(); nHeight++) {
+        PushBack(chain[nHeight]->nTime, chain[nHeight]->nChainWork);
+    }
+
+    // Drop the oldest blocks once twice as many as needed are kept, which
+    // rebuilds the tables but only happens every MAX_CHAIN_STATS_BLOCKS.
+    if (vChainWork.size() >= 2 * (size_t)MAX_CHAIN_STATS_BLOCKS) {
+        size_t nDrop = vChainWork.size() - MAX_CHAIN_STATS_BLOCKS;
+        std::vector<arith_uint256> vKeptWork(vChainWork.begin() + nDrop, vChainWork.end());
+        std::vector<uint32_t> vKeptTimes(vMinTimes[0].begin() + nDrop, vMinTimes[0].end());
+        vChainWork.clear();
+        vMinTimes.clear();
+        vMaxTimes.clear();
+        for (size_t i = 0; i < vKeptWork.size(); i++) {
+            PushBack(vKeptTimes[i], vKeptWork[i]);
+        }
+        nBaseHeight += nDrop;
+    }
+    pindexTip = chain.Tip();
+}
+
+void CChainStats::Clear()
+{
+    LOCK(cs);
+    nBaseHeight = 0;
+    vChainWork.clear();
+    vMinTimes.clear();
+    vMaxTimes.clear();
+    pindexTip = nullptr;
+}
+
+std::optional<int64_t> CChainStats::GetNetworkHashPS(int nLookup, int nHeight) const
+{
+    assert(nLookup > 0);
+    LOCK(cs);
+    if (vChainWork.empty()) {
+        return std::nullopt;
+    }
+    int nTipHeight = nBaseHeight + vChainWork.size() - 1;
+    int nEnd = (nHeight >= 0 && nHeight < nTipHeight) ? nHeight : nTipHeight;
+    if (nEnd == 0) {
+        return 0;
+    }
+    nLookup = std::min(nLookup, nEnd);
+    if (nEnd - nLookup < nBaseHeight) {
+        return std::nullopt;
+    }
+
+    // The window has nLookup + 1 blocks, covered by two runs of 2^k blocks.
+    size_t i = nEnd - nLookup - nBaseHeight;
+    size_t j = nEnd - nBaseHeight;
+    size_t k = 0;
+    while (((size_t)2 << k) <= j - i + 1) {
+        k++;
+    }
+    size_t i2 = j + 1 - ((size_t)1 << k);
+    int64_t minTime = std::min(vMinTimes[k][i], vMinTimes[k][i2]);
+    int64_t maxTime = std::max(vMaxTimes[k][i], vMaxTimes[k][i2]);
+
+    // In case there's a situation where minTime == maxTime, we don't want a divide by zero exception.
+    if (minTime == maxTime) {
+        return 0;
+    }
+
+    arith_uint256 workDiff = vChainWork[j] - vChainWork[i];
+    int64_t timeDiff = maxTime - minTime;
+
+    return (int64_t)(workDiff.getdouble() / timeDiff);
+}
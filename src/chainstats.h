@@ -0,0 +1,71 @@
+// Copyright (c) 2026 The Zcash developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or https://www.opensource.org/licenses/mit-license.php .
+
+#ifndef ZCASH_CHAINSTATS_H
+#define ZCASH_CHAINSTATS_H
+
+#include "arith_uint256.h"
+#include "sync.h"
+
+#include <optional>
+#include <stdint.h>
+#include <vector>
+
+class CBlockIndex;
+class CChain;
+
+//! How many blocks at the tip of the active chain CChainStats keeps.
+static const int MAX_CHAIN_STATS_BLOCKS = 8192;
+
+/**
+ * The times and chain work of the last blocks of the active chain, so that
+ * the network solution rate over any window of them is found without cs_main
+ * and without walking back through the block index.
+ *
+ * The earliest and latest block times of a window are read from a sparse
+ * table: for each power of two 2^k, the earliest and latest time of every
+ * run of 2^k consecutive blocks, so that any window is covered by two runs.
+ * Each block connected adds one entry per power of two.
+ */
+class CChainStats
+{
+private:
+    mutable Mutex cs;
+    //! The height of the first block kept.
+    int nBaseHeight GUARDED_BY(cs) = 0;
+    //! The chain work of each block kept, by height from nBaseHeight.
+    std::vector<arith_uint256> vChainWork GUARDED_BY(cs);
+    //! vMinTimes[k][i] and vMaxTimes[k][i] are the earliest and latest times
+    //! of the blocks at heights nBaseHeight + i to nBaseHeight + i + 2^k - 1.
+    std::vector<std::vector<uint32_t>> vMinTimes GUARDED_BY(cs);
+    std::vector<std::vector<uint32_t>> vMaxTimes GUARDED_BY(cs);
+    //! The tip of the active chain when the statistics were last updated.
+    const CBlockIndex* pindexTip GUARDED_BY(cs) = nullptr;
+
+    void PushBack(uint32_t nTime, const arith_uint256& nChainWork) EXCLUSIVE_LOCKS_REQUIRED(cs);
+    void PopBack() EXCLUSIVE_LOCKS_REQUIRED(cs);
+
+public:
+    /**
+     * Catch up with the active chain after its tip changed. Only the blocks
+     * connected since the fork point of the last tip are read. Called with
+     * cs_main held.
+     */
+    void Update(const CChain& chain);
+
+    /** Forget everything, before the block index is unloaded. */
+    void Clear();
+
+    /**
+     * The average network solutions per second over the lookup blocks before
+     * the block at the given height, or the tip if the height is negative or
+     * not below it, as GetNetworkHashPS computes it. Returns nothing if the
+     * window is not kept. The lookup must be positive.
+     */
+    std::optional<int64_t> GetNetworkHashPS(int nLookup, int nHeight) const;
+};
+
+extern CChainStats chainStats;
+
+#endif // ZCASH_CHAINSTATS_H
@@ -7,12 +7,17 @@
 #define BITCOIN_CHECKQUEUE_H
 
 #include <algorithm>
+#include <atomic>
+#include <deque>
+#include <memory>
+#include <thread>
 #include <vector>
 
 #include <boost/thread/condition_variable.hpp>
 #include <boost/thread/locks.hpp>
 #include <boost/thread/mutex.hpp>
 
+#include "support/allocators/pool.h"
 #include "sync.h"
 
 template <typename T>
@@ -27,12 +32,47 @@ class CCheckQueueControl;
   * onto the queue, where they are processed by N-1 worker threads. When
   * the master is done adding work, it temporarily joins the worker pool
   * as an N'th worker, until all jobs are done.
+  *
+  * Work is spread over per-worker deques, each protected by its own mutex.
+  * A worker takes batches from the back of its own deque, and when that is
+  * empty steals from the front of the other workers' deques, so that workers
+  * only contend with each other when they run out of work. The shared mutex
+  * is only used to put idle threads to sleep and wake them up again.
   */
 template <typename T>
 class CCheckQueue
 {
 private:
-    //! Mutex to protect the inner state
+    //! Maximum number of per-worker deques. Additional workers share deques.
+    static const unsigned int MAX_WORKER_QUEUES = 64;
+
+    static constexpr size_t QUEUE_POOL_ALIGN = std::max(alignof(T), alignof(void*));
+    /**
+     * Largest block of elements that a deque allocates for small elements:
+     * 512 bytes with libstdc++ and 4096 bytes with libc++.
+     */
+    static constexpr size_t QUEUE_POOL_BLOCK_SIZE =
+        (std::max(sizeof(T), (size_t)4096) + QUEUE_POOL_ALIGN - 1) / QUEUE_POOL_ALIGN * QUEUE_POOL_ALIGN;
+    typedef PoolAllocator<T, QUEUE_POOL_BLOCK_SIZE, QUEUE_POOL_ALIGN> QueueAllocator;
+
+    /**
+     * The deque of elements owned by one or more workers. Its blocks are
+     * filled by the master and emptied by the workers, so they are carved out
+     * of a pool of the deque's own, which is only used under its mutex,
+     * rather than going back and forth between the threads' malloc arenas.
+     */
+    struct WorkerQueue {
+        boost::mutex mutex;
+        typename QueueAllocator::ResourceType resource{QUEUE_POOL_BLOCK_SIZE};
+        std::deque<T, QueueAllocator> queue{QueueAllocator(&resource)};
+        //! Size of the deque, readable without taking the mutex.
+        std::atomic<size_t> nSize{0};
+    };
+
+    //! The per-worker deques.
+    std::vector<std::unique_ptr<WorkerQueue>> vWorkerQueues;
+
+    //! Mutex used to sleep and wake idle threads
     boost::mutex mutex;
 
     //! Worker threads block on this when out of work
@@ -41,90 +81,137 @@ private:
     //! Master thread blocks on this when out of work
     boost::condition_variable condMaster;
 
-    //! The queue of elements to be processed.
-    //! As the order of booleans doesn't matter, it is used as a LIFO (stack)
-    std::vector<T> queue;
+    //! The number of worker threads (excluding the master) that have started.
+    std::atomic<unsigned int> nWorkers;
 
-    //! The number of workers (including the master) that are idle.
-    int nIdle;
-
-    //! The total number of workers (including the master).
-    int nTotal;
+    //! The deque that the next Add() starts filling, for round-robin distribution.
+    unsigned int nNextQueue;
 
     //! The temporary evaluation result.
-    bool fAllOk;
+    std::atomic<bool> fAllOk;
 
     /**
      * Number of verifications that haven't completed yet.
      * This includes elements that are no longer queued, but still in the
      * worker's own batches.
      */
-    unsigned int nTodo;
+    std::atomic<int64_t> nTodo;
 
-    //! Whether we're shutting down.
-    bool fQuit;
+    //! Number of verifications that are still sitting in a deque.
+    std::atomic<int64_t> nQueued;
 
     //! The maximum number of elements to be processed in one batch
     unsigned int nBatchSize;
 
+    //! The number of deques that work is currently spread over.
+    unsigned int ActiveQueues() const
+    {
+        return std::max(1U, std::min(nWorkers.load(), (unsigned int)vWorkerQueues.size()));
+    }
+
+    /**
+     * Move up to nBatchSize elements from the given deque into vChecks. The
+     * owner takes from the back, thieves from the front. Take at most half of
+     * what is there, so that the remainder can be shared with other threads.
+     */
+    bool Take(WorkerQueue& wq, std::vector<T>& vChecks, bool fSteal)
+    {
+        if (wq.nSize == 0) {
+            return false;
+        }
+        boost::unique_lock<boost::mutex> lock(wq.mutex);
+        if (wq.queue.empty()) {
+            return false;
+        }
+        size_t nNow = std::max((size_t)1, std::min((size_t)nBatchSize, (wq.queue.size() + 1) / 2));
+        vChecks.resize(nNow);
+        for (size_t i = 0; i < nNow; i++) {
+            // We want the lock on the mutex to be as short as possible, so swap jobs from the
+            // deque to the local batch vector instead of copying.
+            if (fSteal) {
+                vChecks[i].swap(wq.queue.front());
+                wq.queue.pop_front();
+            } else {
+                vChecks[i].swap(wq.queue.back());
+                wq.queue.pop_back();
+            }
+        }
+        wq.nSize = wq.queue.size();
+        nQueued -= nNow;
+        return true;
+    }
+
+    /** Fill vChecks from our own deque, or by stealing from any other. */
+    bool TakeAny(unsigned int nOwn, std::vector<T>& vChecks)
+    {
+        if (nQueued <= 0) {
+            return false;
+        }
+        // Add() only fills the active deques, and their number never shrinks.
+        unsigned int nQueues = ActiveQueues();
+        if (Take(*vWorkerQueues[nOwn], vChecks, false)) {
+            return true;
+        }
+        for (unsigned int i = 1; i < nQueues; i++) {
+            if (Take(*vWorkerQueues[(nOwn + i) % nQueues], vChecks, true)) {
+                return true;
+            }
+        }
+        return false;
+    }
+
     /** Internal function that does bulk of the verification work. */
     bool Loop(bool fMaster = false)
     {
-        boost::condition_variable& cond = fMaster ? condMaster : condWorker;
+        unsigned int nOwn = 0;
+        if (!fMaster) {
+            nOwn = nWorkers++ % vWorkerQueues.size();
+        }
         std::vector<T> vChecks;
         vChecks.reserve(nBatchSize);
-        unsigned int nNow = 0;
-        bool fOk = true;
         do {
-            {
-                boost::unique_lock<boost::mutex> lock(mutex);
-                // first do the clean-up of the previous loop run (allowing us to do it in the same critsect)
-                if (nNow) {
-                    fAllOk &= fOk;
-                    nTodo -= nNow;
-                    if (nTodo == 0 && !fMaster)
-                        // We processed the last element; inform the master it can exit and return the result
-                        condMaster.notify_one();
-                } else {
-                    // first iteration
-                    nTotal++;
+            if (TakeAny(nOwn, vChecks)) {
+                // execute work, unless a previous check has already failed
+                bool fOk = fAllOk;
+                for (T& check : vChecks)
+                    if (fOk)
+                        fOk = check();
+                if (!fOk)
+                    fAllOk = false;
+                int64_t nNow = vChecks.size();
+                // Destroy the checks before reporting them as done, so that
+                // the master never returns while they still hold resources.
+                vChecks.clear();
+                if ((nTodo -= nNow) == 0) {
+                    // We processed the last element; inform the master it can exit and return the result
+                    boost::unique_lock<boost::mutex> lock(mutex);
+                    condMaster.notify_one();
+                }
+                continue;
+            }
+            if (nQueued > 0) {
+                // Work is being added or was just taken by another thread.
+                std::this_thread::yield();
+                continue;
+            }
+
+            boost::unique_lock<boost::mutex> lock(mutex);
+            if (fMaster) {
+                while (nQueued <= 0 && nTodo > 0) {
+                    condMaster.wait(lock);
                 }
-                // logically, the do loop starts here
-                while (queue.empty()) {
-                    if ((fMaster || fQuit) && nTodo == 0) {
-                        nTotal--;
-                        bool fRet = fAllOk;
-                        // reset the status for new work later
-                        if (fMaster)
-                            fAllOk = true;
-                        // return the current status
-                        return fRet;
-                    }
-                    nIdle++;
-                    cond.wait(lock); // wait
-                    nIdle--;
+                if (nTodo == 0) {
+                    bool fRet = fAllOk;
+                    // reset the status for new work later
+                    fAllOk = true;
+                    // return the current status
+                    return fRet;
                 }
-                // Decide how many work units to process now.
-                // * Do not try to do everything at once, but aim for increasingly smaller batches so
-                //   all workers finish approximately simultaneously.
-                // * Try to account for idle jobs which will instantly start helping.
-                // * Don't do batches smaller than 1 (duh), or larger than nBatchSize.
-                nNow = std::max(1U, std::min(nBatchSize, (unsigned int)queue.size() / (nTotal + nIdle + 1)));
-                vChecks.resize(nNow);
-                for (unsigned int i = 0; i < nNow; i++) {
-                    // We want the lock on the mutex to be as short as possible, so swap jobs from the global
-                    // queue to the local batch vector instead of copying.
-                    vChecks[i].swap(queue.back());
-                    queue.pop_back();
+            } else {
+                while (nQueued <= 0) {
+                    condWorker.wait(lock); // wait
                 }
-                // Check whether we need to do work at all
-                fOk = fAllOk;
             }
-            // execute work
-            for (T& check : vChecks)
-                if (fOk)
-                    fOk = check();
-            vChecks.clear();
         } while (true);
     }
 
@@ -133,7 +220,12 @@ public:
     boost::mutex ControlMutex;
 
     //! Create a new check queue
-    CCheckQueue(unsigned int nBatchSizeIn) : nIdle(0), nTotal(0), fAllOk(true), nTodo(0), fQuit(false), nBatchSize(nBatchSizeIn) {}
+    CCheckQueue(unsigned int nBatchSizeIn) : nWorkers(0), nNextQueue(0), fAllOk(true), nTodo(0), nQueued(0), nBatchSize(nBatchSizeIn)
+    {
+        for (unsigned int i = 0; i < MAX_WORKER_QUEUES; i++) {
+            vWorkerQueues.emplace_back(new WorkerQueue());
+        }
+    }
 
     //! Worker thread
     void Thread()
@@ -150,15 +242,36 @@ public:
     //! Add a batch of checks to the queue
     void Add(std::vector<T>& vChecks)
     {
-        boost::unique_lock<boost::mutex> lock(mutex);
-        for (T& check : vChecks) {
-            queue.push_back(T());
-            check.swap(queue.back());
+        if (vChecks.empty()) {
+            return;
         }
+        // Account for the checks before they become visible, so that nTodo
+        // can never be observed below the actual amount of work. nQueued is
+        // only raised afterwards (so it may briefly be negative), so that
+        // threads never spin waiting for checks that are not there yet.
         nTodo += vChecks.size();
-        if (vChecks.size() == 1)
+
+        // Spread the checks in contiguous chunks over the active deques.
+        unsigned int nQueues = ActiveQueues();
+        size_t nChunk = (vChecks.size() + nQueues - 1) / nQueues;
+        unsigned int nChunks = 0;
+        for (size_t nPos = 0; nPos < vChecks.size(); nPos += nChunk, nChunks++) {
+            WorkerQueue& wq = *vWorkerQueues[nNextQueue];
+            nNextQueue = (nNextQueue + 1) % nQueues;
+            boost::unique_lock<boost::mutex> lock(wq.mutex);
+            for (size_t i = nPos; i < std::min(nPos + nChunk, vChecks.size()); i++) {
+                wq.queue.emplace_back();
+                vChecks[i].swap(wq.queue.back());
+            }
+            wq.nSize = wq.queue.size();
+        }
+
+        nQueued += vChecks.size();
+
+        boost::unique_lock<boost::mutex> lock(mutex);
+        if (nChunks == 1)
             condWorker.notify_one();
-        else if (vChecks.size() > 1)
+        else
             condWorker.notify_all();
     }
 
@@ -10,6 +10,7 @@
 #include "version.h"
 
 #include <assert.h>
+#include <map>
 
 #include <rust/history.h>
 
@@ -47,12 +48,22 @@ bool CCoins::Spend(uint32_t nPos)
     return true;
 }
 
+void CCoinsView::GetNullifiers(const std::set<uint256> &nullifiers, ShieldedType type, std::set<uint256> &spent) const
+{
+    for (const uint256 &nf : nullifiers) {
+        if (GetNullifier(nf, type)) {
+            spent.insert(nf);
+        }
+    }
+}
+
 CCoinsViewBacked::CCoinsViewBacked(CCoinsView *viewIn) : base(viewIn) { }
 
 bool CCoinsViewBacked::GetSproutAnchorAt(const uint256 &rt, SproutMerkleTree &tree) const { return base->GetSproutAnchorAt(rt, tree); }
 bool CCoinsViewBacked::GetSaplingAnchorAt(const uint256 &rt, SaplingMerkleTree &tree) const { return base->GetSaplingAnchorAt(rt, tree); }
 bool CCoinsViewBacked::GetOrchardAnchorAt(const uint256 &rt, OrchardMerkleFrontier &tree) const { return base->GetOrchardAnchorAt(rt, tree); }
 bool CCoinsViewBacked::GetNullifier(const uint256 &nullifier, ShieldedType type) const { return base->GetNullifier(nullifier, type); }
+void CCoinsViewBacked::GetNullifiers(const std::set<uint256> &nullifiers, ShieldedType type, std::set<uint256> &spent) const { base->GetNullifiers(nullifiers, type, spent); }
 bool CCoinsViewBacked::GetCoins(const uint256 &txid, CCoins &coins) const { return base->GetCoins(txid, coins); }
 bool CCoinsViewBacked::HaveCoins(const uint256 &txid) const { return base->HaveCoins(txid); }
 uint256 CCoinsViewBacked::GetBestBlock() const { return base->GetBestBlock(); }
@@ -76,17 +87,21 @@ bool CCoinsViewBacked::BatchWrite(CCoinsMap &mapCoins,
                                   CNullifiersMap &mapOrchardNullifiers,
                                   CHistoryCacheMap &historyCacheMap,
                                   SubtreeCache &cacheSaplingSubtrees,
-                                  SubtreeCache &cacheOrchardSubtrees) {
+                                  SubtreeCache &cacheOrchardSubtrees,
+                                  bool fErase) {
     return base->BatchWrite(mapCoins, hashBlock,
                             hashSproutAnchor, hashSaplingAnchor, hashOrchardAnchor,
                             mapSproutAnchors, mapSaplingAnchors, mapOrchardAnchors,
                             mapSproutNullifiers, mapSaplingNullifiers, mapOrchardNullifiers,
-                            historyCacheMap, cacheSaplingSubtrees, cacheOrchardSubtrees);
+                            historyCacheMap, cacheSaplingSubtrees, cacheOrchardSubtrees,
+                            fErase);
 }
 bool CCoinsViewBacked::GetStats(CCoinsStats &stats) const { return base->GetStats(stats); }
 
 SaltedTxidHasher::SaltedTxidHasher() : k0(GetRand(std::numeric_limits<uint64_t>::max())), k1(GetRand(std::numeric_limits<uint64_t>::max())) {}
 
+SaltedOutpointHasher::SaltedOutpointHasher() : k0(GetRand(std::numeric_limits<uint64_t>::max())), k1(GetRand(std::numeric_limits<uint64_t>::max())) {}
+
 CCoinsViewCache::CCoinsViewCache(CCoinsView *baseIn) : CCoinsViewBacked(baseIn), hasModifier(false), cachedCoinsUsage(0) { }
 
 CCoinsViewCache::~CCoinsViewCache()
@@ -94,8 +109,20 @@ CCoinsViewCache::~CCoinsViewCache()
     assert(!hasModifier);
 }
 
+static size_t HistoryNodeCacheUsage(const std::map<uint32_t, CHistoryNodeMap>& historyNodeCache)
+{
+    size_t nUsage = memusage::DynamicUsage(historyNodeCache);
+    for (const auto& [epochId, nodes] : historyNodeCache) {
+        nUsage += memusage::DynamicUsage(nodes);
+    }
+    return nUsage;
+}
+
 size_t CCoinsViewCache::DynamicMemoryUsage() const {
-    return memusage::DynamicUsage(cacheCoins) +
+    // Pool memory freed by erased entries is reused before the pool grows,
+    // so it is not counted against the cache.
+    return memusage::DynamicUsage(cacheMemoryResource) - cacheMemoryResource.AvailableBytes() +
+           memusage::DynamicUsage(cacheCoins) +
            memusage::DynamicUsage(cacheSproutAnchors) +
            memusage::DynamicUsage(cacheSaplingAnchors) +
            memusage::DynamicUsage(cacheOrchardAnchors) +
@@ -103,6 +130,7 @@ size_t CCoinsViewCache::DynamicMemoryUsage() const {
            memusage::DynamicUsage(cacheSaplingNullifiers) +
            memusage::DynamicUsage(cacheOrchardNullifiers) +
            memusage::DynamicUsage(historyCacheMap) +
+           HistoryNodeCacheUsage(historyNodeCache) +
            memusage::DynamicUsage(cacheSaplingSubtrees) +
            memusage::DynamicUsage(cacheOrchardSubtrees) +
            cachedCoinsUsage;
@@ -110,12 +138,18 @@ size_t CCoinsViewCache::DynamicMemoryUsage() const {
 
 CCoinsMap::const_iterator CCoinsViewCache::FetchCoins(const uint256 &txid) const {
     CCoinsMap::iterator it = cacheCoins.find(txid);
-    if (it != cacheCoins.end())
+    if (it != cacheCoins.end()) {
+        it->second.nLastUsed = nCacheEpoch;
+        coinsStats.nHits++;
         return it;
+    }
+    coinsStats.nMisses++;
     CCoins tmp;
     if (!base->GetCoins(txid, tmp))
         return cacheCoins.end();
+    coinsStats.nInsertions++;
     CCoinsMap::iterator ret = cacheCoins.insert(std::make_pair(txid, CCoinsCacheEntry())).first;
+    ret->second.nLastUsed = nCacheEpoch;
     tmp.swap(ret->second.coins);
     if (ret->second.coins.IsPruned()) {
         // The parent only has an empty entry for this txid; we can consider our
@@ -130,6 +164,7 @@ CCoinsMap::const_iterator CCoinsViewCache::FetchCoins(const uint256 &txid) const
 bool CCoinsViewCache::GetSproutAnchorAt(const uint256 &rt, SproutMerkleTree &tree) const {
     CAnchorsSproutMap::const_iterator it = cacheSproutAnchors.find(rt);
     if (it != cacheSproutAnchors.end()) {
+        anchorsStats.nHits++;
         if (it->second.entered) {
             tree = it->second.tree;
             return true;
@@ -138,10 +173,12 @@ bool CCoinsViewCache::GetSproutAnchorAt(const uint256 &rt, SproutMerkleTree &tre
         }
     }
 
+    anchorsStats.nMisses++;
     if (!base->GetSproutAnchorAt(rt, tree)) {
         return false;
     }
 
+    anchorsStats.nInsertions++;
     CAnchorsSproutMap::iterator ret = cacheSproutAnchors.insert(std::make_pair(rt, CAnchorsSproutCacheEntry())).first;
     ret->second.entered = true;
     ret->second.tree = tree;
@@ -153,6 +190,7 @@ bool CCoinsViewCache::GetSproutAnchorAt(const uint256 &rt, SproutMerkleTree &tre
 bool CCoinsViewCache::GetSaplingAnchorAt(const uint256 &rt, SaplingMerkleTree &tree) const {
     CAnchorsSaplingMap::const_iterator it = cacheSaplingAnchors.find(rt);
     if (it != cacheSaplingAnchors.end()) {
+        anchorsStats.nHits++;
         if (it->second.entered) {
             tree = it->second.tree;
             return true;
@@ -161,10 +199,12 @@ bool CCoinsViewCache::GetSaplingAnchorAt(const uint256 &rt, SaplingMerkleTree &t
         }
     }
 
+    anchorsStats.nMisses++;
     if (!base->GetSaplingAnchorAt(rt, tree)) {
         return false;
     }
 
+    anchorsStats.nInsertions++;
     CAnchorsSaplingMap::iterator ret = cacheSaplingAnchors.insert(std::make_pair(rt, CAnchorsSaplingCacheEntry())).first;
     ret->second.entered = true;
     ret->second.tree = tree;
@@ -176,6 +216,7 @@ bool CCoinsViewCache::GetSaplingAnchorAt(const uint256 &rt, SaplingMerkleTree &t
 bool CCoinsViewCache::GetOrchardAnchorAt(const uint256 &rt, OrchardMerkleFrontier &tree) const {
     CAnchorsOrchardMap::const_iterator it = cacheOrchardAnchors.find(rt);
     if (it != cacheOrchardAnchors.end()) {
+        anchorsStats.nHits++;
         if (it->second.entered) {
             tree = it->second.tree;
             return true;
@@ -184,10 +225,12 @@ bool CCoinsViewCache::GetOrchardAnchorAt(const uint256 &rt, OrchardMerkleFrontie
         }
     }
 
+    anchorsStats.nMisses++;
     if (!base->GetOrchardAnchorAt(rt, tree)) {
         return false;
     }
 
+    anchorsStats.nInsertions++;
     CAnchorsOrchardMap::iterator ret = cacheOrchardAnchors.insert(std::make_pair(rt, CAnchorsOrchardCacheEntry())).first;
     ret->second.entered = true;
     ret->second.tree = tree;
@@ -212,18 +255,105 @@ bool CCoinsViewCache::GetNullifier(const uint256 &nullifier, ShieldedType type)
             throw std::runtime_error("Unknown shielded type");
     }
     CNullifiersMap::iterator it = cacheToUse->find(nullifier);
-    if (it != cacheToUse->end())
+    if (it != cacheToUse->end()) {
+        nullifiersStats.nHits++;
         return it->second.entered;
+    }
 
+    nullifiersStats.nMisses++;
     CNullifiersCacheEntry entry;
     bool tmp = base->GetNullifier(nullifier, type);
     entry.entered = tmp;
 
     cacheToUse->insert(std::make_pair(nullifier, entry));
+    nullifiersStats.nInsertions++;
 
     return tmp;
 }
 
+void CCoinsViewCache::GetNullifiers(const std::set<uint256> &nullifiers, ShieldedType type, std::set<uint256> &spent) const {
+    CNullifiersMap* cacheToUse;
+    switch (type) {
+        case SPROUT:
+            cacheToUse = &cacheSproutNullifiers;
+            break;
+        case SAPLING:
+            cacheToUse = &cacheSaplingNullifiers;
+            break;
+        case ORCHARD:
+            cacheToUse = &cacheOrchardNullifiers;
+            break;
+        default:
+            throw std::runtime_error("Unknown shielded type");
+    }
+
+    std::set<uint256> missing;
+    for (const uint256 &nf : nullifiers) {
+        CNullifiersMap::const_iterator it = cacheToUse->find(nf);
+        if (it == cacheToUse->end()) {
+            missing.insert(nf);
+        } else if (it->second.entered) {
+            spent.insert(nf);
+        }
+    }
+    nullifiersStats.nHits += nullifiers.size() - missing.size();
+    nullifiersStats.nMisses += missing.size();
+    if (missing.empty())
+        return;
+
+    std::set<uint256> missingSpent;
+    base->GetNullifiers(missing, type, missingSpent);
+    for (const uint256 &nf : missing) {
+        CNullifiersCacheEntry entry;
+        entry.entered = missingSpent.count(nf) > 0;
+        cacheToUse->insert(std::make_pair(nf, entry));
+    }
+    nullifiersStats.nInsertions += missing.size();
+    spent.insert(missingSpent.begin(), missingSpent.end());
+}
+
+void CCoinsViewCache::PrefetchShieldedRequirements(const std::vector<CTransaction> &vtx) const
+{
+    std::set<uint256> sproutNullifiers, saplingNullifiers, orchardNullifiers;
+    std::set<uint256> saplingAnchors, orchardAnchors;
+    for (const CTransaction &tx : vtx) {
+        for (const JSDescription &joinsplit : tx.vJoinSplit) {
+            for (const uint256 &nf : joinsplit.nullifiers) {
+                sproutNullifiers.insert(nf);
+            }
+        }
+        for (const auto &spend : tx.GetSaplingSpends()) {
+            saplingNullifiers.insert(uint256::FromRawBytes(spend.nullifier()));
+            saplingAnchors.insert(uint256::FromRawBytes(spend.anchor()));
+        }
+        for (const uint256 &nf : tx.GetOrchardBundle().GetNullifiers()) {
+            orchardNullifiers.insert(nf);
+        }
+        auto orchardAnchor = tx.GetOrchardBundle().GetAnchor();
+        if (orchardAnchor.has_value()) {
+            orchardAnchors.insert(orchardAnchor.value());
+        }
+    }
+
+    // We only want the cache populated; which nullifiers are spent is
+    // checked later by CheckShieldedRequirements.
+    std::set<uint256> spent;
+    GetNullifiers(sproutNullifiers, SPROUT, spent);
+    GetNullifiers(saplingNullifiers, SAPLING, spent);
+    GetNullifiers(orchardNullifiers, ORCHARD, spent);
+
+    // Anchors are shared by most of a block's spends, so after deduplication
+    // there are few of them, and each is fetched once and then cached.
+    SaplingMerkleTree saplingTree;
+    for (const uint256 &rt : saplingAnchors) {
+        GetSaplingAnchorAt(rt, saplingTree);
+    }
+    OrchardMerkleFrontier orchardTree;
+    for (const uint256 &rt : orchardAnchors) {
+        GetOrchardAnchorAt(rt, orchardTree);
+    }
+}
+
 HistoryIndex CCoinsViewCache::GetHistoryLength(uint32_t epochId) const {
     HistoryCache& historyCache = SelectHistoryCache(epochId);
     return historyCache.length;
@@ -242,7 +372,12 @@ HistoryNode CCoinsViewCache::GetHistoryAt(uint32_t epochId, HistoryIndex index)
         return historyCache.appends[index];
     }
 
-    return base->GetHistoryAt(epochId, index);
+    CHistoryNodeMap& nodes = historyNodeCache[epochId];
+    auto it = nodes.find(index);
+    if (it == nodes.end()) {
+        it = nodes.emplace(index, base->GetHistoryAt(epochId, index)).first;
+    }
+    return it->second;
 }
 
 uint256 CCoinsViewCache::GetHistoryRoot(uint32_t epochId) const {
@@ -395,14 +530,16 @@ static inline uint32_t altitude(uint32_t n) {
     return floor_log2(n + 1) - 1;
 }
 
-uint32_t CCoinsViewCache::PreloadHistoryTree(uint32_t epochId, bool extra, std::vector<HistoryEntry> &entries, std::vector<uint32_t> &entry_indices) {
-    auto treeLength = GetHistoryLength(epochId);
-
-    if (treeLength <= 0) {
-        throw std::runtime_error("Invalid PreloadHistoryTree state called - tree should exist");
-    } else if (treeLength == 1) {
-        entries.push_back(libzcash::LeafToEntry(GetHistoryAt(epochId, 0)));
-        entry_indices.push_back(0);
+/**
+ * Finds the nodes of a non-empty history tree that appending to it needs,
+ * which are its peaks, and with extra = true also the nodes that removing
+ * its last leaf needs. Adds their positions and altitudes to `nodes` in the
+ * order they are passed to the MMR library, and returns the number of peaks.
+ */
+static uint32_t HistoryTreeUpdateNodes(uint32_t treeLength, bool extra, std::vector<std::pair<uint32_t, uint32_t>> &nodes) {
+    assert(treeLength > 0);
+    if (treeLength == 1) {
+        nodes.emplace_back(0, 0);
         return 1;
     }
 
@@ -461,7 +598,7 @@ uint32_t CCoinsViewCache::PreloadHistoryTree(uint32_t epochId, bool extra, std::
 
         // If the peak exists, we take it and then continue with its right sibling.
         if (peak_pos < treeLength) {
-            draftMMRNode(entry_indices, entries, GetHistoryAt(epochId, peak_pos), alt, peak_pos);
+            nodes.emplace_back(peak_pos, alt);
 
             last_peak_pos = peak_pos;
             last_peak_alt = alt;
@@ -471,7 +608,7 @@ uint32_t CCoinsViewCache::PreloadHistoryTree(uint32_t epochId, bool extra, std::
         }
     }
 
-    total_peaks = entries.size();
+    total_peaks = nodes.size();
 
     // Return early if we don't require extra nodes.
     if (!extra) return total_peaks;
@@ -499,10 +636,10 @@ uint32_t CCoinsViewCache::PreloadHistoryTree(uint32_t epochId, bool extra, std::
         alt = alt - 1;
 
         // drafting left child
-        draftMMRNode(entry_indices, entries, GetHistoryAt(epochId, left_pos), alt, left_pos);
+        nodes.emplace_back(left_pos, alt);
 
         // drafting right child
-        draftMMRNode(entry_indices, entries, GetHistoryAt(epochId, right_pos), alt, right_pos);
+        nodes.emplace_back(right_pos, alt);
 
         // continuing on right slope
         peak_pos = right_pos;
@@ -511,6 +648,53 @@ uint32_t CCoinsViewCache::PreloadHistoryTree(uint32_t epochId, bool extra, std::
     return total_peaks;
 }
 
+uint32_t CCoinsViewCache::PreloadHistoryTree(uint32_t epochId, bool extra, std::vector<HistoryEntry> &entries, std::vector<uint32_t> &entry_indices) {
+    auto treeLength = GetHistoryLength(epochId);
+
+    if (treeLength <= 0) {
+        throw std::runtime_error("Invalid PreloadHistoryTree state called - tree should exist");
+    }
+
+    std::vector<std::pair<uint32_t, uint32_t>> nodes;
+    uint32_t total_peaks = HistoryTreeUpdateNodes(treeLength, extra, nodes);
+    for (const auto& [pos, alt] : nodes) {
+        draftMMRNode(entry_indices, entries, GetHistoryAt(epochId, pos), alt, pos);
+    }
+
+    return total_peaks;
+}
+
+void CCoinsViewCache::TruncateHistory(HistoryCache& historyCache, HistoryIndex newLength) {
+    historyCache.Truncate(newLength);
+    InvalidateHistoryNodes(historyCache.epoch, newLength);
+}
+
+void CCoinsViewCache::InvalidateHistoryNodes(uint32_t epochId, HistoryIndex fromIndex) const {
+    auto it = historyNodeCache.find(epochId);
+    if (it != historyNodeCache.end()) {
+        it->second.erase(it->second.lower_bound(fromIndex), it->second.end());
+    }
+}
+
+void CCoinsViewCache::RetainHistoryNodes() {
+    for (auto& [epochId, historyCache] : historyCacheMap) {
+        CHistoryNodeMap& cached = historyNodeCache[epochId];
+        CHistoryNodeMap retained;
+        if (historyCache.length > 0) {
+            std::vector<std::pair<uint32_t, uint32_t>> nodes;
+            HistoryTreeUpdateNodes(historyCache.length, true, nodes);
+            for (const auto& [pos, alt] : nodes) {
+                if (pos >= historyCache.updateDepth) {
+                    retained.emplace(pos, historyCache.appends[pos]);
+                } else if (auto it = cached.find(pos); it != cached.end()) {
+                    retained.emplace(pos, it->second);
+                }
+            }
+        }
+        cached = std::move(retained);
+    }
+}
+
 HistoryCache& CCoinsViewCache::SelectHistoryCache(uint32_t epochId) const {
     auto entry = historyCacheMap.find(epochId);
 
@@ -522,6 +706,8 @@ HistoryCache& CCoinsViewCache::SelectHistoryCache(uint32_t epochId) const {
             base->GetHistoryRoot(epochId),
             epochId
         );
+        // Nodes beyond the end of the tree in the base view are stale.
+        InvalidateHistoryNodes(epochId, cache.length);
         return historyCacheMap.insert({epochId, cache}).first->second;
     }
 }
@@ -583,7 +769,7 @@ void CCoinsViewCache::PopHistoryNode(uint32_t epochId) {
         case 1:
         {
             // Just resetting tree to empty
-            historyCache.Truncate(0);
+            TruncateHistory(historyCache, 0);
             historyCache.root = uint256();
             return;
         }
@@ -602,7 +788,7 @@ void CCoinsViewCache::PopHistoryNode(uint32_t epochId) {
             auto newRoot = mmr::hash_node(
                 epochId,
                 tmpHistoryRoot);
-            historyCache.Truncate(1);
+            TruncateHistory(historyCache, 1);
             historyCache.root = uint256::FromRawBytes(newRoot);
             return;
         }
@@ -622,7 +808,7 @@ void CCoinsViewCache::PopHistoryNode(uint32_t epochId) {
                 peak_count
             );
 
-            historyCache.Truncate(historyCache.length - effect.count);
+            TruncateHistory(historyCache, historyCache.length - effect.count);
             historyCache.root = uint256::FromRawBytes(effect.root);
             return;
         }
@@ -775,6 +961,7 @@ CCoinsModifier CCoinsViewCache::ModifyCoins(const uint256 &txid) {
     }
     // Assume that whenever ModifyCoins is called, the entry will be modified.
     ret.first->second.flags |= CCoinsCacheEntry::DIRTY;
+    ret.first->second.nLastUsed = nCacheEpoch;
     return CCoinsModifier(*this, ret.first, cachedCoinUsage);
 }
 
@@ -784,6 +971,7 @@ CCoinsModifier CCoinsViewCache::ModifyNewCoins(const uint256 &txid) {
     ret.first->second.coins.Clear();
     ret.first->second.flags = CCoinsCacheEntry::FRESH;
     ret.first->second.flags |= CCoinsCacheEntry::DIRTY;
+    ret.first->second.nLastUsed = nCacheEpoch;
     return CCoinsModifier(*this, ret.first, 0);
 }
 
@@ -796,6 +984,29 @@ const CCoins* CCoinsViewCache::AccessCoins(const uint256 &txid) const {
     }
 }
 
+bool CCoinsViewCache::HaveCoinsInCache(const uint256 &txid) const {
+    CCoinsMap::const_iterator it = cacheCoins.find(txid);
+    return it != cacheCoins.end();
+}
+
+bool CCoinsViewCache::GetCoinsFromBase(const uint256 &txid, CCoins &coins) const {
+    return base->GetCoins(txid, coins);
+}
+
+void CCoinsViewCache::CacheFetchedCoins(const uint256 &txid, CCoins &coins) {
+    std::pair<CCoinsMap::iterator, bool> ret = cacheCoins.insert(std::make_pair(txid, CCoinsCacheEntry()));
+    if (!ret.second)
+        return;
+    coinsStats.nInsertions++;
+    ret.first->second.nLastUsed = nCacheEpoch;
+    coins.swap(ret.first->second.coins);
+    if (ret.first->second.coins.IsPruned()) {
+        // As in FetchCoins, the parent only has an empty entry for this txid.
+        ret.first->second.flags = CCoinsCacheEntry::FRESH;
+    }
+    cachedCoinsUsage += ret.first->second.coins.DynamicMemoryUsage();
+}
+
 bool CCoinsViewCache::HaveCoins(const uint256 &txid) const {
     CCoinsMap::const_iterator it = FetchCoins(txid);
     // We're using vtx.empty() instead of IsPruned here for performance reasons,
@@ -933,7 +1144,8 @@ bool CCoinsViewCache::BatchWrite(CCoinsMap &mapCoins,
                                  CNullifiersMap &mapOrchardNullifiers,
                                  CHistoryCacheMap &historyCacheMapIn,
                                  SubtreeCache &cacheSaplingSubtreesIn,
-                                 SubtreeCache &cacheOrchardSubtreesIn) {
+                                 SubtreeCache &cacheOrchardSubtreesIn,
+                                 bool fErase) {
     assert(!hasModifier);
     for (CCoinsMap::iterator it = mapCoins.begin(); it != mapCoins.end();) {
         if (it->second.flags & CCoinsCacheEntry::DIRTY) { // Ignore non-dirty entries (optimization).
@@ -946,9 +1158,14 @@ bool CCoinsViewCache::BatchWrite(CCoinsMap &mapCoins,
                     // would have pulled it in at first GetCoins).
                     assert(it->second.flags & CCoinsCacheEntry::FRESH);
                     CCoinsCacheEntry& entry = cacheCoins[it->first];
-                    entry.coins.swap(it->second.coins);
+                    if (fErase) {
+                        entry.coins.swap(it->second.coins);
+                    } else {
+                        entry.coins = it->second.coins;
+                    }
                     cachedCoinsUsage += entry.coins.DynamicMemoryUsage();
                     entry.flags = CCoinsCacheEntry::DIRTY | CCoinsCacheEntry::FRESH;
+                    entry.nLastUsed = nCacheEpoch;
                 }
             } else {
                 if ((itUs->second.flags & CCoinsCacheEntry::FRESH) && it->second.coins.IsPruned()) {
@@ -960,14 +1177,22 @@ bool CCoinsViewCache::BatchWrite(CCoinsMap &mapCoins,
                 } else {
                     // A normal modification.
                     cachedCoinsUsage -= itUs->second.coins.DynamicMemoryUsage();
-                    itUs->second.coins.swap(it->second.coins);
+                    if (fErase) {
+                        itUs->second.coins.swap(it->second.coins);
+                    } else {
+                        itUs->second.coins = it->second.coins;
+                    }
                     cachedCoinsUsage += itUs->second.coins.DynamicMemoryUsage();
                     itUs->second.flags |= CCoinsCacheEntry::DIRTY;
+                    itUs->second.nLastUsed = nCacheEpoch;
                 }
             }
         }
-        it = mapCoins.erase(it);
+        it = fErase ? mapCoins.erase(it) : std::next(it);
     }
+    // Each write from a child cache, normally one per connected block,
+    // starts a new recency epoch for SyncAndTrim.
+    nCacheEpoch++;
 
     ::BatchWriteAnchors<CAnchorsSproutMap, CAnchorsSproutMap::iterator, CAnchorsSproutCacheEntry>(mapSproutAnchors, cacheSproutAnchors, cachedCoinsUsage);
     ::BatchWriteAnchors<CAnchorsSaplingMap, CAnchorsSaplingMap::iterator, CAnchorsSaplingCacheEntry>(mapSaplingAnchors, cacheSaplingAnchors, cachedCoinsUsage);
@@ -977,6 +1202,11 @@ bool CCoinsViewCache::BatchWrite(CCoinsMap &mapCoins,
     ::BatchWriteNullifiers(mapSaplingNullifiers, cacheSaplingNullifiers);
     ::BatchWriteNullifiers(mapOrchardNullifiers, cacheOrchardNullifiers);
 
+    // The nodes of each tree from where the child view updated it on have
+    // been replaced.
+    for (const auto& [epochId, historyCacheIn] : historyCacheMapIn) {
+        InvalidateHistoryNodes(epochId, historyCacheIn.updateDepth);
+    }
     ::BatchWriteHistory(historyCacheMap, historyCacheMapIn);
 
     cacheSaplingSubtrees.BatchWrite(base, cacheSaplingSubtreesIn);
@@ -1008,7 +1238,11 @@ bool CCoinsViewCache::Flush() {
                                 cacheOrchardNullifiers,
                                 historyCacheMap,
                                 cacheSaplingSubtrees,
-                                cacheOrchardSubtrees);
+                                cacheOrchardSubtrees,
+                                true);
+    coinsStats.nEvictions += cacheCoins.size();
+    nullifiersStats.nEvictions += NullifiersCacheSize();
+    anchorsStats.nEvictions += AnchorsCacheSize();
     cacheCoins.clear();
     cacheSproutAnchors.clear();
     cacheSaplingAnchors.clear();
@@ -1016,17 +1250,149 @@ bool CCoinsViewCache::Flush() {
     cacheSproutNullifiers.clear();
     cacheSaplingNullifiers.clear();
     cacheOrchardNullifiers.clear();
+    if (fOk) {
+        RetainHistoryNodes();
+    } else {
+        historyNodeCache.clear();
+    }
     historyCacheMap.clear();
     cacheSaplingSubtrees.clear();
     cacheOrchardSubtrees.clear();
+    ReallocateCache();
     cachedCoinsUsage = 0;
     return fOk;
 }
 
+bool CCoinsViewCache::SyncAndTrim(size_t nTargetUsage) {
+    cacheSaplingSubtrees.Initialize(base);
+    cacheOrchardSubtrees.Initialize(base);
+
+    bool fOk = base->BatchWrite(cacheCoins,
+                                hashBlock,
+                                hashSproutAnchor,
+                                hashSaplingAnchor,
+                                hashOrchardAnchor,
+                                cacheSproutAnchors,
+                                cacheSaplingAnchors,
+                                cacheOrchardAnchors,
+                                cacheSproutNullifiers,
+                                cacheSaplingNullifiers,
+                                cacheOrchardNullifiers,
+                                historyCacheMap,
+                                cacheSaplingSubtrees,
+                                cacheOrchardSubtrees,
+                                false);
+    if (!fOk) {
+        return false;
+    }
+
+    // Every entry now matches the base. Spent ones carry no information, and
+    // the rest stay cached as clean entries.
+    for (CCoinsMap::iterator it = cacheCoins.begin(); it != cacheCoins.end();) {
+        if (it->second.coins.IsPruned()) {
+            cachedCoinsUsage -= it->second.coins.DynamicMemoryUsage();
+            it = cacheCoins.erase(it);
+        } else {
+            it->second.flags = 0;
+            ++it;
+        }
+    }
+    nullifiersStats.nEvictions += NullifiersCacheSize();
+    anchorsStats.nEvictions += AnchorsCacheSize();
+    cacheSproutAnchors.clear();
+    cacheSaplingAnchors.clear();
+    cacheOrchardAnchors.clear();
+    cacheSproutNullifiers.clear();
+    cacheSaplingNullifiers.clear();
+    cacheOrchardNullifiers.clear();
+    RetainHistoryNodes();
+    historyCacheMap.clear();
+    cacheSaplingSubtrees.clear();
+    cacheOrchardSubtrees.clear();
+
+    size_t nUsage = DynamicMemoryUsage();
+    if (nUsage <= nTargetUsage) {
+        return true;
+    }
+
+    // Evict whole epochs, least recently used first, until enough memory
+    // has been given back.
+    static const size_t nNodeUsage = sizeof(CCoinsMap::value_type) + 2 * sizeof(void*);
+    std::map<uint32_t, size_t> mapEpochUsage;
+    for (const auto& entry : cacheCoins) {
+        mapEpochUsage[entry.second.nLastUsed] += nNodeUsage + entry.second.coins.DynamicMemoryUsage();
+    }
+    size_t nToFree = nUsage - nTargetUsage;
+    size_t nFreed = 0;
+    uint32_t nCutoff = 0;
+    for (const auto& epoch : mapEpochUsage) {
+        nCutoff = epoch.first;
+        nFreed += epoch.second;
+        if (nFreed >= nToFree) {
+            break;
+        }
+    }
+    for (CCoinsMap::iterator it = cacheCoins.begin(); it != cacheCoins.end();) {
+        if (it->second.nLastUsed <= nCutoff) {
+            cachedCoinsUsage -= it->second.coins.DynamicMemoryUsage();
+            it = cacheCoins.erase(it);
+            coinsStats.nEvictions++;
+        } else {
+            ++it;
+        }
+    }
+    return true;
+}
+
+void CCoinsViewCache::ReallocateCache()
+{
+    assert(cacheCoins.empty());
+    assert(cacheSproutNullifiers.empty());
+    assert(cacheSaplingNullifiers.empty());
+    assert(cacheOrchardNullifiers.empty());
+    cacheCoins.~CCoinsMap();
+    cacheSproutNullifiers.~CNullifiersMap();
+    cacheSaplingNullifiers.~CNullifiersMap();
+    cacheOrchardNullifiers.~CNullifiersMap();
+    cacheMemoryResource.~CCoinsMapMemoryResource();
+    ::new (&cacheMemoryResource) CCoinsMapMemoryResource{};
+    ::new (&cacheCoins) CCoinsMap{0, SaltedTxidHasher(), std::equal_to<uint256>(), &cacheMemoryResource};
+    ::new (&cacheSproutNullifiers) CNullifiersMap{0, SaltedTxidHasher(), std::equal_to<uint256>(), &cacheMemoryResource};
+    ::new (&cacheSaplingNullifiers) CNullifiersMap{0, SaltedTxidHasher(), std::equal_to<uint256>(), &cacheMemoryResource};
+    ::new (&cacheOrchardNullifiers) CNullifiersMap{0, SaltedTxidHasher(), std::equal_to<uint256>(), &cacheMemoryResource};
+}
+
 unsigned int CCoinsViewCache::GetCacheSize() const {
     return cacheCoins.size();
 }
 
+size_t CCoinsViewCache::NullifiersCacheSize() const {
+    return cacheSproutNullifiers.size() + cacheSaplingNullifiers.size() + cacheOrchardNullifiers.size();
+}
+
+size_t CCoinsViewCache::AnchorsCacheSize() const {
+    return cacheSproutAnchors.size() + cacheSaplingAnchors.size() + cacheOrchardAnchors.size();
+}
+
+CCacheStats CCoinsViewCache::GetCoinsCacheStats() const {
+    CCacheStats stats = coinsStats;
+    stats.nEntries = cacheCoins.size();
+    stats.nMemoryUsage = DynamicMemoryUsage();
+    return stats;
+}
+
+CCacheStats CCoinsViewCache::GetNullifiersCacheStats() const {
+    CCacheStats stats = nullifiersStats;
+    stats.nEntries = NullifiersCacheSize();
+    return stats;
+}
+
+CCacheStats CCoinsViewCache::GetAnchorsCacheStats() const {
+    CCacheStats stats = anchorsStats;
+    stats.nEntries = AnchorsCacheSize();
+    return stats;
+}
+
 const CTxOut &CCoinsViewCache::GetOutputFor(const CTxIn& input) const
 {
     const CCoins* coins = AccessCoins(input.prevout.hash);
@@ -7,15 +7,22 @@
 #ifndef BITCOIN_COINS_H
 #define BITCOIN_COINS_H
 
+#include "cachestats.h"
 #include "compressor.h"
 #include "core_memusage.h"
 #include "hash.h"
 #include "memusage.h"
 #include "serialize.h"
+#include "support/allocators/pool.h"
 #include "uint256.h"
 
 #include <assert.h>
+#include <functional>
+#include <map>
+#include <set>
 #include <stdint.h>
+#include <unordered_map>
+#include <vector>
 
 #include <boost/unordered_map.hpp>
 #include <tl/expected.hpp>
@@ -264,17 +271,33 @@ public:
     }
 };
 
+class SaltedOutpointHasher
+{
+private:
+    /** Salt */
+    const uint64_t k0, k1;
+
+public:
+    SaltedOutpointHasher();
+
+    /** This *must* return size_t, see SaltedTxidHasher. */
+    size_t operator()(const COutPoint& outpoint) const {
+        return SipHashUint256Extra(k0, k1, outpoint.hash, outpoint.n);
+    }
+};
+
 struct CCoinsCacheEntry
 {
     CCoins coins; // The actual cached data.
     unsigned char flags;
+    uint32_t nLastUsed; // Recency epoch of the last access, see CCoinsViewCache::SyncAndTrim.
 
     enum Flags {
         DIRTY = (1 << 0), // This cache entry is potentially different from the version in the parent view.
         FRESH = (1 << 1), // The parent view does not have this entry (or it is pruned).
     };
 
-    CCoinsCacheEntry() : coins(), flags(0) {}
+    CCoinsCacheEntry() : coins(), flags(0), nLastUsed(0) {}
 };
 
 struct CAnchorsSproutCacheEntry
@@ -338,12 +361,37 @@ enum ShieldedType: uint8_t
     ORCHARD = 0x03,
 };
 
-typedef boost::unordered_map<uint256, CCoinsCacheEntry, SaltedTxidHasher> CCoinsMap;
+/**
+ * Largest node allocated by the coins and nullifier cache maps: the entry
+ * itself plus the next pointer and cached hash that std::unordered_map keeps
+ * in each node, with room to spare for other standard libraries.
+ */
+static constexpr size_t COINS_CACHE_POOL_BLOCK_SIZE =
+    sizeof(std::pair<const uint256, CCoinsCacheEntry>) + sizeof(void*) * 4;
+static_assert(COINS_CACHE_POOL_BLOCK_SIZE % alignof(void*) == 0,
+    "COINS_CACHE_POOL_BLOCK_SIZE must be a multiple of the pool alignment");
+
+/**
+ * The coins and nullifier maps hold by far the most entries of a cache, so
+ * their nodes are carved out of a pool shared by all of a view's maps,
+ * rather than each costing a separate heap allocation.
+ */
+template<typename Entry>
+using CCoinsCachePoolMap = std::unordered_map<
+    uint256, Entry, SaltedTxidHasher, std::equal_to<uint256>,
+    PoolAllocator<std::pair<const uint256, Entry>, COINS_CACHE_POOL_BLOCK_SIZE, alignof(void*)>>;
+
+typedef CCoinsCachePoolMap<CCoinsCacheEntry> CCoinsMap;
 typedef boost::unordered_map<uint256, CAnchorsSproutCacheEntry, SaltedTxidHasher> CAnchorsSproutMap;
 typedef boost::unordered_map<uint256, CAnchorsSaplingCacheEntry, SaltedTxidHasher> CAnchorsSaplingMap;
 typedef boost::unordered_map<uint256, CAnchorsOrchardCacheEntry, SaltedTxidHasher> CAnchorsOrchardMap;
-typedef boost::unordered_map<uint256, CNullifiersCacheEntry, SaltedTxidHasher> CNullifiersMap;
+typedef CCoinsCachePoolMap<CNullifiersCacheEntry> CNullifiersMap;
+typedef CCoinsMap::allocator_type::ResourceType CCoinsMapMemoryResource;
+static_assert(std::is_same<CNullifiersMap::allocator_type::ResourceType, CCoinsMapMemoryResource>::value,
+    "the coins and nullifier maps must be able to share a pool");
 typedef boost::unordered_map<uint32_t, HistoryCache> CHistoryCacheMap;
+//! History tree nodes of one epoch, by index.
+typedef std::map<HistoryIndex, HistoryNode> CHistoryNodeMap;
 
 struct CCoinsStats
 {
@@ -376,6 +424,11 @@ public:
     //! Determine whether a nullifier is spent or not
     virtual bool GetNullifier(const uint256 &nullifier, ShieldedType type) const = 0;
 
+    //! Determine which of a set of nullifiers are spent, adding those to
+    //! `spent`. By default each nullifier is looked up with GetNullifier;
+    //! database-backed views override this to find them all in one pass.
+    virtual void GetNullifiers(const std::set<uint256> &nullifiers, ShieldedType type, std::set<uint256> &spent) const;
+
     //! Retrieve the CCoins (unspent transaction outputs) for a given txid
     virtual bool GetCoins(const uint256 &txid, CCoins &coins) const = 0;
 
@@ -423,7 +476,8 @@ public:
 
     //! Do a bulk modification onto this cache. All of the provided
     //! caches may be modified and should be cleared by the caller
-    //! after this batch write.
+    //! after this batch write. If fErase is false, the entries of mapCoins
+    //! are copied rather than consumed, so that the caller can keep them.
     virtual bool BatchWrite(CCoinsMap &mapCoins,
                             const uint256 &hashBlock,
                             const uint256 &hashSproutAnchor,
@@ -437,7 +491,8 @@ public:
                             CNullifiersMap &mapOrchardNullifiers,
                             CHistoryCacheMap &historyCacheMap,
                             SubtreeCache &cacheSaplingSubtrees,
-                            SubtreeCache &cacheOrchardSubtrees) = 0;
+                            SubtreeCache &cacheOrchardSubtrees,
+                            bool fErase) = 0;
 
     //! Calculate statistics about the unspent transaction output set
     virtual bool GetStats(CCoinsStats &stats) const = 0;
@@ -533,7 +588,8 @@ public:
                     CNullifiersMap &mapOrchardNullifiers,
                     CHistoryCacheMap &historyCacheMap,
                     SubtreeCache &cacheSaplingSubtrees,
-                    SubtreeCache &cacheOrchardSubtrees) { return false; }
+                    SubtreeCache &cacheOrchardSubtrees,
+                    bool fErase) { return false; }
 
     bool GetStats(CCoinsStats &stats) const { return false; }
 };
@@ -552,6 +608,7 @@ public:
     bool GetSaplingAnchorAt(const uint256 &rt, SaplingMerkleTree &tree) const;
     bool GetOrchardAnchorAt(const uint256 &rt, OrchardMerkleFrontier &tree) const;
     bool GetNullifier(const uint256 &nullifier, ShieldedType type) const;
+    void GetNullifiers(const std::set<uint256> &nullifiers, ShieldedType type, std::set<uint256> &spent) const;
     bool GetCoins(const uint256 &txid, CCoins &coins) const;
     bool HaveCoins(const uint256 &txid) const;
     uint256 GetBestBlock() const;
@@ -564,6 +621,7 @@ public:
             ShieldedType type,
             libzcash::SubtreeIndex index) const;
     void SetBackend(CCoinsView &viewIn);
+    CCoinsView* GetBackend() const { return base; }
     bool BatchWrite(CCoinsMap &mapCoins,
                     const uint256 &hashBlock,
                     const uint256 &hashSproutAnchor,
@@ -577,7 +635,8 @@ public:
                     CNullifiersMap &mapOrchardNullifiers,
                     CHistoryCacheMap &historyCacheMap,
                     SubtreeCache &cacheSaplingSubtrees,
-                    SubtreeCache &cacheOrchardSubtrees);
+                    SubtreeCache &cacheOrchardSubtrees,
+                    bool fErase);
     bool GetStats(CCoinsStats &stats) const;
 };
 
@@ -621,29 +680,50 @@ protected:
     /* Whether this cache has an active modifier. */
     bool hasModifier;
 
+    /* Pool from which the nodes of cacheCoins and the nullifier maps are allocated. */
+    mutable CCoinsMapMemoryResource cacheMemoryResource{};
 
     /**
      * Make mutable so that we can "fill the cache" even from Get-methods
      * declared as "const".
      */
     mutable uint256 hashBlock;
-    mutable CCoinsMap cacheCoins;
+    mutable CCoinsMap cacheCoins{0, SaltedTxidHasher(), std::equal_to<uint256>(), &cacheMemoryResource};
     mutable uint256 hashSproutAnchor;
     mutable uint256 hashSaplingAnchor;
     mutable uint256 hashOrchardAnchor;
     mutable CAnchorsSproutMap cacheSproutAnchors;
     mutable CAnchorsSaplingMap cacheSaplingAnchors;
     mutable CAnchorsOrchardMap cacheOrchardAnchors;
-    mutable CNullifiersMap cacheSproutNullifiers;
-    mutable CNullifiersMap cacheSaplingNullifiers;
-    mutable CNullifiersMap cacheOrchardNullifiers;
+    mutable CNullifiersMap cacheSproutNullifiers{0, SaltedTxidHasher(), std::equal_to<uint256>(), &cacheMemoryResource};
+    mutable CNullifiersMap cacheSaplingNullifiers{0, SaltedTxidHasher(), std::equal_to<uint256>(), &cacheMemoryResource};
+    mutable CNullifiersMap cacheOrchardNullifiers{0, SaltedTxidHasher(), std::equal_to<uint256>(), &cacheMemoryResource};
     mutable CHistoryCacheMap historyCacheMap;
+    /**
+     * History tree nodes of the base view, by epoch. Unlike historyCacheMap
+     * this is kept across flushes, trimmed to the nodes the next update of
+     * each tree needs: its peaks, and the nodes along the right slope of its
+     * last peak. Appending to or removing from the end of a tree then reads
+     * nothing from the base view.
+     */
+    mutable std::map<uint32_t, CHistoryNodeMap> historyNodeCache;
     mutable SubtreeCache cacheSaplingSubtrees = SubtreeCache(SAPLING);
     mutable SubtreeCache cacheOrchardSubtrees = SubtreeCache(ORCHARD);
 
     /* Cached dynamic memory usage for the inner CCoins objects. */
     mutable size_t cachedCoinsUsage;
 
+    /* Recency epoch stamped onto coins entries as they are accessed. */
+    uint32_t nCacheEpoch = 0;
+
+    /* Counters of the lookups in the coins, nullifier and anchor maps. */
+    mutable CCacheStats coinsStats;
+    mutable CCacheStats nullifiersStats;
+    mutable CCacheStats anchorsStats;
+
+    size_t NullifiersCacheSize() const;
+    size_t AnchorsCacheSize() const;
+
 public:
     CCoinsViewCache(CCoinsView *baseIn);
     ~CCoinsViewCache();
@@ -653,6 +733,7 @@ public:
     bool GetSaplingAnchorAt(const uint256 &rt, SaplingMerkleTree &tree) const;
     bool GetOrchardAnchorAt(const uint256 &rt, OrchardMerkleFrontier &tree) const;
     bool GetNullifier(const uint256 &nullifier, ShieldedType type) const;
+    void GetNullifiers(const std::set<uint256> &nullifiers, ShieldedType type, std::set<uint256> &spent) const;
     bool GetCoins(const uint256 &txid, CCoins &coins) const;
     bool HaveCoins(const uint256 &txid) const;
     uint256 GetBestBlock() const;
@@ -678,7 +759,8 @@ public:
                     CNullifiersMap &mapOrchardNullifiers,
                     CHistoryCacheMap &historyCacheMap,
                     SubtreeCache &cacheSaplingSubtrees,
-                    SubtreeCache &cacheOrchardSubtrees);
+                    SubtreeCache &cacheOrchardSubtrees,
+                    bool fErase);
 
     // Adds the tree to mapSproutAnchors, mapSaplingAnchors, or mapOrchardAnchors
     // based on the type of tree and sets the current commitment root to this root.
@@ -716,6 +798,37 @@ public:
      */
     const CCoins* AccessCoins(const uint256 &txid) const;
 
+    /**
+     * Check if we have the given tx already loaded in this cache.
+     * The semantics are the same as HaveCoins(), but no calls to
+     * the backing CCoinsView are made.
+     */
+    bool HaveCoinsInCache(const uint256 &txid) const;
+
+    /**
+     * Load into this cache the spentness of every nullifier revealed by the
+     * given transactions, and every anchor they refer to, so that checking
+     * their shielded requirements does not go to the backing view one key at
+     * a time. Nullifiers missing from the cache are fetched from the backing
+     * view with a single GetNullifiers call per pool.
+     */
+    void PrefetchShieldedRequirements(const std::vector<CTransaction> &vtx) const;
+
+    /**
+     * Read the CCoins for txid from the backing view, bypassing this cache.
+     * This does not touch any state of the cache, so it may be called from
+     * several threads at once as long as the backing view's GetCoins allows
+     * concurrent readers (CCoinsViewDB does).
+     */
+    bool GetCoinsFromBase(const uint256 &txid, CCoins &coins) const;
+
+    /**
+     * Insert a CCoins previously read with GetCoinsFromBase into the cache,
+     * so that later accesses to it do not go to the backing view. Does
+     * nothing if the cache already has an entry for txid.
+     */
+    void CacheFetchedCoins(const uint256 &txid, CCoins &coins);
+
     /**
      * Return a modifiable reference to a CCoins. If no entry with the given
      * txid exists, a new one is created. Simultaneous modifications are not
@@ -740,12 +853,27 @@ public:
      */
     bool Flush();
 
+    /**
+     * Push the modifications applied to this cache to its base like Flush,
+     * but keep the unspent coins cached as clean entries, so that lookups
+     * after a flush do not all go to the base. If the cache then uses more
+     * than nTargetUsage bytes, the least recently used coins are evicted
+     * until it fits. Shielded state is always written out and dropped.
+     */
+    bool SyncAndTrim(size_t nTargetUsage);
+
     //! Calculate the size of the cache (in number of transactions)
     unsigned int GetCacheSize() const;
 
     //! Calculate the size of the cache (in bytes)
     size_t DynamicMemoryUsage() const;
 
+    //! The statistics of the coins map, including the memory usage of the
+    //! whole cache, and of the nullifier and anchor maps.
+    CCacheStats GetCoinsCacheStats() const;
+    CCacheStats GetNullifiersCacheStats() const;
+    CCacheStats GetAnchorsCacheStats() const;
+
     /**
      * Amount of coins coming in to a transaction
      *
@@ -783,6 +911,13 @@ private:
      */
     CCoinsViewCache(const CCoinsViewCache &);
 
+    /**
+     * Release the pool backing the coins and nullifier maps, which must be
+     * empty, and start over with a fresh one. Memory freed by erasing entries
+     * is only reused by later insertions, so this lets it be reclaimed.
+     */
+    void ReallocateCache();
+
     //! Generalized interface for popping anchors
     template<typename Tree, typename Cache, typename CacheEntry>
     void AbstractPopAnchor(
@@ -819,6 +954,19 @@ private:
 
     //! Selects history cache for specified epoch.
     HistoryCache& SelectHistoryCache(uint32_t epochId) const;
+
+    //! Truncates the history of an epoch, forgetting the cached nodes that
+    //! are removed.
+    void TruncateHistory(HistoryCache& historyCache, HistoryIndex newLength);
+
+    //! Forgets the cached history nodes of an epoch from the given index on,
+    //! which no longer match the base view.
+    void InvalidateHistoryNodes(uint32_t epochId, HistoryIndex fromIndex) const;
+
+    //! Before historyCacheMap is cleared, moves into historyNodeCache the
+    //! nodes of each updated tree that its next update needs, and drops the
+    //! rest.
+    void RetainHistoryNodes();
 };
 
 #endif // BITCOIN_COINS_H
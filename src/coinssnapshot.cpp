@@ -0,0 +1,123 @@
+// Copyright (c) 2026 The Zcash developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or https://www.opensource.org/licenses/mit-license.php .
+
+#include "coinssnapshot.h"
+
+#include "chain.h"
+#include "primitives/block.h"
+
+CCoinsSnapshotPublisher coinsSnapshots;
+
+bool CCoinsSnapshot::GetCoins(const uint256 &txid, CCoins &coins) const
+{
+    for (auto it = vDeltas.rbegin(); it != vDeltas.rend(); it++) {
+        auto itCoins = (*it)->find(txid);
+        if (itCoins != (*it)->end()) {
+            coins = itCoins->second;
+            return !coins.IsPruned();
+        }
+    }
+    return base->GetCoins(txid, coins);
+}
+
+bool CCoinsSnapshot::HaveCoins(const uint256 &txid) const
+{
+    for (auto it = vDeltas.rbegin(); it != vDeltas.rend(); it++) {
+        auto itCoins = (*it)->find(txid);
+        if (itCoins != (*it)->end()) {
+            return !itCoins->second.IsPruned();
+        }
+    }
+    return base->HaveCoins(txid);
+}
+
+void CCoinsSnapshotPublisher::Reset(CCoinsView* baseIn, const CBlockIndex* pindexTip)
+{
+    base = baseIn;
+    vDeltas.clear();
+    nEntries = 0;
+    fComplete = true;
+    if (pindexTip) {
+        Publish(pindexTip);
+    } else {
+        LOCK(cs);
+        current.reset();
+    }
+}
+
+void CCoinsSnapshotPublisher::BlockChanged(const CCoinsViewCache& view, const CBlock& block, const CBlockIndex* pindexTip)
+{
+    if (!fComplete) return;
+
+    std::set<uint256> setTxids;
+    for (const CTransaction& tx : block.vtx) {
+        setTxids.insert(tx.GetHash());
+        if (!tx.IsCoinBase()) {
+            for (const CTxIn& txin : tx.vin) {
+                setTxids.insert(txin.prevout.hash);
+            }
+        }
+    }
+
+    if (nEntries + setTxids.size() > MAX_COINS_SNAPSHOT_ENTRIES) {
+        // Far too many blocks since the last flush, as during the initial
+        // download. Readers take cs_main until the next flush.
+        fComplete = false;
+        vDeltas.clear();
+        nEntries = 0;
+        LOCK(cs);
+        current.reset();
+        return;
+    }
+
+    auto delta = std::make_shared<CCoinsSnapshot::Delta>();
+    for (const uint256& txid : setTxids) {
+        CCoins& coins = (*delta)[txid];
+        if (!view.GetCoins(txid, coins)) {
+            coins.Clear();
+        }
+    }
+    nEntries += delta->size();
+    vDeltas.push_back(delta);
+
+    // Merge the deltas once there are many of them, so that lookups do not
+    // have to go through too many maps. Published snapshots keep the
+    // deltas they were made from.
+    if (vDeltas.size() > MAX_COINS_SNAPSHOT_DELTAS) {
+        auto merged = std::make_shared<CCoinsSnapshot::Delta>();
+        for (const auto& d : vDeltas) {
+            for (const auto& [txid, coins] : *d) {
+                (*merged)[txid] = coins;
+            }
+        }
+        vDeltas.assign(1, merged);
+        nEntries = merged->size();
+    }
+
+    Publish(pindexTip);
+}
+
+void CCoinsSnapshotPublisher::Publish(const CBlockIndex* pindexTip)
+{
+    if (!fComplete || !base || !pindexTip) return;
+    auto snapshot = std::make_shared<CCoinsSnapshot>(base, vDeltas, pindexTip->GetBlockHash(), pindexTip->nHeight);
+    LOCK(cs);
+    current = std::move(snapshot);
+}
+
+void CCoinsSnapshotPublisher::Clear()
+{
+    base = nullptr;
+    vDeltas.clear();
+    nEntries = 0;
+    fComplete = false;
+    LOCK(cs);
+    current.reset();
+}
+
+std::shared_ptr<CCoinsSnapshot> CCoinsSnapshotPublisher::Get() const
+{
+    LOCK(cs);
+    return current;
+}
@@ -0,0 +1,98 @@
+// Copyright (c) 2026 The Zcash developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or https://www.opensource.org/licenses/mit-license.php .
+
+#ifndef ZCASH_COINSSNAPSHOT_H
+#define ZCASH_COINSSNAPSHOT_H
+
+#include "coins.h"
+#include "sync.h"
+#include "uint256.h"
+
+#include <map>
+#include <memory>
+#include <set>
+#include <vector>
+
+class CBlock;
+class CBlockIndex;
+
+//! The most coins entries the snapshots may hold before they are dropped
+//! until the next flush of the chain state.
+static const size_t MAX_COINS_SNAPSHOT_ENTRIES = 250000;
+//! How many blocks of changes are kept apart before they are merged.
+static const size_t MAX_COINS_SNAPSHOT_DELTAS = 32;
+
+/**
+ * The unspent transparent outputs as of a block, which can be read without
+ * cs_main.
+ *
+ * A snapshot consists of the chain state as last flushed, which is a
+ * database that can be read from any thread, and the coins changed by each
+ * block connected or disconnected since then. Neither is modified once the
+ * snapshot is published, except that the flushed chain state may move ahead
+ * of the snapshot when a later snapshot is flushed, so the coins of a
+ * transaction that was not changed since the last flush may be answered as
+ * of a slightly later block.
+ */
+class CCoinsSnapshot : public CCoinsViewBacked
+{
+public:
+    //! The coins of the transactions changed by some blocks, pruned if they
+    //! are all spent.
+    typedef std::map<uint256, CCoins> Delta;
+
+private:
+    //! Oldest first.
+    const std::vector<std::shared_ptr<const Delta>> vDeltas;
+
+public:
+    const uint256 hashBlock;
+    const int nHeight;
+
+    CCoinsSnapshot(CCoinsView* baseIn, std::vector<std::shared_ptr<const Delta>> vDeltasIn,
+        const uint256& hashBlockIn, int nHeightIn) :
+        CCoinsViewBacked(baseIn), vDeltas(std::move(vDeltasIn)), hashBlock(hashBlockIn), nHeight(nHeightIn) {}
+
+    bool GetCoins(const uint256 &txid, CCoins &coins) const;
+    bool HaveCoins(const uint256 &txid) const;
+    uint256 GetBestBlock() const { return hashBlock; }
+};
+
+/**
+ * Keeps track of the changes to pcoinsTip since it was last flushed, and
+ * publishes a new CCoinsSnapshot after each change. All of the methods but
+ * Get are called with cs_main held.
+ */
+class CCoinsSnapshotPublisher
+{
+private:
+    mutable Mutex cs;
+    std::shared_ptr<CCoinsSnapshot> current GUARDED_BY(cs);
+
+    CCoinsView* base = nullptr;
+    std::vector<std::shared_ptr<const CCoinsSnapshot::Delta>> vDeltas;
+    size_t nEntries = 0;
+    //! Whether the changes since the last flush are all in vDeltas.
+    bool fComplete = false;
+
+public:
+    //! Start over from a chain state that was just flushed to base, or just
+    //! created over it. A snapshot is published if pindexTip is set.
+    void Reset(CCoinsView* baseIn, const CBlockIndex* pindexTip);
+    //! Record the coins changed by connecting or disconnecting the block,
+    //! read from the view they were changed in, and publish a snapshot as
+    //! of pindexTip.
+    void BlockChanged(const CCoinsViewCache& view, const CBlock& block, const CBlockIndex* pindexTip);
+    //! Publish a snapshot of the changes so far as of pindexTip.
+    void Publish(const CBlockIndex* pindexTip);
+    //! Stop publishing snapshots, before the chain state is deleted.
+    void Clear();
+
+    //! The latest snapshot, or null if there is none.
+    std::shared_ptr<CCoinsSnapshot> Get() const;
+};
+
+extern CCoinsSnapshotPublisher coinsSnapshots;
+
+#endif // ZCASH_COINSSNAPSHOT_H
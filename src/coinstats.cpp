@@ -0,0 +1,354 @@
+// Copyright (c) 2026 The Zcash developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or https://www.opensource.org/licenses/mit-license.php .
+
+#include "coinstats.h"
+
+#include "chain.h"
+#include "clientversion.h"
+#include "init.h"
+#include "main.h"
+#include "primitives/block.h"
+#include "streams.h"
+#include "txdb.h"
+#include "undo.h"
+#include "util/system.h"
+#include "util/time.h"
+
+#include <memory>
+
+CTxOutSetStatsIndex* ptxoutsetstats = NULL;
+
+namespace {
+
+CDataStream TxOutSetElement(const COutPoint& outpoint, const CTxOut& out)
+{
+    CDataStream ss(SER_DISK, PROTOCOL_VERSION);
+    ss << outpoint << out;
+    return ss;
+}
+
+int64_t TxOutBogoSize(const CTxOut& out)
+{
+    return 32 /* txid */ + 4 /* vout index */ + 4 /* height and coinbase flag */ +
+        8 /* amount */ + 2 /* script length */ + out.scriptPubKey.size();
+}
+
+}
+
+void CTxOutSetAccumulator::AddOutput(const COutPoint& outpoint, const CTxOut& out)
+{
+    CDataStream element = TxOutSetElement(outpoint, out);
+    digest.Add((const unsigned char*)element.data(), element.size());
+    nTransactionOutputs++;
+    nBogoSize += TxOutBogoSize(out);
+    nTotalAmount += out.nValue;
+}
+
+void CTxOutSetAccumulator::RemoveOutput(const COutPoint& outpoint, const CTxOut& out)
+{
+    CDataStream element = TxOutSetElement(outpoint, out);
+    digest.Remove((const unsigned char*)element.data(), element.size());
+    nTransactionOutputs--;
+    nBogoSize -= TxOutBogoSize(out);
+    nTotalAmount -= out.nValue;
+}
+
+CTxOutSetAccumulator& CTxOutSetAccumulator::operator+=(const CTxOutSetAccumulator& other)
+{
+    nTransactions += other.nTransactions;
+    nTransactionOutputs += other.nTransactionOutputs;
+    nBogoSize += other.nBogoSize;
+    nTotalAmount += other.nTotalAmount;
+    digest += other.digest;
+    return *this;
+}
+
+CTxOutSetAccumulator& CTxOutSetAccumulator::operator-=(const CTxOutSetAccumulator& other)
+{
+    nTransactions -= other.nTransactions;
+    nTransactionOutputs -= other.nTransactionOutputs;
+    nBogoSize -= other.nBogoSize;
+    nTotalAmount -= other.nTotalAmount;
+    digest -= other.digest;
+    return *this;
+}
+
+CTxOutSetStats CTxOutSetAccumulator::Finalize(int nHeight) const
+{
+    CTxOutSetStats stats;
+    stats.nHeight = nHeight;
+    stats.nTransactions = nTransactions;
+    stats.nTransactionOutputs = nTransactionOutputs;
+    stats.nBogoSize = nBogoSize;
+    stats.nTotalAmount = nTotalAmount;
+    digest.Finalize(stats.hashDigest.begin());
+    return stats;
+}
+
+CTxOutSetAccumulator GetBlockTxOutSetDelta(const CBlock& block, const CBlockUndo& blockundo, const CBlockIndex* pindex)
+{
+    CTxOutSetAccumulator delta;
+    // The outputs of the genesis block are not added to the UTXO set.
+    if (pindex->pprev == NULL) {
+        return delta;
+    }
+    assert(blockundo.vtxundo.size() + 1 == block.vtx.size());
+    for (size_t i = 0; i < block.vtx.size(); i++) {
+        const CTransaction& tx = block.vtx[i];
+        if (i > 0) {
+            const CTxUndo& txundo = blockundo.vtxundo[i - 1];
+            assert(txundo.vprevout.size() == tx.vin.size());
+            for (size_t j = 0; j < tx.vin.size(); j++) {
+                const CTxInUndo& undo = txundo.vprevout[j];
+                delta.RemoveOutput(tx.vin[j].prevout, undo.txout);
+                // The undo data only records the metadata of a transaction
+                // when its last unspent output is spent.
+                if (undo.nHeight != 0) {
+                    delta.nTransactions--;
+                }
+            }
+        }
+        bool fAnyOutputs = false;
+        for (uint32_t n = 0; n < tx.vout.size(); n++) {
+            // Unspendable outputs are never added to the coins database.
+            if (tx.vout[n].scriptPubKey.IsUnspendable()) {
+                continue;
+            }
+            delta.AddOutput(COutPoint(tx.GetHash(), n), tx.vout[n]);
+            fAnyOutputs = true;
+        }
+        if (fAnyOutputs) {
+            delta.nTransactions++;
+        }
+    }
+    return delta;
+}
+
+bool ScanTxOutSet(CCoinsViewDBCursor& cursor, CTxOutSetAccumulator& acc, const std::function<bool()>& fnInterrupt)
+{
+    uint256 prevHash;
+    bool fFirst = true;
+    for (; cursor.Valid(); cursor.Next()) {
+        if (fnInterrupt()) {
+            return false;
+        }
+        const COutPoint& outpoint = cursor.GetOutPoint();
+        CTxOut out;
+        if (!cursor.GetTxOut(out)) {
+            return error("%s: unable to read coins database", __func__);
+        }
+        // The outputs of a transaction are adjacent.
+        if (fFirst || outpoint.hash != prevHash) {
+            acc.nTransactions++;
+            prevHash = outpoint.hash;
+            fFirst = false;
+        }
+        acc.AddOutput(outpoint, out);
+    }
+    return true;
+}
+
+bool ScanTxOutSet(std::vector<std::unique_ptr<CCoinsViewDBCursor>>& cursors, CTxOutSetAccumulator& acc, const std::function<bool()>& fnInterrupt)
+{
+    std::vector<CTxOutSetAccumulator> vParts(cursors.size());
+    // Not std::vector<bool>, whose elements cannot be written concurrently.
+    std::vector<char> vComplete(cursors.size(), false);
+    std::vector<std::thread> vThreads;
+    for (size_t i = 0; i < cursors.size(); i++) {
+        vThreads.emplace_back([&, i] {
+            try {
+                vComplete[i] = ScanTxOutSet(*cursors[i], vParts[i], fnInterrupt);
+            } catch (const std::exception& e) {
+                LogPrintf("%s: %s\n", __func__, e.what());
+            }
+        });
+    }
+    for (std::thread& thread : vThreads) {
+        thread.join();
+    }
+    for (size_t i = 0; i < cursors.size(); i++) {
+        if (!vComplete[i]) {
+            return false;
+        }
+        acc += vParts[i];
+    }
+    return true;
+}
+
+CTxOutSetStatsIndex::CTxOutSetStatsIndex(CBlockTreeDB& blocktreeIn, CCoinsViewDB& coinsdbIn) :
+    blocktree(blocktreeIn), coinsdb(coinsdbIn)
+{
+}
+
+CTxOutSetStatsIndex::~CTxOutSetStatsIndex()
+{
+    Stop();
+}
+
+void CTxOutSetStatsIndex::Init(const CBlockIndex* pindexTip)
+{
+    AssertLockHeld(cs_main);
+    uint256 hashSaved;
+    CTxOutSetAccumulator saved;
+    if (pindexTip == NULL) {
+        // Nothing has been connected, so the UTXO set is empty.
+        fReady = true;
+        fRunningDirty = true;
+    } else if (blocktree.ReadTxOutSetState(hashSaved, saved) && hashSaved == pindexTip->GetBlockHash()) {
+        running = saved;
+        hashTip = hashSaved;
+        fReady = true;
+        LogPrintf("Loaded UTXO set statistics as of block %s\n", hashTip.ToString());
+    } else {
+        LogPrintf("UTXO set statistics are out of date, recomputing them in the background\n");
+        StartScan();
+    }
+}
+
+void CTxOutSetStatsIndex::RecordTip(const CBlockIndex* pindex)
+{
+    hashTip = pindex->GetBlockHash();
+    mapUnflushed[hashTip] = running.Finalize(pindex->nHeight);
+    fRunningDirty = true;
+}
+
+void CTxOutSetStatsIndex::BlockConnected(const CBlock& block, const CBlockUndo& blockundo, const CBlockIndex* pindex)
+{
+    AssertLockHeld(cs_main);
+    if (fReady) {
+        running += GetBlockTxOutSetDelta(block, blockundo, pindex);
+        RecordTip(pindex);
+    } else if (fScanning) {
+        pending += GetBlockTxOutSetDelta(block, blockundo, pindex);
+    }
+}
+
+void CTxOutSetStatsIndex::BlockDisconnected(const CBlock& block, const CBlockUndo& blockundo, const CBlockIndex* pindex)
+{
+    AssertLockHeld(cs_main);
+    if (fReady) {
+        running -= GetBlockTxOutSetDelta(block, blockundo, pindex);
+        RecordTip(pindex->pprev);
+    } else if (fScanning) {
+        pending -= GetBlockTxOutSetDelta(block, blockundo, pindex);
+    }
+}
+
+void CTxOutSetStatsIndex::Rescan()
+{
+    AssertLockHeld(cs_main);
+    fReady = false;
+    if (fScanning) {
+        fRestartScan = true;
+    } else {
+        LogPrintf("Recomputing UTXO set statistics in the background\n");
+        StartScan();
+    }
+}
+
+void CTxOutSetStatsIndex::StartScan()
+{
+    // A previous scan clears fScanning as the last thing it does under
+    // cs_main, so this does not wait for anything that needs the lock.
+    if (scanThread.joinable()) {
+        scanThread.join();
+    }
+    fScanning = true;
+    scanThread = std::thread(&CTxOutSetStatsIndex::ThreadScan, this);
+}
+
+void CTxOutSetStatsIndex::ThreadScan()
+{
+    RenameThread("zc-coinstats");
+    try {
+        while (true) {
+            std::vector<std::unique_ptr<CCoinsViewDBCursor>> cursors;
+            {
+                LOCK(cs_main);
+                fRestartScan = false;
+                // Write everything up to the active tip to the coins database
+                // before reading it; later blocks are collected in pending.
+                FlushStateToDisk();
+                cursors = coinsdb.Cursors(GetNumCores());
+                pending = CTxOutSetAccumulator();
+            }
+
+            int64_t nStart = GetTimeMillis();
+            CTxOutSetAccumulator scanned;
+            bool fComplete = ScanTxOutSet(cursors, scanned, [this] {
+                return fStopScan || ShutdownRequested();
+            });
+            if (!fComplete) {
+                LOCK(cs_main);
+                fScanning = false;
+                return;
+            }
+
+            LOCK(cs_main);
+            if (fRestartScan) {
+                continue;
+            }
+            scanned += pending;
+            running = scanned;
+            pending = CTxOutSetAccumulator();
+            if (chainActive.Tip() != NULL) {
+                RecordTip(chainActive.Tip());
+            }
+            fRunningDirty = true;
+            fReady = true;
+            fScanning = false;
+            LogPrintf("Computed UTXO set statistics as of block %s in %dms\n",
+                hashTip.ToString(), GetTimeMillis() - nStart);
+            return;
+        }
+    } catch (const std::exception& e) {
+        LogPrintf("%s: %s\n", __func__, e.what());
+        LOCK(cs_main);
+        fScanning = false;
+    }
+}
+
+bool CTxOutSetStatsIndex::Flush()
+{
+    AssertLockHeld(cs_main);
+    if (!mapUnflushed.empty()) {
+        if (!blocktree.WriteTxOutSetStats(mapUnflushed)) {
+            return error("%s: failed to write UTXO set statistics", __func__);
+        }
+        mapUnflushed.clear();
+    }
+    // While the statistics are being recomputed, the saved running totals
+    // are left as they are; they do not match the chainstate.
+    if (fReady && fRunningDirty) {
+        if (!blocktree.WriteTxOutSetState(hashTip, running)) {
+            return error("%s: failed to write UTXO set statistics", __func__);
+        }
+        fRunningDirty = false;
+    }
+    return true;
+}
+
+void CTxOutSetStatsIndex::Stop()
+{
+    fStopScan = true;
+    if (scanThread.joinable()) {
+        scanThread.join();
+    }
+}
+
+bool CTxOutSetStatsIndex::GetStats(const CBlockIndex* pindex, CTxOutSetStats& stats) const
+{
+    AssertLockHeld(cs_main);
+    uint256 hash = pindex->GetBlockHash();
+    if (fReady && hash == hashTip) {
+        stats = running.Finalize(pindex->nHeight);
+        return true;
+    }
+    auto it = mapUnflushed.find(hash);
+    if (it != mapUnflushed.end()) {
+        stats = it->second;
+        return true;
+    }
+    return blocktree.ReadTxOutSetStats(hash, stats);
+}
@@ -0,0 +1,191 @@
+// Copyright (c) 2026 The Zcash developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or https://www.opensource.org/licenses/mit-license.php .
+
+#ifndef ZCASH_COINSTATS_H
+#define ZCASH_COINSTATS_H
+
+#include "amount.h"
+#include "crypto/lthash.h"
+#include "primitives/transaction.h"
+#include "serialize.h"
+#include "uint256.h"
+
+#include <atomic>
+#include <functional>
+#include <map>
+#include <memory>
+#include <stdint.h>
+#include <thread>
+#include <vector>
+
+class CBlock;
+class CBlockIndex;
+class CBlockTreeDB;
+class CBlockUndo;
+class CCoinsViewDB;
+class CCoinsViewDBCursor;
+
+//! -txoutsetstats default
+static const bool DEFAULT_TXOUTSET_STATS = true;
+
+/** Statistics of the transparent UTXO set as of a block. */
+struct CTxOutSetStats
+{
+    int nHeight;
+    uint64_t nTransactions;
+    uint64_t nTransactionOutputs;
+    //! An estimate of the size of the set, which unlike the size of the
+    //! database does not depend on how it is stored.
+    uint64_t nBogoSize;
+    CAmount nTotalAmount;
+    //! A digest of the set of outputs that does not depend on the order in
+    //! which they were added.
+    uint256 hashDigest;
+
+    CTxOutSetStats() : nHeight(0), nTransactions(0), nTransactionOutputs(0), nBogoSize(0), nTotalAmount(0) {}
+
+    ADD_SERIALIZE_METHODS;
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream& s, Operation ser_action) {
+        READWRITE(nHeight);
+        READWRITE(nTransactions);
+        READWRITE(nTransactionOutputs);
+        READWRITE(nBogoSize);
+        READWRITE(nTotalAmount);
+        READWRITE(hashDigest);
+    }
+};
+
+/**
+ * Running totals and digest of a multiset of transparent outputs.
+ *
+ * Every quantity is a sum over outputs, so the accumulators of separate sets
+ * of changes can be combined in any order. The totals of a set of changes may
+ * be negative.
+ */
+class CTxOutSetAccumulator
+{
+public:
+    int64_t nTransactions = 0;
+    int64_t nTransactionOutputs = 0;
+    int64_t nBogoSize = 0;
+    CAmount nTotalAmount = 0;
+    LtHash16 digest;
+
+    void AddOutput(const COutPoint& outpoint, const CTxOut& out);
+    void RemoveOutput(const COutPoint& outpoint, const CTxOut& out);
+
+    CTxOutSetAccumulator& operator+=(const CTxOutSetAccumulator& other);
+    CTxOutSetAccumulator& operator-=(const CTxOutSetAccumulator& other);
+
+    CTxOutSetStats Finalize(int nHeight) const;
+
+    ADD_SERIALIZE_METHODS;
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream& s, Operation ser_action) {
+        READWRITE(nTransactions);
+        READWRITE(nTransactionOutputs);
+        READWRITE(nBogoSize);
+        READWRITE(nTotalAmount);
+        READWRITE(digest);
+    }
+};
+
+/**
+ * The changes that connecting a block made to the transparent UTXO set,
+ * given the undo data written when it was connected.
+ */
+CTxOutSetAccumulator GetBlockTxOutSetDelta(const CBlock& block, const CBlockUndo& blockundo, const CBlockIndex* pindex);
+
+/**
+ * Add every output read by cursor to acc. Returns false if fnInterrupt
+ * returned true or the database could not be read.
+ */
+bool ScanTxOutSet(CCoinsViewDBCursor& cursor, CTxOutSetAccumulator& acc, const std::function<bool()>& fnInterrupt);
+
+/**
+ * Like ScanTxOutSet, but reads each cursor from its own thread. The cursors
+ * must cover disjoint ranges of txids, as returned by CCoinsViewDB::Cursors.
+ * fnInterrupt may be called from any of the threads.
+ */
+bool ScanTxOutSet(std::vector<std::unique_ptr<CCoinsViewDBCursor>>& cursors, CTxOutSetAccumulator& acc, const std::function<bool()>& fnInterrupt);
+
+/**
+ * Keeps the statistics of the UTXO set up to date as blocks are connected
+ * and disconnected, so that gettxoutsetinfo does not have to read the whole
+ * coins database. The statistics after each block are kept in the block
+ * tree database, keyed by block hash.
+ *
+ * The running totals are saved along with the chainstate. If on startup they
+ * do not describe the chainstate (because the node was not shut down
+ * cleanly, or the index has just been enabled), they are recomputed from the
+ * coins database by a background thread. The changes made by blocks
+ * connected meanwhile are collected separately and added when it finishes.
+ *
+ * All methods except Stop() must be called with cs_main held.
+ */
+class CTxOutSetStatsIndex
+{
+private:
+    CBlockTreeDB& blocktree;
+    CCoinsViewDB& coinsdb;
+
+    //! Whether running describes the UTXO set as of the active tip.
+    bool fReady = false;
+    uint256 hashTip;
+    CTxOutSetAccumulator running;
+    //! The changes made by blocks while the coins database is scanned.
+    CTxOutSetAccumulator pending;
+    //! Statistics that have not yet been written to the block tree database.
+    std::map<uint256, CTxOutSetStats> mapUnflushed;
+    bool fRunningDirty = false;
+
+    std::thread scanThread;
+    bool fScanning = false;
+    //! Set if the coins database was replaced while it was being scanned.
+    bool fRestartScan = false;
+    std::atomic<bool> fStopScan{false};
+
+    void StartScan();
+    void ThreadScan();
+    void RecordTip(const CBlockIndex* pindex);
+
+    CTxOutSetStatsIndex(const CTxOutSetStatsIndex&) = delete;
+    CTxOutSetStatsIndex& operator=(const CTxOutSetStatsIndex&) = delete;
+
+public:
+    CTxOutSetStatsIndex(CBlockTreeDB& blocktreeIn, CCoinsViewDB& coinsdbIn);
+    ~CTxOutSetStatsIndex();
+
+    //! Load the saved running totals, or start recomputing them if they do
+    //! not describe the UTXO set as of pindexTip.
+    void Init(const CBlockIndex* pindexTip);
+
+    void BlockConnected(const CBlock& block, const CBlockUndo& blockundo, const CBlockIndex* pindex);
+    void BlockDisconnected(const CBlock& block, const CBlockUndo& blockundo, const CBlockIndex* pindex);
+
+    //! Recompute the statistics after the coins database has been replaced.
+    void Rescan();
+
+    //! Write the statistics of recent blocks, and the running totals, to the
+    //! block tree database. Must be called after the chainstate is written.
+    bool Flush();
+
+    //! Stop recomputing the statistics, if that is in progress.
+    void Stop();
+
+    bool IsReady() const { return fReady; }
+
+    //! Look up the statistics of the UTXO set as of a block. Returns false if
+    //! they are not known, because the block was connected before the
+    //! statistics were last recomputed.
+    bool GetStats(const CBlockIndex* pindex, CTxOutSetStats& stats) const;
+};
+
+/** Kept up to date by ConnectTip and DisconnectTip, if -txoutsetstats is set. */
+extern CTxOutSetStatsIndex* ptxoutsetstats;
+
+#endif // ZCASH_COINSTATS_H
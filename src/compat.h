@@ -97,12 +97,24 @@ typedef int32_t ssize_t;
 #define THREAD_PRIORITY_ABOVE_NORMAL    (-2)
 #endif
 
+// Wait for socket events with epoll on Linux and with kqueue on the BSDs
+// and macOS, and for single sockets with poll() on both, rather than with
+// select(), which only works for sockets below FD_SETSIZE.
+#if defined(__linux__)
+#define USE_EPOLL
+#elif defined(__APPLE__) || defined(__FreeBSD__) || defined(__NetBSD__) || defined(__OpenBSD__) || defined(__DragonFly__)
+#define USE_KQUEUE
+#endif
+#if defined(USE_EPOLL) || defined(USE_KQUEUE)
+#define USE_POLL
+#endif
+
 #if HAVE_DECL_STRNLEN == 0
 size_t strnlen( const char *start, size_t max_len);
 #endif // HAVE_DECL_STRNLEN
 
 bool static inline IsSelectableSocket(SOCKET s) {
-#ifdef WIN32
+#if defined(WIN32) || defined(USE_POLL)
     return true;
 #else
     return (s < FD_SETSIZE);
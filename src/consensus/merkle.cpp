@@ -58,6 +58,22 @@ uint256 ComputeMerkleRoot(std::vector<uint256> hashes, bool* mutated) {
     return hashes[0];
 }
 
+std::vector<std::vector<uint256>> ComputeMerkleLevels(std::vector<uint256> leaves) {
+    std::vector<std::vector<uint256>> levels;
+    levels.push_back(std::move(leaves));
+    while (levels.back().size() > 1) {
+        std::vector<uint256> hashes(levels.back());
+        // As in ComputeMerkleRoot, an odd hash at the end is paired with itself.
+        if (hashes.size() & 1) {
+            hashes.push_back(hashes.back());
+        }
+        SHA256D64(hashes[0].begin(), hashes[0].begin(), hashes.size() / 2);
+        hashes.resize(hashes.size() / 2);
+        levels.push_back(std::move(hashes));
+    }
+    return levels;
+}
+
 
 uint256 BlockMerkleRoot(const CBlock& block, bool* mutated)
 {
@@ -14,6 +14,13 @@
 
 uint256 ComputeMerkleRoot(std::vector<uint256> hashes, bool* mutated = nullptr);
 
+/*
+ * Compute every level of the Merkle tree of the given leaves, from the leaves
+ * up to the root. Each level is hashed as a whole by SHA256D64, so that the
+ * hashes of a level are computed several at a time where the CPU allows.
+ */
+std::vector<std::vector<uint256>> ComputeMerkleLevels(std::vector<uint256> leaves);
+
 /*
  * Compute the Merkle root of the transactions in a block.
  * *mutated is set to true if a duplicated subtree was found.
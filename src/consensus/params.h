@@ -507,6 +507,12 @@ struct Params {
     int64_t MaxActualTimespan(int nHeight) const;
 
     uint256 nMinimumChainWork;
+    /**
+     * By default assume that the signatures and proofs in ancestors of this
+     * block are valid. Set to a hash that has been checked to be on the
+     * best chain at release time (or null to verify everything).
+     */
+    uint256 defaultAssumeValid;
 };
 } // namespace Consensus
 
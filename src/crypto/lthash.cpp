@@ -0,0 +1,89 @@
+// Copyright (c) 2026 The Zcash developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or https://www.opensource.org/licenses/mit-license.php .
+
+#include "crypto/lthash.h"
+
+#include "crypto/chacha20.h"
+#include "crypto/common.h"
+#include "crypto/sha256.h"
+
+#include <string.h>
+
+LtHash16::LtHash16()
+{
+    memset(words, 0, sizeof(words));
+}
+
+void LtHash16::Expand(const unsigned char* data, size_t len, uint16_t out[WORDS])
+{
+    unsigned char key[CSHA256::OUTPUT_SIZE];
+    CSHA256().Write(data, len).Finalize(key);
+    unsigned char stream[STATE_SIZE];
+    ChaCha20(key, sizeof(key)).Output(stream, sizeof(stream));
+    for (size_t i = 0; i < WORDS; i++) {
+        out[i] = ReadLE16(stream + 2 * i);
+    }
+}
+
+LtHash16& LtHash16::Add(const unsigned char* data, size_t len)
+{
+    uint16_t element[WORDS];
+    Expand(data, len, element);
+    for (size_t i = 0; i < WORDS; i++) {
+        words[i] += element[i];
+    }
+    return *this;
+}
+
+LtHash16& LtHash16::Remove(const unsigned char* data, size_t len)
+{
+    uint16_t element[WORDS];
+    Expand(data, len, element);
+    for (size_t i = 0; i < WORDS; i++) {
+        words[i] -= element[i];
+    }
+    return *this;
+}
+
+LtHash16& LtHash16::operator+=(const LtHash16& other)
+{
+    for (size_t i = 0; i < WORDS; i++) {
+        words[i] += other.words[i];
+    }
+    return *this;
+}
+
+LtHash16& LtHash16::operator-=(const LtHash16& other)
+{
+    for (size_t i = 0; i < WORDS; i++) {
+        words[i] -= other.words[i];
+    }
+    return *this;
+}
+
+bool LtHash16::operator==(const LtHash16& other) const
+{
+    return memcmp(words, other.words, sizeof(words)) == 0;
+}
+
+void LtHash16::GetState(unsigned char state[STATE_SIZE]) const
+{
+    for (size_t i = 0; i < WORDS; i++) {
+        WriteLE16(state + 2 * i, words[i]);
+    }
+}
+
+void LtHash16::SetState(const unsigned char state[STATE_SIZE])
+{
+    for (size_t i = 0; i < WORDS; i++) {
+        words[i] = ReadLE16(state + 2 * i);
+    }
+}
+
+void LtHash16::Finalize(unsigned char hash[OUTPUT_SIZE]) const
+{
+    unsigned char state[STATE_SIZE];
+    GetState(state);
+    CSHA256().Write(state, sizeof(state)).Finalize(hash);
+}
@@ -0,0 +1,69 @@
+// Copyright (c) 2026 The Zcash developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or https://www.opensource.org/licenses/mit-license.php .
+
+#ifndef ZCASH_CRYPTO_LTHASH_H
+#define ZCASH_CRYPTO_LTHASH_H
+
+#include <stdint.h>
+#include <stdlib.h>
+
+/** A homomorphic hash of a multiset of byte strings (LtHash).
+ *
+ * Each element is expanded with ChaCha20, keyed by the SHA-256 of the
+ * element, into a vector of WORDS 16-bit words, and the state is the sum of
+ * these vectors modulo 2^16. Elements can therefore be added and removed in
+ * any order, and the states of two multisets can be combined, as described in
+ * "Securing Update Propagation with Homomorphic Hashing" (Lewi et al., 2019).
+ *
+ * A state can be compared directly, or condensed with Finalize().
+ */
+class LtHash16
+{
+public:
+    static const size_t WORDS = 1024;
+    static const size_t STATE_SIZE = WORDS * 2;
+    static const size_t OUTPUT_SIZE = 32;
+
+    //! The hash of the empty set.
+    LtHash16();
+
+    LtHash16& Add(const unsigned char* data, size_t len);
+    LtHash16& Remove(const unsigned char* data, size_t len);
+
+    LtHash16& operator+=(const LtHash16& other);
+    LtHash16& operator-=(const LtHash16& other);
+
+    bool operator==(const LtHash16& other) const;
+    bool operator!=(const LtHash16& other) const { return !(*this == other); }
+
+    //! The SHA-256 of the state, as a compact digest of the multiset.
+    void Finalize(unsigned char hash[OUTPUT_SIZE]) const;
+
+    //! The state as WORDS little-endian words.
+    void GetState(unsigned char state[STATE_SIZE]) const;
+    void SetState(const unsigned char state[STATE_SIZE]);
+
+    template<typename Stream>
+    void Serialize(Stream& s) const
+    {
+        unsigned char state[STATE_SIZE];
+        GetState(state);
+        s.write((const char*)state, sizeof(state));
+    }
+
+    template<typename Stream>
+    void Unserialize(Stream& s)
+    {
+        unsigned char state[STATE_SIZE];
+        s.read((char*)state, sizeof(state));
+        SetState(state);
+    }
+
+private:
+    uint16_t words[WORDS];
+
+    static void Expand(const unsigned char* data, size_t len, uint16_t out[WORDS]);
+};
+
+#endif // ZCASH_CRYPTO_LTHASH_H
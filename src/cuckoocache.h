@@ -202,6 +202,15 @@ private:
      */
     const Hash hash_function;
 
+    /** Counters of lookups and insertions, for monitoring. They are updated
+     * with relaxed atomic operations, so that contains() may still be called
+     * from several threads at once, and may be read at any time.
+     */
+    mutable std::atomic<uint64_t> hits{0};
+    mutable std::atomic<uint64_t> misses{0};
+    std::atomic<uint64_t> insertions{0};
+    std::atomic<uint64_t> evictions{0};
+
     /** compute_hashes is convenience for not having to write out this
      * expression everywhere we use the hash values of an Element.
      *
@@ -302,11 +311,15 @@ private:
         // false) and move all elements in the current epoch to the old epoch
         // but do not call allow_erase on their indices.
         if (epoch_unused_count >= epoch_size) {
+            uint32_t aged = 0;
             for (uint32_t i = 0; i < size; ++i)
                 if (epoch_flags[i])
                     epoch_flags[i] = false;
-                else
+                else {
+                    aged += !collection_flags.bit_is_set(i);
                     allow_erase(i);
+                }
+            evictions.fetch_add(aged, std::memory_order_relaxed);
             epoch_heuristic_counter = epoch_size;
         } else
             // reset the epoch_heuristic_counter to next do a scan when worst
@@ -320,6 +333,20 @@ private:
     }
 
 public:
+    /** stats are the counters of a cache and how full it is. */
+    struct stats {
+        uint64_t hits;
+        uint64_t misses;
+        /** The number of elements inserted that were not already present. */
+        uint64_t insertions;
+        /** The number of elements marked for collection because they were
+         * too old, or dropped by an insert that ran out of depth. */
+        uint64_t evictions;
+        /** The number of elements that are not marked for collection. */
+        uint32_t elements;
+        uint32_t size;
+    };
+
     /** You must always construct a cache with some elements via a subsequent
      * call to setup or setup_bytes, otherwise operations may segfault.
      */
@@ -403,6 +430,7 @@ public:
                 epoch_flags[loc] = last_epoch;
                 return;
             }
+        insertions.fetch_add(1, std::memory_order_relaxed);
         for (uint8_t depth = 0; depth < depth_limit; ++depth) {
             // First try to insert to an empty slot, if one exists
             for (uint32_t loc : locs) {
@@ -437,6 +465,7 @@ public:
             // Recompute the locs -- unfortunately happens one too many times!
             locs = compute_hashes(e);
         }
+        evictions.fetch_add(1, std::memory_order_relaxed);
     }
 
     /** contains iterates through the hash locations for a given element
@@ -473,10 +502,42 @@ public:
             if (table[loc] == e) {
                 if (erase)
                     allow_erase(loc);
+                hits.fetch_add(1, std::memory_order_relaxed);
                 return true;
             }
+        misses.fetch_add(1, std::memory_order_relaxed);
         return false;
     }
+
+    /** get_stats returns the counters of the cache, and counts the elements
+     * that are not marked for collection. The count scans the whole table;
+     * it is threadsafe without any concurrent insert, and approximate
+     * otherwise.
+     */
+    stats get_stats() const
+    {
+        uint32_t elements = 0;
+        for (uint32_t i = 0; i < size; ++i)
+            elements += !collection_flags.bit_is_set(i);
+        return {hits.load(std::memory_order_relaxed),
+                misses.load(std::memory_order_relaxed),
+                insertions.load(std::memory_order_relaxed),
+                evictions.load(std::memory_order_relaxed),
+                elements, size};
+    }
+
+    /** get_elements returns the elements that are not marked for collection,
+     * so that they can be inserted into another cache. Like get_stats, it is
+     * threadsafe without any concurrent insert.
+     */
+    std::vector<Element> get_elements() const
+    {
+        std::vector<Element> result;
+        for (uint32_t i = 0; i < size; ++i)
+            if (!collection_flags.bit_is_set(i))
+                result.push_back(table[i]);
+        return result;
+    }
 };
 } // namespace CuckooCache
 
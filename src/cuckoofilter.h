@@ -0,0 +1,188 @@
+// Copyright (c) 2026 The Zcash developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or https://www.opensource.org/licenses/mit-license.php .
+
+#ifndef ZCASH_CUCKOOFILTER_H
+#define ZCASH_CUCKOOFILTER_H
+
+#include <cstddef>
+#include <stdint.h>
+#include <utility>
+#include <vector>
+
+/** Approximate set membership with deletion.
+ *
+ * @ref CuckooFilter::filter stores a 16-bit fingerprint of each element in one
+ * of two candidate buckets of four slots, as described in "Cuckoo Filter:
+ * Practically Better Than Bloom" (Fan et al., 2014). Unlike
+ * CuckooCache::cache it never evicts: contains() has no false negatives, and
+ * false positives occur with probability of roughly 8 / 2^16 at full load.
+ *
+ * Elements are given as already-hashed 64-bit values; the caller is
+ * responsible for salting the hash if the elements may be attacker-chosen.
+ * erase() must only be called for elements that were inserted, or else it may
+ * remove the fingerprint of a different element.
+ *
+ * The filter is not thread-safe.
+ */
+namespace CuckooFilter
+{
+class filter
+{
+    static const unsigned int SLOTS_PER_BUCKET = 4;
+    static const unsigned int MAX_KICKS = 500;
+
+    //! SLOTS_PER_BUCKET fingerprints per bucket; zero marks an empty slot.
+    std::vector<uint16_t> table;
+    uint64_t nBucketMask;
+    size_t nElements = 0;
+    //! A fingerprint displaced by an insertion that ran out of kicks. Once
+    //! set, the filter is full and further insertions fail.
+    uint16_t victimFingerprint = 0;
+    uint64_t victimBucket = 0;
+
+    static uint16_t Fingerprint(uint64_t hash)
+    {
+        uint16_t fp = hash >> 48;
+        return fp == 0 ? 1 : fp;
+    }
+
+    uint64_t AltBucket(uint64_t bucket, uint16_t fp) const
+    {
+        // Multiplying by an odd constant spreads the fingerprint over all bits.
+        return (bucket ^ (fp * 0x5bd1e995ULL)) & nBucketMask;
+    }
+
+    bool BucketContains(uint64_t bucket, uint16_t fp) const
+    {
+        const uint16_t* slots = &table[bucket * SLOTS_PER_BUCKET];
+        for (unsigned int i = 0; i < SLOTS_PER_BUCKET; i++) {
+            if (slots[i] == fp) return true;
+        }
+        return false;
+    }
+
+    bool BucketInsert(uint64_t bucket, uint16_t fp)
+    {
+        uint16_t* slots = &table[bucket * SLOTS_PER_BUCKET];
+        for (unsigned int i = 0; i < SLOTS_PER_BUCKET; i++) {
+            if (slots[i] == 0) {
+                slots[i] = fp;
+                return true;
+            }
+        }
+        return false;
+    }
+
+    bool BucketErase(uint64_t bucket, uint16_t fp)
+    {
+        uint16_t* slots = &table[bucket * SLOTS_PER_BUCKET];
+        for (unsigned int i = 0; i < SLOTS_PER_BUCKET; i++) {
+            if (slots[i] == fp) {
+                slots[i] = 0;
+                return true;
+            }
+        }
+        return false;
+    }
+
+public:
+    /**
+     * Create a filter with room for about nCapacity elements.
+     *
+     * The number of buckets is rounded up to a power of two, leaving room
+     * for the roughly 95% load cuckoo filters reach before insertion fails.
+     */
+    explicit filter(size_t nCapacity)
+    {
+        uint64_t nBuckets = 1;
+        while (nBuckets * SLOTS_PER_BUCKET * 95 / 100 < nCapacity) {
+            nBuckets <<= 1;
+        }
+        nBucketMask = nBuckets - 1;
+        table.assign(nBuckets * SLOTS_PER_BUCKET, 0);
+    }
+
+    /**
+     * Add an element. Returns false if the filter was already full, in which
+     * case the element was not added.
+     */
+    bool insert(uint64_t hash)
+    {
+        if (victimFingerprint != 0) {
+            return false;
+        }
+        uint16_t fp = Fingerprint(hash);
+        uint64_t bucket = hash & nBucketMask;
+        uint64_t alt = AltBucket(bucket, fp);
+        if (BucketInsert(bucket, fp) || BucketInsert(alt, fp)) {
+            nElements++;
+            return true;
+        }
+        // Both buckets are full: move fingerprints to their alternate
+        // bucket until one finds room.
+        bucket = (hash >> 32) & 1 ? alt : bucket;
+        for (unsigned int kick = 0; kick < MAX_KICKS; kick++) {
+            uint16_t& slot = table[bucket * SLOTS_PER_BUCKET + (kick + fp) % SLOTS_PER_BUCKET];
+            std::swap(fp, slot);
+            bucket = AltBucket(bucket, fp);
+            if (BucketInsert(bucket, fp)) {
+                nElements++;
+                return true;
+            }
+        }
+        // The displaced fingerprint has nowhere to go; keeping it aside
+        // means that no element that was already present is lost.
+        victimFingerprint = fp;
+        victimBucket = bucket;
+        nElements++;
+        return true;
+    }
+
+    //! Whether the element may have been inserted.
+    bool contains(uint64_t hash) const
+    {
+        uint16_t fp = Fingerprint(hash);
+        uint64_t bucket = hash & nBucketMask;
+        if (victimFingerprint == fp &&
+            (victimBucket == bucket || victimBucket == AltBucket(bucket, fp))) {
+            return true;
+        }
+        return BucketContains(bucket, fp) || BucketContains(AltBucket(bucket, fp), fp);
+    }
+
+    //! Remove an element that was inserted. Returns false if it was not found.
+    bool erase(uint64_t hash)
+    {
+        uint16_t fp = Fingerprint(hash);
+        uint64_t bucket = hash & nBucketMask;
+        uint64_t alt = AltBucket(bucket, fp);
+        if (victimFingerprint == fp && (victimBucket == bucket || victimBucket == alt)) {
+            victimFingerprint = 0;
+            nElements--;
+            return true;
+        }
+        if (BucketErase(bucket, fp) || BucketErase(alt, fp)) {
+            nElements--;
+            // Freed a slot, so the victim may fit again.
+            if (victimFingerprint != 0 &&
+                (BucketInsert(victimBucket, victimFingerprint) ||
+                 BucketInsert(AltBucket(victimBucket, victimFingerprint), victimFingerprint))) {
+                victimFingerprint = 0;
+            }
+            return true;
+        }
+        return false;
+    }
+
+    //! Number of elements currently stored.
+    size_t size() const { return nElements; }
+
+    //! Whether an insertion has failed to find room.
+    bool full() const { return victimFingerprint != 0; }
+
+    size_t DynamicMemoryUsage() const { return table.capacity() * sizeof(uint16_t); }
+};
+} // namespace CuckooFilter
+
+#endif // ZCASH_CUCKOOFILTER_H
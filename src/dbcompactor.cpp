@@ -0,0 +1,152 @@
+// Copyright (c) 2026 The Zcash developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or https://www.opensource.org/licenses/mit-license.php .
+
+#include "dbcompactor.h"
+
+#include "chainparams.h"
+#include "main.h"
+#include "util/system.h"
+#include "util/time.h"
+
+#include <rust/metrics.h>
+
+CDBCompactor* pdbcompactor = NULL;
+
+namespace {
+
+//! Keys starting with 0xff are not used by any database.
+static const int KEY_PREFIX_END = 0xff00;
+
+//! The first two bytes of the keys in the part of the key space at n.
+std::pair<char, char> KeyPrefix(int n)
+{
+    return std::make_pair((char)(n >> 8), (char)(n & 0xff));
+}
+
+}
+
+CDBCompactor::CDBCompactor(std::vector<std::pair<const char*, const CDBWrapper*>> vDatabasesIn, bool fForceIn) :
+    vDatabases(std::move(vDatabasesIn)), fForce(fForceIn)
+{
+}
+
+CDBCompactor::~CDBCompactor()
+{
+    Stop();
+}
+
+void CDBCompactor::Start()
+{
+    {
+        LOCK(cs_main);
+        nStartHeight = chainActive.Height();
+    }
+    compactThread = std::thread(&CDBCompactor::ThreadCompact, this);
+}
+
+void CDBCompactor::Stop()
+{
+    {
+        LOCK(cs);
+        fStop = true;
+    }
+    condStop.notify_all();
+    if (compactThread.joinable()) {
+        compactThread.join();
+    }
+}
+
+bool CDBCompactor::Sleep(std::chrono::milliseconds duration)
+{
+    WAIT_LOCK(cs, lock);
+    return !condStop.wait_for(lock, duration, [&] { return fStop; });
+}
+
+bool CDBCompactor::Compact(const char* name, const CDBWrapper& db)
+{
+    // Split the key space at two-byte key prefixes. Most keys of the chain
+    // state start with the same byte, so the parts of the key space that are
+    // too large for one range are split at every second byte.
+    std::vector<std::pair<int, size_t>> vParts;
+    size_t nTotal = 0;
+    for (int n = 0; n < KEY_PREFIX_END; n += 0x100) {
+        size_t nSize = db.EstimateSize(KeyPrefix(n), KeyPrefix(n + 0x100));
+        if (nSize <= DB_COMPACTION_RANGE_SIZE) {
+            vParts.emplace_back(n, nSize);
+        } else {
+            for (int m = n; m < n + 0x100; m++) {
+                vParts.emplace_back(m, db.EstimateSize(KeyPrefix(m), KeyPrefix(m + 1)));
+            }
+        }
+        nTotal += nSize;
+    }
+
+    LogPrintf("Compacting the %s database (%.1f MiB)\n", name, nTotal * (1.0 / 1024 / 1024));
+    int64_t nStart = GetTimeMillis();
+    size_t nDone = 0;
+    size_t i = 0;
+    while (i < vParts.size()) {
+        // Join the consecutive parts that fit in one range.
+        int nBegin = vParts[i].first;
+        size_t nSize = vParts[i].second;
+        for (i++; i < vParts.size() && nSize + vParts[i].second <= DB_COMPACTION_RANGE_SIZE; i++) {
+            nSize += vParts[i].second;
+        }
+        int nEnd = i < vParts.size() ? vParts[i].first : KEY_PREFIX_END;
+        if (nSize == 0) {
+            continue;
+        }
+
+        int64_t nRangeStart = GetTimeMillis();
+        db.CompactRange(KeyPrefix(nBegin), KeyPrefix(nEnd));
+        int64_t nRangeTime = GetTimeMillis() - nRangeStart;
+        nDone += nSize;
+        MetricsCounter("zcashd.db.compaction.bytes", nSize, "db", name);
+        MetricsCounter("zcashd.db.compaction.millis", nRangeTime, "db", name);
+        MetricsGauge("zcashd.db.compaction.progress", nTotal == 0 ? 1.0 : (double)nDone / nTotal, "db", name);
+        LogPrint("coindb", "Compacted %.1f MiB of the %s database in %dms\n",
+            nSize * (1.0 / 1024 / 1024), name, nRangeTime);
+
+        if (!Sleep(std::chrono::milliseconds(nRangeTime))) {
+            return false;
+        }
+    }
+    MetricsGauge("zcashd.db.compaction.progress", 1.0, "db", name);
+    LogPrintf("Compacted the %s database to %.1f MiB in %dms\n",
+        name, db.EstimateSize('\x00', '\xff') * (1.0 / 1024 / 1024), GetTimeMillis() - nStart);
+    return true;
+}
+
+void CDBCompactor::ThreadCompact()
+{
+    RenameThread("zc-dbcompact");
+    const Consensus::Params& consensusParams = Params().GetConsensus();
+    try {
+        while (IsInitialBlockDownload(consensusParams)) {
+            if (!Sleep(std::chrono::seconds(10))) {
+                return;
+            }
+        }
+
+        int nBlocks;
+        {
+            LOCK(cs_main);
+            nBlocks = chainActive.Height() - nStartHeight;
+        }
+        // A node that was only briefly behind has not written enough to the
+        // databases to be worth compacting them.
+        if (!fForce && nBlocks < DB_COMPACTION_MIN_IBD_BLOCKS) {
+            return;
+        }
+
+        LogPrintf("Initial block download connected %d blocks, compacting the databases\n", nBlocks);
+        for (const auto& [name, db] : vDatabases) {
+            if (!Compact(name, *db)) {
+                return;
+            }
+        }
+    } catch (const std::exception& e) {
+        LogPrintf("%s: %s\n", __func__, e.what());
+    }
+}
@@ -0,0 +1,72 @@
+// Copyright (c) 2026 The Zcash developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or https://www.opensource.org/licenses/mit-license.php .
+
+#ifndef ZCASH_DBCOMPACTOR_H
+#define ZCASH_DBCOMPACTOR_H
+
+#include "dbwrapper.h"
+#include "sync.h"
+
+#include <chrono>
+#include <condition_variable>
+#include <stdint.h>
+#include <thread>
+#include <utility>
+#include <vector>
+
+/** -dbcompactafteribd default */
+static const bool DEFAULT_DB_COMPACT_AFTER_IBD = true;
+/** Compact after initial block download if at least this many blocks were connected during it */
+static const int DB_COMPACTION_MIN_IBD_BLOCKS = 10000;
+/** Compact the databases in key ranges of about this many bytes */
+static const size_t DB_COMPACTION_RANGE_SIZE = 64 << 20;
+
+/**
+ * Compacts the chain state and block index databases once initial block
+ * download ends. During the download, leveldb writes many files to level 0
+ * and leaves the levels poorly compacted, so reads are slow until its own
+ * compactions catch up. Compacting the whole key space right after the
+ * download brings every level into shape at once.
+ *
+ * The key space is compacted a range at a time, pausing after each range for
+ * as long as it took, so that the compaction takes at most half of the disk
+ * time from block validation and from the peers' requests.
+ */
+class CDBCompactor
+{
+private:
+    //! The databases to compact, by name.
+    const std::vector<std::pair<const char*, const CDBWrapper*>> vDatabases;
+    //! Compact even if few blocks are connected during the download, because
+    //! the databases were written with the initial block download profile.
+    const bool fForce;
+    //! The height of the tip when the compactor is started.
+    int nStartHeight = -1;
+
+    Mutex cs;
+    std::condition_variable condStop;
+    bool fStop = false;
+    std::thread compactThread;
+
+    //! Sleep for the given duration, or until Stop is called. Returns false
+    //! once the compactor is stopped.
+    bool Sleep(std::chrono::milliseconds duration);
+    bool Compact(const char* name, const CDBWrapper& db);
+    void ThreadCompact();
+
+    CDBCompactor(const CDBCompactor&) = delete;
+    CDBCompactor& operator=(const CDBCompactor&) = delete;
+
+public:
+    CDBCompactor(std::vector<std::pair<const char*, const CDBWrapper*>> vDatabases, bool fForce);
+    ~CDBCompactor();
+
+    void Start();
+    void Stop();
+};
+
+/** Set while the databases may be compacted after initial block download. */
+extern CDBCompactor* pdbcompactor;
+
+#endif // ZCASH_DBCOMPACTOR_H
@@ -16,12 +16,16 @@
 
 #include <boost/scoped_ptr.hpp>
 
-static leveldb::Options GetOptions(size_t nCacheSize)
+static leveldb::Options GetOptions(size_t nCacheSize, const CDBOptions& dbOptions)
 {
     leveldb::Options options;
-    options.block_cache = leveldb::NewLRUCache(nCacheSize / 2);
-    options.write_buffer_size = nCacheSize / 4; // up to two write buffers may be held in memory simultaneously
-    options.filter_policy = leveldb::NewBloomFilterPolicy(10);
+    int nBlockCachePercent = dbOptions.fBulkLoad ? MIN_DB_BLOCK_CACHE_PERCENT : dbOptions.nBlockCachePercent;
+    size_t nBlockCacheSize = nCacheSize / 100 * nBlockCachePercent;
+    options.block_cache = leveldb::NewLRUCache(nBlockCacheSize);
+    options.write_buffer_size = (nCacheSize - nBlockCacheSize) / 2; // up to two write buffers may be held in memory simultaneously
+    if (dbOptions.nBloomBitsPerKey > 0) {
+        options.filter_policy = leveldb::NewBloomFilterPolicy(dbOptions.nBloomBitsPerKey);
+    }
     options.compression = leveldb::kNoCompression;
     options.max_open_files = 64;
     if (leveldb::kMajorVersion > 1 || (leveldb::kMajorVersion == 1 && leveldb::kMinorVersion >= 16)) {
@@ -33,14 +37,14 @@ static leveldb::Options GetOptions(size_t nCacheSize)
     return options;
 }
 
-CDBWrapper::CDBWrapper(const fs::path& path, size_t nCacheSize, bool fMemory, bool fWipe)
+CDBWrapper::CDBWrapper(const fs::path& path, size_t nCacheSize, bool fMemory, bool fWipe, const CDBOptions& dbOptions)
 {
     penv = NULL;
     readoptions.verify_checksums = true;
     iteroptions.verify_checksums = true;
     iteroptions.fill_cache = false;
     syncoptions.sync = true;
-    options = GetOptions(nCacheSize);
+    options = GetOptions(nCacheSize, dbOptions);
     options.create_if_missing = true;
     if (fMemory) {
         penv = leveldb::NewMemEnv(leveldb::Env::Default());
@@ -78,6 +82,15 @@ bool CDBWrapper::WriteBatch(CDBBatch& batch, bool fSync)
     return true;
 }
 
+std::string CDBWrapper::GetProperty(const std::string& name) const
+{
+    std::string value;
+    if (!pdb->GetProperty(name, &value)) {
+        return "";
+    }
+    return value;
+}
+
 bool CDBWrapper::IsEmpty()
 {
     boost::scoped_ptr<CDBIterator> it(NewIterator());
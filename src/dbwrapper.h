@@ -19,6 +19,27 @@
 static const size_t DBWRAPPER_PREALLOC_KEY_SIZE = 64;
 static const size_t DBWRAPPER_PREALLOC_VALUE_SIZE = 1024;
 static const size_t DBWRAPPER_MAX_FILE_SIZE = 32 << 20; // 32 MiB
+//! -dbbloombits default
+static const int DEFAULT_DB_BLOOM_BITS = 10;
+//! -dbblockcachepercent default
+static const int DEFAULT_DB_BLOCK_CACHE_PERCENT = 50;
+static const int MIN_DB_BLOCK_CACHE_PERCENT = 10;
+static const int MAX_DB_BLOCK_CACHE_PERCENT = 90;
+
+/** LevelDB settings that can be tuned per database */
+struct CDBOptions
+{
+    //! Bits per key of the bloom filter, or 0 to use no filter.
+    int nBloomBitsPerKey = DEFAULT_DB_BLOOM_BITS;
+    //! Percentage of the cache used as block cache. The rest is split
+    //! between the two write buffers leveldb may hold at the same time.
+    int nBlockCachePercent = DEFAULT_DB_BLOCK_CACHE_PERCENT;
+    //! Open the database for initial block download, which mostly writes to
+    //! it: the write buffers take all but MIN_DB_BLOCK_CACHE_PERCENT of the
+    //! cache, so that leveldb writes fewer and larger files to level 0 and
+    //! compacts them less often while blocks are validated.
+    bool fBulkLoad = false;
+};
 
 class dbwrapper_error : public std::runtime_error
 {
@@ -56,12 +77,12 @@ public:
     template <typename K, typename V>
     void Write(const K& key, const V& value)
     {
-        CDataStream ssKey(SER_DISK, CLIENT_VERSION);
+        CPublicDataStream ssKey(SER_DISK, CLIENT_VERSION);
         ssKey.reserve(DBWRAPPER_PREALLOC_KEY_SIZE);
         ssKey << key;
         leveldb::Slice slKey(ssKey.data(), ssKey.size());
 
-        CDataStream ssValue(SER_DISK, CLIENT_VERSION);
+        CPublicDataStream ssValue(SER_DISK, CLIENT_VERSION);
         ssValue.reserve(DBWRAPPER_PREALLOC_VALUE_SIZE);
         ssValue << value;
         leveldb::Slice slValue(ssValue.data(), ssValue.size());
@@ -72,13 +93,37 @@ public:
     template <typename K>
     void Erase(const K& key)
     {
-        CDataStream ssKey(SER_DISK, CLIENT_VERSION);
+        CPublicDataStream ssKey(SER_DISK, CLIENT_VERSION);
         ssKey.reserve(DBWRAPPER_PREALLOC_KEY_SIZE);
         ssKey << key;
         leveldb::Slice slKey(ssKey.data(), ssKey.size());
 
         batch.Delete(slKey);
     }
+
+    //! Write a record whose key and value are already serialized.
+    void WriteRaw(const std::vector<unsigned char>& key, const std::vector<unsigned char>& value)
+    {
+        leveldb::Slice slKey((const char*)key.data(), key.size());
+        leveldb::Slice slValue((const char*)value.data(), value.size());
+        batch.Put(slKey, slValue);
+    }
+
+    void EraseRaw(const std::vector<unsigned char>& key)
+    {
+        leveldb::Slice slKey((const char*)key.data(), key.size());
+        batch.Delete(slKey);
+    }
+
+    void Clear()
+    {
+        batch.Clear();
+    }
+
+    size_t SizeEstimate() const
+    {
+        return batch.ApproximateSize();
+    }
 };
 
 class CDBIterator
@@ -102,7 +147,7 @@ public:
     void SeekToFirst();
 
     template<typename K> void Seek(const K& key) {
-        CDataStream ssKey(SER_DISK, CLIENT_VERSION);
+        CPublicDataStream ssKey(SER_DISK, CLIENT_VERSION);
         ssKey.reserve(GetSerializeSize(ssKey, key));
         ssKey << key;
         leveldb::Slice slKey(ssKey.data(), ssKey.size());
@@ -114,7 +159,7 @@ public:
     template<typename K> bool GetKey(K& key) {
         leveldb::Slice slKey = piter->key();
         try {
-            CDataStream ssKey(slKey.data(), slKey.data() + slKey.size(), SER_DISK, CLIENT_VERSION);
+            CPublicDataStream ssKey(slKey.data(), slKey.data() + slKey.size(), SER_DISK, CLIENT_VERSION);
             ssKey >> key;
         } catch(std::exception &e) {
             return false;
@@ -125,7 +170,7 @@ public:
     template<typename V> bool GetValue(V& value) {
         leveldb::Slice slValue = piter->value();
         try {
-            CDataStream ssValue(slValue.data(), slValue.data() + slValue.size(), SER_DISK, CLIENT_VERSION);
+            CPublicDataStream ssValue(slValue.data(), slValue.data() + slValue.size(), SER_DISK, CLIENT_VERSION);
             ssValue >> value;
         } catch(std::exception &e) {
             return false;
@@ -137,6 +182,17 @@ public:
         return piter->value().size();
     }
 
+    //! The serialized key, for copying records without knowing their types.
+    std::vector<unsigned char> GetKeyBytes() {
+        leveldb::Slice slKey = piter->key();
+        return std::vector<unsigned char>(slKey.data(), slKey.data() + slKey.size());
+    }
+
+    std::vector<unsigned char> GetValueBytes() {
+        leveldb::Slice slValue = piter->value();
+        return std::vector<unsigned char>(slValue.data(), slValue.data() + slValue.size());
+    }
+
 };
 
 class CDBWrapper
@@ -169,14 +225,15 @@ public:
      * @param[in] nCacheSize  Configures various leveldb cache settings.
      * @param[in] fMemory     If true, use leveldb's memory environment.
      * @param[in] fWipe       If true, remove all existing data.
+     * @param[in] dbOptions   Bloom filter and cache split settings.
      */
-    CDBWrapper(const fs::path& path, size_t nCacheSize, bool fMemory = false, bool fWipe = false);
+    CDBWrapper(const fs::path& path, size_t nCacheSize, bool fMemory = false, bool fWipe = false, const CDBOptions& dbOptions = CDBOptions());
     ~CDBWrapper();
 
     template <typename K, typename V>
     bool Read(const K& key, V& value) const
     {
-        CDataStream ssKey(SER_DISK, CLIENT_VERSION);
+        CPublicDataStream ssKey(SER_DISK, CLIENT_VERSION);
         ssKey.reserve(DBWRAPPER_PREALLOC_KEY_SIZE);
         ssKey << key;
         leveldb::Slice slKey(ssKey.data(), ssKey.size());
@@ -190,7 +247,7 @@ public:
             dbwrapper_private::HandleError(status);
         }
         try {
-            CDataStream ssValue(strValue.data(), strValue.data() + strValue.size(), SER_DISK, CLIENT_VERSION);
+            CPublicDataStream ssValue(strValue.data(), strValue.data() + strValue.size(), SER_DISK, CLIENT_VERSION);
             ssValue >> value;
         } catch (const std::exception&) {
             return false;
@@ -209,7 +266,7 @@ public:
     template <typename K>
     bool Exists(const K& key) const
     {
-        CDataStream ssKey(SER_DISK, CLIENT_VERSION);
+        CPublicDataStream ssKey(SER_DISK, CLIENT_VERSION);
         ssKey.reserve(DBWRAPPER_PREALLOC_KEY_SIZE);
         ssKey << key;
         leveldb::Slice slKey(ssKey.data(), ssKey.size());
@@ -256,6 +313,42 @@ public:
      * Return true if the database managed by this class contains no entries.
      */
     bool IsEmpty();
+
+    /**
+     * Return the value of a leveldb property, such as "leveldb.stats", or
+     * an empty string if the property is unknown.
+     */
+    std::string GetProperty(const std::string& name) const;
+
+    //! Approximate on-disk size of the keys in [key_begin, key_end).
+    template<typename K>
+    size_t EstimateSize(const K& key_begin, const K& key_end) const
+    {
+        CPublicDataStream ssKey1(SER_DISK, CLIENT_VERSION), ssKey2(SER_DISK, CLIENT_VERSION);
+        ssKey1.reserve(DBWRAPPER_PREALLOC_KEY_SIZE);
+        ssKey2.reserve(DBWRAPPER_PREALLOC_KEY_SIZE);
+        ssKey1 << key_begin;
+        ssKey2 << key_end;
+        leveldb::Slice slKey1(ssKey1.data(), ssKey1.size());
+        leveldb::Slice slKey2(ssKey2.data(), ssKey2.size());
+        uint64_t size = 0;
+        leveldb::Range range(slKey1, slKey2);
+        pdb->GetApproximateSizes(&range, 1, &size);
+        return size;
+    }
+
+    template<typename K>
+    void CompactRange(const K& key_begin, const K& key_end) const
+    {
+        CPublicDataStream ssKey1(SER_DISK, CLIENT_VERSION), ssKey2(SER_DISK, CLIENT_VERSION);
+        ssKey1.reserve(DBWRAPPER_PREALLOC_KEY_SIZE);
+        ssKey2.reserve(DBWRAPPER_PREALLOC_KEY_SIZE);
+        ssKey1 << key_begin;
+        ssKey2 << key_end;
+        leveldb::Slice slKey1(ssKey1.data(), ssKey1.size());
+        leveldb::Slice slKey2(ssKey2.data(), ssKey2.size());
+        pdb->CompactRange(&slKey1, &slKey2);
+    }
 };
 
 #endif // BITCOIN_DBWRAPPER_H
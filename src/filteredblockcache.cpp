@@ -0,0 +1,98 @@
+// Copyright (c) 2026 The Zcash developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or https://www.opensource.org/licenses/mit-license.php .
+
+#include "filteredblockcache.h"
+
+#include "hash.h"
+#include "memusage.h"
+#include "streams.h"
+#include "version.h"
+
+CFilteredBlockCache filteredBlockCache;
+
+std::shared_ptr<const CFilterableBlock> CFilteredBlockCache::GetBlock(const uint256& hash)
+{
+    LOCK(cs);
+    auto it = mapBlocks.find(hash);
+    if (it == mapBlocks.end()) {
+        blockStats.nMisses++;
+        return nullptr;
+    }
+    blockStats.nHits++;
+    listBlocksLRU.splice(listBlocksLRU.begin(), listBlocksLRU, it->second.itLRU);
+    return it->second.block;
+}
+
+void CFilteredBlockCache::AddBlock(std::shared_ptr<const CFilterableBlock> block)
+{
+    const uint256 hash = block->block.GetHash();
+
+    LOCK(cs);
+    if (mapBlocks.count(hash)) return;
+    while (mapBlocks.size() >= MAX_FILTERABLE_BLOCKS) {
+        mapBlocks.erase(listBlocksLRU.back());
+        listBlocksLRU.pop_back();
+        blockStats.nEvictions++;
+    }
+    listBlocksLRU.push_front(hash);
+    mapBlocks.emplace(hash, CachedBlock{std::move(block), listBlocksLRU.begin()});
+    blockStats.nInsertions++;
+}
+
+CMerkleBlock CFilteredBlockCache::Filter(const CFilterableBlock& block, CBloomFilter& filter)
+{
+    const ResultKey key(block.block.GetHash(), SerializeHash(filter));
+    {
+        LOCK(cs);
+        auto it = mapResults.find(key);
+        if (it != mapResults.end()) {
+            resultStats.nHits++;
+            listResultsLRU.splice(listResultsLRU.begin(), listResultsLRU, it->second.itLRU);
+            filter = it->second.filter;
+            return it->second.merkleBlock;
+        }
+        resultStats.nMisses++;
+    }
+
+    CMerkleBlock merkleBlock(block, filter);
+    const size_t nUsage = ::GetSerializeSize(merkleBlock, SER_NETWORK, PROTOCOL_VERSION) +
+        memusage::DynamicUsage(merkleBlock.vMatchedTxn) +
+        ::GetSerializeSize(filter, SER_NETWORK, PROTOCOL_VERSION);
+
+    LOCK(cs);
+    if (mapResults.count(key)) return merkleBlock;
+    while (mapResults.size() >= MAX_FILTERED_BLOCKS) {
+        auto itOldest = mapResults.find(listResultsLRU.back());
+        resultStats.nMemoryUsage -= itOldest->second.nUsage;
+        mapResults.erase(itOldest);
+        listResultsLRU.pop_back();
+        resultStats.nEvictions++;
+    }
+    listResultsLRU.push_front(key);
+    mapResults.emplace(key, CachedResult{merkleBlock, filter, nUsage, listResultsLRU.begin()});
+    resultStats.nMemoryUsage += nUsage;
+    resultStats.nInsertions++;
+    return merkleBlock;
+}
+
+CCacheStats CFilteredBlockCache::GetBlockStats() const
+{
+    LOCK(cs);
+    CCacheStats result = blockStats;
+    result.nEntries = mapBlocks.size();
+    result.nMaxEntries = MAX_FILTERABLE_BLOCKS;
+    for (const auto& [hash, cached] : mapBlocks) {
+        result.nMemoryUsage += ::GetSerializeSize(cached.block->block, SER_NETWORK, PROTOCOL_VERSION);
+    }
+    return result;
+}
+
+CCacheStats CFilteredBlockCache::GetResultStats() const
+{
+    LOCK(cs);
+    CCacheStats result = resultStats;
+    result.nEntries = mapResults.size();
+    result.nMaxEntries = MAX_FILTERED_BLOCKS;
+    return result;
+}
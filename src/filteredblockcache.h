@@ -0,0 +1,84 @@
+// Copyright (c) 2026 The Zcash developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or https://www.opensource.org/licenses/mit-license.php .
+
+#ifndef ZCASH_FILTEREDBLOCKCACHE_H
+#define ZCASH_FILTEREDBLOCKCACHE_H
+
+#include "bloom.h"
+#include "cachestats.h"
+#include "merkleblock.h"
+#include "sync.h"
+#include "uint256.h"
+
+#include <list>
+#include <map>
+#include <memory>
+#include <utility>
+
+//! How many blocks prepared for filtering to keep.
+static const size_t MAX_FILTERABLE_BLOCKS = 8;
+//! How many filtered blocks to keep.
+static const size_t MAX_FILTERED_BLOCKS = 1000;
+
+/**
+ * Recently filtered blocks, for serving merkleblock messages to peers with
+ * BIP 37 Bloom filters.
+ *
+ * SPV clients mostly ask for the same few recent blocks, so each of those is
+ * read from disk and has its scripts parsed once, and is then matched
+ * against the filter of each peer. Peers that load the same filter, such as
+ * a client that reconnects and rescans, get the result of the earlier match.
+ * The result depends only on the block and the filter before the match, so
+ * entries never need to be invalidated.
+ */
+class CFilteredBlockCache
+{
+private:
+    typedef std::pair<uint256, uint256> ResultKey;
+
+    struct CachedBlock
+    {
+        std::shared_ptr<const CFilterableBlock> block;
+        std::list<uint256>::iterator itLRU;
+    };
+
+    struct CachedResult
+    {
+        CMerkleBlock merkleBlock;
+        //! The filter after the match updated it.
+        CBloomFilter filter;
+        size_t nUsage;
+        std::list<ResultKey>::iterator itLRU;
+    };
+
+    mutable Mutex cs;
+    std::list<uint256> listBlocksLRU GUARDED_BY(cs);
+    std::map<uint256, CachedBlock> mapBlocks GUARDED_BY(cs);
+    CCacheStats blockStats GUARDED_BY(cs);
+    //! The keys of the results, by block hash and filter hash, most recently
+    //! used first.
+    std::list<ResultKey> listResultsLRU GUARDED_BY(cs);
+    std::map<ResultKey, CachedResult> mapResults GUARDED_BY(cs);
+    CCacheStats resultStats GUARDED_BY(cs);
+
+public:
+    //! The prepared block, if it is cached.
+    std::shared_ptr<const CFilterableBlock> GetBlock(const uint256& hash);
+    //! Cache a prepared block, evicting the least recently used one if the
+    //! cache is full.
+    void AddBlock(std::shared_ptr<const CFilterableBlock> block);
+
+    /**
+     * Filter the block with the filter, updating the filter in the same way
+     * as CMerkleBlock does.
+     */
+    CMerkleBlock Filter(const CFilterableBlock& block, CBloomFilter& filter);
+
+    CCacheStats GetBlockStats() const;
+    CCacheStats GetResultStats() const;
+};
+
+extern CFilteredBlockCache filteredBlockCache;
+
+#endif // ZCASH_FILTEREDBLOCKCACHE_H
@@ -1,12 +1,15 @@
 #include <gtest/gtest.h>
 #include <gmock/gmock.h>
 
+#include "checkpoints.h"
 #include "consensus/validation.h"
 #include "main.h"
 #include "proof_verifier.h"
 #include "util/test.h"
 #include "zcash/Proof.hpp"
 
+#include <boost/thread.hpp>
+
 class MockCValidationState : public CValidationState {
 public:
     MOCK_METHOD6(DoS, bool(int level, bool ret,
@@ -396,3 +399,163 @@ TEST_F(ContextualCheckBlockTest, BlockBlossomRulesRejectOtherTx) {
         ExpectInvalidBlockFromTx(CTransaction(mtx), 100, "bad-sapling-tx-version-group-id");
     }
 }
+
+// Test that checking the transactions of a block on the transaction check
+// threads rejects it with the same state as checking them in order, when an
+// invalid transaction is not the first one.
+TEST(CheckBlock, ParallelTransactionChecksMatchSequential) {
+    SelectParams(CBaseChainParams::MAIN);
+
+    CMutableTransaction mtxCoinbase;
+    mtxCoinbase.vin.resize(1);
+    mtxCoinbase.vin[0].prevout.SetNull();
+    mtxCoinbase.vin[0].scriptSig = CScript() << 1 << OP_0;
+    mtxCoinbase.vout.resize(1);
+    mtxCoinbase.vout[0].scriptPubKey = CScript() << OP_TRUE;
+    mtxCoinbase.vout[0].nValue = 0;
+
+    CMutableTransaction mtxValid;
+    mtxValid.vin.resize(1);
+    mtxValid.vin[0].prevout = COutPoint(uint256S("01"), 0);
+    mtxValid.vout.resize(1);
+    mtxValid.vout[0].scriptPubKey = CScript() << OP_TRUE;
+    mtxValid.vout[0].nValue = 1;
+
+    // The first invalid transaction, and another that is invalid for a
+    // different reason.
+    CMutableTransaction mtxNegative = mtxValid;
+    mtxNegative.vin[0].prevout = COutPoint(uint256S("02"), 0);
+    mtxNegative.vout[0].nValue = -1;
+    CMutableTransaction mtxDuplicate = mtxValid;
+    mtxDuplicate.vin.push_back(mtxDuplicate.vin[0]);
+
+    CBlock block;
+    block.nVersion = 4;
+    block.vtx.push_back(CTransaction(mtxCoinbase));
+    block.vtx.push_back(CTransaction(mtxValid));
+    block.vtx.push_back(CTransaction(mtxNegative));
+    block.vtx.push_back(CTransaction(mtxDuplicate));
+
+    int nScriptCheckThreadsOld = nScriptCheckThreads;
+
+    nScriptCheckThreads = 0;
+    CValidationState stateSequential;
+    auto verifier = ProofVerifier::Strict();
+    EXPECT_FALSE(CheckBlock(block, stateSequential, Params(), verifier, false, false, true));
+
+    nScriptCheckThreads = 2;
+    boost::thread_group threadGroup;
+    threadGroup.create_thread(&ThreadTxCheck);
+    CValidationState stateParallel;
+    auto verifierParallel = ProofVerifier::Strict();
+    EXPECT_FALSE(CheckBlock(block, stateParallel, Params(), verifierParallel, false, false, true));
+    threadGroup.interrupt_all();
+    threadGroup.join_all();
+    nScriptCheckThreads = nScriptCheckThreadsOld;
+
+    int nDoSSequential = 0;
+    int nDoSParallel = 0;
+    EXPECT_TRUE(stateSequential.IsInvalid(nDoSSequential));
+    EXPECT_TRUE(stateParallel.IsInvalid(nDoSParallel));
+    EXPECT_EQ(nDoSSequential, 100);
+    EXPECT_EQ(nDoSParallel, nDoSSequential);
+    EXPECT_EQ(stateSequential.GetRejectReason(), "bad-txns-vout-negative");
+    EXPECT_EQ(stateParallel.GetRejectReason(), stateSequential.GetRejectReason());
+    EXPECT_EQ(stateParallel.GetRejectCode(), stateSequential.GetRejectCode());
+    EXPECT_EQ(stateParallel.CorruptionPossible(), stateSequential.CorruptionPossible());
+}
+
+// Build a chain of evenly-spaced block indices ending just below nHeight, and
+// a header at nHeight on top of it that passes the difficulty and timestamp
+// checks of ContextualCheckBlockHeader. Its hash matches no checkpoint.
+static CBlockHeader HeaderOnFakeChain(
+    const Consensus::Params& params, int nHeight, std::vector<CBlockIndex>& blocks)
+{
+    blocks.resize(2 * params.nPowAveragingWindow + 11);
+    int nFirstHeight = nHeight - (int)blocks.size();
+    for (size_t i = 0; i < blocks.size(); i++) {
+        blocks[i].pprev = i ? &blocks[i - 1] : nullptr;
+        blocks[i].nHeight = nFirstHeight + i;
+        blocks[i].nTime = i ? blocks[i - 1].nTime + params.PoWTargetSpacing(blocks[i].nHeight) : 1600000000;
+        blocks[i].nBits = UintToArith256(params.powLimit).GetCompact();
+    }
+
+    CBlockHeader header;
+    header.nVersion = 4;
+    header.nTime = blocks.back().nTime + params.PoWTargetSpacing(nHeight);
+    header.nBits = GetNextWorkRequired(&blocks.back(), &header, params);
+    return header;
+}
+
+// Test that with -fastheadersync, headers at checkpoint heights below the
+// last checkpoint must match the checkpoints.
+TEST(CheckBlock, FastHeaderSyncRejectsForkBelowLastCheckpoint) {
+    SelectParams(CBaseChainParams::MAIN);
+    const CChainParams& chainparams = Params();
+    const MapCheckpoints& checkpoints = chainparams.Checkpoints().mapCheckpoints;
+    int nLastCheckpoint = Checkpoints::GetTotalBlocksEstimate(chainparams.Checkpoints());
+
+    // The first checkpoint after the genesis block.
+    auto it = checkpoints.upper_bound(0);
+    ASSERT_TRUE(it != checkpoints.end());
+    ASSERT_LT(it->first, nLastCheckpoint);
+
+    std::vector<CBlockIndex> blocks;
+    CBlockHeader header = HeaderOnFakeChain(chainparams.GetConsensus(), it->first, blocks);
+    ASSERT_NE(header.GetHash(), it->second);
+
+    bool fFastHeaderSyncOld = fFastHeaderSync;
+
+    // Without -fastheadersync the solution is checked instead.
+    fFastHeaderSync = false;
+    EXPECT_TRUE(ShouldCheckHeaderSolution(chainparams, it->first));
+    CValidationState stateChecked;
+    EXPECT_TRUE(ContextualCheckBlockHeader(header, stateChecked, chainparams, &blocks.back()));
+
+    fFastHeaderSync = true;
+    EXPECT_FALSE(ShouldCheckHeaderSolution(chainparams, it->first));
+    CValidationState state;
+    EXPECT_FALSE(ContextualCheckBlockHeader(header, state, chainparams, &blocks.back()));
+    fFastHeaderSync = fFastHeaderSyncOld;
+
+    int nDoS = 0;
+    EXPECT_TRUE(state.IsInvalid(nDoS));
+    EXPECT_EQ(nDoS, 100);
+    EXPECT_EQ(state.GetRejectCode(), REJECT_CHECKPOINT);
+    EXPECT_EQ(state.GetRejectReason(), "checkpoint mismatch");
+}
+
+// Test that with -fastheadersync, a header with a bad solution is still
+// rejected at and above the last checkpoint.
+TEST(CheckBlock, FastHeaderSyncChecksSolutionsFromLastCheckpoint) {
+    SelectParams(CBaseChainParams::MAIN);
+    const CChainParams& chainparams = Params();
+    int nLastCheckpoint = Checkpoints::GetTotalBlocksEstimate(chainparams.Checkpoints());
+
+    bool fFastHeaderSyncOld = fFastHeaderSync;
+    fFastHeaderSync = true;
+
+    // At the last checkpoint, the header must be the checkpointed one.
+    std::vector<CBlockIndex> blocks;
+    CBlockHeader header = HeaderOnFakeChain(chainparams.GetConsensus(), nLastCheckpoint, blocks);
+    EXPECT_FALSE(ShouldCheckHeaderSolution(chainparams, nLastCheckpoint));
+    CValidationState stateCheckpoint;
+    EXPECT_FALSE(ContextualCheckBlockHeader(header, stateCheckpoint, chainparams, &blocks.back()));
+    EXPECT_EQ(stateCheckpoint.GetRejectReason(), "checkpoint mismatch");
+
+    // Above it, the solution is checked when the header is accepted. The
+    // header has an empty solution.
+    header = HeaderOnFakeChain(chainparams.GetConsensus(), nLastCheckpoint + 1, blocks);
+    bool fCheckSolution = ShouldCheckHeaderSolution(chainparams, nLastCheckpoint + 1);
+    EXPECT_TRUE(fCheckSolution);
+    CValidationState stateContextual;
+    EXPECT_TRUE(ContextualCheckBlockHeader(header, stateContextual, chainparams, &blocks.back()));
+    CValidationState state;
+    EXPECT_FALSE(CheckBlockHeader(header, state, chainparams, true, fCheckSolution));
+    fFastHeaderSync = fFastHeaderSyncOld;
+
+    int nDoS = 0;
+    EXPECT_TRUE(state.IsInvalid(nDoS));
+    EXPECT_EQ(nDoS, 100);
+    EXPECT_EQ(state.GetRejectReason(), "invalid-solution");
+}
@@ -4,11 +4,13 @@
 // file COPYING or https://www.opensource.org/licenses/mit-license.php .
 
 #include "coins.h"
+#include "coinstats.h"
 #include "gtest/utils.h"
 #include "script/standard.h"
 #include "uint256.h"
 #include "util/strencodings.h"
 #include "test/test_bitcoin.h"
+#include "txdb.h"
 #include "consensus/validation.h"
 #include "main.h"
 #include "undo.h"
@@ -19,8 +21,11 @@
 #include "zcash/Note.hpp"
 #include "zcash/address/mnemonic.h"
 
+#include <algorithm>
+#include <limits>
 #include <vector>
 #include <map>
+#include <optional>
 
 #include <gmock/gmock.h>
 #include <gtest/gtest.h>
@@ -326,7 +331,8 @@ public:
                     CNullifiersMap& mapOrchardNullifiers,
                     CHistoryCacheMap &historyCacheMap,
                     SubtreeCache &cacheSaplingSubtrees,
-                    SubtreeCache &cacheOrchardSubtrees)
+                    SubtreeCache &cacheOrchardSubtrees,
+                    bool fErase)
     {
         for (CCoinsMap::iterator it = mapCoins.begin(); it != mapCoins.end(); ) {
             if (it->second.flags & CCoinsCacheEntry::DIRTY) {
@@ -337,7 +343,7 @@ public:
                     map_.erase(it->first);
                 }
             }
-            it = mapCoins.erase(it);
+            it = fErase ? mapCoins.erase(it) : std::next(it);
         }
 
         BatchWriteAnchors<SproutMerkleTree, CAnchorsSproutMap, CAnchorsSproutCacheEntry>(mapSproutAnchors, mapSproutAnchors_);
@@ -365,7 +371,8 @@ public:
                                  mapOrchardNullifiers,
                                  historyCacheMap,
                                  cacheSaplingSubtrees,
-                                 cacheOrchardSubtrees);
+                                 cacheOrchardSubtrees,
+                                 fErase);
         }
 
         if (!hashBlock.IsNull())
@@ -390,7 +397,8 @@ public:
     void SelfTest() const
     {
         // Manually recompute the dynamic usage of the whole data, and compare it.
-        size_t ret = memusage::DynamicUsage(cacheCoins) +
+        size_t ret = memusage::DynamicUsage(cacheMemoryResource) - cacheMemoryResource.AvailableBytes() +
+                     memusage::DynamicUsage(cacheCoins) +
                      memusage::DynamicUsage(cacheSproutAnchors) +
                      memusage::DynamicUsage(cacheSaplingAnchors) +
                      memusage::DynamicUsage(cacheOrchardAnchors) +
@@ -844,6 +852,528 @@ TEST(CoinsTests, NullifiersTest)
     }
 }
 
+TEST(CoinsTests, NullifiersBatchTest)
+{
+    LoadProofParameters();
+
+    CCoinsViewTest base;
+    TxWithNullifiers txWithNullifiers;
+    {
+        CCoinsViewCacheTest cache(&base);
+        cache.SetNullifiers(txWithNullifiers.tx, true);
+        cache.SetNullifiers(txWithNullifiers.txV5, true);
+        cache.Flush();
+    }
+
+    uint256 unspent = GetRandHash();
+
+    CCoinsViewCacheTest cache(&base);
+    std::set<uint256> spent;
+    cache.GetNullifiers({txWithNullifiers.sproutNullifier, unspent}, SPROUT, spent);
+    EXPECT_EQ(spent, std::set<uint256>({txWithNullifiers.sproutNullifier}));
+
+    // The pools are kept apart.
+    spent.clear();
+    cache.GetNullifiers({txWithNullifiers.sproutNullifier, txWithNullifiers.orchardNullifier}, SAPLING, spent);
+    EXPECT_TRUE(spent.empty());
+
+    // A nullifier spent in the cache but not yet flushed is reported as spent,
+    // and one unspent in the cache is not, whatever the base says.
+    CCoinsViewCacheTest cache2(&base);
+    CMutableTransaction mtx;
+    JSDescription jsd;
+    jsd.nullifiers[0] = unspent;
+    mtx.vJoinSplit.emplace_back(jsd);
+    cache2.SetNullifiers(CTransaction(mtx), true);
+    cache2.SetNullifiers(txWithNullifiers.tx, false);
+    spent.clear();
+    cache2.GetNullifiers({txWithNullifiers.sproutNullifier, unspent}, SPROUT, spent);
+    EXPECT_EQ(spent, std::set<uint256>({unspent}));
+
+    // Prefetching leaves the answers unchanged.
+    CCoinsViewCacheTest cache3(&base);
+    cache3.PrefetchShieldedRequirements({txWithNullifiers.tx, txWithNullifiers.txV5});
+    {
+        SCOPED_TRACE("cache3 with prefetched nullifiers");
+        checkNullifierCache(cache3, txWithNullifiers, true);
+    }
+    EXPECT_FALSE(cache3.GetNullifier(unspent, SPROUT));
+    cache3.SelfTest();
+}
+
+class CCoinsViewDBTest : public CCoinsViewDB
+{
+public:
+    CCoinsViewDBTest() : CCoinsViewDB("coinsdbtest", 1 << 23, true) {}
+
+    void WriteLegacyCoins(const uint256 &txid, const CCoins &coins) {
+        db.Write(std::make_pair('c', txid), coins);
+    }
+
+    bool HaveLegacyCoins(const uint256 &txid) const {
+        return db.Exists(std::make_pair('c', txid));
+    }
+};
+
+static CCoins RandomCoins(unsigned int nOutputs)
+{
+    CCoins coins;
+    coins.nVersion = 4;
+    coins.nHeight = 1000;
+    coins.fCoinBase = true;
+    coins.vout.resize(nOutputs);
+    for (unsigned int i = 0; i < nOutputs; i++) {
+        coins.vout[i].nValue = i + 1;
+        coins.vout[i].scriptPubKey = CScript() << OP_DUP << OP_HASH160 << ToByteVector(GetRandHash()) << OP_CHECKSIG;
+    }
+    return coins;
+}
+
+TEST(CoinsTests, CoinsDBPerOutput)
+{
+    SelectParams(CBaseChainParams::REGTEST);
+    CCoinsViewDBTest db;
+    uint256 txid = GetRandHash();
+    CCoins coins = RandomCoins(300);
+    {
+        CCoinsViewCache cache(&db);
+        {
+            CCoinsModifier modifier = cache.ModifyNewCoins(txid);
+            *modifier = coins;
+        }
+        EXPECT_TRUE(cache.Flush());
+    }
+    CCoins read;
+    EXPECT_TRUE(db.HaveCoins(txid));
+    EXPECT_TRUE(db.GetCoins(txid, read));
+    EXPECT_EQ(read, coins);
+
+    // Spend outputs at the start, in the middle and at the end.
+    {
+        CCoinsViewCache cache(&db);
+        {
+            CCoinsModifier modifier = cache.ModifyCoins(txid);
+            for (uint32_t n : {0, 150, 298, 299}) {
+                EXPECT_TRUE(modifier->Spend(n));
+                coins.Spend(n);
+            }
+        }
+        EXPECT_TRUE(cache.Flush());
+    }
+    EXPECT_TRUE(db.GetCoins(txid, read));
+    EXPECT_EQ(read, coins);
+    EXPECT_EQ(read.vout.size(), 298u);
+    EXPECT_FALSE(read.IsAvailable(150));
+
+    // Outputs of other transactions are left alone.
+    uint256 txid2 = GetRandHash();
+    CCoins coins2 = RandomCoins(3);
+    {
+        CCoinsViewCache cache(&db);
+        {
+            CCoinsModifier modifier = cache.ModifyNewCoins(txid2);
+            *modifier = coins2;
+        }
+        EXPECT_TRUE(cache.Flush());
+    }
+
+    // Spending every output removes the transaction.
+    {
+        CCoinsViewCache cache(&db);
+        {
+            CCoinsModifier modifier = cache.ModifyCoins(txid);
+            for (uint32_t n = 0; n < 300; n++) {
+                modifier->Spend(n);
+            }
+        }
+        EXPECT_TRUE(cache.Flush());
+    }
+    EXPECT_FALSE(db.HaveCoins(txid));
+    EXPECT_FALSE(db.GetCoins(txid, read));
+    EXPECT_TRUE(db.GetCoins(txid2, read));
+    EXPECT_EQ(read, coins2);
+}
+
+TEST(CoinsTests, CoinsDBUpgrade)
+{
+    SelectParams(CBaseChainParams::REGTEST);
+    CCoinsViewDBTest db;
+    std::map<uint256, CCoins> legacy;
+    for (unsigned int i = 1; i <= 20; i++) {
+        CCoins coins = RandomCoins(i);
+        if (i > 2) {
+            coins.Spend(1);
+        }
+        uint256 txid = GetRandHash();
+        db.WriteLegacyCoins(txid, coins);
+        legacy[txid] = coins;
+    }
+
+    EXPECT_TRUE(db.Upgrade());
+    for (const auto& it : legacy) {
+        EXPECT_FALSE(db.HaveLegacyCoins(it.first));
+        CCoins read;
+        EXPECT_TRUE(db.GetCoins(it.first, read));
+        EXPECT_EQ(read, it.second);
+    }
+
+    // A second run has nothing to do.
+    EXPECT_TRUE(db.Upgrade());
+}
+
+TEST(CoinsTests, SyncAndTrim)
+{
+    CCoinsViewTest base;
+    CCoinsViewCacheTest cache(&base);
+
+    // Add coins in four epochs, each one flushed in from a child cache the
+    // way ConnectBlock does.
+    std::vector<std::vector<uint256>> epochs(4);
+    for (auto& txids : epochs) {
+        CCoinsViewCacheTest child(&cache);
+        for (int i = 0; i < 10; i++) {
+            uint256 txid = GetRandHash();
+            CCoinsModifier modifier = child.ModifyNewCoins(txid);
+            *modifier = RandomCoins(2);
+            txids.push_back(txid);
+        }
+        EXPECT_TRUE(child.Flush());
+    }
+
+    // Spend one coin entirely, and touch one from the oldest epoch.
+    uint256 spent = epochs[1][0];
+    {
+        CCoinsModifier modifier = cache.ModifyCoins(spent);
+        modifier->Spend(0);
+        modifier->Spend(1);
+    }
+    uint256 touched = epochs[0][0];
+    EXPECT_TRUE(cache.AccessCoins(touched) != nullptr);
+
+    // Everything is written out, but the unspent coins stay cached.
+    EXPECT_TRUE(cache.SyncAndTrim(std::numeric_limits<size_t>::max()));
+    cache.SelfTest();
+    CCoins read;
+    for (const auto& txids : epochs) {
+        for (const uint256& txid : txids) {
+            if (txid == spent) {
+                EXPECT_FALSE(cache.HaveCoinsInCache(txid));
+                EXPECT_TRUE(!base.GetCoins(txid, read) || read.IsPruned());
+            } else {
+                EXPECT_TRUE(cache.HaveCoinsInCache(txid));
+                EXPECT_TRUE(base.GetCoins(txid, read));
+                EXPECT_EQ(read, *cache.AccessCoins(txid));
+            }
+        }
+    }
+    EXPECT_EQ(cache.GetCacheSize(), 39u);
+
+    // Trimming evicts the least recently used coins first.
+    EXPECT_TRUE(cache.AccessCoins(touched) != nullptr);
+    {
+        CCoinsViewCacheTest child(&cache);
+        EXPECT_TRUE(child.Flush());
+    }
+    EXPECT_TRUE(cache.SyncAndTrim(cache.DynamicMemoryUsage() / 2));
+    cache.SelfTest();
+    EXPECT_FALSE(cache.HaveCoinsInCache(epochs[0][1]));
+    EXPECT_TRUE(cache.HaveCoinsInCache(touched));
+    EXPECT_TRUE(cache.HaveCoinsInCache(epochs[3][0]));
+    EXPECT_LT(cache.GetCacheSize(), 39u);
+
+    // Evicted coins can still be read back from the base.
+    EXPECT_TRUE(cache.AccessCoins(epochs[0][1]) != nullptr);
+}
+
+TEST(CoinsTests, AsyncWriter)
+{
+    SelectParams(CBaseChainParams::REGTEST);
+    CCoinsViewDBTest db;
+    CCoinsViewAsyncWriter writer(&db);
+    uint256 txid = GetRandHash();
+    uint256 spent = GetRandHash();
+    uint256 hashBlock = GetRandHash();
+    CCoins coins = RandomCoins(3);
+    {
+        CCoinsViewCache cache(&writer);
+        {
+            CCoinsModifier modifier = cache.ModifyNewCoins(txid);
+            *modifier = coins;
+        }
+        {
+            CCoinsModifier modifier = cache.ModifyNewCoins(spent);
+            *modifier = RandomCoins(1);
+        }
+        cache.SetBestBlock(hashBlock);
+        EXPECT_TRUE(cache.Flush());
+    }
+
+    // Reads see the snapshot whether or not it has reached the database.
+    CCoins read;
+    EXPECT_TRUE(writer.GetCoins(txid, read));
+    EXPECT_EQ(read, coins);
+    EXPECT_EQ(writer.GetBestBlock(), hashBlock);
+
+    // Spending a coin is layered on top of the first write.
+    {
+        CCoinsViewCache cache(&writer);
+        {
+            CCoinsModifier modifier = cache.ModifyCoins(spent);
+            modifier->Spend(0);
+        }
+        EXPECT_TRUE(cache.SyncAndTrim(std::numeric_limits<size_t>::max()));
+        EXPECT_FALSE(writer.HaveCoins(spent));
+    }
+
+    EXPECT_TRUE(writer.Sync());
+    EXPECT_TRUE(db.GetCoins(txid, read));
+    EXPECT_EQ(read, coins);
+    EXPECT_FALSE(db.HaveCoins(spent));
+    EXPECT_EQ(db.GetBestBlock(), hashBlock);
+}
+
+TEST(CoinsTests, SnapshotRoundTrip)
+{
+    SelectParams(CBaseChainParams::REGTEST);
+    CCoinsViewDBTest source;
+    uint256 txid = GetRandHash();
+    uint256 nf = GetRandHash();
+    uint256 hashBlock = GetRandHash();
+    CCoins coins = RandomCoins(5);
+    {
+        CCoinsViewCache cache(&source);
+        {
+            CCoinsModifier modifier = cache.ModifyNewCoins(txid);
+            *modifier = coins;
+        }
+        CMutableTransaction mtx;
+        JSDescription jsd;
+        jsd.nullifiers[0] = nf;
+        mtx.vJoinSplit.emplace_back(jsd);
+        cache.SetNullifiers(CTransaction(mtx), true);
+        cache.SetBestBlock(hashBlock);
+        EXPECT_TRUE(cache.Flush());
+    }
+
+    CCoinsSnapshotMetadata metadata;
+    memcpy(metadata.pchMessageStart, Params().MessageStart(), sizeof(metadata.pchMessageStart));
+    metadata.hashBlock = hashBlock;
+    metadata.nHeight = 10;
+    metadata.nChainTx = 11;
+
+    fs::path path = fs::temp_directory_path() / fs::unique_path();
+    uint256 hashWritten;
+    uint64_t nWritten;
+    {
+        CAutoFile file(fsbridge::fopen(path, "wb"), SER_DISK, CLIENT_VERSION);
+        ASSERT_FALSE(file.IsNull());
+        EXPECT_TRUE(source.WriteSnapshot(file, metadata, hashWritten, nWritten));
+    }
+
+    // The hash covers the metadata as well as the records.
+    CCoinsSnapshotMetadata read;
+    uint256 hashRead;
+    uint64_t nRead;
+    {
+        CAutoFile file(fsbridge::fopen(path, "rb"), SER_DISK, CLIENT_VERSION);
+        file >> read;
+        EXPECT_EQ(read.hashBlock, hashBlock);
+        EXPECT_EQ(read.nChainTx, 11u);
+        EXPECT_TRUE(HashCoinsSnapshot(file, read, hashRead, nRead));
+        EXPECT_EQ(hashRead, hashWritten);
+        EXPECT_EQ(nRead, nWritten);
+
+        read.nChainTx = 12;
+        EXPECT_TRUE(fseek(file.Get(), 0, SEEK_SET) == 0);
+        CCoinsSnapshotMetadata ignored;
+        file >> ignored;
+        EXPECT_TRUE(HashCoinsSnapshot(file, read, hashRead, nRead));
+        EXPECT_NE(hashRead, hashWritten);
+    }
+
+    // Loading replaces whatever the target database held.
+    CCoinsViewDBTest target;
+    uint256 other = GetRandHash();
+    {
+        CCoinsViewCache cache(&target);
+        {
+            CCoinsModifier modifier = cache.ModifyNewCoins(other);
+            *modifier = RandomCoins(1);
+        }
+        cache.SetBestBlock(GetRandHash());
+        EXPECT_TRUE(cache.Flush());
+    }
+    {
+        // A snapshot that does not match the expected hash is not marked as loaded.
+        CAutoFile file(fsbridge::fopen(path, "rb"), SER_DISK, CLIENT_VERSION);
+        file >> read;
+        EXPECT_FALSE(target.LoadSnapshot(file, read, GetRandHash()));
+        EXPECT_NE(target.GetBestBlock(), hashBlock);
+    }
+    {
+        CAutoFile file(fsbridge::fopen(path, "rb"), SER_DISK, CLIENT_VERSION);
+        file >> read;
+        EXPECT_TRUE(target.LoadSnapshot(file, read, hashWritten));
+    }
+    fs::remove(path);
+
+    CCoins readCoins;
+    EXPECT_TRUE(target.GetCoins(txid, readCoins));
+    EXPECT_EQ(readCoins, coins);
+    EXPECT_FALSE(target.HaveCoins(other));
+    EXPECT_TRUE(target.GetNullifier(nf, SPROUT));
+    EXPECT_EQ(target.GetBestBlock(), hashBlock);
+    EXPECT_EQ(target.GetBestAnchor(SPROUT), source.GetBestAnchor(SPROUT));
+}
+
+static CTxOutSetAccumulator ScanCoinsDB(const CCoinsViewDB& db)
+{
+    CTxOutSetAccumulator acc;
+    std::unique_ptr<CCoinsViewDBCursor> pcursor(db.Cursor());
+    EXPECT_TRUE(ScanTxOutSet(*pcursor, acc, [] { return false; }));
+    return acc;
+}
+
+static void ExpectSameTxOutSet(const CTxOutSetAccumulator& a, const CTxOutSetAccumulator& b)
+{
+    CTxOutSetStats statsA = a.Finalize(1);
+    CTxOutSetStats statsB = b.Finalize(1);
+    EXPECT_EQ(statsA.nTransactions, statsB.nTransactions);
+    EXPECT_EQ(statsA.nTransactionOutputs, statsB.nTransactionOutputs);
+    EXPECT_EQ(statsA.nBogoSize, statsB.nBogoSize);
+    EXPECT_EQ(statsA.nTotalAmount, statsB.nTotalAmount);
+    EXPECT_EQ(statsA.hashDigest, statsB.hashDigest);
+}
+
+TEST(CoinsTests, TxOutSetStatsDelta)
+{
+    SelectParams(CBaseChainParams::REGTEST);
+    CCoinsViewDBTest db;
+    uint256 txidPrev = GetRandHash();
+    {
+        CCoinsViewCache cache(&db);
+        {
+            CCoinsModifier modifier = cache.ModifyNewCoins(txidPrev);
+            *modifier = RandomCoins(3);
+        }
+        cache.SetBestBlock(GetRandHash());
+        EXPECT_TRUE(cache.Flush());
+    }
+    CTxOutSetAccumulator before = ScanCoinsDB(db);
+    EXPECT_EQ(before.nTransactions, 1);
+    EXPECT_EQ(before.nTransactionOutputs, 3);
+
+    CScript script = RandomCoins(1).vout[0].scriptPubKey;
+    CBlock block;
+    {
+        // A coinbase with an unspendable output.
+        CMutableTransaction mtx;
+        mtx.vin.resize(1);
+        mtx.vin[0].prevout.SetNull();
+        mtx.vin[0].scriptSig = CScript() << 1 << OP_0;
+        mtx.vout.emplace_back(5, script);
+        mtx.vout.emplace_back(0, CScript() << OP_RETURN);
+        block.vtx.push_back(CTransaction(mtx));
+    }
+    {
+        // Spends two of the three outputs of txidPrev.
+        CMutableTransaction mtx;
+        mtx.vin.emplace_back(COutPoint(txidPrev, 0));
+        mtx.vin.emplace_back(COutPoint(txidPrev, 2));
+        mtx.vout.emplace_back(2, script);
+        mtx.vout.emplace_back(1, script);
+        block.vtx.push_back(CTransaction(mtx));
+    }
+    {
+        // Spends the last output of txidPrev, and an output created in
+        // the same block.
+        CMutableTransaction mtx;
+        mtx.vin.emplace_back(COutPoint(txidPrev, 1));
+        mtx.vin.emplace_back(COutPoint(block.vtx[1].GetHash(), 1));
+        mtx.vout.emplace_back(3, script);
+        block.vtx.push_back(CTransaction(mtx));
+    }
+    {
+        // Spends the remaining output of the second transaction.
+        CMutableTransaction mtx;
+        mtx.vin.emplace_back(COutPoint(block.vtx[1].GetHash(), 0));
+        mtx.vout.emplace_back(0, CScript() << OP_RETURN);
+        block.vtx.push_back(CTransaction(mtx));
+    }
+
+    CBlockUndo blockundo;
+    {
+        CCoinsViewCache cache(&db);
+        CTxUndo undoDummy;
+        for (size_t i = 0; i < block.vtx.size(); i++) {
+            if (i > 0) {
+                blockundo.vtxundo.push_back(CTxUndo());
+            }
+            UpdateCoins(block.vtx[i], cache, i == 0 ? undoDummy : blockundo.vtxundo.back(), 1001);
+        }
+        cache.SetBestBlock(GetRandHash());
+        EXPECT_TRUE(cache.Flush());
+    }
+    CTxOutSetAccumulator after = ScanCoinsDB(db);
+    EXPECT_EQ(after.nTransactions, 2);
+    EXPECT_EQ(after.nTransactionOutputs, 2);
+    EXPECT_EQ(after.nTotalAmount, 8);
+
+    CBlockIndex indexPrev;
+    CBlockIndex index;
+    index.pprev = &indexPrev;
+    CTxOutSetAccumulator delta = GetBlockTxOutSetDelta(block, blockundo, &index);
+    ExpectSameTxOutSet(CTxOutSetAccumulator(before) += delta, after);
+    ExpectSameTxOutSet(CTxOutSetAccumulator(after) -= delta, before);
+
+    // The genesis block does not change the UTXO set.
+    CBlock genesis;
+    genesis.vtx.push_back(block.vtx[0]);
+    delta = GetBlockTxOutSetDelta(genesis, CBlockUndo(), &indexPrev);
+    ExpectSameTxOutSet(delta, CTxOutSetAccumulator());
+}
+
+TEST(CoinsTests, PartitionedCursors)
+{
+    SelectParams(CBaseChainParams::REGTEST);
+    CCoinsViewDBTest db;
+    {
+        CCoinsViewCache cache(&db);
+        for (int i = 0; i < 500; i++) {
+            CCoinsModifier modifier = cache.ModifyNewCoins(GetRandHash());
+            *modifier = RandomCoins(1 + i % 4);
+        }
+        cache.SetBestBlock(GetRandHash());
+        EXPECT_TRUE(cache.Flush());
+    }
+    CTxOutSetAccumulator whole = ScanCoinsDB(db);
+    EXPECT_EQ(whole.nTransactions, 500);
+
+    for (size_t nParts : {1, 3, 8, 1000}) {
+        auto cursors = db.Cursors(nParts);
+        EXPECT_GE(cursors.size(), 1u);
+        EXPECT_LE(cursors.size(), std::min<size_t>(nParts, 256));
+        // The ranges are in order and do not overlap.
+        uint64_t nOutputs = 0;
+        std::optional<COutPoint> last;
+        for (auto& pcursor : cursors) {
+            for (; pcursor->Valid(); pcursor->Next()) {
+                if (last.has_value()) {
+                    EXPECT_TRUE(last.value() < pcursor->GetOutPoint());
+                }
+                last = pcursor->GetOutPoint();
+                nOutputs++;
+            }
+        }
+        EXPECT_EQ(nOutputs, (uint64_t)whole.nTransactionOutputs);
+
+        CTxOutSetAccumulator parallel;
+        cursors = db.Cursors(nParts);
+        EXPECT_TRUE(ScanTxOutSet(cursors, parallel, [] { return false; }));
+        ExpectSameTxOutSet(parallel, whole);
+        EXPECT_EQ(parallel.nTransactions, whole.nTransactions);
+    }
+}
 
 template<typename Tree> void anchorsFlushImpl(ShieldedType type)
 {
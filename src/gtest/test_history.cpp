@@ -154,3 +154,63 @@ TEST(History, GarbageMemoryHash) {
     // Check history root and garbage history root are equal
     EXPECT_EQ(historyRoot, historyRootGarbage);
 }
+
+// A view that counts the history nodes read from it.
+class CCoinsViewCountingHistory : public CCoinsViewBacked {
+public:
+    mutable size_t nHistoryReads = 0;
+
+    CCoinsViewCountingHistory(CCoinsView *baseIn) : CCoinsViewBacked(baseIn) {}
+
+    HistoryNode GetHistoryAt(uint32_t epochId, HistoryIndex index) const {
+        nHistoryReads++;
+        return CCoinsViewBacked::GetHistoryAt(epochId, index);
+    }
+};
+
+TEST(History, NodeCacheSurvivesFlushes) {
+    CCoinsViewDummy fakeDB;
+    CCoinsViewCache db(&fakeDB);
+    CCoinsViewCountingHistory counting(&db);
+    CCoinsViewCache tip(&counting);
+    CCoinsViewCache reference(&fakeDB);
+
+    uint32_t epochId = 0;
+    std::vector<uint256> roots;
+    for (uint64_t i = 1; i <= 100; i++) {
+        {
+            // Connect each block in a view of its own, as ConnectTip does.
+            CCoinsViewCache view(&tip);
+            view.PushHistoryNode(epochId, getLeafN(i));
+            ASSERT_TRUE(view.Flush());
+        }
+        reference.PushHistoryNode(epochId, getLeafN(i));
+        roots.push_back(reference.GetHistoryRoot(epochId));
+        EXPECT_EQ(tip.GetHistoryRoot(epochId), roots.back());
+
+        if (i % 10 == 0) {
+            ASSERT_TRUE(tip.Flush());
+        }
+    }
+
+    // Removing the last leaf and appending another one after a flush
+    // uses the nodes kept in memory as well.
+    {
+        CCoinsViewCache view(&tip);
+        view.PopHistoryNode(epochId);
+        EXPECT_EQ(view.GetHistoryRoot(epochId), roots[98]);
+        view.PushHistoryNode(epochId, getLeafN(1000));
+        ASSERT_TRUE(view.Flush());
+    }
+    reference.PopHistoryNode(epochId);
+    reference.PushHistoryNode(epochId, getLeafN(1000));
+    EXPECT_EQ(tip.GetHistoryRoot(epochId), reference.GetHistoryRoot(epochId));
+    EXPECT_EQ(counting.nHistoryReads, 0);
+
+    // The replaced nodes are not served from the cache after a flush.
+    ASSERT_TRUE(tip.Flush());
+    EXPECT_EQ(tip.GetHistoryLength(epochId), reference.GetHistoryLength(epochId));
+    for (HistoryIndex i = 0; i < reference.GetHistoryLength(epochId); i++) {
+        EXPECT_EQ(tip.GetHistoryAt(epochId, i), reference.GetHistoryAt(epochId, i));
+    }
+}
@@ -649,6 +649,27 @@ TEST(Joinsplit, BasicJoinsplitVerification)
         auto test = JSDescriptionInfo(joinSplitPubKey, rt, inputs, outputs, 0, 0).BuildDeterministic();
         test.anchor = GetRandHash();
         EXPECT_FALSE(verifier.VerifySprout(test, joinSplitPubKey));
+
+        // Nor when it is checked in a batch.
+        auto batchVerifier = ProofVerifier::Batch(false);
+        EXPECT_TRUE(batchVerifier.VerifySprout(test, joinSplitPubKey));
+        EXPECT_FALSE(batchVerifier.ValidateBatch());
+    }
+
+    {
+        // Several JoinSplits are checked together.
+        auto jsdesc1 = JSDescriptionInfo(joinSplitPubKey, rt, inputs, outputs, 0, 0).BuildDeterministic();
+        auto jsdesc2 = JSDescriptionInfo(joinSplitPubKey, rt, inputs, outputs, 0, 0).BuildDeterministic();
+        auto batchVerifier = ProofVerifier::Batch(true);
+        EXPECT_TRUE(batchVerifier.VerifySprout(jsdesc1, joinSplitPubKey));
+        EXPECT_TRUE(batchVerifier.VerifySprout(jsdesc2, joinSplitPubKey));
+        EXPECT_TRUE(batchVerifier.ValidateBatch());
+
+        // They are now cached, and found again by a batch that does not
+        // cache its results.
+        auto cachedVerifier = ProofVerifier::Batch(false);
+        EXPECT_TRUE(cachedVerifier.VerifySprout(jsdesc1, joinSplitPubKey));
+        EXPECT_TRUE(cachedVerifier.ValidateBatch());
     }
 
 }
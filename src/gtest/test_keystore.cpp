@@ -607,7 +607,7 @@ TEST(KeystoreTests, StoreAndRetrieveUFVKByOrchard) {
     EXPECT_EQ(ufvkmetaUnadded.value().GetDiversifierIndex(), addrPair.second);
 }
 
-TEST(KeystoreTests, AddTransparentReceiverForUnifiedAddress) {
+TEST(KeystoreTests, AddReceiversForUnifiedAddress) {
     SelectParams(CBaseChainParams::TESTNET);
     CBasicKeyStore keyStore;
 
@@ -618,16 +618,27 @@ TEST(KeystoreTests, AddTransparentReceiverForUnifiedAddress) {
     auto ufvk = usk.value().ToFullViewingKey();
     auto zufvk = ZcashdUnifiedFullViewingKey::FromUnifiedFullViewingKey(Params(), ufvk);
     auto ufvkid = zufvk.GetKeyID();
-    auto addrPair = std::get<std::pair<UnifiedAddress, diversifier_index_t>>(zufvk.FindAddress(diversifier_index_t(0), {ReceiverType::P2PKH, ReceiverType::Sapling}));
+    auto addrPair = std::get<std::pair<UnifiedAddress, diversifier_index_t>>(zufvk.FindAddress(diversifier_index_t(0), {ReceiverType::P2PKH, ReceiverType::Sapling, ReceiverType::Orchard}));
     EXPECT_TRUE(addrPair.first.GetP2PKHReceiver().has_value());
     auto ufvkmeta = keyStore.GetUFVKMetadataForReceiver(addrPair.first.GetP2PKHReceiver().value());
     EXPECT_FALSE(ufvkmeta.has_value());
 
-    keyStore.AddTransparentReceiverForUnifiedAddress(ufvkid, addrPair.second, addrPair.first);
+    keyStore.AddReceiversForUnifiedAddress(ufvkid, addrPair.second, addrPair.first);
 
     ufvkmeta = keyStore.GetUFVKMetadataForReceiver(addrPair.first.GetP2PKHReceiver().value());
     EXPECT_TRUE(ufvkmeta.has_value());
     EXPECT_EQ(ufvkmeta.value().GetUFVKId(), ufvkid);
+
+    // The shielded receivers are indexed too, so they are found without the
+    // UFVK having been added to the keystore.
+    EXPECT_FALSE(keyStore.GetUnifiedFullViewingKey(ufvkid).has_value());
+    for (const auto& receiver : addrPair.first) {
+        ufvkmeta = keyStore.GetUFVKMetadataForReceiver(receiver);
+        EXPECT_TRUE(ufvkmeta.has_value());
+        EXPECT_EQ(ufvkmeta.value().GetUFVKId(), ufvkid);
+        EXPECT_EQ(ufvkmeta.value().GetDiversifierIndex(), addrPair.second);
+        EXPECT_TRUE(ufvkmeta.value().IsExternalAddress());
+    }
 }
 
 
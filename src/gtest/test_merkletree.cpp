@@ -355,4 +355,156 @@ TEST(saplingMerkleTree, subtree_roots)
         cur2 = libzcash::PedersenHash::combine(cur2, libzcash::PedersenHash::EmptyRoot(depth), depth);
     }
     EXPECT_EQ(tree.root(), cur2);
-}
\ No newline at end of file
+}
+template<typename Tree, typename Hash>
+void appendBatchMatchesAppend(const std::vector<size_t>& batchSizes)
+{
+    Tree sequential;
+    Tree batched;
+    for (size_t batchSize : batchSizes) {
+        std::vector<Hash> leaves;
+        std::vector<Hash> expectedSubtrees;
+        for (size_t i = 0; i < batchSize; i++) {
+            leaves.push_back(GetRandHash());
+            sequential.append(leaves.back());
+            auto subtreeRoot = sequential.complete_subtree_root();
+            if (subtreeRoot.has_value()) {
+                expectedSubtrees.push_back(*subtreeRoot);
+            }
+        }
+
+        auto completedSubtrees = batched.append_batch(leaves);
+        EXPECT_EQ(completedSubtrees, expectedSubtrees);
+        EXPECT_EQ(batched, sequential);
+        EXPECT_EQ(batched.root(), sequential.root());
+        EXPECT_EQ(batched.size(), sequential.size());
+    }
+}
+
+TEST(merkletree, AppendBatch)
+{
+    // Cross several 2^16 subtree boundaries, including landing on one exactly
+    // and continuing from it.
+    appendBatchMatchesAppend<SproutMerkleTree, libzcash::SHA256Compress>(
+        {0, 1, 1, 2, 3, 1000, 65536 - 1007, 1, 65535, 1, 70000, 65536, 5});
+}
+
+TEST(merkletree, AppendBatchSapling)
+{
+    appendBatchMatchesAppend<SaplingMerkleTree, libzcash::PedersenHash>(
+        {0, 1, 1, 2, 3, 17, 64, 300});
+}
+
+template<typename Tree, typename Witness, typename Hash>
+void fastForwardMatchesAppend(const std::vector<size_t>& batchSizes)
+{
+    Tree tree;
+    std::vector<Witness> appended;
+    std::vector<Witness> fastForwarded;
+    for (size_t batchSize : batchSizes) {
+        libzcash::MerkleTreeNodes<Hash> nodes;
+        size_t nOld = fastForwarded.size();
+        for (size_t i = 0; i < batchSize; i++) {
+            Hash leaf = GetRandHash();
+            tree.append(leaf, &nodes);
+            for (auto& witness : appended) {
+                witness.append(leaf);
+            }
+            // Witness some of the leaves, including the last one of a batch.
+            if (i % 3 == 0 || i + 1 == batchSize) {
+                appended.push_back(tree.witness());
+            }
+        }
+
+        // Witnesses created in this batch were already brought up to date.
+        for (size_t i = 0; i < nOld; i++) {
+            fastForwarded[i].fast_forward(tree, nodes);
+        }
+        fastForwarded.insert(fastForwarded.end(), appended.begin() + nOld, appended.end());
+        ASSERT_EQ(fastForwarded.size(), appended.size());
+        for (size_t i = 0; i < appended.size(); i++) {
+            EXPECT_EQ(fastForwarded[i], appended[i]);
+            EXPECT_EQ(fastForwarded[i].root(), tree.root());
+        }
+    }
+}
+
+TEST(merkletree, WitnessFastForward)
+{
+    fastForwardMatchesAppend<SproutMerkleTree, SproutWitness, libzcash::SHA256Compress>(
+        {1, 0, 1, 2, 3, 7, 8, 1, 64, 100, 1, 2, 513});
+}
+
+TEST(merkletree, WitnessFastForwardSapling)
+{
+    fastForwardMatchesAppend<SaplingMerkleTree, SaplingWitness, libzcash::PedersenHash>(
+        {1, 2, 3, 17, 1, 32, 5});
+}
+
+template<typename Tree, typename Witness, typename Hash>
+void fastForwardMatchesAppendBatch(const std::vector<size_t>& batchSizes)
+{
+    Tree tree;
+    std::vector<Witness> appended;
+    std::vector<Witness> fastForwarded;
+    for (size_t batchSize : batchSizes) {
+        // Append the leaves in segments ending at the witnessed ones, as the
+        // wallet does, and fast-forward every witness with the nodes of all
+        // the segments, including those created in this batch.
+        libzcash::MerkleTreeNodes<Hash> nodes;
+        std::vector<Hash> segment;
+        for (size_t i = 0; i < batchSize; i++) {
+            Hash leaf = GetRandHash();
+            segment.push_back(leaf);
+            for (auto& witness : appended) {
+                witness.append(leaf);
+            }
+            if (i % 5 == 2) {
+                tree.append_batch(segment, &nodes);
+                segment.clear();
+                appended.push_back(tree.witness());
+                fastForwarded.push_back(tree.witness());
+            }
+        }
+        tree.append_batch(segment, &nodes);
+
+        for (auto& witness : fastForwarded) {
+            witness.fast_forward(tree, nodes);
+        }
+        ASSERT_EQ(fastForwarded.size(), appended.size());
+        for (size_t i = 0; i < appended.size(); i++) {
+            EXPECT_EQ(fastForwarded[i], appended[i]);
+            EXPECT_EQ(fastForwarded[i].root(), tree.root());
+        }
+    }
+}
+
+TEST(merkletree, WitnessFastForwardAppendBatch)
+{
+    fastForwardMatchesAppendBatch<SproutMerkleTree, SproutWitness, libzcash::SHA256Compress>(
+        {1, 3, 8, 1, 64, 100, 2, 513});
+}
+
+TEST(merkletree, WitnessFastForwardAppendBatchSapling)
+{
+    fastForwardMatchesAppendBatch<SaplingMerkleTree, SaplingWitness, libzcash::PedersenHash>(
+        {3, 17, 1, 32, 5});
+}
+
+TEST(merkletree, AppendBatchFull)
+{
+    SproutTestingMerkleTree tree;
+    std::vector<libzcash::SHA256Compress> leaves;
+    for (size_t i = 0; i < 15; i++) {
+        leaves.push_back(GetRandHash());
+    }
+    tree.append_batch(leaves);
+
+    // Two more leaves do not fit, and the tree is left unchanged.
+    SproutTestingMerkleTree before = tree;
+    EXPECT_THROW(tree.append_batch({GetRandHash(), GetRandHash()}), std::runtime_error);
+    EXPECT_EQ(tree, before);
+
+    tree.append_batch({GetRandHash()});
+    EXPECT_THROW(tree.append(GetRandHash()), std::runtime_error);
+}
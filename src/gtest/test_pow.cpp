@@ -123,3 +123,19 @@ TEST(PoW, MinDifficultyRules) {
     EXPECT_EQ(GetNextWorkRequired(&blocks[lastBlk], &next, params),
               UintToArith256(params.powLimit).GetCompact());
 }
+
+TEST(PoW, CheckEquihashSolutionCached) {
+    SelectParams(CBaseChainParams::MAIN);
+    const Consensus::Params& params = Params().GetConsensus();
+    CBlockHeader header = Params().GenesisBlock().GetBlockHeader();
+
+    EXPECT_TRUE(CheckEquihashSolutionCached(&header, params));
+    // The second check is answered by the cache.
+    EXPECT_TRUE(CheckEquihashSolutionCached(&header, params));
+
+    // Invalid solutions are not cached.
+    header.nSolution[0] ^= 1;
+    EXPECT_FALSE(CheckEquihashSolutionCached(&header, params));
+    EXPECT_FALSE(CheckEquihashSolutionCached(&header, params));
+    EXPECT_FALSE(CheckEquihashSolution(&header, params));
+}
@@ -0,0 +1,77 @@
+#include "chainparams.h"
+#include "primitives/block.h"
+#include "script/standard.h"
+#include "shieldedblock.h"
+#include "streams.h"
+#include "transaction_builder.h"
+#include "gtest/utils.h"
+#include "util/test.h"
+#include "version.h"
+
+#include <gtest/gtest.h>
+
+TEST(ShieldedCompactBlock, FromBlock)
+{
+    LoadProofParameters();
+
+    auto consensusParams = RegtestActivateSapling();
+
+    CBasicKeyStore keystore;
+    CKey tsk = AddTestCKeyToKeyStore(keystore);
+    auto scriptPubKey = GetScriptForDestination(tsk.GetPubKey().GetID());
+
+    auto sk = libzcash::SaplingSpendingKey::random();
+    auto fvk = sk.full_viewing_key();
+    libzcash::diversifier_t d = {0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0};
+    auto pk = *fvk.in_viewing_key().address(d);
+
+    auto builder = TransactionBuilder(Params(), 1, std::nullopt, SaplingMerkleTree::empty_root(), &keystore);
+    builder.AddTransparentInput(COutPoint(uint256S("1234"), 0), scriptPubKey, 50000);
+    builder.AddSaplingOutput(fvk.ovk, pk, 30000, {});
+    auto tx = builder.Build().GetTxOrThrow();
+    ASSERT_EQ(tx.GetSaplingOutputsCount(), 2);
+
+    // Only the shielded transaction is kept.
+    CMutableTransaction mtxTransparent;
+    mtxTransparent.vin.resize(1);
+    mtxTransparent.vout.resize(1);
+    CBlock block;
+    block.nTime = 1234;
+    block.hashPrevBlock = uint256S("5678");
+    block.vtx.push_back(CTransaction(mtxTransparent));
+    block.vtx.push_back(tx);
+
+    CShieldedCompactBlock cblock(block, 10);
+    EXPECT_EQ(cblock.nHeight, 10U);
+    EXPECT_EQ(cblock.hash, block.GetHash());
+    EXPECT_EQ(cblock.hashPrevBlock, block.hashPrevBlock);
+    EXPECT_EQ(cblock.nTime, 1234U);
+    ASSERT_EQ(cblock.vtx.size(), 1);
+    EXPECT_EQ(cblock.vtx[0].nIndex, 1U);
+    EXPECT_EQ(cblock.vtx[0].txid, tx.GetHash());
+    EXPECT_TRUE(cblock.vtx[0].vSaplingNullifiers.empty());
+    EXPECT_TRUE(cblock.vtx[0].vOrchardActions.empty());
+
+    auto outputs = tx.GetSaplingOutputs();
+    ASSERT_EQ(cblock.vtx[0].vSaplingOutputs.size(), outputs.size());
+    for (size_t i = 0; i < outputs.size(); i++) {
+        const CCompactSaplingOutput& output = cblock.vtx[0].vSaplingOutputs[i];
+        EXPECT_EQ(output.cmu, uint256::FromRawBytes(outputs[i].cmu()));
+        EXPECT_EQ(output.ephemeralKey, uint256::FromRawBytes(outputs[i].ephemeral_key()));
+        auto encCiphertext = outputs[i].enc_ciphertext();
+        EXPECT_TRUE(std::equal(output.ciphertext.begin(), output.ciphertext.end(), encCiphertext.begin()));
+    }
+
+    // Round trip through the serialization.
+    CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
+    ss << cblock;
+    CShieldedCompactBlock cblock2;
+    ss >> cblock2;
+    EXPECT_EQ(cblock2.hash, cblock.hash);
+    ASSERT_EQ(cblock2.vtx.size(), 1);
+    EXPECT_EQ(cblock2.vtx[0].vSaplingOutputs.size(), outputs.size());
+    EXPECT_EQ(cblock2.vtx[0].vSaplingOutputs[1].cmu, cblock.vtx[0].vSaplingOutputs[1].cmu);
+    EXPECT_TRUE(ss.empty());
+
+    RegtestDeactivateSapling();
+}
@@ -6,6 +6,7 @@
 #include "main.h"
 #include "pubkey.h"
 #include "rpc/protocol.h"
+#include "script/interpreter.h"
 #include "transaction_builder.h"
 #include "gtest/test_transaction_builder.h"
 #include "gtest/utils.h"
@@ -427,6 +428,52 @@ TEST(TransactionBuilder, ChangeOutput)
     RegtestDeactivateSapling();
 }
 
+TEST(TransactionBuilder, SignsManyTransparentInputs)
+{
+    LoadProofParameters();
+
+    auto consensusParams = RegtestActivateSapling();
+
+    // Enough inputs to be signed on several threads, with two keys.
+    CBasicKeyStore keystore;
+    CKey tsk = AddTestCKeyToKeyStore(keystore);
+    CKey tsk2;
+    tsk2.MakeNewKey(true);
+    keystore.AddKey(tsk2);
+    std::vector<CScript> scriptPubKeys = {
+        GetScriptForDestination(tsk.GetPubKey().GetID()),
+        GetScriptForDestination(tsk2.GetPubKey().GetID()),
+    };
+    const size_t nInputs = 4 * MIN_INPUTS_PER_SIGNING_THREAD + 3;
+
+    auto builder = TransactionBuilder(Params(), 1, std::nullopt, SaplingMerkleTree::empty_root(), &keystore);
+    std::vector<CTxOut> allPrevOutputs;
+    for (size_t i = 0; i < nInputs; i++) {
+        CAmount nValue = 1000 + i;
+        builder.AddTransparentInput(COutPoint(uint256S("1234"), i), scriptPubKeys[i % 2], nValue);
+        allPrevOutputs.emplace_back(nValue, scriptPubKeys[i % 2]);
+    }
+    builder.AddTransparentOutput(tsk.GetPubKey().GetID(), 50000);
+    builder.SendChangeTo(tsk2.GetPubKey().GetID(), {});
+    auto tx = builder.Build().GetTxOrThrow();
+
+    ASSERT_EQ(tx.vin.size(), nInputs);
+    EXPECT_EQ(tx.vout.size(), 2);
+
+    auto consensusBranchId = CurrentEpochBranchId(1, Params().GetConsensus());
+    const PrecomputedTransactionData txdata(tx, allPrevOutputs);
+    for (size_t i = 0; i < nInputs; i++) {
+        ScriptError serror;
+        EXPECT_TRUE(VerifyScript(
+            tx.vin[i].scriptSig, allPrevOutputs[i].scriptPubKey, STANDARD_SCRIPT_VERIFY_FLAGS,
+            TransactionSignatureChecker(&tx, txdata, i, allPrevOutputs[i].nValue),
+            consensusBranchId, &serror)) << "input " << i << ": " << ScriptErrorString(serror);
+    }
+
+    // Revert to default
+    RegtestDeactivateSapling();
+}
+
 TEST(TransactionBuilder, SetFee)
 {
     LoadProofParameters();
@@ -83,7 +83,8 @@ public:
                     CNullifiersMap &mapOrchardNullifiers,
                     CHistoryCacheMap &historyCacheMap,
                     SubtreeCache &cacheSaplingSubtrees,
-                    SubtreeCache &cacheOrchardSubtrees) {
+                    SubtreeCache &cacheOrchardSubtrees,
+                    bool fErase) {
         return false;
     }
 
@@ -1,15 +1,22 @@
 #include <gtest/gtest.h>
 #include <gmock/gmock.h>
 
+#include "checkqueue.h"
 #include "consensus/merkle.h"
 #include "consensus/upgrades.h"
 #include "consensus/validation.h"
+#include "gtest/utils.h"
 #include "main.h"
+#include "script/standard.h"
 #include "transaction_builder.h"
 #include "util/test.h"
+#include "zcash/Address.hpp"
+#include "zcash/address/mnemonic.h"
 
 #include <optional>
 
+#include <boost/thread.hpp>
+
 extern void SetChainPoolValues(
     const CChainParams& chainparams,
     const CBlock &block,
@@ -25,6 +32,11 @@ extern bool ReceivedBlockTransactions(
 extern void EnsureUnreferencedAsKeyOfMapBlocksUnlinked(
     const CBlockIndex *pindex);
 
+extern bool CheckMemPoolAcceptanceAuth(
+    std::optional<rust::Box<sapling::BatchValidator>>& saplingAuth,
+    std::optional<rust::Box<orchard::BatchValidator>>& orchardAuth,
+    CValidationState &state, bool fParallel);
+
 void ExpectAmount(CAmount expected, std::optional<CAmount> actual) {
     EXPECT_EQ(std::make_optional(expected), actual);
 }
@@ -125,7 +137,8 @@ public:
                     CNullifiersMap &mapOrchardNullifiers,
                     CHistoryCacheMap &historyCacheMap,
                     SubtreeCache &cacheSaplingSubtrees,
-                    SubtreeCache &cacheOrchardSubtrees) {
+                    SubtreeCache &cacheOrchardSubtrees,
+                    bool fErase) {
         return false;
     }
 
@@ -322,6 +335,85 @@ TEST(Validation, ContextualCheckInputsDetectsOldBranchId) {
     RegtestDeactivateBlossom();
 }
 
+TEST(Validation, ContextualCheckInputsCachesScriptResults) {
+    SelectParams(CBaseChainParams::REGTEST);
+    UpdateNetworkUpgradeParameters(Consensus::UPGRADE_OVERWINTER, 10);
+    const CChainParams& params = Params(CBaseChainParams::REGTEST);
+    const Consensus::Params& consensusParams = params.GetConsensus();
+    auto overwinterBranchId = NetworkUpgradeInfo[Consensus::UPGRADE_OVERWINTER].nBranchId;
+
+    CBasicKeyStore keystore;
+    CKey tsk = AddTestCKeyToKeyStore(keystore);
+    auto destination = tsk.GetPubKey().GetID();
+    auto scriptPubKey = GetScriptForDestination(destination);
+
+    CBlock block;
+    block.hashMerkleRoot = BlockMerkleRoot(block);
+    auto blockHash = block.GetHash();
+    CBlockIndex fakeIndex {block};
+    mapBlockIndex.insert(std::make_pair(blockHash, &fakeIndex));
+    chainActive.SetTip(&fakeIndex);
+
+    CAmount coinValue(5000);
+    COutPoint utxo;
+    utxo.hash = uint256S("4343434343434343434343434343434343434343434343434343434343434343");
+    utxo.n = 0;
+    CTxOut txOut;
+    txOut.scriptPubKey = scriptPubKey;
+    txOut.nValue = coinValue;
+    // The same coin with a script that the transaction cannot spend, to tell
+    // whether the scripts were run.
+    CTxOut badTxOut = txOut;
+    badTxOut.scriptPubKey = CScript() << OP_FALSE;
+
+    {
+        ValidationFakeCoinsViewDB fakeDB(blockHash, utxo.hash, txOut, 12);
+        CCoinsViewCache view(&fakeDB);
+        ValidationFakeCoinsViewDB badFakeDB(blockHash, utxo.hash, badTxOut, 12);
+        CCoinsViewCache badView(&badFakeDB);
+
+        auto builder = TransactionBuilder(params, 15, std::nullopt, SaplingMerkleTree::empty_root(), &keystore);
+        builder.AddTransparentInput(utxo, scriptPubKey, coinValue);
+        builder.AddTransparentOutput(destination, 4000);
+        auto tx = builder.Build().GetTxOrThrow();
+        PrecomputedTransactionData txdata(tx, {CTxOut(coinValue, scriptPubKey)});
+
+        // Without caching, nothing is remembered.
+        CValidationState state;
+        EXPECT_TRUE(ContextualCheckInputs(
+            tx, state, view, true, SCRIPT_VERIFY_P2SH, false, txdata,
+            consensusParams, overwinterBranchId));
+        EXPECT_FALSE(ContextualCheckInputs(
+            tx, state, badView, true, SCRIPT_VERIFY_P2SH, false, txdata,
+            consensusParams, overwinterBranchId));
+
+        // Once cached, the scripts are not run again with the same flags...
+        state = CValidationState();
+        EXPECT_TRUE(ContextualCheckInputs(
+            tx, state, view, true, SCRIPT_VERIFY_P2SH, true, txdata,
+            consensusParams, overwinterBranchId));
+        EXPECT_TRUE(ContextualCheckInputs(
+            tx, state, badView, true, SCRIPT_VERIFY_P2SH, true, txdata,
+            consensusParams, overwinterBranchId));
+
+        // ...but they are with other flags.
+        EXPECT_FALSE(ContextualCheckInputs(
+            tx, state, badView, true, SCRIPT_VERIFY_P2SH | SCRIPT_VERIFY_CHECKLOCKTIMEVERIFY, true, txdata,
+            consensusParams, overwinterBranchId));
+
+        // A lookup that does not cache results, as when a block is
+        // connected, also finds the entry.
+        state = CValidationState();
+        EXPECT_TRUE(ContextualCheckInputs(
+            tx, state, badView, true, SCRIPT_VERIFY_P2SH, false, txdata,
+            consensusParams, overwinterBranchId));
+    }
+
+    chainActive.SetTip(NULL);
+    mapBlockIndex.erase(blockHash);
+    RegtestDeactivateOverwinter();
+}
+
 TEST(Validation, ReceivedBlockTransactions) {
     SelectParams(CBaseChainParams::REGTEST);
     const auto chainParams = Params();
@@ -453,3 +545,122 @@ TEST(Validation, ReceivedBlockTransactions) {
     EnsureUnreferencedAsKeyOfMapBlocksUnlinked(&fakeIndex1);
     EnsureUnreferencedAsKeyOfMapBlocksUnlinked(&fakeIndex2);
 }
+
+// Build a transaction shielding a transparent input to both Sapling and
+// Orchard, and return it with the sighash that its bundles authorize.
+static std::pair<CTransaction, uint256> ShieldingTransaction(const CChainParams& params)
+{
+    CBasicKeyStore keystore;
+    CKey tsk = AddTestCKeyToKeyStore(keystore);
+    CTxOut prevout(50000, GetScriptForDestination(tsk.GetPubKey().GetID()));
+
+    auto saplingSk = libzcash::SaplingSpendingKey::random();
+    auto saplingFvk = saplingSk.full_viewing_key();
+    libzcash::diversifier_t d = {0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0};
+    auto saplingAddr = *saplingFvk.in_viewing_key().address(d);
+
+    auto coinType = params.BIP44CoinType();
+    auto seed = MnemonicSeed::Random(coinType);
+    auto orchardSk = libzcash::OrchardSpendingKey::ForAccount(seed, coinType, 0);
+    auto orchardAddr = orchardSk.ToFullViewingKey().ToIncomingViewingKey().Address(libzcash::diversifier_index_t(0));
+
+    auto builder = TransactionBuilder(params, 1, uint256(), SaplingMerkleTree::empty_root(), &keystore);
+    builder.SetFee(10000);
+    builder.AddTransparentInput(COutPoint(GetRandHash(), 0), prevout.scriptPubKey, prevout.nValue);
+    builder.AddSaplingOutput(saplingFvk.ovk, saplingAddr, 20000, std::nullopt);
+    builder.AddOrchardOutput(std::nullopt, orchardAddr, 20000, std::nullopt);
+    CTransaction tx = builder.Build().GetTxOrThrow();
+
+    auto consensusBranchId = CurrentEpochBranchId(1, params.GetConsensus());
+    const PrecomputedTransactionData txdata(tx, {prevout});
+    uint256 sighash = SignatureHash(CScript(), tx, NOT_AN_INPUT, SIGHASH_ALL, 0, consensusBranchId, txdata);
+    return {tx, sighash};
+}
+
+// Test that when the shielded bundles of a block are split into batches that
+// are validated on several threads, the way ConnectBlock shards them, one
+// invalid bundle fails the shared result of the block for its own pool.
+TEST(Validation, ShardedShieldedBatchesFailOnOneInvalidBundle) {
+    LoadProofParameters();
+    RegtestActivateNU5();
+
+    std::vector<std::pair<CTransaction, uint256>> vtx;
+    for (int i = 0; i < 4; i++) {
+        vtx.push_back(ShieldingTransaction(Params()));
+    }
+
+    CCheckQueue<CShieldedBatchCheck> queue(1);
+    boost::thread_group threadGroup;
+    for (int i = 0; i < 2; i++) {
+        threadGroup.create_thread([&queue]() { queue.Thread(); });
+    }
+
+    // Validate one batch per transaction, queueing the Orchard bundle of the
+    // transaction at nInvalid (if any) against the wrong sighash.
+    auto validate = [&](CShieldedBatchResult& result, std::optional<size_t> nInvalid) {
+        std::vector<CShieldedBatchCheck> vChecks;
+        for (size_t i = 0; i < vtx.size(); i++) {
+            auto saplingAuth = sapling::init_batch_validator(false);
+            auto orchardAuth = orchard::init_batch_validator(false);
+            EXPECT_TRUE(vtx[i].first.GetSaplingBundle().QueueAuthValidation(*saplingAuth, vtx[i].second));
+            vtx[i].first.GetOrchardBundle().QueueAuthValidation(*orchardAuth, nInvalid == i ? GetRandHash() : vtx[i].second);
+            vChecks.emplace_back(std::move(saplingAuth), std::move(orchardAuth), &result);
+        }
+        CCheckQueueControl<CShieldedBatchCheck> control(&queue);
+        control.Add(vChecks);
+        return control.Wait();
+    };
+
+    CShieldedBatchResult resultValid;
+    EXPECT_TRUE(validate(resultValid, std::nullopt));
+    EXPECT_TRUE(resultValid.fSaplingValid);
+    EXPECT_TRUE(resultValid.fOrchardValid);
+
+    CShieldedBatchResult resultInvalid;
+    EXPECT_FALSE(validate(resultInvalid, 2));
+    EXPECT_TRUE(resultInvalid.fSaplingValid);
+    EXPECT_FALSE(resultInvalid.fOrchardValid);
+
+    threadGroup.interrupt_all();
+    threadGroup.join_all();
+
+    RegtestDeactivateNU5();
+}
+
+// Test that when the Sapling and Orchard bundles of a mempool transaction are
+// checked in parallel, the transaction is rejected for the invalid one.
+TEST(Validation, ParallelMemPoolAuthChecksReportInvalidBundle) {
+    LoadProofParameters();
+    RegtestActivateNU5();
+
+    auto txAndSighash = ShieldingTransaction(Params());
+    const CTransaction& tx = txAndSighash.first;
+    const uint256& sighash = txAndSighash.second;
+
+    boost::thread_group threadGroup;
+    threadGroup.create_thread(&ThreadProofCheck);
+
+    auto check = [&tx](const uint256& saplingSighash, const uint256& orchardSighash, CValidationState& state) {
+        std::optional<rust::Box<sapling::BatchValidator>> saplingAuth = sapling::init_batch_validator(false);
+        std::optional<rust::Box<orchard::BatchValidator>> orchardAuth = orchard::init_batch_validator(false);
+        EXPECT_TRUE(tx.GetSaplingBundle().QueueAuthValidation(*saplingAuth.value(), saplingSighash));
+        tx.GetOrchardBundle().QueueAuthValidation(*orchardAuth.value(), orchardSighash);
+        return CheckMemPoolAcceptanceAuth(saplingAuth, orchardAuth, state, true);
+    };
+
+    CValidationState stateValid;
+    EXPECT_TRUE(check(sighash, sighash, stateValid));
+
+    CValidationState stateSapling;
+    EXPECT_FALSE(check(GetRandHash(), sighash, stateSapling));
+    EXPECT_EQ(stateSapling.GetRejectReason(), "bad-sapling-bundle-authorization");
+
+    CValidationState stateOrchard;
+    EXPECT_FALSE(check(sighash, GetRandHash(), stateOrchard));
+    EXPECT_EQ(stateOrchard.GetRejectReason(), "bad-orchard-bundle-authorization");
+
+    threadGroup.interrupt_all();
+    threadGroup.join_all();
+
+    RegtestDeactivateNU5();
+}
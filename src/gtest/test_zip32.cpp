@@ -179,3 +179,29 @@ TEST(ZIP32, DeriveChangeAddress)
     EXPECT_EQ(changeSk.ToXFVK().DefaultAddress(), extfvk.GetChangeAddress());
 }
 
+
+TEST(ZIP32, FindAddresses)
+{
+    std::vector<unsigned char, secure_allocator<unsigned char>> rawSeed {
+        0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15, 16,
+        17, 18, 19, 20, 21, 22, 23, 24, 25, 26, 27, 28, 29, 30, 31};
+    HDSeed seed(rawSeed);
+    auto dfvk = libzcash::SaplingExtendedSpendingKey::ForAccount(seed, 1, 0).first.ToXFVK();
+
+    // The same addresses as trying each diversifier index in turn.
+    libzcash::diversifier_index_t j(7);
+    auto found = dfvk.FindAddresses(j, 50);
+    ASSERT_EQ(found.size(), 50);
+    for (const auto& [addr, jFound] : found) {
+        while (!dfvk.Address(j).has_value()) {
+            ASSERT_TRUE(j.increment());
+        }
+        EXPECT_EQ(jFound, j);
+        EXPECT_EQ(addr, dfvk.Address(j).value());
+        ASSERT_TRUE(j.increment());
+    }
+
+    EXPECT_EQ(dfvk.FindAddresses(libzcash::diversifier_index_t(7), 1).front(), found.front());
+    EXPECT_EQ(dfvk.FindAddress(libzcash::diversifier_index_t(7)), found.front());
+    EXPECT_TRUE(dfvk.FindAddresses(j, 0).empty());
+}
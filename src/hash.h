@@ -247,5 +247,8 @@ public:
  *      .Finalize()
  */
 uint64_t SipHashUint256(uint64_t k0, uint64_t k1, const uint256& val);
+/** As SipHashUint256, followed by the 4 little-endian bytes of extra, for
+ *  hashing an outpoint without serializing it. */
+uint64_t SipHashUint256Extra(uint64_t k0, uint64_t k1, const uint256& val, uint32_t extra);
 
 #endif // BITCOIN_HASH_H
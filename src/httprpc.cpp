@@ -70,10 +70,14 @@ static void JSONErrorReply(HTTPRequest* req, const UniValue& objError, const Uni
         nStatus = HTTP_BAD_REQUEST;
     else if (code == RPC_METHOD_NOT_FOUND)
         nStatus = HTTP_NOT_FOUND;
+    else if (code == RPC_METHOD_BUSY)
+        nStatus = HTTP_SERVICE_UNAVAILABLE;
 
     std::string strReply = JSONRPCReply(NullUniValue, objError, id);
 
     req->WriteHeader("Content-Type", "application/json");
+    if (nStatus == HTTP_SERVICE_UNAVAILABLE)
+        req->WriteHeader("Retry-After", "1");
     req->WriteReply(nStatus, strReply);
 }
 
@@ -178,14 +182,13 @@ static bool HTTPReq_JSONRPC(HTTPRequest* req, const std::string &)
         if (valRequest.isObject()) {
             jreq.parse(valRequest);
 
-            UniValue result = tableRPC.execute(jreq.strMethod, jreq.params);
-
             // Send reply
-            strReply = JSONRPCReply(result, NullUniValue, jreq.id);
+            strReply = JSONRPCExecute(jreq);
+            strReply += '\n';
 
         // array of requests
         } else if (valRequest.isArray())
-            strReply = JSONRPCExecBatch(valRequest.get_array());
+            strReply = JSONRPCExecBatch(valRequest.get_array(), HTTPEnqueueWork);
         else
             throw JSONRPCError(RPC_PARSE_ERROR, "Top-level object parse error");
 
@@ -12,6 +12,7 @@
 #include "rpc/protocol.h" // For HTTP status codes
 #include "sync.h"
 #include "ui_interface.h"
+#include "util/time.h"
 
 #include <deque>
 #include <stdio.h>
@@ -22,6 +23,7 @@
 #include <sys/stat.h>
 #include <signal.h>
 #include <future>
+#include <thread>
 
 #include <event2/event.h>
 #include <event2/http.h>
@@ -31,6 +33,8 @@
 #include <event2/util.h>
 #include <event2/keyvalq_struct.h>
 
+#include <rust/metrics.h>
+
 #ifdef EVENT__HAVE_NETINET_IN_H
 #include <netinet/in.h>
 #ifdef _XOPEN_SOURCE_EXTENDED
@@ -61,23 +65,69 @@ private:
     HTTPRequestHandler func;
 };
 
+/** Work item that runs a function queued with HTTPEnqueueWork */
+class HTTPFunctionItem : public HTTPClosure
+{
+public:
+    HTTPFunctionItem(std::function<void()> func): func(std::move(func))
+    {
+    }
+    void operator()()
+    {
+        func();
+    }
+
+private:
+    std::function<void()> func;
+};
+
 /** Simple work queue for distributing work over multiple threads.
  * Work items are simply callable objects.
+ *
+ * The queue starts with a minimum number of worker threads, and starts
+ * another one, up to a maximum, whenever an item is queued while every worker
+ * is busy. Workers that were started are kept until the queue is stopped.
  */
 template <typename WorkItem>
 class WorkQueue
 {
 private:
+    struct QueuedItem
+    {
+        std::unique_ptr<WorkItem> item;
+        int64_t nTimeQueued;
+    };
+
     /** Mutex protects entire object */
     Mutex cs;
     std::condition_variable cond;
-    std::deque<std::unique_ptr<WorkItem>> queue;
+    std::deque<QueuedItem> queue;
+    std::vector<std::thread> threads;
     bool running;
     size_t maxDepth;
+    size_t maxWorkers;
+    //! Number of workers waiting for an item
+    size_t nIdle;
+
+    void StartWorker() EXCLUSIVE_LOCKS_REQUIRED(cs)
+    {
+        try {
+            threads.emplace_back([this] {
+                RenameThread("zc-http-worker");
+                Run();
+            });
+        } catch (const std::system_error& e) {
+            LogPrintf("HTTP: could not start a worker thread: %s\n", e.what());
+            return;
+        }
+        MetricsGauge("zcash.rpc.http.workers", threads.size());
+    }
 
 public:
-    WorkQueue(size_t maxDepth) : running(true),
-                                 maxDepth(maxDepth)
+    WorkQueue(size_t maxDepth, size_t maxWorkers) : running(true),
+                                                    maxDepth(maxDepth),
+                                                    maxWorkers(maxWorkers),
+                                                    nIdle(0)
     {
     }
     /** Precondition: worker threads have all stopped (they have been joined).
@@ -85,6 +135,14 @@ public:
     ~WorkQueue()
     {
     }
+    /** Start the first nWorkers worker threads */
+    void Start(size_t nWorkers)
+    {
+        LOCK(cs);
+        for (size_t i = 0; i < std::min(nWorkers, maxWorkers); i++) {
+            StartWorker();
+        }
+    }
     /** Enqueue a work item */
     bool Enqueue(WorkItem* item)
     {
@@ -92,7 +150,13 @@ public:
         if (queue.size() >= maxDepth) {
             return false;
         }
-        queue.emplace_back(std::unique_ptr<WorkItem>(item));
+        queue.push_back({std::unique_ptr<WorkItem>(item), GetTimeMicros()});
+        // Items that no idle worker will pick up would wait behind the
+        // running ones, which may be slow calls.
+        if (running && nIdle < queue.size() && threads.size() < maxWorkers) {
+            StartWorker();
+        }
+        MetricsGauge("zcash.rpc.http.queue.depth", queue.size());
         cond.notify_one();
         return true;
     }
@@ -101,16 +165,24 @@ public:
     {
         while (true) {
             std::unique_ptr<WorkItem> i;
+            int64_t nTimeStart;
             {
                 WAIT_LOCK(cs, lock);
+                nIdle++;
                 while (running && queue.empty())
                     cond.wait(lock);
+                nIdle--;
                 if (!running)
                     break;
-                i = std::move(queue.front());
+                i = std::move(queue.front().item);
+                nTimeStart = GetTimeMicros();
+                MetricsHistogram("zcash.rpc.http.queue.seconds", (nTimeStart - queue.front().nTimeQueued) * 0.000001);
                 queue.pop_front();
+                MetricsGauge("zcash.rpc.http.queue.depth", queue.size());
+                MetricsGauge("zcash.rpc.http.workers.busy", threads.size() - nIdle);
             }
             (*i)();
+            MetricsHistogram("zcash.rpc.http.request.seconds", (GetTimeMicros() - nTimeStart) * 0.000001);
         }
     }
     /** Interrupt and exit loops */
@@ -120,6 +192,18 @@ public:
         running = false;
         cond.notify_all();
     }
+    /** Wait for the worker threads to exit, after Interrupt */
+    void Join()
+    {
+        std::vector<std::thread> toJoin;
+        {
+            LOCK(cs);
+            toJoin.swap(threads);
+        }
+        for (auto& thread : toJoin) {
+            thread.join();
+        }
+    }
 };
 
 struct HTTPPathHandler
@@ -264,8 +348,12 @@ static void http_request_cb(struct evhttp_request* req, void* arg)
         {
             item.release(); /* if true, queue took ownership */
         } else {
-            LogPrintf("WARNING: request rejected because http work queue depth exceeded, it can be increased with the -rpcworkqueue= setting\n");
-            item->req->WriteReply(HTTP_INTERNAL, "Work queue depth exceeded");
+            // Every worker is busy and the queue is full. Tell the client to
+            // come back rather than failing the request.
+            LogPrintf("WARNING: request rejected because http work queue depth exceeded, it can be increased with the -rpcworkqueue= and -rpcmaxthreads= settings\n");
+            MetricsIncrementCounter("zcash.rpc.http.rejected");
+            item->req->WriteHeader("Retry-After", "1");
+            item->req->WriteReply(HTTP_SERVUNAVAIL, "Work queue depth exceeded");
         }
     } else {
         hreq->WriteReply(HTTP_NOTFOUND);
@@ -329,13 +417,6 @@ static bool HTTPBindAddresses(struct evhttp* http)
     return !boundSockets.empty();
 }
 
-/** Simple wrapper to set thread name and run work queue */
-static void HTTPWorkQueueRun(WorkQueue<HTTPClosure>* queue)
-{
-    RenameThread("zc-http-worker");
-    queue->Run();
-}
-
 /** libevent event log callback */
 static void libevent_log_cb(int severity, const char *msg)
 {
@@ -408,9 +489,11 @@ bool InitHTTPServer()
 
     LogPrint("http", "Initialized HTTP server\n");
     int workQueueDepth = std::max((long)GetArg("-rpcworkqueue", DEFAULT_HTTP_WORKQUEUE), 1L);
-    LogPrintf("HTTP: creating work queue of depth %d\n", workQueueDepth);
+    int rpcThreads = std::max((long)GetArg("-rpcthreads", DEFAULT_HTTP_THREADS), 1L);
+    int rpcMaxThreads = std::max((long)GetArg("-rpcmaxthreads", DEFAULT_HTTP_MAX_THREADS), (long)rpcThreads);
+    LogPrintf("HTTP: creating work queue of depth %d for up to %d worker threads\n", workQueueDepth, rpcMaxThreads);
 
-    workQueue = new WorkQueue<HTTPClosure>(workQueueDepth);
+    workQueue = new WorkQueue<HTTPClosure>(workQueueDepth, rpcMaxThreads);
     eventBase = base;
     eventHTTP = http;
     return true;
@@ -418,7 +501,6 @@ bool InitHTTPServer()
 
 std::thread threadHTTP;
 std::future<bool> threadResult;
-static std::vector<std::thread> g_thread_http_workers;
 
 bool StartHTTPServer()
 {
@@ -429,9 +511,7 @@ bool StartHTTPServer()
     threadResult = task.get_future();
     threadHTTP = std::thread(std::move(task), eventBase, eventHTTP);
 
-    for (int i = 0; i < rpcThreads; i++) {
-        g_thread_http_workers.emplace_back(HTTPWorkQueueRun, workQueue);
-    }
+    workQueue->Start(rpcThreads);
     return true;
 }
 
@@ -455,10 +535,7 @@ void StopHTTPServer()
     LogPrint("http", "Stopping HTTP server\n");
     if (workQueue) {
         LogPrint("http", "Waiting for HTTP worker threads to exit\n");
-        for (auto& thread: g_thread_http_workers) {
-            thread.join();
-        }
-        g_thread_http_workers.clear();
+        workQueue->Join();
         delete workQueue;
     }
     if (eventBase) {
@@ -493,6 +570,19 @@ struct event_base* EventBase()
     return eventBase;
 }
 
+bool HTTPEnqueueWork(std::function<void()> fn)
+{
+    if (!workQueue) {
+        return false;
+    }
+    std::unique_ptr<HTTPFunctionItem> item(new HTTPFunctionItem(std::move(fn)));
+    if (!workQueue->Enqueue(item.get())) {
+        return false;
+    }
+    item.release(); /* queue took ownership */
+    return true;
+}
+
 static void httpevent_callback_fn(evutil_socket_t, short, void* data)
 {
     // Static handler: simply call inner handler
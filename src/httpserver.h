@@ -11,6 +11,7 @@
 #include <functional>
 
 static const int DEFAULT_HTTP_THREADS=4;
+static const int DEFAULT_HTTP_MAX_THREADS=16;
 static const int DEFAULT_HTTP_WORKQUEUE=16;
 static const int DEFAULT_HTTP_SERVER_TIMEOUT=30;
 
@@ -43,6 +44,11 @@ void RegisterHTTPHandler(const std::string &prefix, bool exactMatch, const HTTPR
 /** Unregister handler for prefix */
 void UnregisterHTTPHandler(const std::string &prefix, bool exactMatch);
 
+/** Queue fn to run on an HTTP worker thread. Returns false if the work queue
+ * is full or the server is not running, in which case fn is not run.
+ */
+bool HTTPEnqueueWork(std::function<void()> fn);
+
 /** Return evhttp event base. This can be used by submodules to
  * queue timers or custom events.
  */
@@ -11,11 +11,21 @@
 #include "init.h"
 #include "addrman.h"
 #include "amount.h"
+#include "asyncrpcqueue.h"
+#include "blockcompression.h"
+#include "blockfilterindex.h"
+#include "blockindexsnapshot.h"
+#include "blockreader.h"
+#include "candidateblock.h"
+#include "cachestats.h"
 #include "checkpoints.h"
+#include "coinssnapshot.h"
+#include "coinstats.h"
 #include "compat.h"
 #include "compat/sanity.h"
 #include "consensus/upgrades.h"
 #include "consensus/validation.h"
+#include "dbcompactor.h"
 #include "deprecation.h"
 #include "experimental_features.h"
 #include "fs.h"
@@ -27,6 +37,7 @@
 #endif
 #include "main.h"
 #include "mempool_limit.h"
+#include "mempoolfeed.h"
 #include "metrics.h"
 #include "miner.h"
 #include "net.h"
@@ -36,9 +47,14 @@
 #include "script/standard.h"
 #include "script/sigcache.h"
 #include "scheduler.h"
+#include "shieldedblockindex.h"
+#include "syncstats.h"
 #include "txdb.h"
+#include "txlocationindex.h"
+#include "txrejectcache.h"
 #include "torcontrol.h"
 #include "ui_interface.h"
+#include "util/allocator.h"
 #include "util/system.h"
 #include "util/moneystr.h"
 #include "validationinterface.h"
@@ -49,6 +65,9 @@
 #include "warnings.h"
 #include "zip317.h"
 #include <chrono>
+#include <future>
+#include <optional>
+#include <set>
 #include <stdint.h>
 #include <stdio.h>
 
@@ -66,6 +85,7 @@
 #include <sodium.h>
 
 #if ENABLE_ZMQ
+#include "zmq/zmqabstractnotifier.h"
 #include "zmq/zmqnotificationinterface.h"
 #endif
 
@@ -92,6 +112,10 @@ static const int64_t WALLET_INITIAL_SYNC_TIMEOUT = 1000 * 60 * 60 * 2;
 static CZMQNotificationInterface* pzmqNotificationInterface = NULL;
 #endif
 
+//! Set once the validity caches saved at the last shutdown have been loaded,
+//! so that they are not overwritten if initialization fails before that.
+static std::atomic_bool fValidityCachesLoaded(false);
+
 #ifdef WIN32
 // Win32 LevelDB doesn't use file descriptors, and the ones used for
 // accessing block files don't count towards the fd_set size limit
@@ -170,7 +194,6 @@ public:
     // Writes do not need similar protection, as failure to write is handled by the caller.
 };
 
-static CCoinsViewDB *pcoinsdbview = NULL;
 static CCoinsViewErrorCatcher *pcoinscatcher = NULL;
 
 void Interrupt(boost::thread_group& threadGroup)
@@ -211,21 +234,67 @@ void Shutdown()
 #ifdef ENABLE_MINING
     GenerateBitcoins(false, 0, Params());
 #endif
+    StopTxAcceptThreads();
+    if (pcandidateblock) {
+        pcandidateblock->Stop();
+        delete pcandidateblock;
+        pcandidateblock = NULL;
+    }
+    if (pmempoolfeed) {
+        pmempoolfeed->Stop();
+        delete pmempoolfeed;
+        pmempoolfeed = NULL;
+    }
     StopNode();
     StopTorControl();
     UnregisterNodeSignals(GetNodeSignals());
+    if (fMempoolLoaded && GetBoolArg("-persistmempool", DEFAULT_PERSIST_MEMPOOL)) {
+        DumpMempool();
+    }
+    if (fValidityCachesLoaded && GetBoolArg("-persistsigcache", DEFAULT_PERSIST_SIGCACHE)) {
+        DumpValidityCaches();
+    }
+    if (ptxoutsetstats)
+        ptxoutsetstats->Stop();
+    for (const auto& entry : mapBlockFilterIndexes)
+        entry.second->Stop();
+    if (ptxlocationindex)
+        ptxlocationindex->Stop();
+    if (pshieldedblockindex)
+        pshieldedblockindex->Stop();
+    if (pdbcompactor)
+        pdbcompactor->Stop();
 
     {
         LOCK(cs_main);
         if (pcoinsTip != NULL) {
             FlushStateToDisk();
+            SaveBlockIndexSnapshot();
         }
+        StopPruneUnlink();
+        StopBlockFileSync();
+        delete ptxoutsetstats;
+        ptxoutsetstats = NULL;
+        for (const auto& entry : mapBlockFilterIndexes)
+            delete entry.second;
+        mapBlockFilterIndexes.clear();
+        delete ptxlocationindex;
+        ptxlocationindex = NULL;
+        delete pshieldedblockindex;
+        pshieldedblockindex = NULL;
+        delete pdbcompactor;
+        pdbcompactor = NULL;
+        coinsSnapshots.Clear();
         delete pcoinsTip;
         pcoinsTip = NULL;
+        delete pcoinswriter;
+        pcoinswriter = NULL;
         delete pcoinscatcher;
         pcoinscatcher = NULL;
         delete pcoinsdbview;
         pcoinsdbview = NULL;
+        delete pinsightdb;
+        pinsightdb = NULL;
         delete pblocktree;
         pblocktree = NULL;
     }
@@ -301,6 +370,8 @@ bool static Bind(const CService &addr, unsigned int flags) {
 void OnRPCStopped()
 {
     g_best_block_cv.notify_all();
+    if (pmempoolfeed)
+        pmempoolfeed->Interrupt();
     LogPrint("rpc", "RPC stopped.\n");
 }
 
@@ -324,11 +395,19 @@ std::string HelpMessage(HelpMessageMode mode)
     strUsage += HelpMessageOpt("-version", _("Print version and exit"));
     strUsage += HelpMessageOpt("-alertnotify=<cmd>", _("Execute command on node end-of-service or when we see a really long fork (%s in cmd is replaced by message)"));
     strUsage += HelpMessageOpt("-allowdeprecated=<feature>", strprintf(_("Explicitly allow the use of the specified deprecated feature. Multiple instances of this parameter are permitted; values for <feature> must be selected from among {%s}"), GetAllowableDeprecatedFeatures()));
+    strUsage += HelpMessageOpt("-assumevalid=<hex>", _("If this block is in the chain assume that it and its ancestors are valid and potentially skip their script and proof verification (0 to verify all, default: a recent block on the selected network)"));
+    strUsage += HelpMessageOpt("-blockcompression", strprintf(_("Compress blocks as they are written to the block files (default: %u)"), DEFAULT_BLOCK_COMPRESSION));
+    strUsage += HelpMessageOpt("-blockfilterindex=<type>", strprintf(_("Maintain an index of compact filters by block (default: %s, values: %s). If <type> is not supplied or if <type> = 1, indexes for all known types are enabled."),
+        "0", "basic, shielded"));
+    strUsage += HelpMessageOpt("-blockindexsnapshot", strprintf(_("Save a snapshot of the block index at shutdown, and load the block index from it at the next startup if it is still current (default: %u)"), DEFAULT_BLOCK_INDEX_SNAPSHOT));
     strUsage += HelpMessageOpt("-blocknotify=<cmd>", _("Execute command when the best block changes (%s in cmd is replaced by block hash)"));
+    strUsage += HelpMessageOpt("-blockprealloc=<n>", strprintf(_("Pre-allocate block files in chunks of <n> MiB, and undo files in chunks of a sixteenth of that (1 to %d, default: %d)"), MAX_BLOCK_PREALLOC, BLOCKFILE_CHUNK_SIZE >> 20));
+    strUsage += HelpMessageOpt("-blockreadcache=<n>", strprintf(_("Keep up to <n> MiB of recently read blocks in memory (0 to disable, default: %d)"), DEFAULT_BLOCK_READ_CACHE));
     if (showDebug)
         strUsage += HelpMessageOpt("-blocksonly", strprintf(_("Whether to reject transactions from network peers. Automatic broadcast and rebroadcast of any transactions from inbound peers is disabled, unless '-whitelistforcerelay' is '1', in which case whitelisted peers' transactions will be relayed. RPC transactions are not affected. (default: %u)"), DEFAULT_BLOCKSONLY));
     strUsage += HelpMessageOpt("-checkblocks=<n>", strprintf(_("How many blocks to check at startup (default: %u, 0 = all)"), DEFAULT_CHECKBLOCKS));
     strUsage += HelpMessageOpt("-checklevel=<n>", strprintf(_("How thorough the block verification of -checkblocks is (0-4, default: %u)"), DEFAULT_CHECKLEVEL));
+    strUsage += HelpMessageOpt("-compressblockfiles", strprintf(_("Compress the blocks already in the block files at startup, keeping them where they are on disk (default: %u)"), DEFAULT_COMPRESS_BLOCK_FILES));
     strUsage += HelpMessageOpt("-conf=<file>", strprintf(_("Specify configuration file. Relative paths will be prefixed by datadir location. (default: %s)"), BITCOIN_CONF_FILENAME));
     if (mode == HMM_BITCOIND)
     {
@@ -338,14 +417,31 @@ std::string HelpMessage(HelpMessageMode mode)
     }
     strUsage += HelpMessageOpt("-datadir=<dir>", _("Specify data directory (this path cannot use '~')"));
     strUsage += HelpMessageOpt("-paramsdir=<dir>", _("Specify Zcash network parameters directory"));
+    strUsage += HelpMessageOpt("-dbasyncflush", strprintf(_("Write the chainstate to disk from a background thread (default: %u)"), DEFAULT_DB_ASYNC_FLUSH));
+    strUsage += HelpMessageOpt("-dbblockcachepercent=<n>", strprintf(_("Percentage of each database cache used to cache reads; the rest buffers writes (%d to %d, default: %d)"), MIN_DB_BLOCK_CACHE_PERCENT, MAX_DB_BLOCK_CACHE_PERCENT, DEFAULT_DB_BLOCK_CACHE_PERCENT));
+    strUsage += HelpMessageOpt("-dbbloombits=<n>", strprintf(_("Bits per key of the bloom filters of the chain state and block index databases (0 to disable, default: %d)"), DEFAULT_DB_BLOOM_BITS));
     strUsage += HelpMessageOpt("-dbcache=<n>", strprintf(_("Set database cache size in megabytes (%d to %d, default: %d)"), nMinDbCache, nMaxDbCache, nDefaultDbCache));
+    strUsage += HelpMessageOpt("-dbcompactafteribd", strprintf(_("Compact the chain state and block index databases in the background once initial block download ends (default: %u)"), DEFAULT_DB_COMPACT_AFTER_IBD));
     strUsage += HelpMessageOpt("-debuglogfile=<file>", strprintf(_("Specify location of debug log file. Relative paths will be prefixed by a net-specific datadir location. (default: %s)"), DEFAULT_DEBUGLOGFILE));
     strUsage += HelpMessageOpt("-exportdir=<dir>", _("Specify directory to be used when exporting data"));
+    strUsage += HelpMessageOpt("-fastheadersync", strprintf(_("Check the Equihash solutions of headers up to the last checkpoint height only when their blocks are downloaded, so that header sync finishes sooner. Incompatible with flags that disable checkpoints. (default = %u)"), DEFAULT_FAST_HEADER_SYNC));
+    strUsage += HelpMessageOpt("-ibdproofwindow=<n>", strprintf(_("Batch-validate the Sapling and Orchard proofs of up to <n> blocks ahead of the tip together during initial block download (0 to disable, max: %d, default: %d)"), MAX_IBD_PROOF_WINDOW, DEFAULT_IBD_PROOF_WINDOW));
     strUsage += HelpMessageOpt("-ibdskiptxverification", strprintf(_("Skip transaction verification during initial block download up to the last checkpoint height. Incompatible with flags that disable checkpoints. (default = %u)"), DEFAULT_IBD_SKIP_TX_VERIFICATION));
     strUsage += HelpMessageOpt("-loadblock=<file>", _("Imports blocks from external blk000??.dat file on startup"));
+    strUsage += HelpMessageOpt("-mallocarenas=<n>", strprintf(_("Limit the heap allocator to <n> arenas, which reduces fragmentation at the cost of contention between threads. Not supported by jemalloc, which reads MALLOC_CONF instead (0 = the allocator's default, default: %d)"), DEFAULT_MALLOC_ARENAS));
+    strUsage += HelpMessageOpt("-mallocpurge", strprintf(_("Ask the heap allocator to return free memory to the operating system after flushing the coins cache (default: %u)"), DEFAULT_MALLOC_PURGE));
     strUsage += HelpMessageOpt("-maxorphantx=<n>", strprintf(_("Keep at most <n> unconnectable transactions in memory (default: %u)"), DEFAULT_MAX_ORPHAN_TRANSACTIONS));
-    strUsage += HelpMessageOpt("-par=<n>", strprintf(_("Set the number of script verification threads (%u to %d, 0 = auto, <0 = leave that many cores free, default: %d)"),
+    strUsage += HelpMessageOpt("-maxorphanmemory=<n>", strprintf(_("Keep unconnectable transactions using at most <n> megabytes of memory (default: %u)"), DEFAULT_MAX_ORPHAN_MEMORY));
+    strUsage += HelpMessageOpt("-maxorphanpeermemory=<n>", strprintf(_("Keep unconnectable transactions from one peer using at most <n> kilobytes of memory (default: %u)"), DEFAULT_MAX_ORPHAN_PEER_MEMORY));
+    strUsage += HelpMessageOpt("-maxrejectmemory=<n>", strprintf(_("Remember transactions that are invalid whatever the chain tip using at most <n> megabytes of memory (default: %u)"), DEFAULT_MAX_REJECT_MEMORY));
+    strUsage += HelpMessageOpt("-nullifierfilter", strprintf(_("Keep an in-memory filter of spent nullifiers, so that most nullifier lookups skip the database (default: %u)"), DEFAULT_NULLIFIER_FILTER));
+    strUsage += HelpMessageOpt("-numanode=<n>", _("Run all threads on the CPUs of NUMA node <n>, so that the caches they share are kept in the memory of that node (Linux only, default: any node)"));
+    strUsage += HelpMessageOpt("-persistmempool", strprintf(_("Whether to save the mempool on shutdown and load on restart (default: %u)"), DEFAULT_PERSIST_MEMPOOL));
+    strUsage += HelpMessageOpt("-persistsigcache", strprintf(_("Whether to save the signature and proof validity caches on shutdown and load them on restart (default: %u)"), DEFAULT_PERSIST_SIGCACHE));
+    strUsage += HelpMessageOpt("-par=<n>", strprintf(_("Set the number of threads verifying scripts and proofs, and scanning blocks for the wallet (%u to %d, 0 = auto, <0 = leave that many cores free, default: %d)"),
         -GetNumCores(), MAX_SCRIPTCHECK_THREADS, DEFAULT_SCRIPTCHECK_THREADS));
+    strUsage += HelpMessageOpt("-txacceptthreads=<n>", strprintf(_("Set the number of threads that check transactions received from peers, at most the number of cores (0 to %d, 0 = check them while receiving, default: %d)"),
+        MAX_TX_ACCEPT_THREADS, DEFAULT_TX_ACCEPT_THREADS));
 #ifndef WIN32
     strUsage += HelpMessageOpt("-pid=<file>", strprintf(_("Specify pid file. Relative paths will be prefixed by a net-specific datadir location. (default: %s)"), BITCOIN_PID_FILENAME));
 #endif
@@ -360,10 +456,13 @@ std::string HelpMessage(HelpMessageMode mode)
     strUsage += HelpMessageOpt("-reindex", _("Rebuild chain state and block index from the blk*.dat files on disk"));
 #endif
 #ifndef WIN32
+    strUsage += HelpMessageOpt("-shieldedblockindex", strprintf(_("Maintain an index of the shielded compact blocks served by /rest/shieldedblocks, built in the background (default: %u)"), DEFAULT_SHIELDEDBLOCKINDEX));
     strUsage += HelpMessageOpt("-sysperms", _("Create new files with system default permissions, instead of umask 077 (only effective with disabled wallet functionality)"));
 #endif
     strUsage += HelpMessageOpt("-txexpirynotify=<cmd>", _("Execute command when transaction expires (%s in cmd is replaced by transaction id)"));
+    strUsage += HelpMessageOpt("-txoutsetstats", strprintf(_("Keep statistics of the UTXO set up to date as blocks are connected, so that gettxoutsetinfo answers without reading the whole chain state (default: %u)"), DEFAULT_TXOUTSET_STATS));
     strUsage += HelpMessageOpt("-txindex", strprintf(_("Maintain a full transaction index, used by the getrawtransaction rpc call (default: %u)"), DEFAULT_TXINDEX));
+    strUsage += HelpMessageOpt("-txlocationindex", strprintf(_("Maintain a compact index of the blocks holding each transaction, built in the background, used by the getrawtransaction rpc call (default: %u)"), DEFAULT_TXLOCATIONINDEX));
 
     strUsage += HelpMessageGroup(_("Connection options:"));
     strUsage += HelpMessageOpt("-addnode=<ip>", _("Add a node to connect to and attempt to keep the connection open"));
@@ -375,17 +474,24 @@ std::string HelpMessage(HelpMessageMode mode)
     strUsage += HelpMessageOpt("-dns", _("Allow DNS lookups for -addnode, -seednode and -connect") + " " + strprintf(_("(default: %u)"), DEFAULT_NAME_LOOKUP));
     strUsage += HelpMessageOpt("-dnsseed", _("Query for peer addresses via DNS lookup, if low on addresses (default: 1 unless -connect/-noconnect)"));
     strUsage += HelpMessageOpt("-externalip=<ip>", _("Specify your own public address"));
+    strUsage += HelpMessageOpt("-feefilter", strprintf(_("Tell peers not to announce transactions below our minimum relay fee or over our unpaid action limit (default: %u)"), DEFAULT_FEEFILTER));
     strUsage += HelpMessageOpt("-forcednsseed", strprintf(_("Always query for peer addresses via DNS lookup (default: %u)"), DEFAULT_FORCEDNSSEED));
     strUsage += HelpMessageOpt("-listen", _("Accept connections from outside (default: 1 if no -proxy or -connect/-noconnect)"));
     strUsage += HelpMessageOpt("-listenonion", strprintf(_("Automatically create Tor hidden service (default: %d)"), DEFAULT_LISTEN_ONION));
+    strUsage += HelpMessageOpt("-maxblocksendbuffer=<n>", strprintf(_("Only send blocks to peers with data already queued while the send buffers of all connections hold less than <n>*1000 bytes (default: %u)"), DEFAULT_MAXBLOCKSENDBUFFER));
     strUsage += HelpMessageOpt("-maxconnections=<n>", strprintf(_("Maintain at most <n> connections to peers (default: %u)"), DEFAULT_MAX_PEER_CONNECTIONS));
     strUsage += HelpMessageOpt("-maxreceivebuffer=<n>", strprintf(_("Maximum per-connection receive buffer, <n>*1000 bytes (default: %u)"), DEFAULT_MAXRECEIVEBUFFER));
     strUsage += HelpMessageOpt("-maxsendbuffer=<n>", strprintf(_("Maximum per-connection send buffer, <n>*1000 bytes (default: %u)"), DEFAULT_MAXSENDBUFFER));
+    strUsage += HelpMessageOpt("-maxtxmsgsperround=<n>", strprintf(_("Process at most <n> transactions from peers per message handler round, so that blocks are not delayed by transaction spam (0 = no limit, default: %d)"), DEFAULT_MAX_TX_MSGS_PER_ROUND));
     strUsage += HelpMessageOpt("-mempoolevictionmemoryminutes=<n>", strprintf(_("The number of minutes before allowing rejected transactions to re-enter the mempool. (default: %u)"), DEFAULT_MEMPOOL_EVICTION_MEMORY_MINUTES));
+    strUsage += HelpMessageOpt("-mempoolfeedsize=<n>", strprintf(_("Keep the last <n> transactions to enter or leave the mempool for getmempoolchanges (default: %u)"), DEFAULT_MEMPOOL_FEED_SIZE));
     strUsage += HelpMessageOpt("-mempooltxcostlimit=<n>",strprintf(_("An upper bound on the maximum size in bytes of all transactions in the mempool. (default: %s)"), DEFAULT_MEMPOOL_TOTAL_COST_LIMIT));
+    strUsage += HelpMessageOpt("-msghandthreads=<n>", strprintf(_("Set the number of threads that process messages from peers (1 to %d, default: %d)"),
+        MAX_MSGHAND_THREADS, DEFAULT_MSGHAND_THREADS));
     strUsage += HelpMessageOpt("-onion=<ip:port>", strprintf(_("Use separate SOCKS5 proxy to reach peers via Tor hidden services (default: %s)"), "-proxy"));
     strUsage += HelpMessageOpt("-onlynet=<net>", _("Only connect to nodes in network <net> (ipv4, ipv6 or onion)"));
     strUsage += HelpMessageOpt("-permitbaremultisig", strprintf(_("Relay non-P2SH multisig (default: %u)"), DEFAULT_PERMIT_BAREMULTISIG));
+    strUsage += HelpMessageOpt("-peerblockfilters", strprintf(_("Serve compact block filters to peers per BIP 157 (default: %u)"), DEFAULT_PEERBLOCKFILTERS));
     strUsage += HelpMessageOpt("-peerbloomfilters", strprintf(_("Support filtering of blocks and transaction with bloom filters (default: %u)"), DEFAULT_PEERBLOOMFILTERS));
     if (showDebug)
         strUsage += HelpMessageOpt("-enforcenodebloom", strprintf("Enforce minimum protocol version to limit use of bloom filters (default: %u)", DEFAULT_ENFORCENODEBLOOM));
@@ -397,6 +503,7 @@ std::string HelpMessage(HelpMessageMode mode)
     strUsage += HelpMessageOpt("-timeout=<n>", strprintf(_("Specify connection timeout in milliseconds (minimum: 1, default: %d)"), DEFAULT_CONNECT_TIMEOUT));
     strUsage += HelpMessageOpt("-torcontrol=<ip>:<port>", strprintf(_("Tor control port to use if onion listening enabled (default: %s)"), DEFAULT_TOR_CONTROL));
     strUsage += HelpMessageOpt("-torpassword=<pass>", _("Tor control port password (default: empty)"));
+    strUsage += HelpMessageOpt("-txreconciliation", strprintf(_("Announce transactions to peers that support it by set reconciliation rather than inv (default: %u)"), DEFAULT_TXRECONCILIATION_ENABLE));
     strUsage += HelpMessageOpt("-whitebind=<addr>", _("Bind to given address and whitelist peers connecting to it. Use [host]:port notation for IPv6"));
     strUsage += HelpMessageOpt("-whitelist=<netmask>", _("Whitelist peers connecting from the given netmask or IP address. Can be specified multiple times.") +
         " " + _("Whitelisted peers cannot be DoS banned and their transactions are always relayed, even if they are already in the mempool, useful e.g. for a gateway"));
@@ -411,9 +518,15 @@ std::string HelpMessage(HelpMessageMode mode)
 #if ENABLE_ZMQ
     strUsage += HelpMessageGroup(_("ZeroMQ notification options:"));
     strUsage += HelpMessageOpt("-zmqpubhashblock=<address>", _("Enable publish hash block in <address>"));
+    strUsage += HelpMessageOpt("-zmqpubhashblockhwm=<n>", strprintf(_("Set publish hash block outbound message high water mark (default: %d)"), DEFAULT_ZMQ_SNDHWM));
     strUsage += HelpMessageOpt("-zmqpubhashtx=<address>", _("Enable publish hash transaction in <address>"));
+    strUsage += HelpMessageOpt("-zmqpubhashtxhwm=<n>", strprintf(_("Set publish hash transaction outbound message high water mark (default: %d)"), DEFAULT_ZMQ_SNDHWM));
     strUsage += HelpMessageOpt("-zmqpubrawblock=<address>", _("Enable publish raw block in <address>"));
+    strUsage += HelpMessageOpt("-zmqpubrawblockhwm=<n>", strprintf(_("Set publish raw block outbound message high water mark (default: %d)"), DEFAULT_ZMQ_SNDHWM));
     strUsage += HelpMessageOpt("-zmqpubrawtx=<address>", _("Enable publish raw transaction in <address>"));
+    strUsage += HelpMessageOpt("-zmqpubrawtxhwm=<n>", strprintf(_("Set publish raw transaction outbound message high water mark (default: %d)"), DEFAULT_ZMQ_SNDHWM));
+    strUsage += HelpMessageOpt("-zmqpubsequence=<address>", _("Enable publish hash block and hash transaction sequence in <address>"));
+    strUsage += HelpMessageOpt("-zmqpubsequencehwm=<n>", strprintf(_("Set publish hash block and hash transaction sequence outbound message high water mark (default: %d)"), DEFAULT_ZMQ_SNDHWM));
 #endif
 
     strUsage += HelpMessageGroup(_("Monitoring options:"));
@@ -431,7 +544,9 @@ std::string HelpMessage(HelpMessageMode mode)
     if (showDebug)
     {
         strUsage += HelpMessageOpt("-checkblockindex", strprintf("Do a full consistency check for mapBlockIndex, setBlockIndexCandidates, chainActive and mapBlocksUnlinked occasionally. (default: %u)", Params(CBaseChainParams::MAIN).DefaultConsistencyChecks()));
+        strUsage += HelpMessageOpt("-checkblockreads", strprintf("Check the Equihash solution of each block that is read from disk, even if its header was checked when it was accepted (default: %u)", DEFAULT_CHECK_BLOCK_READS));
         strUsage += HelpMessageOpt("-checkmempool=<n>", strprintf("Run checks every <n> transactions (default: %u)", Params(CBaseChainParams::MAIN).DefaultConsistencyChecks()));
+        strUsage += HelpMessageOpt("-checkmempoolsample=<n>", "Check <n> random mempool transactions, and those that changed, whenever the whole mempool is not checked (default: 0)");
         strUsage += HelpMessageOpt("-checkpoints", strprintf("Disable expensive verification for known chain history (default: %u)", DEFAULT_CHECKPOINTS_ENABLED));
         strUsage += HelpMessageOpt("-disablesafemode", strprintf("Disable safemode, override a real safe mode event (default: %u)", DEFAULT_DISABLE_SAFEMODE));
         strUsage += HelpMessageOpt("-testsafemode", strprintf("Force safe mode (default: %u)", DEFAULT_TESTSAFEMODE));
@@ -448,7 +563,7 @@ std::string HelpMessage(HelpMessageMode mode)
                 "-fundingstream=streamId:startHeight:endHeight:comma_delimited_addresses",
                 "Use given addresses for block subsidy share paid to the funding stream with id <streamId> (regtest-only)");
     }
-    std::string debugCategories = "addrman, bench, coindb, db, http, libevent, lock, mempool, mempoolrej, net, partitioncheck, pow, proxy, prune, "
+    std::string debugCategories = "addrman, bench, cmpctblock, coindb, db, http, libevent, lock, mempool, mempoolrej, net, partitioncheck, pow, proxy, prune, "
                              "rand, receiveunsafe, reindex, rpc, selectcoins, tor, valuepool, zmq, zrpc, zrpcunsafe (implies zrpc)"; // Don't translate these
     strUsage += HelpMessageOpt("-debug=<category>", strprintf(_("Output debugging information (default: %u, supplying <category> is optional)"), 0) + ". " +
         _("If <category> is not supplied or if <category> = 1, output all debugging information.") + " " + _("<category> can be:") + " " + debugCategories + ". " +
@@ -459,12 +574,16 @@ std::string HelpMessage(HelpMessageMode mode)
     strUsage += HelpMessageOpt("-help-debug", _("Show all debugging options (usage: --help -help-debug)"));
     strUsage += HelpMessageOpt("-logips", strprintf(_("Include IP addresses in debug output (default: %u)"), DEFAULT_LOGIPS));
     strUsage += HelpMessageOpt("-logtimestamps", strprintf(_("Prepend debug output with timestamp (default: %u)"), DEFAULT_LOGTIMESTAMPS));
+    strUsage += HelpMessageOpt("-logratelimit=<n>", strprintf(_("Log at most <n> debugging messages per second from each place that logs them, and log how many were dropped (0 = no limit, default: %u)"), DEFAULT_LOGRATELIMIT));
     if (showDebug)
     {
         strUsage += HelpMessageOpt("-clockoffset=<n>", "Applies offset of <n> seconds to the actual time. Incompatible with -mocktime (default: 0)");
         strUsage += HelpMessageOpt("-mocktime=<n>", "Replace actual time with <n> seconds since epoch. Incompatible with -clockoffset (default: 0)");
+        strUsage += HelpMessageOpt("-lockstats", strprintf("Profile how long locks are waited for and held, for getlockstats and the zcash.lock.wait.seconds metric (default: %u)", DEFAULT_LOCK_STATS));
         strUsage += HelpMessageOpt("-maxsigcachesize=<n>", strprintf("Limit total size of signature and bundle caches to <n> MiB (default: %u)", DEFAULT_MAX_SIG_CACHE_SIZE));
         strUsage += HelpMessageOpt("-maxtipage=<n>", strprintf("Maximum tip age in seconds to consider node in initial block download (default: %u)", DEFAULT_MAX_TIP_AGE));
+        strUsage += HelpMessageOpt("-tracespanfile=<file>", "Write the time spent in each enabled tracing span to <file>, in the folded stack format read by flamegraph tools. The spans on the block and transaction validation paths are enabled by -debug=bench, or at runtime with setlogfilter");
+        strUsage += HelpMessageOpt("-schedulerthreads=<n>", strprintf("Number of threads to run scheduled background tasks on (1 to %d, default: %d)", MAX_SCHEDULER_THREADS, DEFAULT_SCHEDULER_THREADS));
     }
     strUsage += HelpMessageOpt("-minrelaytxfee=<amt>", strprintf(_("Transactions must have at least this fee rate (in %s per 1000 bytes) for relaying, mining and transaction creation (default: %s). This is not the only fee constraint."),
         CURRENCY_UNIT, FormatMoney(DEFAULT_MIN_RELAY_TX_FEE)));
@@ -495,6 +614,7 @@ std::string HelpMessage(HelpMessageMode mode)
     strUsage += HelpMessageOpt("-gen", strprintf(_("Generate coins (default: %u)"), DEFAULT_GENERATE));
     strUsage += HelpMessageOpt("-genproclimit=<n>", strprintf(_("Set the number of threads for coin generation if enabled (-1 = all cores, default: %d)"), DEFAULT_GENERATE_THREADS));
     strUsage += HelpMessageOpt("-equihashsolver=<name>", _("Specify the Equihash solver to be used if enabled (default: \"default\")"));
+    strUsage += HelpMessageOpt("-equihashsolverthreads=<n>", strprintf(_("Set the number of threads that the \"tromp\" Equihash solver of each coin generation thread uses (default: %d)"), DEFAULT_EQUIHASH_SOLVER_THREADS));
     strUsage += HelpMessageOpt("-mineraddress=<addr>", _("Send mined coins to a specific single address"));
     strUsage += HelpMessageOpt("-minetolocalwallet", strprintf(
             _("Require that mined blocks use a coinbase address in the local wallet (default: %u)"),
@@ -517,13 +637,14 @@ std::string HelpMessage(HelpMessageMode mode)
     strUsage += HelpMessageOpt("-rpcport=<port>", strprintf(_("Listen for JSON-RPC connections on <port> (default: %u or testnet: %u)"), 8232, 18232));
     strUsage += HelpMessageOpt("-rpcallowip=<ip>", _("Allow JSON-RPC connections from specified source. Valid for <ip> are a single IP (e.g. 1.2.3.4), a network/netmask (e.g. 1.2.3.4/255.255.255.0) or a network/CIDR (e.g. 1.2.3.4/24). This option can be specified multiple times"));
     strUsage += HelpMessageOpt("-rpcthreads=<n>", strprintf(_("Set the number of threads to service RPC calls (default: %d)"), DEFAULT_HTTP_THREADS));
+    strUsage += HelpMessageOpt("-rpcmaxthreads=<n>", strprintf(_("Set the maximum number of threads to service RPC calls. Threads beyond -rpcthreads are started when all of them are busy (default: %d)"), DEFAULT_HTTP_MAX_THREADS));
+    strUsage += HelpMessageOpt("-rpcmethodlimit=<method>:<n>", _("Allow at most <n> calls of an RPC method, or of the methods in a category such as wallet, to run at once. Other calls fail until one finishes. This option can be specified multiple times"));
     if (showDebug) {
         strUsage += HelpMessageOpt("-rpcworkqueue=<n>", strprintf("Set the depth of the work queue to service RPC calls (default: %d)", DEFAULT_HTTP_WORKQUEUE));
         strUsage += HelpMessageOpt("-rpcservertimeout=<n>", strprintf("Timeout during HTTP requests (default: %d)", DEFAULT_HTTP_SERVER_TIMEOUT));
     }
 
-    // Disabled until we can lock notes and also tune performance of the prover which by default uses multiple threads
-    //strUsage += HelpMessageOpt("-rpcasyncthreads=<n>", strprintf(_("Set the number of threads to service Async RPC calls (default: %d)"), 1));
+    strUsage += HelpMessageOpt("-rpcasyncthreads=<n>", strprintf(_("Set the number of threads to service Async RPC calls, such as z_sendmany (1 to %d, 0 = one for every 4 cores, default: %d)"), MAX_RPC_ASYNC_THREADS, DEFAULT_RPC_ASYNC_THREADS));
 
     if (mode == HMM_BITCOIND) {
         strUsage += HelpMessageGroup(_("Metrics Options (only if -daemon and -printtoconsole are not set):"));
@@ -743,35 +864,11 @@ void ThreadStartWalletNotifier()
 void ThreadImport(std::vector<fs::path> vImportFiles, const CChainParams& chainparams)
 {
     RenameThread("zcash-loadblk");
-    CImportingNow imp;
+    std::optional<CImportingNow> imp(std::in_place);
 
     // -reindex
     if (fReindex) {
-        nSizeReindexed = 0;  // will be modified inside LoadExternalBlockFile
-        // Find the summary size of all block files first
-        int nFile = 0;
-        size_t fullSize = 0;
-        while (true) {
-            CDiskBlockPos pos(nFile, 0);
-            fs::path blkFile = GetBlockPosFilename(pos, "blk");
-            if (!fs::exists(blkFile))
-                break; // No block files left to reindex
-            nFile++;
-            fullSize += fs::file_size(blkFile);
-        }
-        nFullSizeToReindex = std::max<size_t>(1, fullSize);
-        nFile = 0;
-        while (true) {
-            CDiskBlockPos pos(nFile, 0);
-            if (!fs::exists(GetBlockPosFilename(pos, "blk")))
-                break; // No block files left to reindex
-            FILE *file = OpenBlockFile(pos, true);
-            if (!file)
-                break; // This error is logged in OpenBlockFile
-            LogPrintf("Reindexing block file blk%05u.dat...\n", (unsigned int)nFile);
-            LoadExternalBlockFile(chainparams, file, &pos);
-            nFile++;
-        }
+        ReindexBlockFiles(chainparams);
         pblocktree->WriteReindexing(false);
         fReindex = false;
         nSizeReindexed = 0;
@@ -813,10 +910,22 @@ void ThreadImport(std::vector<fs::path> vImportFiles, const CChainParams& chainp
         StartShutdown();
     }
 
+    // -compressblockfiles. The import is over by then, so that the node can
+    // leave initial block download while the files are compressed.
+    if (GetBoolArg("-compressblockfiles", DEFAULT_COMPRESS_BLOCK_FILES)) {
+        imp.reset();
+        CompressBlockFiles(chainparams);
+    }
+
     if (GetBoolArg("-stopafterblockimport", DEFAULT_STOPAFTERBLOCKIMPORT)) {
         LogPrintf("Stopping after block import\n");
         StartShutdown();
     }
+
+    if (GetBoolArg("-persistmempool", DEFAULT_PERSIST_MEMPOOL)) {
+        LoadMempool(chainparams);
+    }
+    fMempoolLoaded = !ShutdownRequested();
 }
 
 /** Sanity checks
@@ -981,10 +1090,22 @@ void InitLogging()
         pathDebugLen = pathDebugStr.length();
     }
 
+    fs::path pathSpans;
+    const codeunit* pathSpansCStr = nullptr;
+    size_t pathSpansLen = 0;
+    if (mapArgs.count("-tracespanfile")) {
+        pathSpans = AbsPathForConfigVal(fs::path(GetArg("-tracespanfile", "")));
+        pathSpansCStr = reinterpret_cast<const codeunit*>(pathSpans.native().c_str());
+        pathSpansLen = pathSpans.native().length();
+    }
+
     pTracingHandle = tracing_init(
         pathDebugCStr, pathDebugLen,
         initialFilter.c_str(),
-        fLogTimestamps);
+        fLogTimestamps,
+        pathSpansCStr, pathSpansLen);
+    tracing_set_debug_rate_limit(
+        std::clamp(GetArg("-logratelimit", DEFAULT_LOGRATELIMIT), (int64_t)0, (int64_t)UINT32_MAX));
 
     LogPrintf("\n\n\n\n\n\n\n\n\n\n\n\n\n\n\n\n\n\n\n\n");
     LogPrintf("Zcash version %s\n", FormatFullVersion());
@@ -1060,9 +1181,6 @@ bool AppInit2(boost::thread_group& threadGroup, CScheduler& scheduler)
 
     std::set_new_handler(new_handler_terminate);
 
-    // Set up global Rayon threadpool.
-    init::rayon_threadpool();
-
     // ********************************************************* Step 2: parameter interactions
     const CChainParams& chainparams = Params();
 
@@ -1074,10 +1192,37 @@ bool AppInit2(boost::thread_group& threadGroup, CScheduler& scheduler)
         return InitError(err.value());
     }
 
+    std::set<BlockFilterType> setBlockFilterTypes;
+    for (const std::string& strType : mapMultiArgs["-blockfilterindex"]) {
+        if (strType == "" || strType == "1") {
+            setBlockFilterTypes.insert(AllBlockFilterTypes().begin(), AllBlockFilterTypes().end());
+        } else if (strType == "0") {
+            setBlockFilterTypes.clear();
+        } else {
+            BlockFilterType filterType;
+            if (!BlockFilterTypeByName(strType, filterType)) {
+                return InitError(strprintf(_("Unknown -blockfilterindex value %s."), strType));
+            }
+            setBlockFilterTypes.insert(filterType);
+        }
+    }
+
+    if (GetBoolArg("-peerblockfilters", DEFAULT_PEERBLOCKFILTERS)) {
+        if (!setBlockFilterTypes.count(BlockFilterType::BASIC)) {
+            return InitError(_("Cannot set -peerblockfilters without -blockfilterindex."));
+        }
+    }
+
     // if using block pruning, then disable txindex
     if (GetArg("-prune", 0)) {
         if (GetBoolArg("-txindex", DEFAULT_TXINDEX))
             return InitError(_("Prune mode is incompatible with -txindex."));
+        if (!setBlockFilterTypes.empty())
+            return InitError(_("Prune mode is incompatible with -blockfilterindex."));
+        if (GetBoolArg("-txlocationindex", DEFAULT_TXLOCATIONINDEX))
+            return InitError(_("Prune mode is incompatible with -txlocationindex."));
+        if (GetBoolArg("-shieldedblockindex", DEFAULT_SHIELDEDBLOCKINDEX))
+            return InitError(_("Prune mode is incompatible with -shieldedblockindex."));
 #ifdef ENABLE_WALLET
         if (GetBoolArg("-rescan", false)) {
             return InitError(_("Rescans are not possible in pruned mode. You will need to use -reindex which will download the whole blockchain again."));
@@ -1090,9 +1235,14 @@ bool AppInit2(boost::thread_group& threadGroup, CScheduler& scheduler)
     int nUserMaxConnections = GetArg("-maxconnections", DEFAULT_MAX_PEER_CONNECTIONS);
     nMaxConnections = std::max(nUserMaxConnections, 0);
 
-    // Trim requested connection counts, to fit into system limitations
+    // Trim requested connection counts, to fit into system limitations.
+    // Only select() is limited to sockets below FD_SETSIZE.
+#ifdef USE_POLL
+    int nFD = RaiseFileDescriptorLimit(nMaxConnections + nBind + MIN_CORE_FILEDESCRIPTORS);
+#else
     nMaxConnections = std::max(std::min(nMaxConnections, FD_SETSIZE - nBind - MIN_CORE_FILEDESCRIPTORS), 0);
     int nFD = RaiseFileDescriptorLimit(nMaxConnections + MIN_CORE_FILEDESCRIPTORS);
+#endif
     if (nFD < MIN_CORE_FILEDESCRIPTORS)
         return InitError(_("Not enough file descriptors available."));
     nMaxConnections = std::min(nFD - MIN_CORE_FILEDESCRIPTORS, nMaxConnections);
@@ -1107,6 +1257,11 @@ bool AppInit2(boost::thread_group& threadGroup, CScheduler& scheduler)
             return InitError(_("-ibdskiptxverification requires checkpoints to be enabled; it is incompatible with flags that disable checkpoints"));
         }
     }
+    if (GetBoolArg("-fastheadersync", DEFAULT_FAST_HEADER_SYNC)) {
+        if (!GetBoolArg("-checkpoints", DEFAULT_CHECKPOINTS_ENABLED)) {
+            return InitError(_("-fastheadersync requires checkpoints to be enabled; it is incompatible with flags that disable checkpoints"));
+        }
+    }
 
     // ********************************************************* Step 3: parameter-to-internal-flags
 
@@ -1143,24 +1298,72 @@ bool AppInit2(boost::thread_group& threadGroup, CScheduler& scheduler)
     if (ratio != 0) {
         mempool.setSanityCheck(1.0 / ratio);
     }
+    mempool.setSampleCheck(std::min<int64_t>(std::max<int64_t>(GetArg("-checkmempoolsample", 0), 0), 1000000));
 
     int64_t mempoolTotalCostLimit = GetArg("-mempooltxcostlimit", DEFAULT_MEMPOOL_TOTAL_COST_LIMIT);
     int64_t mempoolEvictionMemorySeconds = GetArg("-mempoolevictionmemoryminutes", DEFAULT_MEMPOOL_EVICTION_MEMORY_MINUTES) * 60;
     mempool.SetMempoolCostLimit(mempoolTotalCostLimit, mempoolEvictionMemorySeconds);
 
     fCheckBlockIndex = GetBoolArg("-checkblockindex", chainparams.DefaultConsistencyChecks());
+    fCheckBlockReads = GetBoolArg("-checkblockreads", DEFAULT_CHECK_BLOCK_READS);
     fIBDSkipTxVerification = GetBoolArg("-ibdskiptxverification", DEFAULT_IBD_SKIP_TX_VERIFICATION);
+    fFastHeaderSync = GetBoolArg("-fastheadersync", DEFAULT_FAST_HEADER_SYNC);
+    nIBDProofWindow = std::max(0, std::min(MAX_IBD_PROOF_WINDOW, (int)GetArg("-ibdproofwindow", DEFAULT_IBD_PROOF_WINDOW)));
+    nBlockFileChunkSize = std::max(1, std::min(MAX_BLOCK_PREALLOC, (int)GetArg("-blockprealloc", BLOCKFILE_CHUNK_SIZE >> 20))) << 20;
+    nUndoFileChunkSize = nBlockFileChunkSize / (BLOCKFILE_CHUNK_SIZE / UNDOFILE_CHUNK_SIZE);
     fCheckpointsEnabled = GetBoolArg("-checkpoints", DEFAULT_CHECKPOINTS_ENABLED);
 
+    hashAssumeValid = uint256S(GetArg("-assumevalid", chainparams.GetConsensus().defaultAssumeValid.GetHex()));
+    if (!hashAssumeValid.IsNull()) {
+        LogPrintf("Assuming ancestors of block %s have valid signatures and proofs.\n", hashAssumeValid.GetHex());
+    } else {
+        LogPrintf("Validating signatures and proofs for all blocks.\n");
+    }
+
+    // Bind to the NUMA node before any worker thread is started, so that all
+    // of them, including those of LevelDB and the proof verifiers, inherit it.
+    int nNumCores = GetNumCores();
+    int nNumaNode = -1;
+    if (mapArgs.count("-numanode")) {
+        nNumaNode = GetArg("-numanode", -1);
+        int nNodeCPUs = BindToNumaNode(nNumaNode);
+        if (nNodeCPUs == 0)
+            return InitError(strprintf(_("Could not bind to NUMA node %d."), nNumaNode));
+        LogPrintf("Bound to the %d CPUs of NUMA node %d\n", nNodeCPUs, nNumaNode);
+        nNumCores = std::min(nNumCores, nNodeCPUs);
+    }
+
     // -par=0 means autodetect, but nScriptCheckThreads==0 means no concurrency
     nScriptCheckThreads = GetArg("-par", DEFAULT_SCRIPTCHECK_THREADS);
     if (nScriptCheckThreads <= 0)
-        nScriptCheckThreads += GetNumCores();
+        nScriptCheckThreads += nNumCores;
     if (nScriptCheckThreads <= 1)
         nScriptCheckThreads = 0;
     else if (nScriptCheckThreads > MAX_SCRIPTCHECK_THREADS)
         nScriptCheckThreads = MAX_SCRIPTCHECK_THREADS;
 
+    // Set up the Rayon threadpools for proof verification and wallet
+    // scanning, with as many threads as script verification, so that -par
+    // bounds all of them.
+    init::rayon_threadpool(std::max(1, nScriptCheckThreads));
+
+    LogPrintf("Using the %s heap allocator\n", GetAllocatorName());
+    int nMallocArenas = GetArg("-mallocarenas", DEFAULT_MALLOC_ARENAS);
+    if (nMallocArenas < 0) {
+        return InitError(_("-mallocarenas must not be negative."));
+    }
+    if (!SetAllocatorArenas(nMallocArenas)) {
+        InitWarning(strprintf(_("-mallocarenas is not supported by the %s heap allocator, ignoring it."), GetAllocatorName()));
+    }
+    fPurgeAllocator = GetBoolArg("-mallocpurge", DEFAULT_MALLOC_PURGE);
+
+    if (GetBoolArg("-lockstats", DEFAULT_LOCK_STATS)) {
+        SetLockWaitObserver([](const char* pszName, double nWaitSeconds) {
+            MetricsHistogram("zcash.lock.wait.seconds", nWaitSeconds, "name", pszName);
+        });
+        EnableLockStats(true);
+    }
+
     fServer = GetBoolArg("-server", false);
 
     // block pruning; get the amount of disk space (in MiB) to allot for block & undo files
@@ -1177,6 +1380,9 @@ bool AppInit2(boost::thread_group& threadGroup, CScheduler& scheduler)
         fPruneMode = true;
     }
 
+    fBlockCompression = GetBoolArg("-blockcompression", DEFAULT_BLOCK_COMPRESSION);
+    fBlockIndexSnapshot = GetBoolArg("-blockindexsnapshot", DEFAULT_BLOCK_INDEX_SNAPSHOT);
+
     RegisterAllCoreRPCCommands(tableRPC);
 #ifdef ENABLE_WALLET
     bool fDisableWallet = GetBoolArg("-disablewallet", false);
@@ -1241,6 +1447,8 @@ bool AppInit2(boost::thread_group& threadGroup, CScheduler& scheduler)
 
     if (GetBoolArg("-peerbloomfilters", DEFAULT_PEERBLOOMFILTERS))
         nLocalServices |= NODE_BLOOM;
+    if (GetBoolArg("-peerblockfilters", DEFAULT_PEERBLOCKFILTERS))
+        nLocalServices |= NODE_COMPACT_FILTERS;
 
     nMaxTipAge = GetArg("-maxtipage", DEFAULT_MAX_TIP_AGE);
 
@@ -1479,28 +1687,49 @@ bool AppInit2(boost::thread_group& threadGroup, CScheduler& scheduler)
     LogPrintf("Using at most %i connections (%i file descriptors available)\n", nMaxConnections, nFD);
     std::ostringstream strErrors;
 
-    // Initialize the validity caches. We currently have three:
+    // Initialize the validity caches. We currently have five:
     // - Transparent signature validity.
+    // - Transparent script validity of whole transactions.
     // - Sapling bundle validity.
     // - Orchard bundle validity.
-    // Assign half of the cap to transparent signatures, and split the rest
-    // between Sapling and Orchard bundles.
+    // - Sprout JoinSplit proof validity.
+    // Assign half of the cap to transparent signatures and scripts, with
+    // most of it going to signatures, and split the rest between Sapling
+    // and Orchard bundles, with a small share for Sprout JoinSplits.
     size_t nMaxCacheSize = GetArg("-maxsigcachesize", DEFAULT_MAX_SIG_CACHE_SIZE) * ((size_t) 1 << 20);
     if (nMaxCacheSize <= 0) {
         return InitError(strprintf(_("-maxsigcachesize must be at least 1")));
     }
-    InitSignatureCache(nMaxCacheSize / 2);
+    InitSignatureCache(nMaxCacheSize / 2 - nMaxCacheSize / 16);
+    InitScriptExecutionCache(nMaxCacheSize / 16);
     bundlecache::init(nMaxCacheSize / 4);
+    // Nothing has been checked yet, so the nonces of the caches can still be
+    // replaced by those of the saved entries.
+    if (GetBoolArg("-persistsigcache", DEFAULT_PERSIST_SIGCACHE)) {
+        LoadValidityCaches();
+    }
+    fValidityCachesLoaded = true;
 
-    LogPrintf("Using %u threads for script verification\n", nScriptCheckThreads);
+    LogPrintf("Using %u threads for script and proof verification\n", nScriptCheckThreads);
     if (nScriptCheckThreads) {
         for (int i=0; i<nScriptCheckThreads-1; i++)
             threadGroup.create_thread(&ThreadScriptCheck);
+        for (int i=0; i<nScriptCheckThreads-1; i++)
+            threadGroup.create_thread(&ThreadProofCheck);
+        for (int i=0; i<nScriptCheckThreads-1; i++)
+            threadGroup.create_thread(&ThreadCoinsPrefetch);
+        for (int i=0; i<nScriptCheckThreads-1; i++)
+            threadGroup.create_thread(&ThreadHeaderCheck);
+        for (int i=0; i<nScriptCheckThreads-1; i++)
+            threadGroup.create_thread(&ThreadTxCheck);
     }
 
-    // Start the lightweight task scheduler thread
+    // Start the lightweight task scheduler threads
+    int nSchedulerThreads = std::clamp((int)GetArg("-schedulerthreads", DEFAULT_SCHEDULER_THREADS), 1, MAX_SCHEDULER_THREADS);
     CScheduler::Function serviceLoop = boost::bind(&CScheduler::serviceQueue, &scheduler);
-    threadGroup.create_thread(boost::bind(&TraceThread<CScheduler::Function>, "scheduler", serviceLoop));
+    for (int i = 0; i < nSchedulerThreads; i++) {
+        threadGroup.create_thread(boost::bind(&TraceThread<CScheduler::Function>, "scheduler", serviceLoop));
+    }
 
     // Count uptime
     MarkStartTime();
@@ -1527,13 +1756,21 @@ bool AppInit2(boost::thread_group& threadGroup, CScheduler& scheduler)
         if (!metrics_run(metricsBindCstr, vAllowCstr.data(), vAllowCstr.size(), prometheusPort, debugMetrics)) {
             return InitError(strprintf(_("Failed to start Prometheus metrics exporter")));
         }
+        scheduler.scheduleEvery(&UpdateCacheMetrics, CACHE_METRICS_INTERVAL, CScheduler::PRIORITY_LOW);
     }
 
+    // Sample the block sync throughput for getblockchaininfo, and for the
+    // metrics if they are enabled.
+    scheduler.scheduleEvery(&UpdateSyncStats, SYNC_STATS_INTERVAL, CScheduler::PRIORITY_LOW);
+
     // Expose binary metadata to metrics, using a single time series with value 1.
     // https://www.robustperception.io/exposing-the-software-version-to-prometheus
     MetricsIncrementCounter(
         "zcashd.build.info",
         "version", CLIENT_BUILD.c_str());
+    if (nNumaNode >= 0) {
+        MetricsStaticGauge("zcash.numa.node", nNumaNode);
+    }
 
     if ((chainparams.NetworkIDString() != "regtest") &&
             GetBoolArg("-showmetrics", isatty(STDOUT_FILENO)) &&
@@ -1545,8 +1782,10 @@ bool AppInit2(boost::thread_group& threadGroup, CScheduler& scheduler)
         );
     }
 
-    // Initialize Zcash circuit parameters
-    ZC_LoadParams(chainparams);
+    // Initialize Zcash circuit parameters. Nothing needs them until blocks
+    // are connected, so they are loaded while the databases are opened and
+    // the block index is loaded. Returning early waits for them.
+    auto loadParams = std::async(std::launch::async, ZC_LoadParams, std::cref(chainparams));
 
     /* Start the RPC server already.  It will be started in "warmup" mode
      * and not really process calls already (but it will signify connections
@@ -1556,6 +1795,9 @@ bool AppInit2(boost::thread_group& threadGroup, CScheduler& scheduler)
     if (fServer)
     {
         uiInterface.InitMessage.connect(SetRPCWarmupStatus);
+        std::string strLimitError;
+        if (!SetRPCMethodLimits(mapMultiArgs["-rpcmethodlimit"], strLimitError))
+            return InitError(strLimitError);
         if (!AppInitServers(threadGroup))
             return InitError(strprintf(_("Unable to start HTTP server. See %s for details."), GetDebugLogPath()));
     }
@@ -1708,6 +1950,18 @@ bool AppInit2(boost::thread_group& threadGroup, CScheduler& scheduler)
     bool fReindexChainState = GetBoolArg("-reindex-chainstate", false);
 
     fs::create_directories(GetDataDir() / "blocks");
+    if (fExperimentalInsightExplorer || fExperimentalLightWalletd) {
+        fs::create_directories(GetDataDir() / "indexes");
+    }
+    if (!setBlockFilterTypes.empty()) {
+        fs::create_directories(GetDataDir() / "indexes" / "blockfilter");
+    }
+    if (GetBoolArg("-txlocationindex", DEFAULT_TXLOCATIONINDEX)) {
+        fs::create_directories(GetDataDir() / "indexes" / "txlocation");
+    }
+    if (GetBoolArg("-shieldedblockindex", DEFAULT_SHIELDEDBLOCKINDEX)) {
+        fs::create_directories(GetDataDir() / "indexes" / "shieldedblock");
+    }
 
     // cache size calculations
     int64_t nTotalCache = (GetArg("-dbcache", nDefaultDbCache) << 20);
@@ -1716,6 +1970,8 @@ bool AppInit2(boost::thread_group& threadGroup, CScheduler& scheduler)
     int64_t nBlockTreeDBCache = nTotalCache / 8;
     if (nBlockTreeDBCache > (1 << 21) && !GetBoolArg("-txindex", DEFAULT_TXINDEX))
         nBlockTreeDBCache = (1 << 21); // block tree db cache shouldn't be larger than 2 MiB
+    // the address, spent and timestamp indexes have their own database
+    int64_t nInsightDBCache = 0;
 
     // https://github.com/bitpay/bitcoin/commit/c91d78b578a8700a45be936cb5bb0931df8f4b87#diff-c865a8939105e6350a50af02766291b7R1233
     if (GetBoolArg("-insightexplorer", false)) {
@@ -1723,20 +1979,66 @@ bool AppInit2(boost::thread_group& threadGroup, CScheduler& scheduler)
             return InitError(_("-insightexplorer requires -txindex."));
         }
         // increase cache if additional indices are needed
-        nBlockTreeDBCache = nTotalCache * 3 / 4;
-    }
-    nTotalCache -= nBlockTreeDBCache;
+        nInsightDBCache = nTotalCache * 3 / 4 - nBlockTreeDBCache;
+    } else if (GetBoolArg("-lightwalletd", false)) {
+        nInsightDBCache = nTotalCache / 8;
+    }
+    // each block filter index has its own database too
+    int64_t nBlockFilterDBCache = 0;
+    if (!setBlockFilterTypes.empty()) {
+        nBlockFilterDBCache = std::min<int64_t>(nTotalCache / 8, MAX_BLOCK_FILTER_DB_CACHE << 20) / setBlockFilterTypes.size();
+    }
+    // and so does the transaction location index
+    int64_t nTxLocationDBCache = 0;
+    if (GetBoolArg("-txlocationindex", DEFAULT_TXLOCATIONINDEX)) {
+        nTxLocationDBCache = std::min<int64_t>(nTotalCache / 8, MAX_TX_LOCATION_DB_CACHE << 20);
+    }
+    // and the shielded compact block index
+    int64_t nShieldedBlockDBCache = 0;
+    if (GetBoolArg("-shieldedblockindex", DEFAULT_SHIELDEDBLOCKINDEX)) {
+        nShieldedBlockDBCache = std::min<int64_t>(nTotalCache / 8, MAX_SHIELDED_BLOCK_DB_CACHE << 20);
+    }
+    nTotalCache -= nBlockTreeDBCache + nInsightDBCache + nBlockFilterDBCache * setBlockFilterTypes.size() + nTxLocationDBCache + nShieldedBlockDBCache;
     int64_t nCoinDBCache = std::min(nTotalCache / 2, (nTotalCache / 4) + (1 << 23)); // use 25%-50% of the remainder for disk cache
     nTotalCache -= nCoinDBCache;
     nCoinCacheUsage = nTotalCache; // the rest goes to in-memory cache
+    int64_t nBlockReadCache = GetArg("-blockreadcache", DEFAULT_BLOCK_READ_CACHE);
+    if (nBlockReadCache < 0) {
+        return InitError(_("-blockreadcache must not be negative."));
+    }
+    blockReader.SetMaxCacheUsage(nBlockReadCache << 20);
     LogPrintf("Cache configuration:\n");
     LogPrintf("* Using %.1fMiB for block index database\n", nBlockTreeDBCache * (1.0 / 1024 / 1024));
+    if (nInsightDBCache > 0) {
+        LogPrintf("* Using %.1fMiB for insight explorer index database\n", nInsightDBCache * (1.0 / 1024 / 1024));
+    }
+    for (BlockFilterType filterType : setBlockFilterTypes) {
+        LogPrintf("* Using %.1fMiB for %s block filter index database\n", nBlockFilterDBCache * (1.0 / 1024 / 1024), BlockFilterTypeName(filterType));
+    }
+    if (nTxLocationDBCache > 0) {
+        LogPrintf("* Using %.1fMiB for transaction location index database\n", nTxLocationDBCache * (1.0 / 1024 / 1024));
+    }
+    if (nShieldedBlockDBCache > 0) {
+        LogPrintf("* Using %.1fMiB for shielded compact block index database\n", nShieldedBlockDBCache * (1.0 / 1024 / 1024));
+    }
     LogPrintf("* Using %.1fMiB for chain state database\n", nCoinDBCache * (1.0 / 1024 / 1024));
     LogPrintf("* Using %.1fMiB for in-memory UTXO set\n", nCoinCacheUsage * (1.0 / 1024 / 1024));
+    LogPrintf("* Using %.1fMiB for recently read blocks\n", nBlockReadCache * 1.0);
+
+    CDBOptions dbOptions;
+    dbOptions.nBloomBitsPerKey = GetArg("-dbbloombits", DEFAULT_DB_BLOOM_BITS);
+    if (dbOptions.nBloomBitsPerKey < 0) {
+        return InitError(_("-dbbloombits must not be negative."));
+    }
+    dbOptions.nBlockCachePercent = GetArg("-dbblockcachepercent", DEFAULT_DB_BLOCK_CACHE_PERCENT);
+    if (dbOptions.nBlockCachePercent < MIN_DB_BLOCK_CACHE_PERCENT || dbOptions.nBlockCachePercent > MAX_DB_BLOCK_CACHE_PERCENT) {
+        return InitError(strprintf(_("-dbblockcachepercent must be between %d and %d."), MIN_DB_BLOCK_CACHE_PERCENT, MAX_DB_BLOCK_CACHE_PERCENT));
+    }
 
     bool clearWitnessCaches = false;
 
     bool fLoaded = false;
+    bool fBulkLoadChainState = false;
     while (!fLoaded) {
         bool fReset = fReindex;
         std::string strLoadError;
@@ -1748,14 +2050,47 @@ bool AppInit2(boost::thread_group& threadGroup, CScheduler& scheduler)
             try {
                 UnloadBlockIndex();
                 delete pcoinsTip;
+                delete pcoinswriter;
+                pcoinswriter = NULL;
                 delete pcoinsdbview;
                 delete pcoinscatcher;
                 delete pblocktree;
-
-                pblocktree = new CBlockTreeDB(nBlockTreeDBCache, false, fReindex);
-                pcoinsdbview = new CCoinsViewDB(nCoinDBCache, false, fReindex || fReindexChainState);
+                delete pinsightdb;
+                pinsightdb = NULL;
+
+                // Databases that are about to be written from scratch are
+                // opened with the initial block download profile.
+                CDBOptions blockTreeDBOptions = dbOptions;
+                blockTreeDBOptions.fBulkLoad = fReindex || !fs::exists(GetDataDir() / "blocks" / "index");
+                CDBOptions coinsDBOptions = dbOptions;
+                fBulkLoadChainState = fReindex || fReindexChainState || !fs::exists(GetDataDir() / "chainstate");
+                coinsDBOptions.fBulkLoad = fBulkLoadChainState;
+
+                pblocktree = new CBlockTreeDB(nBlockTreeDBCache, false, fReindex, blockTreeDBOptions);
+                if (fExperimentalInsightExplorer || fExperimentalLightWalletd) {
+                    pinsightdb = new CInsightIndexDB(nInsightDBCache, false, fReindex, dbOptions);
+                }
+                pcoinsdbview = new CCoinsViewDB(nCoinDBCache, false, fReindex || fReindexChainState, coinsDBOptions);
                 pcoinscatcher = new CCoinsViewErrorCatcher(pcoinsdbview);
-                pcoinsTip = new CCoinsViewCache(pcoinscatcher);
+
+                // If necessary, upgrade from older database format.
+                if (!pcoinsdbview->Upgrade()) {
+                    strLoadError = _("Error upgrading chainstate database");
+                    break;
+                }
+
+                if (GetBoolArg("-nullifierfilter", DEFAULT_NULLIFIER_FILTER)) {
+                    uiInterface.InitMessage(_("Loading nullifier filter..."));
+                    pcoinsdbview->LoadNullifierFilter();
+                }
+
+                if (GetBoolArg("-dbasyncflush", DEFAULT_DB_ASYNC_FLUSH)) {
+                    pcoinswriter = new CCoinsViewAsyncWriter(pcoinscatcher);
+                    pcoinsTip = new CCoinsViewCache(pcoinswriter);
+                } else {
+                    pcoinsTip = new CCoinsViewCache(pcoinscatcher);
+                }
+                coinsSnapshots.Reset(pcoinsTip->GetBackend(), NULL);
 
                 if (fReindex) {
                     pblocktree->WriteReindexing(true);
@@ -1774,6 +2109,12 @@ bool AppInit2(boost::thread_group& threadGroup, CScheduler& scheduler)
                 if (!mapBlockIndex.empty() && mapBlockIndex.count(chainparams.GetConsensus().hashGenesisBlock) == 0)
                     return InitError(_("Incorrect or no genesis block found. Wrong datadir for network?"));
 
+                // Connecting the genesis block, and every block after it,
+                // needs the circuit parameters.
+                if (loadParams.valid()) {
+                    loadParams.get();
+                }
+
                 // Initialize the block index (no-op if non-empty database was already loaded)
                 if (!InitBlockIndex(chainparams)) {
                     strLoadError = _("Error initializing block database");
@@ -1804,6 +2145,19 @@ bool AppInit2(boost::thread_group& threadGroup, CScheduler& scheduler)
                     break;
                 }
 
+                // Earlier versions kept the insight explorer indexes in the
+                // block index database.
+                if (pinsightdb && !pinsightdb->MigrateFrom(*pblocktree)) {
+                    strLoadError = _("Error moving the insight explorer indexes to their own database");
+                    break;
+                }
+
+                // Earlier versions did not keep address summaries.
+                if (pinsightdb && fAddressIndex && !pinsightdb->BuildAddressSummaries()) {
+                    strLoadError = _("Error building the address summaries of the address index");
+                    break;
+                }
+
                 // Check for changed -prune state.  What we are concerned about is a user who has pruned blocks
                 // in the past, but is now trying to run unpruned.
                 if (fHavePruned && !fPruneMode) {
@@ -1921,6 +2275,46 @@ bool AppInit2(boost::thread_group& threadGroup, CScheduler& scheduler)
     }
     LogPrintf(" block index %15dms\n", GetTimeMillis() - nStart);
 
+    if (GetBoolArg("-txoutsetstats", DEFAULT_TXOUTSET_STATS)) {
+        LOCK(cs_main);
+        ptxoutsetstats = new CTxOutSetStatsIndex(*pblocktree, *pcoinsdbview);
+        ptxoutsetstats->Init(chainActive.Tip());
+    }
+
+    for (BlockFilterType filterType : setBlockFilterTypes) {
+        LOCK(cs_main);
+        CBlockFilterIndex* filterIndex = new CBlockFilterIndex(filterType, nBlockFilterDBCache, false, fReindex, dbOptions);
+        mapBlockFilterIndexes[filterType] = filterIndex;
+        filterIndex->Init();
+    }
+
+    if (GetBoolArg("-txlocationindex", DEFAULT_TXLOCATIONINDEX)) {
+        LOCK(cs_main);
+        ptxlocationindex = new CTxLocationIndex(nTxLocationDBCache, false, fReindex, dbOptions);
+        ptxlocationindex->Init();
+    }
+
+    if (GetBoolArg("-shieldedblockindex", DEFAULT_SHIELDEDBLOCKINDEX)) {
+        LOCK(cs_main);
+        pshieldedblockindex = new CShieldedBlockIndex(nShieldedBlockDBCache, false, fReindex, dbOptions);
+        pshieldedblockindex->Init();
+    }
+
+    if (GetBoolArg("-dbcompactafteribd", DEFAULT_DB_COMPACT_AFTER_IBD)) {
+        pdbcompactor = new CDBCompactor({
+            {"chainstate", &pcoinsdbview->GetDB()},
+            {"blockindex", pblocktree},
+        }, fBulkLoadChainState);
+        pdbcompactor->Start();
+    }
+
+    {
+        // From here on, gettxout and getutxos can answer without cs_main.
+        LOCK(cs_main);
+        BlockMap::iterator mi = mapBlockIndex.find(pcoinsTip->GetBestBlock());
+        coinsSnapshots.Publish(mi == mapBlockIndex.end() ? NULL : mi->second);
+    }
+
     // ********************************************************* Step 8: load wallet
 #ifdef ENABLE_WALLET
     if (fDisableWallet) {
@@ -2075,6 +2469,19 @@ bool AppInit2(boost::thread_group& threadGroup, CScheduler& scheduler)
     if (GetBoolArg("-listenonion", DEFAULT_LISTEN_ONION))
         StartTorControl(threadGroup, scheduler);
 
+    int nTxAcceptThreads = std::min((int)GetArg("-txacceptthreads", DEFAULT_TX_ACCEPT_THREADS), GetNumCores());
+    nTxAcceptThreads = std::max(0, std::min(nTxAcceptThreads, MAX_TX_ACCEPT_THREADS));
+    LogPrintf("Using %u threads to check transactions from peers\n", nTxAcceptThreads);
+    StartTxAcceptThreads(nTxAcceptThreads);
+
+    // Keep a block template up to date for getblocktemplate.
+    pcandidateblock = new CandidateBlockBuilder(chainparams);
+    pcandidateblock->Start();
+
+    // Keep the recent mempool changes for getmempoolchanges.
+    pmempoolfeed = new CMempoolFeed(std::max<int64_t>(1, GetArg("-mempoolfeedsize", DEFAULT_MEMPOOL_FEED_SIZE)));
+    pmempoolfeed->Start();
+
     StartNode(threadGroup, scheduler);
 
 #ifdef ENABLE_MINING
@@ -6,10 +6,59 @@
 
 #include "keystore.h"
 
+#include "hash.h"
 #include "key.h"
 #include "pubkey.h"
+#include "random.h"
+#include "streams.h"
 #include "util/system.h"
+#include "version.h"
 
+std::optional<ReceiverIndexKey> GetReceiverIndexKey(const libzcash::Receiver& receiver)
+{
+    ReceiverIndexKey key{};
+    bool known = examine(receiver, match {
+        [&](const CKeyID& keyId) {
+            key[0] = 0x00;
+            std::copy(keyId.begin(), keyId.end(), key.begin() + 1);
+            return true;
+        },
+        [&](const CScriptID& scriptId) {
+            key[0] = 0x01;
+            std::copy(scriptId.begin(), scriptId.end(), key.begin() + 1);
+            return true;
+        },
+        [&](const libzcash::SaplingPaymentAddress& addr) {
+            key[0] = 0x02;
+            std::copy(addr.d.begin(), addr.d.end(), key.begin() + 1);
+            std::copy(addr.pk_d.begin(), addr.pk_d.end(), key.begin() + 1 + addr.d.size());
+            return true;
+        },
+        [&](const libzcash::OrchardRawAddress& addr) {
+            CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
+            ss << addr;
+            assert(ss.size() == key.size() - 1);
+            key[0] = 0x03;
+            std::copy(ss.begin(), ss.end(), key.begin() + 1);
+            return true;
+        },
+        [&](const libzcash::UnknownReceiver&) {
+            return false;
+        }
+    });
+    if (known) {
+        return key;
+    } else {
+        return std::nullopt;
+    }
+}
+
+SaltedReceiverHasher::SaltedReceiverHasher() : k0(GetRand(std::numeric_limits<uint64_t>::max())), k1(GetRand(std::numeric_limits<uint64_t>::max())) {}
+
+size_t SaltedReceiverHasher::operator()(const ReceiverIndexKey& key) const
+{
+    return CSipHasher(k0, k1).Write(key.data(), key.size()).Finalize();
+}
 
 bool CKeyStore::AddKey(const CKey &key) {
     return AddKeyPubKey(key, key.GetPubKey());
@@ -357,27 +406,20 @@ bool CBasicKeyStore::AddUnifiedFullViewingKey(
     return true;
 }
 
-bool CBasicKeyStore::AddTransparentReceiverForUnifiedAddress(
+bool CBasicKeyStore::AddReceiversForUnifiedAddress(
         const libzcash::UFVKId& keyId,
         const libzcash::diversifier_index_t& diversifierIndex,
         const libzcash::UnifiedAddress& ua)
 {
     LOCK(cs_KeyStore);
 
-    // It's only necessary to add p2pkh and p2sh components of
-    // the UA; all other lookups of the associated UFVK will be
-    // made via the protocol-specific viewing key that is used
-    // to trial-decrypt a transaction.
-    auto addrEntry = std::make_pair(keyId, diversifierIndex);
-
-    auto p2pkhReceiver = ua.GetP2PKHReceiver();
-    if (p2pkhReceiver.has_value()) {
-        mapP2PKHUnified.insert(std::make_pair(p2pkhReceiver.value(), addrEntry));
-    }
-
-    auto p2shReceiver = ua.GetP2SHReceiver();
-    if (p2shReceiver.has_value()) {
-        mapP2SHUnified.insert(std::make_pair(p2shReceiver.value(), addrEntry));
+    // We never generate unified addresses with internal receivers.
+    AddressUFVKMetadata addrEntry(keyId, diversifierIndex, true);
+    for (const auto& receiver : ua) {
+        auto key = GetReceiverIndexKey(receiver);
+        if (key.has_value()) {
+            mapReceiverUnified.insert({key.value(), addrEntry});
+        }
     }
 
     return true;
@@ -397,6 +439,18 @@ std::optional<libzcash::ZcashdUnifiedFullViewingKey> CBasicKeyStore::GetUnifiedF
 std::optional<AddressUFVKMetadata>
 CBasicKeyStore::GetUFVKMetadataForReceiver(const libzcash::Receiver& receiver) const
 {
+    LOCK(cs_KeyStore);
+
+    // Receivers of the unified addresses we have generated are found with a
+    // single lookup, whatever their type.
+    auto key = GetReceiverIndexKey(receiver);
+    if (key.has_value()) {
+        auto it = mapReceiverUnified.find(key.value());
+        if (it != mapReceiverUnified.end()) {
+            return it->second;
+        }
+    }
+
     return std::visit(FindUFVKId(*this), receiver);
 }
 
@@ -516,24 +570,12 @@ std::optional<AddressUFVKMetadata> FindUFVKId::operator()(const libzcash::Saplin
     return std::nullopt;
 }
 std::optional<AddressUFVKMetadata> FindUFVKId::operator()(const CScriptID& scriptId) const {
-    const auto metadata = keystore.mapP2SHUnified.find(scriptId);
-    if (metadata != keystore.mapP2SHUnified.end()) {
-        // At present we never generate transparent internal addresses, so this
-        // must be an external address
-        return AddressUFVKMetadata(metadata->second.first, metadata->second.second, true);
-    } else {
-        return std::nullopt;
-    }
+    // Transparent receivers are only known through the receiver index.
+    return std::nullopt;
 }
 std::optional<AddressUFVKMetadata> FindUFVKId::operator()(const CKeyID& keyId) const {
-    const auto metadata = keystore.mapP2PKHUnified.find(keyId);
-    if (metadata != keystore.mapP2PKHUnified.end()) {
-        // At present we never generate transparent internal addresses, so this
-        // must be an external address
-        return AddressUFVKMetadata(metadata->second.first, metadata->second.second, true);
-    } else {
-        return std::nullopt;
-    }
+    // Transparent receivers are only known through the receiver index.
+    return std::nullopt;
 }
 std::optional<AddressUFVKMetadata> FindUFVKId::operator()(const libzcash::UnknownReceiver& receiver) const {
     return std::nullopt;
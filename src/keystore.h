@@ -17,6 +17,9 @@
 #include "zcash/Address.hpp"
 #include "zcash/NoteEncryption.hpp"
 
+#include <array>
+#include <unordered_map>
+
 #include <boost/signals2/signal.hpp>
 
 class AddressUFVKMetadata {
@@ -33,6 +36,27 @@ public:
     bool IsExternalAddress() const { return externalAddress; }
 };
 
+/**
+ * The type of a receiver followed by its encoding, zero-padded. Receivers of
+ * the unified addresses in a keystore are indexed by this key.
+ */
+typedef std::array<unsigned char, 44> ReceiverIndexKey;
+
+/** The index key of a receiver, or nullopt for an unknown receiver. */
+std::optional<ReceiverIndexKey> GetReceiverIndexKey(const libzcash::Receiver& receiver);
+
+class SaltedReceiverHasher
+{
+private:
+    /** Salt */
+    const uint64_t k0, k1;
+
+public:
+    SaltedReceiverHasher();
+
+    size_t operator()(const ReceiverIndexKey& key) const;
+};
+
 /** A virtual base class for key stores */
 class CKeyStore
 {
@@ -125,16 +149,14 @@ public:
             ) = 0;
 
     /**
-     * Add the transparent component of the unified address, if any,
-     * to the keystore to make it possible to identify the unified
-     * full viewing key from which a transparent address was derived.
-     * It is not necessary for implementations to add shielded address
-     * components to the keystore because those will be automatically
-     * reconstructed when scanning the chain with a shielded incoming
-     * viewing key upon discovery of the address as having received
-     * funds.
+     * Add the receivers of the unified address to the keystore to make it
+     * possible to identify the unified full viewing key and diversifier
+     * index from which a receiver was derived. This is required for the
+     * transparent components of the address; for shielded components it
+     * avoids trial-decrypting the diversifier with every unified full
+     * viewing key in the keystore.
      */
-    virtual bool AddTransparentReceiverForUnifiedAddress(
+    virtual bool AddReceiversForUnifiedAddress(
         const libzcash::UFVKId& keyId,
         const libzcash::diversifier_index_t& diversifierIndex,
         const libzcash::UnifiedAddress& ua) = 0;
@@ -202,8 +224,7 @@ protected:
     SaplingIncomingViewingKeyMap mapSaplingIncomingViewingKeys;
 
     // Unified key support
-    std::map<CKeyID, std::pair<libzcash::UFVKId, libzcash::diversifier_index_t>> mapP2PKHUnified;
-    std::map<CScriptID, std::pair<libzcash::UFVKId, libzcash::diversifier_index_t>> mapP2SHUnified;
+    std::unordered_map<ReceiverIndexKey, AddressUFVKMetadata, SaltedReceiverHasher> mapReceiverUnified;
     std::map<libzcash::SaplingIncomingViewingKey, libzcash::UFVKId> mapSaplingKeyUnified;
     std::map<libzcash::OrchardIncomingViewingKey, libzcash::UFVKId> mapOrchardKeyUnified;
     std::map<libzcash::UFVKId, libzcash::ZcashdUnifiedFullViewingKey> mapUnifiedFullViewingKeys;
@@ -386,7 +407,7 @@ public:
     virtual bool AddUnifiedFullViewingKey(
             const libzcash::ZcashdUnifiedFullViewingKey &ufvk);
 
-    virtual bool AddTransparentReceiverForUnifiedAddress(
+    virtual bool AddReceiversForUnifiedAddress(
         const libzcash::UFVKId& keyId,
         const libzcash::diversifier_index_t& diversifierIndex,
         const libzcash::UnifiedAddress& ua);
@@ -18,6 +18,8 @@
 static const bool DEFAULT_LOGTIMEMICROS = false;
 static const bool DEFAULT_LOGIPS        = false;
 static const bool DEFAULT_LOGTIMESTAMPS = true;
+//! -logratelimit default: no limit on debug messages per second
+static const unsigned int DEFAULT_LOGRATELIMIT = 0;
 extern const char * const DEFAULT_DEBUGLOGFILE;
 
 extern bool fPrintToConsole;
@@ -39,12 +41,25 @@ bool LogAcceptCategory(const char* category);
 /** Print to debug log with level DEBUG. */
 #define LogPrint(category, ...) LogPrintInner("debug", category, __VA_ARGS__)
 
-#define LogPrintInner(level, category, ...) do {           \
-    std::string T_MSG = tfm::format(__VA_ARGS__);          \
-    if (!T_MSG.empty() && T_MSG[T_MSG.size()-1] == '\n') { \
-        T_MSG.erase(T_MSG.size()-1);                       \
-    }                                                      \
-    TracingLog(level, category, T_MSG.c_str());            \
+/**
+ * The message is only formatted if the category and level are enabled and
+ * the -logratelimit has not been reached, so that disabled log lines cost
+ * little more than a load. Formatted messages are written to debug.log by
+ * a background thread.
+ */
+#define LogPrintInner(level, category, ...) do {                    \
+    static constexpr const char* const T_LOG_FIELDS[] = {"message"}; \
+    static TracingCallsite* T_LOG_CALLSITE = T_CALLSITE(            \
+        "event " __FILE__ ":" T_ESCAPEQUOTE(__LINE__),              \
+        category, level, T_LOG_FIELDS, false);                      \
+    if (tracing_event_enabled(T_LOG_CALLSITE)) {                    \
+        std::string T_MSG = tfm::format(__VA_ARGS__);               \
+        if (!T_MSG.empty() && T_MSG[T_MSG.size()-1] == '\n') {      \
+            T_MSG.erase(T_MSG.size()-1);                            \
+        }                                                           \
+        const char* T_VALUES[] = {T_MSG.c_str()};                   \
+        tracing_log(T_LOG_CALLSITE, T_VALUES, 1);                   \
+    }                                                               \
 } while(0)
 
 #define LogError(category, ...) ([&]() {          \
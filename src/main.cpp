@@ -9,16 +9,28 @@
 #include "addrman.h"
 #include "alert.h"
 #include "arith_uint256.h"
+#include "blockencodings.h"
+#include "blockcompression.h"
+#include "blockfilterindex.h"
+#include "blockindexsnapshot.h"
+#include "blockreader.h"
 #include "chainparams.h"
+#include "chainstats.h"
 #include "checkpoints.h"
 #include "checkqueue.h"
+#include "coinssnapshot.h"
+#include "coinstats.h"
 #include "consensus/consensus.h"
 #include "consensus/funding.h"
 #include "consensus/merkle.h"
 #include "consensus/upgrades.h"
 #include "consensus/validation.h"
+#include "core_memusage.h"
+#include "crypto/sha256.h"
+#include "cuckoocache.h"
 #include "deprecation.h"
 #include "experimental_features.h"
+#include "filteredblockcache.h"
 #include "init.h"
 #include "key_io.h"
 #include "merkleblock.h"
@@ -27,21 +39,33 @@
 #include "policy/policy.h"
 #include "pow.h"
 #include "reverse_iterator.h"
+#include "shieldedblockindex.h"
+#include "support/allocators/pool.h"
+#include "syncstats.h"
 #include "time.h"
+#include "txlocationindex.h"
 #include "txmempool.h"
+#include "txrejectcache.h"
 #include "ui_interface.h"
 #include "undo.h"
+#include "util/allocator.h"
 #include "util/system.h"
 #include "util/moneystr.h"
 #include "validationinterface.h"
 #include "wallet/asyncrpcoperation_sendmany.h"
 #include "wallet/asyncrpcoperation_shieldcoinbase.h"
 #include "warnings.h"
+#include "zcash/cache.h"
 #include "zip317.h"
 
 #include <algorithm>
 #include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <optional>
 #include <sstream>
+#include <thread>
 #include <variant>
 
 #include <boost/algorithm/string/replace.hpp>
@@ -78,6 +102,7 @@ using namespace std;
 RecursiveMutex cs_main;
 
 BlockMap mapBlockIndex;
+std::set<CBlockIndex*> setChainTips;
 CChain chainActive;
 CBlockIndex *pindexBestHeader = NULL;
 static std::atomic<int64_t> nTimeBestReceived(0); // Used only to inform the wallet of when we last received a block
@@ -97,10 +122,17 @@ bool fPruneMode = false;
 int32_t nPreferredTxVersion = DEFAULT_PREFERRED_TX_VERSION;
 bool fIsBareMultisigStd = DEFAULT_PERMIT_BAREMULTISIG;
 bool fCheckBlockIndex = false;
+bool fCheckBlockReads = DEFAULT_CHECK_BLOCK_READS;
 bool fCheckpointsEnabled = DEFAULT_CHECKPOINTS_ENABLED;
 bool fIBDSkipTxVerification = DEFAULT_IBD_SKIP_TX_VERIFICATION;
+unsigned int nBlockFileChunkSize = BLOCKFILE_CHUNK_SIZE;
+unsigned int nUndoFileChunkSize = UNDOFILE_CHUNK_SIZE;
+bool fFastHeaderSync = DEFAULT_FAST_HEADER_SYNC;
+int nIBDProofWindow = DEFAULT_IBD_PROOF_WINDOW;
+uint256 hashAssumeValid;
 bool fCoinbaseEnforcedShieldingEnabled = true;
 size_t nCoinCacheUsage = 5000 * 300;
+bool fPurgeAllocator = DEFAULT_MALLOC_PURGE;
 uint64_t nPruneTarget = 0;
 int64_t nMaxTipAge = DEFAULT_MAX_TIP_AGE;
 
@@ -123,13 +155,26 @@ struct IteratorComparator
 };
 
 struct COrphanTx {
-    CTransaction tx;
+    CTransactionRef tx;
     NodeId fromPeer;
     int64_t nTimeExpire;
+    //! The memory used by the transaction, which the orphan pool is limited by.
+    size_t nUsage;
 };
-map<uint256, COrphanTx> mapOrphanTransactions GUARDED_BY(cs_main);
-map<COutPoint, set<map<uint256, COrphanTx>::iterator, IteratorComparator>> mapOrphanTransactionsByPrev GUARDED_BY(cs_main);
-void EraseOrphansFor(NodeId peer) EXCLUSIVE_LOCKS_REQUIRED(cs_main);
+/** Guards the orphan pool, so that it can be used without cs_main. When both
+ *  are needed, cs_main must be locked first. */
+RecursiveMutex g_cs_orphans;
+map<uint256, COrphanTx> mapOrphanTransactions GUARDED_BY(g_cs_orphans);
+boost::unordered_map<COutPoint, set<map<uint256, COrphanTx>::iterator, IteratorComparator>, SaltedOutpointHasher> mapOrphanTransactionsByPrev GUARDED_BY(g_cs_orphans);
+
+/** The orphan transactions received from a peer. */
+struct COrphanPeer {
+    set<uint256> setOrphans;
+    size_t nUsage = 0;
+};
+map<NodeId, COrphanPeer> mapOrphanPeers GUARDED_BY(g_cs_orphans);
+size_t nOrphanTxUsage GUARDED_BY(g_cs_orphans) = 0;
+void EraseOrphansFor(NodeId peer);
 
 /**
  * Returns true if there are nRequired or more blocks of minVersion or above
@@ -277,6 +322,55 @@ namespace {
      */
     boost::scoped_ptr<CRollingBloomFilter> recentRejects;
     uint256 hashRecentRejectsChainTip;
+    static const unsigned int RECENT_REJECTS_ENTRIES = 120000;
+
+    /**
+     * Statistics of recentRejects, of which nEntries counts the insertions
+     * since it was last reset, up to the number of entries it is sized for.
+     * Protected by cs_main.
+     */
+    CCacheStats recentRejectsStats;
+
+    /**
+     * Transactions that were rejected whatever the chain tip and the mempool,
+     * which are kept across tip changes. Created by InitBlockIndex.
+     */
+    std::unique_ptr<CTxRejectCache> txRejectCache;
+
+    /** The consensus branch ID that transactions are accepted to the mempool under. */
+    uint32_t MemPoolBranchId() EXCLUSIVE_LOCKS_REQUIRED(cs_main)
+    {
+        return CurrentEpochBranchId(chainActive.Height() + 1, Params().GetConsensus());
+    }
+
+    /**
+     * Add a transaction that was not accepted to the mempool to the filter of
+     * recent rejects and, if the state shows it to be invalid whatever the
+     * chain tip, to txRejectCache.
+     */
+    void InsertRecentReject(const CTransaction& tx, const CValidationState& state) EXCLUSIVE_LOCKS_REQUIRED(cs_main)
+    {
+        const std::vector<unsigned char> vKey = tx.GetWTxId().ToBytes();
+        recentRejects->insert(vKey);
+        recentRejectsStats.nInsertions++;
+        if (recentRejectsStats.nEntries < RECENT_REJECTS_ENTRIES) {
+            recentRejectsStats.nEntries++;
+        } else {
+            recentRejectsStats.nEvictions++;
+        }
+
+        // The rules that depend on the chain tip assign mempool transactions
+        // a DoS score below 100, and so do the policy rules, so a score of 100
+        // means that a check of the transaction itself, or of its proofs or
+        // signatures against the coins it spends, failed.
+        int nDoS = 0;
+        if (state.IsInvalid(nDoS) && nDoS >= 100 && !state.CorruptionPossible()) {
+            txRejectCache->Add(vKey, state.GetRejectCode(), MemPoolBranchId());
+        }
+    }
+
+    /** Transactions from peers that ThreadTxAccept threads have yet to check. Protected by cs_main. */
+    std::set<uint256> setTxAcceptInFlight;
 
     /** Blocks that are in flight, and that are in the queue to be downloaded. Protected by cs_main. */
     struct QueuedBlock {
@@ -285,26 +379,34 @@ namespace {
         int64_t nTime;           //!< Time of "getdata" request in microseconds.
         bool fValidatedHeaders;  //!< Whether this block has validated headers at the time of request.
         int64_t nTimeDisconnect; //!< The timeout for this block request (for disconnecting a slow peer)
+        std::unique_ptr<PartiallyDownloadedBlock> partialBlock;  //!< Optional, used for cmpctblock downloads
     };
     map<uint256, pair<NodeId, list<QueuedBlock>::iterator> > mapBlocksInFlight;
 
+    /** Peers we have asked to announce new blocks with cmpctblock, least recently useful first. Protected by cs_main. */
+    std::list<NodeId> lNodesAnnouncingHeaderAndIDs;
+
+    /** The compact block of the last block announced with cmpctblock, shared by all peers it is sent to. Protected by cs_main. */
+    std::shared_ptr<const CBlockHeaderAndShortTxIDs> pMostRecentCompactBlock;
+    uint256 hashMostRecentCompactBlock;
+
     /** Number of blocks in flight with validated headers. */
     int nQueuedValidatedHeaders = 0;
 
+    /** Sum of the in-flight block limits of the peers that have delivered a block. Protected by cs_main. */
+    int nBlocksInFlightLimitTotal = 0;
+
     /** Number of preferable block download peers. */
     int nPreferredDownload = 0;
 
+    /** Number of outbound peers we reconcile transactions with but still flood them to. Protected by cs_main. */
+    int nTxReconFloodPeers = 0;
+
     /** Dirty block index entries. */
     set<CBlockIndex*> setDirtyBlockIndex;
 
     /** Dirty block file entries. */
     set<int> setDirtyFileInfo;
-
-    /** Relay map, protected by cs_main. */
-    typedef std::map<uint256, std::shared_ptr<const CTransaction>> MapRelay;
-    MapRelay mapRelay;
-    /** Expiration-time ordered list of (expire time, relay map entry) pairs, protected by cs_main). */
-    std::deque<std::pair<int64_t, MapRelay::iterator>> vRelayExpiration;
 } // anon namespace
 
 //////////////////////////////////////////////////////////////////////////////
@@ -352,8 +454,24 @@ struct CNodeState {
     list<QueuedBlock> vBlocksInFlight;
     int nBlocksInFlight;
     int nBlocksInFlightValidHeaders;
+    //! Number of blocks we may have in flight from this peer, adapted to how fast it delivers them.
+    int nBlocksInFlightLimit;
+    //! Moving average of the time between requesting a block and receiving it (in microseconds), or 0.
+    int64_t nBlockLatencyAvg;
     //! Whether we consider this a preferred download peer.
     bool fPreferredDownload;
+    //! Whether this peer wants new blocks announced with cmpctblock rather than inv.
+    bool fPreferHeaderAndIDs;
+    //! Whether this peer will send us cmpctblocks if we request them.
+    bool fProvidesHeaderAndIDs;
+    //! The best header we have sent our peer.
+    CBlockIndex *pindexBestHeaderSent;
+    //! Whether this peer wants new blocks announced with headers rather than inv.
+    bool fPreferHeaders;
+    //! Length of current-streak of unconnecting headers announcements.
+    int nUnconnectingHeaders;
+    //! Whether this peer counts towards nTxReconFloodPeers.
+    bool fTxReconFlood;
 
     CNodeState() {
         fCurrentlyConnected = false;
@@ -366,7 +484,15 @@ struct CNodeState {
         nStallingSince = 0;
         nBlocksInFlight = 0;
         nBlocksInFlightValidHeaders = 0;
+        nBlocksInFlightLimit = DEFAULT_BLOCKS_IN_TRANSIT_PER_PEER;
+        nBlockLatencyAvg = 0;
         fPreferredDownload = false;
+        fPreferHeaderAndIDs = false;
+        fProvidesHeaderAndIDs = false;
+        pindexBestHeaderSent = NULL;
+        fPreferHeaders = false;
+        nUnconnectingHeaders = 0;
+        fTxReconFlood = false;
     }
 };
 
@@ -425,16 +551,65 @@ void FinalizeNode(NodeId nodeid) {
         mapBlocksInFlight.erase(entry.hash);
     EraseOrphansFor(nodeid);
     nPreferredDownload -= state->fPreferredDownload;
+    nTxReconFloodPeers -= state->fTxReconFlood;
+    if (state->nBlockLatencyAvg != 0)
+        nBlocksInFlightLimitTotal -= state->nBlocksInFlightLimit;
+    lNodesAnnouncingHeaderAndIDs.remove(nodeid);
 
     mapNodeState.erase(nodeid);
 }
 
+/** Set the number of blocks we may have in flight from a peer. Requires cs_main. */
+void SetBlocksInFlightLimit(CNodeState* state, int nLimit)
+{
+    nLimit = std::max(MIN_BLOCKS_IN_TRANSIT_PER_PEER, std::min(nLimit, MAX_BLOCKS_IN_TRANSIT_PER_PEER));
+    if (state->nBlockLatencyAvg != 0)
+        nBlocksInFlightLimitTotal += nLimit - state->nBlocksInFlightLimit;
+    state->nBlocksInFlightLimit = nLimit;
+}
+
+/**
+ * Record that a peer delivered a block nLatency microseconds after we asked
+ * for it, and adjust the number of blocks we may have in flight from it.
+ * While its deliveries are faster than BLOCK_DOWNLOAD_TARGET_LATENCY and it
+ * has as many blocks in flight as we allow, the peer can take more; while
+ * they are slower, blocks are queueing up behind each other at the peer and
+ * would be better requested from someone else. This keeps the limit near the
+ * product of the peer's download rate and the target latency.
+ * Requires cs_main.
+ */
+void UpdateBlockDownloadLatency(CNodeState* state, int64_t nLatency)
+{
+    if (state->nBlockLatencyAvg == 0) {
+        state->nBlockLatencyAvg = std::max<int64_t>(nLatency, 1);
+        nBlocksInFlightLimitTotal += state->nBlocksInFlightLimit;
+    } else {
+        state->nBlockLatencyAvg = std::max<int64_t>((state->nBlockLatencyAvg * 7 + nLatency) / 8, 1);
+    }
+
+    if (state->nBlockLatencyAvg < BLOCK_DOWNLOAD_TARGET_LATENCY * 1000) {
+        if (state->nBlocksInFlight >= state->nBlocksInFlightLimit)
+            SetBlocksInFlightLimit(state, state->nBlocksInFlightLimit + 1);
+    } else {
+        SetBlocksInFlightLimit(state, state->nBlocksInFlightLimit - 1);
+    }
+}
+
+/** How far ahead of the last block we have in common with a peer we fetch. Requires cs_main. */
+int GetBlockDownloadWindow()
+{
+    return std::min<int>(MAX_BLOCK_DOWNLOAD_WINDOW, std::max<int>(BLOCK_DOWNLOAD_WINDOW, 2 * nBlocksInFlightLimitTotal));
+}
+
 // Requires cs_main.
-// Returns a bool indicating whether we requested this block.
-bool MarkBlockAsReceived(const uint256& hash) {
+// Returns a bool indicating whether we requested this block. If it was
+// requested from nodeFrom, the download latency of that peer is updated.
+bool MarkBlockAsReceived(const uint256& hash, NodeId nodeFrom = -1) {
     map<uint256, pair<NodeId, list<QueuedBlock>::iterator> >::iterator itInFlight = mapBlocksInFlight.find(hash);
     if (itInFlight != mapBlocksInFlight.end()) {
         CNodeState *state = State(itInFlight->second.first);
+        if (itInFlight->second.first == nodeFrom)
+            UpdateBlockDownloadLatency(state, GetTimeMicros() - itInFlight->second.second->nTime);
         nQueuedValidatedHeaders -= itInFlight->second.second->fValidatedHeaders;
         state->nBlocksInFlightValidHeaders -= itInFlight->second.second->fValidatedHeaders;
         state->vBlocksInFlight.erase(itInFlight->second.second);
@@ -447,23 +622,75 @@ bool MarkBlockAsReceived(const uint256& hash) {
 }
 
 // Requires cs_main.
-void MarkBlockAsInFlight(NodeId nodeid, const uint256& hash, const Consensus::Params& consensusParams, CBlockIndex *pindex = NULL) {
+// If pit is set, the entry gets a PartiallyDownloadedBlock and *pit is set to
+// point to it; in that case, returns false without changing anything if the
+// block is already in flight from the same peer. *pit is only valid as long
+// as cs_main is held.
+bool MarkBlockAsInFlight(NodeId nodeid, const uint256& hash, const Consensus::Params& consensusParams, CBlockIndex *pindex = NULL, list<QueuedBlock>::iterator **pit = NULL) {
     CNodeState *state = State(nodeid);
     assert(state != NULL);
 
+    // Short-circuit most stuff in case it is from the same node.
+    map<uint256, pair<NodeId, list<QueuedBlock>::iterator> >::iterator itInFlight = mapBlocksInFlight.find(hash);
+    if (pit && itInFlight != mapBlocksInFlight.end() && itInFlight->second.first == nodeid) {
+        *pit = &itInFlight->second.second;
+        return false;
+    }
+
     // Make sure it's not listed somewhere already.
     MarkBlockAsReceived(hash);
 
     int64_t nNow = GetTimeMicros();
     int nHeight = pindex != NULL ? pindex->nHeight : chainActive.Height(); // Help block timeout computation
-    QueuedBlock newentry = {hash, pindex, nNow, pindex != NULL, GetBlockTimeout(nNow, nQueuedValidatedHeaders, consensusParams, nHeight)};
+    QueuedBlock newentry = {hash, pindex, nNow, pindex != NULL, GetBlockTimeout(nNow, nQueuedValidatedHeaders, consensusParams, nHeight),
+                            std::unique_ptr<PartiallyDownloadedBlock>(pit ? new PartiallyDownloadedBlock(&mempool) : NULL)};
     nQueuedValidatedHeaders += newentry.fValidatedHeaders;
-    list<QueuedBlock>::iterator it = state->vBlocksInFlight.insert(state->vBlocksInFlight.end(), newentry);
+    list<QueuedBlock>::iterator it = state->vBlocksInFlight.insert(state->vBlocksInFlight.end(), std::move(newentry));
     state->nBlocksInFlight++;
-    state->nBlocksInFlightValidHeaders += newentry.fValidatedHeaders;
-    mapBlocksInFlight[hash] = std::make_pair(nodeid, it);
+    state->nBlocksInFlightValidHeaders += it->fValidatedHeaders;
+    itInFlight = mapBlocksInFlight.insert(std::make_pair(hash, std::make_pair(nodeid, it))).first;
+    if (pit)
+        *pit = &itInFlight->second.second;
+    return true;
+}
+
+/**
+ * Ask pfrom to announce new blocks with cmpctblock, since it was the first
+ * to give us a block. As in BIP 152, at most three peers are asked at a time;
+ * the one that least recently did so is told to go back to announcing with
+ * inv. Requires cs_main.
+ */
+void MaybeSetPeerAsAnnouncingHeaderAndIDs(const CNodeState* nodestate, CNode* pfrom) {
+    if (!nodestate->fProvidesHeaderAndIDs)
+        return;
+    for (std::list<NodeId>::iterator it = lNodesAnnouncingHeaderAndIDs.begin(); it != lNodesAnnouncingHeaderAndIDs.end(); it++) {
+        if (*it == pfrom->GetId()) {
+            lNodesAnnouncingHeaderAndIDs.erase(it);
+            lNodesAnnouncingHeaderAndIDs.push_back(pfrom->GetId());
+            return;
+        }
+    }
+    bool fAnnounceUsingCMPCTBLOCK = false;
+    uint64_t nCMPCTBLOCKVersion = 1;
+    if (lNodesAnnouncingHeaderAndIDs.size() >= 3) {
+        CNode* pnodeStop = FindNode(lNodesAnnouncingHeaderAndIDs.front());
+        if (pnodeStop)
+            pnodeStop->PushMessage("sendcmpct", fAnnounceUsingCMPCTBLOCK, nCMPCTBLOCKVersion);
+        lNodesAnnouncingHeaderAndIDs.pop_front();
+    }
+    fAnnounceUsingCMPCTBLOCK = true;
+    pfrom->PushMessage("sendcmpct", fAnnounceUsingCMPCTBLOCK, nCMPCTBLOCKVersion);
+    lNodesAnnouncingHeaderAndIDs.push_back(pfrom->GetId());
 }
 
+/** Whether the tip is recent enough that blocks should be fetched as they
+ *  are announced, rather than by the parallel download. Requires cs_main. */
+bool CanDirectFetch(const Consensus::Params& consensusParams)
+{
+    return chainActive.Tip()->GetBlockTime() > GetAdjustedTime() - consensusParams.PoWTargetSpacing(chainActive.Height()) * 20;
+}
+
+
 /** Check whether the last unknown block a peer advertized is not yet known. */
 void ProcessBlockAvailability(NodeId nodeid) {
     CNodeState *state = State(nodeid);
@@ -497,6 +724,17 @@ void UpdateBlockAvailability(NodeId nodeid, const uint256 &hash) {
     }
 }
 
+/** Whether the peer is known to have the header, because it announced it
+ *  or we sent it. Requires cs_main. */
+bool PeerHasHeader(const CNodeState *state, const CBlockIndex *pindex)
+{
+    if (state->pindexBestKnownBlock && pindex == state->pindexBestKnownBlock->GetAncestor(pindex->nHeight))
+        return true;
+    if (state->pindexBestHeaderSent && pindex == state->pindexBestHeaderSent->GetAncestor(pindex->nHeight))
+        return true;
+    return false;
+}
+
 /** Find the last common ancestor two blocks have.
  *  Both pa and pb must be non-NULL. */
 CBlockIndex* LastCommonAncestor(CBlockIndex* pa, CBlockIndex* pb) {
@@ -517,8 +755,9 @@ CBlockIndex* LastCommonAncestor(CBlockIndex* pa, CBlockIndex* pb) {
 }
 
 /** Update pindexLastCommonBlock and add not-in-flight missing successors to vBlocks, until it has
- *  at most count entries. */
-void FindNextBlocksToDownload(NodeId nodeid, unsigned int count, std::vector<CBlockIndex*>& vBlocks, NodeId& nodeStaller) {
+ *  at most count entries. If nothing can be fetched because the download window is held up by a block
+ *  in flight from another peer, nodeStaller and pindexStalling are set to that peer and block. */
+void FindNextBlocksToDownload(NodeId nodeid, unsigned int count, std::vector<CBlockIndex*>& vBlocks, NodeId& nodeStaller, CBlockIndex*& pindexStalling) {
     if (count == 0)
         return;
 
@@ -548,12 +787,13 @@ void FindNextBlocksToDownload(NodeId nodeid, unsigned int count, std::vector<CBl
 
     std::vector<CBlockIndex*> vToFetch;
     CBlockIndex *pindexWalk = state->pindexLastCommonBlock;
-    // Never fetch further than the best block we know the peer has, or more than BLOCK_DOWNLOAD_WINDOW + 1 beyond the last
+    // Never fetch further than the best block we know the peer has, or more than the download window + 1 beyond the last
     // linked block we have in common with this peer. The +1 is so we can detect stalling, namely if we would be able to
     // download that next block if the window were 1 larger.
-    int nWindowEnd = state->pindexLastCommonBlock->nHeight + BLOCK_DOWNLOAD_WINDOW;
+    int nWindowEnd = state->pindexLastCommonBlock->nHeight + GetBlockDownloadWindow();
     int nMaxHeight = std::min<int>(state->pindexBestKnownBlock->nHeight, nWindowEnd + 1);
     NodeId waitingfor = -1;
+    CBlockIndex* pindexWaitingFor = NULL;
     while (pindexWalk->nHeight < nMaxHeight) {
         // Read up to 128 (or more, if more blocks than that are needed) successors of pindexWalk (towards
         // pindexBestKnownBlock) into vToFetch. We fetch 128, because CBlockIndex::GetAncestor may be as expensive
@@ -585,6 +825,7 @@ void FindNextBlocksToDownload(NodeId nodeid, unsigned int count, std::vector<CBl
                     if (vBlocks.size() == 0 && waitingfor != nodeid) {
                         // We aren't able to fetch anything, but we would be if the download window was one larger.
                         nodeStaller = waitingfor;
+                        pindexStalling = pindexWaitingFor;
                     }
                     return;
                 }
@@ -595,6 +836,7 @@ void FindNextBlocksToDownload(NodeId nodeid, unsigned int count, std::vector<CBl
             } else if (waitingfor == -1) {
                 // This is the first already-in-flight block.
                 waitingfor = mapBlocksInFlight[pindex->GetBlockHash()].first;
+                pindexWaitingFor = pindex;
             }
         }
     }
@@ -602,6 +844,25 @@ void FindNextBlocksToDownload(NodeId nodeid, unsigned int count, std::vector<CBl
 
 } // anon namespace
 
+void GetBlockDownloadQueue(size_t& nInFlight, size_t& nInFlightLimit, size_t& nWaiting)
+{
+    AssertLockHeld(cs_main);
+    nInFlight = mapBlocksInFlight.size();
+    nInFlightLimit = std::max(nBlocksInFlightLimitTotal, 0);
+    nWaiting = 0;
+    const CBlockIndex* pindexTip = chainActive.Tip();
+    if (pindexBestHeader == NULL || pindexTip == NULL)
+        return;
+    int nEnd = std::min(pindexBestHeader->nHeight, pindexTip->nHeight + GetBlockDownloadWindow());
+    if (nEnd <= pindexTip->nHeight)
+        return;
+    for (const CBlockIndex* pindex = pindexBestHeader->GetAncestor(nEnd);
+         pindex && pindex->nHeight > pindexTip->nHeight; pindex = pindex->pprev) {
+        if (pindex->nStatus & BLOCK_HAVE_DATA)
+            nWaiting++;
+    }
+}
+
 bool GetNodeStateStats(NodeId nodeid, CNodeStateStats &stats) {
     LOCK(cs_main);
     CNodeState *state = State(nodeid);
@@ -614,6 +875,8 @@ bool GetNodeStateStats(NodeId nodeid, CNodeStateStats &stats) {
         if (queue.pindex)
             stats.vHeightInFlight.push_back(queue.pindex->nHeight);
     }
+    stats.nBlocksInFlightLimit = state->nBlocksInFlightLimit;
+    stats.nBlockLatencyAvg = state->nBlockLatencyAvg;
     return true;
 }
 
@@ -655,14 +918,18 @@ CBlockIndex* FindForkInGlobalIndex(const CChain& chain, const CBlockLocator& loc
 
 CCoinsViewCache *pcoinsTip = NULL;
 CBlockTreeDB *pblocktree = NULL;
+CInsightIndexDB *pinsightdb = NULL;
+CCoinsViewDB *pcoinsdbview = NULL;
+CCoinsViewAsyncWriter *pcoinswriter = NULL;
 
 //////////////////////////////////////////////////////////////////////////////
 //
 // mapOrphanTransactions
 //
 
-bool AddOrphanTx(const CTransaction& tx, NodeId peer) EXCLUSIVE_LOCKS_REQUIRED(cs_main)
+bool AddOrphanTx(const CTransactionRef& ptx, NodeId peer) EXCLUSIVE_LOCKS_REQUIRED(g_cs_orphans)
 {
+    const CTransaction& tx = *ptx;
     // See doc/book/src/design/p2p-data-propagation.md for why mapOrphanTransactions uses
     // txid to index transactions instead of wtxid.
     uint256 hash = tx.GetHash();
@@ -683,23 +950,28 @@ bool AddOrphanTx(const CTransaction& tx, NodeId peer) EXCLUSIVE_LOCKS_REQUIRED(c
         return false;
     }
 
-    auto ret = mapOrphanTransactions.emplace(hash, COrphanTx{tx, peer, GetTime() + ORPHAN_TX_EXPIRE_TIME});
+    size_t nUsage = RecursiveDynamicUsage(tx);
+    auto ret = mapOrphanTransactions.emplace(hash, COrphanTx{ptx, peer, GetTime() + ORPHAN_TX_EXPIRE_TIME, nUsage});
     assert(ret.second);
     for (const CTxIn& txin : tx.vin) {
         mapOrphanTransactionsByPrev[txin.prevout].insert(ret.first);
     }
+    COrphanPeer& orphanPeer = mapOrphanPeers[peer];
+    orphanPeer.setOrphans.insert(hash);
+    orphanPeer.nUsage += nUsage;
+    nOrphanTxUsage += nUsage;
 
-    LogPrint("mempool", "stored orphan tx %s (mapsz %u outsz %u)\n", hash.ToString(),
-             mapOrphanTransactions.size(), mapOrphanTransactionsByPrev.size());
+    LogPrint("mempool", "stored orphan tx %s (mapsz %u outsz %u usage %u)\n", hash.ToString(),
+             mapOrphanTransactions.size(), mapOrphanTransactionsByPrev.size(), nOrphanTxUsage);
     return true;
 }
 
-int static EraseOrphanTx(uint256 hash) EXCLUSIVE_LOCKS_REQUIRED(cs_main)
+int static EraseOrphanTx(uint256 hash) EXCLUSIVE_LOCKS_REQUIRED(g_cs_orphans)
 {
     map<uint256, COrphanTx>::iterator it = mapOrphanTransactions.find(hash);
     if (it == mapOrphanTransactions.end())
         return 0;
-    for (const CTxIn& txin : it->second.tx.vin)
+    for (const CTxIn& txin : it->second.tx->vin)
     {
         auto itPrev = mapOrphanTransactionsByPrev.find(txin.prevout);
         if (itPrev == mapOrphanTransactionsByPrev.end())
@@ -708,28 +980,36 @@ int static EraseOrphanTx(uint256 hash) EXCLUSIVE_LOCKS_REQUIRED(cs_main)
         if (itPrev->second.empty())
             mapOrphanTransactionsByPrev.erase(itPrev);
     }
+    auto itPeer = mapOrphanPeers.find(it->second.fromPeer);
+    assert(itPeer != mapOrphanPeers.end());
+    itPeer->second.setOrphans.erase(hash);
+    itPeer->second.nUsage -= it->second.nUsage;
+    if (itPeer->second.setOrphans.empty())
+        mapOrphanPeers.erase(itPeer);
+    nOrphanTxUsage -= it->second.nUsage;
     mapOrphanTransactions.erase(it);
     return 1;
 }
 
 void EraseOrphansFor(NodeId peer)
 {
+    LOCK(g_cs_orphans);
     int nErased = 0;
-    map<uint256, COrphanTx>::iterator iter = mapOrphanTransactions.begin();
-    while (iter != mapOrphanTransactions.end())
-    {
-        map<uint256, COrphanTx>::iterator maybeErase = iter++; // increment to avoid iterator becoming invalid
-        if (maybeErase->second.fromPeer == peer)
-        {
-            nErased += EraseOrphanTx(maybeErase->second.tx.GetHash());
+    auto itPeer = mapOrphanPeers.find(peer);
+    if (itPeer != mapOrphanPeers.end()) {
+        // Erasing the last orphan of the peer erases its entry.
+        const set<uint256> setOrphans = itPeer->second.setOrphans;
+        for (const uint256& hash : setOrphans) {
+            nErased += EraseOrphanTx(hash);
         }
     }
     if (nErased > 0) LogPrint("mempool", "Erased %d orphan tx from peer %d\n", nErased, peer);
 }
 
 
-unsigned int LimitOrphanTxSize(unsigned int nMaxOrphans) EXCLUSIVE_LOCKS_REQUIRED(cs_main)
+unsigned int LimitOrphanTxSize(unsigned int nMaxOrphans, size_t nMaxUsage, size_t nMaxPeerUsage)
 {
+    LOCK(g_cs_orphans);
     unsigned int nEvicted = 0;
     static int64_t nNextSweep;
     int64_t nNow = GetTime();
@@ -743,7 +1023,7 @@ unsigned int LimitOrphanTxSize(unsigned int nMaxOrphans) EXCLUSIVE_LOCKS_REQUIRE
         {
             map<uint256, COrphanTx>::iterator maybeErase = iter++;
             if (maybeErase->second.nTimeExpire <= nNow) {
-                nErased += EraseOrphanTx(maybeErase->second.tx.GetHash());
+                nErased += EraseOrphanTx(maybeErase->second.tx->GetHash());
             } else {
                 nMinExpTime = std::min(maybeErase->second.nTimeExpire, nMinExpTime);
             }
@@ -753,19 +1033,50 @@ unsigned int LimitOrphanTxSize(unsigned int nMaxOrphans) EXCLUSIVE_LOCKS_REQUIRE
         nNextSweep = nMinExpTime + ORPHAN_TX_EXPIRE_INTERVAL;
         if (nErased > 0) LogPrint("mempool", "Erased %d orphan tx due to expiration\n", nErased);
     }
-    while (mapOrphanTransactions.size() > nMaxOrphans)
+    while (!mapOrphanPeers.empty())
     {
-        // Evict a random orphan:
-        uint256 randomhash = GetRandHash();
-        map<uint256, COrphanTx>::iterator it = mapOrphanTransactions.lower_bound(randomhash);
-        if (it == mapOrphanTransactions.end())
-            it = mapOrphanTransactions.begin();
-        EraseOrphanTx(it->first);
+        // Evict a random orphan of the peer whose orphans use the most
+        // memory, so that a peer sending many or large orphans cannot push
+        // out those of other peers.
+        auto itPeer = std::max_element(mapOrphanPeers.begin(), mapOrphanPeers.end(),
+            [](const std::pair<const NodeId, COrphanPeer>& a, const std::pair<const NodeId, COrphanPeer>& b) {
+                return a.second.nUsage < b.second.nUsage;
+            });
+        if (mapOrphanTransactions.size() <= nMaxOrphans &&
+            nOrphanTxUsage <= nMaxUsage &&
+            itPeer->second.nUsage <= nMaxPeerUsage)
+            break;
+        const set<uint256>& setOrphans = itPeer->second.setOrphans;
+        auto it = setOrphans.lower_bound(GetRandHash());
+        if (it == setOrphans.end())
+            it = setOrphans.begin();
+        EraseOrphanTx(*it);
         ++nEvicted;
     }
     return nEvicted;
 }
 
+void GetOrphanTxStats(size_t& nCount, size_t& nUsage)
+{
+    LOCK(g_cs_orphans);
+    nCount = mapOrphanTransactions.size();
+    nUsage = nOrphanTxUsage;
+}
+
+CCacheStats GetRecentRejectsStats()
+{
+    AssertLockHeld(cs_main);
+    CCacheStats stats = recentRejectsStats;
+    stats.nMaxEntries = RECENT_REJECTS_ENTRIES;
+    return stats;
+}
+
+CCacheStats GetTxRejectCacheStats()
+{
+    AssertLockHeld(cs_main);
+    return txRejectCache ? txRejectCache->GetStats() : CCacheStats();
+}
+
 bool IsFinalTx(const CTransaction &tx, int nBlockHeight, int64_t nBlockTime)
 {
     if (tx.nLockTime == 0)
@@ -1407,6 +1718,25 @@ bool ContextualCheckShieldedInputs(
     return true;
 }
 
+/** The part of CheckTransaction that verifies proofs. */
+static bool CheckTransactionProofs(const CTransaction& tx, CValidationState &state,
+                                   ProofVerifier& verifier)
+{
+    // Ensure that zk-SNARKs verify
+    for (const JSDescription &joinsplit : tx.vJoinSplit) {
+        if (!verifier.VerifySprout(joinsplit, tx.joinSplitPubKey)) {
+            return state.DoS(100, error("CheckTransaction(): joinsplit does not verify"),
+                                REJECT_INVALID, "bad-txns-joinsplit-verification-failed");
+        }
+    }
+
+    // Sapling zk-SNARK proofs are checked in librustzcash_sapling_check_{spend,output},
+    // called from ContextualCheckTransaction.
+
+    // Orchard zk-SNARK proofs are checked by orchard::AuthValidator::Batch.
+
+    return true;
+}
 
 bool CheckTransaction(const CTransaction& tx, CValidationState &state,
                       ProofVerifier& verifier)
@@ -1419,20 +1749,7 @@ bool CheckTransaction(const CTransaction& tx, CValidationState &state,
     if (!CheckTransactionWithoutProofVerification(tx, state)) {
         return false;
     } else {
-        // Ensure that zk-SNARKs verify
-        for (const JSDescription &joinsplit : tx.vJoinSplit) {
-            if (!verifier.VerifySprout(joinsplit, tx.joinSplitPubKey)) {
-                return state.DoS(100, error("CheckTransaction(): joinsplit does not verify"),
-                                    REJECT_INVALID, "bad-txns-joinsplit-verification-failed");
-            }
-        }
-
-        // Sapling zk-SNARK proofs are checked in librustzcash_sapling_check_{spend,output},
-        // called from ContextualCheckTransaction.
-
-        // Orchard zk-SNARK proofs are checked by orchard::AuthValidator::Batch.
-
-        return true;
+        return CheckTransactionProofs(tx, state, verifier);
     }
 }
 
@@ -1772,30 +2089,139 @@ std::string FormatStateMessage(const CValidationState &state)
         state.GetRejectCode());
 }
 
-bool AcceptToMemoryPool(
+static CCheckQueue<CScriptCheck> scriptcheckqueue(128);
+
+// Each CShieldedBatchCheck is already a batch of proofs, so workers take them
+// one at a time.
+static CCheckQueue<CShieldedBatchCheck> proofcheckqueue(1);
+
+// Coins reads are cheap to hand out but each may block on the disk, so keep
+// the batches small to have as many reads in flight as there are threads.
+static CCheckQueue<CCoinsPrefetchCheck> coinsprefetchqueue(4);
+
+// Equihash solutions take milliseconds each to check, and a headers message
+// has at most MAX_HEADERS_RESULTS of them, so hand them out one at a time.
+static CCheckQueue<CEquihashCheck> headercheckqueue(1);
+
+// The context-free checks of a transaction are cheap next to handing it out,
+// so give them out a few at a time.
+static CCheckQueue<CTransactionCheck> txcheckqueue(8);
+
+namespace {
+
+/**
+ * A transaction on its way into the mempool. Its acceptance is checked in
+ * stages, so that the checks that depend on neither the chain nor the mempool
+ * can be run without holding cs_main.
+ */
+struct CMemPoolAcceptance
+{
+    //! Shared with the mempool entry, so that it is not copied.
+    const CTransactionRef ptx;
+    const CTransaction& tx;
+    const bool fLimitFree;
+    const bool fRejectAbsurdFee;
+
+    // Set by PrepareMemPoolAcceptance.
+    uint256 hashTip;
+    unsigned int nPoolUpdated = 0;
+    int nextBlockHeight = 0;
+    uint32_t consensusBranchId = 0;
+    //! Holds the coins spent by the transaction, independently of pcoinsTip.
+    std::unique_ptr<CCoinsViewDummy> dummy;
+    std::unique_ptr<CCoinsViewCache> view;
+    std::optional<CTxMemPoolEntry> entry;
+    CTxMemPool::setEntries setAncestors;
+    std::shared_ptr<PrecomputedTransactionData> ptxdata;
+
+    //! Set if the transaction was in a block that was connected under this
+    //! consensus branch ID, so its proofs and shielded signatures are known
+    //! to be valid for it.
+    const std::optional<uint32_t> prevalidatedBranchId;
+
+    //! If set, the time at which the transaction first entered the mempool,
+    //! for a transaction that is added back after a restart.
+    int64_t nAcceptTime = 0;
+
+    CMemPoolAcceptance(const CTransactionRef& ptxIn, bool fLimitFreeIn, bool fRejectAbsurdFeeIn,
+                       std::optional<uint32_t> prevalidatedBranchIdIn = std::nullopt) :
+        ptx(ptxIn), tx(*ptx), fLimitFree(fLimitFreeIn), fRejectAbsurdFee(fRejectAbsurdFeeIn),
+        prevalidatedBranchId(prevalidatedBranchIdIn) {}
+
+    //! Whether the proofs and shielded signatures need not be checked again.
+    bool IsPrevalidated() const {
+        return prevalidatedBranchId.has_value() && *prevalidatedBranchId == consensusBranchId;
+    }
+};
+
+uint256 ActiveTipHash() EXCLUSIVE_LOCKS_REQUIRED(cs_main)
+{
+    return chainActive.Tip() ? chainActive.Tip()->GetBlockHash() : uint256();
+}
+
+/**
+ * Records the time from its construction to its destruction as a stage of
+ * accepting transactions to the mempool.
+ */
+class CMemPoolStageTimer
+{
+private:
+    const char* pszStage;
+    int64_t nTimeStart;
+
+public:
+    explicit CMemPoolStageTimer(const char* pszStageIn) : pszStage(pszStageIn), nTimeStart(GetTimeMicros()) {}
+    ~CMemPoolStageTimer()
+    {
+        MetricsHistogram("zcash.mempool.accept.stage.seconds",
+            (GetTimeMicros() - nTimeStart) * 0.000001, "stage", pszStage);
+    }
+};
+
+/**
+ * The checks that depend only on the transaction, including its Sprout proofs
+ * unless it was in a connected block.
+ */
+bool PreCheckMemPoolAcceptance(const CMemPoolAcceptance& acceptance, CValidationState& state)
+{
+    CMemPoolStageTimer timer("precheck");
+    // Sprout proofs do not commit to the consensus branch ID. The proofs
+    // that are found valid are cached for when the transaction is mined.
+    auto verifier = acceptance.prevalidatedBranchId ? ProofVerifier::Disabled() : ProofVerifier::Batch(true);
+    if (!CheckTransaction(acceptance.tx, state, verifier)) {
+        return false;
+    }
+    if (!verifier.ValidateBatch()) {
+        return state.DoS(100, error("%s: joinsplit does not verify", __func__),
+                         REJECT_INVALID, "bad-txns-joinsplit-verification-failed");
+    }
+    return true;
+}
+
+/**
+ * The checks against the chain and the mempool, which need cs_main and
+ * pool.cs. Looks up the coins spent by the transaction and builds its
+ * mempool entry.
+ */
+bool PrepareMemPoolAcceptance(
         const CChainParams& chainparams,
-        CTxMemPool& pool, CValidationState &state, const CTransaction &tx, bool fLimitFree,
-        bool* pfMissingInputs, bool fRejectAbsurdFee)
+        CTxMemPool& pool, CMemPoolAcceptance& acceptance, CValidationState &state,
+        bool* pfMissingInputs)
 {
     AssertLockHeld(cs_main);
-    LOCK(pool.cs); // mempool "read lock" (held through pool.addUnchecked())
+    AssertLockHeld(pool.cs);
+    CMemPoolStageTimer timer("prepare");
+    const CTransaction& tx = acceptance.tx;
     if (pfMissingInputs) {
         *pfMissingInputs = false;
     }
 
-    int nextBlockHeight = chainActive.Height() + 1;
+    acceptance.hashTip = ActiveTipHash();
+    acceptance.nPoolUpdated = pool.GetTransactionsUpdated();
+    int nextBlockHeight = acceptance.nextBlockHeight = chainActive.Height() + 1;
 
     // Grab the branch ID we expect this transaction to commit to.
-    auto consensusBranchId = CurrentEpochBranchId(nextBlockHeight, chainparams.GetConsensus());
-
-    if (pool.IsRecentlyEvicted(tx.GetHash())) {
-        LogPrint("mempool", "Dropping txid %s : recently evicted", tx.GetHash().ToString());
-        return false;
-    }
-
-    auto verifier = ProofVerifier::Strict();
-    if (!CheckTransaction(tx, state, verifier))
-        return false;
+    auto consensusBranchId = acceptance.consensusBranchId = CurrentEpochBranchId(nextBlockHeight, chainparams.GetConsensus());
 
     // Check transaction contextually against the set of consensus rules which apply in the next block to be mined.
     if (!ContextualCheckTransaction(tx, state, chainparams, nextBlockHeight, false)) {
@@ -1846,229 +2272,893 @@ bool AcceptToMemoryPool(
         }
     }
 
-    {
-        CCoinsViewDummy dummy;
-        CCoinsViewCache view(&dummy);
+    acceptance.dummy.reset(new CCoinsViewDummy());
+    acceptance.view.reset(new CCoinsViewCache(acceptance.dummy.get()));
+    CCoinsViewDummy& dummy = *acceptance.dummy;
+    CCoinsViewCache& view = *acceptance.view;
 
-        CAmount nValueIn = 0;
-        CCoinsViewMemPool viewMemPool(pcoinsTip, pool);
-        view.SetBackend(viewMemPool);
+    CAmount nValueIn = 0;
+    CCoinsViewMemPool viewMemPool(pcoinsTip, pool);
+    view.SetBackend(viewMemPool);
 
-        // do we already have it?
-        if (view.HaveCoins(hash))
-            return state.Invalid(false, REJECT_ALREADY_KNOWN, "txn-already-known");
+    // do we already have it?
+    if (view.HaveCoins(hash))
+        return state.Invalid(false, REJECT_ALREADY_KNOWN, "txn-already-known");
 
-        // do all inputs exist?
-        // Note that this does not check for the presence of actual outputs (see the next check for that),
-        // and only helps with filling in pfMissingInputs (to determine missing vs spent).
-        for (const CTxIn txin : tx.vin) {
-            if (!view.HaveCoins(txin.prevout.hash)) {
-                if (pfMissingInputs)
-                    *pfMissingInputs = true;
-                return false; // fMissingInputs and !state.IsInvalid() is used to detect this condition, don't set state.Invalid()
-            }
+    // do all inputs exist?
+    // Note that this does not check for the presence of actual outputs (see the next check for that),
+    // and only helps with filling in pfMissingInputs (to determine missing vs spent).
+    for (const CTxIn txin : tx.vin) {
+        if (!view.HaveCoins(txin.prevout.hash)) {
+            if (pfMissingInputs)
+                *pfMissingInputs = true;
+            return false; // fMissingInputs and !state.IsInvalid() is used to detect this condition, don't set state.Invalid()
         }
+    }
 
-        // are the actual inputs available?
-        if (!view.HaveInputs(tx))
-            return state.Invalid(false, REJECT_DUPLICATE, "bad-txns-inputs-spent");
+    // are the actual inputs available?
+    if (!view.HaveInputs(tx))
+        return state.Invalid(false, REJECT_DUPLICATE, "bad-txns-inputs-spent");
 
-        // Are the shielded spends' requirements met?
-        // This doesn't trigger the DoS code on purpose; if it did, it would make it easier
-        // for an attacker to attempt to split the network.
-        if (!Consensus::CheckTxShieldedInputs(tx, state, view, 0)) {
-            return false;
-        }
+    // Are the shielded spends' requirements met?
+    // This doesn't trigger the DoS code on purpose; if it did, it would make it easier
+    // for an attacker to attempt to split the network.
+    if (!Consensus::CheckTxShieldedInputs(tx, state, view, 0)) {
+        return false;
+    }
 
-        // Bring the best block into scope
-        view.GetBestBlock();
+    // Bring the best block into scope
+    view.GetBestBlock();
+
+    nValueIn = view.GetValueIn(tx);
+
+    // we have all inputs cached now, so switch back to dummy
+    view.SetBackend(dummy);
+
+    // Check for non-standard pay-to-script-hash in inputs
+    if (chainparams.RequireStandard() && !AreInputsStandard(tx, view, consensusBranchId))
+        return state.Invalid(false, REJECT_NONSTANDARD, "bad-txns-nonstandard-inputs");
+
+    // Check that the transaction doesn't have an excessive number of
+    // sigops, making it impossible to mine. Since the coinbase transaction
+    // itself can contain sigops MAX_STANDARD_TX_SIGOPS is less than
+    // MAX_BLOCK_SIGOPS; we still consider this an invalid rather than
+    // merely non-standard transaction.
+    unsigned int nSigOps = GetLegacySigOpCount(tx);
+    nSigOps += GetP2SHSigOpCount(tx, view);
+    if (nSigOps > MAX_STANDARD_TX_SIGOPS)
+        return state.DoS(0, false, REJECT_NONSTANDARD, "bad-txns-too-many-sigops", false,
+            strprintf("%d > %d", nSigOps, MAX_STANDARD_TX_SIGOPS));
+
+    CAmount nValueOut = tx.GetValueOut();
+    CAmount nFees = nValueIn-nValueOut;
+    // nModifiedFees includes any fee deltas from PrioritiseTransaction
+    CAmount nModifiedFees = nFees;
+    pool.ApplyDelta(hash, nModifiedFees);
+
+    // Keep track of transactions that spend a coinbase, which we re-scan
+    // during reorgs to ensure COINBASE_MATURITY is still met.
+    bool fSpendsCoinbase = false;
+    for (const CTxIn &txin : tx.vin) {
+        const CCoins *coins = view.AccessCoins(txin.prevout.hash);
+        if (coins->IsCoinBase()) {
+            fSpendsCoinbase = true;
+            break;
+        }
+    }
 
-        nValueIn = view.GetValueIn(tx);
+    // For v1-v4 transactions, we don't yet know if the transaction commits
+    // to consensusBranchId, but if the entry gets added to the mempool, then
+    // it has passed ContextualCheckInputs and therefore this is correct.
+    int64_t nAcceptTime = acceptance.nAcceptTime ? acceptance.nAcceptTime : GetTime();
+    acceptance.entry.emplace(acceptance.ptx, nFees, nAcceptTime, chainActive.Height(), pool.HasNoInputsOf(tx), fSpendsCoinbase, nSigOps, consensusBranchId);
+    CTxMemPoolEntry& entry = *acceptance.entry;
+    unsigned int nSize = entry.GetTxSize();
+
+    // No transactions are allowed with modified fee below the minimum relay fee,
+    // except from disconnected blocks. The minimum relay fee will never be more
+    // than LEGACY_DEFAULT_FEE zatoshis.
+    CAmount minRelayFee = ::minRelayTxFee.GetFeeForRelay(nSize);
+    if (acceptance.fLimitFree && nModifiedFees < minRelayFee) {
+        LogPrint("mempool",
+                "Not accepting transaction with txid %s, size %d bytes, effective fee %d " + MINOR_CURRENCY_UNIT +
+                ", and fee delta %d " + MINOR_CURRENCY_UNIT + " to the mempool due to insufficient fee. " +
+                " The minimum acceptance/relay fee for this transaction is %d " + MINOR_CURRENCY_UNIT,
+                tx.GetHash().ToString(), nSize, nModifiedFees, nModifiedFees - nFees, minRelayFee);
+        return state.DoS(0, false, REJECT_INSUFFICIENTFEE, "min relay fee not met");
+    }
+
+    // Transactions with more than `-txunpaidactionlimit` unpaid actions (calculated
+    // using the modified fee) are not accepted to the mempool or relayed.
+    // <https://zips.z.cash/zip-0317#transaction-relaying>
+    size_t nUnpaidActionCount = entry.GetUnpaidActionCount();
+    if (nUnpaidActionCount > nTxUnpaidActionLimit) {
+        LogPrint("mempool",
+                "Not accepting transaction with txid %s, size %d bytes, effective fee %d " + MINOR_CURRENCY_UNIT +
+                ", and fee delta %d " + MINOR_CURRENCY_UNIT + " to the mempool because it has %d unpaid actions"
+                ", which is over the limit of %d. The conventional fee for this transaction is %d " + MINOR_CURRENCY_UNIT,
+                tx.GetHash().ToString(), nSize, nModifiedFees, nModifiedFees - nFees, nUnpaidActionCount,
+                nTxUnpaidActionLimit, tx.GetConventionalFee());
+        return state.DoS(0, false, REJECT_INSUFFICIENTFEE,
+                         strprintf("tx unpaid action limit exceeded: %d action(s) exceeds limit of %d", nUnpaidActionCount, nTxUnpaidActionLimit));
+    }
+
+    if (acceptance.fRejectAbsurdFee && nFees > maxTxFee) {
+        return state.Invalid(false,
+            REJECT_HIGHFEE, "absurdly-high-fee",
+            strprintf("%d > %d", nFees, maxTxFee));
+    }
+
+    // Calculate in-mempool ancestors, up to a limit.
+    size_t nLimitAncestors = GetArg("-limitancestorcount", DEFAULT_ANCESTOR_LIMIT);
+    size_t nLimitAncestorSize = GetArg("-limitancestorsize", DEFAULT_ANCESTOR_SIZE_LIMIT)*1000;
+    size_t nLimitDescendants = GetArg("-limitdescendantcount", DEFAULT_DESCENDANT_LIMIT);
+    size_t nLimitDescendantSize = GetArg("-limitdescendantsize", DEFAULT_DESCENDANT_SIZE_LIMIT)*1000;
+    std::string errString;
+    acceptance.setAncestors.clear();
+    if (!pool.CalculateMemPoolAncestors(entry, acceptance.setAncestors, nLimitAncestors, nLimitAncestorSize, nLimitDescendants, nLimitDescendantSize, errString)) {
+        return state.DoS(0, false, REJECT_NONSTANDARD, "too-long-mempool-chain", false, errString);
+    }
+
+    std::vector<CTxOut> allPrevOutputs;
+    for (const auto& input : tx.vin) {
+        allPrevOutputs.push_back(view.GetOutputFor(input));
+    }
+    // Kept in the mempool entry so that ConnectBlock can reuse it.
+    acceptance.ptxdata = std::make_shared<PrecomputedTransactionData>(tx, allPrevOutputs);
+    return true;
+}
 
-        // we have all inputs cached now, so switch back to dummy
-        view.SetBackend(dummy);
+/**
+ * The script checks of VerifyMemPoolAcceptance, which also check the inputs
+ * against the coins the transaction spends.
+ */
+bool CheckMemPoolAcceptanceScripts(
+        const CChainParams& chainparams,
+        CMemPoolAcceptance& acceptance, CValidationState &state)
+{
+    const CTransaction& tx = acceptance.tx;
+    const CCoinsViewCache& view = *acceptance.view;
+    PrecomputedTransactionData& txdata = *acceptance.ptxdata;
+    uint32_t consensusBranchId = acceptance.consensusBranchId;
+
+    // Check against previous transactions
+    // This is done near the end to help prevent CPU exhaustion denial-of-service attacks.
+    if (!ContextualCheckInputs(tx, state, view, true, STANDARD_SCRIPT_VERIFY_FLAGS, true, txdata, chainparams.GetConsensus(), consensusBranchId))
+    {
+        return false;
+    }
 
-        // Check for non-standard pay-to-script-hash in inputs
-        if (chainparams.RequireStandard() && !AreInputsStandard(tx, view, consensusBranchId))
-            return state.Invalid(false, REJECT_NONSTANDARD, "bad-txns-nonstandard-inputs");
+    // Check again against just the consensus-critical script verification
+    // flags that blocks are checked with, in case of bugs in the standard
+    // flags that cause transactions to pass as valid when they're actually
+    // invalid. For instance the STRICTENC flag was incorrectly allowing
+    // certain CHECKSIG NOT scripts to pass, even though they were invalid.
+    // This also caches the result under the flags that ConnectBlock uses.
+    //
+    // There is a similar check in CreateNewBlock() to prevent creating
+    // invalid blocks, however allowing such transactions into the mempool
+    // can be exploited as a DoS attack.
+    if (!ContextualCheckInputs(tx, state, view, true, BLOCK_SCRIPT_VERIFY_FLAGS, true, txdata, chainparams.GetConsensus(), consensusBranchId))
+    {
+        return error("%s: BUG! PLEASE REPORT THIS! ConnectInputs failed against block but not STANDARD flags %s, %s",
+            __func__, tx.GetHash().ToString(), FormatStateMessage(state));
+    }
+    return true;
+}
 
-        // Check that the transaction doesn't have an excessive number of
-        // sigops, making it impossible to mine. Since the coinbase transaction
-        // itself can contain sigops MAX_STANDARD_TX_SIGOPS is less than
-        // MAX_BLOCK_SIGOPS; we still consider this an invalid rather than
-        // merely non-standard transaction.
-        unsigned int nSigOps = GetLegacySigOpCount(tx);
-        nSigOps += GetP2SHSigOpCount(tx, view);
-        if (nSigOps > MAX_STANDARD_TX_SIGOPS)
-            return state.DoS(0, false, REJECT_NONSTANDARD, "bad-txns-too-many-sigops", false,
-                strprintf("%d > %d", nSigOps, MAX_STANDARD_TX_SIGOPS));
+/**
+ * Check the shielded signatures of a transaction, and add its Sapling and
+ * Orchard bundles to the given batch validators. If the transaction is
+ * prevalidated only its shielded inputs are checked against the chain.
+ */
+bool QueueMemPoolAcceptanceAuth(
+        const CChainParams& chainparams,
+        CMemPoolAcceptance& acceptance, CValidationState &state,
+        std::optional<rust::Box<sapling::BatchValidator>>& saplingAuth,
+        std::optional<rust::Box<orchard::BatchValidator>>& orchardAuth)
+{
+    if (acceptance.IsPrevalidated()) {
+        return Consensus::CheckTxShieldedInputs(acceptance.tx, state, *acceptance.view, 0);
+    }
+    return ContextualCheckShieldedInputs(
+        acceptance.tx,
+        *acceptance.ptxdata,
+        state,
+        *acceptance.view,
+        saplingAuth,
+        orchardAuth,
+        chainparams.GetConsensus(),
+        acceptance.consensusBranchId,
+        chainparams.GetConsensus().NetworkUpgradeActive(acceptance.nextBlockHeight, Consensus::UPGRADE_NU5),
+        false);
+}
 
-        CAmount nValueOut = tx.GetValueOut();
-        CAmount nFees = nValueIn-nValueOut;
-        // nModifiedFees includes any fee deltas from PrioritiseTransaction
-        CAmount nModifiedFees = nFees;
-        pool.ApplyDelta(hash, nModifiedFees);
+/**
+ * Check the Sapling and Orchard bundle authorizations added to the batch
+ * validators, on the proof-checking threads if fParallel is set.
+ */
+bool CheckMemPoolAcceptanceAuth(
+        std::optional<rust::Box<sapling::BatchValidator>>& saplingAuth,
+        std::optional<rust::Box<orchard::BatchValidator>>& orchardAuth,
+        CValidationState &state, bool fParallel)
+{
+    // `saplingAuth` and `orchardAuth` are known here to be non-null.
+    CShieldedBatchResult shieldedResult;
+    if (fParallel) {
+        // Verify the two bundles in parallel on the proof-checking threads.
+        CCheckQueueControl<CShieldedBatchCheck> proofControl(&proofcheckqueue);
+        std::vector<CShieldedBatchCheck> vProofChecks;
+        vProofChecks.emplace_back(std::move(saplingAuth), std::nullopt, &shieldedResult);
+        vProofChecks.emplace_back(std::nullopt, std::move(orchardAuth), &shieldedResult);
+        proofControl.Add(vProofChecks);
+        proofControl.Wait();
+    } else {
+        CShieldedBatchCheck check(std::move(saplingAuth), std::move(orchardAuth), &shieldedResult);
+        check();
+    }
+    if (!shieldedResult.fSaplingValid) {
+        return state.DoS(100, false, REJECT_INVALID, "bad-sapling-bundle-authorization");
+    }
+    if (!shieldedResult.fOrchardValid) {
+        return state.DoS(100, false, REJECT_INVALID, "bad-orchard-bundle-authorization");
+    }
+    return true;
+}
 
-        // Keep track of transactions that spend a coinbase, which we re-scan
-        // during reorgs to ensure COINBASE_MATURITY is still met.
-        bool fSpendsCoinbase = false;
-        for (const CTxIn &txin : tx.vin) {
-            const CCoins *coins = view.AccessCoins(txin.prevout.hash);
-            if (coins->IsCoinBase()) {
-                fSpendsCoinbase = true;
-                break;
-            }
-        }
+/**
+ * Check the scripts, signatures and proofs of a transaction that passed
+ * PrepareMemPoolAcceptance. Only reads the coins it looked up, so it does not
+ * need cs_main. The proof-checking threads are only used if fUseCheckQueues
+ * is set.
+ */
+bool VerifyMemPoolAcceptance(
+        const CChainParams& chainparams,
+        CMemPoolAcceptance& acceptance, CValidationState &state,
+        bool fUseCheckQueues)
+{
+    CMemPoolStageTimer timer("verify");
+    if (!CheckMemPoolAcceptanceScripts(chainparams, acceptance, state)) {
+        return false;
+    }
 
-        // For v1-v4 transactions, we don't yet know if the transaction commits
-        // to consensusBranchId, but if the entry gets added to the mempool, then
-        // it has passed ContextualCheckInputs and therefore this is correct.
-        CTxMemPoolEntry entry(tx, nFees, GetTime(), chainActive.Height(), pool.HasNoInputsOf(tx), fSpendsCoinbase, nSigOps, consensusBranchId);
-        unsigned int nSize = entry.GetTxSize();
-
-        // No transactions are allowed with modified fee below the minimum relay fee,
-        // except from disconnected blocks. The minimum relay fee will never be more
-        // than LEGACY_DEFAULT_FEE zatoshis.
-        CAmount minRelayFee = ::minRelayTxFee.GetFeeForRelay(nSize);
-        if (fLimitFree && nModifiedFees < minRelayFee) {
-            LogPrint("mempool",
-                    "Not accepting transaction with txid %s, size %d bytes, effective fee %d " + MINOR_CURRENCY_UNIT +
-                    ", and fee delta %d " + MINOR_CURRENCY_UNIT + " to the mempool due to insufficient fee. " +
-                    " The minimum acceptance/relay fee for this transaction is %d " + MINOR_CURRENCY_UNIT,
-                    tx.GetHash().ToString(), nSize, nModifiedFees, nModifiedFees - nFees, minRelayFee);
-            return state.DoS(0, false, REJECT_INSUFFICIENTFEE, "min relay fee not met");
-        }
-
-        // Transactions with more than `-txunpaidactionlimit` unpaid actions (calculated
-        // using the modified fee) are not accepted to the mempool or relayed.
-        // <https://zips.z.cash/zip-0317#transaction-relaying>
-        size_t nUnpaidActionCount = entry.GetUnpaidActionCount();
-        if (nUnpaidActionCount > nTxUnpaidActionLimit) {
-            LogPrint("mempool",
-                    "Not accepting transaction with txid %s, size %d bytes, effective fee %d " + MINOR_CURRENCY_UNIT +
-                    ", and fee delta %d " + MINOR_CURRENCY_UNIT + " to the mempool because it has %d unpaid actions"
-                    ", which is over the limit of %d. The conventional fee for this transaction is %d " + MINOR_CURRENCY_UNIT,
-                    tx.GetHash().ToString(), nSize, nModifiedFees, nModifiedFees - nFees, nUnpaidActionCount,
-                    nTxUnpaidActionLimit, tx.GetConventionalFee());
-            return state.DoS(0, false, REJECT_INSUFFICIENTFEE,
-                             strprintf("tx unpaid action limit exceeded: %d action(s) exceeds limit of %d", nUnpaidActionCount, nTxUnpaidActionLimit));
-        }
-
-        if (fRejectAbsurdFee && nFees > maxTxFee) {
-            return state.Invalid(false,
-                REJECT_HIGHFEE, "absurdly-high-fee",
-                strprintf("%d > %d", nFees, maxTxFee));
-        }
-
-        // Calculate in-mempool ancestors, up to a limit.
-        CTxMemPool::setEntries setAncestors;
-        size_t nLimitAncestors = GetArg("-limitancestorcount", DEFAULT_ANCESTOR_LIMIT);
-        size_t nLimitAncestorSize = GetArg("-limitancestorsize", DEFAULT_ANCESTOR_SIZE_LIMIT)*1000;
-        size_t nLimitDescendants = GetArg("-limitdescendantcount", DEFAULT_DESCENDANT_LIMIT);
-        size_t nLimitDescendantSize = GetArg("-limitdescendantsize", DEFAULT_DESCENDANT_SIZE_LIMIT)*1000;
-        std::string errString;
-        if (!pool.CalculateMemPoolAncestors(entry, setAncestors, nLimitAncestors, nLimitAncestorSize, nLimitDescendants, nLimitDescendantSize, errString)) {
-            return state.DoS(0, false, REJECT_NONSTANDARD, "too-long-mempool-chain", false, errString);
-        }
-
-        // Check against previous transactions
-        // This is done near the end to help prevent CPU exhaustion denial-of-service attacks.
-        std::vector<CTxOut> allPrevOutputs;
-        for (const auto& input : tx.vin) {
-            allPrevOutputs.push_back(view.GetOutputFor(input));
-        }
-        PrecomputedTransactionData txdata(tx, allPrevOutputs);
-        if (!ContextualCheckInputs(tx, state, view, true, STANDARD_SCRIPT_VERIFY_FLAGS, true, txdata, chainparams.GetConsensus(), consensusBranchId))
-        {
-            return false;
-        }
+    // This will be a single-transaction batch, which will be more efficient
+    // than unbatched if the transaction contains at least one Sapling Spend
+    // or at least two Sapling Outputs.
+    std::optional<rust::Box<sapling::BatchValidator>> saplingAuth = sapling::init_batch_validator(true);
 
-        // Check again against just the consensus-critical mandatory script
-        // verification flags, in case of bugs in the standard flags that cause
-        // transactions to pass as valid when they're actually invalid. For
-        // instance the STRICTENC flag was incorrectly allowing certain
-        // CHECKSIG NOT scripts to pass, even though they were invalid.
-        //
-        // There is a similar check in CreateNewBlock() to prevent creating
-        // invalid blocks, however allowing such transactions into the mempool
-        // can be exploited as a DoS attack.
-        if (!ContextualCheckInputs(tx, state, view, true, MANDATORY_SCRIPT_VERIFY_FLAGS, true, txdata, chainparams.GetConsensus(), consensusBranchId))
-        {
-            return error("%s: BUG! PLEASE REPORT THIS! ConnectInputs failed against MANDATORY but not STANDARD flags %s, %s",
-                __func__, hash.ToString(), FormatStateMessage(state));
-        }
+    // This will be a single-transaction batch, which is still more efficient as every
+    // Orchard bundle contains at least two signatures.
+    std::optional<rust::Box<orchard::BatchValidator>> orchardAuth = orchard::init_batch_validator(true);
 
-        // This will be a single-transaction batch, which will be more efficient
-        // than unbatched if the transaction contains at least one Sapling Spend
-        // or at least two Sapling Outputs.
-        std::optional<rust::Box<sapling::BatchValidator>> saplingAuth = sapling::init_batch_validator(true);
+    // Check shielded input signatures.
+    if (!QueueMemPoolAcceptanceAuth(chainparams, acceptance, state, saplingAuth, orchardAuth)) {
+        return false;
+    }
 
-        // This will be a single-transaction batch, which is still more efficient as every
-        // Orchard bundle contains at least two signatures.
-        std::optional<rust::Box<orchard::BatchValidator>> orchardAuth = orchard::init_batch_validator(true);
+    // Check Sapling and Orchard bundle authorizations.
+    const CTransaction& tx = acceptance.tx;
+    bool fParallel = fUseCheckQueues && nScriptCheckThreads &&
+        tx.GetSaplingBundle().IsPresent() && tx.GetOrchardBundle().IsPresent();
+    return CheckMemPoolAcceptanceAuth(saplingAuth, orchardAuth, state, fParallel);
+}
 
-        // Check shielded input signatures.
-        if (!ContextualCheckShieldedInputs(
-            tx,
-            txdata,
-            state,
-            view,
-            saplingAuth,
-            orchardAuth,
-            chainparams.GetConsensus(),
-            consensusBranchId,
-            chainparams.GetConsensus().NetworkUpgradeActive(nextBlockHeight, Consensus::UPGRADE_NU5),
-            false))
+/**
+ * Like VerifyMemPoolAcceptance, but for several transactions at once, whose
+ * Sapling and Orchard bundles are checked in a single batch. If the batch
+ * fails, the bundles of each transaction are checked on their own to find
+ * out which are invalid. Returns which of the transactions are valid.
+ */
+std::vector<bool> VerifyMemPoolAcceptances(
+        const CChainParams& chainparams,
+        const std::vector<CMemPoolAcceptance*>& vAcceptances,
+        const std::vector<CValidationState*>& vStates,
+        bool fUseCheckQueues)
+{
+    assert(vAcceptances.size() == vStates.size());
+    if (vAcceptances.size() == 1) {
+        return {VerifyMemPoolAcceptance(chainparams, *vAcceptances[0], *vStates[0], fUseCheckQueues)};
+    }
+
+    CMemPoolStageTimer timer("verify_batch");
+    std::vector<bool> vValid(vAcceptances.size(), false);
+    std::optional<rust::Box<sapling::BatchValidator>> saplingAuth = sapling::init_batch_validator(true);
+    std::optional<rust::Box<orchard::BatchValidator>> orchardAuth = orchard::init_batch_validator(true);
+    std::vector<size_t> vQueued;
+    bool fAnySapling = false;
+    bool fAnyOrchard = false;
+    for (size_t i = 0; i < vAcceptances.size(); i++) {
+        if (CheckMemPoolAcceptanceScripts(chainparams, *vAcceptances[i], *vStates[i]) &&
+            QueueMemPoolAcceptanceAuth(chainparams, *vAcceptances[i], *vStates[i], saplingAuth, orchardAuth))
         {
-            return false;
+            vQueued.push_back(i);
+            fAnySapling |= vAcceptances[i]->tx.GetSaplingBundle().IsPresent();
+            fAnyOrchard |= vAcceptances[i]->tx.GetOrchardBundle().IsPresent();
         }
+    }
+    if (vQueued.empty()) {
+        return vValid;
+    }
 
-        // Check Sapling and Orchard bundle authorizations.
-        // `saplingAuth` and `orchardAuth` are known here to be non-null.
-        if (!saplingAuth.value()->validate()) {
-            return state.DoS(100, false, REJECT_INVALID, "bad-sapling-bundle-authorization");
-        }
-        if (!orchardAuth.value()->validate()) {
-            return state.DoS(100, false, REJECT_INVALID, "bad-orchard-bundle-authorization");
-        }
+    CValidationState stateBatch;
+    if (CheckMemPoolAcceptanceAuth(saplingAuth, orchardAuth, stateBatch,
+            fUseCheckQueues && nScriptCheckThreads && fAnySapling && fAnyOrchard))
+    {
+        for (size_t i : vQueued) {
+            vValid[i] = true;
+        }
+        return vValid;
+    }
+
+    // At least one of the bundles is invalid; check them one transaction at
+    // a time. Bundles are only added to the caches when a whole batch is
+    // valid, so this checks the valid ones again.
+    LogPrint("mempool", "%s: batch of %d transactions failed (%s), checking them individually\n",
+        __func__, vQueued.size(), stateBatch.GetRejectReason());
+    for (size_t i : vQueued) {
+        CMemPoolAcceptance& acceptance = *vAcceptances[i];
+        std::optional<rust::Box<sapling::BatchValidator>> saplingOne = sapling::init_batch_validator(true);
+        std::optional<rust::Box<orchard::BatchValidator>> orchardOne = orchard::init_batch_validator(true);
+        bool fParallel = fUseCheckQueues && nScriptCheckThreads &&
+            acceptance.tx.GetSaplingBundle().IsPresent() && acceptance.tx.GetOrchardBundle().IsPresent();
+        vValid[i] =
+            QueueMemPoolAcceptanceAuth(chainparams, acceptance, *vStates[i], saplingOne, orchardOne) &&
+            CheckMemPoolAcceptanceAuth(saplingOne, orchardOne, *vStates[i], fParallel);
+    }
+    return vValid;
+}
 
-        {
-            // Store transaction in memory
-            pool.addUnchecked(hash, entry, setAncestors);
+/** Add a transaction that passed all the checks to the mempool. */
+void AddToMemPool(CTxMemPool& pool, CMemPoolAcceptance& acceptance)
+{
+    AssertLockHeld(cs_main);
+    AssertLockHeld(pool.cs);
+    CMemPoolStageTimer timer("add");
+    CTxMemPoolEntry& entry = *acceptance.entry;
+    const CCoinsViewCache& view = *acceptance.view;
 
-            // Add memory address index
-            if (fAddressIndex) {
-                pool.addAddressIndex(entry, view);
-            }
+    // Store transaction in memory
+    entry.SetPrecomputedData(acceptance.ptxdata);
+    pool.addUnchecked(acceptance.tx.GetHash(), entry, acceptance.setAncestors);
 
-            // insightexplorer: Add memory spent index
-            if (fSpentIndex) {
-                pool.addSpentIndex(entry, view);
-            }
+    // Add memory address index
+    if (fAddressIndex) {
+        pool.addAddressIndex(entry, view);
+    }
 
-            pool.EnsureSizeLimit();
-            pool.UpdateMetrics();
-        }
+    // insightexplorer: Add memory spent index
+    if (fSpentIndex) {
+        pool.addSpentIndex(entry, view);
     }
 
-    auto txid = tx.GetHash().ToString();
+    pool.EnsureSizeLimit();
+    pool.UpdateMetrics();
+
+    auto txid = acceptance.tx.GetHash().ToString();
     auto poolsz = tfm::format("%u", pool.mapTx.size());
 
     TracingInfo("mempool", "Accepted",
         "txid", txid.c_str(),
         "poolsize", poolsz.c_str());
-
-    return true;
 }
 
-bool GetTimestampIndex(unsigned int high, unsigned int low, bool fActiveOnly,
-    std::vector<std::pair<uint256, unsigned int> > &hashes)
+/**
+ * Add a transaction that was verified without cs_main to the mempool. The
+ * checks against the chain and the mempool are repeated if either has changed
+ * since they were done, and the scripts and proofs are checked again if the
+ * chain tip has changed.
+ */
+bool CompleteMemPoolAcceptance(
+        const CChainParams& chainparams,
+        CTxMemPool& pool, std::unique_ptr<CMemPoolAcceptance>& acceptance, CValidationState &state,
+        bool* pfMissingInputs)
 {
-    if (!fTimestampIndex) {
-        LogPrint("rpc", "Timestamp index not enabled");
-        return false;
+    AssertLockHeld(cs_main);
+    AssertLockHeld(pool.cs);
+    bool fTipChanged = acceptance->hashTip != ActiveTipHash();
+    if (fTipChanged || acceptance->nPoolUpdated != pool.GetTransactionsUpdated()) {
+        std::unique_ptr<CMemPoolAcceptance> recheck(new CMemPoolAcceptance(
+            acceptance->ptx, acceptance->fLimitFree, acceptance->fRejectAbsurdFee,
+            acceptance->prevalidatedBranchId));
+        recheck->nAcceptTime = acceptance->nAcceptTime;
+        if (!PrepareMemPoolAcceptance(chainparams, pool, *recheck, state, pfMissingInputs)) {
+            return false;
+        }
+        if (fTipChanged && !VerifyMemPoolAcceptance(chainparams, *recheck, state, true)) {
+            return false;
+        }
+        acceptance = std::move(recheck);
     }
-    if (!pblocktree->ReadTimestampIndex(high, low, fActiveOnly, hashes)) {
+    AddToMemPool(pool, *acceptance);
+    return true;
+}
+
+/**
+ * The body of AcceptToMemoryPoolBatch. If prevalidatedBranchId is set, the
+ * transactions are all from a block that was connected under it. If
+ * pvAcceptTime is given, it holds the time at which each transaction first
+ * entered the mempool.
+ */
+std::vector<bool> AcceptTransactionsToMemoryPool(
+        const CChainParams& chainparams,
+        CTxMemPool& pool, std::vector<CValidationState>& vStates, const std::vector<CTransactionRef>& vtx, bool fLimitFree,
+        std::vector<bool>* pvMissingInputs, bool fRejectAbsurdFee,
+        std::optional<uint32_t> prevalidatedBranchId,
+        const std::vector<int64_t>* pvAcceptTime = nullptr)
+{
+    AssertLockHeld(cs_main);
+    LOCK(pool.cs); // mempool "read lock" (held through pool.addUnchecked())
+    vStates.assign(vtx.size(), CValidationState());
+    std::vector<bool> vMissingInputs(vtx.size(), false);
+    std::vector<bool> vAccepted(vtx.size(), false);
+    assert(!pvAcceptTime || pvAcceptTime->size() == vtx.size());
+
+    // The transactions that have been neither accepted nor rejected yet.
+    std::vector<size_t> vPending;
+    std::set<uint256> setPending;
+    for (size_t i = 0; i < vtx.size(); i++) {
+        if (pool.IsRecentlyEvicted(vtx[i]->GetHash())) {
+            LogPrint("mempool", "Dropping txid %s : recently evicted", vtx[i]->GetHash().ToString());
+        } else if (PreCheckMemPoolAcceptance(CMemPoolAcceptance(vtx[i], fLimitFree, fRejectAbsurdFee, prevalidatedBranchId), vStates[i])) {
+            vPending.push_back(i);
+            setPending.insert(vtx[i]->GetHash());
+        }
+    }
+
+    // Each round checks the transactions whose inputs are available, so a
+    // transaction that spends from another in the batch waits for a later
+    // round.
+    while (!vPending.empty()) {
+        std::vector<std::unique_ptr<CMemPoolAcceptance>> vRound;
+        std::vector<size_t> vRoundIndex;
+        std::vector<size_t> vWaiting;
+        for (size_t i : vPending) {
+            const CTransaction& tx = *vtx[i];
+            vStates[i] = CValidationState();
+            bool fMissingInputs = false;
+            std::unique_ptr<CMemPoolAcceptance> acceptance(new CMemPoolAcceptance(vtx[i], fLimitFree, fRejectAbsurdFee, prevalidatedBranchId));
+            if (pvAcceptTime) {
+                acceptance->nAcceptTime = (*pvAcceptTime)[i];
+            }
+            if (PrepareMemPoolAcceptance(chainparams, pool, *acceptance, vStates[i], &fMissingInputs)) {
+                vRound.push_back(std::move(acceptance));
+                vRoundIndex.push_back(i);
+                continue;
+            }
+            if (fMissingInputs) {
+                bool fWaiting = false;
+                for (const CTxIn& txin : tx.vin) {
+                    if (setPending.count(txin.prevout.hash)) {
+                        fWaiting = true;
+                        break;
+                    }
+                }
+                if (fWaiting) {
+                    vWaiting.push_back(i);
+                    continue;
+                }
+            }
+            vMissingInputs[i] = fMissingInputs;
+            setPending.erase(tx.GetHash());
+        }
+        if (vRound.empty()) {
+            for (size_t i : vWaiting) {
+                vMissingInputs[i] = true;
+            }
+            break;
+        }
+
+        std::vector<CMemPoolAcceptance*> vVerify;
+        std::vector<CValidationState*> vVerifyStates;
+        for (size_t k = 0; k < vRound.size(); k++) {
+            vVerify.push_back(vRound[k].get());
+            vVerifyStates.push_back(&vStates[vRoundIndex[k]]);
+        }
+        std::vector<bool> vValid = VerifyMemPoolAcceptances(chainparams, vVerify, vVerifyStates, true);
+        for (size_t k = 0; k < vRound.size(); k++) {
+            size_t i = vRoundIndex[k];
+            setPending.erase(vtx[i]->GetHash());
+            if (!vValid[k]) {
+                continue;
+            }
+            // Adding the earlier transactions of the round changed the
+            // mempool, so this checks against it again.
+            bool fMissingInputs = false;
+            vAccepted[i] = CompleteMemPoolAcceptance(chainparams, pool, vRound[k], vStates[i], &fMissingInputs);
+            vMissingInputs[i] = fMissingInputs;
+        }
+        vPending = std::move(vWaiting);
+    }
+
+    if (pvMissingInputs) {
+        *pvMissingInputs = vMissingInputs;
+    }
+    return vAccepted;
+}
+
+}
+
+bool AcceptToMemoryPool(
+        const CChainParams& chainparams,
+        CTxMemPool& pool, CValidationState &state, const CTransaction &tx, bool fLimitFree,
+        bool* pfMissingInputs, bool fRejectAbsurdFee)
+{
+    return AcceptToMemoryPool(chainparams, pool, state, MakeTransactionRef(tx), fLimitFree, pfMissingInputs, fRejectAbsurdFee);
+}
+
+bool AcceptToMemoryPool(
+        const CChainParams& chainparams,
+        CTxMemPool& pool, CValidationState &state, const CTransactionRef &ptx, bool fLimitFree,
+        bool* pfMissingInputs, bool fRejectAbsurdFee)
+{
+    auto span = TracingSpan("debug", "bench", "AcceptToMemoryPool");
+    auto spanGuard = span.Enter();
+
+    AssertLockHeld(cs_main);
+    const CTransaction& tx = *ptx;
+    LOCK(pool.cs); // mempool "read lock" (held through pool.addUnchecked())
+    if (pfMissingInputs) {
+        *pfMissingInputs = false;
+    }
+
+    if (pool.IsRecentlyEvicted(tx.GetHash())) {
+        LogPrint("mempool", "Dropping txid %s : recently evicted", tx.GetHash().ToString());
+        return false;
+    }
+
+    CMemPoolAcceptance acceptance(ptx, fLimitFree, fRejectAbsurdFee);
+    if (!PreCheckMemPoolAcceptance(acceptance, state) ||
+        !PrepareMemPoolAcceptance(chainparams, pool, acceptance, state, pfMissingInputs) ||
+        !VerifyMemPoolAcceptance(chainparams, acceptance, state, true))
+    {
+        return false;
+    }
+    AddToMemPool(pool, acceptance);
+    return true;
+}
+
+std::vector<bool> AcceptToMemoryPoolBatch(
+        const CChainParams& chainparams,
+        CTxMemPool& pool, std::vector<CValidationState>& vStates, const std::vector<CTransactionRef>& vtx, bool fLimitFree,
+        std::vector<bool>* pvMissingInputs, bool fRejectAbsurdFee)
+{
+    return AcceptTransactionsToMemoryPool(chainparams, pool, vStates, vtx, fLimitFree, pvMissingInputs, fRejectAbsurdFee, std::nullopt);
+}
+
+bool AcceptToMemoryPoolStaged(
+        const CChainParams& chainparams,
+        CTxMemPool& pool, CValidationState &state, const CTransactionRef &ptx,
+        const std::function<void()>& fnVerified)
+{
+    std::unique_ptr<CMemPoolAcceptance> acceptance(new CMemPoolAcceptance(ptx, true, false));
+    if (!PreCheckMemPoolAcceptance(*acceptance, state)) {
+        return false;
+    }
+    {
+        LOCK2(cs_main, pool.cs);
+        if (!PrepareMemPoolAcceptance(chainparams, pool, *acceptance, state, NULL)) {
+            return false;
+        }
+    }
+    if (!VerifyMemPoolAcceptance(chainparams, *acceptance, state, false)) {
+        return false;
+    }
+    fnVerified();
+    LOCK2(cs_main, pool.cs);
+    return CompleteMemPoolAcceptance(chainparams, pool, acceptance, state, NULL);
+}
+
+static const uint64_t MEMPOOL_DUMP_VERSION = 1;
+//! The saved transactions are added back to the mempool in batches of this size.
+static const size_t MEMPOOL_LOAD_BATCH_SIZE = 1000;
+
+std::atomic_bool fMempoolLoaded(false);
+
+bool LoadMempool(const CChainParams& chainparams)
+{
+    int64_t nStart = GetTimeMicros();
+    CAutoFile file(fsbridge::fopen(GetDataDir() / "mempool.dat", "rb"), SER_DISK, CLIENT_VERSION);
+    if (file.IsNull()) {
+        LogPrintf("Failed to open mempool file from disk. Continuing anyway.\n");
+        return false;
+    }
+
+    int64_t nAccepted = 0;
+    int64_t nFailed = 0;
+    std::vector<CTransactionRef> vtx;
+    std::vector<int64_t> vAcceptTime;
+    auto acceptBatch = [&]() {
+        LOCK(cs_main);
+        std::vector<CValidationState> vStates;
+        std::vector<bool> vAccepted = AcceptTransactionsToMemoryPool(
+            chainparams, mempool, vStates, vtx, true, NULL, false, std::nullopt, &vAcceptTime);
+        for (bool fAccepted : vAccepted) {
+            if (fAccepted) {
+                nAccepted++;
+            } else {
+                nFailed++;
+            }
+        }
+        vtx.clear();
+        vAcceptTime.clear();
+    };
+
+    try {
+        uint64_t version;
+        file >> version;
+        if (version != MEMPOOL_DUMP_VERSION) {
+            LogPrintf("Unknown mempool file version %d. Continuing anyway.\n", version);
+            return false;
+        }
+        uint64_t num;
+        file >> num;
+        // The transactions were written parents first, so those in a batch
+        // only spend from earlier batches or from each other.
+        while (num--) {
+            CTransactionRef ptx;
+            int64_t nTime;
+            int64_t nFeeDelta;
+            file >> ptx;
+            file >> nTime;
+            file >> nFeeDelta;
+
+            if (nFeeDelta != 0) {
+                mempool.PrioritiseTransaction(ptx->GetHash(), ptx->GetHash().ToString(), nFeeDelta);
+            }
+            vtx.push_back(ptx);
+            vAcceptTime.push_back(nTime);
+            if (vtx.size() >= MEMPOOL_LOAD_BATCH_SIZE) {
+                acceptBatch();
+            }
+            if (ShutdownRequested())
+                return false;
+        }
+        if (!vtx.empty()) {
+            acceptBatch();
+        }
+
+        // The prioritisation of transactions that were not in the mempool.
+        std::map<uint256, CAmount> mapDeltas;
+        file >> mapDeltas;
+        for (const auto& i : mapDeltas) {
+            mempool.PrioritiseTransaction(i.first, i.first.ToString(), i.second);
+        }
+    } catch (const std::exception& e) {
+        LogPrintf("Failed to deserialize mempool data on disk: %s. Continuing anyway.\n", e.what());
+        return false;
+    }
+
+    LogPrintf("Imported mempool transactions from disk: %i successes, %i failed (%.2fms)\n",
+        nAccepted, nFailed, (GetTimeMicros() - nStart) * 0.001);
+    return true;
+}
+
+bool DumpMempool()
+{
+    int64_t nStart = GetTimeMicros();
+
+    std::map<uint256, CAmount> mapDeltas;
+    std::vector<TxMempoolInfo> vinfo;
+    {
+        LOCK(mempool.cs);
+        mapDeltas = mempool.mapDeltas;
+        vinfo = mempool.infoAll();
+    }
+
+    int64_t nMid = GetTimeMicros();
+
+    try {
+        fs::path path = GetDataDir() / "mempool.dat";
+        fs::path temppath = GetDataDir() / "mempool.dat.new";
+        FILE* filestr = fsbridge::fopen(temppath, "wb");
+        if (!filestr) {
+            return false;
+        }
+
+        CAutoFile file(filestr, SER_DISK, CLIENT_VERSION);
+
+        uint64_t version = MEMPOOL_DUMP_VERSION;
+        file << version;
+
+        file << (uint64_t)vinfo.size();
+        for (const auto& i : vinfo) {
+            file << *(i.tx);
+            file << (int64_t)i.nTime;
+            CAmount nFeeDelta = 0;
+            auto it = mapDeltas.find(i.tx->GetHash());
+            if (it != mapDeltas.end()) {
+                nFeeDelta = it->second;
+                mapDeltas.erase(it);
+            }
+            file << (int64_t)nFeeDelta;
+        }
+
+        file << mapDeltas;
+        FileCommit(file.Get());
+        file.fclose();
+        RenameOver(temppath, path);
+        int64_t nLast = GetTimeMicros();
+        LogPrintf("Dumped mempool: %gs to copy, %gs to dump\n", (nMid - nStart) * 0.000001, (nLast - nMid) * 0.000001);
+    } catch (const std::exception& e) {
+        LogPrintf("Failed to dump mempool: %s. Continuing anyway.\n", e.what());
+        return false;
+    }
+    return true;
+}
+
+static const uint64_t VALIDITY_CACHE_DUMP_VERSION = 1;
+
+bool LoadValidityCaches()
+{
+    int64_t nStart = GetTimeMicros();
+    CAutoFile file(fsbridge::fopen(GetDataDir() / "validitycache.dat", "rb"), SER_DISK, CLIENT_VERSION);
+    if (file.IsNull()) {
+        LogPrintf("Failed to open validity cache file from disk. Continuing anyway.\n");
+        return false;
+    }
+
+    size_t nEntries = 0;
+    try {
+        uint64_t version;
+        file >> version;
+        if (version != VALIDITY_CACHE_DUMP_VERSION) {
+            LogPrintf("Unknown validity cache file version %d. Continuing anyway.\n", version);
+            return false;
+        }
+        int nClientVersion;
+        file >> nClientVersion;
+        // What is valid can change between releases, for example when a
+        // check is fixed, so only the entries of this release are trusted.
+        if (nClientVersion != CLIENT_VERSION) {
+            LogPrintf("Validity cache file is from client version %d. Continuing anyway.\n", nClientVersion);
+            return false;
+        }
+
+        uint256 nonce;
+        std::vector<uint256> vEntries;
+        file >> nonce;
+        file >> vEntries;
+        RestoreSignatureCache(nonce, vEntries);
+        nEntries += vEntries.size();
+
+        uint64_t num;
+        file >> num;
+        while (num--) {
+            std::string strKind;
+            std::array<uint8_t, 32> bundleNonce;
+            std::vector<libzcash::BundleCacheEntry> vBundleEntries;
+            file >> strKind;
+            file >> bundleNonce;
+            file >> vBundleEntries;
+            if (!vBundleEntries.empty()) {
+                bundlecache::restore(
+                    strKind,
+                    bundleNonce,
+                    rust::Slice<const uint8_t>(vBundleEntries[0].data(), vBundleEntries.size() * sizeof(libzcash::BundleCacheEntry)));
+                nEntries += vBundleEntries.size();
+            }
+        }
+    } catch (const std::exception& e) {
+        LogPrintf("Failed to deserialize validity cache data on disk: %s. Continuing anyway.\n", e.what());
+        return false;
+    }
+
+    LogPrintf("Imported %u validity cache entries from disk (%.2fms)\n",
+        nEntries, (GetTimeMicros() - nStart) * 0.001);
+    return true;
+}
+
+bool DumpValidityCaches()
+{
+    int64_t nStart = GetTimeMicros();
+
+    uint256 nonce;
+    std::vector<uint256> vEntries;
+    GetSignatureCacheEntries(nonce, vEntries);
+
+    try {
+        fs::path path = GetDataDir() / "validitycache.dat";
+        fs::path temppath = GetDataDir() / "validitycache.dat.new";
+        FILE* filestr = fsbridge::fopen(temppath, "wb");
+        if (!filestr) {
+            return false;
+        }
+
+        CAutoFile file(filestr, SER_DISK, CLIENT_VERSION);
+
+        uint64_t version = VALIDITY_CACHE_DUMP_VERSION;
+        file << version;
+        file << CLIENT_VERSION;
+
+        file << nonce;
+        file << vEntries;
+        size_t nEntries = vEntries.size();
+
+        auto vBundleCaches = libzcash::GetBundleValidityCaches();
+        file << (uint64_t)vBundleCaches.size();
+        for (const auto& [strKind, pcache] : vBundleCaches) {
+            std::vector<libzcash::BundleCacheEntry> vBundleEntries = pcache->GetEntries();
+            file << strKind;
+            file << bundlecache::nonce(strKind);
+            file << vBundleEntries;
+            nEntries += vBundleEntries.size();
+        }
+
+        FileCommit(file.Get());
+        file.fclose();
+        RenameOver(temppath, path);
+        LogPrintf("Dumped %u validity cache entries: %gs\n", nEntries, (GetTimeMicros() - nStart) * 0.000001);
+    } catch (const std::exception& e) {
+        LogPrintf("Failed to dump validity caches: %s. Continuing anyway.\n", e.what());
+        return false;
+    }
+    return true;
+}
+
+namespace {
+/**
+ * The logical timestamps of the blocks of the active chain, by height, as
+ * ConnectBlock writes them to the timestamp index: the time of the block,
+ * or one more than the logical timestamp of its parent if that is later.
+ * The genesis block has none. As they increase along the chain, a range of
+ * them is found by binary search, without scanning the database.
+ *
+ * Kept up to date with the active chain when it is read.
+ */
+std::vector<unsigned int> vActiveLogicalTimes GUARDED_BY(cs_main);
+const CBlockIndex* pindexActiveLogicalTimes GUARDED_BY(cs_main) = nullptr;
+
+void UpdateActiveLogicalTimes() EXCLUSIVE_LOCKS_REQUIRED(cs_main)
+{
+    AssertLockHeld(cs_main);
+    const CBlockIndex* pindexFork = pindexActiveLogicalTimes ? chainActive.FindFork(pindexActiveLogicalTimes) : nullptr;
+    vActiveLogicalTimes.resize(pindexFork ? pindexFork->nHeight + 1 : 0);
+    for (int nHeight = vActiveLogicalTimes.size(); nHeight <= chainActive.Height(); nHeight++) {
+        unsigned int logicalTS = chainActive[nHeight]->nTime;
+        if (nHeight > 1 && logicalTS <= vActiveLogicalTimes[nHeight - 1]) {
+            logicalTS = vActiveLogicalTimes[nHeight - 1] + 1;
+        }
+        vActiveLogicalTimes.push_back(logicalTS);
+    }
+    pindexActiveLogicalTimes = chainActive.Tip();
+}
+} // namespace
+
+bool GetTimestampIndex(unsigned int high, unsigned int low, bool fActiveOnly,
+    const CTimestampIndexKey* pAfter, size_t nLimit,
+    std::vector<std::pair<uint256, unsigned int> > &hashes, bool& fMore)
+{
+    AssertLockHeld(cs_main);
+    if (!fTimestampIndex) {
+        LogPrint("rpc", "Timestamp index not enabled");
+        return false;
+    }
+    // Blocks below a loaded UTXO snapshot were never connected, so they have
+    // no logical timestamps, and those after it are not derived from theirs.
+    if (fActiveOnly && !fHavePruned) {
+        UpdateActiveLogicalTimes();
+        fMore = false;
+        if (vActiveLogicalTimes.size() < 2) {
+            return true;
+        }
+        auto it = std::lower_bound(vActiveLogicalTimes.begin() + 1, vActiveLogicalTimes.end(), low);
+        if (pAfter && pAfter->timestamp >= low) {
+            it = std::lower_bound(vActiveLogicalTimes.begin() + 1, vActiveLogicalTimes.end(), pAfter->timestamp);
+            if (it != vActiveLogicalTimes.end() && *it == pAfter->timestamp &&
+                !(pAfter->blockHash < chainActive[it - vActiveLogicalTimes.begin()]->GetBlockHash())) {
+                ++it;
+            }
+        }
+        for (; it != vActiveLogicalTimes.end() && *it < high; ++it) {
+            if (nLimit > 0 && hashes.size() == nLimit) {
+                fMore = true;
+                break;
+            }
+            hashes.emplace_back(chainActive[it - vActiveLogicalTimes.begin()]->GetBlockHash(), *it);
+        }
+        return true;
+    }
+    if (!pinsightdb->ReadTimestampIndex(high, low, fActiveOnly, pAfter, nLimit, hashes, fMore)) {
         LogPrint("rpc", "Unable to get hashes for timestamps");
         return false;
     }
@@ -2085,7 +3175,30 @@ bool GetSpentIndex(CSpentIndexKey &key, CSpentIndexValue &value)
     if (mempool.getSpentIndex(key, value))
         return true;
 
-    if (!pblocktree->ReadSpentIndex(key, value)) {
+    if (!pinsightdb->ReadSpentIndex(key, value)) {
+        LogPrint("rpc", "Unable to get spent index information");
+        return false;
+    }
+    return true;
+}
+
+bool GetSpentIndex(const std::vector<CSpentIndexKey> &keys, CSpentIndexMap &values)
+{
+    AssertLockHeld(cs_main);
+    if (!fSpentIndex) {
+        LogPrint("rpc", "Spent index not enabled");
+        return false;
+    }
+    std::vector<CSpentIndexKey> vNotInMempool;
+    for (const auto& key : keys) {
+        CSpentIndexValue value;
+        if (mempool.getSpentIndex(key, value)) {
+            values[key] = value;
+        } else {
+            vNotInMempool.push_back(key);
+        }
+    }
+    if (!vNotInMempool.empty() && !pinsightdb->ReadSpentIndex(vNotInMempool, values)) {
         LogPrint("rpc", "Unable to get spent index information");
         return false;
     }
@@ -2100,7 +3213,7 @@ bool GetAddressIndex(const uint160& addressHash, int type,
         LogPrint("rpc", "address index not enabled");
         return false;
     }
-    if (!pblocktree->ReadAddressIndex(addressHash, type, addressIndex, start, end)) {
+    if (!pinsightdb->ReadAddressIndex(addressHash, type, addressIndex, start, end)) {
         LogPrint("rpc", "unable to get txids for address");
         return false;
     }
@@ -2114,13 +3227,37 @@ bool GetAddressUnspent(const uint160& addressHash, int type,
         LogPrint("rpc", "address index not enabled");
         return false;
     }
-    if (!pblocktree->ReadAddressUnspentIndex(addressHash, type, unspentOutputs)) {
+    if (!pinsightdb->ReadAddressUnspentIndex(addressHash, type, unspentOutputs)) {
         LogPrint("rpc", "unable to get txids for address");
         return false;
     }
     return true;
 }
 
+bool GetAddressIndexMerged(const std::vector<std::pair<uint160, int>>& addresses,
+                           int start, int end, const CAddressIndexKey* pAfter, size_t nLimit,
+                           std::vector<CAddressIndexDbEntry>& addressIndex, bool& fMore)
+{
+    if (!fAddressIndex) {
+        LogPrint("rpc", "address index not enabled");
+        return false;
+    }
+    if (!pinsightdb->ReadAddressIndexMerged(addresses, start, end, pAfter, nLimit, addressIndex, fMore)) {
+        LogPrint("rpc", "unable to get txids for addresses");
+        return false;
+    }
+    return true;
+}
+
+bool GetAddressSummary(const uint160& addressHash, int type, CAddressSummary& summary)
+{
+    return fAddressIndex && pinsightdb->ReadAddressSummary(addressHash, type, summary);
+}
+
+static bool ReadStoredBlock(const CDiskBlockPos& pos, const CMessageHeader::MessageStartChars* pMessageStart,
+    std::shared_ptr<CBlockFileMapping>& mapping, std::vector<uint8_t>& vBuffer,
+    const unsigned char*& pch, unsigned int& nSize);
+
 /**
  * Return transaction in txOut, and if it was found inside a block, its hash is placed in hashBlock.
  * If blockIndex is provided, the transaction is fetched from the corresponding block.
@@ -2129,10 +3266,20 @@ bool GetTransaction(const uint256& hash, CTransaction& txOut, const Consensus::P
 {
     const CBlockIndex* pindexSlow = blockIndex;
 
+    if (!blockIndex && !fTxIndex && ptxlocationindex && ptxlocationindex->IsSynced()) {
+        std::vector<std::optional<std::pair<CTransaction, uint256>>> vResult;
+        GetTransactions({hash}, vResult, consensusParams);
+        if (!vResult[0])
+            return false;
+        txOut = vResult[0]->first;
+        hashBlock = vResult[0]->second;
+        return true;
+    }
+
     LOCK(cs_main);
 
     if (!blockIndex) {
-        std::shared_ptr<const CTransaction> ptx = mempool.get(hash);
+        CTransactionRef ptx = mempool.get(hash);
         if (ptx)
         {
             txOut = *ptx;
@@ -2142,14 +3289,20 @@ bool GetTransaction(const uint256& hash, CTransaction& txOut, const Consensus::P
         if (fTxIndex) {
             CDiskTxPos postx;
             if (pblocktree->ReadTxIndex(hash, postx)) {
-                CAutoFile file(OpenBlockFile(postx, true), SER_DISK, CLIENT_VERSION);
-                if (file.IsNull())
-                    return error("%s: OpenBlockFile failed", __func__);
+                // The transaction is at an offset into the serialization of
+                // its block, which may be stored compressed.
+                std::shared_ptr<CBlockFileMapping> mapping;
+                std::vector<uint8_t> vBuffer;
+                const unsigned char* pch;
+                unsigned int nSize;
+                if (!ReadStoredBlock(postx, nullptr, mapping, vBuffer, pch, nSize))
+                    return error("%s: Reading block failed", __func__);
                 CBlockHeader header;
                 try {
-                    file >> header;
-                    fseek(file.Get(), postx.nTxOffset, SEEK_CUR);
-                    file >> txOut;
+                    SpanReader reader(SER_DISK, CLIENT_VERSION, pch, nSize);
+                    reader >> header;
+                    reader.ignore(postx.nTxOffset);
+                    reader >> txOut;
                 } catch (const std::exception& e) {
                     return error("%s: Deserialize or I/O error - %s", __func__, e.what());
                 }
@@ -2192,12 +3345,127 @@ bool GetTransaction(const uint256& hash, CTransaction& txOut, const Consensus::P
     return false;
 }
 
+/**
+ * Read the transactions at the given locations in the block at pos, and keep
+ * those whose txid is the one looked up.
+ */
+static void ReadTransactionsAt(const CDiskBlockPos& pos, const uint256& hashBlock,
+    const std::vector<std::pair<uint32_t, size_t>>& vOffsets, const std::vector<uint256>& hashes,
+    std::vector<std::optional<std::pair<CTransaction, uint256>>>& vResult)
+{
+    std::shared_ptr<const CBlock> precent = recentBlocks.Get(hashBlock);
+    if (precent) {
+        for (const auto& offset : vOffsets) {
+            for (const CTransaction& tx : precent->vtx) {
+                if (tx.GetHash() == hashes[offset.second]) {
+                    vResult[offset.second] = std::make_pair(tx, hashBlock);
+                    break;
+                }
+            }
+        }
+        return;
+    }
+
+    std::shared_ptr<CBlockFileMapping> mapping;
+    std::vector<uint8_t> vBuffer;
+    const unsigned char* pch;
+    unsigned int nSize;
+    if (!ReadStoredBlock(pos, nullptr, mapping, vBuffer, pch, nSize)) {
+        LogPrintf("%s: Reading block %s failed\n", __func__, hashBlock.ToString());
+        return;
+    }
+    size_t nHeaderSize;
+    try {
+        SpanReader reader(SER_DISK, CLIENT_VERSION, pch, nSize);
+        CBlockHeader header;
+        reader >> header;
+        nHeaderSize = nSize - reader.size();
+    } catch (const std::exception& e) {
+        LogPrintf("%s: Deserialize or I/O error - %s\n", __func__, e.what());
+        return;
+    }
+    for (const auto& offset : vOffsets) {
+        if (vResult[offset.second] || offset.first >= nSize - nHeaderSize)
+            continue;
+        // A location left over from a block that was reorganized away may
+        // point into the middle of a transaction; the txid check rejects it.
+        try {
+            SpanReader reader(SER_DISK, CLIENT_VERSION, pch + nHeaderSize + offset.first, nSize - nHeaderSize - offset.first);
+            CTransaction tx;
+            reader >> tx;
+            if (tx.GetHash() == hashes[offset.second])
+                vResult[offset.second] = std::make_pair(tx, hashBlock);
+        } catch (const std::exception&) {
+        }
+    }
+}
+
+void GetTransactions(const std::vector<uint256>& hashes, std::vector<std::optional<std::pair<CTransaction, uint256>>>& vResult, const Consensus::Params& consensusParams)
+{
+    vResult.assign(hashes.size(), std::nullopt);
+
+    std::vector<uint256> vMissing;
+    std::vector<size_t> vMissingIndex;
+    for (size_t i = 0; i < hashes.size(); i++) {
+        CTransactionRef ptx = mempool.get(hashes[i]);
+        if (ptx) {
+            vResult[i] = std::make_pair(*ptx, uint256());
+        } else {
+            vMissing.push_back(hashes[i]);
+            vMissingIndex.push_back(i);
+        }
+    }
+    if (vMissing.empty())
+        return;
+
+    if (ptxlocationindex) {
+        std::vector<std::vector<CTxLocation>> vLocations;
+        ptxlocationindex->FindTransactions(vMissing, vLocations);
+
+        // The candidate locations of each block, with the block files in
+        // the order they are read.
+        std::map<std::pair<int, unsigned int>, std::pair<uint256, std::vector<std::pair<uint32_t, size_t>>>> mapBlocks;
+        {
+            LOCK(cs_main);
+            for (size_t i = 0; i < vMissing.size(); i++) {
+                for (const CTxLocation& location : vLocations[i]) {
+                    const CBlockIndex* pindex = chainActive[location.nHeight];
+                    if (pindex == NULL || !(pindex->nStatus & BLOCK_HAVE_DATA))
+                        continue;
+                    auto& entry = mapBlocks[std::make_pair(pindex->nFile, pindex->nDataPos)];
+                    entry.first = pindex->GetBlockHash();
+                    entry.second.emplace_back(location.nTxOffset, vMissingIndex[i]);
+                }
+            }
+        }
+        for (auto& entry : mapBlocks) {
+            std::sort(entry.second.second.begin(), entry.second.second.end());
+            CDiskBlockPos pos(entry.first.first, entry.first.second);
+            ReadTransactionsAt(pos, entry.second.first, entry.second.second, hashes, vResult);
+        }
+
+        // Until the index has caught up, what it has not found may still be
+        // found otherwise.
+        if (ptxlocationindex->IsSynced())
+            return;
+    }
+
+    for (size_t i : vMissingIndex) {
+        if (vResult[i])
+            continue;
+        CTransaction tx;
+        uint256 hashBlock;
+        if (GetTransaction(hashes[i], tx, consensusParams, hashBlock, true))
+            vResult[i] = std::make_pair(tx, hashBlock);
+    }
+}
+
 //////////////////////////////////////////////////////////////////////////////
 //
 // CBlock and CBlockIndex
 //
 
-bool WriteBlockToDisk(const CBlock& block, CDiskBlockPos& pos, const CMessageHeader::MessageStartChars& messageStart)
+bool WriteBlockToDisk(const CStoredBlock& stored, CDiskBlockPos& pos, const CMessageHeader::MessageStartChars& messageStart)
 {
     // Open history file to append
     CAutoFile fileout(OpenBlockFile(pos), SER_DISK, CLIENT_VERSION);
@@ -2205,59 +3473,206 @@ bool WriteBlockToDisk(const CBlock& block, CDiskBlockPos& pos, const CMessageHea
         return error("WriteBlockToDisk: OpenBlockFile failed");
 
     // Write index header
-    unsigned int nSize = GetSerializeSize(fileout, block);
-    fileout << FLATDATA(messageStart) << nSize;
+    fileout << FLATDATA(messageStart) << stored.nSizeField;
 
     // Write block
     long fileOutPos = ftell(fileout.Get());
     if (fileOutPos < 0)
         return error("WriteBlockToDisk: ftell failed");
     pos.nPos = (unsigned int)fileOutPos;
-    fileout << block;
+    fileout.write((const char*)stored.vData.data(), stored.vData.size());
 
     return true;
 }
 
-bool ReadBlockFromDisk(CBlock& block, const CDiskBlockPos& pos, const Consensus::Params& consensusParams)
+bool WriteBlockToDisk(const CBlock& block, CDiskBlockPos& pos, const CMessageHeader::MessageStartChars& messageStart)
+{
+    return WriteBlockToDisk(CStoredBlock(block, fBlockCompression), pos, messageStart);
+}
+
+/**
+ * Find the serialization of the block at pos, as written by WriteBlockToDisk.
+ * Sets pch and nSize to it, in the mapping of the block file if that can be
+ * mapped and the block is not compressed, and otherwise in vBuffer. The
+ * message start before the block is checked if pMessageStart is set.
+ */
+static bool ReadStoredBlock(const CDiskBlockPos& pos, const CMessageHeader::MessageStartChars* pMessageStart,
+    std::shared_ptr<CBlockFileMapping>& mapping, std::vector<uint8_t>& vBuffer,
+    const unsigned char*& pch, unsigned int& nSize)
+{
+    // The block is preceded by the message start and its size.
+    const unsigned int nHeaderSize = CMessageHeader::MESSAGE_START_SIZE + sizeof(unsigned int);
+    if (pos.nPos < nHeaderSize)
+        return error("%s: Invalid block position %s", __func__, pos.ToString());
+
+    bool fCompressed;
+    mapping = blockReader.MapBlock(pos, pch, nSize, fCompressed);
+    if (mapping) {
+        if (pMessageStart && memcmp(pch - nHeaderSize, *pMessageStart, CMessageHeader::MESSAGE_START_SIZE) != 0)
+            return error("%s: Block magic mismatch at %s", __func__, pos.ToString());
+    } else {
+        CDiskBlockPos hpos = pos;
+        hpos.nPos -= nHeaderSize;
+        CAutoFile filein(OpenBlockFile(hpos, true), SER_DISK, CLIENT_VERSION);
+        if (filein.IsNull())
+            return error("%s: OpenBlockFile failed for %s", __func__, pos.ToString());
+
+        try {
+            CMessageHeader::MessageStartChars blkStart;
+            uint32_t nSizeField;
+            filein >> FLATDATA(blkStart) >> nSizeField;
+
+            if (pMessageStart && memcmp(blkStart, *pMessageStart, CMessageHeader::MESSAGE_START_SIZE) != 0)
+                return error("%s: Block magic mismatch at %s", __func__, pos.ToString());
+            fCompressed = nSizeField & BLOCK_COMPRESSED_FLAG;
+            nSize = nSizeField & ~BLOCK_COMPRESSED_FLAG;
+            if (nSize > MAX_BLOCK_SIZE)
+                return error("%s: Block data is larger than the maximum block size at %s", __func__, pos.ToString());
+
+            vBuffer.resize(nSize);
+            filein.read((char*)vBuffer.data(), nSize);
+        }
+        catch (const std::exception& e) {
+            return error("%s: I/O error - %s at %s", __func__, e.what(), pos.ToString());
+        }
+        pch = vBuffer.data();
+    }
+
+    if (fCompressed) {
+        std::vector<uint8_t> vBlock;
+        if (!DecompressBlockData(pch, nSize, vBlock))
+            return error("%s: Corrupt compressed block at %s", __func__, pos.ToString());
+        vBuffer.swap(vBlock);
+        pch = vBuffer.data();
+        nSize = vBuffer.size();
+    }
+    return true;
+}
+
+/**
+ * Read a block, checking its header unless the caller checks that it is one
+ * whose header was checked when it was accepted. Only checked blocks are
+ * cached.
+ */
+static bool ReadBlockFromDisk(CBlock& block, const CDiskBlockPos& pos, const Consensus::Params& consensusParams, bool fCheckHeader)
 {
     block.SetNull();
 
-    // Open history file to read
-    CAutoFile filein(OpenBlockFile(pos, true), SER_DISK, CLIENT_VERSION);
-    if (filein.IsNull())
-        return error("ReadBlockFromDisk: OpenBlockFile failed for %s", pos.ToString());
+    // A block that was read recently has already been checked.
+    std::shared_ptr<const CBlock> pcached = blockReader.GetCached(pos);
+    if (pcached) {
+        block = *pcached;
+        return true;
+    }
+
+    std::shared_ptr<CBlockFileMapping> mapping;
+    std::vector<uint8_t> vBuffer;
+    const unsigned char* pch;
+    unsigned int nSize;
+    if (!ReadStoredBlock(pos, nullptr, mapping, vBuffer, pch, nSize))
+        return false;
 
     // Read block
     try {
-        filein >> block;
+        SpanReader reader(SER_DISK, CLIENT_VERSION, pch, nSize);
+        reader >> block;
     }
     catch (const std::exception& e) {
-        return error("%s: Deserialize or I/O error - %s at %s", __func__, e.what(), pos.ToString());
+        return error("%s: Deserialize error - %s at %s", __func__, e.what(), pos.ToString());
     }
 
+    if (!fCheckHeader)
+        return true;
+
     // Check the header
     if (!(CheckEquihashSolution(&block, consensusParams) &&
           CheckProofOfWork(block.GetHash(), block.nBits, consensusParams)))
         return error("ReadBlockFromDisk: Errors in block header at %s", pos.ToString());
 
+    blockReader.AddToCache(pos, block);
     return true;
 }
 
+bool ReadBlockFromDisk(CBlock& block, const CDiskBlockPos& pos, const Consensus::Params& consensusParams)
+{
+    return ReadBlockFromDisk(block, pos, consensusParams, true);
+}
+
 bool ReadBlockFromDisk(CBlock& block, const CBlockIndex* pindex, const Consensus::Params& consensusParams)
 {
+    std::shared_ptr<const CBlock> precent = recentBlocks.Get(pindex->GetBlockHash());
+    if (precent) {
+        block = *precent;
+        return true;
+    }
+
     if (pindex->GetBlockPos().IsNull()) {
         return error("ReadBlockFromDisk(CBlock&, CBlockIndex*): block index entry does not provide a valid disk position for block %s at %s",
                 pindex->ToString(), pindex->GetBlockPos().ToString());
     }
 
-    if (!ReadBlockFromDisk(block, pindex->GetBlockPos(), consensusParams))
+    // The Equihash solution and proof of work of a header that was accepted
+    // into the block tree have been checked, and the block hash commits to
+    // them, so a block that matches the hash needs no further checks. The
+    // validity of an index entry only ever goes up, so this may be read
+    // without cs_main.
+    bool fCheckHeader = fCheckBlockReads || !pindex->IsValid(BLOCK_VALID_TREE);
+    if (!ReadBlockFromDisk(block, pindex->GetBlockPos(), consensusParams, fCheckHeader))
         return false;
     if (block.GetHash() != pindex->GetBlockHash())
         return error("ReadBlockFromDisk(CBlock&, CBlockIndex*): GetHash() doesn't match index for %s at %s",
                 pindex->ToString(), pindex->GetBlockPos().ToString());
+    if (!fCheckHeader)
+        blockReader.AddToCache(pindex->GetBlockPos(), block);
+    return true;
+}
+
+bool ReadRawBlockFromDisk(std::vector<uint8_t>& block, const CDiskBlockPos& pos, const CMessageHeader::MessageStartChars& messageStart)
+{
+    std::shared_ptr<CBlockFileMapping> mapping;
+    std::vector<uint8_t> vBuffer;
+    const unsigned char* pch;
+    unsigned int nSize;
+    if (!ReadStoredBlock(pos, &messageStart, mapping, vBuffer, pch, nSize))
+        return false;
+
+    if (pch == vBuffer.data())
+        block.swap(vBuffer);
+    else
+        block.assign(pch, pch + nSize);
     return true;
 }
 
+bool ReadBlockFromDisk(std::shared_ptr<const CBlock>& pblock, const CBlockIndex* pindex, const Consensus::Params& consensusParams)
+{
+    pblock = recentBlocks.Get(pindex->GetBlockHash());
+    if (pblock) {
+        return true;
+    }
+
+    std::shared_ptr<CBlock> pblockRead = std::make_shared<CBlock>();
+    if (!ReadBlockFromDisk(*pblockRead, pindex, consensusParams))
+        return false;
+    pblock = std::move(pblockRead);
+    return true;
+}
+
+bool ReadRawBlockFromDisk(std::vector<uint8_t>& block, const CBlockIndex* pindex, const CMessageHeader::MessageStartChars& messageStart)
+{
+    std::shared_ptr<const std::vector<uint8_t>> pvRaw = recentBlocks.GetRaw(pindex->GetBlockHash());
+    if (pvRaw) {
+        block = *pvRaw;
+        return true;
+    }
+
+    if (pindex->GetBlockPos().IsNull()) {
+        return error("ReadRawBlockFromDisk(std::vector<uint8_t>&, CBlockIndex*): block index entry does not provide a valid disk position for block %s at %s",
+                pindex->ToString(), pindex->GetBlockPos().ToString());
+    }
+
+    return ReadRawBlockFromDisk(block, pindex->GetBlockPos(), messageStart);
+}
+
 static std::atomic<bool> IBDLatchToFalse{false};
 // testing-only, allow initial block down state to be set or reset
 bool TestSetIBD(bool ibd) {
@@ -2520,6 +3935,33 @@ bool CScriptCheck::operator()() {
     return true;
 }
 
+/**
+ * Returns the number of proofs and signatures that a transaction contributes
+ * to the Sapling and Orchard batch validators.
+ */
+static size_t GetShieldedBatchWeight(const CTransaction& tx) {
+    return tx.GetSaplingSpendsCount() +
+        tx.GetSaplingOutputsCount() +
+        tx.GetOrchardBundle().GetNumActions();
+}
+
+bool CShieldedBatchCheck::operator()() {
+    // Both batches are always validated, so that a failure is attributed to
+    // the correct pool.
+    if (saplingAuth.has_value() && !saplingAuth.value()->validate()) {
+        result->fSaplingValid = false;
+    }
+    if (orchardAuth.has_value() && !orchardAuth.value()->validate()) {
+        result->fOrchardValid = false;
+    }
+    return result->fSaplingValid && result->fOrchardValid;
+}
+
+bool CTransactionCheck::operator()() {
+    CValidationState state;
+    return CheckTransactionWithoutProofVerification(*ptx, state);
+}
+
 int GetSpendHeight(const CCoinsViewCache& inputs)
 {
     LOCK(cs_main);
@@ -2616,6 +4058,88 @@ bool CheckTxInputs(const CTransaction& tx, CValidationState& state, const CCoins
 }
 }// namespace Consensus
 
+namespace {
+
+/**
+ * Transactions whose transparent inputs have all been found valid under a
+ * set of script flags and a consensus branch ID. The scripts being spent are
+ * fixed by the outpoints, so a transaction that was checked when it entered
+ * the mempool, or by TestBlockValidity, does not have its scripts run again
+ * when its block is connected.
+ */
+class CScriptExecutionCache
+{
+private:
+    //! Entries are SHA256(nonce || txid || auth digest || flags || branch
+    //! ID), so that they cannot be chosen to collide in the cache.
+    uint256 nonce;
+    CuckooCache::cache<uint256, SignatureCacheHasher> setValid;
+    boost::shared_mutex cs_scriptexecutioncache;
+
+public:
+    CScriptExecutionCache()
+    {
+        GetRandBytes(nonce.begin(), 32);
+        // Resized by InitScriptExecutionCache.
+        setValid.setup_bytes(1 << 20);
+    }
+
+    size_t Setup(size_t nBytes)
+    {
+        return setValid.setup_bytes(nBytes);
+    }
+
+    uint256 ComputeEntry(const CTransaction& tx, unsigned int flags, uint32_t consensusBranchId) const
+    {
+        uint256 entry;
+        unsigned char buf[8];
+        WriteLE32(buf, flags);
+        WriteLE32(buf + 4, consensusBranchId);
+        CSHA256()
+            .Write(nonce.begin(), 32)
+            .Write(tx.GetHash().begin(), 32)
+            .Write(tx.GetAuthDigest().begin(), 32)
+            .Write(buf, sizeof(buf))
+            .Finalize(entry.begin());
+        return entry;
+    }
+
+    bool Contains(const uint256& entry, bool erase)
+    {
+        boost::shared_lock<boost::shared_mutex> lock(cs_scriptexecutioncache);
+        return setValid.contains(entry, erase);
+    }
+
+    void Insert(const uint256& entry)
+    {
+        boost::unique_lock<boost::shared_mutex> lock(cs_scriptexecutioncache);
+        setValid.insert(entry);
+    }
+
+    CCacheStats GetStats()
+    {
+        boost::shared_lock<boost::shared_mutex> lock(cs_scriptexecutioncache);
+        return CuckooCacheStats<uint256>(setValid);
+    }
+};
+
+static CScriptExecutionCache scriptExecutionCache;
+
+}
+
+void InitScriptExecutionCache(size_t nMaxCacheSize)
+{
+    if (nMaxCacheSize <= 0) return;
+    size_t nElems = scriptExecutionCache.Setup(nMaxCacheSize);
+    LogPrintf("Using %zu MiB out of %zu requested for script execution cache, able to store %zu elements\n",
+            (nElems*sizeof(uint256)) >>20, nMaxCacheSize>>20, nElems);
+}
+
+CCacheStats GetScriptExecutionCacheStats()
+{
+    return scriptExecutionCache.GetStats();
+}
+
 bool ContextualCheckInputs(
     const CTransaction& tx,
     CValidationState &state,
@@ -2645,6 +4169,15 @@ bool ContextualCheckInputs(
         // before the last block chain checkpoint. This is safe because block merkle hashes are
         // still computed and checked, and any change will be caught at the next checkpoint.
         if (fScriptChecks) {
+            // A transaction checked with the same flags has nothing left to
+            // verify. When results are not being cached, as when a block is
+            // connected, the entry will not be needed again and may be
+            // evicted.
+            uint256 hashCacheEntry = scriptExecutionCache.ComputeEntry(tx, flags, consensusBranchId);
+            if (scriptExecutionCache.Contains(hashCacheEntry, !cacheStore)) {
+                return true;
+            }
+
             for (unsigned int i = 0; i < tx.vin.size(); i++) {
                 const COutPoint &prevout = tx.vin[i].prevout;
                 const CCoins* coins = inputs.AccessCoins(prevout.hash);
@@ -2690,6 +4223,11 @@ bool ContextualCheckInputs(
                     return state.DoS(100,false, REJECT_INVALID, strprintf("mandatory-script-verify-flag-failed (%s)", ScriptErrorString(check.GetScriptError())));
                 }
             }
+
+            // Checks that were deferred to pvChecks have not run yet.
+            if (cacheStore && !pvChecks) {
+                scriptExecutionCache.Insert(hashCacheEntry);
+            }
         }
     }
 
@@ -2725,6 +4263,8 @@ bool UndoWriteToDisk(const CBlockUndo& blockundo, CDiskBlockPos& pos, const uint
     return true;
 }
 
+} // anon namespace
+
 bool UndoReadFromDisk(CBlockUndo& blockundo, const CDiskBlockPos& pos, const uint256& hashBlock)
 {
     // Open history file to read
@@ -2752,8 +4292,6 @@ bool UndoReadFromDisk(CBlockUndo& blockundo, const CDiskBlockPos& pos, const uin
     return true;
 }
 
-} // anon namespace
-
 /**
  * Apply the undo operation of a CTxInUndo to the given chain state.
  * @param undo The undo object.
@@ -2797,24 +4335,31 @@ enum DisconnectResult
 /** Undo the effects of this block (with given index) on the UTXO set represented by coins.
  *  When UNCLEAN or FAILED is returned, view is left in an indeterminate state.
  *  The addressIndex and spentIndex will be updated if requested.
+ *  If pblockundo is not NULL, the undo data that was applied is stored in it.
+ *  If fHaveUndo is set, pblockundo already holds the undo data of the block,
+ *  read ahead of time, and it is not read again.
  */
 static DisconnectResult DisconnectBlock(const CBlock& block, CValidationState& state,
     const CBlockIndex* pindex, CCoinsViewCache& view, const CChainParams& chainparams,
-    const bool updateIndices)
+    const bool updateIndices, CBlockUndo* pblockundo = NULL, bool fHaveUndo = false)
 {
     assert(pindex->GetBlockHash() == view.GetBestBlock());
 
     bool fClean = true;
 
     CBlockUndo blockUndo;
-    CDiskBlockPos pos = pindex->GetUndoPos();
-    if (pos.IsNull()) {
-        error("DisconnectBlock(): no undo data available");
-        return DISCONNECT_FAILED;
-    }
-    if (!UndoReadFromDisk(blockUndo, pos, pindex->pprev->GetBlockHash())) {
-        error("DisconnectBlock(): failure reading undo data");
-        return DISCONNECT_FAILED;
+    if (fHaveUndo) {
+        blockUndo = std::move(*pblockundo);
+    } else {
+        CDiskBlockPos pos = pindex->GetUndoPos();
+        if (pos.IsNull()) {
+            error("DisconnectBlock(): no undo data available");
+            return DISCONNECT_FAILED;
+        }
+        if (!UndoReadFromDisk(blockUndo, pos, pindex->pprev->GetBlockHash())) {
+            error("DisconnectBlock(): failure reading undo data");
+            return DISCONNECT_FAILED;
+        }
     }
 
     if (blockUndo.vtxundo.size() + 1 != block.vtx.size()) {
@@ -2978,26 +4523,128 @@ static DisconnectResult DisconnectBlock(const CBlock& block, CValidationState& s
 
     // insightexplorer
     if (fAddressIndex && updateIndices) {
-        if (!pblocktree->EraseAddressIndex(addressIndex)) {
+        if (!pinsightdb->EraseAddressIndex(addressIndex)) {
             AbortNode(state, "Failed to delete address index");
             return DISCONNECT_FAILED;
         }
-        if (!pblocktree->UpdateAddressUnspentIndex(addressUnspentIndex)) {
+        if (!pinsightdb->UpdateAddressUnspentIndex(addressUnspentIndex)) {
             AbortNode(state, "Failed to write address unspent index");
             return DISCONNECT_FAILED;
         }
     }
     // insightexplorer
     if (fSpentIndex && updateIndices) {
-        if (!pblocktree->UpdateSpentIndex(spentIndex)) {
+        if (!pinsightdb->UpdateSpentIndex(spentIndex)) {
             AbortNode(state, "Failed to write transaction index");
             return DISCONNECT_FAILED;
         }
     }
+    if (pblockundo)
+        *pblockundo = std::move(blockUndo);
     return fClean ? DISCONNECT_OK : DISCONNECT_UNCLEAN;
 }
 
-void static FlushBlockFile(bool fFinalize = false)
+/** Commit the block and undo files numbered nFile to disk. */
+static void CommitBlockFile(int nFile)
+{
+    CDiskBlockPos pos(nFile, 0);
+
+    FILE *file = OpenBlockFile(pos, true);
+    if (file) {
+        FileCommit(file);
+        fclose(file);
+    }
+
+    file = OpenUndoFile(pos, true);
+    if (file) {
+        FileCommit(file);
+        fclose(file);
+    }
+}
+
+namespace {
+
+Mutex cs_blockFileSync;
+std::condition_variable condBlockFileSync;
+std::set<int> setBlockFileSyncQueue;
+//! The number of files queued or being committed.
+int nBlockFileSyncPending = 0;
+bool fStopBlockFileSync = false;
+std::thread threadBlockFileSync;
+
+void ThreadBlockFileSync()
+{
+    RenameThread("zc-blocksync");
+    while (true) {
+        std::set<int> setFiles;
+        {
+            WAIT_LOCK(cs_blockFileSync, lock);
+            condBlockFileSync.wait(lock, [] { return !setBlockFileSyncQueue.empty() || fStopBlockFileSync; });
+            if (setBlockFileSyncQueue.empty()) {
+                return;
+            }
+            setFiles.swap(setBlockFileSyncQueue);
+        }
+        for (int nFile : setFiles) {
+            CommitBlockFile(nFile);
+        }
+        {
+            LOCK(cs_blockFileSync);
+            nBlockFileSyncPending -= setFiles.size();
+        }
+        condBlockFileSync.notify_all();
+    }
+}
+
+/**
+ * Commit the block and undo files numbered nFile to disk on a background
+ * thread. They must be committed before the block index that refers to
+ * their blocks is written, which WaitForBlockFileSync is for.
+ */
+void QueueBlockFileSync(int nFile)
+{
+    {
+        LOCK(cs_blockFileSync);
+        if (setBlockFileSyncQueue.insert(nFile).second) {
+            nBlockFileSyncPending++;
+        }
+        if (!threadBlockFileSync.joinable()) {
+            fStopBlockFileSync = false;
+            threadBlockFileSync = std::thread(&ThreadBlockFileSync);
+        }
+    }
+    condBlockFileSync.notify_all();
+}
+
+}
+
+void WaitForBlockFileSync()
+{
+    WAIT_LOCK(cs_blockFileSync, lock);
+    condBlockFileSync.wait(lock, [] { return nBlockFileSyncPending == 0; });
+}
+
+void StopBlockFileSync()
+{
+    {
+        LOCK(cs_blockFileSync);
+        fStopBlockFileSync = true;
+    }
+    condBlockFileSync.notify_all();
+    if (threadBlockFileSync.joinable()) {
+        threadBlockFileSync.join();
+    }
+}
+
+/**
+ * Flush the last block and undo files to disk. If fFinalize is set, they are
+ * first truncated to the data they hold. If fQueueCommit is set, they are
+ * committed on the background thread instead, as they are when the node
+ * moves on to new files; only the truncation, which must not race with the
+ * writes that FindUndoPos makes room for, is done here under
+ * cs_LastBlockFile.
+ */
+void static FlushBlockFile(bool fFinalize = false, bool fQueueCommit = false)
 {
     LOCK(cs_LastBlockFile);
 
@@ -3007,26 +4654,88 @@ void static FlushBlockFile(bool fFinalize = false)
     if (fileOld) {
         if (fFinalize)
             TruncateFile(fileOld, vinfoBlockFile[nLastBlockFile].nSize);
-        FileCommit(fileOld);
+        if (!fQueueCommit)
+            FileCommit(fileOld);
+        fclose(fileOld);
+    }
+
+    fileOld = OpenUndoFile(posOld);
+    if (fileOld) {
+        if (fFinalize)
+            TruncateFile(fileOld, vinfoBlockFile[nLastBlockFile].nUndoSize);
+        if (!fQueueCommit)
+            FileCommit(fileOld);
         fclose(fileOld);
     }
 
-    fileOld = OpenUndoFile(posOld);
-    if (fileOld) {
-        if (fFinalize)
-            TruncateFile(fileOld, vinfoBlockFile[nLastBlockFile].nUndoSize);
-        FileCommit(fileOld);
-        fclose(fileOld);
-    }
+    if (fQueueCommit)
+        QueueBlockFileSync(nLastBlockFile);
+}
+
+bool FindUndoPos(CValidationState &state, int nFile, CDiskBlockPos &pos, unsigned int nAddSize);
+
+void ThreadScriptCheck() {
+    RenameThread("zc-scriptcheck");
+    scriptcheckqueue.Thread();
+}
+
+void ThreadProofCheck() {
+    RenameThread("zc-proofcheck");
+    proofcheckqueue.Thread();
+}
+
+void ThreadCoinsPrefetch() {
+    RenameThread("zc-coinsprefetch");
+    coinsprefetchqueue.Thread();
+}
+
+void ThreadHeaderCheck() {
+    RenameThread("zc-headercheck");
+    headercheckqueue.Thread();
 }
 
-bool FindUndoPos(CValidationState &state, int nFile, CDiskBlockPos &pos, unsigned int nAddSize);
+void ThreadTxCheck() {
+    RenameThread("zc-txcheck");
+    txcheckqueue.Thread();
+}
 
-static CCheckQueue<CScriptCheck> scriptcheckqueue(128);
+/**
+ * Run the context-free checks that do not verify proofs of the transactions of
+ * a block on the transaction check threads. Returns false if any of them fails,
+ * or if there are no such threads; the transactions then have to be checked
+ * one by one.
+ */
+static bool CheckTransactionsWithoutProofVerification(const std::vector<CTransaction>& vtx)
+{
+    if (!nScriptCheckThreads || vtx.size() < 2)
+        return false;
 
-void ThreadScriptCheck() {
-    RenameThread("zc-scriptcheck");
-    scriptcheckqueue.Thread();
+    CCheckQueueControl<CTransactionCheck> control(&txcheckqueue);
+    std::vector<CTransactionCheck> vChecks;
+    vChecks.reserve(vtx.size());
+    for (const CTransaction& tx : vtx)
+        vChecks.emplace_back(&tx);
+    control.Add(vChecks);
+    return control.Wait();
+}
+
+/**
+ * Check the Equihash solutions of headers on the header check threads.
+ * Returns false if any of them is invalid, or if there are no such threads;
+ * the solutions then have to be checked one by one with the headers.
+ */
+static bool CheckEquihashSolutions(const std::vector<const CBlockHeader*>& headers, const Consensus::Params& consensusParams)
+{
+    if (!nScriptCheckThreads || headers.empty())
+        return false;
+
+    CCheckQueueControl<CEquihashCheck> control(&headercheckqueue);
+    std::vector<CEquihashCheck> vChecks;
+    vChecks.reserve(headers.size());
+    for (const CBlockHeader* pheader : headers)
+        vChecks.emplace_back(pheader, &consensusParams);
+    control.Add(vChecks);
+    return control.Wait();
 }
 
 static int64_t nTimeVerify = 0;
@@ -3035,6 +4744,29 @@ static int64_t nTimeIndex = 0;
 static int64_t nTimeCallbacks = 0;
 static int64_t nTimeTotal = 0;
 
+/** Record the time taken by a stage of accepting or connecting a block. */
+static void RecordBlockStage(const char* pszStage, int64_t nMicros)
+{
+    MetricsHistogram("zcash.chain.block.stage.seconds", nMicros * 0.000001, "stage", pszStage);
+}
+
+std::map<std::string, int64_t>* pConnectBlockStageTimes = NULL;
+
+/**
+ * Record the time taken by a stage of ConnectBlock. Blocks that are only
+ * checked are left out of the metrics, but not out of pConnectBlockStageTimes.
+ */
+static void RecordConnectBlockStage(bool fJustCheck, const char* pszStage, int64_t nMicros)
+{
+    AssertLockHeld(cs_main);
+    if (!fJustCheck) {
+        RecordBlockStage(pszStage, nMicros);
+    }
+    if (pConnectBlockStageTimes) {
+        (*pConnectBlockStageTimes)[pszStage] += nMicros;
+    }
+}
+
 /**
  * Determine whether to do transaction checks when verifying blocks.
  * Returns `false` (allowing transaction checks to be skipped) only if all
@@ -3050,10 +4782,70 @@ static bool ShouldCheckTransactions(const CChainParams& chainparams, const CBloc
              && Checkpoints::IsAncestorOfLastCheckpoint(chainparams.Checkpoints(), pindex));
 }
 
+/**
+ * Determine whether to check the Equihash solution of a header at the given
+ * height when it is accepted. Returns `false` only if all of the following
+ * are true:
+ *   - the `-fastheadersync` flag is set
+ *   - checkpoints are enabled
+ *   - the height is at most that of the last checkpoint.
+ * Such headers must match the checkpoints at the checkpoint heights, so a
+ * chain of them that reaches the last checkpoint is tied to it by the hash
+ * chain alone. Their solutions are still checked with their blocks.
+ */
+bool ShouldCheckHeaderSolution(const CChainParams& chainparams, int nHeight) {
+    return !(fFastHeaderSync
+             && fCheckpointsEnabled
+             && nHeight <= Checkpoints::GetTotalBlocksEstimate(chainparams.Checkpoints()));
+}
+
+/**
+ * Determine whether a block's scripts and proofs may be assumed valid because
+ * of `-assumevalid`. This is the case only if all of the following are true:
+ *   - the assumed-valid block is in our block index;
+ *   - pindex is an ancestor of both the assumed-valid block and the best header;
+ *   - the best header has at least the minimum chain work; and
+ *   - the best header is at least two weeks' worth of work past pindex, so that
+ *     a fake chain containing the assumed-valid block would be expensive.
+ * Coin, nullifier and anchor accounting is unaffected.
+ */
+static bool IsAncestorOfAssumeValid(const Consensus::Params& consensusParams, const CBlockIndex* pindex)
+{
+    AssertLockHeld(cs_main);
+    if (hashAssumeValid.IsNull() || pindexBestHeader == nullptr) {
+        return false;
+    }
+    BlockMap::const_iterator it = mapBlockIndex.find(hashAssumeValid);
+    if (it == mapBlockIndex.end()) {
+        return false;
+    }
+    return it->second->GetAncestor(pindex->nHeight) == pindex &&
+        pindexBestHeader->GetAncestor(pindex->nHeight) == pindex &&
+        pindexBestHeader->nChainWork >= UintToArith256(consensusParams.nMinimumChainWork) &&
+        GetBlockProofEquivalentTime(*pindexBestHeader, *pindex, *pindexBestHeader, consensusParams) > 60 * 60 * 24 * 7 * 2;
+}
+
+/**
+ * Largest allocation of a PrecomputedTransactionData made by ConnectBlock:
+ * the object together with the control block that std::allocate_shared
+ * places in front of it, with room to spare for other standard libraries.
+ */
+static constexpr size_t TXDATA_POOL_BLOCK_SIZE =
+    sizeof(PrecomputedTransactionData) + sizeof(void*) * 4;
+static_assert(TXDATA_POOL_BLOCK_SIZE % alignof(void*) == 0,
+    "TXDATA_POOL_BLOCK_SIZE must be a multiple of the pool alignment");
+typedef PoolAllocator<PrecomputedTransactionData, TXDATA_POOL_BLOCK_SIZE, alignof(void*)> TxDataPoolAllocator;
+typedef TxDataPoolAllocator::ResourceType TxDataPoolResource;
+
 bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pindex,
                   CCoinsViewCache& view, const CChainParams& chainparams,
-                  bool fJustCheck, CheckAs blockChecks)
+                  bool fJustCheck, CheckAs blockChecks,
+                  CBlockUndo* pblockundo)
 {
+    auto span = TracingSpan("debug", "bench", "ConnectBlock",
+        "height", std::to_string(pindex->nHeight).c_str());
+    auto spanGuard = span.Enter();
+
     AssertLockHeld(cs_main);
 
     auto consensusParams = chainparams.GetConsensus();
@@ -3083,12 +4875,18 @@ bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pin
         fExpensiveChecks = false;
     }
 
+    // If this block is an ancestor of the assumed-valid block, disable expensive checks
+    if (blockChecks == CheckAs::Block && IsAncestorOfAssumeValid(consensusParams, pindex)) {
+        fExpensiveChecks = false;
+    }
+
     // Don't cache results if we're actually connecting blocks or benchmarking
     // (still consult the cache, though, which will be empty for benchmarks).
     bool fCacheResults = fJustCheck && (blockChecks != CheckAs::SlowBenchmark);
 
-    // proof verification is expensive, disable if possible
-    auto verifier = fExpensiveChecks ? ProofVerifier::Strict() : ProofVerifier::Disabled();
+    // proof verification is expensive, disable if possible, and otherwise
+    // check the block's Sprout proofs together
+    auto verifier = fExpensiveChecks ? ProofVerifier::Batch(fCacheResults) : ProofVerifier::Disabled();
 
     // Disable Sapling and Orchard batch validation if possible.
     std::optional<rust::Box<sapling::BatchValidator>> saplingAuth = fExpensiveChecks ?
@@ -3106,6 +4904,10 @@ bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pin
     {
         return false;
     }
+    if (!verifier.ValidateBatch()) {
+        return state.DoS(100, error("ConnectBlock(): joinsplit proofs of the block do not verify"),
+                         REJECT_INVALID, "bad-txns-joinsplit-verification-failed");
+    }
 
     // verify that the view's current state corresponds to the previous block
     uint256 hashPrevBlock = pindex->pprev == NULL ? uint256() : pindex->pprev->GetBlockHash();
@@ -3196,14 +4998,54 @@ bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pin
                              REJECT_INVALID, "bad-txns-BIP30");
     }
 
-    unsigned int flags = SCRIPT_VERIFY_P2SH | SCRIPT_VERIFY_CHECKLOCKTIMEVERIFY;
+    unsigned int flags = BLOCK_SCRIPT_VERIFY_FLAGS;
 
     // DERSIG (BIP66) is also always enforced, but does not have a flag.
 
     CBlockUndo blockundo;
 
+    // The precomputed data of the block's transactions is freed together
+    // once the block has been checked, so it is carved out of a pool for the
+    // block rather than allocated one transaction at a time. Declared before
+    // the check queue controls, so that it outlives the checks pointing into it.
+    TxDataPoolResource txdataPool(TXDATA_POOL_BLOCK_SIZE * std::clamp(block.vtx.size(), (size_t)1, (size_t)256));
+    // Held by pointer so that the data computed when a transaction was
+    // accepted to the mempool can be shared rather than recomputed, and so
+    // that the CScriptChecks' pointers into it stay valid.
+    std::vector<std::shared_ptr<PrecomputedTransactionData>> txdata;
+    txdata.reserve(block.vtx.size());
+
     CCheckQueueControl<CScriptCheck> control(fExpensiveChecks && nScriptCheckThreads ? &scriptcheckqueue : NULL);
 
+    // If we have worker threads, the Sapling and Orchard batches are handed
+    // off to the proof-checking threads as they fill up, so that proof
+    // verification overlaps with the rest of the block's validation.
+    bool fPipelineProofs = (saplingAuth.has_value() || orchardAuth.has_value()) && nScriptCheckThreads;
+    CShieldedBatchResult shieldedResult;
+    CCheckQueueControl<CShieldedBatchCheck> proofControl(fPipelineProofs ? &proofcheckqueue : NULL);
+    size_t nShieldedQueued = 0;
+    size_t nShieldedBatchSize = MIN_SHIELDED_BATCH_SIZE;
+    if (fPipelineProofs) {
+        // Spread the block's shielded descriptions evenly over the
+        // verification threads, without splitting small blocks into batches
+        // too small to amortize the per-batch cost.
+        size_t nShieldedTotal = 0;
+        for (const CTransaction& tx : block.vtx) {
+            nShieldedTotal += GetShieldedBatchWeight(tx);
+        }
+        nShieldedBatchSize = std::max(
+            MIN_SHIELDED_BATCH_SIZE,
+            (nShieldedTotal + nScriptCheckThreads - 1) / nScriptCheckThreads);
+    }
+    auto handOffShieldedBatch = [&]() {
+        std::vector<CShieldedBatchCheck> vProofChecks;
+        vProofChecks.emplace_back(std::move(saplingAuth), std::move(orchardAuth), &shieldedResult);
+        saplingAuth = sapling::init_batch_validator(fCacheResults);
+        orchardAuth = orchard::init_batch_validator(fCacheResults);
+        proofControl.Add(vProofChecks);
+        nShieldedQueued = 0;
+    };
+
     int64_t nTimeStart = GetTimeMicros();
     std::vector<uint256> vOrphanErase;
     CAmount nFees = 0;
@@ -3273,8 +5115,22 @@ bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pin
     size_t total_sapling_tx = 0;
     size_t total_orchard_tx = 0;
 
-    std::vector<PrecomputedTransactionData> txdata;
-    txdata.reserve(block.vtx.size()); // Required so that pointers to individual PrecomputedTransactionData don't get invalidated
+    // Load every nullifier and anchor the block refers to in one batch,
+    // rather than one database lookup at a time as each transaction's
+    // shielded requirements are checked below.
+    int64_t nTimePrefetch = GetTimeMicros();
+    view.PrefetchShieldedRequirements(block.vtx);
+    LogPrint("bench", "    - Prefetch shielded requirements: %.2fms\n", 0.001 * (GetTimeMicros() - nTimePrefetch));
+    RecordConnectBlockStage(fJustCheck, "shielded_prefetch", GetTimeMicros() - nTimePrefetch);
+
+    std::vector<libzcash::PedersenHash> saplingCommitments;
+
+    // Reused for every transaction, so that they are only reallocated when
+    // a transaction has more inputs than any before it.
+    std::vector<CTxOut> allPrevOutputs;
+    std::vector<CScriptCheck> vChecks;
+    size_t nTxDataReused = 0;
+    size_t nTxPrevalidated = 0;
     for (unsigned int i = 0; i < block.vtx.size(); i++)
     {
         const CTransaction &tx = block.vtx[i];
@@ -3291,7 +5147,7 @@ bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pin
         // Only shielded coinbase transactions will need to produce sighashes for coinbase
         // transactions; this is handled in ZIP 244 by having the coinbase sighash be the
         // txid.
-        std::vector<CTxOut> allPrevOutputs;
+        allPrevOutputs.clear();
 
         // Are the shielded spends' requirements met?
         if (!Consensus::CheckTxShieldedInputs(tx, state, view, 100)) {
@@ -3311,11 +5167,12 @@ bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pin
             }
 
             // Which orphan pool entries must we evict?
+            LOCK(g_cs_orphans);
             for (size_t j = 0; j < tx.vin.size(); j++) {
                 auto itByPrev = mapOrphanTransactionsByPrev.find(tx.vin[j].prevout);
                 if (itByPrev == mapOrphanTransactionsByPrev.end()) continue;
                 for (auto mi = itByPrev->second.begin(); mi != itByPrev->second.end(); ++mi) {
-                    const CTransaction& orphanTx = (*mi)->second.tx;
+                    const CTransaction& orphanTx = *(*mi)->second.tx;
                     const uint256& orphanHash = orphanTx.GetHash();
                     vOrphanErase.push_back(orphanHash);
                 }
@@ -3362,7 +5219,25 @@ bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pin
                                  REJECT_INVALID, "bad-blk-sigops");
         }
 
-        txdata.emplace_back(tx, allPrevOutputs);
+        auto ptxdata = tx.IsCoinBase() ? nullptr : mempool.getPrecomputedData(tx);
+        if (ptxdata) {
+            nTxDataReused++;
+        } else {
+            ptxdata = std::allocate_shared<PrecomputedTransactionData>(
+                TxDataPoolAllocator(&txdataPool), tx, allPrevOutputs);
+        }
+        txdata.push_back(ptxdata);
+
+        // A transaction that the mempool accepted with identical authorizing
+        // data in this epoch has already had its scripts, proofs and
+        // signatures verified under at least the flags applied here, and
+        // none of those depend on the chain state. Only the value, input and
+        // shielded requirement checks need to run again.
+        bool fPrevalidated = ptxdata && fExpensiveChecks &&
+            mempool.isValidated(tx, consensusBranchId);
+        if (fPrevalidated) {
+            nTxPrevalidated++;
+        }
 
         if (tx.IsCoinBase())
         {
@@ -3382,17 +5257,19 @@ bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pin
             // they will be re-added in the other branch of this conditional.
             chainSupplyDelta -= txFee;
 
-            std::vector<CScriptCheck> vChecks;
-            if (!ContextualCheckInputs(tx, state, view, fExpensiveChecks, flags, fCacheResults, txdata.back(), consensusParams, consensusBranchId, nScriptCheckThreads ? &vChecks : NULL))
+            // Add() swaps the checks out, leaving default-constructed ones behind.
+            vChecks.clear();
+            if (!ContextualCheckInputs(tx, state, view, fExpensiveChecks && !fPrevalidated, flags, fCacheResults, *txdata.back(), consensusParams, consensusBranchId, nScriptCheckThreads ? &vChecks : NULL))
                 return error("%s: CheckInputs on %s failed with %s", __func__,
                     tx.GetHash().ToString(), FormatStateMessage(state));
             control.Add(vChecks);
         }
 
-        // Check shielded inputs.
-        if (!ContextualCheckShieldedInputs(
+        // Check shielded inputs. The shielded requirements were checked
+        // above, so a prevalidated transaction has nothing left to verify.
+        if (!fPrevalidated && !ContextualCheckShieldedInputs(
             tx,
-            txdata.back(),
+            *txdata.back(),
             state,
             view,
             saplingAuth,
@@ -3408,6 +5285,13 @@ bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pin
                 FormatStateMessage(state));
         }
 
+        if (fPipelineProofs) {
+            nShieldedQueued += GetShieldedBatchWeight(tx);
+            if (nShieldedQueued >= nShieldedBatchSize) {
+                handOffShieldedBatch();
+            }
+        }
+
         // insightexplorer
         // https://github.com/bitpay/bitcoin/commit/017f548ea6d89423ef568117447e61dd5707ec42#diff-7ec3c68a81efff79b6ca22ac1f1eabbaR2656
         if (fAddressIndex) {
@@ -3444,23 +5328,10 @@ bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pin
             }
         }
 
+        // The Sapling note commitments are appended to the tree all at once
+        // after this loop.
         for (const auto &outputDescription : tx.GetSaplingOutputs()) {
-            sapling_tree.append(uint256::FromRawBytes(outputDescription.cmu()));
-
-            if (fUpdateSaplingSubtrees) {
-                auto completeSubtreeRoot = sapling_tree.complete_subtree_root();
-                if (completeSubtreeRoot.has_value()) {
-                    libzcash::SubtreeData subtree(completeSubtreeRoot->ToRawBytes(), pindex->nHeight);
-                    view.PushSubtree(SAPLING, subtree);
-                    auto latest = view.GetLatestSubtree(SAPLING);
-
-                    // The latest subtree, according to the view, should now be one
-                    // less than the "current" subtree index according to the tree
-                    // itself, after the append takes place earlier in this loop.
-                    assert(latest.has_value());
-                    assert((latest->index + 1) == sapling_tree.current_subtree_index());
-                }
-            }
+            saplingCommitments.push_back(uint256::FromRawBytes(outputDescription.cmu()));
         }
 
         if (tx.GetOrchardBundle().IsPresent()) {
@@ -3501,6 +5372,27 @@ bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pin
         pos.nTxOffset += ::GetSerializeSize(tx, SER_DISK, CLIENT_VERSION);
     }
 
+    // Hashing the block's Sapling note commitments into the tree one level at
+    // a time lets each level's hashes be computed in parallel.
+    int64_t nTimeAppend = GetTimeMicros();
+    auto completedSaplingSubtrees = sapling_tree.append_batch(saplingCommitments);
+    RecordConnectBlockStage(fJustCheck, "tree_append", GetTimeMicros() - nTimeAppend);
+    if (fUpdateSaplingSubtrees) {
+        for (const auto& completedSubtreeRoot : completedSaplingSubtrees) {
+            libzcash::SubtreeData subtree(completedSubtreeRoot.ToRawBytes(), pindex->nHeight);
+            view.PushSubtree(SAPLING, subtree);
+        }
+        if (!completedSaplingSubtrees.empty()) {
+            auto latest = view.GetLatestSubtree(SAPLING);
+
+            // The latest subtree, according to the view, should now be one
+            // less than the "current" subtree index according to the tree
+            // itself, after the appends above.
+            assert(latest.has_value());
+            assert((latest->index + 1) == sapling_tree.current_subtree_index());
+        }
+    }
+
     // Derive the various block commitments.
     // We only derive them if they will be used for this block.
     std::optional<uint256> hashAuthDataRoot;
@@ -3644,6 +5536,9 @@ bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pin
 
     int64_t nTime1 = GetTimeMicros(); nTimeConnect += nTime1 - nTimeStart;
     LogPrint("bench", "      - Connect %u transactions: %.2fms (%.3fms/tx, %.3fms/txin) [%.2fs]\n", (unsigned)block.vtx.size(), 0.001 * (nTime1 - nTimeStart), 0.001 * (nTime1 - nTimeStart) / block.vtx.size(), nInputs <= 1 ? 0 : 0.001 * (nTime1 - nTimeStart) / (nInputs-1), nTimeConnect * 0.000001);
+    LogPrint("bench", "      - Reused precomputed data of %u mempool transactions\n", nTxDataReused);
+    LogPrint("bench", "      - Skipped re-verifying %u mempool transactions\n", nTxPrevalidated);
+    RecordConnectBlockStage(fJustCheck, "transactions", nTime1 - nTimeStart);
 
     CAmount cbTotalOutputValue = block.vtx[0].GetValueOut() + pindex->nLockboxValue;
     CAmount cbTotalInputValue = consensusParams.GetBlockSubsidy(pindex->nHeight) + nFees;
@@ -3687,28 +5582,52 @@ bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pin
         }
     }
 
+    int64_t nTimeShielded = GetTimeMicros();
+    if (fPipelineProofs) {
+        // Hand off whatever remains, and join the proof-checking threads
+        // until every batch of this block has been validated.
+        if (nShieldedQueued > 0) {
+            handOffShieldedBatch();
+        }
+        proofControl.Wait();
+    } else {
+        if (saplingAuth.has_value() && !saplingAuth.value()->validate()) {
+            shieldedResult.fSaplingValid = false;
+        }
+        if (orchardAuth.has_value() && !orchardAuth.value()->validate()) {
+            shieldedResult.fOrchardValid = false;
+        }
+    }
+    RecordConnectBlockStage(fJustCheck, "shielded_validate", GetTimeMicros() - nTimeShielded);
+
     // Ensure Sapling authorizations are valid (if we are checking them)
-    if (saplingAuth.has_value() && !saplingAuth.value()->validate()) {
+    if (!shieldedResult.fSaplingValid) {
         return state.DoS(100,
             error("%s: a Sapling bundle within the block is invalid", __func__),
             REJECT_INVALID, "bad-sapling-bundle-authorization");
     }
 
     // Ensure Orchard signatures are valid (if we are checking them)
-    if (orchardAuth.has_value() && !orchardAuth.value()->validate()) {
+    if (!shieldedResult.fOrchardValid) {
         return state.DoS(100,
             error("%s: an Orchard bundle within the block is invalid", __func__),
             REJECT_INVALID, "bad-orchard-bundle-authorization");
     }
 
+    int64_t nTimeScripts = GetTimeMicros();
     if (!control.Wait())
         return state.DoS(100, false);
     int64_t nTime2 = GetTimeMicros(); nTimeVerify += nTime2 - nTimeStart;
+    RecordConnectBlockStage(fJustCheck, "script_wait", nTime2 - nTimeScripts);
     LogPrint("bench", "    - Verify %u txins: %.2fms (%.3fms/txin) [%.2fs]\n", nInputs - 1, 0.001 * (nTime2 - nTimeStart), nInputs <= 1 ? 0 : 0.001 * (nTime2 - nTimeStart) / (nInputs-1), nTimeVerify * 0.000001);
 
     if (fJustCheck)
         return true;
 
+    // The transactions of a block that is disconnected are added back to the
+    // mempool without checking again what was checked here.
+    pindex->fExpensiveChecksDone = fExpensiveChecks && fCheckTransactions;
+
     // Write undo information to disk
     if (pindex->GetUndoPos().IsNull() || !pindex->IsValid(BLOCK_VALID_SCRIPTS))
     {
@@ -3716,8 +5635,10 @@ bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pin
             CDiskBlockPos _pos;
             if (!FindUndoPos(state, pindex->nFile, _pos, ::GetSerializeSize(blockundo, SER_DISK, CLIENT_VERSION) + 40))
                 return error("%s: FindUndoPos failed", __func__);
+            int64_t nTimeUndo = GetTimeMicros();
             if (!UndoWriteToDisk(blockundo, _pos, pindex->pprev->GetBlockHash(), chainparams.MessageStart()))
                 return AbortNode(state, "Failed to write undo data");
+            RecordConnectBlockStage(fJustCheck, "undo_write", GetTimeMicros() - nTimeUndo);
 
             // update nUndoPos in block index
             pindex->nUndoPos = _pos.nPos;
@@ -3745,15 +5666,15 @@ bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pin
 
     // START insightexplorer
     if (fAddressIndex) {
-        if (!pblocktree->WriteAddressIndex(addressIndex)) {
+        if (!pinsightdb->WriteAddressIndex(addressIndex)) {
             return AbortNode(state, "Failed to write address index");
         }
-        if (!pblocktree->UpdateAddressUnspentIndex(addressUnspentIndex)) {
+        if (!pinsightdb->UpdateAddressUnspentIndex(addressUnspentIndex)) {
             return AbortNode(state, "Failed to write address unspent index");
         }
     }
     if (fSpentIndex) {
-        if (!pblocktree->UpdateSpentIndex(spentIndex)) {
+        if (!pinsightdb->UpdateSpentIndex(spentIndex)) {
             return AbortNode(state, "Failed to write spent index");
         }
     }
@@ -3763,7 +5684,7 @@ bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pin
 
         // retrieve logical timestamp of the previous block
         if (pindex->pprev)
-            if (!pblocktree->ReadTimestampBlockIndex(pindex->pprev->GetBlockHash(), prevLogicalTS))
+            if (!pinsightdb->ReadTimestampBlockIndex(pindex->pprev->GetBlockHash(), prevLogicalTS))
                 LogPrintf("%s: Failed to read previous block's logical timestamp\n", __func__);
 
         if (logicalTS <= prevLogicalTS) {
@@ -3771,11 +5692,9 @@ bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pin
             LogPrintf("%s: Previous logical timestamp is newer Actual[%d] prevLogical[%d] Logical[%d]\n", __func__, pindex->nTime, prevLogicalTS, logicalTS);
         }
 
-        if (!pblocktree->WriteTimestampIndex(CTimestampIndexKey(logicalTS, pindex->GetBlockHash())))
+        if (!pinsightdb->WriteTimestampIndex(CTimestampIndexKey(logicalTS, pindex->GetBlockHash()),
+                CTimestampBlockIndexKey(pindex->GetBlockHash()), CTimestampBlockIndexValue(logicalTS)))
             return AbortNode(state, "Failed to write timestamp index");
-
-        if (!pblocktree->WriteTimestampBlockIndex(CTimestampBlockIndexKey(pindex->GetBlockHash()), CTimestampBlockIndexValue(logicalTS)))
-            return AbortNode(state, "Failed to write blockhash index");
     }
     // END insightexplorer
 
@@ -3784,9 +5703,11 @@ bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pin
 
     int64_t nTime3 = GetTimeMicros(); nTimeIndex += nTime3 - nTime2;
     LogPrint("bench", "    - Index writing: %.2fms [%.2fs]\n", 0.001 * (nTime3 - nTime2), nTimeIndex * 0.000001);
+    RecordConnectBlockStage(fJustCheck, "index", nTime3 - nTime2);
 
     // Erase orphan transactions include or precluded by this block
     if (vOrphanErase.size()) {
+        LOCK(g_cs_orphans);
         int nErased = 0;
         for (uint256 &orphanHash : vOrphanErase) {
             nErased += EraseOrphanTx(orphanHash);
@@ -3794,6 +5715,9 @@ bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pin
         LogPrint("mempool", "Erased %d orphan tx included or conflicted by block\n", nErased);
     }
 
+    if (pblockundo)
+        *pblockundo = std::move(blockundo);
+
     return true;
 }
 
@@ -3810,10 +5734,24 @@ enum FlushStateMode {
  * if they're too large, if it's been a while since the last write,
  * or always and in all cases if we're in prune mode and are deleting files.
  */
+/** Report how much of the memory held by the heap allocator is in use. */
+static void UpdateAllocatorMetrics()
+{
+    auto stats = GetAllocatorStats();
+    if (stats) {
+        MetricsGauge("zcash.memory.allocator.allocated.bytes", stats->nAllocated);
+        MetricsGauge("zcash.memory.allocator.held.bytes", stats->nHeld);
+    }
+    MetricsGauge("zcash.coins.cache.usage.bytes", pcoinsTip->DynamicMemoryUsage());
+}
+
 bool static FlushStateToDisk(
     const CChainParams& chainparams,
     CValidationState &state,
     FlushStateMode mode) {
+    auto span = TracingSpan("debug", "bench", "FlushStateToDisk");
+    auto spanGuard = span.Enter();
+
     LOCK2(cs_main, cs_LastBlockFile);
     static int64_t nLastWrite = 0;
     static int64_t nLastFlush = 0;
@@ -3855,8 +5793,10 @@ bool static FlushStateToDisk(
         // Depend on nMinDiskSpace to ensure we can write block index
         if (!CheckDiskSpace(0))
             return state.Error("out of disk space");
-        // First make sure all block and undo data is flushed to disk.
+        // First make sure all block and undo data is flushed to disk,
+        // including that of the files left since the last write.
         FlushBlockFile();
+        WaitForBlockFileSync();
         // Then update all block file information (which may refer to block and undo files).
         {
             std::vector<std::pair<int, const CBlockFileInfo*> > vFiles;
@@ -3871,6 +5811,11 @@ bool static FlushStateToDisk(
                 vBlocks.push_back(*it);
                 it = setDirtyBlockIndex.erase(it);
             }
+            // The chainstate written below must not get ahead of the
+            // indexes of the blocks it includes.
+            if (pinsightdb && !pinsightdb->Sync()) {
+                return AbortNode(state, "Failed to write insight explorer indexes");
+            }
             if (!pblocktree->WriteBatchSync(vFiles, nLastBlockFile, vBlocks)) {
                 return AbortNode(state, "Files to write to block index database");
             }
@@ -3881,9 +5826,11 @@ bool static FlushStateToDisk(
                 pblockindex->TrimSolution();
             }
         }
-        // Finally remove any pruned files
+        // Finally remove any pruned files, now that the block index no
+        // longer refers to them. That is left to a thread of its own, so
+        // that deleting large files does not hold up the flush.
         if (fFlushForPrune)
-            UnlinkPrunedFiles(setFilesToPrune);
+            QueueUnlinkPrunedFiles(setFilesToPrune);
         nLastWrite = nNow;
     }
     // Flush best chain related state. This can only be done if the blocks / block index write was also done.
@@ -3896,9 +5843,41 @@ bool static FlushStateToDisk(
         if (!CheckDiskSpace(128 * 2 * 2 * pcoinsTip->GetCacheSize()))
             return state.Error("out of disk space");
         // Flush the chainstate (which may refer to block index entries).
-        if (!pcoinsTip->Flush())
+        // Unless we were asked for a full flush, keep the clean coins cached
+        // so that block processing does not slow to a crawl while the cache
+        // warms up again; if the cache is too large, only trim it to the low
+        // watermark.
+        // Full flushes also wait for the background writer, so that the
+        // chainstate is on disk when we return.
+        bool fFlushed;
+        if (mode == FLUSH_STATE_ALWAYS) {
+            fFlushed = pcoinsTip->Flush() && (pcoinswriter == NULL || pcoinswriter->Sync());
+        } else {
+            size_t nTargetUsage = (fCacheLarge || fCacheCritical) ?
+                nCoinCacheUsage / 100 * COINS_CACHE_LOW_WATERMARK_PERCENT : nCoinCacheUsage;
+            fFlushed = pcoinsTip->SyncAndTrim(nTargetUsage);
+        }
+        if (!fFlushed)
             return AbortNode(state, "Failed to write to coin database");
+        BlockMap::iterator miCoins = mapBlockIndex.find(pcoinsTip->GetBestBlock());
+        coinsSnapshots.Reset(pcoinsTip->GetBackend(), miCoins == mapBlockIndex.end() ? NULL : miCoins->second);
+        if (ptxoutsetstats && !ptxoutsetstats->Flush())
+            return AbortNode(state, "Failed to write UTXO set statistics");
+        for (const auto& entry : mapBlockFilterIndexes) {
+            if (!entry.second->Flush())
+                return AbortNode(state, "Failed to write block filter index");
+        }
+        LogPrint("coindb", "Flushed coins cache, %u transactions (%.1f MiB) remain cached\n",
+            pcoinsTip->GetCacheSize(), pcoinsTip->DynamicMemoryUsage() * (1.0 / (1<<20)));
         nLastFlush = nNow;
+        // Emptying the coins cache leaves much of the heap free, but spread
+        // over pages that the allocator keeps unless asked to return them.
+        if (fPurgeAllocator) {
+            PurgeAllocator();
+        }
+    }
+    if (fDoFullFlush || fPeriodicWrite) {
+        UpdateAllocatorMetrics();
     }
     // Don't flush the wallet witness cache (SetBestChain()) here, see #4301
     } catch (const std::runtime_error& e) {
@@ -4015,6 +5994,7 @@ struct PoolMetrics {
 /** Update chainActive and related internal data structures. */
 void static UpdateTip(CBlockIndex *pindexNew, const CChainParams& chainParams) {
     chainActive.SetTip(pindexNew);
+    chainStats.Update(chainActive);
 
     // New best block
     nTimeBestReceived = GetTime();
@@ -4058,17 +6038,163 @@ void static UpdateTip(CBlockIndex *pindexNew, const CChainParams& chainParams) {
     }
 }
 
+//! How many blocks CDisconnectReader reads ahead of those being disconnected.
+static const size_t MAX_DISCONNECT_READAHEAD = 32;
+
+/**
+ * Reads the blocks that are about to be disconnected from chainActive, and
+ * their undo data, on a thread of its own, so that disconnecting many blocks
+ * in a row, in a deep reorg, a rewind or invalidateblock, does not wait on
+ * the disk and on the checks of each block as it is read. Blocks are read in
+ * the order they are disconnected, at most MAX_DISCONNECT_READAHEAD ahead.
+ */
+class CDisconnectReader
+{
+private:
+    struct Entry
+    {
+        //! Taken from the block index when the reader is created, as the
+        //! thread may not read the block index.
+        uint256 hash;
+        uint256 hashPrev;
+        CDiskBlockPos pos;
+        CDiskBlockPos posUndo;
+
+        bool fRead = false;
+        bool fOk = false;
+        CBlock block;
+        CBlockUndo blockundo;
+    };
+
+    const CChainParams& chainparams;
+    Mutex cs;
+    std::condition_variable cond;
+    std::vector<Entry> vEntries;
+    size_t nNextRead = 0;
+    size_t nNextTake = 0;
+    bool fStop = false;
+    std::thread thread;
+
+    void ThreadRead();
+
+public:
+    //! Start reading the blocks from the tip of chainActive down to, but not
+    //! including, pindexFork. Nothing is read ahead if that is a single
+    //! block. Requires cs_main.
+    CDisconnectReader(const CChainParams& chainparamsIn, const CBlockIndex* pindexFork);
+    ~CDisconnectReader();
+
+    //! Take the block and the undo data read for pindex, which must be the
+    //! next block to be disconnected. Returns false if they could not be
+    //! read, so that the caller reads them itself and reports the failure.
+    bool Take(const CBlockIndex* pindex, CBlock& block, CBlockUndo& blockundo);
+};
+
+CDisconnectReader::CDisconnectReader(const CChainParams& chainparamsIn, const CBlockIndex* pindexFork) :
+    chainparams(chainparamsIn)
+{
+    AssertLockHeld(cs_main);
+    for (const CBlockIndex* pindex = chainActive.Tip(); pindex && pindex != pindexFork && pindex->pprev; pindex = pindex->pprev) {
+        Entry entry;
+        entry.hash = pindex->GetBlockHash();
+        entry.hashPrev = pindex->pprev->GetBlockHash();
+        entry.pos = pindex->GetBlockPos();
+        entry.posUndo = pindex->GetUndoPos();
+        vEntries.push_back(std::move(entry));
+    }
+    if (vEntries.size() > 1) {
+        thread = std::thread(&CDisconnectReader::ThreadRead, this);
+    }
+}
+
+CDisconnectReader::~CDisconnectReader()
+{
+    {
+        LOCK(cs);
+        fStop = true;
+    }
+    cond.notify_all();
+    if (thread.joinable()) {
+        thread.join();
+    }
+}
+
+void CDisconnectReader::ThreadRead()
+{
+    RenameThread("zc-disconnread");
+    while (true) {
+        Entry* pentry;
+        {
+            WAIT_LOCK(cs, lock);
+            cond.wait(lock, [this] {
+                return fStop || nNextRead == vEntries.size() || nNextRead < nNextTake + MAX_DISCONNECT_READAHEAD;
+            });
+            if (fStop || nNextRead == vEntries.size())
+                return;
+            pentry = &vEntries[nNextRead];
+        }
+
+        // Only this thread touches the entry until it is marked as read.
+        CBlock block;
+        CBlockUndo blockundo;
+        bool fOk = !pentry->pos.IsNull() && !pentry->posUndo.IsNull() &&
+            ReadBlockFromDisk(block, pentry->pos, chainparams.GetConsensus()) &&
+            block.GetHash() == pentry->hash &&
+            UndoReadFromDisk(blockundo, pentry->posUndo, pentry->hashPrev);
+
+        {
+            LOCK(cs);
+            pentry->fRead = true;
+            pentry->fOk = fOk;
+            if (fOk) {
+                pentry->block = std::move(block);
+                pentry->blockundo = std::move(blockundo);
+            }
+            nNextRead++;
+        }
+        cond.notify_all();
+    }
+}
+
+bool CDisconnectReader::Take(const CBlockIndex* pindex, CBlock& block, CBlockUndo& blockundo)
+{
+    if (!thread.joinable())
+        return false;
+    WAIT_LOCK(cs, lock);
+    if (nNextTake == vEntries.size() || vEntries[nNextTake].hash != pindex->GetBlockHash())
+        return false;
+    cond.wait(lock, [this] { return vEntries[nNextTake].fRead; });
+    Entry& entry = vEntries[nNextTake++];
+    bool fOk = entry.fOk;
+    if (fOk) {
+        block = std::move(entry.block);
+        blockundo = std::move(entry.blockundo);
+    }
+    lock.unlock();
+    cond.notify_all();
+    return fOk;
+}
+
+/** Height of the last block whose shielded proofs were batch-validated by PreverifyShieldedProofWindow. */
+int nProofWindowEnd = -1;
+
 /**
  * Disconnect chainActive's tip. You probably want to call mempool.removeForReorg and
  * mempool.removeWithoutBranchId after this, with cs_main held.
+ * If preader is not NULL, the block and its undo data are taken from it.
  */
-bool static DisconnectTip(CValidationState &state, const CChainParams& chainparams, bool fBare = false)
+bool static DisconnectTip(CValidationState &state, const CChainParams& chainparams, bool fBare = false, CDisconnectReader* preader = NULL)
 {
+    auto span = TracingSpan("debug", "bench", "DisconnectTip");
+    auto spanGuard = span.Enter();
+
     CBlockIndex *pindexDelete = chainActive.Tip();
     assert(pindexDelete);
-    // Read block from disk.
+    // Read block from disk, unless it was read ahead along with its undo data.
     CBlock block;
-    if (!ReadBlockFromDisk(block, pindexDelete, chainparams.GetConsensus()))
+    CBlockUndo blockundo;
+    bool fHaveUndo = preader && preader->Take(pindexDelete, block, blockundo);
+    if (!fHaveUndo && !ReadBlockFromDisk(block, pindexDelete, chainparams.GetConsensus()))
         return AbortNode(state, "Failed to read block");
     // Apply the block atomically to the chain state.
     uint256 sproutAnchorBeforeDisconnect = pcoinsTip->GetBestAnchor(SPROUT);
@@ -4078,9 +6204,16 @@ bool static DisconnectTip(CValidationState &state, const CChainParams& chainpara
     {
         CCoinsViewCache view(pcoinsTip);
         // insightexplorer: update indices (true)
-        if (DisconnectBlock(block, state, pindexDelete, view, chainparams, true) != DISCONNECT_OK)
+        if (DisconnectBlock(block, state, pindexDelete, view, chainparams, true, &blockundo, fHaveUndo) != DISCONNECT_OK)
             return error("DisconnectTip(): DisconnectBlock %s failed", pindexDelete->GetBlockHash().ToString());
+        coinsSnapshots.BlockChanged(view, block, pindexDelete->pprev);
         assert(view.Flush());
+        if (ptxoutsetstats)
+            ptxoutsetstats->BlockDisconnected(block, blockundo, pindexDelete);
+        for (const auto& entry : mapBlockFilterIndexes)
+            entry.second->BlockDisconnected(pindexDelete);
+        if (pshieldedblockindex)
+            pshieldedblockindex->BlockDisconnected(pindexDelete);
     }
     LogPrint("bench", "- Disconnect block: %.2fms\n", (GetTimeMicros() - nStart) * 0.001);
     uint256 sproutAnchorAfterDisconnect = pcoinsTip->GetBestAnchor(SPROUT);
@@ -4090,15 +6223,39 @@ bool static DisconnectTip(CValidationState &state, const CChainParams& chainpara
     if (!FlushStateToDisk(chainparams, state, FLUSH_STATE_IF_NEEDED))
         return false;
 
+    GetMainSignals().BlockDisconnected(pindexDelete);
+
     if (!fBare) {
-        // Resurrect mempool transactions from the disconnected block.
-        std::vector<uint256> vHashUpdate;
+        // Resurrect mempool transactions from the disconnected block, as one
+        // batch. If their scripts, proofs and signatures were verified when
+        // the block was connected, then unless the next block is in a
+        // different epoch their proofs and shielded signatures are not
+        // checked again. Blocks below a checkpoint or the assumed-valid block
+        // were connected without those checks, so their transactions are
+        // verified in full.
+        std::vector<CTransactionRef> vResurrect;
         for (const CTransaction &tx : block.vtx) {
-            // ignore validation errors in resurrected transactions
-            list<CTransaction> removed;
-            CValidationState stateDummy;
-            if (tx.IsCoinBase() || !AcceptToMemoryPool(chainparams, mempool, stateDummy, tx, false, NULL)) {
-                mempool.remove(tx, removed, true);
+            if (tx.IsCoinBase()) {
+                list<CTransactionRef> removed;
+                mempool.remove(tx, removed, true, MemPoolRemovalReason::REORG);
+            } else {
+                vResurrect.push_back(MakeTransactionRef(tx));
+            }
+        }
+        std::optional<uint32_t> blockBranchId;
+        if (pindexDelete->fExpensiveChecksDone) {
+            blockBranchId = CurrentEpochBranchId(pindexDelete->nHeight, chainparams.GetConsensus());
+        }
+        // ignore validation errors in resurrected transactions
+        std::vector<CValidationState> vStateDummy;
+        std::vector<bool> vAccepted = AcceptTransactionsToMemoryPool(
+            chainparams, mempool, vStateDummy, vResurrect, false, NULL, false, blockBranchId);
+        std::vector<uint256> vHashUpdate;
+        for (size_t i = 0; i < vResurrect.size(); i++) {
+            const CTransaction &tx = *vResurrect[i];
+            list<CTransactionRef> removed;
+            if (!vAccepted[i]) {
+                mempool.remove(tx, removed, true, MemPoolRemovalReason::REORG);
             } else if (mempool.exists(tx.GetHash())) {
                 vHashUpdate.push_back(tx.GetHash());
             }
@@ -4128,6 +6285,9 @@ bool static DisconnectTip(CValidationState &state, const CChainParams& chainpara
 
     // Update chainActive and related variables.
     UpdateTip(pindexDelete->pprev, chainparams);
+    // The blocks of the preverified window above the new tip may no longer be
+    // the ones that will be connected.
+    nProofWindowEnd = std::min(nProofWindowEnd, chainActive.Height());
 
     // Updates to connected wallets are triggered by ThreadNotifyWallets
 
@@ -4141,24 +6301,90 @@ static int64_t nTimeChainState = 0;
 static int64_t nTimePostConnect = 0;
 
 // Protected by cs_main
-std::map<const CBlockIndex*, std::list<CTransaction>> recentlyConflictedTxs;
+std::map<const CBlockIndex*, std::list<CTransactionRef>> recentlyConflictedTxs;
 uint64_t nConnectedSequence = 0;
 uint64_t nNotifiedSequence = 0;
 
+/**
+ * Warm pcoinsTip with the coins spent by the transparent inputs of a block, so
+ * that ConnectBlock does not have to wait on one coins database read at a time.
+ * The reads are spread over the coins prefetching threads; if there are none,
+ * this does nothing and ConnectBlock fetches the coins itself as before.
+ */
+static void PrefetchBlockInputs(const CBlock& block)
+{
+    AssertLockHeld(cs_main);
+    if (!nScriptCheckThreads)
+        return;
+
+    int64_t nTimeStart = GetTimeMicros();
+
+    // Outputs created within the block itself cannot be in the database.
+    std::set<uint256> setBlockTxids;
+    for (const CTransaction& tx : block.vtx) {
+        setBlockTxids.insert(tx.GetHash());
+    }
+
+    std::set<uint256> setToFetch;
+    for (const CTransaction& tx : block.vtx) {
+        if (tx.IsCoinBase())
+            continue;
+        for (const CTxIn& txin : tx.vin) {
+            const uint256& prevHash = txin.prevout.hash;
+            if (setBlockTxids.count(prevHash) || pcoinsTip->HaveCoinsInCache(prevHash))
+                continue;
+            setToFetch.insert(prevHash);
+        }
+    }
+    if (setToFetch.empty())
+        return;
+
+    std::vector<CCoinsPrefetchSlot> vSlots(setToFetch.size());
+    std::vector<CCoinsPrefetchCheck> vChecks;
+    vChecks.reserve(vSlots.size());
+    size_t i = 0;
+    for (const uint256& txid : setToFetch) {
+        vSlots[i].txid = txid;
+        vChecks.emplace_back(pcoinsTip, &vSlots[i]);
+        i++;
+    }
+
+    CCheckQueueControl<CCoinsPrefetchCheck> control(&coinsprefetchqueue);
+    control.Add(vChecks);
+    control.Wait();
+
+    size_t nFound = 0;
+    for (CCoinsPrefetchSlot& slot : vSlots) {
+        if (slot.fFound) {
+            pcoinsTip->CacheFetchedCoins(slot.txid, slot.coins);
+            nFound++;
+        }
+    }
+
+    LogPrint("bench", "  - Prefetch %u/%u input txs: %.2fms\n",
+        nFound, vSlots.size(), (GetTimeMicros() - nTimeStart) * 0.001);
+    RecordBlockStage("input_prefetch", GetTimeMicros() - nTimeStart);
+}
+
 /**
  * Connect a new block to chainActive. pblock is either NULL or a pointer to a CBlock
  * corresponding to pindexNew, to bypass loading it again from disk.
  * You probably want to call mempool.removeWithoutBranchId after this, with cs_main held.
  */
-bool static ConnectTip(CValidationState& state, const CChainParams& chainparams, CBlockIndex* pindexNew, const CBlock* pblock)
+bool static ConnectTip(CValidationState& state, const CChainParams& chainparams, CBlockIndex* pindexNew, const std::shared_ptr<const CBlock>& pblock)
 {
+    auto span = TracingSpan("debug", "bench", "ConnectTip");
+    auto spanGuard = span.Enter();
+
     assert(pblock && pindexNew->pprev == chainActive.Tip());
     // Apply the block atomically to the chain state.
     int64_t nTime2 = GetTimeMicros();
     int64_t nTime3;
+    PrefetchBlockInputs(*pblock);
     {
         CCoinsViewCache view(pcoinsTip);
-        bool rv = ConnectBlock(*pblock, state, pindexNew, view, chainparams);
+        CBlockUndo blockundo;
+        bool rv = ConnectBlock(*pblock, state, pindexNew, view, chainparams, false, CheckAs::Block, &blockundo);
         GetMainSignals().BlockChecked(*pblock, state);
         if (!rv) {
             if (state.IsInvalid())
@@ -4168,17 +6394,31 @@ bool static ConnectTip(CValidationState& state, const CChainParams& chainparams,
         mapBlockSource.erase(pindexNew->GetBlockHash());
         nTime3 = GetTimeMicros(); nTimeConnectTotal += nTime3 - nTime2;
         LogPrint("bench", "  - Connect total: %.2fms [%.2fs]\n", (nTime3 - nTime2) * 0.001, nTimeConnectTotal * 0.000001);
+        RecordBlockStage("connect", nTime3 - nTime2);
+        RecordSyncStage(SyncStage::Validation, nTime3 - nTime2);
+        coinsSnapshots.BlockChanged(view, *pblock, pindexNew);
         assert(view.Flush());
+        if (ptxoutsetstats)
+            ptxoutsetstats->BlockConnected(*pblock, blockundo, pindexNew);
+        for (const auto& entry : mapBlockFilterIndexes)
+            entry.second->BlockConnected(*pblock, blockundo, pindexNew);
+        if (ptxlocationindex)
+            ptxlocationindex->BlockConnected(*pblock, pindexNew);
+        if (pshieldedblockindex)
+            pshieldedblockindex->BlockConnected(*pblock, pindexNew);
     }
     int64_t nTime4 = GetTimeMicros(); nTimeFlush += nTime4 - nTime3;
     LogPrint("bench", "  - Flush: %.2fms [%.2fs]\n", (nTime4 - nTime3) * 0.001, nTimeFlush * 0.000001);
+    RecordBlockStage("flush", nTime4 - nTime3);
     // Write the chain state to disk, if necessary.
     if (!FlushStateToDisk(chainparams, state, FLUSH_STATE_IF_NEEDED))
         return false;
     int64_t nTime5 = GetTimeMicros(); nTimeChainState += nTime5 - nTime4;
     LogPrint("bench", "  - Writing chainstate: %.2fms [%.2fs]\n", (nTime5 - nTime4) * 0.001, nTimeChainState * 0.000001);
+    RecordBlockStage("chainstate_write", nTime5 - nTime4);
+    RecordSyncStage(SyncStage::Flush, nTime5 - nTime4);
     // Remove conflicting transactions from the mempool.
-    std::list<CTransaction> txConflicted;
+    std::list<CTransactionRef> txConflicted;
     mempool.removeForBlock(pblock->vtx, pindexNew->nHeight, txConflicted);
 
     // Remove transactions that expire at new block height from mempool
@@ -4191,6 +6431,12 @@ bool static ConnectTip(CValidationState& state, const CChainParams& chainparams,
     // Update chainActive & related variables.
     UpdateTip(pindexNew, chainparams);
 
+    GetMainSignals().BlockConnected(pindexNew);
+
+    // Keep the block for the notification threads and peers, which are
+    // about to ask for it.
+    recentBlocks.Add(pindexNew->GetBlockHash(), pblock);
+
     // Cache the conflicted transactions for subsequent notification.
     // Updates to connected wallets are triggered by ThreadNotifyWallets
     recentlyConflictedTxs.insert(std::make_pair(pindexNew, txConflicted));
@@ -4202,12 +6448,13 @@ bool static ConnectTip(CValidationState& state, const CChainParams& chainparams,
 
     int64_t nTime6 = GetTimeMicros(); nTimePostConnect += nTime6 - nTime5;
     LogPrint("bench", "  - Connect postprocess: %.2fms [%.2fs]\n", (nTime6 - nTime5) * 0.001, nTimePostConnect * 0.000001);
+    RecordBlockStage("postprocess", nTime6 - nTime5);
     // Total connection time benchmarking occurs in ActivateBestChainStep.
     MetricsIncrementCounter("zcash.chain.verified.block.total");
     return true;
 }
 
-std::pair<std::list<CTransaction>, std::optional<uint64_t>> TakeRecentlyConflicted(const CBlockIndex* pindex)
+std::pair<std::list<CTransactionRef>, std::optional<uint64_t>> TakeRecentlyConflicted(const CBlockIndex* pindex)
 {
     AssertLockHeld(cs_main);
 
@@ -4217,7 +6464,7 @@ std::pair<std::list<CTransaction>, std::optional<uint64_t>> TakeRecentlyConflict
     // no entries will exist in `recentlyConflictedTxs` until the next block after the
     // node's chain tip at the point of shutdown. In these cases, the wallet cannot learn
     // about conflicts in those blocks (which should be fine).
-    std::list<CTransaction> conflictedTxs = recentlyConflictedTxs[pindex];
+    std::list<CTransactionRef> conflictedTxs = recentlyConflictedTxs[pindex];
     recentlyConflictedTxs.erase(pindex);
     if (recentlyConflictedTxs.empty()) {
         return std::make_pair(conflictedTxs, nConnectedSequence);
@@ -4301,16 +6548,164 @@ static CBlockIndex* FindMostWorkChain() {
     } while(true);
 }
 
-/** Delete all entries in setBlockIndexCandidates that are worse than the current tip. */
-static void PruneBlockIndexCandidates() {
-    // Note that we can't delete the current block itself, as we may need to return to it later in case a
-    // reorganization to a better block fails.
-    std::set<CBlockIndex*, CBlockIndexWorkComparator>::iterator it = setBlockIndexCandidates.begin();
-    while (it != setBlockIndexCandidates.end() && setBlockIndexCandidates.value_comp()(*it, chainActive.Tip())) {
-        it = setBlockIndexCandidates.erase(it);
+/** Delete all entries in setBlockIndexCandidates that are worse than the current tip. */
+static void PruneBlockIndexCandidates() {
+    // Note that we can't delete the current block itself, as we may need to return to it later in case a
+    // reorganization to a better block fails.
+    std::set<CBlockIndex*, CBlockIndexWorkComparator>::iterator it = setBlockIndexCandidates.begin();
+    while (it != setBlockIndexCandidates.end() && setBlockIndexCandidates.value_comp()(*it, chainActive.Tip())) {
+        it = setBlockIndexCandidates.erase(it);
+    }
+    // Either the current tip or a successor of it we're working towards is left in setBlockIndexCandidates.
+    assert(!setBlockIndexCandidates.empty());
+}
+
+/**
+ * During initial block download, batch-validate the Sapling and Orchard
+ * authorizations of the next -ibdproofwindow blocks towards pindexMostWork
+ * in one large batch (split over the proof-checking threads), instead of a
+ * small batch per block. Bundles that verify are added to the bundle validity
+ * caches, so that ConnectBlock skips them when the blocks are connected.
+ *
+ * This only warms the caches: any bundle that could not be pre-verified,
+ * including every bundle in a sub-batch that failed, is verified as usual
+ * by ConnectBlock.
+ */
+static void PreverifyShieldedProofWindow(const CChainParams& chainparams, const CBlockIndex* pindexMostWork)
+{
+    AssertLockHeld(cs_main);
+    const Consensus::Params& consensusParams = chainparams.GetConsensus();
+    const CBlockIndex* pindexTip = chainActive.Tip();
+    if (nIBDProofWindow <= 0 || pindexTip == nullptr || !IsInitialBlockDownload(consensusParams)) {
+        return;
+    }
+
+    int nStart = std::max(pindexTip->nHeight, nProofWindowEnd) + 1;
+    int nEnd = std::min(pindexMostWork->nHeight, pindexTip->nHeight + nIBDProofWindow);
+    // A window of a single block gains nothing over ConnectBlock's own batch.
+    if (nEnd <= nStart) {
+        return;
+    }
+    nProofWindowEnd = nEnd;
+
+    int64_t nTimeStart = GetTimeMicros();
+
+    // The window's blocks must outlive the queued bundles' transactions.
+    std::vector<CBlock> vBlocks;
+    vBlocks.reserve(nEnd - nStart + 1);
+    // Transactions created within the window, for looking up the previous
+    // outputs that v5 sighashes commit to.
+    std::map<uint256, const CTransaction*> mapWindowTxs;
+    std::vector<std::pair<const CTransaction*, uint256>> vQueued;
+    size_t nTotalWeight = 0;
+
+    for (int nHeight = nStart; nHeight <= nEnd; nHeight++) {
+        const CBlockIndex* pindex = pindexMostWork->GetAncestor(nHeight);
+        if (!(pindex->nStatus & BLOCK_HAVE_DATA)) {
+            break;
+        }
+        // Skip blocks for which ConnectBlock will not check proofs at all.
+        if ((fCheckpointsEnabled && Checkpoints::IsAncestorOfLastCheckpoint(chainparams.Checkpoints(), pindex)) ||
+            IsAncestorOfAssumeValid(consensusParams, pindex)) {
+            continue;
+        }
+        vBlocks.emplace_back();
+        if (!ReadBlockFromDisk(vBlocks.back(), pindex, consensusParams)) {
+            vBlocks.pop_back();
+            break;
+        }
+
+        auto consensusBranchId = CurrentEpochBranchId(nHeight, consensusParams);
+        for (const CTransaction& tx : vBlocks.back().vtx) {
+            mapWindowTxs.emplace(tx.GetHash(), &tx);
+            if (!tx.GetSaplingBundle().IsPresent() && !tx.GetOrchardBundle().IsPresent()) {
+                continue;
+            }
+
+            std::vector<CTxOut> allPrevOutputs;
+            bool fHavePrevOutputs = true;
+            if (!tx.IsCoinBase() && tx.nVersion >= ZIP225_TX_VERSION) {
+                for (const auto& input : tx.vin) {
+                    auto it = mapWindowTxs.find(input.prevout.hash);
+                    if (it != mapWindowTxs.end() && input.prevout.n < it->second->vout.size()) {
+                        allPrevOutputs.push_back(it->second->vout[input.prevout.n]);
+                        continue;
+                    }
+                    const CCoins* coins = pcoinsTip->AccessCoins(input.prevout.hash);
+                    if (coins && coins->IsAvailable(input.prevout.n)) {
+                        allPrevOutputs.push_back(coins->vout[input.prevout.n]);
+                        continue;
+                    }
+                    fHavePrevOutputs = false;
+                    break;
+                }
+            }
+            if (!fHavePrevOutputs) {
+                continue;
+            }
+
+            try {
+                PrecomputedTransactionData txdata(tx, allPrevOutputs);
+                CScript scriptCode;
+                vQueued.emplace_back(&tx, SignatureHash(scriptCode, tx, NOT_AN_INPUT, SIGHASH_ALL, 0, consensusBranchId, txdata));
+                nTotalWeight += GetShieldedBatchWeight(tx);
+            } catch (const std::exception&) {
+                // Leave this transaction to ConnectBlock.
+            }
+        }
+    }
+
+    if (vQueued.empty()) {
+        return;
+    }
+
+    size_t nThreads = std::max(1, nScriptCheckThreads);
+    size_t nBatchSize = std::max(MIN_SHIELDED_BATCH_SIZE, (nTotalWeight + nThreads - 1) / nThreads);
+
+    CShieldedBatchResult shieldedResult;
+    std::vector<CShieldedBatchCheck> vProofChecks;
+    std::optional<rust::Box<sapling::BatchValidator>> saplingAuth;
+    std::optional<rust::Box<orchard::BatchValidator>> orchardAuth;
+    size_t nBatchWeight = 0;
+    for (const auto& [ptx, sighash] : vQueued) {
+        if (nBatchWeight == 0) {
+            saplingAuth = sapling::init_batch_validator(true);
+            orchardAuth = orchard::init_batch_validator(true);
+        }
+        // A Sapling batch containing a bundle that violates a consensus rule
+        // must not be validated, so drop it and let ConnectBlock report the
+        // failure.
+        if (saplingAuth.has_value() && !ptx->GetSaplingBundle().QueueAuthValidation(*saplingAuth.value(), sighash)) {
+            saplingAuth = std::nullopt;
+        }
+        ptx->GetOrchardBundle().QueueAuthValidation(*orchardAuth.value(), sighash);
+
+        nBatchWeight += GetShieldedBatchWeight(*ptx);
+        if (nBatchWeight >= nBatchSize) {
+            vProofChecks.emplace_back(std::move(saplingAuth), std::move(orchardAuth), &shieldedResult);
+            nBatchWeight = 0;
+        }
+    }
+    if (nBatchWeight > 0) {
+        vProofChecks.emplace_back(std::move(saplingAuth), std::move(orchardAuth), &shieldedResult);
+    }
+
+    size_t nChecks = vProofChecks.size();
+    CCheckQueueControl<CShieldedBatchCheck> proofControl(nScriptCheckThreads ? &proofcheckqueue : NULL);
+    if (nScriptCheckThreads) {
+        proofControl.Add(vProofChecks);
+        proofControl.Wait();
+    } else {
+        for (auto& check : vProofChecks) {
+            check();
+        }
     }
-    // Either the current tip or a successor of it we're working towards is left in setBlockIndexCandidates.
-    assert(!setBlockIndexCandidates.empty());
+
+    LogPrint("bench", "  - Pre-verify shielded proofs for blocks %d to %d: %u transactions in %u batches: %.2fms%s\n",
+        nStart, nEnd, vQueued.size(), nChecks, 0.001 * (GetTimeMicros() - nTimeStart),
+        (shieldedResult.fSaplingValid && shieldedResult.fOrchardValid) ? "" : " (some batches failed)");
+    RecordBlockStage("shielded_preverify", GetTimeMicros() - nTimeStart);
+    RecordSyncStage(SyncStage::Validation, GetTimeMicros() - nTimeStart);
 }
 
 /**
@@ -4350,10 +6745,13 @@ static bool ActivateBestChainStep(CValidationState& state, const CChainParams& c
 
     // Disconnect active blocks which are no longer in the best chain.
     bool fBlocksDisconnected = false;
-    while (chainActive.Tip() && chainActive.Tip() != pindexFork) {
-        if (!DisconnectTip(state, chainparams))
-            return false;
-        fBlocksDisconnected = true;
+    {
+        CDisconnectReader reader(chainparams, pindexFork);
+        while (chainActive.Tip() && chainActive.Tip() != pindexFork) {
+            if (!DisconnectTip(state, chainparams, false, &reader))
+                return false;
+            fBlocksDisconnected = true;
+        }
     }
 
     // Build list of new blocks to connect.
@@ -4373,21 +6771,22 @@ static bool ActivateBestChainStep(CValidationState& state, const CChainParams& c
         }
         nHeight = nTargetHeight;
 
+        PreverifyShieldedProofWindow(chainparams, pindexMostWork);
+
         // Connect new blocks.
         for (CBlockIndex *pindexConnect : reverse_iterate(vpindexToConnect)) {
             int64_t nTime1 = GetTimeMicros();
-            const CBlock* pconnectBlock;
-            CBlock block;
+            std::shared_ptr<const CBlock> pconnectBlock;
             if (pblock && pindexConnect == pindexMostWork) {
-                pconnectBlock = pblock;
+                pconnectBlock = std::make_shared<const CBlock>(*pblock);
             } else {
                 // read the block to be connected from disk
-                if (!ReadBlockFromDisk(block, pindexConnect, chainparams.GetConsensus()))
+                if (!ReadBlockFromDisk(pconnectBlock, pindexConnect, chainparams.GetConsensus()))
                     return AbortNode(state, "Failed to read block");
-                pconnectBlock = &block;
             }
             int64_t nTime2 = GetTimeMicros(); nTimeReadFromDisk += nTime2 - nTime1;
             LogPrint("bench", "  - Load block from disk: %.2fms [%.2fs]\n", (nTime2 - nTime1) * 0.001, nTimeReadFromDisk * 0.000001);
+            RecordBlockStage("load", nTime2 - nTime1);
 
             if (!ConnectTip(state, chainparams, pindexConnect, pconnectBlock)) {
                 if (state.IsInvalid()) {
@@ -4479,8 +6878,10 @@ bool ActivateBestChain(CValidationState& state, const CChainParams& chainparams,
 
         bool fInitialDownload;
         int nNewHeight;
+        const CBlockIndex *pindexFork;
         {
             LOCK(cs_main);
+            CBlockIndex *pindexOldTip = chainActive.Tip();
             if (pindexMostWork == NULL) {
                 pindexMostWork = FindMostWorkChain();
             }
@@ -4498,6 +6899,7 @@ bool ActivateBestChain(CValidationState& state, const CChainParams& chainparams,
                 pindexMostWork = NULL;
             }
             pindexNewTip = chainActive.Tip();
+            pindexFork = chainActive.FindFork(pindexOldTip);
             fInitialDownload = IsInitialBlockDownload(chainparams.GetConsensus());
             nNewHeight = chainActive.Height();
         }
@@ -4507,16 +6909,31 @@ bool ActivateBestChain(CValidationState& state, const CChainParams& chainparams,
         // Always notify the UI if a new block tip was connected
         uiInterface.NotifyBlockTip(fInitialDownload, pindexNewTip);
         if (!fInitialDownload) {
-            uint256 hashNewTip = pindexNewTip->GetBlockHash();
+            // Find the hashes of all blocks that weren't previously in the best chain.
+            std::vector<uint256> vHashes;
+            const CBlockIndex *pindexToAnnounce = pindexNewTip;
+            while (pindexToAnnounce != pindexFork) {
+                vHashes.push_back(pindexToAnnounce->GetBlockHash());
+                pindexToAnnounce = pindexToAnnounce->pprev;
+                if (vHashes.size() == MAX_BLOCKS_TO_ANNOUNCE) {
+                    // Limit announcements in case of a huge reorganization.
+                    // Rely on the peer's synchronization mechanism in that case.
+                    break;
+                }
+            }
             // Relay inventory, but don't relay old inventory during initial block download.
             int nBlockEstimate = 0;
             if (fCheckpointsEnabled)
                 nBlockEstimate = Checkpoints::GetTotalBlocksEstimate(chainparams.Checkpoints());
             {
                 LOCK(cs_vNodes);
-                for (CNode* pnode : vNodes)
-                    if (nNewHeight > (pnode->nStartingHeight != -1 ? pnode->nStartingHeight - 2000 : nBlockEstimate))
-                        pnode->PushBlockInventory(hashNewTip);
+                for (CNode* pnode : vNodes) {
+                    if (nNewHeight > (pnode->nStartingHeight != -1 ? pnode->nStartingHeight - 2000 : nBlockEstimate)) {
+                        for (auto it = vHashes.rbegin(); it != vHashes.rend(); ++it) {
+                            pnode->PushBlockHash(*it);
+                        }
+                    }
+                }
             }
             // Notify external listeners about the new tip.
             GetMainSignals().UpdatedBlockTip(pindexNewTip);
@@ -4541,6 +6958,7 @@ bool InvalidateBlock(CValidationState& state, const CChainParams& chainparams, C
     setDirtyBlockIndex.insert(pindex);
     setBlockIndexCandidates.erase(pindex);
 
+    CDisconnectReader reader(chainparams, chainActive.Contains(pindex) ? pindex->pprev : NULL);
     while (chainActive.Contains(pindex)) {
         CBlockIndex *pindexWalk = chainActive.Tip();
         pindexWalk->nStatus |= BLOCK_FAILED_CHILD;
@@ -4548,7 +6966,7 @@ bool InvalidateBlock(CValidationState& state, const CChainParams& chainparams, C
         setBlockIndexCandidates.erase(pindexWalk);
         // ActivateBestChain considers blocks already in chainActive
         // unconditionally valid already, so force disconnect away from it.
-        if (!DisconnectTip(state, chainparams)) {
+        if (!DisconnectTip(state, chainparams, false, &reader)) {
             mempool.removeForReorg(pcoinsTip, chainActive.Tip()->nHeight + 1, STANDARD_LOCKTIME_VERIFY_FLAGS);
             mempool.removeWithoutBranchId(
                 CurrentEpochBranchId(chainActive.Tip()->nHeight + 1, chainparams.GetConsensus()));
@@ -4623,11 +7041,13 @@ CBlockIndex* AddToBlockIndex(const CBlockHeader& block, const Consensus::Params&
     pindexNew->nSequenceId = 0;
     BlockMap::iterator mi = mapBlockIndex.insert(make_pair(hash, pindexNew)).first;
     pindexNew->phashBlock = &((*mi).first);
+    setChainTips.insert(pindexNew);
     BlockMap::iterator miPrev = mapBlockIndex.find(block.hashPrevBlock);
     if (miPrev != mapBlockIndex.end())
     {
         pindexNew->pprev = (*miPrev).second;
         pindexNew->nHeight = pindexNew->pprev->nHeight + 1;
+        setChainTips.erase(pindexNew->pprev);
 
         if (consensusParams.NetworkUpgradeActive(pindexNew->nHeight, Consensus::UPGRADE_NU5)) {
             // The following hashes will be null if this block has never been
@@ -4655,8 +7075,10 @@ CBlockIndex* AddToBlockIndex(const CBlockHeader& block, const Consensus::Params&
     }
     pindexNew->nChainWork = (pindexNew->pprev ? pindexNew->pprev->nChainWork : 0) + GetBlockProof(*pindexNew);
     pindexNew->RaiseValidity(BLOCK_VALID_TREE);
-    if (pindexBestHeader == NULL || pindexBestHeader->nChainWork < pindexNew->nChainWork)
+    if (pindexBestHeader == NULL || pindexBestHeader->nChainWork < pindexNew->nChainWork) {
         pindexBestHeader = pindexNew;
+        UpdateMetricsBestHeader(pindexBestHeader);
+    }
 
     setDirtyBlockIndex.insert(pindexNew);
 
@@ -4778,6 +7200,82 @@ void SetChainPoolValues(
     pindex->nChainLockboxValue = std::nullopt;
 }
 
+/**
+ * Set nChainTx and the chain value pool balances of pindexNew, whose parents
+ * are all BLOCK_VALID_TRANSACTIONS, and of any descendants that were waiting
+ * for it in mapBlocksUnlinked.
+ */
+static void LinkChainTransactions(CBlockIndex *pindexNew, const CChainParams& chainparams)
+{
+    deque<CBlockIndex*> queue;
+    queue.push_back(pindexNew);
+
+    // Recursively process any descendant blocks that now may be eligible to be connected.
+    while (!queue.empty()) {
+        CBlockIndex *pindex = queue.front();
+        queue.pop_front();
+        pindex->nChainTx = (pindex->pprev ? pindex->pprev->nChainTx : 0) + pindex->nTx;
+
+        if (pindex->pprev) {
+            // Transparent value and chain total supply are added to the
+            // block index only in `ConnectBlock`, because that's the only
+            // place that we have a valid coins view with which to compute
+            // the transparent input value and fees.
+
+            // Calculate the block's effect on the Sprout chain value pool balance.
+            if (pindex->pprev->nChainSproutValue && pindex->nSproutValue) {
+                pindex->nChainSproutValue = *pindex->pprev->nChainSproutValue + *pindex->nSproutValue;
+            } else {
+                pindex->nChainSproutValue = std::nullopt;
+            }
+
+            // Calculate the block's effect on the Sapling chain value pool balance.
+            if (pindex->pprev->nChainSaplingValue) {
+                pindex->nChainSaplingValue = *pindex->pprev->nChainSaplingValue + pindex->nSaplingValue;
+            } else {
+                pindex->nChainSaplingValue = std::nullopt;
+            }
+
+            // Calculate the block's effect on the Orchard chain value pool balance.
+            if (pindex->pprev->nChainOrchardValue) {
+                pindex->nChainOrchardValue = *pindex->pprev->nChainOrchardValue + pindex->nOrchardValue;
+            } else {
+                pindex->nChainOrchardValue = std::nullopt;
+            }
+
+            // Calculate the block's effect on the Lockbox balance
+            if (pindex->pprev->nChainLockboxValue) {
+                pindex->nChainLockboxValue = *pindex->pprev->nChainLockboxValue + pindex->nLockboxValue;
+            } else {
+                pindex->nChainLockboxValue = std::nullopt;
+            }
+        } else {
+            pindex->nChainTotalSupply = pindex->nChainSupplyDelta;
+            pindex->nChainTransparentValue = pindex->nTransparentValue;
+            pindex->nChainSproutValue = pindex->nSproutValue;
+            pindex->nChainSaplingValue = pindex->nSaplingValue;
+            pindex->nChainOrchardValue = pindex->nOrchardValue;
+            pindex->nChainLockboxValue = pindex->nLockboxValue;
+        }
+
+        // Fall back to hardcoded Sprout value pool balance
+        FallbackSproutValuePoolBalance(pindex, chainparams);
+
+        {
+            LOCK(cs_nBlockSequenceId);
+            pindex->nSequenceId = nBlockSequenceId++;
+        }
+        if (chainActive.Tip() == NULL || !setBlockIndexCandidates.value_comp()(pindex, chainActive.Tip())) {
+            setBlockIndexCandidates.insert(pindex);
+        }
+        std::pair<std::multimap<CBlockIndex*, CBlockIndex*>::iterator, std::multimap<CBlockIndex*, CBlockIndex*>::iterator> range = mapBlocksUnlinked.equal_range(pindex);
+        while (range.first != range.second) {
+            queue.push_back(range.first->second);
+            range.first = mapBlocksUnlinked.erase(range.first);
+        }
+    }
+}
+
 /**
  * Mark a block as having its data received and checked (up to BLOCK_VALID_TRANSACTIONS).
  * The caller is expected to mark `pindexNew` as dirty by adding it to `setDirtyBlockIndex`.
@@ -4800,79 +7298,135 @@ bool ReceivedBlockTransactions(
 
     if (pindexNew->pprev == NULL || pindexNew->pprev->nChainTx) {
         // If pindexNew is the genesis block or all parents are BLOCK_VALID_TRANSACTIONS.
-        deque<CBlockIndex*> queue;
-        queue.push_back(pindexNew);
-
-        // Recursively process any descendant blocks that now may be eligible to be connected.
-        while (!queue.empty()) {
-            CBlockIndex *pindex = queue.front();
-            queue.pop_front();
-            pindex->nChainTx = (pindex->pprev ? pindex->pprev->nChainTx : 0) + pindex->nTx;
-
-            if (pindex->pprev) {
-                // Transparent value and chain total supply are added to the
-                // block index only in `ConnectBlock`, because that's the only
-                // place that we have a valid coins view with which to compute
-                // the transparent input value and fees.
-
-                // Calculate the block's effect on the Sprout chain value pool balance.
-                if (pindex->pprev->nChainSproutValue && pindex->nSproutValue) {
-                    pindex->nChainSproutValue = *pindex->pprev->nChainSproutValue + *pindex->nSproutValue;
-                } else {
-                    pindex->nChainSproutValue = std::nullopt;
-                }
+        LinkChainTransactions(pindexNew, chainparams);
+    } else {
+        if (pindexNew->pprev && pindexNew->pprev->IsValid(BLOCK_VALID_TREE)) {
+            mapBlocksUnlinked.insert(std::make_pair(pindexNew->pprev, pindexNew));
+        }
+    }
 
-                // Calculate the block's effect on the Sapling chain value pool balance.
-                if (pindex->pprev->nChainSaplingValue) {
-                    pindex->nChainSaplingValue = *pindex->pprev->nChainSaplingValue + pindex->nSaplingValue;
-                } else {
-                    pindex->nChainSaplingValue = std::nullopt;
-                }
+    return true;
+}
 
-                // Calculate the block's effect on the Orchard chain value pool balance.
-                if (pindex->pprev->nChainOrchardValue) {
-                    pindex->nChainOrchardValue = *pindex->pprev->nChainOrchardValue + pindex->nOrchardValue;
-                } else {
-                    pindex->nChainOrchardValue = std::nullopt;
-                }
+bool ActivateCoinsSnapshot(CAutoFile& file, const CCoinsSnapshotMetadata& metadata, const uint256& hashSnapshot, const CChainParams& chainparams)
+{
+    AssertLockHeld(cs_main);
+    const Consensus::Params& consensusParams = chainparams.GetConsensus();
 
-                // Calculate the block's effect on the Lockbox balance
-                if (pindex->pprev->nChainLockboxValue) {
-                    pindex->nChainLockboxValue = *pindex->pprev->nChainLockboxValue + pindex->nLockboxValue;
-                } else {
-                    pindex->nChainLockboxValue = std::nullopt;
-                }
-            } else {
-                pindex->nChainTotalSupply = pindex->nChainSupplyDelta;
-                pindex->nChainTransparentValue = pindex->nTransparentValue;
-                pindex->nChainSproutValue = pindex->nSproutValue;
-                pindex->nChainSaplingValue = pindex->nSaplingValue;
-                pindex->nChainOrchardValue = pindex->nOrchardValue;
-                pindex->nChainLockboxValue = pindex->nLockboxValue;
-            }
+    BlockMap::iterator mi = mapBlockIndex.find(metadata.hashBlock);
+    if (mi == mapBlockIndex.end() || mi->second->nHeight != metadata.nHeight || metadata.nHeight <= 0)
+        return error("%s: snapshot base block %s is not in the block index", __func__, metadata.hashBlock.ToString());
+    CBlockIndex* pindexBase = mi->second;
+    if (chainActive.Height() != 0)
+        return error("%s: blocks have already been connected", __func__);
 
-            // Fall back to hardcoded Sprout value pool balance
-            FallbackSproutValuePoolBalance(pindex, chainparams);
+    std::vector<CBlockIndex*> vChain;
+    for (CBlockIndex* pindex = pindexBase; pindex->pprev != NULL; pindex = pindex->pprev) {
+        if (pindex->nStatus & BLOCK_FAILED_MASK)
+            return error("%s: snapshot base block %s is not on a valid chain", __func__, metadata.hashBlock.ToString());
+        vChain.push_back(pindex);
+    }
+    std::reverse(vChain.begin(), vChain.end());
 
-            {
-                LOCK(cs_nBlockSequenceId);
-                pindex->nSequenceId = nBlockSequenceId++;
-            }
-            if (chainActive.Tip() == NULL || !setBlockIndexCandidates.value_comp()(pindex, chainActive.Tip())) {
-                setBlockIndexCandidates.insert(pindex);
-            }
-            std::pair<std::multimap<CBlockIndex*, CBlockIndex*>::iterator, std::multimap<CBlockIndex*, CBlockIndex*>::iterator> range = mapBlocksUnlinked.equal_range(pindex);
+    CValidationState state;
+    if (!FlushStateToDisk(chainparams, state, FLUSH_STATE_ALWAYS))
+        return error("%s: failed to flush the chain state: %s", __func__, FormatStateMessage(state));
+    if (!pcoinsdbview->LoadSnapshot(file, metadata, hashSnapshot))
+        return AbortNode("Failed to load the UTXO snapshot", _("Error loading the UTXO snapshot; restart with -reindex-chainstate"));
+
+    // Replace the cache, which still remembers the previous best block and anchors.
+    CCoinsView* pcoinsBase = pcoinsTip->GetBackend();
+    coinsSnapshots.Clear();
+    delete pcoinsTip;
+    pcoinsTip = new CCoinsViewCache(pcoinsBase);
+    coinsSnapshots.Reset(pcoinsBase, pindexBase);
+    if (pcoinsTip->GetBestBlock() != metadata.hashBlock)
+        return AbortNode("Loaded UTXO snapshot does not match its metadata");
+
+    // The blocks up to the snapshot base are treated like blocks that were
+    // validated and then pruned. Their transaction counts and value pool
+    // deltas are unknown, so the totals recorded in the snapshot are
+    // attributed to the base block, which keeps them correct when
+    // LoadBlockIndexDB recomputes them from the deltas.
+    for (CBlockIndex* pindex : vChain) {
+        // Processed with each one's parent below.
+        if (pindex->nTx > 0) {
+            auto range = mapBlocksUnlinked.equal_range(pindex->pprev);
             while (range.first != range.second) {
-                queue.push_back(range.first->second);
-                range.first = mapBlocksUnlinked.erase(range.first);
-            }
+                range.first = range.first->second == pindex ? mapBlocksUnlinked.erase(range.first) : std::next(range.first);
+            }
+        }
+    }
+    for (CBlockIndex* pindex : vChain) {
+        CBlockIndex* pindexPrev = pindex->pprev;
+        if (pindex == pindexBase) {
+            if (pindex->nTx == 0) {
+                pindex->nTx = metadata.nChainTx > pindexPrev->nChainTx ? metadata.nChainTx - pindexPrev->nChainTx : 1;
+            }
+            pindex->nChainSupplyDelta = std::nullopt;
+            if (metadata.nChainTotalSupply && pindexPrev->nChainTotalSupply)
+                pindex->nChainSupplyDelta = *metadata.nChainTotalSupply - *pindexPrev->nChainTotalSupply;
+            pindex->nTransparentValue = std::nullopt;
+            if (metadata.nChainTransparentValue && pindexPrev->nChainTransparentValue)
+                pindex->nTransparentValue = *metadata.nChainTransparentValue - *pindexPrev->nChainTransparentValue;
+            pindex->nSproutValue = std::nullopt;
+            pindex->nSaplingValue = metadata.nChainSaplingValue - pindexPrev->nChainSaplingValue.value_or(0);
+            pindex->nOrchardValue = metadata.nChainOrchardValue - pindexPrev->nChainOrchardValue.value_or(0);
+            pindex->nLockboxValue = metadata.nChainLockboxValue - pindexPrev->nChainLockboxValue.value_or(0);
+        } else if (pindex->nTx == 0) {
+            pindex->nTx = 1;
+            pindex->nChainSupplyDelta = metadata.nChainTotalSupply ? std::optional<CAmount>(0) : std::nullopt;
+            pindex->nTransparentValue = metadata.nChainTransparentValue ? std::optional<CAmount>(0) : std::nullopt;
+            pindex->nSproutValue = std::nullopt;
+            pindex->nSaplingValue = 0;
+            pindex->nOrchardValue = 0;
+            pindex->nLockboxValue = 0;
+        }
+        if (pindexPrev->nChainTotalSupply && pindex->nChainSupplyDelta) {
+            pindex->nChainTotalSupply = *pindexPrev->nChainTotalSupply + *pindex->nChainSupplyDelta;
+        } else {
+            pindex->nChainTotalSupply = std::nullopt;
         }
-    } else {
-        if (pindexNew->pprev && pindexNew->pprev->IsValid(BLOCK_VALID_TREE)) {
-            mapBlocksUnlinked.insert(std::make_pair(pindexNew->pprev, pindexNew));
+        if (pindexPrev->nChainTransparentValue && pindex->nTransparentValue) {
+            pindex->nChainTransparentValue = *pindexPrev->nChainTransparentValue + *pindex->nTransparentValue;
+        } else {
+            pindex->nChainTransparentValue = std::nullopt;
         }
+
+        if (IsActivationHeightForAnyUpgrade(pindex->nHeight, consensusParams)) {
+            pindex->nStatus |= BLOCK_ACTIVATES_UPGRADE;
+            pindex->nCachedBranchId = CurrentEpochBranchId(pindex->nHeight, consensusParams);
+        } else {
+            pindex->nCachedBranchId = pindexPrev->nCachedBranchId;
+        }
+        pindex->RaiseValidity(BLOCK_VALID_SCRIPTS);
+        setDirtyBlockIndex.insert(pindex);
+        LinkChainTransactions(pindex, chainparams);
     }
 
+    pindexBase->hashFinalSproutRoot = pcoinsTip->GetBestAnchor(SPROUT);
+    if (consensusParams.NetworkUpgradeActive(pindexBase->nHeight, Consensus::UPGRADE_HEARTWOOD)) {
+        pindexBase->hashFinalSaplingRoot = pcoinsTip->GetBestAnchor(SAPLING);
+    }
+    if (consensusParams.NetworkUpgradeActive(pindexBase->nHeight, Consensus::UPGRADE_NU5)) {
+        pindexBase->hashAuthDataRoot = metadata.hashAuthDataRoot;
+        pindexBase->hashFinalOrchardRoot = pcoinsTip->GetBestAnchor(ORCHARD);
+        pindexBase->hashChainHistoryRoot = metadata.hashChainHistoryRoot;
+    }
+
+    fHavePruned = true;
+    pblocktree->WriteFlag("prunedblockfiles", true);
+    chainActive.SetTip(pindexBase);
+    chainStats.Update(chainActive);
+    PruneBlockIndexCandidates();
+    mempool.clear();
+
+    if (!FlushStateToDisk(chainparams, state, FLUSH_STATE_ALWAYS))
+        return error("%s: failed to flush the block index: %s", __func__, FormatStateMessage(state));
+    if (ptxoutsetstats)
+        ptxoutsetstats->Rescan();
+    LogPrintf("%s: loaded UTXO snapshot at height %d (%s)\n", __func__,
+        pindexBase->nHeight, pindexBase->GetBlockHash().ToString());
     return true;
 }
 
@@ -4906,7 +7460,7 @@ bool FindBlockPos(CValidationState &state, CDiskBlockPos &pos, unsigned int nAdd
         if (!fKnown) {
             LogPrintf("Leaving block file %i: %s\n", nFile, vinfoBlockFile[nFile].ToString());
         }
-        FlushBlockFile(!fKnown);
+        FlushBlockFile(!fKnown, true);
         nLastBlockFile = nFile;
     }
 
@@ -4917,16 +7471,16 @@ bool FindBlockPos(CValidationState &state, CDiskBlockPos &pos, unsigned int nAdd
         vinfoBlockFile[nFile].nSize += nAddSize;
 
     if (!fKnown) {
-        unsigned int nOldChunks = (pos.nPos + BLOCKFILE_CHUNK_SIZE - 1) / BLOCKFILE_CHUNK_SIZE;
-        unsigned int nNewChunks = (vinfoBlockFile[nFile].nSize + BLOCKFILE_CHUNK_SIZE - 1) / BLOCKFILE_CHUNK_SIZE;
+        unsigned int nOldChunks = (pos.nPos + nBlockFileChunkSize - 1) / nBlockFileChunkSize;
+        unsigned int nNewChunks = (vinfoBlockFile[nFile].nSize + nBlockFileChunkSize - 1) / nBlockFileChunkSize;
         if (nNewChunks > nOldChunks) {
             if (fPruneMode)
                 fCheckForPruning = true;
-            if (CheckDiskSpace(nNewChunks * BLOCKFILE_CHUNK_SIZE - pos.nPos)) {
+            if (CheckDiskSpace(nNewChunks * nBlockFileChunkSize - pos.nPos)) {
                 FILE *file = OpenBlockFile(pos);
                 if (file) {
-                    LogPrintf("Pre-allocating up to position 0x%x in blk%05u.dat\n", nNewChunks * BLOCKFILE_CHUNK_SIZE, pos.nFile);
-                    AllocateFileRange(file, pos.nPos, nNewChunks * BLOCKFILE_CHUNK_SIZE - pos.nPos);
+                    LogPrintf("Pre-allocating up to position 0x%x in blk%05u.dat\n", nNewChunks * nBlockFileChunkSize, pos.nFile);
+                    AllocateFileRange(file, pos.nPos, nNewChunks * nBlockFileChunkSize - pos.nPos);
                     fclose(file);
                 }
             }
@@ -4950,16 +7504,16 @@ bool FindUndoPos(CValidationState &state, int nFile, CDiskBlockPos &pos, unsigne
     nNewSize = vinfoBlockFile[nFile].nUndoSize += nAddSize;
     setDirtyFileInfo.insert(nFile);
 
-    unsigned int nOldChunks = (pos.nPos + UNDOFILE_CHUNK_SIZE - 1) / UNDOFILE_CHUNK_SIZE;
-    unsigned int nNewChunks = (nNewSize + UNDOFILE_CHUNK_SIZE - 1) / UNDOFILE_CHUNK_SIZE;
+    unsigned int nOldChunks = (pos.nPos + nUndoFileChunkSize - 1) / nUndoFileChunkSize;
+    unsigned int nNewChunks = (nNewSize + nUndoFileChunkSize - 1) / nUndoFileChunkSize;
     if (nNewChunks > nOldChunks) {
         if (fPruneMode)
             fCheckForPruning = true;
-        if (CheckDiskSpace(nNewChunks * UNDOFILE_CHUNK_SIZE - pos.nPos)) {
+        if (CheckDiskSpace(nNewChunks * nUndoFileChunkSize - pos.nPos)) {
             FILE *file = OpenUndoFile(pos);
             if (file) {
-                LogPrintf("Pre-allocating up to position 0x%x in rev%05u.dat\n", nNewChunks * UNDOFILE_CHUNK_SIZE, pos.nFile);
-                AllocateFileRange(file, pos.nPos, nNewChunks * UNDOFILE_CHUNK_SIZE - pos.nPos);
+                LogPrintf("Pre-allocating up to position 0x%x in rev%05u.dat\n", nNewChunks * nUndoFileChunkSize, pos.nFile);
+                AllocateFileRange(file, pos.nPos, nNewChunks * nUndoFileChunkSize - pos.nPos);
                 fclose(file);
             }
         }
@@ -4974,7 +7528,8 @@ bool CheckBlockHeader(
     const CBlockHeader& block,
     CValidationState& state,
     const CChainParams& chainparams,
-    bool fCheckPOW)
+    bool fCheckPOW,
+    bool fCheckSolution)
 {
     // Check block version
     if (block.nVersion < MIN_BLOCK_VERSION)
@@ -4982,7 +7537,7 @@ bool CheckBlockHeader(
                          REJECT_INVALID, "version-too-low");
 
     // Check Equihash solution is valid
-    if (fCheckPOW && !CheckEquihashSolution(&block, chainparams.GetConsensus()))
+    if (fCheckPOW && fCheckSolution && !CheckEquihashSolutionCached(&block, chainparams.GetConsensus()))
         return state.DoS(100, error("CheckBlockHeader(): Equihash solution invalid"),
                          REJECT_INVALID, "invalid-solution");
 
@@ -5008,7 +7563,8 @@ bool CheckBlock(const CBlock& block,
         return true;
 
     // Check that the header is valid (particularly PoW).  This is mostly
-    // redundant with the call in AcceptBlockHeader.
+    // redundant with the call in AcceptBlockHeader, and the Equihash solution
+    // of a header that was checked there is found in the cache.
     if (!CheckBlockHeader(block, state, chainparams, fCheckPOW))
         return false;
 
@@ -5049,12 +7605,26 @@ bool CheckBlock(const CBlock& block,
     // skip all transaction checks if this flag is not set
     if (!fCheckTransactions) return true;
 
-    // Check transactions
-    for (const CTransaction& tx : block.vtx)
-        if (!CheckTransaction(tx, state, verifier))
+    // Check transactions. The checks that do not verify proofs are spread over
+    // the transaction check threads first. If any of them fails, every check is
+    // run again in order, so that the state is that of the first invalid
+    // transaction.
+    bool fCheckedWithoutProofs = CheckTransactionsWithoutProofVerification(block.vtx);
+    for (const CTransaction& tx : block.vtx) {
+        bool fValid;
+        if (fCheckedWithoutProofs) {
+            if (!tx.IsCoinBase()) {
+                transactionsValidated.increment();
+            }
+            fValid = CheckTransactionProofs(tx, state, verifier);
+        } else {
+            fValid = CheckTransaction(tx, state, verifier);
+        }
+        if (!fValid)
             return error("CheckBlock(): CheckTransaction of %s failed with %s",
                 tx.GetHash().ToString(),
                 FormatStateMessage(state));
+    }
 
     unsigned int nSigOps = 0;
     for (const CTransaction& tx : block.vtx)
@@ -5126,6 +7696,16 @@ bool ContextualCheckBlockHeader(
         if (pcheckpoint && nHeight < pcheckpoint->nHeight) {
             return state.DoS(100, error("%s: forked chain older than last checkpoint (height %d)", __func__, nHeight));
         }
+
+        // Headers whose solutions were not checked must lead to the checkpoints
+        if (!ShouldCheckHeaderSolution(chainParams, nHeight)) {
+            const MapCheckpoints& checkpoints = chainParams.Checkpoints().mapCheckpoints;
+            auto it = checkpoints.find(nHeight);
+            if (it != checkpoints.end() && it->second != hash) {
+                return state.DoS(100, error("%s: rejected by checkpoint lock-in at height %d", __func__, nHeight),
+                                 REJECT_CHECKPOINT, "checkpoint mismatch");
+            }
+        }
     }
 
     // Reject block.nVersion < 4 blocks
@@ -5220,7 +7800,11 @@ bool ContextualCheckBlock(
     return true;
 }
 
-static bool AcceptBlockHeader(const CBlockHeader& block, CValidationState& state, const CChainParams& chainparams, CBlockIndex** ppindex=NULL)
+/**
+ * Add a block header to the block index, if it is valid.
+ * fSolutionChecked is set if its Equihash solution is already known to be valid.
+ */
+static bool AcceptBlockHeader(const CBlockHeader& block, CValidationState& state, const CChainParams& chainparams, CBlockIndex** ppindex=NULL, bool fSolutionChecked=false)
 {
     AssertLockHeld(cs_main);
     // Check for duplicate
@@ -5237,7 +7821,14 @@ static bool AcceptBlockHeader(const CBlockHeader& block, CValidationState& state
         return true;
     }
 
-    if (!CheckBlockHeader(block, state, chainparams))
+    bool fCheckSolution = !fSolutionChecked;
+    if (fCheckSolution && hash != chainparams.GetConsensus().hashGenesisBlock) {
+        BlockMap::iterator mi = mapBlockIndex.find(block.hashPrevBlock);
+        if (mi != mapBlockIndex.end() && !ShouldCheckHeaderSolution(chainparams, mi->second->nHeight + 1))
+            fCheckSolution = false;
+    }
+
+    if (!CheckBlockHeader(block, state, chainparams, true, fCheckSolution))
         return false;
 
     // Get prev block index
@@ -5278,7 +7869,8 @@ static bool AcceptBlock(const CBlock& block, CValidationState& state, const CCha
     CBlockIndex *pindexDummy = NULL;
     CBlockIndex *&pindex = ppindex ? *ppindex : pindexDummy;
 
-    if (!AcceptBlockHeader(block, state, chainparams, &pindex))
+    // A block that passed CheckBlock already had its Equihash solution checked.
+    if (!AcceptBlockHeader(block, state, chainparams, &pindex, block.fChecked))
         return false;
 
     SetChainPoolValues(chainparams, block, pindex);
@@ -5308,6 +7900,7 @@ static bool AcceptBlock(const CBlock& block, CValidationState& state, const CCha
     auto verifier = ProofVerifier::Disabled();
 
     bool fCheckTransactions = ShouldCheckTransactions(chainparams, pindex);
+    int64_t nTimeCheck = GetTimeMicros();
     if ((!CheckBlock(block, state, chainparams, verifier, true, true, fCheckTransactions)) ||
          !ContextualCheckBlock(block, state, chainparams, pindex->pprev, fCheckTransactions)) {
         if (state.IsInvalid() && !state.CorruptionPossible()) {
@@ -5316,12 +7909,23 @@ static bool AcceptBlock(const CBlock& block, CValidationState& state, const CCha
         }
         return false;
     }
+    int64_t nTimeWrite = GetTimeMicros();
+    RecordBlockStage("check", nTimeWrite - nTimeCheck);
+    RecordSyncStage(SyncStage::Validation, nTimeWrite - nTimeCheck);
 
     int nHeight = pindex->nHeight;
 
     // Write block to history file
     try {
-        unsigned int nBlockSize = ::GetSerializeSize(block, SER_DISK, CLIENT_VERSION);
+        // A block that is already on disk is not stored again.
+        std::optional<CStoredBlock> stored;
+        unsigned int nBlockSize;
+        if (dbp == NULL) {
+            stored.emplace(block, fBlockCompression);
+            nBlockSize = stored->vData.size();
+        } else {
+            nBlockSize = ::GetSerializeSize(block, SER_DISK, CLIENT_VERSION);
+        }
         CDiskBlockPos blockPos;
         if (dbp != NULL)
             blockPos = *dbp;
@@ -5329,7 +7933,7 @@ static bool AcceptBlock(const CBlock& block, CValidationState& state, const CCha
             return error("AcceptBlock(): FindBlockPos failed");
 
         if (dbp == NULL) {
-            if (!WriteBlockToDisk(block, blockPos, chainparams.MessageStart())) {
+            if (!WriteBlockToDisk(*stored, blockPos, chainparams.MessageStart())) {
                 AbortNode(state, "Failed to write block");
             }
         }
@@ -5337,6 +7941,8 @@ static bool AcceptBlock(const CBlock& block, CValidationState& state, const CCha
         if (!ReceivedBlockTransactions(block, state, chainparams, pindex, blockPos)) {
             return error("AcceptBlock(): ReceivedBlockTransactions failed");
         }
+        RecordBlockStage("write", GetTimeMicros() - nTimeWrite);
+        RecordSyncStage(SyncStage::Flush, GetTimeMicros() - nTimeWrite);
     } catch (const std::runtime_error& e) {
         return AbortNode(state, std::string("System error: ") + e.what());
     }
@@ -5364,10 +7970,11 @@ bool ProcessNewBlock(CValidationState& state, const CChainParams& chainparams, c
 {
     auto span = TracingSpan("info", "main", "ProcessNewBlock");
     auto spanGuard = span.Enter();
+    int64_t nTimeStart = GetTimeMicros();
 
     {
         LOCK(cs_main);
-        bool fRequested = MarkBlockAsReceived(pblock->GetHash()) | fForceProcessing;
+        bool fRequested = MarkBlockAsReceived(pblock->GetHash(), pfrom ? pfrom->GetId() : -1) | fForceProcessing;
 
         // Store to disk
         CBlockIndex *pindex = NULL;
@@ -5385,6 +7992,11 @@ bool ProcessNewBlock(CValidationState& state, const CChainParams& chainparams, c
     if (!ActivateBestChain(state, chainparams, pblock))
         return error("%s: ActivateBestChain failed", __func__);
 
+    auto tip = chainActive.TipSnapshot();
+    if (tip && tip->hash == pblock->GetHash()) {
+        RecordBlockStage("receive_to_connect", GetTimeMicros() - nTimeStart);
+    }
+
     return true;
 }
 
@@ -5478,12 +8090,69 @@ void UnlinkPrunedFiles(std::set<int>& setFilesToPrune)
 {
     for (set<int>::iterator it = setFilesToPrune.begin(); it != setFilesToPrune.end(); ++it) {
         CDiskBlockPos pos(*it, 0);
+        blockReader.ForgetFile(*it);
         fs::remove(GetBlockPosFilename(pos, "blk"));
         fs::remove(GetBlockPosFilename(pos, "rev"));
         LogPrintf("Prune: %s deleted blk/rev (%05u)\n", __func__, *it);
     }
 }
 
+namespace {
+
+Mutex cs_pruneUnlink;
+std::condition_variable condPruneUnlink;
+std::set<int> setPruneUnlinkQueue;
+bool fStopPruneUnlink = false;
+std::thread threadPruneUnlink;
+
+void ThreadPruneUnlink()
+{
+    RenameThread("zc-pruneunlink");
+    while (true) {
+        std::set<int> setFiles;
+        {
+            WAIT_LOCK(cs_pruneUnlink, lock);
+            condPruneUnlink.wait(lock, [] { return !setPruneUnlinkQueue.empty() || fStopPruneUnlink; });
+            if (setPruneUnlinkQueue.empty()) {
+                return;
+            }
+            setFiles.swap(setPruneUnlinkQueue);
+        }
+        try {
+            UnlinkPrunedFiles(setFiles);
+        } catch (const fs::filesystem_error& e) {
+            LogPrintf("Prune: %s: %s\n", __func__, e.what());
+        }
+    }
+}
+
+}
+
+void QueueUnlinkPrunedFiles(const std::set<int>& setFilesToPrune)
+{
+    {
+        LOCK(cs_pruneUnlink);
+        setPruneUnlinkQueue.insert(setFilesToPrune.begin(), setFilesToPrune.end());
+        if (!threadPruneUnlink.joinable()) {
+            fStopPruneUnlink = false;
+            threadPruneUnlink = std::thread(&ThreadPruneUnlink);
+        }
+    }
+    condPruneUnlink.notify_one();
+}
+
+void StopPruneUnlink()
+{
+    {
+        LOCK(cs_pruneUnlink);
+        fStopPruneUnlink = true;
+    }
+    condPruneUnlink.notify_all();
+    if (threadPruneUnlink.joinable()) {
+        threadPruneUnlink.join();
+    }
+}
+
 /* Calculate the block/rev files that should be deleted to remain under target*/
 void FindFilesToPrune(std::set<int>& setFilesToPrune, uint64_t nPruneAfterHeight)
 {
@@ -5500,7 +8169,7 @@ void FindFilesToPrune(std::set<int>& setFilesToPrune, uint64_t nPruneAfterHeight
     // We don't check to prune until after we've allocated new space for files
     // So we should leave a buffer under our target to account for another allocation
     // before the next pruning.
-    uint64_t nBuffer = BLOCKFILE_CHUNK_SIZE + UNDOFILE_CHUNK_SIZE;
+    uint64_t nBuffer = nBlockFileChunkSize + nUndoFileChunkSize;
     uint64_t nBytesToPrune;
     int count=0;
 
@@ -5574,6 +8243,18 @@ FILE* OpenUndoFile(const CDiskBlockPos &pos, bool fReadOnly) {
     return OpenDiskFile(pos, "rev", fReadOnly);
 }
 
+/** Recompute setChainTips from the parent pointers of the whole block index. */
+void static RebuildChainTips()
+{
+    setChainTips.clear();
+    for (const std::pair<const uint256, CBlockIndex*>& item : mapBlockIndex)
+        setChainTips.insert(item.second);
+    for (const std::pair<const uint256, CBlockIndex*>& item : mapBlockIndex) {
+        if (item.second->pprev)
+            setChainTips.erase(item.second->pprev);
+    }
+}
+
 fs::path GetBlockPosFilename(const CDiskBlockPos &pos, const char *prefix)
 {
     return GetDataDir() / "blocks" / strprintf("%s%05u.dat", prefix, pos.nFile);
@@ -5599,11 +8280,65 @@ CBlockIndex * InsertBlockIndex(const uint256& hash)
     return pindexNew;
 }
 
-bool static LoadBlockIndexDB(const CChainParams& chainparams)
+static fs::path GetBlockIndexSnapshotPath()
+{
+    return GetDataDir() / "blocks" / "blockindex.dat";
+}
+
+/**
+ * Load the block index from the snapshot written at the last shutdown, if
+ * the block index database was not written since. The chain work, the value
+ * pool totals and the skip pointers are read rather than computed again.
+ */
+bool static LoadBlockIndexSnapshot()
 {
-    if (!pblocktree->LoadBlockIndexGuts(InsertBlockIndex, chainparams))
+    uint256 hashSnapshot;
+    if (!pblocktree->ReadBlockIndexSnapshot(hashSnapshot))
+        return false;
+    // The snapshot stops matching the database once the database is written.
+    pblocktree->EraseBlockIndexSnapshot();
+    if (!fBlockIndexSnapshot)
         return false;
 
+    int64_t nStart = GetTimeMillis();
+    std::vector<CBlockIndex*> vSortedByHeight;
+    if (!ReadBlockIndexSnapshot(GetBlockIndexSnapshotPath(), hashSnapshot, pcoinsTip->GetBestBlock(),
+                                std::max(1, nScriptCheckThreads), mapBlockIndex, vSortedByHeight))
+        return false;
+
+    // Candidates with less work than the tip would be pruned as soon as the
+    // tip is set, so they are not added.
+    BlockMap::iterator itTip = mapBlockIndex.find(pcoinsTip->GetBestBlock());
+    CBlockIndex* pindexTip = itTip == mapBlockIndex.end() ? NULL : itTip->second;
+    for (CBlockIndex* pindex : vSortedByHeight)
+    {
+        if (pindex->nTx > 0 && pindex->pprev && !pindex->pprev->nChainTx)
+            mapBlocksUnlinked.insert(std::make_pair(pindex->pprev, pindex));
+        if (pindex->nTx > 0 && fExperimentalDeveloperSetPoolSizeZero) {
+            pindex->nChainSproutValue = 0;
+            pindex->nChainSaplingValue = 0;
+            pindex->nChainOrchardValue = 0;
+        }
+        if (pindex->IsValid(BLOCK_VALID_TRANSACTIONS) && (pindex->nChainTx || pindex->pprev == NULL) &&
+            (pindexTip == NULL || !CBlockIndexWorkComparator()(pindex, pindexTip)))
+            setBlockIndexCandidates.insert(pindex);
+        if (pindex->nStatus & BLOCK_FAILED_MASK && (!pindexBestInvalid || pindex->nChainWork > pindexBestInvalid->nChainWork))
+            pindexBestInvalid = pindex;
+        if (pindex->IsValid(BLOCK_VALID_TREE) && (pindexBestHeader == NULL || CBlockIndexWorkComparator()(pindexBestHeader, pindex)))
+            pindexBestHeader = pindex;
+    }
+
+    LogPrintf("%s: loaded %u block index entries from the snapshot in %dms\n", __func__,
+        vSortedByHeight.size(), GetTimeMillis() - nStart);
+    return true;
+}
+
+/**
+ * Compute what is only kept in memory for the entries read from the block
+ * index database.
+ */
+void static ComputeBlockIndexValues(const CChainParams& chainparams)
+{
     // Calculate nChainWork
     vector<pair<int, CBlockIndex*> > vSortedByHeight;
     vSortedByHeight.reserve(mapBlockIndex.size());
@@ -5713,6 +8448,16 @@ bool static LoadBlockIndexDB(const CChainParams& chainparams)
         if (pindex->IsValid(BLOCK_VALID_TREE) && (pindexBestHeader == NULL || CBlockIndexWorkComparator()(pindexBestHeader, pindex)))
             pindexBestHeader = pindex;
     }
+}
+
+bool static LoadBlockIndexDB(const CChainParams& chainparams)
+{
+    if (!LoadBlockIndexSnapshot()) {
+        if (!pblocktree->LoadBlockIndexGuts(InsertBlockIndex, chainparams))
+            return false;
+        ComputeBlockIndexValues(chainparams);
+    }
+    RebuildChainTips();
 
     // Load block file info
     pblocktree->ReadLastBlockFile(nLastBlockFile);
@@ -5751,8 +8496,21 @@ bool static LoadBlockIndexDB(const CChainParams& chainparams)
 
     // Check whether we have ever pruned block & undo files
     pblocktree->ReadFlag("prunedblockfiles", fHavePruned);
-    if (fHavePruned)
+    if (fHavePruned) {
         LogPrintf("LoadBlockIndexDB(): Block files have previously been pruned\n");
+        // Remove the files that were pruned but not yet deleted when the
+        // node last stopped.
+        std::set<int> setFilesToPrune;
+        for (int nFile = 0; nFile < nLastBlockFile; nFile++) {
+            if (vinfoBlockFile[nFile].nSize == 0 && vinfoBlockFile[nFile].nUndoSize == 0 &&
+                !setBlkDataFiles.count(nFile) && fs::exists(GetBlockPosFilename(CDiskBlockPos(nFile, 0), "blk"))) {
+                setFilesToPrune.insert(nFile);
+            }
+        }
+        if (!setFilesToPrune.empty()) {
+            QueueUnlinkPrunedFiles(setFilesToPrune);
+        }
+    }
 
     // Check whether we need to continue reindexing
     bool fReindexing = false;
@@ -5794,24 +8552,185 @@ bool static LoadBlockIndexDB(const CChainParams& chainparams)
         }
     }
 
-    // Load pointer to end of best chain
-    BlockMap::iterator it = mapBlockIndex.find(pcoinsTip->GetBestBlock());
-    if (it == mapBlockIndex.end())
-        return true;
-    chainActive.SetTip(it->second);
-    // Set hashFinalSproutRoot for the end of best chain
-    it->second->hashFinalSproutRoot = pcoinsTip->GetBestAnchor(SPROUT);
-
-    PruneBlockIndexCandidates();
+    // Load pointer to end of best chain
+    BlockMap::iterator it = mapBlockIndex.find(pcoinsTip->GetBestBlock());
+    if (it == mapBlockIndex.end())
+        return true;
+    chainActive.SetTip(it->second);
+    chainStats.Update(chainActive);
+    // Set hashFinalSproutRoot for the end of best chain
+    it->second->hashFinalSproutRoot = pcoinsTip->GetBestAnchor(SPROUT);
+
+    PruneBlockIndexCandidates();
+
+    LogPrintf("%s: hashBestChain=%s height=%d date=%s progress=%f\n", __func__,
+        chainActive.Tip()->GetBlockHash().ToString(), chainActive.Height(),
+        DateTimeStrFormat("%Y-%m-%d %H:%M:%S", chainActive.Tip()->GetBlockTime()),
+        Checkpoints::GuessVerificationProgress(chainparams.Checkpoints(), chainActive.Tip()));
+
+    EnforceNodeDeprecation(chainparams, chainActive.Height(), true);
+
+    return true;
+}
+
+void SaveBlockIndexSnapshot()
+{
+    AssertLockHeld(cs_main);
+    // A snapshot taken with the developer pool size override would hold the
+    // overridden pool totals.
+    if (!fBlockIndexSnapshot || fReindex || fImporting || fExperimentalDeveloperSetPoolSizeZero ||
+        pblocktree == NULL || pcoinsTip == NULL)
+        return;
+    // The snapshot must match the block index database.
+    if (!setDirtyBlockIndex.empty() || !setDirtyFileInfo.empty())
+        return;
+
+    int64_t nStart = GetTimeMillis();
+    uint256 hashSnapshot;
+    if (WriteBlockIndexSnapshot(GetBlockIndexSnapshotPath(), mapBlockIndex, pcoinsTip->GetBestBlock(), hashSnapshot) &&
+        pblocktree->WriteBlockIndexSnapshot(hashSnapshot)) {
+        LogPrintf("%s: wrote %u block index entries in %dms\n", __func__, mapBlockIndex.size(), GetTimeMillis() - nStart);
+    }
+}
+
+//! How many blocks CVerifyDBChecker checks ahead of those being verified.
+static const size_t MAX_VERIFY_READAHEAD = 64;
+
+/**
+ * Reads and checks the blocks that VerifyDB verifies, and their undo data,
+ * on several threads. These checks do not depend on one another, unlike
+ * disconnecting the blocks, which VerifyDB then does in order from the tip.
+ * Blocks are checked at most MAX_VERIFY_READAHEAD ahead of that.
+ */
+class CVerifyDBChecker
+{
+private:
+    struct Entry
+    {
+        //! Taken from the block index when the checker is created, as the
+        //! threads may not read the block index.
+        uint256 hash;
+        uint256 hashPrev;
+        CDiskBlockPos pos;
+        CDiskBlockPos posUndo;
+        bool fCheckTransactions;
+
+        bool fChecked = false;
+        //! What failed, if the block did not pass the checks.
+        std::string strError;
+        CBlock block;
+    };
+
+    const CChainParams& chainparams;
+    const int nCheckLevel;
+    Mutex cs;
+    std::condition_variable cond;
+    std::vector<Entry> vEntries;
+    size_t nNextCheck = 0;
+    size_t nNextTake = 0;
+    bool fStop = false;
+    std::vector<std::thread> threads;
+
+    void ThreadCheck();
+
+public:
+    //! Start checking the given blocks, in that order. Requires cs_main.
+    CVerifyDBChecker(const CChainParams& chainparamsIn, const std::vector<CBlockIndex*>& vBlocks, int nCheckLevelIn, int nThreads);
+    ~CVerifyDBChecker();
+
+    //! Take the next block. Returns false, with what failed in strError, if
+    //! it did not pass the checks.
+    bool Take(CBlock& block, std::string& strError);
+};
+
+CVerifyDBChecker::CVerifyDBChecker(const CChainParams& chainparamsIn, const std::vector<CBlockIndex*>& vBlocks, int nCheckLevelIn, int nThreads) :
+    chainparams(chainparamsIn), nCheckLevel(nCheckLevelIn)
+{
+    AssertLockHeld(cs_main);
+    for (const CBlockIndex* pindex : vBlocks) {
+        Entry entry;
+        entry.hash = pindex->GetBlockHash();
+        entry.hashPrev = pindex->pprev->GetBlockHash();
+        entry.pos = pindex->GetBlockPos();
+        entry.posUndo = pindex->GetUndoPos();
+        entry.fCheckTransactions = ShouldCheckTransactions(chainparams, pindex);
+        vEntries.push_back(std::move(entry));
+    }
+    for (int i = 0; i < nThreads; i++) {
+        threads.emplace_back(&CVerifyDBChecker::ThreadCheck, this);
+    }
+}
+
+CVerifyDBChecker::~CVerifyDBChecker()
+{
+    {
+        LOCK(cs);
+        fStop = true;
+    }
+    cond.notify_all();
+    for (std::thread& thread : threads) {
+        thread.join();
+    }
+}
+
+void CVerifyDBChecker::ThreadCheck()
+{
+    RenameThread("zc-verifydb");
+    auto verifier = ProofVerifier::Disabled(); // No need to verify JoinSplits twice
+    while (true) {
+        Entry* pentry;
+        {
+            WAIT_LOCK(cs, lock);
+            cond.wait(lock, [this] {
+                return fStop || nNextCheck == vEntries.size() || nNextCheck < nNextTake + MAX_VERIFY_READAHEAD;
+            });
+            if (fStop || nNextCheck == vEntries.size())
+                return;
+            pentry = &vEntries[nNextCheck++];
+        }
 
-    LogPrintf("%s: hashBestChain=%s height=%d date=%s progress=%f\n", __func__,
-        chainActive.Tip()->GetBlockHash().ToString(), chainActive.Height(),
-        DateTimeStrFormat("%Y-%m-%d %H:%M:%S", chainActive.Tip()->GetBlockTime()),
-        Checkpoints::GuessVerificationProgress(chainparams.Checkpoints(), chainActive.Tip()));
+        // Only this thread touches the entry until it is marked as checked.
+        CBlock block;
+        CValidationState state;
+        std::string strError;
+        // check level 0: read from disk
+        if (!ReadBlockFromDisk(block, pentry->pos, chainparams.GetConsensus()) || block.GetHash() != pentry->hash) {
+            strError = "ReadBlockFromDisk failed";
+        // check level 1: verify block validity
+        } else if (nCheckLevel >= 1 && !CheckBlock(block, state, chainparams, verifier, true, true, pentry->fCheckTransactions)) {
+            strError = "found bad block";
+        // check level 2: verify undo validity
+        } else if (nCheckLevel >= 2 && !pentry->posUndo.IsNull()) {
+            CBlockUndo undo;
+            if (!UndoReadFromDisk(undo, pentry->posUndo, pentry->hashPrev)) {
+                strError = "found bad undo data";
+            }
+        }
 
-    EnforceNodeDeprecation(chainparams, chainActive.Height(), true);
+        {
+            LOCK(cs);
+            pentry->fChecked = true;
+            pentry->strError = strError;
+            // Only disconnecting the blocks, at check level 3, needs them.
+            if (nCheckLevel >= 3) {
+                pentry->block = std::move(block);
+            }
+        }
+        cond.notify_all();
+    }
+}
 
-    return true;
+bool CVerifyDBChecker::Take(CBlock& block, std::string& strError)
+{
+    WAIT_LOCK(cs, lock);
+    assert(nNextTake < vEntries.size());
+    cond.wait(lock, [this] { return vEntries[nNextTake].fChecked; });
+    Entry& entry = vEntries[nNextTake++];
+    strError = entry.strError;
+    block = std::move(entry.block);
+    lock.unlock();
+    cond.notify_all();
+    return strError.empty();
 }
 
 CVerifyDB::CVerifyDB()
@@ -5843,36 +8762,30 @@ bool CVerifyDB::VerifyDB(const CChainParams& chainparams, CCoinsView *coinsview,
     int nGoodTransactions = 0;
     CValidationState state;
 
-    // Flags used to permit skipping checks for efficiency
-    auto verifier = ProofVerifier::Disabled(); // No need to verify JoinSplits twice
-    bool fCheckTransactions = true;
-
+    std::vector<CBlockIndex*> vBlocks;
     for (CBlockIndex* pindex = chainActive.Tip(); pindex && pindex->pprev; pindex = pindex->pprev)
     {
-        boost::this_thread::interruption_point();
-        uiInterface.ShowProgress(_("Verifying blocks..."), std::max(1, std::min(99, (int)(((double)(chainActive.Height() - pindex->nHeight)) / (double)nCheckDepth * (nCheckLevel >= 4 ? 50 : 100)))));
         if (pindex->nHeight < chainActive.Height()-nCheckDepth)
             break;
+        // Blocks below a loaded UTXO snapshot were never downloaded.
+        if (fHavePruned && !(pindex->nStatus & BLOCK_HAVE_DATA))
+            break;
+        vBlocks.push_back(pindex);
+    }
 
-        CBlock block;
-        // check level 0: read from disk
-        if (!ReadBlockFromDisk(block, pindex, chainparams.GetConsensus()))
-            return error("VerifyDB(): *** ReadBlockFromDisk failed at %d, hash=%s", pindex->nHeight, pindex->GetBlockHash().ToString());
+    // Check levels 0 to 2 are done for each block independently, on as many
+    // threads as verifying scripts.
+    CVerifyDBChecker checker(chainparams, vBlocks, nCheckLevel, std::max(1, nScriptCheckThreads));
 
-        // check level 1: verify block validity
-        fCheckTransactions = ShouldCheckTransactions(chainparams, pindex);
-        if (nCheckLevel >= 1 && !CheckBlock(block, state, chainparams, verifier, true, true, fCheckTransactions))
-            return error("VerifyDB(): *** found bad block at %d, hash=%s\n", pindex->nHeight, pindex->GetBlockHash().ToString());
+    for (CBlockIndex* pindex : vBlocks)
+    {
+        boost::this_thread::interruption_point();
+        uiInterface.ShowProgress(_("Verifying blocks..."), std::max(1, std::min(99, (int)(((double)(chainActive.Height() - pindex->nHeight)) / (double)nCheckDepth * (nCheckLevel >= 4 ? 50 : 100)))));
 
-        // check level 2: verify undo validity
-        if (nCheckLevel >= 2 && pindex) {
-            CBlockUndo undo;
-            CDiskBlockPos pos = pindex->GetUndoPos();
-            if (!pos.IsNull()) {
-                if (!UndoReadFromDisk(undo, pos, pindex->pprev->GetBlockHash()))
-                    return error("VerifyDB(): *** found bad undo data at %d, hash=%s\n", pindex->nHeight, pindex->GetBlockHash().ToString());
-            }
-        }
+        CBlock block;
+        std::string strError;
+        if (!checker.Take(block, strError))
+            return error("VerifyDB(): *** %s at %d, hash=%s", strError, pindex->nHeight, pindex->GetBlockHash().ToString());
 
         // check level 3: check for inconsistencies during memory-only disconnect of tip blocks
         if (nCheckLevel >= 3 && pindex == pindexState && (coins.DynamicMemoryUsage() + pcoinsTip->DynamicMemoryUsage()) <= nCoinCacheUsage) {
@@ -5916,6 +8829,65 @@ bool CVerifyDB::VerifyDB(const CChainParams& chainparams, CCoinsView *coinsview,
     return true;
 }
 
+namespace {
+
+/** The rebuild of the subtree completed by one block. */
+struct SubtreeRebuild
+{
+    const CBlockIndex* pindex;
+    //! The final frontier of the previous block, of the pool being rebuilt.
+    SaplingMerkleTree saplingTree;
+    OrchardMerkleFrontier orchardTree;
+    //! The rebuilt subtree, or nothing if the block could not be read.
+    std::optional<libzcash::SubtreeData> subtree;
+
+    explicit SubtreeRebuild(const CBlockIndex* pindexIn) : pindex(pindexIn) {}
+
+    //! Read the block and append its note commitments to the frontier until
+    //! they complete the subtree. Called from any thread.
+    void Rebuild(ShieldedType type, const Consensus::Params& consensusParams)
+    {
+        CBlock block;
+        if (!ReadBlockFromDisk(block, pindex, consensusParams)) {
+            return;
+        }
+
+        if (type == SAPLING) {
+            for (const CTransaction &tx : block.vtx) {
+                for (const auto &outputDescription : tx.GetSaplingOutputs()) {
+                    saplingTree.append(uint256::FromRawBytes(outputDescription.cmu()));
+
+                    auto completeSubtreeRoot = saplingTree.complete_subtree_root();
+                    if (completeSubtreeRoot.has_value()) {
+                        subtree = libzcash::SubtreeData(completeSubtreeRoot->ToRawBytes(), pindex->nHeight);
+                        return;
+                    }
+                }
+            }
+        } else {
+            for (const CTransaction &tx : block.vtx) {
+                if (tx.GetOrchardBundle().IsPresent()) {
+                    try {
+                        auto appendResult = orchardTree.AppendBundle(tx.GetOrchardBundle());
+                        if (appendResult.has_subtree_boundary) {
+                            subtree = libzcash::SubtreeData(appendResult.completed_subtree_root, pindex->nHeight);
+                            return;
+                        }
+                    } catch (const rust::Error& e) {
+                        return;
+                    }
+                }
+            }
+        }
+
+        // We should not get here; this block should have completed the subtree
+        // and one of the return statements above should have executed.
+        assert(false);
+    }
+};
+
+} // namespace
+
 bool RegenerateSubtrees(ShieldedType type, const Consensus::Params& consensusParams)
 {
     AssertLockHeld(cs_main);
@@ -6049,84 +9021,60 @@ bool RegenerateSubtrees(ShieldedType type, const Consensus::Params& consensusPar
 
     LogPrintf("RegenerateSubtrees: Found all complete subtrees.\n");
 
-    percentage = 0;
-
-    for (size_t subtreeIndex = 0; subtreeIndex < vHeights.size(); subtreeIndex++) {
-        if ((subtreeIndex % loggingModulus) == 0) {
-            LogPrintf(
-                "RegenerateSubtrees: Rebuilding complete subtrees... %d percent complete (%d / %d)\n",
-                percentage,
-                subtreeIndex,
-                chainSubtreeIndex
-            );
-            percentage += 10;
-        }
-
-        int nHeight = vHeights[subtreeIndex];
-
-        auto pindex = chainActive[nHeight];
-        CBlock block;
-        if (!ReadBlockFromDisk(block, pindex, consensusParams)) {
-            LogPrintf("Failed to read block\n");
-            return false;
-        }
-
-        // We'll grab the final frontier from the previous block (which
-        // should have a hashFinalSaplingRoot/hashFinalOrchardRoot
-        // because this block completed a 2^16 size subtree!) and append
-        // to it until we complete the subtree.
-        auto pushSapling = [&]() {
-            SaplingMerkleTree sapling_tree;
-            assert(pcoinsTip->GetSaplingAnchorAt(pindex->pprev->hashFinalSaplingRoot, sapling_tree));
-            for (const CTransaction &tx : block.vtx) {
-                for (const auto &outputDescription : tx.GetSaplingOutputs()) {
-                    sapling_tree.append(uint256::FromRawBytes(outputDescription.cmu()));
-
-                    auto completeSubtreeRoot = sapling_tree.complete_subtree_root();
-                    if (completeSubtreeRoot.has_value()) {
-                        libzcash::SubtreeData subtree(completeSubtreeRoot->ToRawBytes(), nHeight);
-                        pcoinsTip->PushSubtree(SAPLING, subtree);
-                        return;
-                    }
-                }
+    // Each subtree is rebuilt from the final frontier of the block before
+    // the one that completed it, by appending the note commitments of that
+    // block, independently of the other subtrees. Reading those blocks and
+    // hashing their commitments is most of the work, so it is spread across
+    // threads, a batch of subtrees at a time. The frontiers are looked up
+    // here, because pcoinsTip is not thread-safe, and the subtrees are
+    // pushed in order once the batch is done.
+    int nThreads = std::max(1, nScriptCheckThreads);
+    size_t nBatchSize = 64 * nThreads;
+
+    for (size_t nBatchStart = 0; nBatchStart < vHeights.size(); nBatchStart += nBatchSize) {
+        size_t nBatchEnd = std::min(vHeights.size(), nBatchStart + nBatchSize);
+        LogPrintf(
+            "RegenerateSubtrees: Rebuilding complete subtrees... %d percent complete (%d / %d)\n",
+            nBatchStart * 100 / vHeights.size(),
+            nBatchStart,
+            vHeights.size()
+        );
+
+        std::vector<SubtreeRebuild> vRebuilds;
+        for (size_t subtreeIndex = nBatchStart; subtreeIndex < nBatchEnd; subtreeIndex++) {
+            // The previous block should have a hashFinalSaplingRoot or
+            // hashFinalOrchardRoot, because this block completed a 2^16
+            // size subtree.
+            SubtreeRebuild rebuild(chainActive[vHeights[subtreeIndex]]);
+            if (type == SAPLING) {
+                assert(pcoinsTip->GetSaplingAnchorAt(rebuild.pindex->pprev->hashFinalSaplingRoot, rebuild.saplingTree));
+            } else {
+                assert(pcoinsTip->GetOrchardAnchorAt(rebuild.pindex->pprev->hashFinalOrchardRoot, rebuild.orchardTree));
             }
+            vRebuilds.push_back(std::move(rebuild));
+        }
 
-            // We should not get here; this block should have completed the subtree
-            // and the return statement above should have executed.
-            assert(false);
-        };
-
-        auto pushOrchard = [&]() {
-            OrchardMerkleFrontier orchard_tree;
-            assert(pcoinsTip->GetOrchardAnchorAt(pindex->pprev->hashFinalOrchardRoot, orchard_tree));
-            for (const CTransaction &tx : block.vtx) {
-                if (tx.GetOrchardBundle().IsPresent()) {
-                    try {
-                        auto appendResult = orchard_tree.AppendBundle(tx.GetOrchardBundle());
-                        if (appendResult.has_subtree_boundary) {
-                            libzcash::SubtreeData subtree(appendResult.completed_subtree_root, nHeight);
-
-                            pcoinsTip->PushSubtree(ORCHARD, subtree);
-                            return true;
-                        }
-                    } catch (const rust::Error& e) {
-                        return false;
-                    }
-                }
+        std::atomic<size_t> nNext{0};
+        auto rebuildSubtrees = [&]() {
+            for (size_t i = nNext++; i < vRebuilds.size(); i = nNext++) {
+                vRebuilds[i].Rebuild(type, consensusParams);
             }
-
-            // Similarly we should not get here.
-            assert(false);
         };
+        std::vector<std::thread> threads;
+        for (int i = 1; i < std::min<int>(nThreads, vRebuilds.size()); i++) {
+            threads.emplace_back(rebuildSubtrees);
+        }
+        rebuildSubtrees();
+        for (std::thread& thread : threads) {
+            thread.join();
+        }
 
-        if (type == SAPLING) {
-            pushSapling();
-        } else if (type == ORCHARD) {
-            if (!pushOrchard()) {
+        for (const SubtreeRebuild& rebuild : vRebuilds) {
+            if (!rebuild.subtree.has_value()) {
+                LogPrintf("RegenerateSubtrees: Failed to rebuild the subtree completed at height %d\n", rebuild.pindex->nHeight);
                 return false;
             }
-        } else {
-            assert(false);
+            pcoinsTip->PushSubtree(type, *rebuild.subtree);
         }
     }
 
@@ -6212,23 +9160,25 @@ bool RewindBlockIndex(const CChainParams& chainparams, bool& clearWitnessCaches)
         }
     }
 
+    // The chain state is only written once the rewind is done, below, or
+    // when the coins cache fills up.
     CValidationState state;
     CBlockIndex* pindex = chainActive.Tip();
-    while (chainActive.Height() > lastValidHeight) {
-        if (fPruneMode && !(chainActive.Tip()->nStatus & BLOCK_HAVE_DATA)) {
-            // If pruning, don't try rewinding past the HAVE_DATA point;
-            // since older blocks can't be served anyway, there's
-            // no need to walk further, and trying to DisconnectTip()
-            // will fail (and require a needless reindex/redownload
-            // of the blockchain).
-            break;
-        }
-        if (!DisconnectTip(state, chainparams, true)) {
-            return error("RewindBlockIndex: unable to disconnect block at height %i", pindex->nHeight);
+    {
+        CDisconnectReader reader(chainparams, chainActive[lastValidHeight]);
+        while (chainActive.Height() > lastValidHeight) {
+            if (fPruneMode && !(chainActive.Tip()->nStatus & BLOCK_HAVE_DATA)) {
+                // If pruning, don't try rewinding past the HAVE_DATA point;
+                // since older blocks can't be served anyway, there's
+                // no need to walk further, and trying to DisconnectTip()
+                // will fail (and require a needless reindex/redownload
+                // of the blockchain).
+                break;
+            }
+            if (!DisconnectTip(state, chainparams, true, &reader)) {
+                return error("RewindBlockIndex: unable to disconnect block at height %i", pindex->nHeight);
+            }
         }
-        // Occasionally flush state to disk.
-        if (!FlushStateToDisk(chainparams, state, FLUSH_STATE_PERIODIC))
-            return false;
     }
 
     // Collect blocks to be removed (blocks in mapBlockIndex must be at least BLOCK_VALID_TREE).
@@ -6282,6 +9232,7 @@ bool RewindBlockIndex(const CChainParams& chainparams, bool& clearWitnessCaches)
             delete pindex;
         }
     }
+    RebuildChainTips();
 
     PruneBlockIndexCandidates();
 
@@ -6307,217 +9258,591 @@ void UnloadBlockIndex()
     LOCK(cs_main);
     setBlockIndexCandidates.clear();
     chainActive.SetTip(NULL);
+    chainStats.Clear();
     pindexBestInvalid = NULL;
     pindexBestHeader = NULL;
     mempool.clear();
-    mapOrphanTransactions.clear();
-    mapOrphanTransactionsByPrev.clear();
+    {
+        LOCK(g_cs_orphans);
+        mapOrphanTransactions.clear();
+        mapOrphanTransactionsByPrev.clear();
+        mapOrphanPeers.clear();
+        nOrphanTxUsage = 0;
+    }
     nSyncStarted = 0;
     mapBlocksUnlinked.clear();
+    recentBlocks.Clear();
     vinfoBlockFile.clear();
     nLastBlockFile = 0;
     nBlockSequenceId = 1;
+    nProofWindowEnd = -1;
     mapBlockSource.clear();
     mapBlocksInFlight.clear();
     nQueuedValidatedHeaders = 0;
     nPreferredDownload = 0;
+    nTxReconFloodPeers = 0;
     setDirtyBlockIndex.clear();
     setDirtyFileInfo.clear();
     mapNodeState.clear();
     recentRejects.reset(NULL);
+    txRejectCache.reset();
 
     for (BlockMap::value_type& entry : mapBlockIndex) {
         delete entry.second;
     }
-    mapBlockIndex.clear();
-    fHavePruned = false;
+    mapBlockIndex.clear();
+    setChainTips.clear();
+    fHavePruned = false;
+}
+
+bool LoadBlockIndex()
+{
+    // Load block index from databases
+    if (!fReindex && !LoadBlockIndexDB(Params()))
+        return false;
+    return true;
+}
+
+bool InitBlockIndex(const CChainParams& chainparams)
+{
+    LOCK(cs_main);
+
+    // Initialize global variables that cannot be constructed at startup.
+    recentRejects.reset(new CRollingBloomFilter(RECENT_REJECTS_ENTRIES, 0.000001));
+    txRejectCache.reset(new CTxRejectCache(
+        std::max((int64_t)0, GetArg("-maxrejectmemory", DEFAULT_MAX_REJECT_MEMORY)) * 1000000));
+
+    // Check whether we're already initialized
+    if (chainActive.Genesis() != NULL)
+        return true;
+
+    // Use the provided setting for -txindex in the new database
+    fTxIndex = GetBoolArg("-txindex", DEFAULT_TXINDEX);
+    pblocktree->WriteFlag("txindex", fTxIndex);
+
+    // Use the provided setting for -insightexplorer or -lightwalletd in the new database
+    pblocktree->WriteFlag("insightexplorer", fExperimentalInsightExplorer);
+    pblocktree->WriteFlag("lightwalletd", fExperimentalLightWalletd);
+    if (fExperimentalInsightExplorer) {
+        fAddressIndex = true;
+        fSpentIndex = true;
+        fTimestampIndex = true;
+    }
+    else if (fExperimentalLightWalletd) {
+        fAddressIndex = true;
+    }
+
+    LogPrintf("Initializing databases...\n");
+
+    // Only add the genesis block if not reindexing (in which case we reuse the one already on disk)
+    if (!fReindex) {
+        try {
+            CBlock &block = const_cast<CBlock&>(chainparams.GenesisBlock());
+            // Start new block file
+            CStoredBlock stored(block, fBlockCompression);
+            unsigned int nBlockSize = stored.vData.size();
+            CDiskBlockPos blockPos;
+            CValidationState state;
+            if (!FindBlockPos(state, blockPos, nBlockSize+8, 0, block.GetBlockTime()))
+                return error("LoadBlockIndex(): FindBlockPos failed");
+            if (!WriteBlockToDisk(stored, blockPos, chainparams.MessageStart()))
+                return error("LoadBlockIndex(): writing genesis block to disk failed");
+            CBlockIndex *pindex = AddToBlockIndex(block, chainparams.GetConsensus());
+            SetChainPoolValues(chainparams, block, pindex);
+            setDirtyBlockIndex.insert(pindex);
+            if (!ReceivedBlockTransactions(block, state, chainparams, pindex, blockPos)) {
+                return error("LoadBlockIndex(): genesis block not accepted");
+            }
+            // Before the genesis block, there was an empty tree. We set its root here so
+            // that the block import thread doesn't race other methods that need to query
+            // the Sprout tree (namely CWallet::ScanForWalletTransactions).
+            SproutMerkleTree tree;
+            pindex->hashSproutAnchor = tree.root();
+            // Force a chainstate write so that when we VerifyDB in a moment, it doesn't check stale data
+            return FlushStateToDisk(chainparams, state, FLUSH_STATE_ALWAYS);
+        } catch (const std::runtime_error& e) {
+            return error("LoadBlockIndex(): failed to initialize block database: %s", e.what());
+        }
+    }
+
+    return true;
+}
+
+namespace {
+
+//! Out of order blocks read during a reindex or an import are kept in memory
+//! while they use less than this many bytes.
+static const size_t MAX_STAGED_BLOCKS_USAGE = 64 << 20;
+
+/**
+ * The blocks read during a reindex or an import whose parent is not known
+ * yet, by the hash of the parent. Those read most recently are kept in
+ * memory, up to MAX_STAGED_BLOCKS_USAGE, so that they are imported without
+ * being read and checked again when their parent is. The older ones are only
+ * remembered by their position in our block files, and are dropped if they
+ * have none.
+ */
+class CUnknownParentBlocks
+{
+public:
+    typedef std::pair<std::shared_ptr<CBlock>, std::optional<CDiskBlockPos>> Child;
+
+private:
+    struct Entry
+    {
+        //! The block, while it is kept in memory.
+        std::shared_ptr<CBlock> pblock;
+        std::optional<CDiskBlockPos> pos;
+        size_t nUsage;
+        uint64_t nSequence;
+    };
+    typedef std::multimap<uint256, Entry> EntryMap;
+
+    EntryMap mapByParent;
+    //! The entries whose block is in memory, oldest first.
+    std::map<uint64_t, EntryMap::iterator> mapStaged;
+    uint64_t nNextSequence = 0;
+    size_t nUsage = 0;
+
+public:
+    //! Keep a block whose parent is not known, taking its contents.
+    void Add(CBlock& block, const CDiskBlockPos* dbp)
+    {
+        Entry entry;
+        if (dbp)
+            entry.pos = *dbp;
+        entry.nUsage = sizeof(CBlock) + RecursiveDynamicUsage(block);
+        entry.nSequence = nNextSequence++;
+        uint256 hashPrevBlock = block.hashPrevBlock;
+        if (entry.nUsage > MAX_STAGED_BLOCKS_USAGE) {
+            if (dbp)
+                mapByParent.emplace(hashPrevBlock, std::move(entry));
+            return;
+        }
+        entry.pblock = std::make_shared<CBlock>(std::move(block));
+        size_t nEntryUsage = entry.nUsage;
+        auto it = mapByParent.emplace(hashPrevBlock, std::move(entry));
+        mapStaged.emplace(it->second.nSequence, it);
+        nUsage += nEntryUsage;
+
+        while (nUsage > MAX_STAGED_BLOCKS_USAGE) {
+            auto itOldest = mapStaged.begin();
+            EntryMap::iterator itEntry = itOldest->second;
+            nUsage -= itEntry->second.nUsage;
+            mapStaged.erase(itOldest);
+            if (itEntry->second.pos) {
+                itEntry->second.pblock.reset();
+            } else {
+                mapByParent.erase(itEntry);
+            }
+        }
+    }
+
+    //! Remove the blocks waiting for the parent, in the order they were
+    //! read. The block of a child is null if it has to be read from disk.
+    std::vector<Child> TakeChildren(const uint256& hashParent)
+    {
+        std::vector<Child> vChildren;
+        auto range = mapByParent.equal_range(hashParent);
+        for (auto it = range.first; it != range.second; it = mapByParent.erase(it)) {
+            if (it->second.pblock) {
+                nUsage -= it->second.nUsage;
+                mapStaged.erase(it->second.nSequence);
+            }
+            vChildren.emplace_back(std::move(it->second.pblock), it->second.pos);
+        }
+        return vChildren;
+    }
+};
+
+CUnknownParentBlocks unknownParentBlocks;
+
+//! During a reindex, the block files are only read ahead while those read and
+//! not imported yet take less than this many bytes on disk.
+static const size_t MAX_REINDEX_READAHEAD = 256 << 20;
+
+}
+
+void ScanExternalBlockFile(const CChainParams& chainparams, FILE* fileIn, const std::function<bool(CBlock&, unsigned int)>& fn)
+{
+    // This takes over fileIn and calls fclose() on it in the CBufferedFile destructor
+    CBufferedFile blkdat(fileIn, 2*MAX_BLOCK_SIZE, MAX_BLOCK_SIZE+8, SER_DISK, CLIENT_VERSION);
+    uint64_t nRewind = blkdat.GetPos();
+    while (!blkdat.eof()) {
+        boost::this_thread::interruption_point();
+
+        blkdat.SetPos(nRewind);
+        nRewind++; // start one byte further next time, in case of failure
+        blkdat.SetLimit(); // remove former limit
+        unsigned int nSize = 0;
+        bool fCompressed = false;
+        try {
+            // locate a header
+            unsigned char buf[CMessageHeader::MESSAGE_START_SIZE];
+            blkdat.FindByte(chainparams.MessageStart()[0]);
+            nRewind = blkdat.GetPos()+1;
+            blkdat >> FLATDATA(buf);
+            if (memcmp(buf, chainparams.MessageStart(), CMessageHeader::MESSAGE_START_SIZE))
+                continue;
+            // read size
+            blkdat >> nSize;
+            fCompressed = nSize & BLOCK_COMPRESSED_FLAG;
+            nSize &= ~BLOCK_COMPRESSED_FLAG;
+            if (nSize < (fCompressed ? sizeof(uint32_t) : 80) || nSize > MAX_BLOCK_SIZE)
+                continue;
+        } catch (const std::exception&) {
+            // no valid block header found; don't complain
+            break;
+        }
+        try {
+            // read block
+            uint64_t nBlockPos = blkdat.GetPos();
+            blkdat.SetLimit(nBlockPos + nSize);
+            blkdat.SetPos(nBlockPos);
+            CBlock block;
+            if (fCompressed) {
+                std::vector<uint8_t> vStored(nSize), vBlock;
+                blkdat.read((char*)vStored.data(), nSize);
+                nRewind = blkdat.GetPos();
+                if (!DecompressBlockData(vStored.data(), nSize, vBlock)) {
+                    LogPrintf("%s: Corrupt compressed block at %u\n", __func__, nBlockPos);
+                    continue;
+                }
+                SpanReader reader(SER_DISK, CLIENT_VERSION, vBlock.data(), vBlock.size());
+                reader >> block;
+            } else {
+                blkdat >> block;
+                nRewind = blkdat.GetPos();
+            }
+            if (!fn(block, nBlockPos))
+                break;
+        } catch (const std::exception& e) {
+            LogPrintf("%s: Deserialize or I/O error - %s\n", __func__, e.what());
+        }
+    }
 }
 
-bool LoadBlockIndex()
+namespace {
+
+/**
+ * Store a block read from a block file or an external file, followed by the
+ * blocks read earlier that were waiting for it. dbp is the position of the
+ * block if it is in one of our block files. Returns false if importing the
+ * rest of the file has to be abandoned.
+ */
+bool ImportExternalBlock(const CChainParams& chainparams, CBlock& block, const CDiskBlockPos* dbp, int& nLoaded)
 {
-    // Load block index from databases
-    if (!fReindex && !LoadBlockIndexDB(Params()))
-        return false;
+    // detect out of order blocks, and store them for later
+    uint256 hash = block.GetHash();
+    if (hash != chainparams.GetConsensus().hashGenesisBlock && mapBlockIndex.find(block.hashPrevBlock) == mapBlockIndex.end()) {
+        LogPrint("reindex", "%s: Out of order block %s, parent %s not known\n", __func__, hash.ToString(),
+                block.hashPrevBlock.ToString());
+        unknownParentBlocks.Add(block, dbp);
+        return true;
+    }
+
+    // process in case the block isn't known yet
+    if (mapBlockIndex.count(hash) == 0 || (mapBlockIndex[hash]->nStatus & BLOCK_HAVE_DATA) == 0) {
+        LOCK(cs_main);
+        CValidationState state;
+        if (AcceptBlock(block, state, chainparams, NULL, true, dbp))
+            nLoaded++;
+        if (state.IsError())
+            return false;
+    } else if (hash != chainparams.GetConsensus().hashGenesisBlock && mapBlockIndex[hash]->nHeight % 1000 == 0) {
+        LogPrint("reindex", "Block Import: already had block %s at height %d\n", hash.ToString(), mapBlockIndex[hash]->nHeight);
+    }
+
+    // Activate the genesis block so normal node progress can continue
+    if (hash == chainparams.GetConsensus().hashGenesisBlock) {
+        CValidationState state;
+        if (!ActivateBestChain(state, chainparams)) {
+            return false;
+        }
+    }
+
+    NotifyHeaderTip(chainparams.GetConsensus());
+
+    // Recursively process earlier encountered successors of this block
+    deque<uint256> queue;
+    queue.push_back(hash);
+    while (!queue.empty()) {
+        uint256 head = queue.front();
+        queue.pop_front();
+        for (CUnknownParentBlocks::Child& child : unknownParentBlocks.TakeChildren(head)) {
+            std::shared_ptr<CBlock> pchild = child.first;
+            const CDiskBlockPos* pos = child.second ? &*child.second : NULL;
+            if (!pchild) {
+                pchild = std::make_shared<CBlock>();
+                if (!ReadBlockFromDisk(*pchild, *pos, chainparams.GetConsensus()))
+                    continue;
+            }
+            LogPrint("reindex", "%s: Processing out of order child %s of %s\n", __func__, pchild->GetHash().ToString(),
+                    head.ToString());
+            {
+                LOCK(cs_main);
+                CValidationState dummy;
+                if (AcceptBlock(*pchild, dummy, chainparams, NULL, true, pos))
+                {
+                    nLoaded++;
+                    queue.push_back(pchild->GetHash());
+                }
+            }
+            NotifyHeaderTip(chainparams.GetConsensus());
+        }
+    }
     return true;
 }
 
-bool InitBlockIndex(const CChainParams& chainparams)
+/**
+ * Reads our block files for a reindex on several threads, so that finding,
+ * deserializing and checking the blocks of some files overlaps with importing
+ * those of the files before them. The files are handed out in order.
+ */
+class CBlockFileReaders
 {
-    LOCK(cs_main);
+private:
+    struct BlockFile
+    {
+        size_t nSize;
+        bool fRead = false;
+        bool fOpened = false;
+        //! The blocks found in the file, with their positions in it.
+        std::vector<std::pair<CBlock, unsigned int>> vBlocks;
 
-    // Initialize global variables that cannot be constructed at startup.
-    recentRejects.reset(new CRollingBloomFilter(120000, 0.000001));
+        explicit BlockFile(size_t nSizeIn) : nSize(nSizeIn) {}
+    };
 
-    // Check whether we're already initialized
-    if (chainActive.Genesis() != NULL)
-        return true;
+    const CChainParams& chainparams;
+    Mutex cs;
+    std::condition_variable cond;
+    std::vector<BlockFile> vFiles;
+    //! The next file to be read, and the next to be imported.
+    size_t nNextRead = 0;
+    size_t nNextImport = 0;
+    //! The size of the files being read or read that were not imported yet.
+    size_t nReadAhead = 0;
+    std::atomic<bool> fStop{false};
+    std::vector<std::thread> threads;
 
-    // Use the provided setting for -txindex in the new database
-    fTxIndex = GetBoolArg("-txindex", DEFAULT_TXINDEX);
-    pblocktree->WriteFlag("txindex", fTxIndex);
+    void ThreadRead();
 
-    // Use the provided setting for -insightexplorer or -lightwalletd in the new database
-    pblocktree->WriteFlag("insightexplorer", fExperimentalInsightExplorer);
-    pblocktree->WriteFlag("lightwalletd", fExperimentalLightWalletd);
-    if (fExperimentalInsightExplorer) {
-        fAddressIndex = true;
-        fSpentIndex = true;
-        fTimestampIndex = true;
+public:
+    CBlockFileReaders(const CChainParams& chainparamsIn, const std::vector<size_t>& vFileSizes, int nThreads);
+    ~CBlockFileReaders();
+
+    //! Wait for the next file to be read and take its blocks. Returns false
+    //! once all files have been taken, or at the first that could not be
+    //! opened.
+    bool Next(int& nFile, std::vector<std::pair<CBlock, unsigned int>>& vBlocks);
+};
+
+CBlockFileReaders::CBlockFileReaders(const CChainParams& chainparamsIn, const std::vector<size_t>& vFileSizes, int nThreads) :
+    chainparams(chainparamsIn)
+{
+    for (size_t nSize : vFileSizes) {
+        vFiles.emplace_back(nSize);
     }
-    else if (fExperimentalLightWalletd) {
-        fAddressIndex = true;
+    for (int i = 0; i < nThreads; i++) {
+        threads.emplace_back(&CBlockFileReaders::ThreadRead, this);
+    }
+}
+
+CBlockFileReaders::~CBlockFileReaders()
+{
+    {
+        LOCK(cs);
+        fStop = true;
     }
+    cond.notify_all();
+    for (std::thread& thread : threads) {
+        thread.join();
+    }
+}
 
-    LogPrintf("Initializing databases...\n");
+void CBlockFileReaders::ThreadRead()
+{
+    RenameThread("zc-loadblkread");
+    auto verifier = ProofVerifier::Disabled();
+    while (true) {
+        size_t nFile;
+        {
+            WAIT_LOCK(cs, lock);
+            // The next file to import may always be read, so that importing
+            // makes progress however large it is.
+            cond.wait(lock, [this] {
+                return fStop || nNextRead == vFiles.size() || nNextRead == nNextImport ||
+                    nReadAhead + vFiles[nNextRead].nSize <= MAX_REINDEX_READAHEAD;
+            });
+            if (fStop || nNextRead == vFiles.size())
+                return;
+            nFile = nNextRead++;
+            nReadAhead += vFiles[nFile].nSize;
+        }
 
-    // Only add the genesis block if not reindexing (in which case we reuse the one already on disk)
-    if (!fReindex) {
-        try {
-            CBlock &block = const_cast<CBlock&>(chainparams.GenesisBlock());
-            // Start new block file
-            unsigned int nBlockSize = ::GetSerializeSize(block, SER_DISK, CLIENT_VERSION);
-            CDiskBlockPos blockPos;
-            CValidationState state;
-            if (!FindBlockPos(state, blockPos, nBlockSize+8, 0, block.GetBlockTime()))
-                return error("LoadBlockIndex(): FindBlockPos failed");
-            if (!WriteBlockToDisk(block, blockPos, chainparams.MessageStart()))
-                return error("LoadBlockIndex(): writing genesis block to disk failed");
-            CBlockIndex *pindex = AddToBlockIndex(block, chainparams.GetConsensus());
-            SetChainPoolValues(chainparams, block, pindex);
-            setDirtyBlockIndex.insert(pindex);
-            if (!ReceivedBlockTransactions(block, state, chainparams, pindex, blockPos)) {
-                return error("LoadBlockIndex(): genesis block not accepted");
+        std::vector<std::pair<CBlock, unsigned int>> vBlocks;
+        FILE* file = OpenBlockFile(CDiskBlockPos((int)nFile, 0), true);
+        if (file) {
+            AdviseSequentialRead(file);
+            try {
+                ScanExternalBlockFile(chainparams, file, [&](CBlock& block, unsigned int nBlockPos) {
+                    // Do the checks that do not depend on the chain here,
+                    // including that of the Equihash solution. A block that
+                    // passes them is marked as checked, so that AcceptBlock
+                    // does not repeat them; one that fails is checked again
+                    // there, and rejected.
+                    CValidationState state;
+                    CheckBlock(block, state, chainparams, verifier, true, true, true);
+                    vBlocks.emplace_back(std::move(block), nBlockPos);
+                    return !fStop;
+                });
+            } catch (const std::exception& e) {
+                LogPrintf("%s: error reading blk%05u.dat: %s\n", __func__, (unsigned int)nFile, e.what());
             }
-            // Before the genesis block, there was an empty tree. We set its root here so
-            // that the block import thread doesn't race other methods that need to query
-            // the Sprout tree (namely CWallet::ScanForWalletTransactions).
-            SproutMerkleTree tree;
-            pindex->hashSproutAnchor = tree.root();
-            // Force a chainstate write so that when we VerifyDB in a moment, it doesn't check stale data
-            return FlushStateToDisk(chainparams, state, FLUSH_STATE_ALWAYS);
-        } catch (const std::runtime_error& e) {
-            return error("LoadBlockIndex(): failed to initialize block database: %s", e.what());
         }
+
+        {
+            LOCK(cs);
+            BlockFile& blockFile = vFiles[nFile];
+            blockFile.vBlocks = std::move(vBlocks);
+            blockFile.fOpened = file != NULL;
+            blockFile.fRead = true;
+        }
+        cond.notify_all();
     }
+}
 
+bool CBlockFileReaders::Next(int& nFile, std::vector<std::pair<CBlock, unsigned int>>& vBlocks)
+{
+    {
+        WAIT_LOCK(cs, lock);
+        if (nNextImport == vFiles.size())
+            return false;
+        cond.wait(lock, [this] { return vFiles[nNextImport].fRead; });
+        BlockFile& blockFile = vFiles[nNextImport];
+        if (!blockFile.fOpened)
+            return false; // This error is logged in OpenBlockFile
+        nFile = nNextImport++;
+        vBlocks = std::move(blockFile.vBlocks);
+        blockFile.vBlocks.clear();
+        nReadAhead -= blockFile.nSize;
+    }
+    cond.notify_all();
     return true;
 }
 
+}
+
 bool LoadExternalBlockFile(const CChainParams& chainparams, FILE* fileIn, CDiskBlockPos *dbp)
 {
-    // Map of disk positions for blocks with unknown parent (only used for reindex)
-    static std::multimap<uint256, CDiskBlockPos> mapBlocksUnknownParent;
     int64_t nStart = GetTimeMillis();
 
     int nLoaded = 0;
     try {
-        // This takes over fileIn and calls fclose() on it in the CBufferedFile destructor
-        CBufferedFile blkdat(fileIn, 2*MAX_BLOCK_SIZE, MAX_BLOCK_SIZE+8, SER_DISK, CLIENT_VERSION);
-        uint64_t nRewind = blkdat.GetPos();
         size_t initialSize = nSizeReindexed;
-        while (!blkdat.eof()) {
-            boost::this_thread::interruption_point();
-
+        ScanExternalBlockFile(chainparams, fileIn, [&](CBlock& block, unsigned int nBlockPos) {
             if (fReindex)
-               nSizeReindexed = initialSize + nRewind;
+                nSizeReindexed = initialSize + nBlockPos;
+            if (dbp)
+                dbp->nPos = nBlockPos;
+            return ImportExternalBlock(chainparams, block, dbp, nLoaded);
+        });
+    } catch (const std::runtime_error& e) {
+        AbortNode(std::string("System error: ") + e.what());
+    }
+    if (nLoaded > 0)
+        LogPrintf("Loaded %i blocks from external file in %dms\n", nLoaded, GetTimeMillis() - nStart);
+    return nLoaded > 0;
+}
 
-            blkdat.SetPos(nRewind);
-            nRewind++; // start one byte further next time, in case of failure
-            blkdat.SetLimit(); // remove former limit
-            unsigned int nSize = 0;
+void ReindexBlockFiles(const CChainParams& chainparams)
+{
+    // Find the summary size of all block files first
+    std::vector<size_t> vFileSizes;
+    size_t nFullSize = 0;
+    while (true) {
+        fs::path blkFile = GetBlockPosFilename(CDiskBlockPos((int)vFileSizes.size(), 0), "blk");
+        if (!fs::exists(blkFile))
+            break; // No block files left to reindex
+        vFileSizes.push_back(fs::file_size(blkFile));
+        nFullSize += vFileSizes.back();
+    }
+    nSizeReindexed = 0;
+    nFullSizeToReindex = std::max<size_t>(1, nFullSize);
+
+    // Reading the files mostly means checking Equihash solutions, so use as
+    // many threads as for verifying scripts.
+    int nThreads = std::max(1, nScriptCheckThreads);
+    LogPrintf("Reindexing %u block files using %d reader threads\n", vFileSizes.size(), nThreads);
+    CBlockFileReaders readers(chainparams, vFileSizes, nThreads);
+
+    size_t nSizeBefore = 0;
+    int nFile;
+    std::vector<std::pair<CBlock, unsigned int>> vBlocks;
+    while (readers.Next(nFile, vBlocks)) {
+        LogPrintf("Reindexing block file blk%05u.dat...\n", (unsigned int)nFile);
+        int64_t nStart = GetTimeMillis();
+        int nLoaded = 0;
+        for (std::pair<CBlock, unsigned int>& entry : vBlocks) {
+            boost::this_thread::interruption_point();
+            nSizeReindexed = nSizeBefore + entry.second;
+            CDiskBlockPos pos(nFile, entry.second);
             try {
-                // locate a header
-                unsigned char buf[CMessageHeader::MESSAGE_START_SIZE];
-                blkdat.FindByte(chainparams.MessageStart()[0]);
-                nRewind = blkdat.GetPos()+1;
-                blkdat >> FLATDATA(buf);
-                if (memcmp(buf, chainparams.MessageStart(), CMessageHeader::MESSAGE_START_SIZE))
-                    continue;
-                // read size
-                blkdat >> nSize;
-                if (nSize < 80 || nSize > MAX_BLOCK_SIZE)
-                    continue;
-            } catch (const std::exception&) {
-                // no valid block header found; don't complain
-                break;
+                if (!ImportExternalBlock(chainparams, entry.first, &pos, nLoaded))
+                    break;
+            } catch (const std::exception& e) {
+                LogPrintf("%s: Deserialize or I/O error - %s\n", __func__, e.what());
             }
-            try {
-                // read block
-                uint64_t nBlockPos = blkdat.GetPos();
-                if (dbp)
-                    dbp->nPos = nBlockPos;
-                blkdat.SetLimit(nBlockPos + nSize);
-                blkdat.SetPos(nBlockPos);
-                CBlock block;
-                blkdat >> block;
-                nRewind = blkdat.GetPos();
+        }
+        nSizeBefore += vFileSizes[nFile];
+        if (nLoaded > 0)
+            LogPrintf("Loaded %i blocks from blk%05u.dat in %dms\n", nLoaded, (unsigned int)nFile, GetTimeMillis() - nStart);
+    }
+}
 
-                // detect out of order blocks, and store them for later
-                uint256 hash = block.GetHash();
-                if (hash != chainparams.GetConsensus().hashGenesisBlock && mapBlockIndex.find(block.hashPrevBlock) == mapBlockIndex.end()) {
-                    LogPrint("reindex", "%s: Out of order block %s, parent %s not known\n", __func__, hash.ToString(),
-                            block.hashPrevBlock.ToString());
-                    if (dbp)
-                        mapBlocksUnknownParent.insert(std::make_pair(block.hashPrevBlock, *dbp));
-                    continue;
-                }
+void CompressBlockFiles(const CChainParams& chainparams)
+{
+    // The last block file is still written to.
+    int nLastFile;
+    {
+        LOCK(cs_LastBlockFile);
+        nLastFile = nLastBlockFile;
+    }
 
-                // process in case the block isn't known yet
-                if (mapBlockIndex.count(hash) == 0 || (mapBlockIndex[hash]->nStatus & BLOCK_HAVE_DATA) == 0) {
-                    LOCK(cs_main);
-                    CValidationState state;
-                    if (AcceptBlock(block, state, chainparams, NULL, true, dbp))
-                        nLoaded++;
-                    if (state.IsError())
-                        break;
-                } else if (hash != chainparams.GetConsensus().hashGenesisBlock && mapBlockIndex[hash]->nHeight % 1000 == 0) {
-                    LogPrint("reindex", "Block Import: already had block %s at height %d\n", hash.ToString(), mapBlockIndex[hash]->nHeight);
-                }
+    LogPrintf("Compressing block files...\n");
+    int64_t nStart = GetTimeMillis();
+    int nTotal = 0;
+    for (int nFile = 0; nFile < nLastFile && !ShutdownRequested(); nFile++) {
+        CDiskBlockPos pos(nFile, 0);
+        fs::path path = GetBlockPosFilename(pos, "blk");
+        fs::path pathNew = path.string() + ".new";
+        if (!fs::exists(path))
+            continue;
 
-                // Activate the genesis block so normal node progress can continue
-                if (hash == chainparams.GetConsensus().hashGenesisBlock) {
-                    CValidationState state;
-                    if (!ActivateBestChain(state, chainparams)) {
-                        break;
-                    }
-                }
+        int nCompressed = CompressBlockFile(path, pathNew, chainparams.MessageStart());
+        if (nCompressed < 0) {
+            LogPrintf("%s: Could not compress blk%05u.dat\n", __func__, nFile);
+            continue;
+        }
+        if (nCompressed == 0) {
+            fs::remove(pathNew);
+            continue;
+        }
 
-                NotifyHeaderTip(chainparams.GetConsensus());
-
-                // Recursively process earlier encountered successors of this block
-                deque<uint256> queue;
-                queue.push_back(hash);
-                while (!queue.empty()) {
-                    uint256 head = queue.front();
-                    queue.pop_front();
-                    std::pair<std::multimap<uint256, CDiskBlockPos>::iterator, std::multimap<uint256, CDiskBlockPos>::iterator> range = mapBlocksUnknownParent.equal_range(head);
-                    while (range.first != range.second) {
-                        if (ReadBlockFromDisk(block, range.first->second, chainparams.GetConsensus()))
-                        {
-                            LogPrint("reindex", "%s: Processing out of order child %s of %s\n", __func__, block.GetHash().ToString(),
-                                    head.ToString());
-                            LOCK(cs_main);
-                            CValidationState dummy;
-                            if (AcceptBlock(block, dummy, chainparams, NULL, true, &(range.first->second)))
-                            {
-                                nLoaded++;
-                                queue.push_back(block.GetHash());
-                            }
-                        }
-                        range.first = mapBlocksUnknownParent.erase(range.first);
-                        NotifyHeaderTip(chainparams.GetConsensus());
-                    }
-                }
-            } catch (const std::exception& e) {
-                LogPrintf("%s: Deserialize or I/O error - %s\n", __func__, e.what());
+        // Pruning deletes block files with cs_main held, and must not see
+        // the file come back.
+        {
+            LOCK(cs_main);
+            if (!fs::exists(path) || !RenameOver(pathNew, path)) {
+                fs::remove(pathNew);
+                continue;
             }
+            blockReader.ForgetFile(nFile);
         }
-    } catch (const std::runtime_error& e) {
-        AbortNode(std::string("System error: ") + e.what());
+        nTotal += nCompressed;
+        LogPrint("reindex", "Compressed %i blocks in blk%05u.dat\n", nCompressed, nFile);
     }
-    if (nLoaded > 0)
-        LogPrintf("Loaded %i blocks from external file in %dms\n", nLoaded, GetTimeMillis() - nStart);
-    return nLoaded > 0;
+    LogPrintf("Compressed %i blocks in %dms\n", nTotal, GetTimeMillis() - nStart);
 }
 
 void static CheckBlockIndex(const Consensus::Params& consensusParams)
@@ -6706,6 +10031,15 @@ void static CheckBlockIndex(const Consensus::Params& consensusParams)
 
     // Check that we actually traversed the entire map.
     assert(nNodes == forward.size());
+
+    // The tracked chain tips are exactly the blocks without children.
+    size_t nTips = 0;
+    for (BlockMap::iterator it = mapBlockIndex.begin(); it != mapBlockIndex.end(); it++) {
+        bool fTip = forward.count(it->second) == 0;
+        assert(setChainTips.count(it->second) == (fTip ? 1 : 0));
+        if (fTip) nTips++;
+    }
+    assert(setChainTips.size() == nTips);
 }
 
 
@@ -6716,7 +10050,7 @@ void static CheckBlockIndex(const Consensus::Params& consensusParams)
 //
 
 
-CInv static InvForTransaction(const std::shared_ptr<const CTransaction> tx)
+CInv static InvForTransaction(const CTransactionRef tx)
 {
     if (tx->nVersion >= 5) {
         auto& wtxid = tx->GetWTxId();
@@ -6742,15 +10076,26 @@ bool static AlreadyHave(const CInv& inv) EXCLUSIVE_LOCKS_REQUIRED(cs_main)
                 // txs a second chance.
                 hashRecentRejectsChainTip = chainActive.Tip()->GetBlockHash();
                 recentRejects->reset();
+                recentRejectsStats.nEvictions += recentRejectsStats.nEntries;
+                recentRejectsStats.nEntries = 0;
             }
 
             // We only need to use wtxid with recentRejects. Orphan map entries
             // are re-validated once their parents have arrived, and all other
             // locations are only possible if the transaction has already been
             // validated (we don't care about alternative authorizing data).
-            return recentRejects->contains(inv.GetWideHash()) ||
-                   mempool.exists(inv.hash) ||
+            if (recentRejects->contains(inv.GetWideHash())) {
+                recentRejectsStats.nHits++;
+                return true;
+            }
+            recentRejectsStats.nMisses++;
+            if (txRejectCache->Contains(inv.GetWideHash(), MemPoolBranchId())) {
+                return true;
+            }
+            LOCK(g_cs_orphans);
+            return mempool.exists(inv.hash) ||
                    mapOrphanTransactions.count(inv.hash) ||
+                   setTxAcceptInFlight.count(inv.hash) ||
                    pcoinsTip->HaveCoins(inv.hash);
         }
     case MSG_BLOCK:
@@ -6760,7 +10105,224 @@ bool static AlreadyHave(const CInv& inv) EXCLUSIVE_LOCKS_REQUIRED(cs_main)
     return true;
 }
 
-void static ProcessGetData(CNode* pfrom, const Consensus::Params& consensusParams)
+/**
+ * Check that a block rebuilt from a cmpctblock has the authorizing data its
+ * header commits to. Short IDs are computed over wtxids, but FillBlock only
+ * checks the merkle root of the txids; a ZIP 244 commitment mismatch would
+ * otherwise only be found by ConnectBlock, which marks the block invalid.
+ * The chain history root is only known here for blocks that extend the tip.
+ * Requires cs_main.
+ */
+static bool CheckReconstructedBlockCommitments(const CBlock& block, const CBlockIndex* pindex, const Consensus::Params& consensusParams)
+{
+    if (!consensusParams.NetworkUpgradeActive(pindex->nHeight, Consensus::UPGRADE_NU5))
+        return true;
+    if (pindex->pprev != chainActive.Tip())
+        return false;
+    auto prevConsensusBranchId = CurrentEpochBranchId(pindex->pprev->nHeight, consensusParams);
+    return block.hashBlockCommitments == DeriveBlockCommitmentsHash(
+        pcoinsTip->GetHistoryRoot(prevConsensusBranchId),
+        block.BuildAuthDataMerkleTree());
+}
+
+/**
+ * Rebuild the block of a compact block download from pfrom, given the
+ * missing transactions. Returns true and sets block if this succeeded;
+ * otherwise the download is either abandoned or retried as a full block.
+ * Requires cs_main.
+ */
+static bool ReconstructBlock(CNode* pfrom, const BlockTransactions& resp, CBlock& block, const CChainParams& chainparams)
+{
+    map<uint256, pair<NodeId, list<QueuedBlock>::iterator> >::iterator it = mapBlocksInFlight.find(resp.blockhash);
+    if (it == mapBlocksInFlight.end() || !it->second.second->partialBlock ||
+            it->second.first != pfrom->GetId()) {
+        LogPrint("net", "Peer %d sent us block transactions for block we weren't expecting\n", pfrom->id);
+        return false;
+    }
+
+    PartiallyDownloadedBlock& partialBlock = *it->second.second->partialBlock;
+    ReadStatus status = partialBlock.FillBlock(block, resp.txn);
+    if (status == READ_STATUS_INVALID) {
+        MarkBlockAsReceived(resp.blockhash); // Reset in-flight state in case of whitelist
+        Misbehaving(pfrom->GetId(), 100);
+        LogPrintf("Peer %d sent us invalid compact block/non-matching block transactions\n", pfrom->id);
+        return false;
+    }
+    if (status == READ_STATUS_FAILED ||
+        !CheckReconstructedBlockCommitments(block, it->second.second->pindex, chainparams.GetConsensus()))
+    {
+        // Might have collided, fall back to getdata now :(
+        LogPrint("cmpctblock", "Failed to reconstruct block %s from peer=%d, requesting it in full\n",
+                 resp.blockhash.ToString(), pfrom->id);
+        it->second.second->partialBlock.reset();
+        std::vector<CInv> invs;
+        invs.push_back(CInv(MSG_BLOCK, resp.blockhash));
+        pfrom->PushMessage("getdata", invs);
+        return false;
+    }
+    return true;
+}
+
+/**
+ * Process a block rebuilt from a cmpctblock. The block was requested from
+ * pfrom, so it is processed even if it would not otherwise be.
+ */
+static void ProcessReconstructedBlock(CNode* pfrom, const std::string& strCommand, const CBlock& block, const CChainParams& chainparams)
+{
+    CValidationState state;
+    ProcessNewBlock(state, chainparams, pfrom, &block, true, NULL);
+    int nDoS;
+    if (state.IsInvalid(nDoS)) {
+        assert (state.GetRejectCode() < REJECT_INTERNAL); // Blocks are never rejected with internal reject codes
+        pfrom->PushMessage("reject", strCommand, (unsigned char)state.GetRejectCode(),
+                           state.GetRejectReason().substr(0, MAX_REJECT_MESSAGE_LENGTH), block.GetHash());
+        if (nDoS > 0) {
+            LOCK(cs_main);
+            Misbehaving(pfrom->GetId(), nDoS);
+        }
+    }
+}
+
+/**
+ * Send a block requested by pfrom. cs_main is held only to decide whether
+ * and how to send it; reading it from disk and serializing it are done
+ * without cs_main, so that serving old blocks does not hold up validation
+ * or the message handler threads working for other peers.
+ */
+void static ProcessGetBlockData(CNode* pfrom, const Consensus::Params& consensusParams, const CInv& inv) LOCKS_EXCLUDED(cs_main)
+{
+    int currentHeight = GetHeight();
+
+    CBlockIndex* pindex = NULL;
+    bool fSendCompact = false;
+    uint256 hashTip;
+    {
+        LOCK(cs_main);
+        bool send = false;
+        BlockMap::iterator mi = mapBlockIndex.find(inv.hash);
+        if (mi != mapBlockIndex.end())
+        {
+            if (chainActive.Contains(mi->second)) {
+                send = true;
+            } else {
+                static const int nOneMonth = 30 * 24 * 60 * 60;
+                // To prevent fingerprinting attacks, only send blocks outside of the active
+                // chain if they are valid, and no more than a month older (both in time, and in
+                // best equivalent proof of work) than the best header chain we know about.
+                send = mi->second->IsValid(BLOCK_VALID_SCRIPTS) && (pindexBestHeader != NULL) &&
+                    (pindexBestHeader->GetBlockTime() - mi->second->GetBlockTime() < nOneMonth) &&
+                    (GetBlockProofEquivalentTime(*pindexBestHeader, *mi->second, *pindexBestHeader, consensusParams) < nOneMonth);
+                if (!send) {
+                    LogPrintf("%s: ignoring request from peer=%i for old block that isn't in the main chain\n", __func__, pfrom->GetId());
+                }
+            }
+        }
+        // disconnect node in case we have reached the outbound limit for serving historical blocks
+        // never disconnect whitelisted nodes
+        static const int nOneWeek = 7 * 24 * 60 * 60; // assume > 1 week = historical
+        if (send && CNode::OutboundTargetReached(consensusParams.PoWTargetSpacing(currentHeight), true) && (
+                (
+                    (pindexBestHeader != NULL) &&
+                    (pindexBestHeader->GetBlockTime() - mi->second->GetBlockTime() > nOneWeek)
+                ) || inv.type == MSG_FILTERED_BLOCK
+            ) && !pfrom->fWhitelisted)
+        {
+            LogPrint("net", "historical block serving limit reached, disconnect peer=%d\n", pfrom->GetId());
+
+            //disconnect node
+            pfrom->fDisconnect = true;
+            send = false;
+        }
+        // Pruned nodes may have deleted the block, so check whether
+        // it's available before trying to send.
+        if (!send || !(mi->second->nStatus & BLOCK_HAVE_DATA))
+            return;
+
+        pindex = mi->second;
+        // A peer asking for an old block is unlikely to have
+        // its transactions in its mempool, so send it in full.
+        fSendCompact = inv.type == MSG_CMPCT_BLOCK && pindex->nHeight >= chainActive.Height() - MAX_CMPCTBLOCK_DEPTH;
+        hashTip = chainActive.Tip()->GetBlockHash();
+    }
+
+    // Send block from disk. Full blocks are sent as they are stored, without
+    // deserializing and reserializing them. Blocks recently filtered for
+    // other peers are not read again.
+    const bool fSendRaw = inv.type == MSG_BLOCK || (inv.type == MSG_CMPCT_BLOCK && !fSendCompact);
+    CBlock block;
+    std::vector<uint8_t> vRawBlock;
+    std::shared_ptr<const CFilterableBlock> filterableBlock;
+    if (inv.type == MSG_FILTERED_BLOCK)
+        filterableBlock = filteredBlockCache.GetBlock(pindex->GetBlockHash());
+    bool fRead = filterableBlock || (fSendRaw ?
+        ReadRawBlockFromDisk(vRawBlock, pindex, Params().MessageStart()) :
+        ReadBlockFromDisk(block, pindex, consensusParams));
+    if (!fRead) {
+        // The block may have been pruned since cs_main was released.
+        LOCK(cs_main);
+        if (pindex->nStatus & BLOCK_HAVE_DATA)
+            assert(!"cannot load block from disk");
+        LogPrint("net", "%s: block %s was pruned before it could be sent to peer=%d\n", __func__, inv.hash.ToString(), pfrom->GetId());
+        pfrom->fDisconnect = true;
+        return;
+    }
+    if (fSendRaw)
+        pfrom->PushMessage("block", CFlatData(vRawBlock));
+    else if (inv.type == MSG_CMPCT_BLOCK)
+    {
+        CBlockHeaderAndShortTxIDs cmpctblock(block);
+        pfrom->PushMessage("cmpctblock", cmpctblock);
+    }
+    else // MSG_FILTERED_BLOCK)
+    {
+        if (!filterableBlock) {
+            filterableBlock = std::make_shared<const CFilterableBlock>(std::move(block));
+            filteredBlockCache.AddBlock(filterableBlock);
+        }
+        bool send = false;
+        CMerkleBlock merkleBlock;
+        {
+            LOCK(pfrom->cs_filter);
+            if (pfrom->pfilter) {
+                send = true;
+                merkleBlock = filteredBlockCache.Filter(*filterableBlock, *pfrom->pfilter);
+            }
+        }
+        if (send) {
+            pfrom->PushMessage("merkleblock", merkleBlock);
+            // CMerkleBlock just contains hashes, so also push any transactions in the block the client did not see
+            // This avoids hurting performance by pointlessly requiring a round-trip
+            // Note that there is currently no way for a node to request any single transactions we didn't send here -
+            // they must either disconnect and retry or request the full block.
+            // Thus, the protocol spec specified allows for us to provide duplicate txn here,
+            // however we MUST always provide at least what the remote peer needs
+            typedef std::pair<unsigned int, uint256> PairType;
+            for (PairType& pair : merkleBlock.vMatchedTxn)
+                pfrom->PushMessage("tx", filterableBlock->block.vtx[pair.first]);
+        }
+        // else
+            // no response
+    }
+
+    // Trigger the peer node to send a getblocks request for the next batch of inventory
+    if (inv.hash == pfrom->hashContinue)
+    {
+        // Bypass PushBlockInventory, this must send even if redundant,
+        // and we want it right after the last block so they don't
+        // wait for other stuff first.
+        vector<CInv> vInv;
+        vInv.push_back(CInv(MSG_BLOCK, hashTip));
+        pfrom->PushMessage("inv", vInv);
+        pfrom->hashContinue.SetNull();
+    }
+}
+
+/**
+ * Answer the getdata requests queued in pfrom->vRecvGetData. Transactions
+ * are sent until the next block request, which is served on its own with
+ * ProcessGetBlockData; the rest of the queue is left for the next call.
+ */
+void static ProcessGetData(CNode* pfrom, const Consensus::Params& consensusParams) LOCKS_EXCLUDED(cs_main)
 {
     int currentHeight = GetHeight();
 
@@ -6768,115 +10330,34 @@ void static ProcessGetData(CNode* pfrom, const Consensus::Params& consensusParam
 
     vector<CInv> vNotFound;
 
-    LOCK(cs_main);
+    {
+        LOCK(cs_main);
 
-    while (it != pfrom->vRecvGetData.end()) {
-        // Don't bother if send buffer is too full to respond anyway
-        if (pfrom->nSendSize >= SendBufferSize())
-            break;
+        while (it != pfrom->vRecvGetData.end() &&
+               it->type != MSG_BLOCK && it->type != MSG_FILTERED_BLOCK && it->type != MSG_CMPCT_BLOCK) {
+            // Don't bother if send buffer is too full to respond anyway
+            if (pfrom->nSendSize >= SendBufferSize())
+                break;
 
-        const CInv &inv = *it;
-        {
+            const CInv &inv = *it;
             boost::this_thread::interruption_point();
             it++;
 
-            if (inv.type == MSG_BLOCK || inv.type == MSG_FILTERED_BLOCK)
-            {
-                bool send = false;
-                BlockMap::iterator mi = mapBlockIndex.find(inv.hash);
-                if (mi != mapBlockIndex.end())
-                {
-                    if (chainActive.Contains(mi->second)) {
-                        send = true;
-                    } else {
-                        static const int nOneMonth = 30 * 24 * 60 * 60;
-                        // To prevent fingerprinting attacks, only send blocks outside of the active
-                        // chain if they are valid, and no more than a month older (both in time, and in
-                        // best equivalent proof of work) than the best header chain we know about.
-                        send = mi->second->IsValid(BLOCK_VALID_SCRIPTS) && (pindexBestHeader != NULL) &&
-                            (pindexBestHeader->GetBlockTime() - mi->second->GetBlockTime() < nOneMonth) &&
-                            (GetBlockProofEquivalentTime(*pindexBestHeader, *mi->second, *pindexBestHeader, consensusParams) < nOneMonth);
-                        if (!send) {
-                            LogPrintf("%s: ignoring request from peer=%i for old block that isn't in the main chain\n", __func__, pfrom->GetId());
-                        }
-                    }
-                }
-                // disconnect node in case we have reached the outbound limit for serving historical blocks
-                // never disconnect whitelisted nodes
-                static const int nOneWeek = 7 * 24 * 60 * 60; // assume > 1 week = historical
-                if (send && CNode::OutboundTargetReached(consensusParams.PoWTargetSpacing(currentHeight), true) && (
-                        (
-                            (pindexBestHeader != NULL) &&
-                            (pindexBestHeader->GetBlockTime() - mi->second->GetBlockTime() > nOneWeek)
-                        ) || inv.type == MSG_FILTERED_BLOCK
-                    ) && !pfrom->fWhitelisted)
-                {
-                    LogPrint("net", "historical block serving limit reached, disconnect peer=%d\n", pfrom->GetId());
-
-                    //disconnect node
-                    pfrom->fDisconnect = true;
-                    send = false;
-                }
-                // Pruned nodes may have deleted the block, so check whether
-                // it's available before trying to send.
-                if (send && (mi->second->nStatus & BLOCK_HAVE_DATA))
-                {
-                    // Send block from disk
-                    CBlock block;
-                    if (!ReadBlockFromDisk(block, (*mi).second, consensusParams))
-                        assert(!"cannot load block from disk");
-                    if (inv.type == MSG_BLOCK)
-                        pfrom->PushMessage("block", block);
-                    else // MSG_FILTERED_BLOCK)
-                    {
-                        bool send = false;
-                        CMerkleBlock merkleBlock;
-                        {
-                            LOCK(pfrom->cs_filter);
-                            if (pfrom->pfilter) {
-                                send = true;
-                                merkleBlock = CMerkleBlock(block, *pfrom->pfilter);
-                            }
-                        }
-                        if (send) {
-                            pfrom->PushMessage("merkleblock", merkleBlock);
-                            // CMerkleBlock just contains hashes, so also push any transactions in the block the client did not see
-                            // This avoids hurting performance by pointlessly requiring a round-trip
-                            // Note that there is currently no way for a node to request any single transactions we didn't send here -
-                            // they must either disconnect and retry or request the full block.
-                            // Thus, the protocol spec specified allows for us to provide duplicate txn here,
-                            // however we MUST always provide at least what the remote peer needs
-                            typedef std::pair<unsigned int, uint256> PairType;
-                            for (PairType& pair : merkleBlock.vMatchedTxn)
-                                pfrom->PushMessage("tx", block.vtx[pair.first]);
-                        }
-                        // else
-                            // no response
-                    }
-
-                    // Trigger the peer node to send a getblocks request for the next batch of inventory
-                    if (inv.hash == pfrom->hashContinue)
-                    {
-                        // Bypass PushBlockInventory, this must send even if redundant,
-                        // and we want it right after the last block so they don't
-                        // wait for other stuff first.
-                        vector<CInv> vInv;
-                        vInv.push_back(CInv(MSG_BLOCK, chainActive.Tip()->GetBlockHash()));
-                        pfrom->PushMessage("inv", vInv);
-                        pfrom->hashContinue.SetNull();
-                    }
-                }
-            }
-            else if (inv.type == MSG_TX || inv.type == MSG_WTX)
+            if (inv.type == MSG_TX || inv.type == MSG_WTX)
             {
-                // Send stream from relay memory
+                // Send the transaction from the mempool if we announced it to
+                // this peer recently, or it was in the mempool when the peer
+                // last sent us a mempool request. To protect privacy, other
+                // transactions are not sent, even if we have them.
                 bool push = false;
-                auto mi = mapRelay.find(inv.hash);
-                if (mi != mapRelay.end() && !IsExpiringSoonTx(*mi->second, currentHeight + 1)) {
+                auto txinfo = mempool.info(inv.hash);
+                if (txinfo.tx && !IsExpiringSoonTx(*txinfo.tx, currentHeight + 1) &&
+                    ((pfrom->timeLastMempoolReq && txinfo.nTime <= pfrom->timeLastMempoolReq) ||
+                     pfrom->WasRecentlyAnnounced(inv.hash))) {
                     // ZIP 239: MSG_TX should be used if and only if the tx is v4 or earlier.
-                    if ((mi->second->nVersion <= 4) != (inv.type == MSG_TX)) {
+                    if ((txinfo.tx->nVersion <= 4) != (inv.type == MSG_TX)) {
                         Misbehaving(pfrom->GetId(), 100);
-                        LogPrint("net", "Wrong INV message type used for v%d tx", mi->second->nVersion);
+                        LogPrint("net", "Wrong INV message type used for v%d tx", txinfo.tx->nVersion);
                         // Break so that this inv message will be erased from the queue
                         // (otherwise the peer would repeatedly hit this case until its
                         // Misbehaving level rises above -banscore, no matter what the
@@ -6885,41 +10366,28 @@ void static ProcessGetData(CNode* pfrom, const Consensus::Params& consensusParam
                     }
                     // Ensure we only reply with a transaction if it is exactly what the
                     // peer requested from us. Otherwise we add it to vNotFound below.
-                    if (inv.hashAux == mi->second->GetAuthDigest()) {
-                        pfrom->PushMessage("tx", *mi->second);
+                    if (inv.hashAux == txinfo.tx->GetAuthDigest()) {
+                        pfrom->PushMessage("tx", *txinfo.tx);
                         push = true;
                     }
-                } else if (pfrom->timeLastMempoolReq) {
-                    auto txinfo = mempool.info(inv.hash);
-                    // To protect privacy, do not answer getdata using the mempool when
-                    // that TX couldn't have been INVed in reply to a MEMPOOL request.
-                    if (txinfo.tx && txinfo.nTime <= pfrom->timeLastMempoolReq && !IsExpiringSoonTx(*txinfo.tx, currentHeight + 1)) {
-                        // ZIP 239: MSG_TX should be used if and only if the tx is v4 or earlier.
-                        if ((txinfo.tx->nVersion <= 4) != (inv.type == MSG_TX)) {
-                            Misbehaving(pfrom->GetId(), 100);
-                            LogPrint("net", "Wrong INV message type used for v%d tx", txinfo.tx->nVersion);
-                            // Break so that this inv message will be erased from the queue.
-                            break;
-                        }
-                        // Ensure we only reply with a transaction if it is exactly what
-                        // the peer requested from us. Otherwise we add it to vNotFound
-                        // below.
-                        if (inv.hashAux == txinfo.tx->GetAuthDigest()) {
-                            pfrom->PushMessage("tx", *txinfo.tx);
-                            push = true;
-                        }
-                    }
                 }
                 if (!push) {
                     vNotFound.push_back(inv);
                 }
             }
-
-            if (inv.type == MSG_BLOCK || inv.type == MSG_FILTERED_BLOCK)
-                break;
         }
     }
 
+    // Only process one block request per call, so that other peers are not
+    // kept waiting and the order of responses is maintained. The block is
+    // only read once the blocks sent before it have mostly left the send
+    // queue, so that serving many peers does not hold many blocks in memory.
+    if (it != pfrom->vRecvGetData.end() && pfrom->CanQueueBlock()) {
+        const CInv inv = *it;
+        it++;
+        ProcessGetBlockData(pfrom, consensusParams, inv);
+    }
+
     pfrom->vRecvGetData.erase(pfrom->vRecvGetData.begin(), it);
 
     if (!vNotFound.empty()) {
@@ -6937,63 +10405,440 @@ void static ProcessGetData(CNode* pfrom, const Consensus::Params& consensusParam
 void static ProcessOrphanTx(const CChainParams& chainparams, std::set<uint256>& orphan_work_set) EXCLUSIVE_LOCKS_REQUIRED(cs_main)
 {
     AssertLockHeld(cs_main);
+    LOCK(g_cs_orphans);
     set<NodeId> setMisbehaving;
     bool done = false;
     while (!done && !orphan_work_set.empty()) {
-        const uint256 orphanHash = *orphan_work_set.begin();
-        orphan_work_set.erase(orphan_work_set.begin());
-
-        auto orphan_it = mapOrphanTransactions.find(orphanHash);
-        if (orphan_it == mapOrphanTransactions.end()) continue;
-
-        const CTransaction& orphanTx = orphan_it->second.tx;
-        NodeId fromPeer = orphan_it->second.fromPeer;
-        bool fMissingInputs2 = false;
-        // Use a dummy CValidationState so someone can't setup nodes to counter-DoS based on orphan
+        // Check up to MAX_TX_ACCEPT_BATCH orphans at a time, so that their
+        // proofs are verified in one batch.
+        std::vector<CTransactionRef> vOrphans;
+        std::vector<NodeId> vFromPeers;
+        while (vOrphans.size() < MAX_TX_ACCEPT_BATCH && !orphan_work_set.empty()) {
+            const uint256 orphanHash = *orphan_work_set.begin();
+            orphan_work_set.erase(orphan_work_set.begin());
+
+            auto orphan_it = mapOrphanTransactions.find(orphanHash);
+            if (orphan_it == mapOrphanTransactions.end()) continue;
+            if (setMisbehaving.count(orphan_it->second.fromPeer)) continue;
+            vOrphans.push_back(orphan_it->second.tx);
+            vFromPeers.push_back(orphan_it->second.fromPeer);
+        }
+
+        // Use dummy CValidationStates so someone can't setup nodes to counter-DoS based on orphan
         // resolution (that is, feeding people an invalid transaction based on LegitTxX in order to get
         // anyone relaying LegitTxX banned)
-        CValidationState stateDummy;
-
-        if (setMisbehaving.count(fromPeer)) continue;
-        if (AcceptToMemoryPool(chainparams, mempool, stateDummy, orphanTx, true, &fMissingInputs2))
-        {
-            LogPrint("mempool", "   accepted orphan tx %s\n", orphanHash.ToString());
-            RelayTransaction(orphanTx);
-            for (unsigned int i = 0; i < orphanTx.vout.size(); i++) {
-                auto it_by_prev = mapOrphanTransactionsByPrev.find(COutPoint(orphanHash, i));
-                if (it_by_prev != mapOrphanTransactionsByPrev.end()) {
-                    for (const auto& elem : it_by_prev->second) {
-                        orphan_work_set.insert(elem->first);
+        std::vector<CValidationState> vStateDummy;
+        std::vector<bool> vMissingInputs;
+        std::vector<bool> vAccepted = AcceptToMemoryPoolBatch(chainparams, mempool, vStateDummy, vOrphans, true, &vMissingInputs);
+
+        for (size_t i = 0; i < vOrphans.size(); i++) {
+            const CTransaction& orphanTx = *vOrphans[i];
+            const uint256 orphanHash = orphanTx.GetHash();
+            NodeId fromPeer = vFromPeers[i];
+            if (vAccepted[i])
+            {
+                LogPrint("mempool", "   accepted orphan tx %s\n", orphanHash.ToString());
+                RelayTransaction(orphanTx);
+                for (unsigned int j = 0; j < orphanTx.vout.size(); j++) {
+                    auto it_by_prev = mapOrphanTransactionsByPrev.find(COutPoint(orphanHash, j));
+                    if (it_by_prev != mapOrphanTransactionsByPrev.end()) {
+                        for (const auto& elem : it_by_prev->second) {
+                            orphan_work_set.insert(elem->first);
+                        }
+                    }
+                }
+                EraseOrphanTx(orphanHash);
+                done = true;
+            } else if (!vMissingInputs[i]) {
+                int nDos = 0;
+                if (vStateDummy[i].IsInvalid(nDos) && nDos > 0) {
+                    // Punish peer that gave us an invalid orphan tx
+                    if (setMisbehaving.insert(fromPeer).second) {
+                        Misbehaving(fromPeer, nDos);
                     }
+                    LogPrint("mempool", "   invalid orphan tx %s\n", orphanHash.ToString());
                 }
+                // Has inputs but not accepted to mempool
+                // Probably non-standard or insufficient fee
+                LogPrint("mempool", "   removed orphan tx %s\n", orphanHash.ToString());
+                // Add the wtxid of this transaction to our reject filter.
+                // Unlike upstream Bitcoin Core, we can unconditionally add
+                // these, as they are always bound to the entirety of the
+                // transaction regardless of version.
+                assert(recentRejects);
+                InsertRecentReject(orphanTx, vStateDummy[i]);
+                EraseOrphanTx(orphanHash);
+                done = true;
             }
-            EraseOrphanTx(orphanHash);
-            done = true;
-        } else if (!fMissingInputs2) {
-            int nDos = 0;
-            if (stateDummy.IsInvalid(nDos) && nDos > 0) {
-                // Punish peer that gave us an invalid orphan tx
-                Misbehaving(fromPeer, nDos);
-                setMisbehaving.insert(fromPeer);
-                LogPrint("mempool", "   invalid orphan tx %s\n", orphanHash.ToString());
-            }
-            // Has inputs but not accepted to mempool
-            // Probably non-standard or insufficient fee
-            LogPrint("mempool", "   removed orphan tx %s\n", orphanHash.ToString());
-            // Add the wtxid of this transaction to our reject filter.
-            // Unlike upstream Bitcoin Core, we can unconditionally add
-            // these, as they are always bound to the entirety of the
-            // transaction regardless of version.
-            assert(recentRejects);
-            recentRejects->insert(orphanTx.GetWTxId().ToBytes());
-            EraseOrphanTx(orphanHash);
-            done = true;
         }
         mempool.check(pcoinsTip);
     }
 }
 
-bool static ProcessMessage(const CChainParams& chainparams, CNode* pfrom, string strCommand, CDataStream& vRecv, int64_t nTimeReceived)
+/**
+ * Relay a transaction received from pfrom that was accepted to the mempool,
+ * or keep it as an orphan, or reject it.
+ */
+void static ProcessTxFromPeer(const CChainParams& chainparams, CNode* pfrom, const CTransactionRef& ptx,
+    bool fAccepted, bool fMissingInputs, CValidationState& state) EXCLUSIVE_LOCKS_REQUIRED(cs_main)
+{
+    AssertLockHeld(cs_main);
+    const CTransaction& tx = *ptx;
+    const uint256& txid = tx.GetHash();
+
+    if (fAccepted)
+    {
+        mempool.check(pcoinsTip);
+        RelayTransaction(tx);
+        LOCK(g_cs_orphans);
+        for (unsigned int i = 0; i < tx.vout.size(); i++) {
+            auto it_by_prev = mapOrphanTransactionsByPrev.find(COutPoint(txid, i));
+            if (it_by_prev != mapOrphanTransactionsByPrev.end()) {
+                for (const auto& elem : it_by_prev->second) {
+                    pfrom->orphan_work_set.insert(elem->first);
+                }
+            }
+        }
+
+        LogPrint("mempool", "AcceptToMemoryPool: peer=%d %s: accepted %s (poolsz %u txn, %u kB)\n",
+            pfrom->id, pfrom->cleanSubVer,
+            tx.GetHash().ToString(),
+            mempool.size(), mempool.DynamicMemoryUsage() / 1000);
+
+        // Recursively process any orphan transactions that depended on this one
+        ProcessOrphanTx(chainparams, pfrom->orphan_work_set);
+    }
+    // TODO: currently, prohibit joinsplits and shielded spends/outputs/actions from entering mapOrphans
+    else if (fMissingInputs &&
+             tx.vJoinSplit.empty() &&
+             !tx.GetSaplingBundle().IsPresent() &&
+             !tx.GetOrchardBundle().IsPresent())
+    {
+        bool fRejectedParents = false; // It may be the case that the orphan's parents have all been rejected
+        for (const CTxIn& txin : tx.vin) {
+            if (recentRejects->contains(txin.prevout.hash)) {
+                fRejectedParents = true;
+                break;
+            }
+        }
+        if (!fRejectedParents) {
+            for (const CTxIn& txin : tx.vin) {
+                CInv inv(MSG_TX, txin.prevout.hash);
+                pfrom->AddKnownTxId(inv.hash);
+                if (!AlreadyHave(inv)) pfrom->AskFor(inv);
+            }
+            {
+                LOCK(g_cs_orphans);
+                AddOrphanTx(ptx, pfrom->GetId());
+            }
+
+            // DoS prevention: do not allow mapOrphanTransactions and
+            // mapOrphanTransactionsByPrev to grow unbounded.
+            unsigned int nMaxOrphanTx = (unsigned int)std::max((int64_t)0, GetArg("-maxorphantx", DEFAULT_MAX_ORPHAN_TRANSACTIONS));
+            size_t nMaxOrphanUsage = std::max((int64_t)0, GetArg("-maxorphanmemory", DEFAULT_MAX_ORPHAN_MEMORY)) * 1000000;
+            size_t nMaxOrphanPeerUsage = std::max((int64_t)0, GetArg("-maxorphanpeermemory", DEFAULT_MAX_ORPHAN_PEER_MEMORY)) * 1000;
+            unsigned int nEvicted = LimitOrphanTxSize(nMaxOrphanTx, nMaxOrphanUsage, nMaxOrphanPeerUsage);
+            if (nEvicted > 0)
+                LogPrint("mempool", "mapOrphan overflow, removed %u tx\n", nEvicted);
+        } else {
+            LogPrint("mempool", "not keeping orphan with rejected parents %s\n",tx.GetHash().ToString());
+        }
+    } else {
+        // Add the wtxid of this transaction to our reject filter.
+        // Unlike upstream Bitcoin Core, we can unconditionally add
+        // these, as they are always bound to the entirety of the
+        // transaction regardless of version.
+        assert(recentRejects);
+        InsertRecentReject(tx, state);
+
+        if (pfrom->fWhitelisted && GetBoolArg("-whitelistforcerelay", DEFAULT_WHITELISTFORCERELAY)) {
+            // Always relay transactions received from whitelisted peers, even
+            // if they were already in the mempool or rejected from it due
+            // to policy, allowing the node to function as a gateway for
+            // nodes hidden behind it.
+            //
+            // Never relay transactions that we would assign a non-zero DoS
+            // score for, as we expect peers to do the same with us in that
+            // case.
+            int nDoS = 0;
+            if (!state.IsInvalid(nDoS) || nDoS == 0) {
+                LogPrintf("Force relaying tx %s from whitelisted peer=%d\n", tx.GetHash().ToString(), pfrom->id);
+                RelayTransaction(tx);
+            } else {
+                LogPrintf("Not relaying invalid transaction %s from whitelisted peer=%d (%s (code %d))\n",
+                    tx.GetHash().ToString(), pfrom->id, state.GetRejectReason(), state.GetRejectCode());
+            }
+        }
+    }
+    int nDoS = 0;
+    if (state.IsInvalid(nDoS))
+    {
+        LogPrint("mempoolrej", "%s from peer=%d %s was not accepted into the memory pool: %s\n", tx.GetHash().ToString(),
+            pfrom->id, pfrom->cleanSubVer,
+            FormatStateMessage(state));
+        if (state.GetRejectCode() < REJECT_INTERNAL) // Never send AcceptToMemoryPool's internal codes over P2P
+            pfrom->PushMessage("reject", std::string("tx"), (unsigned char)state.GetRejectCode(),
+                               state.GetRejectReason().substr(0, MAX_REJECT_MESSAGE_LENGTH), txid);
+        if (nDoS > 0)
+            Misbehaving(pfrom->GetId(), nDoS);
+    }
+}
+
+namespace {
+
+/** A transaction received from a peer that is waiting for a ThreadTxAccept thread. */
+struct CTxAcceptJob {
+    CTransactionRef ptx;
+    //! Referenced until the job is done.
+    CNode* pfrom;
+    //! Set once the transaction passed PreCheckMemPoolAcceptance, so that a
+    //! deferred job does not repeat the context-free checks.
+    bool fPreChecked = false;
+};
+
+//! Jobs beyond this many are checked by the message handler thread itself.
+static const size_t MAX_TX_ACCEPT_QUEUE = 1000;
+//! Jobs that would be deferred beyond this many are handled as orphans.
+static const size_t MAX_TX_ACCEPT_DEFERRED = 1000;
+
+Mutex cs_txAccept;
+std::condition_variable condTxAccept;
+std::deque<CTxAcceptJob> queueTxAccept;
+//! Jobs whose inputs are spent by a transaction that is still being checked,
+//! by the txid of that transaction.
+std::multimap<uint256, CTxAcceptJob> mapTxAcceptDeferred;
+bool fStopTxAccept = false;
+std::vector<std::thread> vTxAcceptThreads;
+
+}
+
+/**
+ * Hand a transaction received from pfrom to the ThreadTxAccept threads.
+ * Returns false if the caller has to check it instead.
+ */
+bool QueueTxAccept(CNode* pfrom, const CTransactionRef& ptx) EXCLUSIVE_LOCKS_REQUIRED(cs_main)
+{
+    AssertLockHeld(cs_main);
+    {
+        LOCK(cs_txAccept);
+        if (vTxAcceptThreads.empty() || queueTxAccept.size() >= MAX_TX_ACCEPT_QUEUE) {
+            return false;
+        }
+        queueTxAccept.push_back(CTxAcceptJob{ptx, pfrom->AddRef()});
+    }
+    setTxAcceptInFlight.insert(ptx->GetHash());
+    condTxAccept.notify_one();
+    return true;
+}
+
+/** Mark a transaction as checked, and retry the jobs that were waiting for it. */
+void static EndTxAcceptJob(const uint256& txid) EXCLUSIVE_LOCKS_REQUIRED(cs_main)
+{
+    AssertLockHeld(cs_main);
+    setTxAcceptInFlight.erase(txid);
+    {
+        LOCK(cs_txAccept);
+        auto range = mapTxAcceptDeferred.equal_range(txid);
+        if (range.first == range.second) {
+            return;
+        }
+        for (auto it = range.first; it != range.second; ++it) {
+            queueTxAccept.push_back(std::move(it->second));
+        }
+        mapTxAcceptDeferred.erase(range.first, range.second);
+    }
+    condTxAccept.notify_all();
+}
+
+/**
+ * Run the checks of AcceptToMemoryPool for transactions received from peers,
+ * holding cs_main only for the checks against the chain and the mempool, and
+ * checking the Sapling and Orchard bundles of the transactions in one batch.
+ * Jobs that have to wait until a transaction they spend from has been checked
+ * are deferred, and their pfrom is cleared; the others are done on return.
+ * Once too many jobs are deferred, the transactions that would be are handled
+ * as orphans instead.
+ */
+void static ProcessTxAcceptJobs(const CChainParams& chainparams, std::vector<CTxAcceptJob>& jobs)
+{
+    std::vector<std::unique_ptr<CMemPoolAcceptance>> vAcceptances;
+    std::vector<CValidationState> vStates(jobs.size());
+    std::vector<bool> vMissingInputs(jobs.size(), false);
+    std::vector<bool> vChecked(jobs.size(), false);
+    for (size_t i = 0; i < jobs.size(); i++) {
+        const CTransaction& tx = *jobs[i].ptx;
+        vAcceptances.emplace_back(new CMemPoolAcceptance(jobs[i].ptx, true, false));
+        if (mempool.IsRecentlyEvicted(tx.GetHash())) {
+            LogPrint("mempool", "Dropping txid %s : recently evicted", tx.GetHash().ToString());
+        } else {
+            vChecked[i] = jobs[i].fPreChecked || PreCheckMemPoolAcceptance(*vAcceptances[i], vStates[i]);
+        }
+    }
+
+    std::vector<CMemPoolAcceptance*> vVerify;
+    std::vector<CValidationState*> vVerifyStates;
+    std::vector<size_t> vVerifyIndex;
+    {
+        LOCK2(cs_main, mempool.cs);
+        for (size_t i = 0; i < jobs.size(); i++) {
+            if (!vChecked[i]) {
+                continue;
+            }
+            const CTransaction& tx = *jobs[i].ptx;
+            bool fMissingInputs = false;
+            vChecked[i] = PrepareMemPoolAcceptance(chainparams, mempool, *vAcceptances[i], vStates[i], &fMissingInputs);
+            vMissingInputs[i] = fMissingInputs;
+            if (vChecked[i]) {
+                vVerify.push_back(vAcceptances[i].get());
+                vVerifyStates.push_back(&vStates[i]);
+                vVerifyIndex.push_back(i);
+            } else if (fMissingInputs) {
+                for (const CTxIn& txin : tx.vin) {
+                    if (setTxAcceptInFlight.count(txin.prevout.hash)) {
+                        LOCK(cs_txAccept);
+                        if (mapTxAcceptDeferred.size() < MAX_TX_ACCEPT_DEFERRED) {
+                            jobs[i].fPreChecked = true;
+                            mapTxAcceptDeferred.emplace(txin.prevout.hash, jobs[i]);
+                            jobs[i].pfrom = NULL;
+                        }
+                        break;
+                    }
+                }
+            }
+        }
+    }
+    if (!vVerify.empty()) {
+        std::vector<bool> vValid = VerifyMemPoolAcceptances(chainparams, vVerify, vVerifyStates, false);
+        for (size_t k = 0; k < vVerifyIndex.size(); k++) {
+            vChecked[vVerifyIndex[k]] = vValid[k];
+        }
+    }
+
+    LOCK(cs_main);
+    for (size_t i = 0; i < jobs.size(); i++) {
+        if (jobs[i].pfrom == NULL) {
+            continue;
+        }
+        bool fAccepted = false;
+        if (vChecked[i]) {
+            LOCK(mempool.cs);
+            bool fMissingInputs = false;
+            fAccepted = CompleteMemPoolAcceptance(chainparams, mempool, vAcceptances[i], vStates[i], &fMissingInputs);
+            vMissingInputs[i] = fMissingInputs;
+        }
+        EndTxAcceptJob(jobs[i].ptx->GetHash());
+        ProcessTxFromPeer(chainparams, jobs[i].pfrom, jobs[i].ptx, fAccepted, vMissingInputs[i], vStates[i]);
+    }
+}
+
+void static ThreadTxAccept()
+{
+    RenameThread("zc-txaccept");
+    // Checking transactions for the mempool yields to validating blocks.
+    SetThreadPriority(THREAD_PRIORITY_BELOW_NORMAL);
+    while (true) {
+        std::vector<CTxAcceptJob> jobs;
+        {
+            WAIT_LOCK(cs_txAccept, lock);
+            condTxAccept.wait(lock, [] { return !queueTxAccept.empty() || fStopTxAccept; });
+            if (fStopTxAccept) {
+                return;
+            }
+            while (jobs.size() < MAX_TX_ACCEPT_BATCH && !queueTxAccept.empty()) {
+                jobs.push_back(std::move(queueTxAccept.front()));
+                queueTxAccept.pop_front();
+            }
+        }
+        try {
+            ProcessTxAcceptJobs(Params(), jobs);
+        } catch (const std::exception& e) {
+            PrintExceptionContinue(&e, "ThreadTxAccept()");
+            LOCK(cs_main);
+            for (const CTxAcceptJob& job : jobs) {
+                if (job.pfrom != NULL) {
+                    EndTxAcceptJob(job.ptx->GetHash());
+                }
+            }
+        }
+        for (const CTxAcceptJob& job : jobs) {
+            if (job.pfrom != NULL) {
+                job.pfrom->Release();
+            }
+        }
+    }
+}
+
+void StartTxAcceptThreads(int nThreads)
+{
+    LOCK(cs_txAccept);
+    fStopTxAccept = false;
+    for (int i = 0; i < nThreads; i++) {
+        vTxAcceptThreads.emplace_back(&ThreadTxAccept);
+    }
+}
+
+void StopTxAcceptThreads()
+{
+    {
+        LOCK(cs_txAccept);
+        fStopTxAccept = true;
+    }
+    condTxAccept.notify_all();
+    for (std::thread& thread : vTxAcceptThreads) {
+        thread.join();
+    }
+
+    // Drop the transactions that were not checked.
+    LOCK2(cs_main, cs_txAccept);
+    vTxAcceptThreads.clear();
+    for (CTxAcceptJob& job : queueTxAccept) {
+        setTxAcceptInFlight.erase(job.ptx->GetHash());
+        job.pfrom->Release();
+    }
+    queueTxAccept.clear();
+    for (auto& entry : mapTxAcceptDeferred) {
+        setTxAcceptInFlight.erase(entry.second.ptx->GetHash());
+        entry.second.pfrom->Release();
+    }
+    mapTxAcceptDeferred.clear();
+}
+
+/**
+ * Check a request for the block filters of a range of blocks of the active
+ * chain, as made by getcfilters and getcfheaders, and find the index to
+ * serve it from. Disconnects the peer if we do not serve filters of the
+ * requested type, or the range is invalid.
+ */
+static bool PrepareBlockFilterRequest(CNode* pfrom, uint8_t nFilterType, uint32_t nStartHeight, const uint256& hashStop,
+    uint32_t nMaxHeightDiff, const CBlockIndex*& pindexStop, CBlockFilterIndex*& filterIndex) EXCLUSIVE_LOCKS_REQUIRED(cs_main)
+{
+    filterIndex = NULL;
+    if (nLocalServices & NODE_COMPACT_FILTERS) {
+        filterIndex = GetBlockFilterIndex(static_cast<BlockFilterType>(nFilterType));
+    }
+    if (filterIndex == NULL) {
+        LogPrint("net", "peer=%d requested unsupported block filter type %d\n", pfrom->id, nFilterType);
+        pfrom->fDisconnect = true;
+        return false;
+    }
+
+    BlockMap::const_iterator it = mapBlockIndex.find(hashStop);
+    pindexStop = it == mapBlockIndex.end() ? NULL : it->second;
+    if (pindexStop == NULL || !chainActive.Contains(pindexStop)) {
+        LogPrint("net", "peer=%d requested block filters up to unknown block %s\n", pfrom->id, hashStop.ToString());
+        pfrom->fDisconnect = true;
+        return false;
+    }
+    if (nStartHeight > (uint32_t)pindexStop->nHeight || pindexStop->nHeight - nStartHeight >= nMaxHeightDiff) {
+        LogPrint("net", "peer=%d requested invalid range of block filters from height %d to %d\n",
+            pfrom->id, nStartHeight, pindexStop->nHeight);
+        pfrom->fDisconnect = true;
+        return false;
+    }
+    return true;
+}
+
+bool static ProcessMessage(const CChainParams& chainparams, CNode* pfrom, string strCommand, CPublicDataStream& vRecv, int64_t nTimeReceived)
 {
     LogPrint("net", "received: %s (%u bytes) peer=%d\n", SanitizeString(strCommand), vRecv.size(), pfrom->id);
     if (mapArgs.count("-dropmessagestest") && GetRand(atoi(mapArgs["-dropmessagestest"])) == 0)
@@ -7128,6 +10973,27 @@ bool static ProcessMessage(const CChainParams& chainparams, CNode* pfrom, string
             UpdatePreferredDownload(pfrom, State(pfrom->GetId()));
         }
 
+        // Offer to reconcile transactions rather than flood them, if both
+        // of us relay them.
+        bool fRelayTxes;
+        {
+            LOCK(pfrom->cs_filter);
+            fRelayTxes = pfrom->fRelayTxes;
+        }
+        if (pfrom->nVersion >= TXRECONCILIATION_VERSION && fRelayTxes &&
+            !GetBoolArg("-blocksonly", DEFAULT_BLOCKSONLY) &&
+            GetBoolArg("-txreconciliation", DEFAULT_TXRECONCILIATION_ENABLE))
+        {
+            uint64_t nSalt;
+            {
+                LOCK(pfrom->cs_inventory);
+                // Zero means we did not offer it.
+                pfrom->nTxReconSalt = GetRand(std::numeric_limits<uint64_t>::max()) | 1;
+                nSalt = pfrom->nTxReconSalt;
+            }
+            pfrom->PushMessage("sendtxrcncl", TXRECONCILIATION_PROTOCOL_VERSION, nSalt);
+        }
+
         // Change version
         pfrom->PushMessage("verack");
         pfrom->ssSend.SetVersion(min(pfrom->nVersion, PROTOCOL_VERSION));
@@ -7183,30 +11049,180 @@ bool static ProcessMessage(const CChainParams& chainparams, CNode* pfrom, string
     }
 
 
-    else if (pfrom->nVersion == 0)
+    else if (pfrom->nVersion == 0)
+    {
+        // Must have a version message before anything else
+        LOCK(cs_main);
+        Misbehaving(pfrom->GetId(), 1);
+        return false;
+    }
+
+
+    else if (strCommand == "verack")
+    {
+        LOCK(cs_main);
+        CNodeState* state = State(pfrom->GetId());
+        assert(state != nullptr);
+        if (state->fCurrentlyConnected) {
+            pfrom->PushMessage("reject", strCommand, REJECT_DUPLICATE, std::string("Duplicate verack message"));
+            Misbehaving(pfrom->GetId(), 1);
+            return false;
+        }
+        pfrom->SetRecvVersion(min(pfrom->nVersion, PROTOCOL_VERSION));
+
+        // Mark this node as currently connected, so we update its timestamp later.
+        if (pfrom->fNetworkNode) {
+            state->fCurrentlyConnected = true;
+        }
+
+        if (pfrom->nVersion >= SENDHEADERS_VERSION) {
+            // Tell our peer we prefer to receive headers rather than inv's
+            // We send this to non-NODE NETWORK peers as well, because even
+            // non-NODE NETWORK peers can announce blocks (such as pruning
+            // nodes)
+            pfrom->PushMessage("sendheaders");
+        }
+        if (pfrom->nVersion >= SHORT_IDS_BLOCKS_VERSION) {
+            // Tell our peer we are willing to provide version-1 cmpctblocks.
+            // We only send unsolicited cmpctblocks to the few peers that
+            // have recently given us new blocks first; see
+            // MaybeSetPeerAsAnnouncingHeaderAndIDs.
+            bool fAnnounceUsingCMPCTBLOCK = false;
+            uint64_t nCMPCTBLOCKVersion = 1;
+            pfrom->PushMessage("sendcmpct", fAnnounceUsingCMPCTBLOCK, nCMPCTBLOCKVersion);
+        }
+    }
+
+
+    else if (strCommand == "sendheaders")
+    {
+        LOCK(cs_main);
+        State(pfrom->GetId())->fPreferHeaders = true;
+    }
+
+
+    else if (strCommand == "sendcmpct")
+    {
+        bool fAnnounceUsingCMPCTBLOCK = false;
+        uint64_t nCMPCTBLOCKVersion = 1;
+        vRecv >> fAnnounceUsingCMPCTBLOCK >> nCMPCTBLOCKVersion;
+        if (nCMPCTBLOCKVersion == 1) {
+            LOCK(cs_main);
+            State(pfrom->GetId())->fProvidesHeaderAndIDs = true;
+            State(pfrom->GetId())->fPreferHeaderAndIDs = fAnnounceUsingCMPCTBLOCK;
+        }
+    }
+
+
+    else if (strCommand == "sendtxrcncl")
+    {
+        uint32_t nReconVersion;
+        uint64_t nRemoteSalt;
+        vRecv >> nReconVersion >> nRemoteSalt;
+
+        LOCK2(cs_main, pfrom->cs_inventory);
+        // Ignore the offer if we did not make one ourselves, or if it is
+        // repeated.
+        if (pfrom->nTxReconSalt == 0 || pfrom->txrecon || nReconVersion < TXRECONCILIATION_PROTOCOL_VERSION) {
+            LogPrint("net", "ignoring sendtxrcncl from peer=%d\n", pfrom->id);
+            return true;
+        }
+        // Keep flooding to a few outbound peers, so that transactions still
+        // propagate quickly; everyone else learns about them by reconciliation.
+        bool fFlood = !pfrom->fInbound && nTxReconFloodPeers < MAX_RECON_FLOOD_OUTBOUND_PEERS;
+        if (fFlood) {
+            State(pfrom->GetId())->fTxReconFlood = true;
+            nTxReconFloodPeers++;
+        }
+        // The peer that opened the connection starts the rounds.
+        pfrom->txrecon.reset(new TxReconciliationState(!pfrom->fInbound, fFlood, pfrom->nTxReconSalt, nRemoteSalt));
+        pfrom->txrecon->nNextRequest = PoissonNextSend(GetTimeMicros(), RECON_REQUEST_INTERVAL);
+        LogPrint("net", "reconciling transactions with peer=%d%s\n", pfrom->id, fFlood ? " (flooding)" : "");
+    }
+
+
+    else if (strCommand == "reqrecon")
+    {
+        uint32_t nRemoteSetSize;
+        vRecv >> nRemoteSetSize;
+
+        CTxSketch sketch;
+        bool fExpected = false;
+        {
+            LOCK(pfrom->cs_inventory);
+            if (pfrom->txrecon && !pfrom->txrecon->fInitiator) {
+                // Anything left of a round the peer gave up on is part of this one.
+                pfrom->txrecon->StartRound(GetTimeMicros());
+                sketch = pfrom->txrecon->SketchSnapshot(nRemoteSetSize);
+                fExpected = true;
+            }
+        }
+        if (!fExpected) {
+            LOCK(cs_main);
+            Misbehaving(pfrom->GetId(), 10);
+            return false;
+        }
+        pfrom->PushMessage("sketch", sketch);
+    }
+
+
+    else if (strCommand == "sketch")
+    {
+        CTxSketch sketch;
+        vRecv >> sketch;
+
+        bool fExpected = false;
+        bool fSuccess = false;
+        std::vector<uint32_t> vRequest;
+        {
+            LOCK(pfrom->cs_inventory);
+            TxReconciliationState* recon = pfrom->txrecon.get();
+            if (recon && recon->fInitiator && recon->fRoundInFlight) {
+                std::vector<uint256> vAnnounce;
+                fSuccess = recon->Reconcile(sketch, vAnnounce, vRequest);
+                // If the difference could not be decoded, both sides announce
+                // everything they held in this round.
+                if (fSuccess) {
+                    recon->FinishRound(std::vector<uint32_t>(), false);
+                } else {
+                    vAnnounce = recon->FinishRound(std::vector<uint32_t>(), true);
+                }
+                pfrom->setInventoryTxToSend.insert(vAnnounce.begin(), vAnnounce.end());
+                recon->nNextRequest = PoissonNextSend(GetTimeMicros(), RECON_REQUEST_INTERVAL);
+                fExpected = true;
+            }
+        }
+        if (!fExpected) {
+            LOCK(cs_main);
+            Misbehaving(pfrom->GetId(), 10);
+            return false;
+        }
+        LogPrint("net", "reconciliation with peer=%d %s, %u transactions requested\n",
+            pfrom->id, fSuccess ? "succeeded" : "failed", vRequest.size());
+        pfrom->PushMessage("reconcildiff", fSuccess, vRequest);
+    }
+
+
+    else if (strCommand == "reconcildiff")
     {
-        // Must have a version message before anything else
-        LOCK(cs_main);
-        Misbehaving(pfrom->GetId(), 1);
-        return false;
-    }
+        bool fSuccess;
+        std::vector<uint32_t> vRequest;
+        vRecv >> fSuccess >> vRequest;
 
-
-    else if (strCommand == "verack")
-    {
-        LOCK(cs_main);
-        CNodeState* state = State(pfrom->GetId());
-        assert(state != nullptr);
-        if (state->fCurrentlyConnected) {
-            pfrom->PushMessage("reject", strCommand, REJECT_DUPLICATE, std::string("Duplicate verack message"));
-            Misbehaving(pfrom->GetId(), 1);
-            return false;
+        bool fExpected = false;
+        if (vRequest.size() <= MAX_SKETCH_CELLS) {
+            LOCK(pfrom->cs_inventory);
+            TxReconciliationState* recon = pfrom->txrecon.get();
+            if (recon && !recon->fInitiator && recon->fRoundInFlight) {
+                std::vector<uint256> vAnnounce = recon->FinishRound(vRequest, !fSuccess);
+                pfrom->setInventoryTxToSend.insert(vAnnounce.begin(), vAnnounce.end());
+                fExpected = true;
+            }
         }
-        pfrom->SetRecvVersion(min(pfrom->nVersion, PROTOCOL_VERSION));
-
-        // Mark this node as currently connected, so we update its timestamp later.
-        if (pfrom->fNetworkNode) {
-            state->fCurrentlyConnected = true;
+        if (!fExpected) {
+            LOCK(cs_main);
+            Misbehaving(pfrom->GetId(), 10);
+            return false;
         }
     }
 
@@ -7494,10 +11510,79 @@ bool static ProcessMessage(const CChainParams& chainparams, CNode* pfrom, string
             if (--nLimit <= 0 || pindex->GetBlockHash() == hashStop)
                 break;
         }
+        // pindex can be NULL either if we sent chainActive.Tip() OR
+        // if our peer has chainActive.Tip() (and thus we are sending an empty
+        // headers message). In both cases it's safe to update
+        // pindexBestHeaderSent to be our tip.
+        CNodeState *nodestate = State(pfrom->GetId());
+        nodestate->pindexBestHeaderSent = pindex ? pindex : chainActive.Tip();
         pfrom->PushMessage("headers", vHeaders);
     }
 
 
+    else if (strCommand == "getcfilters")
+    {
+        uint8_t nFilterType;
+        uint32_t nStartHeight;
+        uint256 hashStop;
+        vRecv >> nFilterType >> nStartHeight >> hashStop;
+
+        LOCK(cs_main);
+        const CBlockIndex* pindexStop;
+        CBlockFilterIndex* filterIndex;
+        if (!PrepareBlockFilterRequest(pfrom, nFilterType, nStartHeight, hashStop, MAX_GETCFILTERS_SIZE, pindexStop, filterIndex))
+            return true;
+
+        std::vector<BlockFilter> vFilters;
+        vFilters.reserve(pindexStop->nHeight - nStartHeight + 1);
+        for (const CBlockIndex* pindex = pindexStop; pindex != NULL && pindex->nHeight >= (int)nStartHeight; pindex = pindex->pprev) {
+            BlockFilter filter;
+            if (!filterIndex->LookupFilter(pindex, filter)) {
+                LogPrint("net", "block filter of block %s requested by peer=%d is not indexed yet\n",
+                    pindex->GetBlockHash().ToString(), pfrom->id);
+                return true;
+            }
+            vFilters.push_back(std::move(filter));
+        }
+        for (auto it = vFilters.rbegin(); it != vFilters.rend(); ++it) {
+            pfrom->PushMessage("cfilter", *it);
+        }
+    }
+
+
+    else if (strCommand == "getcfheaders")
+    {
+        uint8_t nFilterType;
+        uint32_t nStartHeight;
+        uint256 hashStop;
+        vRecv >> nFilterType >> nStartHeight >> hashStop;
+
+        LOCK(cs_main);
+        const CBlockIndex* pindexStop;
+        CBlockFilterIndex* filterIndex;
+        if (!PrepareBlockFilterRequest(pfrom, nFilterType, nStartHeight, hashStop, MAX_GETCFHEADERS_SIZE, pindexStop, filterIndex))
+            return true;
+
+        // The filter hashes of the range, and the header of the filter
+        // before it, from which the peer can compute the headers.
+        std::vector<uint256> vFilterHashes(pindexStop->nHeight - nStartHeight + 1);
+        const CBlockIndex* pindex = pindexStop;
+        for (auto it = vFilterHashes.rbegin(); it != vFilterHashes.rend(); ++it, pindex = pindex->pprev) {
+            CBlockFilterHeader entry;
+            if (!filterIndex->LookupFilterHeader(pindex, entry)) {
+                LogPrint("net", "block filter of block %s requested by peer=%d is not indexed yet\n",
+                    pindex->GetBlockHash().ToString(), pfrom->id);
+                return true;
+            }
+            *it = entry.hashFilter;
+        }
+        CBlockFilterHeader prevEntry;
+        if (pindex != NULL && !filterIndex->LookupFilterHeader(pindex, prevEntry))
+            return true;
+        pfrom->PushMessage("cfheaders", nFilterType, hashStop, prevEntry.header, vFilterHashes);
+    }
+
+
     else if (strCommand == "tx" && !IsInitialBlockDownload(chainparams.GetConsensus()))
     {
         // Stop processing the transaction early if
@@ -7508,8 +11593,11 @@ bool static ProcessMessage(const CChainParams& chainparams, CNode* pfrom, string
             return true;
         }
 
-        CTransaction tx;
-        vRecv >> tx;
+        // Deserialized in place, and shared from here on by the accept
+        // queue, the mempool and the orphan pool.
+        CTransactionRef ptx;
+        vRecv >> ptx;
+        const CTransaction& tx = *ptx;
 
         const uint256& txid = tx.GetHash();
         const WTxId& wtxid = tx.GetWTxId();
@@ -7527,97 +11615,22 @@ bool static ProcessMessage(const CChainParams& chainparams, CNode* pfrom, string
         // We do the AlreadyHave() check using a MSG_WTX inv unconditionally,
         // because for pre-v5 transactions wtxid.authDigest is set to the same
         // placeholder as is used for the CInv.hashAux field for MSG_TX.
-        if (!AlreadyHave(CInv(MSG_WTX, txid, wtxid.authDigest)) &&
-            AcceptToMemoryPool(chainparams, mempool, state, tx, true, &fMissingInputs))
-        {
-            mempool.check(pcoinsTip);
-            RelayTransaction(tx);
-            for (unsigned int i = 0; i < tx.vout.size(); i++) {
-                auto it_by_prev = mapOrphanTransactionsByPrev.find(COutPoint(txid, i));
-                if (it_by_prev != mapOrphanTransactionsByPrev.end()) {
-                    for (const auto& elem : it_by_prev->second) {
-                        pfrom->orphan_work_set.insert(elem->first);
-                    }
-                }
-            }
-
-            LogPrint("mempool", "AcceptToMemoryPool: peer=%d %s: accepted %s (poolsz %u txn, %u kB)\n",
-                pfrom->id, pfrom->cleanSubVer,
-                tx.GetHash().ToString(),
-                mempool.size(), mempool.DynamicMemoryUsage() / 1000);
-
-            // Recursively process any orphan transactions that depended on this one
-            ProcessOrphanTx(chainparams, pfrom->orphan_work_set);
-        }
-        // TODO: currently, prohibit joinsplits and shielded spends/outputs/actions from entering mapOrphans
-        else if (fMissingInputs &&
-                 tx.vJoinSplit.empty() &&
-                 !tx.GetSaplingBundle().IsPresent() &&
-                 !tx.GetOrchardBundle().IsPresent())
-        {
-            bool fRejectedParents = false; // It may be the case that the orphan's parents have all been rejected
-            for (const CTxIn& txin : tx.vin) {
-                if (recentRejects->contains(txin.prevout.hash)) {
-                    fRejectedParents = true;
-                    break;
-                }
-            }
-            if (!fRejectedParents) {
-                for (const CTxIn& txin : tx.vin) {
-                    CInv inv(MSG_TX, txin.prevout.hash);
-                    pfrom->AddKnownTxId(inv.hash);
-                    if (!AlreadyHave(inv)) pfrom->AskFor(inv);
-                }
-                AddOrphanTx(tx, pfrom->GetId());
-
-                // DoS prevention: do not allow mapOrphanTransactions and
-                // mapOrphanTransactionsByPrev to grow unbounded.
-                unsigned int nMaxOrphanTx = (unsigned int)std::max((int64_t)0, GetArg("-maxorphantx", DEFAULT_MAX_ORPHAN_TRANSACTIONS));
-                unsigned int nEvicted = LimitOrphanTxSize(nMaxOrphanTx);
-                if (nEvicted > 0)
-                    LogPrint("mempool", "mapOrphan overflow, removed %u tx\n", nEvicted);
-            } else {
-                LogPrint("mempool", "not keeping orphan with rejected parents %s\n",tx.GetHash().ToString());
-            }
-        } else {
-            // Add the wtxid of this transaction to our reject filter.
-            // Unlike upstream Bitcoin Core, we can unconditionally add
-            // these, as they are always bound to the entirety of the
-            // transaction regardless of version.
-            assert(recentRejects);
-            recentRejects->insert(tx.GetWTxId().ToBytes());
-
-            if (pfrom->fWhitelisted && GetBoolArg("-whitelistforcerelay", DEFAULT_WHITELISTFORCERELAY)) {
-                // Always relay transactions received from whitelisted peers, even
-                // if they were already in the mempool or rejected from it due
-                // to policy, allowing the node to function as a gateway for
-                // nodes hidden behind it.
-                //
-                // Never relay transactions that we would assign a non-zero DoS
-                // score for, as we expect peers to do the same with us in that
-                // case.
-                int nDoS = 0;
-                if (!state.IsInvalid(nDoS) || nDoS == 0) {
-                    LogPrintf("Force relaying tx %s from whitelisted peer=%d\n", tx.GetHash().ToString(), pfrom->id);
-                    RelayTransaction(tx);
-                } else {
-                    LogPrintf("Not relaying invalid transaction %s from whitelisted peer=%d (%s (code %d))\n",
-                        tx.GetHash().ToString(), pfrom->id, state.GetRejectReason(), state.GetRejectCode());
-                }
-            }
-        }
-        int nDoS = 0;
-        if (state.IsInvalid(nDoS))
-        {
-            LogPrint("mempoolrej", "%s from peer=%d %s was not accepted into the memory pool: %s\n", tx.GetHash().ToString(),
-                pfrom->id, pfrom->cleanSubVer,
-                FormatStateMessage(state));
-            if (state.GetRejectCode() < REJECT_INTERNAL) // Never send AcceptToMemoryPool's internal codes over P2P
-                pfrom->PushMessage("reject", strCommand, (unsigned char)state.GetRejectCode(),
-                                   state.GetRejectReason().substr(0, MAX_REJECT_MESSAGE_LENGTH), txid);
-            if (nDoS > 0)
-                Misbehaving(pfrom->GetId(), nDoS);
+        CInv inv(MSG_WTX, txid, wtxid.authDigest);
+        bool fAlreadyHave = AlreadyHave(inv);
+        if (fAlreadyHave) {
+            // Reject a transaction that is known to be invalid as it was the
+            // first time, without checking its proofs and signatures again.
+            if (auto chRejectCode = txRejectCache->GetRejectCode(inv.GetWideHash(), MemPoolBranchId())) {
+                state.DoS(100, false, *chRejectCode, "known-invalid");
+            }
+        }
+        if (!fAlreadyHave && QueueTxAccept(pfrom, ptx)) {
+            // The transaction is checked by a ThreadTxAccept thread, which
+            // then calls ProcessTxFromPeer.
+            return true;
         }
+        bool fAccepted = !fAlreadyHave && AcceptToMemoryPool(chainparams, mempool, state, ptx, true, &fMissingInputs);
+        ProcessTxFromPeer(chainparams, pfrom, ptx, fAccepted, fMissingInputs, state);
     }
 
 
@@ -7638,26 +11651,92 @@ bool static ProcessMessage(const CChainParams& chainparams, CNode* pfrom, string
             ReadCompactSize(vRecv); // ignore tx count; assume it is 0.
         }
 
-        {
-        LOCK(cs_main);
-
         if (nCount == 0) {
             // Nothing interesting. Stop asking this peer for more headers.
             return true;
         }
 
-        // If we already know the last header in the message, then it contains
-        // no new information for us.  In this case, we do not request
-        // more headers later.  This prevents multiple chains of redundant
-        // getheader requests from running in parallel if triggered by incoming
-        // blocks while the node is still in initial headers sync.
-        //
-        // (Allow disabling optimization in case there are unexpected problems.)
+        // The headers that we do not know yet and whose solutions need to be
+        // checked.
+        std::vector<const CBlockHeader*> vNewHeaders;
         bool hasNewHeaders = true;
-        if (GetBoolArg("-optimize-getheaders", true) && IsInitialBlockDownload(chainparams.GetConsensus())) {
-            hasNewHeaders = (mapBlockIndex.count(headers.back().GetHash()) == 0);
+        {
+            LOCK(cs_main);
+            CNodeState *nodestate = State(pfrom->GetId());
+
+            // If this looks like it could be a block announcement (nCount <
+            // MAX_BLOCKS_TO_ANNOUNCE), use special logic for handling headers that
+            // don't connect:
+            // - Send a getheaders message in response to try to connect the chain.
+            // - The peer can send up to MAX_UNCONNECTING_HEADERS in a row that
+            //   don't connect before giving DoS points
+            // - Once a headers message is received that is valid and does connect,
+            //   nUnconnectingHeaders gets reset back to 0.
+            if (mapBlockIndex.find(headers[0].hashPrevBlock) == mapBlockIndex.end() && nCount < MAX_BLOCKS_TO_ANNOUNCE) {
+                nodestate->nUnconnectingHeaders++;
+                pfrom->PushMessage("getheaders", chainActive.GetLocator(pindexBestHeader), uint256());
+                LogPrint("net", "received header %s: missing prev block %s, sending getheaders (%d) to end (peer=%d, nUnconnectingHeaders=%d)\n",
+                        headers[0].GetHash().ToString(),
+                        headers[0].hashPrevBlock.ToString(),
+                        pindexBestHeader->nHeight,
+                        pfrom->id, nodestate->nUnconnectingHeaders);
+                // Set hashLastUnknownBlock for this peer, so that if we
+                // eventually get the headers - even from a different peer -
+                // we can use this peer to download.
+                UpdateBlockAvailability(pfrom->GetId(), headers.back().GetHash());
+
+                if (nodestate->nUnconnectingHeaders % MAX_UNCONNECTING_HEADERS == 0) {
+                    Misbehaving(pfrom->GetId(), 20);
+                }
+                return true;
+            }
+
+            // The heights are only known if the first header connects; if it
+            // does not, all of the solutions are checked.
+            BlockMap::iterator miPrev = mapBlockIndex.find(headers[0].hashPrevBlock);
+            int nHeight = miPrev == mapBlockIndex.end() ? -1 : miPrev->second->nHeight;
+            for (const CBlockHeader& header : headers) {
+                if (nHeight >= 0)
+                    nHeight++;
+                if (mapBlockIndex.count(header.GetHash()) == 0 &&
+                    (nHeight < 0 || ShouldCheckHeaderSolution(chainparams, nHeight)))
+                    vNewHeaders.push_back(&header);
+            }
+
+            // If we already know the last header in the message, then it contains
+            // no new information for us.  In this case, we do not request
+            // more headers later.  This prevents multiple chains of redundant
+            // getheader requests from running in parallel if triggered by incoming
+            // blocks while the node is still in initial headers sync.
+            //
+            // (Allow disabling optimization in case there are unexpected problems.)
+            if (GetBoolArg("-optimize-getheaders", true) && IsInitialBlockDownload(chainparams.GetConsensus())) {
+                hasNewHeaders = (mapBlockIndex.count(headers.back().GetHash()) == 0);
+            }
+
+            if (nCount == MAX_HEADERS_RESULTS && hasNewHeaders) {
+                // Headers message had its maximum size; the peer may have more headers.
+                // Ask for them before checking these, so that the next headers
+                // message is on its way while we do. The locator starts at the
+                // last header received, falling back to our best header in case
+                // the peer has since switched away from it.
+                LogPrint("net", "more getheaders (after %s) to send to peer=%d (startheight:%d)\n", headers.back().GetHash().ToString(), pfrom->id, pfrom->nStartingHeight);
+                CBlockLocator locator = chainActive.GetLocator(pindexBestHeader);
+                locator.vHave.insert(locator.vHave.begin(), headers.back().GetHash());
+                pfrom->PushMessage("getheaders", locator, uint256());
+            }
         }
 
+        // Equihash solutions are by far the most expensive part of checking
+        // headers, so check those of the new headers on the header check
+        // threads, without holding cs_main. If any is invalid, the headers
+        // are checked one at a time below to find it.
+        bool fSolutionsChecked = CheckEquihashSolutions(vNewHeaders, chainparams.GetConsensus());
+
+        {
+        LOCK(cs_main);
+        CNodeState *nodestate = State(pfrom->GetId());
+
         CBlockIndex *pindexLast = NULL;
         for (const CBlockHeader& header : headers) {
             CValidationState state;
@@ -7665,7 +11744,7 @@ bool static ProcessMessage(const CChainParams& chainparams, CNode* pfrom, string
                 Misbehaving(pfrom->GetId(), 20);
                 return error("non-continuous headers sequence");
             }
-            if (!AcceptBlockHeader(header, state, chainparams, &pindexLast)) {
+            if (!AcceptBlockHeader(header, state, chainparams, &pindexLast, fSolutionsChecked)) {
                 int nDoS;
                 if (state.IsInvalid(nDoS)) {
                     if (nDoS > 0)
@@ -7675,20 +11754,69 @@ bool static ProcessMessage(const CChainParams& chainparams, CNode* pfrom, string
             }
         }
 
-        if (pindexLast)
-            UpdateBlockAvailability(pfrom->GetId(), pindexLast->GetBlockHash());
+        if (nodestate->nUnconnectingHeaders > 0) {
+            LogPrint("net", "peer=%d: resetting nUnconnectingHeaders (%d -> 0)\n", pfrom->id, nodestate->nUnconnectingHeaders);
+        }
+        nodestate->nUnconnectingHeaders = 0;
+
+        assert(pindexLast);
+        UpdateBlockAvailability(pfrom->GetId(), pindexLast->GetBlockHash());
 
         // Temporary, until we're sure the optimization works
-        if (nCount == MAX_HEADERS_RESULTS && pindexLast && !hasNewHeaders) {
+        if (nCount == MAX_HEADERS_RESULTS && !hasNewHeaders) {
             LogPrint("net", "NO more getheaders (%d) to send to peer=%d (startheight:%d)\n", pindexLast->nHeight, pfrom->id, pfrom->nStartingHeight);
         }
 
-        if (nCount == MAX_HEADERS_RESULTS && pindexLast && hasNewHeaders) {
-            // Headers message had its maximum size; the peer may have more headers.
-            // TODO: optimize: if pindexLast is an ancestor of chainActive.Tip or pindexBestHeader, continue
-            // from there instead.
-            LogPrint("net", "more getheaders (%d) to send to peer=%d (startheight:%d)\n", pindexLast->nHeight, pfrom->id, pfrom->nStartingHeight);
-            pfrom->PushMessage("getheaders", chainActive.GetLocator(pindexLast), uint256());
+        bool fCanDirectFetch = CanDirectFetch(chainparams.GetConsensus());
+        // If this set of headers is valid and ends in a block with at least as
+        // much work as our tip, download as much as possible.
+        if (fCanDirectFetch && pindexLast->IsValid(BLOCK_VALID_TREE) && chainActive.Tip()->nChainWork <= pindexLast->nChainWork) {
+            vector<CBlockIndex *> vToFetch;
+            CBlockIndex *pindexWalk = pindexLast;
+            // Calculate all the blocks we'd need to switch to pindexLast, up to a limit.
+            while (pindexWalk && !chainActive.Contains(pindexWalk) && vToFetch.size() <= (size_t)nodestate->nBlocksInFlightLimit) {
+                if (!(pindexWalk->nStatus & BLOCK_HAVE_DATA) &&
+                        !mapBlocksInFlight.count(pindexWalk->GetBlockHash())) {
+                    // We don't have this block, and it's not yet in flight.
+                    vToFetch.push_back(pindexWalk);
+                }
+                pindexWalk = pindexWalk->pprev;
+            }
+            // If pindexWalk still isn't on our main chain, we're looking at a
+            // very large reorg at a time we think we're close to caught up to
+            // the main chain -- this shouldn't really happen.  Bail out on the
+            // direct fetch and rely on parallel download instead.
+            if (!chainActive.Contains(pindexWalk)) {
+                LogPrint("net", "Large reorg, won't direct fetch to %s (%d)\n",
+                        pindexLast->GetBlockHash().ToString(),
+                        pindexLast->nHeight);
+            } else {
+                vector<CInv> vGetData;
+                // Download as much as possible, from earliest to latest.
+                for (auto it = vToFetch.rbegin(); it != vToFetch.rend(); ++it) {
+                    CBlockIndex *pindex = *it;
+                    if (nodestate->nBlocksInFlight >= nodestate->nBlocksInFlightLimit) {
+                        // Can't download any more from this peer
+                        break;
+                    }
+                    vGetData.push_back(CInv(MSG_BLOCK, pindex->GetBlockHash()));
+                    MarkBlockAsInFlight(pfrom->GetId(), pindex->GetBlockHash(), chainparams.GetConsensus(), pindex);
+                    LogPrint("net", "Requesting block %s from  peer=%d\n",
+                            pindex->GetBlockHash().ToString(), pfrom->id);
+                }
+                if (vGetData.size() > 1) {
+                    LogPrint("net", "Downloading blocks toward %s (%d) via headers direct fetch\n",
+                            pindexLast->GetBlockHash().ToString(), pindexLast->nHeight);
+                }
+                if (vGetData.size() > 0) {
+                    if (nodestate->fProvidesHeaderAndIDs && vGetData.size() == 1 && mapBlocksInFlight.size() == 1 && pindexLast->pprev->IsValid(BLOCK_VALID_CHAIN)) {
+                        // A single new block on top of our tip: we probably
+                        // have most of its transactions already.
+                        vGetData[0] = CInv(MSG_CMPCT_BLOCK, vGetData[0].hash);
+                    }
+                    pfrom->PushMessage("getdata", vGetData);
+                }
+            }
         }
 
         CheckBlockIndex(chainparams.GetConsensus());
@@ -7697,8 +11825,202 @@ bool static ProcessMessage(const CChainParams& chainparams, CNode* pfrom, string
         NotifyHeaderTip(chainparams.GetConsensus());
     }
 
+
+    else if (strCommand == "getblocktxn")
+    {
+        BlockTransactionsRequest req;
+        vRecv >> req;
+
+        LOCK(cs_main);
+
+        BlockMap::iterator it = mapBlockIndex.find(req.blockhash);
+        if (it == mapBlockIndex.end() || !(it->second->nStatus & BLOCK_HAVE_DATA)) {
+            LogPrint("net", "Peer %d sent us a getblocktxn for a block we don't have\n", pfrom->id);
+            return true;
+        }
+
+        if (it->second->nHeight < chainActive.Height() - MAX_BLOCKTXN_DEPTH) {
+            // If an older block is requested (should never happen in practice,
+            // but can happen in tests) send a block response instead of a
+            // blocktxn response. Sending a full block response instead of a
+            // small blocktxn response is preferable in the case where a peer
+            // might maliciously send lots of getblocktxn requests to trigger
+            // expensive disk reads, because it will require the peer to
+            // actually receive all the data read from disk over the network.
+            LogPrint("net", "Peer %d sent us a getblocktxn for a block > %i deep\n", pfrom->id, MAX_BLOCKTXN_DEPTH);
+            CInv inv(MSG_BLOCK, req.blockhash);
+            pfrom->vRecvGetData.push_back(inv);
+            // ProcessMessages serves it on the next pass, without cs_main.
+            return true;
+        }
+
+        CBlock block;
+        if (!ReadBlockFromDisk(block, it->second, chainparams.GetConsensus()))
+            assert(!"cannot load block from disk");
+
+        BlockTransactions resp(req);
+        for (size_t i = 0; i < req.indexes.size(); i++) {
+            if (req.indexes[i] >= block.vtx.size()) {
+                Misbehaving(pfrom->GetId(), 100);
+                LogPrintf("Peer %d sent us a getblocktxn with out-of-bounds tx indices\n", pfrom->id);
+                return true;
+            }
+            resp.txn[i] = block.vtx[req.indexes[i]];
+        }
+        pfrom->PushMessage("blocktxn", resp);
+    }
+
+
+    else if (strCommand == "cmpctblock" && !fImporting && !fReindex) // Ignore blocks received while importing
+    {
+        CBlockHeaderAndShortTxIDs cmpctblock;
+        vRecv >> cmpctblock;
+
+        // Set when the whole block could be rebuilt from our mempool.
+        bool fBlockReconstructed = false;
+        CBlock block;
+
+        {
+        LOCK(cs_main);
+
+        if (mapBlockIndex.find(cmpctblock.header.hashPrevBlock) == mapBlockIndex.end()) {
+            // Doesn't connect (or is genesis), instead of DoSing in AcceptBlockHeader, request deeper headers
+            if (!IsInitialBlockDownload(chainparams.GetConsensus()))
+                pfrom->PushMessage("getheaders", chainActive.GetLocator(pindexBestHeader), uint256());
+            return true;
+        }
+
+        CBlockIndex *pindex = NULL;
+        CValidationState state;
+        if (!AcceptBlockHeader(cmpctblock.header, state, chainparams, &pindex)) {
+            int nDoS;
+            if (state.IsInvalid(nDoS)) {
+                if (nDoS > 0)
+                    Misbehaving(pfrom->GetId(), nDoS);
+                LogPrintf("Peer %d sent us invalid header via cmpctblock\n", pfrom->id);
+                return true;
+            }
+        }
+
+        // If AcceptBlockHeader returned true, it set pindex
+        assert(pindex);
+        UpdateBlockAvailability(pfrom->GetId(), pindex->GetBlockHash());
+
+        std::map<uint256, pair<NodeId, list<QueuedBlock>::iterator> >::iterator blockInFlightIt = mapBlocksInFlight.find(pindex->GetBlockHash());
+        bool fAlreadyInFlight = blockInFlightIt != mapBlocksInFlight.end();
+
+        if (pindex->nStatus & BLOCK_HAVE_DATA) // Nothing to do here
+            return true;
+
+        if (pindex->nChainWork <= chainActive.Tip()->nChainWork || // We know something better
+                pindex->nTx != 0) { // We had this block at some point, but pruned it
+            if (fAlreadyInFlight) {
+                // We requested this block for some reason, but our mempool will probably be useless
+                // so we just grab the block via normal getdata
+                std::vector<CInv> vInv(1);
+                vInv[0] = CInv(MSG_BLOCK, cmpctblock.header.GetHash());
+                pfrom->PushMessage("getdata", vInv);
+            }
+            return true;
+        }
+
+        // If we're not close to tip yet, give up and let parallel block fetch work its magic
+        if (!fAlreadyInFlight && !CanDirectFetch(chainparams.GetConsensus()))
+            return true;
+
+        CNodeState *nodestate = State(pfrom->GetId());
+
+        // We want to be a bit conservative just to be extra careful about DoS
+        // possibilities in compact block processing...
+        if (pindex->nHeight <= chainActive.Height() + 2) {
+            if ((!fAlreadyInFlight && nodestate->nBlocksInFlight < nodestate->nBlocksInFlightLimit) ||
+                 (fAlreadyInFlight && blockInFlightIt->second.first == pfrom->GetId())) {
+                list<QueuedBlock>::iterator *queuedBlockIt = NULL;
+                if (!MarkBlockAsInFlight(pfrom->GetId(), pindex->GetBlockHash(), chainparams.GetConsensus(), pindex, &queuedBlockIt)) {
+                    if (!(*queuedBlockIt)->partialBlock)
+                        (*queuedBlockIt)->partialBlock.reset(new PartiallyDownloadedBlock(&mempool));
+                    else {
+                        // The block was already in flight using compact blocks from the same peer
+                        LogPrint("net", "Peer sent us compact block we were already syncing!\n");
+                        return true;
+                    }
+                }
+
+                PartiallyDownloadedBlock& partialBlock = *(*queuedBlockIt)->partialBlock;
+                ReadStatus status = partialBlock.InitData(cmpctblock);
+                if (status == READ_STATUS_INVALID) {
+                    MarkBlockAsReceived(pindex->GetBlockHash()); // Reset in-flight state in case of whitelist
+                    Misbehaving(pfrom->GetId(), 100);
+                    LogPrintf("Peer %d sent us invalid compact block\n", pfrom->id);
+                    return true;
+                } else if (status == READ_STATUS_FAILED) {
+                    // Duplicate txindexes, the block is now in-flight, so just request it
+                    std::vector<CInv> vInv(1);
+                    vInv[0] = CInv(MSG_BLOCK, cmpctblock.header.GetHash());
+                    pfrom->PushMessage("getdata", vInv);
+                    return true;
+                }
+
+                if (!fAlreadyInFlight && mapBlocksInFlight.size() == 1 && pindex->pprev->IsValid(BLOCK_VALID_CHAIN)) {
+                    // We seem to be rather well-synced, so it appears pfrom was the first to provide us
+                    // with this block! Let's get them to announce using compact blocks in the future.
+                    MaybeSetPeerAsAnnouncingHeaderAndIDs(nodestate, pfrom);
+                }
+
+                BlockTransactionsRequest req;
+                for (size_t i = 0; i < cmpctblock.BlockTxCount(); i++) {
+                    if (!partialBlock.IsTxAvailable(i))
+                        req.indexes.push_back(i);
+                }
+                if (req.indexes.empty()) {
+                    BlockTransactions txn;
+                    txn.blockhash = cmpctblock.header.GetHash();
+                    fBlockReconstructed = ReconstructBlock(pfrom, txn, block, chainparams);
+                } else {
+                    req.blockhash = pindex->GetBlockHash();
+                    pfrom->PushMessage("getblocktxn", req);
+                }
+            }
+        } else {
+            if (fAlreadyInFlight) {
+                // We requested this block, but its far into the future, so our
+                // mempool will probably be useless - request the block normally
+                std::vector<CInv> vInv(1);
+                vInv[0] = CInv(MSG_BLOCK, cmpctblock.header.GetHash());
+                pfrom->PushMessage("getdata", vInv);
+                return true;
+            }
+        }
+
+        CheckBlockIndex(chainparams.GetConsensus());
+        } // cs_main
+
+        if (fBlockReconstructed)
+            ProcessReconstructedBlock(pfrom, strCommand, block, chainparams);
+        else
+            NotifyHeaderTip(chainparams.GetConsensus());
+    }
+
+
+    else if (strCommand == "blocktxn" && !fImporting && !fReindex) // Ignore blocks received while importing
+    {
+        BlockTransactions resp;
+        vRecv >> resp;
+
+        CBlock block;
+        bool fBlockReconstructed;
+        {
+            LOCK(cs_main);
+            fBlockReconstructed = ReconstructBlock(pfrom, resp, block, chainparams);
+        }
+
+        if (fBlockReconstructed)
+            ProcessReconstructedBlock(pfrom, strCommand, block, chainparams);
+    }
+
     else if (strCommand == "block" && !fImporting && !fReindex) // Ignore blocks received while importing
     {
+        RecordSyncBlockReceived(vRecv.size());
         CBlock block;
         vRecv >> block;
 
@@ -7916,6 +12238,23 @@ bool static ProcessMessage(const CChainParams& chainparams, CNode* pfrom, string
     }
 
 
+    else if (strCommand == "feefilter" && pfrom->nVersion >= FEEFILTER_VERSION)
+    {
+        CAmount newFeeFilter = 0;
+        int64_t newUnpaidActionFilter = 0;
+        vRecv >> newFeeFilter >> newUnpaidActionFilter;
+        if (MoneyRange(newFeeFilter) && newUnpaidActionFilter >= 0) {
+            {
+                LOCK(pfrom->cs_feeFilter);
+                pfrom->minFeeFilter = newFeeFilter;
+                pfrom->nUnpaidActionFilter = newUnpaidActionFilter;
+            }
+            LogPrint("net", "received: feefilter of %s and %d unpaid actions from peer=%d\n",
+                     CFeeRate(newFeeFilter).ToString(), newUnpaidActionFilter, pfrom->id);
+        }
+    }
+
+
     else if (strCommand == "reject")
     {
         if (fDebug) {
@@ -7945,7 +12284,8 @@ bool static ProcessMessage(const CChainParams& chainparams, CNode* pfrom, string
         // message would be undesirable as we transmit it ourselves.
     }
 
-    else if (!(strCommand == "tx" || strCommand == "block" || strCommand == "headers")) {
+    else if (!(strCommand == "tx" || strCommand == "block" || strCommand == "headers" ||
+               strCommand == "cmpctblock" || strCommand == "blocktxn")) {
         // Ignore unknown commands for extensibility
         LogPrint("net", "Unknown command \"%s\" from peer=%d\n", SanitizeString(strCommand), pfrom->id);
     }
@@ -7955,8 +12295,37 @@ bool static ProcessMessage(const CChainParams& chainparams, CNode* pfrom, string
     return true;
 }
 
+/**
+ * Charges the elapsed time, thread CPU time and lock wait time between its
+ * construction and destruction to a message command of a peer. The lock wait
+ * time includes waiting for cs_main, and is only measured with -lockstats.
+ */
+class CMessageProcessingTimer
+{
+    CNode* pnode;
+    std::string strCommand;
+    int64_t nStart;
+    int64_t nStartCPU;
+    int64_t nStartLockWait;
+
+public:
+    CMessageProcessingTimer(CNode* pnodeIn, std::string strCommandIn) :
+        pnode(pnodeIn), strCommand(std::move(strCommandIn)),
+        nStart(GetTimeMicros()), nStartCPU(GetThreadCPUTimeMicros()),
+        nStartLockWait(GetThreadLockWaitMicros()) {}
+
+    ~CMessageProcessingTimer()
+    {
+        pnode->RecordMsgProcessing(
+            strCommand,
+            GetTimeMicros() - nStart,
+            GetThreadCPUTimeMicros() - nStartCPU,
+            GetThreadLockWaitMicros() - nStartLockWait);
+    }
+};
+
 // requires LOCK(cs_vRecvMsg)
-bool ProcessMessages(const CChainParams& chainparams, CNode* pfrom)
+bool ProcessMessages(const CChainParams& chainparams, CNode* pfrom, int& nTxBudget)
 {
     //if (fDebug)
     //    LogPrintf("%s(%u messages)\n", __func__, pfrom->vRecvMsg.size());
@@ -7971,8 +12340,12 @@ bool ProcessMessages(const CChainParams& chainparams, CNode* pfrom)
     //
     bool fOk = true;
 
-    if (!pfrom->vRecvGetData.empty())
+    if (!pfrom->vRecvGetData.empty()) {
+        // Serving the objects a peer asked for is counted as time spent
+        // processing its getdata messages.
+        CMessageProcessingTimer timer(pfrom, "getdata");
         ProcessGetData(pfrom, chainparams.GetConsensus());
+    }
 
     if (!pfrom->orphan_work_set.empty()) {
         LOCK(cs_main);
@@ -7983,6 +12356,21 @@ bool ProcessMessages(const CChainParams& chainparams, CNode* pfrom)
     if (!pfrom->vRecvGetData.empty()) return fOk;
     if (!pfrom->orphan_work_set.empty()) return true;
 
+    // Once the handshake is done, a complete block or headers message is
+    // moved ahead of the transactions queued before it, so that tip
+    // propagation does not wait behind transaction relay.
+    if (pfrom->fSuccessfullyConnected) {
+        std::deque<CNetMessage>::iterator itBlock = std::find_if(pfrom->vRecvMsg.begin(), pfrom->vRecvMsg.end(),
+            [](const CNetMessage& msg) {
+                if (!msg.complete())
+                    return false;
+                std::string strCommand = msg.hdr.GetCommand();
+                return strCommand == "block" || strCommand == "headers";
+            });
+        if (itBlock != pfrom->vRecvMsg.end())
+            std::rotate(pfrom->vRecvMsg.begin(), itBlock, itBlock + 1);
+    }
+
     std::deque<CNetMessage>::iterator it = pfrom->vRecvMsg.begin();
     while (!pfrom->fDisconnect && it != pfrom->vRecvMsg.end()) {
         // Don't bother if send buffer is too full to respond anyway
@@ -8001,6 +12389,11 @@ bool ProcessMessages(const CChainParams& chainparams, CNode* pfrom)
         if (!msg.complete())
             break;
 
+        // Leave transactions for the next round once this round's budget is
+        // spent.
+        if (nTxBudget <= 0 && msg.hdr.GetCommand() == "tx")
+            break;
+
         // at this point, any failure means we can delete the current message
         it++;
 
@@ -8024,8 +12417,8 @@ bool ProcessMessages(const CChainParams& chainparams, CNode* pfrom)
         unsigned int nMessageSize = hdr.nMessageSize;
 
         // Checksum
-        CDataStream& vRecv = msg.vRecv;
-        uint256 hash = Hash(vRecv.begin(), vRecv.begin() + nMessageSize);
+        CPublicDataStream& vRecv = msg.vRecv;
+        const uint256& hash = msg.GetMessageHash();
         if (memcmp(hash.begin(), hdr.pchChecksum, CMessageHeader::CHECKSUM_SIZE) != 0)
         {
             LogPrintf("%s(%s, %u bytes): CHECKSUM ERROR expected %s was %s\n", __func__,
@@ -8037,6 +12430,7 @@ bool ProcessMessages(const CChainParams& chainparams, CNode* pfrom)
 
         // Process message
         bool fRet = false;
+        std::optional<CMessageProcessingTimer> timer(std::in_place, pfrom, SanitizeString(strCommand));
         try
         {
             fRet = ProcessMessage(chainparams, pfrom, strCommand, vRecv, msg.nTime);
@@ -8068,10 +12462,14 @@ bool ProcessMessages(const CChainParams& chainparams, CNode* pfrom)
         } catch (...) {
             PrintExceptionContinue(NULL, "ProcessMessages()");
         }
+        timer.reset();
 
         if (!fRet)
             LogPrintf("%s(%s, %u bytes) FAILED peer=%d\n", __func__, SanitizeString(strCommand), nMessageSize, pfrom->id);
 
+        if (strCommand == "tx")
+            nTxBudget--;
+
         break;
     }
 
@@ -8223,6 +12621,134 @@ bool SendMessages(const Consensus::Params& params, CNode* pto)
             GetMainSignals().Broadcast(nTimeBestReceived);
         }
 
+        //
+        // Try sending block announcements via headers
+        //
+        {
+            // If we have less than MAX_BLOCKS_TO_ANNOUNCE in our
+            // list of block hashes we're relaying, and our peer wants
+            // headers announcements, then find the first header
+            // not yet known to our peer but would connect, and send.
+            // If no header would connect, or if we have too many
+            // blocks, or if the peer doesn't want headers, just
+            // add all to the inv queue.
+            LOCK(pto->cs_inventory);
+            vector<CBlock> vHeaders;
+            bool fRevertToInv = ((!state.fPreferHeaders &&
+                                 (!state.fPreferHeaderAndIDs || pto->vBlockHashesToAnnounce.size() > 1)) ||
+                                pto->vBlockHashesToAnnounce.size() > MAX_BLOCKS_TO_ANNOUNCE);
+            CBlockIndex *pBestIndex = NULL; // last header queued for delivery
+            ProcessBlockAvailability(pto->id); // ensure pindexBestKnownBlock is up-to-date
+
+            if (!fRevertToInv) {
+                bool fFoundStartingHeader = false;
+                // Try to find first header that our peer doesn't have, and
+                // then send all headers past that one.  If we come across any
+                // headers that aren't on chainActive, give up.
+                for (const uint256 &hash : pto->vBlockHashesToAnnounce) {
+                    BlockMap::iterator mi = mapBlockIndex.find(hash);
+                    assert(mi != mapBlockIndex.end());
+                    CBlockIndex *pindex = mi->second;
+                    if (chainActive[pindex->nHeight] != pindex) {
+                        // Bail out if we reorged away from this block
+                        fRevertToInv = true;
+                        break;
+                    }
+                    if (pBestIndex != NULL && pindex->pprev != pBestIndex) {
+                        // This means that the list of blocks to announce don't
+                        // connect to each other.
+                        // This shouldn't really be possible to hit during
+                        // regular operation (because reorgs should take us to
+                        // a chain that has some block not on the prior chain,
+                        // which should be caught by the prior check), but one
+                        // way this could happen is by using invalidateblock /
+                        // reconsiderblock repeatedly on the tip, causing it to
+                        // be added multiple times to vBlockHashesToAnnounce.
+                        // Robustly deal with this rare situation by reverting
+                        // to an inv.
+                        fRevertToInv = true;
+                        break;
+                    }
+                    pBestIndex = pindex;
+                    if (fFoundStartingHeader) {
+                        // add this to the headers message
+                        vHeaders.push_back(pindex->GetBlockHeader());
+                    } else if (PeerHasHeader(&state, pindex)) {
+                        continue; // keep looking for the first new block
+                    } else if (pindex->pprev == NULL || PeerHasHeader(&state, pindex->pprev)) {
+                        // Peer doesn't have this header but they do have the prior one.
+                        // Start sending headers.
+                        fFoundStartingHeader = true;
+                        vHeaders.push_back(pindex->GetBlockHeader());
+                    } else {
+                        // Peer doesn't have this header or the prior one -- nothing will
+                        // connect, so bail out.
+                        fRevertToInv = true;
+                        break;
+                    }
+                }
+            }
+            if (!fRevertToInv && !vHeaders.empty()) {
+                if (vHeaders.size() == 1 && state.fPreferHeaderAndIDs) {
+                    // We only send up to 1 block as header-and-ids, as otherwise
+                    // probably means we're doing an initial-ish-sync or they're slow
+                    LogPrint("net", "%s sending header-and-ids %s to peer=%d\n", __func__,
+                            vHeaders.front().GetHash().ToString(), pto->id);
+                    if (hashMostRecentCompactBlock != pBestIndex->GetBlockHash()) {
+                        CBlock block;
+                        if (!ReadBlockFromDisk(block, pBestIndex, params))
+                            assert(!"cannot load block from disk");
+                        pMostRecentCompactBlock = std::make_shared<const CBlockHeaderAndShortTxIDs>(block);
+                        hashMostRecentCompactBlock = pBestIndex->GetBlockHash();
+                    }
+                    pto->PushMessage("cmpctblock", *pMostRecentCompactBlock);
+                    state.pindexBestHeaderSent = pBestIndex;
+                } else if (state.fPreferHeaders) {
+                    if (vHeaders.size() > 1) {
+                        LogPrint("net", "%s: %u headers, range (%s, %s), to peer=%d\n", __func__,
+                                vHeaders.size(),
+                                vHeaders.front().GetHash().ToString(),
+                                vHeaders.back().GetHash().ToString(), pto->id);
+                    } else {
+                        LogPrint("net", "%s: sending header %s to peer=%d\n", __func__,
+                                vHeaders.front().GetHash().ToString(), pto->id);
+                    }
+                    pto->PushMessage("headers", vHeaders);
+                    state.pindexBestHeaderSent = pBestIndex;
+                } else
+                    fRevertToInv = true;
+            }
+            if (fRevertToInv) {
+                // If falling back to using an inv, just try to inv the tip.
+                // The last entry in vBlockHashesToAnnounce was our tip at some point
+                // in the past.
+                if (!pto->vBlockHashesToAnnounce.empty()) {
+                    const uint256 &hashToAnnounce = pto->vBlockHashesToAnnounce.back();
+                    BlockMap::iterator mi = mapBlockIndex.find(hashToAnnounce);
+                    assert(mi != mapBlockIndex.end());
+                    CBlockIndex *pindex = mi->second;
+
+                    // Warn if we're announcing a block that is not on the main chain.
+                    // This should be very rare and could be optimized out.
+                    // Just log for now.
+                    if (chainActive[pindex->nHeight] != pindex) {
+                        LogPrint("net", "Announcing block %s not on main chain (tip=%s)\n",
+                            hashToAnnounce.ToString(), chainActive.Tip()->GetBlockHash().ToString());
+                    }
+
+                    // If the peer announced this block to us, don't inv it back.
+                    // (Since block announcements may not be via inv's, we can't solely rely on
+                    // setInventoryKnown to track this.)
+                    if (!PeerHasHeader(&state, pindex)) {
+                        pto->PushBlockInventory(hashToAnnounce);
+                        LogPrint("net", "%s: sending inv peer=%d hash=%s\n", __func__,
+                            pto->id, hashToAnnounce.ToString());
+                    }
+                }
+            }
+            pto->vBlockHashesToAnnounce.clear();
+        }
+
         //
         // Message: inventory
         //
@@ -8247,6 +12773,20 @@ bool SendMessages(const Consensus::Params& params, CNode* pto)
             }
             pto->vInventoryBlockToSend.clear();
 
+            // Give up on a reconciliation round the peer did not finish, and
+            // announce what it held by inv. Start the next one if it is our turn.
+            if (pto->txrecon) {
+                TxReconciliationState& recon = *pto->txrecon;
+                if (recon.fRoundInFlight && recon.nRoundStart < nNow - RECON_RESPONSE_TIMEOUT * 1000000LL) {
+                    std::vector<uint256> vAnnounce = recon.FinishRound(std::vector<uint32_t>(), true);
+                    pto->setInventoryTxToSend.insert(vAnnounce.begin(), vAnnounce.end());
+                }
+                if (recon.fInitiator && !recon.fRoundInFlight && recon.nNextRequest < nNow) {
+                    uint32_t nSetSize = recon.StartRound(nNow);
+                    pto->PushMessage("reqrecon", nSetSize);
+                }
+            }
+
             // Check whether periodic sends should happen
             bool fSendTrickle = pto->fWhitelisted;
             if (pto->nNextInvSend < nNow) {
@@ -8263,6 +12803,20 @@ bool SendMessages(const Consensus::Params& params, CNode* pto)
 
             int currentHeight = GetHeight();
 
+            // Skip transactions that the peer would not accept, given the
+            // feefilter it sent us.
+            CAmount filterrate;
+            int64_t nUnpaidActionFilter;
+            {
+                LOCK(pto->cs_feeFilter);
+                filterrate = pto->minFeeFilter;
+                nUnpaidActionFilter = pto->nUnpaidActionFilter;
+            }
+            auto isFilteredByFee = [&](const TxMempoolInfo& txinfo) {
+                return txinfo.nFee < CFeeRate(filterrate).GetFeeForRelay(txinfo.nTxSize) ||
+                       txinfo.nUnpaidActionCount > (uint64_t) nUnpaidActionFilter;
+            };
+
             // Respond to BIP35 mempool requests
             if (fSendTrickle && pto->fSendMempool) {
                 auto vtxinfo = mempool.infoAll();
@@ -8279,6 +12833,7 @@ bool SendMessages(const Consensus::Params& params, CNode* pto)
                     // that understand MSG_WTX.
                     if (inv.type == MSG_WTX) assert(pto->nVersion >= CINV_WTX_VERSION);
                     if (IsExpiringSoonTx(*txinfo.tx, currentHeight + 1)) continue;
+                    if (isFilteredByFee(txinfo)) continue;
                     if (pto->pfilter) {
                         if (!pto->pfilter->IsRelevantAndUpdate(*txinfo.tx)) continue;
                     }
@@ -8306,9 +12861,13 @@ bool SendMessages(const Consensus::Params& params, CNode* pto)
                 std::make_heap(vInvTx.begin(), vInvTx.end(), compareInvMempoolOrder);
                 // No reason to drain out at many times the network's capacity,
                 // especially since we have many peers and some will draw much shorter delays.
+                // When many transactions are queued, as during a flood, send more of them in
+                // each inv, so that the queue is drained rather than growing without bound.
                 unsigned int nRelayedTransactions = 0;
+                size_t nBroadcastMax = std::min<size_t>(INVENTORY_BROADCAST_MAX_QUEUED,
+                    INVENTORY_BROADCAST_MAX + (pto->setInventoryTxToSend.size() / 1000) * 5);
                 LOCK(pto->cs_filter);
-                while (!vInvTx.empty() && nRelayedTransactions < INVENTORY_BROADCAST_MAX) {
+                while (!vInvTx.empty() && nRelayedTransactions < nBroadcastMax) {
                     // Fetch the top element from the heap
                     std::pop_heap(vInvTx.begin(), vInvTx.end(), compareInvMempoolOrder);
                     std::set<uint256>::iterator it = vInvTx.back();
@@ -8331,23 +12890,12 @@ bool SendMessages(const Consensus::Params& params, CNode* pto)
                     // that understand MSG_WTX.
                     if (inv.type == MSG_WTX) assert(pto->nVersion >= CINV_WTX_VERSION);
                     if (IsExpiringSoonTx(*txinfo.tx, currentHeight + 1)) continue;
+                    if (isFilteredByFee(txinfo)) continue;
                     if (pto->pfilter && !pto->pfilter->IsRelevantAndUpdate(*txinfo.tx)) continue;
                     // Send
                     vInv.push_back(inv);
                     nRelayedTransactions++;
-                    {
-                        // Expire old relay messages
-                        while (!vRelayExpiration.empty() && vRelayExpiration.front().first < nNow)
-                        {
-                            mapRelay.erase(vRelayExpiration.front().second);
-                            vRelayExpiration.pop_front();
-                        }
-
-                        auto ret = mapRelay.insert(std::make_pair(hash, std::move(txinfo.tx)));
-                        if (ret.second) {
-                            vRelayExpiration.push_back(std::make_pair(nNow + 15 * 60 * 1000000, ret.first));
-                        }
-                    }
+                    pto->filterRecentlyAnnounced.insert(hash);
                     if (vInv.size() == MAX_INV_SZ) {
                         pto->PushMessage("inv", vInv);
                         vInv.clear();
@@ -8395,21 +12943,42 @@ bool SendMessages(const Consensus::Params& params, CNode* pto)
         // Message: getdata (blocks)
         //
         vector<CInv> vGetData;
-        if (!pto->fDisconnect && !pto->fClient && (fFetch || !IsInitialBlockDownload(params)) && state.nBlocksInFlight < MAX_BLOCKS_IN_TRANSIT_PER_PEER) {
+        if (!pto->fDisconnect && !pto->fClient && (fFetch || !IsInitialBlockDownload(params)) && state.nBlocksInFlight < state.nBlocksInFlightLimit) {
             vector<CBlockIndex*> vToDownload;
             NodeId staller = -1;
-            FindNextBlocksToDownload(pto->GetId(), MAX_BLOCKS_IN_TRANSIT_PER_PEER - state.nBlocksInFlight, vToDownload, staller);
+            CBlockIndex* pindexStalling = NULL;
+            FindNextBlocksToDownload(pto->GetId(), state.nBlocksInFlightLimit - state.nBlocksInFlight, vToDownload, staller, pindexStalling);
             for (CBlockIndex *pindex : vToDownload) {
-                vGetData.push_back(CInv(MSG_BLOCK, pindex->GetBlockHash()));
+                // Ask for a block that extends our tip as a cmpctblock, if
+                // the peer supports them, since we are likely to have most
+                // of its transactions already.
+                if (state.fProvidesHeaderAndIDs && pindex->pprev == chainActive.Tip() &&
+                    CanDirectFetch(params) && !IsInitialBlockDownload(params))
+                    vGetData.push_back(CInv(MSG_CMPCT_BLOCK, pindex->GetBlockHash()));
+                else
+                    vGetData.push_back(CInv(MSG_BLOCK, pindex->GetBlockHash()));
                 MarkBlockAsInFlight(pto->GetId(), pindex->GetBlockHash(), params, pindex);
                 LogPrint("net", "Requesting block %s (%d) peer=%d\n", pindex->GetBlockHash().ToString(),
                     pindex->nHeight, pto->id);
             }
             if (state.nBlocksInFlight == 0 && staller != -1) {
-                if (State(staller)->nStallingSince == 0) {
-                    State(staller)->nStallingSince = nNow;
+                CNodeState* stallerState = State(staller);
+                if (stallerState->nStallingSince == 0) {
+                    stallerState->nStallingSince = nNow;
+                    // The staller has more blocks in flight than it can deliver in time.
+                    SetBlocksInFlightLimit(stallerState, stallerState->nBlocksInFlightLimit / 2);
                     LogPrint("net", "Stall started peer=%d\n", staller);
                 }
+                // If the block holding up the window has been in flight for more than twice as long as the
+                // staller usually takes to deliver a block, ask this peer for it instead, rather than waiting
+                // for the staller to be disconnected. This peer has the block, as it is on its best chain.
+                const QueuedBlock& stalledBlock = *mapBlocksInFlight[pindexStalling->GetBlockHash()].second;
+                if (stallerState->nBlockLatencyAvg != 0 && nNow - stalledBlock.nTime > 2 * stallerState->nBlockLatencyAvg) {
+                    vGetData.push_back(CInv(MSG_BLOCK, pindexStalling->GetBlockHash()));
+                    MarkBlockAsInFlight(pto->GetId(), pindexStalling->GetBlockHash(), params, pindexStalling);
+                    LogPrint("net", "Reassigning stalled block %s (%d) from peer=%d to peer=%d\n", pindexStalling->GetBlockHash().ToString(),
+                        pindexStalling->nHeight, staller, pto->id);
+                }
             }
         }
 
@@ -8438,6 +13007,28 @@ bool SendMessages(const Consensus::Params& params, CNode* pto)
         if (!vGetData.empty())
             pto->PushMessage("getdata", vGetData);
 
+        //
+        // Message: feefilter
+        //
+        // Tell the peer not to announce transactions that we would reject
+        // anyway. Whitelisted peers may be relaying transactions on behalf of
+        // others, so we still want to hear about everything they have.
+        if (!pto->fDisconnect && pto->nVersion >= FEEFILTER_VERSION &&
+            GetBoolArg("-feefilter", DEFAULT_FEEFILTER) &&
+            !(pto->fWhitelisted && GetBoolArg("-whitelistforcerelay", DEFAULT_WHITELISTFORCERELAY)))
+        {
+            // We ignore transactions during initial block download, so ask
+            // not to be sent any.
+            CAmount currentFilter = IsInitialBlockDownload(params) ? MAX_MONEY : ::minRelayTxFee.GetFeePerK();
+            int64_t currentUnpaidActionFilter = nTxUnpaidActionLimit;
+            if (currentFilter != pto->lastSentFeeFilter ||
+                currentUnpaidActionFilter != pto->lastSentUnpaidActionFilter)
+            {
+                pto->PushMessage("feefilter", currentFilter, currentUnpaidActionFilter);
+                pto->lastSentFeeFilter = currentFilter;
+                pto->lastSentUnpaidActionFilter = currentUnpaidActionFilter;
+            }
+        }
     }
     return true;
 }
@@ -8460,8 +13051,10 @@ public:
         mapBlockIndex.clear();
 
         // orphan transactions
+        LOCK(g_cs_orphans);
         mapOrphanTransactions.clear();
         mapOrphanTransactionsByPrev.clear();
+        mapOrphanPeers.clear();
     }
 } instance_of_cmaincleanup;
 
@@ -18,6 +18,7 @@
 #include "consensus/upgrades.h"
 #include "fs.h"
 #include "net.h"
+#include "pow.h"
 #include "primitives/block.h"
 #include "primitives/transaction.h"
 #include "proof_verifier.h"
@@ -34,8 +35,11 @@
 #include "timestampindex.h"
 
 #include <algorithm>
+#include <atomic>
 #include <exception>
+#include <functional>
 #include <map>
+#include <memory>
 #include <optional>
 #include <set>
 #include <stdint.h>
@@ -50,10 +54,13 @@
 
 class CBlockIndex;
 class CBlockTreeDB;
+class CBlockUndo;
+class CInsightIndexDB;
 class CBloomFilter;
 class CChainParams;
 class CInv;
 class CScriptCheck;
+class CStoredBlock;
 class CValidationInterface;
 class CValidationState;
 class PrecomputedTransactionData;
@@ -64,6 +71,8 @@ struct CNodeStateStats;
 static const unsigned int MAX_REORG_LENGTH = COINBASE_MATURITY - 1;
 /** Default for DEFAULT_WHITELISTRELAY. */
 static const bool DEFAULT_WHITELISTRELAY = true;
+/** Default for -feefilter, whether to send feefilter messages to peers. */
+static const bool DEFAULT_FEEFILTER = true;
 /** Default for DEFAULT_WHITELISTFORCERELAY. */
 static const bool DEFAULT_WHITELISTFORCERELAY = true;
 /** Default for -minrelaytxfee, minimum relay fee rate for transactions in zatoshis per 1000 bytes. TODO(misnamed, this is a rate) */
@@ -78,6 +87,10 @@ static const CAmount HIGH_MAX_TX_FEE = 100 * HIGH_TX_FEE_PER_KB;
 static const unsigned int LOW_LOGICAL_ACTIONS = 10;
 /** Default for -maxorphantx, maximum number of orphan transactions kept in memory */
 static const unsigned int DEFAULT_MAX_ORPHAN_TRANSACTIONS = 100;
+/** Default for -maxorphanmemory, maximum megabytes of memory used by orphan transactions */
+static const int64_t DEFAULT_MAX_ORPHAN_MEMORY = 20;
+/** Default for -maxorphanpeermemory, maximum kilobytes of memory used by the orphan transactions of one peer */
+static const int64_t DEFAULT_MAX_ORPHAN_PEER_MEMORY = 5000;
 /** Expiration time for orphan transactions in seconds */
 static const int64_t ORPHAN_TX_EXPIRE_TIME = 20 * 60;
 /** Minimum time between orphan transactions expire time checks in seconds */
@@ -101,27 +114,65 @@ static const unsigned int MAX_BLOCKFILE_SIZE = 0x8000000; // 128 MiB
 static const unsigned int BLOCKFILE_CHUNK_SIZE = 0x1000000; // 16 MiB
 /** The pre-allocation chunk size for rev?????.dat files (since 0.8) */
 static const unsigned int UNDOFILE_CHUNK_SIZE = 0x100000; // 1 MiB
+/** The largest -blockprealloc, in MiB */
+static const int MAX_BLOCK_PREALLOC = MAX_BLOCKFILE_SIZE >> 20;
 
 /** Maximum number of script-checking threads allowed */
 static const int MAX_SCRIPTCHECK_THREADS = 16;
 /** -par default (number of script-checking threads, 0 = auto) */
 static const int DEFAULT_SCRIPTCHECK_THREADS = 0;
-/** Number of blocks that can be requested at any given time from a single peer. */
-static const int MAX_BLOCKS_IN_TRANSIT_PER_PEER = 16;
+/** Maximum number of threads checking transactions received from peers */
+static const int MAX_TX_ACCEPT_THREADS = 16;
+/** -txacceptthreads default (0 = check them on the message handler thread) */
+static const int DEFAULT_TX_ACCEPT_THREADS = 4;
+/** Maximum number of transactions from peers whose proofs are checked in one batch */
+static const size_t MAX_TX_ACCEPT_BATCH = 16;
+/**
+ * Minimum number of Sapling spends and outputs plus Orchard actions that
+ * ConnectBlock accumulates in a batch before handing it off to the
+ * proof-checking threads. Larger blocks are split into one sub-batch per
+ * verification thread.
+ */
+static const size_t MIN_SHIELDED_BATCH_SIZE = 64;
+/** Number of blocks that can be requested at any given time from a single peer, until it has delivered one. */
+static const int DEFAULT_BLOCKS_IN_TRANSIT_PER_PEER = 16;
+/** Bounds on the number of blocks that can be requested at any given time from a single peer. */
+static const int MIN_BLOCKS_IN_TRANSIT_PER_PEER = 2;
+static const int MAX_BLOCKS_IN_TRANSIT_PER_PEER = 128;
+/** Target time in milliseconds between requesting a block from a peer and receiving it. The number of blocks
+ *  in flight from each peer is adjusted to keep its average delivery time near this. */
+static const int64_t BLOCK_DOWNLOAD_TARGET_LATENCY = 1000;
 /** Timeout in seconds during which a peer must stall block download progress before being disconnected. */
 static const unsigned int BLOCK_STALLING_TIMEOUT = 2;
 /** Number of headers sent in one getheaders result. We rely on the assumption that if a peer sends
  *  less than this number, we reached its tip. Changing this value is a protocol upgrade. */
 static const unsigned int MAX_HEADERS_RESULTS = 160;
+/** Maximum depth of blocks we're willing to serve as compact blocks to peers
+ *  when requested. For older blocks, a regular BLOCK response will be sent. */
+static const int MAX_CMPCTBLOCK_DEPTH = 5;
+/** Maximum depth of blocks we're willing to respond to GETBLOCKTXN requests for. */
+static const int MAX_BLOCKTXN_DEPTH = 10;
+/** Maximum number of block filters sent in reply to one getcfilters message. */
+static const int MAX_GETCFILTERS_SIZE = 1000;
+/** Maximum number of block filter hashes sent in one cfheaders message. */
+static const int MAX_GETCFHEADERS_SIZE = 2000;
+/** Maximum number of headers to announce when relaying blocks with headers message.*/
+static const unsigned int MAX_BLOCKS_TO_ANNOUNCE = 8;
+/** Maximum number of unconnecting headers announcements before DoS score */
+static const int MAX_UNCONNECTING_HEADERS = 10;
 /** Size of the "block download window": how far ahead of our current height do we fetch?
  *  Larger windows tolerate larger download speed differences between peer, but increase the potential
  *  degree of disordering of blocks on disk (which make reindexing and in the future perhaps pruning
- *  harder). We'll probably want to make this a per-peer adaptive value at some point. */
+ *  harder). The window grows beyond this to twice the number of blocks that the peers we download
+ *  from may have in flight, up to MAX_BLOCK_DOWNLOAD_WINDOW. */
 static const unsigned int BLOCK_DOWNLOAD_WINDOW = 1024;
+static const unsigned int MAX_BLOCK_DOWNLOAD_WINDOW = 4096;
 /** Time to wait (in seconds) between writing blocks/block index to disk. */
 static const unsigned int DATABASE_WRITE_INTERVAL = 60 * 60;
 /** Time to wait (in seconds) between flushing chainstate to disk. */
 static const unsigned int DATABASE_FLUSH_INTERVAL = 24 * 60 * 60;
+/** Percentage of -dbcache that the coins cache is trimmed to after a flush forced by its size. */
+static const unsigned int COINS_CACHE_LOW_WATERMARK_PERCENT = 50;
 /** Time to wait (in seconds) between writing wallet witness data to disk. */
 static const unsigned int WITNESS_WRITE_INTERVAL = 10 * 60;
 /** Number of updates between writing wallet witness data to disk. */
@@ -138,6 +189,8 @@ static const unsigned int INVENTORY_BROADCAST_INTERVAL = 5;
 /** Maximum number of inventory items to send per transmission.
  *  Limits the impact of low-fee transaction floods. */
 static const unsigned int INVENTORY_BROADCAST_MAX = 7 * INVENTORY_BROADCAST_INTERVAL;
+/** Maximum number of inventory items to send per transmission while many are queued for a peer. */
+static const unsigned int INVENTORY_BROADCAST_MAX_QUEUED = 1000;
 
 static const int64_t DEFAULT_MAX_TIP_AGE = 24 * 60 * 60;
 
@@ -145,12 +198,27 @@ static const int64_t DEFAULT_MAX_TIP_AGE = 24 * 60 * 60;
 static const bool DEFAULT_PERMIT_BAREMULTISIG = true;
 static const bool DEFAULT_CHECKPOINTS_ENABLED = true;
 static const bool DEFAULT_IBD_SKIP_TX_VERIFICATION = false;
+/** Default for -fastheadersync */
+static const bool DEFAULT_FAST_HEADER_SYNC = false;
+/** Default for -checkblockreads */
+static const bool DEFAULT_CHECK_BLOCK_READS = false;
+/** Default for -ibdproofwindow, the number of blocks whose shielded proofs are batch-validated together during IBD */
+static const int DEFAULT_IBD_PROOF_WINDOW = 32;
+/** Maximum for -ibdproofwindow; the window's blocks are held in memory while they are checked */
+static const int MAX_IBD_PROOF_WINDOW = 256;
+/** The script verification flags that the transactions of a block are checked with */
+static const unsigned int BLOCK_SCRIPT_VERIFY_FLAGS = SCRIPT_VERIFY_P2SH | SCRIPT_VERIFY_CHECKLOCKTIMEVERIFY;
 static const bool DEFAULT_TXINDEX = false;
 static const unsigned int DEFAULT_BANSCORE_THRESHOLD = 100;
 
 /** Default for -nurejectoldversions */
 static const bool DEFAULT_NU_REJECT_OLD_VERSIONS = true;
 
+/** Default for -persistmempool */
+static const bool DEFAULT_PERSIST_MEMPOOL = true;
+/** Default for -persistsigcache */
+static const bool DEFAULT_PERSIST_SIGCACHE = true;
+
 #define equihash_parameters_acceptable(N, K) \
     ((CBlockHeader::HEADER_SIZE + equihash_solution_size(N, K))*MAX_HEADERS_RESULTS < \
      MAX_PROTOCOL_MESSAGE_LENGTH-1000)
@@ -169,6 +237,8 @@ extern CCriticalSection cs_main;
 extern CTxMemPool mempool;
 typedef boost::unordered_map<uint256, CBlockIndex*, BlockHasher> BlockMap;
 extern BlockMap mapBlockIndex;
+/** The blocks in mapBlockIndex that no other block builds on. */
+extern std::set<CBlockIndex*> setChainTips;
 extern std::optional<uint64_t> last_block_num_txs;
 extern std::optional<uint64_t> last_block_size;
 extern const std::string strMessageMagic;
@@ -187,6 +257,8 @@ extern uint256 g_best_block;
 
 extern std::atomic_bool fImporting;
 extern std::atomic_bool fReindex;
+/** Set once the mempool saved at the last shutdown has been loaded. */
+extern std::atomic_bool fMempoolLoaded;
 extern int nScriptCheckThreads;
 extern bool fTxIndex;
 
@@ -206,12 +278,24 @@ extern bool fTimestampIndex;
 
 extern bool fIsBareMultisigStd;
 extern bool fCheckBlockIndex;
+/** Whether blocks read from disk have their Equihash solutions checked even if their headers were checked on acceptance. */
+extern bool fCheckBlockReads;
 extern bool fCheckpointsEnabled;
 extern bool fIBDSkipTxVerification;
+/** The pre-allocation chunk sizes of blk?????.dat and rev?????.dat files, set by -blockprealloc. */
+extern unsigned int nBlockFileChunkSize;
+extern unsigned int nUndoFileChunkSize;
+/** Whether the Equihash solutions of headers up to the last checkpoint are left to be checked with their blocks. */
+extern bool fFastHeaderSync;
+extern int nIBDProofWindow;
+/** Block hash whose ancestors we will assume to have valid scripts and proofs without checking them. */
+extern uint256 hashAssumeValid;
 // TODO: remove this flag by structuring our code such that
 // it is unneeded for testing
 extern bool fCoinbaseEnforcedShieldingEnabled;
 extern size_t nCoinCacheUsage;
+/** Whether the heap allocator is asked to return free memory to the OS after the coins cache is flushed. */
+extern bool fPurgeAllocator;
 /** Transactions must have at least this fee rate (in zatoshis per 1000 bytes) for relaying, mining and transaction creation. */
 extern CFeeRate minRelayTxFee;
 /** Absolute maximum transaction fee (in zatoshis) used by wallet and mempool (rejects high fee in sendrawtransaction). */
@@ -283,14 +367,33 @@ FILE* OpenUndoFile(const CDiskBlockPos &pos, bool fReadOnly = false);
 fs::path GetBlockPosFilename(const CDiskBlockPos &pos, const char *prefix);
 /** Import blocks from an external file */
 bool LoadExternalBlockFile(const CChainParams& chainparams, FILE* fileIn, CDiskBlockPos *dbp = NULL);
+/**
+ * Find the blocks in a file of serialized blocks, each preceded by the network
+ * magic and its size, and pass each of them to fn along with its position in
+ * the file. Stops early if fn returns false. Takes over fileIn.
+ */
+void ScanExternalBlockFile(const CChainParams& chainparams, FILE* fileIn, const std::function<bool(CBlock&, unsigned int)>& fn);
+/**
+ * Import the blocks in our block files for a reindex. The files are read and
+ * the blocks in them checked on several threads, ahead of importing them in
+ * order.
+ */
+void ReindexBlockFiles(const CChainParams& chainparams);
+/** Compress the blocks in the block files that are no longer written to, in place (-compressblockfiles) */
+void CompressBlockFiles(const CChainParams& chainparams);
 /** Initialize a new block tree database + block data on disk */
 bool InitBlockIndex(const CChainParams& chainparams);
 /** Load the block tree and coins database from disk */
 bool LoadBlockIndex();
 /** Unload database information */
 void UnloadBlockIndex();
-/** Process protocol messages received from a given node */
-bool ProcessMessages(const CChainParams& chainparams, CNode* pfrom);
+/**
+ * Process protocol messages received from a given node. Blocks and headers are
+ * processed ahead of the node's other queued messages, and "tx" messages are
+ * left queued once nTxBudget, shared by the nodes of a message handler round,
+ * is spent.
+ */
+bool ProcessMessages(const CChainParams& chainparams, CNode* pfrom, int& nTxBudget);
 /**
  * Send queued protocol messages to be sent to a give node.
  *
@@ -300,6 +403,18 @@ bool ProcessMessages(const CChainParams& chainparams, CNode* pfrom);
 bool SendMessages(const Consensus::Params& params, CNode* pto);
 /** Run an instance of the script checking thread */
 void ThreadScriptCheck();
+/** Run an instance of the shielded proof checking thread */
+void ThreadProofCheck();
+/** Run an instance of the coins prefetching thread */
+void ThreadCoinsPrefetch();
+/** Run an instance of the header Equihash checking thread */
+void ThreadHeaderCheck();
+/** Run an instance of the transaction checking thread */
+void ThreadTxCheck();
+/** Start the threads that check transactions received from peers */
+void StartTxAcceptThreads(int nThreads);
+/** Stop them, dropping the transactions they have not checked */
+void StopTxAcceptThreads();
 /** Check whether we are doing an initial block download (synchronizing from disk or network) */
 bool IsInitialBlockDownload(const Consensus::Params& params);
 /** testing-only, set or reset initial block down (IBD) state, return previous */
@@ -308,8 +423,23 @@ bool TestSetIBD(bool);
 std::pair<std::string, int64_t> GetWarnings(const std::string& strFor);
 /** Retrieve a transaction (from memory pool, or from disk, if possible) */
 bool GetTransaction(const uint256& hash, CTransaction& tx, const Consensus::Params& params, uint256& hashBlock, bool fAllowSlow = false, const CBlockIndex* blockIndex = nullptr);
+/**
+ * Retrieve many transactions, from the memory pool or from disk. With
+ * -txlocationindex, each block holding some of them is read once, in the
+ * order of the block files, and cs_main is not held while reading. Entries
+ * of vResult are the transaction and the hash of its block (null for the
+ * memory pool), or empty if the transaction was not found.
+ */
+void GetTransactions(const std::vector<uint256>& hashes, std::vector<std::optional<std::pair<CTransaction, uint256>>>& vResult, const Consensus::Params& params);
 /** Find the best known block, and make it the tip of the block chain */
 bool ActivateBestChain(CValidationState& state, const CChainParams& chainparams, const CBlock* pblock = NULL);
+/**
+ * Replace the chain state, which must be at the genesis block, with a UTXO
+ * snapshot read from file just after its metadata, and make the snapshot's
+ * base block the tip. The snapshot must hash to hashSnapshot, which the
+ * caller has checked against the chain parameters.
+ */
+bool ActivateCoinsSnapshot(CAutoFile& file, const CCoinsSnapshotMetadata& metadata, const uint256& hashSnapshot, const CChainParams& chainparams);
 CAmount GetBlockSubsidy(int nHeight, const Consensus::Params& consensusParams);
 
 /**
@@ -334,22 +464,111 @@ void FindFilesToPrune(std::set<int>& setFilesToPrune, uint64_t nPruneAfterHeight
  */
 void UnlinkPrunedFiles(std::set<int>& setFilesToPrune);
 
+/**
+ *  Unlink the specified files on a background thread. They must no longer be
+ *  referred to by the block index that was written to disk.
+ */
+void QueueUnlinkPrunedFiles(const std::set<int>& setFilesToPrune);
+
+/** Unlink the files that are still queued, and stop the thread that does it. */
+void StopPruneUnlink();
+
+/**
+ *  Wait until the block and undo files that were left for new ones have been
+ *  committed to disk.
+ */
+void WaitForBlockFileSync();
+
+/** Commit the files that are still queued, and stop the thread that does it. */
+void StopBlockFileSync();
+
 /** Create a new block index entry for a given block hash */
 CBlockIndex * InsertBlockIndex(const uint256& hash);
 /** Get statistics from node state */
 bool GetNodeStateStats(NodeId nodeid, CNodeStateStats &stats);
+/**
+ * The number of blocks requested from peers and not received yet, the number
+ * that may be requested at once, and the number received ahead of the tip
+ * (within the download window) that are waiting to be connected. Requires
+ * cs_main.
+ */
+void GetBlockDownloadQueue(size_t& nInFlight, size_t& nInFlightLimit, size_t& nWaiting);
 /** Increase a node's misbehavior score. */
 void Misbehaving(NodeId nodeid, int howmuch);
 /** Flush all state, indexes and buffers to disk. */
 void FlushStateToDisk();
 /** Prune block files and flush state to disk. */
 void PruneAndFlush();
+/**
+ * Write a snapshot of the block index for the next startup to load, once the
+ * block index has been flushed at shutdown. Requires cs_main.
+ */
+void SaveBlockIndexSnapshot();
 
 /** (try to) add transaction to memory pool **/
 bool AcceptToMemoryPool(
         const CChainParams& chainparams,
         CTxMemPool& pool, CValidationState &state, const CTransaction &tx, bool fLimitFree,
         bool* pfMissingInputs, bool fRejectAbsurdFee=false);
+/** Like the above, but the mempool entry shares the given transaction. */
+bool AcceptToMemoryPool(
+        const CChainParams& chainparams,
+        CTxMemPool& pool, CValidationState &state, const CTransactionRef &ptx, bool fLimitFree,
+        bool* pfMissingInputs, bool fRejectAbsurdFee=false);
+
+/**
+ * Like AcceptToMemoryPool, but for several transactions, whose Sapling and
+ * Orchard bundles are checked together in one batch. A transaction may spend
+ * the outputs of others in vtx. Sets vStates, and *pvMissingInputs if it is
+ * given, for each transaction, and returns which of them were accepted.
+ */
+std::vector<bool> AcceptToMemoryPoolBatch(
+        const CChainParams& chainparams,
+        CTxMemPool& pool, std::vector<CValidationState>& vStates, const std::vector<CTransactionRef>& vtx, bool fLimitFree,
+        std::vector<bool>* pvMissingInputs, bool fRejectAbsurdFee=false);
+
+/**
+ * testing-only, check a transaction for the mempool in the stages and with the
+ * locks that the threads checking transactions from peers use, and call
+ * fnVerified after it is verified and before it is added.
+ */
+bool AcceptToMemoryPoolStaged(
+        const CChainParams& chainparams,
+        CTxMemPool& pool, CValidationState &state, const CTransactionRef &ptx,
+        const std::function<void()>& fnVerified);
+
+/**
+ * Add the transactions saved in mempool.dat back to the mempool, with the
+ * times at which they first entered it and their prioritisation.
+ */
+bool LoadMempool(const CChainParams& chainparams);
+
+/** Save the transactions in the mempool to mempool.dat. */
+bool DumpMempool();
+
+/**
+ * Add the entries of the signature and bundle validity caches saved in
+ * validitycache.dat back to the caches, with the nonces they were computed
+ * with. Must be called after the caches are set up, and before any signature
+ * or bundle is checked.
+ */
+bool LoadValidityCaches();
+
+/**
+ * Save the entries of the signature and bundle validity caches, with their
+ * nonces, to validitycache.dat. Must not be called while signatures or
+ * bundles are being checked.
+ */
+bool DumpValidityCaches();
+
+/** The number of orphan transactions, and the memory they use. */
+void GetOrphanTxStats(size_t& nCount, size_t& nUsage);
+
+/** The statistics of the filter of recently rejected transactions. */
+CCacheStats GetRecentRejectsStats() EXCLUSIVE_LOCKS_REQUIRED(cs_main);
+
+/** The statistics of the cache of transactions that are invalid whatever the chain tip. */
+CCacheStats GetTxRejectCacheStats() EXCLUSIVE_LOCKS_REQUIRED(cs_main);
 
 /** Convert CValidationState to a human-readable message for logging */
 std::string FormatStateMessage(const CValidationState &state);
@@ -359,6 +578,8 @@ struct CNodeStateStats {
     int nSyncHeight;
     int nCommonHeight;
     std::vector<int> vHeightInFlight;
+    int nBlocksInFlightLimit;
+    int64_t nBlockLatencyAvg;
 };
 
 
@@ -379,6 +600,11 @@ unsigned int GetLegacySigOpCount(const CTransaction& tx);
 unsigned int GetP2SHSigOpCount(const CTransaction& tx, const CCoinsViewCache& mapInputs);
 
 
+/** Initialize the cache of transactions whose scripts are valid. */
+void InitScriptExecutionCache(size_t nMaxCacheSize);
+
+CCacheStats GetScriptExecutionCacheStats();
+
 /**
  * Check whether all inputs of this transaction are valid (no double spends, scripts & sigs, amounts)
  * This does not modify the UTXO set. If pvChecks is not NULL, script checks are pushed onto it
@@ -532,19 +758,173 @@ public:
     ScriptError GetScriptError() const { return error; }
 };
 
+/**
+ * Shared outcome of the CShieldedBatchCheck closures queued for one block, so
+ * that the caller can report which pool's authorization failed.
+ */
+struct CShieldedBatchResult
+{
+    std::atomic<bool> fSaplingValid{true};
+    std::atomic<bool> fOrchardValid{true};
+};
+
+/**
+ * Closure representing the batch validation of the Sapling and Orchard
+ * authorizations queued for a contiguous range of a block's transactions.
+ * The batch validators are owned by the closure, so that they can be
+ * validated on a proof-checking thread while the caller continues filling
+ * new batches.
+ */
+class CShieldedBatchCheck
+{
+private:
+    std::optional<rust::Box<sapling::BatchValidator>> saplingAuth;
+    std::optional<rust::Box<orchard::BatchValidator>> orchardAuth;
+    CShieldedBatchResult *result;
+
+public:
+    CShieldedBatchCheck(): result(nullptr) {}
+    CShieldedBatchCheck(
+        std::optional<rust::Box<sapling::BatchValidator>> saplingAuthIn,
+        std::optional<rust::Box<orchard::BatchValidator>> orchardAuthIn,
+        CShieldedBatchResult* resultIn) :
+        saplingAuth(std::move(saplingAuthIn)), orchardAuth(std::move(orchardAuthIn)), result(resultIn) { }
+
+    bool operator()();
+
+    void swap(CShieldedBatchCheck &check) {
+        std::swap(saplingAuth, check.saplingAuth);
+        std::swap(orchardAuth, check.orchardAuth);
+        std::swap(result, check.result);
+    }
+};
+
+/**
+ * A transparent input's previous transaction whose coins are to be read from
+ * the coins database ahead of ConnectBlock.
+ */
+struct CCoinsPrefetchSlot
+{
+    uint256 txid;
+    CCoins coins;
+    bool fFound = false;
+};
+
+/**
+ * Closure representing one coins database read made by a prefetching thread.
+ * The result is written to the slot, which is owned by the caller and merged
+ * into the cache once all reads have completed.
+ */
+class CCoinsPrefetchCheck
+{
+private:
+    const CCoinsViewCache *view;
+    CCoinsPrefetchSlot *slot;
+
+public:
+    CCoinsPrefetchCheck(): view(nullptr), slot(nullptr) {}
+    CCoinsPrefetchCheck(const CCoinsViewCache* viewIn, CCoinsPrefetchSlot* slotIn) :
+        view(viewIn), slot(slotIn) { }
+
+    bool operator()() {
+        slot->fFound = view->GetCoinsFromBase(slot->txid, slot->coins);
+        return true;
+    }
+
+    void swap(CCoinsPrefetchCheck &check) {
+        std::swap(view, check.view);
+        std::swap(slot, check.slot);
+    }
+};
+
+/**
+ * Closure representing the check of the Equihash solution of a block header.
+ */
+class CEquihashCheck
+{
+private:
+    const CBlockHeader *pheader;
+    const Consensus::Params *params;
+
+public:
+    CEquihashCheck(): pheader(nullptr), params(nullptr) {}
+    CEquihashCheck(const CBlockHeader* pheaderIn, const Consensus::Params* paramsIn) :
+        pheader(pheaderIn), params(paramsIn) { }
+
+    bool operator()() {
+        return CheckEquihashSolutionCached(pheader, *params);
+    }
+
+    void swap(CEquihashCheck &check) {
+        std::swap(pheader, check.pheader);
+        std::swap(params, check.params);
+    }
+};
+
+/**
+ * Closure representing the context-free checks of a transaction that do not
+ * verify its proofs.
+ */
+class CTransactionCheck
+{
+private:
+    const CTransaction *ptx;
+
+public:
+    CTransactionCheck(): ptx(nullptr) {}
+    CTransactionCheck(const CTransaction* ptxIn) : ptx(ptxIn) { }
+
+    bool operator()();
+
+    void swap(CTransactionCheck &check) {
+        std::swap(ptx, check.ptx);
+    }
+};
+
 bool GetSpentIndex(CSpentIndexKey &key, CSpentIndexValue &value);
+/**
+ * Look up the spent index entries of several outputs at once, adding those
+ * of the spent outputs to values.
+ */
+bool GetSpentIndex(const std::vector<CSpentIndexKey> &keys, CSpentIndexMap &values);
 bool GetAddressIndex(const uint160& addressHash, int type,
         std::vector<CAddressIndexDbEntry> &addressIndex,
         int start = 0, int end = 0);
 bool GetAddressUnspent(const uint160& addressHash, int type,
         std::vector<CAddressUnspentDbEntry>& unspentOutputs);
+bool GetAddressIndexMerged(const std::vector<std::pair<uint160, int>>& addresses,
+        int start, int end, const CAddressIndexKey* pAfter, size_t nLimit,
+        std::vector<CAddressIndexDbEntry>& addressIndex, bool& fMore);
+bool GetAddressSummary(const uint160& addressHash, int type, CAddressSummary& summary);
+/**
+ * The blocks with logical timestamps in [low, high), in the order of their
+ * logical timestamps, after the entry pAfter if it is not null and at most
+ * nLimit of them if it is not 0. fMore is set if there are more. With
+ * fActiveOnly, these come from the block index rather than the database.
+ */
 bool GetTimestampIndex(unsigned int high, unsigned int low, bool fActiveOnly,
-    std::vector<std::pair<uint256, unsigned int> > &hashes);
+    const CTimestampIndexKey* pAfter, size_t nLimit,
+    std::vector<std::pair<uint256, unsigned int> > &hashes, bool& fMore)
+    EXCLUSIVE_LOCKS_REQUIRED(cs_main);
 
 /** Functions for disk access for blocks */
 bool WriteBlockToDisk(const CBlock& block, CDiskBlockPos& pos, const CMessageHeader::MessageStartChars& messageStart);
+bool WriteBlockToDisk(const CStoredBlock& stored, CDiskBlockPos& pos, const CMessageHeader::MessageStartChars& messageStart);
 bool ReadBlockFromDisk(CBlock& block, const CDiskBlockPos& pos, const Consensus::Params& consensusParams);
 bool ReadBlockFromDisk(CBlock& block, const CBlockIndex* pindex, const Consensus::Params& consensusParams);
+/**
+ * Read a block, sharing it with the cache of recently connected blocks
+ * rather than copying it when it is there.
+ */
+bool ReadBlockFromDisk(std::shared_ptr<const CBlock>& pblock, const CBlockIndex* pindex, const Consensus::Params& consensusParams);
+/**
+ * Read the serialized bytes of a block, as they would be sent in a "block"
+ * message, without deserializing or checking it.
+ */
+bool ReadRawBlockFromDisk(std::vector<uint8_t>& block, const CDiskBlockPos& pos, const CMessageHeader::MessageStartChars& messageStart);
+bool ReadRawBlockFromDisk(std::vector<uint8_t>& block, const CBlockIndex* pindex, const CMessageHeader::MessageStartChars& messageStart);
+/** Read the undo data written when a block was connected, checking it against the hash of its parent. */
+bool UndoReadFromDisk(CBlockUndo& blockundo, const CDiskBlockPos& pos, const uint256& hashBlock);
 
 /** Functions for validating blocks and updating the block tree */
 
@@ -552,7 +932,11 @@ bool ReadBlockFromDisk(CBlock& block, const CBlockIndex* pindex, const Consensus
 
 bool CheckBlockHeader(const CBlockHeader& block, CValidationState& state,
     const CChainParams& chainparams,
-    bool fCheckPOW = true);
+    bool fCheckPOW = true,
+    bool fCheckSolution = true);
+
+/** Whether the Equihash solution of a header at the given height is checked on its acceptance (see -fastheadersync). */
+bool ShouldCheckHeaderSolution(const CChainParams& chainparams, int nHeight);
 
 bool CheckBlock(const CBlock& block, CValidationState& state,
                 const CChainParams& chainparams,
@@ -590,10 +974,19 @@ enum class CheckAs {
 
 /** Apply the effects of this block (with given index) on the UTXO set represented by coins.
  *  Validity checks that depend on the UTXO set are also done; ConnectBlock()
- *  can fail if those validity checks fail (among other reasons). */
+ *  can fail if those validity checks fail (among other reasons).
+ *  If pblockundo is not NULL, the undo data of the block is stored in it. */
 bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pindex, CCoinsViewCache& coins,
                   const CChainParams& chainparams,
-                  bool fJustCheck = false, CheckAs blockChecks = CheckAs::Block);
+                  bool fJustCheck = false, CheckAs blockChecks = CheckAs::Block,
+                  CBlockUndo* pblockundo = NULL);
+
+/**
+ * While not NULL, ConnectBlock adds the time it spends in each of its stages
+ * to this map, in microseconds, including for blocks that it only checks.
+ * Used by the block replay benchmark.
+ */
+extern std::map<std::string, int64_t>* pConnectBlockStageTimes GUARDED_BY(cs_main);
 
 /**
  * Check a block is completely valid from start to finish (only works on top
@@ -647,6 +1040,15 @@ extern CCoinsViewCache *pcoinsTip;
 /** Global variable that points to the active block tree (protected by cs_main) */
 extern CBlockTreeDB *pblocktree;
 
+/** Global variable that points to the insight explorer indexes, if they are enabled */
+extern CInsightIndexDB *pinsightdb;
+
+/** Global variable that points to the coins database (protected by cs_main) */
+extern CCoinsViewDB *pcoinsdbview;
+
+/** Background writer beneath pcoinsTip, or NULL if -dbasyncflush is disabled (protected by cs_main) */
+extern CCoinsViewAsyncWriter *pcoinswriter;
+
 /**
  * Return the spend height, which is one more than the inputs.GetBestBlock().
  * While checking, GetBestBlock() refers to the parent block. (protected by cs_main)
@@ -677,7 +1079,7 @@ CMutableTransaction CreateNewContextualCMutableTransaction(
     int nHeight,
     bool requireV4);
 
-std::pair<std::list<CTransaction>, std::optional<uint64_t>> TakeRecentlyConflicted(const CBlockIndex* pindex);
+std::pair<std::list<CTransactionRef>, std::optional<uint64_t>> TakeRecentlyConflicted(const CBlockIndex* pindex);
 uint64_t GetChainConnectedSequence();
 void SetChainNotifiedSequence(const CChainParams& chainparams, uint64_t recentlyConflictedSequence);
 bool ChainIsFullyNotified(const CChainParams& chainparams);
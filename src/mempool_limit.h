@@ -6,10 +6,10 @@
 #define ZCASH_MEMPOOL_LIMIT_H
 
 #include <deque>
-#include <map>
 #include <optional>
-#include <set>
+#include <unordered_set>
 
+#include "coins.h"
 #include "logging.h"
 #include "random.h"
 #include "primitives/transaction.h"
@@ -38,7 +38,7 @@ class RecentlyEvictedList
     // Pairs of txid and time (seconds since epoch)
     std::deque<std::pair<uint256, int64_t>> txIdsAndTimes;
 
-    std::set<uint256> txIdSet;
+    std::unordered_set<uint256, SaltedTxidHasher> txIdSet;
 
     void pruneList();
 
@@ -70,7 +70,7 @@ std::pair<int64_t, int64_t> MempoolCostAndEvictionWeight(const CTransaction& tx,
 
 class MempoolLimitTxSet
 {
-    WeightedMap<uint256, int64_t, int64_t, GetRandInt64> txmap;
+    WeightedMap<uint256, int64_t, int64_t, GetRandInt64, SaltedTxidHasher> txmap;
     int64_t capacity;
     int64_t cost;
 
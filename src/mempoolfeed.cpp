@@ -0,0 +1,86 @@
+// Copyright (c) 2026 The Zcash developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or https://www.opensource.org/licenses/mit-license.php .
+
+#include "mempoolfeed.h"
+
+#include "main.h"
+
+#include <algorithm>
+
+CMempoolFeed* pmempoolfeed = NULL;
+
+CMempoolFeed::CMempoolFeed(size_t nMaxChangesIn) : nMaxChanges(std::max<size_t>(1, nMaxChangesIn))
+{
+}
+
+CMempoolFeed::~CMempoolFeed()
+{
+    Stop();
+}
+
+void CMempoolFeed::Start()
+{
+    // Take the sequence number and connect together, so that no change is
+    // missed.
+    LOCK(mempool.cs);
+    {
+        LOCK(cs_feed);
+        nSequence = nDroppedSequence = mempool.GetSequence();
+    }
+    connAdded = mempool.NotifyEntryAdded.connect([this](const CTransaction& tx, uint64_t nMempoolSequence) {
+        Push({nMempoolSequence, tx.GetHash(), true, MemPoolRemovalReason::UNKNOWN});
+    });
+    connRemoved = mempool.NotifyEntryRemoved.connect([this](const CTransaction& tx, MemPoolRemovalReason reason, uint64_t nMempoolSequence) {
+        Push({nMempoolSequence, tx.GetHash(), false, reason});
+    });
+}
+
+void CMempoolFeed::Stop()
+{
+    Interrupt();
+    connAdded.disconnect();
+    connRemoved.disconnect();
+}
+
+void CMempoolFeed::Interrupt()
+{
+    {
+        LOCK(cs_feed);
+        fInterrupted = true;
+    }
+    condChanged.notify_all();
+}
+
+void CMempoolFeed::Push(const CMempoolChange& change)
+{
+    {
+        LOCK(cs_feed);
+        if (changes.size() >= nMaxChanges) {
+            nDroppedSequence = changes.front().nSequence;
+            changes.pop_front();
+        }
+        changes.push_back(change);
+        nSequence = change.nSequence;
+    }
+    condChanged.notify_all();
+}
+
+bool CMempoolFeed::GetChanges(uint64_t nSince, std::chrono::steady_clock::time_point deadline,
+                              std::vector<CMempoolChange>& vChanges, uint64_t& nSequenceOut)
+{
+    WAIT_LOCK(cs_feed, lock);
+    condChanged.wait_until(lock, deadline, [&] {
+        return fInterrupted || nSequence != nSince;
+    });
+    // A client ahead of the mempool has seen the changes of an earlier run of
+    // the node.
+    if (nSince < nDroppedSequence || nSince > nSequence) {
+        return false;
+    }
+    // Each change increments the sequence number, so the first change after
+    // nSince is found by its distance from the end.
+    vChanges.assign(changes.end() - (nSequence - nSince), changes.end());
+    nSequenceOut = nSequence;
+    return true;
+}
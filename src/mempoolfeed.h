@@ -0,0 +1,91 @@
+// Copyright (c) 2026 The Zcash developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or https://www.opensource.org/licenses/mit-license.php .
+
+#ifndef ZCASH_MEMPOOLFEED_H
+#define ZCASH_MEMPOOLFEED_H
+
+#include "sync.h"
+#include "txmempool.h"
+#include "uint256.h"
+
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <stdint.h>
+#include <vector>
+
+#include <boost/signals2/connection.hpp>
+
+/** -mempoolfeedsize default */
+static const unsigned int DEFAULT_MEMPOOL_FEED_SIZE = 100000;
+/** Longest time getmempoolchanges waits for a change, in seconds */
+static const int64_t MAX_MEMPOOL_FEED_WAIT = 600;
+
+/** A transaction entering or leaving the mempool. */
+struct CMempoolChange
+{
+    //! The mempool sequence number after the change.
+    uint64_t nSequence;
+    uint256 txid;
+    bool fAdded;
+    //! Why the transaction left the mempool, if it did.
+    MemPoolRemovalReason reason;
+};
+
+/**
+ * Keeps the most recent transactions to enter and leave the mempool, numbered
+ * by the mempool sequence number as published by -zmqpubsequence, so that
+ * getmempoolchanges can give clients such as light wallet servers the changes
+ * since the last one they have seen. Clients start from the transaction ids
+ * and sequence number returned by getrawmempool, and then follow the changes,
+ * instead of polling the whole mempool.
+ *
+ * Only the last nMaxChanges changes are kept; a client that falls further
+ * behind has to start again from getrawmempool.
+ */
+class CMempoolFeed
+{
+private:
+    Mutex cs_feed;
+    std::condition_variable condChanged;
+    const size_t nMaxChanges;
+    std::deque<CMempoolChange> changes;
+    //! The sequence number after the last change that is no longer kept, or
+    //! before the first change seen. Changes after it are all kept.
+    uint64_t nDroppedSequence = 0;
+    //! The current mempool sequence number.
+    uint64_t nSequence = 0;
+    bool fInterrupted = false;
+
+    boost::signals2::connection connAdded;
+    boost::signals2::connection connRemoved;
+
+    void Push(const CMempoolChange& change);
+
+    CMempoolFeed(const CMempoolFeed&) = delete;
+    CMempoolFeed& operator=(const CMempoolFeed&) = delete;
+
+public:
+    CMempoolFeed(size_t nMaxChanges);
+    ~CMempoolFeed();
+
+    void Start();
+    void Stop();
+    //! Wake up the callers of GetChanges, for shutdown.
+    void Interrupt();
+
+    /**
+     * Fill vChanges with the changes after nSince, waiting until deadline for
+     * one if there are none yet, and set nSequenceOut to the sequence number
+     * the changes lead to. Returns false if some of the changes after nSince
+     * are no longer kept.
+     */
+    bool GetChanges(uint64_t nSince, std::chrono::steady_clock::time_point deadline,
+                    std::vector<CMempoolChange>& vChanges, uint64_t& nSequenceOut);
+};
+
+/** Used by getmempoolchanges, if set. */
+extern CMempoolFeed* pmempoolfeed;
+
+#endif // ZCASH_MEMPOOLFEED_H
@@ -9,8 +9,11 @@
 
 #include <map>
 #include <set>
+#include <unordered_map>
 #include <vector>
 
+#include "support/allocators/pool.h"
+
 #include <boost/unordered_set.hpp>
 #include <boost/unordered_map.hpp>
 
@@ -129,6 +132,33 @@ static inline size_t DynamicUsage(const std::shared_ptr<X>& p)
     return p ? MallocUsage(sizeof(X)) + MallocUsage(sizeof(stl_shared_counter)) : 0;
 }
 
+// Pool-allocated data structures
+
+/**
+ * The pool owns every chunk it has allocated until it is destroyed, so its
+ * usage is that of the chunks plus the list that tracks them, whatever the
+ * maps using it currently hold.
+ */
+template <std::size_t MAX_BLOCK_SIZE_BYTES, std::size_t ALIGN_BYTES>
+static inline size_t DynamicUsage(const PoolResource<MAX_BLOCK_SIZE_BYTES, ALIGN_BYTES>& resource)
+{
+    // The chunks are kept in a std::list, whose nodes hold next and previous
+    // pointers as well as the pointer to the chunk.
+    size_t estimated_list_node_size = MallocUsage(sizeof(void*) * 3);
+    return (estimated_list_node_size + MallocUsage(resource.ChunkSizeBytes())) * resource.NumAllocatedChunks();
+}
+
+/**
+ * Only the bucket array of a pool-allocated map is counted here; its nodes
+ * live in the pool, which may be shared by several maps and is accounted for
+ * once by the overload above.
+ */
+template <typename X, typename Y, typename Z, typename P, std::size_t MAX_BLOCK_SIZE_BYTES, std::size_t ALIGN_BYTES>
+static inline size_t DynamicUsage(const std::unordered_map<X, Y, Z, P, PoolAllocator<std::pair<const X, Y>, MAX_BLOCK_SIZE_BYTES, ALIGN_BYTES>>& m)
+{
+    return MallocUsage(sizeof(void*) * m.bucket_count());
+}
+
 // Boost data structures
 
 template<typename X>
@@ -8,6 +8,7 @@
 
 #include "hash.h"
 #include "consensus/consensus.h"
+#include "consensus/merkle.h"
 #include "util/strencodings.h"
 
 CMerkleBlock::CMerkleBlock(const CBlock& block, CBloomFilter& filter)
@@ -36,6 +37,43 @@ CMerkleBlock::CMerkleBlock(const CBlock& block, CBloomFilter& filter)
     txn = CPartialMerkleTree(vHashes, vMatch);
 }
 
+static std::vector<CBloomFilterableTx> PrepareTransactions(const CBlock& block)
+{
+    std::vector<CBloomFilterableTx> vtx;
+    vtx.reserve(block.vtx.size());
+    for (const CTransaction& tx : block.vtx)
+        vtx.emplace_back(tx);
+    return vtx;
+}
+
+CFilterableBlock::CFilterableBlock(CBlock blockIn) :
+    block(std::move(blockIn)), vtx(PrepareTransactions(block))
+{
+}
+
+CMerkleBlock::CMerkleBlock(const CFilterableBlock& block, CBloomFilter& filter)
+{
+    header = block.block.GetBlockHeader();
+
+    std::vector<bool> vMatch;
+    std::vector<uint256> vHashes;
+
+    vMatch.reserve(block.vtx.size());
+    vHashes.reserve(block.vtx.size());
+
+    for (unsigned int i = 0; i < block.vtx.size(); i++)
+    {
+        const uint256& hash = block.vtx[i].hash;
+        bool fMatch = filter.IsRelevantAndUpdate(block.vtx[i]);
+        vMatch.push_back(fMatch);
+        if (fMatch)
+            vMatchedTxn.push_back(std::make_pair(i, hash));
+        vHashes.push_back(hash);
+    }
+
+    txn = CPartialMerkleTree(vHashes, vMatch);
+}
+
 CMerkleBlock::CMerkleBlock(const CBlock& block, const std::set<uint256>& txids)
 {
     header = block.GetBlockHeader();
@@ -59,24 +97,7 @@ CMerkleBlock::CMerkleBlock(const CBlock& block, const std::set<uint256>& txids)
     txn = CPartialMerkleTree(vHashes, vMatch);
 }
 
-uint256 CPartialMerkleTree::CalcHash(int height, unsigned int pos, const std::vector<uint256> &vTxid) {
-    if (height == 0) {
-        // hash at height 0 is the txid itself
-        return vTxid[pos];
-    } else {
-        // calculate left hash
-        uint256 left = CalcHash(height-1, pos*2, vTxid), right;
-        // calculate right hash if not beyond the end of the array - copy left hash otherwise
-        if (pos*2+1 < CalcTreeWidth(height-1))
-            right = CalcHash(height-1, pos*2+1, vTxid);
-        else
-            right = left;
-        // combine subhashes
-        return Hash(BEGIN(left), END(left), BEGIN(right), END(right));
-    }
-}
-
-void CPartialMerkleTree::TraverseAndBuild(int height, unsigned int pos, const std::vector<uint256> &vTxid, const std::vector<bool> &vMatch) {
+void CPartialMerkleTree::TraverseAndBuild(int height, unsigned int pos, const std::vector<std::vector<uint256>> &vLevels, const std::vector<bool> &vMatch) {
     // determine whether this node is the parent of at least one matched txid
     bool fParentOfMatch = false;
     for (unsigned int p = pos << height; p < (pos+1) << height && p < nTransactions; p++)
@@ -85,12 +106,12 @@ void CPartialMerkleTree::TraverseAndBuild(int height, unsigned int pos, const st
     vBits.push_back(fParentOfMatch);
     if (height==0 || !fParentOfMatch) {
         // if at height 0, or nothing interesting below, store hash and stop
-        vHash.push_back(CalcHash(height, pos, vTxid));
+        vHash.push_back(vLevels[height][pos]);
     } else {
         // otherwise, don't store any hash, but descend into the subtrees
-        TraverseAndBuild(height-1, pos*2, vTxid, vMatch);
+        TraverseAndBuild(height-1, pos*2, vLevels, vMatch);
         if (pos*2+1 < CalcTreeWidth(height-1))
-            TraverseAndBuild(height-1, pos*2+1, vTxid, vMatch);
+            TraverseAndBuild(height-1, pos*2+1, vLevels, vMatch);
     }
 }
 
@@ -140,8 +161,9 @@ CPartialMerkleTree::CPartialMerkleTree(const std::vector<uint256> &vTxid, const
     while (CalcTreeWidth(nHeight) > 1)
         nHeight++;
 
-    // traverse the partial tree
-    TraverseAndBuild(nHeight, 0, vTxid, vMatch);
+    // traverse the partial tree, with the hashes of all its nodes computed
+    // level by level
+    TraverseAndBuild(nHeight, 0, ComputeMerkleLevels(vTxid), vMatch);
 }
 
 CPartialMerkleTree::CPartialMerkleTree() : nTransactions(0), fBad(true) {}
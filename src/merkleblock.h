@@ -68,11 +68,11 @@ protected:
         return (nTransactions+(1 << height)-1) >> height;
     }
 
-    /** calculate the hash of a node in the merkle tree (at leaf level: the txid itself) */
-    uint256 CalcHash(int height, unsigned int pos, const std::vector<uint256> &vTxid);
-
-    /** recursive function that traverses tree nodes, storing the data as bits and hashes */
-    void TraverseAndBuild(int height, unsigned int pos, const std::vector<uint256> &vTxid, const std::vector<bool> &vMatch);
+    /**
+     * recursive function that traverses tree nodes, storing the data as bits and hashes.
+     * vLevels holds the hashes of each level of the tree, as computed by ComputeMerkleLevels.
+     */
+    void TraverseAndBuild(int height, unsigned int pos, const std::vector<std::vector<uint256>> &vLevels, const std::vector<bool> &vMatch);
 
     /**
      * recursive function that traverses tree nodes, consuming the bits and hashes produced by TraverseAndBuild.
@@ -118,6 +118,20 @@ public:
 };
 
 
+/**
+ * A block prepared to be filtered for many peers: the transactions with their
+ * scripts already parsed, along with the block itself to send the matched
+ * transactions from.
+ */
+class CFilterableBlock
+{
+public:
+    const CBlock block;
+    const std::vector<CBloomFilterableTx> vtx;
+
+    explicit CFilterableBlock(CBlock blockIn);
+};
+
 /**
  * Used to relay blocks as header + vector<merkle branch>
  * to filtered nodes.
@@ -139,6 +153,8 @@ public:
      * thus the filter will likely be modified.
      */
     CMerkleBlock(const CBlock& block, CBloomFilter& filter);
+    //! The same as above, for a block prepared beforehand.
+    CMerkleBlock(const CFilterableBlock& block, CBloomFilter& filter);
 
     // Create from a CBlock, matching the txids in the set
     CMerkleBlock(const CBlock& block, const std::set<uint256>& txids);
@@ -98,6 +98,19 @@ std::atomic<size_t> nFullSizeToReindex(1);   // valid only during reindex
 
 static boost::synchronized_value<std::list<uint256>> trackedBlocks;
 
+// The node state shown by the metrics screen. It is updated when the chain
+// tip, the best header or the number of peers changes, so that drawing the
+// screen takes none of the node's locks.
+static std::atomic<int> nSnapshotHeight(-1);
+static std::atomic<int> nSnapshotHeadersHeight(-1);
+static std::atomic<int64_t> nSnapshotHeadersTime(0);
+static std::atomic<size_t> nSnapshotConnections(0);
+static std::atomic<bool> fSnapshotInitialDownload(true);
+static std::atomic<int64_t> nSnapshotNetSolPS(0);
+static std::atomic<int> nSnapshotOrphaned(0);
+static std::atomic<CAmount> nSnapshotImmature(0);
+static std::atomic<CAmount> nSnapshotMature(0);
+
 static boost::synchronized_value<std::list<std::string>> messageBox;
 static boost::synchronized_value<std::string> initMessage;
 static bool loaded = false;
@@ -160,6 +173,83 @@ int EstimateNetHeight(const Consensus::Params& params, int currentHeadersHeight,
     return ((netheight + 5) / 10) * 10;
 }
 
+void UpdateMetricsBestHeader(const CBlockIndex* pindex)
+{
+    nSnapshotHeadersHeight = pindex->nHeight;
+    nSnapshotHeadersTime = pindex->nTime;
+}
+
+// Recompute the state of the blocks mined by this node against the new tip.
+static void UpdateMinedBlocks()
+{
+    if (minedBlocks.get() == 0) {
+        return;
+    }
+
+    LOCK2(cs_main, cs_metrics);
+    boost::strict_lock_ptr<std::list<uint256>> u = trackedBlocks.synchronize();
+    const Consensus::Params& consensusParams = Params().GetConsensus();
+    auto tipHeight = chainActive.Height();
+    CAmount immature {0};
+    CAmount mature {0};
+
+    // Update orphans and calculate subsidies
+    std::list<uint256>::iterator it = u->begin();
+    while (it != u->end()) {
+        auto hash = *it;
+        if (mapBlockIndex.count(hash) > 0 &&
+                chainActive.Contains(mapBlockIndex[hash])) {
+            int height = mapBlockIndex[hash]->nHeight;
+            CAmount subsidy = consensusParams.GetBlockSubsidy(height);
+            if ((height > 0) && (height <= consensusParams.GetLastFoundersRewardBlockHeight(height))) {
+                subsidy -= subsidy/5;
+            }
+            if (std::max(0, COINBASE_MATURITY - (tipHeight - height)) > 0) {
+                immature += subsidy;
+            } else {
+                mature += subsidy;
+            }
+            it++;
+        } else {
+            it = u->erase(it);
+        }
+    }
+
+    nSnapshotOrphaned = minedBlocks.get() - u->size();
+    nSnapshotImmature = immature;
+    nSnapshotMature = mature;
+}
+
+static void metrics_NotifyBlockTip(bool fInitialDownload, const CBlockIndex* pindexNew)
+{
+    nSnapshotHeight = pindexNew->nHeight;
+    fSnapshotInitialDownload = fInitialDownload;
+    nSnapshotNetSolPS = GetNetworkHashPS(120, -1);
+    UpdateMinedBlocks();
+}
+
+static void metrics_NotifyNumConnectionsChanged(int newNumConnections)
+{
+    nSnapshotConnections = newNumConnections;
+}
+
+// Take the state shown by the metrics screen from the node once it has
+// loaded. From then on it is kept up to date by the notifications above.
+static void LoadSnapshot()
+{
+    {
+        LOCK(cs_main);
+        nSnapshotHeight = chainActive.Height();
+        if (pindexBestHeader) {
+            UpdateMetricsBestHeader(pindexBestHeader);
+        }
+        fSnapshotInitialDownload = IsInitialBlockDownload(Params().GetConsensus());
+    }
+    nSnapshotNetSolPS = GetNetworkHashPS(120, -1);
+    nSnapshotConnections = GetNodesSnapshot()->size();
+    UpdateMinedBlocks();
+}
+
 void TriggerRefresh()
 {
     *nNextRefresh = GetTime();
@@ -218,6 +308,8 @@ void ConnectMetricsScreen()
     uiInterface.ThreadSafeQuestion.connect(metrics_ThreadSafeQuestion);
     uiInterface.InitMessage.disconnect_all_slots();
     uiInterface.InitMessage.connect(metrics_InitMessage);
+    uiInterface.NotifyBlockTip.connect(metrics_NotifyBlockTip);
+    uiInterface.NotifyNumConnectionsChanged.connect(metrics_NotifyNumConnectionsChanged);
 }
 
 std::string DisplayDuration(int64_t duration, DurationFormat format)
@@ -308,30 +400,12 @@ struct MetricsStats {
 
 MetricsStats loadStats()
 {
-    int height;
-    int64_t currentHeadersHeight;
-    int64_t currentHeadersTime;
-    size_t connections;
-    int64_t netsolps;
-
-    {
-        LOCK(cs_main);
-        height = chainActive.Height();
-        currentHeadersHeight = pindexBestHeader ? pindexBestHeader->nHeight: -1;
-        currentHeadersTime = pindexBestHeader ? pindexBestHeader->nTime : 0;
-        netsolps = GetNetworkHashPS(120, -1);
-    }
-    {
-        LOCK(cs_vNodes);
-        connections = vNodes.size();
-    }
-
     return MetricsStats {
-        height,
-        currentHeadersHeight,
-        currentHeadersTime,
-        connections,
-        netsolps
+        nSnapshotHeight,
+        nSnapshotHeadersHeight,
+        nSnapshotHeadersTime,
+        nSnapshotConnections,
+        nSnapshotNetSolPS
     };
 }
 
@@ -343,7 +417,7 @@ int printStats(MetricsStats stats, bool isScreen, bool mining)
     const Consensus::Params& params = Params().GetConsensus();
     auto localsolps = GetLocalSolPS();
 
-    if (IsInitialBlockDownload(Params().GetConsensus())) {
+    if (fSnapshotInitialDownload) {
         if (fReindex) {
             int downloadPercent = nSizeReindexed * 100 / nFullSizeToReindex;
             std::cout << "      " << _("Reindexing blocks") << " | "
@@ -424,14 +498,9 @@ int printMiningStatus(bool mining)
             std::cout << strprintf(_("You are mining with the %s solver on %d threads."),
                                    GetArg("-equihashsolver", "default"), nThreads) << std::endl;
         } else {
-            bool fvNodesEmpty;
-            {
-                LOCK(cs_vNodes);
-                fvNodesEmpty = vNodes.empty();
-            }
-            if (fvNodesEmpty) {
+            if (nSnapshotConnections == 0) {
                 std::cout << _("Mining is paused while waiting for connections.") << std::endl;
-            } else if (IsInitialBlockDownload(Params().GetConsensus())) {
+            } else if (fSnapshotInitialDownload) {
                 std::cout << _("Mining is paused while downloading blocks.") << std::endl;
             } else {
                 std::cout << _("Mining is paused (a JoinSplit may be in progress).") << std::endl;
@@ -476,41 +545,10 @@ int printMetrics(size_t cols, bool mining)
         std::cout << "- " << strprintf(_("You have completed %d Equihash solver runs."), ehSolverRuns.get()) << std::endl;
         lines++;
 
-        int mined = 0;
-        int orphaned = 0;
-        CAmount immature {0};
-        CAmount mature {0};
-        {
-            LOCK2(cs_main, cs_metrics);
-            boost::strict_lock_ptr<std::list<uint256>> u = trackedBlocks.synchronize();
-            const Consensus::Params& consensusParams = Params().GetConsensus();
-            auto tipHeight = chainActive.Height();
-
-            // Update orphans and calculate subsidies
-            std::list<uint256>::iterator it = u->begin();
-            while (it != u->end()) {
-                auto hash = *it;
-                if (mapBlockIndex.count(hash) > 0 &&
-                        chainActive.Contains(mapBlockIndex[hash])) {
-                    int height = mapBlockIndex[hash]->nHeight;
-                    CAmount subsidy = consensusParams.GetBlockSubsidy(height);
-                    if ((height > 0) && (height <= consensusParams.GetLastFoundersRewardBlockHeight(height))) {
-                        subsidy -= subsidy/5;
-                    }
-                    if (std::max(0, COINBASE_MATURITY - (tipHeight - height)) > 0) {
-                        immature += subsidy;
-                    } else {
-                        mature += subsidy;
-                    }
-                    it++;
-                } else {
-                    it = u->erase(it);
-                }
-            }
-
-            mined = minedBlocks.get();
-            orphaned = mined - u->size();
-        }
+        int mined = minedBlocks.get();
+        int orphaned = nSnapshotOrphaned;
+        CAmount immature = nSnapshotImmature;
+        CAmount mature = nSnapshotMature;
 
         if (mined > 0) {
             std::string units = Params().CurrencyUnits();
@@ -571,6 +609,7 @@ int printInitMessage()
     std::cout << std::endl;
 
     if (msg == _("Done loading")) {
+        LoadSnapshot();
         loaded = true;
     }
 
@@ -648,7 +687,7 @@ void ThreadShowMetricsScreen()
 #endif
         }
 
-        // Lock and fetch stats before erasing the screen, in case we block.
+        // Fetch stats before erasing the screen.
         std::optional<MetricsStats> metricsStats;
         if (loaded) {
             metricsStats = loadStats();
@@ -73,7 +73,11 @@ extern AtomicTimer miningTimer;
 extern std::atomic<size_t> nSizeReindexed; // valid only during reindex
 extern std::atomic<size_t> nFullSizeToReindex; // valid only during reindex
 
+class CBlockIndex;
+
 void TrackMinedBlock(uint256 hash);
+//! Record a new best header for the metrics screen. Called with cs_main held.
+void UpdateMetricsBestHeader(const CBlockIndex* pindex);
 
 void MarkStartTime();
 double GetLocalSolPS();
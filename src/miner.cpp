@@ -46,6 +46,8 @@
 #ifdef ENABLE_MINING
 #include <functional>
 #endif
+#include <algorithm>
+#include <list>
 #include <mutex>
 #include <queue>
 
@@ -284,7 +286,7 @@ public:
     }
 };
 
-CMutableTransaction CreateCoinbaseTransaction(const CChainParams& chainparams, CAmount nFees, const MinerAddress& minerAddress, int nHeight)
+static CMutableTransaction BuildCoinbaseTransaction(const CChainParams& chainparams, CAmount nFees, const MinerAddress& minerAddress, int nHeight)
 {
         CMutableTransaction mtx = CreateNewContextualCMutableTransaction(
                 chainparams.GetConsensus(), nHeight,
@@ -309,6 +311,76 @@ CMutableTransaction CreateCoinbaseTransaction(const CChainParams& chainparams, C
         return mtx;
 }
 
+//! The number of coinbase transactions that CreateCoinbaseTransaction keeps.
+static const size_t COINBASE_CACHE_SIZE = 8;
+
+/**
+ * A coinbase transaction built lately. Building one with shielded outputs
+ * means creating proofs, so the templates at one height with the same fees,
+ * such as those of repeated getblocktemplate calls, share it.
+ */
+struct CachedCoinbase
+{
+    int nHeight;
+    uint32_t consensusBranchId;
+    int32_t nTxVersionPreference;
+    CAmount nFees;
+    MinerAddress minerAddress;
+    CMutableTransaction mtx;
+};
+
+static Mutex cs_coinbaseCache;
+//! Most recently used first.
+static std::list<CachedCoinbase> coinbaseCache;
+
+/** Whether two miner addresses are paid with the same outputs. */
+static bool IsSameMinerAddress(const MinerAddress& a, const MinerAddress& b)
+{
+    if (a.index() != b.index()) {
+        return false;
+    }
+    return examine(a, match {
+        [&](const libzcash::OrchardRawAddress& addr) {
+            return addr == std::get<libzcash::OrchardRawAddress>(b);
+        },
+        [&](const libzcash::SaplingPaymentAddress& addr) {
+            return addr == std::get<libzcash::SaplingPaymentAddress>(b);
+        },
+        [&](const boost::shared_ptr<CReserveScript>& script) {
+            const boost::shared_ptr<CReserveScript>& other = std::get<boost::shared_ptr<CReserveScript>>(b);
+            return script && other && script->reserveScript == other->reserveScript;
+        },
+    });
+}
+
+CMutableTransaction CreateCoinbaseTransaction(const CChainParams& chainparams, CAmount nFees, const MinerAddress& minerAddress, int nHeight)
+{
+    // The network upgrade and the preferred version decide the format.
+    uint32_t consensusBranchId = CurrentEpochBranchId(nHeight, chainparams.GetConsensus());
+    {
+        LOCK(cs_coinbaseCache);
+        for (auto it = coinbaseCache.begin(); it != coinbaseCache.end(); ++it) {
+            if (it->nHeight == nHeight && it->consensusBranchId == consensusBranchId &&
+                it->nTxVersionPreference == nPreferredTxVersion && it->nFees == nFees &&
+                IsSameMinerAddress(it->minerAddress, minerAddress)) {
+                coinbaseCache.splice(coinbaseCache.begin(), coinbaseCache, it);
+                return coinbaseCache.front().mtx;
+            }
+        }
+    }
+
+    // Built without the lock, so that other callers do not wait for the
+    // proofs.
+    CMutableTransaction mtx = BuildCoinbaseTransaction(chainparams, nFees, minerAddress, nHeight);
+
+    LOCK(cs_coinbaseCache);
+    coinbaseCache.push_front(CachedCoinbase{nHeight, consensusBranchId, nPreferredTxVersion, nFees, minerAddress, mtx});
+    if (coinbaseCache.size() > COINBASE_CACHE_SIZE) {
+        coinbaseCache.pop_back();
+    }
+    return mtx;
+}
+
 BlockAssembler::BlockAssembler(const CChainParams& _chainparams)
     : chainparams(_chainparams)
 {
@@ -369,7 +441,7 @@ CBlockTemplate* BlockAssembler::CreateNewBlock(
     blockFinished = blockFinished || next_cb_mtx;
 
     LOCK2(cs_main, mempool.cs);
-    CBlockIndex* pindexPrev = chainActive.Tip();
+    pindexPrev = chainActive.Tip();
     nHeight = pindexPrev->nHeight + 1;
     uint32_t consensusBranchId = CurrentEpochBranchId(nHeight, chainparams.GetConsensus());
 
@@ -384,10 +456,6 @@ CBlockTemplate* BlockAssembler::CreateNewBlock(
     UpdateTime(pblock, chainparams.GetConsensus(), pindexPrev);
 
     const int64_t nMedianTimePast = pindexPrev->GetMedianTimePast();
-    CCoinsViewCache view(pcoinsTip);
-
-    SaplingMerkleTree sapling_tree;
-    assert(view.GetSaplingAnchorAt(view.GetBestAnchor(SAPLING), sapling_tree));
 
     nLockTimeCutoff = (STANDARD_LOCKTIME_VERIFY_FLAGS & LOCKTIME_MEDIAN_TIME_PAST)
                        ? nMedianTimePast
@@ -417,8 +485,46 @@ CBlockTemplate* BlockAssembler::CreateNewBlock(
         }
     }
 
-    constructZIP317BlockTemplate();
+    // An empty block needs no look at the mempool.
+    if (!blockFinished) {
+        constructZIP317BlockTemplate();
+    }
+
+    FinishBlock(minerAddress, next_cb_mtx);
+
+    return pblocktemplate.release();
+}
+
+CBlockTemplate* BlockAssembler::UpdateNewBlock(
+    const CBlockTemplate& prev,
+    const MinerAddress& minerAddress,
+    const std::vector<CTxMemPool::txiter>& vNew)
+{
+    LOCK2(cs_main, mempool.cs);
+    assert(pindexPrev == chainActive.Tip());
+
+    pblocktemplate.reset(new CBlockTemplate(prev));
+    pblock = &pblocktemplate->block;
+
+    for (CTxMemPool::txiter iter : vNew) {
+        // Only add the transactions that CreateNewBlock would certainly have
+        // added: those that pay the conventional fee and whose parents are
+        // in the block, while it has room for them.
+        if (blockFinished || iter->GetUnpaidActionCount() > 0 || isStillDependent(iter) || !TestForBlock(iter)) {
+            return NULL;
+        }
+        AddToBlock(iter);
+    }
+
+    FinishBlock(minerAddress, std::nullopt);
+
+    return pblocktemplate.release();
+}
 
+void BlockAssembler::FinishBlock(
+    const MinerAddress& minerAddress,
+    const std::optional<CMutableTransaction>& next_cb_mtx)
+{
     last_block_num_txs = nBlockTx;
     last_block_size = nBlockSize;
     LogPrintf("%s: total size %u (excluding coinbase) txs: %u fees: %ld sigops %d", __func__, nBlockSize, nBlockTx, nFees, nBlockSigOps);
@@ -432,6 +538,9 @@ CBlockTemplate* BlockAssembler::CreateNewBlock(
     pblocktemplate->vTxFees[0] = -nFees;
 
     // Update the Sapling commitment tree.
+    CCoinsViewCache view(pcoinsTip);
+    SaplingMerkleTree sapling_tree;
+    assert(view.GetSaplingAnchorAt(view.GetBestAnchor(SAPLING), sapling_tree));
     for (const CTransaction& tx : pblock->vtx) {
         for (const auto& odesc : tx.GetSaplingOutputs()) {
             sapling_tree.append(uint256::FromRawBytes(odesc.cmu()));
@@ -494,8 +603,6 @@ CBlockTemplate* BlockAssembler::CreateNewBlock(
     if (!TestBlockValidity(state, chainparams, *pblock, pindexPrev, true)) {
         throw std::runtime_error(strprintf("%s: TestBlockValidity failed: %s", __func__, FormatStateMessage(state)));
     }
-
-    return pblocktemplate.release();
 }
 
 bool BlockAssembler::isStillDependent(CTxMemPool::txiter iter)
@@ -513,7 +620,13 @@ bool BlockAssembler::isStillDependent(CTxMemPool::txiter iter)
 
 bool BlockAssembler::TestForBlock(CTxMemPool::txiter iter)
 {
-    if (nBlockSize + iter->GetTxSize() >= nBlockMaxSize) {
+    return TestPackage(iter, iter->GetTxSize(), iter->GetSigOpCount()) &&
+        TestPackageTransactions({iter});
+}
+
+bool BlockAssembler::TestPackage(CTxMemPool::txiter iter, uint64_t packageSize, unsigned int packageSigOps)
+{
+    if (nBlockSize + packageSize >= nBlockMaxSize) {
         // If the block is so close to full that no more txs will fit
         // or if we've tried more than 50 times to fill remaining space
         // then flag that the block is finished
@@ -533,7 +646,7 @@ bool BlockAssembler::TestForBlock(CTxMemPool::txiter iter)
         return false;
     }
 
-    if (nBlockSigOps + iter->GetSigOpCount() >= MAX_BLOCK_SIGOPS) {
+    if (nBlockSigOps + packageSigOps >= MAX_BLOCK_SIGOPS) {
         // If the block has room for no more sig ops then
         // flag that the block is finished
         if (nBlockSigOps > MAX_BLOCK_SIGOPS - 2) {
@@ -549,55 +662,62 @@ bool BlockAssembler::TestForBlock(CTxMemPool::txiter iter)
         return false;
     }
 
-    // Must check that lock times are still valid
-    // This can be removed once MTP is always enforced
-    // as long as reorgs keep the mempool consistent.
-    if (!IsFinalTx(iter->GetTx(), nHeight, nLockTimeCutoff))
-        return false;
+    return true;
+}
 
-    // Must check that expiry heights are still valid.
-    if (IsExpiredTx(iter->GetTx(), nHeight))
-        return false;
+bool BlockAssembler::TestPackageTransactions(const std::vector<CTxMemPool::txiter>& package)
+{
+    CAmount sproutValueDummy = sproutValue;
+    CAmount saplingValueDummy = saplingValue;
+    CAmount orchardValueDummy = orchardValue;
+
+    for (CTxMemPool::txiter iter : package) {
+        // Must check that lock times are still valid
+        // This can be removed once MTP is always enforced
+        // as long as reorgs keep the mempool consistent.
+        if (!IsFinalTx(iter->GetTx(), nHeight, nLockTimeCutoff))
+            return false;
 
-    if (chainparams.ZIP209Enabled() && monitoring_pool_balances) {
-        // Does this transaction lead to a turnstile violation?
+        // Must check that expiry heights are still valid.
+        if (IsExpiredTx(iter->GetTx(), nHeight))
+            return false;
 
-        CAmount sproutValueDummy = sproutValue;
-        CAmount saplingValueDummy = saplingValue;
-        CAmount orchardValueDummy = orchardValue;
+        if (chainparams.ZIP209Enabled() && monitoring_pool_balances) {
+            // Does this transaction lead to a turnstile violation?
 
-        saplingValueDummy += -iter->GetTx().GetValueBalanceSapling();
-        orchardValueDummy += -iter->GetTx().GetOrchardBundle().GetValueBalance();
+            saplingValueDummy += -iter->GetTx().GetValueBalanceSapling();
+            orchardValueDummy += -iter->GetTx().GetOrchardBundle().GetValueBalance();
 
-        for (auto js : iter->GetTx().vJoinSplit) {
-            sproutValueDummy += js.vpub_old;
-            sproutValueDummy -= js.vpub_new;
-        }
+            for (auto js : iter->GetTx().vJoinSplit) {
+                sproutValueDummy += js.vpub_old;
+                sproutValueDummy -= js.vpub_new;
+            }
 
-        if (sproutValueDummy < 0) {
-            LogPrintf("CreateNewBlock: tx %s appears to violate Sprout turnstile\n",
-                      iter->GetTx().GetHash().GetHex());
-            return false;
-        }
-        if (saplingValueDummy < 0) {
-            LogPrintf("CreateNewBlock: tx %s appears to violate Sapling turnstile\n",
-                      iter->GetTx().GetHash().GetHex());
-            return false;
-        }
-        if (orchardValueDummy < 0) {
-            LogPrintf("CreateNewBlock: tx %s appears to violate Orchard turnstile\n",
-                      iter->GetTx().GetHash().GetHex());
-            return false;
+            if (sproutValueDummy < 0) {
+                LogPrintf("CreateNewBlock: tx %s appears to violate Sprout turnstile\n",
+                          iter->GetTx().GetHash().GetHex());
+                return false;
+            }
+            if (saplingValueDummy < 0) {
+                LogPrintf("CreateNewBlock: tx %s appears to violate Sapling turnstile\n",
+                          iter->GetTx().GetHash().GetHex());
+                return false;
+            }
+            if (orchardValueDummy < 0) {
+                LogPrintf("CreateNewBlock: tx %s appears to violate Orchard turnstile\n",
+                          iter->GetTx().GetHash().GetHex());
+                return false;
+            }
         }
-
-        // We update this here instead of in AddToBlock to avoid recalculating
-        // the deltas, because there are no more checks and we know that the
-        // transaction will be added to the block.
-        sproutValue = sproutValueDummy;
-        saplingValue = saplingValueDummy;
-        orchardValue = orchardValueDummy;
     }
 
+    // We update this here instead of in AddToBlock to avoid recalculating
+    // the deltas, because there are no more checks and we know that the
+    // transactions will be added to the block.
+    sproutValue = sproutValueDummy;
+    saplingValue = saplingValueDummy;
+    orchardValue = orchardValueDummy;
+
     return true;
 }
 
@@ -625,90 +745,165 @@ void BlockAssembler::AddToBlock(CTxMemPool::txiter iter)
     }
 }
 
+CTxPackageState::CTxPackageState(const CTxMemPoolEntry& entry) :
+    nSizeWithAncestors(entry.GetSizeWithAncestors()),
+    nModFeesWithAncestors(entry.GetModFeesWithAncestors()),
+    nSigOpCountWithAncestors(entry.GetSigOpCountWithAncestors()),
+    nConventionalFeeWithAncestors(entry.GetConventionalFeeWithAncestors())
+{
+}
+
+void CTxPackageState::RemoveAncestor(const CTxMemPoolEntry& ancestor)
+{
+    nSizeWithAncestors -= ancestor.GetTxSize();
+    nModFeesWithAncestors -= ancestor.GetModifiedFee();
+    nSigOpCountWithAncestors -= ancestor.GetSigOpCount();
+    nConventionalFeeWithAncestors -= ancestor.GetConventionalFee();
+    assert(nConventionalFeeWithAncestors > 0);
+}
+
+size_t CTxPackageState::GetUnpaidActionCount() const
+{
+    return CalculateUnpaidActionCount(nModFeesWithAncestors, nConventionalFeeWithAncestors);
+}
+
+int128_t CTxPackageState::GetWeightRatio() const
+{
+    return CalculateWeightRatio(nModFeesWithAncestors, nConventionalFeeWithAncestors);
+}
+
+static void AddCandidate(
+    CTxMemPool::txiter iter,
+    int128_t weightRatio,
+    CTxMemPool::weightedCandidates& candidatesPayingConventionalFee,
+    CTxMemPool::weightedCandidates& candidatesNotPayingConventionalFee)
+{
+    if (weightRatio >= WEIGHT_RATIO_SCALE) {
+        candidatesPayingConventionalFee.add(iter->GetTx().GetHash(), iter, weightRatio);
+    } else {
+        candidatesNotPayingConventionalFee.add(iter->GetTx().GetHash(), iter, weightRatio);
+    }
+}
+
 void BlockAssembler::constructZIP317BlockTemplate()
 {
     CTxMemPool::weightedCandidates candidatesPayingConventionalFee;
     CTxMemPool::weightedCandidates candidatesNotPayingConventionalFee;
 
+    // Each transaction is weighted by the weight ratio of the package made of
+    // it and its in-mempool ancestors, so that a child can pay for its parents.
     for (auto mi = mempool.mapTx.begin(); mi != mempool.mapTx.end(); ++mi)
     {
-        int128_t weightRatio = mi->GetWeightRatio();
-        if (weightRatio >= WEIGHT_RATIO_SCALE) {
-            candidatesPayingConventionalFee.add(mi->GetTx().GetHash(), mi, weightRatio);
-        } else {
-            candidatesNotPayingConventionalFee.add(mi->GetTx().GetHash(), mi, weightRatio);
-        }
+        AddCandidate(mi, mi->GetWeightRatioWithAncestors(),
+                     candidatesPayingConventionalFee, candidatesNotPayingConventionalFee);
     }
 
-    CTxMemPool::queueEntries waiting;
-    CTxMemPool::queueEntries cleared;
-    addTransactions(candidatesPayingConventionalFee, waiting, cleared);
-    addTransactions(candidatesNotPayingConventionalFee, waiting, cleared);
+    addPackages(candidatesPayingConventionalFee, candidatesNotPayingConventionalFee);
 }
 
-void BlockAssembler::addTransactions(
-    CTxMemPool::weightedCandidates& candidates,
-    CTxMemPool::queueEntries& waiting,
-    CTxMemPool::queueEntries& cleared)
+void BlockAssembler::addPackages(
+    CTxMemPool::weightedCandidates& candidatesPayingConventionalFee,
+    CTxMemPool::weightedCandidates& candidatesNotPayingConventionalFee)
 {
     size_t nBlockUnpaidActions = 0;
 
-    while (!blockFinished && !(candidates.empty() && cleared.empty()))
+    // The packages of the candidates that have ancestors in the block. Other
+    // candidates' packages are described by their ancestor state.
+    packageStates mapModified;
+
+    while (!blockFinished)
     {
-        CTxMemPool::txiter iter;
-        if (cleared.empty()) {
-            // If no txs that were previously postponed are available to try
-            // again, then select the next transaction randomly by weight ratio
-            // from the candidate set.
-            assert(!candidates.empty());
-            iter = std::get<1>(candidates.takeRandom().value());
-        } else {
-            // If a previously postponed tx is available to try again, then it
-            // has already been randomly sampled, so just take it in order.
-            iter = cleared.front();
-            cleared.pop_front();
+        // Select the next transaction randomly by weight ratio, from the
+        // packages that pay the conventional fee while there are any.
+        CTxMemPool::weightedCandidates& candidates = candidatesPayingConventionalFee.empty() ?
+            candidatesNotPayingConventionalFee : candidatesPayingConventionalFee;
+        if (candidates.empty()) {
+            break;
         }
+        CTxMemPool::txiter iter = std::get<1>(candidates.takeRandom().value());
 
-        // The tx should never already be in the block for ZIP 317.
+        // Transactions are taken out of the candidates when they are added to
+        // the block, whether they were selected or are in a selected package.
         assert(inBlock.count(iter) == 0);
 
-        // If the tx would cause the block to exceed the unpaid action limit, skip it.
-        // A tx that pays at least the conventional fee will have no unpaid actions.
-        size_t txUnpaidActions = iter->GetUnpaidActionCount();
-        if (nBlockUnpaidActions + txUnpaidActions > nBlockUnpaidActionLimit) {
+        auto modit = mapModified.find(iter);
+        const CTxPackageState package = modit == mapModified.end() ? CTxPackageState(*iter) : modit->second;
+
+        // If the package would cause the block to exceed the unpaid action
+        // limit, skip it. A package that pays at least the conventional fee
+        // will have no unpaid actions.
+        size_t packageUnpaidActions = package.GetUnpaidActionCount();
+        if (nBlockUnpaidActions + packageUnpaidActions > nBlockUnpaidActionLimit) {
             continue;
         }
 
-        // If tx is dependent on other mempool transactions that haven't yet been
-        // included then put it in the waiting queue.
-        if (isStillDependent(iter)) {
-            waiting.push_back(iter);
+        if (!TestPackage(iter, package.nSizeWithAncestors, package.nSigOpCountWithAncestors)) {
             continue;
         }
 
-        // If this tx fits in the block add it, otherwise keep looping.
-        if (TestForBlock(iter)) {
-            AddToBlock(iter);
-            nBlockUnpaidActions += txUnpaidActions;
+        // The package is the tx and its ancestors that are not yet in the
+        // block. Each tx has more in-mempool ancestors than any of its
+        // ancestors, so sorting by ancestor count puts parents first.
+        CTxMemPool::setEntries setAncestors;
+        uint64_t nNoLimit = std::numeric_limits<uint64_t>::max();
+        std::string dummy;
+        mempool.CalculateMemPoolAncestors(*iter, setAncestors, nNoLimit, nNoLimit, nNoLimit, nNoLimit, dummy, false);
+        std::vector<CTxMemPool::txiter> vPackage;
+        for (CTxMemPool::txiter ancestorIt : setAncestors) {
+            if (!inBlock.count(ancestorIt)) {
+                vPackage.push_back(ancestorIt);
+            }
+        }
+        vPackage.push_back(iter);
+        std::sort(vPackage.begin(), vPackage.end(), [](CTxMemPool::txiter a, CTxMemPool::txiter b) {
+            return a->GetCountWithAncestors() < b->GetCountWithAncestors();
+        });
 
-            // This tx was successfully added, so add waiting transactions that
-            // depend on this one to the cleared queue to try again.
-            //
-            // TODO: This makes the overall algorithm O(n^2 log n) in the worst case
-            // of a linear dependency chain. (children is a std::map; its count method
-            // is O(log n) given the maximum number of children at each step, and is
-            // called O(n^2) times.) Daira conjectures that O(n log n) is possible.
-            auto children = mempool.GetMemPoolChildren(iter);
-            CTxMemPool::queueEntries stillWaiting;
-            for (CTxMemPool::txiter maybeChild : waiting)
-            {
-                if (children.count(maybeChild) > 0) {
-                    cleared.push_back(maybeChild);
-                } else {
-                    stillWaiting.push_back(maybeChild);
-                }
+        if (!TestPackageTransactions(vPackage)) {
+            continue;
+        }
+
+        for (CTxMemPool::txiter packageIt : vPackage) {
+            AddToBlock(packageIt);
+            candidatesPayingConventionalFee.remove(packageIt->GetTx().GetHash());
+            candidatesNotPayingConventionalFee.remove(packageIt->GetTx().GetHash());
+            mapModified.erase(packageIt);
+        }
+        nBlockUnpaidActions += packageUnpaidActions;
+
+        UpdatePackagesForAdded(vPackage, mapModified,
+                               candidatesPayingConventionalFee, candidatesNotPayingConventionalFee);
+    }
+}
+
+void BlockAssembler::UpdatePackagesForAdded(
+    const std::vector<CTxMemPool::txiter>& added,
+    packageStates& mapModified,
+    CTxMemPool::weightedCandidates& candidatesPayingConventionalFee,
+    CTxMemPool::weightedCandidates& candidatesNotPayingConventionalFee)
+{
+    for (CTxMemPool::txiter addedIt : added) {
+        CTxMemPool::setEntries setDescendants;
+        mempool.CalculateDescendants(addedIt, setDescendants);
+        for (CTxMemPool::txiter descendantIt : setDescendants) {
+            if (inBlock.count(descendantIt)) {
+                continue;
+            }
+            auto modit = mapModified.find(descendantIt);
+            if (modit == mapModified.end()) {
+                modit = mapModified.emplace(descendantIt, CTxPackageState(*descendantIt)).first;
+            }
+            modit->second.RemoveAncestor(*addedIt);
+
+            // If the descendant is still a candidate, weight it by what is
+            // left of its package, which may no longer pay the conventional
+            // fee or may now pay it.
+            const uint256& hash = descendantIt->GetTx().GetHash();
+            if (candidatesPayingConventionalFee.remove(hash).has_value() ||
+                candidatesNotPayingConventionalFee.remove(hash).has_value()) {
+                AddCandidate(descendantIt, modit->second.GetWeightRatio(),
+                             candidatesPayingConventionalFee, candidatesNotPayingConventionalFee);
             }
-            waiting.swap(stillWaiting);
         }
     }
 }
@@ -834,7 +1029,7 @@ static bool ProcessBlockFound(const CBlock* pblock, const CChainParams& chainpar
     return true;
 }
 
-void static BitcoinMiner(const CChainParams& chainparams)
+void static BitcoinMiner(const CChainParams& chainparams, int nThread)
 {
     LogPrintf("ZcashMiner started\n");
     SetThreadPriority(THREAD_PRIORITY_LOWEST);
@@ -853,6 +1048,14 @@ void static BitcoinMiner(const CChainParams& chainparams)
     assert(solver == "tromp" || solver == "default");
     LogPrint("pow", "Using Equihash solver \"%s\" with n = %u, k = %u\n", solver, n, k);
 
+    // The memory of the tromp solver is allocated once, and reused for each
+    // nonce and block.
+    std::unique_ptr<equi> eq;
+    if (solver == "tromp") {
+        int nSolverThreads = std::max(1, (int)GetArg("-equihashsolverthreads", DEFAULT_EQUIHASH_SOLVER_THREADS));
+        eq.reset(new equi(nSolverThreads));
+    }
+
     std::mutex m_cs;
     bool cancelSolver = false;
     boost::signals2::connection c = uiInterface.NotifyBlockTip.connect(
@@ -917,6 +1120,9 @@ void static BitcoinMiner(const CChainParams& chainparams)
             }
             CBlock *pblock = &pblocktemplate->block;
             IncrementExtraNonce(pblocktemplate.get(), pindexPrev, nExtraNonce, chainparams.GetConsensus());
+            // Each thread searches its own part of the nonce space, marked in
+            // the top 16 bits that CreateNewBlock leaves clear.
+            pblock->nNonce = ArithToUint256(UintToArith256(pblock->nNonce) | (arith_uint256(nThread & 0xffff) << 240));
 
             LogPrintf("Running ZcashMiner with %u transactions in block (%u bytes)\n", pblock->vtx.size(),
                 ::GetSerializeSize(*pblock, SER_NETWORK, PROTOCOL_VERSION));
@@ -992,7 +1198,17 @@ void static BitcoinMiner(const CChainParams& chainparams)
                         LogPrint("pow", "Checking solution %d\n", s+1);
                         return validBlock(GetMinimalFromIndices(index_vector, DIGITBITS));
                     };
-                    equihash_solve(curr_state.inner, incrementRuns, checkSolution);
+                    std::function<bool()> cancelledTromp = [&m_cs, &cancelSolver]() {
+                        std::lock_guard<std::mutex> lock{m_cs};
+                        return cancelSolver;
+                    };
+                    if (!equihash_solve(*eq, curr_state.inner, incrementRuns, checkSolution, cancelledTromp)) {
+                        std::lock_guard<std::mutex> lock{m_cs};
+                        if (cancelSolver) {
+                            LogPrint("pow", "Equihash solver cancelled\n");
+                            cancelSolver = false;
+                        }
+                    }
                 } else {
                     try {
                         // If we find a valid block, we rebuild
@@ -1071,7 +1287,7 @@ void GenerateBitcoins(bool fGenerate, int nThreads, const CChainParams& chainpar
 
     minerThreads = new boost::thread_group();
     for (int i = 0; i < nThreads; i++) {
-        minerThreads->create_thread(boost::bind(&BitcoinMiner, boost::cref(chainparams)));
+        minerThreads->create_thread(boost::bind(&BitcoinMiner, boost::cref(chainparams), i));
     }
 }
 
@@ -12,8 +12,10 @@
 #include "weighted_map.h"
 
 #include <stdint.h>
+#include <map>
 #include <memory>
 #include <variant>
+#include <vector>
 
 #include <boost/shared_ptr.hpp>
 
@@ -25,6 +27,8 @@ namespace Consensus { struct Params; };
 
 static const bool DEFAULT_GENERATE = false;
 static const int DEFAULT_GENERATE_THREADS = 1;
+/** Default for -equihashsolverthreads, the number of threads of each tromp solver */
+static const int DEFAULT_EQUIHASH_SOLVER_THREADS = 1;
 
 static const bool DEFAULT_PRINTPRIORITY = false;
 
@@ -96,6 +100,27 @@ struct CBlockTemplate
     std::vector<int64_t> vTxSigOps;
 };
 
+/**
+ * The ancestor state of a mempool entry, less the ancestors that have already
+ * been added to the block being assembled. This describes the package of
+ * transactions that would be added to the block to include the entry.
+ */
+struct CTxPackageState
+{
+    uint64_t nSizeWithAncestors;
+    CAmount nModFeesWithAncestors;
+    unsigned int nSigOpCountWithAncestors;
+    CAmount nConventionalFeeWithAncestors;
+
+    explicit CTxPackageState(const CTxMemPoolEntry& entry);
+
+    /** Account for an ancestor having been added to the block. */
+    void RemoveAncestor(const CTxMemPoolEntry& ancestor);
+
+    size_t GetUnpaidActionCount() const;
+    int128_t GetWeightRatio() const;
+};
+
 CMutableTransaction CreateCoinbaseTransaction(const CChainParams& chainparams, CAmount nFees, const MinerAddress& minerAddress, int nHeight);
 
 /** Generate a new block, without valid proof-of-work */
@@ -125,6 +150,7 @@ private:
     bool monitoring_pool_balances;
 
     // Chain context for the block
+    CBlockIndex* pindexPrev;
     int nHeight;
     int64_t nLockTimeCutoff;
     const CChainParams& chainparams;
@@ -139,19 +165,42 @@ public:
     CBlockTemplate* CreateNewBlock(
         const MinerAddress& minerAddress,
         const std::optional<CMutableTransaction>& next_coinbase_mtx = std::nullopt);
+    /**
+     * Add transactions that have entered the mempool to prev, which must be
+     * the template returned by the last call to CreateNewBlock or
+     * UpdateNewBlock, and return the new template. Returns NULL if one of them
+     * could not be added where CreateNewBlock would have added it, in which
+     * case CreateNewBlock must be called before this can be used again.
+     */
+    CBlockTemplate* UpdateNewBlock(
+        const CBlockTemplate& prev,
+        const MinerAddress& minerAddress,
+        const std::vector<CTxMemPool::txiter>& vNew);
 
 private:
+    typedef std::map<CTxMemPool::txiter, CTxPackageState, CTxMemPool::CompareIteratorByHash> packageStates;
+
     void constructZIP317BlockTemplate();
-    void addTransactions(
-        CTxMemPool::weightedCandidates& candidates,
-        CTxMemPool::queueEntries& waiting,
-        CTxMemPool::queueEntries& cleared);
+    void addPackages(
+        CTxMemPool::weightedCandidates& candidatesPayingConventionalFee,
+        CTxMemPool::weightedCandidates& candidatesNotPayingConventionalFee);
+    /** Update the packages of the in-mempool descendants of transactions
+     *  that have been added to the block, and weight them again */
+    void UpdatePackagesForAdded(
+        const std::vector<CTxMemPool::txiter>& added,
+        packageStates& mapModified,
+        CTxMemPool::weightedCandidates& candidatesPayingConventionalFee,
+        CTxMemPool::weightedCandidates& candidatesNotPayingConventionalFee);
 
     // utility functions
     /** Clear the block's state and prepare for assembling a new block */
     void resetBlock(const MinerAddress& minerAddress);
     /** Add a tx to the block */
     void AddToBlock(CTxMemPool::txiter iter);
+    /** Create the coinbase tx, fill in the header and check the block */
+    void FinishBlock(
+        const MinerAddress& minerAddress,
+        const std::optional<CMutableTransaction>& next_coinbase_mtx);
 
     // Methods for how to add transactions to a block.
     /** Add transactions based on modified feerate */
@@ -160,6 +209,12 @@ private:
     // helper function for addScoreTxs and addPriorityTxs
     /** Test if tx will still "fit" in the block */
     bool TestForBlock(CTxMemPool::txiter iter);
+    /** Test if a package of the given size and sig ops, added to include iter,
+     *  will still "fit" in the block */
+    bool TestPackage(CTxMemPool::txiter iter, uint64_t packageSize, unsigned int packageSigOps);
+    /** Test if the transactions of a package, in the order that they would be
+     *  added, are final, unexpired and keep the pool balances non-negative */
+    bool TestPackageTransactions(const std::vector<CTxMemPool::txiter>& package);
     /** Test if tx still has unconfirmed parents not yet in block */
     bool isStillDependent(CTxMemPool::txiter iter);
 };
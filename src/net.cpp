@@ -21,6 +21,7 @@
 #include "hash.h"
 #include "primitives/transaction.h"
 #include "scheduler.h"
+#include "socketevents.h"
 #include "ui_interface.h"
 
 #ifdef WIN32
@@ -31,6 +32,7 @@
 
 #include <boost/thread.hpp>
 
+#include <limits>
 #include <math.h>
 
 #include <rust/metrics.h>
@@ -74,6 +76,8 @@ std::string strSubVersion;
 
 vector<CNode*> vNodes;
 CCriticalSection cs_vNodes;
+static CCriticalSection cs_vNodesSnapshot;
+static NodesSnapshot vNodesSnapshot = std::make_shared<const std::vector<CNode*>>();
 limitedmap<WTxId, int64_t> mapAlreadyAskedFor(MAX_INV_SZ);
 
 static deque<string> vOneShots;
@@ -89,7 +93,13 @@ NodeId nLastNodeId = 0;
 CCriticalSection cs_nLastNodeId;
 
 static CSemaphore *semOutbound = NULL;
-static boost::condition_variable messageHandlerCondition;
+//! Each peer is handled by message handler thread (id % nMessageHandlerThreads).
+static int nMessageHandlerThreads = 1;
+//! The number of "tx" messages each message handler thread processes per round.
+static int nMaxTxMessagesPerRound = DEFAULT_MAX_TX_MSGS_PER_ROUND;
+static boost::condition_variable messageHandlerCondition[MAX_MSGHAND_THREADS];
+//! The total size of the send queues of all connections.
+static std::atomic<size_t> nTotalSendSize{0};
 
 // Signals for message handling
 static CNodeSignals g_signals;
@@ -318,6 +328,30 @@ uint64_t CNode::nMaxOutboundTotalBytesSentInCycle = 0;
 uint64_t CNode::nMaxOutboundTimeframe = 60*60*24; //1 day
 uint64_t CNode::nMaxOutboundCycleStartTime = 0;
 
+NodesSnapshot GetNodesSnapshot()
+{
+    LOCK(cs_vNodesSnapshot);
+    return vNodesSnapshot;
+}
+
+// Replace the snapshot returned by GetNodesSnapshot after a change to vNodes.
+// requires LOCK(cs_vNodes)
+static void PublishNodesSnapshot()
+{
+    for (CNode* pnode : vNodes) {
+        pnode->nSnapshotRefs++;
+    }
+    NodesSnapshot snapshot(new std::vector<CNode*>(vNodes), [](const std::vector<CNode*>* pvNodes) {
+        for (CNode* pnode : *pvNodes) {
+            pnode->nSnapshotRefs--;
+        }
+        delete pvNodes;
+    });
+    // The previous snapshot is released once we no longer hold the lock.
+    LOCK(cs_vNodesSnapshot);
+    vNodesSnapshot.swap(snapshot);
+}
+
 CNode* FindNode(const CNetAddr& ip)
 {
     LOCK(cs_vNodes);
@@ -356,6 +390,15 @@ CNode* FindNode(const CService& addr)
     return NULL;
 }
 
+CNode* FindNode(const NodeId id)
+{
+    LOCK(cs_vNodes);
+    for (CNode* pnode : vNodes)
+        if (pnode->GetId() == id)
+            return (pnode);
+    return NULL;
+}
+
 CNode* ConnectNode(CAddress addrConnect, const char *pszDest)
 {
     if (pszDest == NULL) {
@@ -398,6 +441,7 @@ CNode* ConnectNode(CAddress addrConnect, const char *pszDest)
         {
             LOCK(cs_vNodes);
             vNodes.push_back(pnode);
+            PublishNodesSnapshot();
         }
 
         return pnode;
@@ -476,6 +520,7 @@ void CNode::PushVersion()
 
 
 banmap_t CNode::setBanned;
+CBanIndex CNode::banIndex;
 CCriticalSection CNode::cs_setBanned;
 bool CNode::setBannedIsDirty;
 
@@ -484,6 +529,7 @@ void CNode::ClearBanned()
     {
         LOCK(cs_setBanned);
         setBanned.clear();
+        banIndex.Clear();
         setBannedIsDirty = true;
     }
     DumpBanlist(); //store banlist to disk
@@ -493,16 +539,7 @@ void CNode::ClearBanned()
 bool CNode::IsBanned(CNetAddr ip)
 {
     LOCK(cs_setBanned);
-    for (banmap_t::iterator it = setBanned.begin(); it != setBanned.end(); it++)
-    {
-        CSubNet subNet = (*it).first;
-        CBanEntry banEntry = (*it).second;
-
-        if (subNet.Match(ip) && GetTime() < banEntry.nBanUntil) {
-            return true;
-        }
-    }
-    return false;
+    return banIndex.IsBanned(ip, GetTime());
 }
 
 bool CNode::IsBanned(CSubNet subnet)
@@ -538,6 +575,7 @@ void CNode::Ban(const CSubNet& subNet, const BanReason &banReason, int64_t banti
         LOCK(cs_setBanned);
         if (setBanned[subNet].nBanUntil < banEntry.nBanUntil) {
             setBanned[subNet] = banEntry;
+            banIndex.Set(subNet, banEntry.nBanUntil);
             setBannedIsDirty = true;
         }
         else
@@ -565,6 +603,7 @@ bool CNode::Unban(const CSubNet &subNet) {
         LOCK(cs_setBanned);
         if (!setBanned.erase(subNet))
             return false;
+        banIndex.Remove(subNet);
         setBannedIsDirty = true;
     }
     uiInterface.BannedListChanged();
@@ -582,6 +621,7 @@ void CNode::SetBanned(const banmap_t &banMap)
 {
     LOCK(cs_setBanned);
     setBanned = banMap;
+    banIndex.Rebuild(setBanned);
     setBannedIsDirty = true;
 }
 
@@ -597,6 +637,7 @@ void CNode::SweepBanned()
         CBanEntry banEntry = (*it).second;
         if(now > banEntry.nBanUntil)
         {
+            banIndex.Remove(subNet);
             setBanned.erase(it++);
             setBannedIsDirty = true;
             LogPrint("net", "%s: Removed banned node ip/subnet from banlist.dat: %s\n", __func__, subNet.ToString());
@@ -683,15 +724,14 @@ void CNode::copyStats(CNodeStats &stats)
     }
     stats.fInbound = fInbound;
     stats.nStartingHeight = nStartingHeight;
+    stats.nSendBytes = nSendBytes;
+    stats.nRecvBytes = nRecvBytes;
+    stats.fWhitelisted = fWhitelisted;
     {
-        LOCK(cs_vSend);
-        stats.nSendBytes = nSendBytes;
-    }
-    {
-        LOCK(cs_vRecv);
-        stats.nRecvBytes = nRecvBytes;
+        LOCK(cs_feeFilter);
+        stats.minFeeFilter = minFeeFilter;
+        stats.nUnpaidActionFilter = nUnpaidActionFilter;
     }
-    stats.fWhitelisted = fWhitelisted;
 
     // It is common for nodes with good ping times to suddenly become lagged,
     // due to a new block arriving or other large transfer.
@@ -711,6 +751,15 @@ void CNode::copyStats(CNodeStats &stats)
     stats.m_addr_processed = m_addr_processed.load();
     stats.m_addr_rate_limited = m_addr_rate_limited.load();
 
+    {
+        LOCK(cs_msgStats);
+        stats.mapSendBytesPerMsgCmd = mapSendBytesPerMsgCmd;
+        stats.mapRecvBytesPerMsgCmd = mapRecvBytesPerMsgCmd;
+        stats.mapProcessTimePerMsgCmd = mapProcessTimePerMsgCmd;
+        stats.mapProcessCPUPerMsgCmd = mapProcessCPUPerMsgCmd;
+        stats.mapLockWaitPerMsgCmd = mapLockWaitPerMsgCmd;
+    }
+
     // Leave string empty if addrLocal invalid (not filled in yet)
     CService addrLocalUnlocked = GetAddrLocal();
     stats.addrLocal = addrLocalUnlocked.IsValid() ? addrLocalUnlocked.ToString() : "";
@@ -749,17 +798,72 @@ bool CNode::ReceiveMsgBytes(const char *pch, unsigned int nBytes)
         if (msg.complete()) {
             msg.nTime = GetTimeMicros();
             std::string strCommand = SanitizeString(msg.hdr.GetCommand());
+            RecordMsgRecv(strCommand, CMessageHeader::HEADER_SIZE + msg.hdr.nMessageSize);
             MetricsIncrementCounter("zcash.net.in.messages", "command", strCommand.c_str());
             MetricsCounter(
                 "zcash.net.in.bytes", msg.hdr.nMessageSize,
                 "command", strCommand.c_str());
-            messageHandlerCondition.notify_one();
+            messageHandlerCondition[GetId() % nMessageHandlerThreads].notify_one();
         }
     }
 
     return true;
 }
 
+namespace {
+
+/**
+ * Payload buffers of received messages, kept for reuse by later messages from
+ * any peer instead of being freed, so that steady block and transaction
+ * traffic does not keep allocating and freeing multi-megabyte buffers.
+ */
+class CRecvBufferPool
+{
+private:
+    CCriticalSection cs;
+    //! Free buffers, ordered by capacity.
+    std::multimap<size_t, CPublicSerializeData> mapFree;
+    size_t nFreeBytes = 0;
+
+public:
+    /** Take a free buffer with a capacity of at least nSize, if there is one. */
+    void Take(CPublicSerializeData& buf, size_t nSize)
+    {
+        LOCK(cs);
+        auto it = mapFree.lower_bound(nSize);
+        if (it == mapFree.end())
+            return;
+        buf.swap(it->second);
+        nFreeBytes -= it->first;
+        mapFree.erase(it);
+    }
+
+    /** Give a buffer back, keeping it if the pool has room for it. */
+    void Give(CPublicSerializeData& buf)
+    {
+        size_t nCapacity = buf.capacity();
+        if (nCapacity == 0 || nCapacity > MAX_PROTOCOL_MESSAGE_LENGTH)
+            return;
+        LOCK(cs);
+        if (nFreeBytes + nCapacity > MAX_RECV_BUFFER_POOL_SIZE)
+            return;
+        buf.clear();
+        mapFree.emplace(nCapacity, CPublicSerializeData())->second.swap(buf);
+        nFreeBytes += nCapacity;
+    }
+};
+
+CRecvBufferPool recvBufferPool;
+
+}
+
+CNetMessage::~CNetMessage()
+{
+    CPublicSerializeData buf;
+    vRecv.Swap(buf);
+    recvBufferPool.Give(buf);
+}
+
 int CNetMessage::readHeader(const char *pch, unsigned int nBytes)
 {
     // copy data to temporary parsing buffer
@@ -785,6 +889,15 @@ int CNetMessage::readHeader(const char *pch, unsigned int nBytes)
     if (hdr.nMessageSize > MAX_SIZE)
             return -1;
 
+    // Size the payload buffer from the header. Buffers for large messages
+    // are only taken in full from the pool, so that a peer cannot make us
+    // allocate a lot of memory by just sending headers.
+    CPublicSerializeData buf;
+    recvBufferPool.Take(buf, hdr.nMessageSize);
+    if (buf.capacity() == 0)
+        buf.reserve(std::min(hdr.nMessageSize, RECV_BUFFER_PREALLOCATE_SIZE));
+    vRecv.Swap(buf);
+
     // switch state to reading message data
     in_data = true;
 
@@ -798,15 +911,24 @@ int CNetMessage::readData(const char *pch, unsigned int nBytes)
 
     if (vRecv.size() < nDataPos + nCopy) {
         // Allocate up to 256 KiB ahead, but never more than the total message size.
-        vRecv.resize(std::min(hdr.nMessageSize, nDataPos + nCopy + 256 * 1024));
+        vRecv.resize(std::min(hdr.nMessageSize, nDataPos + nCopy + RECV_BUFFER_PREALLOCATE_SIZE));
     }
 
+    hasher.Write((const unsigned char*)pch, nCopy);
     memcpy(&vRecv[nDataPos], pch, nCopy);
     nDataPos += nCopy;
 
     return nCopy;
 }
 
+const uint256& CNetMessage::GetMessageHash() const
+{
+    assert(complete());
+    if (data_hash.IsNull())
+        hasher.Finalize(data_hash.begin());
+    return data_hash;
+}
+
 
 
 
@@ -818,10 +940,11 @@ int CNetMessage::readData(const char *pch, unsigned int nBytes)
 // requires LOCK(cs_vSend)
 void SocketSendData(CNode *pnode)
 {
-    std::deque<CSerializeData>::iterator it = pnode->vSendMsg.begin();
+    std::deque<CPublicSerializeData>::iterator it = pnode->vSendMsg.begin();
+    const size_t nSendSizeBefore = pnode->nSendSize;
 
     while (it != pnode->vSendMsg.end()) {
-        const CSerializeData &data = *it;
+        const CPublicSerializeData &data = *it;
         assert(data.size() > pnode->nSendOffset);
         int nBytes = 0;
         {
@@ -832,15 +955,13 @@ void SocketSendData(CNode *pnode)
         }
         if (nBytes > 0) {
             pnode->nLastSend = GetTime();
-            {
-                LOCK(pnode->cs_vSend);
-                pnode->nSendBytes += nBytes;
-            }
+            pnode->nSendBytes += nBytes;
             pnode->nSendOffset += nBytes;
             pnode->RecordBytesSent(nBytes);
             if (pnode->nSendOffset == data.size()) {
                 pnode->nSendOffset = 0;
                 pnode->nSendSize -= data.size();
+                nTotalSendSize -= data.size();
                 it++;
             } else {
                 // could not send full message; stop sending more
@@ -866,6 +987,10 @@ void SocketSendData(CNode *pnode)
         assert(pnode->nSendSize == 0);
     }
     pnode->vSendMsg.erase(pnode->vSendMsg.begin(), it);
+
+    // Let the message handler serve the next block the node asked for.
+    if (nSendSizeBefore >= SendBufferSize() / 4 && pnode->CanQueueBlock())
+        messageHandlerCondition[pnode->GetId() % nMessageHandlerThreads].notify_one();
 }
 
 static list<CNode*> vNodesDisconnected;
@@ -1089,11 +1214,30 @@ static void AcceptConnection(const ListenSocket& hListenSocket) {
     {
         LOCK(cs_vNodes);
         vNodes.push_back(pnode);
+        PublishNodesSnapshot();
     }
 }
 
+// Ids under which listening sockets are registered with CSocketEvents; nodes
+// are registered under their NodeId.
+static const uint64_t LISTEN_SOCKET_EVENTS_ID = 1ULL << 63;
+
 void ThreadSocketHandler()
 {
+    CSocketEvents events;
+    if (!events.IsValid()) {
+        LogPrintf("Error: Couldn't initialize %s socket events (%s)\n", CSocketEvents::Backend(), NetworkErrorString(WSAGetLastError()));
+        return;
+    }
+    LogPrint("net", "Waiting for socket events with %s\n", CSocketEvents::Backend());
+
+    for (size_t i = 0; i < vhListenSocket.size(); i++) {
+        if (!events.Set(LISTEN_SOCKET_EVENTS_ID + i, vhListenSocket[i].socket, SOCKET_EVENT_RECV))
+            LogPrintf("Error: Couldn't wait for connections on listening socket (%s)\n", NetworkErrorString(WSAGetLastError()));
+    }
+
+    std::vector<std::pair<uint64_t, int>> vReady;
+    std::map<NodeId, int> mapReady;
     unsigned int nPrevNodeCount = 0;
     while (true)
     {
@@ -1104,6 +1248,7 @@ void ThreadSocketHandler()
             LOCK(cs_vNodes);
             // Disconnect unused nodes
             vector<CNode*> vNodesCopy = vNodes;
+            bool fRemoved = false;
             for (CNode* pnode : vNodesCopy)
             {
                 if (pnode->fDisconnect ||
@@ -1119,13 +1264,18 @@ void ThreadSocketHandler()
 
                     // close socket and cleanup
                     pnode->CloseSocketDisconnect();
+                    events.Remove(pnode->id);
 
                     // hold in disconnected pool until all refs are released
                     if (pnode->fNetworkNode || pnode->fInbound)
                         pnode->Release();
                     vNodesDisconnected.push_back(pnode);
+                    fRemoved = true;
                 }
             }
+            if (fRemoved) {
+                PublishNodesSnapshot();
+            }
         }
         {
             // Delete disconnected nodes
@@ -1133,7 +1283,7 @@ void ThreadSocketHandler()
             for (CNode* pnode : vNodesDisconnectedCopy)
             {
                 // wait until threads are done using it
-                if (pnode->GetRefCount() <= 0) {
+                if (pnode->GetRefCount() <= 0 && pnode->nSnapshotRefs == 0) {
                     bool fDelete = false;
                     {
                         TRY_LOCK(pnode->cs_inventory, lockInv);
@@ -1168,37 +1318,18 @@ void ThreadSocketHandler()
         //
         // Find which sockets have data to receive
         //
-        struct timeval timeout;
-        timeout.tv_sec  = 0;
-        timeout.tv_usec = 50000; // frequency to poll pnode->vSend
-
-        fd_set fdsetRecv;
-        fd_set fdsetSend;
-        fd_set fdsetError;
-        FD_ZERO(&fdsetRecv);
-        FD_ZERO(&fdsetSend);
-        FD_ZERO(&fdsetError);
-        SOCKET hSocketMax = 0;
-        bool have_fds = false;
-
-        for (const ListenSocket& hListenSocket : vhListenSocket) {
-            FD_SET(hListenSocket.socket, &fdsetRecv);
-            hSocketMax = max(hSocketMax, hListenSocket.socket);
-            have_fds = true;
-        }
-
         {
             LOCK(cs_vNodes);
             for (CNode* pnode : vNodes)
             {
                 // Implement the following logic:
-                // * If there is data to send, select() for sending data. As this only
+                // * If there is data to send, wait for sending data. As this only
                 //   happens when optimistic write failed, we choose to first drain the
                 //   write buffer in this case before receiving more. This avoids
                 //   needlessly queueing received data, if the remote peer is not themselves
                 //   receiving data. This means properly utilizing TCP flow control signaling.
                 // * Otherwise, if there is no (complete) message in the receive buffer,
-                //   or there is space left in the buffer, select() for receiving data.
+                //   or there is space left in the buffer, wait for receiving data.
                 // * (if neither of the above applies, there is certainly one message
                 //   in the receiver buffer ready to be processed).
                 // Together, that means that at least one of the following is always possible,
@@ -1221,50 +1352,47 @@ void ThreadSocketHandler()
                         pnode->GetTotalRecvSize() <= ReceiveFloodSize());
                 }
 
+                // The socket stays registered while its events are unchanged,
+                // so only sockets whose events change cost a system call.
                 LOCK(pnode->cs_hSocket);
-                if (pnode->hSocket == INVALID_SOCKET)
-                    continue;
-
-                FD_SET(pnode->hSocket, &fdsetError);
-                hSocketMax = max(hSocketMax, pnode->hSocket);
-                have_fds = true;
-
-                if (select_send) {
-                    FD_SET(pnode->hSocket, &fdsetSend);
+                if (pnode->hSocket == INVALID_SOCKET) {
+                    events.Remove(pnode->id);
                     continue;
                 }
-                if (select_recv) {
-                    FD_SET(pnode->hSocket, &fdsetRecv);
+                int nEvents = select_send ? SOCKET_EVENT_SEND : (select_recv ? SOCKET_EVENT_RECV : 0);
+                if (!events.Set(pnode->id, pnode->hSocket, nEvents)) {
+                    LogPrintf("socket events error %s\n", NetworkErrorString(WSAGetLastError()));
+                    pnode->fDisconnect = true;
                 }
             }
         }
 
-        int nSelect = select(have_fds ? hSocketMax + 1 : 0,
-                             &fdsetRecv, &fdsetSend, &fdsetError, &timeout);
+        bool fWaited = events.Wait(50, vReady); // frequency to poll pnode->vSend
         boost::this_thread::interruption_point();
 
-        if (nSelect == SOCKET_ERROR)
+        if (!fWaited)
         {
-            if (have_fds)
-            {
-                int nErr = WSAGetLastError();
-                LogPrintf("socket select error %s\n", NetworkErrorString(nErr));
-                for (unsigned int i = 0; i <= hSocketMax; i++)
-                    FD_SET(i, &fdsetRecv);
-            }
-            FD_ZERO(&fdsetSend);
-            FD_ZERO(&fdsetError);
-            MilliSleep(timeout.tv_usec/1000);
+            int nErr = WSAGetLastError();
+            if (nErr != WSAEINTR)
+                LogPrintf("socket %s error %s\n", CSocketEvents::Backend(), NetworkErrorString(nErr));
+            MilliSleep(50);
         }
 
         //
         // Accept new connections
         //
-        for (const ListenSocket& hListenSocket : vhListenSocket)
+        mapReady.clear();
+        for (const std::pair<uint64_t, int>& ready : vReady)
         {
-            if (hListenSocket.socket != INVALID_SOCKET && FD_ISSET(hListenSocket.socket, &fdsetRecv))
-            {
-                AcceptConnection(hListenSocket);
+            if (ready.first >= LISTEN_SOCKET_EVENTS_ID) {
+                size_t i = ready.first - LISTEN_SOCKET_EVENTS_ID;
+                if (i < vhListenSocket.size() && vhListenSocket[i].socket != INVALID_SOCKET &&
+                    (ready.second & SOCKET_EVENT_RECV))
+                {
+                    AcceptConnection(vhListenSocket[i]);
+                }
+            } else {
+                mapReady[ready.first] = ready.second;
             }
         }
 
@@ -1287,17 +1415,16 @@ void ThreadSocketHandler()
             //
             // Receive
             //
-            bool recvSet = false;
-            bool sendSet = false;
-            bool errorSet = false;
             {
                 LOCK(pnode->cs_hSocket);
                 if (pnode->hSocket == INVALID_SOCKET)
                     continue;
-                recvSet = FD_ISSET(pnode->hSocket, &fdsetRecv);
-                sendSet = FD_ISSET(pnode->hSocket, &fdsetSend);
-                errorSet = FD_ISSET(pnode->hSocket, &fdsetError);
             }
+            auto itReady = mapReady.find(pnode->id);
+            int nReady = itReady == mapReady.end() ? 0 : itReady->second;
+            bool recvSet = nReady & SOCKET_EVENT_RECV;
+            bool sendSet = nReady & SOCKET_EVENT_SEND;
+            bool errorSet = nReady & SOCKET_EVENT_ERROR;
             if (recvSet || errorSet)
             {
                 TRY_LOCK(pnode->cs_vRecvMsg, lockRecv);
@@ -1318,10 +1445,7 @@ void ThreadSocketHandler()
                             if (!pnode->ReceiveMsgBytes(pchBuf, nBytes))
                                 pnode->CloseSocketDisconnect();
                             pnode->nLastRecv = GetTime();
-                            {
-                                LOCK(pnode->cs_vRecv);
-                                pnode->nRecvBytes += nBytes;
-                            }
+                            pnode->nRecvBytes += nBytes;
                             pnode->RecordBytesRecv(nBytes);
                         }
                         else if (nBytes == 0)
@@ -1448,10 +1572,16 @@ void ThreadDNSAddressSeed()
 
 void DumpAddresses()
 {
+    // Rewriting a large peers.dat is expensive, skip it if nothing changed.
+    if (!addrman.IsDirty())
+        return;
+
     int64_t nStart = GetTimeMillis();
 
     CAddrDB adb;
-    adb.Write(addrman);
+    addrman.SetDirty(false);
+    if (!adb.Write(addrman))
+        addrman.SetDirty(true);
 
     LogPrint("net", "Flushed %d addresses to peers.dat  %dms\n",
            addrman.size(), GetTimeMillis() - nStart);
@@ -1681,13 +1811,26 @@ bool OpenNetworkConnection(const CAddress& addrConnect, CSemaphoreGrant *grantOu
 }
 
 
-void ThreadMessageHandler()
+/**
+ * Process messages for, and send messages to, the peers whose id is nThread
+ * modulo nMessageHandlerThreads. Each peer is only ever handled by one thread,
+ * so its messages are processed in order, while a slow request from one peer
+ * only delays the peers that share its thread.
+ *
+ * Each round processes at most nMaxTxMessagesPerRound "tx" messages over all
+ * of the thread's peers, so that a round stays short during transaction spam
+ * and blocks and headers are processed soon after they are received. The
+ * round starts at a different peer each time, so that transactions left for
+ * the next round are not always those of the same peers.
+ */
+void ThreadMessageHandler(int nThread)
 {
     const CChainParams& chainparams = Params();
     boost::mutex condition_mutex;
     boost::unique_lock<boost::mutex> lock(condition_mutex);
 
     SetThreadPriority(THREAD_PRIORITY_BELOW_NORMAL);
+    size_t nRound = 0;
     while (true)
     {
         vector<CNode*> vNodesCopy;
@@ -1698,12 +1841,15 @@ void ThreadMessageHandler()
                 pnode->AddRef();
             }
         }
+        if (!vNodesCopy.empty())
+            std::rotate(vNodesCopy.begin(), vNodesCopy.begin() + (nRound++ % vNodesCopy.size()), vNodesCopy.end());
 
         bool fSleep = true;
+        int nTxBudget = nMaxTxMessagesPerRound > 0 ? nMaxTxMessagesPerRound : std::numeric_limits<int>::max();
 
         for (CNode* pnode : vNodesCopy)
         {
-            if (pnode->fDisconnect)
+            if (pnode->fDisconnect || pnode->GetId() % nMessageHandlerThreads != nThread)
                 continue;
 
             auto spanGuard = pnode->span.Enter();
@@ -1713,12 +1859,13 @@ void ThreadMessageHandler()
                 TRY_LOCK(pnode->cs_vRecvMsg, lockRecv);
                 if (lockRecv)
                 {
-                    if (!g_signals.ProcessMessages(chainparams, pnode))
+                    if (!g_signals.ProcessMessages(chainparams, pnode, nTxBudget))
                         pnode->CloseSocketDisconnect();
 
                     if (pnode->nSendSize < SendBufferSize())
                     {
-                        if (!pnode->vRecvGetData.empty() || (!pnode->vRecvMsg.empty() && pnode->vRecvMsg[0].complete()))
+                        if ((!pnode->vRecvGetData.empty() && (!pnode->vRecvGetData.front().IsBlock() || pnode->CanQueueBlock())) ||
+                            (pnode->vRecvGetData.empty() && !pnode->vRecvMsg.empty() && pnode->vRecvMsg[0].complete()))
                         {
                             fSleep = false;
                         }
@@ -1742,7 +1889,7 @@ void ThreadMessageHandler()
         }
 
         if (fSleep)
-            messageHandlerCondition.timed_wait(lock, boost::posix_time::microsec_clock::universal_time() + boost::posix_time::milliseconds(100));
+            messageHandlerCondition[nThread].timed_wait(lock, boost::posix_time::microsec_clock::universal_time() + boost::posix_time::milliseconds(100));
     }
 }
 
@@ -1955,6 +2102,10 @@ void StartNode(boost::thread_group& threadGroup, CScheduler& scheduler)
 
     Discover(threadGroup);
 
+    nMessageHandlerThreads = std::max(1, std::min((int)GetArg("-msghandthreads", DEFAULT_MSGHAND_THREADS), MAX_MSGHAND_THREADS));
+    LogPrintf("Using %d message handler threads\n", nMessageHandlerThreads);
+    nMaxTxMessagesPerRound = GetArg("-maxtxmsgsperround", DEFAULT_MAX_TX_MSGS_PER_ROUND);
+
     //
     // Start threads
     //
@@ -1975,10 +2126,12 @@ void StartNode(boost::thread_group& threadGroup, CScheduler& scheduler)
         threadGroup.create_thread(boost::bind(&TraceThread<void (*)()>, "opencon", &ThreadOpenConnections));
 
     // Process messages
-    threadGroup.create_thread(boost::bind(&TraceThread<void (*)()>, "msghand", &ThreadMessageHandler));
+    for (int i = 0; i < nMessageHandlerThreads; i++)
+        threadGroup.create_thread(boost::bind(&TraceThread<std::function<void()>>, "msghand", std::function<void()>(std::bind(&ThreadMessageHandler, i))));
 
-    // Dump network addresses
-    scheduler.scheduleEvery(&DumpData, DUMP_ADDRESSES_INTERVAL);
+    // Dump network addresses, after any other tasks that are due, as it can
+    // be slow on a busy disk
+    scheduler.scheduleEvery(&DumpData, DUMP_ADDRESSES_INTERVAL, CScheduler::PRIORITY_LOW);
 }
 
 bool StopNode()
@@ -2016,6 +2169,10 @@ public:
                     LogPrintf("CloseSocket(hListenSocket) failed with error %s\n", NetworkErrorString(WSAGetLastError()));
 
         // clean up some globals (to help leak detection)
+        {
+            LOCK(cs_vNodesSnapshot);
+            vNodesSnapshot = std::make_shared<const std::vector<CNode*>>();
+        }
         for (CNode *pnode : vNodes)
             delete pnode;
         for (CNode *pnode : vNodesDisconnected)
@@ -2044,13 +2201,59 @@ instance_of_cnetcleanup;
 
 void RelayTransaction(const CTransaction& tx)
 {
-    LOCK(cs_vNodes);
-    for (CNode* pnode : vNodes)
+    NodesSnapshot vNodesCopy = GetNodesSnapshot();
+    for (CNode* pnode : *vNodesCopy)
     {
         pnode->PushTxInventory(tx.GetWTxId());
     }
 }
 
+static void AddToMsgCmdStats(std::map<std::string, uint64_t>& mapStats, const std::string& strCommand, uint64_t nValue)
+{
+    auto it = mapStats.find(strCommand);
+    if (it == mapStats.end()) {
+        // Peers choose the commands they send, so bound the map.
+        if (mapStats.size() >= MAX_MSG_CMD_STATS) {
+            it = mapStats.emplace("*other*", 0).first;
+        } else {
+            it = mapStats.emplace(strCommand, 0).first;
+        }
+    }
+    it->second += nValue;
+}
+
+void CNode::RecordMsgSent(const std::string& strCommand, uint64_t nBytes)
+{
+    LOCK(cs_msgStats);
+    AddToMsgCmdStats(mapSendBytesPerMsgCmd, strCommand, nBytes);
+}
+
+void CNode::RecordMsgRecv(const std::string& strCommand, uint64_t nBytes)
+{
+    LOCK(cs_msgStats);
+    AddToMsgCmdStats(mapRecvBytesPerMsgCmd, strCommand, nBytes);
+}
+
+void CNode::RecordMsgProcessing(const std::string& strCommand, int64_t nMicros, int64_t nCPUMicros, int64_t nLockWaitMicros)
+{
+    nMicros = std::max<int64_t>(nMicros, 0);
+    nCPUMicros = std::max<int64_t>(nCPUMicros, 0);
+    nLockWaitMicros = std::max<int64_t>(nLockWaitMicros, 0);
+    {
+        LOCK(cs_msgStats);
+        AddToMsgCmdStats(mapProcessTimePerMsgCmd, strCommand, nMicros);
+        AddToMsgCmdStats(mapProcessCPUPerMsgCmd, strCommand, nCPUMicros);
+        AddToMsgCmdStats(mapLockWaitPerMsgCmd, strCommand, nLockWaitMicros);
+    }
+    // The metrics are not labelled by peer, which would make their number
+    // unbounded; getpeerinfo has the per-peer breakdown.
+    MetricsHistogram("zcash.net.in.process.seconds", nMicros / 1000000.0, "command", strCommand.c_str());
+    MetricsCounter("zcash.net.in.process.cpu.micros", nCPUMicros, "command", strCommand.c_str());
+    if (nLockWaitMicros > 0) {
+        MetricsCounter("zcash.net.in.process.lock.wait.micros", nLockWaitMicros, "command", strCommand.c_str());
+    }
+}
+
 void CNode::RecordBytesRecv(uint64_t bytes)
 {
     LOCK(cs_totalBytesRecv);
@@ -2173,21 +2376,21 @@ void CNode::Fuzz(int nChance)
     case 0:
         // xor a random byte with a random value:
         if (!ssSend.empty()) {
-            CDataStream::size_type pos = GetRand(ssSend.size());
+            CPublicDataStream::size_type pos = GetRand(ssSend.size());
             ssSend[pos] ^= (unsigned char)(GetRand(256));
         }
         break;
     case 1:
         // delete a random byte:
         if (!ssSend.empty()) {
-            CDataStream::size_type pos = GetRand(ssSend.size());
+            CPublicDataStream::size_type pos = GetRand(ssSend.size());
             ssSend.erase(ssSend.begin()+pos);
         }
         break;
     case 2:
         // insert a random byte at a random position
         {
-            CDataStream::size_type pos = GetRand(ssSend.size());
+            CPublicDataStream::size_type pos = GetRand(ssSend.size());
             char ch = (char)GetRand(256);
             ssSend.insert(ssSend.begin()+pos, ch);
         }
@@ -2200,6 +2403,14 @@ void CNode::Fuzz(int nChance)
 
 unsigned int ReceiveFloodSize() { return 1000*GetArg("-maxreceivebuffer", DEFAULT_MAXRECEIVEBUFFER); }
 unsigned int SendBufferSize() { return 1000*GetArg("-maxsendbuffer", DEFAULT_MAXSENDBUFFER); }
+size_t BlockSendBufferSize() { return 1000*GetArg("-maxblocksendbuffer", DEFAULT_MAXBLOCKSENDBUFFER); }
+size_t TotalSendSize() { return nTotalSendSize; }
+
+bool CNode::CanQueueBlock() const
+{
+    size_t nSize = nSendSize;
+    return nSize < SendBufferSize() / 4 && (nSize == 0 || nTotalSendSize < BlockSendBufferSize());
+}
 
 CNode::CNode(SOCKET hSocketIn, const CAddress& addrIn, const std::string& addrNameIn, bool fInboundIn) :
     ssSend(SER_NETWORK, INIT_PROTO_VERSION),
@@ -2207,7 +2418,8 @@ CNode::CNode(SOCKET hSocketIn, const CAddress& addrIn, const std::string& addrNa
     addr(addrIn),
     nKeyedNetGroup(CalculateKeyedNetGroup(addrIn)),
     addrKnown(5000, 0.001),
-    filterInventoryKnown(50000, 0.000001)
+    filterInventoryKnown(50000, 0.000001),
+    filterRecentlyAnnounced(INVENTORY_MAX_RECENT_RELAY, 0.000001)
 {
     nServices = 0;
     hSocket = hSocketIn;
@@ -2228,11 +2440,13 @@ CNode::CNode(SOCKET hSocketIn, const CAddress& addrIn, const std::string& addrNa
     fSuccessfullyConnected = false;
     fDisconnect = false;
     nRefCount = 0;
+    nSnapshotRefs = 0;
     nSendSize = 0;
     nSendOffset = 0;
     hashContinue = uint256();
     nStartingHeight = -1;
     fSendMempool = false;
+    nTxReconSalt = 0;
     fGetAddr = false;
     nNextLocalAddrSend = 0;
     nNextAddrSend = 0;
@@ -2241,6 +2455,10 @@ CNode::CNode(SOCKET hSocketIn, const CAddress& addrIn, const std::string& addrNa
     fSentAddr = false;
     pfilter = new CBloomFilter();
     timeLastMempoolReq = 0;
+    minFeeFilter = 0;
+    nUnpaidActionFilter = std::numeric_limits<int64_t>::max();
+    lastSentFeeFilter = -1;
+    lastSentUnpaidActionFilter = -1;
     nPingNonceSent = 0;
     nPingUsecStart = 0;
     nPingUsecTime = 0;
@@ -2268,6 +2486,7 @@ CNode::CNode(SOCKET hSocketIn, const CAddress& addrIn, const std::string& addrNa
 CNode::~CNode()
 {
     CloseSocket(hSocket);
+    nTotalSendSize -= nSendSize;
 
     if (pfilter)
         delete pfilter;
@@ -2373,12 +2592,14 @@ void CNode::EndMessage() UNLOCK_FUNCTION(cs_vSend)
 
     LogPrint("net", "(%d bytes) peer=%d\n", nSize, id);
 
-    std::deque<CSerializeData>::iterator it = vSendMsg.insert(vSendMsg.end(), CSerializeData());
+    std::deque<CPublicSerializeData>::iterator it = vSendMsg.insert(vSendMsg.end(), CPublicSerializeData());
     ssSend.GetAndClear(*it);
     nSendSize += (*it).size();
+    nTotalSendSize += (*it).size();
     MetricsCounter(
         "zcash.net.out.bytes", (*it).size(),
         "command", strSendCommand.c_str());
+    RecordMsgSent(strSendCommand, (*it).size());
     strSendCommand.clear();
 
     // If write queue empty, attempt "optimistic write"
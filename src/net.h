@@ -8,21 +8,25 @@
 #define BITCOIN_NET_H
 
 #include "addrdb.h"
+#include "banindex.h"
 #include "bloom.h"
 #include "compat.h"
 #include "fs.h"
+#include "hash.h"
 #include "limitedmap.h"
 #include "netbase.h"
 #include "protocol.h"
 #include "random.h"
 #include "streams.h"
 #include "sync.h"
+#include "txreconciliation.h"
 #include "uint256.h"
 #include "util/strencodings.h"
 #include "chainparams.h"
 
 #include <atomic>
 #include <deque>
+#include <memory>
 #include <stdint.h>
 
 #ifndef WIN32
@@ -63,6 +67,8 @@ static const unsigned int MAX_PROTOCOL_MESSAGE_LENGTH = 2 * 1024 * 1024;
 static const unsigned int MAX_SUBVERSION_LENGTH = 256;
 /** -listen default */
 static const bool DEFAULT_LISTEN = true;
+/** The number of most recently announced transactions a peer can request from our mempool. */
+static const unsigned int INVENTORY_MAX_RECENT_RELAY = 3500;
 /** The maximum number of entries in mapAskFor */
 static const size_t MAPASKFOR_MAX_SZ = MAX_INV_SZ;
 /** The maximum number of entries in setAskFor (larger due to getdata latency)*/
@@ -79,15 +85,36 @@ static const bool DEFAULT_BLOCKSONLY = false;
  */
 static const int NETWORK_UPGRADE_PEER_PREFERENCE_BLOCK_PERIOD = 1728;
 
+/** -msghandthreads default */
+static const int DEFAULT_MSGHAND_THREADS = 4;
+/** Maximum number of message handler threads */
+static const int MAX_MSGHAND_THREADS = 16;
+/** -maxtxmsgsperround default */
+static const int DEFAULT_MAX_TX_MSGS_PER_ROUND = 32;
+
 static const bool DEFAULT_FORCEDNSSEED = false;
 static const size_t DEFAULT_MAXRECEIVEBUFFER = 5 * 1000;
+/** Maximum total size of the message payload buffers kept for reuse by CNetMessage. */
+static const size_t MAX_RECV_BUFFER_POOL_SIZE = 16 * 1024 * 1024;
+/** Payload buffers are allocated in full for messages up to this size, and grown for larger ones. */
+static const unsigned int RECV_BUFFER_PREALLOCATE_SIZE = 256 * 1024;
+/** The number of message commands whose traffic is counted separately for each
+ *  peer; the traffic of any further commands is counted under "*other*". */
+static const size_t MAX_MSG_CMD_STATS = 64;
 static const size_t DEFAULT_MAXSENDBUFFER    = 1 * 1000;
+/** The default for -maxblocksendbuffer, in units of 1000 bytes. */
+static const size_t DEFAULT_MAXBLOCKSENDBUFFER = 64 * 1000;
 
 // NOTE: When adjusting this, update rpcnet:setban's help ("24h")
 static const unsigned int DEFAULT_MISBEHAVING_BANTIME = 60 * 60 * 24;  // Default 24-hour ban
 
 unsigned int ReceiveFloodSize();
 unsigned int SendBufferSize();
+size_t BlockSendBufferSize();
+//! The total size of the send queues of all connections.
+size_t TotalSendSize();
+
+typedef int64_t NodeId;
 
 void AddOneShot(const std::string& strDest);
 void AddressCurrentlyConnected(const CService& addr);
@@ -95,6 +122,7 @@ CNode* FindNode(const CNetAddr& ip);
 CNode* FindNode(const CSubNet& subNet);
 CNode* FindNode(const std::string& addrName);
 CNode* FindNode(const CService& ip);
+CNode* FindNode(const NodeId id);
 CNode* ConnectNode(CAddress addrConnect, const char *pszDest = NULL);
 bool OpenNetworkConnection(const CAddress& addrConnect, CSemaphoreGrant *grantOutbound = NULL, const char *strDest = NULL, bool fOneShot = false);
 unsigned short GetListenPort();
@@ -103,8 +131,6 @@ void StartNode(boost::thread_group& threadGroup, CScheduler& scheduler);
 bool StopNode();
 void SocketSendData(CNode *pnode);
 
-typedef int64_t NodeId;
-
 struct CombinerAll
 {
     typedef bool result_type;
@@ -124,7 +150,7 @@ struct CombinerAll
 struct CNodeSignals
 {
     boost::signals2::signal<int ()> GetHeight;
-    boost::signals2::signal<bool (const CChainParams&, CNode*), CombinerAll> ProcessMessages;
+    boost::signals2::signal<bool (const CChainParams&, CNode*, int&), CombinerAll> ProcessMessages;
     boost::signals2::signal<bool (const Consensus::Params&, CNode*), CombinerAll> SendMessages;
     boost::signals2::signal<void (NodeId, const CNode*)> InitializeNode;
     boost::signals2::signal<void (NodeId)> FinalizeNode;
@@ -172,6 +198,13 @@ extern int nMaxConnections;
 
 extern std::vector<CNode*> vNodes;
 extern CCriticalSection cs_vNodes;
+
+typedef std::shared_ptr<const std::vector<CNode*>> NodesSnapshot;
+/** Return the connected nodes without taking cs_vNodes. The snapshot is
+ *  replaced whenever a node is added to or removed from vNodes, and the nodes
+ *  in it are not deleted until it is released, so it must not be held for
+ *  long. Disconnected nodes may still appear in it with fDisconnect set. */
+NodesSnapshot GetNodesSnapshot();
 extern limitedmap<WTxId, int64_t> mapAlreadyAskedFor;
 
 extern std::vector<std::string> vAddedNodes;
@@ -212,22 +245,33 @@ public:
     double dPingTime;
     double dPingWait;
     std::string addrLocal;
+    CAmount minFeeFilter;
+    int64_t nUnpaidActionFilter;
     uint64_t m_addr_processed{0};
     uint64_t m_addr_rate_limited{0};
+    std::map<std::string, uint64_t> mapSendBytesPerMsgCmd;
+    std::map<std::string, uint64_t> mapRecvBytesPerMsgCmd;
+    std::map<std::string, uint64_t> mapProcessTimePerMsgCmd;
+    std::map<std::string, uint64_t> mapProcessCPUPerMsgCmd;
+    std::map<std::string, uint64_t> mapLockWaitPerMsgCmd;
 };
 
 
 
 
 class CNetMessage {
+private:
+    mutable CHash256 hasher;        // hash of the data received so far
+    mutable uint256 data_hash;      // set by GetMessageHash()
+
 public:
     bool in_data;                   // parsing header (false) or data (true)
 
-    CDataStream hdrbuf;             // partially received header
+    CPublicDataStream hdrbuf;             // partially received header
     CMessageHeader hdr;             // complete header
     unsigned int nHdrPos;
 
-    CDataStream vRecv;              // received message data
+    CPublicDataStream vRecv;              // received message data
     unsigned int nDataPos;
 
     int64_t nTime;                  // time (in microseconds) of message receipt.
@@ -240,6 +284,12 @@ public:
         nTime = 0;
     }
 
+    CNetMessage(CNetMessage&&) = default;
+    CNetMessage& operator=(CNetMessage&&) = default;
+
+    //! Returns the payload buffer to the pool shared by all peers.
+    ~CNetMessage();
+
     bool complete() const
     {
         if (!in_data)
@@ -253,6 +303,10 @@ public:
         vRecv.SetVersion(nVersionIn);
     }
 
+    //! The double SHA-256 of the message data, which is hashed as it is
+    //! received. The message must be complete.
+    const uint256& GetMessageHash() const;
+
     int readHeader(const char *pch, unsigned int nBytes);
     int readData(const char *pch, unsigned int nBytes);
 };
@@ -265,22 +319,21 @@ public:
     // socket
     std::atomic<uint64_t> nServices;
     SOCKET hSocket;
-    CDataStream ssSend;
+    CPublicDataStream ssSend;
     std::string strSendCommand; // Current command being assembled in ssSend
     size_t nSendSize; // total size of all vSendMsg entries
     size_t nSendOffset; // offset inside the first vSendMsg already sent
-    uint64_t nSendBytes;
-    std::deque<CSerializeData> vSendMsg;
+    std::atomic<uint64_t> nSendBytes;
+    std::deque<CPublicSerializeData> vSendMsg;
     CCriticalSection cs_vSend;
     CCriticalSection cs_hSocket;
-    CCriticalSection cs_vRecv;
 
     CCriticalSection cs_sendProcessing;
 
     std::deque<CInv> vRecvGetData;
     std::deque<CNetMessage> vRecvMsg;
     CCriticalSection cs_vRecvMsg;
-    uint64_t nRecvBytes;
+    std::atomic<uint64_t> nRecvBytes;
     int nRecvVersion;
 
     std::atomic<int64_t> nLastSend;
@@ -313,12 +366,17 @@ public:
     CBloomFilter* pfilter;
     NodeId id;
     std::atomic<int> nRefCount;
+    // Number of node list snapshots this node is part of; see GetNodesSnapshot.
+    std::atomic<int> nSnapshotRefs;
     CRollingBloomFilter addrKnown;
     mutable CCriticalSection cs_addrKnown;
 
     // Inventory based relay
     // This filter is protected by cs_inventory and contains both txids and wtxids.
     CRollingBloomFilter filterInventoryKnown;
+    // Txids of the transactions we announced to this peer most recently, which
+    // it may request from our mempool. Protected by cs_inventory.
+    CRollingBloomFilter filterRecentlyAnnounced;
 
     const uint64_t nKeyedNetGroup;
 
@@ -331,6 +389,8 @@ protected:
     // Denial-of-service detection/prevention
     // Key is IP address, value is banned-until-time
     static banmap_t setBanned;
+    // The subnets of setBanned, indexed for matching addresses against them
+    static CBanIndex banIndex;
     static CCriticalSection cs_setBanned;
     static bool setBannedIsDirty;
 
@@ -369,15 +429,33 @@ public:
     // There is no final sorting before sending, as they are always sent immediately
     // and in the order requested.
     std::vector<uint256> vInventoryBlockToSend;
+    // List of new tips to announce, with headers or cmpctblock if the peer
+    // asked for it, and otherwise with inv.
+    std::vector<uint256> vBlockHashesToAnnounce;
     mutable CCriticalSection cs_inventory;
     std::set<WTxId> setAskFor;
     std::multimap<int64_t, CInv> mapAskFor;
     int64_t nNextInvSend;
     // Used for BIP35 mempool sending, also protected by cs_inventory
     bool fSendMempool;
+    // Set once the peer agreed to reconcile transactions with us, also
+    // protected by cs_inventory.
+    std::unique_ptr<TxReconciliationState> txrecon;
+    // The salt we sent the peer in "sendtxrcncl", or 0 if we did not.
+    uint64_t nTxReconSalt;
 
     // Last time a "MEMPOOL" request was serviced.
     std::atomic<int64_t> timeLastMempoolReq;
+
+    // The filter the peer sent in "feefilter": it does not want to hear about
+    // transactions that pay less than the relay fee at the rate minFeeFilter,
+    // or that have more than nUnpaidActionFilter unpaid actions.
+    CCriticalSection cs_feeFilter;
+    CAmount minFeeFilter;
+    int64_t nUnpaidActionFilter;
+    // The filter we last sent to the peer.
+    CAmount lastSentFeeFilter;
+    int64_t lastSentUnpaidActionFilter;
     // Ping time measurement:
     // The pong reply we're expecting, or 0 if no pong expected.
     std::atomic<uint64_t> nPingNonceSent;
@@ -392,6 +470,17 @@ public:
 
     std::set<uint256> orphan_work_set;
 
+    // Bytes sent and received, including message headers, and microseconds
+    // spent processing received messages, by message command. Processing is
+    // counted as elapsed time, CPU time of the handler thread, and time spent
+    // waiting for locks such as cs_main (only while -lockstats is enabled).
+    mutable CCriticalSection cs_msgStats;
+    std::map<std::string, uint64_t> mapSendBytesPerMsgCmd;
+    std::map<std::string, uint64_t> mapRecvBytesPerMsgCmd;
+    std::map<std::string, uint64_t> mapProcessTimePerMsgCmd;
+    std::map<std::string, uint64_t> mapProcessCPUPerMsgCmd;
+    std::map<std::string, uint64_t> mapLockWaitPerMsgCmd;
+
     CNode(SOCKET hSocketIn, const CAddress &addrIn, const std::string &addrNameIn = "", bool fInboundIn = false);
     ~CNode();
 
@@ -512,6 +601,7 @@ public:
         LOCK(cs_inventory);
         if (!fDisconnect) {
             filterInventoryKnown.insert(wtxid.ToBytes());
+            if (txrecon) txrecon->Remove(wtxid.hash);
         }
     }
 
@@ -520,6 +610,7 @@ public:
         LOCK(cs_inventory);
         if (!fDisconnect) {
             filterInventoryKnown.insert(txid);
+            if (txrecon) txrecon->Remove(txid);
         }
     }
 
@@ -529,10 +620,19 @@ public:
         return filterInventoryKnown.contains(txid);
     }
 
+    bool WasRecentlyAnnounced(const uint256& txid) const
+    {
+        LOCK(cs_inventory);
+        return filterRecentlyAnnounced.contains(txid);
+    }
+
     void PushTxInventory(const WTxId& wtxid)
     {
         LOCK(cs_inventory);
         if (!fDisconnect && !filterInventoryKnown.contains(wtxid.ToBytes())) {
+            // Peers we reconcile with learn about the transaction in the
+            // next round, unless we flood to them.
+            if (txrecon && !txrecon->fFlood && txrecon->Add(wtxid.hash)) return;
             setInventoryTxToSend.insert(wtxid.hash);
         }
     }
@@ -545,8 +645,25 @@ public:
         }
     }
 
+    void PushBlockHash(const uint256& hash)
+    {
+        LOCK(cs_inventory);
+        if (!fDisconnect) {
+            vBlockHashesToAnnounce.push_back(hash);
+        }
+    }
+
     void AskFor(const CInv& inv);
 
+    /**
+     * Whether a block the node asked for can be queued for sending now.
+     * Blocks are only read and queued once the send queue of the node has
+     * drained below a quarter of -maxsendbuffer, and while the send queues of
+     * all connections take less than -maxblocksendbuffer, unless the queue
+     * of the node is empty.
+     */
+    bool CanQueueBlock() const;
+
     // TODO: Document the postcondition of this function.  Is cs_vSend locked?
     void BeginMessage(const char* pszCommand) EXCLUSIVE_LOCK_FUNCTION(cs_vSend);
 
@@ -752,6 +869,10 @@ public:
 
     void copyStats(CNodeStats &stats);
 
+    void RecordMsgSent(const std::string& strCommand, uint64_t nBytes);
+    void RecordMsgRecv(const std::string& strCommand, uint64_t nBytes);
+    void RecordMsgProcessing(const std::string& strCommand, int64_t nMicros, int64_t nCPUMicros, int64_t nLockWaitMicros);
+
     static bool IsWhitelistedRange(const CNetAddr &ip);
     static void AddWhitelistedRange(const CSubNet &subnet);
 
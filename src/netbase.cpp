@@ -26,6 +26,9 @@
 #include <arpa/inet.h>
 #endif
 #include <fcntl.h>
+#ifdef USE_POLL
+#include <poll.h>
+#endif
 #endif
 
 #include <boost/algorithm/string/case_conv.hpp> // for to_lower()
@@ -269,11 +272,18 @@ bool static InterruptibleRecv(uint8_t* data, size_t len, int timeout, SOCKET& hS
                 if (!IsSelectableSocket(hSocket)) {
                     return false;
                 }
+#ifdef USE_POLL
+                struct pollfd pollfd = {};
+                pollfd.fd = hSocket;
+                pollfd.events = POLLIN;
+                int nRet = poll(&pollfd, 1, std::min(endTime - curTime, maxWait));
+#else
                 struct timeval tval = MillisToTimeval(std::min(endTime - curTime, maxWait));
                 fd_set fdset;
                 FD_ZERO(&fdset);
                 FD_SET(hSocket, &fdset);
                 int nRet = select(hSocket + 1, &fdset, NULL, NULL, &tval);
+#endif
                 if (nRet == SOCKET_ERROR) {
                     return false;
                 }
@@ -467,11 +477,18 @@ bool static ConnectSocketDirectly(const CService &addrConnect, SOCKET& hSocketRe
         // WSAEINVAL is here because some legacy version of winsock uses it
         if (nErr == WSAEINPROGRESS || nErr == WSAEWOULDBLOCK || nErr == WSAEINVAL)
         {
+#ifdef USE_POLL
+            struct pollfd pollfd = {};
+            pollfd.fd = hSocket;
+            pollfd.events = POLLIN | POLLOUT;
+            int nRet = poll(&pollfd, 1, nTimeout);
+#else
             struct timeval timeout = MillisToTimeval(nTimeout);
             fd_set fdset;
             FD_ZERO(&fdset);
             FD_SET(hSocket, &fdset);
             int nRet = select(hSocket + 1, NULL, &fdset, NULL, &timeout);
+#endif
             if (nRet == 0)
             {
                 LogPrint("net", "connection to %s timeout\n", addrConnect.ToString());
@@ -1308,6 +1325,17 @@ CSubNet::CSubNet(const CNetAddr &addr):
     network = addr;
 }
 
+CSubNet::CSubNet(const CNetAddr &addr, int nBits):
+    valid(addr.IsValid() && nBits >= 0 && nBits <= 128)
+{
+    memset(netmask, 0, sizeof(netmask));
+    for (int n = 0; n < nBits && n < 128; ++n)
+        netmask[n>>3] |= 1<<(7-(n&7));
+    network = addr;
+    for(int x=0; x<16; ++x)
+        network.ip[x] &= netmask[x];
+}
+
 bool CSubNet::Match(const CNetAddr &addr) const
 {
     if (!valid || !addr.IsValid())
@@ -1377,6 +1405,25 @@ bool CSubNet::IsValid() const
     return valid;
 }
 
+int CSubNet::GetPrefixLength() const
+{
+    int nBits = 0;
+    int n = 0;
+    for (; n < 16 && netmask[n] == 0xff; ++n)
+        nBits += 8;
+    if (n < 16) {
+        int bits = NetmaskBits(netmask[n]);
+        if (bits < 0)
+            return -1;
+        nBits += bits;
+        ++n;
+    }
+    for (; n < 16; ++n)
+        if (netmask[n] != 0x00)
+            return -1;
+    return nBits;
+}
+
 bool operator==(const CSubNet& a, const CSubNet& b)
 {
     return a.valid == b.valid && a.network == b.network && !memcmp(a.netmask, b.netmask, 16);
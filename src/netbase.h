@@ -124,11 +124,20 @@ class CSubNet
         //constructor for single ip subnet (<ipv4>/32 or <ipv6>/128)
         explicit CSubNet(const CNetAddr &addr);
 
+        //constructor for the subnet of addr whose netmask is a prefix of nBits
+        //bits of the 128-bit address, that of IPv4 subnets included
+        CSubNet(const CNetAddr &addr, int nBits);
+
         bool Match(const CNetAddr &addr) const;
 
         std::string ToString() const;
         bool IsValid() const;
 
+        /// The base address of the subnet, with the bits outside the netmask cleared
+        const CNetAddr& GetBaseAddress() const { return network; }
+        /// The length in bits of the netmask if it is a prefix of the 128-bit address, or -1
+        int GetPrefixLength() const;
+
         friend bool operator==(const CSubNet& a, const CSubNet& b);
         friend bool operator!=(const CSubNet& a, const CSubNet& b);
         friend bool operator<(const CSubNet& a, const CSubNet& b);
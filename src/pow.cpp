@@ -7,16 +7,82 @@
 #include "pow.h"
 
 #include "arith_uint256.h"
+#include "cachestats.h"
 #include "chain.h"
 #include "chainparams.h"
 #include "crypto/equihash.h"
+#include "crypto/sha256.h"
+#include "cuckoocache.h"
 #include "primitives/block.h"
+#include "random.h"
+#include "script/sigcache.h"
 #include "streams.h"
 #include "uint256.h"
 
 #include <librustzcash.h>
 #include <rust/equihash.h>
 
+#include <boost/thread.hpp>
+
+namespace {
+
+//! Memory used by the cache of valid Equihash solutions.
+static const size_t EQUIHASH_CACHE_BYTES = 1 << 20;
+
+/**
+ * Hashes of the headers whose Equihash solutions have been found valid, so
+ * that a header that is seen again, such as in the block that follows it or
+ * in another peer's headers message, is not checked again. The block hash
+ * commits to the solution.
+ */
+class CEquihashCache
+{
+private:
+    //! Entries are SHA256(nonce || block hash), so that they cannot be
+    //! chosen to collide in the cache.
+    uint256 nonce;
+    CuckooCache::cache<uint256, SignatureCacheHasher> setValid;
+    boost::shared_mutex cs_equihashcache;
+
+    uint256 ComputeEntry(const uint256& hash) const
+    {
+        uint256 entry;
+        CSHA256().Write(nonce.begin(), 32).Write(hash.begin(), 32).Finalize(entry.begin());
+        return entry;
+    }
+
+public:
+    CEquihashCache()
+    {
+        GetRandBytes(nonce.begin(), 32);
+        setValid.setup_bytes(EQUIHASH_CACHE_BYTES);
+    }
+
+    bool Contains(const uint256& hash)
+    {
+        uint256 entry = ComputeEntry(hash);
+        boost::shared_lock<boost::shared_mutex> lock(cs_equihashcache);
+        return setValid.contains(entry, false);
+    }
+
+    void Insert(const uint256& hash)
+    {
+        uint256 entry = ComputeEntry(hash);
+        boost::unique_lock<boost::shared_mutex> lock(cs_equihashcache);
+        setValid.insert(entry);
+    }
+
+    CCacheStats GetStats()
+    {
+        boost::shared_lock<boost::shared_mutex> lock(cs_equihashcache);
+        return CuckooCacheStats<uint256>(setValid);
+    }
+};
+
+static CEquihashCache equihashCache;
+
+}
+
 unsigned int GetNextWorkRequired(const CBlockIndex* pindexLast, const CBlockHeader *pblock, const Consensus::Params& params)
 {
     unsigned int nProofOfWorkLimit = UintToArith256(params.powLimit).GetCompact();
@@ -122,6 +188,22 @@ bool CheckEquihashSolution(const CBlockHeader *pblock, const Consensus::Params&
         {pblock->nSolution.data(), pblock->nSolution.size()});
 }
 
+bool CheckEquihashSolutionCached(const CBlockHeader *pblock, const Consensus::Params& params)
+{
+    uint256 hash = pblock->GetHash();
+    if (equihashCache.Contains(hash))
+        return true;
+    if (!CheckEquihashSolution(pblock, params))
+        return false;
+    equihashCache.Insert(hash);
+    return true;
+}
+
+CCacheStats GetEquihashCacheStats()
+{
+    return equihashCache.GetStats();
+}
+
 bool CheckProofOfWork(uint256 hash, unsigned int nBits, const Consensus::Params& params)
 {
     bool fNegative;
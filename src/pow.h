@@ -16,6 +16,7 @@ class CBlockIndex;
 class CChainParams;
 class uint256;
 class arith_uint256;
+struct CCacheStats;
 
 unsigned int GetNextWorkRequired(const CBlockIndex* pindexLast, const CBlockHeader *pblock, const Consensus::Params&);
 unsigned int CalculateNextWorkRequired(arith_uint256 bnAvg,
@@ -26,6 +27,13 @@ unsigned int CalculateNextWorkRequired(arith_uint256 bnAvg,
 /** Check whether the Equihash solution in a block header is valid */
 bool CheckEquihashSolution(const CBlockHeader *pblock, const Consensus::Params&);
 
+/** Like CheckEquihashSolution, but remembers the headers whose solutions are
+ *  valid, so that checking one of them again is free. */
+bool CheckEquihashSolutionCached(const CBlockHeader *pblock, const Consensus::Params&);
+
+/** The statistics of the cache used by CheckEquihashSolutionCached. */
+CCacheStats GetEquihashCacheStats();
+
 /** Check whether a block hash satisfies the proof-of-work requirement specified by nBits */
 bool CheckProofOfWork(uint256 hash, unsigned int nBits, const Consensus::Params&);
 arith_uint256 GetBlockProof(const CBlockIndex& block);
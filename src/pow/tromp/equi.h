@@ -53,6 +53,17 @@ bool duped(proof prf);
 // verify Wagner conditions
 int verify(u32 indices[PROOFSIZE], const rust::Box<blake2b::State> ctx);
 
+struct equi;
+
+// Solve with the preallocated memory and the threads of eq. Returns false
+// without a solution if cancelled() is true between two rounds.
+bool equihash_solve(
+  equi& eq,
+  const rust::Box<blake2b::State>& curr_state,
+  std::function<void()>& incrementRuns,
+  std::function<bool(size_t s, const std::vector<uint32_t>&)>& checkSolution,
+  const std::function<bool()>& cancelled);
+
 bool equihash_solve(
   const rust::Box<blake2b::State>& curr_state,
   std::function<void()>& incrementRuns,
@@ -26,7 +26,10 @@
 #include <stdlib.h>
 #include <pthread.h>
 #include <assert.h>
+#include <functional>
 #include <optional>
+#include <thread>
+#include <vector>
 
 typedef uint16_t u16;
 typedef uint64_t u64;
@@ -706,25 +709,40 @@ int verify(u32 indices[PROOFSIZE], const rust::Box<blake2b::State> ctx) {
   return verifyrec(ctx, indices, hash, WK);
 }
 
+// Run one round of the solver on each of its threads.
+void equihash_round(equi& eq, const std::function<void(u32)>& round) {
+  std::vector<std::thread> threads;
+  for (u32 id = 1; id < eq.nthreads; id++)
+    threads.emplace_back(round, id);
+  round(0);
+  for (std::thread& thread : threads)
+    thread.join();
+}
+
 bool equihash_solve(
+  equi& eq,
   const rust::Box<blake2b::State>& curr_state,
   std::function<void()>& incrementRuns,
-  std::function<bool(size_t s, const std::vector<uint32_t>&)>& checkSolution)
+  std::function<bool(size_t s, const std::vector<uint32_t>&)>& checkSolution,
+  const std::function<bool()>& cancelled)
 {
-  // Create solver and initialize it.
-  equi eq(1);
+  // The memory of the solver is reused, only its state is reset.
   eq.setstate(curr_state);
 
   // Initialization done, start algo driver.
-  eq.digit0(0);
+  equihash_round(eq, [&eq](u32 id) { eq.digit0(id); });
   eq.xfull = eq.bfull = eq.hfull = 0;
   eq.showbsizes(0);
   for (u32 r = 1; r < WK; r++) {
-    (r&1) ? eq.digitodd(r, 0) : eq.digiteven(r, 0);
+    if (cancelled())
+      return false;
+    equihash_round(eq, [&eq, r](u32 id) { (r&1) ? eq.digitodd(r, id) : eq.digiteven(r, id); });
     eq.xfull = eq.bfull = eq.hfull = 0;
     eq.showbsizes(r);
   }
-  eq.digitK(0);
+  if (cancelled())
+    return false;
+  equihash_round(eq, [&eq](u32 id) { eq.digitK(id); });
   incrementRuns();
 
   // Decompress solution indices and pass to checkSolution.
@@ -742,4 +760,14 @@ bool equihash_solve(
   return false;
 }
 
+bool equihash_solve(
+  const rust::Box<blake2b::State>& curr_state,
+  std::function<void()>& incrementRuns,
+  std::function<bool(size_t s, const std::vector<uint32_t>&)>& checkSolution)
+{
+  // Create solver and initialize it.
+  equi eq(1);
+  return equihash_solve(eq, curr_state, incrementRuns, checkSolution, []() { return false; });
+}
+
 #endif // ZCASH_POW_TROMP_EQUI_MINER_H
@@ -67,14 +67,17 @@ uint256 CBlock::BuildAuthDataMerkleTree() const
     tree.insert(tree.end(), perfectSize - vtx.size(), uint256());
     assert(tree.size() == perfectSize);
 
+    // Each parent is the hash of its two adjacent children, so a whole layer
+    // is hashed at once.
     int j = 0;
     for (int layerWidth = perfectSize; layerWidth > 1; layerWidth = layerWidth / 2) {
-        for (int i = 0; i < layerWidth; i += 2) {
-            CBLAKE2bWriter ss(SER_GETHASH, 0, ZCASH_AUTH_DATA_HASH_PERSONALIZATION);
-            ss << tree[j + i];
-            ss << tree[j + i + 1];
-            tree.push_back(ss.GetHash());
-        }
+        tree.resize(tree.size() + layerWidth / 2);
+        blake2b::hash_many(
+            32,
+            {ZCASH_AUTH_DATA_HASH_PERSONALIZATION, blake2b::PERSONALBYTES},
+            64,
+            {tree[j].begin(), (size_t)layerWidth * 32},
+            {tree[j + layerWidth].begin(), (size_t)layerWidth / 2 * 32});
 
         // Move to the next layer.
         j += layerWidth;
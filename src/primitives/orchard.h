@@ -16,7 +16,7 @@
 
 class OrchardMerkleFrontier;
 class OrchardWallet;
-namespace orchard { class UnauthorizedBundle; }
+namespace orchard { class ProvenBundle; class UnauthorizedBundle; }
 
 /**
  * The Orchard component of an authorized transaction.
@@ -32,6 +32,7 @@ private:
 
     friend class OrchardMerkleFrontier;
     friend class OrchardWallet;
+    friend class orchard::ProvenBundle;
     friend class orchard::UnauthorizedBundle;
 public:
     OrchardBundle() : inner(orchard_bundle::none()) {}
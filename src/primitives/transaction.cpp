@@ -211,6 +211,14 @@ CTransaction& CTransaction::operator=(const CTransaction &tx) {
     return *this;
 }
 
+void CTransaction::SetContentsKeepingHash(const CTransaction& tx)
+{
+    WTxId wtxidKept = wtxid;
+    *this = tx;
+    *const_cast<uint256*>(&wtxid.hash) = wtxidKept.hash;
+    *const_cast<uint256*>(&wtxid.authDigest) = wtxidKept.authDigest;
+}
+
 CAmount CTransaction::GetValueOut() const
 {
     CAmount nValueOut = 0;
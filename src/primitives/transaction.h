@@ -17,6 +17,7 @@
 #include "consensus/upgrades.h"
 
 #include <array>
+#include <memory>
 #include <variant>
 
 #include "zcash/NoteEncryption.hpp"
@@ -470,6 +471,13 @@ protected:
      */
     CTransaction(const CMutableTransaction &tx, bool evilDeveloperFlag);
 
+    /**
+     * Replace the contents of this transaction with those of tx, keeping the
+     * hash of this one. Used by the wallet to drop the shielded data of old
+     * transactions from memory.
+     */
+    void SetContentsKeepingHash(const CTransaction& tx);
+
 public:
     typedef std::array<unsigned char, 64> joinsplit_sig_t;
 
@@ -908,4 +916,12 @@ struct CMutableTransaction
     uint256 GetAuthDigest() const;
 };
 
+/**
+ * A transaction shared by the mempool, the orphan pool, the relay and the
+ * wallet notifications, so that its shielded bundles are not copied between
+ * them. CTransaction is immutable, so it cannot change under any of them.
+ */
+typedef std::shared_ptr<const CTransaction> CTransactionRef;
+template <typename Tx> static inline CTransactionRef MakeTransactionRef(Tx&& txIn) { return std::make_shared<const CTransaction>(std::forward<Tx>(txIn)); }
+
 #endif // BITCOIN_PRIMITIVES_TRANSACTION_H
@@ -0,0 +1,189 @@
+// Copyright (c) 2026 The Zcash developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or https://www.opensource.org/licenses/mit-license.php .
+
+#include "primitives/transaction_view.h"
+
+#include "serialize.h"
+#include "version.h"
+#include "zcash/NoteEncryption.hpp"
+#include "zcash/Proof.hpp"
+#include "zcash/Zcash.h"
+
+#include <rust/transaction.h>
+
+namespace {
+
+//! The serialized size of a JSDescription, without its proof.
+static const size_t JSDESCRIPTION_SIZE_WITHOUT_PROOF =
+    8 + 8 +                                       // vpub_old, vpub_new
+    32 +                                          // anchor
+    32 * ZC_NUM_JS_INPUTS +                       // nullifiers
+    32 * ZC_NUM_JS_OUTPUTS +                      // commitments
+    32 + 32 +                                     // ephemeralKey, randomSeed
+    32 * ZC_NUM_JS_INPUTS +                       // macs
+    ZCNoteEncryption::CLEN * ZC_NUM_JS_OUTPUTS;   // ciphertexts
+//! 7 compressed G1 points and a compressed G2 point.
+static const size_t PHGR_PROOF_SIZE = 7 * 33 + 65;
+
+static const size_t SAPLING_V4_SPEND_SIZE = 32 + 32 + 32 + 32 + GROTH_PROOF_SIZE + 64;
+static const size_t SAPLING_V4_OUTPUT_SIZE = 32 + 32 + 32 + libzcash::SAPLING_ENCCIPHERTEXT_SIZE + libzcash::SAPLING_OUTCIPHERTEXT_SIZE + GROTH_PROOF_SIZE;
+//! cv, nullifier and rk; the proofs and signatures follow all the spends.
+static const size_t SAPLING_V5_SPEND_SIZE = 32 + 32 + 32;
+//! cv, cmu, ephemeralKey and the ciphertexts; the proofs follow all the outputs.
+static const size_t SAPLING_V5_OUTPUT_SIZE = 32 + 32 + 32 + libzcash::SAPLING_ENCCIPHERTEXT_SIZE + libzcash::SAPLING_OUTCIPHERTEXT_SIZE;
+
+void SkipItems(SpanReader& reader, uint64_t nCount, size_t nItemSize)
+{
+    // Checked before multiplying, so that the count cannot overflow it.
+    if (nCount > reader.size() / nItemSize) {
+        throw std::ios_base::failure("CTransactionView: end of data");
+    }
+    reader.ignore(nCount * nItemSize);
+}
+
+void SkipSaplingV4(SpanReader& reader, uint64_t& nActions)
+{
+    reader.ignore(8); // valueBalanceSapling
+    uint64_t nSpends = ReadCompactSize(reader);
+    SkipItems(reader, nSpends, SAPLING_V4_SPEND_SIZE);
+    uint64_t nOutputs = ReadCompactSize(reader);
+    SkipItems(reader, nOutputs, SAPLING_V4_OUTPUT_SIZE);
+    nActions = nSpends + nOutputs;
+}
+
+void SkipSaplingV5(SpanReader& reader)
+{
+    uint64_t nSpends = ReadCompactSize(reader);
+    SkipItems(reader, nSpends, SAPLING_V5_SPEND_SIZE);
+    uint64_t nOutputs = ReadCompactSize(reader);
+    SkipItems(reader, nOutputs, SAPLING_V5_OUTPUT_SIZE);
+    if (nSpends + nOutputs > 0) {
+        reader.ignore(8); // valueBalanceSapling
+    }
+    if (nSpends > 0) {
+        reader.ignore(32); // anchorSapling
+    }
+    SkipItems(reader, nSpends, GROTH_PROOF_SIZE + 64);  // proofs and spendAuthSigs
+    SkipItems(reader, nOutputs, GROTH_PROOF_SIZE);
+    if (nSpends + nOutputs > 0) {
+        reader.ignore(64); // bindingSigSapling
+    }
+}
+
+void SkipOrchard(SpanReader& reader)
+{
+    uint64_t nActions = ReadCompactSize(reader);
+    SkipItems(reader, nActions, ZC_ZIP225_ORCHARD_ACTION_SIZE);
+    if (nActions == 0) {
+        return;
+    }
+    reader.ignore(
+        ZC_ZIP225_ORCHARD_FLAGS_SIZE +
+        ZC_ZIP225_ORCHARD_VALUE_BALANCE_SIZE +
+        ZC_ZIP225_ORCHARD_ANCHOR_SIZE);
+    uint64_t nProofSize = ReadCompactSize(reader);
+    SkipItems(reader, nProofSize, 1);
+    SkipItems(reader, nActions, ZC_ZIP225_ORCHARD_SPEND_AUTH_SIG_SIZE);
+    reader.ignore(ZC_ZIP225_ORCHARD_BINDING_SIG_SIZE);
+}
+
+}
+
+CTransactionView::CTransactionView(SpanReader& reader) :
+    pBegin(reader.unread_u8()), nVersionGroupId(0), nExpiryHeight(0)
+{
+    // Follows CTransaction::SerializationOp.
+    uint32_t header = ser_readdata32(reader);
+    fOverwintered = header >> 31;
+    nVersion = header & 0x7FFFFFFF;
+    if (fOverwintered) {
+        nVersionGroupId = ser_readdata32(reader);
+    }
+
+    bool isOverwinterV3 =
+        fOverwintered &&
+        nVersionGroupId == OVERWINTER_VERSION_GROUP_ID &&
+        nVersion == OVERWINTER_TX_VERSION;
+    bool isSaplingV4 =
+        fOverwintered &&
+        nVersionGroupId == SAPLING_VERSION_GROUP_ID &&
+        nVersion == SAPLING_TX_VERSION;
+    bool isZip225V5 =
+        fOverwintered &&
+        nVersionGroupId == ZIP225_VERSION_GROUP_ID &&
+        nVersion == ZIP225_TX_VERSION;
+    bool isFuture =
+        fOverwintered &&
+        nVersionGroupId == ZFUTURE_VERSION_GROUP_ID &&
+        nVersion == ZFUTURE_TX_VERSION;
+    if (fOverwintered && !(isOverwinterV3 || isSaplingV4 || isZip225V5 || isFuture)) {
+        throw std::ios_base::failure("Unknown transaction format");
+    }
+
+    if (isZip225V5) {
+        reader.ignore(4); // nConsensusBranchId
+        nLockTime = ser_readdata32(reader);
+        nExpiryHeight = ser_readdata32(reader);
+        reader >> vin;
+        reader >> vout;
+        SkipSaplingV5(reader);
+        SkipOrchard(reader);
+    } else {
+        reader >> vin;
+        reader >> vout;
+        nLockTime = ser_readdata32(reader);
+        if (isOverwinterV3 || isSaplingV4 || isFuture) {
+            nExpiryHeight = ser_readdata32(reader);
+        }
+        uint64_t nSaplingActions = 0;
+        if (isSaplingV4 || isFuture) {
+            SkipSaplingV4(reader, nSaplingActions);
+        }
+        if (nVersion >= 2) {
+            bool useGroth = fOverwintered && nVersion >= SAPLING_TX_VERSION;
+            uint64_t nJoinSplits = ReadCompactSize(reader);
+            SkipItems(reader, nJoinSplits,
+                JSDESCRIPTION_SIZE_WITHOUT_PROOF + (useGroth ? GROTH_PROOF_SIZE : PHGR_PROOF_SIZE));
+            if (nJoinSplits > 0) {
+                reader.ignore(32 + 64); // joinSplitPubKey, joinSplitSig
+            }
+        }
+        if ((isSaplingV4 || isFuture) && nSaplingActions > 0) {
+            reader.ignore(64); // bindingSigSapling
+        }
+    }
+
+    nSize = reader.unread_u8() - pBegin;
+}
+
+void CTransactionView::ComputeDigests() const
+{
+    uint256 hash, authDigest;
+    if (!zcash_transaction_digests(pBegin, nSize, hash.begin(), authDigest.begin())) {
+        throw std::ios_base::failure("CTransactionView: Invalid transaction format");
+    }
+    wtxid.emplace(hash, authDigest);
+}
+
+const uint256& CTransactionView::GetHash() const
+{
+    if (!wtxid) {
+        ComputeDigests();
+    }
+    return wtxid->hash;
+}
+
+const uint256& CTransactionView::GetAuthDigest() const
+{
+    if (!wtxid) {
+        ComputeDigests();
+    }
+    return wtxid->authDigest;
+}
+
+CTransaction CTransactionView::ToTransaction() const
+{
+    SpanReader reader(SER_NETWORK, PROTOCOL_VERSION, pBegin, nSize);
+    return CTransaction(deserialize, reader);
+}
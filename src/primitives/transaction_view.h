@@ -0,0 +1,69 @@
+// Copyright (c) 2026 The Zcash developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or https://www.opensource.org/licenses/mit-license.php .
+
+#ifndef ZCASH_PRIMITIVES_TRANSACTION_VIEW_H
+#define ZCASH_PRIMITIVES_TRANSACTION_VIEW_H
+
+#include "primitives/transaction.h"
+#include "streams.h"
+#include "uint256.h"
+
+#include <optional>
+#include <stdint.h>
+#include <vector>
+
+/**
+ * A serialized transaction of which only the transparent part is decoded.
+ * The shielded components are skipped over without being parsed, and the
+ * txid and auth digest are computed from the serialized bytes when they are
+ * first asked for.
+ *
+ * These digests are those of the CTransaction that the bytes deserialize to
+ * when the bytes are its serialization, as they are in block files. Only
+ * use a view over bytes that this node has not serialized itself where a
+ * wrong txid is harmless.
+ *
+ * The view points to the serialized bytes, which must outlive it. It is
+ * not safe to use from several threads at once.
+ */
+class CTransactionView
+{
+private:
+    const unsigned char* pBegin;
+    size_t nSize;
+
+    mutable std::optional<WTxId> wtxid;
+
+    void ComputeDigests() const;
+
+public:
+    bool fOverwintered;
+    int32_t nVersion;
+    uint32_t nVersionGroupId;
+    std::vector<CTxIn> vin;
+    std::vector<CTxOut> vout;
+    uint32_t nLockTime;
+    uint32_t nExpiryHeight;
+
+    //! Decode the transaction at the start of the unread bytes of the reader,
+    //! and advance the reader past it. Throws std::ios_base::failure if they
+    //! do not start with a transaction in a known format.
+    explicit CTransactionView(SpanReader& reader);
+
+    const unsigned char* data() const { return pBegin; }
+    size_t GetSerializeSize() const { return nSize; }
+
+    bool IsCoinBase() const
+    {
+        return vin.size() == 1 && vin[0].prevout.IsNull();
+    }
+
+    const uint256& GetHash() const;
+    const uint256& GetAuthDigest() const;
+
+    //! Deserialize the whole transaction, parsing its shielded components.
+    CTransaction ToTransaction() const;
+};
+
+#endif // ZCASH_PRIMITIVES_TRANSACTION_VIEW_H
@@ -34,6 +34,22 @@ public:
     {
         uint256 h_sig = ZCJoinSplit::h_sig(jsdesc.randomSeed, jsdesc.nullifiers, joinSplitPubKey);
 
+        if (verifier.batch.has_value()) {
+            return verifier.batch.value()->check_joinsplit(
+                proof,
+                jsdesc.anchor.GetRawBytes(),
+                h_sig.GetRawBytes(),
+                jsdesc.macs[0].GetRawBytes(),
+                jsdesc.macs[1].GetRawBytes(),
+                jsdesc.nullifiers[0].GetRawBytes(),
+                jsdesc.nullifiers[1].GetRawBytes(),
+                jsdesc.commitments[0].GetRawBytes(),
+                jsdesc.commitments[1].GetRawBytes(),
+                jsdesc.vpub_old,
+                jsdesc.vpub_new
+            );
+        }
+
         return sprout::verify(
             proof,
             jsdesc.anchor.GetRawBytes(),
@@ -58,6 +74,10 @@ ProofVerifier ProofVerifier::Disabled() {
     return ProofVerifier(false);
 }
 
+ProofVerifier ProofVerifier::Batch(bool cacheStore) {
+    return ProofVerifier(sprout::init_batch_validator(cacheStore));
+}
+
 bool ProofVerifier::VerifySprout(
     const JSDescription& jsdesc,
     const ed25519::VerificationKey& joinSplitPubKey
@@ -69,3 +89,10 @@ bool ProofVerifier::VerifySprout(
     auto pv = SproutProofVerifier(*this, joinSplitPubKey, jsdesc);
     return std::visit(pv, jsdesc.proof);
 }
+
+bool ProofVerifier::ValidateBatch() {
+    if (!batch.has_value()) {
+        return true;
+    }
+    return batch.value()->validate();
+}
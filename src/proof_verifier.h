@@ -8,13 +8,21 @@
 #include <primitives/transaction.h>
 #include <uint256.h>
 
+#include <optional>
+
 #include <rust/ed25519.h>
+#include <rust/sprout.h>
 
 class ProofVerifier {
 private:
     bool perform_verification;
+    //! Set when Groth16 proofs are queued and checked together.
+    std::optional<rust::Box<sprout::BatchValidator>> batch;
 
     ProofVerifier(bool perform_verification) : perform_verification(perform_verification) { }
+    ProofVerifier(rust::Box<sprout::BatchValidator> batch) : perform_verification(true), batch(std::move(batch)) { }
+
+    friend class SproutProofVerifier;
 
 public:
     // ProofVerifier should never be copied
@@ -32,11 +40,22 @@ public:
     // such as during reindexing.
     static ProofVerifier Disabled();
 
-    // Verifies that the JoinSplit proof is correct.
+    // Creates a verification context that queues Groth16 proofs, to be
+    // checked together by ValidateBatch(). If cacheStore is set, the proofs
+    // that are found valid are added to the bundle validity cache; otherwise
+    // the cached proofs that are looked up are evicted.
+    static ProofVerifier Batch(bool cacheStore);
+
+    // Verifies that the JoinSplit proof is correct. In a batching context,
+    // only checks that the proof can be parsed, and queues it.
     bool VerifySprout(
         const JSDescription& jsdesc,
         const ed25519::VerificationKey& joinSplitPubKey
     );
+
+    // Verifies the proofs queued in a batching context, which cannot be used
+    // afterwards. Returns true in other contexts.
+    bool ValidateBatch();
 };
 
 #endif // ZCASH_PROOF_VERIFIER_H
@@ -73,6 +73,9 @@ enum {
     // Zcash nodes used to support this by default, without advertising this bit,
     // but no longer do as of protocol version 170004 (= NO_BLOOM_VERSION)
     NODE_BLOOM = (1 << 2),
+    // NODE_COMPACT_FILTERS means the node serves the block filters of BIP 157
+    // and 158, and the shielded filters of any other types it has indexed.
+    NODE_COMPACT_FILTERS = (1 << 6),
 
     // Bits 24-31 are reserved for temporary experiments. Just pick a bit that
     // isn't getting used, or one not being used much, and notify the
@@ -129,6 +132,7 @@ enum GetDataMsg : uint32_t {
     MSG_WTX = 5,             //!< Defined in ZIP 239
     // The following can only occur in getdata. Invs always use TX/WTX or BLOCK.
     MSG_FILTERED_BLOCK = 3,  //!< Defined in BIP37
+    MSG_CMPCT_BLOCK = 4,     //!< Defined in BIP152
 };
 
 /** inv message data */
@@ -160,6 +164,7 @@ public:
         case MSG_TX:
         case MSG_BLOCK:
         case MSG_FILTERED_BLOCK:
+        case MSG_CMPCT_BLOCK:
             break;
         case MSG_WTX:
             if (nVersion < CINV_WTX_VERSION) {
@@ -187,6 +192,8 @@ public:
     std::string GetCommand() const;
     std::vector<unsigned char> GetWideHash() const;
     std::string ToString() const;
+    //! Whether this requests a block, in any of its forms.
+    bool IsBlock() const { return type == MSG_BLOCK || type == MSG_FILTERED_BLOCK || type == MSG_CMPCT_BLOCK; }
 
     // TODO: make private (improves encapsulation)
 public:
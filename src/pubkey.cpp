@@ -18,6 +18,43 @@ struct Secp256k1SelfTester
     }
 } SECP256K1_SELFTESTER;
 
+//! Number of parsed public keys that each thread keeps.
+static const size_t PARSED_PUBKEY_CACHE_SIZE = 8;
+
+/**
+ * The public keys that a thread has parsed most recently. The inputs of a
+ * transaction often spend outputs to the same few keys, for instance when
+ * the outputs to one address are consolidated, and the script check threads
+ * take consecutive inputs. Parsing a compressed key takes a square root.
+ */
+class CParsedPubKeyCache
+{
+private:
+    CPubKey keys[PARSED_PUBKEY_CACHE_SIZE];
+    secp256k1_pubkey parsed[PARSED_PUBKEY_CACHE_SIZE];
+    size_t nNext = 0;
+
+public:
+    bool Parse(const CPubKey& key, secp256k1_pubkey& result)
+    {
+        for (size_t i = 0; i < PARSED_PUBKEY_CACHE_SIZE; i++) {
+            if (keys[i] == key) {
+                result = parsed[i];
+                return true;
+            }
+        }
+        if (!secp256k1_ec_pubkey_parse(secp256k1_context_static, &result, key.begin(), key.size())) {
+            return false;
+        }
+        keys[nNext] = key;
+        parsed[nNext] = result;
+        nNext = (nNext + 1) % PARSED_PUBKEY_CACHE_SIZE;
+        return true;
+    }
+};
+
+static thread_local CParsedPubKeyCache parsedPubKeyCache;
+
 } // namespace
 
 bool CPubKey::Verify(const uint256 &hash, const std::vector<unsigned char>& vchSig) const {
@@ -25,7 +62,7 @@ bool CPubKey::Verify(const uint256 &hash, const std::vector<unsigned char>& vchS
         return false;
     secp256k1_pubkey pubkey;
     secp256k1_ecdsa_signature sig;
-    if (!secp256k1_ec_pubkey_parse(secp256k1_context_static, &pubkey, &(*this)[0], size())) {
+    if (!parsedPubKeyCache.Parse(*this, pubkey)) {
         return false;
     }
     if (vchSig.size() == 0) {
@@ -5,11 +5,15 @@
 // file COPYING or https://www.opensource.org/licenses/mit-license.php .
 
 #include "chainparams.h"
+#include "coinssnapshot.h"
 #include "primitives/block.h"
 #include "primitives/transaction.h"
 #include "main.h"
 #include "httpserver.h"
+#include "rpc/jsonwriter.h"
 #include "rpc/server.h"
+#include "shieldedblock.h"
+#include "shieldedblockindex.h"
 #include "streams.h"
 #include "sync.h"
 #include "txmempool.h"
@@ -24,6 +28,10 @@
 using namespace std;
 
 static const size_t MAX_GETUTXOS_OUTPOINTS = 15; //allow a max of 15 outpoints to be queried at once
+static const long MAX_REST_HEADERS_RESULTS = 10000;
+static const int MAX_REST_BLOCKS_RESULTS = 1000;
+//! No block is added to a block range reply once it holds this many bytes
+static const size_t MAX_REST_BLOCKS_REPLY_SIZE = 32 << 20;
 
 enum RetFormat {
     RF_UNDEF,
@@ -59,9 +67,9 @@ struct CCoin {
 };
 
 extern void TxToJSON(const CTransaction& tx, const uint256 hashBlock, UniValue& entry);
-extern UniValue blockToJSON(const CBlock& block, const CBlockIndex* blockindex, bool txDetails = false);
+extern void blockToJSON(const CBlock& block, const CBlockIndex* blockindex, bool txDetails, JSONWriter& out);
 extern UniValue mempoolInfoToJSON();
-extern UniValue mempoolToJSON(bool fVerbose = false);
+extern void mempoolToJSON(bool fVerbose, JSONWriter& out);
 extern void ScriptPubKeyToJSON(const CScript& scriptPubKey, UniValue& out, bool fIncludeHex);
 extern UniValue blockheaderToJSON(const CBlockIndex* blockindex);
 
@@ -131,7 +139,7 @@ static bool rest_headers(HTTPRequest* req,
         return RESTERR(req, HTTP_BAD_REQUEST, "No header count specified. Use /rest/headers/<count>/<hash>.<ext>.");
 
     long count = strtol(path[0].c_str(), NULL, 10);
-    if (count < 1 || count > 2000)
+    if (count < 1 || count > MAX_REST_HEADERS_RESULTS)
         return RESTERR(req, HTTP_BAD_REQUEST, "Header count out of range: " + path[0]);
 
     string hashStr = path[1];
@@ -141,7 +149,7 @@ static bool rest_headers(HTTPRequest* req,
 
     std::vector<const CBlockIndex *> headers;
     headers.reserve(count);
-    CDataStream ssHeader(SER_NETWORK, PROTOCOL_VERSION);
+    CPublicDataStream ssHeader(SER_NETWORK, PROTOCOL_VERSION);
     {
         LOCK(cs_main);
         BlockMap::const_iterator it = mapBlockIndex.find(hash);
@@ -215,6 +223,7 @@ static bool rest_block(HTTPRequest* req,
         return RESTERR(req, HTTP_BAD_REQUEST, "Invalid hash: " + hashStr);
 
     CBlock block;
+    std::vector<uint8_t> vRawBlock;
     CBlockIndex* pblockindex = NULL;
     {
         LOCK(cs_main);
@@ -225,35 +234,38 @@ static bool rest_block(HTTPRequest* req,
         if (fHavePruned && !(pblockindex->nStatus & BLOCK_HAVE_DATA) && pblockindex->nTx > 0)
             return RESTERR(req, HTTP_NOT_FOUND, hashStr + " not available (pruned data)");
 
-        if (!ReadBlockFromDisk(block, pblockindex, Params().GetConsensus()))
+        // The binary and hex formats are served from the stored bytes.
+        if (rf == RF_JSON) {
+            if (!ReadBlockFromDisk(block, pblockindex, Params().GetConsensus()))
+                return RESTERR(req, HTTP_NOT_FOUND, hashStr + " not found");
+        } else if (!ReadRawBlockFromDisk(vRawBlock, pblockindex, Params().MessageStart())) {
             return RESTERR(req, HTTP_NOT_FOUND, hashStr + " not found");
+        }
     }
 
-    CDataStream ssBlock(SER_NETWORK, PROTOCOL_VERSION);
-    ssBlock << block;
-
     switch (rf) {
     case RF_BINARY: {
-        string binaryBlock = ssBlock.str();
+        string binaryBlock(vRawBlock.begin(), vRawBlock.end());
         req->WriteHeader("Content-Type", "application/octet-stream");
         req->WriteReply(HTTP_OK, binaryBlock);
         return true;
     }
 
     case RF_HEX: {
-        string strHex = HexStr(ssBlock.begin(), ssBlock.end()) + "\n";
+        string strHex = HexStr(vRawBlock.begin(), vRawBlock.end()) + "\n";
         req->WriteHeader("Content-Type", "text/plain");
         req->WriteReply(HTTP_OK, strHex);
         return true;
     }
 
     case RF_JSON: {
-        UniValue objBlock;
+        string strJSON;
         {
             LOCK(cs_main);
-            objBlock = blockToJSON(block, pblockindex, showTxDetails);
+            JSONWriter out(strJSON);
+            blockToJSON(block, pblockindex, showTxDetails, out);
         }
-        string strJSON = objBlock.write() + "\n";
+        strJSON += "\n";
         req->WriteHeader("Content-Type", "application/json");
         req->WriteReply(HTTP_OK, strJSON);
         return true;
@@ -278,6 +290,128 @@ static bool rest_block_notxdetails(HTTPRequest* req, const std::string& strURIPa
     return rest_block(req, strURIPart, false);
 }
 
+/**
+ * Parse <start>/<count> and find the blocks of the active chain from height
+ * start on, up to count of them or up to the tip.
+ */
+static bool FindBlockRange(HTTPRequest* req, const std::string& strRange, const std::string& strUsage, std::vector<const CBlockIndex*>& vIndex)
+{
+    vector<string> path;
+    boost::split(path, strRange, boost::is_any_of("/"));
+    int32_t nStart, nCount;
+    if (path.size() != 2 || !ParseInt32(path[0], &nStart) || !ParseInt32(path[1], &nCount))
+        return RESTERR(req, HTTP_BAD_REQUEST, "Invalid block range. Use " + strUsage + ".");
+    if (nStart < 0)
+        return RESTERR(req, HTTP_BAD_REQUEST, "Block height out of range: " + path[0]);
+    if (nCount < 1 || nCount > MAX_REST_BLOCKS_RESULTS)
+        return RESTERR(req, HTTP_BAD_REQUEST, "Block count out of range: " + path[1]);
+
+    LOCK(cs_main);
+    if (nStart > chainActive.Height())
+        return RESTERR(req, HTTP_NOT_FOUND, "Block height out of range: " + path[0]);
+    for (int nHeight = nStart; nHeight <= chainActive.Height() && vIndex.size() < (size_t)nCount; nHeight++) {
+        const CBlockIndex* pindex = chainActive[nHeight];
+        if (fHavePruned && !(pindex->nStatus & BLOCK_HAVE_DATA) && pindex->nTx > 0)
+            return RESTERR(req, HTTP_NOT_FOUND, pindex->GetBlockHash().GetHex() + " not available (pruned data)");
+        vIndex.push_back(pindex);
+    }
+    return true;
+}
+
+static bool WriteBinaryReply(HTTPRequest* req, RetFormat rf, const std::string& strData)
+{
+    switch (rf) {
+    case RF_BINARY: {
+        req->WriteHeader("Content-Type", "application/octet-stream");
+        req->WriteReply(HTTP_OK, strData);
+        return true;
+    }
+
+    case RF_HEX: {
+        string strHex = HexStr(strData.begin(), strData.end()) + "\n";
+        req->WriteHeader("Content-Type", "text/plain");
+        req->WriteReply(HTTP_OK, strHex);
+        return true;
+    }
+
+    default: {
+        return RESTERR(req, HTTP_NOT_FOUND, "output format not found (available: .bin, .hex)");
+    }
+    }
+}
+
+/**
+ * Consecutive blocks of the active chain, as stored on disk, one after the
+ * other. The reply holds fewer blocks than asked for if it reaches the tip
+ * or MAX_REST_BLOCKS_REPLY_SIZE.
+ */
+static bool rest_blocks(HTTPRequest* req, const std::string& strURIPart)
+{
+    if (!CheckWarmup(req))
+        return false;
+    vector<string> params;
+    const RetFormat rf = ParseDataFormat(params, strURIPart);
+    if (rf != RF_BINARY && rf != RF_HEX)
+        return RESTERR(req, HTTP_NOT_FOUND, "output format not found (available: .bin, .hex)");
+
+    std::vector<const CBlockIndex*> vIndex;
+    if (!FindBlockRange(req, params[0], "/rest/blocks/<start>/<count>.<ext>", vIndex))
+        return false;
+
+    // The blocks are read without cs_main, so that a long range does not
+    // hold up validation, and are copied from the block files without being
+    // deserialized.
+    std::string strBlocks;
+    std::vector<uint8_t> vRawBlock;
+    for (const CBlockIndex* pindex : vIndex) {
+        if (strBlocks.size() >= MAX_REST_BLOCKS_REPLY_SIZE)
+            break;
+        if (!ReadRawBlockFromDisk(vRawBlock, pindex, Params().MessageStart()))
+            return RESTERR(req, HTTP_NOT_FOUND, pindex->GetBlockHash().GetHex() + " not found");
+        strBlocks.append(vRawBlock.begin(), vRawBlock.end());
+    }
+
+    return WriteBinaryReply(req, rf, strBlocks);
+}
+
+/**
+ * Consecutive blocks of the active chain as CShieldedCompactBlock, for light
+ * wallet servers. The reply holds fewer blocks than asked for if it reaches
+ * the tip or MAX_REST_BLOCKS_REPLY_SIZE. With -shieldedblockindex, the
+ * compact blocks are copied from the index; blocks that it has not indexed
+ * yet are read from disk and reduced here.
+ */
+static bool rest_shieldedblocks(HTTPRequest* req, const std::string& strURIPart)
+{
+    if (!CheckWarmup(req))
+        return false;
+    vector<string> params;
+    const RetFormat rf = ParseDataFormat(params, strURIPart);
+    if (rf != RF_BINARY && rf != RF_HEX)
+        return RESTERR(req, HTTP_NOT_FOUND, "output format not found (available: .bin, .hex)");
+
+    std::vector<const CBlockIndex*> vIndex;
+    if (!FindBlockRange(req, params[0], "/rest/shieldedblocks/<start>/<count>.<ext>", vIndex))
+        return false;
+
+    CPublicDataStream ssBlocks(SER_NETWORK, PROTOCOL_VERSION);
+    std::vector<unsigned char> vCompactBlock;
+    for (const CBlockIndex* pindex : vIndex) {
+        if (ssBlocks.size() >= MAX_REST_BLOCKS_REPLY_SIZE)
+            break;
+        if (pshieldedblockindex && pshieldedblockindex->LookupBlock(pindex->GetBlockHash(), vCompactBlock)) {
+            ssBlocks.write((const char*)vCompactBlock.data(), vCompactBlock.size());
+            continue;
+        }
+        std::shared_ptr<const CBlock> pblock;
+        if (!ReadBlockFromDisk(pblock, pindex, Params().GetConsensus()))
+            return RESTERR(req, HTTP_NOT_FOUND, pindex->GetBlockHash().GetHex() + " not found");
+        ssBlocks << CShieldedCompactBlock(*pblock, pindex->nHeight);
+    }
+
+    return WriteBinaryReply(req, rf, ssBlocks.str());
+}
+
 // A bit of a hack - dependency on a function defined in rpc/blockchain.cpp
 UniValue getblockchaininfo(const UniValue& params, bool fHelp);
 
@@ -340,9 +474,10 @@ static bool rest_mempool_contents(HTTPRequest* req, const std::string& strURIPar
 
     switch (rf) {
     case RF_JSON: {
-        UniValue mempoolObject = mempoolToJSON(true);
-
-        string strJSON = mempoolObject.write() + "\n";
+        string strJSON;
+        JSONWriter out(strJSON);
+        mempoolToJSON(true, out);
+        strJSON += "\n";
         req->WriteHeader("Content-Type", "application/json");
         req->WriteReply(HTTP_OK, strJSON);
         return true;
@@ -373,7 +508,7 @@ static bool rest_tx(HTTPRequest* req, const std::string& strURIPart)
     if (!GetTransaction(hash, tx, Params().GetConsensus(), hashBlock, true))
         return RESTERR(req, HTTP_NOT_FOUND, hashStr + " not found");
 
-    CDataStream ssTx(SER_NETWORK, PROTOCOL_VERSION);
+    CPublicDataStream ssTx(SER_NETWORK, PROTOCOL_VERSION);
     ssTx << tx;
 
     switch (rf) {
@@ -478,7 +613,7 @@ static bool rest_getutxos(HTTPRequest* req, const std::string& strURIPart)
                 if (fInputParsed) //don't allow sending input over URI and HTTP RAW DATA
                     return RESTERR(req, HTTP_INTERNAL_SERVER_ERROR, "Combination of URI scheme inputs and raw post data is not allowed");
 
-                CDataStream oss(SER_NETWORK, PROTOCOL_VERSION);
+                CPublicDataStream oss(SER_NETWORK, PROTOCOL_VERSION);
                 oss << strRequestMutable;
                 oss >> fCheckMemPool;
                 oss >> vOutPoints;
@@ -509,13 +644,13 @@ static bool rest_getutxos(HTTPRequest* req, const std::string& strURIPart)
     vector<CCoin> outs;
     std::string bitmapStringRepresentation;
     boost::dynamic_bitset<unsigned char> hits(vOutPoints.size());
-    {
-        LOCK2(cs_main, mempool.cs);
-
+    int nBestHeight;
+    uint256 hashBest;
+    // Called with mempool.cs held.
+    auto check = [&](CCoinsView& viewChain) {
         CCoinsViewDummy viewDummy;
         CCoinsViewCache view(&viewDummy);
 
-        CCoinsViewCache& viewChain = *pcoinsTip;
         CCoinsViewMemPool viewMempool(&viewChain, mempool);
 
         if (fCheckMemPool)
@@ -541,6 +676,19 @@ static bool rest_getutxos(HTTPRequest* req, const std::string& strURIPart)
 
             bitmapStringRepresentation.append(hits[i] ? "1" : "0"); // form a binary string representation (human-readable for json output)
         }
+    };
+    // Read from the latest snapshot of the chain state if there is one,
+    // which does not need cs_main.
+    if (auto snapshot = coinsSnapshots.Get()) {
+        LOCK(mempool.cs);
+        check(*snapshot);
+        nBestHeight = snapshot->nHeight;
+        hashBest = snapshot->hashBlock;
+    } else {
+        LOCK2(cs_main, mempool.cs);
+        check(*pcoinsTip);
+        nBestHeight = chainActive.Height();
+        hashBest = chainActive.Tip()->GetBlockHash();
     }
     boost::to_block_range(hits, std::back_inserter(bitmap));
 
@@ -548,8 +696,8 @@ static bool rest_getutxos(HTTPRequest* req, const std::string& strURIPart)
     case RF_BINARY: {
         // serialize data
         // use exact same output as mentioned in Bip64
-        CDataStream ssGetUTXOResponse(SER_NETWORK, PROTOCOL_VERSION);
-        ssGetUTXOResponse << chainActive.Height() << chainActive.Tip()->GetBlockHash() << bitmap << outs;
+        CPublicDataStream ssGetUTXOResponse(SER_NETWORK, PROTOCOL_VERSION);
+        ssGetUTXOResponse << nBestHeight << hashBest << bitmap << outs;
         string ssGetUTXOResponseString = ssGetUTXOResponse.str();
 
         req->WriteHeader("Content-Type", "application/octet-stream");
@@ -558,8 +706,8 @@ static bool rest_getutxos(HTTPRequest* req, const std::string& strURIPart)
     }
 
     case RF_HEX: {
-        CDataStream ssGetUTXOResponse(SER_NETWORK, PROTOCOL_VERSION);
-        ssGetUTXOResponse << chainActive.Height() << chainActive.Tip()->GetBlockHash() << bitmap << outs;
+        CPublicDataStream ssGetUTXOResponse(SER_NETWORK, PROTOCOL_VERSION);
+        ssGetUTXOResponse << nBestHeight << hashBest << bitmap << outs;
         string strHex = HexStr(ssGetUTXOResponse.begin(), ssGetUTXOResponse.end()) + "\n";
 
         req->WriteHeader("Content-Type", "text/plain");
@@ -572,8 +720,8 @@ static bool rest_getutxos(HTTPRequest* req, const std::string& strURIPart)
 
         // pack in some essentials
         // use more or less the same output as mentioned in Bip64
-        objGetUTXOResponse.pushKV("chainHeight", chainActive.Height());
-        objGetUTXOResponse.pushKV("chaintipHash", chainActive.Tip()->GetBlockHash().GetHex());
+        objGetUTXOResponse.pushKV("chainHeight", nBestHeight);
+        objGetUTXOResponse.pushKV("chaintipHash", hashBest.GetHex());
         objGetUTXOResponse.pushKV("bitmap", bitmapStringRepresentation);
 
         UniValue utxos(UniValue::VARR);
@@ -617,6 +765,8 @@ static const struct {
       {"/rest/mempool/info", rest_mempool_info},
       {"/rest/mempool/contents", rest_mempool_contents},
       {"/rest/headers/", rest_headers},
+      {"/rest/blocks/", rest_blocks},
+      {"/rest/shieldedblocks/", rest_shieldedblocks},
       {"/rest/getutxos", rest_getutxos},
 };
 
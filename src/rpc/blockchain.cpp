@@ -5,30 +5,48 @@
 // file COPYING or https://www.opensource.org/licenses/mit-license.php .
 
 #include "amount.h"
+#include "blockfilterindex.h"
+#include "cachestats.h"
 #include "chain.h"
 #include "chainparams.h"
 #include "checkpoints.h"
+#include "coinssnapshot.h"
+#include "coinstats.h"
 #include "consensus/validation.h"
+#include "core_io.h"
 #include "experimental_features.h"
+#include "init.h"
 #include "key_io.h"
 #include "main.h"
+#include "mempoolfeed.h"
 #include "metrics.h"
 #include "primitives/transaction.h"
+#include "rpc/jsonwriter.h"
 #include "rpc/server.h"
+#include "rpc/treestatecache.h"
 #include "streams.h"
 #include "sync.h"
+#include "syncstats.h"
+#include "txdb.h"
+#include "util/strencodings.h"
 #include "util/system.h"
 
+#ifdef ENABLE_WALLET
+#include "wallet/wallet.h"
+#endif
+
 #include <stdint.h>
 
 #include <univalue.h>
 
+#include <algorithm>
+#include <memory>
 #include <optional>
 #include <regex>
 
 using namespace std;
 
-extern void TxToJSON(const CTransaction& tx, const uint256 hashBlock, UniValue& entry);
+extern void TxToJSON(const CTransaction& tx, const uint256 hashBlock, UniValue& entry, unsigned int nFields);
 void ScriptPubKeyToJSON(const CScript& scriptPubKey, UniValue& out, bool fIncludeHex);
 
 double GetDifficultyINTERNAL(const CBlockIndex* blockindex, bool networkDifficulty)
@@ -148,6 +166,20 @@ UniValue blockToDeltasJSON(const CBlock& block, const CBlockIndex* blockindex)
     result.pushKV("version", block.nVersion);
     result.pushKV("merkleroot", block.hashMerkleRoot.GetHex());
 
+    // Look up the spent outputs of all of the inputs of the block at once.
+    std::vector<CSpentIndexKey> vSpentKeys;
+    for (const CTransaction& tx : block.vtx) {
+        if (!tx.IsCoinBase()) {
+            for (const CTxIn& input : tx.vin) {
+                vSpentKeys.emplace_back(input.prevout.hash, input.prevout.n);
+            }
+        }
+    }
+    CSpentIndexMap mapSpentInfo;
+    if (!GetSpentIndex(vSpentKeys, mapSpentInfo)) {
+        throw JSONRPCError(RPC_INTERNAL_ERROR, "Spent information not available");
+    }
+
     KeyIO keyIO(Params());
     UniValue deltas(UniValue::VARR);
     for (unsigned int i = 0; i < block.vtx.size(); i++) {
@@ -163,12 +195,11 @@ UniValue blockToDeltasJSON(const CBlock& block, const CBlockIndex* blockindex)
             for (size_t j = 0; j < tx.vin.size(); j++) {
                 const CTxIn input = tx.vin[j];
                 UniValue delta(UniValue::VOBJ);
-                CSpentIndexValue spentInfo;
-                CSpentIndexKey spentKey(input.prevout.hash, input.prevout.n);
-
-                if (!GetSpentIndex(spentKey, spentInfo)) {
+                auto itSpent = mapSpentInfo.find(CSpentIndexKey(input.prevout.hash, input.prevout.n));
+                if (itSpent == mapSpentInfo.end()) {
                     throw JSONRPCError(RPC_INTERNAL_ERROR, "Spent information not available");
                 }
+                const CSpentIndexValue& spentInfo = itSpent->second;
                 CTxDestination dest = DestFromAddressHash(spentInfo.addressType, spentInfo.addressHash);
                 if (IsValidDestination(dest)) {
                     delta.pushKV("address", keyIO.EncodeDestination(dest));
@@ -222,61 +253,68 @@ UniValue blockToDeltasJSON(const CBlock& block, const CBlockIndex* blockindex)
     return result;
 }
 
-UniValue blockToJSON(const CBlock& block, const CBlockIndex* blockindex, bool txDetails = false)
+void blockToJSON(const CBlock& block, const CBlockIndex* blockindex, bool txDetails, unsigned int nFields, JSONWriter& out)
 {
     AssertLockHeld(cs_main);
     bool nu5Active = Params().GetConsensus().NetworkUpgradeActive(
         blockindex->nHeight, Consensus::UPGRADE_NU5);
 
-    UniValue result(UniValue::VOBJ);
-    result.pushKV("hash", block.GetHash().GetHex());
+    out.BeginObject();
+    out.KV("hash", block.GetHash().GetHex());
     int confirmations = -1;
     // Only report confirmations if the block is on the main chain
     if (chainActive.Contains(blockindex))
         confirmations = chainActive.Height() - blockindex->nHeight + 1;
-    result.pushKV("confirmations", confirmations);
-    result.pushKV("size", (int)::GetSerializeSize(block, SER_NETWORK, PROTOCOL_VERSION));
-    result.pushKV("height", blockindex->nHeight);
-    result.pushKV("version", block.nVersion);
-    result.pushKV("merkleroot", block.hashMerkleRoot.GetHex());
-    result.pushKV("blockcommitments", blockindex->hashBlockCommitments.GetHex());
-    result.pushKV("authdataroot", blockindex->hashAuthDataRoot.GetHex());
-    result.pushKV("finalsaplingroot", blockindex->hashFinalSaplingRoot.GetHex());
+    out.KV("confirmations", confirmations);
+    out.KV("size", (int)::GetSerializeSize(block, SER_NETWORK, PROTOCOL_VERSION));
+    out.KV("height", blockindex->nHeight);
+    out.KV("version", block.nVersion);
+    out.KV("merkleroot", block.hashMerkleRoot.GetHex());
+    out.KV("blockcommitments", blockindex->hashBlockCommitments.GetHex());
+    out.KV("authdataroot", blockindex->hashAuthDataRoot.GetHex());
+    out.KV("finalsaplingroot", blockindex->hashFinalSaplingRoot.GetHex());
     if (nu5Active) {
         auto finalOrchardRootBytes = blockindex->hashFinalOrchardRoot;
-        result.pushKV("finalorchardroot", HexStr(finalOrchardRootBytes.begin(), finalOrchardRootBytes.end()));
+        out.KV("finalorchardroot", HexStr(finalOrchardRootBytes.begin(), finalOrchardRootBytes.end()));
     }
-    result.pushKV("chainhistoryroot", blockindex->hashChainHistoryRoot.GetHex());
-    UniValue txs(UniValue::VARR);
+    out.KV("chainhistoryroot", blockindex->hashChainHistoryRoot.GetHex());
+    // Each transaction is written as soon as it is converted, so that only
+    // one of them is held as a UniValue at a time.
+    out.Key("tx");
+    out.BeginArray();
     for (const CTransaction&tx : block.vtx)
     {
         if(txDetails)
         {
             UniValue objTx(UniValue::VOBJ);
-            TxToJSON(tx, uint256(), objTx);
-            txs.push_back(objTx);
+            TxToJSON(tx, uint256(), objTx, nFields);
+            out.Value(objTx);
         }
         else
-            txs.push_back(tx.GetHash().GetHex());
+            out.Value(tx.GetHash().GetHex());
+    }
+    out.EndArray();
+    out.KV("time", block.GetBlockTime());
+    out.KV("nonce", block.nNonce.GetHex());
+    out.KV("solution", HexStr(block.nSolution));
+    out.KV("bits", strprintf("%08x", block.nBits));
+    out.KV("difficulty", GetDifficulty(blockindex));
+    out.KV("chainwork", blockindex->nChainWork.GetHex());
+    out.KV("anchor", blockindex->hashFinalSproutRoot.GetHex());
+    if (nFields & BLOCK_FIELD_CHAIN_SUPPLY) {
+        out.KV("chainSupply", ValuePoolDesc(std::nullopt, blockindex->nChainTotalSupply, blockindex->nChainSupplyDelta));
+    }
+    if (nFields & BLOCK_FIELD_VALUE_POOLS) {
+        UniValue valuePools(UniValue::VARR);
+        valuePools.push_back(ValuePoolDesc("transparent", blockindex->nChainTransparentValue, blockindex->nTransparentValue));
+        valuePools.push_back(ValuePoolDesc("sprout", blockindex->nChainSproutValue, blockindex->nSproutValue));
+        valuePools.push_back(ValuePoolDesc("sapling", blockindex->nChainSaplingValue, blockindex->nSaplingValue));
+        valuePools.push_back(ValuePoolDesc("orchard", blockindex->nChainOrchardValue, blockindex->nOrchardValue));
+        valuePools.push_back(ValuePoolDesc("lockbox", blockindex->nChainLockboxValue, blockindex->nLockboxValue));
+        out.KV("valuePools", valuePools);
     }
-    result.pushKV("tx", txs);
-    result.pushKV("time", block.GetBlockTime());
-    result.pushKV("nonce", block.nNonce.GetHex());
-    result.pushKV("solution", HexStr(block.nSolution));
-    result.pushKV("bits", strprintf("%08x", block.nBits));
-    result.pushKV("difficulty", GetDifficulty(blockindex));
-    result.pushKV("chainwork", blockindex->nChainWork.GetHex());
-    result.pushKV("anchor", blockindex->hashFinalSproutRoot.GetHex());
-    result.pushKV("chainSupply", ValuePoolDesc(std::nullopt, blockindex->nChainTotalSupply, blockindex->nChainSupplyDelta));
-    UniValue valuePools(UniValue::VARR);
-    valuePools.push_back(ValuePoolDesc("transparent", blockindex->nChainTransparentValue, blockindex->nTransparentValue));
-    valuePools.push_back(ValuePoolDesc("sprout", blockindex->nChainSproutValue, blockindex->nSproutValue));
-    valuePools.push_back(ValuePoolDesc("sapling", blockindex->nChainSaplingValue, blockindex->nSaplingValue));
-    valuePools.push_back(ValuePoolDesc("orchard", blockindex->nChainOrchardValue, blockindex->nOrchardValue));
-    valuePools.push_back(ValuePoolDesc("lockbox", blockindex->nChainLockboxValue, blockindex->nLockboxValue));
-    result.pushKV("valuePools", valuePools);
 
-    {
+    if (nFields & BLOCK_FIELD_TREES) {
         UniValue trees(UniValue::VOBJ);
 
         SaplingMerkleTree saplingTree;
@@ -293,14 +331,30 @@ UniValue blockToJSON(const CBlock& block, const CBlockIndex* blockindex, bool tx
             trees.pushKV("orchard", orchard);
         }
 
-        result.pushKV("trees", trees);
+        out.KV("trees", trees);
     }
 
     if (blockindex->pprev)
-        result.pushKV("previousblockhash", blockindex->pprev->GetBlockHash().GetHex());
+        out.KV("previousblockhash", blockindex->pprev->GetBlockHash().GetHex());
     CBlockIndex *pnext = chainActive.Next(blockindex);
     if (pnext)
-        result.pushKV("nextblockhash", pnext->GetBlockHash().GetHex());
+        out.KV("nextblockhash", pnext->GetBlockHash().GetHex());
+    out.EndObject();
+}
+
+void blockToJSON(const CBlock& block, const CBlockIndex* blockindex, bool txDetails, JSONWriter& out)
+{
+    blockToJSON(block, blockindex, txDetails, BLOCK_FIELDS_DEFAULT, out);
+}
+
+UniValue blockToJSON(const CBlock& block, const CBlockIndex* blockindex, bool txDetails = false)
+{
+    std::string strBlock;
+    JSONWriter out(strBlock);
+    blockToJSON(block, blockindex, txDetails, out);
+    UniValue result;
+    bool fRead = result.read(strBlock);
+    assert(fRead);
     return result;
 }
 
@@ -318,8 +372,9 @@ UniValue getblockcount(const UniValue& params, bool fHelp)
             + HelpExampleRpc("getblockcount", "")
         );
 
-    LOCK(cs_main);
-    return chainActive.Height();
+    // Does not wait for cs_main, which is held while blocks are connected.
+    auto tip = chainActive.TipSnapshot();
+    return tip ? tip->nHeight : -1;
 }
 
 UniValue getbestblockhash(const UniValue& params, bool fHelp)
@@ -335,8 +390,11 @@ UniValue getbestblockhash(const UniValue& params, bool fHelp)
             + HelpExampleRpc("getbestblockhash", "")
         );
 
-    LOCK(cs_main);
-    return chainActive.Tip()->GetBlockHash().GetHex();
+    auto tip = chainActive.TipSnapshot();
+    if (!tip) {
+        throw JSONRPCError(RPC_IN_WARMUP, "No blocks have been loaded");
+    }
+    return tip->hash.GetHex();
 }
 
 UniValue getdifficulty(const UniValue& params, bool fHelp)
@@ -352,16 +410,23 @@ UniValue getdifficulty(const UniValue& params, bool fHelp)
             + HelpExampleRpc("getdifficulty", "")
         );
 
-    LOCK(cs_main);
-    return GetNetworkDifficulty();
+    // The difficulty only depends on the header fields of the tip and its
+    // ancestors, which do not change.
+    auto tip = chainActive.TipSnapshot();
+    if (!tip) {
+        return 1.0;
+    }
+    return GetNetworkDifficulty(tip->pindex);
 }
 
-UniValue mempoolToJSON(bool fVerbose = false)
+void mempoolToJSON(bool fVerbose, JSONWriter& out)
 {
     if (fVerbose)
     {
         LOCK(mempool.cs);
-        UniValue o(UniValue::VOBJ);
+        // Entries are written one at a time rather than added to an object,
+        // which looks for an existing key on every addition.
+        out.BeginObject();
         for (const CTxMemPoolEntry& e : mempool.mapTx)
         {
             const uint256& hash = e.GetTx().GetHash();
@@ -389,31 +454,71 @@ UniValue mempoolToJSON(bool fVerbose = false)
             }
 
             info.pushKV("depends", depends);
-            o.pushKV(hash.ToString(), info);
+            out.KV(hash.ToString(), info);
         }
-        return o;
+        out.EndObject();
     }
     else
     {
         vector<uint256> vtxid;
         mempool.queryHashes(vtxid);
 
-        UniValue a(UniValue::VARR);
+        out.BeginArray();
         for (const uint256& hash : vtxid)
-            a.push_back(hash.ToString());
+            out.Value(hash.ToString());
+        out.EndArray();
+    }
+}
+
+static void getrawmempool_write(const UniValue& params, JSONWriter& out)
+{
+    LOCK(cs_main);
+
+    bool fVerbose = false;
+    if (params.size() > 0)
+        fVerbose = params[0].get_bool();
+
+    bool fMempoolSequence = false;
+    if (params.size() > 1)
+        fMempoolSequence = params[1].get_bool();
+
+    if (fMempoolSequence) {
+        if (fVerbose)
+            throw JSONRPCError(RPC_INVALID_PARAMETER, "Verbose results cannot contain mempool sequence values.");
 
-        return a;
+        // The transaction ids and the sequence number must be taken together.
+        vector<uint256> vtxid;
+        uint64_t nMempoolSequence;
+        {
+            LOCK(mempool.cs);
+            mempool.queryHashes(vtxid);
+            nMempoolSequence = mempool.GetSequence();
+        }
+
+        out.BeginObject();
+        out.Key("txids");
+        out.BeginArray();
+        for (const uint256& hash : vtxid)
+            out.Value(hash.ToString());
+        out.EndArray();
+        out.KV("mempool_sequence", nMempoolSequence);
+        out.EndObject();
+        return;
     }
+
+    mempoolToJSON(fVerbose, out);
 }
 
 UniValue getrawmempool(const UniValue& params, bool fHelp)
 {
-    if (fHelp || params.size() > 1)
+    if (fHelp || params.size() > 2)
         throw runtime_error(
-            "getrawmempool ( verbose )\n"
+            "getrawmempool ( verbose mempool_sequence )\n"
             "\nReturns all transaction ids in memory pool as a json array of string transaction ids.\n"
             "\nArguments:\n"
             "1. verbose           (boolean, optional, default=false) true for a json object, false for array of transaction ids\n"
+            "2. mempool_sequence  (boolean, optional, default=false) If verbose=false, returns a json object with transaction list and\n"
+            "                     the mempool sequence number, as published by the -zmqpubsequence notifier\n"
             "\nResult: (for verbose = false):\n"
             "[                     (json array of string)\n"
             "  \"transactionid\"     (string) The transaction id\n"
@@ -435,18 +540,105 @@ UniValue getrawmempool(const UniValue& params, bool fHelp)
             "       ... ]\n"
             "  }, ...\n"
             "}\n"
+            "\nResult: (for verbose = false and mempool_sequence = true):\n"
+            "{                           (json object)\n"
+            "  \"txids\" : [               (json array of string)\n"
+            "    \"transactionid\"         (string) The transaction id\n"
+            "    ,...\n"
+            "  ],\n"
+            "  \"mempool_sequence\" : n    (numeric) The mempool sequence value\n"
+            "}\n"
             "\nExamples\n"
             + HelpExampleCli("getrawmempool", "true")
             + HelpExampleRpc("getrawmempool", "true")
         );
 
-    LOCK(cs_main);
+    return WriterToUniValue(getrawmempool_write, params);
+}
+
+UniValue getmempoolchanges(const UniValue& params, bool fHelp)
+{
+    if (fHelp || params.size() < 1 || params.size() > 3)
+        throw runtime_error(
+            "getmempoolchanges mempool_sequence ( timeout verbose )\n"
+            "\nReturns the transactions that entered and left the memory pool after the given mempool sequence\n"
+            "number, in order. A client starts from the result of getrawmempool with mempool_sequence = true,\n"
+            "and then follows the changes by passing the mempool_sequence of each result to the next call.\n"
+            "\nIf there are no changes yet, waits for one for up to timeout seconds. Only the last -mempoolfeedsize\n"
+            "changes are kept; a client that has fallen further behind gets an error, and starts again from\n"
+            "getrawmempool.\n"
+            "\nArguments:\n"
+            "1. mempool_sequence  (numeric, required) The mempool sequence number of the last change seen\n"
+            "2. timeout           (numeric, optional, default=0) How long to wait for a change, in seconds (at most "
+                + strprintf("%d", MAX_MEMPOOL_FEED_WAIT) + ")\n"
+            "3. verbose           (boolean, optional, default=false) Include the serialized transactions that entered\n"
+            "                     the memory pool and are still in it\n"
+            "\nResult:\n"
+            "{\n"
+            "  \"mempool_sequence\" : n,   (numeric) The mempool sequence number after the last change\n"
+            "  \"changes\" : [\n"
+            "    {\n"
+            "      \"sequence\" : n,       (numeric) The mempool sequence number after this change\n"
+            "      \"txid\" : \"id\",        (string) The transaction id\n"
+            "      \"type\" : \"type\",      (string) \"added\" or \"removed\"\n"
+            "      \"reason\" : \"reason\",  (string, removed only) Why the transaction left the memory pool: \"block\",\n"
+            "                           \"conflict\", \"expiry\", \"reorg\", \"sizelimit\" or \"unknown\"\n"
+            "      \"hex\" : \"data\"        (string, verbose only) The serialized, hex-encoded transaction\n"
+            "    }, ...\n"
+            "  ]\n"
+            "}\n"
+            "\nExamples\n"
+            + HelpExampleCli("getmempoolchanges", "1234 30")
+            + HelpExampleRpc("getmempoolchanges", "1234, 30")
+        );
+
+    if (pmempoolfeed == NULL)
+        throw JSONRPCError(RPC_MISC_ERROR, "Memory pool changes are not being kept");
+
+    int64_t nSince = params[0].get_int64();
+    if (nSince < 0)
+        throw JSONRPCError(RPC_INVALID_PARAMETER, "Negative mempool sequence number");
+
+    int64_t nTimeout = 0;
+    if (params.size() > 1)
+        nTimeout = params[1].get_int64();
+    if (nTimeout < 0 || nTimeout > MAX_MEMPOOL_FEED_WAIT)
+        throw JSONRPCError(RPC_INVALID_PARAMETER, strprintf("Timeout must be between 0 and %d seconds", MAX_MEMPOOL_FEED_WAIT));
 
     bool fVerbose = false;
-    if (params.size() > 0)
-        fVerbose = params[0].get_bool();
+    if (params.size() > 2)
+        fVerbose = params[2].get_bool();
+
+    std::vector<CMempoolChange> vChanges;
+    uint64_t nSequence;
+    if (!pmempoolfeed->GetChanges(nSince, std::chrono::steady_clock::now() + std::chrono::seconds(nTimeout), vChanges, nSequence))
+        throw JSONRPCError(RPC_MISC_ERROR, strprintf("The memory pool changes after sequence number %d are not kept, call getrawmempool again", nSince));
 
-    return mempoolToJSON(fVerbose);
+    UniValue changes(UniValue::VARR);
+    for (const CMempoolChange& change : vChanges) {
+        UniValue entry(UniValue::VOBJ);
+        entry.pushKV("sequence", change.nSequence);
+        entry.pushKV("txid", change.txid.GetHex());
+        if (change.fAdded) {
+            entry.pushKV("type", "added");
+            if (fVerbose) {
+                // A transaction that has left the memory pool again is
+                // followed by its removal.
+                CTransactionRef tx = mempool.get(change.txid);
+                if (tx)
+                    entry.pushKV("hex", EncodeHexTx(*tx));
+            }
+        } else {
+            entry.pushKV("type", "removed");
+            entry.pushKV("reason", RemovalReasonToString(change.reason));
+        }
+        changes.push_back(entry);
+    }
+
+    UniValue result(UniValue::VOBJ);
+    result.pushKV("mempool_sequence", nSequence);
+    result.pushKV("changes", changes);
+    return result;
 }
 
 // insightexplorer
@@ -541,7 +733,7 @@ UniValue getblockhashes(const UniValue& params, bool fHelp)
     }
     if (fHelp || params.size() < 2)
         throw runtime_error(
-            "getblockhashes high low ( {\"noOrphans\": true|false, \"logicalTimes\": true|false} )\n"
+            "getblockhashes high low ( {\"noOrphans\": true|false, \"logicalTimes\": true|false, \"limit\": n, \"cursor\": \"xxxx\"} )\n"
             "\nReturns array of hashes of blocks within the timestamp range provided,\n"
             "\ngreater or equal to low, less than high.\n"
             + disabledMsg +
@@ -552,6 +744,8 @@ UniValue getblockhashes(const UniValue& params, bool fHelp)
             "    {\n"
             "      \"noOrphans\": true|false      (boolean) will only include blocks on the main chain\n"
             "      \"logicalTimes\": true|false   (boolean) will include logical timestamps with hashes\n"
+            "      \"limit\": n                 (numeric) return at most n hashes, and a cursor if there are more\n"
+            "      \"cursor\": \"xxxx\"          (string) return the hashes after the cursor of the previous page\n"
             "    }\n"
             "\nResult:\n"
             "[\n"
@@ -564,6 +758,11 @@ UniValue getblockhashes(const UniValue& params, bool fHelp)
             "    \"logicalts\": n         (numeric) The logical timestamp\n"
             "  }\n"
             "]\n"
+            "or, if limit or cursor is given\n"
+            "{\n"
+            "  \"blockhashes\": [ ... ]   (array) The block hashes, as above\n"
+            "  \"cursor\": \"xxxx\"        (string, optional) Where the next page starts, if there are more\n"
+            "}\n"
             "\nExamples:\n"
             + HelpExampleCli("getblockhashes", "1558141697 1558141576")
             + HelpExampleRpc("getblockhashes", "1558141697, 1558141576")
@@ -579,6 +778,8 @@ UniValue getblockhashes(const UniValue& params, bool fHelp)
     unsigned int low = params[1].get_int();
     bool fActiveOnly = false;
     bool fLogicalTS = false;
+    int64_t nLimit = 0;
+    std::optional<CTimestampIndexKey> after;
 
     if (params.size() > 2) {
         UniValue noOrphans = find_value(params[2].get_obj(), "noOrphans");
@@ -588,12 +789,38 @@ UniValue getblockhashes(const UniValue& params, bool fHelp)
         UniValue returnLogical = find_value(params[2].get_obj(), "logicalTimes");
         if (!returnLogical.isNull())
             fLogicalTS = returnLogical.get_bool();
+
+        UniValue limitValue = find_value(params[2].get_obj(), "limit");
+        if (!limitValue.isNull()) {
+            nLimit = limitValue.get_int64();
+            if (nLimit <= 0) {
+                throw JSONRPCError(RPC_INVALID_PARAMETER, "Limit must be positive");
+            }
+        }
+
+        UniValue cursorValue = find_value(params[2].get_obj(), "cursor");
+        if (!cursorValue.isNull()) {
+            std::vector<unsigned char> vCursor = ParseHexV(cursorValue, "cursor");
+            try {
+                CDataStream ss(vCursor, SER_DISK, CLIENT_VERSION);
+                CTimestampIndexKey key;
+                ss >> key;
+                if (!ss.empty()) {
+                    throw std::ios_base::failure("trailing data");
+                }
+                after = key;
+            } catch (const std::exception&) {
+                throw JSONRPCError(RPC_INVALID_PARAMETER, "Invalid cursor");
+            }
+        }
     }
+    bool fPaged = nLimit > 0 || after.has_value();
 
     std::vector<std::pair<uint256, unsigned int> > blockHashes;
+    bool fMore = false;
     {
         LOCK(cs_main);
-        if (!GetTimestampIndex(high, low, fActiveOnly, blockHashes)) {
+        if (!GetTimestampIndex(high, low, fActiveOnly, after ? &after.value() : nullptr, nLimit, blockHashes, fMore)) {
             throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY,
                 "No information available for block hashes");
         }
@@ -610,6 +837,16 @@ UniValue getblockhashes(const UniValue& params, bool fHelp)
             result.push_back(it->first.GetHex());
         }
     }
+    if (fPaged) {
+        UniValue page(UniValue::VOBJ);
+        page.pushKV("blockhashes", result);
+        if (fMore) {
+            CDataStream ss(SER_DISK, CLIENT_VERSION);
+            ss << CTimestampIndexKey(blockHashes.back().second, blockHashes.back().first);
+            page.pushKV("cursor", HexStr(ss.begin(), ss.end()));
+        }
+        return page;
+    }
     return result;
 }
 
@@ -713,7 +950,7 @@ UniValue getblockheader(const UniValue& params, bool fHelp)
 
     try {
         if (!fVerbose) {
-            CDataStream ssBlock(SER_NETWORK, PROTOCOL_VERSION);
+            CPublicDataStream ssBlock(SER_NETWORK, PROTOCOL_VERSION);
             ssBlock << pblockindex->GetBlockHeader();
             std::string strHex = HexStr(ssBlock.begin(), ssBlock.end());
             return strHex;
@@ -725,17 +962,169 @@ UniValue getblockheader(const UniValue& params, bool fHelp)
     }
 }
 
-UniValue getblock(const UniValue& params, bool fHelp)
+UniValue getblockfilter(const UniValue& params, bool fHelp)
 {
     if (fHelp || params.size() < 1 || params.size() > 2)
         throw runtime_error(
-            "getblock \"hash|height\" ( verbosity )\n"
+            "getblockfilter \"blockhash\" ( \"filtertype\" )\n"
+            "\nRetrieve a compact filter of a block, as indexed by -blockfilterindex.\n"
+            "\nArguments:\n"
+            "1. \"blockhash\"       (string, required) The hash of the block\n"
+            "2. \"filtertype\"      (string, optional, default=\"basic\") The type of filter: \"basic\" for the\n"
+            "                       scripts of the block as in BIP 158, or \"shielded\" for its nullifiers\n"
+            "\nResult:\n"
+            "{\n"
+            "  \"filter\" : \"hex\",  (string) the hex-encoded filter data\n"
+            "  \"header\" : \"hex\"   (string) the hex-encoded filter header\n"
+            "}\n"
+            "\nExamples:\n"
+            + HelpExampleCli("getblockfilter", "\"00000000c937983704a73af28acdec37b049d214adbda81d7e2a3dd146f6ed09\" \"basic\"")
+            + HelpExampleRpc("getblockfilter", "\"00000000c937983704a73af28acdec37b049d214adbda81d7e2a3dd146f6ed09\", \"basic\"")
+        );
+
+    uint256 hash(ParseHashV(params[0], "blockhash"));
+    BlockFilterType filterType = BlockFilterType::BASIC;
+    if (params.size() > 1) {
+        if (!BlockFilterTypeByName(params[1].get_str(), filterType))
+            throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Unknown filtertype");
+    }
+
+    LOCK(cs_main);
+    CBlockFilterIndex* filterIndex = GetBlockFilterIndex(filterType);
+    if (filterIndex == NULL)
+        throw JSONRPCError(RPC_MISC_ERROR, "Index is not enabled for filtertype " + BlockFilterTypeName(filterType));
+
+    BlockMap::const_iterator it = mapBlockIndex.find(hash);
+    if (it == mapBlockIndex.end())
+        throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Block not found");
+    const CBlockIndex* pblockindex = it->second;
+
+    BlockFilter filter;
+    CBlockFilterHeader entry;
+    if (!filterIndex->LookupFilter(pblockindex, filter) || !filterIndex->LookupFilterHeader(pblockindex, entry)) {
+        std::string strError = "Filter not found.";
+        if (!filterIndex->IsSynced())
+            strError += " Block filters are still in the process of being indexed.";
+        throw JSONRPCError(RPC_MISC_ERROR, strError);
+    }
+
+    UniValue ret(UniValue::VOBJ);
+    ret.pushKV("filter", HexStr(filter.GetEncodedFilter()));
+    ret.pushKV("header", entry.header.GetHex());
+    return ret;
+}
+
+static const struct {
+    const char* name;
+    unsigned int flag;
+} blockFieldNames[] = {
+    {"chainSupply", BLOCK_FIELD_CHAIN_SUPPLY},
+    {"valuePools", BLOCK_FIELD_VALUE_POOLS},
+    {"trees", BLOCK_FIELD_TREES},
+    {"hex", TX_FIELD_HEX},
+    {"transparent", TX_FIELD_TRANSPARENT},
+    {"sprout", TX_FIELD_SPROUT},
+    {"sapling", TX_FIELD_SAPLING},
+    {"orchard", TX_FIELD_ORCHARD},
+    {"shieldedSummary", TX_FIELD_SHIELDED_SUMMARY},
+};
+
+static unsigned int ParseBlockFields(const UniValue& fields, int verbosity)
+{
+    if (verbosity == 0) {
+        throw JSONRPCError(RPC_INVALID_PARAMETER, "Fields can only be selected with verbosity 1 or 2");
+    }
+    unsigned int nFields = 0;
+    for (const UniValue& field : fields.get_array().getValues()) {
+        const std::string& strField = field.get_str();
+        auto it = std::find_if(std::begin(blockFieldNames), std::end(blockFieldNames),
+            [&](const auto& entry) { return strField == entry.name; });
+        if (it == std::end(blockFieldNames)) {
+            throw JSONRPCError(RPC_INVALID_PARAMETER, "Unknown field: " + strField);
+        }
+        if (verbosity < 2 && (it->flag & ~(BLOCK_FIELD_CHAIN_SUPPLY | BLOCK_FIELD_VALUE_POOLS | BLOCK_FIELD_TREES))) {
+            throw JSONRPCError(RPC_INVALID_PARAMETER, "Transaction fields require verbosity 2: " + strField);
+        }
+        nFields |= it->flag;
+    }
+    return nFields;
+}
+
+static void getblock_write(const UniValue& params, JSONWriter& out)
+{
+    LOCK(cs_main);
+
+    std::string strHash = params[0].get_str();
+
+    // If height is supplied, find the hash
+    if (strHash.size() < (2 * sizeof(uint256))) {
+        strHash = chainActive[parseHeightArg(strHash, chainActive.Height())]->GetBlockHash().GetHex();
+    }
+
+    uint256 hash(uint256S(strHash));
+
+    int verbosity = 1;
+    if (params.size() > 1) {
+        if(params[1].isNum()) {
+            verbosity = params[1].get_int();
+        } else {
+            verbosity = params[1].get_bool() ? 1 : 0;
+        }
+    }
+
+    if (verbosity < 0 || verbosity > 2) {
+        throw JSONRPCError(RPC_INVALID_PARAMETER, "Verbosity must be in range from 0 to 2");
+    }
+
+    unsigned int nFields = BLOCK_FIELDS_DEFAULT;
+    if (params.size() > 2 && !params[2].isNull()) {
+        nFields = ParseBlockFields(params[2], verbosity);
+    }
+
+    if (mapBlockIndex.count(hash) == 0)
+        throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Block not found");
+
+    CBlock block;
+    CBlockIndex* pblockindex = mapBlockIndex[hash];
+
+    if (fHavePruned && !(pblockindex->nStatus & BLOCK_HAVE_DATA) && pblockindex->nTx > 0)
+        throw JSONRPCError(RPC_INTERNAL_ERROR, "Block not available (pruned data)");
+
+    if (verbosity == 0)
+    {
+        std::vector<uint8_t> vRawBlock;
+        if (!ReadRawBlockFromDisk(vRawBlock, pblockindex, Params().MessageStart()))
+            throw JSONRPCError(RPC_INTERNAL_ERROR, "Can't read block from disk");
+        out.Value(HexStr(vRawBlock.begin(), vRawBlock.end()));
+        return;
+    }
+
+    if(!ReadBlockFromDisk(block, pblockindex, Params().GetConsensus()))
+        throw JSONRPCError(RPC_INTERNAL_ERROR, "Can't read block from disk");
+
+    blockToJSON(block, pblockindex, verbosity >= 2, nFields, out);
+}
+
+UniValue getblock(const UniValue& params, bool fHelp)
+{
+    if (fHelp || params.size() < 1 || params.size() > 3)
+        throw runtime_error(
+            "getblock \"hash|height\" ( verbosity [\"field\",...] )\n"
             "\nIf verbosity is 0, returns a string that is serialized, hex-encoded data for the block.\n"
             "If verbosity is 1, returns an Object with information about the block.\n"
             "If verbosity is 2, returns an Object with information about the block and information about each transaction. \n"
             "\nArguments:\n"
             "1. \"hash|height\"          (string, required) The block hash or height. Height can be negative where -1 is the last known valid block\n"
             "2. verbosity              (numeric, optional, default=1) 0 for hex encoded data, 1 for a json object, and 2 for json object with transaction data\n"
+            "3. fields                 (array, optional) The groups of optional fields to include, for verbosity 1 or 2. Fields\n"
+            "                          of groups that are not listed are not computed. By default every group but \"shieldedSummary\"\n"
+            "                          is included, and an empty array leaves out all of them.\n"
+            "                          Block fields: \"chainSupply\", \"valuePools\", \"trees\".\n"
+            "                          Transaction fields, for verbosity 2 only: \"hex\", \"transparent\" (vin and vout),\n"
+            "                          \"sprout\" (vjoinsplit, joinSplitPubKey and joinSplitSig), \"sapling\" (valueBalance,\n"
+            "                          valueBalanceZat, vShieldedSpend, vShieldedOutput and bindingSig), \"orchard\", and\n"
+            "                          \"shieldedSummary\", an object with the number of JoinSplits, Sapling spends and\n"
+            "                          outputs and Orchard actions, and the Sapling and Orchard value balances.\n"
             "\nResult (for verbosity = 0):\n"
             "\"data\"             (string) A string that is serialized, hex-encoded data for the block.\n"
             "\nResult (for verbosity = 1):\n"
@@ -804,93 +1193,436 @@ UniValue getblock(const UniValue& params, bool fHelp)
             + HelpExampleRpc("getblock", "\"00000000febc373a1da2bd9f887b105ad79ddc26ac26c2b28652d64e5207c5b5\"")
             + HelpExampleCli("getblock", "12800")
             + HelpExampleRpc("getblock", "12800")
+            + HelpExampleCli("getblock", "12800 2 '[\"transparent\"]'")
+            + HelpExampleRpc("getblock", "12800, 2, [\"transparent\"]")
         );
 
-    LOCK(cs_main);
+    return WriterToUniValue(getblock_write, params);
+}
 
-    std::string strHash = params[0].get_str();
+UniValue gettxoutsetinfo(const UniValue& params, bool fHelp)
+{
+    if (fHelp || params.size() > 1)
+        throw runtime_error(
+            "gettxoutsetinfo ( height )\n"
+            "\nReturns statistics about the unspent transparent transaction output set.\n"
+            "With -txoutsetstats (the default) the statistics are kept up to date as blocks are connected,\n"
+            "and those as of earlier blocks of the active chain are also available. Otherwise this call\n"
+            "reads the whole chain state, which may take some time.\n"
+            "\nArguments:\n"
+            "1. height    (numeric, optional, default=the current height) Return the statistics as of the block\n"
+            "             of the active chain at this height.\n"
+            "\nResult:\n"
+            "{\n"
+            "  \"height\":n,     (numeric) The height of the block\n"
+            "  \"bestblock\": \"hex\",   (string) the hash of the block\n"
+            "  \"transactions\": n,      (numeric) The number of transactions with unspent outputs\n"
+            "  \"txouts\": n,            (numeric) The number of unspent transaction outputs\n"
+            "  \"bogosize\": n,          (numeric) An estimate of the size of the set, independent of how it is stored\n"
+            "  \"lthash\": \"hash\",      (string) A digest of the set of unspent outputs, independent of their order\n"
+            "  \"total_amount\": x.xxx   (numeric) The total amount\n"
+            "}\n"
+            "\nExamples:\n"
+            + HelpExampleCli("gettxoutsetinfo", "")
+            + HelpExampleCli("gettxoutsetinfo", "1000")
+            + HelpExampleRpc("gettxoutsetinfo", "")
+        );
 
-    // If height is supplied, find the hash
-    if (strHash.size() < (2 * sizeof(uint256))) {
-        strHash = chainActive[parseHeightArg(strHash, chainActive.Height())]->GetBlockHash().GetHex();
+    CTxOutSetStats stats;
+    const CBlockIndex* pindex;
+    if (ptxoutsetstats) {
+        LOCK(cs_main);
+        pindex = chainActive.Tip();
+        if (params.size() > 0) {
+            int nHeight = params[0].get_int();
+            if (nHeight < 0 || nHeight > chainActive.Height())
+                throw JSONRPCError(RPC_INVALID_PARAMETER, "Block height out of range");
+            pindex = chainActive[nHeight];
+        }
+        if (pindex == NULL)
+            throw JSONRPCError(RPC_IN_WARMUP, "No blocks have been connected yet");
+        if (!ptxoutsetstats->GetStats(pindex, stats)) {
+            if (!ptxoutsetstats->IsReady())
+                throw JSONRPCError(RPC_IN_WARMUP, "UTXO set statistics are still being computed");
+            throw JSONRPCError(RPC_MISC_ERROR, "UTXO set statistics are not available for this block");
+        }
+    } else {
+        std::vector<std::unique_ptr<CCoinsViewDBCursor>> cursors;
+        {
+            LOCK(cs_main);
+            pindex = chainActive.Tip();
+            if (params.size() > 0 && params[0].get_int() != chainActive.Height())
+                throw JSONRPCError(RPC_INVALID_PARAMETER, "Statistics as of earlier blocks require -txoutsetstats");
+            if (pindex == NULL)
+                throw JSONRPCError(RPC_IN_WARMUP, "No blocks have been connected yet");
+            FlushStateToDisk();
+            cursors = pcoinsdbview->Cursors(GetNumCores());
+        }
+        CTxOutSetAccumulator acc;
+        if (!ScanTxOutSet(cursors, acc, [] { return ShutdownRequested(); }))
+            throw JSONRPCError(RPC_DATABASE_ERROR, "Unable to read UTXO set");
+        stats = acc.Finalize(pindex->nHeight);
     }
 
-    uint256 hash(uint256S(strHash));
+    UniValue ret(UniValue::VOBJ);
+    ret.pushKV("height", (int64_t)stats.nHeight);
+    ret.pushKV("bestblock", pindex->GetBlockHash().GetHex());
+    ret.pushKV("transactions", (int64_t)stats.nTransactions);
+    ret.pushKV("txouts", (int64_t)stats.nTransactionOutputs);
+    ret.pushKV("bogosize", (int64_t)stats.nBogoSize);
+    ret.pushKV("lthash", stats.hashDigest.GetHex());
+    ret.pushKV("total_amount", ValueFromAmount(stats.nTotalAmount));
+    return ret;
+}
 
-    int verbosity = 1;
-    if (params.size() > 1) {
-        if(params[1].isNum()) {
-            verbosity = params[1].get_int();
-        } else {
-            verbosity = params[1].get_bool() ? 1 : 0;
-        }
-    }
+static UniValue DBStatsToJSON(const CDBWrapper& db)
+{
+    UniValue ret(UniValue::VOBJ);
+    // Keys starting with 0xff are not used by any database.
+    ret.pushKV("size_on_disk", (uint64_t)db.EstimateSize('\x00', '\xff'));
+    ret.pushKV("memory_usage", atoi64(db.GetProperty("leveldb.approximate-memory-usage")));
+    ret.pushKV("stats", db.GetProperty("leveldb.stats"));
+    return ret;
+}
 
-    if (verbosity < 0 || verbosity > 2) {
-        throw JSONRPCError(RPC_INVALID_PARAMETER, "Verbosity must be in range from 0 to 2");
+UniValue getdbstats(const UniValue& params, bool fHelp)
+{
+    if (fHelp || params.size() != 0)
+        throw runtime_error(
+            "getdbstats\n"
+            "\nReturns LevelDB statistics for the chain state and block index databases.\n"
+            "\nResult:\n"
+            "{\n"
+            "  \"chainstate\": {           (object) The chain state database\n"
+            "    \"size_on_disk\": n,      (numeric) The approximate size of its tables on disk, in bytes\n"
+            "    \"memory_usage\": n,      (numeric) The approximate memory used by memtables and block cache, in bytes\n"
+            "    \"stats\": \"...\"        (string) The per-level compaction statistics reported by LevelDB\n"
+            "  },\n"
+            "  \"blockindex\": { ... }     (object) The block index database, with the same fields\n"
+            "}\n"
+            "\nExamples:\n"
+            + HelpExampleCli("getdbstats", "")
+            + HelpExampleRpc("getdbstats", "")
+        );
+
+    LOCK(cs_main);
+
+    UniValue ret(UniValue::VOBJ);
+    if (pcoinsdbview != NULL) {
+        ret.pushKV("chainstate", DBStatsToJSON(pcoinsdbview->GetDB()));
     }
+    if (pblocktree != NULL) {
+        ret.pushKV("blockindex", DBStatsToJSON(*pblocktree));
+    }
+    return ret;
+}
 
-    if (mapBlockIndex.count(hash) == 0)
-        throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Block not found");
+UniValue getcachestats(const UniValue& params, bool fHelp)
+{
+    if (fHelp || params.size() != 0)
+        throw runtime_error(
+            "getcachestats\n"
+            "\nReturns how much each of the internal caches has been used since the node started, and how full it is.\n"
+            "The caches are \"signatures\", \"script_executions\", \"equihash_solutions\", \"sapling_bundles\",\n"
+            "\"orchard_bundles\", \"sprout_bundles\", \"tree_states\", the results of z_gettreestate,\n"
+            "\"filterable_blocks\" and \"filtered_blocks\", the blocks recently sent to peers with Bloom filters, the \"coins\",\n"
+            "\"nullifiers\" and \"anchors\" of the chain state cache, \"recent_rejects\", the filter of\n"
+            "recently rejected transactions, \"invalid_txs\", the transactions rejected whatever the chain tip,\n"
+            "and with -insightexplorer, \"spent_index\".\n"
+            "\nResult:\n"
+            "{\n"
+            "  \"name\": {               (object) The statistics of the cache\n"
+            "    \"hits\": n,            (numeric) The number of lookups that found an entry\n"
+            "    \"misses\": n,          (numeric) The number of lookups that did not\n"
+            "    \"insertions\": n,      (numeric) The number of entries added\n"
+            "    \"evictions\": n,       (numeric) The number of entries dropped to make room, or when the cache was flushed\n"
+            "    \"entries\": n,         (numeric) The number of entries the cache holds\n"
+            "    \"max_entries\": n,     (numeric, optional) The number of entries the cache can hold\n"
+            "    \"memory_usage\": n     (numeric, optional) The memory used by the cache, in bytes\n"
+            "  },\n"
+            "  ...\n"
+            "}\n"
+            "\nExamples:\n"
+            + HelpExampleCli("getcachestats", "")
+            + HelpExampleRpc("getcachestats", "")
+        );
 
-    CBlock block;
-    CBlockIndex* pblockindex = mapBlockIndex[hash];
+    UniValue ret(UniValue::VOBJ);
+    for (const auto& [strName, stats] : GetCacheStats()) {
+        UniValue obj(UniValue::VOBJ);
+        obj.pushKV("hits", stats.nHits);
+        obj.pushKV("misses", stats.nMisses);
+        obj.pushKV("insertions", stats.nInsertions);
+        obj.pushKV("evictions", stats.nEvictions);
+        obj.pushKV("entries", stats.nEntries);
+        if (stats.nMaxEntries > 0) {
+            obj.pushKV("max_entries", stats.nMaxEntries);
+        }
+        if (stats.nMemoryUsage > 0) {
+            obj.pushKV("memory_usage", (uint64_t)stats.nMemoryUsage);
+        }
+        ret.pushKV(strName, obj);
+    }
+    return ret;
+}
 
-    if (fHavePruned && !(pblockindex->nStatus & BLOCK_HAVE_DATA) && pblockindex->nTx > 0)
-        throw JSONRPCError(RPC_INTERNAL_ERROR, "Block not available (pruned data)");
+UniValue dumptxoutset(const UniValue& params, bool fHelp)
+{
+    if (fHelp || params.size() != 1)
+        throw runtime_error(
+            "dumptxoutset \"filename\"\n"
+            "\nWrites a snapshot of the chain state at the current tip, which a new node can load with loadtxoutset.\n"
+            "Overwriting an existing file is not permitted. Note this call may take some time, during which no\n"
+            "blocks are connected.\n"
+            "\nArguments:\n"
+            "1. \"filename\"    (string, required) The filename, saved in folder set by zcashd -exportdir option\n"
+            "\nResult:\n"
+            "{\n"
+            "  \"path\": \"path\",           (string) The full path of the snapshot file\n"
+            "  \"base_height\": n,         (numeric) The height of the block the snapshot was taken at\n"
+            "  \"base_hash\": \"hash\",      (string) The hash of that block\n"
+            "  \"records\": n,             (numeric) The number of chain state records written\n"
+            "  \"snapshot_hash\": \"hash\"   (string) The hash that loadtxoutset checks the snapshot against\n"
+            "}\n"
+            "\nExamples:\n"
+            + HelpExampleCli("dumptxoutset", "\"snapshot\"")
+            + HelpExampleRpc("dumptxoutset", "\"snapshot\"")
+        );
 
-    if(!ReadBlockFromDisk(block, pblockindex, Params().GetConsensus()))
-        throw JSONRPCError(RPC_INTERNAL_ERROR, "Can't read block from disk");
+    fs::path exportdir;
+    try {
+        exportdir = GetExportDir();
+    } catch (const std::runtime_error& e) {
+        throw JSONRPCError(RPC_INTERNAL_ERROR, e.what());
+    }
+    if (exportdir.empty()) {
+        throw JSONRPCError(RPC_MISC_ERROR, "Cannot write a snapshot until the zcashd -exportdir option has been set");
+    }
+    std::string unclean = params[0].get_str();
+    std::string clean = SanitizeFilename(unclean);
+    if (clean.compare(unclean) != 0) {
+        throw JSONRPCError(RPC_INVALID_PARAMETER, strprintf("Filename is invalid as only alphanumeric characters are allowed.  Try '%s' instead.", clean));
+    }
+    fs::path path = exportdir / clean;
+    fs::path temppath = exportdir / (clean + ".incomplete");
+    if (fs::exists(path)) {
+        throw JSONRPCError(RPC_INVALID_PARAMETER, "Cannot overwrite existing file " + path.string());
+    }
 
-    if (verbosity == 0)
-    {
-        CDataStream ssBlock(SER_NETWORK, PROTOCOL_VERSION);
-        ssBlock << block;
-        std::string strHex = HexStr(ssBlock.begin(), ssBlock.end());
-        return strHex;
+    LOCK(cs_main);
+    CBlockIndex* pindex = chainActive.Tip();
+    if (!pindex->nChainSaplingValue || !pindex->nChainOrchardValue || !pindex->nChainLockboxValue) {
+        throw JSONRPCError(RPC_MISC_ERROR, "The chain value pool balances are not known; restart with -reindex to compute them");
+    }
+    FlushStateToDisk();
+
+    CCoinsSnapshotMetadata metadata;
+    memcpy(metadata.pchMessageStart, Params().MessageStart(), sizeof(metadata.pchMessageStart));
+    metadata.hashBlock = pindex->GetBlockHash();
+    metadata.nHeight = pindex->nHeight;
+    metadata.nChainTx = pindex->nChainTx;
+    metadata.nChainTotalSupply = pindex->nChainTotalSupply;
+    metadata.nChainTransparentValue = pindex->nChainTransparentValue;
+    metadata.nChainSaplingValue = *pindex->nChainSaplingValue;
+    metadata.nChainOrchardValue = *pindex->nChainOrchardValue;
+    metadata.nChainLockboxValue = *pindex->nChainLockboxValue;
+    metadata.hashAuthDataRoot = pindex->hashAuthDataRoot;
+    metadata.hashChainHistoryRoot = pindex->hashChainHistoryRoot;
+
+    CAutoFile file(fsbridge::fopen(temppath, "wb"), SER_DISK, CLIENT_VERSION);
+    if (file.IsNull()) {
+        throw JSONRPCError(RPC_INVALID_PARAMETER, "Cannot open snapshot file " + temppath.string());
+    }
+    uint256 hashSnapshot;
+    uint64_t nRecords;
+    if (!pcoinsdbview->WriteSnapshot(file, metadata, hashSnapshot, nRecords)) {
+        file.fclose();
+        fs::remove(temppath);
+        throw JSONRPCError(RPC_DATABASE_ERROR, "Failed to write the snapshot, see debug.log for details");
     }
+    FileCommit(file.Get());
+    file.fclose();
+    fs::rename(temppath, path);
 
-    return blockToJSON(block, pblockindex, verbosity >= 2);
+    UniValue ret(UniValue::VOBJ);
+    ret.pushKV("path", path.string());
+    ret.pushKV("base_height", metadata.nHeight);
+    ret.pushKV("base_hash", metadata.hashBlock.GetHex());
+    ret.pushKV("records", nRecords);
+    ret.pushKV("snapshot_hash", hashSnapshot.GetHex());
+    return ret;
 }
 
-UniValue gettxoutsetinfo(const UniValue& params, bool fHelp)
+UniValue loadtxoutset(const UniValue& params, bool fHelp)
 {
-    if (fHelp || params.size() != 0)
+    if (fHelp || params.size() != 1)
         throw runtime_error(
-            "gettxoutsetinfo\n"
-            "\nReturns statistics about the unspent transaction output set.\n"
-            "Note this call may take some time.\n"
+            "loadtxoutset \"path\"\n"
+            "\nLoads a chain state snapshot written by dumptxoutset and makes the block it was taken at the tip,\n"
+            "so that the node only has to download and validate the blocks after it. The snapshot is only\n"
+            "accepted if its hash matches the one built into this node for its height.\n"
+            "The node must not have connected any block but the genesis block, must already have the header\n"
+            "of the snapshot's block, and must not have a wallet loaded. Blocks before the snapshot's block are\n"
+            "never downloaded, as on a pruned node.\n"
+            "\nArguments:\n"
+            "1. \"path\"        (string, required) The snapshot file\n"
             "\nResult:\n"
             "{\n"
-            "  \"height\":n,     (numeric) The current block height (index)\n"
-            "  \"bestblock\": \"hex\",   (string) the best block hash hex\n"
-            "  \"transactions\": n,      (numeric) The number of transactions\n"
-            "  \"txouts\": n,            (numeric) The number of output transactions\n"
-            "  \"bytes_serialized\": n,  (numeric) The serialized size\n"
-            "  \"hash_serialized\": \"hash\",   (string) The serialized hash\n"
-            "  \"total_amount\": x.xxx          (numeric) The total amount\n"
+            "  \"base_height\": n,         (numeric) The height of the block the snapshot was taken at\n"
+            "  \"base_hash\": \"hash\",      (string) The hash of that block\n"
+            "  \"records\": n,             (numeric) The number of chain state records loaded\n"
+            "  \"snapshot_hash\": \"hash\"   (string) The hash of the snapshot\n"
             "}\n"
             "\nExamples:\n"
-            + HelpExampleCli("gettxoutsetinfo", "")
-            + HelpExampleRpc("gettxoutsetinfo", "")
+            + HelpExampleCli("loadtxoutset", "\"/path/to/snapshot\"")
+            + HelpExampleRpc("loadtxoutset", "\"/path/to/snapshot\"")
         );
 
-    UniValue ret(UniValue::VOBJ);
+#ifdef ENABLE_WALLET
+    if (pwalletMain) {
+        throw JSONRPCError(RPC_MISC_ERROR, "Cannot load a snapshot while a wallet is loaded; restart with -disablewallet");
+    }
+#endif
 
-    CCoinsStats stats;
-    FlushStateToDisk();
-    if (pcoinsTip->GetStats(stats)) {
-        ret.pushKV("height", (int64_t)stats.nHeight);
-        ret.pushKV("bestblock", stats.hashBlock.GetHex());
-        ret.pushKV("transactions", (int64_t)stats.nTransactions);
-        ret.pushKV("txouts", (int64_t)stats.nTransactionOutputs);
-        ret.pushKV("bytes_serialized", (int64_t)stats.nSerializedSize);
-        ret.pushKV("hash_serialized", stats.hashSerialized.GetHex());
-        ret.pushKV("total_amount", ValueFromAmount(stats.nTotalAmount));
+    fs::path path(params[0].get_str());
+    CAutoFile file(fsbridge::fopen(path, "rb"), SER_DISK, CLIENT_VERSION);
+    if (file.IsNull()) {
+        throw JSONRPCError(RPC_INVALID_PARAMETER, "Cannot open snapshot file " + path.string());
+    }
+    CCoinsSnapshotMetadata metadata;
+    try {
+        file >> metadata;
+    } catch (const std::exception&) {
+        throw JSONRPCError(RPC_DESERIALIZATION_ERROR, "Snapshot metadata decode failed");
+    }
+    if (memcmp(metadata.pchMessageStart, Params().MessageStart(), sizeof(metadata.pchMessageStart)) != 0) {
+        throw JSONRPCError(RPC_INVALID_PARAMETER, "Snapshot is for a different network");
+    }
+    if (metadata.nVersion != CCoinsSnapshotMetadata::CURRENT_VERSION) {
+        throw JSONRPCError(RPC_INVALID_PARAMETER, strprintf("Unsupported snapshot version %d", metadata.nVersion));
+    }
+    const CAssumeutxoData* assumeutxo = Params().AssumeutxoForHeight(metadata.nHeight);
+    if (assumeutxo == nullptr || assumeutxo->hashBlock != metadata.hashBlock) {
+        throw JSONRPCError(RPC_INVALID_PARAMETER, strprintf(
+            "No snapshot is accepted at height %d with block %s", metadata.nHeight, metadata.hashBlock.GetHex()));
+    }
+    {
+        LOCK(cs_main);
+        if (chainActive.Height() != 0) {
+            throw JSONRPCError(RPC_MISC_ERROR, "Blocks have already been connected; a snapshot can only be loaded by a new node");
+        }
+        if (mapBlockIndex.count(metadata.hashBlock) == 0) {
+            throw JSONRPCError(RPC_MISC_ERROR, "The header of the snapshot's block is not known yet; wait for the headers to sync");
+        }
+    }
+
+    // Check the whole file before touching the chain state.
+    long nRecordsPos = ftell(file.Get());
+    uint256 hashSnapshot;
+    uint64_t nRecords;
+    if (!HashCoinsSnapshot(file, metadata, hashSnapshot, nRecords)) {
+        throw JSONRPCError(RPC_DESERIALIZATION_ERROR, "Snapshot is truncated or malformed");
+    }
+    if (hashSnapshot != assumeutxo->hashSnapshot) {
+        throw JSONRPCError(RPC_INVALID_PARAMETER, strprintf(
+            "Snapshot hash %s does not match the expected %s", hashSnapshot.GetHex(), assumeutxo->hashSnapshot.GetHex()));
+    }
+    if (nRecordsPos < 0 || fseek(file.Get(), nRecordsPos, SEEK_SET) != 0) {
+        throw JSONRPCError(RPC_INTERNAL_ERROR, "Cannot rewind snapshot file");
+    }
+
+    {
+        LOCK(cs_main);
+        if (chainActive.Height() != 0) {
+            throw JSONRPCError(RPC_MISC_ERROR, "Blocks have already been connected; a snapshot can only be loaded by a new node");
+        }
+        if (!ActivateCoinsSnapshot(file, metadata, hashSnapshot, Params())) {
+            throw JSONRPCError(RPC_DATABASE_ERROR, "Failed to load the snapshot, see debug.log for details");
+        }
     }
+
+    // Connect any blocks after the snapshot that have already been downloaded.
+    CValidationState state;
+    ActivateBestChain(state, Params());
+
+    UniValue ret(UniValue::VOBJ);
+    ret.pushKV("base_height", metadata.nHeight);
+    ret.pushKV("base_hash", metadata.hashBlock.GetHex());
+    ret.pushKV("records", nRecords);
+    ret.pushKV("snapshot_hash", hashSnapshot.GetHex());
     return ret;
 }
 
+//! The most outpoints gettxouts looks up at once.
+static const size_t MAX_GETTXOUTS_OUTPOINTS = 1000;
+
+/**
+ * The gettxout results for the outpoints. The coins are read from the
+ * latest published snapshot of the chain state where there is one, so that
+ * only the mempool lock is taken, and each transaction is looked up once.
+ */
+static UniValue TxOutsToJSON(const std::vector<COutPoint>& vOutPoints, bool fMempool)
+{
+    std::map<uint256, std::optional<CCoins>> mapCoins;
+    for (const COutPoint& out : vOutPoints) {
+        mapCoins.emplace(out.hash, std::nullopt);
+    }
+
+    // Called with mempool.cs held.
+    auto lookup = [&](CCoinsView& viewChain) {
+        CCoinsViewMemPool viewMempool(&viewChain, mempool);
+        CCoinsView& view = fMempool ? static_cast<CCoinsView&>(viewMempool) : viewChain;
+        for (auto& [txid, result] : mapCoins) {
+            CCoins coins;
+            if (view.GetCoins(txid, coins)) {
+                if (fMempool)
+                    mempool.pruneSpent(txid, coins); // TODO: this should be done by the CCoinsViewMemPool
+                result = std::move(coins);
+            }
+        }
+    };
+
+    uint256 hashBest;
+    int nBestHeight;
+    if (auto snapshot = coinsSnapshots.Get()) {
+        LOCK(mempool.cs);
+        lookup(*snapshot);
+        hashBest = snapshot->hashBlock;
+        nBestHeight = snapshot->nHeight;
+    } else {
+        LOCK2(cs_main, mempool.cs);
+        lookup(*pcoinsTip);
+        BlockMap::iterator it = mapBlockIndex.find(pcoinsTip->GetBestBlock());
+        CBlockIndex *pindex = it->second;
+        hashBest = pindex->GetBlockHash();
+        nBestHeight = pindex->nHeight;
+    }
+
+    UniValue results(UniValue::VARR);
+    for (const COutPoint& out : vOutPoints) {
+        const std::optional<CCoins>& coins = mapCoins[out.hash];
+        if (!coins || out.n >= coins->vout.size() || coins->vout[out.n].IsNull()) {
+            results.push_back(NullUniValue);
+            continue;
+        }
+
+        UniValue ret(UniValue::VOBJ);
+        ret.pushKV("bestblock", hashBest.GetHex());
+        if ((unsigned int)coins->nHeight == MEMPOOL_HEIGHT)
+            ret.pushKV("confirmations", 0);
+        else
+            ret.pushKV("confirmations", nBestHeight - coins->nHeight + 1);
+        ret.pushKV("value", ValueFromAmount(coins->vout[out.n].nValue));
+        UniValue o(UniValue::VOBJ);
+        ScriptPubKeyToJSON(coins->vout[out.n].scriptPubKey, o, true);
+        ret.pushKV("scriptPubKey", o);
+        ret.pushKV("version", coins->nVersion);
+        ret.pushKV("coinbase", coins->fCoinBase);
+        results.push_back(ret);
+    }
+    return results;
+}
+
 UniValue gettxout(const UniValue& params, bool fHelp)
 {
     if (fHelp || params.size() < 2 || params.size() > 3)
@@ -929,10 +1661,6 @@ UniValue gettxout(const UniValue& params, bool fHelp)
             + HelpExampleRpc("gettxout", "\"txid\", 1")
         );
 
-    LOCK(cs_main);
-
-    UniValue ret(UniValue::VOBJ);
-
     std::string strHash = params[0].get_str();
     uint256 hash(uint256S(strHash));
     int n = params[1].get_int();
@@ -940,35 +1668,63 @@ UniValue gettxout(const UniValue& params, bool fHelp)
     if (params.size() > 2)
         fMempool = params[2].get_bool();
 
-    CCoins coins;
-    if (fMempool) {
-        LOCK(mempool.cs);
-        CCoinsViewMemPool view(pcoinsTip, mempool);
-        if (!view.GetCoins(hash, coins))
-            return NullUniValue;
-        mempool.pruneSpent(hash, coins); // TODO: this should be done by the CCoinsViewMemPool
-    } else {
-        if (!pcoinsTip->GetCoins(hash, coins))
-            return NullUniValue;
-    }
-    if (n<0 || (unsigned int)n>=coins.vout.size() || coins.vout[n].IsNull())
+    if (n < 0)
         return NullUniValue;
+    return TxOutsToJSON({COutPoint(hash, n)}, fMempool)[0];
+}
 
-    BlockMap::iterator it = mapBlockIndex.find(pcoinsTip->GetBestBlock());
-    CBlockIndex *pindex = it->second;
-    ret.pushKV("bestblock", pindex->GetBlockHash().GetHex());
-    if ((unsigned int)coins.nHeight == MEMPOOL_HEIGHT)
-        ret.pushKV("confirmations", 0);
-    else
-        ret.pushKV("confirmations", pindex->nHeight - coins.nHeight + 1);
-    ret.pushKV("value", ValueFromAmount(coins.vout[n].nValue));
-    UniValue o(UniValue::VOBJ);
-    ScriptPubKeyToJSON(coins.vout[n].scriptPubKey, o, true);
-    ret.pushKV("scriptPubKey", o);
-    ret.pushKV("version", coins.nVersion);
-    ret.pushKV("coinbase", coins.fCoinBase);
+UniValue gettxouts(const UniValue& params, bool fHelp)
+{
+    if (fHelp || params.size() < 1 || params.size() > 2)
+        throw runtime_error(
+            "gettxouts [{\"txid\":\"id\",\"vout\":n},...] ( includemempool )\n"
+            "\nReturns details about several transaction outputs at once. This is the same as calling\n"
+            "gettxout for each of them, but all of them are looked up as of the same block.\n"
+            "\nArguments:\n"
+            "1. \"outputs\"      (array, required) The outputs, at most " + strprintf("%d", MAX_GETTXOUTS_OUTPOINTS) + "\n"
+            "     [\n"
+            "       {\n"
+            "         \"txid\":\"id\",    (string, required) The transaction id\n"
+            "         \"vout\":n          (numeric, required) The output number\n"
+            "       }\n"
+            "       ,...\n"
+            "     ]\n"
+            "2. includemempool  (boolean, optional, default=true) Whether to include the mempool\n"
+            "\nResult:\n"
+            "[\n"
+            "  { ... },         (json object) The result of gettxout for the output, or null if it is\n"
+            "                   spent or does not exist\n"
+            "  ,...\n"
+            "]\n"
+            "\nExamples:\n"
+            + HelpExampleCli("gettxouts", "'[{\"txid\":\"id\",\"vout\":0},{\"txid\":\"id\",\"vout\":1}]'")
+            + HelpExampleRpc("gettxouts", "[{\"txid\":\"id\",\"vout\":0},{\"txid\":\"id\",\"vout\":1}]")
+        );
 
-    return ret;
+    const UniValue& outputs = params[0].get_array();
+    if (outputs.size() > MAX_GETTXOUTS_OUTPOINTS)
+        throw JSONRPCError(RPC_INVALID_PARAMETER, strprintf("Too many outputs (max: %d)", MAX_GETTXOUTS_OUTPOINTS));
+    bool fMempool = true;
+    if (params.size() > 1)
+        fMempool = params[1].get_bool();
+
+    std::vector<COutPoint> vOutPoints;
+    for (size_t idx = 0; idx < outputs.size(); idx++) {
+        const UniValue& o = outputs[idx].get_obj();
+
+        uint256 txid = ParseHashO(o, "txid");
+
+        const UniValue& vout_v = find_value(o, "vout");
+        if (!vout_v.isNum())
+            throw JSONRPCError(RPC_INVALID_PARAMETER, "Invalid parameter, missing vout key");
+        int nOutput = vout_v.get_int();
+        if (nOutput < 0)
+            throw JSONRPCError(RPC_INVALID_PARAMETER, "Invalid parameter, vout must be positive");
+
+        vOutPoints.emplace_back(txid, nOutput);
+    }
+
+    return TxOutsToJSON(vOutPoints, fMempool);
 }
 
 UniValue verifychain(const UniValue& params, bool fHelp)
@@ -1079,6 +1835,20 @@ UniValue getblockchaininfo(const UniValue& params, bool fHelp)
             "  \"difficulty\": xxxxxx,     (numeric) the current difficulty\n"
             "  \"verificationprogress\": xxxx, (numeric) estimate of verification progress [0..1]\n"
             "  \"estimatedheight\": xxxx,  (numeric) if syncing, the estimated height of the chain, else the current best height\n"
+            "  \"sync\": {                 (object) block sync throughput over the last minute, and what limits it\n"
+            "     \"download_blocks_per_second\": x.x,  (numeric) blocks received from peers\n"
+            "     \"download_bytes_per_second\": x.x,   (numeric) bytes of blocks received from peers\n"
+            "     \"connect_blocks_per_second\": x.x,   (numeric) blocks connected to the chain\n"
+            "     \"validation_busy\": x.x,   (numeric) fraction of the time spent checking and connecting blocks\n"
+            "     \"flush_busy\": x.x,        (numeric) fraction of the time spent writing blocks and the chainstate to disk\n"
+            "     \"blocks_in_flight\": n,    (numeric) blocks requested from peers and not received yet\n"
+            "     \"blocks_in_flight_limit\": n, (numeric) how many blocks may be requested at once\n"
+            "     \"blocks_waiting\": n,      (numeric) blocks received ahead of the tip and waiting to be connected\n"
+            "     \"dbcache_usage\": n,       (numeric) memory used by the coins cache, in bytes\n"
+            "     \"dbcache_limit\": n,       (numeric) memory the coins cache may use, in bytes\n"
+            "     \"bottleneck\": \"xxxx\"     (string) the stage limiting the sync: \"download\", \"validation\" or \"flush\";\n"
+            "                                 \"none\" after the initial block download, or \"unknown\" until it has been measured\n"
+            "  },\n"
             "  \"chainwork\": \"xxxx\"     (string) total amount of work in active chain, in hexadecimal\n"
             "  \"size_on_disk\": xxxxxx,       (numeric) the estimated size of the block and undo files on disk\n"
             "  \"commitments\": xxxxxx,    (numeric) the current number of note commitments in the commitment tree\n"
@@ -1145,6 +1915,21 @@ UniValue getblockchaininfo(const UniValue& params, bool fHelp)
     else
         obj.pushKV("estimatedheight",       (int)chainActive.Height());
 
+    CSyncStats syncStats = GetSyncStats();
+    UniValue sync(UniValue::VOBJ);
+    sync.pushKV("download_blocks_per_second", syncStats.nDownloadBlocksPerSecond);
+    sync.pushKV("download_bytes_per_second", syncStats.nDownloadBytesPerSecond);
+    sync.pushKV("connect_blocks_per_second", syncStats.nConnectBlocksPerSecond);
+    sync.pushKV("validation_busy", syncStats.nValidationBusy);
+    sync.pushKV("flush_busy", syncStats.nFlushBusy);
+    sync.pushKV("blocks_in_flight", (uint64_t)syncStats.nBlocksInFlight);
+    sync.pushKV("blocks_in_flight_limit", (uint64_t)syncStats.nBlocksInFlightLimit);
+    sync.pushKV("blocks_waiting", (uint64_t)syncStats.nBlocksWaiting);
+    sync.pushKV("dbcache_usage", (uint64_t)syncStats.nCoinsCacheUsage);
+    sync.pushKV("dbcache_limit", (uint64_t)syncStats.nCoinsCacheLimit);
+    sync.pushKV("bottleneck", syncStats.strBottleneck);
+    obj.pushKV("sync", sync);
+
     SproutMerkleTree tree;
     pcoinsTip->GetSproutAnchorAt(pcoinsTip->GetBestAnchor(SPROUT), tree);
     obj.pushKV("commitments",           static_cast<uint64_t>(tree.size()));
@@ -1245,18 +2030,9 @@ UniValue getchaintips(const UniValue& params, bool fHelp)
 
     LOCK(cs_main);
 
-    /* Build up a list of chain tips.  We start with the list of all
-       known blocks, and successively remove blocks that appear as pprev
-       of another block.  */
-    std::set<const CBlockIndex*, CompareBlocksByHeight> setTips;
-    for (const std::pair<const uint256, CBlockIndex*>& item : mapBlockIndex)
-        setTips.insert(item.second);
-    for (const std::pair<const uint256, CBlockIndex*>& item : mapBlockIndex)
-    {
-        const CBlockIndex* pprev = item.second->pprev;
-        if (pprev)
-            setTips.erase(pprev);
-    }
+    /* The blocks that no other block builds on are tracked as the block
+       index grows, so only the tips themselves are visited here.  */
+    std::set<const CBlockIndex*, CompareBlocksByHeight> setTips(setChainTips.begin(), setChainTips.end());
 
     // Always report the currently active tip.
     setTips.insert(chainActive.Tip());
@@ -1363,6 +2139,10 @@ UniValue z_gettreestate(const UniValue& params, bool fHelp)
         throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Requested block is not part of the main chain");
     }
 
+    if (auto cached = treeStateCache.Get(hash)) {
+        return *cached;
+    }
+
     UniValue res(UniValue::VOBJ);
     res.pushKV("hash", pindex->GetBlockHash().GetHex());
     res.pushKV("height", pindex->nHeight);
@@ -1375,7 +2155,7 @@ UniValue z_gettreestate(const UniValue& params, bool fHelp)
         sprout_commitments.pushKV("finalRoot", pindex->hashFinalSproutRoot.GetHex());
         SproutMerkleTree tree;
         if (pcoinsTip->GetSproutAnchorAt(pindex->hashFinalSproutRoot, tree)) {
-            CDataStream s(SER_NETWORK, PROTOCOL_VERSION);
+            CPublicDataStream s(SER_NETWORK, PROTOCOL_VERSION);
             s << tree;
             sprout_commitments.pushKV("finalState", HexStr(s.begin(), s.end()));
         } else {
@@ -1401,7 +2181,7 @@ UniValue z_gettreestate(const UniValue& params, bool fHelp)
         bool need_skiphash = false;
         SaplingMerkleTree tree;
         if (pcoinsTip->GetSaplingAnchorAt(pindex->hashFinalSaplingRoot, tree)) {
-            CDataStream s(SER_NETWORK, PROTOCOL_VERSION);
+            CPublicDataStream s(SER_NETWORK, PROTOCOL_VERSION);
             s << tree;
             sapling_commitments.pushKV("finalState", HexStr(s.begin(), s.end()));
         } else {
@@ -1431,7 +2211,7 @@ UniValue z_gettreestate(const UniValue& params, bool fHelp)
         bool need_skiphash = false;
         OrchardMerkleFrontier tree;
         if (pcoinsTip->GetOrchardAnchorAt(pindex->hashFinalOrchardRoot, tree)) {
-            CDataStream s(SER_NETWORK, PROTOCOL_VERSION);
+            CPublicDataStream s(SER_NETWORK, PROTOCOL_VERSION);
             s << OrchardMerkleFrontierLegacySer(tree);
             orchard_commitments.pushKV("finalState", HexStr(s.begin(), s.end()));
         } else {
@@ -1451,6 +2231,7 @@ UniValue z_gettreestate(const UniValue& params, bool fHelp)
         res.pushKV("orchard", orchard_result);
     }
 
+    treeStateCache.Add(hash, res);
     return res;
 }
 
@@ -1544,6 +2325,12 @@ UniValue mempoolInfoToJSON()
     ret.pushKV("size", (int64_t) mempool.size());
     ret.pushKV("bytes", (int64_t) mempool.GetTotalTxSize());
     ret.pushKV("usage", (int64_t) mempool.DynamicMemoryUsage());
+    ret.pushKV("loaded", (bool) fMempoolLoaded);
+
+    size_t nOrphans, nOrphanUsage;
+    GetOrphanTxStats(nOrphans, nOrphanUsage);
+    ret.pushKV("orphans", (int64_t) nOrphans);
+    ret.pushKV("orphanusage", (int64_t) nOrphanUsage);
 
     if (Params().NetworkIDString() == "regtest") {
         ret.pushKV("fullyNotified", mempool.IsFullyNotified());
@@ -1563,6 +2350,9 @@ UniValue getmempoolinfo(const UniValue& params, bool fHelp)
             "  \"size\": xxxxx                (numeric) Current tx count\n"
             "  \"bytes\": xxxxx               (numeric) Sum of all tx sizes\n"
             "  \"usage\": xxxxx               (numeric) Total memory usage for the mempool\n"
+            "  \"loaded\": true|false         (boolean) Whether the mempool saved at the last shutdown has been loaded\n"
+            "  \"orphans\": xxxxx             (numeric) Number of orphan transactions, whose inputs are not known yet\n"
+            "  \"orphanusage\": xxxxx         (numeric) Memory used by the orphan transactions\n"
             "  \"fullyNotified\": true|false  (boolean, regtest only)\n"
             "                               Whether the node has finished notifying all\n"
             "                               listeners/tests about every transaction currently\n"
@@ -1577,6 +2367,28 @@ UniValue getmempoolinfo(const UniValue& params, bool fHelp)
     return mempoolInfoToJSON();
 }
 
+UniValue savemempool(const UniValue& params, bool fHelp)
+{
+    if (fHelp || params.size() != 0)
+        throw runtime_error(
+            "savemempool\n"
+            "\nDumps the mempool to disk. It will fail until the previous dump is fully loaded.\n"
+            "\nExamples:\n"
+            + HelpExampleCli("savemempool", "")
+            + HelpExampleRpc("savemempool", "")
+        );
+
+    if (!fMempoolLoaded) {
+        throw JSONRPCError(RPC_MISC_ERROR, "The mempool was not loaded yet");
+    }
+
+    if (!DumpMempool()) {
+        throw JSONRPCError(RPC_MISC_ERROR, "Unable to dump mempool to disk");
+    }
+
+    return NullUniValue;
+}
+
 UniValue invalidateblock(const UniValue& params, bool fHelp)
 {
     if (fHelp || params.size() != 1)
@@ -1655,31 +2467,39 @@ UniValue reconsiderblock(const UniValue& params, bool fHelp)
 }
 
 static const CRPCCommand commands[] =
-{ //  category              name                      actor (function)         okSafeMode
-  //  --------------------- ------------------------  -----------------------  ----------
-    { "blockchain",         "getblockchaininfo",      &getblockchaininfo,      true  },
-    { "blockchain",         "getbestblockhash",       &getbestblockhash,       true  },
-    { "blockchain",         "getblockcount",          &getblockcount,          true  },
-    { "blockchain",         "getblock",               &getblock,               true  },
-    { "blockchain",         "getblockhash",           &getblockhash,           true  },
-    { "blockchain",         "getblockheader",         &getblockheader,         true  },
-    { "blockchain",         "getchaintips",           &getchaintips,           true  },
-    { "blockchain",         "z_gettreestate",         &z_gettreestate,         true  },
-    { "blockchain",         "z_getsubtreesbyindex",   &z_getsubtreesbyindex,   true  },
-    { "blockchain",         "getdifficulty",          &getdifficulty,          true  },
-    { "blockchain",         "getmempoolinfo",         &getmempoolinfo,         true  },
-    { "blockchain",         "getrawmempool",          &getrawmempool,          true  },
-    { "blockchain",         "gettxout",               &gettxout,               true  },
-    { "blockchain",         "gettxoutsetinfo",        &gettxoutsetinfo,        true  },
-    { "blockchain",         "verifychain",            &verifychain,            true  },
+{ //  category              name                      actor (function)         okSafeMode okParallel writer
+  //  --------------------- ------------------------  -----------------------  ---------- ---------- ----------------------
+    { "blockchain",         "getblockchaininfo",      &getblockchaininfo,      true,      true  },
+    { "blockchain",         "getbestblockhash",       &getbestblockhash,       true,      true  },
+    { "blockchain",         "getblockcount",          &getblockcount,          true,      true  },
+    { "blockchain",         "getblock",               &getblock,               true,      true,      &getblock_write },
+    { "blockchain",         "getblockhash",           &getblockhash,           true,      true  },
+    { "blockchain",         "getblockheader",         &getblockheader,         true,      true  },
+    { "blockchain",         "getblockfilter",         &getblockfilter,         true,      true  },
+    { "blockchain",         "getchaintips",           &getchaintips,           true,      true  },
+    { "blockchain",         "getdbstats",             &getdbstats,             true,      false },
+    { "blockchain",         "getcachestats",          &getcachestats,          true,      true  },
+    { "blockchain",         "dumptxoutset",           &dumptxoutset,           true,      false },
+    { "blockchain",         "loadtxoutset",           &loadtxoutset,           false,     false },
+    { "blockchain",         "z_gettreestate",         &z_gettreestate,         true,      true  },
+    { "blockchain",         "z_getsubtreesbyindex",   &z_getsubtreesbyindex,   true,      true  },
+    { "blockchain",         "getdifficulty",          &getdifficulty,          true,      true  },
+    { "blockchain",         "getmempoolinfo",         &getmempoolinfo,         true,      true  },
+    { "blockchain",         "getrawmempool",          &getrawmempool,          true,      true,      &getrawmempool_write },
+    { "blockchain",         "getmempoolchanges",      &getmempoolchanges,      true,      true  },
+    { "blockchain",         "savemempool",            &savemempool,            true,      false },
+    { "blockchain",         "gettxout",               &gettxout,               true,      true  },
+    { "blockchain",         "gettxouts",              &gettxouts,              true,      true  },
+    { "blockchain",         "gettxoutsetinfo",        &gettxoutsetinfo,        true,      false },
+    { "blockchain",         "verifychain",            &verifychain,            true,      false },
 
     // insightexplorer
-    { "blockchain",         "getblockdeltas",         &getblockdeltas,         false },
-    { "blockchain",         "getblockhashes",         &getblockhashes,         true  },
+    { "blockchain",         "getblockdeltas",         &getblockdeltas,         false,     true  },
+    { "blockchain",         "getblockhashes",         &getblockhashes,         true,      true  },
 
     /* Not shown in help */
-    { "hidden",             "invalidateblock",        &invalidateblock,        true  },
-    { "hidden",             "reconsiderblock",        &reconsiderblock,        true  },
+    { "hidden",             "invalidateblock",        &invalidateblock,        true,      false },
+    { "hidden",             "reconsiderblock",        &reconsiderblock,        true,      false },
 };
 
 void RegisterBlockchainRPCCommands(CRPCTable &tableRPC)
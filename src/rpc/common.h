@@ -47,17 +47,23 @@ static const CRPCConvertTable rpcCvtTable =
     { "getblockcount",               {{}, {}} },
     { "getbestblockhash",            {{}, {}} },
     { "getdifficulty",               {{}, {}} },
-    { "getrawmempool",               {{}, {o}} },
+    { "getrawmempool",               {{}, {o, o}} },
+    { "getmempoolchanges",           {{o}, {o, o}} },
     { "getblockdeltas",              {{o}, {}} },
     { "getblockhashes",              {{o, o}, {o}} },
     { "getblockhash",                {{o}, {}} },
     { "getblockheader",              {{s}, {o}} },
-    { "getblock",                    {{s}, {o}} },
-    { "gettxoutsetinfo",             {{}, {}} },
+    { "getblock",                    {{s}, {o, o}} },
+    { "gettxoutsetinfo",             {{}, {o}} },
     { "gettxout",                    {{s, o}, {o}} },
+    { "gettxouts",                   {{o}, {o}} },
     { "verifychain",                 {{}, {o, o}} },
     { "getblockchaininfo",           {{}, {}} },
     { "getchaintips",                {{}, {}} },
+    { "getdbstats",                  {{}, {}} },
+    { "getcachestats",               {{}, {}} },
+    { "dumptxoutset",                {{s}, {}} },
+    { "loadtxoutset",                {{s}, {}} },
     { "z_gettreestate",              {{s}, {}} },
     { "z_getsubtreesbyindex",        {{s, o}, {o}} },
     { "getmempoolinfo",              {{}, {}} },
@@ -92,6 +98,7 @@ static const CRPCConvertTable rpcCvtTable =
     { "getaddresstxids",             {{o}, {}} },
     { "getspentinfo",                {{o}, {}} },
     { "getmemoryinfo",               {{}, {}} },
+    { "getlockstats",                {{}, {o}} },
     // net
     { "getconnectioncount",          {{}, {}} },
     { "ping",                        {{}, {}} },
@@ -114,6 +121,7 @@ static const CRPCConvertTable rpcCvtTable =
     { "decodescript",                {{s}, {}} },
     { "signrawtransaction",          {{s}, {o, o, s, s}} },
     { "sendrawtransaction",          {{s}, {o}} },
+    { "sendrawtransactions",         {{o}, {o}} },
     // rpcdisclosure
     { "z_getpaymentdisclosure",      {{s, o, o}, {s}} },
     { "z_validatepaymentdisclosure", {{s}, {}} },
@@ -161,7 +169,7 @@ static const CRPCConvertTable rpcCvtTable =
     { "z_listunspent",               {{}, {o, o, o, o, o}} },
     { "fundrawtransaction",          {{s}, {o}} },
     { "zcsamplejoinsplit",           {{}, {}} },
-    { "zcbenchmark",                 {{s, o}, {o}} },
+    { "zcbenchmark",                 {{s, o}, {o, o, o}} },
     { "z_getnewaddress",             {{}, {s}} },
     { "z_getnewaccount",             {{}, {}} },
     { "z_getaddressforaccount",      {{o}, {o, o}} },
@@ -184,6 +192,7 @@ static const CRPCConvertTable rpcCvtTable =
     { "z_listoperationids",          {{}, {s}} },
     { "z_getnotescount",             {{}, {o, o}} },
     // server
+    { "getrpcinfo",                  {{}, {}} },
     { "help",                        {{}, {s}} },
     { "setlogfilter",                {{s}, {}} },
     { "stop",                        {{}, {o}} },
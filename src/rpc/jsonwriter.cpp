@@ -0,0 +1,64 @@
+// Copyright (c) 2026 The Zcash developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or https://www.opensource.org/licenses/mit-license.php .
+
+#include "rpc/jsonwriter.h"
+
+#include <assert.h>
+
+void JSONWriter::BeginElement()
+{
+    if (fAfterKey) {
+        fAfterKey = false;
+        return;
+    }
+    if (!vHasElement.empty()) {
+        if (vHasElement.back()) {
+            out += ',';
+        }
+        vHasElement.back() = true;
+    }
+}
+
+void JSONWriter::BeginObject()
+{
+    BeginElement();
+    out += '{';
+    vHasElement.push_back(false);
+}
+
+void JSONWriter::EndObject()
+{
+    assert(!vHasElement.empty() && !fAfterKey);
+    vHasElement.pop_back();
+    out += '}';
+}
+
+void JSONWriter::BeginArray()
+{
+    BeginElement();
+    out += '[';
+    vHasElement.push_back(false);
+}
+
+void JSONWriter::EndArray()
+{
+    assert(!vHasElement.empty() && !fAfterKey);
+    vHasElement.pop_back();
+    out += ']';
+}
+
+void JSONWriter::Key(const std::string& key)
+{
+    assert(!vHasElement.empty() && !fAfterKey);
+    BeginElement();
+    out += UniValue(key).write();
+    out += ':';
+    fAfterKey = true;
+}
+
+void JSONWriter::Value(const UniValue& value)
+{
+    BeginElement();
+    out += value.write();
+}
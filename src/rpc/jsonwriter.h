@@ -0,0 +1,48 @@
+// Copyright (c) 2026 The Zcash developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or https://www.opensource.org/licenses/mit-license.php .
+
+#ifndef ZCASH_RPC_JSONWRITER_H
+#define ZCASH_RPC_JSONWRITER_H
+
+#include <string>
+#include <vector>
+
+#include <univalue.h>
+
+/**
+ * Appends JSON to a string as it is produced, in the same compact format as
+ * UniValue::write(), so that a large RPC result does not have to be built as
+ * a UniValue tree and then copied out of it. Parts of the result that are
+ * small, such as a single transaction, can still be written as a UniValue.
+ */
+class JSONWriter
+{
+private:
+    std::string& out;
+    //! For each open object or array, whether it already has an element.
+    std::vector<bool> vHasElement;
+    //! Whether a key was written and its value has not been.
+    bool fAfterKey = false;
+
+    void BeginElement();
+
+public:
+    explicit JSONWriter(std::string& outIn) : out(outIn) {}
+
+    void BeginObject();
+    void EndObject();
+    void BeginArray();
+    void EndArray();
+
+    //! Write the key of the next value of the current object.
+    void Key(const std::string& key);
+    void Value(const UniValue& value);
+    void KV(const std::string& key, const UniValue& value)
+    {
+        Key(key);
+        Value(value);
+    }
+};
+
+#endif // ZCASH_RPC_JSONWRITER_H
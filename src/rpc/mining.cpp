@@ -5,7 +5,9 @@
 // file COPYING or https://www.opensource.org/licenses/mit-license.php .
 
 #include "amount.h"
+#include "candidateblock.h"
 #include "chainparams.h"
+#include "chainstats.h"
 #include "consensus/consensus.h"
 #include "consensus/funding.h"
 #include "consensus/merkle.h"
@@ -31,6 +33,8 @@
 #include "wallet/wallet.h"
 #endif
 
+#include <deque>
+#include <set>
 #include <stdint.h>
 #include <variant>
 
@@ -45,8 +49,19 @@ using namespace std;
  * Return average network hashes per second based on the last 'lookup' blocks,
  * or over the difficulty averaging window if 'lookup' is nonpositive.
  * If 'height' is nonnegative, compute the estimate at the time when a given block was found.
+ * Windows among the last MAX_CHAIN_STATS_BLOCKS blocks are answered from the
+ * chain statistics, without cs_main.
  */
 int64_t GetNetworkHashPS(int lookup, int height) {
+    // If lookup is nonpositive, then use difficulty averaging window.
+    if (lookup <= 0)
+        lookup = Params().GetConsensus().nPowAveragingWindow;
+
+    if (auto nHashPS = chainStats.GetNetworkHashPS(lookup, height)) {
+        return *nHashPS;
+    }
+
+    LOCK(cs_main);
     CBlockIndex *pb = chainActive.Tip();
 
     if (height >= 0 && height < chainActive.Height())
@@ -55,10 +70,6 @@ int64_t GetNetworkHashPS(int lookup, int height) {
     if (pb == NULL || !pb->nHeight)
         return 0;
 
-    // If lookup is nonpositive, then use difficulty averaging window.
-    if (lookup <= 0)
-        lookup = Params().GetConsensus().nPowAveragingWindow;
-
     // If lookup is larger than chain, then set it to chain length.
     if (lookup > pb->nHeight)
         lookup = pb->nHeight;
@@ -97,7 +108,6 @@ UniValue getlocalsolps(const UniValue& params, bool fHelp)
             + HelpExampleRpc("getlocalsolps", "")
        );
 
-    LOCK(cs_main);
     return GetLocalSolPS();
 }
 
@@ -119,7 +129,6 @@ UniValue getnetworksolps(const UniValue& params, bool fHelp)
             + HelpExampleRpc("getnetworksolps", "")
        );
 
-    LOCK(cs_main);
     return GetNetworkHashPS(params.size() > 0 ? params[0].get_int() : 120, params.size() > 1 ? params[1].get_int() : -1);
 }
 
@@ -144,7 +153,6 @@ UniValue getnetworkhashps(const UniValue& params, bool fHelp)
             + HelpExampleRpc("getnetworkhashps", "")
         );
 
-    LOCK(cs_main);
     return GetNetworkHashPS(params.size() > 0 ? params[0].get_int() : 120, params.size() > 1 ? params[1].get_int() : -1);
 }
 
@@ -350,14 +358,18 @@ UniValue getmininginfo(const UniValue& params, bool fHelp)
             + HelpExampleRpc("getmininginfo", "")
         );
 
-
-    LOCK(cs_main);
+    // Only the last assembled block needs cs_main; the chain and its
+    // statistics are read from their snapshots.
+    auto tip = chainActive.TipSnapshot();
 
     UniValue obj(UniValue::VOBJ);
-    obj.pushKV("blocks",           (int)chainActive.Height());
-    if (last_block_size.has_value()) obj.pushKV("currentblocksize", last_block_size.value());
-    if (last_block_num_txs.has_value()) obj.pushKV("currentblocktx", last_block_num_txs.value());
-    obj.pushKV("difficulty",       (double)GetNetworkDifficulty());
+    obj.pushKV("blocks",           tip ? tip->nHeight : -1);
+    {
+        LOCK(cs_main);
+        if (last_block_size.has_value()) obj.pushKV("currentblocksize", last_block_size.value());
+        if (last_block_num_txs.has_value()) obj.pushKV("currentblocktx", last_block_num_txs.value());
+    }
+    obj.pushKV("difficulty",       tip ? GetNetworkDifficulty(tip->pindex) : 1.0);
     auto warnings = GetWarnings("statusbar");
     obj.pushKV("errors",           warnings.first);
     obj.pushKV("errorstimestamp",  warnings.second);
@@ -405,6 +417,9 @@ UniValue prioritisetransaction(const UniValue& params, bool fHelp)
     }
 
     mempool.PrioritiseTransaction(hash, params[0].get_str(), nAmount);
+    if (pcandidateblock) {
+        pcandidateblock->MarkStale();
+    }
     return true;
 }
 
@@ -428,6 +443,18 @@ static UniValue BIP22ValidationResult(const CValidationState& state)
     return "valid?";
 }
 
+/** The transactions of a template that getblocktemplate has returned, so
+ *  that a later call can return only the changes since then. */
+struct RecentTemplate
+{
+    uint64_t nId;
+    uint256 hashPrevBlock;
+    std::vector<uint256> txids;
+};
+
+//! The number of recent templates that a call can ask for the changes since.
+static const size_t MAX_RECENT_TEMPLATES = 16;
+
 UniValue getblocktemplate(const UniValue& params, bool fHelp)
 {
     if (fHelp || params.size() > 1)
@@ -455,6 +482,8 @@ UniValue getblocktemplate(const UniValue& params, bool fHelp)
             "           ,...\n"
             "         ],\n"
             "       \"longpollid\":\"id\"     (string, optional) id to wait for\n"
+            "       \"templateid\":\"id\"     (string, optional) the templateid of a template returned lately; if its\n"
+            "                               previousblockhash is unchanged, only the transactions that are not in it are returned\n"
             "     }\n"
             "\n"
 
@@ -485,6 +514,12 @@ UniValue getblocktemplate(const UniValue& params, bool fHelp)
             "      }\n"
             "      ,...\n"
             "  ],\n"
+            "  \"templateid\" : \"id\",             (string) an id to include with a later request to get only the changes to this template\n"
+            "  \"basetemplateid\" : \"id\",         (string, optional) the templateid given in the request, if 'transactions' only holds the\n"
+            "                                     transactions that are not in that template\n"
+            "  \"removed\" : [ \"txid\", ... ],      (array, optional) with basetemplateid, the transactions of that template that this one leaves out\n"
+            "  \"txids\" : [ \"txid\", ... ],        (array, optional) with basetemplateid, all the non-coinbase transactions of this template in\n"
+            "                                     order; 'depends' counts positions in this list\n"
 //            "  \"coinbaseaux\" : {                  (json object) data that should be included in the coinbase's scriptSig content\n"
 //            "      \"flags\" : \"flags\"            (string) \n"
 //            "  },\n"
@@ -525,6 +560,7 @@ UniValue getblocktemplate(const UniValue& params, bool fHelp)
 
     std::string strMode = "template";
     UniValue lpval = NullUniValue;
+    UniValue templateidval = NullUniValue;
     // TODO: Re-enable coinbasevalue once a specification has been written
     bool coinbasetxn = true;
     if (params.size() > 0)
@@ -540,6 +576,7 @@ UniValue getblocktemplate(const UniValue& params, bool fHelp)
         else
             throw JSONRPCError(RPC_INVALID_PARAMETER, "Invalid mode");
         lpval = find_value(oparam, "longpollid");
+        templateidval = find_value(oparam, "templateid");
 
         if (strMode == "proposal")
         {
@@ -592,6 +629,7 @@ UniValue getblocktemplate(const UniValue& params, bool fHelp)
     auto minerAddress = maybeMinerAddress.value();
 
     static unsigned int nTransactionsUpdatedLast;
+    static uint64_t nCandidateUpdatesLast;
     static std::optional<CMutableTransaction> cached_next_cb_mtx;
     static int cached_next_cb_height;
 
@@ -603,6 +641,10 @@ UniValue getblocktemplate(const UniValue& params, bool fHelp)
 
     std::optional<CMutableTransaction> next_cb_mtx(cached_next_cb_mtx);
 
+    // The candidate block is kept up to date as transactions arrive, so a new
+    // template is returned as soon as it changes.
+    bool fUseCandidate = pcandidateblock && CandidateBlockBuilder::CanKeep(minerAddress);
+
     if (!lpval.isNull())
     {
         // Wait to respond until either the best block changes, OR some time passes and there are more transactions
@@ -624,6 +666,9 @@ UniValue getblocktemplate(const UniValue& params, bool fHelp)
             hashWatchedChain = chainActive.Tip()->GetBlockHash();
             nTransactionsUpdatedLastLP = nTransactionsUpdatedLast;
         }
+        // The candidate block wakes us up when it changes, so that the caller
+        // gets the new transactions at once.
+        uint64_t nCandidateUpdatesLP = nCandidateUpdatesLast;
 
         // Release the main lock while waiting
         // Don't call chainActive->Tip() without holding cs_main
@@ -652,6 +697,8 @@ UniValue getblocktemplate(const UniValue& params, bool fHelp)
                 // while waiting for cs_main; if so, don't discard next_cb_mtx.
                 if (g_best_block != hashWatchedChain) break;
 
+                if (fUseCandidate && pcandidateblock->GetUpdateCount() != nCandidateUpdatesLP) break;
+
                 // Timeout: Check transactions for update
                 if (timedout && mempool.GetTransactionsUpdated() != nTransactionsUpdatedLastLP) {
                     // Create a non-empty block.
@@ -676,7 +723,12 @@ UniValue getblocktemplate(const UniValue& params, bool fHelp)
     static CBlockIndex* pindexPrev;
     static int64_t nStart;
     static CBlockTemplate* pblocktemplate;
+    static uint64_t nTemplateId;
+    static std::deque<RecentTemplate> recentTemplates;
+    fUseCandidate = fUseCandidate && !next_cb_mtx;
+    uint64_t nCandidateUpdates = fUseCandidate ? pcandidateblock->GetUpdateCount() : 0;
     if (!lpval.isNull() || pindexPrev != chainActive.Tip() ||
+        (fUseCandidate && nCandidateUpdates != nCandidateUpdatesLast) ||
         (mempool.GetTransactionsUpdated() != nTransactionsUpdatedLast && GetTime() - nStart > 5))
     {
         // Clear pindexPrev so future calls make a new block, despite any failures from here on
@@ -705,18 +757,55 @@ UniValue getblocktemplate(const UniValue& params, bool fHelp)
             throw JSONRPCError(RPC_INTERNAL_ERROR, "No miner address available (mining requires a wallet or -mineraddress)");
         }
 
-        pblocktemplate = BlockAssembler(Params()).CreateNewBlock(minerAddress, next_cb_mtx);
-        if (!pblocktemplate)
-            throw JSONRPCError(RPC_OUT_OF_MEMORY, "Out of memory");
+        if (fUseCandidate) {
+            // A long poll gets work on a new tip at once, and the full
+            // template with the next long poll.
+            pblocktemplate = pcandidateblock->GetBlockTemplate(minerAddress, !lpval.isNull());
+            nCandidateUpdatesLast = pcandidateblock->GetUpdateCount();
+        }
+        if (!pblocktemplate) {
+            pblocktemplate = BlockAssembler(Params()).CreateNewBlock(minerAddress, next_cb_mtx);
+            if (!pblocktemplate)
+                throw JSONRPCError(RPC_OUT_OF_MEMORY, "Out of memory");
 
-        // Mark script as important because it was used at least for one coinbase output
-        std::visit(KeepMinerAddress(), minerAddress);
+            // Mark script as important because it was used at least for one coinbase output
+            std::visit(KeepMinerAddress(), minerAddress);
+        }
 
         // Need to update only after we know CreateNewBlock succeeded
         pindexPrev = pindexPrevNew;
+
+        RecentTemplate recent;
+        recent.nId = ++nTemplateId;
+        recent.hashPrevBlock = pblocktemplate->block.hashPrevBlock;
+        for (size_t i = 1; i < pblocktemplate->block.vtx.size(); i++) {
+            recent.txids.push_back(pblocktemplate->block.vtx[i].GetHash());
+        }
+        recentTemplates.push_back(std::move(recent));
+        if (recentTemplates.size() > MAX_RECENT_TEMPLATES) {
+            recentTemplates.pop_front();
+        }
     }
     CBlock* pblock = &pblocktemplate->block; // pointer for convenience
 
+    // A template that the caller already has, built on the same block, lets
+    // us leave out the transactions that it holds.
+    const RecentTemplate* pbase = nullptr;
+    if (!templateidval.isNull()) {
+        int64_t nBaseId;
+        if (!templateidval.isStr() || !ParseInt64(templateidval.get_str(), &nBaseId))
+            throw JSONRPCError(RPC_INVALID_PARAMETER, "Invalid templateid");
+        for (const RecentTemplate& recent : recentTemplates) {
+            if ((int64_t)recent.nId == nBaseId && recent.hashPrevBlock == pblock->hashPrevBlock)
+                pbase = &recent;
+        }
+    }
+    std::set<uint256> setBase;
+    if (pbase) {
+        setBase.insert(pbase->txids.begin(), pbase->txids.end());
+    }
+    UniValue txids(UniValue::VARR);
+
     const Consensus::Params& consensus = Params().GetConsensus();
 
     // Update nTime
@@ -736,6 +825,13 @@ UniValue getblocktemplate(const UniValue& params, bool fHelp)
         if (tx.IsCoinBase() && !coinbasetxn)
             continue;
 
+        if (pbase && !tx.IsCoinBase()) {
+            txids.push_back(txHash.GetHex());
+            // The caller has the transactions of the base template.
+            if (setBase.erase(txHash))
+                continue;
+        }
+
         UniValue entry(UniValue::VOBJ);
 
         entry.pushKV("data", EncodeHexTx(tx));
@@ -807,6 +903,18 @@ UniValue getblocktemplate(const UniValue& params, bool fHelp)
         result.pushKV("defaultroots", defaults);
     }
     result.pushKV("transactions", transactions);
+    result.pushKV("templateid", i64tostr(recentTemplates.back().nId));
+    if (pbase) {
+        // What is left of the base template is not in this one.
+        UniValue removed(UniValue::VARR);
+        for (const uint256& txid : pbase->txids) {
+            if (setBase.count(txid))
+                removed.push_back(txid.GetHex());
+        }
+        result.pushKV("basetemplateid", i64tostr(pbase->nId));
+        result.pushKV("removed", removed);
+        result.pushKV("txids", txids);
+    }
     if (coinbasetxn) {
         assert(txCoinbase.isObject());
         result.pushKV("coinbasetxn", txCoinbase);
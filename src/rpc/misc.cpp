@@ -12,7 +12,9 @@
 #include "main.h"
 #include "net.h"
 #include "netbase.h"
+#include "rpc/jsonwriter.h"
 #include "rpc/server.h"
+#include "sync.h"
 #include "txmempool.h"
 #include "util/system.h"
 #ifdef ENABLE_WALLET
@@ -20,6 +22,7 @@
 #include "wallet/walletdb.h"
 #endif
 
+#include <optional>
 #include <stdint.h>
 #include <variant>
 
@@ -877,6 +880,125 @@ static void getAddressesInHeightRange(
     }
 }
 
+// insightexplorer
+static void getaddressdeltas_write(const UniValue& params, JSONWriter& out)
+{
+    if (!(fExperimentalInsightExplorer || fExperimentalLightWalletd)) {
+        throw JSONRPCError(RPC_MISC_ERROR, "Error: getaddressdeltas is disabled. "
+            "Run './zcash-cli help getaddressdeltas' for instructions on how to enable this feature.");
+    }
+
+    int start = 0;
+    int end = 0;
+    getHeightRange(params, start, end);
+
+    // A page of the deltas of all the addresses, in chain order, is read
+    // if a limit or a cursor is given.
+    int64_t nLimit = 0;
+    std::optional<CAddressIndexKey> after;
+    if (params[0].isObject()) {
+        UniValue limitValue = find_value(params[0].get_obj(), "limit");
+        UniValue cursorValue = find_value(params[0].get_obj(), "cursor");
+        if (!limitValue.isNull()) {
+            nLimit = limitValue.get_int64();
+            if (nLimit <= 0) {
+                throw JSONRPCError(RPC_INVALID_PARAMETER, "Limit must be positive");
+            }
+        }
+        if (!cursorValue.isNull()) {
+            std::vector<unsigned char> vCursor = ParseHexV(cursorValue, "cursor");
+            try {
+                CDataStream ss(vCursor, SER_DISK, CLIENT_VERSION);
+                CAddressIndexKey key;
+                ss >> key;
+                if (!ss.empty()) {
+                    throw std::ios_base::failure("trailing data");
+                }
+                after = key;
+            } catch (const std::exception&) {
+                throw JSONRPCError(RPC_INVALID_PARAMETER, "Invalid cursor");
+            }
+        }
+    }
+    bool fPaged = nLimit > 0 || after.has_value();
+
+    std::vector<std::pair<uint160, int>> addresses;
+    std::vector<std::pair<CAddressIndexKey, CAmount>> addressIndex;
+    bool fMore = false;
+    if (fPaged) {
+        if (!getAddressesFromParams(params, addresses)) {
+            throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Invalid address");
+        }
+        if (!GetAddressIndexMerged(addresses, start, end, after ? &after.value() : nullptr, nLimit, addressIndex, fMore)) {
+            throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY,
+                "No information available for address");
+        }
+    } else {
+        getAddressesInHeightRange(params, start, end, addresses, addressIndex);
+    }
+
+    bool includeChainInfo = false;
+    if (params[0].isObject()) {
+        UniValue chainInfo = find_value(params[0].get_obj(), "chainInfo");
+        if (!chainInfo.isNull()) {
+            includeChainInfo = chainInfo.get_bool();
+        }
+    }
+
+    // The chain info is looked up first, so that the deltas can be written
+    // as they are converted.
+    bool fChainInfo = includeChainInfo && start > 0 && end > 0;
+    UniValue startInfo(UniValue::VOBJ);
+    UniValue endInfo(UniValue::VOBJ);
+    if (fChainInfo) {
+        {
+            LOCK(cs_main);  // for chainActive
+            if (start > chainActive.Height() || end > chainActive.Height()) {
+                throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Start or end is outside chain range");
+            }
+            startInfo.pushKV("hash", chainActive[start]->GetBlockHash().GetHex());
+            endInfo.pushKV("hash", chainActive[end]->GetBlockHash().GetHex());
+        }
+        startInfo.pushKV("height", start);
+        endInfo.pushKV("height", end);
+    }
+    if (fChainInfo || fPaged) {
+        out.BeginObject();
+        out.Key("deltas");
+    }
+
+    out.BeginArray();
+    for (const auto& it : addressIndex) {
+        std::string address;
+        if (!getAddressFromIndex(it.first.type, it.first.hashBytes, address)) {
+            throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Unknown address type");
+        }
+
+        UniValue delta(UniValue::VOBJ);
+        delta.pushKV("address", address);
+        delta.pushKV("blockindex", (int)it.first.txindex);
+        delta.pushKV("height", it.first.blockHeight);
+        delta.pushKV("index", (int)it.first.index);
+        delta.pushKV("satoshis", it.second);
+        delta.pushKV("txid", it.first.txhash.GetHex());
+        out.Value(delta);
+    }
+    out.EndArray();
+
+    if (fPaged && fMore) {
+        CDataStream ss(SER_DISK, CLIENT_VERSION);
+        ss << addressIndex.back().first;
+        out.KV("cursor", HexStr(ss.begin(), ss.end()));
+    }
+    if (fChainInfo) {
+        out.KV("start", startInfo);
+        out.KV("end", endInfo);
+    }
+    if (fChainInfo || fPaged) {
+        out.EndObject();
+    }
+}
+
 // insightexplorer
 UniValue getaddressdeltas(const UniValue& params, bool fHelp)
 {
@@ -886,13 +1008,16 @@ UniValue getaddressdeltas(const UniValue& params, bool fHelp)
     }
     if (fHelp || params.size() != 1)
         throw runtime_error(
-            "getaddressdeltas {\"addresses\": [\"taddr\", ...], (\"start\": n), (\"end\": n), (\"chainInfo\": true|false)}\n"
+            "getaddressdeltas {\"addresses\": [\"taddr\", ...], (\"start\": n), (\"end\": n), (\"chainInfo\": true|false), (\"limit\": n), (\"cursor\": \"hex\")}\n"
             "\nReturns all changes for an address.\n"
             "\nReturns information about all changes to the given transparent addresses within the given (inclusive)\n"
             "\nblock height range, default is the full blockchain."
             "\nIf start or end are not specified, they default to zero."
             "\nIf start is greater than the latest block height, it's interpreted as that height.\n"
             "\nIf end is zero, it's interpreted as the latest block height.\n"
+            "\nIf a limit or a cursor is given, the changes of all the addresses are returned in the order of\n"
+            "\ntheir transactions in the chain, at most limit at a time, in an object. Its \"cursor\" is present\n"
+            "\nif there are more changes, and is passed back to get the next ones.\n"
             + disabledMsg +
             "\nArguments:\n"
             "{\n"
@@ -904,6 +1029,8 @@ UniValue getaddressdeltas(const UniValue& params, bool fHelp)
             "  \"start\"       (number, optional) The start block height\n"
             "  \"end\"         (number, optional) The end block height\n"
             "  \"chainInfo\"   (boolean, optional, default=false) Include chain info in results, only applies if start and end specified\n"
+            "  \"limit\"       (number, optional) The maximum number of changes to return\n"
+            "  \"cursor\"      (string, optional) The cursor returned with the previous changes\n"
             "}\n"
             "(or)\n"
             "\"address\"       (string) The base58check encoded address\n"
@@ -917,7 +1044,7 @@ UniValue getaddressdeltas(const UniValue& params, bool fHelp)
             "    \"address\"   (string) The base58check encoded address\n"
             "  }, ...\n"
             "]\n\n"
-            "(or, if chainInfo is true):\n\n"
+            "(or, if chainInfo is true, or a limit or a cursor is given):\n\n"
             "{\n"
             "  \"deltas\":\n"
             "    [\n"
@@ -929,6 +1056,7 @@ UniValue getaddressdeltas(const UniValue& params, bool fHelp)
             "        \"address\"     (string)  The address base58check encoded\n"
             "      }, ...\n"
             "    ],\n"
+            "  \"cursor\"        (string, optional) Where the next changes start, if there are more\n"
             "  \"start\":\n"
             "    {\n"
             "      \"hash\"          (string)  The start block hash\n"
@@ -945,68 +1073,7 @@ UniValue getaddressdeltas(const UniValue& params, bool fHelp)
             + HelpExampleRpc("getaddressdeltas", "{\"addresses\": [\"tmYXBYJj1K7vhejSec5osXK2QsGa5MTisUQ\"], \"start\": 1000, \"end\": 2000, \"chainInfo\": true}")
         );
 
-    if (!(fExperimentalInsightExplorer || fExperimentalLightWalletd)) {
-        throw JSONRPCError(RPC_MISC_ERROR, "Error: getaddressdeltas is disabled. "
-            "Run './zcash-cli help getaddressdeltas' for instructions on how to enable this feature.");
-    }
-
-    int start = 0;
-    int end = 0;
-    getHeightRange(params, start, end);
-
-    std::vector<std::pair<uint160, int>> addresses;
-    std::vector<std::pair<CAddressIndexKey, CAmount>> addressIndex;
-    getAddressesInHeightRange(params, start, end, addresses, addressIndex);
-
-    bool includeChainInfo = false;
-    if (params[0].isObject()) {
-        UniValue chainInfo = find_value(params[0].get_obj(), "chainInfo");
-        if (!chainInfo.isNull()) {
-            includeChainInfo = chainInfo.get_bool();
-        }
-    }
-
-    UniValue deltas(UniValue::VARR);
-    for (const auto& it : addressIndex) {
-        std::string address;
-        if (!getAddressFromIndex(it.first.type, it.first.hashBytes, address)) {
-            throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Unknown address type");
-        }
-
-        UniValue delta(UniValue::VOBJ);
-        delta.pushKV("address", address);
-        delta.pushKV("blockindex", (int)it.first.txindex);
-        delta.pushKV("height", it.first.blockHeight);
-        delta.pushKV("index", (int)it.first.index);
-        delta.pushKV("satoshis", it.second);
-        delta.pushKV("txid", it.first.txhash.GetHex());
-        deltas.push_back(delta);
-    }
-
-    UniValue result(UniValue::VOBJ);
-
-    if (!(includeChainInfo && start > 0 && end > 0)) {
-        return deltas;
-    }
-
-    UniValue startInfo(UniValue::VOBJ);
-    UniValue endInfo(UniValue::VOBJ);
-    {
-        LOCK(cs_main);  // for chainActive
-        if (start > chainActive.Height() || end > chainActive.Height()) {
-            throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Start or end is outside chain range");
-        }
-        startInfo.pushKV("hash", chainActive[start]->GetBlockHash().GetHex());
-        endInfo.pushKV("hash", chainActive[end]->GetBlockHash().GetHex());
-    }
-    startInfo.pushKV("height", start);
-    endInfo.pushKV("height", end);
-
-    result.pushKV("deltas", deltas);
-    result.pushKV("start", startInfo);
-    result.pushKV("end", endInfo);
-
-    return result;
+    return WriterToUniValue(getaddressdeltas_write, params);
 }
 
 // insightexplorer
@@ -1035,6 +1102,7 @@ UniValue getaddressbalance(const UniValue& params, bool fHelp)
             "{\n"
             "  \"balance\"  (string) The current balance in " + MINOR_CURRENCY_UNIT + "\n"
             "  \"received\"  (string) The total number of " + MINOR_CURRENCY_UNIT + " received (including change)\n"
+            "  \"txcount\"  (numeric) The number of transactions involving each address, summed over the addresses\n"
             "}\n"
             "\nExamples:\n"
             + HelpExampleCli("getaddressbalance", "'{\"addresses\": [\"tmYXBYJj1K7vhejSec5osXK2QsGa5MTisUQ\"]}'")
@@ -1047,22 +1115,46 @@ UniValue getaddressbalance(const UniValue& params, bool fHelp)
     }
 
     std::vector<std::pair<uint160, int>> addresses;
-    std::vector<std::pair<CAddressIndexKey, CAmount>> addressIndex;
-    // this method doesn't take start and end block height params, so set
-    // to zero (full range, entire blockchain)
-    getAddressesInHeightRange(params, 0, 0, addresses, addressIndex);
+    if (!getAddressesFromParams(params, addresses)) {
+        throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Invalid address");
+    }
 
     CAmount balance = 0;
     CAmount received = 0;
-    for (const auto& it : addressIndex) {
-        if (it.second > 0) {
-            received += it.second;
+    uint64_t txcount = 0;
+    for (const auto& it : addresses) {
+        // The summary of the address answers without reading its entries,
+        // unless the summaries are still being built.
+        CAddressSummary summary;
+        if (!GetAddressSummary(it.first, it.second, summary)) {
+            // this method doesn't take start and end block height params, so
+            // read the full range, entire blockchain
+            std::vector<std::pair<CAddressIndexKey, CAmount>> addressIndex;
+            if (!GetAddressIndex(it.first, it.second, addressIndex, 0, 0)) {
+                throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY,
+                    "No information available for address");
+            }
+            const uint256* pLastTxid = nullptr;
+            for (const auto& entry : addressIndex) {
+                if (entry.second > 0) {
+                    summary.received += entry.second;
+                }
+                summary.balance += entry.second;
+                // The entries of a transaction are adjacent.
+                if (pLastTxid == nullptr || *pLastTxid != entry.first.txhash) {
+                    summary.txCount++;
+                }
+                pLastTxid = &entry.first.txhash;
+            }
         }
-        balance += it.second;
+        balance += summary.balance;
+        received += summary.received;
+        txcount += summary.txCount;
     }
     UniValue result(UniValue::VOBJ);
     result.pushKV("balance", balance);
     result.pushKV("received", received);
+    result.pushKV("txcount", txcount);
     return result;
 }
 
@@ -1117,23 +1209,27 @@ UniValue getaddresstxids(const UniValue& params, bool fHelp)
     getHeightRange(params, start, end);
 
     std::vector<std::pair<uint160, int>> addresses;
+    if (!getAddressesFromParams(params, addresses)) {
+        throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Invalid address");
+    }
+    // The entries of all the addresses are merged in chain order, so the
+    // result is sorted by (height, txindex).
     std::vector<std::pair<CAddressIndexKey, CAmount>> addressIndex;
-    getAddressesInHeightRange(params, start, end, addresses, addressIndex);
-
-    // This is an ordered set, sorted by (height,txindex) so result also sorted by height.
-    std::set<std::tuple<int, int, std::string>> txids;
-
-    for (const auto& it : addressIndex) {
-        const int height = it.first.blockHeight;
-        const int txindex = it.first.txindex;
-        const std::string txid = it.first.txhash.GetHex();
-        // Duplicate entries (two addresses in same tx) are suppressed
-        txids.insert(std::make_tuple(height, txindex, txid));
+    bool fMore;
+    if (!GetAddressIndexMerged(addresses, start, end, nullptr, 0, addressIndex, fMore)) {
+        throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY,
+            "No information available for address");
     }
+
     UniValue result(UniValue::VARR);
-    for (const auto& it : txids) {
-        // only push the txid, not the height
-        result.push_back(std::get<2>(it));
+    const uint256* pLastTxid = nullptr;
+    for (const auto& it : addressIndex) {
+        // Duplicate entries (two addresses in same tx) are adjacent, and
+        // suppressed
+        if (pLastTxid == nullptr || *pLastTxid != it.first.txhash) {
+            result.push_back(it.first.txhash.GetHex());
+        }
+        pLastTxid = &it.first.txhash;
     }
 
     return result;
@@ -1241,29 +1337,146 @@ UniValue getmemoryinfo(const UniValue& params, bool fHelp)
     return obj;
 }
 
+/** The profile of a lock's acquisitions, summed over the places it was taken at. */
+struct LockTotals
+{
+    uint64_t nAcquisitions = 0;
+    uint64_t nContended = 0;
+    int64_t nWaitMicros = 0;
+    int64_t nMaxWaitMicros = 0;
+    int64_t nHoldMicros = 0;
+    int64_t nMaxHoldMicros = 0;
+
+    void Add(const LockSiteStats& site)
+    {
+        nAcquisitions += site.nAcquisitions;
+        nContended += site.nContended;
+        nWaitMicros += site.nWaitMicros;
+        nMaxWaitMicros = std::max(nMaxWaitMicros, site.nMaxWaitMicros);
+        nHoldMicros += site.nHoldMicros;
+        nMaxHoldMicros = std::max(nMaxHoldMicros, site.nMaxHoldMicros);
+    }
+
+    void Push(UniValue& obj) const
+    {
+        obj.pushKV("acquisitions", nAcquisitions);
+        obj.pushKV("contended", nContended);
+        obj.pushKV("wait_ms", nWaitMicros * 0.001);
+        obj.pushKV("max_wait_ms", nMaxWaitMicros * 0.001);
+        obj.pushKV("hold_ms", nHoldMicros * 0.001);
+        obj.pushKV("max_hold_ms", nMaxHoldMicros * 0.001);
+    }
+};
+
+UniValue getlockstats(const UniValue& params, bool fHelp)
+{
+    if (fHelp || params.size() > 1)
+        throw runtime_error(
+            "getlockstats ( reset )\n"
+            "\nReturns how long threads have waited for and held each lock, and where they took it,\n"
+            "while the node has been profiling its locks (-lockstats). Locks, and the places each one\n"
+            "was taken at, are listed by the time spent waiting for them, longest first.\n"
+            "\nArguments:\n"
+            "1. reset      (boolean, optional, default=false) Reset the statistics after returning them\n"
+            "\nResult:\n"
+            "{\n"
+            "  \"enabled\": true|false,       (boolean) Whether locks are being profiled\n"
+            "  \"locks\": [\n"
+            "    {\n"
+            "      \"name\": \"name\",          (string) The lock, as named where it was taken\n"
+            "      \"acquisitions\": n,       (numeric) The number of times it was taken\n"
+            "      \"contended\": n,          (numeric) The number of times it was held by another thread\n"
+            "      \"wait_ms\": n,            (numeric) The total time spent waiting for it\n"
+            "      \"max_wait_ms\": n,        (numeric) The longest wait for it\n"
+            "      \"hold_ms\": n,            (numeric) The total time it was held, including nested acquisitions\n"
+            "      \"max_hold_ms\": n,        (numeric) The longest time it was held\n"
+            "      \"sites\": [               (array) The same, for each place it was taken at\n"
+            "        {\n"
+            "          \"site\": \"file:line\",  (string) Where it was taken\n"
+            "          ...\n"
+            "        }, ...\n"
+            "      ]\n"
+            "    }, ...\n"
+            "  ]\n"
+            "}\n"
+            "\nExamples:\n"
+            + HelpExampleCli("getlockstats", "")
+            + HelpExampleCli("getlockstats", "true")
+            + HelpExampleRpc("getlockstats", "")
+        );
+
+    bool fReset = params.size() > 0 && params[0].get_bool();
+
+    std::map<std::string, std::pair<LockTotals, std::vector<LockSiteStats>>> locks;
+    for (LockSiteStats& site : GetLockStats()) {
+        if (site.nAcquisitions == 0) {
+            continue;
+        }
+        auto& lock = locks[site.name];
+        lock.first.Add(site);
+        lock.second.push_back(std::move(site));
+    }
+    if (fReset) {
+        ResetLockStats();
+    }
+
+    std::vector<std::pair<std::string, std::pair<LockTotals, std::vector<LockSiteStats>>>> vLocks(locks.begin(), locks.end());
+    std::sort(vLocks.begin(), vLocks.end(), [](const auto& a, const auto& b) {
+        return a.second.first.nWaitMicros > b.second.first.nWaitMicros;
+    });
+
+    UniValue arrLocks(UniValue::VARR);
+    for (auto& [name, lock] : vLocks) {
+        auto& [totals, sites] = lock;
+        std::sort(sites.begin(), sites.end(), [](const LockSiteStats& a, const LockSiteStats& b) {
+            return a.nWaitMicros > b.nWaitMicros;
+        });
+        UniValue objLock(UniValue::VOBJ);
+        objLock.pushKV("name", name);
+        totals.Push(objLock);
+        UniValue arrSites(UniValue::VARR);
+        for (const LockSiteStats& site : sites) {
+            UniValue objSite(UniValue::VOBJ);
+            objSite.pushKV("site", strprintf("%s:%d", site.file, site.line));
+            LockTotals siteTotals;
+            siteTotals.Add(site);
+            siteTotals.Push(objSite);
+            arrSites.push_back(objSite);
+        }
+        objLock.pushKV("sites", arrSites);
+        arrLocks.push_back(objLock);
+    }
+
+    UniValue obj(UniValue::VOBJ);
+    obj.pushKV("enabled", g_lock_stats_enabled.load());
+    obj.pushKV("locks", arrLocks);
+    return obj;
+}
+
 static const CRPCCommand commands[] =
-{ //  category              name                      actor (function)         okSafeMode
-  //  --------------------- ------------------------  -----------------------  ----------
-    { "control",            "getinfo",                &getinfo,                true  }, /* uses wallet if enabled */
-    { "control",            "getmemoryinfo",          &getmemoryinfo,          true  },
-    { "util",               "validateaddress",        &validateaddress,        true  }, /* uses wallet if enabled */
-    { "util",               "z_validateaddress",      &z_validateaddress,      true  }, /* uses wallet if enabled */
-    { "util",               "createmultisig",         &createmultisig,         true  },
-    { "util",               "verifymessage",          &verifymessage,          true  },
-    { "control",            "getexperimentalfeatures",&getexperimentalfeatures,true  },
+{ //  category              name                      actor (function)         okSafeMode okParallel writer
+  //  --------------------- ------------------------  -----------------------  ---------- ---------- ----------------------
+    { "control",            "getinfo",                &getinfo,                true,      true  }, /* uses wallet if enabled */
+    { "control",            "getmemoryinfo",          &getmemoryinfo,          true,      true  },
+    { "control",            "getlockstats",           &getlockstats,           true,      true  },
+    { "util",               "validateaddress",        &validateaddress,        true,      true  }, /* uses wallet if enabled */
+    { "util",               "z_validateaddress",      &z_validateaddress,      true,      true  }, /* uses wallet if enabled */
+    { "util",               "createmultisig",         &createmultisig,         true,      true  },
+    { "util",               "verifymessage",          &verifymessage,          true,      true  },
+    { "control",            "getexperimentalfeatures",&getexperimentalfeatures,true,      true  },
 
     // START insightexplorer
     /* Address index */
-    { "addressindex",       "getaddresstxids",        &getaddresstxids,        false }, /* insight explorer */
-    { "addressindex",       "getaddressbalance",      &getaddressbalance,      false }, /* insight explorer */
-    { "addressindex",       "getaddressdeltas",       &getaddressdeltas,       false }, /* insight explorer */
-    { "addressindex",       "getaddressutxos",        &getaddressutxos,        false }, /* insight explorer */
-    { "addressindex",       "getaddressmempool",      &getaddressmempool,      true  }, /* insight explorer */
-    { "blockchain",         "getspentinfo",           &getspentinfo,           false }, /* insight explorer */
+    { "addressindex",       "getaddresstxids",        &getaddresstxids,        false,     true  }, /* insight explorer */
+    { "addressindex",       "getaddressbalance",      &getaddressbalance,      false,     true  }, /* insight explorer */
+    { "addressindex",       "getaddressdeltas",       &getaddressdeltas,       false,     true,      &getaddressdeltas_write }, /* insight explorer */
+    { "addressindex",       "getaddressutxos",        &getaddressutxos,        false,     true  }, /* insight explorer */
+    { "addressindex",       "getaddressmempool",      &getaddressmempool,      true,      true  }, /* insight explorer */
+    { "blockchain",         "getspentinfo",           &getspentinfo,           false,     true  }, /* insight explorer */
     // END insightexplorer
 
     /* Not shown in help */
-    { "hidden",             "setmocktime",            &setmocktime,            true  },
+    { "hidden",             "setmocktime",            &setmocktime,            true,      false },
 };
 
 void RegisterMiscRPCCommands(CRPCTable &tableRPC)
@@ -34,9 +34,7 @@ UniValue getconnectioncount(const UniValue& params, bool fHelp)
             + HelpExampleRpc("getconnectioncount", "")
         );
 
-    LOCK2(cs_main, cs_vNodes);
-
-    return (int)vNodes.size();
+    return (int)GetNodesSnapshot()->size();
 }
 
 UniValue ping(const UniValue& params, bool fHelp)
@@ -53,9 +51,8 @@ UniValue ping(const UniValue& params, bool fHelp)
         );
 
     // Request that each node send a ping during next message processing pass
-    LOCK2(cs_main, cs_vNodes);
-
-    for (CNode* pNode : vNodes) {
+    NodesSnapshot vNodesCopy = GetNodesSnapshot();
+    for (CNode* pNode : *vNodesCopy) {
         pNode->fPingQueued = true;
     }
 
@@ -66,9 +63,9 @@ static void CopyNodeStats(std::vector<CNodeStats>& vstats)
 {
     vstats.clear();
 
-    LOCK(cs_vNodes);
-    vstats.reserve(vNodes.size());
-    for (CNode* pnode : vNodes) {
+    NodesSnapshot vNodesCopy = GetNodesSnapshot();
+    vstats.reserve(vNodesCopy->size());
+    for (CNode* pnode : *vNodesCopy) {
         vstats.emplace_back();
         pnode->copyStats(vstats.back());
     }
@@ -103,10 +100,35 @@ UniValue getpeerinfo(const UniValue& params, bool fHelp)
             "    \"banscore\": n,             (numeric) The ban score\n"
             "    \"synced_headers\": n,       (numeric) The last header we have in common with this peer\n"
             "    \"synced_blocks\": n,        (numeric) The last block we have in common with this peer\n"
+            "    \"inflightlimit\": n,        (numeric) The number of blocks we may have in flight from this peer\n"
+            "    \"blocklatency\": n,         (numeric, optional) The average time in seconds this peer has taken to deliver a requested block\n"
+            "    \"minfeefilter\": n,         (numeric) The minimum relay fee rate, in " + CURRENCY_UNIT + "/kB, of transactions announced to this peer\n"
+            "    \"unpaidactionfilter\": n,   (numeric, optional) The maximum number of unpaid actions of transactions announced to this peer\n"
             "    \"inflight\": [\n"
             "       n,                        (numeric) The heights of blocks we're currently asking from this peer\n"
             "       ...\n"
-            "    ]\n"
+            "    ],\n"
+            "    \"bytessent_per_msg\": {\n"
+            "       \"command\": n,            (numeric) The total bytes sent in messages of this command, including headers\n"
+            "       ...\n"
+            "    },\n"
+            "    \"bytesrecv_per_msg\": {\n"
+            "       \"command\": n,            (numeric) The total bytes received in messages of this command, including headers\n"
+            "       ...\n"
+            "    },\n"
+            "    \"processtime_per_msg\": {\n"
+            "       \"command\": n,            (numeric) The total time in microseconds spent processing received messages of this command\n"
+            "       ...\n"
+            "    },\n"
+            "    \"processcpu_per_msg\": {\n"
+            "       \"command\": n,            (numeric) The total CPU time in microseconds used processing received messages of this command\n"
+            "       ...\n"
+            "    },\n"
+            "    \"lockwait_per_msg\": {\n"
+            "       \"command\": n,            (numeric) The total time in microseconds spent waiting for locks, including cs_main, while\n"
+            "                                 processing received messages of this command (only measured with -lockstats)\n"
+            "       ...\n"
+            "    }\n"
             "  }\n"
             "  ,...\n"
             "]\n"
@@ -115,8 +137,6 @@ UniValue getpeerinfo(const UniValue& params, bool fHelp)
             + HelpExampleRpc("getpeerinfo", "")
         );
 
-    LOCK(cs_main);
-
     vector<CNodeStats> vstats;
     CopyNodeStats(vstats);
 
@@ -152,16 +172,37 @@ UniValue getpeerinfo(const UniValue& params, bool fHelp)
             obj.pushKV("banscore", statestats.nMisbehavior);
             obj.pushKV("synced_headers", statestats.nSyncHeight);
             obj.pushKV("synced_blocks", statestats.nCommonHeight);
+            obj.pushKV("inflightlimit", statestats.nBlocksInFlightLimit);
+            if (statestats.nBlockLatencyAvg != 0)
+                obj.pushKV("blocklatency", statestats.nBlockLatencyAvg / 1e6);
             UniValue heights(UniValue::VARR);
             for (int height : statestats.vHeightInFlight) {
                 heights.push_back(height);
             }
             obj.pushKV("inflight", heights);
         }
+        obj.pushKV("minfeefilter", ValueFromAmount(stats.minFeeFilter));
+        if (stats.nUnpaidActionFilter != std::numeric_limits<int64_t>::max())
+            obj.pushKV("unpaidactionfilter", stats.nUnpaidActionFilter);
         obj.pushKV("addr_processed", stats.m_addr_processed);
         obj.pushKV("addr_rate_limited", stats.m_addr_rate_limited);
         obj.pushKV("whitelisted", stats.fWhitelisted);
 
+        auto renderPerMsg = [&](const std::string& key, const std::map<std::string, uint64_t>& mapStats) {
+            UniValue perMsg(UniValue::VOBJ);
+            for (const auto& [strCommand, nValue] : mapStats) {
+                if (nValue > 0) {
+                    perMsg.pushKV(strCommand, nValue);
+                }
+            }
+            obj.pushKV(key, perMsg);
+        };
+        renderPerMsg("bytessent_per_msg", stats.mapSendBytesPerMsgCmd);
+        renderPerMsg("bytesrecv_per_msg", stats.mapRecvBytesPerMsgCmd);
+        renderPerMsg("processtime_per_msg", stats.mapProcessTimePerMsgCmd);
+        renderPerMsg("processcpu_per_msg", stats.mapProcessCPUPerMsgCmd);
+        renderPerMsg("lockwait_per_msg", stats.mapLockWaitPerMsgCmd);
+
         ret.push_back(obj);
     }
 
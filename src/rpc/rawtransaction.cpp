@@ -21,6 +21,7 @@
 #include "script/script_error.h"
 #include "script/sign.h"
 #include "script/standard.h"
+#include "txlocationindex.h"
 #include "uint256.h"
 #ifdef ENABLE_WALLET
 #include "wallet/wallet.h"
@@ -209,7 +210,21 @@ UniValue TxOrchardBundleToJSON(const CTransaction& tx, UniValue& entry)
     return obj;
 }
 
-void TxToJSON(const CTransaction& tx, const uint256 hashBlock, UniValue& entry)
+static UniValue TxShieldedSummaryToJSON(const CTransaction& tx)
+{
+    UniValue obj(UniValue::VOBJ);
+    obj.pushKV("joinSplits", (uint64_t)tx.vJoinSplit.size());
+    obj.pushKV("saplingSpends", (uint64_t)tx.GetSaplingSpendsCount());
+    obj.pushKV("saplingOutputs", (uint64_t)tx.GetSaplingOutputsCount());
+    obj.pushKV("orchardActions", (uint64_t)tx.GetOrchardBundle().GetNumActions());
+    obj.pushKV("valueBalanceSapling", ValueFromAmount(tx.GetValueBalanceSapling()));
+    obj.pushKV("valueBalanceSaplingZat", tx.GetValueBalanceSapling());
+    obj.pushKV("valueBalanceOrchard", ValueFromAmount(tx.GetOrchardBundle().GetValueBalance()));
+    obj.pushKV("valueBalanceOrchardZat", tx.GetOrchardBundle().GetValueBalance());
+    return obj;
+}
+
+void TxToJSON(const CTransaction& tx, const uint256 hashBlock, UniValue& entry, unsigned int nFields)
 {
     const uint256 txid = tx.GetHash();
     entry.pushKV("txid", txid.GetHex());
@@ -225,69 +240,90 @@ void TxToJSON(const CTransaction& tx, const uint256 hashBlock, UniValue& entry)
         entry.pushKV("expiryheight", (int64_t)tx.nExpiryHeight);
     }
 
-    entry.pushKV("hex", EncodeHexTx(tx));
+    if (nFields & TX_FIELD_HEX) {
+        entry.pushKV("hex", EncodeHexTx(tx));
+    }
 
-    KeyIO keyIO(Params());
-    UniValue vin(UniValue::VARR);
-    for (const CTxIn& txin : tx.vin) {
-        UniValue in(UniValue::VOBJ);
-        if (tx.IsCoinBase())
-            in.pushKV("coinbase", HexStr(txin.scriptSig.begin(), txin.scriptSig.end()));
-        else {
-            in.pushKV("txid", txin.prevout.hash.GetHex());
-            in.pushKV("vout", (int64_t)txin.prevout.n);
-            UniValue o(UniValue::VOBJ);
-            o.pushKV("asm", ScriptToAsmStr(txin.scriptSig, true));
-            o.pushKV("hex", HexStr(txin.scriptSig.begin(), txin.scriptSig.end()));
-            in.pushKV("scriptSig", o);
-
-            // Add address and value info if spentindex enabled
-            CSpentIndexValue spentInfo;
-            CSpentIndexKey spentKey(txin.prevout.hash, txin.prevout.n);
-            if (fSpentIndex && GetSpentIndex(spentKey, spentInfo)) {
-                in.pushKV("value", ValueFromAmount(spentInfo.satoshis));
-                in.pushKV("valueSat", spentInfo.satoshis);
-
-                CTxDestination dest =
-                    DestFromAddressHash(spentInfo.addressType, spentInfo.addressHash);
-                if (IsValidDestination(dest)) {
-                    in.pushKV("address", keyIO.EncodeDestination(dest));
+    if (nFields & TX_FIELD_TRANSPARENT) {
+        KeyIO keyIO(Params());
+        // Look up the outputs spent by the inputs, and the spends of the
+        // outputs, at once.
+        CSpentIndexMap mapSpentInfo;
+        if (fSpentIndex) {
+            std::vector<CSpentIndexKey> vSpentKeys;
+            if (!tx.IsCoinBase()) {
+                for (const CTxIn& txin : tx.vin) {
+                    vSpentKeys.emplace_back(txin.prevout.hash, txin.prevout.n);
                 }
             }
+            for (unsigned int i = 0; i < tx.vout.size(); i++) {
+                vSpentKeys.emplace_back(txid, i);
+            }
+            GetSpentIndex(vSpentKeys, mapSpentInfo);
         }
-        in.pushKV("sequence", (int64_t)txin.nSequence);
-        vin.push_back(in);
-    }
-    entry.pushKV("vin", vin);
-    UniValue vout(UniValue::VARR);
-    for (unsigned int i = 0; i < tx.vout.size(); i++) {
-        const CTxOut& txout = tx.vout[i];
-        UniValue out(UniValue::VOBJ);
-        out.pushKV("value", ValueFromAmount(txout.nValue));
-        out.pushKV("valueZat", txout.nValue);
-        out.pushKV("valueSat", txout.nValue);
-        out.pushKV("n", (int64_t)i);
-        UniValue o(UniValue::VOBJ);
-        ScriptPubKeyToJSON(txout.scriptPubKey, o, true);
-        out.pushKV("scriptPubKey", o);
-
-        // Add spent information if spentindex is enabled
-        CSpentIndexValue spentInfo;
-        CSpentIndexKey spentKey(txid, i);
-        if (fSpentIndex && GetSpentIndex(spentKey, spentInfo)) {
-            out.pushKV("spentTxId", spentInfo.txid.GetHex());
-            out.pushKV("spentIndex", (int)spentInfo.inputIndex);
-            out.pushKV("spentHeight", spentInfo.blockHeight);
+        UniValue vin(UniValue::VARR);
+        for (const CTxIn& txin : tx.vin) {
+            UniValue in(UniValue::VOBJ);
+            if (tx.IsCoinBase())
+                in.pushKV("coinbase", HexStr(txin.scriptSig.begin(), txin.scriptSig.end()));
+            else {
+                in.pushKV("txid", txin.prevout.hash.GetHex());
+                in.pushKV("vout", (int64_t)txin.prevout.n);
+                UniValue o(UniValue::VOBJ);
+                o.pushKV("asm", ScriptToAsmStr(txin.scriptSig, true));
+                o.pushKV("hex", HexStr(txin.scriptSig.begin(), txin.scriptSig.end()));
+                in.pushKV("scriptSig", o);
+
+                // Add address and value info if spentindex enabled
+                auto itSpent = mapSpentInfo.find(CSpentIndexKey(txin.prevout.hash, txin.prevout.n));
+                if (itSpent != mapSpentInfo.end()) {
+                    const CSpentIndexValue& spentInfo = itSpent->second;
+                    in.pushKV("value", ValueFromAmount(spentInfo.satoshis));
+                    in.pushKV("valueSat", spentInfo.satoshis);
+
+                    CTxDestination dest =
+                        DestFromAddressHash(spentInfo.addressType, spentInfo.addressHash);
+                    if (IsValidDestination(dest)) {
+                        in.pushKV("address", keyIO.EncodeDestination(dest));
+                    }
+                }
+            }
+            in.pushKV("sequence", (int64_t)txin.nSequence);
+            vin.push_back(in);
         }
-        vout.push_back(out);
+        entry.pushKV("vin", vin);
+        UniValue vout(UniValue::VARR);
+        for (unsigned int i = 0; i < tx.vout.size(); i++) {
+            const CTxOut& txout = tx.vout[i];
+            UniValue out(UniValue::VOBJ);
+            out.pushKV("value", ValueFromAmount(txout.nValue));
+            out.pushKV("valueZat", txout.nValue);
+            out.pushKV("valueSat", txout.nValue);
+            out.pushKV("n", (int64_t)i);
+            UniValue o(UniValue::VOBJ);
+            ScriptPubKeyToJSON(txout.scriptPubKey, o, true);
+            out.pushKV("scriptPubKey", o);
+
+            // Add spent information if spentindex is enabled
+            auto itSpent = mapSpentInfo.find(CSpentIndexKey(txid, i));
+            if (itSpent != mapSpentInfo.end()) {
+                const CSpentIndexValue& spentInfo = itSpent->second;
+                out.pushKV("spentTxId", spentInfo.txid.GetHex());
+                out.pushKV("spentIndex", (int)spentInfo.inputIndex);
+                out.pushKV("spentHeight", spentInfo.blockHeight);
+            }
+            vout.push_back(out);
+        }
+        entry.pushKV("vout", vout);
     }
-    entry.pushKV("vout", vout);
 
-    UniValue vjoinsplit = TxJoinSplitToJSON(tx);
-    entry.pushKV("vjoinsplit", vjoinsplit);
+    if (nFields & TX_FIELD_SPROUT) {
+        UniValue vjoinsplit = TxJoinSplitToJSON(tx);
+        entry.pushKV("vjoinsplit", vjoinsplit);
+    }
 
     if (tx.fOverwintered) {
-        if (tx.nVersion >= SAPLING_TX_VERSION) {
+        if (tx.nVersion >= SAPLING_TX_VERSION && (nFields & TX_FIELD_SAPLING)) {
             const auto& bundle = tx.GetSaplingBundle().GetDetails();
             entry.pushKV("valueBalance", ValueFromAmount(tx.GetValueBalanceSapling()));
             entry.pushKV("valueBalanceZat", tx.GetValueBalanceSapling());
@@ -300,13 +336,17 @@ void TxToJSON(const CTransaction& tx, const uint256 hashBlock, UniValue& entry)
                 entry.pushKV("bindingSig", HexStr(bindingSig.begin(), bindingSig.end()));
             }
         }
-        if (tx.nVersion >= ZIP225_TX_VERSION) {
+        if (tx.nVersion >= ZIP225_TX_VERSION && (nFields & TX_FIELD_ORCHARD)) {
             UniValue orchard = TxOrchardBundleToJSON(tx, entry);
             entry.pushKV("orchard", orchard);
         }
     }
 
-    if (tx.nVersion >= 2 && tx.vJoinSplit.size() > 0) {
+    if (nFields & TX_FIELD_SHIELDED_SUMMARY) {
+        entry.pushKV("shieldedSummary", TxShieldedSummaryToJSON(tx));
+    }
+
+    if (tx.nVersion >= 2 && tx.vJoinSplit.size() > 0 && (nFields & TX_FIELD_SPROUT)) {
         // Copy joinSplitPubKey into a uint256 so that
         // it is byte-flipped in the RPC output.
         uint256 joinSplitPubKey;
@@ -337,6 +377,11 @@ void TxToJSON(const CTransaction& tx, const uint256 hashBlock, UniValue& entry)
     }
 }
 
+void TxToJSON(const CTransaction& tx, const uint256 hashBlock, UniValue& entry)
+{
+    TxToJSON(tx, hashBlock, entry, TX_FIELDS_DEFAULT);
+}
+
 UniValue getrawtransaction(const UniValue& params, bool fHelp)
 {
     if (fHelp || params.size() < 1 || params.size() > 3)
@@ -348,9 +393,13 @@ UniValue getrawtransaction(const UniValue& params, bool fHelp)
             "is known, its hash can be provided even for nodes without -txindex. Note that if a blockhash is\n"
             "provided, only that block will be searched and if the transaction is in the mempool or other\n"
             "blocks, or if this node does not have the given block available, the transaction will not be found.\n"
+            "The -txlocationindex option also enables blockchain transaction queries.\n"
             "\nReturn the raw transaction data.\n"
             "\nIf verbose=0, returns a string that is serialized, hex-encoded data for 'txid'.\n"
             "If verbose is non-zero, returns an Object with information about 'txid'.\n"
+            "\nOver JSON-RPC, \"txid\" may also be an array of txids, which are looked up together;\n"
+            "the result is then an array of the results for each txid, or null where it was not found.\n"
+            "With -txlocationindex, each block holding some of them is read only once.\n"
 
             "\nArguments:\n"
             "1. \"txid\"      (string, required) The transaction id\n"
@@ -505,6 +554,36 @@ UniValue getrawtransaction(const UniValue& params, bool fHelp)
             + HelpExampleCli("getrawtransaction", "\"mytxid\" 1 \"myblockhash\"")
         );
 
+    if (params[0].isArray()) {
+        if (params.size() > 2)
+            throw JSONRPCError(RPC_INVALID_PARAMETER, "A blockhash cannot be given with an array of txids");
+        bool fVerbose = params.size() > 1 && params[1].get_int() != 0;
+        std::vector<uint256> hashes;
+        for (const UniValue& txid : params[0].getValues()) {
+            hashes.push_back(ParseHashV(txid, "txid"));
+        }
+
+        // The transactions are read without holding cs_main.
+        std::vector<std::optional<std::pair<CTransaction, uint256>>> vResult;
+        GetTransactions(hashes, vResult, Params().GetConsensus());
+
+        LOCK(cs_main);
+        UniValue results(UniValue::VARR);
+        for (const auto& result : vResult) {
+            if (!result) {
+                results.push_back(NullUniValue);
+            } else if (!fVerbose) {
+                results.push_back(EncodeHexTx(result->first));
+            } else {
+                UniValue entry(UniValue::VOBJ);
+                entry.pushKV("hex", EncodeHexTx(result->first));
+                TxToJSON(result->first, result->second, entry);
+                results.push_back(entry);
+            }
+        }
+        return results;
+    }
+
     LOCK(cs_main);
 
     bool in_active_chain = true;
@@ -537,7 +616,7 @@ UniValue getrawtransaction(const UniValue& params, bool fHelp)
             }
             errmsg = "No such transaction found in the provided block";
         } else {
-            errmsg = fTxIndex
+            errmsg = fTxIndex || ptxlocationindex
               ? "No such mempool or blockchain transaction"
               : "No such mempool transaction. Use -txindex to enable blockchain transaction queries";
         }
@@ -630,7 +709,7 @@ UniValue gettxoutproof(const UniValue& params, bool fHelp)
     if (ntxFound != setTxids.size())
         throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "(Not all) transactions not found in specified block");
 
-    CDataStream ssMB(SER_NETWORK, PROTOCOL_VERSION);
+    CPublicDataStream ssMB(SER_NETWORK, PROTOCOL_VERSION);
     CMerkleBlock mb(block, setTxids);
     ssMB << mb;
     std::string strHex = HexStr(ssMB.begin(), ssMB.end());
@@ -650,7 +729,7 @@ UniValue verifytxoutproof(const UniValue& params, bool fHelp)
             "[\"txid\"]      (array, strings) The txid(s) which the proof commits to, or empty array if the proof is invalid\n"
         );
 
-    CDataStream ssMB(ParseHexV(params[0], "proof"), SER_NETWORK, PROTOCOL_VERSION);
+    CPublicDataStream ssMB(ParseHexV(params[0], "proof"), SER_NETWORK, PROTOCOL_VERSION);
     CMerkleBlock merkleBlock;
     ssMB >> merkleBlock;
 
@@ -1025,7 +1104,7 @@ UniValue signrawtransaction(const UniValue& params, bool fHelp)
     RPCTypeCheck(params, boost::assign::list_of(UniValue::VSTR)(UniValue::VARR)(UniValue::VARR)(UniValue::VSTR)(UniValue::VSTR), true);
 
     vector<unsigned char> txData(ParseHexV(params[0], "argument 1"));
-    CDataStream ssData(txData, SER_NETWORK, PROTOCOL_VERSION);
+    CPublicDataStream ssData(txData, SER_NETWORK, PROTOCOL_VERSION);
     vector<CMutableTransaction> txVariants;
     while (!ssData.empty()) {
         try {
@@ -1313,18 +1392,130 @@ UniValue sendrawtransaction(const UniValue& params, bool fHelp)
     return hashTx.GetHex();
 }
 
+UniValue sendrawtransactions(const UniValue& params, bool fHelp)
+{
+    if (fHelp || params.size() < 1 || params.size() > 2)
+        throw runtime_error(
+            "sendrawtransactions [\"hexstring\",...] ( allowhighfees )\n"
+            "\nSubmits several raw transactions (serialized, hex-encoded) to local node and network.\n"
+            "The Sapling and Orchard proofs and signatures of the transactions are checked together,\n"
+            "which is faster than submitting them one at a time with sendrawtransaction. A transaction\n"
+            "may spend the outputs of others in the list.\n"
+            "\nArguments:\n"
+            "1. \"hexstrings\"   (array, required) The hex strings of the raw transactions\n"
+            "2. allowhighfees    (boolean, optional, default=false) Allow high fees\n"
+            "\nResult:\n"
+            "[                   (array of json objects, in the order of the transactions)\n"
+            "  {\n"
+            "    \"txid\": \"hex\",   (string) The transaction hash in hex\n"
+            "    \"error\": \"msg\"   (string, optional) Why the transaction was not accepted, if it was not\n"
+            "  }\n"
+            "  ,...\n"
+            "]\n"
+            "\nExamples:\n"
+            + HelpExampleCli("sendrawtransactions", "\"[\\\"signedhex\\\",\\\"signedhex\\\"]\"") +
+            "\nAs a json rpc call\n"
+            + HelpExampleRpc("sendrawtransactions", "[\"signedhex\",\"signedhex\"]")
+        );
+
+    LOCK(cs_main);
+    RPCTypeCheck(params, boost::assign::list_of(UniValue::VARR)(UniValue::VBOOL));
+
+    const UniValue& hexstrings = params[0].get_array();
+    std::vector<CTransactionRef> vtx;
+    for (size_t i = 0; i < hexstrings.size(); i++) {
+        CTransaction tx;
+        if (!hexstrings[i].isStr() || !DecodeHexTx(tx, hexstrings[i].get_str()))
+            throw JSONRPCError(RPC_DESERIALIZATION_ERROR, strprintf("TX decode failed for transaction %d", i));
+        vtx.push_back(MakeTransactionRef(std::move(tx)));
+    }
+
+    auto chainparams = Params();
+
+    bool fOverrideFees = false;
+    if (params.size() > 1)
+        fOverrideFees = params[1].get_bool();
+
+    // The error for each transaction that will not be submitted.
+    std::vector<std::string> vErrors(vtx.size());
+    std::vector<CTransactionRef> vSubmit;
+    std::vector<size_t> vSubmitIndex;
+    int nextBlockHeight = chainActive.Height() + 1;
+    CCoinsViewCache &view = *pcoinsTip;
+    for (size_t i = 0; i < vtx.size(); i++) {
+        const CTransaction& tx = *vtx[i];
+        uint256 hashTx = tx.GetHash();
+
+        // DoS mitigation: reject transactions expiring soon
+        if (tx.nExpiryHeight > 0 &&
+            chainparams.GetConsensus().NetworkUpgradeActive(nextBlockHeight, Consensus::UPGRADE_OVERWINTER) &&
+            nextBlockHeight + TX_EXPIRING_SOON_THRESHOLD > tx.nExpiryHeight)
+        {
+            vErrors[i] = strprintf("tx-expiring-soon: expiryheight is %d but should be at least %d to avoid transaction expiring soon",
+                tx.nExpiryHeight,
+                nextBlockHeight + TX_EXPIRING_SOON_THRESHOLD);
+            continue;
+        }
+
+        const CCoins* existingCoins = view.AccessCoins(hashTx);
+        if (existingCoins && existingCoins->nHeight < 1000000000) {
+            vErrors[i] = "transaction already in block chain";
+        } else if (!mempool.exists(hashTx)) {
+            vSubmit.push_back(vtx[i]);
+            vSubmitIndex.push_back(i);
+        }
+    }
+
+    // push to local node and sync with wallets
+    std::vector<CValidationState> vStates;
+    std::vector<bool> vMissingInputs;
+    std::vector<bool> vAccepted = AcceptToMemoryPoolBatch(chainparams, mempool, vStates, vSubmit, true, &vMissingInputs, !fOverrideFees);
+    for (size_t k = 0; k < vSubmit.size(); k++) {
+        if (vAccepted[k]) {
+            continue;
+        }
+        const CValidationState& state = vStates[k];
+        std::string& strError = vErrors[vSubmitIndex[k]];
+        if (state.IsInvalid()) {
+            strError = strprintf("%i: %s", state.GetRejectCode(), state.GetRejectReason());
+        } else if (vMissingInputs[k]) {
+            strError = "Missing inputs";
+        } else {
+            strError = state.GetRejectReason();
+        }
+        // An empty reject reason would read as success.
+        if (strError.empty()) {
+            strError = "not accepted";
+        }
+    }
+
+    UniValue result(UniValue::VARR);
+    for (size_t i = 0; i < vtx.size(); i++) {
+        UniValue entry(UniValue::VOBJ);
+        entry.pushKV("txid", vtx[i]->GetHash().GetHex());
+        if (vErrors[i].empty()) {
+            RelayTransaction(*vtx[i]);
+        } else {
+            entry.pushKV("error", vErrors[i]);
+        }
+        result.push_back(entry);
+    }
+    return result;
+}
+
 static const CRPCCommand commands[] =
-{ //  category              name                      actor (function)         okSafeMode
-  //  --------------------- ------------------------  -----------------------  ----------
-    { "rawtransactions",    "getrawtransaction",      &getrawtransaction,      true  },
-    { "rawtransactions",    "createrawtransaction",   &createrawtransaction,   true  },
-    { "rawtransactions",    "decoderawtransaction",   &decoderawtransaction,   true  },
-    { "rawtransactions",    "decodescript",           &decodescript,           true  },
-    { "rawtransactions",    "sendrawtransaction",     &sendrawtransaction,     false },
-    { "rawtransactions",    "signrawtransaction",     &signrawtransaction,     false }, /* uses wallet if enabled */
-
-    { "blockchain",         "gettxoutproof",          &gettxoutproof,          true  },
-    { "blockchain",         "verifytxoutproof",       &verifytxoutproof,       true  },
+{ //  category              name                      actor (function)         okSafeMode okParallel
+  //  --------------------- ------------------------  -----------------------  ---------- ----------
+    { "rawtransactions",    "getrawtransaction",      &getrawtransaction,      true,      true  },
+    { "rawtransactions",    "createrawtransaction",   &createrawtransaction,   true,      true  },
+    { "rawtransactions",    "decoderawtransaction",   &decoderawtransaction,   true,      true  },
+    { "rawtransactions",    "decodescript",           &decodescript,           true,      true  },
+    { "rawtransactions",    "sendrawtransaction",     &sendrawtransaction,     false,     false },
+    { "rawtransactions",    "sendrawtransactions",    &sendrawtransactions,    false,     false },
+    { "rawtransactions",    "signrawtransaction",     &signrawtransaction,     false,     false }, /* uses wallet if enabled */
+
+    { "blockchain",         "gettxoutproof",          &gettxoutproof,          true,      true  },
+    { "blockchain",         "verifytxoutproof",       &verifytxoutproof,       true,      true  },
 };
 
 void RegisterRawTransactionRPCCommands(CRPCTable &tableRPC)
@@ -11,13 +11,18 @@
 #include "key_io.h"
 #include "random.h"
 #include "rpc/common.h"
+#include "rpc/jsonwriter.h"
 #include "sync.h"
 #include "ui_interface.h"
 #include "util/system.h"
 #include "util/strencodings.h"
 #include "asyncrpcqueue.h"
 
+#include <atomic>
+#include <condition_variable>
+#include <list>
 #include <memory>
+#include <set>
 
 #include <univalue.h>
 
@@ -29,6 +34,7 @@
 #include <boost/thread.hpp>
 #include <boost/algorithm/string/case_conv.hpp> // for to_upper()
 
+#include <rust/metrics.h>
 #include <tracing.h>
 
 using namespace RPCServer;
@@ -45,6 +51,25 @@ static std::vector<RPCTimerInterface*> timerInterfaces;
  * @note Can be changed to std::unique_ptr when C++11 */
 static std::map<std::string, boost::shared_ptr<RPCTimerBase> > deadlineTimers;
 
+struct RPCMethodLimit
+{
+    int nLimit;
+    int nRunning;
+};
+static Mutex cs_rpcMethodLimits;
+//! Limits set with -rpcmethodlimit, by method or category name
+static std::map<std::string, RPCMethodLimit> mapRPCMethodLimits GUARDED_BY(cs_rpcMethodLimits);
+
+struct RPCCommandExecutionInfo
+{
+    std::string method;
+    int64_t nStartMicros;
+};
+
+static Mutex cs_rpcActiveCommands;
+//! The calls that are running, in the order they started.
+static std::list<RPCCommandExecutionInfo> g_rpcActiveCommands GUARDED_BY(cs_rpcActiveCommands);
+
 static struct CRPCSignals
 {
     boost::signals2::signal<void ()> Started;
@@ -278,6 +303,44 @@ UniValue setlogfilter(const UniValue& params, bool fHelp)
 }
 
 
+UniValue getrpcinfo(const UniValue& params, bool fHelp)
+{
+    if (fHelp || params.size() != 0)
+        throw runtime_error(
+            "getrpcinfo\n"
+            "\nReturns details of the RPC server.\n"
+            "\nResult:\n"
+            "{\n"
+            "  \"active_commands\": [     (array) The calls that are running, this one included\n"
+            "    {\n"
+            "      \"method\": \"xxxx\",     (string) The name of the RPC method\n"
+            "      \"duration\": n          (numeric) The time in microseconds the call has been running\n"
+            "    },\n"
+            "    ...\n"
+            "  ]\n"
+            "}\n"
+            "\nExamples:\n"
+            + HelpExampleCli("getrpcinfo", "")
+            + HelpExampleRpc("getrpcinfo", "")
+        );
+
+    UniValue active(UniValue::VARR);
+    int64_t nNow = GetTimeMicros();
+    {
+        LOCK(cs_rpcActiveCommands);
+        for (const auto& info : g_rpcActiveCommands) {
+            UniValue entry(UniValue::VOBJ);
+            entry.pushKV("method", info.method);
+            entry.pushKV("duration", nNow - info.nStartMicros);
+            active.push_back(entry);
+        }
+    }
+
+    UniValue result(UniValue::VOBJ);
+    result.pushKV("active_commands", active);
+    return result;
+}
+
 UniValue stop(const UniValue& params, bool fHelp)
 {
     // Accept the deprecated and ignored 'detach' boolean argument
@@ -298,6 +361,7 @@ static const CRPCCommand vRPCCommands[] =
 { //  category              name                      actor (function)         okSafeMode
   //  --------------------- ------------------------  -----------------------  ----------
     /* Overall control/query calls */
+    { "control",            "getrpcinfo",             &getrpcinfo,             true  },
     { "control",            "help",                   &help,                   true  },
     { "control",            "setlogfilter",           &setlogfilter,           true  },
     { "control",            "stop",                   &stop,                   true  },
@@ -343,20 +407,16 @@ bool StartRPC()
     fRPCRunning = true;
     g_rpcSignals.Started();
 
-    // Launch one async rpc worker.  The ability to launch multiple workers is not recommended at present and thus the option is disabled.
-    getAsyncRPCQueue()->addWorker();
-/*
-    int n = GetArg("-rpcasyncthreads", 1);
-    if (n<1) {
-        LogPrintf("ERROR: Invalid value %d for -rpcasyncthreads.  Must be at least 1.\n", n);
-        strerr = strprintf(_("An error occurred while setting up the Async RPC threads, invalid parameter value of %d (must be at least 1)."), n);
-        uiInterface.ThreadSafeMessageBox(strerr, "", CClientUIInterface::MSG_ERROR);
-        StartShutdown();
-        return;
+    // Spendable notes are locked by the operation that spends them, so
+    // operations can run at the same time.
+    int n = GetArg("-rpcasyncthreads", DEFAULT_RPC_ASYNC_THREADS);
+    if (n <= 0) {
+        n = GetNumCores() / 4;
     }
+    n = std::max(1, std::min(n, MAX_RPC_ASYNC_THREADS));
+    LogPrintf("Using %d async RPC threads\n", n);
     for (int i = 0; i < n; i++)
         getAsyncRPCQueue()->addWorker();
-*/
     return true;
 }
 
@@ -404,6 +464,108 @@ bool RPCIsInWarmup(std::string *outStatus)
     return fRPCInWarmup;
 }
 
+bool SetRPCMethodLimits(const std::vector<std::string>& vLimits, std::string& strError)
+{
+    std::set<std::string> setCategories;
+    for (const std::string& strMethod : tableRPC.listCommands()) {
+        setCategories.insert(tableRPC[strMethod]->category);
+    }
+
+    std::map<std::string, RPCMethodLimit> mapLimits;
+    for (const std::string& strLimit : vLimits) {
+        size_t nPos = strLimit.rfind(':');
+        int nLimit;
+        if (nPos == std::string::npos || !ParseInt32(strLimit.substr(nPos + 1), &nLimit) || nLimit < 1) {
+            strError = strprintf(_("Invalid -rpcmethodlimit '%s', expected <method>:<n> or <category>:<n>"), strLimit);
+            return false;
+        }
+        std::string strName = strLimit.substr(0, nPos);
+        if (!tableRPC[strName] && !setCategories.count(strName)) {
+            strError = strprintf(_("Unknown RPC method or category in -rpcmethodlimit: '%s'"), strName);
+            return false;
+        }
+        mapLimits[strName] = {nLimit, 0};
+    }
+
+    LOCK(cs_rpcMethodLimits);
+    mapRPCMethodLimits = std::move(mapLimits);
+    return true;
+}
+
+/**
+ * Counts a call against the -rpcmethodlimit of its method, or else of its
+ * category, for as long as it runs.
+ */
+class RPCMethodLimitGuard
+{
+private:
+    std::string strKey;
+
+public:
+    explicit RPCMethodLimitGuard(const CRPCCommand& cmd)
+    {
+        LOCK(cs_rpcMethodLimits);
+        auto it = mapRPCMethodLimits.find(cmd.name);
+        if (it == mapRPCMethodLimits.end()) {
+            it = mapRPCMethodLimits.find(cmd.category);
+            if (it == mapRPCMethodLimits.end()) {
+                return;
+            }
+        }
+        if (it->second.nRunning >= it->second.nLimit) {
+            throw JSONRPCError(RPC_METHOD_BUSY, strprintf("Too many %s calls are running, try again later", it->first));
+        }
+        it->second.nRunning++;
+        strKey = it->first;
+    }
+
+    ~RPCMethodLimitGuard()
+    {
+        if (!strKey.empty()) {
+            LOCK(cs_rpcMethodLimits);
+            mapRPCMethodLimits[strKey].nRunning--;
+        }
+    }
+};
+
+/**
+ * Lists a call in getrpcinfo for as long as it runs, then records how long
+ * it took, and how long it waited for locks if they are profiled, as
+ * metrics of its method.
+ */
+class RPCCommandExecution
+{
+private:
+    const std::string& strMethod;
+    std::list<RPCCommandExecutionInfo>::iterator it;
+    int64_t nLockWaitStart;
+
+public:
+    explicit RPCCommandExecution(const CRPCCommand& cmd) : strMethod(cmd.name)
+    {
+        {
+            LOCK(cs_rpcActiveCommands);
+            it = g_rpcActiveCommands.insert(g_rpcActiveCommands.end(), {cmd.name, GetTimeMicros()});
+        }
+        nLockWaitStart = GetThreadLockWaitMicros();
+    }
+
+    ~RPCCommandExecution()
+    {
+        int64_t nLockWait = GetThreadLockWaitMicros() - nLockWaitStart;
+        int64_t nStart;
+        {
+            LOCK(cs_rpcActiveCommands);
+            nStart = it->nStartMicros;
+            g_rpcActiveCommands.erase(it);
+        }
+        MetricsHistogram("zcash.rpc.method.seconds", (GetTimeMicros() - nStart) * 0.000001, "method", strMethod.c_str());
+        if (g_lock_stats_enabled) {
+            MetricsHistogram("zcash.rpc.method.lock.wait.seconds", nLockWait * 0.000001, "method", strMethod.c_str());
+        }
+    }
+};
+
 void JSONRequest::parse(const UniValue& valRequest)
 {
     // Parse request
@@ -433,40 +595,145 @@ void JSONRequest::parse(const UniValue& valRequest)
         throw JSONRPCError(RPC_INVALID_REQUEST, "Params must be an array");
 }
 
-static UniValue JSONRPCExecOne(const UniValue& req)
+std::string JSONRPCExecute(const JSONRequest& jreq)
 {
-    UniValue rpc_result(UniValue::VOBJ);
+    // The same object as JSONRPCReplyObj, with the result written in place.
+    std::string strReply = "{\"result\":";
+    size_t nResultStart = strReply.size();
+    JSONWriter out(strReply);
+    tableRPC.execute(jreq.strMethod, jreq.params, out);
+    // The method exists, as the call succeeded.
+    MetricsHistogram("zcash.rpc.method.response.bytes", strReply.size() - nResultStart, "method", jreq.strMethod.c_str());
+    strReply += ",\"error\":null,\"id\":";
+    strReply += jreq.id.write();
+    strReply += '}';
+    return strReply;
+}
+
+UniValue WriterToUniValue(rpcwritefn_type writer, const UniValue& params)
+{
+    std::string strResult;
+    JSONWriter out(strResult);
+    writer(params, out);
+    UniValue result;
+    if (!result.read(strResult)) {
+        throw JSONRPCError(RPC_INTERNAL_ERROR, "Invalid JSON written for result");
+    }
+    return result;
+}
 
+static std::string JSONRPCExecOne(const UniValue& req)
+{
     JSONRequest jreq;
     try {
         jreq.parse(req);
-
-        UniValue result = tableRPC.execute(jreq.strMethod, jreq.params);
-        rpc_result = JSONRPCReplyObj(result, NullUniValue, jreq.id);
+        return JSONRPCExecute(jreq);
     }
     catch (const UniValue& objError)
     {
-        rpc_result = JSONRPCReplyObj(NullUniValue, objError, jreq.id);
+        return JSONRPCReplyObj(NullUniValue, objError, jreq.id).write();
     }
     catch (const std::exception& e)
     {
-        rpc_result = JSONRPCReplyObj(NullUniValue,
-                                     JSONRPCError(RPC_PARSE_ERROR, e.what()), jreq.id);
+        return JSONRPCReplyObj(NullUniValue,
+                               JSONRPCError(RPC_PARSE_ERROR, e.what()), jreq.id).write();
     }
+}
 
-    return rpc_result;
+static bool IsParallelRequest(const UniValue& req)
+{
+    if (!req.isObject()) {
+        return false;
+    }
+    const UniValue& valMethod = find_value(req.get_obj(), "method");
+    if (!valMethod.isStr()) {
+        return false;
+    }
+    const CRPCCommand* pcmd = tableRPC[valMethod.get_str()];
+    return pcmd && pcmd->okParallel;
 }
 
-std::string JSONRPCExecBatch(const UniValue& vReq)
+/**
+ * A run of consecutive batch elements that may be executed in any order.
+ * The elements are claimed one at a time by the thread that received the
+ * batch and by the helpers it queued. Helpers that start after every element
+ * was claimed return at once, so the caller never waits for a helper that is
+ * still queued.
+ */
+struct RPCBatchRun
 {
-    UniValue ret(UniValue::VARR);
-    for (size_t reqIdx = 0; reqIdx < vReq.size(); reqIdx++)
-        ret.push_back(JSONRPCExecOne(vReq[reqIdx]));
+    std::vector<UniValue> vReq;
+    std::vector<std::string> vReply;
+    std::atomic<size_t> nNext{0};
 
-    return ret.write() + "\n";
+    Mutex cs;
+    std::condition_variable cond;
+    size_t nDone GUARDED_BY(cs) = 0;
+
+    void Work()
+    {
+        size_t i;
+        while ((i = nNext++) < vReq.size()) {
+            vReply[i] = JSONRPCExecOne(vReq[i]);
+            LOCK(cs);
+            if (++nDone == vReq.size()) {
+                cond.notify_all();
+            }
+        }
+    }
+
+    void Wait()
+    {
+        WAIT_LOCK(cs, lock);
+        while (nDone < vReq.size()) {
+            cond.wait(lock);
+        }
+    }
+};
+
+std::string JSONRPCExecBatch(const UniValue& vReq, const std::function<bool(std::function<void()>)>& enqueue)
+{
+    std::string ret = "[";
+    auto addReply = [&ret](const std::string& strReply) {
+        if (ret.size() > 1) {
+            ret += ',';
+        }
+        ret += strReply;
+    };
+    size_t reqIdx = 0;
+    while (reqIdx < vReq.size()) {
+        size_t runEnd = reqIdx;
+        while (enqueue && runEnd < vReq.size() && IsParallelRequest(vReq[runEnd])) {
+            runEnd++;
+        }
+        if (runEnd - reqIdx < 2) {
+            addReply(JSONRPCExecOne(vReq[reqIdx++]));
+            continue;
+        }
+
+        auto run = std::make_shared<RPCBatchRun>();
+        for (size_t i = reqIdx; i < runEnd; i++) {
+            run->vReq.push_back(vReq[i]);
+        }
+        run->vReply.resize(run->vReq.size());
+        size_t nHelpers = std::min(run->vReq.size() - 1, MAX_RPC_BATCH_HELPERS);
+        for (size_t i = 0; i < nHelpers; i++) {
+            if (!enqueue([run]() { run->Work(); })) {
+                break;
+            }
+        }
+        run->Work();
+        run->Wait();
+        for (const std::string& strReply : run->vReply) {
+            addReply(strReply);
+        }
+        reqIdx = runEnd;
+    }
+
+    return ret + "]\n";
 }
 
-UniValue CRPCTable::execute(const std::string &strMethod, const UniValue &params) const
+const CRPCCommand* CRPCTable::PrepareCall(const std::string &strMethod, const UniValue &params) const
 {
     // Return immediately if in warmup
     {
@@ -482,45 +749,70 @@ UniValue CRPCTable::execute(const std::string &strMethod, const UniValue &params
 
     g_rpcSignals.PreCommand(*pcmd);
 
+    auto paramRange = rpcCvtTable.find(strMethod);
+    if (paramRange == rpcCvtTable.end()) {
+        throw JSONRPCError(
+                RPC_INTERNAL_ERROR,
+                "Parameters for "
+                + strMethod
+                + " not found – this is an internal error, please report it.");
+    }
+    auto numRequired = paramRange->second.first.size();
+    auto numOptional = paramRange->second.second.size();
+    if (params.size() < numRequired || numRequired + numOptional < params.size()) {
+        std::string helpMsg;
+        try {
+            // help gets thrown – if it doesn’t throw, then no help message
+            pcmd->actor(params, true);
+        } catch (const std::runtime_error& err) {
+            helpMsg = std::string("\n\n") + err.what();
+        }
+        throw JSONRPCError(
+            RPC_INVALID_PARAMS,
+            strprintf(
+                    "%s for method `%s`. Needed %s, but received %u%s",
+                    params.size() < numRequired
+                    ? "Not enough parameters"
+                    : "Too many parameters",
+                    strMethod,
+                    numOptional == 0
+                    ? strprintf("exactly %u", numRequired)
+                    : strprintf("at least %u and at most %u", numRequired, numRequired + numOptional),
+                    params.size(),
+                    helpMsg));
+    }
+    return pcmd;
+}
+
+UniValue CRPCTable::execute(const std::string &strMethod, const UniValue &params) const
+{
+    const CRPCCommand *pcmd = PrepareCall(strMethod, params);
+    RPCMethodLimitGuard limitGuard(*pcmd);
+    RPCCommandExecution execution(*pcmd);
+    try
+    {
+        // Execute
+        return pcmd->actor(params, false);
+    }
+    catch (const std::exception& e)
+    {
+        throw JSONRPCError(RPC_MISC_ERROR, e.what());
+    }
+}
+
+void CRPCTable::execute(const std::string &strMethod, const UniValue &params, JSONWriter& out) const
+{
+    const CRPCCommand *pcmd = PrepareCall(strMethod, params);
+    RPCMethodLimitGuard limitGuard(*pcmd);
+    RPCCommandExecution execution(*pcmd);
     try
     {
         // Execute
-        auto paramRange = rpcCvtTable.find(strMethod);
-        if (paramRange != rpcCvtTable.end()) {
-            auto numRequired = paramRange->second.first.size();
-            auto numOptional = paramRange->second.second.size();
-            if (params.size() < numRequired || numRequired + numOptional < params.size()) {
-                std::string helpMsg;
-                try {
-                    // help gets thrown – if it doesn’t throw, then no help message
-                    pcmd->actor(params, true);
-                } catch (const std::runtime_error& err) {
-                    helpMsg = std::string("\n\n") + err.what();
-                }
-                throw JSONRPCError(
-                    RPC_INVALID_PARAMS,
-                    strprintf(
-                            "%s for method `%s`. Needed %s, but received %u%s",
-                            params.size() < numRequired
-                            ? "Not enough parameters"
-                            : "Too many parameters",
-                            strMethod,
-                            numOptional == 0
-                            ? strprintf("exactly %u", numRequired)
-                            : strprintf("at least %u and at most %u", numRequired, numRequired + numOptional),
-                            params.size(),
-                            helpMsg));
-            } else {
-                return pcmd->actor(params, false);
-            }
+        if (pcmd->writer) {
+            pcmd->writer(params, out);
         } else {
-            throw JSONRPCError(
-                    RPC_INTERNAL_ERROR,
-                    "Parameters for "
-                    + strMethod
-                    + " not found – this is an internal error, please report it.");
+            out.Value(pcmd->actor(params, false));
         }
-
     }
     catch (const std::exception& e)
     {
@@ -12,6 +12,7 @@
 #include "uint256.h"
 #include "zcash/memo.h"
 
+#include <functional>
 #include <list>
 #include <map>
 #include <stdint.h>
@@ -22,6 +23,10 @@
 
 class AsyncRPCQueue;
 class CRPCCommand;
+class JSONWriter;
+
+//! Number of helper threads a JSON-RPC batch may queue for its elements
+static const size_t MAX_RPC_BATCH_HELPERS = 3;
 
 namespace RPCServer
 {
@@ -63,6 +68,14 @@ void SetRPCWarmupFinished();
 /* returns the current warmup state.  */
 bool RPCIsInWarmup(std::string *statusOut);
 
+/**
+ * Set the limits on concurrent calls given with -rpcmethodlimit, each of the
+ * form <method>:<n> or <category>:<n>. A call to a method whose limit is
+ * reached fails with RPC_METHOD_BUSY. Returns false and sets strError if an
+ * entry is malformed or names neither a method nor a category.
+ */
+bool SetRPCMethodLimits(const std::vector<std::string>& vLimits, std::string& strError);
+
 /**
  * Type-check arguments; throws JSONRPCError if wrong type given. Does not check that
  * the right number of arguments are passed, just that any passed are the correct type.
@@ -118,6 +131,9 @@ void RPCUnregisterTimerInterface(RPCTimerInterface *iface);
 void RPCRunLater(const std::string& name, std::function<void(void)> func, int64_t nSeconds);
 
 typedef UniValue(*rpcfn_type)(const UniValue& params, bool fHelp);
+//! Writes the result of a command straight to a JSONWriter. Parameters have
+//! been checked against the conversion table; help is not asked for.
+typedef void(*rpcwritefn_type)(const UniValue& params, JSONWriter& out);
 
 class CRPCCommand
 {
@@ -126,6 +142,12 @@ public:
     std::string name;
     rpcfn_type actor;
     bool okSafeMode;
+    //! Whether the command only reads node state, so that the elements of a
+    //! batch that call it may run at the same time as each other.
+    bool okParallel = false;
+    //! Used instead of actor to serialize the result of calls over HTTP, for
+    //! commands whose results can be large.
+    rpcwritefn_type writer = nullptr;
 };
 
 /**
@@ -135,6 +157,9 @@ class CRPCTable
 {
 private:
     std::map<std::string, const CRPCCommand*> mapCommands;
+
+    //! Look up a method and check that it can be called with params.
+    const CRPCCommand* PrepareCall(const std::string& method, const UniValue& params) const;
 public:
     CRPCTable();
     const CRPCCommand* operator[](const std::string& name) const;
@@ -149,6 +174,14 @@ public:
      */
     UniValue execute(const std::string &method, const UniValue &params) const;
 
+    /**
+     * Execute a method and write its result to out, with the writer of the
+     * command if it has one.
+     * @throws an exception (UniValue) when an error happens, in which case
+     * part of the result may have been written.
+     */
+    void execute(const std::string &method, const UniValue &params, JSONWriter& out) const;
+
     /**
     * Returns a list of registered commands
     * @returns List of registered commands.
@@ -189,7 +222,22 @@ extern void EnsureWalletIsUnlocked();
 bool StartRPC();
 void InterruptRPC();
 void StopRPC();
-std::string JSONRPCExecBatch(const UniValue& vReq);
+
+/**
+ * Run the elements of a JSON-RPC batch and return the serialized array of
+ * their replies, in the order of the requests. Consecutive elements that
+ * call okParallel commands are spread over the calling thread and up to
+ * MAX_RPC_BATCH_HELPERS helpers, which are queued with enqueue if it is
+ * given; the other elements are run in order on the calling thread.
+ */
+std::string JSONRPCExecBatch(const UniValue& vReq, const std::function<bool(std::function<void()>)>& enqueue = nullptr);
+/**
+ * Execute a parsed request and return the serialized reply object.
+ * @throws an exception (UniValue) when an error happens.
+ */
+std::string JSONRPCExecute(const JSONRequest& jreq);
+/** The result of writer, for callers that want it as a UniValue. */
+UniValue WriterToUniValue(rpcwritefn_type writer, const UniValue& params);
 
 extern std::string experimentalDisabledHelpMsg(const std::string& rpc, const std::vector<std::string>& enableArgs);
 
@@ -200,6 +248,26 @@ int parseMinconf(int defaultValue, const UniValue& params, int index, const std:
 extern int interpretHeightArg(int nHeight, int currentHeight);
 extern int parseHeightArg(const std::string& strHeight, int currentHeight);
 
+/**
+ * Groups of fields of the getblock result that a caller can ask for, so that
+ * the others are neither computed nor decoded. The TX_FIELD groups apply to
+ * each transaction of a verbosity 2 result, in the getrawtransaction format.
+ */
+enum BlockJSONField : unsigned int {
+    BLOCK_FIELD_CHAIN_SUPPLY    = 1 << 0,
+    BLOCK_FIELD_VALUE_POOLS     = 1 << 1,
+    BLOCK_FIELD_TREES           = 1 << 2,
+    TX_FIELD_HEX                = 1 << 3,
+    TX_FIELD_TRANSPARENT        = 1 << 4,
+    TX_FIELD_SPROUT             = 1 << 5,
+    TX_FIELD_SAPLING            = 1 << 6,
+    TX_FIELD_ORCHARD            = 1 << 7,
+    //! Counts and value balances in place of the shielded components
+    TX_FIELD_SHIELDED_SUMMARY   = 1 << 8,
+};
+static const unsigned int TX_FIELDS_DEFAULT = TX_FIELD_HEX | TX_FIELD_TRANSPARENT | TX_FIELD_SPROUT | TX_FIELD_SAPLING | TX_FIELD_ORCHARD;
+static const unsigned int BLOCK_FIELDS_DEFAULT = BLOCK_FIELD_CHAIN_SUPPLY | BLOCK_FIELD_VALUE_POOLS | BLOCK_FIELD_TREES | TX_FIELDS_DEFAULT;
+
 /// Adds relevant memo-related entries to the JSON `obj`
 void AddMemo(UniValue &obj, const std::optional<libzcash::Memo> &memo);
 
@@ -0,0 +1,56 @@
+// Copyright (c) 2026 The Zcash developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or https://www.opensource.org/licenses/mit-license.php .
+
+#include "rpc/treestatecache.h"
+
+CTreeStateCache treeStateCache(MAX_TREESTATE_CACHE_ENTRIES);
+
+std::optional<UniValue> CTreeStateCache::Get(const uint256& hash)
+{
+    LOCK(cs);
+    auto it = mapResults.find(hash);
+    if (it == mapResults.end()) {
+        stats.nMisses++;
+        return std::nullopt;
+    }
+    stats.nHits++;
+    listLRU.splice(listLRU.begin(), listLRU, it->second.itLRU);
+    return it->second.result;
+}
+
+void CTreeStateCache::Add(const uint256& hash, const UniValue& result)
+{
+    if (nMaxEntries == 0) return;
+    // The serialized size is close to what the result takes in memory,
+    // which is mostly the hex strings of the trees.
+    size_t nUsage = result.write().size();
+
+    LOCK(cs);
+    if (mapResults.count(hash)) return;
+    while (mapResults.size() >= nMaxEntries) {
+        auto itOldest = mapResults.find(listLRU.back());
+        stats.nMemoryUsage -= itOldest->second.nUsage;
+        mapResults.erase(itOldest);
+        listLRU.pop_back();
+        stats.nEvictions++;
+    }
+    listLRU.push_front(hash);
+    mapResults.emplace(hash, CachedResult{result, nUsage, listLRU.begin()});
+    stats.nMemoryUsage += nUsage;
+    stats.nInsertions++;
+}
+
+CCacheStats CTreeStateCache::GetStats() const
+{
+    LOCK(cs);
+    CCacheStats result = stats;
+    result.nEntries = mapResults.size();
+    result.nMaxEntries = nMaxEntries;
+    return result;
+}
+
+CCacheStats GetTreeStateCacheStats()
+{
+    return treeStateCache.GetStats();
+}
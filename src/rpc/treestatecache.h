@@ -0,0 +1,65 @@
+// Copyright (c) 2026 The Zcash developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or https://www.opensource.org/licenses/mit-license.php .
+
+#ifndef ZCASH_RPC_TREESTATECACHE_H
+#define ZCASH_RPC_TREESTATECACHE_H
+
+#include "cachestats.h"
+#include "sync.h"
+#include "uint256.h"
+
+#include <list>
+#include <map>
+#include <optional>
+
+#include <univalue.h>
+
+//! How many z_gettreestate results to keep.
+static const size_t MAX_TREESTATE_CACHE_ENTRIES = 1000;
+
+/**
+ * The most recently returned z_gettreestate results, by block hash. Light
+ * wallet servers ask for the tree states at the same few heights, such as
+ * the birthdays of new wallets, again and again, and each answer otherwise
+ * reads and serializes the note commitment trees of the block, and walks
+ * back through earlier blocks when the block has no tree state of its own.
+ *
+ * The tree states of a block never change, so entries are only evicted and
+ * never invalidated. Callers must still check that the block is in the
+ * active chain before using an entry.
+ */
+class CTreeStateCache
+{
+private:
+    struct CachedResult
+    {
+        UniValue result;
+        size_t nUsage;
+        std::list<uint256>::iterator itLRU;
+    };
+
+    mutable Mutex cs;
+    //! The block hashes of the entries, most recently used first.
+    std::list<uint256> listLRU GUARDED_BY(cs);
+    std::map<uint256, CachedResult> mapResults GUARDED_BY(cs);
+    const size_t nMaxEntries;
+    CCacheStats stats GUARDED_BY(cs);
+
+public:
+    explicit CTreeStateCache(size_t nMaxEntriesIn) : nMaxEntries(nMaxEntriesIn) {}
+
+    //! The cached result for the block, if there is one.
+    std::optional<UniValue> Get(const uint256& hash);
+    //! Cache the result for the block, evicting the least recently used
+    //! result if the cache is full.
+    void Add(const uint256& hash, const UniValue& result);
+    CCacheStats GetStats() const;
+};
+
+/** The statistics of the z_gettreestate result cache. */
+CCacheStats GetTreeStateCacheStats();
+
+extern CTreeStateCache treeStateCache;
+
+#endif // ZCASH_RPC_TREESTATECACHE_H
@@ -27,6 +27,9 @@ typedef struct OrchardBuilderPtr OrchardBuilderPtr;
 struct OrchardUnauthorizedBundlePtr;
 typedef struct OrchardUnauthorizedBundlePtr OrchardUnauthorizedBundlePtr;
 
+struct OrchardProvenBundlePtr;
+typedef struct OrchardProvenBundlePtr OrchardProvenBundlePtr;
+
 /// Frees the memory associated with an Orchard spend info struct that was
 /// allocated by Rust.
 void orchard_spend_info_free(OrchardSpendInfoPtr* ptr);
@@ -85,6 +88,26 @@ OrchardBundlePtr* orchard_unauthorized_bundle_prove_and_sign(
     size_t keys_len,
     const unsigned char* sighash);
 
+/// Creates the proof for a copy of the bundle, which is left unchanged.
+///
+/// Returns `null` if an error occurs.
+OrchardProvenBundlePtr* orchard_unauthorized_bundle_prove(
+    const OrchardUnauthorizedBundlePtr* bundle);
+
+/// Frees an Orchard bundle returned from `orchard_unauthorized_bundle_prove`.
+void orchard_proven_bundle_free(OrchardProvenBundlePtr* bundle);
+
+/// Adds signatures to the proven bundle.
+///
+/// Returns `null` if an error occurs.
+///
+/// `bundle` is always freed by this method.
+OrchardBundlePtr* orchard_proven_bundle_sign(
+    OrchardProvenBundlePtr* bundle,
+    const OrchardSpendingKeyPtr** keys,
+    size_t keys_len,
+    const unsigned char* sighash);
+
 #ifdef __cplusplus
 }
 #endif
@@ -138,6 +138,27 @@ bool orchard_wallet_add_notes_from_bundle(
         push_spend_action_idx_callback_t spend_cb
         );
 
+/**
+ * Like `orchard_wallet_add_notes_from_bundle`, but only decrypts the actions
+ * that the batch scanner found to be decryptable: the action at index
+ * `hintActionIdxs[i]` with the 64-byte incoming viewing key `hintIvks[i]`, for
+ * `i` below `hintsLen`. Hints that do not decrypt their action with one of the
+ * wallet's keys are ignored.
+ *
+ * Returns `true` if the bundle is involved with the wallet.
+ */
+bool orchard_wallet_add_notes_from_bundle_with_hints(
+        OrchardWalletPtr* wallet,
+        const unsigned char txid[32],
+        const OrchardBundlePtr* bundle,
+        const uint32_t* hintActionIdxs,
+        const unsigned char (*hintIvks)[64],
+        size_t hintsLen,
+        void* callbackReceiver,
+        push_action_ivk_callback_t push_cb,
+        push_spend_action_idx_callback_t spend_cb
+        );
+
 /**
  * Decrypts a selection of notes from the bundle with specified incoming viewing
  * keys, and adds those notes to the wallet.
@@ -173,6 +194,34 @@ bool orchard_wallet_append_bundle_commitments(
         const OrchardBundlePtr* bundle
         );
 
+/**
+ * A C struct used to pass the Orchard bundles of a block to Rust across the
+ * FFI boundary. This must have the same in-memory representation as the
+ * `FFIBlockBundle` type in orchard_ffi/wallet.rs.
+ */
+struct RawOrchardBlockBundle {
+    size_t txIdx;
+    unsigned char txid[32];
+    const OrchardBundlePtr* bundle;
+};
+static_assert(
+    sizeof(RawOrchardBlockBundle) == 48,
+    "RawOrchardBlockBundle struct should have exactly a 384-bit in-memory representation.");
+static_assert(alignof(RawOrchardBlockBundle) == 8, "RawOrchardBlockBundle struct alignment is not 64 bits.");
+
+/**
+ * Appends the note commitments of the given bundles of a block to the
+ * wallet's note commitment tree, as `orchard_wallet_append_bundle_commitments`
+ * does for each of them in turn, in one call. The bundles must be given in the
+ * order of their transactions in the block.
+ */
+bool orchard_wallet_append_block_commitments(
+        OrchardWalletPtr* wallet,
+        const uint32_t block_height,
+        const RawOrchardBlockBundle* bundles,
+        size_t bundlesLen
+        );
+
 /**
  * Obtains the root of the wallet's Orchard note commitment tree at the given
  * checkpoint depth, copying it to `root_ret` which must point to a 32-byte
@@ -344,6 +393,20 @@ bool orchard_wallet_is_nullifier_from_me(
 
 typedef void (*push_txid_callback_t)(void* resultVector, unsigned char txid[32]);
 
+typedef void (*push_ivk_bytes_callback_t)(void* resultVector, const unsigned char ivk[64]);
+
+/**
+ * Passes the 64-byte encoding of each of the wallet's incoming viewing keys to
+ * the `push_cb` callback, leaving out the keys the wallet cannot spend with if
+ * `requireSpendingKey` is set.
+ */
+void orchard_wallet_get_incoming_viewing_keys(
+        const OrchardWalletPtr* wallet,
+        bool requireSpendingKey,
+        void* resultVector,
+        push_ivk_bytes_callback_t push_cb
+        );
+
 /**
  * Returns a vector of transaction IDs for transactions that have been observed as
  * spending the given outpoint (transaction ID and action index) by using the `push_cb`
@@ -24,11 +24,16 @@ typedef struct TracingHandle TracingHandle;
 /// component. The handle must be freed to close the logging component.
 ///
 /// If log_path is NULL, logging is sent to standard output.
+///
+/// If span_path is not NULL, the time spent in each enabled span is written
+/// to that file in the folded stack format read by flamegraph tools.
 TracingHandle* tracing_init(
     const codeunit* log_path,
     size_t log_path_len,
     const char* initial_filter,
-    bool log_timestamps);
+    bool log_timestamps,
+    const codeunit* span_path,
+    size_t span_path_len);
 
 /// Initializes the tracing crate for use in tests, returning a handle for the
 /// logging component. The handle must be freed to close the logging component.
@@ -77,7 +82,9 @@ typedef struct TracingSpanGuard TracingSpanGuard;
 
 /// Creates a span for a callsite.
 ///
-/// The span must be freed when it goes out of scope.
+/// Returns NULL if the span is disabled by the current filter; the other span
+/// functions accept NULL and do nothing with it. Otherwise the span must be
+/// freed when it goes out of scope.
 TracingSpanHandle* tracing_span_create(
     const TracingCallsite* callsite,
     const char* const* field_values,
@@ -100,6 +107,22 @@ TracingSpanGuard* tracing_span_enter(const TracingSpanHandle* span);
 /// Exits a span by dropping the given guard.
 void tracing_span_exit(TracingSpanGuard* guard);
 
+/// Sets the maximum number of debug and trace events per second that
+/// `tracing_event_enabled` allows from each callsite, or 0 for no limit.
+///
+/// The number of events dropped from a callsite is logged at the warn level
+/// the next time it logs an event in a later second.
+void tracing_set_debug_rate_limit(uint32_t max_per_second);
+
+/// Returns whether an event for the callsite would be logged now, so that
+/// the caller can skip building its fields if it would not.
+///
+/// Debug and trace events over the limit set by
+/// `tracing_set_debug_rate_limit` are counted as dropped, and are not
+/// enabled. An event that is enabled should then be logged with
+/// `tracing_log`.
+bool tracing_event_enabled(const TracingCallsite* callsite);
+
 /// Logs a message for a callsite.
 ///
 /// You should usually call the `TracingLog` macro (or one of the helper
@@ -11,9 +11,19 @@ mod ffi {
         fn box_clone(&self) -> Box<State>;
         fn update(&mut self, input: &[u8]);
         fn finalize(&self, output: &mut [u8]);
+
+        fn hash_many(
+            output_len: usize,
+            personalization: &[u8],
+            input_len: usize,
+            inputs: &[u8],
+            outputs: &mut [u8],
+        );
     }
 }
 
+use blake2b_simd::many::HashManyJob;
+
 #[derive(Clone)]
 struct State(blake2b_simd::State);
 
@@ -26,6 +36,33 @@ fn init(output_len: usize, personalization: &[u8]) -> Box<State> {
     ))
 }
 
+/// Hashes each of the consecutive `input_len`-byte messages in `inputs`
+/// with the same parameters, writing the digests one after the other to
+/// `outputs`. The messages are hashed in parallel lanes when the CPU
+/// supports it (AVX2 is detected at runtime).
+fn hash_many(
+    output_len: usize,
+    personalization: &[u8],
+    input_len: usize,
+    inputs: &[u8],
+    outputs: &mut [u8],
+) {
+    assert!(input_len > 0 && inputs.len() % input_len == 0);
+    let count = inputs.len() / input_len;
+    assert_eq!(outputs.len(), count * output_len);
+
+    let mut params = blake2b_simd::Params::new();
+    params.hash_length(output_len).personal(personalization);
+    let mut jobs: Vec<_> = inputs
+        .chunks(input_len)
+        .map(|input| HashManyJob::new(&params, input))
+        .collect();
+    blake2b_simd::many::hash_many(jobs.iter_mut());
+    for (job, output) in jobs.iter().zip(outputs.chunks_mut(output_len)) {
+        output.copy_from_slice(job.to_hash().as_bytes());
+    }
+}
+
 impl State {
     fn box_clone(&self) -> Box<Self> {
         Box::new(self.clone())
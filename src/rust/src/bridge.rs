@@ -9,7 +9,9 @@
 // This file can't use a module comment (`//! comment`) because it causes compilation issues in zcash_script.
 use crate::{
     builder_ffi::shielded_signature_digest,
-    bundlecache::init as bundlecache_init,
+    bundlecache::{
+        init as bundlecache_init, nonce as bundlecache_nonce, restore as bundlecache_restore,
+    },
     merkle_frontier::{new_orchard, orchard_empty_root, parse_orchard, Orchard, OrchardWallet},
     note_encryption::{
         try_sapling_note_decryption, try_sapling_output_recovery, DecryptedSaplingOutput,
@@ -30,7 +32,7 @@ use crate::{
     },
     streams::{
         from_auto_file, from_blake2b_writer, from_buffered_file, from_data, from_hash_writer,
-        from_size_computer, CppStream,
+        from_size_computer, from_span_reader, CppStream,
     },
     test_harness_ffi::{
         test_only_invalid_sapling_bundle, test_only_replace_sapling_nullifier,
@@ -50,6 +52,7 @@ pub(crate) mod ffi {
         type RustStream = crate::streams::ffi::RustStream;
         type CAutoFile = crate::streams::ffi::CAutoFile;
         type CBufferedFile = crate::streams::ffi::CBufferedFile;
+        type SpanReader = crate::streams::ffi::SpanReader;
         type CHashWriter = crate::streams::ffi::CHashWriter;
         type CBLAKE2bWriter = crate::streams::ffi::CBLAKE2bWriter;
         type CSizeComputer = crate::streams::ffi::CSizeComputer;
@@ -61,6 +64,7 @@ pub(crate) mod ffi {
         fn from_data(stream: Pin<&mut RustStream>) -> Box<CppStream<'_>>;
         fn from_auto_file(file: Pin<&mut CAutoFile>) -> Box<CppStream<'_>>;
         fn from_buffered_file(file: Pin<&mut CBufferedFile>) -> Box<CppStream<'_>>;
+        fn from_span_reader(reader: Pin<&mut SpanReader>) -> Box<CppStream<'_>>;
         fn from_hash_writer(writer: Pin<&mut CHashWriter>) -> Box<CppStream<'_>>;
         fn from_blake2b_writer(writer: Pin<&mut CBLAKE2bWriter>) -> Box<CppStream<'_>>;
         fn from_size_computer(sc: Pin<&mut CSizeComputer>) -> Box<CppStream<'_>>;
@@ -91,13 +95,17 @@ pub(crate) mod ffi {
         type BundleValidityCache;
 
         fn NewBundleValidityCache(kind: &str, bytes: usize) -> UniquePtr<BundleValidityCache>;
-        fn insert(self: Pin<&mut BundleValidityCache>, entry: [u8; 32]);
+        fn insert(&self, entry: [u8; 32]);
         fn contains(&self, entry: &[u8; 32], erase: bool) -> bool;
     }
     #[namespace = "bundlecache"]
     extern "Rust" {
         #[rust_name = "bundlecache_init"]
         fn init(cache_bytes: usize);
+        #[rust_name = "bundlecache_nonce"]
+        fn nonce(kind: &str) -> Result<[u8; 32]>;
+        #[rust_name = "bundlecache_restore"]
+        fn restore(kind: &str, nonce: [u8; 32], entries: &[u8]) -> Result<()>;
     }
 
     #[namespace = "sapling"]
@@ -361,6 +369,13 @@ pub(crate) mod ffi {
         pk_d: [u8; 32],
     }
 
+    #[namespace = "wallet"]
+    struct OrchardDecryptionResult {
+        txid: [u8; 32],
+        action: u32,
+        ivk: [u8; 64],
+    }
+
     #[namespace = "wallet"]
     pub(crate) struct SaplingShieldedOutput {
         cv: [u8; 32],
@@ -399,6 +414,7 @@ pub(crate) mod ffi {
         fn init_batch_scanner(
             network: &Network,
             sapling_ivks: &[[u8; 32]],
+            orchard_ivks: &[[u8; 64]],
         ) -> Result<Box<BatchScanner>>;
         fn add_transaction(
             self: &mut BatchScanner,
@@ -414,5 +430,6 @@ pub(crate) mod ffi {
         ) -> Box<BatchResult>;
 
         fn get_sapling(self: &BatchResult) -> Vec<SaplingDecryptionResult>;
+        fn get_orchard(self: &BatchResult) -> Vec<OrchardDecryptionResult>;
     }
 }
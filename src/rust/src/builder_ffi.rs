@@ -11,7 +11,7 @@ use orchard::{
     keys::{FullViewingKey, OutgoingViewingKey},
     tree::{MerkleHashOrchard, MerklePath},
     value::NoteValue,
-    Bundle, Note,
+    Bundle, Note, Proof,
 };
 use rand_core::OsRng;
 use tracing::error;
@@ -28,8 +28,8 @@ use zcash_protocol::value::ZatBalance;
 
 use crate::{
     bridge::ffi::OrchardUnauthorizedBundlePtr,
+    init::orchard_proving_key,
     transaction_ffi::{MapTransparent, TransparentAuth},
-    ORCHARD_PK,
 };
 
 pub struct OrchardSpendInfo {
@@ -171,8 +171,7 @@ pub extern "C" fn orchard_unauthorized_bundle_prove_and_sign(
     let bundle = unsafe { Box::from_raw(bundle) };
     let keys = unsafe { slice::from_raw_parts(keys, keys_len) };
     let sighash = unsafe { sighash.as_ref() }.expect("sighash pointer may not be null.");
-    let pk = unsafe { ORCHARD_PK.as_ref() }
-        .expect("Parameters not loaded: ORCHARD_PK should have been initialized");
+    let pk = orchard_proving_key();
 
     let signing_keys = keys
         .iter()
@@ -200,6 +199,68 @@ pub extern "C" fn orchard_unauthorized_bundle_prove_and_sign(
     }
 }
 
+#[no_mangle]
+pub extern "C" fn orchard_unauthorized_bundle_prove(
+    bundle: *const Bundle<InProgress<Unproven, Unauthorized>, ZatBalance>,
+) -> *mut Bundle<InProgress<Proof, Unauthorized>, ZatBalance> {
+    let bundle = unsafe { bundle.as_ref() }.expect("bundle pointer may not be null.");
+    let pk = orchard_proving_key();
+
+    // The bundle is cloned rather than consumed, so that the caller can still compute
+    // the signature digest from it.
+    match bundle.clone().create_proof(pk, OsRng) {
+        Ok(proven) => Box::into_raw(Box::new(proven)),
+        Err(e) => {
+            error!(
+                "An error occurred while creating the orchard bundle proof: {:?}",
+                e
+            );
+            ptr::null_mut()
+        }
+    }
+}
+
+#[no_mangle]
+pub extern "C" fn orchard_proven_bundle_free(
+    bundle: *mut Bundle<InProgress<Proof, Unauthorized>, ZatBalance>,
+) {
+    if !bundle.is_null() {
+        drop(unsafe { Box::from_raw(bundle) });
+    }
+}
+
+#[no_mangle]
+pub extern "C" fn orchard_proven_bundle_sign(
+    bundle: *mut Bundle<InProgress<Proof, Unauthorized>, ZatBalance>,
+    keys: *const *const SpendingKey,
+    keys_len: size_t,
+    sighash: *const [u8; 32],
+) -> *mut Bundle<Authorized, ZatBalance> {
+    let bundle = unsafe { Box::from_raw(bundle) };
+    let keys = unsafe { slice::from_raw_parts(keys, keys_len) };
+    let sighash = unsafe { sighash.as_ref() }.expect("sighash pointer may not be null.");
+
+    let signing_keys = keys
+        .iter()
+        .map(|sk| {
+            unsafe { sk.as_ref() }
+                .expect("SpendingKey pointers must not be null")
+                .into()
+        })
+        .collect::<Vec<_>>();
+
+    match bundle.apply_signatures(OsRng, *sighash, &signing_keys) {
+        Ok(signed) => Box::into_raw(Box::new(signed)),
+        Err(e) => {
+            error!(
+                "An error occurred while signing the orchard bundle: {:?}",
+                e
+            );
+            ptr::null_mut()
+        }
+    }
+}
+
 /// Calculates a shielded signature digest for the given under-construction transaction.
 ///
 /// Returns `false` if any of the parameters are invalid; in this case, `sighash_ret`
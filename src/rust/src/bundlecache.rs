@@ -1,6 +1,6 @@
 use std::{
     convert::TryInto,
-    sync::{Once, RwLock, RwLockReadGuard, RwLockWriteGuard},
+    sync::{Once, RwLock},
 };
 
 use rand_core::{OsRng, RngCore};
@@ -24,43 +24,65 @@ impl CacheEntries {
     }
 }
 
-pub(crate) struct BundleValidityCache {
-    hasher: blake2b_simd::State,
-    cache: cxx::UniquePtr<ffi::BundleValidityCache>,
+// The C++ cache synchronizes itself: it is split into shards, each with its own lock.
+unsafe impl Send for ffi::BundleValidityCache {}
+unsafe impl Sync for ffi::BundleValidityCache {}
+
+struct Hasher {
+    nonce: [u8; 32],
+    state: blake2b_simd::State,
 }
 
-impl BundleValidityCache {
-    fn new(kind: &'static str, personalization: &[u8; 16], cache_bytes: usize) -> Self {
+impl Hasher {
+    fn new(personalization: &[u8; 16], nonce: [u8; 32]) -> Self {
         // Use BLAKE2b to produce entries from bundles. It has a block size of 128 bytes,
         // into which we put:
         // - 32 byte nonce
         // - 64 bytes of bundle commitments
         // - 32 byte sighash
-        let mut hasher = blake2b_simd::Params::new()
+        let mut state = blake2b_simd::Params::new()
             .hash_length(32)
             .personal(personalization)
             .to_state();
+        state.update(&nonce);
+        Self { nonce, state }
+    }
+}
 
+/// A bundle validity cache. It is shared by every thread that checks bundles without
+/// an outer lock: the C++ cache is sharded and locks each shard itself, and the lock
+/// around the hasher is only taken exclusively when a saved nonce is restored.
+pub(crate) struct BundleValidityCache {
+    personalization: &'static [u8; 16],
+    hasher: RwLock<Hasher>,
+    cache: cxx::UniquePtr<ffi::BundleValidityCache>,
+}
+
+impl BundleValidityCache {
+    fn new(kind: &'static str, personalization: &'static [u8; 16], cache_bytes: usize) -> Self {
         // Pre-load the hasher with a per-instance nonce. This ensures that cache entries
         // are deterministic but also unique per node.
         let mut nonce = [0; 32];
         OsRng.fill_bytes(&mut nonce);
-        hasher.update(&nonce);
 
         Self {
-            hasher,
+            personalization,
+            hasher: RwLock::new(Hasher::new(personalization, nonce)),
             cache: ffi::NewBundleValidityCache(kind, cache_bytes),
         }
     }
 
+    fn hasher(&self) -> blake2b_simd::State {
+        self.hasher.read().unwrap().state.clone()
+    }
+
     pub(crate) fn compute_entry(
         &self,
         bundle_commitment: &[u8; 32],
         bundle_authorizing_commitment: &[u8; 32],
         sighash: &[u8; 32],
     ) -> CacheEntry {
-        self.hasher
-            .clone()
+        self.hasher()
             .update(bundle_commitment)
             .update(bundle_authorizing_commitment)
             .update(sighash)
@@ -71,10 +93,23 @@ impl BundleValidityCache {
             .expect("BLAKE2b configured with hash length of 32 so conversion cannot fail")
     }
 
-    pub(crate) fn insert(&mut self, queued_entries: CacheEntries) {
+    /// Computes the entry of a Sprout JoinSplit from the public inputs of its
+    /// proof and the proof itself.
+    pub(crate) fn compute_joinsplit_entry(&self, public_input: &[u8], proof: &[u8]) -> CacheEntry {
+        self.hasher()
+            .update(public_input)
+            .update(proof)
+            .finalize()
+            .as_bytes()
+            .try_into()
+            .map(CacheEntry)
+            .expect("BLAKE2b configured with hash length of 32 so conversion cannot fail")
+    }
+
+    pub(crate) fn insert(&self, queued_entries: CacheEntries) {
         if let CacheEntries::Storing(cache_entries) = queued_entries {
             for cache_entry in cache_entries {
-                self.cache.pin_mut().insert(cache_entry.0);
+                self.cache.insert(cache_entry.0);
             }
         }
     }
@@ -95,50 +130,87 @@ impl BundleValidityCache {
 }
 
 static BUNDLE_CACHES_LOADED: Once = Once::new();
-static mut SAPLING_BUNDLE_VALIDITY_CACHE: Option<RwLock<BundleValidityCache>> = None;
-static mut ORCHARD_BUNDLE_VALIDITY_CACHE: Option<RwLock<BundleValidityCache>> = None;
+static mut SAPLING_BUNDLE_VALIDITY_CACHE: Option<BundleValidityCache> = None;
+static mut ORCHARD_BUNDLE_VALIDITY_CACHE: Option<BundleValidityCache> = None;
+static mut SPROUT_BUNDLE_VALIDITY_CACHE: Option<BundleValidityCache> = None;
 
+/// Sets up the bundle validity caches, taking `2 * cache_bytes` in total. Sprout
+/// JoinSplits are rare after Sapling activation, so the Sprout cache takes an eighth
+/// of the share of each of the Sapling and Orchard caches.
 pub(crate) fn init(cache_bytes: usize) {
     BUNDLE_CACHES_LOADED.call_once(|| unsafe {
-        SAPLING_BUNDLE_VALIDITY_CACHE = Some(RwLock::new(BundleValidityCache::new(
+        SAPLING_BUNDLE_VALIDITY_CACHE = Some(BundleValidityCache::new(
             "Sapling",
             b"SaplingVeriCache",
-            cache_bytes,
-        )));
-        ORCHARD_BUNDLE_VALIDITY_CACHE = Some(RwLock::new(BundleValidityCache::new(
+            cache_bytes - cache_bytes / 8,
+        ));
+        ORCHARD_BUNDLE_VALIDITY_CACHE = Some(BundleValidityCache::new(
             "Orchard",
             b"OrchardVeriCache",
-            cache_bytes,
-        )));
+            cache_bytes - cache_bytes / 8,
+        ));
+        SPROUT_BUNDLE_VALIDITY_CACHE = Some(BundleValidityCache::new(
+            "Sprout",
+            b"Sprout_VeriCache",
+            cache_bytes / 4,
+        ));
     });
 }
 
-pub(crate) fn sapling_bundle_validity_cache() -> RwLockReadGuard<'static, BundleValidityCache> {
-    unsafe { SAPLING_BUNDLE_VALIDITY_CACHE.as_ref() }
-        .expect("bundlecache::init() should have been called")
+fn bundle_validity_cache_by_kind(kind: &str) -> Result<&'static BundleValidityCache, String> {
+    let cache = match kind {
+        "Sapling" => unsafe { SAPLING_BUNDLE_VALIDITY_CACHE.as_ref() },
+        "Orchard" => unsafe { ORCHARD_BUNDLE_VALIDITY_CACHE.as_ref() },
+        "Sprout" => unsafe { SPROUT_BUNDLE_VALIDITY_CACHE.as_ref() },
+        _ => return Err(format!("Unknown bundle validity cache {}", kind)),
+    };
+    cache.ok_or_else(|| "bundlecache::init() should have been called".to_owned())
+}
+
+/// Returns the nonce that the entries of the bundle validity cache of the given kind
+/// are computed with, to be saved along with the entries.
+pub(crate) fn nonce(kind: &str) -> Result<[u8; 32], String> {
+    Ok(bundle_validity_cache_by_kind(kind)?
+        .hasher
         .read()
         .unwrap()
+        .nonce)
 }
 
-pub(crate) fn sapling_bundle_validity_cache_mut() -> RwLockWriteGuard<'static, BundleValidityCache>
-{
-    unsafe { SAPLING_BUNDLE_VALIDITY_CACHE.as_mut() }
+/// Replaces the nonce of the bundle validity cache of the given kind with a saved one,
+/// and inserts the saved entries, which are concatenated in `entries`.
+///
+/// The entries already in the cache were computed with the old nonce and no longer
+/// match, so this should be called before any bundle is checked.
+pub(crate) fn restore(kind: &str, nonce: [u8; 32], entries: &[u8]) -> Result<(), String> {
+    if entries.len() % 32 != 0 {
+        return Err(format!(
+            "Invalid length {} of {} bundle validity cache entries",
+            entries.len(),
+            kind
+        ));
+    }
+    let cache = bundle_validity_cache_by_kind(kind)?;
+    *cache.hasher.write().unwrap() = Hasher::new(cache.personalization, nonce);
+    for entry in entries.chunks_exact(32) {
+        cache
+            .cache
+            .insert(entry.try_into().expect("chunks are 32 bytes"));
+    }
+    Ok(())
+}
+
+pub(crate) fn sapling_bundle_validity_cache() -> &'static BundleValidityCache {
+    unsafe { SAPLING_BUNDLE_VALIDITY_CACHE.as_ref() }
         .expect("bundlecache::init() should have been called")
-        .write()
-        .unwrap()
 }
 
-pub(crate) fn orchard_bundle_validity_cache() -> RwLockReadGuard<'static, BundleValidityCache> {
+pub(crate) fn orchard_bundle_validity_cache() -> &'static BundleValidityCache {
     unsafe { ORCHARD_BUNDLE_VALIDITY_CACHE.as_ref() }
         .expect("bundlecache::init() should have been called")
-        .read()
-        .unwrap()
 }
 
-pub(crate) fn orchard_bundle_validity_cache_mut() -> RwLockWriteGuard<'static, BundleValidityCache>
-{
-    unsafe { ORCHARD_BUNDLE_VALIDITY_CACHE.as_mut() }
+pub(crate) fn sprout_bundle_validity_cache() -> &'static BundleValidityCache {
+    unsafe { SPROUT_BUNDLE_VALIDITY_CACHE.as_ref() }
         .expect("bundlecache::init() should have been called")
-        .write()
-        .unwrap()
 }
@@ -0,0 +1,24 @@
+// Copyright (c) 2026 The Zcash developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or https://www.opensource.org/licenses/mit-license.php .
+
+#[cxx::bridge(namespace = "compression")]
+mod ffi {
+    extern "Rust" {
+        fn deflate(input: &[u8], level: u8) -> Vec<u8>;
+        fn inflate(input: &[u8], max_len: usize) -> Result<Vec<u8>>;
+    }
+}
+
+/// Compresses `input` into a raw DEFLATE stream, at a level from 0 (no
+/// compression) to 10 (smallest output).
+fn deflate(input: &[u8], level: u8) -> Vec<u8> {
+    miniz_oxide::deflate::compress_to_vec(input, level)
+}
+
+/// Decompresses a raw DEFLATE stream, failing if it is malformed or would
+/// decompress to more than `max_len` bytes.
+fn inflate(input: &[u8], max_len: usize) -> Result<Vec<u8>, String> {
+    miniz_oxide::inflate::decompress_to_vec_with_limit(input, max_len)
+        .map_err(|e| format!("{:?}", e.status))
+}
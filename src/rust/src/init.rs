@@ -1,87 +1,158 @@
 use std::ffi::OsString;
 use std::path::PathBuf;
-use std::sync::Once;
+use std::sync::atomic::{AtomicBool, Ordering};
+use std::sync::{Once, OnceLock};
 
 use bls12_381::Bls12;
 use sapling::circuit::{OutputParameters, SpendParameters};
 use tracing::info;
 
 use crate::{
-    ORCHARD_PK, ORCHARD_VK, SAPLING_OUTPUT_PARAMS, SAPLING_OUTPUT_VK, SAPLING_SPEND_PARAMS,
-    SAPLING_SPEND_VK, SPROUT_GROTH16_PARAMS_PATH, SPROUT_GROTH16_VK,
+    ORCHARD_VK, SAPLING_OUTPUT_VK, SAPLING_SPEND_VK, SPROUT_GROTH16_BATCH_VK,
+    SPROUT_GROTH16_PARAMS_PATH, SPROUT_GROTH16_VK,
 };
 
 #[cxx::bridge]
 mod ffi {
     #[namespace = "init"]
     extern "Rust" {
-        fn rayon_threadpool();
+        fn rayon_threadpool(num_threads: usize);
         fn zksnark_params(sprout_path: String, load_proving_keys: bool);
     }
 }
 
 static PROOF_PARAMETERS_LOADED: Once = Once::new();
 
-fn rayon_threadpool() {
+/// Whether the proving keys may be loaded, as passed to [`zksnark_params`].
+static PROVING_KEYS_ENABLED: AtomicBool = AtomicBool::new(false);
+static SAPLING_PROVING_PARAMS: OnceLock<(SpendParameters, OutputParameters)> = OnceLock::new();
+static ORCHARD_PK: OnceLock<orchard::circuit::ProvingKey> = OnceLock::new();
+static WALLET_SCAN_POOL: OnceLock<rayon::ThreadPool> = OnceLock::new();
+
+/// Sets up the global Rayon threadpool, which verifies proofs, and the threadpool that
+/// scans blocks for the wallet. Both have `num_threads` threads, or one per CPU if it is
+/// zero, the same as the `-par` script verification threads.
+///
+/// The wallet scanning threads run at the lowest scheduling priority, and jobs queued on
+/// them never delay the verification of a block, which has its own threads.
+fn rayon_threadpool(num_threads: usize) {
     rayon::ThreadPoolBuilder::new()
+        .num_threads(num_threads)
         .thread_name(|i| format!("zc-rayon-{}", i))
         .build_global()
         .expect("Only initialized once");
+    WALLET_SCAN_POOL
+        .set(build_wallet_scan_pool(num_threads))
+        .expect("Only initialized once");
+}
+
+fn build_wallet_scan_pool(num_threads: usize) -> rayon::ThreadPool {
+    rayon::ThreadPoolBuilder::new()
+        .num_threads(num_threads)
+        .thread_name(|i| format!("zc-walletscan-{}", i))
+        .start_handler(|_| {
+            // On Linux this only applies to the calling thread.
+            #[cfg(target_os = "linux")]
+            unsafe {
+                libc::setpriority(libc::PRIO_PROCESS, 0, 19);
+            }
+        })
+        .build()
+        .expect("can build the wallet scanning threadpool")
+}
+
+/// Returns the threadpool that scans blocks for the wallet, creating it with the default
+/// number of threads if [`rayon_threadpool`] was not called, as in unit tests.
+pub(crate) fn wallet_scan_pool() -> &'static rayon::ThreadPool {
+    WALLET_SCAN_POOL.get_or_init(|| build_wallet_scan_pool(0))
 }
 
 /// Loads the zk-SNARK parameters into memory and saves paths as necessary.
 /// Only called once.
 ///
-/// If `load_proving_keys` is `false`, the proving keys will not be loaded, making it
-/// impossible to create proofs. This flag is for the Boost test suite, which never
+/// The proving keys are loaded when a proof is first created, rather than here. If
+/// `load_proving_keys` is `false`, they will never be loaded, making it impossible to
+/// create proofs. This flag is for the Boost test suite, which never
 /// creates shielded transactions, but exercises code that requires the verifying keys to
 /// be present even if there are no shielded components to verify.
 fn zksnark_params(sprout_path: String, load_proving_keys: bool) {
     PROOF_PARAMETERS_LOADED.call_once(|| {
         let sprout_path = PathBuf::from(OsString::from(sprout_path));
 
-        let sprout_vk = {
+        // The batch validator takes the unprepared key.
+        let (sprout_vk, sprout_batch_vk) = {
             use bellman::groth16::{prepare_verifying_key, VerifyingKey};
             let sprout_vk_bytes = include_bytes!("sprout-groth16.vk");
             let vk = VerifyingKey::<Bls12>::read(&sprout_vk_bytes[..])
                 .expect("should be able to parse Sprout verification key");
-            prepare_verifying_key(&vk)
+            (prepare_verifying_key(&vk), vk)
         };
 
-        // Load params
-        let (sapling_spend_params, sapling_output_params) = {
-            let (spend_buf, output_buf) = wagyu_zcash_parameters::load_sapling_parameters();
+        // The verifying keys are taken from the parameters, which are then
+        // dropped. They are read again if a proof is ever created.
+        let (sapling_spend_vk, sapling_output_vk) = {
+            let (sapling_spend_params, sapling_output_params) = read_sapling_parameters();
             (
-                SpendParameters::read(&spend_buf[..], false)
-                    .expect("Failed to read Sapling Spend parameters"),
-                OutputParameters::read(&output_buf[..], false)
-                    .expect("Failed to read Sapling Output parameters"),
+                sapling_spend_params.verifying_key(),
+                sapling_output_params.verifying_key(),
             )
         };
 
-        // We need to clone these because we aren't necessarily storing the proving
-        // parameters in memory.
-        let sapling_spend_vk = sapling_spend_params.verifying_key();
-        let sapling_output_vk = sapling_output_params.verifying_key();
-
         // Generate Orchard parameters.
         info!(target: "main", "Loading Orchard parameters");
-        let orchard_pk = load_proving_keys.then(orchard::circuit::ProvingKey::build);
         let orchard_vk = orchard::circuit::VerifyingKey::build();
 
         // Caller is responsible for calling this function once, so
         // these global mutations are safe.
         unsafe {
-            SAPLING_SPEND_PARAMS = load_proving_keys.then_some(sapling_spend_params);
-            SAPLING_OUTPUT_PARAMS = load_proving_keys.then_some(sapling_output_params);
             SPROUT_GROTH16_PARAMS_PATH = Some(sprout_path);
 
             SAPLING_SPEND_VK = Some(sapling_spend_vk);
             SAPLING_OUTPUT_VK = Some(sapling_output_vk);
             SPROUT_GROTH16_VK = Some(sprout_vk);
+            SPROUT_GROTH16_BATCH_VK = Some(sprout_batch_vk);
 
-            ORCHARD_PK = orchard_pk;
             ORCHARD_VK = Some(orchard_vk);
         }
+        PROVING_KEYS_ENABLED.store(load_proving_keys, Ordering::Release);
     });
 }
+
+fn read_sapling_parameters() -> (SpendParameters, OutputParameters) {
+    let (spend_buf, output_buf) = wagyu_zcash_parameters::load_sapling_parameters();
+    (
+        SpendParameters::read(&spend_buf[..], false)
+            .expect("Failed to read Sapling Spend parameters"),
+        OutputParameters::read(&output_buf[..], false)
+            .expect("Failed to read Sapling Output parameters"),
+    )
+}
+
+fn assert_proving_keys_enabled() {
+    assert!(
+        PROVING_KEYS_ENABLED.load(Ordering::Acquire),
+        "Parameters not loaded: the proving keys were not enabled"
+    );
+}
+
+/// Returns the Sapling Spend and Output proving parameters.
+///
+/// They take hundreds of megabytes of memory, and most nodes never create a proof, so
+/// they are only read on first use. Concurrent first uses wait for the same read.
+pub(crate) fn sapling_proving_params() -> &'static (SpendParameters, OutputParameters) {
+    assert_proving_keys_enabled();
+    SAPLING_PROVING_PARAMS.get_or_init(|| {
+        info!(target: "main", "Loading Sapling proving parameters");
+        read_sapling_parameters()
+    })
+}
+
+/// Returns the Orchard proving key, building it on first use like
+/// [`sapling_proving_params`].
+pub(crate) fn orchard_proving_key() -> &'static orchard::circuit::ProvingKey {
+    assert_proving_keys_enabled();
+    ORCHARD_PK.get_or_init(|| {
+        info!(target: "main", "Building Orchard proving key");
+        orchard::circuit::ProvingKey::build()
+    })
+}
@@ -19,15 +19,14 @@
 // See https://github.com/rust-lang/rfcs/pull/2585 for more background.
 #![allow(clippy::not_unsafe_ptr_arg_deref)]
 
-use ::sapling::circuit::{
-    OutputParameters, OutputVerifyingKey, SpendParameters, SpendVerifyingKey,
-};
-use bellman::groth16::PreparedVerifyingKey;
+use ::sapling::circuit::{OutputVerifyingKey, SpendVerifyingKey};
+use bellman::groth16::{PreparedVerifyingKey, VerifyingKey};
 use bls12_381::Bls12;
 use std::path::PathBuf;
 use subtle::CtOption;
 
 mod blake2b;
+mod compression;
 mod ed25519;
 mod equihash;
 mod metrics_ffi;
@@ -67,12 +66,10 @@ mod tests;
 static mut SAPLING_SPEND_VK: Option<SpendVerifyingKey> = None;
 static mut SAPLING_OUTPUT_VK: Option<OutputVerifyingKey> = None;
 static mut SPROUT_GROTH16_VK: Option<PreparedVerifyingKey<Bls12>> = None;
+static mut SPROUT_GROTH16_BATCH_VK: Option<VerifyingKey<Bls12>> = None;
 
-static mut SAPLING_SPEND_PARAMS: Option<SpendParameters> = None;
-static mut SAPLING_OUTPUT_PARAMS: Option<OutputParameters> = None;
 static mut SPROUT_GROTH16_PARAMS_PATH: Option<PathBuf> = None;
 
-static mut ORCHARD_PK: Option<orchard::circuit::ProvingKey> = None;
 static mut ORCHARD_VK: Option<orchard::circuit::VerifyingKey> = None;
 
 /// Converts CtOption<t> into Option<T>
@@ -11,7 +11,10 @@ use zcash_note_encryption::try_output_recovery_with_ovk;
 use zcash_primitives::transaction::components::orchard as orchard_serialization;
 use zcash_protocol::value::ZatBalance;
 
-use crate::{bridge::ffi, streams::CppStream};
+use crate::{
+    bridge::ffi,
+    streams::{write_buffered, CppStream},
+};
 
 pub struct Action(orchard::Action<Signature<SpendAuth>>);
 
@@ -94,8 +97,10 @@ impl Bundle {
     ///
     /// If `bundle == None`, this serializes `nActionsOrchard = 0`.
     pub(crate) fn serialize(&self, writer: &mut CppStream<'_>) -> Result<(), String> {
-        orchard_serialization::write_v5_bundle(self.inner(), writer)
-            .map_err(|e| format!("Failed to serialize Orchard bundle: {}", e))
+        write_buffered(writer, |buf| {
+            orchard_serialization::write_v5_bundle(self.inner(), buf)
+        })
+        .map_err(|e| format!("Failed to serialize Orchard bundle: {}", e))
     }
 
     pub(crate) fn inner(&self) -> Option<&orchard::Bundle<Authorized, ZatBalance>> {
@@ -4,7 +4,7 @@ use rand_core::OsRng;
 use tracing::{debug, error};
 
 use crate::{
-    bundlecache::{orchard_bundle_validity_cache, orchard_bundle_validity_cache_mut, CacheEntries},
+    bundlecache::{orchard_bundle_validity_cache, CacheEntries},
     orchard_bundle::Bundle,
 };
 
@@ -85,7 +85,7 @@ impl BatchValidator {
                 // `BatchValidator::check_bundle()` returned `true`, so at this point
                 // every bundle that was added to `inner.queued_entries` has valid
                 // authorization.
-                orchard_bundle_validity_cache_mut().insert(inner.queued_entries);
+                orchard_bundle_validity_cache().insert(inner.queued_entries);
                 true
             } else {
                 false
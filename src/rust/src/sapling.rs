@@ -35,13 +35,12 @@ use zcash_primitives::{
 use zcash_protocol::value::ZatBalance;
 
 use super::GROTH_PROOF_SIZE;
-use super::{
-    de_ct, SAPLING_OUTPUT_PARAMS, SAPLING_OUTPUT_VK, SAPLING_SPEND_PARAMS, SAPLING_SPEND_VK,
-};
+use super::{de_ct, SAPLING_OUTPUT_VK, SAPLING_SPEND_VK};
 use crate::params::Network;
 use crate::{
-    bundlecache::{sapling_bundle_validity_cache, sapling_bundle_validity_cache_mut, CacheEntries},
-    streams::CppStream,
+    bundlecache::{sapling_bundle_validity_cache, CacheEntries},
+    init::sapling_proving_params,
+    streams::{write_buffered, CppStream},
 };
 
 pub(crate) mod spec;
@@ -157,11 +156,13 @@ impl Bundle {
         writer: &mut CppStream<'_>,
         has_sapling: bool,
     ) -> Result<(), String> {
-        sapling_serialization::temporary_zcashd_write_v4_components(
-            writer,
-            self.0.as_ref(),
-            has_sapling,
-        )
+        write_buffered(writer, |buf| {
+            sapling_serialization::temporary_zcashd_write_v4_components(
+                buf,
+                self.0.as_ref(),
+                has_sapling,
+            )
+        })
         .map_err(|e| format!("{}", e))
     }
 
@@ -169,8 +170,10 @@ impl Bundle {
     ///
     /// If `bundle == None`, this serializes `nSpendsSapling = nOutputsSapling = 0`.
     pub(crate) fn serialize_v5(&self, writer: &mut CppStream<'_>) -> Result<(), String> {
-        Transaction::temporary_zcashd_write_v5_sapling(self.inner(), writer)
-            .map_err(|e| format!("Failed to serialize Sapling bundle: {}", e))
+        write_buffered(writer, |buf| {
+            Transaction::temporary_zcashd_write_v5_sapling(self.inner(), buf)
+        })
+        .map_err(|e| format!("Failed to serialize Sapling bundle: {}", e))
     }
 
     pub(crate) fn inner(
@@ -336,9 +339,7 @@ impl SpendProver for StaticTxProver {
     }
 
     fn create_proof<R: RngCore>(&self, circuit: circuit::Spend, rng: &mut R) -> Self::Proof {
-        unsafe { SAPLING_SPEND_PARAMS.as_ref() }
-            .expect("Parameters not loaded: SAPLING_SPEND_PARAMS should have been initialized")
-            .create_proof(circuit, rng)
+        sapling_proving_params().0.create_proof(circuit, rng)
     }
 
     fn encode_proof(proof: Self::Proof) -> sapling::bundle::GrothProofBytes {
@@ -360,9 +361,7 @@ impl OutputProver for StaticTxProver {
     }
 
     fn create_proof<R: RngCore>(&self, circuit: circuit::Output, rng: &mut R) -> Self::Proof {
-        unsafe { SAPLING_OUTPUT_PARAMS.as_ref() }
-            .expect("Parameters not loaded: SAPLING_OUTPUT_PARAMS should have been initialized")
-            .create_proof(circuit, rng)
+        sapling_proving_params().1.create_proof(circuit, rng)
     }
 
     fn encode_proof(proof: Self::Proof) -> sapling::bundle::GrothProofBytes {
@@ -726,7 +725,7 @@ impl BatchValidator {
                 // returned `true`, so at this point every bundle that was added to
                 // `inner.queued_entries` has valid authorization and satisfies the
                 // Sapling-specific consensus rules.
-                sapling_bundle_validity_cache_mut().insert(inner.queued_entries);
+                sapling_bundle_validity_cache().insert(inner.queued_entries);
                 true
             } else {
                 false
@@ -4,6 +4,7 @@ use blake2s_simd::Params as Blake2sParams;
 use group::{cofactor::CofactorGroup, GroupEncoding};
 use incrementalmerkletree::Hashable;
 use rand_core::{OsRng, RngCore};
+use rayon::prelude::*;
 
 use sapling::{
     constants::{CRH_IVK_PERSONALIZATION, PROOF_GENERATION_KEY_GENERATOR, SPENDING_KEY_GENERATOR},
@@ -22,6 +23,7 @@ mod ffi {
     extern "Rust" {
         fn tree_uncommitted() -> [u8; 32];
         fn merkle_hash(depth: usize, lhs: &[u8; 32], rhs: &[u8; 32]) -> [u8; 32];
+        fn merkle_hash_pairs(depth: usize, pairs: &[u8]) -> Vec<u8>;
         fn to_scalar(input: &[u8; 64]) -> [u8; 32];
         fn ask_to_ak(ask: &[u8; 32]) -> [u8; 32];
         fn nsk_to_nk(nsk: &[u8; 32]) -> [u8; 32];
@@ -68,6 +70,26 @@ fn tree_uncommitted() -> [u8; 32] {
     result
 }
 
+/// Hashes each 64-byte `(lhs, rhs)` pair in `pairs` at the given depth, returning the
+/// concatenated 32-byte results.
+///
+/// The pairs are independent, so they are spread across the global rayon thread pool.
+fn merkle_hash_pairs(depth: usize, pairs: &[u8]) -> Vec<u8> {
+    assert_eq!(pairs.len() % 64, 0);
+    let mut result = vec![0; pairs.len() / 2];
+    result
+        .par_chunks_mut(32)
+        .zip(pairs.par_chunks(64))
+        .for_each(|(res, pair)| {
+            res.copy_from_slice(&merkle_hash(
+                depth,
+                pair[..32].try_into().unwrap(),
+                pair[32..].try_into().unwrap(),
+            ))
+        });
+    result
+}
+
 fn to_scalar(input: &[u8; 64]) -> [u8; 32] {
     jubjub::Scalar::from_bytes_wide(input).to_bytes()
 }
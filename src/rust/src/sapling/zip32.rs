@@ -1,9 +1,13 @@
+use rayon::prelude::*;
 use sapling::{
     keys::FullViewingKey,
     zip32::{sapling_address, sapling_derive_internal_fvk, sapling_find_address},
     Diversifier,
 };
 
+/// The most diversifier indices that `find_addresses` tests at once.
+const MAX_FIND_ADDRESSES_BATCH: usize = 4096;
+
 #[cxx::bridge]
 mod ffi {
     struct FfiFullViewingKey {
@@ -24,6 +28,12 @@ mod ffi {
         fn derive_internal_fvk(fvk: &[u8; 96], dk: [u8; 32]) -> FfiFullViewingKey;
         fn address(fvk: &[u8; 96], dk: [u8; 32], j: [u8; 11]) -> Result<[u8; 43]>;
         fn find_address(fvk: &[u8; 96], dk: [u8; 32], j: [u8; 11]) -> Result<FfiPaymentAddress>;
+        fn find_addresses(
+            fvk: &[u8; 96],
+            dk: [u8; 32],
+            j: [u8; 11],
+            n: usize,
+        ) -> Result<Vec<FfiPaymentAddress>>;
         fn diversifier_index(dk: [u8; 32], d: [u8; 11]) -> [u8; 11];
     }
 }
@@ -109,6 +119,51 @@ fn find_address(
         })
 }
 
+/// Finds the first `n` diversifier indices at or above `j` that produce valid
+/// payment addresses, in order, along with the addresses.
+///
+/// About half of all diversifier indices are valid, so candidates are tested
+/// in batches of twice the number of addresses still to be found, in parallel.
+fn find_addresses(
+    fvk: &[u8; 96],
+    dk: [u8; 32],
+    j: [u8; 11],
+    n: usize,
+) -> Result<Vec<ffi::FfiPaymentAddress>, String> {
+    let fvk = FullViewingKey::read(&fvk[..]).expect("valid Sapling FullViewingKey");
+    let dk = sapling::zip32::DiversifierKey::from_bytes(dk);
+    let mut next = Some(zip32::DiversifierIndex::from(j));
+
+    let mut found = Vec::with_capacity(n);
+    while found.len() < n {
+        let batch_size = ((n - found.len()) * 2).min(MAX_FIND_ADDRESSES_BATCH);
+        let mut batch = Vec::with_capacity(batch_size);
+        while batch.len() < batch_size {
+            match next {
+                Some(j) => {
+                    batch.push(j);
+                    let mut succ = j;
+                    next = succ.increment().ok().map(|()| succ);
+                }
+                None => break,
+            }
+        }
+        if batch.is_empty() {
+            return Err("No valid diversifiers at or above given index".to_string());
+        }
+
+        found.par_extend(batch.into_par_iter().filter_map(|j| {
+            sapling_address(&fvk, &dk, j).map(|addr| ffi::FfiPaymentAddress {
+                j: *j.as_bytes(),
+                addr: addr.to_bytes(),
+            })
+        }));
+    }
+    found.truncate(n);
+
+    Ok(found)
+}
+
 fn diversifier_index(dk: [u8; 32], d: [u8; 11]) -> [u8; 11] {
     let dk = sapling::zip32::DiversifierKey::from_bytes(dk);
     let diversifier = Diversifier(d);
@@ -2,10 +2,17 @@ use std::fs::File;
 use std::io::BufReader;
 use std::ptr::addr_of;
 
-use bellman::groth16::Parameters;
+use bellman::{
+    gadgets::multipack,
+    groth16::{batch, Parameters, Proof},
+};
+use bls12_381::Bls12;
 use zcash_proofs::sprout;
 
-use crate::{GROTH_PROOF_SIZE, SPROUT_GROTH16_PARAMS_PATH, SPROUT_GROTH16_VK};
+use crate::{
+    bundlecache::{sprout_bundle_validity_cache, CacheEntries},
+    GROTH_PROOF_SIZE, SPROUT_GROTH16_BATCH_VK, SPROUT_GROTH16_PARAMS_PATH, SPROUT_GROTH16_VK,
+};
 
 #[allow(clippy::too_many_arguments)]
 #[cxx::bridge]
@@ -49,6 +56,24 @@ mod ffi {
             vpub_old: u64,
             vpub_new: u64,
         ) -> bool;
+
+        type BatchValidator;
+        fn init_batch_validator(cache_store: bool) -> Box<BatchValidator>;
+        fn check_joinsplit(
+            self: &mut BatchValidator,
+            proof: &[u8; 192], // GROTH_PROOF_SIZE
+            rt: &[u8; 32],
+            h_sig: &[u8; 32],
+            mac1: &[u8; 32],
+            mac2: &[u8; 32],
+            nf1: &[u8; 32],
+            nf2: &[u8; 32],
+            cm1: &[u8; 32],
+            cm2: &[u8; 32],
+            vpub_old: u64,
+            vpub_new: u64,
+        ) -> bool;
+        fn validate(self: &mut BatchValidator) -> bool;
     }
 }
 
@@ -180,3 +205,131 @@ fn verify(
             .expect("Parameters not loaded: SPROUT_GROTH16_VK should have been initialized"),
     )
 }
+
+/// The public inputs of a Sprout JoinSplit proof, in the order that
+/// `zcash_proofs::sprout::verify_proof` packs them.
+#[allow(clippy::too_many_arguments)]
+fn joinsplit_public_input(
+    rt: &[u8; 32],
+    h_sig: &[u8; 32],
+    mac1: &[u8; 32],
+    mac2: &[u8; 32],
+    nf1: &[u8; 32],
+    nf2: &[u8; 32],
+    cm1: &[u8; 32],
+    cm2: &[u8; 32],
+    vpub_old: u64,
+    vpub_new: u64,
+) -> Vec<u8> {
+    let mut public_input = Vec::with_capacity((32 * 8) + (8 * 2));
+    public_input.extend(rt);
+    public_input.extend(h_sig);
+    public_input.extend(nf1);
+    public_input.extend(mac1);
+    public_input.extend(nf2);
+    public_input.extend(mac2);
+    public_input.extend(cm1);
+    public_input.extend(cm2);
+    public_input.extend(vpub_old.to_le_bytes());
+    public_input.extend(vpub_new.to_le_bytes());
+    public_input
+}
+
+struct BatchValidatorInner {
+    validator: batch::Verifier<Bls12>,
+    has_proofs: bool,
+    queued_entries: CacheEntries,
+}
+
+pub(crate) struct BatchValidator(Option<BatchValidatorInner>);
+
+fn init_batch_validator(cache_store: bool) -> Box<BatchValidator> {
+    Box::new(BatchValidator(Some(BatchValidatorInner {
+        validator: batch::Verifier::new(),
+        has_proofs: false,
+        queued_entries: CacheEntries::new(cache_store),
+    })))
+}
+
+impl BatchValidator {
+    /// Queues the proof of a Sprout JoinSplit for validation.
+    ///
+    /// Returns `false` if the proof cannot be parsed. This `BatchValidator` can
+    /// continue to be used regardless.
+    ///
+    /// If this batch was configured to not cache the results, then if the JoinSplit
+    /// was in the global bundle validity cache, it will have been removed (and this
+    /// method will return `true`).
+    #[allow(clippy::too_many_arguments)]
+    fn check_joinsplit(
+        &mut self,
+        proof: &[u8; GROTH_PROOF_SIZE],
+        rt: &[u8; 32],
+        h_sig: &[u8; 32],
+        mac1: &[u8; 32],
+        mac2: &[u8; 32],
+        nf1: &[u8; 32],
+        nf2: &[u8; 32],
+        cm1: &[u8; 32],
+        cm2: &[u8; 32],
+        vpub_old: u64,
+        vpub_new: u64,
+    ) -> bool {
+        if let Some(inner) = &mut self.0 {
+            let public_input = joinsplit_public_input(
+                rt, h_sig, mac1, mac2, nf1, nf2, cm1, cm2, vpub_old, vpub_new,
+            );
+
+            let cache = sprout_bundle_validity_cache();
+            let cache_entry = cache.compute_joinsplit_entry(&public_input, proof);
+            if cache.contains(cache_entry, &mut inner.queued_entries) {
+                return true;
+            }
+
+            let proof = match Proof::<Bls12>::read(&proof[..]) {
+                Ok(p) => p,
+                Err(_) => return false,
+            };
+            let public_input =
+                multipack::compute_multipacking(&multipack::bytes_to_bits(&public_input));
+            inner.validator.queue((proof, public_input));
+            inner.has_proofs = true;
+            true
+        } else {
+            tracing::error!("sprout::BatchValidator has already been used");
+            false
+        }
+    }
+
+    /// Batch-validates the accumulated proofs, using the Rayon thread pool.
+    ///
+    /// Returns `true` if every proof added to the batch validator is valid, or `false`
+    /// if one or more are invalid.
+    ///
+    /// This method MUST NOT be called if any prior call to `Self::check_joinsplit`
+    /// returned `false`.
+    ///
+    /// If this batch was configured to cache the results, then if this method returns
+    /// `true` every JoinSplit added to the batch will have also been added to the
+    /// global bundle validity cache.
+    fn validate(&mut self) -> bool {
+        if let Some(inner) = self.0.take() {
+            if !inner.has_proofs
+                || inner
+                    .validator
+                    .verify_multicore(unsafe { SPROUT_GROTH16_BATCH_VK.as_ref() }.expect(
+                    "Parameters not loaded: SPROUT_GROTH16_BATCH_VK should have been initialized",
+                ))
+                .is_ok()
+            {
+                sprout_bundle_validity_cache().insert(inner.queued_entries);
+                true
+            } else {
+                false
+            }
+        } else {
+            tracing::error!("sprout::BatchValidator has already been used");
+            false
+        }
+    }
+}
@@ -11,6 +11,9 @@ pub(crate) mod ffi {
         type RustStream;
         unsafe fn read_u8(self: Pin<&mut RustStream>, pch: *mut u8, nSize: usize) -> Result<()>;
         unsafe fn write_u8(self: Pin<&mut RustStream>, pch: *const u8, nSize: usize) -> Result<()>;
+        fn unread_u8(self: &RustStream) -> *const u8;
+        fn unread_size(self: &RustStream) -> usize;
+        fn skip_u8(self: Pin<&mut RustStream>, nSize: usize) -> Result<()>;
 
         type CAutoFile;
         unsafe fn read_u8(self: Pin<&mut CAutoFile>, pch: *mut u8, nSize: usize) -> Result<()>;
@@ -19,6 +22,12 @@ pub(crate) mod ffi {
         type CBufferedFile;
         unsafe fn read_u8(self: Pin<&mut CBufferedFile>, pch: *mut u8, nSize: usize) -> Result<()>;
 
+        type SpanReader;
+        unsafe fn read_u8(self: Pin<&mut SpanReader>, pch: *mut u8, nSize: usize) -> Result<()>;
+        fn unread_u8(self: &SpanReader) -> *const u8;
+        fn unread_size(self: &SpanReader) -> usize;
+        fn skip_u8(self: Pin<&mut SpanReader>, nSize: usize) -> Result<()>;
+
         type CHashWriter;
         unsafe fn write_u8(self: Pin<&mut CHashWriter>, pch: *const u8, nSize: usize)
             -> Result<()>;
@@ -41,13 +50,14 @@ pub(crate) mod ffi {
     impl UniquePtr<RustStream> {}
     impl UniquePtr<CAutoFile> {}
     impl UniquePtr<CBufferedFile> {}
+    impl UniquePtr<SpanReader> {}
     impl UniquePtr<CHashWriter> {}
     impl UniquePtr<CBLAKE2bWriter> {}
     impl UniquePtr<CSizeComputer> {}
 }
 
 pub(crate) fn from_data(stream: Pin<&mut ffi::RustStream>) -> Box<CppStream<'_>> {
-    Box::new(CppStream::Data(stream))
+    Box::new(CppStream::Data(stream, InPlace::default()))
 }
 
 pub(crate) fn from_auto_file(file: Pin<&mut ffi::CAutoFile>) -> Box<CppStream<'_>> {
@@ -58,6 +68,10 @@ pub(crate) fn from_buffered_file(file: Pin<&mut ffi::CBufferedFile>) -> Box<CppS
     Box::new(CppStream::BufferedFile(file))
 }
 
+pub(crate) fn from_span_reader(reader: Pin<&mut ffi::SpanReader>) -> Box<CppStream<'_>> {
+    Box::new(CppStream::Span(reader, InPlace::default()))
+}
+
 pub(crate) fn from_hash_writer(writer: Pin<&mut ffi::CHashWriter>) -> Box<CppStream<'_>> {
     Box::new(CppStream::Hash(writer))
 }
@@ -70,10 +84,59 @@ pub(crate) fn from_size_computer(sc: Pin<&mut ffi::CSizeComputer>) -> Box<CppStr
     Box::new(CppStream::Size(sc))
 }
 
+/// Serializes a value into a buffer with `write`, and then writes the buffer to
+/// `writer` in one call into C++, instead of one call for every field.
+pub(crate) fn write_buffered(
+    writer: &mut CppStream<'_>,
+    write: impl FnOnce(&mut Vec<u8>) -> io::Result<()>,
+) -> io::Result<()> {
+    let mut buf = vec![];
+    write(&mut buf)?;
+    io::Write::write_all(writer, &buf)
+}
+
+/// Reads the unread bytes of an in-memory C++ stream in place, instead of
+/// calling back into C++ for every field. The bytes that were read are skipped
+/// in the C++ stream before it is written to, and when the `CppStream` is
+/// dropped.
+#[derive(Default)]
+pub(crate) struct InPlace {
+    unread: Option<(*const u8, usize)>,
+    pos: usize,
+}
+
+impl InPlace {
+    fn read(
+        &mut self,
+        buf: &mut [u8],
+        fetch: impl FnOnce() -> (*const u8, usize),
+    ) -> io::Result<usize> {
+        let (data, len) = *self.unread.get_or_insert_with(fetch);
+        if buf.len() > len - self.pos {
+            return Err(io::Error::new(io::ErrorKind::UnexpectedEof, "end of data"));
+        }
+        if !buf.is_empty() {
+            // The C++ stream is not modified until `Self::take_read()` is called.
+            let unread = unsafe { std::slice::from_raw_parts(data, len) };
+            buf.copy_from_slice(&unread[self.pos..self.pos + buf.len()]);
+            self.pos += buf.len();
+        }
+        Ok(buf.len())
+    }
+
+    /// Returns the number of bytes read since the last call, which the caller
+    /// skips in the C++ stream.
+    fn take_read(&mut self) -> usize {
+        self.unread = None;
+        std::mem::take(&mut self.pos)
+    }
+}
+
 pub(crate) enum CppStream<'a> {
-    Data(Pin<&'a mut ffi::RustStream>),
+    Data(Pin<&'a mut ffi::RustStream>, InPlace),
     AutoFile(Pin<&'a mut ffi::CAutoFile>),
     BufferedFile(Pin<&'a mut ffi::CBufferedFile>),
+    Span(Pin<&'a mut ffi::SpanReader>, InPlace),
     Hash(Pin<&'a mut ffi::CHashWriter>),
     Blake2b(Pin<&'a mut ffi::CBLAKE2bWriter>),
     Size(Pin<&'a mut ffi::CSizeComputer>),
@@ -84,15 +147,18 @@ impl<'a> io::Read for CppStream<'a> {
         let pch = buf.as_mut_ptr();
         let len = buf.len();
         match self {
-            CppStream::Data(inner) => unsafe { inner.as_mut().read_u8(pch, len) }
-                .map(|()| buf.len())
-                .map_err(|e| io::Error::new(io::ErrorKind::Other, e)),
+            CppStream::Data(inner, in_place) => {
+                in_place.read(buf, || (inner.unread_u8(), inner.unread_size()))
+            }
             CppStream::AutoFile(inner) => unsafe { inner.as_mut().read_u8(pch, len) }
                 .map(|()| buf.len())
                 .map_err(|e| io::Error::new(io::ErrorKind::Other, e)),
             CppStream::BufferedFile(inner) => unsafe { inner.as_mut().read_u8(pch, len) }
                 .map(|()| buf.len())
                 .map_err(|e| io::Error::new(io::ErrorKind::Other, e)),
+            CppStream::Span(inner, in_place) => {
+                in_place.read(buf, || (inner.unread_u8(), inner.unread_size()))
+            }
             CppStream::Hash(_) => Err(io::Error::new(
                 io::ErrorKind::Unsupported,
                 "Cannot read from CHashWriter",
@@ -114,9 +180,16 @@ impl<'a> io::Write for CppStream<'a> {
         let pch = buf.as_ptr();
         let len = buf.len();
         match self {
-            CppStream::Data(inner) => unsafe { inner.as_mut().write_u8(pch, len) }
-                .map(|()| buf.len())
-                .map_err(|e| io::Error::new(io::ErrorKind::Other, e)),
+            CppStream::Data(inner, in_place) => {
+                // Writing may move the unread bytes.
+                let read = in_place.take_read();
+                inner
+                    .as_mut()
+                    .skip_u8(read)
+                    .and_then(|()| unsafe { inner.as_mut().write_u8(pch, len) })
+                    .map(|()| buf.len())
+                    .map_err(|e| io::Error::new(io::ErrorKind::Other, e))
+            }
             CppStream::AutoFile(inner) => unsafe { inner.as_mut().write_u8(pch, len) }
                 .map(|()| buf.len())
                 .map_err(|e| io::Error::new(io::ErrorKind::Other, e)),
@@ -124,6 +197,10 @@ impl<'a> io::Write for CppStream<'a> {
                 io::ErrorKind::Unsupported,
                 "Cannot write to CBufferedFile",
             )),
+            CppStream::Span(..) => Err(io::Error::new(
+                io::ErrorKind::Unsupported,
+                "Cannot write to SpanReader",
+            )),
             CppStream::Hash(inner) => unsafe { inner.as_mut().write_u8(pch, len) }
                 .map(|()| buf.len())
                 .map_err(|e| io::Error::new(io::ErrorKind::Other, e)),
@@ -140,3 +217,18 @@ impl<'a> io::Write for CppStream<'a> {
         Ok(())
     }
 }
+
+impl<'a> Drop for CppStream<'a> {
+    fn drop(&mut self) {
+        // Skipping bytes that were available to read cannot fail.
+        match self {
+            CppStream::Data(inner, in_place) => {
+                let _ = inner.as_mut().skip_u8(in_place.take_read());
+            }
+            CppStream::Span(inner, in_place) => {
+                let _ = inner.as_mut().skip_u8(in_place.take_read());
+            }
+            _ => (),
+        }
+    }
+}
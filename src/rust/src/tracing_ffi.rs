@@ -1,28 +1,32 @@
 use libc::c_char;
 use std::ffi::CStr;
 use std::fs::File;
+use std::io::Write;
 use std::path::Path;
 use std::slice;
 use std::str;
 use std::sync::{
-    atomic::{AtomicUsize, Ordering},
+    atomic::{AtomicU32, AtomicU64, AtomicUsize, Ordering},
     Mutex,
 };
+use std::time::{Duration, Instant, SystemTime, UNIX_EPOCH};
 
 use tracing::{
     callsite::{Callsite, Identifier},
     field::{FieldSet, Value},
     level_enabled,
     metadata::Kind,
-    span::Entered,
+    span::{Attributes, Entered, Id},
     subscriber::{Interest, Subscriber},
-    Event, Metadata, Span,
+    Event, Level, Metadata, Span,
 };
-use tracing_appender::non_blocking::WorkerGuard;
+use tracing_appender::non_blocking::{NonBlocking, WorkerGuard};
 use tracing_core::Once;
 use tracing_subscriber::{
     filter::EnvFilter,
-    layer::{Layer, SubscriberExt},
+    fmt::MakeWriter,
+    layer::{Context, Layer, SubscriberExt},
+    registry::LookupSpan,
     reload::{self, Handle},
     util::SubscriberInitExt,
 };
@@ -53,9 +57,87 @@ where
 
 pub struct TracingHandle {
     _file_guard: Option<WorkerGuard>,
+    _span_file_guard: Option<WorkerGuard>,
     reload_handle: Box<dyn ReloadHandle>,
 }
 
+/// The time a span has spent entered, stored in the span's extensions.
+#[derive(Default)]
+struct SpanTiming {
+    entered: Option<Instant>,
+    busy: Duration,
+    children: Duration,
+}
+
+/// A layer that writes the time spent in each span, excluding the time spent
+/// in its child spans, as lines in the folded stack format read by flamegraph
+/// tools such as `inferno-flamegraph` and `flamegraph.pl`:
+///
+///     ActivateBestChain;ConnectTip;ConnectBlock 1234
+///
+/// where the number is in microseconds. A line is written when a span closes,
+/// so a stack appears once per execution; the tools sum the lines.
+struct FoldedSpanLayer {
+    writer: NonBlocking,
+}
+
+impl<S> Layer<S> for FoldedSpanLayer
+where
+    S: Subscriber + for<'a> LookupSpan<'a>,
+{
+    fn on_new_span(&self, _attrs: &Attributes<'_>, id: &Id, ctx: Context<'_, S>) {
+        if let Some(span) = ctx.span(id) {
+            span.extensions_mut().insert(SpanTiming::default());
+        }
+    }
+
+    fn on_enter(&self, id: &Id, ctx: Context<'_, S>) {
+        if let Some(span) = ctx.span(id) {
+            if let Some(timing) = span.extensions_mut().get_mut::<SpanTiming>() {
+                timing.entered = Some(Instant::now());
+            }
+        }
+    }
+
+    fn on_exit(&self, id: &Id, ctx: Context<'_, S>) {
+        if let Some(span) = ctx.span(id) {
+            if let Some(timing) = span.extensions_mut().get_mut::<SpanTiming>() {
+                if let Some(entered) = timing.entered.take() {
+                    timing.busy += entered.elapsed();
+                }
+            }
+        }
+    }
+
+    fn on_close(&self, id: Id, ctx: Context<'_, S>) {
+        let span = match ctx.span(&id) {
+            Some(span) => span,
+            None => return,
+        };
+        let (busy, self_time) = match span.extensions().get::<SpanTiming>() {
+            Some(timing) => (timing.busy, timing.busy.saturating_sub(timing.children)),
+            None => return,
+        };
+        if let Some(parent) = span.parent() {
+            if let Some(timing) = parent.extensions_mut().get_mut::<SpanTiming>() {
+                timing.children += busy;
+            }
+        }
+
+        let micros = self_time.as_micros();
+        if micros == 0 {
+            return;
+        }
+        let stack = span
+            .scope()
+            .from_root()
+            .map(|s| s.name())
+            .collect::<Vec<_>>()
+            .join(";");
+        let _ = writeln!(self.writer.make_writer(), "{} {}", stack, micros);
+    }
+}
+
 #[no_mangle]
 pub extern "C" fn tracing_init(
     #[cfg(not(target_os = "windows"))] log_path: *const u8,
@@ -63,6 +145,9 @@ pub extern "C" fn tracing_init(
     log_path_len: usize,
     initial_filter: *const c_char,
     log_timestamps: bool,
+    #[cfg(not(target_os = "windows"))] span_path: *const u8,
+    #[cfg(target_os = "windows")] span_path: *const u16,
+    span_path_len: usize,
 ) -> *mut TracingHandle {
     let initial_filter = unsafe { CStr::from_ptr(initial_filter) }
         .to_str()
@@ -132,6 +217,31 @@ pub extern "C" fn tracing_init(
         (None, None)
     };
 
+    let span_path = if span_path.is_null() {
+        None
+    } else {
+        Some(unsafe { slice::from_raw_parts(span_path, span_path_len) })
+    };
+
+    #[cfg(not(target_os = "windows"))]
+    let span_path = span_path.map(OsStr::from_bytes);
+
+    #[cfg(target_os = "windows")]
+    let span_path = span_path.map(OsString::from_wide);
+
+    let span_path = span_path.as_ref().map(Path::new);
+
+    let (span_logger, span_file_guard) = if let Some(span_path) = span_path {
+        let span_appender = tracing_appender::rolling::never(
+            span_path.parent().unwrap(),
+            span_path.file_name().unwrap(),
+        );
+        let (writer, span_file_guard) = tracing_appender::non_blocking(span_appender);
+        (Some(FoldedSpanLayer { writer }), Some(span_file_guard))
+    } else {
+        (None, None)
+    };
+
     let (filter, reload_handle) = reload::Layer::new(EnvFilter::from(initial_filter));
 
     tracing_subscriber::registry()
@@ -139,11 +249,13 @@ pub extern "C" fn tracing_init(
         .with(stdout_no_timestamps)
         .with(file_logger)
         .with(file_no_timestamps)
+        .with(span_logger)
         .with(filter)
         .init();
 
     Box::into_raw(Box::new(TracingHandle {
         _file_guard: file_guard,
+        _span_file_guard: span_file_guard,
         reload_handle: Box::new(reload_handle),
     }))
 }
@@ -184,6 +296,7 @@ pub extern "C" fn tracing_init_test(
 
     Box::into_raw(Box::new(TracingHandle {
         _file_guard: None,
+        _span_file_guard: None,
         reload_handle: Box::new(reload_handle),
     }))
 }
@@ -216,11 +329,20 @@ pub extern "C" fn tracing_reload(handle: *mut TracingHandle, new_filter: *const
     }
 }
 
+/// The maximum number of debug and trace events logged per second from each
+/// callsite through `tracing_event_enabled`, or 0 for no limit.
+static DEBUG_RATE_LIMIT: AtomicU32 = AtomicU32::new(0);
+
 pub struct FfiCallsite {
     interest: AtomicUsize,
     meta: Option<Metadata<'static>>,
     registration: Once,
     fields: Vec<&'static str>,
+    // The second that the rate limit is counting events in, the events
+    // counted in it, and the events dropped since the last one was logged.
+    rate_window: AtomicU64,
+    rate_count: AtomicU32,
+    rate_dropped: AtomicU64,
 }
 
 impl FfiCallsite {
@@ -230,6 +352,47 @@ impl FfiCallsite {
             meta: None,
             registration: Once::new(),
             fields,
+            rate_window: AtomicU64::new(0),
+            rate_count: AtomicU32::new(0),
+            rate_dropped: AtomicU64::new(0),
+        }
+    }
+
+    /// Returns true if this debug or trace event is over the rate limit, and
+    /// counts it as dropped. The count is reported the next time an event
+    /// from this callsite is logged in a later second.
+    fn is_rate_limited(&self) -> bool {
+        let limit = DEBUG_RATE_LIMIT.load(Ordering::Relaxed);
+        let level = *self.metadata().level();
+        if limit == 0 || !(level == Level::DEBUG || level == Level::TRACE) {
+            return false;
+        }
+
+        let now = SystemTime::now()
+            .duration_since(UNIX_EPOCH)
+            .map(|d| d.as_secs())
+            .unwrap_or(0);
+        if self.rate_window.swap(now, Ordering::Relaxed) != now {
+            // Concurrent callers may both start the window; the limit is
+            // approximate, and only needs to bound the rate.
+            self.rate_count.store(1, Ordering::Relaxed);
+            let dropped = self.rate_dropped.swap(0, Ordering::Relaxed);
+            if dropped > 0 {
+                let meta = self.metadata();
+                tracing::warn!(
+                    target: "main",
+                    "Dropped {} log messages from {}:{} over the -logratelimit",
+                    dropped,
+                    meta.file().unwrap_or("?"),
+                    meta.line().unwrap_or(0),
+                );
+            }
+            false
+        } else if self.rate_count.fetch_add(1, Ordering::Relaxed) >= limit {
+            self.rate_dropped.fetch_add(1, Ordering::Relaxed);
+            true
+        } else {
+            false
         }
     }
 
@@ -505,7 +668,13 @@ pub extern "C" fn tracing_span_create(
     let meta = callsite.metadata();
     assert!(meta.is_span());
 
-    let span = if level_enabled!(*meta.level()) && callsite.is_enabled() {
+    // A disabled span is represented by a null handle, so that spans on hot
+    // paths cost no allocations while they are filtered out.
+    if !(level_enabled!(*meta.level()) && callsite.is_enabled()) {
+        return std::ptr::null_mut();
+    }
+
+    let span = {
         let mut fi = meta.fields().iter();
         let mut vi = field_values
             .iter()
@@ -565,8 +734,6 @@ pub extern "C" fn tracing_span_create(
             32 => new_span!(32),
             _ => unimplemented!(),
         }
-    } else {
-        Span::none()
     };
 
     Box::into_raw(Box::new(span))
@@ -600,6 +767,20 @@ pub extern "C" fn tracing_span_exit(guard: *mut Entered) {
     }
 }
 
+#[no_mangle]
+pub extern "C" fn tracing_set_debug_rate_limit(max_per_second: u32) {
+    DEBUG_RATE_LIMIT.store(max_per_second, Ordering::Relaxed);
+}
+
+#[no_mangle]
+pub extern "C" fn tracing_event_enabled(callsite: *const FfiCallsite) -> bool {
+    let callsite = unsafe { &*callsite };
+    let meta = callsite.metadata();
+    assert!(meta.is_event());
+
+    level_enabled!(*meta.level()) && callsite.is_enabled() && !callsite.is_rate_limited()
+}
+
 #[no_mangle]
 pub extern "C" fn tracing_log(
     callsite: *const FfiCallsite,
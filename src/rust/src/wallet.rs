@@ -408,6 +408,34 @@ impl Wallet {
         involvement
     }
 
+    /// Like `add_notes_from_bundle`, but only decrypts the actions that the batch
+    /// scanner found to be decryptable, each with the incoming viewing key it found.
+    ///
+    /// `hints` is a map from action index to the incoming viewing key that decrypts
+    /// that action. Hints for keys that are not in this wallet, or that do not decrypt
+    /// their action, are ignored.
+    #[tracing::instrument(level = "trace", skip(self))]
+    pub fn add_notes_from_bundle_with_hints(
+        &mut self,
+        txid: &TxId,
+        bundle: &Bundle<Authorized, ZatBalance>,
+        hints: BTreeMap<usize, IncomingViewingKey>,
+    ) -> BundleWalletInvolvement {
+        let mut involvement = BundleWalletInvolvement::new();
+        involvement.spend_action_metadata = self.add_potential_spends(txid, bundle);
+
+        for (action_idx, ivk) in hints.into_iter() {
+            if let Some((note, recipient, memo)) = bundle.decrypt_output_with_key(action_idx, &ivk)
+            {
+                if self.add_decrypted_note(txid, action_idx, ivk.clone(), note, recipient, memo) {
+                    involvement.receive_action_metadata.insert(action_idx, ivk);
+                }
+            }
+        }
+
+        involvement
+    }
+
     /// Restore note and potential spend data from a bundle using the provided
     /// metadata.
     ///
@@ -868,24 +896,73 @@ pub extern "C" fn orchard_wallet_add_notes_from_bundle(
     let txid = TxId::from_bytes(*unsafe { txid.as_ref() }.expect("txid may not be null."));
     if let Some(bundle) = unsafe { bundle.as_ref() } {
         let added = wallet.add_notes_from_bundle(&txid, bundle);
-        let involved =
-            !(added.receive_action_metadata.is_empty() && added.spend_action_metadata.is_empty());
-        for (action_idx, ivk) in added.receive_action_metadata.into_iter() {
-            let action_ivk = FFIActionIvk {
-                action_idx: action_idx.try_into().unwrap(),
-                ivk_ptr: Box::into_raw(Box::new(ivk.clone())),
-            };
-            unsafe { (action_ivk_push_cb.unwrap())(cb_receiver, action_ivk) };
-        }
-        for action_idx in added.spend_action_metadata {
-            unsafe { (spend_idx_push_cb.unwrap())(cb_receiver, action_idx.try_into().unwrap()) };
+        push_involvement(added, cb_receiver, action_ivk_push_cb, spend_idx_push_cb)
+    } else {
+        false
+    }
+}
+
+#[no_mangle]
+pub extern "C" fn orchard_wallet_add_notes_from_bundle_with_hints(
+    wallet: *mut Wallet,
+    txid: *const [c_uchar; 32],
+    bundle: *const Bundle<Authorized, ZatBalance>,
+    hint_action_idxs: *const u32,
+    hint_ivks: *const [c_uchar; 64],
+    hints_len: usize,
+    cb_receiver: Option<FFICallbackReceiver>,
+    action_ivk_push_cb: Option<ActionIvkPushCb>,
+    spend_idx_push_cb: Option<SpendIndexPushCb>,
+) -> bool {
+    let wallet = unsafe { wallet.as_mut() }.expect("Wallet pointer may not be null");
+    let txid = TxId::from_bytes(*unsafe { txid.as_ref() }.expect("txid may not be null."));
+    let hint_action_idxs = unsafe { slice::from_raw_parts(hint_action_idxs, hints_len) };
+    let hint_ivks = unsafe { slice::from_raw_parts(hint_ivks, hints_len) };
+
+    let mut hints = BTreeMap::new();
+    for (action_idx, raw_ivk) in hint_action_idxs.iter().zip(hint_ivks.iter()) {
+        match Option::from(IncomingViewingKey::from_bytes(raw_ivk)) {
+            Some(ivk) => {
+                hints.insert((*action_idx).try_into().unwrap(), ivk);
+            }
+            None => {
+                error!("Invalid Orchard incoming viewing key in batch scanner hints");
+                return false;
+            }
         }
-        involved
+    }
+
+    if let Some(bundle) = unsafe { bundle.as_ref() } {
+        let added = wallet.add_notes_from_bundle_with_hints(&txid, bundle, hints);
+        push_involvement(added, cb_receiver, action_ivk_push_cb, spend_idx_push_cb)
     } else {
         false
     }
 }
 
+/// Passes the actions of a bundle that are involved with the wallet to the C++ callback
+/// receiver, and returns whether there are any.
+fn push_involvement(
+    added: BundleWalletInvolvement,
+    cb_receiver: Option<FFICallbackReceiver>,
+    action_ivk_push_cb: Option<ActionIvkPushCb>,
+    spend_idx_push_cb: Option<SpendIndexPushCb>,
+) -> bool {
+    let involved =
+        !(added.receive_action_metadata.is_empty() && added.spend_action_metadata.is_empty());
+    for (action_idx, ivk) in added.receive_action_metadata.into_iter() {
+        let action_ivk = FFIActionIvk {
+            action_idx: action_idx.try_into().unwrap(),
+            ivk_ptr: Box::into_raw(Box::new(ivk.clone())),
+        };
+        unsafe { (action_ivk_push_cb.unwrap())(cb_receiver, action_ivk) };
+    }
+    for action_idx in added.spend_action_metadata {
+        unsafe { (spend_idx_push_cb.unwrap())(cb_receiver, action_idx.try_into().unwrap()) };
+    }
+    involved
+}
+
 #[no_mangle]
 pub extern "C" fn orchard_wallet_load_bundle(
     wallet: *mut Wallet,
@@ -943,6 +1020,43 @@ pub extern "C" fn orchard_wallet_append_bundle_commitments(
     true
 }
 
+/// A type used to pass the Orchard bundles of a block across the FFI boundary.
+/// This must have the same representation as `struct RawOrchardBlockBundle`
+/// in `rust/include/rust/orchard/wallet.h`.
+#[repr(C)]
+pub struct FFIBlockBundle {
+    block_tx_idx: usize,
+    txid: [u8; 32],
+    bundle: *const Bundle<Authorized, ZatBalance>,
+}
+
+#[no_mangle]
+pub extern "C" fn orchard_wallet_append_block_commitments(
+    wallet: *mut Wallet,
+    block_height: u32,
+    bundles: *const FFIBlockBundle,
+    bundles_len: usize,
+) -> bool {
+    let wallet = unsafe { wallet.as_mut() }.expect("Wallet pointer may not be null");
+    let bundles = unsafe { slice::from_raw_parts(bundles, bundles_len) };
+    for block_bundle in bundles {
+        let txid = TxId::from_bytes(block_bundle.txid);
+        if let Some(bundle) = unsafe { block_bundle.bundle.as_ref() } {
+            if let Err(e) = wallet.append_bundle_commitments(
+                block_height.into(),
+                block_bundle.block_tx_idx,
+                &txid,
+                bundle,
+            ) {
+                error!("An error occurred adding the Orchard bundle's notes to the note commitment tree: {:?}", e);
+                return false;
+            }
+        }
+    }
+
+    true
+}
+
 #[no_mangle]
 pub extern "C" fn orchard_wallet_commitment_tree_root(
     wallet: *const Wallet,
@@ -1198,6 +1312,24 @@ pub extern "C" fn orchard_wallet_is_nullifier_from_me(
 
 pub type PushTxId = unsafe extern "C" fn(obj: Option<FFICallbackReceiver>, txid: *const [u8; 32]);
 
+pub type PushIvkBytes = unsafe extern "C" fn(obj: Option<FFICallbackReceiver>, ivk: *const [u8; 64]);
+
+#[no_mangle]
+pub extern "C" fn orchard_wallet_get_incoming_viewing_keys(
+    wallet: *const Wallet,
+    require_spending_key: bool,
+    result: Option<FFICallbackReceiver>,
+    push_cb: Option<PushIvkBytes>,
+) {
+    let wallet = unsafe { wallet.as_ref() }.expect("Wallet pointer may not be null.");
+    for ivk in wallet.key_store.viewing_keys.keys() {
+        if require_spending_key && wallet.key_store.spending_key_for_ivk(ivk).is_none() {
+            continue;
+        }
+        unsafe { (push_cb.unwrap())(result, &ivk.to_bytes()) };
+    }
+}
+
 #[no_mangle]
 pub extern "C" fn orchard_wallet_get_potential_spends(
     wallet: *const Wallet,
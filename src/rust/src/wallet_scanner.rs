@@ -10,9 +10,16 @@ use std::sync::{
 
 use crossbeam_channel as channel;
 use memuse::DynamicUsage;
+use orchard::{
+    keys::{IncomingViewingKey, PreparedIncomingViewingKey},
+    note_encryption::OrchardDomain,
+    Action,
+};
 use sapling::bundle::OutputDescription;
 use sapling::{bundle::GrothProofBytes, note_encryption::SaplingDomain};
-use zcash_note_encryption::{batch, BatchDomain, Domain, ShieldedOutput, ENC_CIPHERTEXT_SIZE};
+use zcash_note_encryption::{
+    batch, BatchDomain, Domain, EphemeralKeyBytes, ShieldedOutput, ENC_CIPHERTEXT_SIZE,
+};
 use zcash_primitives::{
     block::BlockHash,
     transaction::{components::sapling as sapling_serialization, Transaction, TxId},
@@ -26,6 +33,13 @@ use crate::{bridge::ffi, note_encryption::parse_and_prepare_sapling_ivk, params:
 /// TODO: Tune this.
 const BATCH_SIZE_THRESHOLD: usize = 20;
 
+/// The maximum number of incoming viewing keys to trial decrypt with in a single batch.
+///
+/// Accumulated outputs are trial decrypted with each chunk of this many keys in a
+/// separate batch, so that the work for wallets with many keys is split by key as well as
+/// by output.
+const IVK_CHUNK_SIZE: usize = 64;
+
 const METRIC_OUTPUTS_SCANNED: &str = "zcashd.wallet.batchscanner.outputs.scanned";
 const METRIC_LABEL_KIND: &str = "kind";
 
@@ -40,6 +54,57 @@ impl OutputDomain for SaplingDomain {
     const KIND: &'static str = "sapling";
 }
 
+impl OutputDomain for OrchardDomain {
+    const KIND: &'static str = "orchard";
+}
+
+/// The parts of an Orchard action that are needed to trial decrypt it.
+///
+/// Batches hold these instead of the actions, which also carry their proofs' value
+/// commitments and spend authorization signatures.
+#[derive(Clone)]
+struct OrchardOutput {
+    epk_bytes: [u8; 32],
+    cmx: [u8; 32],
+    enc_ciphertext: [u8; ENC_CIPHERTEXT_SIZE],
+}
+
+impl OrchardOutput {
+    fn from_action<T>(action: &Action<T>) -> Self {
+        OrchardOutput {
+            epk_bytes: action.encrypted_note().epk_bytes,
+            cmx: action.cmx().to_bytes(),
+            enc_ciphertext: action.encrypted_note().enc_ciphertext,
+        }
+    }
+}
+
+impl ShieldedOutput<OrchardDomain, ENC_CIPHERTEXT_SIZE> for OrchardOutput {
+    fn ephemeral_key(&self) -> EphemeralKeyBytes {
+        EphemeralKeyBytes(self.epk_bytes)
+    }
+
+    fn cmstar_bytes(&self) -> [u8; 32] {
+        self.cmx
+    }
+
+    fn enc_ciphertext(&self) -> &[u8; ENC_CIPHERTEXT_SIZE] {
+        &self.enc_ciphertext
+    }
+}
+
+impl DynamicUsage for OrchardOutput {
+    #[inline(always)]
+    fn dynamic_usage(&self) -> usize {
+        0
+    }
+
+    #[inline(always)]
+    fn dynamic_usage_bounds(&self) -> (usize, Option<usize>) {
+        (0, Some(0))
+    }
+}
+
 /// A decrypted note.
 struct DecryptedNote<A, D: Domain> {
     /// The tag corresponding to the incoming viewing key used to decrypt the note.
@@ -83,6 +148,15 @@ type OutputItem<A, D> = OutputIndex<DecryptedNote<A, D>>;
 /// The sender for the result of batch scanning a specific transaction output.
 struct OutputReplier<A, D: Domain>(OutputIndex<channel::Sender<OutputItem<A, D>>>);
 
+impl<A, D: Domain> Clone for OutputReplier<A, D> {
+    fn clone(&self) -> Self {
+        OutputReplier(OutputIndex {
+            output_index: self.0.output_index,
+            value: self.0.value.clone(),
+        })
+    }
+}
+
 impl<A, D: Domain> DynamicUsage for OutputReplier<A, D> {
     #[inline(always)]
     fn dynamic_usage(&self) -> usize {
@@ -105,7 +179,7 @@ pub(crate) trait Tasks<Item> {
     fn add_task(&self, item: Item) -> Self::Task;
     fn run_task(&self, item: Item) {
         let task = self.add_task(item);
-        rayon::spawn_fifo(|| task.run());
+        crate::init::wallet_scan_pool().spawn_fifo(|| task.run());
     }
 }
 
@@ -163,7 +237,7 @@ impl<Item: Task + DynamicUsage> Tasks<Item> for WithUsage {
             running_usage: self.running_usage.clone(),
         };
 
-        // `rayon::spawn_fifo` creates a `HeapJob` holding a closure. The size of a
+        // `ThreadPool::spawn_fifo` creates a `HeapJob` holding a closure. The size of a
         // closure is (to good approximation) the size of the captured environment, which
         // in this case is two moved variables:
         // - An `Arc<Registry>`, which is a pointer to data that is amortized over the
@@ -206,10 +280,37 @@ impl<Item: Task> Task for WithUsageTask<Item> {
     }
 }
 
-/// A batch of outputs to trial decrypt.
-struct Batch<A, D: BatchDomain, Output: ShieldedOutput<D, ENC_CIPHERTEXT_SIZE>> {
+/// A chunk of the incoming viewing keys to trial decrypt with.
+///
+/// Each chunk is shared by every batch that trial decrypts with its keys.
+struct IvkChunk<A, D: Domain> {
     tags: Vec<A>,
     ivks: Vec<D::IncomingViewingKey>,
+}
+
+impl<A, D> DynamicUsage for IvkChunk<A, D>
+where
+    A: DynamicUsage,
+    D: Domain,
+    D::IncomingViewingKey: DynamicUsage,
+{
+    fn dynamic_usage(&self) -> usize {
+        self.tags.dynamic_usage() + self.ivks.dynamic_usage()
+    }
+
+    fn dynamic_usage_bounds(&self) -> (usize, Option<usize>) {
+        let (tags_lower, tags_upper) = self.tags.dynamic_usage_bounds();
+        let (ivks_lower, ivks_upper) = self.ivks.dynamic_usage_bounds();
+
+        (
+            tags_lower + ivks_lower,
+            tags_upper.zip(ivks_upper).map(|(a, b)| a + b),
+        )
+    }
+}
+
+/// Outputs that have been queued for trial decryption, but not yet run.
+struct PendingOutputs<A, D: BatchDomain, Output: ShieldedOutput<D, ENC_CIPHERTEXT_SIZE>> {
     /// We currently store outputs and repliers as parallel vectors, because
     /// [`batch::try_note_decryption`] accepts a slice of domain/output pairs
     /// rather than a value that implements `IntoIterator`, and therefore we
@@ -221,98 +322,135 @@ struct Batch<A, D: BatchDomain, Output: ShieldedOutput<D, ENC_CIPHERTEXT_SIZE>>
     repliers: Vec<OutputReplier<A, D>>,
 }
 
-impl<A, D, Output> DynamicUsage for Batch<A, D, Output>
+impl<A, D, Output> DynamicUsage for PendingOutputs<A, D, Output>
 where
-    A: DynamicUsage,
     D: BatchDomain + DynamicUsage,
-    D::IncomingViewingKey: DynamicUsage,
     Output: ShieldedOutput<D, ENC_CIPHERTEXT_SIZE> + DynamicUsage,
 {
     fn dynamic_usage(&self) -> usize {
-        self.tags.dynamic_usage()
-            + self.ivks.dynamic_usage()
-            + self.outputs.dynamic_usage()
-            + self.repliers.dynamic_usage()
+        self.outputs.dynamic_usage() + self.repliers.dynamic_usage()
     }
 
     fn dynamic_usage_bounds(&self) -> (usize, Option<usize>) {
-        let (tags_lower, tags_upper) = self.tags.dynamic_usage_bounds();
-        let (ivks_lower, ivks_upper) = self.ivks.dynamic_usage_bounds();
         let (outputs_lower, outputs_upper) = self.outputs.dynamic_usage_bounds();
         let (repliers_lower, repliers_upper) = self.repliers.dynamic_usage_bounds();
 
         (
-            tags_lower + ivks_lower + outputs_lower + repliers_lower,
-            tags_upper
-                .zip(ivks_upper)
-                .zip(outputs_upper)
-                .zip(repliers_upper)
-                .map(|(((a, b), c), d)| a + b + c + d),
+            outputs_lower + repliers_lower,
+            outputs_upper.zip(repliers_upper).map(|(a, b)| a + b),
         )
     }
 }
 
-impl<A, D, Output> Batch<A, D, Output>
-where
-    A: Clone,
-    D: OutputDomain,
-    Output: ShieldedOutput<D, ENC_CIPHERTEXT_SIZE>,
+impl<A, D: BatchDomain, Output: ShieldedOutput<D, ENC_CIPHERTEXT_SIZE>>
+    PendingOutputs<A, D, Output>
 {
-    /// Constructs a new batch.
-    fn new(tags: Vec<A>, ivks: Vec<D::IncomingViewingKey>) -> Self {
-        assert_eq!(tags.len(), ivks.len());
+    fn new() -> Self {
         Self {
-            tags,
-            ivks,
             outputs: vec![],
             repliers: vec![],
         }
     }
 
-    /// Returns `true` if the batch is currently empty.
+    /// Returns `true` if no outputs are pending.
     fn is_empty(&self) -> bool {
         self.outputs.is_empty()
     }
 }
 
+impl<A, D: BatchDomain, Output: ShieldedOutput<D, ENC_CIPHERTEXT_SIZE> + Clone>
+    PendingOutputs<A, D, Output>
+{
+    /// Adds the given outputs, each with the domain to decrypt it in, to the pending
+    /// outputs.
+    ///
+    /// `replier` will be called with the result of every output.
+    fn add_outputs(
+        &mut self,
+        outputs: impl IntoIterator<Item = (D, Output)>,
+        replier: channel::Sender<OutputItem<A, D>>,
+    ) {
+        let start = self.outputs.len();
+        self.outputs.extend(outputs);
+        self.repliers.extend((0..self.outputs.len() - start).map(|output_index| {
+            OutputReplier(OutputIndex {
+                output_index,
+                value: replier.clone(),
+            })
+        }));
+    }
+}
+
+/// A batch of outputs to trial decrypt with one chunk of incoming viewing keys.
+struct Batch<A, D: BatchDomain, Output: ShieldedOutput<D, ENC_CIPHERTEXT_SIZE>> {
+    keys: Arc<IvkChunk<A, D>>,
+    /// The outputs are shared by the batches for every chunk of keys.
+    outputs: Arc<Vec<(D, Output)>>,
+    /// The number of batches that share `outputs`, to count the heap usage of the
+    /// outputs once across all of them.
+    shared_by: usize,
+    repliers: Vec<OutputReplier<A, D>>,
+}
+
+impl<A, D, Output> DynamicUsage for Batch<A, D, Output>
+where
+    D: BatchDomain + DynamicUsage,
+    Output: ShieldedOutput<D, ENC_CIPHERTEXT_SIZE> + DynamicUsage,
+{
+    fn dynamic_usage(&self) -> usize {
+        // The keys are counted by the `BatchRunner` that owns them.
+        (mem::size_of::<Vec<(D, Output)>>() + (*self.outputs).dynamic_usage()) / self.shared_by
+            + self.repliers.dynamic_usage()
+    }
+
+    fn dynamic_usage_bounds(&self) -> (usize, Option<usize>) {
+        let own = mem::size_of::<Vec<(D, Output)>>();
+        let (outputs_lower, outputs_upper) = (*self.outputs).dynamic_usage_bounds();
+        let (repliers_lower, repliers_upper) = self.repliers.dynamic_usage_bounds();
+
+        (
+            (own + outputs_lower) / self.shared_by + repliers_lower,
+            outputs_upper
+                .zip(repliers_upper)
+                .map(|(a, b)| (own + a) / self.shared_by + b),
+        )
+    }
+}
+
 impl<A, D, Output> Task for Batch<A, D, Output>
 where
-    A: Clone + Send + 'static,
-    D: OutputDomain + Send + 'static,
-    D::IncomingViewingKey: Send,
+    A: Clone + Send + Sync + 'static,
+    D: OutputDomain + Send + Sync + 'static,
+    D::IncomingViewingKey: Send + Sync,
     D::Memo: Send,
     D::Note: Send,
     D::Recipient: Send,
-    Output: ShieldedOutput<D, ENC_CIPHERTEXT_SIZE> + Send + 'static,
+    Output: ShieldedOutput<D, ENC_CIPHERTEXT_SIZE> + Send + Sync + 'static,
 {
     /// Runs the batch of trial decryptions, and reports the results.
     fn run(self) {
         // Deconstruct self so we can consume the pieces individually.
         let Self {
-            tags,
-            ivks,
+            keys,
             outputs,
             repliers,
+            ..
         } = self;
 
         assert_eq!(outputs.len(), repliers.len());
-        let decryption_results = batch::try_note_decryption(&ivks, &outputs);
-        metrics::counter!(
-            METRIC_OUTPUTS_SCANNED,
-            outputs.len() as u64,
-            METRIC_LABEL_KIND => D::KIND,
-        );
+        let decryption_results = batch::try_note_decryption(&keys.ivks, &outputs);
 
         for (decryption_result, OutputReplier(replier)) in
             decryption_results.into_iter().zip(repliers.into_iter())
         {
             // If `decryption_result` is `None` then we will just drop `replier`,
-            // indicating to the parent `BatchRunner` that this output was not for us.
+            // indicating to the parent `BatchRunner` that this output was not for
+            // any key in this chunk.
             if let Some(((note, recipient, memo), ivk_idx)) = decryption_result {
                 let result = OutputIndex {
                     output_index: replier.output_index,
                     value: DecryptedNote {
-                        ivk_tag: tags[ivk_idx].clone(),
+                        ivk_tag: keys.tags[ivk_idx].clone(),
                         recipient,
                         note,
                         memo,
@@ -328,29 +466,6 @@ where
     }
 }
 
-impl<A, D: BatchDomain, Output: ShieldedOutput<D, ENC_CIPHERTEXT_SIZE> + Clone>
-    Batch<A, D, Output>
-{
-    /// Adds the given outputs to this batch.
-    ///
-    /// `replier` will be called with the result of every output.
-    fn add_outputs(
-        &mut self,
-        domain: impl Fn() -> D,
-        outputs: &[Output],
-        replier: channel::Sender<OutputItem<A, D>>,
-    ) {
-        self.outputs
-            .extend(outputs.iter().cloned().map(|output| (domain(), output)));
-        self.repliers.extend((0..outputs.len()).map(|output_index| {
-            OutputReplier(OutputIndex {
-                output_index,
-                value: replier.clone(),
-            })
-        }));
-    }
-}
-
 /// A `HashMap` key for looking up the result of a batch scanning a specific transaction.
 #[derive(PartialEq, Eq, Hash)]
 struct ResultKey(BlockHash, TxId);
@@ -407,14 +522,40 @@ where
     Output: ShieldedOutput<D, ENC_CIPHERTEXT_SIZE>,
     T: Tasks<Batch<A, D, Output>>,
 {
-    // The batch currently being accumulated.
-    acc: Batch<A, D, Output>,
+    // The incoming viewing keys, in chunks of at most `IVK_CHUNK_SIZE`.
+    keys: Vec<Arc<IvkChunk<A, D>>>,
+    // The outputs currently being accumulated.
+    acc: PendingOutputs<A, D, Output>,
     // The running batches.
     running_tasks: T,
     // Receivers for the results of the running batches.
     pending_results: HashMap<ResultKey, BatchReceiver<A, D>>,
 }
 
+impl<A, D, Output, T> BatchRunner<A, D, Output, T>
+where
+    A: DynamicUsage,
+    D: BatchDomain,
+    D::IncomingViewingKey: DynamicUsage,
+    Output: ShieldedOutput<D, ENC_CIPHERTEXT_SIZE>,
+    T: Tasks<Batch<A, D, Output>>,
+{
+    /// Returns the bounds on the heap usage of the keys.
+    fn keys_usage_bounds(&self) -> (usize, Option<usize>) {
+        // Each chunk is allocated alongside the two reference counts of its `Arc`.
+        let own = mem::size_of::<Arc<IvkChunk<A, D>>>() * self.keys.capacity()
+            + (mem::size_of::<IvkChunk<A, D>>() + 2 * mem::size_of::<usize>()) * self.keys.len();
+
+        self.keys.iter().fold((own, Some(own)), |(lower, upper), chunk| {
+            let (chunk_lower, chunk_upper) = (**chunk).dynamic_usage_bounds();
+            (
+                lower + chunk_lower,
+                upper.zip(chunk_upper).map(|(a, b)| a + b),
+            )
+        })
+    }
+}
+
 impl<A, D, Output, T> DynamicUsage for BatchRunner<A, D, Output, T>
 where
     A: DynamicUsage,
@@ -424,7 +565,8 @@ where
     T: Tasks<Batch<A, D, Output>> + DynamicUsage,
 {
     fn dynamic_usage(&self) -> usize {
-        self.acc.dynamic_usage()
+        self.keys_usage_bounds().0
+            + self.acc.dynamic_usage()
             + self.running_tasks.dynamic_usage()
             + self.pending_results.dynamic_usage()
     }
@@ -435,14 +577,16 @@ where
         let bounds = (
             self.acc.dynamic_usage_bounds(),
             self.pending_results.dynamic_usage_bounds(),
+            self.keys_usage_bounds(),
         );
         (
-            bounds.0 .0 + running_usage + bounds.1 .0,
+            bounds.0 .0 + running_usage + bounds.1 .0 + bounds.2 .0,
             bounds
                 .0
                  .1
                 .zip(bounds.1 .1)
-                .map(|(a, b)| a + running_usage + b),
+                .zip(bounds.2 .1)
+                .map(|((a, b), c)| a + running_usage + b + c),
         )
     }
 }
@@ -456,9 +600,16 @@ where
 {
     /// Constructs a new batch runner for the given incoming viewing keys.
     fn new(ivks: impl Iterator<Item = (A, D::IncomingViewingKey)>) -> Self {
-        let (tags, ivks) = ivks.unzip();
+        let mut ivks = ivks.peekable();
+        let mut keys = vec![];
+        while ivks.peek().is_some() {
+            let (tags, ivks) = ivks.by_ref().take(IVK_CHUNK_SIZE).unzip();
+            keys.push(Arc::new(IvkChunk { tags, ivks }));
+        }
+
         Self {
-            acc: Batch::new(tags, ivks),
+            keys,
+            acc: PendingOutputs::new(),
             running_tasks: T::new(),
             pending_results: HashMap::default(),
         }
@@ -467,16 +618,17 @@ where
 
 impl<A, D, Output, T> BatchRunner<A, D, Output, T>
 where
-    A: Clone + Send + 'static,
-    D: OutputDomain + Send + 'static,
-    D::IncomingViewingKey: Clone + Send + 'static,
+    A: Clone + Send + Sync + 'static,
+    D: OutputDomain + Send + Sync + 'static,
+    D::IncomingViewingKey: Send + Sync + 'static,
     D::Memo: Send,
     D::Note: Send,
     D::Recipient: Send,
-    Output: ShieldedOutput<D, ENC_CIPHERTEXT_SIZE> + Clone + Send + 'static,
+    Output: ShieldedOutput<D, ENC_CIPHERTEXT_SIZE> + Clone + Send + Sync + 'static,
     T: Tasks<Batch<A, D, Output>>,
 {
-    /// Batches the given outputs for trial decryption.
+    /// Batches the given outputs, each with the domain to decrypt it in, for trial
+    /// decryption.
     ///
     /// `block_tag` is the hash of the block that triggered this txid being added to the
     /// batch, or the all-zeros hash to indicate that no block triggered it (i.e. it was a
@@ -489,11 +641,10 @@ where
         &mut self,
         block_tag: BlockHash,
         txid: TxId,
-        domain: impl Fn() -> D,
-        outputs: &[Output],
+        outputs: impl IntoIterator<Item = (D, Output)>,
     ) {
         let (tx, rx) = channel::unbounded();
-        self.acc.add_outputs(domain, outputs, tx);
+        self.acc.add_outputs(outputs, tx);
         self.pending_results
             .insert(ResultKey(block_tag, txid), BatchReceiver(rx));
 
@@ -502,14 +653,35 @@ where
         }
     }
 
-    /// Runs the currently accumulated batch on the global threadpool.
+    /// Runs the currently accumulated outputs on the global threadpool, in one batch per
+    /// chunk of incoming viewing keys.
+    ///
+    /// Splitting the keys lets a wallet with many keys use the whole threadpool even when
+    /// only a few outputs are queued, such as for a single mempool transaction.
     ///
     /// Subsequent calls to `Self::add_outputs` will be accumulated into a new batch.
     fn flush(&mut self) {
         if !self.acc.is_empty() {
-            let mut batch = Batch::new(self.acc.tags.clone(), self.acc.ivks.clone());
-            mem::swap(&mut batch, &mut self.acc);
-            self.running_tasks.run_task(batch);
+            let PendingOutputs { outputs, repliers } =
+                mem::replace(&mut self.acc, PendingOutputs::new());
+            metrics::counter!(
+                METRIC_OUTPUTS_SCANNED,
+                outputs.len() as u64,
+                METRIC_LABEL_KIND => D::KIND,
+            );
+
+            // Each batch holds its own clones of the repliers, so that the results for a
+            // transaction are complete once the batches for every chunk have finished.
+            // The original repliers are dropped at the end of this function.
+            let outputs = Arc::new(outputs);
+            for keys in &self.keys {
+                self.running_tasks.run_task(Batch {
+                    keys: keys.clone(),
+                    outputs: outputs.clone(),
+                    shared_by: self.keys.len(),
+                    repliers: repliers.clone(),
+                });
+            }
         }
     }
 
@@ -550,25 +722,35 @@ where
 type SaplingRunner =
     BatchRunner<[u8; 32], SaplingDomain, OutputDescription<GrothProofBytes>, WithUsage>;
 
+type OrchardRunner = BatchRunner<[u8; 64], OrchardDomain, OrchardOutput, WithUsage>;
+
 /// A batch scanner for the `zcashd` wallet.
 pub(crate) struct BatchScanner {
     params: Network,
     sapling_runner: Option<SaplingRunner>,
+    orchard_runner: Option<OrchardRunner>,
 }
 
 impl DynamicUsage for BatchScanner {
     fn dynamic_usage(&self) -> usize {
-        self.sapling_runner.dynamic_usage()
+        self.sapling_runner.dynamic_usage() + self.orchard_runner.dynamic_usage()
     }
 
     fn dynamic_usage_bounds(&self) -> (usize, Option<usize>) {
-        self.sapling_runner.dynamic_usage_bounds()
+        let (sapling_lower, sapling_upper) = self.sapling_runner.dynamic_usage_bounds();
+        let (orchard_lower, orchard_upper) = self.orchard_runner.dynamic_usage_bounds();
+
+        (
+            sapling_lower + orchard_lower,
+            sapling_upper.zip(orchard_upper).map(|(a, b)| a + b),
+        )
     }
 }
 
 pub(crate) fn init_batch_scanner(
     network: &Network,
     sapling_ivks: &[[u8; 32]],
+    orchard_ivks: &[[u8; 64]],
 ) -> Result<Box<BatchScanner>, &'static str> {
     let sapling_runner = if sapling_ivks.is_empty() {
         None
@@ -584,9 +766,24 @@ pub(crate) fn init_batch_scanner(
         Some(BatchRunner::new(ivks.into_iter()))
     };
 
+    let orchard_runner = if orchard_ivks.is_empty() {
+        None
+    } else {
+        let ivks: Vec<(_, _)> = orchard_ivks
+            .iter()
+            .map(|raw_ivk| {
+                Option::<IncomingViewingKey>::from(IncomingViewingKey::from_bytes(raw_ivk))
+                    .map(|ivk| (*raw_ivk, PreparedIncomingViewingKey::new(&ivk)))
+                    .ok_or("Invalid Orchard ivk passed to wallet::init_batch_scanner()")
+            })
+            .collect::<Result<_, _>>()?;
+        Some(BatchRunner::new(ivks.into_iter()))
+    };
+
     Ok(Box::new(BatchScanner {
         params: *network,
         sapling_runner,
+        orchard_runner,
     }))
 }
 
@@ -620,8 +817,29 @@ impl BatchScanner {
             runner.add_outputs(
                 block_tag,
                 txid,
-                || SaplingDomain::new(sapling_serialization::zip212_enforcement(&params, height)),
-                bundle.shielded_outputs(),
+                bundle.shielded_outputs().iter().map(|output| {
+                    (
+                        SaplingDomain::new(sapling_serialization::zip212_enforcement(
+                            &params, height,
+                        )),
+                        output.clone(),
+                    )
+                }),
+            );
+        }
+
+        // Likewise for Orchard actions. Each action is decrypted in its own domain,
+        // which depends on the nullifier it reveals.
+        if let Some((runner, bundle)) = self.orchard_runner.as_mut().zip(tx.orchard_bundle()) {
+            runner.add_outputs(
+                block_tag,
+                txid,
+                bundle.actions().iter().map(|action| {
+                    (
+                        OrchardDomain::for_action(action),
+                        OrchardOutput::from_action(action),
+                    )
+                }),
             );
         }
 
@@ -638,6 +856,9 @@ impl BatchScanner {
         if let Some(runner) = &mut self.sapling_runner {
             runner.flush();
         }
+        if let Some(runner) = &mut self.orchard_runner {
+            runner.flush();
+        }
     }
 
     /// Collects the pending decryption results for the given transaction.
@@ -661,15 +882,22 @@ impl BatchScanner {
             .map(|runner| runner.collect_results(block_tag, txid))
             .unwrap_or_default();
 
+        let orchard = self
+            .orchard_runner
+            .as_mut()
+            .map(|runner| runner.collect_results(block_tag, txid))
+            .unwrap_or_default();
+
         // Update the size of the batch scanner.
         metrics::decrement_gauge!(METRIC_SIZE_TXS, 1.0);
 
-        Box::new(BatchResult { sapling })
+        Box::new(BatchResult { sapling, orchard })
     }
 }
 
 pub(crate) struct BatchResult {
     sapling: HashMap<(TxId, usize), DecryptedNote<[u8; 32], SaplingDomain>>,
+    orchard: HashMap<(TxId, usize), DecryptedNote<[u8; 64], OrchardDomain>>,
 }
 
 impl BatchResult {
@@ -689,4 +917,19 @@ impl BatchResult {
             )
             .collect()
     }
+    /// Returns the Orchard actions that were decrypted, with the incoming viewing key
+    /// that decrypts each of them. The wallet decrypts them again with that key alone
+    /// when it adds the notes.
+    pub(crate) fn get_orchard(&self) -> Vec<ffi::OrchardDecryptionResult> {
+        self.orchard
+            .iter()
+            .map(
+                |((txid, action), decrypted_note)| ffi::OrchardDecryptionResult {
+                    txid: *txid.as_ref(),
+                    action: *action as u32,
+                    ivk: decrypted_note.ivk_tag,
+                },
+            )
+            .collect()
+    }
 }
@@ -12,6 +12,8 @@
 
 #include <boost/bind/bind.hpp>
 
+#include <rust/metrics.h>
+
 CScheduler::CScheduler() : nThreadsServicingQueue(0), stopRequested(false), stopWhenEmpty(false)
 {
 }
@@ -55,8 +57,23 @@ void CScheduler::serviceQueue()
             if (shouldStop() || taskQueue.empty())
                 continue;
 
-            Function f = taskQueue.begin()->second;
-            taskQueue.erase(taskQueue.begin());
+            // Of the tasks that are due, run the one with the highest
+            // priority, and the earliest of those.
+            auto now = boost::chrono::system_clock::now();
+            auto next = taskQueue.begin();
+            for (auto it = std::next(next); it != taskQueue.end() && it->first <= now; ++it) {
+                if (it->second.priority > next->second.priority) {
+                    next = it;
+                }
+            }
+            if (next->first < now) {
+                MetricsHistogram(
+                    "zcash.scheduler.delay.seconds",
+                    boost::chrono::duration<double>(now - next->first).count());
+            }
+            Function f = std::move(next->second.f);
+            taskQueue.erase(next);
+            MetricsGauge("zcash.scheduler.queue.depth", taskQueue.size());
 
             {
                 // Unlock before calling f, so it can reschedule itself or another task
@@ -85,29 +102,29 @@ void CScheduler::stop(bool drain)
     newTaskScheduled.notify_all();
 }
 
-void CScheduler::schedule(CScheduler::Function f, boost::chrono::system_clock::time_point t)
+void CScheduler::schedule(CScheduler::Function f, boost::chrono::system_clock::time_point t, Priority priority)
 {
     {
         boost::unique_lock<boost::mutex> lock(newTaskMutex);
-        taskQueue.insert(std::make_pair(t, f));
+        taskQueue.insert(std::make_pair(t, Task{f, priority}));
     }
     newTaskScheduled.notify_one();
 }
 
-void CScheduler::scheduleFromNow(CScheduler::Function f, int64_t deltaSeconds)
+void CScheduler::scheduleFromNow(CScheduler::Function f, int64_t deltaSeconds, Priority priority)
 {
-    schedule(f, boost::chrono::system_clock::now() + boost::chrono::seconds(deltaSeconds));
+    schedule(f, boost::chrono::system_clock::now() + boost::chrono::seconds(deltaSeconds), priority);
 }
 
-static void Repeat(CScheduler* s, CScheduler::Function f, int64_t deltaSeconds)
+static void Repeat(CScheduler* s, CScheduler::Function f, int64_t deltaSeconds, CScheduler::Priority priority)
 {
     f();
-    s->scheduleFromNow(boost::bind(&Repeat, s, f, deltaSeconds), deltaSeconds);
+    s->scheduleFromNow(boost::bind(&Repeat, s, f, deltaSeconds, priority), deltaSeconds, priority);
 }
 
-void CScheduler::scheduleEvery(CScheduler::Function f, int64_t deltaSeconds)
+void CScheduler::scheduleEvery(CScheduler::Function f, int64_t deltaSeconds, Priority priority)
 {
-    scheduleFromNow(boost::bind(&Repeat, this, f, deltaSeconds), deltaSeconds);
+    scheduleFromNow(boost::bind(&Repeat, this, f, deltaSeconds, priority), deltaSeconds, priority);
 }
 
 size_t CScheduler::getQueueInfo(boost::chrono::system_clock::time_point &first,
@@ -121,3 +138,47 @@ size_t CScheduler::getQueueInfo(boost::chrono::system_clock::time_point &first,
     }
     return result;
 }
+
+void CSerialTaskQueue::add(CScheduler::Function f)
+{
+    boost::unique_lock<boost::mutex> lock(mutex);
+    pending.push_back(std::move(f));
+    scheduleNext(lock);
+}
+
+size_t CSerialTaskQueue::size() const
+{
+    boost::unique_lock<boost::mutex> lock(mutex);
+    return pending.size();
+}
+
+void CSerialTaskQueue::scheduleNext(boost::unique_lock<boost::mutex>& lock)
+{
+    assert(lock.owns_lock());
+    if (fScheduled || pending.empty())
+        return;
+    fScheduled = true;
+    scheduler.schedule(boost::bind(&CSerialTaskQueue::runNext, this), boost::chrono::system_clock::now(), priority);
+}
+
+void CSerialTaskQueue::runNext()
+{
+    CScheduler::Function f;
+    {
+        boost::unique_lock<boost::mutex> lock(mutex);
+        assert(fScheduled && !pending.empty());
+        f = std::move(pending.front());
+        pending.pop_front();
+    }
+    try {
+        f();
+    } catch (...) {
+        boost::unique_lock<boost::mutex> lock(mutex);
+        fScheduled = false;
+        scheduleNext(lock);
+        throw;
+    }
+    boost::unique_lock<boost::mutex> lock(mutex);
+    fScheduled = false;
+    scheduleNext(lock);
+}
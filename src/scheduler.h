@@ -13,8 +13,14 @@
 //
 #include <boost/chrono/chrono.hpp>
 #include <boost/thread.hpp>
+#include <list>
 #include <map>
 
+//! -schedulerthreads default
+static const int DEFAULT_SCHEDULER_THREADS = 2;
+//! Maximum number of scheduler threads
+static const int MAX_SCHEDULER_THREADS = 16;
+
 //
 // Simple class for background tasks that should be run
 // periodically or once "after a while"
@@ -41,18 +47,26 @@ public:
 
     typedef std::function<void(void)> Function;
 
+    // When several tasks are due, the one with the highest
+    // priority is run first.
+    enum Priority {
+        PRIORITY_LOW,
+        PRIORITY_NORMAL,
+        PRIORITY_HIGH,
+    };
+
     // Call func at/after time t
-    void schedule(Function f, boost::chrono::system_clock::time_point t);
+    void schedule(Function f, boost::chrono::system_clock::time_point t, Priority priority = PRIORITY_NORMAL);
 
     // Convenience method: call f once deltaSeconds from now
-    void scheduleFromNow(Function f, int64_t deltaSeconds);
+    void scheduleFromNow(Function f, int64_t deltaSeconds, Priority priority = PRIORITY_NORMAL);
 
     // Another convenience method: call f approximately
     // every deltaSeconds forever, starting deltaSeconds from now.
     // To be more precise: every time f is finished, it
     // is rescheduled to run deltaSeconds later. If you
     // need more accurate scheduling, don't use this method.
-    void scheduleEvery(Function f, int64_t deltaSeconds);
+    void scheduleEvery(Function f, int64_t deltaSeconds, Priority priority = PRIORITY_NORMAL);
 
     // To keep things as simple as possible, there is no unschedule.
 
@@ -71,7 +85,11 @@ public:
                         boost::chrono::system_clock::time_point &last) const;
 
 private:
-    std::multimap<boost::chrono::system_clock::time_point, Function> taskQueue;
+    struct Task {
+        Function f;
+        Priority priority;
+    };
+    std::multimap<boost::chrono::system_clock::time_point, Task> taskQueue;
     boost::condition_variable newTaskScheduled;
     mutable boost::mutex newTaskMutex;
     int nThreadsServicingQueue;
@@ -80,4 +98,36 @@ private:
     bool shouldStop() { return stopRequested || (stopWhenEmpty && taskQueue.empty()); }
 };
 
+//
+// Runs the tasks added to it on the threads of a CScheduler one at
+// a time, in the order they were added, for tasks that must not
+// overlap even when the scheduler has several threads.
+//
+// The queue must outlive the scheduler's threads, or at least
+// any task added to it.
+//
+class CSerialTaskQueue
+{
+public:
+    CSerialTaskQueue(CScheduler& schedulerIn, CScheduler::Priority priorityIn = CScheduler::PRIORITY_NORMAL) :
+        scheduler(schedulerIn), priority(priorityIn), fScheduled(false) {}
+
+    // Run f after the tasks already added have finished.
+    void add(CScheduler::Function f);
+
+    // Returns the number of tasks that have not started yet.
+    size_t size() const;
+
+private:
+    CScheduler& scheduler;
+    const CScheduler::Priority priority;
+    mutable boost::mutex mutex;
+    std::list<CScheduler::Function> pending;
+    // Whether a task of this queue is scheduled or running.
+    bool fScheduled;
+
+    void scheduleNext(boost::unique_lock<boost::mutex>& lock);
+    void runNext();
+};
+
 #endif
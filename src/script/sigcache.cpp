@@ -58,6 +58,28 @@ public:
     {
         return setValid.setup_bytes(n);
     }
+
+    CCacheStats GetStats()
+    {
+        boost::shared_lock<boost::shared_mutex> lock(cs_sigcache);
+        return CuckooCacheStats<uint256>(setValid);
+    }
+
+    void GetEntries(uint256& nonceOut, std::vector<uint256>& entries)
+    {
+        boost::shared_lock<boost::shared_mutex> lock(cs_sigcache);
+        nonceOut = nonce;
+        entries = setValid.get_elements();
+    }
+
+    void Restore(const uint256& nonceIn, const std::vector<uint256>& entries)
+    {
+        boost::unique_lock<boost::shared_mutex> lock(cs_sigcache);
+        nonce = nonceIn;
+        for (const uint256& entry : entries) {
+            setValid.insert(entry);
+        }
+    }
 };
 
 /* In previous versions of this code, signatureCache was a local static variable
@@ -78,6 +100,21 @@ void InitSignatureCache(size_t nMaxCacheSize)
             (nElems*sizeof(uint256)) >>20, nMaxCacheSize>>20, nElems);
 }
 
+CCacheStats GetSignatureCacheStats()
+{
+    return signatureCache.GetStats();
+}
+
+void GetSignatureCacheEntries(uint256& nonce, std::vector<uint256>& entries)
+{
+    signatureCache.GetEntries(nonce, entries);
+}
+
+void RestoreSignatureCache(const uint256& nonce, const std::vector<uint256>& entries)
+{
+    signatureCache.Restore(nonce, entries);
+}
+
 bool CachingTransactionSignatureChecker::VerifySignature(const std::vector<unsigned char>& vchSig, const CPubKey& pubkey, const uint256& sighash) const
 {
     uint256 entry;
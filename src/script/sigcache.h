@@ -7,6 +7,7 @@
 #ifndef BITCOIN_SCRIPT_SIGCACHE_H
 #define BITCOIN_SCRIPT_SIGCACHE_H
 
+#include "cachestats.h"
 #include "script/interpreter.h"
 
 #include <vector>
@@ -52,4 +53,20 @@ public:
 
 void InitSignatureCache(size_t nMaxCacheSize);
 
+CCacheStats GetSignatureCacheStats();
+
+/**
+ * The nonce of the signature cache, and the entries that are not marked for
+ * collection, to be saved across restarts.
+ */
+void GetSignatureCacheEntries(uint256& nonce, std::vector<uint256>& entries);
+
+/**
+ * Replace the nonce of the signature cache with a saved one, and add the saved
+ * entries. The entries are only valid with the nonce they were computed with,
+ * and the nonce is read without the lock, so this must be called before any
+ * signature is checked.
+ */
+void RestoreSignatureCache(const uint256& nonce, const std::vector<uint256>& entries);
+
 #endif // BITCOIN_SCRIPT_SIGCACHE_H
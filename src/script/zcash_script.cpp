@@ -12,6 +12,11 @@
 #include "script/interpreter.h"
 #include "version.h"
 
+#include <algorithm>
+#include <atomic>
+#include <system_error>
+#include <thread>
+
 namespace {
 inline int set_error(zcash_script_error* ret, zcash_script_error serror)
 {
@@ -240,6 +245,106 @@ int zcash_script_verify_v5(
     }
 }
 
+int zcash_script_verify_batch(
+    const unsigned char* txTo,
+    unsigned int txToLen,
+    const unsigned char* allPrevOutputs,
+    unsigned int allPrevOutputsLen,
+    unsigned int flags,
+    uint32_t consensusBranchId,
+    unsigned int nThreads,
+    unsigned char* results,
+    unsigned int resultsLen,
+    zcash_script_error* err)
+{
+    CTransaction tx;
+    try {
+        const char* txToEnd = (const char *)(txTo + txToLen);
+        RustDataStream stream((const char *)txTo, txToEnd, SER_NETWORK, PROTOCOL_VERSION);
+        stream >> tx;
+        if (GetSerializeSize(tx, SER_NETWORK, PROTOCOL_VERSION) != txToLen)
+            return set_error(err, zcash_script_ERR_TX_SIZE_MISMATCH);
+    } catch (const std::exception&) {
+        return set_error(err, zcash_script_ERR_TX_DESERIALIZE); // Error deserializing
+    }
+    if (results && resultsLen != tx.vin.size())
+        return set_error(err, zcash_script_ERR_RESULTS_SIZE_MISMATCH);
+
+    std::vector<CTxOut> prevOutputs;
+    try {
+        CDataStream sAllPrevOutputs(
+            reinterpret_cast<const char*>(allPrevOutputs),
+            reinterpret_cast<const char*>(allPrevOutputs + allPrevOutputsLen),
+            SER_NETWORK,
+            PROTOCOL_VERSION);
+        sAllPrevOutputs >> prevOutputs;
+        if (!(tx.IsCoinBase() ? prevOutputs.empty() : tx.vin.size() == prevOutputs.size())) {
+            return set_error(err, zcash_script_ERR_ALL_PREV_OUTPUTS_SIZE_MISMATCH);
+        }
+    } catch (const std::exception&) {
+        return set_error(err, zcash_script_ERR_ALL_PREV_OUTPUTS_DESERIALIZE);
+    }
+
+    if (tx.IsCoinBase()) {
+        set_error(err, zcash_script_ERR_OK);
+        if (results)
+            std::fill(results, results + resultsLen, 1);
+        return 1;
+    }
+
+    try {
+        PrecomputedTransactionData txdata(tx, allPrevOutputs, allPrevOutputsLen);
+        std::vector<unsigned char> vValid(tx.vin.size(), 0);
+        std::atomic<bool> fError{false};
+        auto verifyInputs = [&](size_t nBegin, size_t nEnd) {
+            try {
+                for (size_t nIn = nBegin; nIn < nEnd; nIn++) {
+                    vValid[nIn] = VerifyScript(
+                        tx.vin[nIn].scriptSig,
+                        prevOutputs[nIn].scriptPubKey,
+                        flags,
+                        TransactionSignatureChecker(&tx, txdata, nIn, prevOutputs[nIn].nValue),
+                        consensusBranchId,
+                        NULL);
+                }
+            } catch (const std::exception&) {
+                fError = true;
+            }
+        };
+
+        // Each thread verifies a contiguous range of inputs, and this thread
+        // the first one. If a thread cannot be started, its range is verified
+        // here instead.
+        size_t nInputs = tx.vin.size();
+        size_t nRanges = std::max<size_t>(1, std::min<size_t>(nThreads, nInputs));
+        size_t nRangeSize = (nInputs + nRanges - 1) / nRanges;
+        std::vector<std::thread> threads;
+        for (size_t nBegin = nRangeSize; nBegin < nInputs; nBegin += nRangeSize) {
+            size_t nEnd = std::min(nInputs, nBegin + nRangeSize);
+            try {
+                threads.emplace_back(verifyInputs, nBegin, nEnd);
+            } catch (const std::system_error&) {
+                verifyInputs(nBegin, nEnd);
+            }
+        }
+        verifyInputs(0, std::min(nInputs, nRangeSize));
+        for (std::thread& thread : threads) {
+            thread.join();
+        }
+
+        if (fError)
+            return set_error(err, zcash_script_ERR_VERIFY_SCRIPT); // Error during script verification
+
+        // Regardless of the verification result, the tx did not error.
+        set_error(err, zcash_script_ERR_OK);
+        if (results)
+            std::copy(vValid.begin(), vValid.end(), results);
+        return std::all_of(vValid.begin(), vValid.end(), [](unsigned char fValid) { return fValid; });
+    } catch (const std::exception&) {
+        return set_error(err, zcash_script_ERR_VERIFY_SCRIPT); // Error during script verification
+    }
+}
+
 unsigned int zcash_script_legacy_sigop_count_precomputed(
     const void* pre_preTx,
     zcash_script_error* err)
@@ -34,7 +34,7 @@
 extern "C" {
 #endif
 
-#define ZCASH_SCRIPT_API_VER 3
+#define ZCASH_SCRIPT_API_VER 4
 
 typedef enum zcash_script_error_t
 {
@@ -47,6 +47,8 @@ typedef enum zcash_script_error_t
     zcash_script_ERR_ALL_PREV_OUTPUTS_SIZE_MISMATCH,
     zcash_script_ERR_ALL_PREV_OUTPUTS_DESERIALIZE,
     zcash_script_ERR_VERIFY_SCRIPT,
+    // Defined since API version 4.
+    zcash_script_ERR_RESULTS_SIZE_MISMATCH,
 } zcash_script_error;
 
 /** Script verification flags */
@@ -157,6 +159,42 @@ EXPORT_SYMBOL int zcash_script_verify_v5(
     uint32_t consensusBranchId,
     zcash_script_error* err);
 
+/// Verifies every input of the serialized transaction pointed to by txTo
+/// against the matching output in allPrevOutputs, under the additional
+/// constraints specified by flags. This is the same as calling
+/// zcash_script_verify_v5 for each input, except that the transaction and
+/// allPrevOutputs are deserialized, and the signature hash data precomputed,
+/// only once. May be used for all transaction versions.
+///
+/// allPrevOutputs is encoded as for zcash_script_verify_v5.
+///
+/// If nThreads is greater than 1, the inputs are split between up to that
+/// many threads. The threads are started and joined within the call.
+///
+/// If results is not NULL, it must point to resultsLen bytes, one for each
+/// input, which are set to 1 for the inputs that are valid and to 0 for the
+/// others.
+///
+/// Returns 1 if every input is valid. A coinbase transaction spends no
+/// outputs, so it has nothing to verify and 1 is returned.
+///
+/// If not NULL, err will contain an error/success code for the operation.
+/// Note that script verification failure is indicated by err being set to
+/// zcash_script_ERR_OK and a return value of 0.
+///
+/// Defined since API version 4.
+EXPORT_SYMBOL int zcash_script_verify_batch(
+    const unsigned char* txTo,
+    unsigned int txToLen,
+    const unsigned char* allPrevOutputs,
+    unsigned int allPrevOutputsLen,
+    unsigned int flags,
+    uint32_t consensusBranchId,
+    unsigned int nThreads,
+    unsigned char* results,
+    unsigned int resultsLen,
+    zcash_script_error* err);
+
 /// Returns the number of transparent signature operations in the
 /// transparent inputs and outputs of the precomputed transaction
 /// pointed to by preTx.
@@ -0,0 +1,52 @@
+// Copyright (c) 2026 The Zcash developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or https://www.opensource.org/licenses/mit-license.php .
+
+#include "shieldedblock.h"
+
+#include "primitives/block.h"
+
+#include <algorithm>
+
+template <size_t N>
+static void CopyCiphertextPrefix(const std::array<unsigned char, N>& encCiphertext, std::array<unsigned char, COMPACT_NOTE_CIPHERTEXT_SIZE>& ciphertext)
+{
+    static_assert(N >= COMPACT_NOTE_CIPHERTEXT_SIZE, "ciphertext is too short");
+    std::copy(encCiphertext.begin(), encCiphertext.begin() + COMPACT_NOTE_CIPHERTEXT_SIZE, ciphertext.begin());
+}
+
+CShieldedCompactBlock::CShieldedCompactBlock(const CBlock& block, int nHeightIn) :
+    nHeight(nHeightIn), hash(block.GetHash()), hashPrevBlock(block.hashPrevBlock), nTime(block.nTime)
+{
+    for (size_t i = 0; i < block.vtx.size(); i++) {
+        const CTransaction& tx = block.vtx[i];
+        if (tx.GetSaplingSpendsCount() == 0 && tx.GetSaplingOutputsCount() == 0 && tx.GetOrchardBundle().GetNumActions() == 0) {
+            continue;
+        }
+
+        CShieldedCompactTx ctx;
+        ctx.nIndex = i;
+        ctx.txid = tx.GetHash();
+        for (const auto& spend : tx.GetSaplingSpends()) {
+            ctx.vSaplingNullifiers.push_back(uint256::FromRawBytes(spend.nullifier()));
+        }
+        for (const auto& output : tx.GetSaplingOutputs()) {
+            CCompactSaplingOutput coutput;
+            coutput.cmu = uint256::FromRawBytes(output.cmu());
+            coutput.ephemeralKey = uint256::FromRawBytes(output.ephemeral_key());
+            CopyCiphertextPrefix(output.enc_ciphertext(), coutput.ciphertext);
+            ctx.vSaplingOutputs.push_back(coutput);
+        }
+        if (tx.GetOrchardBundle().IsPresent()) {
+            for (const auto& action : tx.GetOrchardBundle().GetDetails()->actions()) {
+                CCompactOrchardAction caction;
+                caction.nullifier = uint256::FromRawBytes(action.nullifier());
+                caction.cmx = uint256::FromRawBytes(action.cmx());
+                caction.ephemeralKey = uint256::FromRawBytes(action.ephemeral_key());
+                CopyCiphertextPrefix(action.enc_ciphertext(), caction.ciphertext);
+                ctx.vOrchardActions.push_back(caction);
+            }
+        }
+        vtx.push_back(std::move(ctx));
+    }
+}
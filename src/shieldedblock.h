@@ -0,0 +1,112 @@
+// Copyright (c) 2026 The Zcash developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or https://www.opensource.org/licenses/mit-license.php .
+
+#ifndef ZCASH_SHIELDEDBLOCK_H
+#define ZCASH_SHIELDEDBLOCK_H
+
+#include "serialize.h"
+#include "uint256.h"
+
+#include <array>
+#include <stdint.h>
+#include <vector>
+
+class CBlock;
+
+//! The leading bytes of a note ciphertext, which are enough to detect a
+//! note by trial decryption (ZIP 307).
+static const size_t COMPACT_NOTE_CIPHERTEXT_SIZE = 52;
+
+/** A Sapling output, reduced to what trial decryption needs. */
+struct CCompactSaplingOutput
+{
+    uint256 cmu;
+    uint256 ephemeralKey;
+    std::array<unsigned char, COMPACT_NOTE_CIPHERTEXT_SIZE> ciphertext;
+
+    ADD_SERIALIZE_METHODS;
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream& s, Operation ser_action)
+    {
+        READWRITE(cmu);
+        READWRITE(ephemeralKey);
+        READWRITE(ciphertext);
+    }
+};
+
+/** An Orchard action, reduced to its nullifier and what trial decryption needs. */
+struct CCompactOrchardAction
+{
+    uint256 nullifier;
+    uint256 cmx;
+    uint256 ephemeralKey;
+    std::array<unsigned char, COMPACT_NOTE_CIPHERTEXT_SIZE> ciphertext;
+
+    ADD_SERIALIZE_METHODS;
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream& s, Operation ser_action)
+    {
+        READWRITE(nullifier);
+        READWRITE(cmx);
+        READWRITE(ephemeralKey);
+        READWRITE(ciphertext);
+    }
+};
+
+/** The Sapling and Orchard parts of a transaction that a light wallet scans. */
+struct CShieldedCompactTx
+{
+    //! Position of the transaction in its block
+    uint32_t nIndex;
+    uint256 txid;
+    std::vector<uint256> vSaplingNullifiers;
+    std::vector<CCompactSaplingOutput> vSaplingOutputs;
+    std::vector<CCompactOrchardAction> vOrchardActions;
+
+    ADD_SERIALIZE_METHODS;
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream& s, Operation ser_action)
+    {
+        READWRITE(nIndex);
+        READWRITE(txid);
+        READWRITE(vSaplingNullifiers);
+        READWRITE(vSaplingOutputs);
+        READWRITE(vOrchardActions);
+    }
+};
+
+/**
+ * A block reduced to the nullifiers and note commitments, keys and
+ * ciphertext prefixes of its Sapling and Orchard components, in the manner of
+ * the lightwalletd CompactBlock. Only transactions with Sapling or Orchard
+ * components are included. Sprout and transparent data are left out.
+ */
+struct CShieldedCompactBlock
+{
+    uint32_t nHeight;
+    uint256 hash;
+    uint256 hashPrevBlock;
+    uint32_t nTime;
+    std::vector<CShieldedCompactTx> vtx;
+
+    CShieldedCompactBlock() : nHeight(0), nTime(0) {}
+    CShieldedCompactBlock(const CBlock& block, int nHeightIn);
+
+    ADD_SERIALIZE_METHODS;
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream& s, Operation ser_action)
+    {
+        READWRITE(nHeight);
+        READWRITE(hash);
+        READWRITE(hashPrevBlock);
+        READWRITE(nTime);
+        READWRITE(vtx);
+    }
+};
+
+#endif // ZCASH_SHIELDEDBLOCK_H
@@ -0,0 +1,178 @@
+// Copyright (c) 2026 The Zcash developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or https://www.opensource.org/licenses/mit-license.php .
+
+#include "shieldedblockindex.h"
+
+#include "chain.h"
+#include "chainparams.h"
+#include "init.h"
+#include "main.h"
+#include "primitives/block.h"
+#include "shieldedblock.h"
+#include "streams.h"
+#include "util/system.h"
+#include "util/time.h"
+#include "version.h"
+
+CShieldedBlockIndex* pshieldedblockindex = NULL;
+
+namespace {
+
+static const char DB_SHIELDED_BLOCK = 's';
+static const char DB_BEST_BLOCK = 'B';
+
+//! Write the compact blocks collected by the sync thread once they take this
+//! many bytes.
+static const size_t SYNC_BATCH_SIZE = 16 << 20;
+
+}
+
+CShieldedBlockIndex::CShieldedBlockIndex(size_t nCacheSize, bool fMemory, bool fWipe, const CDBOptions& dbOptions) :
+    db(GetDataDir() / "indexes" / "shieldedblock", nCacheSize, fMemory, fWipe, dbOptions)
+{
+}
+
+CShieldedBlockIndex::~CShieldedBlockIndex()
+{
+    Stop();
+}
+
+void CShieldedBlockIndex::Init()
+{
+    AssertLockHeld(cs_main);
+    uint256 hashBest;
+    if (db.Read(DB_BEST_BLOCK, hashBest)) {
+        BlockMap::const_iterator it = mapBlockIndex.find(hashBest);
+        if (it != mapBlockIndex.end()) {
+            pindexBest = it->second;
+        }
+    }
+    syncThread = std::thread(&CShieldedBlockIndex::ThreadSync, this);
+}
+
+void CShieldedBlockIndex::WriteBlock(CDBBatch& batch, const CBlock& block, int nHeight) const
+{
+    // Stored in the form it is served in, so that lookups only copy it.
+    CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
+    ss << CShieldedCompactBlock(block, nHeight);
+    batch.Write(std::make_pair(DB_SHIELDED_BLOCK, block.GetHash()), std::vector<unsigned char>(ss.begin(), ss.end()));
+}
+
+void CShieldedBlockIndex::ThreadSync()
+{
+    RenameThread("zc-shieldedblock");
+    const Consensus::Params& consensusParams = Params().GetConsensus();
+    try {
+        const CBlockIndex* pindex;
+        {
+            LOCK(cs_main);
+            pindex = pindexBest;
+        }
+        CDBBatch batch(db);
+        int nBlocks = 0;
+        int64_t nStart = GetTimeMillis();
+
+        while (true) {
+            if (fStopSync || ShutdownRequested()) {
+                if (pindex != NULL) {
+                    batch.Write(DB_BEST_BLOCK, pindex->GetBlockHash());
+                }
+                db.WriteBatch(batch);
+                return;
+            }
+
+            const CBlockIndex* pindexNext;
+            {
+                LOCK(cs_main);
+                if (pindex != NULL && !chainActive.Contains(pindex)) {
+                    pindex = chainActive.FindFork(pindex);
+                }
+                if (pindex == chainActive.Tip()) {
+                    if (pindex != NULL) {
+                        batch.Write(DB_BEST_BLOCK, pindex->GetBlockHash());
+                    }
+                    if (!db.WriteBatch(batch)) {
+                        LogPrintf("%s: failed to write shielded compact blocks\n", __func__);
+                        return;
+                    }
+                    pindexBest = pindex;
+                    fSynced = true;
+                    LogPrintf("Indexed shielded compact blocks of %d blocks in %dms\n", nBlocks, GetTimeMillis() - nStart);
+                    return;
+                }
+                pindexNext = pindex == NULL ? chainActive.Genesis() : chainActive.Next(pindex);
+                if (!(pindexNext->nStatus & BLOCK_HAVE_DATA)) {
+                    LogPrintf("%s: data of block %s is not available, stopped indexing shielded compact blocks\n",
+                        __func__, pindexNext->GetBlockHash().ToString());
+                    return;
+                }
+            }
+
+            CBlock block;
+            if (!ReadBlockFromDisk(block, pindexNext, consensusParams)) {
+                LogPrintf("%s: failed to read block %s, stopped indexing shielded compact blocks\n",
+                    __func__, pindexNext->GetBlockHash().ToString());
+                return;
+            }
+            WriteBlock(batch, block, pindexNext->nHeight);
+            pindex = pindexNext;
+            nBlocks++;
+
+            if (batch.SizeEstimate() > SYNC_BATCH_SIZE) {
+                batch.Write(DB_BEST_BLOCK, pindex->GetBlockHash());
+                if (!db.WriteBatch(batch)) {
+                    LogPrintf("%s: failed to write shielded compact blocks\n", __func__);
+                    return;
+                }
+                batch.Clear();
+                LogPrint("shieldedblock", "Indexed shielded compact blocks up to height %d\n", pindex->nHeight);
+            }
+        }
+    } catch (const std::exception& e) {
+        LogPrintf("%s: %s\n", __func__, e.what());
+    }
+}
+
+void CShieldedBlockIndex::BlockConnected(const CBlock& block, const CBlockIndex* pindex)
+{
+    AssertLockHeld(cs_main);
+    // Until the sync thread has caught up, it indexes connected blocks itself.
+    if (!fSynced) {
+        return;
+    }
+    CDBBatch batch(db);
+    WriteBlock(batch, block, pindex->nHeight);
+    batch.Write(DB_BEST_BLOCK, pindex->GetBlockHash());
+    if (!db.WriteBatch(batch)) {
+        LogPrintf("%s: failed to write shielded compact block of block %s\n", __func__, pindex->GetBlockHash().ToString());
+        return;
+    }
+    pindexBest = pindex;
+}
+
+void CShieldedBlockIndex::BlockDisconnected(const CBlockIndex* pindex)
+{
+    AssertLockHeld(cs_main);
+    // The compact block stays in the index, in case the block is connected
+    // again. It is only served for blocks of the active chain.
+    if (fSynced && pindexBest == pindex) {
+        pindexBest = pindex->pprev;
+        if (pindexBest != NULL) {
+            db.Write(DB_BEST_BLOCK, pindexBest->GetBlockHash());
+        }
+    }
+}
+
+void CShieldedBlockIndex::Stop()
+{
+    fStopSync = true;
+    if (syncThread.joinable()) {
+        syncThread.join();
+    }
+}
+
+bool CShieldedBlockIndex::LookupBlock(const uint256& hashBlock, std::vector<unsigned char>& vData) const
+{
+    return db.Read(std::make_pair(DB_SHIELDED_BLOCK, hashBlock), vData);
+}
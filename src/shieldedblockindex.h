@@ -0,0 +1,83 @@
+// Copyright (c) 2026 The Zcash developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or https://www.opensource.org/licenses/mit-license.php .
+
+#ifndef ZCASH_SHIELDEDBLOCKINDEX_H
+#define ZCASH_SHIELDEDBLOCKINDEX_H
+
+#include "dbwrapper.h"
+#include "uint256.h"
+
+#include <atomic>
+#include <stdint.h>
+#include <thread>
+#include <vector>
+
+class CBlock;
+class CBlockIndex;
+
+//! -shieldedblockindex default
+static const bool DEFAULT_SHIELDEDBLOCKINDEX = false;
+//! Maximum cache of the shielded compact block database, in MiB
+static const int64_t MAX_SHIELDED_BLOCK_DB_CACHE = 256;
+
+/**
+ * Keeps the CShieldedCompactBlock of each block of the active chain, as
+ * served by /rest/shieldedblocks, in its own database under
+ * indexes/shieldedblock, so that light wallet servers are answered without
+ * reading and parsing the full blocks.
+ *
+ * Entries are keyed by block hash and hold the serialized compact block, so
+ * a reorg only moves the best indexed block back. Like CBlockFilterIndex,
+ * blocks connected while the index is behind the active chain are indexed by
+ * a background thread, and once it has caught up, compact blocks are built
+ * as blocks are connected.
+ *
+ * Init(), BlockConnected() and BlockDisconnected() must be called with
+ * cs_main held. LookupBlock() may be called without it.
+ */
+class CShieldedBlockIndex
+{
+private:
+    CDBWrapper db;
+
+    //! The last block of the active chain that is indexed.
+    const CBlockIndex* pindexBest = nullptr;
+    //! Whether the background thread has caught up with the active chain.
+    std::atomic<bool> fSynced{false};
+
+    std::thread syncThread;
+    std::atomic<bool> fStopSync{false};
+
+    void ThreadSync();
+    void WriteBlock(CDBBatch& batch, const CBlock& block, int nHeight) const;
+
+    CShieldedBlockIndex(const CShieldedBlockIndex&) = delete;
+    CShieldedBlockIndex& operator=(const CShieldedBlockIndex&) = delete;
+
+public:
+    CShieldedBlockIndex(size_t nCacheSize, bool fMemory = false, bool fWipe = false, const CDBOptions& dbOptions = CDBOptions());
+    ~CShieldedBlockIndex();
+
+    //! Load the best indexed block and start catching up with the active
+    //! chain in the background.
+    void Init();
+
+    void BlockConnected(const CBlock& block, const CBlockIndex* pindex);
+    void BlockDisconnected(const CBlockIndex* pindex);
+
+    //! Stop catching up with the active chain, if that is in progress.
+    void Stop();
+
+    bool IsSynced() const { return fSynced; }
+
+    //! Look up the serialized compact block of a block. Returns false if it
+    //! has not been indexed yet.
+    bool LookupBlock(const uint256& hashBlock, std::vector<unsigned char>& vData) const;
+};
+
+/** The shielded compact block index, or NULL if it is not enabled. Kept up to
+ *  date by ConnectTip and DisconnectTip. */
+extern CShieldedBlockIndex* pshieldedblockindex;
+
+#endif // ZCASH_SHIELDEDBLOCKINDEX_H
@@ -0,0 +1,288 @@
+// Copyright (c) 2026 The Zcash developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or https://www.opensource.org/licenses/mit-license.php .
+
+#include "socketevents.h"
+
+#include "netbase.h"
+#include "util/time.h"
+
+#include <algorithm>
+
+#if defined(USE_EPOLL)
+#include <sys/epoll.h>
+#elif defined(USE_KQUEUE)
+#include <sys/event.h>
+#include <sys/time.h>
+#endif
+
+// The most events returned by a single wait. Sockets are level-triggered,
+// so any that are still ready are reported by the next wait.
+static const int MAX_WAIT_EVENTS = 1024;
+
+void CSocketEvents::ReportAllReceivable(std::vector<std::pair<uint64_t, int>>& vReady) const
+{
+    for (const auto& entry : mapRegistered)
+        vReady.emplace_back(entry.first, SOCKET_EVENT_RECV);
+}
+
+#if defined(USE_EPOLL)
+
+CSocketEvents::CSocketEvents()
+{
+    fdEvents = epoll_create1(EPOLL_CLOEXEC);
+}
+
+CSocketEvents::~CSocketEvents()
+{
+    if (fdEvents >= 0)
+        close(fdEvents);
+}
+
+const char* CSocketEvents::Backend()
+{
+    return "epoll";
+}
+
+bool CSocketEvents::IsValid() const
+{
+    return fdEvents >= 0;
+}
+
+bool CSocketEvents::Set(uint64_t id, SOCKET s, int events)
+{
+    auto it = mapRegistered.find(id);
+    if (it != mapRegistered.end() && it->second.events == events)
+        return true;
+
+    struct epoll_event event = {};
+    event.data.u64 = id;
+    if (events & SOCKET_EVENT_RECV)
+        event.events |= EPOLLIN;
+    if (events & SOCKET_EVENT_SEND)
+        event.events |= EPOLLOUT;
+
+    int op = it == mapRegistered.end() ? EPOLL_CTL_ADD : EPOLL_CTL_MOD;
+    if (epoll_ctl(fdEvents, op, s, &event) != 0) {
+        // The kernel's set and ours can only disagree if a descriptor was
+        // closed and reused behind our back; retry with the other operation.
+        if (errno != EEXIST && errno != ENOENT)
+            return false;
+        op = op == EPOLL_CTL_ADD ? EPOLL_CTL_MOD : EPOLL_CTL_ADD;
+        if (epoll_ctl(fdEvents, op, s, &event) != 0)
+            return false;
+    }
+    mapRegistered[id] = {s, events};
+    return true;
+}
+
+void CSocketEvents::Remove(uint64_t id)
+{
+    mapRegistered.erase(id);
+}
+
+bool CSocketEvents::Wait(int nTimeoutMs, std::vector<std::pair<uint64_t, int>>& vReady)
+{
+    vReady.clear();
+
+    struct epoll_event events[MAX_WAIT_EVENTS];
+    int nEvents = epoll_wait(fdEvents, events, MAX_WAIT_EVENTS, nTimeoutMs);
+    if (nEvents < 0) {
+        ReportAllReceivable(vReady);
+        return false;
+    }
+
+    for (int i = 0; i < nEvents; i++) {
+        int flags = 0;
+        if (events[i].events & EPOLLIN)
+            flags |= SOCKET_EVENT_RECV;
+        if (events[i].events & EPOLLOUT)
+            flags |= SOCKET_EVENT_SEND;
+        if (events[i].events & (EPOLLERR | EPOLLHUP))
+            flags |= SOCKET_EVENT_ERROR;
+        uint64_t id = events[i].data.u64;
+        vReady.emplace_back(id, flags);
+    }
+    return true;
+}
+
+#elif defined(USE_KQUEUE)
+
+CSocketEvents::CSocketEvents()
+{
+    fdEvents = kqueue();
+    if (fdEvents >= 0)
+        fcntl(fdEvents, F_SETFD, FD_CLOEXEC);
+}
+
+CSocketEvents::~CSocketEvents()
+{
+    if (fdEvents >= 0)
+        close(fdEvents);
+}
+
+const char* CSocketEvents::Backend()
+{
+    return "kqueue";
+}
+
+bool CSocketEvents::IsValid() const
+{
+    return fdEvents >= 0;
+}
+
+bool CSocketEvents::Set(uint64_t id, SOCKET s, int events)
+{
+    auto it = mapRegistered.find(id);
+    int current = it == mapRegistered.end() ? 0 : it->second.events;
+    if (it != mapRegistered.end() && current == events)
+        return true;
+
+    // udata is a pointer, which may be narrower than the id; keep the id
+    // alongside the registration instead, and look it up through the
+    // socket when events arrive.
+    struct kevent changes[2];
+    int nChanges = 0;
+    if ((events ^ current) & SOCKET_EVENT_RECV) {
+        EV_SET(&changes[nChanges++], s, EVFILT_READ,
+               (events & SOCKET_EVENT_RECV) ? EV_ADD : EV_DELETE, 0, 0, 0);
+    }
+    if ((events ^ current) & SOCKET_EVENT_SEND) {
+        EV_SET(&changes[nChanges++], s, EVFILT_WRITE,
+               (events & SOCKET_EVENT_SEND) ? EV_ADD : EV_DELETE, 0, 0, 0);
+    }
+    if (nChanges > 0 && kevent(fdEvents, changes, nChanges, NULL, 0, NULL) != 0)
+        return false;
+
+    mapRegistered[id] = {s, events};
+    mapSocketIds[s] = id;
+    return true;
+}
+
+void CSocketEvents::Remove(uint64_t id)
+{
+    auto it = mapRegistered.find(id);
+    if (it == mapRegistered.end())
+        return;
+    // The descriptor may already belong to a newer registration.
+    auto itSocket = mapSocketIds.find(it->second.socket);
+    if (itSocket != mapSocketIds.end() && itSocket->second == id)
+        mapSocketIds.erase(itSocket);
+    mapRegistered.erase(it);
+}
+
+bool CSocketEvents::Wait(int nTimeoutMs, std::vector<std::pair<uint64_t, int>>& vReady)
+{
+    vReady.clear();
+
+    struct kevent events[MAX_WAIT_EVENTS];
+    struct timespec timeout;
+    timeout.tv_sec = nTimeoutMs / 1000;
+    timeout.tv_nsec = (nTimeoutMs % 1000) * 1000000L;
+    int nEvents = kevent(fdEvents, NULL, 0, events, MAX_WAIT_EVENTS, &timeout);
+    if (nEvents < 0) {
+        ReportAllReceivable(vReady);
+        return false;
+    }
+
+    // A socket can be reported once per filter; merge those.
+    std::map<uint64_t, int> mapReady;
+    for (int i = 0; i < nEvents; i++) {
+        auto it = mapSocketIds.find(events[i].ident);
+        if (it == mapSocketIds.end())
+            continue;
+        int& flags = mapReady[it->second];
+        if (events[i].filter == EVFILT_READ)
+            flags |= SOCKET_EVENT_RECV;
+        if (events[i].filter == EVFILT_WRITE)
+            flags |= SOCKET_EVENT_SEND;
+        if (events[i].flags & (EV_EOF | EV_ERROR))
+            flags |= SOCKET_EVENT_ERROR;
+    }
+    vReady.assign(mapReady.begin(), mapReady.end());
+    return true;
+}
+
+#else
+
+CSocketEvents::CSocketEvents()
+{
+}
+
+CSocketEvents::~CSocketEvents()
+{
+}
+
+const char* CSocketEvents::Backend()
+{
+    return "select";
+}
+
+bool CSocketEvents::IsValid() const
+{
+    return true;
+}
+
+bool CSocketEvents::Set(uint64_t id, SOCKET s, int events)
+{
+    if (!IsSelectableSocket(s))
+        return false;
+    mapRegistered[id] = {s, events};
+    return true;
+}
+
+void CSocketEvents::Remove(uint64_t id)
+{
+    mapRegistered.erase(id);
+}
+
+bool CSocketEvents::Wait(int nTimeoutMs, std::vector<std::pair<uint64_t, int>>& vReady)
+{
+    vReady.clear();
+
+    // select() with no sockets fails on Windows rather than sleeping.
+    if (mapRegistered.empty()) {
+        MilliSleep(nTimeoutMs);
+        return true;
+    }
+
+    fd_set fdsetRecv;
+    fd_set fdsetSend;
+    fd_set fdsetError;
+    FD_ZERO(&fdsetRecv);
+    FD_ZERO(&fdsetSend);
+    FD_ZERO(&fdsetError);
+    SOCKET hSocketMax = 0;
+    for (const auto& entry : mapRegistered) {
+        const Registration& reg = entry.second;
+        FD_SET(reg.socket, &fdsetError);
+        if (reg.events & SOCKET_EVENT_RECV)
+            FD_SET(reg.socket, &fdsetRecv);
+        if (reg.events & SOCKET_EVENT_SEND)
+            FD_SET(reg.socket, &fdsetSend);
+        hSocketMax = std::max(hSocketMax, reg.socket);
+    }
+
+    struct timeval timeout = MillisToTimeval(nTimeoutMs);
+    int nSelect = select(hSocketMax + 1, &fdsetRecv, &fdsetSend, &fdsetError, &timeout);
+    if (nSelect == SOCKET_ERROR) {
+        ReportAllReceivable(vReady);
+        return false;
+    }
+
+    for (const auto& entry : mapRegistered) {
+        SOCKET s = entry.second.socket;
+        int flags = 0;
+        if (FD_ISSET(s, &fdsetRecv))
+            flags |= SOCKET_EVENT_RECV;
+        if (FD_ISSET(s, &fdsetSend))
+            flags |= SOCKET_EVENT_SEND;
+        if (FD_ISSET(s, &fdsetError))
+            flags |= SOCKET_EVENT_ERROR;
+        if (flags != 0)
+            vReady.emplace_back(entry.first, flags);
+    }
+    return true;
+}
+
+#endif
@@ -0,0 +1,83 @@
+// Copyright (c) 2026 The Zcash developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or https://www.opensource.org/licenses/mit-license.php .
+
+#ifndef BITCOIN_SOCKETEVENTS_H
+#define BITCOIN_SOCKETEVENTS_H
+
+#include "compat.h"
+
+#include <stdint.h>
+#include <map>
+#include <utility>
+#include <vector>
+
+static const int SOCKET_EVENT_RECV = 1;
+static const int SOCKET_EVENT_SEND = 2;
+static const int SOCKET_EVENT_ERROR = 4;
+
+/**
+ * Waits for a set of sockets to become ready, using epoll on Linux, kqueue on
+ * the BSDs and macOS, and select() elsewhere.
+ *
+ * Sockets stay registered between calls to Wait, identified by the caller's
+ * id, so that the cost of a wait depends on the number of sockets that are
+ * ready rather than on the number of connections. Errors and hang-ups are
+ * always reported, whichever events were asked for.
+ */
+class CSocketEvents
+{
+private:
+    struct Registration {
+        SOCKET socket;
+        int events;
+    };
+
+    std::map<uint64_t, Registration> mapRegistered;
+#if defined(USE_EPOLL) || defined(USE_KQUEUE)
+    int fdEvents;
+#endif
+#if defined(USE_KQUEUE)
+    std::map<SOCKET, uint64_t> mapSocketIds;
+#endif
+
+    void ReportAllReceivable(std::vector<std::pair<uint64_t, int>>& vReady) const;
+
+public:
+    CSocketEvents();
+    ~CSocketEvents();
+
+    CSocketEvents(const CSocketEvents&) = delete;
+    CSocketEvents& operator=(const CSocketEvents&) = delete;
+
+    /** The name of the backend in use. */
+    static const char* Backend();
+
+    /** Whether the backend could be initialized. */
+    bool IsValid() const;
+
+    /**
+     * Wait for the given SOCKET_EVENT_RECV and SOCKET_EVENT_SEND events on s,
+     * registering it under id if it is not already. Returns false if the
+     * backend rejected the socket.
+     */
+    bool Set(uint64_t id, SOCKET s, int events);
+
+    /**
+     * Forget the socket registered under id. Must be called once the socket
+     * is closed, which already removes it from the kernel's set; the
+     * descriptor may have been reused by then, so it is not touched.
+     */
+    void Remove(uint64_t id);
+
+    /**
+     * Wait up to nTimeoutMs milliseconds for any registered socket to become
+     * ready, and return the ids and SOCKET_EVENT_* flags of those that are in
+     * vReady. If waiting fails, false is returned and every socket is
+     * reported ready to receive, so that the caller's non-blocking reads find
+     * out which are broken.
+     */
+    bool Wait(int nTimeoutMs, std::vector<std::pair<uint64_t, int>>& vReady);
+};
+
+#endif // BITCOIN_SOCKETEVENTS_H
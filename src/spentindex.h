@@ -10,6 +10,8 @@
 #include "uint256.h"
 #include "amount.h"
 
+#include <map>
+
 struct CSpentIndexKey {
     uint256 txid;
     unsigned int outputIndex;
@@ -35,6 +37,10 @@ struct CSpentIndexKey {
         txid.SetNull();
         outputIndex = 0;
     }
+
+    friend bool operator==(const CSpentIndexKey& a, const CSpentIndexKey& b) {
+        return a.txid == b.txid && a.outputIndex == b.outputIndex;
+    }
 };
 
 struct CSpentIndexValue {
@@ -95,4 +101,6 @@ struct CSpentIndexKeyCompare
     }
 };
 
+typedef std::map<CSpentIndexKey, CSpentIndexValue, CSpentIndexKeyCompare> CSpentIndexMap;
+
 #endif // BITCOIN_SPENTINDEX_H
@@ -115,6 +115,26 @@ OverrideStream<S> WithVersion(S* s, int nVersion)
     return OverrideStream<S>(s, s->GetType(), nVersion);
 }
 
+/**
+ * Allocator for buffers of public data, such as blocks, transactions and
+ * network messages. Unlike zero_after_free_allocator, it does not cleanse
+ * the memory that it frees. It is only a distinct type so that
+ * CPublicSerializeData is not the same type as std::vector<char>.
+ */
+template <typename T>
+struct public_data_allocator : public std::allocator<T> {
+    public_data_allocator() noexcept {}
+    template <typename U>
+    public_data_allocator(const public_data_allocator<U>& a) noexcept : std::allocator<T>(a) {}
+    template <typename U>
+    struct rebind {
+        typedef public_data_allocator<U> other;
+    };
+};
+
+// Byte-vector for public data, which is not cleansed before deletion.
+typedef std::vector<char, public_data_allocator<char> > CPublicSerializeData;
+
 /** Double ended buffer combining vector and stream-like interfaces.
  *
  * >> and << read and write unformatted data using the above serialization templates.
@@ -162,6 +182,13 @@ public:
         Init(nTypeIn, nVersionIn);
     }
 
+    //! Take over vchIn as the buffer, to read from its beginning, without
+    //! copying it.
+    CBaseDataStream(vector_type&& vchIn, int nTypeIn, int nVersionIn) : vch(std::move(vchIn))
+    {
+        Init(nTypeIn, nVersionIn);
+    }
+
     CBaseDataStream(const std::vector<char>& vchIn, int nTypeIn, int nVersionIn) : vch(vchIn.begin(), vchIn.end())
     {
         Init(nTypeIn, nVersionIn);
@@ -328,6 +355,12 @@ public:
         read(reinterpret_cast<char*>(pch), nSize);
     }
 
+    //! The unread bytes, which Rust code parses in place, followed by
+    //! skip_u8() with the number of bytes it read.
+    const unsigned char* unread_u8() const { return reinterpret_cast<const unsigned char*>(data()); }
+    size_t unread_size() const { return size(); }
+    void skip_u8(size_t nSize) { ignore(nSize); }
+
     void read(char* pch, size_t nSize)
     {
         if (nSize == 0) return;
@@ -406,10 +439,16 @@ public:
         return (*this);
     }
 
-    void GetAndClear(CSerializeData &d) {
+    void GetAndClear(vector_type &d) {
         d.insert(d.end(), begin(), end());
         clear();
     }
+
+    /** Exchange the underlying buffer with vchOther, and read from its beginning. */
+    void Swap(vector_type& vchOther) {
+        vch.swap(vchOther);
+        nReadPos = 0;
+    }
 };
 
 class CDataStream : public CBaseDataStream<CSerializeData>
@@ -444,6 +483,17 @@ public:
 
 };
 
+/**
+ * A data stream for public data, such as blocks, transactions and network
+ * messages, whose buffer is not cleansed when it is freed. Use CDataStream
+ * for anything that may hold key material.
+ */
+class CPublicDataStream : public CBaseDataStream<CPublicSerializeData>
+{
+public:
+    using CBaseDataStream::CBaseDataStream;
+};
+
 /**
  * Concrete instantiation of a data stream, enabling them to be passed into Rust code.
  *
@@ -452,6 +502,62 @@ public:
 typedef CBaseDataStream<CSerializeData> RustDataStream;
 
 
+/** Minimal stream for deserializing from memory that it does not own, such
+ *  as a memory-mapped block file, without copying it first.
+ */
+class SpanReader
+{
+private:
+    const int nType;
+    const int nVersion;
+    const unsigned char* pBegin;
+    const unsigned char* pEnd;
+
+public:
+    SpanReader(int nTypeIn, int nVersionIn, const unsigned char* pBeginIn, size_t nSize) :
+        nType(nTypeIn), nVersion(nVersionIn), pBegin(pBeginIn), pEnd(pBeginIn + nSize) {}
+
+    int GetType() const          { return nType; }
+    int GetVersion() const       { return nVersion; }
+    size_t size() const          { return pEnd - pBegin; }
+    bool empty() const           { return pBegin == pEnd; }
+
+    void read_u8(unsigned char* pch, size_t nSize)
+    {
+        read(reinterpret_cast<char*>(pch), nSize);
+    }
+
+    //! The unread bytes, which Rust code parses in place, followed by
+    //! skip_u8() with the number of bytes it read.
+    const unsigned char* unread_u8() const { return pBegin; }
+    size_t unread_size() const { return size(); }
+    void skip_u8(size_t nSize) { ignore(nSize); }
+
+    void read(char* pch, size_t nSize)
+    {
+        if (nSize > size())
+            throw std::ios_base::failure("SpanReader::read(): end of data");
+        memcpy(pch, pBegin, nSize);
+        pBegin += nSize;
+    }
+
+    void ignore(size_t nSize)
+    {
+        if (nSize > size())
+            throw std::ios_base::failure("SpanReader::ignore(): end of data");
+        pBegin += nSize;
+    }
+
+    template<typename T>
+    SpanReader& operator>>(T&& obj)
+    {
+        // Unserialize from this stream
+        ::Unserialize(*this, obj);
+        return (*this);
+    }
+};
+
+
 
 
 
@@ -16,6 +16,10 @@ rust::Box<stream::CppStream> ToRustStream(CBufferedFile& file) {
     return stream::from_buffered_file(file);
 }
 
+rust::Box<stream::CppStream> ToRustStream(SpanReader& reader) {
+    return stream::from_span_reader(reader);
+}
+
 rust::Box<stream::CppStream> ToRustStream(CHashWriter& writer) {
     return stream::from_hash_writer(writer);
 }
@@ -13,6 +13,8 @@
 #include <map>
 #include <memory>
 #include <set>
+#include <tuple>
+#include <unordered_map>
 
 #ifdef DEBUG_LOCKCONTENTION
 #if !defined(HAVE_THREAD_LOCAL)
@@ -25,6 +27,169 @@ void PrintLockContention(const char* pszName, const char* pszFile, int nLine)
 }
 #endif /* DEBUG_LOCKCONTENTION */
 
+std::atomic<bool> g_lock_stats_enabled{false};
+
+class CLockSite
+{
+public:
+    const std::string name;
+    const std::string file;
+    const int line;
+
+    std::atomic<uint64_t> nAcquisitions{0};
+    std::atomic<uint64_t> nContended{0};
+    std::atomic<int64_t> nWaitMicros{0};
+    std::atomic<int64_t> nMaxWaitMicros{0};
+    std::atomic<int64_t> nHoldMicros{0};
+    std::atomic<int64_t> nMaxHoldMicros{0};
+
+    CLockSite(const char* pszName, const char* pszFile, int nLine) : name(pszName), file(pszFile), line(nLine) {}
+};
+
+namespace {
+
+struct LockSiteRegistry
+{
+    std::mutex mutex;
+    //! Keyed by contents, as each translation unit has its own copy of the
+    //! strings of a LOCK in a header.
+    std::map<std::tuple<std::string, std::string, int>, std::unique_ptr<CLockSite>> sites;
+    std::atomic<void (*)(const char* pszName, double nWaitSeconds)> observer{nullptr};
+};
+
+// Never destroyed, as locks may still be released by global destructors.
+LockSiteRegistry& GetLockSiteRegistry()
+{
+    static LockSiteRegistry* registry = new LockSiteRegistry();
+    return *registry;
+}
+
+struct LockSiteKey
+{
+    const char* pszName;
+    const char* pszFile;
+    int nLine;
+
+    bool operator==(const LockSiteKey& other) const
+    {
+        return pszName == other.pszName && pszFile == other.pszFile && nLine == other.nLine;
+    }
+};
+
+struct LockSiteKeyHasher
+{
+    size_t operator()(const LockSiteKey& key) const
+    {
+        return std::hash<const void*>()(key.pszName) ^ (std::hash<const void*>()(key.pszFile) * 31) ^ key.nLine;
+    }
+};
+
+//! The sites that this thread has already looked up, so that profiled
+//! acquisitions do not contend for the registry.
+thread_local std::unordered_map<LockSiteKey, CLockSite*, LockSiteKeyHasher> g_lock_sites;
+
+thread_local int64_t g_thread_lock_wait_micros = 0;
+
+void UpdateMax(std::atomic<int64_t>& nMax, int64_t nValue)
+{
+    int64_t nPrev = nMax.load(std::memory_order_relaxed);
+    while (nValue > nPrev && !nMax.compare_exchange_weak(nPrev, nValue, std::memory_order_relaxed)) {}
+}
+
+}
+
+void EnableLockStats(bool fEnable)
+{
+    g_lock_stats_enabled = fEnable;
+}
+
+CLockSite* GetLockSite(const char* pszName, const char* pszFile, int nLine)
+{
+    LockSiteKey key{pszName, pszFile, nLine};
+    auto it = g_lock_sites.find(key);
+    if (it != g_lock_sites.end()) {
+        return it->second;
+    }
+    LockSiteRegistry& registry = GetLockSiteRegistry();
+    std::lock_guard<std::mutex> lock(registry.mutex);
+    auto& site = registry.sites[std::make_tuple(std::string(pszName), std::string(pszFile), nLine)];
+    if (!site) {
+        site.reset(new CLockSite(pszName, pszFile, nLine));
+    }
+    g_lock_sites.emplace(key, site.get());
+    return site.get();
+}
+
+void RecordLockAcquired(CLockSite* site, bool fContended, int64_t nWaitMicros)
+{
+    site->nAcquisitions.fetch_add(1, std::memory_order_relaxed);
+    if (!fContended) {
+        return;
+    }
+    site->nContended.fetch_add(1, std::memory_order_relaxed);
+    site->nWaitMicros.fetch_add(nWaitMicros, std::memory_order_relaxed);
+    g_thread_lock_wait_micros += nWaitMicros;
+    UpdateMax(site->nMaxWaitMicros, nWaitMicros);
+    auto observer = GetLockSiteRegistry().observer.load(std::memory_order_relaxed);
+    if (observer) {
+        observer(site->name.c_str(), nWaitMicros * 0.000001);
+    }
+}
+
+void RecordLockReleased(CLockSite* site, int64_t nHoldMicros)
+{
+    site->nHoldMicros.fetch_add(nHoldMicros, std::memory_order_relaxed);
+    UpdateMax(site->nMaxHoldMicros, nHoldMicros);
+}
+
+std::vector<LockSiteStats> GetLockStats()
+{
+    LockSiteRegistry& registry = GetLockSiteRegistry();
+    std::lock_guard<std::mutex> lock(registry.mutex);
+    std::vector<LockSiteStats> stats;
+    stats.reserve(registry.sites.size());
+    for (const auto& entry : registry.sites) {
+        const CLockSite& site = *entry.second;
+        stats.push_back(LockSiteStats{
+            site.name,
+            site.file,
+            site.line,
+            site.nAcquisitions.load(std::memory_order_relaxed),
+            site.nContended.load(std::memory_order_relaxed),
+            site.nWaitMicros.load(std::memory_order_relaxed),
+            site.nMaxWaitMicros.load(std::memory_order_relaxed),
+            site.nHoldMicros.load(std::memory_order_relaxed),
+            site.nMaxHoldMicros.load(std::memory_order_relaxed),
+        });
+    }
+    return stats;
+}
+
+void ResetLockStats()
+{
+    LockSiteRegistry& registry = GetLockSiteRegistry();
+    std::lock_guard<std::mutex> lock(registry.mutex);
+    for (auto& entry : registry.sites) {
+        CLockSite& site = *entry.second;
+        site.nAcquisitions = 0;
+        site.nContended = 0;
+        site.nWaitMicros = 0;
+        site.nMaxWaitMicros = 0;
+        site.nHoldMicros = 0;
+        site.nMaxHoldMicros = 0;
+    }
+}
+
+void SetLockWaitObserver(void (*observer)(const char* pszName, double nWaitSeconds))
+{
+    GetLockSiteRegistry().observer = observer;
+}
+
+int64_t GetThreadLockWaitMicros()
+{
+    return g_thread_lock_wait_micros;
+}
+
 #ifdef DEBUG_LOCKORDER
 //
 // Early deadlock detection.
@@ -12,9 +12,14 @@
 #include <boost/thread/condition_variable.hpp>
 #include <boost/thread/locks.hpp>
 #include <boost/thread/mutex.hpp>
+#include <atomic>
+#include <chrono>
 #include <condition_variable>
+#include <stdint.h>
+#include <string>
 #include <thread>
 #include <mutex>
+#include <vector>
 
 
 ////////////////////////////////////////////////
@@ -118,14 +123,86 @@ typedef AnnotatedMixin<std::mutex> Mutex;
 void PrintLockContention(const char* pszName, const char* pszFile, int nLine);
 #endif
 
+/**
+ * Lock contention profiling. While it is enabled, each acquisition through
+ * LOCK, LOCK2, TRY_LOCK and WAIT_LOCK records, for the place that it was
+ * taken at, how long it waited for the lock and how long the lock was then
+ * held. The hold time of a WAIT_LOCK includes any time spent waiting on a
+ * condition variable with it. While it is disabled, an acquisition only
+ * checks g_lock_stats_enabled.
+ */
+class CLockSite;
+
+//! -lockstats default
+static const bool DEFAULT_LOCK_STATS = false;
+
+/** The profile of the acquisitions of a lock at one place. */
+struct LockSiteStats
+{
+    std::string name;
+    std::string file;
+    int line;
+    uint64_t nAcquisitions;
+    //! Acquisitions that had to wait for another thread to release the lock.
+    uint64_t nContended;
+    int64_t nWaitMicros;
+    int64_t nMaxWaitMicros;
+    int64_t nHoldMicros;
+    int64_t nMaxHoldMicros;
+};
+
+extern std::atomic<bool> g_lock_stats_enabled;
+
+void EnableLockStats(bool fEnable);
+//! The profile of every place that a lock has been taken at while profiling
+//! was enabled, in no particular order.
+std::vector<LockSiteStats> GetLockStats();
+void ResetLockStats();
+//! Set a function to be called with the wait time of each contended
+//! acquisition, e.g. to record it as a metric.
+void SetLockWaitObserver(void (*observer)(const char* pszName, double nWaitSeconds));
+//! The time this thread has waited for profiled locks, in microseconds. Only
+//! grows while profiling is enabled.
+int64_t GetThreadLockWaitMicros();
+
+CLockSite* GetLockSite(const char* pszName, const char* pszFile, int nLine);
+void RecordLockAcquired(CLockSite* site, bool fContended, int64_t nWaitMicros);
+void RecordLockReleased(CLockSite* site, int64_t nHoldMicros);
+
 /** Wrapper around std::unique_lock style lock for Mutex. */
 template <typename Mutex, typename Base = typename Mutex::UniqueLock>
 class SCOPED_LOCKABLE UniqueLock : public Base
 {
 private:
+    //! Where the lock was taken and when it was acquired, if it is profiled.
+    CLockSite* m_site = nullptr;
+    std::chrono::steady_clock::time_point m_acquired;
+
+    void EnterProfiled(const char* pszName, const char* pszFile, int nLine)
+    {
+        m_site = GetLockSite(pszName, pszFile, nLine);
+        if (Base::try_lock()) {
+            m_acquired = std::chrono::steady_clock::now();
+            RecordLockAcquired(m_site, false, 0);
+            return;
+        }
+#ifdef DEBUG_LOCKCONTENTION
+        PrintLockContention(pszName, pszFile, nLine);
+#endif
+        auto start = std::chrono::steady_clock::now();
+        Base::lock();
+        m_acquired = std::chrono::steady_clock::now();
+        RecordLockAcquired(m_site, true,
+            std::chrono::duration_cast<std::chrono::microseconds>(m_acquired - start).count());
+    }
+
     void Enter(const char* pszName, const char* pszFile, int nLine)
     {
         EnterCritical(pszName, pszFile, nLine, (void*)(Base::mutex()));
+        if (g_lock_stats_enabled.load(std::memory_order_relaxed)) {
+            EnterProfiled(pszName, pszFile, nLine);
+            return;
+        }
 #ifdef DEBUG_LOCKCONTENTION
         if (!Base::try_lock()) {
             PrintLockContention(pszName, pszFile, nLine);
@@ -140,8 +217,13 @@ private:
     {
         EnterCritical(pszName, pszFile, nLine, (void*)(Base::mutex()), true);
         Base::try_lock();
-        if (!Base::owns_lock())
+        if (!Base::owns_lock()) {
             LeaveCritical();
+        } else if (g_lock_stats_enabled.load(std::memory_order_relaxed)) {
+            m_site = GetLockSite(pszName, pszFile, nLine);
+            m_acquired = std::chrono::steady_clock::now();
+            RecordLockAcquired(m_site, false, 0);
+        }
         return Base::owns_lock();
     }
 
@@ -167,8 +249,13 @@ public:
 
     ~UniqueLock() UNLOCK_FUNCTION()
     {
-        if (Base::owns_lock())
+        if (Base::owns_lock()) {
+            if (m_site) {
+                RecordLockReleased(m_site, std::chrono::duration_cast<std::chrono::microseconds>(
+                    std::chrono::steady_clock::now() - m_acquired).count());
+            }
             LeaveCritical();
+        }
     }
 
     operator bool()
@@ -0,0 +1,143 @@
+// Copyright (c) 2026 The Zcash developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or https://www.opensource.org/licenses/mit-license.php .
+
+#include "syncstats.h"
+
+#include "chainparams.h"
+#include "main.h"
+#include "sync.h"
+#include "util/time.h"
+
+#include <algorithm>
+#include <atomic>
+#include <deque>
+
+#include <rust/metrics.h>
+
+static std::atomic<uint64_t> nSyncBlocksReceived{0};
+static std::atomic<uint64_t> nSyncBytesReceived{0};
+static std::atomic<int64_t> nSyncValidationMicros{0};
+static std::atomic<int64_t> nSyncFlushMicros{0};
+
+/** The sync counters and chain height at a point in time. */
+struct CSyncSample
+{
+    int64_t nTimeMicros;
+    int nHeight;
+    uint64_t nBlocksReceived;
+    uint64_t nBytesReceived;
+    int64_t nValidationMicros;
+    int64_t nFlushMicros;
+};
+
+static Mutex cs_syncSamples;
+//! Samples taken every SYNC_STATS_INTERVAL seconds, oldest first, going back
+//! at least SYNC_STATS_WINDOW seconds once there are enough of them.
+static std::deque<CSyncSample> vSyncSamples GUARDED_BY(cs_syncSamples);
+
+static CSyncSample TakeSyncSample(int nHeight)
+{
+    return CSyncSample{
+        GetTimeMicros(),
+        nHeight,
+        nSyncBlocksReceived.load(),
+        nSyncBytesReceived.load(),
+        nSyncValidationMicros.load(),
+        nSyncFlushMicros.load(),
+    };
+}
+
+void RecordSyncBlockReceived(size_t nBytes)
+{
+    nSyncBlocksReceived++;
+    nSyncBytesReceived += nBytes;
+}
+
+void RecordSyncStage(SyncStage stage, int64_t nMicros)
+{
+    switch (stage) {
+    case SyncStage::Validation:
+        nSyncValidationMicros += nMicros;
+        break;
+    case SyncStage::Flush:
+        nSyncFlushMicros += nMicros;
+        break;
+    }
+}
+
+CSyncStats GetSyncStats()
+{
+    CSyncStats stats;
+    bool fInitialDownload;
+    int nHeight;
+    {
+        LOCK(cs_main);
+        fInitialDownload = IsInitialBlockDownload(Params().GetConsensus());
+        nHeight = chainActive.Height();
+        GetBlockDownloadQueue(stats.nBlocksInFlight, stats.nBlocksInFlightLimit, stats.nBlocksWaiting);
+        stats.nCoinsCacheUsage = pcoinsTip ? pcoinsTip->DynamicMemoryUsage() : 0;
+        stats.nCoinsCacheLimit = nCoinCacheUsage;
+    }
+
+    CSyncSample now = TakeSyncSample(nHeight);
+    {
+        LOCK(cs_syncSamples);
+        if (!vSyncSamples.empty() && now.nTimeMicros > vSyncSamples.front().nTimeMicros) {
+            const CSyncSample& start = vSyncSamples.front();
+            double nSeconds = (now.nTimeMicros - start.nTimeMicros) * 0.000001;
+            stats.nWindowSeconds = nSeconds;
+            stats.nDownloadBlocksPerSecond = (now.nBlocksReceived - start.nBlocksReceived) / nSeconds;
+            stats.nDownloadBytesPerSecond = (now.nBytesReceived - start.nBytesReceived) / nSeconds;
+            stats.nConnectBlocksPerSecond = std::max(0, now.nHeight - start.nHeight) / nSeconds;
+            stats.nValidationBusy = (now.nValidationMicros - start.nValidationMicros) * 0.000001 / nSeconds;
+            stats.nFlushBusy = (now.nFlushMicros - start.nFlushMicros) * 0.000001 / nSeconds;
+        }
+    }
+
+    // Blocks are validated and flushed one at a time while holding cs_main.
+    // If that keeps the thread busy, whichever of the two takes longer is
+    // what limits the sync; otherwise the node is waiting for blocks.
+    if (!fInitialDownload) {
+        stats.strBottleneck = "none";
+    } else if (stats.nWindowSeconds == 0) {
+        stats.strBottleneck = "unknown";
+    } else if (stats.nValidationBusy + stats.nFlushBusy >= SYNC_SATURATED_BUSY) {
+        stats.strBottleneck = stats.nValidationBusy >= stats.nFlushBusy ? "validation" : "flush";
+    } else {
+        stats.strBottleneck = "download";
+    }
+    return stats;
+}
+
+void UpdateSyncStats()
+{
+    int nHeight;
+    {
+        LOCK(cs_main);
+        nHeight = chainActive.Height();
+    }
+    {
+        LOCK(cs_syncSamples);
+        vSyncSamples.push_back(TakeSyncSample(nHeight));
+        int64_t nWindowStart = vSyncSamples.back().nTimeMicros - SYNC_STATS_WINDOW * 1000000;
+        while (vSyncSamples.size() > 1 && vSyncSamples[1].nTimeMicros <= nWindowStart) {
+            vSyncSamples.pop_front();
+        }
+    }
+
+    CSyncStats stats = GetSyncStats();
+    MetricsGauge("zcash.sync.download.blocks.rate", stats.nDownloadBlocksPerSecond);
+    MetricsGauge("zcash.sync.download.bytes.rate", stats.nDownloadBytesPerSecond);
+    MetricsGauge("zcash.sync.connect.blocks.rate", stats.nConnectBlocksPerSecond);
+    MetricsGauge("zcash.sync.stage.busy", stats.nValidationBusy, "stage", "validation");
+    MetricsGauge("zcash.sync.stage.busy", stats.nFlushBusy, "stage", "flush");
+    MetricsGauge("zcash.sync.blocks.inflight", stats.nBlocksInFlight);
+    MetricsGauge("zcash.sync.blocks.inflight.limit", stats.nBlocksInFlightLimit);
+    MetricsGauge("zcash.sync.blocks.waiting", stats.nBlocksWaiting);
+    MetricsGauge("zcash.sync.coins.cache.bytes", stats.nCoinsCacheUsage);
+    MetricsGauge("zcash.sync.coins.cache.limit.bytes", stats.nCoinsCacheLimit);
+    for (const char* pszStage : {"download", "validation", "flush"}) {
+        MetricsGauge("zcash.sync.bottleneck", stats.strBottleneck == pszStage ? 1 : 0, "stage", pszStage);
+    }
+}
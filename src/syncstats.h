@@ -0,0 +1,66 @@
+// Copyright (c) 2026 The Zcash developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or https://www.opensource.org/licenses/mit-license.php .
+
+#ifndef ZCASH_SYNCSTATS_H
+#define ZCASH_SYNCSTATS_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string>
+
+//! How often the block sync throughput is sampled, in seconds.
+static const int64_t SYNC_STATS_INTERVAL = 10;
+//! The period the block sync throughput is measured over, in seconds.
+static const int64_t SYNC_STATS_WINDOW = 60;
+//! The fraction of the time spent validating and flushing above which the
+//! thread connecting blocks is taken to be saturated.
+static const double SYNC_SATURATED_BUSY = 0.8;
+
+/** The stages of block sync that run while holding cs_main. */
+enum class SyncStage {
+    //! Checking and connecting blocks.
+    Validation,
+    //! Writing blocks and the chainstate to disk.
+    Flush,
+};
+
+/** How quickly blocks are being synced, and which stage limits it. */
+struct CSyncStats
+{
+    //! The period the rates below are measured over, in seconds, or 0 until
+    //! the throughput has first been sampled.
+    double nWindowSeconds = 0;
+    double nDownloadBlocksPerSecond = 0;
+    double nDownloadBytesPerSecond = 0;
+    double nConnectBlocksPerSecond = 0;
+    //! The fractions of the period spent validating and flushing.
+    double nValidationBusy = 0;
+    double nFlushBusy = 0;
+    //! Blocks requested from peers and not received yet, and the number
+    //! that may be requested at once.
+    size_t nBlocksInFlight = 0;
+    size_t nBlocksInFlightLimit = 0;
+    //! Blocks received ahead of the tip that are waiting to be connected.
+    size_t nBlocksWaiting = 0;
+    //! The memory used by the coins cache, and the -dbcache share it may use.
+    size_t nCoinsCacheUsage = 0;
+    size_t nCoinsCacheLimit = 0;
+    //! "download", "validation" or "flush"; "none" once the initial block
+    //! download is complete, or "unknown" before the first sample.
+    std::string strBottleneck;
+};
+
+/** Count a block received from a peer, of the given size in bytes. */
+void RecordSyncBlockReceived(size_t nBytes);
+
+/** Count time spent in a stage of block sync. */
+void RecordSyncStage(SyncStage stage, int64_t nMicros);
+
+/** The block sync throughput over the last SYNC_STATS_WINDOW seconds. Takes cs_main. */
+CSyncStats GetSyncStats();
+
+/** Sample the block sync throughput and export it as metrics. */
+void UpdateSyncStats();
+
+#endif // ZCASH_SYNCSTATS_H
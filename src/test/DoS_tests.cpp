@@ -28,15 +28,16 @@
 #include <boost/test/data/test_case.hpp>
 
 // Tests this internal-to-main.cpp method:
-extern bool AddOrphanTx(const CTransaction& tx, NodeId peer);
+extern bool AddOrphanTx(const CTransactionRef& ptx, NodeId peer);
 extern void EraseOrphansFor(NodeId peer);
-extern unsigned int LimitOrphanTxSize(unsigned int nMaxOrphans);
+extern unsigned int LimitOrphanTxSize(unsigned int nMaxOrphans, size_t nMaxUsage, size_t nMaxPeerUsage);
 struct COrphanTx {
-    CTransaction tx;
+    CTransactionRef tx;
     NodeId fromPeer;
+    int64_t nTimeExpire;
+    size_t nUsage;
 };
 extern std::map<uint256, COrphanTx> mapOrphanTransactions;
-extern std::map<uint256, std::set<uint256> > mapOrphanTransactionsByPrev;
 
 CService ip(uint32_t i)
 {
@@ -123,7 +124,7 @@ CTransaction RandomOrphan()
     it = mapOrphanTransactions.lower_bound(InsecureRand256());
     if (it == mapOrphanTransactions.end())
         it = mapOrphanTransactions.begin();
-    return it->second.tx;
+    return *it->second.tx;
 }
 
 // Parameterized testing over consensus branch ids
@@ -147,7 +148,7 @@ BOOST_DATA_TEST_CASE(DoS_mapOrphans, boost::unit_test::data::xrange(static_cast<
         tx.vout[0].nValue = 1*CENT;
         tx.vout[0].scriptPubKey = GetScriptForDestination(key.GetPubKey().GetID());
 
-        AddOrphanTx(tx, i);
+        AddOrphanTx(MakeTransactionRef(tx), i);
     }
 
     // ... and 50 that depend on other orphans:
@@ -165,7 +166,7 @@ BOOST_DATA_TEST_CASE(DoS_mapOrphans, boost::unit_test::data::xrange(static_cast<
         const PrecomputedTransactionData txdata(tx, {txPrev.vout[0]});
         SignSignature(keystore, txPrev, tx, txdata, 0, SIGHASH_ALL, consensusBranchId);
 
-        AddOrphanTx(tx, i);
+        AddOrphanTx(MakeTransactionRef(tx), i);
     }
 
     // This really-big orphan should be ignored:
@@ -193,7 +194,7 @@ BOOST_DATA_TEST_CASE(DoS_mapOrphans, boost::unit_test::data::xrange(static_cast<
         for (unsigned int j = 1; j < tx.vin.size(); j++)
             tx.vin[j].scriptSig = tx.vin[0].scriptSig;
 
-        BOOST_CHECK(!AddOrphanTx(tx, i));
+        BOOST_CHECK(!AddOrphanTx(MakeTransactionRef(tx), i));
     }
 
     // Test EraseOrphansFor:
@@ -205,13 +206,75 @@ BOOST_DATA_TEST_CASE(DoS_mapOrphans, boost::unit_test::data::xrange(static_cast<
     }
 
     // Test LimitOrphanTxSize() function:
-    LimitOrphanTxSize(40);
+    const size_t nNoLimit = std::numeric_limits<size_t>::max();
+    LimitOrphanTxSize(40, nNoLimit, nNoLimit);
     BOOST_CHECK(mapOrphanTransactions.size() <= 40);
-    LimitOrphanTxSize(10);
+    LimitOrphanTxSize(10, nNoLimit, nNoLimit);
     BOOST_CHECK(mapOrphanTransactions.size() <= 10);
-    LimitOrphanTxSize(0);
+    LimitOrphanTxSize(0, nNoLimit, nNoLimit);
     BOOST_CHECK(mapOrphanTransactions.empty());
-    BOOST_CHECK(mapOrphanTransactionsByPrev.empty());
+    size_t nCount, nUsage;
+    GetOrphanTxStats(nCount, nUsage);
+    BOOST_CHECK_EQUAL(nCount, 0);
+    BOOST_CHECK_EQUAL(nUsage, 0);
+}
+
+BOOST_AUTO_TEST_CASE(DoS_mapOrphansMemory)
+{
+    CKey key = CKey::TestOnlyRandomKey(true);
+    auto makeOrphan = [&](size_t nOutputs) {
+        CMutableTransaction tx;
+        tx.vin.resize(1);
+        tx.vin[0].prevout.n = 0;
+        tx.vin[0].prevout.hash = InsecureRand256();
+        tx.vin[0].scriptSig << OP_1;
+        tx.vout.resize(nOutputs);
+        for (CTxOut& out : tx.vout) {
+            out.nValue = 1*CENT;
+            out.scriptPubKey = GetScriptForDestination(key.GetPubKey().GetID());
+        }
+        return CTransaction(tx);
+    };
+
+    // Peer 0 sends 20 orphans with many outputs, and peer 1 sends one small one.
+    for (int i = 0; i < 20; i++) {
+        BOOST_CHECK(AddOrphanTx(MakeTransactionRef(makeOrphan(50)), 0));
+    }
+    CTransaction txSmall = makeOrphan(1);
+    BOOST_CHECK(AddOrphanTx(MakeTransactionRef(txSmall), 1));
+
+    size_t nCount, nUsage;
+    GetOrphanTxStats(nCount, nUsage);
+    BOOST_CHECK_EQUAL(nCount, 21);
+    size_t nSmallUsage = mapOrphanTransactions.at(txSmall.GetHash()).nUsage;
+    size_t nLargeUsage = (nUsage - nSmallUsage) / 20;
+    BOOST_CHECK(nLargeUsage > nSmallUsage);
+
+    // The memory limit evicts the orphans of the peer using the most memory.
+    const size_t nNoLimit = std::numeric_limits<size_t>::max();
+    LimitOrphanTxSize(nNoLimit, nSmallUsage + 10 * nLargeUsage, nNoLimit);
+    GetOrphanTxStats(nCount, nUsage);
+    BOOST_CHECK_EQUAL(nCount, 11);
+    BOOST_CHECK(nUsage <= nSmallUsage + 10 * nLargeUsage);
+    BOOST_CHECK(mapOrphanTransactions.count(txSmall.GetHash()));
+
+    // So does the count limit.
+    LimitOrphanTxSize(6, nNoLimit, nNoLimit);
+    GetOrphanTxStats(nCount, nUsage);
+    BOOST_CHECK_EQUAL(nCount, 6);
+    BOOST_CHECK(mapOrphanTransactions.count(txSmall.GetHash()));
+
+    // The per-peer limit only evicts the orphans of peers over it.
+    LimitOrphanTxSize(nNoLimit, nNoLimit, 2 * nLargeUsage);
+    GetOrphanTxStats(nCount, nUsage);
+    BOOST_CHECK_EQUAL(nCount, 3);
+    BOOST_CHECK(mapOrphanTransactions.count(txSmall.GetHash()));
+
+    EraseOrphansFor(0);
+    EraseOrphansFor(1);
+    GetOrphanTxStats(nCount, nUsage);
+    BOOST_CHECK_EQUAL(nCount, 0);
+    BOOST_CHECK_EQUAL(nUsage, 0);
 }
 
 BOOST_AUTO_TEST_SUITE_END()
@@ -7,8 +7,10 @@
 #include <string>
 #include <boost/test/unit_test.hpp>
 
+#include "clientversion.h"
 #include "hash.h"
 #include "random.h"
+#include "streams.h"
 
 using namespace std;
 
@@ -521,4 +523,60 @@ BOOST_AUTO_TEST_CASE(caddrinfo_get_new_bucket)
     //  than 64 buckets.
     BOOST_CHECK(buckets.size() > 64);
 }
+
+BOOST_AUTO_TEST_CASE(addrman_select_sparse)
+{
+    CAddrManTest addrman;
+
+    // Set addrman addr placement to be deterministic.
+    addrman.MakeDeterministic();
+
+    // Test 35: Select finds the only entry of each table, however few of
+    //  the positions in them are taken.
+    CAddress addr1 = CAddress(CService("250.1.1.1", 8333));
+    addr1.nTime = GetTime();
+    CAddress addr2 = CAddress(CService("250.2.2.2", 8333));
+    addr2.nTime = GetTime();
+    addrman.Add(addr1, CNetAddr("252.2.2.2"));
+    addrman.Good(addr1);
+    addrman.Add(addr2, CNetAddr("252.2.2.2"));
+
+    std::set<std::string> selected;
+    for (int i = 0; i < 50; i++) {
+        CAddrInfo addr = addrman.Select();
+        BOOST_CHECK(addr.IsValid());
+        selected.insert(addr.ToString());
+    }
+    BOOST_CHECK_EQUAL(selected.size(), 2);
+    BOOST_CHECK_EQUAL(addrman.Select(true).ToString(), "250.2.2.2:8333");
+}
+
+BOOST_AUTO_TEST_CASE(addrman_dirty)
+{
+    CAddrManTest addrman;
+    addrman.MakeDeterministic();
+
+    // Test 36: A new addrman has to be written out.
+    BOOST_CHECK(addrman.IsDirty());
+
+    CAddress addr1 = CAddress(CService("250.1.1.1", 8333));
+    addr1.nTime = GetTime();
+    addrman.Add(addr1, CNetAddr("252.2.2.2"));
+
+    // Test 37: A loaded addrman is clean until it changes.
+    CDataStream ss(SER_DISK, CLIENT_VERSION);
+    ss << addrman;
+    CAddrMan addrman2;
+    ss >> addrman2;
+    BOOST_CHECK(!addrman2.IsDirty());
+    BOOST_CHECK_EQUAL(addrman2.size(), 1);
+    addrman2.Select();
+    BOOST_CHECK(!addrman2.IsDirty());
+    addrman2.Good(addr1);
+    BOOST_CHECK(addrman2.IsDirty());
+
+    addrman2.SetDirty(false);
+    addrman2.Attempt(addr1);
+    BOOST_CHECK(addrman2.IsDirty());
+}
 BOOST_AUTO_TEST_SUITE_END()
@@ -5,6 +5,8 @@
 
 #include "util/system.h"
 
+#include "memusage.h"
+#include "support/allocators/pool.h"
 #include "support/allocators/secure.h"
 #include "test/test_bitcoin.h"
 
@@ -226,4 +228,62 @@ BOOST_AUTO_TEST_CASE(lockedpool_tests_live)
     pool.free(nullptr);
 }
 
+BOOST_AUTO_TEST_CASE(pool_resource_tests)
+{
+    PoolResource<128, 8> resource(1024);
+    BOOST_CHECK_EQUAL(resource.NumAllocatedChunks(), 1u);
+    BOOST_CHECK_EQUAL(resource.ChunkSizeBytes(), 1024u);
+
+    // Deallocated blocks are handed out again for the same size class.
+    void* a = resource.Allocate(24, 8);
+    void* b = resource.Allocate(24, 8);
+    BOOST_CHECK(a != b);
+    resource.Deallocate(a, 24, 8);
+    BOOST_CHECK(resource.Allocate(20, 8) == a);
+    resource.Deallocate(b, 24, 8);
+
+    // Blocks larger than the pool's maximum bypass it.
+    void* big = resource.Allocate(4096, 8);
+    BOOST_CHECK_EQUAL(resource.NumAllocatedChunks(), 1u);
+    resource.Deallocate(big, 4096, 8);
+
+    // Exhausting a chunk allocates the next one.
+    for (int i = 0; i < 64; i++) {
+        resource.Allocate(128, 8);
+    }
+    BOOST_CHECK(resource.NumAllocatedChunks() > 1);
+    BOOST_CHECK_EQUAL(memusage::DynamicUsage(resource),
+        (memusage::MallocUsage(sizeof(void*) * 3) + memusage::MallocUsage(1024)) * resource.NumAllocatedChunks());
+}
+
+BOOST_AUTO_TEST_CASE(pool_map_tests)
+{
+    typedef std::unordered_map<int, uint64_t, std::hash<int>, std::equal_to<int>,
+        PoolAllocator<std::pair<const int, uint64_t>, 64, alignof(void*)>> PoolMap;
+    PoolMap::allocator_type::ResourceType resource;
+
+    // Two maps can share one pool.
+    PoolMap a{0, std::hash<int>(), std::equal_to<int>(), &resource};
+    PoolMap b{0, std::hash<int>(), std::equal_to<int>(), &resource};
+    for (int i = 0; i < 10000; i++) {
+        a[i] = i;
+        b[-i] = i;
+    }
+    for (int i = 0; i < 10000; i += 2) {
+        a.erase(i);
+    }
+    BOOST_CHECK_EQUAL(a.size(), 5000u);
+    BOOST_CHECK_EQUAL(b.size(), 10000u);
+    BOOST_CHECK_EQUAL(a.at(9999), 9999u);
+    BOOST_CHECK_EQUAL(b.at(-9999), 9999u);
+
+    // Erased nodes are reused rather than growing the pool.
+    size_t chunks = resource.NumAllocatedChunks();
+    for (int i = 0; i < 10000; i += 2) {
+        a[i] = i;
+    }
+    BOOST_CHECK_EQUAL(resource.NumAllocatedChunks(), chunks);
+    BOOST_CHECK_EQUAL(memusage::DynamicUsage(a), memusage::MallocUsage(sizeof(void*) * a.bucket_count()));
+}
+
 BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,101 @@
+// Copyright (c) 2026 The Zcash developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or https://www.opensource.org/licenses/mit-license.php .
+
+#include "banindex.h"
+#include "test/test_bitcoin.h"
+#include "tinyformat.h"
+
+#include <boost/test/unit_test.hpp>
+
+namespace {
+
+// An IPv4 address within a few small networks, so that random subnets and
+// addresses overlap often.
+CNetAddr RandomIPv4()
+{
+    return CNetAddr(strprintf("10.%d.%d.%d", InsecureRandRange(3), InsecureRandRange(4), InsecureRandRange(256)));
+}
+
+CNetAddr RandomIPv6()
+{
+    return CNetAddr(strprintf("2001:db8:%x::%x", InsecureRandRange(3), InsecureRandRange(256)));
+}
+
+bool WalkIsBanned(const banmap_t& banmap, const CNetAddr& addr, int64_t nNow)
+{
+    for (const auto& entry : banmap) {
+        if (entry.first.Match(addr) && nNow < entry.second.nBanUntil)
+            return true;
+    }
+    return false;
+}
+
+} // namespace
+
+BOOST_FIXTURE_TEST_SUITE(banindex_tests, BasicTestingSetup)
+
+BOOST_AUTO_TEST_CASE(prefix_length)
+{
+    BOOST_CHECK_EQUAL(CSubNet("1.2.3.4").GetPrefixLength(), 128);
+    BOOST_CHECK_EQUAL(CSubNet("1.2.3.0/24").GetPrefixLength(), 120);
+    BOOST_CHECK_EQUAL(CSubNet("1.2.3.0/255.255.255.0").GetPrefixLength(), 120);
+    BOOST_CHECK_EQUAL(CSubNet("1.2.3.4/255.0.255.0").GetPrefixLength(), -1);
+    BOOST_CHECK_EQUAL(CSubNet("2001:db8::/32").GetPrefixLength(), 32);
+
+    CSubNet subNet(CNetAddr("1.2.3.4"), 120);
+    BOOST_CHECK(subNet == CSubNet("1.2.3.0/24"));
+    BOOST_CHECK(subNet.GetBaseAddress() == CNetAddr("1.2.3.0"));
+    BOOST_CHECK(!CSubNet(CNetAddr("1.2.3.4"), 129).IsValid());
+}
+
+BOOST_AUTO_TEST_CASE(matches_walk)
+{
+    const int64_t nNow = 1000;
+    banmap_t banmap;
+    CBanIndex index;
+
+    for (int n = 0; n < 200; n++) {
+        CSubNet subNet;
+        switch (InsecureRandRange(4)) {
+        case 0:
+            subNet = CSubNet(RandomIPv4());
+            break;
+        case 1:
+            subNet = CSubNet(RandomIPv4(), 96 + 16 + InsecureRandRange(17));
+            break;
+        case 2:
+            subNet = CSubNet(strprintf("10.%d.0.%d/255.255.0.%d", InsecureRandRange(3), InsecureRandRange(256), InsecureRandRange(256)));
+            break;
+        default:
+            subNet = CSubNet(RandomIPv6(), 32 + InsecureRandRange(97));
+            break;
+        }
+        CBanEntry banEntry;
+        banEntry.nBanUntil = nNow - 100 + InsecureRandRange(200);
+        banmap[subNet] = banEntry;
+        index.Set(subNet, banEntry.nBanUntil);
+
+        // Unban one now and then.
+        if (InsecureRandBool() && !banmap.empty()) {
+            auto it = banmap.begin();
+            std::advance(it, InsecureRandRange(banmap.size()));
+            index.Remove(it->first);
+            banmap.erase(it);
+        }
+    }
+
+    CBanIndex rebuilt;
+    rebuilt.Rebuild(banmap);
+    for (int n = 0; n < 2000; n++) {
+        CNetAddr addr = InsecureRandBool() ? RandomIPv4() : RandomIPv6();
+        bool fBanned = WalkIsBanned(banmap, addr, nNow);
+        BOOST_CHECK_EQUAL(index.IsBanned(addr, nNow), fBanned);
+        BOOST_CHECK_EQUAL(rebuilt.IsBanned(addr, nNow), fBanned);
+    }
+
+    index.Clear();
+    BOOST_CHECK(!index.IsBanned(CNetAddr("10.0.0.1"), nNow));
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,134 @@
+// Copyright (c) 2026 The Zcash developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or https://www.opensource.org/licenses/mit-license.php .
+
+#include "blockcompression.h"
+#include "blockreader.h"
+#include "chainparams.h"
+#include "clientversion.h"
+#include "crypto/common.h"
+#include "main.h"
+#include "random.h"
+#include "script/script.h"
+#include "streams.h"
+
+#include "test/test_bitcoin.h"
+
+#include <boost/test/unit_test.hpp>
+
+namespace {
+
+// A block whose transactions repeat each other, as many do.
+CBlock CompressibleBlock(uint32_t nTime)
+{
+    CBlock block;
+    block.nVersion = 4;
+    block.nTime = nTime;
+    for (int i = 0; i < 20; i++) {
+        CMutableTransaction mtx;
+        mtx.vin.resize(1);
+        mtx.vin[0].prevout = COutPoint(uint256S("01"), i);
+        mtx.vout.emplace_back(1000, CScript() << OP_DUP << OP_HASH160 << std::vector<unsigned char>(20, 7) << OP_EQUALVERIFY << OP_CHECKSIG);
+        block.vtx.push_back(CTransaction(mtx));
+    }
+    return block;
+}
+
+std::vector<uint8_t> Serialize(const CBlock& block)
+{
+    CDataStream ss(SER_DISK, CLIENT_VERSION);
+    ss << block;
+    return std::vector<uint8_t>(ss.begin(), ss.end());
+}
+
+}
+
+BOOST_FIXTURE_TEST_SUITE(blockcompression_tests, TestingSetup)
+
+BOOST_AUTO_TEST_CASE(block_compression_roundtrip)
+{
+    CBlock block = CompressibleBlock(1);
+    std::vector<uint8_t> vBlock = Serialize(block);
+
+    CStoredBlock stored(block, true);
+    BOOST_CHECK(stored.IsCompressed());
+    BOOST_CHECK_EQUAL(stored.nSizeField & ~BLOCK_COMPRESSED_FLAG, stored.vData.size());
+    BOOST_CHECK(stored.vData.size() < vBlock.size());
+    std::vector<uint8_t> vOut;
+    BOOST_CHECK(DecompressBlockData(stored.vData.data(), stored.vData.size(), vOut));
+    BOOST_CHECK(vOut == vBlock);
+
+    CStoredBlock raw(block, false);
+    BOOST_CHECK(!raw.IsCompressed());
+    BOOST_CHECK(raw.vData == vBlock);
+
+    // Data that does not compress is stored as it is.
+    std::vector<uint8_t> vRandom(1000);
+    GetRandBytes(vRandom.data(), vRandom.size());
+    BOOST_CHECK(!CompressBlockData(vRandom.data(), vRandom.size(), vOut));
+
+    // Corrupt or truncated data, or a wrong size, is rejected.
+    std::vector<uint8_t> vCorrupt = stored.vData;
+    vCorrupt.resize(vCorrupt.size() / 2);
+    BOOST_CHECK(!DecompressBlockData(vCorrupt.data(), vCorrupt.size(), vOut));
+    vCorrupt = stored.vData;
+    WriteLE32(vCorrupt.data(), vBlock.size() - 1);
+    BOOST_CHECK(!DecompressBlockData(vCorrupt.data(), vCorrupt.size(), vOut));
+    WriteLE32(vCorrupt.data(), MAX_BLOCK_SIZE + 1);
+    BOOST_CHECK(!DecompressBlockData(vCorrupt.data(), vCorrupt.size(), vOut));
+}
+
+BOOST_AUTO_TEST_CASE(block_compression_read_write)
+{
+    const CChainParams& chainparams = Params();
+    CBlock block = CompressibleBlock(2);
+
+    // Blocks written compressed are read back as they were serialized.
+    fBlockCompression = true;
+    CDiskBlockPos pos(9998, 0);
+    BOOST_REQUIRE(WriteBlockToDisk(block, pos, chainparams.MessageStart()));
+    fBlockCompression = DEFAULT_BLOCK_COMPRESSION;
+
+    std::vector<uint8_t> vRaw;
+    BOOST_REQUIRE(ReadRawBlockFromDisk(vRaw, pos, chainparams.MessageStart()));
+    BOOST_CHECK(vRaw == Serialize(block));
+    BOOST_CHECK(fs::file_size(GetBlockPosFilename(pos, "blk")) < vRaw.size());
+
+    blockReader.ForgetFile(pos.nFile);
+    fs::remove(GetBlockPosFilename(pos, "blk"));
+}
+
+BOOST_AUTO_TEST_CASE(block_compression_file)
+{
+    const CChainParams& chainparams = Params();
+    CBlock block1 = CompressibleBlock(3);
+    CBlock block2 = CompressibleBlock(4);
+    CDiskBlockPos pos1(9997, 0);
+    BOOST_REQUIRE(WriteBlockToDisk(block1, pos1, chainparams.MessageStart()));
+    CDiskBlockPos pos2(9997, pos1.nPos + Serialize(block1).size());
+    BOOST_REQUIRE(WriteBlockToDisk(block2, pos2, chainparams.MessageStart()));
+
+    fs::path path = GetBlockPosFilename(pos1, "blk");
+    fs::path pathNew = path.string() + ".new";
+    uintmax_t nFileSize = fs::file_size(path);
+    BOOST_CHECK_EQUAL(CompressBlockFile(path, pathNew, chainparams.MessageStart()), 2);
+    BOOST_REQUIRE(RenameOver(pathNew, path));
+    blockReader.ForgetFile(pos1.nFile);
+
+    // The blocks are where they were, and the file is as long as it was.
+    BOOST_CHECK_EQUAL(fs::file_size(path), nFileSize);
+    std::vector<uint8_t> vRaw;
+    BOOST_REQUIRE(ReadRawBlockFromDisk(vRaw, pos1, chainparams.MessageStart()));
+    BOOST_CHECK(vRaw == Serialize(block1));
+    BOOST_REQUIRE(ReadRawBlockFromDisk(vRaw, pos2, chainparams.MessageStart()));
+    BOOST_CHECK(vRaw == Serialize(block2));
+
+    // There is nothing left to compress.
+    BOOST_CHECK_EQUAL(CompressBlockFile(path, pathNew, chainparams.MessageStart()), 0);
+
+    blockReader.ForgetFile(pos1.nFile);
+    fs::remove(pathNew);
+    fs::remove(path);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
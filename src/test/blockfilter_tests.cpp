@@ -0,0 +1,177 @@
+// Copyright (c) 2026 The Zcash developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or https://www.opensource.org/licenses/mit-license.php .
+
+#include "blockfilter.h"
+#include "hash.h"
+#include "primitives/block.h"
+#include "script/script.h"
+#include "streams.h"
+#include "undo.h"
+#include "version.h"
+
+#include "test/test_bitcoin.h"
+
+#include <boost/test/unit_test.hpp>
+
+namespace {
+
+GCSFilter::Element RandomElement()
+{
+    uint256 hash = InsecureRand256();
+    return GCSFilter::Element(hash.begin(), hash.end());
+}
+
+GCSFilter::Element ScriptElement(const CScript& script)
+{
+    return GCSFilter::Element(script.begin(), script.end());
+}
+
+}
+
+BOOST_FIXTURE_TEST_SUITE(blockfilter_tests, BasicTestingSetup)
+
+BOOST_AUTO_TEST_CASE(gcsfilter_match)
+{
+    uint256 hashBlock = InsecureRand256();
+    GCSFilter::ElementSet included, excluded;
+    for (int i = 0; i < 100; i++) {
+        included.insert(RandomElement());
+        excluded.insert(RandomElement());
+    }
+
+    GCSFilter filter(hashBlock, included);
+    BOOST_CHECK_EQUAL(filter.GetN(), 100U);
+    for (const GCSFilter::Element& element : included) {
+        BOOST_CHECK(filter.Match(element));
+    }
+    // With a false positive rate of 1/M, none of these should match.
+    BOOST_CHECK(!filter.MatchAny(excluded));
+    GCSFilter::ElementSet query = excluded;
+    query.insert(*included.begin());
+    BOOST_CHECK(filter.MatchAny(query));
+
+    // A filter decoded from its encoding matches the same elements.
+    GCSFilter decoded(hashBlock, filter.GetEncoded());
+    BOOST_CHECK_EQUAL(decoded.GetN(), 100U);
+    BOOST_CHECK(decoded.MatchAny(included));
+    BOOST_CHECK(!decoded.MatchAny(excluded));
+
+    // The elements are hashed under a key taken from the block hash.
+    GCSFilter other(InsecureRand256(), included);
+    BOOST_CHECK(other.GetEncoded() != filter.GetEncoded());
+}
+
+BOOST_AUTO_TEST_CASE(gcsfilter_empty)
+{
+    GCSFilter filter(InsecureRand256(), GCSFilter::ElementSet());
+    BOOST_CHECK_EQUAL(filter.GetN(), 0U);
+    BOOST_CHECK(filter.GetEncoded() == std::vector<unsigned char>(1, 0));
+    BOOST_CHECK(!filter.Match(RandomElement()));
+}
+
+BOOST_AUTO_TEST_CASE(blockfilter_basic)
+{
+    CScript included1 = CScript() << OP_1 << OP_EQUAL;
+    CScript included2 = CScript() << OP_DUP << OP_HASH160 << std::vector<unsigned char>(20, 1) << OP_EQUALVERIFY << OP_CHECKSIG;
+    CScript spent = CScript() << OP_2 << OP_EQUAL;
+    CScript opreturn = CScript() << OP_RETURN << std::vector<unsigned char>(4, 2);
+    CScript unrelated = CScript() << OP_3 << OP_EQUAL;
+
+    CMutableTransaction coinbase;
+    coinbase.vin.resize(1);
+    coinbase.vout.emplace_back(1, included1);
+    CMutableTransaction mtx;
+    mtx.vin.resize(1);
+    mtx.vin[0].prevout = COutPoint(InsecureRand256(), 0);
+    mtx.vout.emplace_back(2, included2);
+    mtx.vout.emplace_back(0, opreturn);
+    mtx.vout.emplace_back(3, CScript());
+
+    CBlock block;
+    block.vtx.push_back(CTransaction(coinbase));
+    block.vtx.push_back(CTransaction(mtx));
+
+    CBlockUndo blockundo;
+    blockundo.vtxundo.emplace_back();
+    blockundo.vtxundo.back().vprevout.emplace_back(CTxOut(4, spent));
+
+    BlockFilter filter(BlockFilterType::BASIC, block, blockundo);
+    BOOST_CHECK(filter.GetBlockHash() == block.GetHash());
+    const GCSFilter& gcs = filter.GetFilter();
+    BOOST_CHECK_EQUAL(gcs.GetN(), 3U);
+    BOOST_CHECK(gcs.Match(ScriptElement(included1)));
+    BOOST_CHECK(gcs.Match(ScriptElement(included2)));
+    BOOST_CHECK(gcs.Match(ScriptElement(spent)));
+    BOOST_CHECK(!gcs.Match(ScriptElement(opreturn)));
+    BOOST_CHECK(!gcs.Match(ScriptElement(unrelated)));
+
+    // Without shielded spends, the shielded filter is empty.
+    BlockFilter shielded(BlockFilterType::SHIELDED, block, blockundo);
+    BOOST_CHECK_EQUAL(shielded.GetFilter().GetN(), 0U);
+}
+
+BOOST_AUTO_TEST_CASE(blockfilter_shielded)
+{
+    uint256 nf1 = InsecureRand256();
+    uint256 nf2 = InsecureRand256();
+    CMutableTransaction mtx;
+    mtx.nVersion = 2;
+    JSDescription jsdesc;
+    jsdesc.nullifiers[0] = nf1;
+    jsdesc.nullifiers[1] = nf2;
+    mtx.vJoinSplit.push_back(jsdesc);
+
+    CBlock block;
+    block.vtx.push_back(CTransaction(mtx));
+
+    BlockFilter filter(BlockFilterType::SHIELDED, block, CBlockUndo());
+    const GCSFilter& gcs = filter.GetFilter();
+    BOOST_CHECK_EQUAL(gcs.GetN(), 2U);
+    BOOST_CHECK(gcs.Match(GCSFilter::Element(nf1.begin(), nf1.end())));
+    BOOST_CHECK(gcs.Match(GCSFilter::Element(nf2.begin(), nf2.end())));
+    BOOST_CHECK(!gcs.Match(RandomElement()));
+}
+
+BOOST_AUTO_TEST_CASE(blockfilter_header_and_serialization)
+{
+    CMutableTransaction coinbase;
+    coinbase.vin.resize(1);
+    coinbase.vout.emplace_back(1, CScript() << OP_1);
+    CBlock block;
+    block.vtx.push_back(CTransaction(coinbase));
+    BlockFilter filter(BlockFilterType::BASIC, block, CBlockUndo());
+
+    uint256 prevHeader = InsecureRand256();
+    uint256 hashFilter = filter.GetHash();
+    BOOST_CHECK(filter.ComputeHeader(prevHeader) ==
+        Hash(hashFilter.begin(), hashFilter.end(), prevHeader.begin(), prevHeader.end()));
+    BOOST_CHECK(filter.ComputeHeader(prevHeader) != filter.ComputeHeader(uint256()));
+
+    CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
+    ss << filter;
+    BlockFilter filter2;
+    ss >> filter2;
+    BOOST_CHECK(filter2.GetType() == BlockFilterType::BASIC);
+    BOOST_CHECK(filter2.GetBlockHash() == filter.GetBlockHash());
+    BOOST_CHECK(filter2.GetEncodedFilter() == filter.GetEncodedFilter());
+    BOOST_CHECK(filter2.GetFilter().Match(ScriptElement(CScript() << OP_1)));
+
+    // Filters of unknown types are rejected.
+    CDataStream ss2(SER_NETWORK, PROTOCOL_VERSION);
+    ss2 << uint8_t(7) << filter.GetBlockHash() << filter.GetEncodedFilter();
+    BOOST_CHECK_THROW(ss2 >> filter2, std::ios_base::failure);
+}
+
+BOOST_AUTO_TEST_CASE(blockfilter_type_names)
+{
+    BlockFilterType filterType;
+    BOOST_CHECK(BlockFilterTypeByName("basic", filterType));
+    BOOST_CHECK(filterType == BlockFilterType::BASIC);
+    BOOST_CHECK(BlockFilterTypeByName("shielded", filterType));
+    BOOST_CHECK(filterType == BlockFilterType::SHIELDED);
+    BOOST_CHECK(!BlockFilterTypeByName("extended", filterType));
+    BOOST_CHECK_EQUAL(AllBlockFilterTypes().size(), 2U);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,172 @@
+// Copyright (c) 2026 The Zcash developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or https://www.opensource.org/licenses/mit-license.php .
+
+#include "blockindexsnapshot.h"
+#include "chain.h"
+#include "main.h"
+#include "random.h"
+#include "util/system.h"
+
+#include "test/test_bitcoin.h"
+
+#include <boost/test/unit_test.hpp>
+
+namespace {
+
+// A chain long enough to span several chunks of records, with a short fork.
+void BuildBlockIndex(BlockMap& mapIndex)
+{
+    FastRandomContext rng(true);
+    CBlockIndex* pindexPrev = nullptr;
+    CBlockIndex* pindexFork = nullptr;
+    for (int nHeight = 0; nHeight < 20000 + 10; nHeight++) {
+        CBlockIndex* pindex = new CBlockIndex();
+        bool fFork = nHeight >= 20000;
+        pindex->pprev = fFork ? (pindexFork ? pindexFork : pindexPrev->GetAncestor(19990)) : pindexPrev;
+        pindex->nHeight = fFork ? pindex->pprev->nHeight + 1 : nHeight;
+        pindex->nFile = nHeight / 1000;
+        pindex->nDataPos = rng.rand32();
+        pindex->nUndoPos = rng.rand32();
+        pindex->nStatus = BLOCK_VALID_SCRIPTS | BLOCK_HAVE_DATA;
+        pindex->nTx = 1 + rng.randrange(100);
+        pindex->nChainTx = (pindex->pprev ? pindex->pprev->nChainTx : 0) + pindex->nTx;
+        pindex->nChainWork = (pindex->pprev ? pindex->pprev->nChainWork : arith_uint256()) + rng.randrange(1000);
+        if (nHeight % 3) {
+            pindex->nCachedBranchId = rng.rand32();
+        }
+        pindex->nTime = rng.rand32();
+        pindex->nBits = rng.rand32();
+        pindex->nNonce = GetRandHash();
+        pindex->hashMerkleRoot = GetRandHash();
+        pindex->hashSproutAnchor = GetRandHash();
+        pindex->hashChainHistoryRoot = GetRandHash();
+        if (nHeight % 2) {
+            pindex->nSproutValue = rng.randrange(1000);
+            pindex->nChainSproutValue = -(CAmount)rng.randrange(1000);
+        }
+        pindex->nSaplingValue = rng.randrange(1000);
+        pindex->nChainSaplingValue = rng.randrange(1000);
+        pindex->nLockboxValue = rng.randrange(1000);
+
+        uint256 hash = GetRandHash();
+        auto it = mapIndex.emplace(hash, pindex).first;
+        pindex->phashBlock = &it->first;
+        pindex->BuildSkip();
+        if (fFork) {
+            pindexFork = pindex;
+        } else {
+            pindexPrev = pindex;
+        }
+    }
+}
+
+void FreeBlockIndex(BlockMap& mapIndex)
+{
+    for (const auto& entry : mapIndex) {
+        delete entry.second;
+    }
+    mapIndex.clear();
+}
+
+void CheckEqual(const CBlockIndex* a, const CBlockIndex* b)
+{
+    BOOST_CHECK(a->GetBlockHash() == b->GetBlockHash());
+    BOOST_CHECK((a->pprev ? a->pprev->GetBlockHash() : uint256()) == (b->pprev ? b->pprev->GetBlockHash() : uint256()));
+    BOOST_CHECK((a->pskip ? a->pskip->GetBlockHash() : uint256()) == (b->pskip ? b->pskip->GetBlockHash() : uint256()));
+    BOOST_CHECK_EQUAL(a->nHeight, b->nHeight);
+    BOOST_CHECK_EQUAL(a->nFile, b->nFile);
+    BOOST_CHECK_EQUAL(a->nDataPos, b->nDataPos);
+    BOOST_CHECK_EQUAL(a->nUndoPos, b->nUndoPos);
+    BOOST_CHECK_EQUAL(a->nStatus, b->nStatus);
+    BOOST_CHECK_EQUAL(a->nTx, b->nTx);
+    BOOST_CHECK_EQUAL(a->nChainTx, b->nChainTx);
+    BOOST_CHECK(a->nChainWork == b->nChainWork);
+    BOOST_CHECK(a->nCachedBranchId == b->nCachedBranchId);
+    BOOST_CHECK_EQUAL(a->nTime, b->nTime);
+    BOOST_CHECK_EQUAL(a->nBits, b->nBits);
+    BOOST_CHECK(a->nNonce == b->nNonce);
+    BOOST_CHECK(a->hashMerkleRoot == b->hashMerkleRoot);
+    BOOST_CHECK(a->hashSproutAnchor == b->hashSproutAnchor);
+    BOOST_CHECK(a->hashChainHistoryRoot == b->hashChainHistoryRoot);
+    BOOST_CHECK(a->nSproutValue == b->nSproutValue);
+    BOOST_CHECK(a->nChainSproutValue == b->nChainSproutValue);
+    BOOST_CHECK_EQUAL(a->nSaplingValue, b->nSaplingValue);
+    BOOST_CHECK(a->nChainSaplingValue == b->nChainSaplingValue);
+    BOOST_CHECK_EQUAL(a->nLockboxValue, b->nLockboxValue);
+    BOOST_CHECK(a->nChainLockboxValue == b->nChainLockboxValue);
+}
+
+}
+
+BOOST_FIXTURE_TEST_SUITE(blockindexsnapshot_tests, BasicTestingSetup)
+
+BOOST_AUTO_TEST_CASE(block_index_snapshot_roundtrip)
+{
+    fs::path path = GetDataDir() / "blockindex_test.dat";
+    BlockMap mapIndex;
+    BuildBlockIndex(mapIndex);
+    uint256 hashBest = GetRandHash();
+    uint256 hashSnapshot;
+    BOOST_CHECK(WriteBlockIndexSnapshot(path, mapIndex, hashBest, hashSnapshot));
+
+    for (int nThreads : {1, 3}) {
+        BlockMap mapLoaded;
+        std::vector<CBlockIndex*> vSorted;
+        BOOST_CHECK(ReadBlockIndexSnapshot(path, hashSnapshot, hashBest, nThreads, mapLoaded, vSorted));
+        BOOST_CHECK_EQUAL(mapLoaded.size(), mapIndex.size());
+        BOOST_CHECK_EQUAL(vSorted.size(), mapIndex.size());
+        for (size_t i = 1; i < vSorted.size(); i++) {
+            BOOST_CHECK(vSorted[i - 1]->nHeight <= vSorted[i]->nHeight);
+        }
+        for (const auto& entry : mapIndex) {
+            auto it = mapLoaded.find(entry.first);
+            BOOST_REQUIRE(it != mapLoaded.end());
+            BOOST_CHECK_EQUAL(it->second->phashBlock, &it->first);
+            CheckEqual(entry.second, it->second);
+        }
+        // The skip pointers lead to the same ancestors as before.
+        CBlockIndex* pindexTip = vSorted.back();
+        BOOST_CHECK(pindexTip->GetAncestor(1234)->GetBlockHash() == mapIndex[pindexTip->GetBlockHash()]->GetAncestor(1234)->GetBlockHash());
+        FreeBlockIndex(mapLoaded);
+    }
+
+    FreeBlockIndex(mapIndex);
+    fs::remove(path);
+}
+
+BOOST_AUTO_TEST_CASE(block_index_snapshot_rejected)
+{
+    fs::path path = GetDataDir() / "blockindex_test.dat";
+    BlockMap mapIndex;
+    BuildBlockIndex(mapIndex);
+    uint256 hashBest = GetRandHash();
+    uint256 hashSnapshot;
+    BOOST_CHECK(WriteBlockIndexSnapshot(path, mapIndex, hashBest, hashSnapshot));
+    FreeBlockIndex(mapIndex);
+
+    BlockMap mapLoaded;
+    std::vector<CBlockIndex*> vSorted;
+    // A snapshot for another database or another best block is not loaded.
+    BOOST_CHECK(!ReadBlockIndexSnapshot(path, GetRandHash(), hashBest, 2, mapLoaded, vSorted));
+    BOOST_CHECK(!ReadBlockIndexSnapshot(path, hashSnapshot, GetRandHash(), 2, mapLoaded, vSorted));
+    BOOST_CHECK(mapLoaded.empty());
+
+    // Neither is a corrupt one.
+    {
+        FILE* file = fsbridge::fopen(path, "rb+");
+        BOOST_REQUIRE(file);
+        BOOST_CHECK_EQUAL(fseek(file, -100, SEEK_END), 0);
+        int c = fgetc(file);
+        BOOST_CHECK_EQUAL(fseek(file, -100, SEEK_END), 0);
+        fputc(c ^ 1, file);
+        fclose(file);
+    }
+    BOOST_CHECK(!ReadBlockIndexSnapshot(path, hashSnapshot, hashBest, 2, mapLoaded, vSorted));
+    BOOST_CHECK(mapLoaded.empty());
+
+    fs::remove(path);
+    BOOST_CHECK(!ReadBlockIndexSnapshot(path, hashSnapshot, hashBest, 2, mapLoaded, vSorted));
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -6,10 +6,13 @@
 #include "bloom.h"
 
 #include "clientversion.h"
+#include "filteredblockcache.h"
+#include "hash.h"
 #include "key.h"
 #include "key_io.h"
 #include "merkleblock.h"
 #include "random.h"
+#include "script/script.h"
 #include "serialize.h"
 #include "streams.h"
 #include "uint256.h"
@@ -26,6 +29,33 @@ using namespace std;
 
 BOOST_FIXTURE_TEST_SUITE(bloom_tests, BasicTestingSetup)
 
+// Filtering a prepared block, directly or through the cache, must give the
+// same merkle block and leave the filter in the same state as filtering the
+// block itself.
+static void CheckFilterableBlock(const CBlock& block, const CBloomFilter& filterIn)
+{
+    CBloomFilter filter(filterIn);
+    CMerkleBlock expected(block, filter);
+
+    CFilterableBlock filterableBlock(block);
+    CBloomFilter filter2(filterIn);
+    CMerkleBlock merkleBlock(filterableBlock, filter2);
+    BOOST_CHECK(SerializeHash(merkleBlock) == SerializeHash(expected));
+    BOOST_CHECK(merkleBlock.vMatchedTxn == expected.vMatchedTxn);
+    BOOST_CHECK(SerializeHash(filter2) == SerializeHash(filter));
+
+    CFilteredBlockCache cache;
+    for (int i = 0; i < 2; i++) {
+        CBloomFilter filter3(filterIn);
+        merkleBlock = cache.Filter(filterableBlock, filter3);
+        BOOST_CHECK(SerializeHash(merkleBlock) == SerializeHash(expected));
+        BOOST_CHECK(merkleBlock.vMatchedTxn == expected.vMatchedTxn);
+        BOOST_CHECK(SerializeHash(filter3) == SerializeHash(filter));
+    }
+    BOOST_CHECK_EQUAL(cache.GetResultStats().nInsertions, 1U);
+    BOOST_CHECK_EQUAL(cache.GetResultStats().nHits, 1U);
+}
+
 BOOST_AUTO_TEST_CASE(bloom_create_insert_serialize)
 {
     CBloomFilter filter(3, 0.01, 0, BLOOM_UPDATE_ALL);
@@ -192,6 +222,7 @@ BOOST_AUTO_TEST_CASE(merkle_block_1)
     // Match the last transaction
     filter.insert(uint256S("0x74d681e0e03bafa802c8aa084379aa98d9fcd632ddc2ed9782b586ec87451f20"));
 
+    CheckFilterableBlock(block, filter);
     CMerkleBlock merkleBlock(block, filter);
     BOOST_CHECK(merkleBlock.header.GetHash() == block.GetHash());
 
@@ -237,6 +268,7 @@ BOOST_AUTO_TEST_CASE(merkle_block_2)
     // Match the first transaction
     filter.insert(uint256S("0xe980fe9f792d014e73b95203dc1335c5f9ce19ac537a419e6df5b47aecb93b70"));
 
+    CheckFilterableBlock(block, filter);
     CMerkleBlock merkleBlock(block, filter);
     BOOST_CHECK(merkleBlock.header.GetHash() == block.GetHash());
 
@@ -291,6 +323,7 @@ BOOST_AUTO_TEST_CASE(merkle_block_2_with_update_none)
     // Match the first transaction
     filter.insert(uint256S("0xe980fe9f792d014e73b95203dc1335c5f9ce19ac537a419e6df5b47aecb93b70"));
 
+    CheckFilterableBlock(block, filter);
     CMerkleBlock merkleBlock(block, filter);
     BOOST_CHECK(merkleBlock.header.GetHash() == block.GetHash());
 
@@ -342,6 +375,7 @@ BOOST_AUTO_TEST_CASE(merkle_block_3_and_serialize)
     // Match the only transaction
     filter.insert(uint256S("0x63194f18be0af63f2c6bc9dc0f777cbefed3d9415c4af83f3ee3a3d669c00cb5"));
 
+    CheckFilterableBlock(block, filter);
     CMerkleBlock merkleBlock(block, filter);
     BOOST_CHECK(merkleBlock.header.GetHash() == block.GetHash());
 
@@ -380,6 +414,7 @@ BOOST_AUTO_TEST_CASE(merkle_block_4)
     // Match the last transaction
     filter.insert(uint256S("0x0a2a92f0bda4727d0a13eaddf4dd9ac6b5c61a1429e6b2b818f19b15df0ac154"));
 
+    CheckFilterableBlock(block, filter);
     CMerkleBlock merkleBlock(block, filter);
     BOOST_CHECK(merkleBlock.header.GetHash() == block.GetHash());
 
@@ -427,6 +462,7 @@ BOOST_AUTO_TEST_CASE(merkle_block_4_test_p2pubkey_only)
     // ...and the output address of the 4th transaction
     filter.insert(ParseHex("b6efd80d99179f4f4ff6f4dd0a007d018c385d21"));
 
+    CheckFilterableBlock(block, filter);
     CMerkleBlock merkleBlock(block, filter);
     BOOST_CHECK(merkleBlock.header.GetHash() == block.GetHash());
 
@@ -450,6 +486,7 @@ BOOST_AUTO_TEST_CASE(merkle_block_4_test_update_none)
     // ...and the output address of the 4th transaction
     filter.insert(ParseHex("b6efd80d99179f4f4ff6f4dd0a007d018c385d21"));
 
+    CheckFilterableBlock(block, filter);
     CMerkleBlock merkleBlock(block, filter);
     BOOST_CHECK(merkleBlock.header.GetHash() == block.GetHash());
 
@@ -564,4 +601,42 @@ BOOST_AUTO_TEST_CASE(rolling_bloom_reset)
     BOOST_CHECK(rb.contains(d));
 }
 
+BOOST_AUTO_TEST_CASE(expanding_bloom)
+{
+    CExpandingBloomFilter eb;
+    BOOST_CHECK(!eb.contains(RandomData()));
+
+    // The filter grows several times, and remembers every entry.
+    static const int DATASIZE=5000;
+    std::vector<unsigned char> data[DATASIZE];
+    for (int i = 0; i < DATASIZE; i++) {
+        data[i] = RandomData();
+        eb.insert(data[i]);
+        BOOST_CHECK(eb.contains(data[i]));
+    }
+    BOOST_CHECK_EQUAL(eb.size(), DATASIZE);
+    for (int i = 0; i < DATASIZE; i++) {
+        BOOST_CHECK(eb.contains(data[i]));
+    }
+
+    // The false positive rate is at most about 0.25%, so we should get
+    // fewer than 25 hits when testing 10,000 random keys.
+    unsigned int nHits = 0;
+    for (int i = 0; i < 10000; i++) {
+        if (eb.contains(RandomData()))
+            ++nHits;
+    }
+    BOOST_TEST_MESSAGE("ExpandingBloomFilter got " << nHits << " false positives (<25 expected)");
+    BOOST_CHECK(nHits < 75);
+
+    uint256 hash = GetRandHash();
+    eb.insert(hash);
+    BOOST_CHECK(eb.contains(hash));
+
+    CScript script = CScript() << OP_DUP << OP_HASH160 << ToByteVector(GetRandHash()) << OP_EQUALVERIFY << OP_CHECKSIG;
+    eb.insert(script);
+    BOOST_CHECK(eb.contains(script));
+    BOOST_CHECK(eb.contains(std::vector<unsigned char>(script.begin(), script.end())));
+}
+
 BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,121 @@
+// Copyright (c) 2026 The Zcash developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or https://www.opensource.org/licenses/mit-license.php .
+
+#include "chain.h"
+#include "chainstats.h"
+#include "test/test_bitcoin.h"
+
+#include <vector>
+
+#include <boost/test/unit_test.hpp>
+
+namespace {
+
+// Build a branch of nLength blocks on top of pindexFork (or a new chain if it
+// is null), with times that go backwards now and then as real ones do.
+void BuildBranch(std::vector<CBlockIndex>& vBlocks, std::vector<uint256>& vHashes, CBlockIndex* pindexFork, size_t nLength)
+{
+    vBlocks.resize(nLength);
+    vHashes.resize(nLength);
+    for (size_t i = 0; i < nLength; i++) {
+        CBlockIndex* pprev = i ? &vBlocks[i - 1] : pindexFork;
+        vHashes[i] = InsecureRand256();
+        vBlocks[i].phashBlock = &vHashes[i];
+        vBlocks[i].pprev = pprev;
+        vBlocks[i].nHeight = pprev ? pprev->nHeight + 1 : 0;
+        vBlocks[i].nTime = (pprev ? pprev->nTime : 1000000) + InsecureRandRange(300) - 100;
+        vBlocks[i].nChainWork = pprev ? pprev->nChainWork : arith_uint256();
+        vBlocks[i].nChainWork += 1 + InsecureRandRange(1000);
+        vBlocks[i].BuildSkip();
+    }
+}
+
+// The walk that GetNetworkHashPS does without the statistics.
+int64_t WalkNetworkHashPS(const CChain& chain, int nLookup, int nHeight)
+{
+    const CBlockIndex* pb = chain.Tip();
+    if (nHeight >= 0 && nHeight < chain.Height())
+        pb = chain[nHeight];
+    if (pb == NULL || !pb->nHeight)
+        return 0;
+    if (nLookup > pb->nHeight)
+        nLookup = pb->nHeight;
+    const CBlockIndex* pb0 = pb;
+    int64_t minTime = pb0->GetBlockTime();
+    int64_t maxTime = minTime;
+    for (int i = 0; i < nLookup; i++) {
+        pb0 = pb0->pprev;
+        minTime = std::min(pb0->GetBlockTime(), minTime);
+        maxTime = std::max(pb0->GetBlockTime(), maxTime);
+    }
+    if (minTime == maxTime)
+        return 0;
+    return (int64_t)((pb->nChainWork - pb0->nChainWork).getdouble() / (maxTime - minTime));
+}
+
+void CheckAgainstWalk(const CChainStats& stats, const CChain& chain)
+{
+    for (int n = 0; n < 500; n++) {
+        int nLookup = 1 + InsecureRandRange(std::min(chain.Height(), MAX_CHAIN_STATS_BLOCKS) + 10);
+        int nHeight = (int)InsecureRandRange(chain.Height() + 10) - 5;
+        auto result = stats.GetNetworkHashPS(nLookup, nHeight);
+        int nEnd = (nHeight >= 0 && nHeight < chain.Height()) ? nHeight : chain.Height();
+        if (nEnd - std::min(nLookup, nEnd) > chain.Height() - MAX_CHAIN_STATS_BLOCKS / 2) {
+            // Windows within the blocks that are kept even after the
+            // reorganizations below.
+            BOOST_REQUIRE(result.has_value());
+        }
+        if (result.has_value()) {
+            BOOST_CHECK_EQUAL(*result, WalkNetworkHashPS(chain, nLookup, nHeight));
+        }
+    }
+}
+
+} // namespace
+
+BOOST_FIXTURE_TEST_SUITE(chainstats_tests, BasicTestingSetup)
+
+BOOST_AUTO_TEST_CASE(chainstats_matches_walk)
+{
+    std::vector<CBlockIndex> vMain;
+    std::vector<uint256> vMainHashes;
+    BuildBranch(vMain, vMainHashes, nullptr, 3 * MAX_CHAIN_STATS_BLOCKS);
+
+    CChain chain;
+    CChainStats stats;
+    BOOST_CHECK(!stats.GetNetworkHashPS(1, -1).has_value());
+
+    // Connect the blocks a few at a time, past the point where the oldest are
+    // dropped.
+    size_t nConnected = 0;
+    while (nConnected < vMain.size()) {
+        nConnected = std::min(vMain.size(), nConnected + 1 + (size_t)InsecureRandRange(2000));
+        chain.SetTip(&vMain[nConnected - 1]);
+        stats.Update(chain);
+        CheckAgainstWalk(stats, chain);
+    }
+
+    // A window that starts before the blocks that are kept.
+    BOOST_CHECK(!stats.GetNetworkHashPS(2 * MAX_CHAIN_STATS_BLOCKS, -1).has_value());
+
+    // Reorganize to a branch that forks off 100 blocks below the tip.
+    std::vector<CBlockIndex> vFork;
+    std::vector<uint256> vForkHashes;
+    BuildBranch(vFork, vForkHashes, &vMain[vMain.size() - 101], 150);
+    chain.SetTip(&vFork.back());
+    stats.Update(chain);
+    CheckAgainstWalk(stats, chain);
+
+    // And back to a shorter part of the main chain.
+    chain.SetTip(&vMain[vMain.size() - 50]);
+    stats.Update(chain);
+    CheckAgainstWalk(stats, chain);
+
+    stats.Clear();
+    BOOST_CHECK(!stats.GetNetworkHashPS(1, -1).has_value());
+    stats.Update(chain);
+    CheckAgainstWalk(stats, chain);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
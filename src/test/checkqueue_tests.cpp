@@ -210,6 +210,30 @@ BOOST_AUTO_TEST_CASE(test_CheckQueue_Correct_Random)
     Correct_Queue_range(range);
 }
 
+/** Test that checks are all run when there are more workers than deques,
+ * so that some deques are shared.
+ */
+BOOST_AUTO_TEST_CASE(test_CheckQueue_Correct_Many_Workers)
+{
+    auto queue = std::unique_ptr<Correct_Queue>(new Correct_Queue {QUEUE_BATCH_SIZE});
+    boost::thread_group tg;
+    for (auto x = 0; x < 80; ++x) {
+       tg.create_thread([&]{queue->Thread();});
+    }
+    for (size_t i = 0; i < 100; ++i) {
+        size_t total = InsecureRandRange(10000);
+        FakeCheckCheckCompletion::n_calls = 0;
+        {
+            CCheckQueueControl<FakeCheckCheckCompletion> control(queue.get());
+            std::vector<FakeCheckCheckCompletion> vChecks(total);
+            control.Add(vChecks);
+            BOOST_REQUIRE(control.Wait());
+        }
+        BOOST_REQUIRE_EQUAL(FakeCheckCheckCompletion::n_calls, total);
+    }
+    tg.interrupt_all();
+    tg.join_all();
+}
 
 /** Test that failing checks are caught */
 BOOST_AUTO_TEST_CASE(test_CheckQueue_Catches_Failure)
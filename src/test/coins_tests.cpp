@@ -4,6 +4,7 @@
 // file COPYING or https://www.opensource.org/licenses/mit-license.php .
 
 #include "coins.h"
+#include "coinssnapshot.h"
 #include "script/standard.h"
 #include "uint256.h"
 #include "util/strencodings.h"
@@ -221,7 +222,8 @@ public:
                     CNullifiersMap& mapOrchardNullifiers,
                     CHistoryCacheMap &historyCacheMap,
                     SubtreeCache &cacheSaplingSubtrees,
-                    SubtreeCache &cacheOrchardSubtrees)
+                    SubtreeCache &cacheOrchardSubtrees,
+                    bool fErase)
     {
         for (CCoinsMap::iterator it = mapCoins.begin(); it != mapCoins.end(); ) {
             if (it->second.flags & CCoinsCacheEntry::DIRTY) {
@@ -232,7 +234,7 @@ public:
                     map_.erase(it->first);
                 }
             }
-            it = mapCoins.erase(it);
+            it = fErase ? mapCoins.erase(it) : std::next(it);
         }
 
         BatchWriteAnchors<SproutMerkleTree, CAnchorsSproutMap, CAnchorsSproutCacheEntry>(mapSproutAnchors, mapSproutAnchors_);
@@ -266,7 +268,8 @@ public:
     void SelfTest() const
     {
         // Manually recompute the dynamic usage of the whole data, and compare it.
-        size_t ret = memusage::DynamicUsage(cacheCoins) +
+        size_t ret = memusage::DynamicUsage(cacheMemoryResource) - cacheMemoryResource.AvailableBytes() +
+                     memusage::DynamicUsage(cacheCoins) +
                      memusage::DynamicUsage(cacheSproutAnchors) +
                      memusage::DynamicUsage(cacheSaplingAnchors) +
                      memusage::DynamicUsage(cacheOrchardAnchors) +
@@ -608,6 +611,131 @@ BOOST_AUTO_TEST_CASE(coins_coinbase_spends)
     }
 }
 
+BOOST_AUTO_TEST_CASE(coins_prefetch)
+{
+    CCoinsViewTest base;
+    uint256 txid = InsecureRand256();
+    uint256 missing = InsecureRand256();
+
+    {
+        CCoinsViewCacheTest writer(&base);
+        {
+            CCoinsModifier coins = writer.ModifyCoins(txid);
+            coins->nVersion = 1;
+            coins->nHeight = 100;
+            coins->vout.resize(1);
+            coins->vout[0].nValue = 500;
+            coins->vout[0].scriptPubKey = CScript() << OP_1;
+        }
+        writer.SetBestBlock(InsecureRand256());
+        BOOST_CHECK(writer.Flush());
+    }
+
+    CCoinsViewCacheTest cache(&base);
+    BOOST_CHECK(!cache.HaveCoinsInCache(txid));
+
+    // Reading from the base leaves the cache untouched.
+    CCoins coins;
+    BOOST_CHECK(cache.GetCoinsFromBase(txid, coins));
+    BOOST_CHECK(!cache.GetCoinsFromBase(missing, coins));
+    BOOST_CHECK(cache.GetCoinsFromBase(txid, coins));
+    BOOST_CHECK(!cache.HaveCoinsInCache(txid));
+    BOOST_CHECK_EQUAL(cache.GetCacheSize(), 0u);
+
+    cache.CacheFetchedCoins(txid, coins);
+    BOOST_CHECK(cache.HaveCoinsInCache(txid));
+    BOOST_CHECK(!cache.HaveCoinsInCache(missing));
+    cache.SelfTest();
+
+    const CCoins* cached = cache.AccessCoins(txid);
+    BOOST_CHECK(cached != NULL);
+    BOOST_CHECK_EQUAL(cached->nHeight, 100);
+    BOOST_CHECK_EQUAL(cached->vout[0].nValue, 500);
+
+    // An existing entry is not replaced.
+    CCoins other;
+    other.nVersion = 1;
+    other.vout.resize(2);
+    cache.CacheFetchedCoins(txid, other);
+    BOOST_CHECK_EQUAL(cache.AccessCoins(txid)->vout.size(), 1u);
+    cache.SelfTest();
+}
+
+BOOST_AUTO_TEST_CASE(coins_snapshot)
+{
+    CCoinsViewTest base;
+    CCoinsViewCacheTest tip(&base);
+    CCoinsSnapshotPublisher publisher;
+
+    uint256 hash0 = InsecureRand256();
+    uint256 hash1 = InsecureRand256();
+    CBlockIndex index0, index1;
+    index0.phashBlock = &hash0;
+    index0.nHeight = 0;
+    index1.phashBlock = &hash1;
+    index1.nHeight = 1;
+
+    BOOST_CHECK(!publisher.Get());
+    publisher.Reset(&base, &index0);
+    std::shared_ptr<CCoinsSnapshot> before = publisher.Get();
+    BOOST_CHECK(before && before->hashBlock == hash0);
+
+    // A block with a coinbase of two outputs, and a transaction that spends
+    // the first of them.
+    CMutableTransaction mtx;
+    mtx.vin.resize(1);
+    mtx.vin[0].scriptSig = CScript() << OP_1;
+    mtx.vout.resize(2);
+    mtx.vout[0].nValue = 500;
+    mtx.vout[0].scriptPubKey = CScript() << OP_1;
+    mtx.vout[1].nValue = 500;
+    mtx.vout[1].scriptPubKey = CScript() << OP_2;
+    CTransaction coinbase(mtx);
+
+    CMutableTransaction mtx2;
+    mtx2.vin.resize(1);
+    mtx2.vin[0].prevout = COutPoint(coinbase.GetHash(), 0);
+    mtx2.vout.resize(1);
+    mtx2.vout[0].nValue = 400;
+    mtx2.vout[0].scriptPubKey = CScript() << OP_3;
+    CTransaction spend(mtx2);
+
+    CBlock block;
+    block.vtx.push_back(coinbase);
+    block.vtx.push_back(spend);
+    {
+        CCoinsViewCacheTest view(&tip);
+        UpdateCoins(coinbase, view, 1);
+        UpdateCoins(spend, view, 1);
+        view.SetBestBlock(hash1);
+        publisher.BlockChanged(view, block, &index1);
+        BOOST_CHECK(view.Flush());
+    }
+
+    std::shared_ptr<CCoinsSnapshot> after = publisher.Get();
+    BOOST_CHECK(after->hashBlock == hash1);
+    BOOST_CHECK_EQUAL(after->nHeight, 1);
+    CCoins coins;
+    BOOST_CHECK(after->GetCoins(coinbase.GetHash(), coins));
+    BOOST_CHECK(!coins.IsAvailable(0));
+    BOOST_CHECK(coins.IsAvailable(1));
+    BOOST_CHECK(after->HaveCoins(spend.GetHash()));
+
+    // The earlier snapshot is unchanged, as the block is not flushed yet.
+    BOOST_CHECK(!before->HaveCoins(coinbase.GetHash()));
+    BOOST_CHECK(!before->HaveCoins(spend.GetHash()));
+
+    // Once the tip is flushed, snapshots are read from the base.
+    BOOST_CHECK(tip.Flush());
+    publisher.Reset(&base, &index1);
+    BOOST_CHECK(publisher.Get()->GetCoins(coinbase.GetHash(), coins));
+    BOOST_CHECK(!coins.IsAvailable(0));
+    BOOST_CHECK(coins.IsAvailable(1));
+
+    publisher.Clear();
+    BOOST_CHECK(!publisher.Get());
+}
+
 // This test is similar to the previous test
 // except the emphasis is on testing the functionality of UpdateCoins
 // random txs are created and UpdateCoins is used to update the cache stack
@@ -11,6 +11,7 @@
 #include "crypto/sha512.h"
 #include "crypto/hmac_sha256.h"
 #include "crypto/hmac_sha512.h"
+#include "crypto/lthash.h"
 #include "util/strencodings.h"
 #include "test/test_bitcoin.h"
 
@@ -520,4 +521,51 @@ BOOST_AUTO_TEST_CASE(sha256d64)
     }
 }
 
+BOOST_AUTO_TEST_CASE(lthash_tests)
+{
+    const unsigned char abc[] = {'a', 'b', 'c'};
+    const unsigned char def[] = {'d', 'e', 'f'};
+    auto digest = [](const LtHash16& hash) {
+        unsigned char out[LtHash16::OUTPUT_SIZE];
+        hash.Finalize(out);
+        return HexStr(out, out + sizeof(out));
+    };
+
+    LtHash16 empty;
+    BOOST_CHECK_EQUAL(digest(empty), "e5a00aa9991ac8a5ee3109844d84a55583bd20572ad3ffcd42792f3c36b183ad");
+
+    LtHash16 a;
+    a.Add(abc, sizeof(abc));
+    BOOST_CHECK_EQUAL(digest(a), "cf1906c3be0bae57c8bbea9f45351d21c1bd27834819118b13142a6bf5b6214f");
+
+    // The order of insertion does not matter.
+    LtHash16 ab, ba;
+    ab.Add(abc, sizeof(abc)).Add(def, sizeof(def));
+    ba.Add(def, sizeof(def)).Add(abc, sizeof(abc));
+    BOOST_CHECK(ab == ba);
+    BOOST_CHECK_EQUAL(digest(ab), "ed4e97410b74e90cae62640eb5e0fc8846f56b5377b12fb24850f3b7af4b2009");
+
+    // Removal undoes insertion, and states combine.
+    LtHash16 b;
+    b.Add(def, sizeof(def));
+    BOOST_CHECK(LtHash16(ab).Remove(def, sizeof(def)) == a);
+    BOOST_CHECK((LtHash16(a) += b) == ab);
+    BOOST_CHECK((LtHash16(ab) -= a) == b);
+    BOOST_CHECK(LtHash16(a).Remove(abc, sizeof(abc)) == empty);
+
+    // Removing an element that was not added can be made up for later.
+    LtHash16 c;
+    c.Remove(abc, sizeof(abc)).Add(def, sizeof(def));
+    BOOST_CHECK(c != b);
+    c.Add(abc, sizeof(abc));
+    BOOST_CHECK(c == b);
+
+    // The state round-trips.
+    LtHash16 d;
+    unsigned char state[LtHash16::STATE_SIZE];
+    ab.GetState(state);
+    d.SetState(state);
+    BOOST_CHECK(d == ab);
+}
+
 BOOST_AUTO_TEST_SUITE_END()
@@ -6,6 +6,7 @@
 #include "script/sigcache.h"
 #include "test/test_bitcoin.h"
 #include "random.h"
+#include "zcash/cache.h"
 #include <thread>
 #include <boost/thread.hpp>
 
@@ -379,4 +380,121 @@ BOOST_AUTO_TEST_CASE(cuckoocache_generations)
     test_cache_generations<CuckooCache::cache<uint256, SignatureCacheHasher>>();
 }
 
+BOOST_AUTO_TEST_CASE(cuckoocache_stats)
+{
+    local_rand_ctx = FastRandomContext(true);
+    CuckooCache::cache<uint256, SignatureCacheHasher> cc{};
+    cc.setup(1024);
+    std::vector<uint256> hashes(256);
+    for (uint256& h : hashes) {
+        insecure_GetRandHash(h);
+        cc.insert(h);
+    }
+    // Inserting an element that is present does not count.
+    cc.insert(hashes[0]);
+    auto stats = cc.get_stats();
+    BOOST_CHECK_EQUAL(stats.insertions, 256);
+    BOOST_CHECK_EQUAL(stats.size, 1024);
+    BOOST_CHECK_EQUAL(stats.elements, 256 - stats.evictions);
+
+    uint256 unknown;
+    insecure_GetRandHash(unknown);
+    BOOST_CHECK(!cc.contains(unknown, false));
+    for (const uint256& h : hashes) {
+        cc.contains(h, false);
+    }
+    stats = cc.get_stats();
+    BOOST_CHECK_EQUAL(stats.hits + stats.misses, 257);
+    BOOST_CHECK(stats.hits >= 256 - stats.evictions);
+
+    // Elements found with erase set are no longer counted.
+    cc.contains(hashes[1], true);
+    BOOST_CHECK(cc.get_stats().elements < stats.elements);
+
+    // Overfilling the cache evicts elements.
+    uint256 h;
+    for (int i = 0; i < 4096; ++i) {
+        insecure_GetRandHash(h);
+        cc.insert(h);
+    }
+    stats = cc.get_stats();
+    BOOST_CHECK(stats.evictions > 0);
+    BOOST_CHECK(stats.elements <= stats.size);
+}
+
+BOOST_AUTO_TEST_CASE(cuckoocache_get_elements)
+{
+    local_rand_ctx = FastRandomContext(true);
+    CuckooCache::cache<uint256, SignatureCacheHasher> cc{};
+    cc.setup(1024);
+    std::vector<uint256> hashes(256);
+    for (uint256& h : hashes) {
+        insecure_GetRandHash(h);
+        cc.insert(h);
+    }
+    // The elements that are still present are returned, and can be inserted
+    // into another cache.
+    std::vector<uint256> elements = cc.get_elements();
+    BOOST_CHECK_EQUAL(elements.size(), cc.get_stats().elements);
+    CuckooCache::cache<uint256, SignatureCacheHasher> copy{};
+    copy.setup(1024);
+    for (const uint256& h : elements) {
+        BOOST_CHECK(std::find(hashes.begin(), hashes.end(), h) != hashes.end());
+        copy.insert(h);
+    }
+    auto stats = copy.get_stats();
+    BOOST_CHECK_EQUAL(stats.elements, elements.size() - stats.evictions);
+
+    // Elements found with erase set are left out.
+    cc.contains(elements[0], true);
+    std::vector<uint256> remaining = cc.get_elements();
+    BOOST_CHECK_EQUAL(remaining.size(), elements.size() - 1);
+    BOOST_CHECK(std::find(remaining.begin(), remaining.end(), elements[0]) == remaining.end());
+}
+
+BOOST_AUTO_TEST_CASE(bundle_validity_cache_shards)
+{
+    local_rand_ctx = FastRandomContext(true);
+    libzcash::BundleValidityCache cache;
+    size_t nElems = cache.setup_bytes(64 * 1024 * sizeof(libzcash::BundleCacheEntry));
+    BOOST_CHECK_EQUAL(nElems, 64 * 1024);
+
+    std::vector<libzcash::BundleCacheEntry> entries(4096);
+    for (libzcash::BundleCacheEntry& entry : entries) {
+        uint256 h;
+        insecure_GetRandHash(h);
+        std::copy(h.begin(), h.end(), entry.begin());
+    }
+
+    // Insert from several threads at once, each into every shard.
+    std::vector<std::thread> threads;
+    for (int t = 0; t < 4; ++t) {
+        threads.emplace_back([&, t] {
+            for (size_t i = t; i < entries.size(); i += 4) {
+                cache.insert(entries[i]);
+            }
+        });
+    }
+    for (std::thread& t : threads) {
+        t.join();
+    }
+
+    // The cache is far from full, so nothing was evicted.
+    for (const libzcash::BundleCacheEntry& entry : entries) {
+        BOOST_CHECK(cache.contains(entry, false));
+    }
+    CCacheStats stats = cache.GetStats();
+    BOOST_CHECK_EQUAL(stats.nInsertions, entries.size());
+    BOOST_CHECK_EQUAL(stats.nEvictions, 0);
+    BOOST_CHECK_EQUAL(stats.nEntries, entries.size());
+    BOOST_CHECK_EQUAL(stats.nHits, entries.size());
+    BOOST_CHECK_EQUAL(stats.nMaxEntries, nElems);
+    BOOST_CHECK_EQUAL(cache.GetEntries().size(), entries.size());
+
+    // Erased entries are left out.
+    cache.contains(entries[0], true);
+    BOOST_CHECK_EQUAL(cache.GetStats().nEntries, entries.size() - 1);
+    BOOST_CHECK_EQUAL(cache.GetEntries().size(), entries.size() - 1);
+}
+
 BOOST_AUTO_TEST_SUITE_END();
@@ -0,0 +1,88 @@
+// Copyright (c) 2026 The Zcash developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or https://www.opensource.org/licenses/mit-license.php .
+
+#include "cuckoofilter.h"
+#include "random.h"
+#include "test/test_bitcoin.h"
+
+#include <vector>
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_FIXTURE_TEST_SUITE(cuckoofilter_tests, BasicTestingSetup)
+
+BOOST_AUTO_TEST_CASE(cuckoofilter_no_false_negatives)
+{
+    FastRandomContext ctx(true);
+    CuckooFilter::filter filter(100000);
+    std::vector<uint64_t> inserted;
+    for (int i = 0; i < 100000; i++) {
+        uint64_t hash = ctx.rand64();
+        BOOST_CHECK(filter.insert(hash));
+        inserted.push_back(hash);
+    }
+    BOOST_CHECK(!filter.full());
+    BOOST_CHECK_EQUAL(filter.size(), 100000);
+    for (uint64_t hash : inserted) {
+        BOOST_CHECK(filter.contains(hash));
+    }
+
+    // Roughly 8 in 2^16 lookups of absent elements match.
+    int nFalsePositives = 0;
+    for (int i = 0; i < 100000; i++) {
+        nFalsePositives += filter.contains(ctx.rand64());
+    }
+    BOOST_CHECK(nFalsePositives < 100);
+}
+
+BOOST_AUTO_TEST_CASE(cuckoofilter_erase)
+{
+    FastRandomContext ctx(true);
+    CuckooFilter::filter filter(10000);
+    std::vector<uint64_t> inserted;
+    for (int i = 0; i < 10000; i++) {
+        inserted.push_back(ctx.rand64());
+        filter.insert(inserted.back());
+    }
+    // Insert one element twice; it stays present until both are erased.
+    filter.insert(inserted[0]);
+
+    for (size_t i = 0; i < inserted.size(); i += 2) {
+        BOOST_CHECK(filter.erase(inserted[i]));
+    }
+    BOOST_CHECK_EQUAL(filter.size(), 5001);
+    for (size_t i = 1; i < inserted.size(); i += 2) {
+        BOOST_CHECK(filter.contains(inserted[i]));
+    }
+    BOOST_CHECK(filter.contains(inserted[0]));
+    BOOST_CHECK(filter.erase(inserted[0]));
+    BOOST_CHECK(!filter.erase(inserted[0]));
+}
+
+BOOST_AUTO_TEST_CASE(cuckoofilter_full)
+{
+    FastRandomContext ctx(true);
+    CuckooFilter::filter filter(1000);
+    std::vector<uint64_t> inserted;
+    while (!filter.full()) {
+        uint64_t hash = ctx.rand64();
+        BOOST_CHECK(filter.insert(hash));
+        inserted.push_back(hash);
+    }
+    // Nothing that was inserted is lost when the filter fills up, but
+    // further insertions are refused.
+    for (uint64_t hash : inserted) {
+        BOOST_CHECK(filter.contains(hash));
+    }
+    BOOST_CHECK(!filter.insert(ctx.rand64()));
+
+    // Erasing makes room again.
+    for (size_t i = 0; i < inserted.size() / 2; i++) {
+        filter.erase(inserted[i]);
+    }
+    BOOST_CHECK(!filter.full());
+    BOOST_CHECK(filter.insert(ctx.rand64()));
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -43,6 +43,58 @@ BOOST_AUTO_TEST_CASE(dbwrapper)
     }
 }
 
+BOOST_AUTO_TEST_CASE(dbwrapper_options)
+{
+    path ph = temp_directory_path() / unique_path();
+    CDBOptions dbOptions;
+    dbOptions.nBloomBitsPerKey = 0;
+    dbOptions.nBlockCachePercent = MIN_DB_BLOCK_CACHE_PERCENT;
+    CDBWrapper dbw(ph, (1 << 20), true, false, dbOptions);
+
+    for (uint32_t i = 0; i < 1000; i++) {
+        BOOST_CHECK(dbw.Write(std::make_pair('k', i), InsecureRand256()));
+    }
+    uint256 res;
+    BOOST_CHECK(dbw.Read(std::make_pair('k', (uint32_t)0), res));
+    BOOST_CHECK(!dbw.Read(std::make_pair('k', (uint32_t)1000), res));
+
+    // Only keys that have reached a table are counted.
+    dbw.CompactRange('\x00', '\xff');
+    BOOST_CHECK(dbw.EstimateSize('\x00', '\xff') > 0);
+    BOOST_CHECK_EQUAL(dbw.EstimateSize('a', 'b'), 0);
+
+    BOOST_CHECK(!dbw.GetProperty("leveldb.stats").empty());
+    BOOST_CHECK(dbw.GetProperty("leveldb.nonexistent").empty());
+}
+
+BOOST_AUTO_TEST_CASE(dbwrapper_bulk_load)
+{
+    path ph = temp_directory_path() / unique_path();
+    CDBOptions dbOptions;
+    dbOptions.fBulkLoad = true;
+    CDBWrapper dbw(ph, (1 << 20), true, false, dbOptions);
+
+    std::vector<uint256> values;
+    for (uint32_t i = 0; i < 1000; i++) {
+        values.push_back(InsecureRand256());
+        BOOST_CHECK(dbw.Write(std::make_pair('k', i), values.back()));
+    }
+
+    // Compact the keys a two-byte prefix at a time, as after initial block
+    // download. The keys are serialized little-endian.
+    for (int n = 0; n < 0x100; n++) {
+        auto end = n == 0xff ? std::make_pair('l', '\x00') : std::make_pair('k', (char)(n + 1));
+        dbw.CompactRange(std::make_pair('k', (char)n), end);
+    }
+    BOOST_CHECK(dbw.EstimateSize(std::make_pair('k', '\x00'), std::make_pair('l', '\x00')) > 0);
+
+    for (uint32_t i = 0; i < 1000; i++) {
+        uint256 res;
+        BOOST_CHECK(dbw.Read(std::make_pair('k', i), res));
+        BOOST_CHECK(res == values[i]);
+    }
+}
+
 // Test batch operations
 BOOST_AUTO_TEST_CASE(dbwrapper_batch)
 {
@@ -3,6 +3,7 @@
 // Distributed under the MIT software license, see the accompanying
 // file COPYING or https://www.opensource.org/licenses/mit-license.php .
 
+#include "crypto/common.h"
 #include "hash.h"
 #include "util/strencodings.h"
 #include "test/test_bitcoin.h"
@@ -108,6 +109,16 @@ BOOST_AUTO_TEST_CASE(siphash)
 
     BOOST_CHECK_EQUAL(SipHashUint256(0x0706050403020100ULL, 0x0F0E0D0C0B0A0908ULL, uint256S("1f1e1d1c1b1a191817161514131211100f0e0d0c0b0a09080706050403020100")), 0x7127512f72f27cceull);
 
+    // Check that SipHashUint256Extra hashes the uint256 followed by 4 bytes.
+    uint256 x = uint256S("1f1e1d1c1b1a191817161514131211100f0e0d0c0b0a09080706050403020100");
+    for (uint32_t n : {0u, 1u, 0xdeadbeefu}) {
+        unsigned char nb[4];
+        WriteLE32(nb, n);
+        CSipHasher sip288(0x0706050403020100ULL, 0x0F0E0D0C0B0A0908ULL);
+        sip288.Write(x.begin(), 32).Write(nb, 4);
+        BOOST_CHECK_EQUAL(SipHashUint256Extra(0x0706050403020100ULL, 0x0F0E0D0C0B0A0908ULL, x, n), sip288.Finalize());
+    }
+
     // Check test vectors from spec, one byte at a time
     CSipHasher hasher2(0x0706050403020100ULL, 0x0F0E0D0C0B0A0908ULL);
     for (uint8_t x=0; x<ARRAYLEN(siphash_4_2_testvec); ++x)
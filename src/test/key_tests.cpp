@@ -162,6 +162,30 @@ BOOST_AUTO_TEST_CASE(key_test1)
     BOOST_CHECK(detsigc == ParseHex("2052d8a32079c11e79db95af63bb9600c5b04f21a9ca33dc129c2bfa8ac9dc1cd561d8ae5e0f6c1a16bde3719c64c2fd70e404b6428ab9a69566962e8771b5944d"));
 }
 
+BOOST_AUTO_TEST_CASE(key_verify_parsed_pubkey_cache)
+{
+    // More keys than the parsed public key cache of a thread holds, so that
+    // keys are evicted and parsed again.
+    std::vector<CKey> keys;
+    std::vector<std::vector<unsigned char>> sigs;
+    uint256 hash = Hash(strSecret1.begin(), strSecret1.end());
+    for (int i = 0; i < 20; i++) {
+        keys.push_back(CKey::TestOnlyRandomKey(i % 2 == 0));
+        std::vector<unsigned char> sig;
+        BOOST_CHECK(keys.back().Sign(hash, sig));
+        sigs.push_back(sig);
+    }
+    for (int round = 0; round < 2; round++) {
+        for (size_t i = 0; i < keys.size(); i++) {
+            CPubKey pubkey = keys[i].GetPubKey();
+            BOOST_CHECK(pubkey.Verify(hash, sigs[i]));
+            // A recently parsed key still rejects the signatures of others.
+            BOOST_CHECK(!pubkey.Verify(hash, sigs[(i + 1) % keys.size()]));
+            BOOST_CHECK(pubkey.Verify(hash, sigs[i]));
+        }
+    }
+}
+
 BOOST_AUTO_TEST_CASE(zc_address_test)
 {
     KeyIO keyIO(Params());
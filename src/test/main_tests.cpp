@@ -4,7 +4,10 @@
 // file COPYING or https://www.opensource.org/licenses/mit-license.php .
 
 #include "chainparams.h"
+#include "clientversion.h"
 #include "main.h"
+#include "streams.h"
+#include "version.h"
 
 #include "test/test_bitcoin.h"
 
@@ -123,4 +126,59 @@ BOOST_AUTO_TEST_CASE(test_combiner_all)
     Test.disconnect(&ReturnTrue);
     BOOST_CHECK(Test());
 }
+
+BOOST_AUTO_TEST_CASE(read_raw_block_from_disk)
+{
+    const CChainParams& chainparams = Params();
+    CBlockIndex* pindex;
+    {
+        LOCK(cs_main);
+        pindex = chainActive.Genesis();
+    }
+    BOOST_REQUIRE(pindex != NULL);
+
+    CBlock block;
+    BOOST_REQUIRE(ReadBlockFromDisk(block, pindex, chainparams.GetConsensus()));
+    CDataStream ssBlock(SER_NETWORK, PROTOCOL_VERSION);
+    ssBlock << block;
+
+    std::vector<uint8_t> vRawBlock;
+    BOOST_REQUIRE(ReadRawBlockFromDisk(vRawBlock, pindex, chainparams.MessageStart()));
+    BOOST_CHECK(std::equal(vRawBlock.begin(), vRawBlock.end(), ssBlock.begin(), ssBlock.end()));
+
+    // The block magic is checked.
+    CMessageHeader::MessageStartChars wrongStart = {0, 0, 0, 0};
+    BOOST_CHECK(!ReadRawBlockFromDisk(vRawBlock, pindex, wrongStart));
+}
+
+BOOST_AUTO_TEST_CASE(optional_amount)
+{
+    OptionalAmount missing;
+    BOOST_CHECK(!missing.has_value());
+    BOOST_CHECK(missing == std::nullopt);
+    BOOST_CHECK_EQUAL(missing.value_or(7), 7);
+    BOOST_CHECK_THROW(missing.value(), std::bad_optional_access);
+    BOOST_CHECK(!std::optional<CAmount>(missing));
+
+    OptionalAmount zero = 0;
+    BOOST_CHECK(zero.has_value());
+    BOOST_CHECK(zero != missing);
+    OptionalAmount negative = -MAX_MONEY;
+    BOOST_CHECK_EQUAL(*negative, -MAX_MONEY);
+    BOOST_CHECK(std::optional<CAmount>(negative) == std::optional<CAmount>(-MAX_MONEY));
+    BOOST_CHECK(OptionalAmount(std::optional<CAmount>()) == missing);
+
+    // Block index entries on disk must read the same as before.
+    for (const std::optional<CAmount>& value : {std::optional<CAmount>(), std::optional<CAmount>(0), std::optional<CAmount>(MAX_MONEY)}) {
+        CDataStream ssOld(SER_DISK, CLIENT_VERSION);
+        ssOld << value;
+        CDataStream ssNew(SER_DISK, CLIENT_VERSION);
+        ssNew << OptionalAmount(value);
+        BOOST_CHECK(ssOld.str() == ssNew.str());
+        OptionalAmount read;
+        ssNew >> read;
+        BOOST_CHECK(std::optional<CAmount>(read) == value);
+    }
+}
+
 BOOST_AUTO_TEST_SUITE_END()
@@ -5,8 +5,11 @@
 
 #include "consensus/upgrades.h"
 #include "main.h"
+#include "script/interpreter.h"
+#include "script/standard.h"
 #include "txmempool.h"
 #include "util/system.h"
+#include "zip317.h"
 
 #include "test/test_bitcoin.h"
 
@@ -57,7 +60,7 @@ BOOST_AUTO_TEST_CASE(MempoolRemoveTest)
 
 
     CTxMemPool testPool(CFeeRate(0));
-    std::list<CTransaction> removed;
+    std::list<CTransactionRef> removed;
 
     // Nothing in pool, remove should do nothing:
     testPool.remove(txParent, removed, true);
@@ -282,7 +285,7 @@ BOOST_AUTO_TEST_CASE(MempoolIndexingTest)
     BOOST_CHECK_EQUAL(pool.size(), 10);
 
     // Now try removing tx10 and verify the sort order returns to normal
-    std::list<CTransaction> removed;
+    std::list<CTransactionRef> removed;
     pool.remove(pool.mapTx.find(tx10.GetHash())->GetTx(), removed, true);
     CheckSort<descendant_score>(pool, snapshotOrder);
 
@@ -319,6 +322,316 @@ BOOST_AUTO_TEST_CASE(MempoolIndexingTest)
     CheckSort<mining_score>(pool, sortedOrder);
 }
 
+BOOST_AUTO_TEST_CASE(MempoolAncestorStateTest)
+{
+    CTxMemPool pool(CFeeRate(0));
+    TestMemPoolEntryHelper entry;
+
+    // A chain of three transactions.
+    CMutableTransaction tx1 = CMutableTransaction();
+    tx1.vin.resize(1);
+    tx1.vin[0].scriptSig = CScript() << OP_11;
+    tx1.vout.resize(1);
+    tx1.vout[0].scriptPubKey = CScript() << OP_11 << OP_EQUAL;
+    tx1.vout[0].nValue = 10 * COIN;
+
+    CMutableTransaction tx2 = CMutableTransaction();
+    tx2.vin.resize(1);
+    tx2.vin[0].scriptSig = CScript() << OP_11;
+    tx2.vin[0].prevout.hash = tx1.GetHash();
+    tx2.vout.resize(1);
+    tx2.vout[0].scriptPubKey = CScript() << OP_11 << OP_EQUAL;
+    tx2.vout[0].nValue = 9 * COIN;
+
+    CMutableTransaction tx3 = CMutableTransaction();
+    tx3.vin.resize(1);
+    tx3.vin[0].scriptSig = CScript() << OP_11;
+    tx3.vin[0].prevout.hash = tx2.GetHash();
+    tx3.vout.resize(1);
+    tx3.vout[0].scriptPubKey = CScript() << OP_11 << OP_EQUAL;
+    tx3.vout[0].nValue = 8 * COIN;
+
+    pool.addUnchecked(tx1.GetHash(), entry.Fee(0).SigOps(1).FromTx(tx1));
+    pool.addUnchecked(tx2.GetHash(), entry.Fee(10000).SigOps(2).FromTx(tx2));
+    pool.addUnchecked(tx3.GetHash(), entry.Fee(30000).SigOps(3).FromTx(tx3));
+
+    CTxMemPool::txiter it1 = pool.mapTx.find(tx1.GetHash());
+    CTxMemPool::txiter it2 = pool.mapTx.find(tx2.GetHash());
+    CTxMemPool::txiter it3 = pool.mapTx.find(tx3.GetHash());
+    BOOST_CHECK_EQUAL(it1->GetCountWithAncestors(), 1);
+    BOOST_CHECK_EQUAL(it3->GetCountWithAncestors(), 3);
+    BOOST_CHECK_EQUAL(it3->GetSizeWithAncestors(), it1->GetTxSize() + it2->GetTxSize() + it3->GetTxSize());
+    BOOST_CHECK_EQUAL(it3->GetModFeesWithAncestors(), 40000);
+    BOOST_CHECK_EQUAL(it3->GetSigOpCountWithAncestors(), 6);
+    BOOST_CHECK_EQUAL(it3->GetConventionalFeeWithAncestors(), 3 * MINIMUM_FEE);
+
+    // tx1 pays nothing, but the package of tx3 pays more than its conventional fee.
+    BOOST_CHECK(it1->GetWeightRatio() < WEIGHT_RATIO_SCALE);
+    BOOST_CHECK(it3->GetWeightRatioWithAncestors() > WEIGHT_RATIO_SCALE);
+
+    // Prioritising a transaction changes the ancestor state of its descendants.
+    pool.PrioritiseTransaction(tx1.GetHash(), tx1.GetHash().ToString(), 5000);
+    BOOST_CHECK_EQUAL(it1->GetModFeesWithAncestors(), 5000);
+    BOOST_CHECK_EQUAL(it2->GetModFeesWithAncestors(), 15000);
+    BOOST_CHECK_EQUAL(it3->GetModFeesWithAncestors(), 45000);
+
+    // When tx1 is mined, it is no longer an ancestor of the others.
+    std::list<CTransactionRef> conflicts;
+    pool.removeForBlock({tx1}, 1, conflicts);
+    BOOST_CHECK_EQUAL(pool.size(), 2);
+    BOOST_CHECK_EQUAL(it2->GetCountWithAncestors(), 1);
+    BOOST_CHECK_EQUAL(it2->GetModFeesWithAncestors(), 10000);
+    BOOST_CHECK_EQUAL(it3->GetCountWithAncestors(), 2);
+    BOOST_CHECK_EQUAL(it3->GetSizeWithAncestors(), it2->GetTxSize() + it3->GetTxSize());
+    BOOST_CHECK_EQUAL(it3->GetModFeesWithAncestors(), 40000);
+    BOOST_CHECK_EQUAL(it3->GetSigOpCountWithAncestors(), 5);
+    BOOST_CHECK_EQUAL(it3->GetConventionalFeeWithAncestors(), 2 * MINIMUM_FEE);
+}
+
+BOOST_AUTO_TEST_CASE(MempoolRemoveForBlockTest)
+{
+    CTxMemPool pool(CFeeRate(0));
+    TestMemPoolEntryHelper entry;
+
+    // A parent with two children, one of which has a child of its own.
+    CMutableTransaction txParent;
+    txParent.vin.resize(1);
+    txParent.vin[0].scriptSig = CScript() << OP_11;
+    txParent.vout.resize(2);
+    for (int i = 0; i < 2; i++) {
+        txParent.vout[i].scriptPubKey = CScript() << OP_11 << OP_EQUAL;
+        txParent.vout[i].nValue = 10 * COIN;
+    }
+    CMutableTransaction txChild[2];
+    for (int i = 0; i < 2; i++) {
+        txChild[i].vin.resize(1);
+        txChild[i].vin[0].scriptSig = CScript() << OP_11;
+        txChild[i].vin[0].prevout.hash = txParent.GetHash();
+        txChild[i].vin[0].prevout.n = i;
+        txChild[i].vout.resize(1);
+        txChild[i].vout[0].scriptPubKey = CScript() << OP_11 << OP_EQUAL;
+        txChild[i].vout[0].nValue = 9 * COIN;
+    }
+    CMutableTransaction txGrandChild;
+    txGrandChild.vin.resize(1);
+    txGrandChild.vin[0].scriptSig = CScript() << OP_11;
+    txGrandChild.vin[0].prevout.hash = txChild[1].GetHash();
+    txGrandChild.vout.resize(1);
+    txGrandChild.vout[0].scriptPubKey = CScript() << OP_11 << OP_EQUAL;
+    txGrandChild.vout[0].nValue = 8 * COIN;
+
+    pool.addUnchecked(txParent.GetHash(), entry.Fee(10000).FromTx(txParent));
+    pool.addUnchecked(txChild[0].GetHash(), entry.Fee(10000).FromTx(txChild[0]));
+    pool.addUnchecked(txChild[1].GetHash(), entry.Fee(10000).FromTx(txChild[1]));
+    pool.addUnchecked(txGrandChild.GetHash(), entry.Fee(10000).FromTx(txGrandChild));
+    pool.PrioritiseTransaction(txParent.GetHash(), txParent.GetHash().ToString(), 5000);
+    BOOST_CHECK_EQUAL(pool.size(), 4);
+
+    // The block contains the parent and the first child, and a transaction
+    // that double-spends the output of the parent spent by the second child.
+    CMutableTransaction txDoubleSpend;
+    txDoubleSpend.vin.resize(1);
+    txDoubleSpend.vin[0].scriptSig = CScript() << OP_12;
+    txDoubleSpend.vin[0].prevout.hash = txParent.GetHash();
+    txDoubleSpend.vin[0].prevout.n = 1;
+    txDoubleSpend.vout.resize(1);
+    txDoubleSpend.vout[0].scriptPubKey = CScript() << OP_11 << OP_EQUAL;
+    txDoubleSpend.vout[0].nValue = 9 * COIN;
+
+    std::list<CTransactionRef> conflicts;
+    pool.removeForBlock({txParent, txChild[0], txDoubleSpend}, 1, conflicts);
+    BOOST_CHECK_EQUAL(pool.size(), 0);
+    BOOST_CHECK_EQUAL(conflicts.size(), 2);
+    for (const CTransactionRef& ptx : conflicts) {
+        BOOST_CHECK(ptx->GetHash() == txChild[1].GetHash() || ptx->GetHash() == txGrandChild.GetHash());
+    }
+
+    // The prioritisation of the mined transactions is cleared.
+    CAmount nFeeDelta = 0;
+    pool.ApplyDelta(txParent.GetHash(), nFeeDelta);
+    BOOST_CHECK_EQUAL(nFeeDelta, 0);
+}
+
+BOOST_AUTO_TEST_CASE(MempoolAddressIndexTest)
+{
+    fAddressIndex = true;
+    CTxMemPool pool(CFeeRate(0));
+    TestMemPoolEntryHelper entry;
+    CCoinsViewDummy coinsDummy;
+    CCoinsViewCache view(&coinsDummy);
+
+    uint160 hashA(std::vector<unsigned char>(20, 1));
+    uint160 hashB(std::vector<unsigned char>(20, 2));
+    CScript scriptA = GetScriptForDestination(CKeyID(hashA));
+    CScript scriptB = GetScriptForDestination(CKeyID(hashB));
+
+    // A confirmed transaction that pays A twice.
+    CMutableTransaction txFund;
+    txFund.vin.resize(1);
+    txFund.vout.resize(2);
+    for (int i = 0; i < 2; i++) {
+        txFund.vout[i].scriptPubKey = scriptA;
+        txFund.vout[i].nValue = 10 * COIN;
+    }
+    view.ModifyCoins(txFund.GetHash())->FromTx(txFund, 0);
+
+    // Two mempool transactions that each spend one of its outputs and pay A
+    // again, and the first of them also B.
+    CMutableTransaction tx[2];
+    for (int i = 0; i < 2; i++) {
+        tx[i].vin.resize(1);
+        tx[i].vin[0].prevout = COutPoint(txFund.GetHash(), i);
+        tx[i].vout.resize(1);
+        tx[i].vout[0].scriptPubKey = scriptA;
+        tx[i].vout[0].nValue = 5 * COIN;
+    }
+    tx[0].vout.resize(2);
+    tx[0].vout[1].scriptPubKey = scriptB;
+    tx[0].vout[1].nValue = 4 * COIN;
+    for (int i = 0; i < 2; i++) {
+        CTxMemPoolEntry txEntry = entry.Fee(10000).FromTx(tx[i]);
+        pool.addUnchecked(tx[i].GetHash(), txEntry);
+        pool.addAddressIndex(txEntry, view);
+    }
+
+    auto getDeltas = [&](const uint160& hash) {
+        std::vector<std::pair<CMempoolAddressDeltaKey, CMempoolAddressDelta>> results;
+        pool.getAddressIndex({{hash, CScript::P2PKH}}, results);
+        return results;
+    };
+
+    auto deltasA = getDeltas(hashA);
+    BOOST_CHECK_EQUAL(deltasA.size(), 4);
+    for (size_t i = 1; i < deltasA.size(); i++) {
+        BOOST_CHECK(CMempoolAddressDeltaKeyCompare()(deltasA[i - 1].first, deltasA[i].first));
+    }
+    CAmount nBalanceA = 0;
+    for (const auto& delta : deltasA) {
+        BOOST_CHECK(delta.first.addressBytes == hashA);
+        nBalanceA += delta.second.amount;
+    }
+    BOOST_CHECK_EQUAL(nBalanceA, -10 * COIN);
+    BOOST_CHECK_EQUAL(getDeltas(hashB).size(), 1);
+
+    // Mining the first transaction removes its deltas only.
+    std::list<CTransactionRef> conflicts;
+    pool.removeForBlock({tx[0]}, 1, conflicts);
+    deltasA = getDeltas(hashA);
+    BOOST_CHECK_EQUAL(deltasA.size(), 2);
+    for (const auto& delta : deltasA) {
+        BOOST_CHECK(delta.first.txhash == tx[1].GetHash());
+    }
+    BOOST_CHECK(getDeltas(hashB).empty());
+
+    std::list<CTransactionRef> removed;
+    pool.remove(tx[1], removed);
+    BOOST_CHECK(getDeltas(hashA).empty());
+    fAddressIndex = false;
+}
+
+// Test that sampled checks pass on a consistent pool, as transactions are
+// added and removed.
+BOOST_AUTO_TEST_CASE(MempoolSampleCheckTest)
+{
+    CTxMemPool pool(CFeeRate(0));
+    pool.setSampleCheck(2);
+    TestMemPoolEntryHelper entry;
+    CCoinsViewCache view(pcoinsTip);
+
+    CMutableTransaction txFund;
+    txFund.vin.resize(1);
+    txFund.vin[0].prevout = COutPoint(uint256S("01"), 0);
+    txFund.vout.resize(4);
+    for (int i = 0; i < 4; i++) {
+        txFund.vout[i].scriptPubKey = CScript() << OP_11 << OP_EQUAL;
+        txFund.vout[i].nValue = 10 * COIN;
+    }
+    view.ModifyCoins(txFund.GetHash())->FromTx(txFund, 0);
+
+    // Transactions spending the outputs of txFund, and a child of the first.
+    std::vector<CMutableTransaction> txs(4);
+    for (int i = 0; i < 4; i++) {
+        txs[i].vin.resize(1);
+        txs[i].vin[0].scriptSig = CScript() << OP_11;
+        txs[i].vin[0].prevout = COutPoint(txFund.GetHash(), i);
+        txs[i].vout.resize(1);
+        txs[i].vout[0].scriptPubKey = CScript() << OP_11 << OP_EQUAL;
+        txs[i].vout[0].nValue = 9 * COIN;
+    }
+    CMutableTransaction txChild;
+    txChild.vin.resize(1);
+    txChild.vin[0].scriptSig = CScript() << OP_11;
+    txChild.vin[0].prevout = COutPoint(txs[0].GetHash(), 0);
+    txChild.vout.resize(1);
+    txChild.vout[0].scriptPubKey = CScript() << OP_11 << OP_EQUAL;
+    txChild.vout[0].nValue = 8 * COIN;
+
+    for (const CMutableTransaction& tx : txs) {
+        pool.addUnchecked(tx.GetHash(), entry.Fee(COIN).FromTx(tx));
+        pool.check(&view);
+    }
+    pool.addUnchecked(txChild.GetHash(), entry.Fee(COIN).FromTx(txChild));
+    pool.check(&view);
+
+    std::list<CTransactionRef> removed;
+    pool.remove(txChild, removed);
+    BOOST_CHECK_EQUAL(removed.size(), 1);
+    pool.check(&view);
+    pool.remove(txs[1], removed);
+    pool.check(&view);
+    BOOST_CHECK_EQUAL(pool.size(), 3);
+}
+
+BOOST_AUTO_TEST_CASE(MempoolRemoveExpiredTest)
+{
+    CTxMemPool pool(CFeeRate(0));
+    TestMemPoolEntryHelper entry;
+    entry.nFee = 10000LL;
+
+    // Transactions expiring at heights 0 (never) to 4.
+    std::vector<CMutableTransaction> txs(5);
+    for (int i = 0; i < 5; i++) {
+        txs[i].vin.resize(1);
+        txs[i].vin[0].scriptSig = CScript() << OP_11;
+        txs[i].vin[0].prevout.n = i;
+        txs[i].vout.resize(1);
+        txs[i].vout[0].scriptPubKey = CScript() << OP_11 << OP_EQUAL;
+        txs[i].vout[0].nValue = 10 * COIN;
+        txs[i].nExpiryHeight = i;
+        pool.addUnchecked(txs[i].GetHash(), entry.FromTx(txs[i]));
+    }
+    // A child that never expires, of the transaction expiring at height 2.
+    CMutableTransaction txChild;
+    txChild.vin.resize(1);
+    txChild.vin[0].scriptSig = CScript() << OP_11;
+    txChild.vin[0].prevout.hash = txs[2].GetHash();
+    txChild.vout.resize(1);
+    txChild.vout[0].scriptPubKey = CScript() << OP_11 << OP_EQUAL;
+    txChild.vout[0].nValue = 9 * COIN;
+    pool.addUnchecked(txChild.GetHash(), entry.FromTx(txChild));
+    BOOST_CHECK_EQUAL(pool.size(), 6);
+
+    // Nothing has expired at heights 0 and 1.
+    BOOST_CHECK(pool.removeExpired(0).empty());
+    BOOST_CHECK(pool.removeExpired(1).empty());
+    BOOST_CHECK_EQUAL(pool.size(), 6);
+
+    // At height 3 the transactions expiring at heights 1 and 2 have expired,
+    // and the child is removed with its parent.
+    std::vector<uint256> ids = pool.removeExpired(3);
+    BOOST_CHECK_EQUAL(ids.size(), 2);
+    BOOST_CHECK(ids[0] == txs[1].GetHash());
+    BOOST_CHECK(ids[1] == txs[2].GetHash());
+    BOOST_CHECK_EQUAL(pool.size(), 3);
+    BOOST_CHECK(!pool.exists(txChild.GetHash()));
+
+    // The transaction that never expires is left behind.
+    ids = pool.removeExpired(1000);
+    BOOST_CHECK_EQUAL(ids.size(), 2);
+    BOOST_CHECK_EQUAL(pool.size(), 1);
+    BOOST_CHECK(pool.exists(txs[0].GetHash()));
+}
+
 BOOST_AUTO_TEST_CASE(RemoveWithoutBranchId) {
     CTxMemPool pool(CFeeRate(0));
     TestMemPoolEntryHelper entry;
@@ -374,6 +687,68 @@ BOOST_AUTO_TEST_CASE(RemoveWithoutBranchId) {
     BOOST_CHECK_EQUAL(pool.size(), 0);
 }
 
+BOOST_AUTO_TEST_CASE(PrecomputedDataReuse) {
+    CTxMemPool pool(CFeeRate(0));
+    TestMemPoolEntryHelper entry;
+
+    CMutableTransaction mtx;
+    mtx.vin.resize(1);
+    mtx.vin[0].prevout = COutPoint(GetRandHash(), 0);
+    mtx.vin[0].scriptSig = CScript() << OP_11;
+    mtx.vout.resize(1);
+    mtx.vout[0].scriptPubKey = CScript() << OP_11 << OP_EQUAL;
+    mtx.vout[0].nValue = COIN;
+    CTransaction tx(mtx);
+
+    std::vector<CTxOut> allPrevOutputs;
+    allPrevOutputs.emplace_back(COIN, CScript() << OP_TRUE);
+    auto txdata = std::make_shared<PrecomputedTransactionData>(tx, allPrevOutputs);
+
+    // Unknown transactions have nothing to reuse.
+    BOOST_CHECK(pool.getPrecomputedData(tx) == nullptr);
+
+    CTxMemPoolEntry poolEntry = entry.FromTx(mtx);
+    poolEntry.SetPrecomputedData(txdata);
+    pool.addUnchecked(tx.GetHash(), poolEntry);
+    BOOST_CHECK(pool.getPrecomputedData(tx) == txdata);
+
+    // Entries added without precomputed data return none.
+    CMutableTransaction mtx2 = mtx;
+    mtx2.vout[0].nValue = 2 * COIN;
+    pool.addUnchecked(mtx2.GetHash(), entry.FromTx(mtx2));
+    BOOST_CHECK(pool.getPrecomputedData(CTransaction(mtx2)) == nullptr);
+
+    std::list<CTransactionRef> removed;
+    pool.remove(tx, removed);
+    BOOST_CHECK(pool.getPrecomputedData(tx) == nullptr);
+}
+
+BOOST_AUTO_TEST_CASE(IsValidated) {
+    CTxMemPool pool(CFeeRate(0));
+    TestMemPoolEntryHelper entry;
+
+    CMutableTransaction mtx;
+    mtx.vin.resize(1);
+    mtx.vin[0].prevout = COutPoint(GetRandHash(), 0);
+    mtx.vin[0].scriptSig = CScript() << OP_11;
+    mtx.vout.resize(1);
+    mtx.vout[0].scriptPubKey = CScript() << OP_11 << OP_EQUAL;
+    mtx.vout[0].nValue = COIN;
+    CTransaction tx(mtx);
+
+    BOOST_CHECK(!pool.isValidated(tx, SPROUT_BRANCH_ID));
+
+    pool.addUnchecked(tx.GetHash(), entry.BranchId(SPROUT_BRANCH_ID).FromTx(mtx));
+    BOOST_CHECK(pool.isValidated(tx, SPROUT_BRANCH_ID));
+
+    // Transactions validated in a different epoch must be re-verified.
+    BOOST_CHECK(!pool.isValidated(tx, NetworkUpgradeInfo[Consensus::UPGRADE_OVERWINTER].nBranchId));
+
+    std::list<CTransactionRef> removed;
+    pool.remove(tx, removed);
+    BOOST_CHECK(!pool.isValidated(tx, SPROUT_BRANCH_ID));
+}
+
 // Test that nCheckFrequency is set correctly when calling setSanityCheck().
 // https://github.com/zcash/zcash/issues/3134
 BOOST_AUTO_TEST_CASE(SetSanityCheck) {
@@ -245,6 +245,16 @@ BOOST_AUTO_TEST_CASE(merkle_test)
                     BOOST_CHECK(oldBranch == newBranch);
                     BOOST_CHECK(ComputeMerkleRootFromBranch(block.vtx[mtx].GetHash(), newBranch, mtx) == oldRoot);
                 }
+                // Every level of the tree is computed as by the old mechanism.
+                std::vector<uint256> leaves;
+                for (const CTransaction& tx : block.vtx) {
+                    leaves.push_back(tx.GetHash());
+                }
+                std::vector<uint256> levelsTree;
+                for (const std::vector<uint256>& level : ComputeMerkleLevels(leaves)) {
+                    levelsTree.insert(levelsTree.end(), level.begin(), level.end());
+                }
+                BOOST_CHECK(levelsTree == merkleTree);
             }
         }
     }
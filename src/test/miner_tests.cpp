@@ -475,6 +475,45 @@ BOOST_AUTO_TEST_CASE(CreateNewBlock_validity)
     delete pblocktemplate;
     mempool.clear();
 
+    // Transactions that enter the mempool later can be added to the template.
+    {
+        BlockAssembler assembler(chainparams);
+        std::vector<CTxMemPoolEntry> vLater;
+        PrepareMempool(20, MINIMUM_FEE, [&](size_t i, auto& entry, auto& tx) {
+            if (i < 10) {
+                mempool.addUnchecked(tx.GetHash(), entry.SigOps(20).FromTx(tx));
+            } else {
+                vLater.push_back(entry.SigOps(20).FromTx(tx));
+            }
+        });
+        std::unique_ptr<CBlockTemplate> prev(assembler.CreateNewBlock(scriptPubKey));
+        BOOST_CHECK_EQUAL(11, prev->block.vtx.size());
+
+        std::vector<CTxMemPool::txiter> vNew;
+        for (const CTxMemPoolEntry& later : vLater) {
+            mempool.addUnchecked(later.GetTx().GetHash(), later);
+            vNew.push_back(mempool.mapTx.find(later.GetTx().GetHash()));
+        }
+        std::unique_ptr<CBlockTemplate> updated(assembler.UpdateNewBlock(*prev, scriptPubKey, vNew));
+        BOOST_REQUIRE(updated);
+        BOOST_CHECK_EQUAL(21, updated->block.vtx.size());
+        BOOST_CHECK_EQUAL(-20 * MINIMUM_FEE, updated->vTxFees[0]);
+        BOOST_CHECK(updated->block.vtx[20].GetHash() == vLater.back().GetTx().GetHash());
+        mempool.clear();
+    }
+
+    // A parent that pays no fee is added along with a child that pays the
+    // conventional fee for both of them.
+    PrepareMempool(2, MINIMUM_FEE, [&](size_t i, auto& entry, auto& tx) {
+        mempool.addUnchecked(tx.GetHash(), entry.Fee(i == 0 ? 0 : 2 * MINIMUM_FEE).SigOps(20).FromTx(tx));
+    });
+    BOOST_CHECK(pblocktemplate = BlockAssembler(chainparams).CreateNewBlock(scriptPubKey));
+    BOOST_CHECK_EQUAL(3, pblocktemplate->block.vtx.size());
+    BOOST_CHECK_EQUAL(0, pblocktemplate->vTxFees[1]);
+    BOOST_CHECK_EQUAL(-2 * MINIMUM_FEE, pblocktemplate->vTxFees[0]);
+    delete pblocktemplate;
+    mempool.clear();
+
     tx.vin[0].scriptSig = CScript();
     // 18 * (520char + DROP) + OP_1 = 9433 bytes
     std::vector<unsigned char> vchData(520);
@@ -143,4 +143,65 @@ BOOST_AUTO_TEST_CASE(caddrdb_read_corrupted)
     BOOST_CHECK(addrman2.size() == 0);
 }
 
+BOOST_AUTO_TEST_CASE(cnetmessage_recv_buffer_reuse)
+{
+    // Larger than RECV_BUFFER_PREALLOCATE_SIZE, so that the first message
+    // has to grow its buffer.
+    const unsigned int nSize = 300 * 1000;
+    std::vector<char> vPayload(nSize);
+    for (unsigned int i = 0; i < nSize; i++)
+        vPayload[i] = (char)(i * 7);
+    CDataStream ssHeader(SER_NETWORK, PROTOCOL_VERSION);
+    ssHeader << CMessageHeader(Params().MessageStart(), "block", nSize);
+    BOOST_REQUIRE_EQUAL(ssHeader.size(), 24U);
+
+    {
+        CNetMessage msg(Params().MessageStart(), SER_NETWORK, PROTOCOL_VERSION);
+        BOOST_CHECK_EQUAL(msg.readHeader(&ssHeader[0], ssHeader.size()), 24);
+        BOOST_CHECK(!msg.complete());
+        unsigned int nPos = 0;
+        while (nPos < nSize) {
+            int nRead = msg.readData(&vPayload[nPos], std::min(nSize - nPos, 1000U));
+            BOOST_REQUIRE(nRead > 0);
+            nPos += nRead;
+        }
+        BOOST_CHECK(msg.complete());
+        BOOST_CHECK(std::equal(msg.vRecv.begin(), msg.vRecv.end(), vPayload.begin(), vPayload.end()));
+    }
+
+    // The buffer of the first message is reused for the second, so it is
+    // large enough as soon as the header has been read.
+    CNetMessage msg(Params().MessageStart(), SER_NETWORK, PROTOCOL_VERSION);
+    BOOST_CHECK_EQUAL(msg.readHeader(&ssHeader[0], ssHeader.size()), 24);
+    CPublicSerializeData buf;
+    msg.vRecv.Swap(buf);
+    BOOST_CHECK(buf.capacity() >= nSize);
+}
+
+BOOST_AUTO_TEST_CASE(cnetmessage_hash_as_received)
+{
+    std::vector<char> vPayload(10000);
+    for (size_t i = 0; i < vPayload.size(); i++)
+        vPayload[i] = (char)(i * 13);
+    CDataStream ssHeader(SER_NETWORK, PROTOCOL_VERSION);
+    ssHeader << CMessageHeader(Params().MessageStart(), "tx", vPayload.size());
+
+    // The data arrives in pieces of uneven sizes.
+    CNetMessage msg(Params().MessageStart(), SER_NETWORK, PROTOCOL_VERSION);
+    BOOST_CHECK_EQUAL(msg.readHeader(&ssHeader[0], ssHeader.size()), 24);
+    unsigned int nPos = 0;
+    unsigned int nPiece = 1;
+    while (nPos < vPayload.size()) {
+        int nRead = msg.readData(&vPayload[nPos], std::min<unsigned int>(vPayload.size() - nPos, nPiece));
+        BOOST_REQUIRE(nRead > 0);
+        nPos += nRead;
+        nPiece = nPiece * 3 + 1;
+    }
+    BOOST_REQUIRE(msg.complete());
+    uint256 hash = Hash(vPayload.begin(), vPayload.end());
+    BOOST_CHECK(msg.GetMessageHash() == hash);
+    // It is only computed once.
+    BOOST_CHECK(msg.GetMessageHash() == hash);
+}
+
 BOOST_AUTO_TEST_SUITE_END()
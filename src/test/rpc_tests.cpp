@@ -5,6 +5,7 @@
 
 #include "rpc/server.h"
 #include "rpc/client.h"
+#include "rpc/jsonwriter.h"
 
 #include "experimental_features.h"
 #include "key_io.h"
@@ -17,6 +18,8 @@
 
 #include <boost/test/unit_test.hpp>
 
+#include <thread>
+
 #include <univalue.h>
 
 using namespace std;
@@ -67,6 +70,11 @@ BOOST_AUTO_TEST_CASE(rpc_rawparams)
     BOOST_CHECK_THROW(CallRPC("sendrawtransaction null"), runtime_error);
     BOOST_CHECK_THROW(CallRPC("sendrawtransaction DEADBEEF"), runtime_error);
     BOOST_CHECK_THROW(CallRPC(string("sendrawtransaction ")+rawtx+" extra"), runtime_error);
+    BOOST_CHECK_THROW(CallRPC("sendrawtransactions"), runtime_error);
+    BOOST_CHECK_THROW(CallRPC("sendrawtransactions null"), runtime_error);
+    BOOST_CHECK_THROW(CallRPC(string("sendrawtransactions ")+rawtx), runtime_error);
+    BOOST_CHECK_THROW(CallRPC("sendrawtransactions [\"DEADBEEF\"]"), runtime_error);
+    BOOST_CHECK_THROW(CallRPC(string("sendrawtransactions [\"")+rawtx+"\"] false extra"), runtime_error);
 }
 
 BOOST_AUTO_TEST_CASE(rpc_rawsign)
@@ -184,6 +192,94 @@ BOOST_AUTO_TEST_CASE(json_parse_errors)
     BOOST_CHECK(!ParseNonRFCJSONValue("3J98t1WpEZ73CNmQviecrnyiWrnqRhWNL").has_value());
 }
 
+BOOST_AUTO_TEST_CASE(json_writer)
+{
+    UniValue inner(UniValue::VOBJ);
+    inner.pushKV("a\"b", 1);
+    inner.pushKV("c", UniValue(UniValue::VARR));
+
+    std::string strJSON;
+    JSONWriter out(strJSON);
+    out.BeginObject();
+    out.KV("x", "y");
+    out.Key("list");
+    out.BeginArray();
+    out.Value(inner);
+    out.BeginObject();
+    out.EndObject();
+    out.Value(true);
+    out.EndArray();
+    out.KV("z", ValueFromAmount(12345));
+    out.EndObject();
+
+    UniValue list(UniValue::VARR);
+    list.push_back(inner);
+    list.push_back(UniValue(UniValue::VOBJ));
+    list.push_back(true);
+    UniValue expected(UniValue::VOBJ);
+    expected.pushKV("x", "y");
+    expected.pushKV("list", list);
+    expected.pushKV("z", ValueFromAmount(12345));
+    BOOST_CHECK_EQUAL(strJSON, expected.write());
+}
+
+BOOST_AUTO_TEST_CASE(rpc_batch_order)
+{
+    // decodescript may run in parallel; an unknown method is run in order.
+    UniValue vReq(UniValue::VARR);
+    for (int i = 0; i < 20; i++) {
+        UniValue req(UniValue::VOBJ);
+        req.pushKV("id", i);
+        req.pushKV("method", i == 7 ? "nosuchmethod" : "decodescript");
+        UniValue params(UniValue::VARR);
+        params.push_back(HexStr(std::vector<unsigned char>(1, 0x51 + i % 16)));
+        req.pushKV("params", params);
+        vReq.push_back(req);
+    }
+
+    std::vector<std::thread> threads;
+    auto enqueue = [&threads](std::function<void()> fn) {
+        threads.emplace_back(fn);
+        return true;
+    };
+    for (bool fParallel : {false, true}) {
+        UniValue ret;
+        BOOST_CHECK(ret.read(fParallel ? JSONRPCExecBatch(vReq, enqueue) : JSONRPCExecBatch(vReq)));
+        for (auto& thread : threads) {
+            thread.join();
+        }
+        threads.clear();
+
+        BOOST_REQUIRE_EQUAL(ret.size(), 20);
+        for (int i = 0; i < 20; i++) {
+            BOOST_CHECK_EQUAL(find_value(ret[i], "id").get_int(), i);
+            if (i == 7) {
+                BOOST_CHECK_EQUAL(find_value(find_value(ret[i], "error"), "code").get_int(), RPC_METHOD_NOT_FOUND);
+            } else {
+                BOOST_CHECK_EQUAL(find_value(find_value(ret[i], "result"), "asm").get_str(), strprintf("%d", 1 + i % 16));
+            }
+        }
+    }
+}
+
+BOOST_AUTO_TEST_CASE(rpc_method_limits)
+{
+    std::string strError;
+    BOOST_CHECK(!SetRPCMethodLimits({"decodescript"}, strError));
+    BOOST_CHECK(!SetRPCMethodLimits({"decodescript:0"}, strError));
+    BOOST_CHECK(!SetRPCMethodLimits({"decodescript:x"}, strError));
+    BOOST_CHECK(!SetRPCMethodLimits({"nosuchmethod:1"}, strError));
+    BOOST_CHECK(SetRPCMethodLimits({"decodescript:1", "blockchain:2"}, strError));
+
+    // A call is only counted while it runs, including when it fails.
+    for (int i = 0; i < 3; i++) {
+        BOOST_CHECK_NO_THROW(CallRPC("decodescript 51"));
+        BOOST_CHECK_THROW(CallRPC("decodescript nothex"), runtime_error);
+    }
+
+    BOOST_CHECK(SetRPCMethodLimits({}, strError));
+}
+
 BOOST_AUTO_TEST_CASE(rpc_ban)
 {
     BOOST_CHECK_NO_THROW(CallRPC(string("clearbanned")));
@@ -8,6 +8,8 @@
 
 #include "test/test_bitcoin.h"
 
+#include <atomic>
+
 #include <boost/bind/bind.hpp>
 #include <boost/random/mersenne_twister.hpp>
 #include <boost/random/uniform_int_distribution.hpp>
@@ -108,4 +110,65 @@ BOOST_AUTO_TEST_CASE(manythreads)
     BOOST_CHECK_EQUAL(counterSum, 200);
 }
 
+static void recordTask(std::vector<int>& order, int n)
+{
+    order.push_back(n);
+}
+
+BOOST_AUTO_TEST_CASE(priorities)
+{
+    CScheduler scheduler;
+    std::vector<int> order;
+
+    // All of these are due, so they run in order of priority, and then
+    // of time, regardless of the order they were scheduled in.
+    boost::chrono::system_clock::time_point now = boost::chrono::system_clock::now();
+    scheduler.schedule(boost::bind(&recordTask, boost::ref(order), 1), now - boost::chrono::seconds(4), CScheduler::PRIORITY_LOW);
+    scheduler.schedule(boost::bind(&recordTask, boost::ref(order), 2), now - boost::chrono::seconds(3));
+    scheduler.schedule(boost::bind(&recordTask, boost::ref(order), 3), now - boost::chrono::seconds(1), CScheduler::PRIORITY_HIGH);
+    scheduler.schedule(boost::bind(&recordTask, boost::ref(order), 4), now - boost::chrono::seconds(2), CScheduler::PRIORITY_HIGH);
+    // Not due yet, so it runs last even though its priority is high.
+    scheduler.schedule(boost::bind(&recordTask, boost::ref(order), 5), now + boost::chrono::milliseconds(10), CScheduler::PRIORITY_HIGH);
+
+    scheduler.stop(true);
+    scheduler.serviceQueue();
+
+    BOOST_CHECK(order == std::vector<int>({4, 3, 2, 1, 5}));
+}
+
+static void serialTask(std::atomic<int>& running, std::vector<int>& order, int n)
+{
+    BOOST_CHECK_EQUAL(running.fetch_add(1), 0);
+    MicroSleep(n % 3 * 100);
+    order.push_back(n);
+    running--;
+}
+
+BOOST_AUTO_TEST_CASE(serial_queue)
+{
+    CScheduler scheduler;
+    CSerialTaskQueue queue(scheduler);
+    std::atomic<int> running{0};
+    std::vector<int> order;
+
+    for (int i = 0; i < 50; i++) {
+        queue.add(boost::bind(&serialTask, boost::ref(running), boost::ref(order), i));
+    }
+    BOOST_CHECK_EQUAL(queue.size(), 50);
+
+    // The tasks of the queue run one at a time, in order, although the
+    // scheduler has several threads.
+    boost::thread_group threads;
+    for (int i = 0; i < 4; i++)
+        threads.create_thread(boost::bind(&CScheduler::serviceQueue, &scheduler));
+    scheduler.stop(true);
+    threads.join_all();
+
+    BOOST_CHECK_EQUAL(queue.size(), 0);
+    BOOST_CHECK_EQUAL(order.size(), 50);
+    for (int i = 0; i < (int)order.size(); i++) {
+        BOOST_CHECK_EQUAL(order[i], i);
+    }
+}
+
 BOOST_AUTO_TEST_SUITE_END()
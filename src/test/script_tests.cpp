@@ -93,6 +93,20 @@ void DoTest(const CScript& scriptPubKey, const CScript& scriptSig, int flags, ui
         0, flags,
         consensusBranchId,
         NULL) == expect,message);
+    CDataStream streamPrevOutputs(SER_NETWORK, PROTOCOL_VERSION);
+    streamPrevOutputs << txCredit.vout;
+    unsigned char result = 2;
+    zcash_script_error batchErr;
+    BOOST_CHECK_MESSAGE(zcash_script_verify_batch(
+        (const unsigned char*)&stream[0], stream.size(),
+        (const unsigned char*)&streamPrevOutputs[0], streamPrevOutputs.size(),
+        flags,
+        consensusBranchId,
+        2,
+        &result, 1,
+        &batchErr) == expect, message);
+    BOOST_CHECK_EQUAL(batchErr, zcash_script_ERR_OK);
+    BOOST_CHECK_EQUAL(result, expect ? 1 : 0);
 #endif
 }
 
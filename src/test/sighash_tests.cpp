@@ -7,6 +7,7 @@
 #include "consensus/validation.h"
 #include "test/data/sighash.json.h"
 #include "main.h"
+#include "primitives/transaction_view.h"
 #include "script/interpreter.h"
 #include "script/script.h"
 #include "serialize.h"
@@ -323,6 +324,20 @@ BOOST_AUTO_TEST_CASE(sighash_from_data)
         const PrecomputedTransactionData txdata(tx, {});
         sh = SignatureHash(scriptCode, tx, nIn, nHashType, 0, consensusBranchId, txdata);
         BOOST_CHECK_MESSAGE(sh.GetHex() == sigHashHex, strTest);
+
+        // The view skips the shielded components to the end of the
+        // transaction, and computes the same txid.
+        std::vector<unsigned char> vRawTx = ParseHex(raw_tx);
+        SpanReader reader(SER_NETWORK, PROTOCOL_VERSION, vRawTx.data(), vRawTx.size());
+        CTransactionView view(reader);
+        BOOST_CHECK_MESSAGE(reader.empty(), strTest);
+        BOOST_CHECK_EQUAL(view.GetSerializeSize(), vRawTx.size());
+        BOOST_CHECK(view.vin == tx.vin);
+        BOOST_CHECK(view.vout == tx.vout);
+        BOOST_CHECK_EQUAL(view.nLockTime, tx.nLockTime);
+        BOOST_CHECK_EQUAL(view.nExpiryHeight, tx.nExpiryHeight);
+        BOOST_CHECK_EQUAL(view.GetHash().GetHex(), tx.GetHash().GetHex());
+        BOOST_CHECK(view.ToTransaction() == tx);
     }
 }
 BOOST_AUTO_TEST_SUITE_END()
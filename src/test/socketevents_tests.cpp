@@ -0,0 +1,70 @@
+// Copyright (c) 2026 The Zcash developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or https://www.opensource.org/licenses/mit-license.php .
+
+#include "socketevents.h"
+#include "test/test_bitcoin.h"
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_FIXTURE_TEST_SUITE(socketevents_tests, BasicTestingSetup)
+
+#ifndef WIN32
+
+static int ReadyEvents(const std::vector<std::pair<uint64_t, int>>& vReady, uint64_t id)
+{
+    int flags = 0;
+    for (const auto& ready : vReady) {
+        if (ready.first == id)
+            flags |= ready.second;
+    }
+    return flags;
+}
+
+BOOST_AUTO_TEST_CASE(socketevents_recv_send)
+{
+    int fds[2];
+    BOOST_REQUIRE(socketpair(AF_UNIX, SOCK_STREAM, 0, fds) == 0);
+
+    CSocketEvents events;
+    BOOST_REQUIRE(events.IsValid());
+    std::vector<std::pair<uint64_t, int>> vReady;
+
+    // Nothing to receive yet.
+    BOOST_CHECK(events.Set(7, fds[0], SOCKET_EVENT_RECV));
+    BOOST_CHECK(events.Wait(0, vReady));
+    BOOST_CHECK_EQUAL(ReadyEvents(vReady, 7), 0);
+
+    char ch = 'x';
+    BOOST_REQUIRE(send(fds[1], &ch, 1, 0) == 1);
+    BOOST_CHECK(events.Wait(1000, vReady));
+    BOOST_CHECK(ReadyEvents(vReady, 7) & SOCKET_EVENT_RECV);
+
+    // Readiness is level-triggered, so it is reported until the data is read.
+    BOOST_CHECK(events.Wait(0, vReady));
+    BOOST_CHECK(ReadyEvents(vReady, 7) & SOCKET_EVENT_RECV);
+    BOOST_REQUIRE(recv(fds[0], &ch, 1, 0) == 1);
+    BOOST_CHECK(events.Wait(0, vReady));
+    BOOST_CHECK_EQUAL(ReadyEvents(vReady, 7), 0);
+
+    // Changing the events of a registered socket.
+    BOOST_CHECK(events.Set(7, fds[0], SOCKET_EVENT_SEND));
+    BOOST_CHECK(events.Wait(1000, vReady));
+    BOOST_CHECK(ReadyEvents(vReady, 7) & SOCKET_EVENT_SEND);
+    BOOST_CHECK(!(ReadyEvents(vReady, 7) & SOCKET_EVENT_RECV));
+
+    // A hang-up is reported.
+    BOOST_CHECK(events.Set(7, fds[0], SOCKET_EVENT_RECV));
+    close(fds[1]);
+    BOOST_CHECK(events.Wait(1000, vReady));
+    BOOST_CHECK(ReadyEvents(vReady, 7) != 0);
+
+    close(fds[0]);
+    events.Remove(7);
+    BOOST_CHECK(events.Wait(0, vReady));
+    BOOST_CHECK_EQUAL(ReadyEvents(vReady, 7), 0);
+}
+
+#endif
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -2,8 +2,12 @@
 // Distributed under the MIT software license, see the accompanying
 // file COPYING or https://www.opensource.org/licenses/mit-license.php.
 
+#include "blockreader.h"
+#include "chainparams.h"
+#include "clientversion.h"
 #include "fs.h"
 #include "main.h"
+#include "streams.h"
 #include "test/test_bitcoin.h"
 
 #include <boost/test/unit_test.hpp>
@@ -253,4 +257,108 @@ BOOST_AUTO_TEST_CASE(streams_buffered_file_rand)
     fs::remove("streams_test_tmp");
 }
 
+BOOST_AUTO_TEST_CASE(streams_span_reader)
+{
+    CDataStream ss(SER_DISK, CLIENT_VERSION);
+    ss << uint32_t(0x01020304) << std::string("span") << uint8_t(5);
+    std::vector<unsigned char> data(ss.begin(), ss.end());
+
+    SpanReader reader(SER_DISK, CLIENT_VERSION, data.data(), data.size());
+    BOOST_CHECK_EQUAL(reader.GetType(), SER_DISK);
+    BOOST_CHECK_EQUAL(reader.GetVersion(), CLIENT_VERSION);
+    uint32_t n;
+    std::string str;
+    reader >> n >> str;
+    BOOST_CHECK_EQUAL(n, 0x01020304U);
+    BOOST_CHECK_EQUAL(str, "span");
+    BOOST_CHECK_EQUAL(reader.size(), 1U);
+
+    // Reading past the end throws, and leaves the reader where it was.
+    BOOST_CHECK_THROW(reader >> n, std::ios_base::failure);
+    BOOST_CHECK_EQUAL(reader.size(), 1U);
+    uint8_t b;
+    reader >> b;
+    BOOST_CHECK_EQUAL(b, 5);
+    BOOST_CHECK(reader.empty());
+}
+
+BOOST_AUTO_TEST_CASE(streams_block_reader)
+{
+    const CChainParams& chainparams = Params();
+    CBlock block;
+    block.nVersion = 4;
+    block.nTime = 1234;
+    CMutableTransaction mtx;
+    mtx.vin.resize(1);
+    mtx.vout.resize(1);
+    block.vtx.push_back(CTransaction(mtx));
+
+    // Write the block at the start of a block file of its own.
+    CDiskBlockPos pos(9999, 0);
+    BOOST_REQUIRE(WriteBlockToDisk(block, pos, chainparams.MessageStart()));
+
+    CDataStream ss(SER_DISK, CLIENT_VERSION);
+    ss << block;
+    std::vector<uint8_t> raw;
+    BOOST_REQUIRE(ReadRawBlockFromDisk(raw, pos, chainparams.MessageStart()));
+    BOOST_CHECK(raw == std::vector<uint8_t>(ss.begin(), ss.end()));
+
+    const unsigned char* pch;
+    unsigned int nSize;
+    bool fCompressed;
+    std::shared_ptr<CBlockFileMapping> mapping = blockReader.MapBlock(pos, pch, nSize, fCompressed);
+#ifndef WIN32
+    BOOST_REQUIRE(mapping);
+    BOOST_CHECK(!fCompressed);
+    BOOST_CHECK_EQUAL(nSize, ss.size());
+    CBlock block2;
+    SpanReader reader(SER_DISK, CLIENT_VERSION, pch, nSize);
+    reader >> block2;
+    BOOST_CHECK(block2.GetHash() == block.GetHash());
+#endif
+
+    // Cached blocks are forgotten with their file.
+    size_t nUsage = blockReader.GetCacheUsage();
+    blockReader.AddToCache(pos, block);
+    std::shared_ptr<const CBlock> pcached = blockReader.GetCached(pos);
+    BOOST_REQUIRE(pcached);
+    BOOST_CHECK(pcached->GetHash() == block.GetHash());
+    BOOST_CHECK(blockReader.GetCacheUsage() > nUsage);
+    blockReader.ForgetFile(pos.nFile);
+    BOOST_CHECK(!blockReader.GetCached(pos));
+    BOOST_CHECK_EQUAL(blockReader.GetCacheUsage(), nUsage);
+
+    mapping.reset();
+    fs::remove(GetBlockPosFilename(pos, "blk"));
+}
+
+BOOST_AUTO_TEST_CASE(streams_recent_blocks)
+{
+    CRecentBlocks recent;
+    std::vector<std::shared_ptr<const CBlock>> vBlocks;
+    for (size_t i = 0; i <= MAX_RECENT_BLOCKS; i++) {
+        std::shared_ptr<CBlock> pblock = std::make_shared<CBlock>();
+        pblock->nTime = i;
+        vBlocks.push_back(pblock);
+        recent.Add(pblock->GetHash(), pblock);
+    }
+
+    // The oldest block was dropped; the others are shared, not copied.
+    BOOST_CHECK(!recent.Get(vBlocks[0]->GetHash()));
+    BOOST_CHECK(!recent.GetRaw(vBlocks[0]->GetHash()));
+    BOOST_CHECK(recent.Get(vBlocks[1]->GetHash()) == vBlocks[1]);
+    BOOST_CHECK(recent.Get(vBlocks.back()->GetHash()) == vBlocks.back());
+
+    // Serializations are made once and then shared.
+    CDataStream ss(SER_DISK, CLIENT_VERSION);
+    ss << *vBlocks.back();
+    std::shared_ptr<const std::vector<uint8_t>> pvRaw = recent.GetRaw(vBlocks.back()->GetHash());
+    BOOST_REQUIRE(pvRaw);
+    BOOST_CHECK(*pvRaw == std::vector<uint8_t>(ss.begin(), ss.end()));
+    BOOST_CHECK(recent.GetRaw(vBlocks.back()->GetHash()) == pvRaw);
+
+    recent.Clear();
+    BOOST_CHECK(!recent.Get(vBlocks.back()->GetHash()));
+}
+
 BOOST_AUTO_TEST_SUITE_END()
@@ -7,6 +7,10 @@
 
 #include <boost/test/unit_test.hpp>
 
+#include <atomic>
+#include <thread>
+#include <tuple>
+
 namespace {
 template <typename MutexType>
 void TestPotentialDeadLockDetected(MutexType& mutex1, MutexType& mutex2)
@@ -49,4 +53,59 @@ BOOST_AUTO_TEST_CASE(potential_deadlock_detected)
     #endif
 }
 
+BOOST_AUTO_TEST_CASE(lock_stats)
+{
+    Mutex profiled_mutex;
+    auto find_stats = []() {
+        uint64_t nAcquisitions = 0, nContended = 0;
+        int64_t nWaitMicros = 0, nHoldMicros = 0;
+        for (const LockSiteStats& site : GetLockStats()) {
+            if (site.name == "profiled_mutex") {
+                nAcquisitions += site.nAcquisitions;
+                nContended += site.nContended;
+                nWaitMicros += site.nWaitMicros;
+                nHoldMicros += site.nHoldMicros;
+            }
+        }
+        return std::make_tuple(nAcquisitions, nContended, nWaitMicros, nHoldMicros);
+    };
+
+    // Not recorded while profiling is disabled.
+    {
+        LOCK(profiled_mutex);
+    }
+    BOOST_CHECK_EQUAL(std::get<0>(find_stats()), 0);
+
+    EnableLockStats(true);
+    std::atomic<bool> fLocked{false};
+    std::thread holder([&]() {
+        LOCK(profiled_mutex);
+        fLocked = true;
+        std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    });
+    while (!fLocked) {
+        std::this_thread::yield();
+    }
+    {
+        LOCK(profiled_mutex);
+    }
+    holder.join();
+    {
+        TRY_LOCK(profiled_mutex, lockProfiled);
+        BOOST_CHECK(lockProfiled);
+    }
+    EnableLockStats(false);
+
+    uint64_t nAcquisitions, nContended;
+    int64_t nWaitMicros, nHoldMicros;
+    std::tie(nAcquisitions, nContended, nWaitMicros, nHoldMicros) = find_stats();
+    BOOST_CHECK_EQUAL(nAcquisitions, 3);
+    BOOST_CHECK_EQUAL(nContended, 1);
+    BOOST_CHECK(nWaitMicros > 0);
+    BOOST_CHECK(nHoldMicros >= 20000);
+
+    ResetLockStats();
+    BOOST_CHECK_EQUAL(std::get<0>(find_stats()), 0);
+}
+
 BOOST_AUTO_TEST_SUITE_END()
@@ -64,7 +64,8 @@ BasicTestingSetup::BasicTestingSetup(const std::string& chainName)
     //     pTracingHandle = tracing_init(
     //         nullptr, 0,
     //         initialFilter.c_str(),
-    //         false);
+    //         false,
+    //         nullptr, 0);
     // }
 
     fCheckBlockIndex = true;
@@ -108,6 +109,7 @@ TestingSetup::TestingSetup(const std::string& chainName) : BasicTestingSetup(cha
         fs::create_directories(pathTemp);
         mapArgs["-datadir"] = pathTemp.string();
         pblocktree = new CBlockTreeDB(1 << 20, true);
+        pinsightdb = new CInsightIndexDB(1 << 20, true);
         pcoinsdbview = new CCoinsViewDB(1 << 23, true);
         pcoinsTip = new CCoinsViewCache(pcoinsdbview);
         InitBlockIndex(chainparams);
@@ -119,6 +121,10 @@ TestingSetup::TestingSetup(const std::string& chainName) : BasicTestingSetup(cha
         nScriptCheckThreads = 3;
         for (int i=0; i < nScriptCheckThreads-1; i++)
             threadGroup.create_thread(&ThreadScriptCheck);
+        for (int i=0; i < nScriptCheckThreads-1; i++)
+            threadGroup.create_thread(&ThreadProofCheck);
+        for (int i=0; i < nScriptCheckThreads-1; i++)
+            threadGroup.create_thread(&ThreadCoinsPrefetch);
         RegisterNodeSignals(GetNodeSignals());
 }
 
@@ -130,6 +136,7 @@ TestingSetup::~TestingSetup()
         UnloadBlockIndex();
         delete pcoinsTip;
         delete pcoinsdbview;
+        delete pinsightdb;
         delete pblocktree;
 
         // Restore the previous current path so temporary directory can be deleted
@@ -154,10 +161,10 @@ TestChain100Setup::TestChain100Setup() : TestingSetup(CBaseChainParams::REGTEST)
 
 //
 // Create a new block with just given transactions, coinbase paying to
-// scriptPubKey, and try to add it to the current chain.
+// scriptPubKey, on top of the current chain tip.
 //
 CBlock
-TestChain100Setup::CreateAndProcessBlock(const std::vector<CMutableTransaction>& txns, const CScript& scriptPubKey)
+TestChain100Setup::CreateBlock(const std::vector<CMutableTransaction>& txns, const CScript& scriptPubKey)
 {
     const CChainParams& chainparams = Params();
     unsigned int n = chainparams.GetConsensus().nEquihashN;
@@ -205,14 +212,25 @@ TestChain100Setup::CreateAndProcessBlock(const std::vector<CMutableTransaction>&
         found = EhBasicSolveUncancellable(n, k, curr_state, validBlock);
     } while (!found);
 
-    CValidationState state;
-    ProcessNewBlock(state, chainparams, NULL, &block, true, NULL);
-
     CBlock result = block;
     delete pblocktemplate;
     return result;
 }
 
+//
+// Create a new block with just given transactions, coinbase paying to
+// scriptPubKey, and try to add it to the current chain.
+//
+CBlock
+TestChain100Setup::CreateAndProcessBlock(const std::vector<CMutableTransaction>& txns, const CScript& scriptPubKey)
+{
+    CBlock block = CreateBlock(txns, scriptPubKey);
+
+    CValidationState state;
+    ProcessNewBlock(state, Params(), NULL, &block, true, NULL);
+    return block;
+}
+
 TestChain100Setup::~TestChain100Setup()
 {
 }
@@ -24,6 +24,7 @@
 #include "script/sign.h"
 #include "test/test_util.h"
 #include "primitives/transaction.h"
+#include "primitives/transaction_view.h"
 #include "transaction_builder.h"
 #include "util/test.h"
 
@@ -832,6 +833,27 @@ BOOST_AUTO_TEST_CASE(TxV5)
         CDataStream stream(ParseHex(transaction), SER_NETWORK, PROTOCOL_VERSION);
         CTransaction tx;
         stream >> tx;
+        BOOST_CHECK(stream.empty());
+
+        // Shielded bundles are parsed in place from memory, and leave what
+        // follows them unread.
+        std::vector<unsigned char> vTxAndTrailer = ParseHex(transaction);
+        vTxAndTrailer.push_back(0x42);
+        SpanReader reader(SER_NETWORK, PROTOCOL_VERSION, vTxAndTrailer.data(), vTxAndTrailer.size());
+        CTransaction txFromSpan;
+        reader >> txFromSpan;
+        BOOST_CHECK(txFromSpan == tx);
+        BOOST_CHECK_EQUAL(reader.size(), 1);
+
+        // The view skips the shielded bundles without parsing them.
+        SpanReader viewReader(SER_NETWORK, PROTOCOL_VERSION, vTxAndTrailer.data(), vTxAndTrailer.size());
+        CTransactionView view(viewReader);
+        BOOST_CHECK_EQUAL(viewReader.size(), 1);
+        BOOST_CHECK_EQUAL(view.GetSerializeSize(), vTxAndTrailer.size() - 1);
+        BOOST_CHECK(view.vin == tx.vin);
+        BOOST_CHECK(view.vout == tx.vout);
+        BOOST_CHECK_EQUAL(view.GetHash().GetHex(), test[1].getValStr());
+        BOOST_CHECK_EQUAL(view.GetAuthDigest().GetHex(), test[2].getValStr());
 
         // Check that re-serializing the transaction gives the same encoding.
         CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
@@ -0,0 +1,144 @@
+// Copyright (c) 2026 The Zcash developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or https://www.opensource.org/licenses/mit-license.php .
+
+#include "txreconciliation.h"
+#include "random.h"
+#include "streams.h"
+#include "version.h"
+
+#include "test/test_bitcoin.h"
+
+#include <algorithm>
+#include <set>
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_FIXTURE_TEST_SUITE(txreconciliation_tests, BasicTestingSetup)
+
+BOOST_AUTO_TEST_CASE(sketch_decode)
+{
+    std::set<uint32_t> setHere, setThere;
+    CTxSketch here(CTxSketch::CellsForCapacity(500));
+    CTxSketch there(here.Cells());
+    for (uint32_t i = 0; i < 500; i++) {
+        uint32_t key = InsecureRand32();
+        here.Add(key);
+        there.Add(key);
+    }
+    for (uint32_t i = 0; i < 10; i++) {
+        uint32_t key = InsecureRand32();
+        here.Add(key);
+        setHere.insert(key);
+    }
+    for (uint32_t i = 0; i < 10; i++) {
+        uint32_t key = InsecureRand32();
+        there.Add(key);
+        setThere.insert(key);
+    }
+
+    BOOST_CHECK(here.Subtract(there));
+    std::vector<uint32_t> vOnlyHere, vOnlyThere;
+    BOOST_CHECK(here.Decode(vOnlyHere, vOnlyThere));
+    BOOST_CHECK(std::set<uint32_t>(vOnlyHere.begin(), vOnlyHere.end()) == setHere);
+    BOOST_CHECK(std::set<uint32_t>(vOnlyThere.begin(), vOnlyThere.end()) == setThere);
+
+    // Sketches of different sizes cannot be subtracted.
+    BOOST_CHECK(!here.Subtract(CTxSketch(here.Cells() + 3)));
+}
+
+BOOST_AUTO_TEST_CASE(sketch_overflow)
+{
+    CTxSketch sketch(CTxSketch::CellsForCapacity(10));
+    for (uint32_t i = 0; i < 100; i++) {
+        sketch.Add(InsecureRand32());
+    }
+    std::vector<uint32_t> vOnlyHere, vOnlyThere;
+    BOOST_CHECK(!sketch.Decode(vOnlyHere, vOnlyThere));
+}
+
+BOOST_AUTO_TEST_CASE(sketch_serialization)
+{
+    CTxSketch sketch(CTxSketch::CellsForCapacity(5));
+    sketch.Add(42);
+    CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
+    ss << sketch;
+    CTxSketch sketch2;
+    ss >> sketch2;
+    BOOST_CHECK_EQUAL(sketch2.Cells(), sketch.Cells());
+    BOOST_CHECK(sketch2.Subtract(sketch));
+    std::vector<uint32_t> vOnlyHere, vOnlyThere;
+    BOOST_CHECK(sketch2.Decode(vOnlyHere, vOnlyThere));
+    BOOST_CHECK(vOnlyHere.empty() && vOnlyThere.empty());
+
+    // A number of cells that is not a multiple of three is rejected.
+    std::vector<CTxSketch::Cell> cells(4);
+    ss << cells;
+    BOOST_CHECK_THROW(ss >> sketch2, std::ios_base::failure);
+}
+
+BOOST_AUTO_TEST_CASE(reconciliation_round)
+{
+    TxReconciliationState initiator(true, false, 1234, 5678);
+    TxReconciliationState responder(false, false, 5678, 1234);
+    BOOST_CHECK_EQUAL(initiator.ShortId(uint256S("01")), responder.ShortId(uint256S("01")));
+
+    std::vector<uint256> vShared, vInitiatorOnly, vResponderOnly;
+    for (int i = 0; i < 400; i++) {
+        vShared.push_back(InsecureRand256());
+        BOOST_CHECK(initiator.Add(vShared.back()));
+        BOOST_CHECK(responder.Add(vShared.back()));
+    }
+    for (int i = 0; i < 5; i++) {
+        vInitiatorOnly.push_back(InsecureRand256());
+        BOOST_CHECK(initiator.Add(vInitiatorOnly.back()));
+        vResponderOnly.push_back(InsecureRand256());
+        BOOST_CHECK(responder.Add(vResponderOnly.back()));
+    }
+    // Transactions the peer already knows about are not reconciled.
+    uint256 known = InsecureRand256();
+    BOOST_CHECK(responder.Add(known));
+    responder.Remove(known);
+
+    size_t nInitiatorSize = initiator.StartRound(0);
+    BOOST_CHECK_EQUAL(nInitiatorSize, 405U);
+    BOOST_CHECK_EQUAL(responder.StartRound(0), 405U);
+    BOOST_CHECK_EQUAL(responder.LocalSetSize(), 0U);
+    CTxSketch sketch = responder.SketchSnapshot(nInitiatorSize);
+    BOOST_CHECK(!sketch.IsEmpty());
+
+    std::vector<uint256> vAnnounce;
+    std::vector<uint32_t> vRequest;
+    BOOST_CHECK(initiator.Reconcile(sketch, vAnnounce, vRequest));
+    std::sort(vAnnounce.begin(), vAnnounce.end());
+    std::sort(vInitiatorOnly.begin(), vInitiatorOnly.end());
+    BOOST_CHECK(vAnnounce == vInitiatorOnly);
+    BOOST_CHECK(initiator.FinishRound(std::vector<uint32_t>(), false).empty());
+    BOOST_CHECK(!initiator.fRoundInFlight);
+
+    std::vector<uint256> vRequested = responder.FinishRound(vRequest, false);
+    std::sort(vRequested.begin(), vRequested.end());
+    std::sort(vResponderOnly.begin(), vResponderOnly.end());
+    BOOST_CHECK(vRequested == vResponderOnly);
+
+    // When the difference is too large, the whole snapshot is announced.
+    for (int i = 0; i < 50; i++) {
+        BOOST_CHECK(initiator.Add(InsecureRand256()));
+    }
+    initiator.StartRound(0);
+    responder.StartRound(0);
+    BOOST_CHECK(!initiator.Reconcile(CTxSketch(CTxSketch::CellsForCapacity(1)), vAnnounce, vRequest));
+    BOOST_CHECK_EQUAL(initiator.FinishRound(std::vector<uint32_t>(), true).size(), 50U);
+}
+
+BOOST_AUTO_TEST_CASE(reconciliation_set_limit)
+{
+    TxReconciliationState state(false, false, 1, 2);
+    while (state.LocalSetSize() < MAX_RECON_SET_SIZE) {
+        state.Add(InsecureRand256());
+    }
+    BOOST_CHECK(!state.Add(InsecureRand256()));
+    BOOST_CHECK_EQUAL(state.LocalSetSize(), MAX_RECON_SET_SIZE);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
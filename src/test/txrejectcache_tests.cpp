@@ -0,0 +1,88 @@
+// Copyright (c) 2026 The Zcash developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or https://www.opensource.org/licenses/mit-license.php .
+
+#include "txrejectcache.h"
+#include "consensus/validation.h"
+#include "random.h"
+
+#include "test/test_bitcoin.h"
+
+#include <boost/test/unit_test.hpp>
+
+static std::vector<unsigned char> RandomWideHash()
+{
+    uint256 txid = InsecureRand256();
+    uint256 authDigest = InsecureRand256();
+    std::vector<unsigned char> vData(txid.begin(), txid.end());
+    vData.insert(vData.end(), authDigest.begin(), authDigest.end());
+    return vData;
+}
+
+BOOST_FIXTURE_TEST_SUITE(txrejectcache_tests, BasicTestingSetup)
+
+BOOST_AUTO_TEST_CASE(reject_codes)
+{
+    CTxRejectCache cache(1000000);
+    auto vHash = RandomWideHash();
+    BOOST_CHECK(!cache.Contains(vHash, 1));
+    cache.Add(vHash, REJECT_INVALID, 1);
+    BOOST_CHECK(cache.Contains(vHash, 1));
+    BOOST_CHECK(cache.GetRejectCode(vHash, 1) == REJECT_INVALID);
+
+    // The same txid with another auth digest is a different transaction.
+    auto vOther = vHash;
+    vOther.back() ^= 1;
+    BOOST_CHECK(!cache.Contains(vOther, 1));
+    BOOST_CHECK(!cache.GetRejectCode(vOther, 1).has_value());
+
+    // Adding it again keeps the first code.
+    cache.Add(vHash, REJECT_MALFORMED, 1);
+    BOOST_CHECK(cache.GetRejectCode(vHash, 1) == REJECT_INVALID);
+
+    CCacheStats stats = cache.GetStats();
+    BOOST_CHECK_EQUAL(stats.nEntries, 1U);
+    BOOST_CHECK_EQUAL(stats.nInsertions, 1U);
+    BOOST_CHECK_EQUAL(stats.nHits, 1U);
+    BOOST_CHECK_EQUAL(stats.nMisses, 2U);
+    BOOST_CHECK(stats.nMemoryUsage > 0);
+}
+
+BOOST_AUTO_TEST_CASE(branch_id_change)
+{
+    CTxRejectCache cache(1000000);
+    auto vHash = RandomWideHash();
+    cache.Add(vHash, REJECT_INVALID, 1);
+
+    // Looking up under another branch ID does not clear the cache, but
+    // checking against it does.
+    BOOST_CHECK(!cache.GetRejectCode(vHash, 2).has_value());
+    BOOST_CHECK(cache.GetRejectCode(vHash, 1).has_value());
+    BOOST_CHECK(!cache.Contains(vHash, 2));
+    BOOST_CHECK(!cache.Contains(vHash, 1));
+    BOOST_CHECK_EQUAL(cache.GetStats().nEntries, 0U);
+    BOOST_CHECK_EQUAL(cache.GetStats().nEvictions, 1U);
+}
+
+BOOST_AUTO_TEST_CASE(oldest_evicted_first)
+{
+    const size_t nMaxEntries = 100;
+    CTxRejectCache cache(nMaxEntries * CTxRejectCache::EntryUsage());
+    BOOST_CHECK_EQUAL(cache.GetStats().nMaxEntries, nMaxEntries);
+
+    std::vector<std::vector<unsigned char>> vHashes;
+    for (size_t i = 0; i < 3 * nMaxEntries + nMaxEntries / 2; i++) {
+        vHashes.push_back(RandomWideHash());
+        cache.Add(vHashes.back(), REJECT_INVALID, 1);
+    }
+    for (size_t i = 0; i < vHashes.size(); i++) {
+        BOOST_CHECK_EQUAL(cache.GetRejectCode(vHashes[i], 1).has_value(), i >= vHashes.size() - nMaxEntries);
+    }
+
+    CCacheStats stats = cache.GetStats();
+    BOOST_CHECK_EQUAL(stats.nEntries, nMaxEntries);
+    BOOST_CHECK_EQUAL(stats.nInsertions, vHashes.size());
+    BOOST_CHECK_EQUAL(stats.nEvictions, vHashes.size() - nMaxEntries);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -3,19 +3,37 @@
 // Distributed under the MIT software license, see the accompanying
 // file COPYING or https://www.opensource.org/licenses/mit-license.php .
 
+#include "consensus/upgrades.h"
 #include "consensus/validation.h"
 #include "key.h"
+#include "keystore.h"
 #include "main.h"
 #include "miner.h"
+#include "net.h"
+#include "pow.h"
 #include "pubkey.h"
 #include "txmempool.h"
 #include "random.h"
 #include "script/standard.h"
+#include "streams.h"
 #include "test/test_bitcoin.h"
+#include "transaction_builder.h"
 #include "util/time.h"
+#include "zcash/Address.hpp"
+#include "zcash/IncrementalMerkleTree.hpp"
+#include "zcash/address/mnemonic.h"
+
+#include <rust/ed25519.h>
+
+#include <algorithm>
 
 #include <boost/test/unit_test.hpp>
 
+// Tests this internal-to-main.cpp method:
+extern bool QueueTxAccept(CNode* pfrom, const CTransactionRef& ptx);
+// and this internal-to-main.cpp variable:
+extern int nProofWindowEnd;
+
 BOOST_AUTO_TEST_SUITE(tx_validationcache_tests)
 
 static bool
@@ -27,6 +45,39 @@ ToMemPool(CMutableTransaction& tx)
     return AcceptToMemoryPool(Params(), mempool, state, tx, false, NULL, false);
 }
 
+//! Sign the first input of tx, which spends prevout to key's P2PK script.
+static void
+SignFirstInput(CMutableTransaction& tx, const CKey& key, const CTxOut& prevout, uint32_t consensusBranchId)
+{
+    const PrecomputedTransactionData txdata(tx, {prevout});
+    std::vector<unsigned char> vchSig;
+    uint256 hash = SignatureHash(prevout.scriptPubKey, tx, 0, SIGHASH_ALL, prevout.nValue, consensusBranchId, txdata);
+    BOOST_CHECK(key.Sign(hash, vchSig));
+    vchSig.push_back((unsigned char)SIGHASH_ALL);
+    tx.vin[0].scriptSig = CScript() << vchSig;
+}
+
+//! Wait for the ThreadTxAccept threads to add the transactions to the mempool.
+static bool
+WaitForMemPool(const std::vector<uint256>& vHash)
+{
+    for (int i = 0; i < 1000; i++) {
+        if (std::all_of(vHash.begin(), vHash.end(), [](const uint256& hash) { return mempool.exists(hash); })) {
+            return true;
+        }
+        MilliSleep(10);
+    }
+    return false;
+}
+
+static CAddress
+DummyAddress()
+{
+    struct in_addr s;
+    s.s_addr = 0xa0b0c001;
+    return CAddress(CService(CNetAddr(s), Params().GetDefaultPort()));
+}
+
 #ifdef ENABLE_MINING
 BOOST_FIXTURE_TEST_CASE(tx_mempool_block_doublespend, TestChain100Setup)
 {
@@ -85,6 +136,327 @@ BOOST_FIXTURE_TEST_CASE(tx_mempool_block_doublespend, TestChain100Setup)
     // block with spends[0] is accepted:
     BOOST_CHECK_EQUAL(mempool.size(), 0);
 }
+
+BOOST_FIXTURE_TEST_CASE(tx_mempool_reorg_assumevalid, TestChain100Setup)
+{
+    // Make sure the transactions of a block that was connected without
+    // checking its proofs are checked in full when the block is disconnected
+    // and they are added back to the memory pool.
+    CScript scriptPubKey = CScript() <<  ToByteVector(coinbaseKey.GetPubKey()) << OP_CHECKSIG;
+    const Consensus::Params& consensusParams = Params().GetConsensus();
+    int nNextHeight = chainActive.Height() + 1;
+    UpdateNetworkUpgradeParameters(Consensus::UPGRADE_OVERWINTER, nNextHeight);
+    UpdateNetworkUpgradeParameters(Consensus::UPGRADE_SAPLING, nNextHeight);
+    uint32_t consensusBranchId = CurrentEpochBranchId(nNextHeight, consensusParams);
+    CAmount nFee = 100000;
+
+    auto signInput = [&](CMutableTransaction& tx, const CTxOut& prevout) {
+        const PrecomputedTransactionData txdata(tx, {prevout});
+        std::vector<unsigned char> vchSig;
+        uint256 hash = SignatureHash(scriptPubKey, tx, 0, SIGHASH_ALL, prevout.nValue, consensusBranchId, txdata);
+        BOOST_CHECK(coinbaseKey.Sign(hash, vchSig));
+        vchSig.push_back((unsigned char)SIGHASH_ALL);
+        tx.vin[0].scriptSig = CScript() << vchSig;
+    };
+
+    // A valid spend of a mature coinbase output.
+    CMutableTransaction txValid;
+    txValid.fOverwintered = true;
+    txValid.nVersionGroupId = SAPLING_VERSION_GROUP_ID;
+    txValid.nVersion = SAPLING_TX_VERSION;
+    txValid.vin.resize(1);
+    txValid.vin[0].prevout = COutPoint(coinbaseTxns[0].GetHash(), 0);
+    txValid.vout.resize(1);
+    txValid.vout[0].nValue = coinbaseTxns[0].vout[0].nValue - nFee;
+    txValid.vout[0].scriptPubKey = scriptPubKey;
+    signInput(txValid, coinbaseTxns[0].vout[0]);
+
+    // A spend of its output into a JoinSplit with a signature that is valid
+    // and a proof that is not.
+    CMutableTransaction txBadProof;
+    txBadProof.fOverwintered = true;
+    txBadProof.nVersionGroupId = SAPLING_VERSION_GROUP_ID;
+    txBadProof.nVersion = SAPLING_TX_VERSION;
+    txBadProof.vin.resize(1);
+    txBadProof.vin[0].prevout = COutPoint(txValid.GetHash(), 0);
+    txBadProof.vJoinSplit.resize(1);
+    JSDescription& jsdesc = txBadProof.vJoinSplit[0];
+    jsdesc.vpub_old = txValid.vout[0].nValue - nFee;
+    jsdesc.anchor = SproutMerkleTree::empty_root();
+    jsdesc.nullifiers[0] = InsecureRand256();
+    jsdesc.nullifiers[1] = InsecureRand256();
+    jsdesc.commitments[0] = InsecureRand256();
+    jsdesc.commitments[1] = InsecureRand256();
+    jsdesc.proof = libzcash::GrothProof();
+    ed25519::SigningKey joinSplitPrivKey;
+    ed25519::generate_keypair(joinSplitPrivKey, txBadProof.joinSplitPubKey);
+    {
+        const PrecomputedTransactionData txdata(txBadProof, {txValid.vout[0]});
+        uint256 dataToBeSigned = SignatureHash(CScript(), CTransaction(txBadProof), NOT_AN_INPUT, SIGHASH_ALL, 0, consensusBranchId, txdata);
+        ed25519::sign(joinSplitPrivKey, {dataToBeSigned.begin(), 32}, txBadProof.joinSplitSig);
+    }
+    signInput(txBadProof, txValid.vout[0]);
+
+    // Mine the block with both transactions, and a block at the same height
+    // that becomes the tip first.
+    CBlock block = CreateBlock({txValid, txBadProof}, scriptPubKey);
+    CBlock blockTip = CreateAndProcessBlock({}, scriptPubKey);
+    BOOST_CHECK(chainActive.Tip()->GetBlockHash() == blockTip.GetHash());
+    CValidationState state;
+    BOOST_CHECK(ProcessNewBlock(state, Params(), NULL, &block, true, NULL));
+
+    CBlockIndex* pindex = mapBlockIndex[block.GetHash()];
+    BOOST_CHECK(chainActive.Tip() != pindex);
+
+    // Assume the block is valid, by adding a header two weeks' worth of work
+    // past it as the assumed-valid block.
+    uint256 hashAssumed = InsecureRand256();
+    CBlockIndex indexAssumed;
+    indexAssumed.phashBlock = &hashAssumed;
+    indexAssumed.pprev = pindex;
+    indexAssumed.nHeight = pindex->nHeight + 1;
+    indexAssumed.nBits = pindex->nBits;
+    indexAssumed.nChainWork = pindex->nChainWork + GetBlockProof(*pindex) * 100000;
+    indexAssumed.BuildSkip();
+    CBlockIndex* pindexBestHeaderOld;
+    {
+        LOCK(cs_main);
+        mapBlockIndex[hashAssumed] = &indexAssumed;
+        pindexBestHeaderOld = pindexBestHeader;
+        pindexBestHeader = &indexAssumed;
+        hashAssumeValid = hashAssumed;
+
+        // Switch to the block, which is connected without checking the proof.
+        BOOST_CHECK(InvalidateBlock(state, Params(), chainActive.Tip()));
+    }
+    BOOST_CHECK(ActivateBestChain(state, Params()));
+    BOOST_CHECK(chainActive.Tip() == pindex);
+    BOOST_CHECK(!pindex->fExpensiveChecksDone);
+
+    LOCK(cs_main);
+    hashAssumeValid = uint256();
+    pindexBestHeader = pindexBestHeaderOld;
+    mapBlockIndex.erase(hashAssumed);
+
+    // When the block is disconnected, only the valid transaction is added
+    // back to the memory pool.
+    BOOST_CHECK(InvalidateBlock(state, Params(), pindex));
+    BOOST_CHECK(chainActive.Tip() == pindex->pprev);
+    BOOST_CHECK(mempool.exists(txValid.GetHash()));
+    BOOST_CHECK(!mempool.exists(txBadProof.GetHash()));
+    mempool.clear();
+
+    UpdateNetworkUpgradeParameters(Consensus::UPGRADE_SAPLING, Consensus::NetworkUpgrade::NO_ACTIVATION_HEIGHT);
+    UpdateNetworkUpgradeParameters(Consensus::UPGRADE_OVERWINTER, Consensus::NetworkUpgrade::NO_ACTIVATION_HEIGHT);
+}
+
+BOOST_FIXTURE_TEST_CASE(tx_accept_threads_parent_and_child, TestChain100Setup)
+{
+    // A parent and its child that arrive together are both accepted by the
+    // threads that check transactions from peers.
+    CScript scriptPubKey = CScript() <<  ToByteVector(coinbaseKey.GetPubKey()) << OP_CHECKSIG;
+    CMutableTransaction txParent;
+    txParent.vin.resize(1);
+    txParent.vin[0].prevout = COutPoint(coinbaseTxns[0].GetHash(), 0);
+    txParent.vout.resize(1);
+    txParent.vout[0].nValue = coinbaseTxns[0].vout[0].nValue - 100000;
+    txParent.vout[0].scriptPubKey = scriptPubKey;
+    SignFirstInput(txParent, coinbaseKey, coinbaseTxns[0].vout[0], SPROUT_BRANCH_ID);
+
+    CMutableTransaction txChild;
+    txChild.vin.resize(1);
+    txChild.vin[0].prevout = COutPoint(txParent.GetHash(), 0);
+    txChild.vout.resize(1);
+    txChild.vout[0].nValue = txParent.vout[0].nValue - 100000;
+    txChild.vout[0].scriptPubKey = scriptPubKey;
+    SignFirstInput(txChild, coinbaseKey, txParent.vout[0], SPROUT_BRANCH_ID);
+
+    CNode dummyNode(INVALID_SOCKET, DummyAddress(), "", true);
+    dummyNode.nVersion = 1;
+    StartTxAcceptThreads(2);
+    {
+        LOCK(cs_main);
+        BOOST_CHECK(QueueTxAccept(&dummyNode, MakeTransactionRef(txParent)));
+        BOOST_CHECK(QueueTxAccept(&dummyNode, MakeTransactionRef(txChild)));
+    }
+    BOOST_CHECK(WaitForMemPool({txParent.GetHash(), txChild.GetHash()}));
+    StopTxAcceptThreads();
+    mempool.clear();
+}
+
+BOOST_FIXTURE_TEST_CASE(tx_accept_threads_deferred_child, TestChain100Setup)
+{
+    // A child that is checked while its parent is still being checked is
+    // deferred, and accepted once the parent is. The child has a JoinSplit,
+    // so it would be rejected rather than kept as an orphan if it were not
+    // deferred.
+    CScript scriptPubKey = CScript() <<  ToByteVector(coinbaseKey.GetPubKey()) << OP_CHECKSIG;
+    CMutableTransaction txParent;
+    txParent.vin.resize(1);
+    txParent.vin[0].prevout = COutPoint(coinbaseTxns[0].GetHash(), 0);
+    txParent.vout.resize(1);
+    txParent.vout[0].nValue = coinbaseTxns[0].vout[0].nValue - 100000;
+    txParent.vout[0].scriptPubKey = scriptPubKey;
+    SignFirstInput(txParent, coinbaseKey, coinbaseTxns[0].vout[0], SPROUT_BRANCH_ID);
+
+    CMutableTransaction txChild;
+    txChild.nVersion = 2;
+    txChild.vin.resize(1);
+    txChild.vin[0].prevout = COutPoint(txParent.GetHash(), 0);
+    txChild.vJoinSplit.resize(1);
+    JSDescription& jsdesc = txChild.vJoinSplit[0];
+    jsdesc.vpub_old = txParent.vout[0].nValue - 100000;
+    jsdesc.anchor = SproutMerkleTree::empty_root();
+    jsdesc.nullifiers[0] = InsecureRand256();
+    jsdesc.nullifiers[1] = InsecureRand256();
+    jsdesc.commitments[0] = InsecureRand256();
+    jsdesc.commitments[1] = InsecureRand256();
+    ed25519::SigningKey joinSplitPrivKey;
+    ed25519::generate_keypair(joinSplitPrivKey, txChild.joinSplitPubKey);
+    {
+        const PrecomputedTransactionData txdata(txChild, {txParent.vout[0]});
+        uint256 dataToBeSigned = SignatureHash(CScript(), CTransaction(txChild), NOT_AN_INPUT, SIGHASH_ALL, 0, SPROUT_BRANCH_ID, txdata);
+        ed25519::sign(joinSplitPrivKey, {dataToBeSigned.begin(), 32}, txChild.joinSplitSig);
+    }
+    SignFirstInput(txChild, coinbaseKey, txParent.vout[0], SPROUT_BRANCH_ID);
+
+    // The thread cannot check the child against the mempool until cs_main
+    // is released, by which time the parent is queued behind it.
+    CNode dummyNode(INVALID_SOCKET, DummyAddress(), "", true);
+    dummyNode.nVersion = 1;
+    StartTxAcceptThreads(1);
+    {
+        LOCK(cs_main);
+        BOOST_CHECK(QueueTxAccept(&dummyNode, MakeTransactionRef(txChild)));
+        BOOST_CHECK(QueueTxAccept(&dummyNode, MakeTransactionRef(txParent)));
+    }
+    BOOST_CHECK(WaitForMemPool({txParent.GetHash(), txChild.GetHash()}));
+    StopTxAcceptThreads();
+    mempool.clear();
+}
+
+BOOST_FIXTURE_TEST_CASE(tx_accept_staged_tip_change, TestChain100Setup)
+{
+    // A transaction that was verified before the tip changed is verified
+    // again before it is added to the mempool.
+    CScript scriptPubKey = CScript() <<  ToByteVector(coinbaseKey.GetPubKey()) << OP_CHECKSIG;
+    const Consensus::Params& consensusParams = Params().GetConsensus();
+    int nNextHeight = chainActive.Height() + 1;
+    UpdateNetworkUpgradeParameters(Consensus::UPGRADE_OVERWINTER, nNextHeight);
+    UpdateNetworkUpgradeParameters(Consensus::UPGRADE_SAPLING, nNextHeight);
+    UpdateNetworkUpgradeParameters(Consensus::UPGRADE_BLOSSOM, nNextHeight + 2);
+    uint32_t saplingBranchId = CurrentEpochBranchId(nNextHeight, consensusParams);
+
+    std::vector<CMutableTransaction> vtx(2);
+    for (int i = 0; i < 2; i++) {
+        vtx[i].fOverwintered = true;
+        vtx[i].nVersionGroupId = SAPLING_VERSION_GROUP_ID;
+        vtx[i].nVersion = SAPLING_TX_VERSION;
+        vtx[i].vin.resize(1);
+        vtx[i].vin[0].prevout = COutPoint(coinbaseTxns[i].GetHash(), 0);
+        vtx[i].vout.resize(1);
+        vtx[i].vout[0].nValue = coinbaseTxns[i].vout[0].nValue - 100000;
+        vtx[i].vout[0].scriptPubKey = scriptPubKey;
+        SignFirstInput(vtx[i], coinbaseKey, coinbaseTxns[i].vout[0], saplingBranchId);
+    }
+    auto mineBlock = [&]() { CreateAndProcessBlock({}, scriptPubKey); };
+
+    // The next block is still in the Sapling epoch, so the transaction
+    // verifies again.
+    CValidationState state;
+    BOOST_CHECK(AcceptToMemoryPoolStaged(Params(), mempool, state, MakeTransactionRef(vtx[0]), mineBlock));
+    BOOST_CHECK_EQUAL(chainActive.Height(), nNextHeight);
+    BOOST_CHECK(mempool.exists(vtx[0].GetHash()));
+    mempool.clear();
+
+    // The next block is in the Blossom epoch, so the signature, which
+    // commits to the Sapling branch ID, no longer verifies.
+    state = CValidationState();
+    BOOST_CHECK(!AcceptToMemoryPoolStaged(Params(), mempool, state, MakeTransactionRef(vtx[1]), mineBlock));
+    BOOST_CHECK_EQUAL(chainActive.Height(), nNextHeight + 1);
+    BOOST_CHECK(state.GetRejectReason().find("mandatory-script-verify-flag-failed") == 0);
+    BOOST_CHECK(!mempool.exists(vtx[1].GetHash()));
+
+    UpdateNetworkUpgradeParameters(Consensus::UPGRADE_BLOSSOM, Consensus::NetworkUpgrade::NO_ACTIVATION_HEIGHT);
+    UpdateNetworkUpgradeParameters(Consensus::UPGRADE_SAPLING, Consensus::NetworkUpgrade::NO_ACTIVATION_HEIGHT);
+    UpdateNetworkUpgradeParameters(Consensus::UPGRADE_OVERWINTER, Consensus::NetworkUpgrade::NO_ACTIVATION_HEIGHT);
+}
+
+BOOST_FIXTURE_TEST_CASE(proof_window_invalid_proof, TestChain100Setup)
+{
+    // A block with an invalid Orchard proof that is connected within the
+    // proof window of initial block download is rejected and marked invalid,
+    // and disconnecting blocks moves the window back to the new tip.
+    CScript scriptPubKey = CScript() <<  ToByteVector(coinbaseKey.GetPubKey()) << OP_CHECKSIG;
+    int nNextHeight = chainActive.Height() + 1;
+    for (int idx = Consensus::UPGRADE_OVERWINTER; idx <= Consensus::UPGRADE_NU5; idx++) {
+        UpdateNetworkUpgradeParameters(Consensus::UpgradeIndex(idx), nNextHeight);
+    }
+    CAmount nFee = 10000;
+
+    CreateAndProcessBlock({}, scriptPubKey);
+    CBlock blockValid = CreateAndProcessBlock({}, scriptPubKey);
+    CBlockIndex* pindexValid = chainActive.Tip();
+    BOOST_CHECK(pindexValid->GetBlockHash() == blockValid.GetHash());
+
+    // Shield a mature coinbase output to Orchard, then corrupt the proof.
+    CBasicKeyStore keystore;
+    keystore.AddKey(coinbaseKey);
+    auto coinType = Params().BIP44CoinType();
+    auto seed = MnemonicSeed::Random(coinType);
+    auto sk = libzcash::OrchardSpendingKey::ForAccount(seed, coinType, 0);
+    auto recipient = sk.ToFullViewingKey().ToIncomingViewingKey().Address(libzcash::diversifier_index_t(0));
+
+    auto builder = TransactionBuilder(
+        Params(), chainActive.Height() + 1, pcoinsTip->GetBestAnchor(ORCHARD), SaplingMerkleTree::empty_root(), &keystore);
+    builder.SetFee(nFee);
+    builder.AddTransparentInput(COutPoint(coinbaseTxns[0].GetHash(), 0), coinbaseTxns[0].vout[0].scriptPubKey, coinbaseTxns[0].vout[0].nValue);
+    builder.AddOrchardOutput(std::nullopt, recipient, coinbaseTxns[0].vout[0].nValue - nFee, std::nullopt);
+    CTransaction tx = builder.Build().GetTxOrThrow();
+    BOOST_CHECK(tx.GetOrchardBundle().IsPresent());
+
+    // The proof is followed by the spend authorization signatures of the
+    // actions and the binding signature.
+    CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
+    ss << tx;
+    ss[ss.size() - 64 * (tx.GetOrchardBundle().GetNumActions() + 1) - 1] ^= 1;
+    CMutableTransaction txBadProof;
+    ss >> txBadProof;
+
+    // Mine the transaction in a block on top of blockValid, and then take
+    // blockValid off the chain so that both blocks are connected together.
+    CBlock blockBad = CreateBlock({txBadProof}, scriptPubKey);
+    CValidationState state;
+    {
+        LOCK(cs_main);
+        BOOST_CHECK(InvalidateBlock(state, Params(), pindexValid));
+        BOOST_CHECK(ReconsiderBlock(state, pindexValid));
+    }
+    BOOST_CHECK(chainActive.Tip() == pindexValid->pprev);
+
+    bool fIBD = TestSetIBD(true);
+    fImporting = true;
+    BOOST_CHECK(IsInitialBlockDownload(Params().GetConsensus()));
+    ProcessNewBlock(state, Params(), NULL, &blockBad, true, NULL);
+    fImporting = false;
+    TestSetIBD(fIBD);
+
+    LOCK(cs_main);
+    CBlockIndex* pindexBad = mapBlockIndex[blockBad.GetHash()];
+    BOOST_CHECK_EQUAL(nProofWindowEnd, pindexBad->nHeight);
+    BOOST_CHECK(pindexBad->nStatus & BLOCK_FAILED_VALID);
+    BOOST_CHECK(chainActive.Tip() == pindexValid);
+
+    // Disconnecting blockValid moves the window back below it.
+    BOOST_CHECK(InvalidateBlock(state, Params(), pindexValid));
+    BOOST_CHECK(chainActive.Tip() == pindexValid->pprev);
+    BOOST_CHECK_EQUAL(nProofWindowEnd, chainActive.Height());
+    mempool.clear();
+
+    for (int idx = Consensus::UPGRADE_NU5; idx >= Consensus::UPGRADE_OVERWINTER; idx--) {
+        UpdateNetworkUpgradeParameters(Consensus::UpgradeIndex(idx), Consensus::NetworkUpgrade::NO_ACTIVATION_HEIGHT);
+    }
+}
 #endif // ENABLE_MINING
 
 BOOST_AUTO_TEST_SUITE_END()
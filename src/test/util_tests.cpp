@@ -621,4 +621,20 @@ BOOST_AUTO_TEST_CASE(test_ArbitraryIntStr)
         "309485009821345068724781055");
 }
 
+BOOST_AUTO_TEST_CASE(test_ParseCPUList)
+{
+    std::vector<int> vCPUs;
+    BOOST_CHECK(ParseCPUList("0-3,8,10-11\n", vCPUs));
+    BOOST_CHECK(vCPUs == std::vector<int>({0, 1, 2, 3, 8, 10, 11}));
+    BOOST_CHECK(ParseCPUList("5", vCPUs));
+    BOOST_CHECK(vCPUs == std::vector<int>({5}));
+    BOOST_CHECK(ParseCPUList("", vCPUs));
+    BOOST_CHECK(vCPUs.empty());
+
+    BOOST_CHECK(!ParseCPUList("3-1", vCPUs));
+    BOOST_CHECK(!ParseCPUList("0-", vCPUs));
+    BOOST_CHECK(!ParseCPUList("a", vCPUs));
+    BOOST_CHECK(!ParseCPUList("-1", vCPUs));
+}
+
 BOOST_AUTO_TEST_SUITE_END()
@@ -10,12 +10,16 @@
 #include "rpc/protocol.h"
 #include "script/sign.h"
 #include "util/moneystr.h"
+#include "util/system.h"
 #include "zcash/Note.hpp"
 
 #include <librustzcash.h>
 #include <rust/builder.h>
 #include <rust/ed25519.h>
 
+#include <future>
+#include <thread>
+
 uint256 ProduceShieldedSignatureHash(
     uint32_t consensusBranchId,
     const CTransaction& tx,
@@ -126,6 +130,42 @@ std::optional<OrchardBundle> UnauthorizedBundle::ProveAndSign(
     }
 }
 
+std::optional<ProvenBundle> UnauthorizedBundle::Prove() const
+{
+    if (!inner) {
+        throw std::logic_error("orchard::UnauthorizedBundle has already been used");
+    }
+
+    auto provenBundle = orchard_unauthorized_bundle_prove(inner.get());
+    if (provenBundle == nullptr) {
+        return std::nullopt;
+    } else {
+        return ProvenBundle(provenBundle);
+    }
+}
+
+std::optional<OrchardBundle> ProvenBundle::Sign(
+    const std::vector<libzcash::OrchardSpendingKey>& keys,
+    uint256 sighash)
+{
+    if (!inner) {
+        throw std::logic_error("orchard::ProvenBundle has already been used");
+    }
+
+    std::vector<const OrchardSpendingKeyPtr*> pKeys;
+    for (const auto& key : keys) {
+        pKeys.push_back(key.inner.get());
+    }
+
+    auto authorizedBundle = orchard_proven_bundle_sign(
+        inner.release(), pKeys.data(), pKeys.size(), sighash.begin());
+    if (authorizedBundle == nullptr) {
+        return std::nullopt;
+    } else {
+        return OrchardBundle(authorizedBundle);
+    }
+}
+
 } // namespace orchard
 
 JSDescription JSDescriptionInfo::BuildDeterministic(
@@ -519,6 +559,16 @@ TransactionBuilderResult TransactionBuilder::Build()
         }
     }
 
+    // The signature hash only needs the unproven Orchard bundle, so its proof is
+    // created on another thread while the Sapling proofs are. If we return early,
+    // the future waits for the proof before orchardBundle is destroyed.
+    std::future<std::optional<orchard::ProvenBundle>> orchardProof;
+    if (orchardBundle.has_value()) {
+        orchardProof = std::async(std::launch::async, [&orchardBundle]() {
+            return orchardBundle->Prove();
+        });
+    }
+
     //
     // Sapling spends and outputs
     //
@@ -575,16 +625,6 @@ TransactionBuilderResult TransactionBuilder::Build()
         return TransactionBuilderResult("Could not construct signature hash: " + std::string(ex.what()));
     }
 
-    if (orchardBundle.has_value()) {
-        auto authorizedBundle = orchardBundle.value().ProveAndSign(
-            orchardSpendingKeys, dataToBeSigned);
-        if (authorizedBundle.has_value()) {
-            mtx.orchardBundle = authorizedBundle.value();
-        } else {
-            return TransactionBuilderResult("Failed to create Orchard proof or signatures");
-        }
-    }
-
     // Create Sapling spendAuth and binding signatures
     try {
         mtx.saplingBundle = sapling::apply_bundle_signatures(
@@ -608,22 +648,55 @@ TransactionBuilderResult TransactionBuilder::Build()
         return TransactionBuilderResult("Sprout joinSplitSig sanity check failed");
     }
 
-    // Transparent signatures
+    // The Sapling and Sprout signatures above were made while the Orchard
+    // proof was still being created.
+    if (orchardBundle.has_value()) {
+        auto provenBundle = orchardProof.get();
+        std::optional<OrchardBundle> authorizedBundle;
+        if (provenBundle.has_value()) {
+            authorizedBundle = provenBundle->Sign(orchardSpendingKeys, dataToBeSigned);
+        }
+        if (authorizedBundle.has_value()) {
+            mtx.orchardBundle = authorizedBundle.value();
+        } else {
+            return TransactionBuilderResult("Failed to create Orchard proof or signatures");
+        }
+    }
+
+    // Transparent signatures. The digests that the signature hashes of all the
+    // inputs share are computed once in txdata, and then the inputs are
+    // signed independently, on several threads if there are many of them.
     CTransaction txNewConst(mtx);
     const PrecomputedTransactionData txdata(txNewConst, tIns);
-    for (int nIn = 0; nIn < mtx.vin.size(); nIn++) {
-        auto tIn = tIns[nIn];
-        SignatureData sigdata;
-        bool signSuccess = ProduceSignature(
-            TransactionSignatureCreator(
-                keystore, &txNewConst, txdata, nIn, tIn.nValue, SIGHASH_ALL),
-            tIn.scriptPubKey, sigdata, consensusBranchId);
-
-        if (!signSuccess) {
+    const size_t nInputs = mtx.vin.size();
+    std::vector<SignatureData> vSigData(nInputs);
+    // Not std::vector<bool>, whose elements cannot be set from several threads.
+    std::vector<char> vSigned(nInputs, false);
+    const size_t nThreads = std::max<size_t>(1, std::min<size_t>(
+        GetNumCores(), nInputs / MIN_INPUTS_PER_SIGNING_THREAD));
+    auto sign = [&](size_t nThread) {
+        for (size_t nIn = nThread; nIn < nInputs; nIn += nThreads) {
+            const auto& tIn = tIns[nIn];
+            vSigned[nIn] = ProduceSignature(
+                TransactionSignatureCreator(
+                    keystore, &txNewConst, txdata, nIn, tIn.nValue, SIGHASH_ALL),
+                tIn.scriptPubKey, vSigData[nIn], consensusBranchId);
+        }
+    };
+    std::vector<std::thread> threads;
+    for (size_t nThread = 1; nThread < nThreads; nThread++) {
+        threads.emplace_back(sign, nThread);
+    }
+    sign(0);
+    for (std::thread& thread : threads) {
+        thread.join();
+    }
+
+    for (size_t nIn = 0; nIn < nInputs; nIn++) {
+        if (!vSigned[nIn]) {
             return TransactionBuilderResult("Failed to sign transaction");
-        } else {
-            UpdateTransaction(mtx, nIn, sigdata);
         }
+        UpdateTransaction(mtx, nIn, vSigData[nIn]);
     }
 
     return TransactionBuilderResult(CTransaction(mtx));
@@ -30,6 +30,10 @@
 class OrchardWallet;
 namespace orchard { class UnauthorizedBundle; }
 
+//! Transparent inputs are signed on more than one thread only if each thread
+//! gets at least this many.
+static const size_t MIN_INPUTS_PER_SIGNING_THREAD = 16;
+
 uint256 ProduceShieldedSignatureHash(
     uint32_t consensusBranchId,
     const CTransaction& tx,
@@ -135,6 +139,38 @@ public:
     std::optional<UnauthorizedBundle> Build();
 };
 
+/// An Orchard bundle with its proof created, ready for signatures to be applied.
+class ProvenBundle {
+private:
+    /// Memory is allocated by Rust.
+    std::unique_ptr<OrchardProvenBundlePtr, decltype(&orchard_proven_bundle_free)> inner;
+
+    ProvenBundle(OrchardProvenBundlePtr* bundle) : inner(bundle, orchard_proven_bundle_free) {}
+    friend class UnauthorizedBundle;
+
+public:
+    // ProvenBundle should never be copied
+    ProvenBundle(const ProvenBundle&) = delete;
+    ProvenBundle& operator=(const ProvenBundle&) = delete;
+    ProvenBundle(ProvenBundle&& bundle) : inner(std::move(bundle.inner)) {}
+    ProvenBundle& operator=(ProvenBundle&& bundle)
+    {
+        if (this != &bundle) {
+            inner = std::move(bundle.inner);
+        }
+        return *this;
+    }
+
+    /// Adds signatures to this bundle.
+    ///
+    /// Returns `std::nullopt` if an error occurs.
+    ///
+    /// Calling this method invalidates this object. Subsequent usage of this object
+    /// in any way will cause an exception.
+    std::optional<OrchardBundle> Sign(
+        const std::vector<libzcash::OrchardSpendingKey>& keys, uint256 sighash);
+};
+
 /// An unauthorized Orchard bundle, ready for its proof to be created and signatures
 /// applied.
 class UnauthorizedBundle {
@@ -180,6 +216,13 @@ public:
     /// move semantics at runtime.
     std::optional<OrchardBundle> ProveAndSign(
         const std::vector<libzcash::OrchardSpendingKey>& keys, uint256 sighash);
+
+    /// Creates the proof for a copy of this bundle, leaving this bundle unchanged so
+    /// that the signature hash can be computed from it while the proof is created.
+    /// This may be called on another thread than the one using this bundle.
+    ///
+    /// Returns `std::nullopt` if an error occurs.
+    std::optional<ProvenBundle> Prove() const;
 };
 
 } // namespace orchard
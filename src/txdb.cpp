@@ -8,12 +8,19 @@
 
 #include "chainparams.h"
 #include "hash.h"
+#include "init.h"
 #include "main.h"
 #include "pow.h"
+#include "ui_interface.h"
 #include "uint256.h"
+#include "util/system.h"
 #include "zcash/History.hpp"
 
+#include <algorithm>
+#include <queue>
+#include <set>
 #include <stdint.h>
+#include <tuple>
 
 #include <boost/thread.hpp>
 
@@ -29,6 +36,7 @@ static const char DB_ORCHARD_ANCHOR = 'Y';
 static const char DB_NULLIFIER = 's';
 static const char DB_SAPLING_NULLIFIER = 'S';
 static const char DB_ORCHARD_NULLIFIER = 'O';
+static const char DB_COIN = 'C';
 static const char DB_COINS = 'c';
 static const char DB_BLOCK_FILES = 'f';
 static const char DB_TXINDEX = 't';
@@ -41,6 +49,9 @@ static const char DB_BEST_ORCHARD_ANCHOR = 'y';
 static const char DB_FLAG = 'F';
 static const char DB_REINDEX_FLAG = 'R';
 static const char DB_LAST_BLOCK = 'l';
+static const char DB_TXOUTSET_STATS = 'U';
+static const char DB_TXOUTSET_STATE = 'V';
+static const char DB_BLOCK_INDEX_SNAPSHOT = 'k';
 
 static const char DB_MMR_LENGTH = 'M';
 static const char DB_MMR_NODE = 'm';
@@ -55,11 +66,91 @@ static const char DB_ADDRESSUNSPENTINDEX = 'u';
 static const char DB_SPENTINDEX = 'p';
 static const char DB_TIMESTAMPINDEX = 'T';
 static const char DB_BLOCKHASHINDEX = 'h';
+static const char DB_ADDRESSSUMMARY = 'D';
+static const char DB_INSIGHT_FLAG = 'F';
+
+namespace {
+
+/**
+ * Key of a single unspent transaction output in the coin database. Outputs
+ * of the same transaction are adjacent and ordered by index, because VARINT
+ * preserves numeric order.
+ */
+struct CoinEntry {
+    COutPoint* outpoint;
+    char key;
+    CoinEntry(const COutPoint* ptr) : outpoint(const_cast<COutPoint*>(ptr)), key(DB_COIN) {}
+
+    ADD_SERIALIZE_METHODS;
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream& s, Operation ser_action) {
+        READWRITE(key);
+        READWRITE(outpoint->hash);
+        READWRITE(VARINT(outpoint->n));
+    }
+};
+
+/**
+ * Value of a single unspent transaction output in the coin database. Each
+ * record repeats the metadata of its transaction, so that spending one
+ * output only touches that output's record.
+ */
+struct CoinRecord {
+    bool fCoinBase;
+    int nHeight;
+    int nVersion;
+    CTxOut out;
+
+    CoinRecord() : fCoinBase(false), nHeight(0), nVersion(0) {}
+    CoinRecord(const CCoins& coins, const CTxOut& outIn) :
+        fCoinBase(coins.fCoinBase), nHeight(coins.nHeight), nVersion(coins.nVersion), out(outIn) {}
+
+    template<typename Stream>
+    void Serialize(Stream &s) const {
+        unsigned int nCode = nHeight * 2 + (fCoinBase ? 1 : 0);
+        ::Serialize(s, VARINT(nCode));
+        ::Serialize(s, VARINT(nVersion));
+        ::Serialize(s, CTxOutCompressor(REF(out)));
+    }
+
+    template<typename Stream>
+    void Unserialize(Stream &s) {
+        unsigned int nCode = 0;
+        ::Unserialize(s, VARINT(nCode));
+        nHeight = nCode / 2;
+        fCoinBase = nCode & 1;
+        ::Unserialize(s, VARINT(nVersion));
+        ::Unserialize(s, REF(CTxOutCompressor(out)));
+    }
+};
+
+/**
+ * Position the cursor on the first output of txid. Returns false if the
+ * database has no unspent outputs of that transaction.
+ */
+bool SeekCoins(CDBIterator& cursor, const uint256& txid, COutPoint& outpoint)
+{
+    cursor.Seek(make_pair(DB_COIN, txid));
+    CoinEntry entry(&outpoint);
+    return cursor.Valid() && cursor.GetKey(entry) && entry.key == DB_COIN && outpoint.hash == txid;
+}
+
+/** Advance the cursor to the next output of the same transaction. */
+bool NextCoin(CDBIterator& cursor, COutPoint& outpoint)
+{
+    uint256 txid = outpoint.hash;
+    cursor.Next();
+    CoinEntry entry(&outpoint);
+    return cursor.Valid() && cursor.GetKey(entry) && entry.key == DB_COIN && outpoint.hash == txid;
+}
+
+}
 
 CCoinsViewDB::CCoinsViewDB(std::string dbName, size_t nCacheSize, bool fMemory, bool fWipe) : db(GetDataDir() / dbName, nCacheSize, fMemory, fWipe) {
 }
 
-CCoinsViewDB::CCoinsViewDB(size_t nCacheSize, bool fMemory, bool fWipe) : db(GetDataDir() / "chainstate", nCacheSize, fMemory, fWipe)
+CCoinsViewDB::CCoinsViewDB(size_t nCacheSize, bool fMemory, bool fWipe, const CDBOptions& dbOptions) : db(GetDataDir() / "chainstate", nCacheSize, fMemory, fWipe, dbOptions)
 {
 }
 
@@ -99,31 +190,84 @@ bool CCoinsViewDB::GetOrchardAnchorAt(const uint256 &rt, OrchardMerkleFrontier &
     return read;
 }
 
-bool CCoinsViewDB::GetNullifier(const uint256 &nf, ShieldedType type) const {
-    bool spent = false;
-    char dbChar;
+static char NullifierKeyPrefix(ShieldedType type) {
     switch (type) {
         case SPROUT:
-            dbChar = DB_NULLIFIER;
-            break;
+            return DB_NULLIFIER;
         case SAPLING:
-            dbChar = DB_SAPLING_NULLIFIER;
-            break;
+            return DB_SAPLING_NULLIFIER;
         case ORCHARD:
-            dbChar = DB_ORCHARD_NULLIFIER;
-            break;
+            return DB_ORCHARD_NULLIFIER;
         default:
             throw runtime_error("Unknown shielded type");
     }
-    return db.Read(make_pair(dbChar, nf), spent);
+}
+
+uint64_t CCoinsViewDB::NullifierFilterHash(const uint256 &nf, ShieldedType type) const {
+    // The type only changes the fingerprint, so equal nullifiers of different
+    // types share their buckets.
+    return nullifierHasher(nf) ^ ((uint64_t)type << 56);
+}
+
+bool CCoinsViewDB::MayHaveNullifier(const uint256 &nf, ShieldedType type) const {
+    LOCK(cs_nullifierFilter);
+    return !nullifierFilter || nullifierFilter->contains(NullifierFilterHash(nf, type));
+}
+
+bool CCoinsViewDB::GetNullifier(const uint256 &nf, ShieldedType type) const {
+    if (!MayHaveNullifier(nf, type))
+        return false;
+    bool spent = false;
+    return db.Read(make_pair(NullifierKeyPrefix(type), nf), spent);
+}
+
+void CCoinsViewDB::GetNullifiers(const std::set<uint256> &nullifiers, ShieldedType type, std::set<uint256> &spent) const {
+    if (nullifiers.empty())
+        return;
+    char dbChar = NullifierKeyPrefix(type);
+
+    // Only spent nullifiers are stored. The set iterates in the same order as
+    // their keys, so a single cursor moving forwards through the database
+    // visits each table block at most once instead of once per lookup.
+    boost::scoped_ptr<CDBIterator> pcursor(const_cast<CDBWrapper*>(&db)->NewIterator());
+    for (const uint256 &nf : nullifiers) {
+        if (!MayHaveNullifier(nf, type))
+            continue;
+        pcursor->Seek(make_pair(dbChar, nf));
+        if (!pcursor->Valid())
+            break;
+        std::pair<char, uint256> key;
+        if (pcursor->GetKey(key) && key.first == dbChar && key.second == nf) {
+            spent.insert(nf);
+        }
+    }
 }
 
 bool CCoinsViewDB::GetCoins(const uint256 &txid, CCoins &coins) const {
-    return db.Read(make_pair(DB_COINS, txid), coins);
+    boost::scoped_ptr<CDBIterator> pcursor(const_cast<CDBWrapper*>(&db)->NewIterator());
+    COutPoint outpoint;
+    if (!SeekCoins(*pcursor, txid, outpoint))
+        return false;
+
+    coins.Clear();
+    do {
+        CoinRecord record;
+        if (!pcursor->GetValue(record))
+            return false;
+        coins.fCoinBase = record.fCoinBase;
+        coins.nHeight = record.nHeight;
+        coins.nVersion = record.nVersion;
+        if (coins.vout.size() <= outpoint.n)
+            coins.vout.resize(outpoint.n + 1);
+        coins.vout[outpoint.n] = record.out;
+    } while (NextCoin(*pcursor, outpoint));
+    return true;
 }
 
 bool CCoinsViewDB::HaveCoins(const uint256 &txid) const {
-    return db.Exists(make_pair(DB_COINS, txid));
+    boost::scoped_ptr<CDBIterator> pcursor(const_cast<CDBWrapper*>(&db)->NewIterator());
+    COutPoint outpoint;
+    return SeekCoins(*pcursor, txid, outpoint);
 }
 
 uint256 CCoinsViewDB::GetBestBlock() const {
@@ -225,7 +369,7 @@ std::optional<libzcash::SubtreeData> CCoinsViewDB::GetSubtreeData(
     return subtreeData;
 }
 
-void BatchWriteNullifiers(CDBBatch& batch, CNullifiersMap& mapToUse, const char& dbChar)
+void BatchWriteNullifiers(CDBBatch& batch, CNullifiersMap& mapToUse, const char& dbChar, bool fErase)
 {
     for (CNullifiersMap::iterator it = mapToUse.begin(); it != mapToUse.end();) {
         if (it->second.flags & CNullifiersCacheEntry::DIRTY) {
@@ -235,12 +379,12 @@ void BatchWriteNullifiers(CDBBatch& batch, CNullifiersMap& mapToUse, const char&
                 batch.Write(make_pair(dbChar, it->first), true);
             // TODO: changed++? ... See comment in CCoinsViewDB::BatchWrite. If this is needed we could return an int
         }
-        it = mapToUse.erase(it);
+        it = fErase ? mapToUse.erase(it) : std::next(it);
     }
 }
 
 template<typename Map, typename MapIterator, typename MapEntry, typename Tree>
-void BatchWriteAnchors(CDBBatch& batch, Map& mapToUse, const char& dbChar)
+void BatchWriteAnchors(CDBBatch& batch, Map& mapToUse, const char& dbChar, bool fErase)
 {
     for (MapIterator it = mapToUse.begin(); it != mapToUse.end();) {
         if (it->second.flags & MapEntry::DIRTY) {
@@ -253,7 +397,7 @@ void BatchWriteAnchors(CDBBatch& batch, Map& mapToUse, const char& dbChar)
             }
             // TODO: changed++?
         }
-        it = mapToUse.erase(it);
+        it = fErase ? mapToUse.erase(it) : std::next(it);
     }
 }
 
@@ -340,6 +484,41 @@ void WriteSubtrees(
     }
 }
 
+/**
+ * Queue the changes needed to bring the stored outputs of txid in line with
+ * coins. Outputs are immutable, so only outputs that were spent or created
+ * since the last write touch the database. If fFresh is set, the database is
+ * known to hold no outputs of this transaction and is not consulted.
+ */
+static size_t BatchWriteCoins(CDBBatch& batch, CDBWrapper& db, const uint256& txid, const CCoins& coins, bool fFresh)
+{
+    size_t changed = 0;
+    std::vector<bool> vStored(coins.vout.size(), false);
+    if (!fFresh) {
+        boost::scoped_ptr<CDBIterator> pcursor(db.NewIterator());
+        COutPoint outpoint;
+        if (SeekCoins(*pcursor, txid, outpoint)) {
+            do {
+                if (coins.IsAvailable(outpoint.n)) {
+                    vStored[outpoint.n] = true;
+                } else {
+                    batch.Erase(CoinEntry(&outpoint));
+                    changed++;
+                }
+            } while (NextCoin(*pcursor, outpoint));
+        }
+    }
+
+    for (uint32_t i = 0; i < coins.vout.size(); i++) {
+        if (!coins.vout[i].IsNull() && !vStored[i]) {
+            COutPoint outpoint(txid, i);
+            batch.Write(CoinEntry(&outpoint), CoinRecord(coins, coins.vout[i]));
+            changed++;
+        }
+    }
+    return changed;
+}
+
 bool CCoinsViewDB::BatchWrite(CCoinsMap &mapCoins,
                               const uint256 &hashBlock,
                               const uint256 &hashSproutAnchor,
@@ -353,32 +532,50 @@ bool CCoinsViewDB::BatchWrite(CCoinsMap &mapCoins,
                               CNullifiersMap &mapOrchardNullifiers,
                               CHistoryCacheMap &historyCacheMap,
                               SubtreeCache &cacheSaplingSubtrees,
-                              SubtreeCache &cacheOrchardSubtrees) {
+                              SubtreeCache &cacheOrchardSubtrees,
+                              bool fErase) {
     auto latestSaplingSubtree = GetLatestSubtree(SAPLING);
     auto latestOrchardSubtree = GetLatestSubtree(ORCHARD);
 
     CDBBatch batch(db);
     size_t count = 0;
     size_t changed = 0;
+    size_t outputs = 0;
     for (CCoinsMap::iterator it = mapCoins.begin(); it != mapCoins.end();) {
         if (it->second.flags & CCoinsCacheEntry::DIRTY) {
-            if (it->second.coins.IsPruned())
-                batch.Erase(make_pair(DB_COINS, it->first));
-            else
-                batch.Write(make_pair(DB_COINS, it->first), it->second.coins);
+            bool fFresh = it->second.flags & CCoinsCacheEntry::FRESH;
+            outputs += BatchWriteCoins(batch, db, it->first, it->second.coins, fFresh);
             changed++;
         }
         count++;
-        it = mapCoins.erase(it);
+        it = fErase ? mapCoins.erase(it) : std::next(it);
     }
 
-    ::BatchWriteAnchors<CAnchorsSproutMap, CAnchorsSproutMap::iterator, CAnchorsSproutCacheEntry, SproutMerkleTree>(batch, mapSproutAnchors, DB_SPROUT_ANCHOR);
-    ::BatchWriteAnchors<CAnchorsSaplingMap, CAnchorsSaplingMap::iterator, CAnchorsSaplingCacheEntry, SaplingMerkleTree>(batch, mapSaplingAnchors, DB_SAPLING_ANCHOR);
-    ::BatchWriteAnchors<CAnchorsOrchardMap, CAnchorsOrchardMap::iterator, CAnchorsOrchardCacheEntry, OrchardMerkleFrontier>(batch, mapOrchardAnchors, DB_ORCHARD_ANCHOR);
+    ::BatchWriteAnchors<CAnchorsSproutMap, CAnchorsSproutMap::iterator, CAnchorsSproutCacheEntry, SproutMerkleTree>(batch, mapSproutAnchors, DB_SPROUT_ANCHOR, fErase);
+    ::BatchWriteAnchors<CAnchorsSaplingMap, CAnchorsSaplingMap::iterator, CAnchorsSaplingCacheEntry, SaplingMerkleTree>(batch, mapSaplingAnchors, DB_SAPLING_ANCHOR, fErase);
+    ::BatchWriteAnchors<CAnchorsOrchardMap, CAnchorsOrchardMap::iterator, CAnchorsOrchardCacheEntry, OrchardMerkleFrontier>(batch, mapOrchardAnchors, DB_ORCHARD_ANCHOR, fErase);
+
+    // Nullifiers are added to the filter before they are written, and only
+    // removed once they are gone from the database.
+    std::vector<uint64_t> vFilterErase;
+    size_t nFilterRebuild = 0;
+    {
+        LOCK(cs_nullifierFilter);
+        if (nullifierFilter) {
+            size_t nFilterSize = nullifierFilter->size();
+            if (!PrepareNullifierFilter(mapSproutNullifiers, SPROUT, vFilterErase) ||
+                !PrepareNullifierFilter(mapSaplingNullifiers, SAPLING, vFilterErase) ||
+                !PrepareNullifierFilter(mapOrchardNullifiers, ORCHARD, vFilterErase)) {
+                LogPrintf("%s: nullifier filter is full, rebuilding it after this write\n", __func__);
+                nullifierFilter.reset();
+                nFilterRebuild = 2 * nFilterSize;
+            }
+        }
+    }
 
-    ::BatchWriteNullifiers(batch, mapSproutNullifiers, DB_NULLIFIER);
-    ::BatchWriteNullifiers(batch, mapSaplingNullifiers, DB_SAPLING_NULLIFIER);
-    ::BatchWriteNullifiers(batch, mapOrchardNullifiers, DB_ORCHARD_NULLIFIER);
+    ::BatchWriteNullifiers(batch, mapSproutNullifiers, DB_NULLIFIER, fErase);
+    ::BatchWriteNullifiers(batch, mapSaplingNullifiers, DB_SAPLING_NULLIFIER, fErase);
+    ::BatchWriteNullifiers(batch, mapOrchardNullifiers, DB_ORCHARD_NULLIFIER, fErase);
 
     ::BatchWriteHistory(batch, historyCacheMap);
 
@@ -397,11 +594,194 @@ bool CCoinsViewDB::BatchWrite(CCoinsMap &mapCoins,
     if (!hashOrchardAnchor.IsNull())
         batch.Write(DB_BEST_ORCHARD_ANCHOR, hashOrchardAnchor);
 
-    LogPrint("coindb", "Committing %u changed transactions (out of %u) to coin database...\n", (unsigned int)changed, (unsigned int)count);
-    return db.WriteBatch(batch);
+    LogPrint("coindb", "Committing %u changed transactions (out of %u, %u outputs) to coin database...\n", (unsigned int)changed, (unsigned int)count, (unsigned int)outputs);
+    if (!db.WriteBatch(batch))
+        return false;
+
+    if (nFilterRebuild > 0) {
+        BuildNullifierFilter(nFilterRebuild);
+    } else {
+        LOCK(cs_nullifierFilter);
+        if (nullifierFilter) {
+            for (uint64_t hash : vFilterErase) {
+                nullifierFilter->erase(hash);
+            }
+        }
+    }
+    return true;
+}
+
+bool CCoinsViewDB::PrepareNullifierFilter(const CNullifiersMap &mapNullifiers, ShieldedType type, std::vector<uint64_t> &vErase) {
+    AssertLockHeld(cs_nullifierFilter);
+    char dbChar = NullifierKeyPrefix(type);
+    for (const auto& entry : mapNullifiers) {
+        if (!(entry.second.flags & CNullifiersCacheEntry::DIRTY))
+            continue;
+        uint64_t hash = NullifierFilterHash(entry.first, type);
+        // Each stored nullifier must be in the filter exactly once, so that
+        // erasing it cannot take away the fingerprint of another one. The
+        // database is only consulted when the filter already matches.
+        bool fStored = nullifierFilter->contains(hash) && db.Exists(make_pair(dbChar, entry.first));
+        if (entry.second.entered) {
+            if (!fStored && !nullifierFilter->insert(hash))
+                return false;
+        } else if (fStored) {
+            vErase.push_back(hash);
+        }
+    }
+    return true;
+}
+
+void CCoinsViewDB::BuildNullifierFilter(size_t nCapacity) {
+    int64_t nStart = GetTimeMillis();
+    while (true) {
+        std::unique_ptr<CuckooFilter::filter> filter(new CuckooFilter::filter(nCapacity));
+        bool fFull = false;
+        for (ShieldedType type : {SPROUT, SAPLING, ORCHARD}) {
+            char dbChar = NullifierKeyPrefix(type);
+            boost::scoped_ptr<CDBIterator> pcursor(db.NewIterator());
+            pcursor->Seek(make_pair(dbChar, uint256()));
+            std::pair<char, uint256> key;
+            while (!fFull && pcursor->Valid() && pcursor->GetKey(key) && key.first == dbChar) {
+                if (ShutdownRequested())
+                    return;
+                fFull = !filter->insert(NullifierFilterHash(key.second, type)) || filter->full();
+                pcursor->Next();
+            }
+        }
+        if (!fFull) {
+            LogPrintf("Loaded %u nullifiers into the nullifier filter (%.1f MiB) in %dms\n",
+                filter->size(), filter->DynamicMemoryUsage() * (1.0 / (1 << 20)), GetTimeMillis() - nStart);
+            LOCK(cs_nullifierFilter);
+            nullifierFilter = std::move(filter);
+            return;
+        }
+        nCapacity *= 2;
+    }
+}
+
+void CCoinsViewDB::LoadNullifierFilter() {
+    // Each record holds a one-byte prefix, the nullifier and a one-byte value.
+    size_t nEstimate = 0;
+    for (ShieldedType type : {SPROUT, SAPLING, ORCHARD}) {
+        char dbChar = NullifierKeyPrefix(type);
+        nEstimate += db.EstimateSize(dbChar, (char)(dbChar + 1)) / 34;
+    }
+    // Leave room for the nullifiers of the coming blocks.
+    BuildNullifierFilter(std::max<size_t>(nEstimate + nEstimate / 4, 1 << 16));
+}
+
+// Snapshot records are (key, value) pairs of serialized bytes, in database
+// order, terminated by an empty key.
+bool CCoinsViewDB::WriteSnapshot(CAutoFile& file, const CCoinsSnapshotMetadata& metadata, uint256& hashSnapshot, uint64_t& nRecords) const {
+    CHashWriter ss(SER_GETHASH, PROTOCOL_VERSION);
+    ss << metadata;
+    nRecords = 0;
+    try {
+        file << metadata;
+        boost::scoped_ptr<CDBIterator> pcursor(const_cast<CDBWrapper*>(&db)->NewIterator());
+        for (pcursor->SeekToFirst(); pcursor->Valid(); pcursor->Next()) {
+            boost::this_thread::interruption_point();
+            std::vector<unsigned char> key = pcursor->GetKeyBytes();
+            std::vector<unsigned char> value = pcursor->GetValueBytes();
+            ss << key << value;
+            file << key << value;
+            nRecords++;
+        }
+        file << std::vector<unsigned char>();
+    } catch (const std::exception& e) {
+        return error("%s: failed to write snapshot: %s", __func__, e.what());
+    }
+    hashSnapshot = ss.GetHash();
+    return true;
+}
+
+bool HashCoinsSnapshot(CAutoFile& file, const CCoinsSnapshotMetadata& metadata, uint256& hashSnapshot, uint64_t& nRecords) {
+    CHashWriter ss(SER_GETHASH, PROTOCOL_VERSION);
+    ss << metadata;
+    nRecords = 0;
+    try {
+        std::vector<unsigned char> key, value;
+        while (true) {
+            boost::this_thread::interruption_point();
+            file >> key;
+            if (key.empty())
+                break;
+            file >> value;
+            ss << key << value;
+            nRecords++;
+        }
+    } catch (const std::exception& e) {
+        return error("%s: failed to read snapshot: %s", __func__, e.what());
+    }
+    hashSnapshot = ss.GetHash();
+    return true;
+}
+
+bool CCoinsViewDB::LoadSnapshot(CAutoFile& file, const CCoinsSnapshotMetadata& metadata, const uint256& hashExpected) {
+    bool fNullifierFilter;
+    {
+        LOCK(cs_nullifierFilter);
+        fNullifierFilter = nullifierFilter != nullptr;
+        nullifierFilter.reset();
+    }
+
+    const std::vector<unsigned char> keyBestBlock(1, DB_BEST_BLOCK);
+    std::vector<unsigned char> valueBestBlock;
+    size_t batch_size = 1 << 24;
+    CDBBatch batch(db);
+    {
+        boost::scoped_ptr<CDBIterator> pcursor(db.NewIterator());
+        for (pcursor->SeekToFirst(); pcursor->Valid(); pcursor->Next()) {
+            batch.EraseRaw(pcursor->GetKeyBytes());
+        }
+    }
+    CHashWriter ss(SER_GETHASH, PROTOCOL_VERSION);
+    ss << metadata;
+    uint64_t count = 0;
+    try {
+        std::vector<unsigned char> key, value;
+        while (true) {
+            boost::this_thread::interruption_point();
+            file >> key;
+            if (key.empty())
+                break;
+            file >> value;
+            ss << key << value;
+            if (key == keyBestBlock) {
+                valueBestBlock = value;
+            } else {
+                batch.WriteRaw(key, value);
+            }
+            if (++count % 100000 == 0) {
+                LogPrintf("Loaded %u chain state records from snapshot...\n", count);
+            }
+            if (batch.SizeEstimate() > batch_size) {
+                if (!db.WriteBatch(batch))
+                    return error("%s: failed to write to coin database", __func__);
+                batch.Clear();
+            }
+        }
+    } catch (const std::exception& e) {
+        return error("%s: failed to read snapshot: %s", __func__, e.what());
+    }
+    // The file is read again after its hash was checked by the caller, so
+    // check that it has not changed in between.
+    if (ss.GetHash() != hashExpected)
+        return error("%s: snapshot hash does not match", __func__);
+    if (valueBestBlock.empty())
+        return error("%s: snapshot has no best block", __func__);
+    batch.WriteRaw(keyBestBlock, valueBestBlock);
+    if (!db.WriteBatch(batch, true))
+        return error("%s: failed to write to coin database", __func__);
+    LogPrintf("Loaded %u chain state records from snapshot\n", count);
+
+    if (fNullifierFilter)
+        LoadNullifierFilter();
+    return true;
 }
 
-CBlockTreeDB::CBlockTreeDB(size_t nCacheSize, bool fMemory, bool fWipe) : CDBWrapper(GetDataDir() / "blocks" / "index", nCacheSize, fMemory, fWipe) {
+CBlockTreeDB::CBlockTreeDB(size_t nCacheSize, bool fMemory, bool fWipe, const CDBOptions& dbOptions) : CDBWrapper(GetDataDir() / "blocks" / "index", nCacheSize, fMemory, fWipe, dbOptions) {
 }
 
 bool CBlockTreeDB::ReadBlockFileInfo(int nFile, CBlockFileInfo &info) const {
@@ -420,6 +800,18 @@ bool CBlockTreeDB::ReadReindexing(bool &fReindexing) const {
     return true;
 }
 
+bool CBlockTreeDB::WriteBlockIndexSnapshot(const uint256& hashSnapshot) {
+    return Write(DB_BLOCK_INDEX_SNAPSHOT, hashSnapshot, true);
+}
+
+bool CBlockTreeDB::ReadBlockIndexSnapshot(uint256& hashSnapshot) const {
+    return Read(DB_BLOCK_INDEX_SNAPSHOT, hashSnapshot);
+}
+
+bool CBlockTreeDB::EraseBlockIndexSnapshot() {
+    return Erase(DB_BLOCK_INDEX_SNAPSHOT, true);
+}
+
 bool CBlockTreeDB::ReadLastBlockFile(int &nFile) const {
     return Read(DB_LAST_BLOCK, nFile);
 }
@@ -429,30 +821,35 @@ bool CCoinsViewDB::GetStats(CCoinsStats &stats) const {
        only need read operations on it, use a const-cast to get around
        that restriction.  */
     boost::scoped_ptr<CDBIterator> pcursor(const_cast<CDBWrapper*>(&db)->NewIterator());
-    pcursor->Seek(DB_COINS);
+    pcursor->Seek(DB_COIN);
 
     CHashWriter ss(SER_GETHASH, PROTOCOL_VERSION);
     stats.hashBlock = GetBestBlock();
     ss << stats.hashBlock;
     CAmount nTotalAmount = 0;
+    // Outputs of a transaction are adjacent, so the per-transaction hash
+    // layout of the previous database format is kept.
+    uint256 prevHash;
+    bool fFirst = true;
     while (pcursor->Valid()) {
         boost::this_thread::interruption_point();
-        std::pair<char, uint256> key;
-        CCoins coins;
-        if (pcursor->GetKey(key) && key.first == DB_COINS) {
-            if (pcursor->GetValue(coins)) {
-                stats.nTransactions++;
-                for (unsigned int i=0; i<coins.vout.size(); i++) {
-                    const CTxOut &out = coins.vout[i];
-                    if (!out.IsNull()) {
-                        stats.nTransactionOutputs++;
-                        ss << VARINT(i+1);
-                        ss << out;
-                        nTotalAmount += out.nValue;
-                    }
+        COutPoint outpoint;
+        CoinEntry entry(&outpoint);
+        CoinRecord record;
+        if (pcursor->GetKey(entry) && entry.key == DB_COIN) {
+            if (pcursor->GetValue(record)) {
+                if (fFirst || outpoint.hash != prevHash) {
+                    if (!fFirst)
+                        ss << VARINT(0);
+                    stats.nTransactions++;
+                    prevHash = outpoint.hash;
+                    fFirst = false;
                 }
+                stats.nTransactionOutputs++;
+                ss << VARINT(outpoint.n + 1);
+                ss << record.out;
+                nTotalAmount += record.out.nValue;
                 stats.nSerializedSize += 32 + pcursor->GetValueSize();
-                ss << VARINT(0);
             } else {
                 return error("CCoinsViewDB::GetStats() : unable to read value");
             }
@@ -461,6 +858,8 @@ bool CCoinsViewDB::GetStats(CCoinsStats &stats) const {
         }
         pcursor->Next();
     }
+    if (!fFirst)
+        ss << VARINT(0);
     {
         LOCK(cs_main);
         stats.nHeight = mapBlockIndex.find(stats.hashBlock)->second->nHeight;
@@ -470,164 +869,1207 @@ bool CCoinsViewDB::GetStats(CCoinsStats &stats) const {
     return true;
 }
 
-bool CBlockTreeDB::WriteBatchSync(const std::vector<std::pair<int, const CBlockFileInfo*> >& fileInfo, int nLastFile, const std::vector<CBlockIndex*>& blockinfo) {
-    MetricsIncrementCounter("zcashd.debug.blocktree.write_batch");
-    CDBBatch batch(*this);
-    for (const auto& it : fileInfo) {
-        batch.Write(make_pair(DB_BLOCK_FILES, it.first), *it.second);
-    }
-    batch.Write(DB_LAST_BLOCK, nLastFile);
-    for (const auto& it : blockinfo) {
-        std::pair<char, uint256> key = make_pair(DB_BLOCK_INDEX, it->GetBlockHash());
-        try {
-            CDiskBlockIndex dbindex {it, [this, &key]() {
-                MetricsIncrementCounter("zcashd.debug.blocktree.write_batch_read_dbindex");
-                // It can happen that the index entry is written, then the Equihash solution is cleared from memory,
-                // then the index entry is rewritten. In that case we must read the solution from the old entry.
-                CDiskBlockIndex dbindex_old;
-                if (!Read(key, dbindex_old)) {
-                    LogPrintf("%s: Failed to read index entry", __func__);
-                    throw runtime_error("Failed to read index entry");
-                }
-                return dbindex_old.GetSolution();
-            }};
-            batch.Write(key, dbindex);
-        } catch (const runtime_error&) {
-            return false;
-        }
-    }
-    return WriteBatch(batch, true);
-}
-
-bool CBlockTreeDB::EraseBatchSync(const std::vector<const CBlockIndex*>& blockinfo) {
-    CDBBatch batch(*this);
-    for (std::vector<const CBlockIndex*>::const_iterator it=blockinfo.begin(); it != blockinfo.end(); it++) {
-        batch.Erase(make_pair(DB_BLOCK_INDEX, (*it)->GetBlockHash()));
-    }
-    return WriteBatch(batch, true);
-}
-
-bool CBlockTreeDB::ReadDiskBlockIndex(const uint256 &blockhash, CDiskBlockIndex &dbindex) const {
-    return Read(make_pair(DB_BLOCK_INDEX, blockhash), dbindex);
-}
-
-bool CBlockTreeDB::ReadTxIndex(const uint256 &txid, CDiskTxPos &pos) const {
-    return Read(make_pair(DB_TXINDEX, txid), pos);
-}
-
-bool CBlockTreeDB::WriteTxIndex(const std::vector<std::pair<uint256, CDiskTxPos> >&vect) {
-    CDBBatch batch(*this);
-    for (std::vector<std::pair<uint256,CDiskTxPos> >::const_iterator it=vect.begin(); it!=vect.end(); it++)
-        batch.Write(make_pair(DB_TXINDEX, it->first), it->second);
-    return WriteBatch(batch);
+CCoinsViewDBCursor::CCoinsViewDBCursor(CDBIterator* pcursorIn, const uint256& hashBegin, const std::optional<uint256>& hashEndIn) :
+    pcursor(pcursorIn), hashEnd(hashEndIn)
+{
+    pcursor->Seek(make_pair(DB_COIN, hashBegin));
+    ReadKey();
 }
 
-// START insightexplorer
-// https://github.com/bitpay/bitcoin/commit/017f548ea6d89423ef568117447e61dd5707ec42#diff-81e4f16a1b5d5b7ca25351a63d07cb80R183
-bool CBlockTreeDB::UpdateAddressUnspentIndex(const std::vector<CAddressUnspentDbEntry> &vect)
+void CCoinsViewDBCursor::ReadKey()
 {
-    CDBBatch batch(*this);
-    for (std::vector<CAddressUnspentDbEntry>::const_iterator it=vect.begin(); it!=vect.end(); it++) {
-        if (it->second.IsNull()) {
-            batch.Erase(make_pair(DB_ADDRESSUNSPENTINDEX, it->first));
-        } else {
-            batch.Write(make_pair(DB_ADDRESSUNSPENTINDEX, it->first), it->second);
-        }
-    }
-    return WriteBatch(batch);
+    CoinEntry entry(&outpoint);
+    fValid = pcursor->Valid() && pcursor->GetKey(entry) && entry.key == DB_COIN &&
+        (!hashEnd.has_value() || outpoint.hash < hashEnd.value());
 }
 
-bool CBlockTreeDB::ReadAddressUnspentIndex(uint160 addressHash, int type, std::vector<CAddressUnspentDbEntry> &unspentOutputs)
+bool CCoinsViewDBCursor::GetTxOut(CTxOut& out) const
 {
-    boost::scoped_ptr<CDBIterator> pcursor(NewIterator());
-
-    pcursor->Seek(make_pair(DB_ADDRESSUNSPENTINDEX, CAddressIndexIteratorKey(type, addressHash)));
-
-    while (pcursor->Valid()) {
-        boost::this_thread::interruption_point();
-        std::pair<char,CAddressUnspentKey> key;
-        if (!(pcursor->GetKey(key) && key.first == DB_ADDRESSUNSPENTINDEX && key.second.hashBytes == addressHash))
-            break;
-        CAddressUnspentValue nValue;
-        if (!pcursor->GetValue(nValue))
-            return error("failed to get address unspent value");
-        unspentOutputs.push_back(make_pair(key.second, nValue));
-        pcursor->Next();
+    CoinRecord record;
+    if (!pcursor->GetValue(record)) {
+        return false;
     }
+    out = record.out;
     return true;
 }
 
-bool CBlockTreeDB::WriteAddressIndex(const std::vector<CAddressIndexDbEntry> &vect) {
-    CDBBatch batch(*this);
-    for (std::vector<CAddressIndexDbEntry>::const_iterator it=vect.begin(); it!=vect.end(); it++)
-        batch.Write(make_pair(DB_ADDRESSINDEX, it->first), it->second);
-    return WriteBatch(batch);
+void CCoinsViewDBCursor::Next()
+{
+    pcursor->Next();
+    ReadKey();
 }
 
-bool CBlockTreeDB::EraseAddressIndex(const std::vector<CAddressIndexDbEntry> &vect) {
-    CDBBatch batch(*this);
-    for (std::vector<CAddressIndexDbEntry>::const_iterator it=vect.begin(); it!=vect.end(); it++)
-        batch.Erase(make_pair(DB_ADDRESSINDEX, it->first));
-    return WriteBatch(batch);
+CCoinsViewDBCursor* CCoinsViewDB::Cursor() const
+{
+    // See GetStats for why the const-cast is needed.
+    return new CCoinsViewDBCursor(const_cast<CDBWrapper*>(&db)->NewIterator(), uint256(), std::nullopt);
 }
 
-bool CBlockTreeDB::ReadAddressIndex(
-        uint160 addressHash, int type,
-        std::vector<CAddressIndexDbEntry> &addressIndex,
-        int start, int end)
+std::vector<std::unique_ptr<CCoinsViewDBCursor>> CCoinsViewDB::Cursors(size_t nParts) const
 {
-    boost::scoped_ptr<CDBIterator> pcursor(NewIterator());
+    // Estimate the size of the outputs of the txids starting with each byte.
+    // Txids are uniformly distributed, so this is fine-grained enough for
+    // any useful number of parts.
+    static const int SLICES = 256;
+    auto sliceStart = [](int i) {
+        uint256 hash;
+        *hash.begin() = i;
+        return make_pair(DB_COIN, hash);
+    };
+    std::vector<uint64_t> vSizes(SLICES);
+    uint64_t nTotal = 0;
+    for (int i = 0; i < SLICES; i++) {
+        auto end = i + 1 < SLICES ? sliceStart(i + 1) : make_pair((char)(DB_COIN + 1), uint256());
+        vSizes[i] = db.EstimateSize(sliceStart(i), end);
+        nTotal += vSizes[i];
+    }
+    // Recently written records are not yet counted; treat the slices as
+    // equal if nothing is.
+    if (nTotal == 0) {
+        std::fill(vSizes.begin(), vSizes.end(), 1);
+        nTotal = SLICES;
+    }
 
-    if (start > 0 && end > 0) {
-        pcursor->Seek(make_pair(DB_ADDRESSINDEX, CAddressIndexIteratorHeightKey(type, addressHash, start)));
-    } else {
-        pcursor->Seek(make_pair(DB_ADDRESSINDEX, CAddressIndexIteratorKey(type, addressHash)));
+    nParts = std::max<size_t>(1, std::min<size_t>(nParts, SLICES));
+    std::vector<std::unique_ptr<CCoinsViewDBCursor>> vCursors;
+    uint256 hashBegin;
+    uint64_t nCumulative = 0;
+    for (int i = 0; i < SLICES; i++) {
+        nCumulative += vSizes[i];
+        bool fLast = i + 1 == SLICES;
+        // Close the current range once it reaches its share of the total.
+        if (fLast || (vCursors.size() + 1 < nParts && nCumulative * nParts >= nTotal * (vCursors.size() + 1))) {
+            std::optional<uint256> hashEnd;
+            if (!fLast) {
+                hashEnd = sliceStart(i + 1).second;
+            }
+            vCursors.emplace_back(new CCoinsViewDBCursor(const_cast<CDBWrapper*>(&db)->NewIterator(), hashBegin, hashEnd));
+            if (fLast) {
+                break;
+            }
+            hashBegin = hashEnd.value();
+        }
+    }
+    return vCursors;
+}
+
+bool CCoinsViewDB::Upgrade() {
+    boost::scoped_ptr<CDBIterator> pcursor(db.NewIterator());
+    pcursor->Seek(make_pair(DB_COINS, uint256()));
+    std::pair<char, uint256> key;
+    // An upgraded database has no records in the legacy format.
+    if (!pcursor->Valid() || !pcursor->GetKey(key) || key.first != DB_COINS) {
+        return true;
     }
 
+    int64_t count = 0;
+    LogPrintf("Upgrading UTXO database to the per-output format...\n");
+    uiInterface.ShowProgress(_("Upgrading UTXO database"), 0);
+    size_t batch_size = 1 << 24;
+    CDBBatch batch(db);
+    int reportDone = 0;
+    std::pair<char, uint256> prev_key = make_pair(DB_COINS, uint256());
+    std::pair<char, uint256> last_key = prev_key;
     while (pcursor->Valid()) {
         boost::this_thread::interruption_point();
-        std::pair<char,CAddressIndexKey> key;
-        if (!(pcursor->GetKey(key) && key.first == DB_ADDRESSINDEX && key.second.hashBytes == addressHash))
+        if (ShutdownRequested()) {
             break;
-        if (end > 0 && key.second.blockHeight > end)
+        }
+        if (pcursor->GetKey(key) && key.first == DB_COINS) {
+            if (count++ % 256 == 0) {
+                uint32_t high = 0x100 * *key.second.begin() + *(key.second.begin() + 1);
+                int percentageDone = (int)(high * 100.0 / 65536.0 + 0.5);
+                uiInterface.ShowProgress(_("Upgrading UTXO database"), percentageDone);
+                if (reportDone < percentageDone / 10) {
+                    // report max. every 10% step
+                    LogPrintf("[%d%%]...", percentageDone);
+                    reportDone = percentageDone / 10;
+                }
+            }
+            CCoins coins;
+            if (!pcursor->GetValue(coins)) {
+                return error("%s: cannot parse CCoins record", __func__);
+            }
+            for (uint32_t i = 0; i < coins.vout.size(); i++) {
+                if (!coins.vout[i].IsNull()) {
+                    COutPoint outpoint(key.second, i);
+                    batch.Write(CoinEntry(&outpoint), CoinRecord(coins, coins.vout[i]));
+                }
+            }
+            batch.Erase(key);
+            last_key = key;
+            if (batch.SizeEstimate() > batch_size) {
+                db.WriteBatch(batch);
+                batch.Clear();
+                db.CompactRange(prev_key, key);
+                prev_key = key;
+            }
+            pcursor->Next();
+        } else {
             break;
-        CAmount nValue;
-        if (!pcursor->GetValue(nValue))
-            return error("failed to get address index value");
-        addressIndex.push_back(make_pair(key.second, nValue));
-        pcursor->Next();
+        }
     }
-    return true;
+    db.WriteBatch(batch);
+    if (count > 0) {
+        db.CompactRange(make_pair(DB_COINS, uint256()), last_key);
+    }
+    uiInterface.ShowProgress("", 100);
+    LogPrintf("[%s].\n", ShutdownRequested() ? "CANCELLED" : "DONE");
+    return !ShutdownRequested();
 }
 
-bool CBlockTreeDB::ReadSpentIndex(CSpentIndexKey &key, CSpentIndexValue &value) const {
-    return Read(make_pair(DB_SPENTINDEX, key), value);
+CCoinsViewAsyncWriter::CCoinsViewAsyncWriter(CCoinsView *viewIn) : CCoinsViewBacked(viewIn)
+{
+    writerThread = std::thread(&CCoinsViewAsyncWriter::ThreadWrite, this);
 }
 
-bool CBlockTreeDB::UpdateSpentIndex(const std::vector<CSpentIndexDbEntry> &vect) {
-    CDBBatch batch(*this);
-    for (std::vector<CSpentIndexDbEntry>::const_iterator it=vect.begin(); it!=vect.end(); it++) {
-        if (it->second.IsNull()) {
-            batch.Erase(make_pair(DB_SPENTINDEX, it->first));
-        } else {
-            batch.Write(make_pair(DB_SPENTINDEX, it->first), it->second);
-        }
+CCoinsViewAsyncWriter::~CCoinsViewAsyncWriter()
+{
+    {
+        LOCK(cs_pending);
+        fStop = true;
     }
-    return WriteBatch(batch);
+    condPending.notify_all();
+    writerThread.join();
 }
 
-bool CBlockTreeDB::WriteTimestampIndex(const CTimestampIndexKey &timestampIndex) {
-    CDBBatch batch(*this);
-    batch.Write(make_pair(DB_TIMESTAMPINDEX, timestampIndex), 0);
-    return WriteBatch(batch);
+const CNullifiersMap& CCoinsViewAsyncWriter::Snapshot::Nullifiers(ShieldedType type) const
+{
+    switch (type) {
+        case SPROUT:
+            return mapSproutNullifiers;
+        case SAPLING:
+            return mapSaplingNullifiers;
+        case ORCHARD:
+            return mapOrchardNullifiers;
+        default:
+            throw std::runtime_error("Unknown shielded type");
+    }
 }
 
-bool CBlockTreeDB::ReadTimestampIndex(unsigned int high, unsigned int low,
-    const bool fActiveOnly, std::vector<std::pair<uint256, unsigned int> > &hashes)
+SubtreeCache& CCoinsViewAsyncWriter::Snapshot::Subtrees(ShieldedType type)
 {
-    boost::scoped_ptr<CDBIterator> pcursor(NewIterator());
+    switch (type) {
+        case SAPLING:
+            return cacheSaplingSubtrees;
+        case ORCHARD:
+            return cacheOrchardSubtrees;
+        default:
+            throw std::runtime_error("Subtrees: unsupported shielded type");
+    }
+}
+
+void CCoinsViewAsyncWriter::ThreadWrite()
+{
+    RenameThread("zc-coinswriter");
+    while (true) {
+        Snapshot* snapshot;
+        {
+            WAIT_LOCK(cs_pending, lock);
+            condPending.wait(lock, [this] { return fQueued || fStop; });
+            if (!fQueued) {
+                return;
+            }
+            snapshot = pending.get();
+        }
+
+        // The snapshot is not modified until fQueued is cleared, and the
+        // backing view only reads it, so it can keep serving lookups.
+        int64_t nStart = GetTimeMicros();
+        bool fOk = false;
+        try {
+            fOk = base->BatchWrite(snapshot->mapCoins,
+                                   snapshot->hashBlock,
+                                   snapshot->hashSproutAnchor,
+                                   snapshot->hashSaplingAnchor,
+                                   snapshot->hashOrchardAnchor,
+                                   snapshot->mapSproutAnchors,
+                                   snapshot->mapSaplingAnchors,
+                                   snapshot->mapOrchardAnchors,
+                                   snapshot->mapSproutNullifiers,
+                                   snapshot->mapSaplingNullifiers,
+                                   snapshot->mapOrchardNullifiers,
+                                   snapshot->historyCacheMap,
+                                   snapshot->cacheSaplingSubtrees,
+                                   snapshot->cacheOrchardSubtrees,
+                                   false);
+        } catch (const std::exception& e) {
+            LogPrintf("%s: %s\n", __func__, e.what());
+        }
+        if (fOk) {
+            LogPrint("coindb", "Wrote coins snapshot in background: %.2fms\n", (GetTimeMicros() - nStart) * 0.001);
+        } else {
+            LogPrintf("%s: failed to write coins snapshot\n", __func__);
+        }
+
+        {
+            LOCK(cs_pending);
+            if (fOk) {
+                pending.reset();
+            } else {
+                fWriteFailed = true;
+            }
+            fQueued = false;
+        }
+        condPending.notify_all();
+    }
+}
+
+bool CCoinsViewAsyncWriter::Sync() const
+{
+    WAIT_LOCK(cs_pending, lock);
+    condPending.wait(lock, [this] { return !fQueued; });
+    return !fWriteFailed;
+}
+
+template<typename Map, typename Tree>
+static bool GetSnapshotAnchorAt(const Map& map, const uint256 &rt, Tree &tree, bool &fFound)
+{
+    typename Map::const_iterator it = map.find(rt);
+    fFound = it != map.end();
+    if (fFound && it->second.entered) {
+        tree = it->second.tree;
+        return true;
+    }
+    return false;
+}
+
+bool CCoinsViewAsyncWriter::GetSproutAnchorAt(const uint256 &rt, SproutMerkleTree &tree) const {
+    {
+        LOCK(cs_pending);
+        bool fFound = false;
+        if (pending) {
+            bool fRet = GetSnapshotAnchorAt(pending->mapSproutAnchors, rt, tree, fFound);
+            if (fFound) return fRet;
+        }
+    }
+    return base->GetSproutAnchorAt(rt, tree);
+}
+
+bool CCoinsViewAsyncWriter::GetSaplingAnchorAt(const uint256 &rt, SaplingMerkleTree &tree) const {
+    {
+        LOCK(cs_pending);
+        bool fFound = false;
+        if (pending) {
+            bool fRet = GetSnapshotAnchorAt(pending->mapSaplingAnchors, rt, tree, fFound);
+            if (fFound) return fRet;
+        }
+    }
+    return base->GetSaplingAnchorAt(rt, tree);
+}
+
+bool CCoinsViewAsyncWriter::GetOrchardAnchorAt(const uint256 &rt, OrchardMerkleFrontier &tree) const {
+    {
+        LOCK(cs_pending);
+        bool fFound = false;
+        if (pending) {
+            bool fRet = GetSnapshotAnchorAt(pending->mapOrchardAnchors, rt, tree, fFound);
+            if (fFound) return fRet;
+        }
+    }
+    return base->GetOrchardAnchorAt(rt, tree);
+}
+
+bool CCoinsViewAsyncWriter::GetNullifier(const uint256 &nullifier, ShieldedType type) const {
+    {
+        LOCK(cs_pending);
+        if (pending) {
+            const CNullifiersMap& map = pending->Nullifiers(type);
+            CNullifiersMap::const_iterator it = map.find(nullifier);
+            if (it != map.end()) {
+                return it->second.entered;
+            }
+        }
+    }
+    return base->GetNullifier(nullifier, type);
+}
+
+void CCoinsViewAsyncWriter::GetNullifiers(const std::set<uint256> &nullifiers, ShieldedType type, std::set<uint256> &spent) const {
+    std::set<uint256> missing;
+    {
+        LOCK(cs_pending);
+        if (!pending) {
+            missing = nullifiers;
+        } else {
+            const CNullifiersMap& map = pending->Nullifiers(type);
+            for (const uint256& nf : nullifiers) {
+                CNullifiersMap::const_iterator it = map.find(nf);
+                if (it == map.end()) {
+                    missing.insert(nf);
+                } else if (it->second.entered) {
+                    spent.insert(nf);
+                }
+            }
+        }
+    }
+    if (!missing.empty()) {
+        base->GetNullifiers(missing, type, spent);
+    }
+}
+
+bool CCoinsViewAsyncWriter::GetCoins(const uint256 &txid, CCoins &coins) const {
+    {
+        LOCK(cs_pending);
+        if (pending) {
+            CCoinsMap::const_iterator it = pending->mapCoins.find(txid);
+            if (it != pending->mapCoins.end()) {
+                coins = it->second.coins;
+                return !coins.IsPruned();
+            }
+        }
+    }
+    return base->GetCoins(txid, coins);
+}
+
+bool CCoinsViewAsyncWriter::HaveCoins(const uint256 &txid) const {
+    {
+        LOCK(cs_pending);
+        if (pending) {
+            CCoinsMap::const_iterator it = pending->mapCoins.find(txid);
+            if (it != pending->mapCoins.end()) {
+                return !it->second.coins.IsPruned();
+            }
+        }
+    }
+    return base->HaveCoins(txid);
+}
+
+uint256 CCoinsViewAsyncWriter::GetBestBlock() const {
+    {
+        LOCK(cs_pending);
+        if (pending && !pending->hashBlock.IsNull()) {
+            return pending->hashBlock;
+        }
+    }
+    return base->GetBestBlock();
+}
+
+uint256 CCoinsViewAsyncWriter::GetBestAnchor(ShieldedType type) const {
+    {
+        LOCK(cs_pending);
+        if (pending) {
+            uint256 hash;
+            switch (type) {
+                case SPROUT:
+                    hash = pending->hashSproutAnchor;
+                    break;
+                case SAPLING:
+                    hash = pending->hashSaplingAnchor;
+                    break;
+                case ORCHARD:
+                    hash = pending->hashOrchardAnchor;
+                    break;
+                default:
+                    throw std::runtime_error("Unknown shielded type");
+            }
+            if (!hash.IsNull()) {
+                return hash;
+            }
+        }
+    }
+    return base->GetBestAnchor(type);
+}
+
+HistoryIndex CCoinsViewAsyncWriter::GetHistoryLength(uint32_t epochId) const {
+    {
+        LOCK(cs_pending);
+        if (pending) {
+            auto it = pending->historyCacheMap.find(epochId);
+            if (it != pending->historyCacheMap.end()) {
+                return it->second.length;
+            }
+        }
+    }
+    return base->GetHistoryLength(epochId);
+}
+
+HistoryNode CCoinsViewAsyncWriter::GetHistoryAt(uint32_t epochId, HistoryIndex index) const {
+    {
+        LOCK(cs_pending);
+        if (pending) {
+            auto it = pending->historyCacheMap.find(epochId);
+            if (it != pending->historyCacheMap.end() && index >= it->second.updateDepth) {
+                return it->second.appends.at(index);
+            }
+        }
+    }
+    return base->GetHistoryAt(epochId, index);
+}
+
+uint256 CCoinsViewAsyncWriter::GetHistoryRoot(uint32_t epochId) const {
+    {
+        LOCK(cs_pending);
+        if (pending) {
+            auto it = pending->historyCacheMap.find(epochId);
+            if (it != pending->historyCacheMap.end()) {
+                return it->second.root;
+            }
+        }
+    }
+    return base->GetHistoryRoot(epochId);
+}
+
+std::optional<libzcash::LatestSubtree> CCoinsViewAsyncWriter::GetLatestSubtree(ShieldedType type) const {
+    {
+        LOCK(cs_pending);
+        if (pending) {
+            // The snapshot's subtree caches were initialized against
+            // the backing view before they were handed over, so this
+            // does not modify them.
+            return pending->Subtrees(type).GetLatestSubtree(base);
+        }
+    }
+    return base->GetLatestSubtree(type);
+}
+
+std::optional<libzcash::SubtreeData> CCoinsViewAsyncWriter::GetSubtreeData(
+    ShieldedType type,
+    libzcash::SubtreeIndex index) const
+{
+    {
+        LOCK(cs_pending);
+        if (pending) {
+            return pending->Subtrees(type).GetSubtreeData(base, index);
+        }
+    }
+    return base->GetSubtreeData(type, index);
+}
+
+template<typename Map, typename MapEntry>
+static void CopyDirtyAnchors(const Map& from, Map& to)
+{
+    for (const auto& entry : from) {
+        if (entry.second.flags & MapEntry::DIRTY) {
+            to.insert(entry);
+        }
+    }
+}
+
+static void CopyDirtyNullifiers(const CNullifiersMap& from, CNullifiersMap& to)
+{
+    for (const auto& entry : from) {
+        if (entry.second.flags & CNullifiersCacheEntry::DIRTY) {
+            to.insert(entry);
+        }
+    }
+}
+
+bool CCoinsViewAsyncWriter::BatchWrite(CCoinsMap &mapCoins,
+                                       const uint256 &hashBlock,
+                                       const uint256 &hashSproutAnchor,
+                                       const uint256 &hashSaplingAnchor,
+                                       const uint256 &hashOrchardAnchor,
+                                       CAnchorsSproutMap &mapSproutAnchors,
+                                       CAnchorsSaplingMap &mapSaplingAnchors,
+                                       CAnchorsOrchardMap &mapOrchardAnchors,
+                                       CNullifiersMap &mapSproutNullifiers,
+                                       CNullifiersMap &mapSaplingNullifiers,
+                                       CNullifiersMap &mapOrchardNullifiers,
+                                       CHistoryCacheMap &historyCacheMap,
+                                       SubtreeCache &cacheSaplingSubtrees,
+                                       SubtreeCache &cacheOrchardSubtrees,
+                                       bool fErase) {
+    // Changes are only ever layered on top of a completed write, so that
+    // fresh entries really are absent from the backing view by the time
+    // they are written to it.
+    if (!Sync()) {
+        return false;
+    }
+
+    std::unique_ptr<Snapshot> snapshot(new Snapshot());
+    for (CCoinsMap::iterator it = mapCoins.begin(); it != mapCoins.end();) {
+        if ((it->second.flags & CCoinsCacheEntry::DIRTY) &&
+            !((it->second.flags & CCoinsCacheEntry::FRESH) && it->second.coins.IsPruned())) {
+            CCoinsCacheEntry& entry = snapshot->mapCoins[it->first];
+            if (fErase) {
+                entry.coins.swap(it->second.coins);
+            } else {
+                entry.coins = it->second.coins;
+            }
+            entry.flags = it->second.flags;
+        }
+        it = fErase ? mapCoins.erase(it) : std::next(it);
+    }
+    snapshot->hashBlock = hashBlock;
+    snapshot->hashSproutAnchor = hashSproutAnchor;
+    snapshot->hashSaplingAnchor = hashSaplingAnchor;
+    snapshot->hashOrchardAnchor = hashOrchardAnchor;
+    CopyDirtyAnchors<CAnchorsSproutMap, CAnchorsSproutCacheEntry>(mapSproutAnchors, snapshot->mapSproutAnchors);
+    CopyDirtyAnchors<CAnchorsSaplingMap, CAnchorsSaplingCacheEntry>(mapSaplingAnchors, snapshot->mapSaplingAnchors);
+    CopyDirtyAnchors<CAnchorsOrchardMap, CAnchorsOrchardCacheEntry>(mapOrchardAnchors, snapshot->mapOrchardAnchors);
+    CopyDirtyNullifiers(mapSproutNullifiers, snapshot->mapSproutNullifiers);
+    CopyDirtyNullifiers(mapSaplingNullifiers, snapshot->mapSaplingNullifiers);
+    CopyDirtyNullifiers(mapOrchardNullifiers, snapshot->mapOrchardNullifiers);
+    snapshot->historyCacheMap = historyCacheMap;
+    snapshot->cacheSaplingSubtrees = cacheSaplingSubtrees;
+    snapshot->cacheOrchardSubtrees = cacheOrchardSubtrees;
+
+    {
+        LOCK(cs_pending);
+        pending = std::move(snapshot);
+        fQueued = true;
+    }
+    condPending.notify_all();
+    return true;
+}
+
+bool CCoinsViewAsyncWriter::GetStats(CCoinsStats &stats) const {
+    if (!Sync()) {
+        return false;
+    }
+    return base->GetStats(stats);
+}
+
+bool CBlockTreeDB::WriteBatchSync(const std::vector<std::pair<int, const CBlockFileInfo*> >& fileInfo, int nLastFile, const std::vector<CBlockIndex*>& blockinfo) {
+    MetricsIncrementCounter("zcashd.debug.blocktree.write_batch");
+    CDBBatch batch(*this);
+    for (const auto& it : fileInfo) {
+        batch.Write(make_pair(DB_BLOCK_FILES, it.first), *it.second);
+    }
+    batch.Write(DB_LAST_BLOCK, nLastFile);
+    for (const auto& it : blockinfo) {
+        std::pair<char, uint256> key = make_pair(DB_BLOCK_INDEX, it->GetBlockHash());
+        try {
+            CDiskBlockIndex dbindex {it, [this, &key]() {
+                MetricsIncrementCounter("zcashd.debug.blocktree.write_batch_read_dbindex");
+                // It can happen that the index entry is written, then the Equihash solution is cleared from memory,
+                // then the index entry is rewritten. In that case we must read the solution from the old entry.
+                CDiskBlockIndex dbindex_old;
+                if (!Read(key, dbindex_old)) {
+                    LogPrintf("%s: Failed to read index entry", __func__);
+                    throw runtime_error("Failed to read index entry");
+                }
+                return dbindex_old.GetSolution();
+            }};
+            batch.Write(key, dbindex);
+        } catch (const runtime_error&) {
+            return false;
+        }
+    }
+    return WriteBatch(batch, true);
+}
+
+bool CBlockTreeDB::EraseBatchSync(const std::vector<const CBlockIndex*>& blockinfo) {
+    CDBBatch batch(*this);
+    for (std::vector<const CBlockIndex*>::const_iterator it=blockinfo.begin(); it != blockinfo.end(); it++) {
+        batch.Erase(make_pair(DB_BLOCK_INDEX, (*it)->GetBlockHash()));
+    }
+    return WriteBatch(batch, true);
+}
+
+bool CBlockTreeDB::ReadDiskBlockIndex(const uint256 &blockhash, CDiskBlockIndex &dbindex) const {
+    return Read(make_pair(DB_BLOCK_INDEX, blockhash), dbindex);
+}
+
+bool CBlockTreeDB::ReadTxIndex(const uint256 &txid, CDiskTxPos &pos) const {
+    return Read(make_pair(DB_TXINDEX, txid), pos);
+}
+
+bool CBlockTreeDB::WriteTxIndex(const std::vector<std::pair<uint256, CDiskTxPos> >&vect) {
+    CDBBatch batch(*this);
+    for (std::vector<std::pair<uint256,CDiskTxPos> >::const_iterator it=vect.begin(); it!=vect.end(); it++)
+        batch.Write(make_pair(DB_TXINDEX, it->first), it->second);
+    return WriteBatch(batch);
+}
+
+// START insightexplorer
+//! Queued index writes beyond this size make block processing wait.
+static const size_t MAX_INSIGHT_QUEUE_BYTES = 64 << 20;
+//! Size of the batches in which old index entries are moved to the new database.
+static const size_t INSIGHT_MIGRATE_BATCH_BYTES = 16 << 20;
+
+CInsightIndexDB::CInsightIndexDB(size_t nCacheSize, bool fMemory, bool fWipe, const CDBOptions& dbOptions) :
+    CDBWrapper(GetDataDir() / "indexes" / "insight", nCacheSize, fMemory, fWipe, dbOptions)
+{
+    writerThread = std::thread(&CInsightIndexDB::ThreadWrite, this);
+}
+
+CInsightIndexDB::~CInsightIndexDB()
+{
+    {
+        LOCK(cs_queue);
+        fStop = true;
+    }
+    condQueue.notify_all();
+    writerThread.join();
+}
+
+void CInsightIndexDB::ThreadWrite()
+{
+    RenameThread("zc-insightdb");
+    while (true) {
+        CDBBatch* batch;
+        {
+            WAIT_LOCK(cs_queue, lock);
+            condQueue.wait(lock, [this] { return (!queue.empty() && !fWriteFailed) || fStop; });
+            if (queue.empty() || fWriteFailed) {
+                return;
+            }
+            batch = queue.front().batch.get();
+        }
+
+        // The front of the queue is only removed by this thread.
+        bool fOk = false;
+        try {
+            fOk = WriteBatch(*batch);
+        } catch (const std::exception& e) {
+            LogPrintf("%s: %s\n", __func__, e.what());
+        }
+        if (!fOk) {
+            LogPrintf("%s: failed to write insight explorer indexes\n", __func__);
+        }
+
+        {
+            LOCK(cs_queue);
+            if (fOk) {
+                PendingWrite& front = queue.front();
+                nQueuedBytes -= front.batch->SizeEstimate();
+                if (front.hashTimestampBlock) {
+                    mapPendingTimestamps.erase(*front.hashTimestampBlock);
+                }
+                for (const AddressId& id : front.vSummaries) {
+                    // A later batch may write the summary again.
+                    auto it = mapPendingSummaries.find(id);
+                    if (it != mapPendingSummaries.end() && it->second.second == front.nSequence) {
+                        mapPendingSummaries.erase(it);
+                    }
+                }
+                queue.pop_front();
+                nWritten++;
+            } else {
+                fWriteFailed = true;
+            }
+        }
+        condQueue.notify_all();
+    }
+}
+
+bool CInsightIndexDB::Enqueue(std::unique_ptr<CDBBatch> batch, const std::optional<std::pair<uint256, unsigned int>>& timestamp,
+    const std::map<AddressId, CAddressSummary>& mapSummaries)
+{
+    size_t nBytes = batch->SizeEstimate();
+    {
+        WAIT_LOCK(cs_queue, lock);
+        condQueue.wait(lock, [this] { return nQueuedBytes < MAX_INSIGHT_QUEUE_BYTES || fWriteFailed; });
+        if (fWriteFailed) {
+            return false;
+        }
+        PendingWrite write;
+        write.batch = std::move(batch);
+        if (timestamp) {
+            write.hashTimestampBlock = timestamp->first;
+            mapPendingTimestamps[timestamp->first] = timestamp->second;
+        }
+        nQueued++;
+        write.nSequence = nQueued;
+        for (const auto& entry : mapSummaries) {
+            mapPendingSummaries[entry.first] = std::make_pair(entry.second, nQueued);
+            write.vSummaries.push_back(entry.first);
+        }
+        queue.push_back(std::move(write));
+        nQueuedBytes += nBytes;
+    }
+    condQueue.notify_all();
+    return true;
+}
 
-    pcursor->Seek(make_pair(DB_TIMESTAMPINDEX, CTimestampIndexIteratorKey(low)));
+bool CInsightIndexDB::WaitForWrites() const
+{
+    WAIT_LOCK(cs_queue, lock);
+    uint64_t nTarget = nQueued;
+    condQueue.wait(lock, [this, nTarget] { return nWritten >= nTarget || fWriteFailed; });
+    return !fWriteFailed;
+}
+
+bool CInsightIndexDB::Sync()
+{
+    if (!WaitForWrites()) {
+        return false;
+    }
+    return CDBWrapper::Sync();
+}
+
+// https://github.com/bitpay/bitcoin/commit/017f548ea6d89423ef568117447e61dd5707ec42#diff-81e4f16a1b5d5b7ca25351a63d07cb80R183
+bool CInsightIndexDB::UpdateAddressUnspentIndex(const std::vector<CAddressUnspentDbEntry> &vect)
+{
+    std::unique_ptr<CDBBatch> batch(new CDBBatch(*this));
+    for (std::vector<CAddressUnspentDbEntry>::const_iterator it=vect.begin(); it!=vect.end(); it++) {
+        if (it->second.IsNull()) {
+            batch->Erase(make_pair(DB_ADDRESSUNSPENTINDEX, it->first));
+        } else {
+            batch->Write(make_pair(DB_ADDRESSUNSPENTINDEX, it->first), it->second);
+        }
+    }
+    return Enqueue(std::move(batch));
+}
+
+bool CInsightIndexDB::ReadAddressUnspentIndex(uint160 addressHash, int type, std::vector<CAddressUnspentDbEntry> &unspentOutputs)
+{
+    if (!WaitForWrites()) {
+        return false;
+    }
+    boost::scoped_ptr<CDBIterator> pcursor(NewIterator());
+
+    pcursor->Seek(make_pair(DB_ADDRESSUNSPENTINDEX, CAddressIndexIteratorKey(type, addressHash)));
+
+    while (pcursor->Valid()) {
+        boost::this_thread::interruption_point();
+        std::pair<char,CAddressUnspentKey> key;
+        if (!(pcursor->GetKey(key) && key.first == DB_ADDRESSUNSPENTINDEX && key.second.hashBytes == addressHash))
+            break;
+        CAddressUnspentValue nValue;
+        if (!pcursor->GetValue(nValue))
+            return error("failed to get address unspent value");
+        unspentOutputs.push_back(make_pair(key.second, nValue));
+        pcursor->Next();
+    }
+    return true;
+}
+
+void CInsightIndexDB::UpdateAddressSummaries(CDBBatch& batch, const std::vector<CAddressIndexDbEntry> &vect, bool fErase,
+    std::map<AddressId, CAddressSummary>& mapSummaries) const
+{
+    // Only the block connecting or disconnecting thread writes summaries, so
+    // one that is not queued is up to date in the database.
+    std::set<std::pair<AddressId, uint256>> setTxs;
+    for (const auto& entry : vect) {
+        AddressId id(entry.first.type, entry.first.hashBytes);
+        auto it = mapSummaries.find(id);
+        if (it == mapSummaries.end()) {
+            it = mapSummaries.emplace(id, CAddressSummary()).first;
+            bool fPending = false;
+            {
+                LOCK(cs_queue);
+                auto itPending = mapPendingSummaries.find(id);
+                if (itPending != mapPendingSummaries.end()) {
+                    it->second = itPending->second.first;
+                    fPending = true;
+                }
+            }
+            if (!fPending) {
+                Read(make_pair(DB_ADDRESSSUMMARY, CAddressIndexIteratorKey(id.first, id.second)), it->second);
+            }
+        }
+        CAmount nSign = fErase ? -1 : 1;
+        it->second.balance += nSign * entry.second;
+        if (entry.second > 0) {
+            it->second.received += nSign * entry.second;
+        }
+        if (setTxs.insert(std::make_pair(id, entry.first.txhash)).second) {
+            it->second.txCount += nSign;
+        }
+    }
+    for (const auto& entry : mapSummaries) {
+        auto key = make_pair(DB_ADDRESSSUMMARY, CAddressIndexIteratorKey(entry.first.first, entry.first.second));
+        if (entry.second.IsNull()) {
+            batch.Erase(key);
+        } else {
+            batch.Write(key, entry.second);
+        }
+    }
+}
+
+bool CInsightIndexDB::WriteAddressIndex(const std::vector<CAddressIndexDbEntry> &vect) {
+    std::unique_ptr<CDBBatch> batch(new CDBBatch(*this));
+    for (std::vector<CAddressIndexDbEntry>::const_iterator it=vect.begin(); it!=vect.end(); it++)
+        batch->Write(make_pair(DB_ADDRESSINDEX, it->first), it->second);
+    std::map<AddressId, CAddressSummary> mapSummaries;
+    UpdateAddressSummaries(*batch, vect, false, mapSummaries);
+    return Enqueue(std::move(batch), std::nullopt, mapSummaries);
+}
+
+bool CInsightIndexDB::EraseAddressIndex(const std::vector<CAddressIndexDbEntry> &vect) {
+    std::unique_ptr<CDBBatch> batch(new CDBBatch(*this));
+    for (std::vector<CAddressIndexDbEntry>::const_iterator it=vect.begin(); it!=vect.end(); it++)
+        batch->Erase(make_pair(DB_ADDRESSINDEX, it->first));
+    std::map<AddressId, CAddressSummary> mapSummaries;
+    UpdateAddressSummaries(*batch, vect, true, mapSummaries);
+    return Enqueue(std::move(batch), std::nullopt, mapSummaries);
+}
+
+bool CInsightIndexDB::ReadAddressSummary(uint160 addressHash, int type, CAddressSummary &summary) const
+{
+    if (!fAddressSummaries) {
+        return false;
+    }
+    AddressId id(type, addressHash);
+    {
+        LOCK(cs_queue);
+        auto it = mapPendingSummaries.find(id);
+        if (it != mapPendingSummaries.end()) {
+            summary = it->second.first;
+            return true;
+        }
+    }
+    summary.SetNull();
+    Read(make_pair(DB_ADDRESSSUMMARY, CAddressIndexIteratorKey(type, addressHash)), summary);
+    return true;
+}
+
+bool CInsightIndexDB::BuildAddressSummaries()
+{
+    const auto flagKey = std::make_pair(DB_INSIGHT_FLAG, std::string("addresssummaries"));
+    if (Exists(flagKey)) {
+        fAddressSummaries = true;
+        return true;
+    }
+    if (!WaitForWrites()) {
+        return false;
+    }
+
+    // Summaries written before they were all built may be partial.
+    int64_t nStart = GetTimeMillis();
+    CDBBatch batch(*this);
+    {
+        boost::scoped_ptr<CDBIterator> pcursor(NewIterator());
+        for (pcursor->Seek(DB_ADDRESSSUMMARY); pcursor->Valid(); pcursor->Next()) {
+            std::vector<unsigned char> key = pcursor->GetKeyBytes();
+            if (key.empty() || key[0] != (unsigned char)DB_ADDRESSSUMMARY) {
+                break;
+            }
+            batch.EraseRaw(key);
+        }
+    }
+
+    // The entries of an address are adjacent, and so are those of each of
+    // its transactions.
+    uint64_t nAddresses = 0;
+    boost::scoped_ptr<CDBIterator> pcursor(NewIterator());
+    pcursor->Seek(DB_ADDRESSINDEX);
+    std::optional<CAddressIndexKey> last;
+    CAddressSummary summary;
+    while (true) {
+        boost::this_thread::interruption_point();
+        std::pair<char, CAddressIndexKey> key;
+        bool fValid = pcursor->Valid() && pcursor->GetKey(key) && key.first == DB_ADDRESSINDEX;
+        if (last && (!fValid || key.second.type != last->type || key.second.hashBytes != last->hashBytes)) {
+            batch.Write(make_pair(DB_ADDRESSSUMMARY, CAddressIndexIteratorKey(last->type, last->hashBytes)), summary);
+            summary.SetNull();
+            nAddresses++;
+            if (batch.SizeEstimate() > INSIGHT_MIGRATE_BATCH_BYTES) {
+                if (!WriteBatch(batch)) {
+                    return error("%s: failed to write address summaries", __func__);
+                }
+                batch.Clear();
+                LogPrintf("Built the summaries of %u addresses\n", nAddresses);
+            }
+        }
+        if (!fValid) {
+            break;
+        }
+        CAmount nValue;
+        if (!pcursor->GetValue(nValue)) {
+            return error("%s: failed to get address index value", __func__);
+        }
+        summary.balance += nValue;
+        if (nValue > 0) {
+            summary.received += nValue;
+        }
+        if (!last || summary.txCount == 0 || key.second.txhash != last->txhash) {
+            summary.txCount++;
+        }
+        last = key.second;
+        pcursor->Next();
+    }
+    batch.Write(flagKey, '1');
+    if (!WriteBatch(batch, true)) {
+        return error("%s: failed to write address summaries", __func__);
+    }
+    LogPrintf("Built the summaries of %u addresses in %dms\n", nAddresses, GetTimeMillis() - nStart);
+    fAddressSummaries = true;
+    return true;
+}
+
+bool CInsightIndexDB::ReadAddressIndex(
+        uint160 addressHash, int type,
+        std::vector<CAddressIndexDbEntry> &addressIndex,
+        int start, int end)
+{
+    if (!WaitForWrites()) {
+        return false;
+    }
+    boost::scoped_ptr<CDBIterator> pcursor(NewIterator());
+
+    if (start > 0 && end > 0) {
+        pcursor->Seek(make_pair(DB_ADDRESSINDEX, CAddressIndexIteratorHeightKey(type, addressHash, start)));
+    } else {
+        pcursor->Seek(make_pair(DB_ADDRESSINDEX, CAddressIndexIteratorKey(type, addressHash)));
+    }
+
+    while (pcursor->Valid()) {
+        boost::this_thread::interruption_point();
+        std::pair<char,CAddressIndexKey> key;
+        if (!(pcursor->GetKey(key) && key.first == DB_ADDRESSINDEX && key.second.hashBytes == addressHash))
+            break;
+        if (end > 0 && key.second.blockHeight > end)
+            break;
+        CAmount nValue;
+        if (!pcursor->GetValue(nValue))
+            return error("failed to get address index value");
+        addressIndex.push_back(make_pair(key.second, nValue));
+        pcursor->Next();
+    }
+    return true;
+}
+
+namespace {
+
+//! The order of address index entries in the chain, with the address last.
+bool AddressIndexChainOrder(const CAddressIndexKey& a, const CAddressIndexKey& b)
+{
+    return std::tie(a.blockHeight, a.txindex, a.txhash, a.index, a.spending, a.type, a.hashBytes) <
+           std::tie(b.blockHeight, b.txindex, b.txhash, b.index, b.spending, b.type, b.hashBytes);
+}
+
+}
+
+bool CInsightIndexDB::ReadAddressIndexMerged(
+        const std::vector<std::pair<uint160, int>>& addresses, int start, int end,
+        const CAddressIndexKey* pAfter, size_t nLimit,
+        std::vector<CAddressIndexDbEntry> &addressIndex, bool& fMore)
+{
+    fMore = false;
+    if (!WaitForWrites()) {
+        return false;
+    }
+
+    // One cursor per address, each positioned at its next entry; the heap
+    // holds the entry of each cursor that has one.
+    std::set<std::pair<uint160, int>> setAddresses(addresses.begin(), addresses.end());
+    std::vector<std::pair<uint160, int>> vAddresses(setAddresses.begin(), setAddresses.end());
+    std::vector<std::unique_ptr<CDBIterator>> vCursors;
+    typedef std::pair<CAddressIndexDbEntry, size_t> HeapEntry;
+    auto greater = [](const HeapEntry& a, const HeapEntry& b) {
+        return AddressIndexChainOrder(b.first.first, a.first.first);
+    };
+    std::priority_queue<HeapEntry, std::vector<HeapEntry>, decltype(greater)> heap(greater);
+
+    auto next = [&](size_t i) -> bool {
+        CDBIterator* pcursor = vCursors[i].get();
+        const std::pair<uint160, int>& address = vAddresses[i];
+        while (pcursor->Valid()) {
+            boost::this_thread::interruption_point();
+            std::pair<char, CAddressIndexKey> key;
+            if (!(pcursor->GetKey(key) && key.first == DB_ADDRESSINDEX &&
+                  key.second.hashBytes == address.first && (int)key.second.type == address.second))
+                return true;
+            if (end > 0 && key.second.blockHeight > end)
+                return true;
+            if (pAfter && !AddressIndexChainOrder(*pAfter, key.second)) {
+                pcursor->Next();
+                continue;
+            }
+            CAmount nValue;
+            if (!pcursor->GetValue(nValue))
+                return error("failed to get address index value");
+            heap.push(std::make_pair(std::make_pair(key.second, nValue), i));
+            pcursor->Next();
+            return true;
+        }
+        return true;
+    };
+
+    int nSeekHeight = std::max(start, pAfter ? pAfter->blockHeight : 0);
+    for (const auto& address : vAddresses) {
+        vCursors.emplace_back(NewIterator());
+        if (nSeekHeight > 0) {
+            vCursors.back()->Seek(make_pair(DB_ADDRESSINDEX, CAddressIndexIteratorHeightKey(address.second, address.first, nSeekHeight)));
+        } else {
+            vCursors.back()->Seek(make_pair(DB_ADDRESSINDEX, CAddressIndexIteratorKey(address.second, address.first)));
+        }
+        if (!next(vCursors.size() - 1))
+            return false;
+    }
+
+    while (!heap.empty()) {
+        if (nLimit > 0 && addressIndex.size() == nLimit) {
+            fMore = true;
+            break;
+        }
+        HeapEntry top = heap.top();
+        heap.pop();
+        addressIndex.push_back(top.first);
+        if (!next(top.second))
+            return false;
+    }
+    return true;
+}
+
+//! The memory taken by an entry of the spent index cache.
+static size_t SpentCacheEntryUsage()
+{
+    // A node of the map, and a node of the list with two pointers.
+    return memusage::MallocUsage(sizeof(memusage::stl_tree_node<std::pair<const CSpentIndexKey, CSpentIndexValue>>) + sizeof(void*)) +
+        memusage::MallocUsage(sizeof(CSpentIndexKey) + 2 * sizeof(void*));
+}
+
+void CInsightIndexDB::CacheSpentInfo(const CSpentIndexKey& key, const CSpentIndexValue& value) const
+{
+    if (mapSpentCache.count(key)) return;
+    while (mapSpentCache.size() >= MAX_SPENT_INDEX_CACHE_ENTRIES) {
+        mapSpentCache.erase(listSpentLRU.back());
+        listSpentLRU.pop_back();
+        spentCacheStats.nEvictions++;
+    }
+    listSpentLRU.push_front(key);
+    mapSpentCache.emplace(key, CachedSpentInfo{value, listSpentLRU.begin()});
+    spentCacheStats.nInsertions++;
+}
+
+bool CInsightIndexDB::ReadSpentIndex(CSpentIndexKey &key, CSpentIndexValue &value) const {
+    CSpentIndexMap values;
+    if (!ReadSpentIndex(std::vector<CSpentIndexKey>{key}, values)) {
+        return false;
+    }
+    auto it = values.find(key);
+    if (it == values.end()) {
+        return false;
+    }
+    value = it->second;
+    return true;
+}
+
+bool CInsightIndexDB::ReadSpentIndex(const std::vector<CSpentIndexKey> &keys, CSpentIndexMap &values) const {
+    std::vector<CSpentIndexKey> vMissing;
+    {
+        LOCK(cs_spentCache);
+        for (const auto& key : keys) {
+            auto it = mapSpentCache.find(key);
+            if (it == mapSpentCache.end()) {
+                spentCacheStats.nMisses++;
+                vMissing.push_back(key);
+                continue;
+            }
+            spentCacheStats.nHits++;
+            listSpentLRU.splice(listSpentLRU.begin(), listSpentLRU, it->second.itLRU);
+            if (!it->second.value.IsNull()) {
+                values[key] = it->second.value;
+            }
+        }
+    }
+    if (vMissing.empty()) {
+        return true;
+    }
+    if (!WaitForWrites()) {
+        return false;
+    }
+
+    // Sorting groups the keys by transaction, and the entries of the outputs
+    // of a transaction are next to each other in the database, so each
+    // transaction takes one seek.
+    CSpentIndexKeyCompare compare;
+    std::sort(vMissing.begin(), vMissing.end(), compare);
+    vMissing.erase(std::unique(vMissing.begin(), vMissing.end()), vMissing.end());
+
+    std::vector<CSpentIndexDbEntry> vRead;
+    vRead.reserve(vMissing.size());
+    boost::scoped_ptr<CDBIterator> pcursor(const_cast<CInsightIndexDB*>(this)->NewIterator());
+    for (auto itBegin = vMissing.begin(); itBegin != vMissing.end(); ) {
+        const uint256 txid = itBegin->txid;
+        auto itEnd = std::find_if(itBegin, vMissing.end(),
+            [&](const CSpentIndexKey& key) { return key.txid != txid; });
+
+        std::map<unsigned int, CSpentIndexValue> mapFound;
+        if (itEnd - itBegin == 1) {
+            CSpentIndexValue value;
+            if (Read(make_pair(DB_SPENTINDEX, *itBegin), value)) {
+                mapFound.emplace(itBegin->outputIndex, value);
+            }
+        } else {
+            // The output index is serialized little-endian, so the entries
+            // of the transaction are not in the order of their indices, and
+            // the sweep goes on until all of the requested ones are found.
+            size_t nWanted = itEnd - itBegin;
+            pcursor->Seek(make_pair(DB_SPENTINDEX, CSpentIndexKey(txid, 0)));
+            while (pcursor->Valid() && mapFound.size() < nWanted) {
+                boost::this_thread::interruption_point();
+                std::pair<char, CSpentIndexKey> key;
+                if (!(pcursor->GetKey(key) && key.first == DB_SPENTINDEX && key.second.txid == txid)) {
+                    break;
+                }
+                if (std::binary_search(itBegin, itEnd, key.second, compare)) {
+                    CSpentIndexValue value;
+                    if (!pcursor->GetValue(value)) {
+                        return error("failed to get spent index value");
+                    }
+                    mapFound.emplace(key.second.outputIndex, value);
+                }
+                pcursor->Next();
+            }
+        }
+
+        for (auto it = itBegin; it != itEnd; it++) {
+            auto itFound = mapFound.find(it->outputIndex);
+            vRead.emplace_back(*it, itFound == mapFound.end() ? CSpentIndexValue() : itFound->second);
+        }
+        itBegin = itEnd;
+    }
+
+    LOCK(cs_spentCache);
+    for (const auto& [key, value] : vRead) {
+        if (!value.IsNull()) {
+            values[key] = value;
+        }
+        CacheSpentInfo(key, value);
+    }
+    return true;
+}
+
+bool CInsightIndexDB::UpdateSpentIndex(const std::vector<CSpentIndexDbEntry> &vect) {
+    std::unique_ptr<CDBBatch> batch(new CDBBatch(*this));
+    {
+        LOCK(cs_spentCache);
+        for (std::vector<CSpentIndexDbEntry>::const_iterator it=vect.begin(); it!=vect.end(); it++) {
+            if (it->second.IsNull()) {
+                batch->Erase(make_pair(DB_SPENTINDEX, it->first));
+            } else {
+                batch->Write(make_pair(DB_SPENTINDEX, it->first), it->second);
+            }
+            // Cached entries are read ahead of the queued writes, so they
+            // must change with them.
+            auto itCached = mapSpentCache.find(it->first);
+            if (itCached != mapSpentCache.end()) {
+                itCached->second.value = it->second;
+            }
+        }
+    }
+    return Enqueue(std::move(batch));
+}
+
+CCacheStats CInsightIndexDB::GetSpentIndexCacheStats() const
+{
+    LOCK(cs_spentCache);
+    CCacheStats result = spentCacheStats;
+    result.nEntries = mapSpentCache.size();
+    result.nMaxEntries = MAX_SPENT_INDEX_CACHE_ENTRIES;
+    result.nMemoryUsage = mapSpentCache.size() * SpentCacheEntryUsage();
+    return result;
+}
+
+bool CInsightIndexDB::WriteTimestampIndex(const CTimestampIndexKey &timestampIndex,
+    const CTimestampBlockIndexKey &blockhashIndex, const CTimestampBlockIndexValue &logicalts)
+{
+    std::unique_ptr<CDBBatch> batch(new CDBBatch(*this));
+    batch->Write(make_pair(DB_TIMESTAMPINDEX, timestampIndex), 0);
+    batch->Write(make_pair(DB_BLOCKHASHINDEX, blockhashIndex), logicalts);
+    return Enqueue(std::move(batch), std::make_pair(blockhashIndex.blockHash, logicalts.ltimestamp));
+}
+
+bool CInsightIndexDB::ReadTimestampIndex(unsigned int high, unsigned int low,
+    const bool fActiveOnly, const CTimestampIndexKey* pAfter, size_t nLimit,
+    std::vector<std::pair<uint256, unsigned int> > &hashes, bool& fMore)
+{
+    fMore = false;
+    if (!WaitForWrites()) {
+        return false;
+    }
+    boost::scoped_ptr<CDBIterator> pcursor(NewIterator());
+
+    if (pAfter && pAfter->timestamp >= low) {
+        pcursor->Seek(make_pair(DB_TIMESTAMPINDEX, *pAfter));
+    } else {
+        pcursor->Seek(make_pair(DB_TIMESTAMPINDEX, CTimestampIndexIteratorKey(low)));
+    }
 
     while (pcursor->Valid()) {
         boost::this_thread::interruption_point();
@@ -635,6 +2077,14 @@ bool CBlockTreeDB::ReadTimestampIndex(unsigned int high, unsigned int low,
         if (!(pcursor->GetKey(key) && key.first == DB_TIMESTAMPINDEX && key.second.timestamp < high)) {
             break;
         }
+        if (pAfter && key.second.timestamp == pAfter->timestamp && key.second.blockHash == pAfter->blockHash) {
+            pcursor->Next();
+            continue;
+        }
+        if (nLimit > 0 && hashes.size() == nLimit) {
+            fMore = true;
+            break;
+        }
         if (fActiveOnly) {
             CBlockIndex* pblockindex = mapBlockIndex[key.second.blockHash];
             if (chainActive.Contains(pblockindex)) {
@@ -648,16 +2098,19 @@ bool CBlockTreeDB::ReadTimestampIndex(unsigned int high, unsigned int low,
     return true;
 }
 
-bool CBlockTreeDB::WriteTimestampBlockIndex(const CTimestampBlockIndexKey &blockhashIndex,
-    const CTimestampBlockIndexValue &logicalts)
+bool CInsightIndexDB::ReadTimestampBlockIndex(const uint256 &hash, unsigned int &ltimestamp) const
 {
-    CDBBatch batch(*this);
-    batch.Write(make_pair(DB_BLOCKHASHINDEX, blockhashIndex), logicalts);
-    return WriteBatch(batch);
-}
+    // This is read for the previous block while connecting each block, so
+    // look in the queue rather than waiting for it.
+    {
+        LOCK(cs_queue);
+        auto it = mapPendingTimestamps.find(hash);
+        if (it != mapPendingTimestamps.end()) {
+            ltimestamp = it->second;
+            return true;
+        }
+    }
 
-bool CBlockTreeDB::ReadTimestampBlockIndex(const uint256 &hash, unsigned int &ltimestamp) const
-{
     CTimestampBlockIndexValue(lts);
     if (!Read(std::make_pair(DB_BLOCKHASHINDEX, hash), lts))
         return false;
@@ -665,6 +2118,45 @@ bool CBlockTreeDB::ReadTimestampBlockIndex(const uint256 &hash, unsigned int &lt
     ltimestamp = lts.ltimestamp;
     return true;
 }
+
+bool CInsightIndexDB::MigrateFrom(CBlockTreeDB& blocktree)
+{
+    const char prefixes[] = {DB_ADDRESSINDEX, DB_ADDRESSUNSPENTINDEX, DB_SPENTINDEX, DB_TIMESTAMPINDEX, DB_BLOCKHASHINDEX};
+    uint64_t nMoved = 0;
+    for (char prefix : prefixes) {
+        while (true) {
+            // Make each batch of copied entries durable before erasing them
+            // from the block tree, so that an interruption loses nothing.
+            CDBBatch batchCopy(*this);
+            CDBBatch batchErase(blocktree);
+            size_t nBatch = 0;
+            {
+                boost::scoped_ptr<CDBIterator> pcursor(blocktree.NewIterator());
+                for (pcursor->Seek(prefix); pcursor->Valid(); pcursor->Next()) {
+                    std::vector<unsigned char> key = pcursor->GetKeyBytes();
+                    if (key.empty() || key[0] != (unsigned char)prefix) {
+                        break;
+                    }
+                    batchCopy.WriteRaw(key, pcursor->GetValueBytes());
+                    batchErase.EraseRaw(key);
+                    nBatch++;
+                    if (batchCopy.SizeEstimate() > INSIGHT_MIGRATE_BATCH_BYTES) {
+                        break;
+                    }
+                }
+            }
+            if (nBatch == 0) {
+                break;
+            }
+            if (!WriteBatch(batchCopy, true) || !blocktree.WriteBatch(batchErase, true)) {
+                return error("%s: failed to move insight explorer indexes", __func__);
+            }
+            nMoved += nBatch;
+            LogPrintf("Moved %u insight explorer index entries to their own database\n", nMoved);
+        }
+    }
+    return true;
+}
 // END insightexplorer
 
 bool CBlockTreeDB::WriteFlag(const std::string &name, bool fValue) {
@@ -679,6 +2171,31 @@ bool CBlockTreeDB::ReadFlag(const std::string &name, bool &fValue) const {
     return true;
 }
 
+bool CBlockTreeDB::WriteTxOutSetStats(const std::map<uint256, CTxOutSetStats>& mapStats) {
+    CDBBatch batch(*this);
+    for (const auto& entry : mapStats) {
+        batch.Write(std::make_pair(DB_TXOUTSET_STATS, entry.first), entry.second);
+    }
+    return WriteBatch(batch);
+}
+
+bool CBlockTreeDB::ReadTxOutSetStats(const uint256& hashBlock, CTxOutSetStats& stats) const {
+    return Read(std::make_pair(DB_TXOUTSET_STATS, hashBlock), stats);
+}
+
+bool CBlockTreeDB::WriteTxOutSetState(const uint256& hashBlock, const CTxOutSetAccumulator& running) {
+    return Write(DB_TXOUTSET_STATE, std::make_pair(hashBlock, running));
+}
+
+bool CBlockTreeDB::ReadTxOutSetState(uint256& hashBlock, CTxOutSetAccumulator& running) const {
+    std::pair<uint256, CTxOutSetAccumulator> state;
+    if (!Read(DB_TXOUTSET_STATE, state))
+        return false;
+    hashBlock = state.first;
+    running = state.second;
+    return true;
+}
+
 bool CBlockTreeDB::LoadBlockIndexGuts(
     std::function<CBlockIndex*(const uint256&)> insertBlockIndex,
     const CChainParams& chainParams)
@@ -7,12 +7,25 @@
 #ifndef BITCOIN_TXDB_H
 #define BITCOIN_TXDB_H
 
+#include "addressindex.h"
 #include "coins.h"
+#include "coinstats.h"
+#include "cuckoofilter.h"
 #include "dbwrapper.h"
 #include "chain.h"
+#include "protocol.h"
+#include "spentindex.h"
+#include "sync.h"
 
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <list>
 #include <map>
+#include <memory>
+#include <optional>
 #include <string>
+#include <thread>
 #include <utility>
 #include <vector>
 
@@ -27,8 +40,6 @@ struct CAddressUnspentValue;
 struct CAddressIndexKey;
 struct CAddressIndexIteratorKey;
 struct CAddressIndexIteratorHeightKey;
-struct CSpentIndexKey;
-struct CSpentIndexValue;
 struct CTimestampIndexKey;
 struct CTimestampIndexIteratorKey;
 struct CTimestampBlockIndexKey;
@@ -47,6 +58,12 @@ static const int64_t nDefaultDbCache = 450;
 static const int64_t nMaxDbCache = sizeof(void*) > 4 ? 16384 : 1024;
 //! min. -dbcache in (MiB)
 static const int64_t nMinDbCache = 4;
+//! -dbasyncflush default
+static const bool DEFAULT_DB_ASYNC_FLUSH = true;
+//! -nullifierfilter default
+static const bool DEFAULT_NULLIFIER_FILTER = true;
+//! How many spent index entries to keep in memory.
+static const size_t MAX_SPENT_INDEX_CACHE_ENTRIES = 50000;
 
 struct CDiskTxPos : public CDiskBlockPos
 {
@@ -73,20 +90,241 @@ struct CDiskTxPos : public CDiskBlockPos
     }
 };
 
-/** CCoinsView backed by the coin database (chainstate/) */
+/**
+ * Header of a chain state snapshot, as written by dumptxoutset.
+ *
+ * Besides the block the snapshot was taken at, it records the chain totals
+ * and commitments of that block which a node loading the snapshot cannot
+ * compute without the earlier blocks. Everything but the network magic is
+ * covered by the snapshot hash.
+ */
+class CCoinsSnapshotMetadata
+{
+public:
+    static const int CURRENT_VERSION = 1;
+
+    CMessageHeader::MessageStartChars pchMessageStart;
+    int nVersion = CURRENT_VERSION;
+    uint256 hashBlock;
+    int nHeight = 0;
+    uint64_t nChainTx = 0;
+    std::optional<CAmount> nChainTotalSupply;
+    std::optional<CAmount> nChainTransparentValue;
+    CAmount nChainSaplingValue = 0;
+    CAmount nChainOrchardValue = 0;
+    CAmount nChainLockboxValue = 0;
+    uint256 hashAuthDataRoot;
+    uint256 hashChainHistoryRoot;
+
+    ADD_SERIALIZE_METHODS;
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream& s, Operation ser_action) {
+        if (!(s.GetType() & SER_GETHASH))
+            READWRITE(FLATDATA(pchMessageStart));
+        READWRITE(nVersion);
+        READWRITE(hashBlock);
+        READWRITE(nHeight);
+        READWRITE(nChainTx);
+        READWRITE(nChainTotalSupply);
+        READWRITE(nChainTransparentValue);
+        READWRITE(nChainSaplingValue);
+        READWRITE(nChainOrchardValue);
+        READWRITE(nChainLockboxValue);
+        READWRITE(hashAuthDataRoot);
+        READWRITE(hashChainHistoryRoot);
+    }
+};
+
+/**
+ * Read the records of a snapshot whose metadata has just been read from
+ * file, and compute the hash that CCoinsViewDB::WriteSnapshot reported for
+ * it. Returns false if the file is truncated or malformed.
+ */
+bool HashCoinsSnapshot(CAutoFile& file, const CCoinsSnapshotMetadata& metadata, uint256& hashSnapshot, uint64_t& nRecords);
+
+/**
+ * CCoinsView backed by the coin database (chainstate/)
+ *
+ * A BatchWrite with fErase set to false leaves every map it is given
+ * untouched, so that the caller can keep reading them concurrently.
+ */
+/**
+ * Iterator over the unspent outputs stored in a CCoinsViewDB, in outpoint
+ * order, optionally restricted to a range of txids. It reads the database as
+ * it was when the cursor was created.
+ */
+class CCoinsViewDBCursor
+{
+private:
+    std::unique_ptr<CDBIterator> pcursor;
+    COutPoint outpoint;
+    bool fValid;
+    //! If set, the cursor stops before the first txid that is not below it.
+    std::optional<uint256> hashEnd;
+
+    CCoinsViewDBCursor(CDBIterator* pcursorIn, const uint256& hashBegin, const std::optional<uint256>& hashEndIn);
+    void ReadKey();
+
+    friend class CCoinsViewDB;
+
+public:
+    bool Valid() const { return fValid; }
+    const COutPoint& GetOutPoint() const { return outpoint; }
+    bool GetTxOut(CTxOut& out) const;
+    void Next();
+};
+
 class CCoinsViewDB : public CCoinsView
 {
 protected:
     CDBWrapper db;
     CCoinsViewDB(std::string dbName, size_t nCacheSize, bool fMemory = false, bool fWipe = false);
+
+private:
+    //! Fingerprints of every stored nullifier, if enabled. Lookups of
+    //! nullifiers it does not contain are answered without reading the
+    //! database.
+    mutable Mutex cs_nullifierFilter;
+    std::unique_ptr<CuckooFilter::filter> nullifierFilter;
+    SaltedTxidHasher nullifierHasher;
+
+    uint64_t NullifierFilterHash(const uint256 &nf, ShieldedType type) const;
+    bool MayHaveNullifier(const uint256 &nf, ShieldedType type) const;
+    void BuildNullifierFilter(size_t nCapacity);
+    bool PrepareNullifierFilter(const CNullifiersMap &mapNullifiers, ShieldedType type, std::vector<uint64_t> &vErase);
+
 public:
-    CCoinsViewDB(size_t nCacheSize, bool fMemory = false, bool fWipe = false);
+    CCoinsViewDB(size_t nCacheSize, bool fMemory = false, bool fWipe = false, const CDBOptions& dbOptions = CDBOptions());
     ~CCoinsViewDB() {}
 
+    //! The underlying database, for reporting its statistics.
+    const CDBWrapper& GetDB() const { return db; }
+
     bool GetSproutAnchorAt(const uint256 &rt, SproutMerkleTree &tree) const;
     bool GetSaplingAnchorAt(const uint256 &rt, SaplingMerkleTree &tree) const;
     bool GetOrchardAnchorAt(const uint256 &rt, OrchardMerkleFrontier &tree) const;
     bool GetNullifier(const uint256 &nf, ShieldedType type) const;
+    void GetNullifiers(const std::set<uint256> &nullifiers, ShieldedType type, std::set<uint256> &spent) const;
+    bool GetCoins(const uint256 &txid, CCoins &coins) const;
+    bool HaveCoins(const uint256 &txid) const;
+    uint256 GetBestBlock() const;
+    uint256 GetBestAnchor(ShieldedType type) const;
+    HistoryIndex GetHistoryLength(uint32_t epochId) const;
+    HistoryNode GetHistoryAt(uint32_t epochId, HistoryIndex index) const;
+    uint256 GetHistoryRoot(uint32_t epochId) const;
+    std::optional<libzcash::LatestSubtree> GetLatestSubtree(ShieldedType type) const;
+    std::optional<libzcash::SubtreeData> GetSubtreeData(
+            ShieldedType type,
+            libzcash::SubtreeIndex index) const;
+    bool BatchWrite(CCoinsMap &mapCoins,
+                    const uint256 &hashBlock,
+                    const uint256 &hashSproutAnchor,
+                    const uint256 &hashSaplingAnchor,
+                    const uint256 &hashOrchardAnchor,
+                    CAnchorsSproutMap &mapSproutAnchors,
+                    CAnchorsSaplingMap &mapSaplingAnchors,
+                    CAnchorsOrchardMap &mapOrchardAnchors,
+                    CNullifiersMap &mapSproutNullifiers,
+                    CNullifiersMap &mapSaplingNullifiers,
+                    CNullifiersMap &mapOrchardNullifiers,
+                    CHistoryCacheMap &historyCacheMap,
+                    SubtreeCache &cacheSaplingSubtrees,
+                    SubtreeCache &cacheOrchardSubtrees,
+                    bool fErase);
+    bool GetStats(CCoinsStats &stats) const;
+
+    //! Return a cursor over the unspent outputs. The caller owns it.
+    CCoinsViewDBCursor* Cursor() const;
+
+    //! Return up to nParts cursors over disjoint ranges of txids that
+    //! together cover every unspent output, so that they can be read in
+    //! parallel. The ranges are balanced by the approximate size of their
+    //! records on disk. The outputs of a transaction are all in one range.
+    //! The database must not be written to while the cursors are created.
+    std::vector<std::unique_ptr<CCoinsViewDBCursor>> Cursors(size_t nParts) const;
+
+    //! Convert per-transaction records left by an older version to the
+    //! per-output format. Returns false on error or if interrupted.
+    bool Upgrade();
+
+    //! Build the nullifier filter from the nullifiers in the database. It is
+    //! kept up to date by BatchWrite, and grown when it fills up.
+    void LoadNullifierFilter();
+
+    //! Write metadata followed by every record of the database to file. The
+    //! database must not be written to meanwhile.
+    bool WriteSnapshot(CAutoFile& file, const CCoinsSnapshotMetadata& metadata, uint256& hashSnapshot, uint64_t& nRecords) const;
+
+    //! Replace the contents of the database with the records of a snapshot,
+    //! read from file just after its metadata. The best block is written
+    //! last, and only if the snapshot hash matches hashExpected, so that an
+    //! interrupted or failed load does not look like a complete one.
+    bool LoadSnapshot(CAutoFile& file, const CCoinsSnapshotMetadata& metadata, const uint256& hashExpected);
+};
+
+/**
+ * CCoinsView that writes batches to its backing view from a background thread.
+ *
+ * BatchWrite only copies the dirty entries it is given into a snapshot and
+ * returns, so the caller (which holds cs_main) does not wait for the disk.
+ * Until the snapshot has been written, reads are answered from it first.
+ * At most one snapshot is outstanding: a BatchWrite issued while the
+ * previous one is still being written waits for it to complete. Since the
+ * backing view commits each batch atomically, with the best block marker
+ * included, a crash leaves the database at the last completed write.
+ */
+class CCoinsViewAsyncWriter : public CCoinsViewBacked
+{
+private:
+    struct Snapshot {
+        CCoinsMapMemoryResource resource{};
+        CCoinsMap mapCoins{0, SaltedTxidHasher(), std::equal_to<uint256>(), &resource};
+        uint256 hashBlock;
+        uint256 hashSproutAnchor;
+        uint256 hashSaplingAnchor;
+        uint256 hashOrchardAnchor;
+        CAnchorsSproutMap mapSproutAnchors;
+        CAnchorsSaplingMap mapSaplingAnchors;
+        CAnchorsOrchardMap mapOrchardAnchors;
+        CNullifiersMap mapSproutNullifiers{0, SaltedTxidHasher(), std::equal_to<uint256>(), &resource};
+        CNullifiersMap mapSaplingNullifiers{0, SaltedTxidHasher(), std::equal_to<uint256>(), &resource};
+        CNullifiersMap mapOrchardNullifiers{0, SaltedTxidHasher(), std::equal_to<uint256>(), &resource};
+        CHistoryCacheMap historyCacheMap;
+        SubtreeCache cacheSaplingSubtrees = SubtreeCache(SAPLING);
+        SubtreeCache cacheOrchardSubtrees = SubtreeCache(ORCHARD);
+
+        const CNullifiersMap& Nullifiers(ShieldedType type) const;
+        SubtreeCache& Subtrees(ShieldedType type);
+    };
+
+    mutable Mutex cs_pending;
+    mutable std::condition_variable condPending;
+    //! The snapshot being written, if any. Only replaced or reset while
+    //! holding cs_pending, and otherwise only read.
+    std::unique_ptr<Snapshot> pending;
+    //! Whether pending still has to be written.
+    bool fQueued = false;
+    //! Set if a write failed; pending is then kept so reads stay correct.
+    bool fWriteFailed = false;
+    bool fStop = false;
+    std::thread writerThread;
+
+    void ThreadWrite();
+
+    CCoinsViewAsyncWriter(const CCoinsViewAsyncWriter&) = delete;
+    CCoinsViewAsyncWriter& operator=(const CCoinsViewAsyncWriter&) = delete;
+
+public:
+    CCoinsViewAsyncWriter(CCoinsView *viewIn);
+    //! Completes any outstanding write before returning.
+    ~CCoinsViewAsyncWriter();
+
+    bool GetSproutAnchorAt(const uint256 &rt, SproutMerkleTree &tree) const;
+    bool GetSaplingAnchorAt(const uint256 &rt, SaplingMerkleTree &tree) const;
+    bool GetOrchardAnchorAt(const uint256 &rt, OrchardMerkleFrontier &tree) const;
+    bool GetNullifier(const uint256 &nullifier, ShieldedType type) const;
+    void GetNullifiers(const std::set<uint256> &nullifiers, ShieldedType type, std::set<uint256> &spent) const;
     bool GetCoins(const uint256 &txid, CCoins &coins) const;
     bool HaveCoins(const uint256 &txid) const;
     uint256 GetBestBlock() const;
@@ -111,15 +349,20 @@ public:
                     CNullifiersMap &mapOrchardNullifiers,
                     CHistoryCacheMap &historyCacheMap,
                     SubtreeCache &cacheSaplingSubtrees,
-                    SubtreeCache &cacheOrchardSubtrees);
+                    SubtreeCache &cacheOrchardSubtrees,
+                    bool fErase);
     bool GetStats(CCoinsStats &stats) const;
+
+    //! Wait until the outstanding write, if any, has reached the backing
+    //! view. Returns false if a write has failed.
+    bool Sync() const;
 };
 
 /** Access to the block database (blocks/index/) */
 class CBlockTreeDB : public CDBWrapper
 {
 public:
-    CBlockTreeDB(size_t nCacheSize, bool fMemory = false, bool fWipe = false);
+    CBlockTreeDB(size_t nCacheSize, bool fMemory = false, bool fWipe = false, const CDBOptions& dbOptions = CDBOptions());
 private:
     CBlockTreeDB(const CBlockTreeDB&);
     void operator=(const CBlockTreeDB&);
@@ -130,31 +373,153 @@ public:
     bool ReadLastBlockFile(int &nFile) const;
     bool WriteReindexing(bool fReindexing);
     bool ReadReindexing(bool &fReindexing) const;
+    //! The hash of the block index snapshot that matches the database, if
+    //! the database was not written since the snapshot was.
+    bool WriteBlockIndexSnapshot(const uint256& hashSnapshot);
+    bool ReadBlockIndexSnapshot(uint256& hashSnapshot) const;
+    bool EraseBlockIndexSnapshot();
     bool ReadDiskBlockIndex(const uint256 &blockhash, CDiskBlockIndex &dbindex) const;
     bool ReadTxIndex(const uint256 &txid, CDiskTxPos &pos) const;
     bool WriteTxIndex(const std::vector<std::pair<uint256, CDiskTxPos> > &vect);
 
-    // START insightexplorer
+    bool WriteFlag(const std::string &name, bool fValue);
+    bool ReadFlag(const std::string &name, bool &fValue) const;
+    bool WriteTxOutSetStats(const std::map<uint256, CTxOutSetStats>& mapStats);
+    bool ReadTxOutSetStats(const uint256& hashBlock, CTxOutSetStats& stats) const;
+    bool WriteTxOutSetState(const uint256& hashBlock, const CTxOutSetAccumulator& running);
+    bool ReadTxOutSetState(uint256& hashBlock, CTxOutSetAccumulator& running) const;
+    bool LoadBlockIndexGuts(
+        std::function<CBlockIndex*(const uint256&)> insertBlockIndex,
+        const CChainParams& chainParams);
+};
+
+// START insightexplorer
+/**
+ * Access to the address, spent and timestamp indexes of -insightexplorer and
+ * -lightwalletd, which are kept apart from the block index so that they do
+ * not slow down its compactions and flushes.
+ *
+ * Writes are queued and applied in order by a background thread; reads see
+ * every write queued before them. A failed write makes all later writes, and
+ * Sync(), fail.
+ */
+class CInsightIndexDB : public CDBWrapper
+{
+private:
+    typedef std::pair<unsigned int, uint160> AddressId;
+
+    struct PendingWrite {
+        std::unique_ptr<CDBBatch> batch;
+        //! The block whose logical timestamp the batch writes, if any.
+        std::optional<uint256> hashTimestampBlock;
+        //! The addresses whose summaries the batch writes.
+        std::vector<AddressId> vSummaries;
+        //! Count of batches queued up to and including this one.
+        uint64_t nSequence;
+    };
+
+    mutable Mutex cs_queue;
+    mutable std::condition_variable condQueue;
+    std::deque<PendingWrite> queue;
+    //! Logical timestamps of blocks that are still queued.
+    std::map<uint256, unsigned int> mapPendingTimestamps;
+    //! Summaries of addresses that are still queued, and the sequence
+    //! number of the last batch that writes each of them.
+    std::map<AddressId, std::pair<CAddressSummary, uint64_t>> mapPendingSummaries;
+    //! Whether every address has its summary, rather than only those
+    //! changed since the summaries were introduced.
+    std::atomic<bool> fAddressSummaries{false};
+    size_t nQueuedBytes = 0;
+    //! Counts of batches queued and written so far.
+    uint64_t nQueued = 0;
+    uint64_t nWritten = 0;
+    bool fWriteFailed = false;
+    bool fStop = false;
+    std::thread writerThread;
+
+    struct CachedSpentInfo {
+        //! Null if the output is not spent.
+        CSpentIndexValue value;
+        std::list<CSpentIndexKey>::iterator itLRU;
+    };
+
+    //! The most recently read spent index entries, including those of
+    //! outputs that are not spent. Entries are only added while cs_main is
+    //! held, as are the changes to the index, so that a read cannot cache
+    //! an entry that a concurrent change has already replaced.
+    mutable Mutex cs_spentCache;
+    //! The keys of the entries, most recently used first.
+    mutable std::list<CSpentIndexKey> listSpentLRU GUARDED_BY(cs_spentCache);
+    mutable std::map<CSpentIndexKey, CachedSpentInfo, CSpentIndexKeyCompare> mapSpentCache GUARDED_BY(cs_spentCache);
+    mutable CCacheStats spentCacheStats GUARDED_BY(cs_spentCache);
+
+    void CacheSpentInfo(const CSpentIndexKey& key, const CSpentIndexValue& value) const
+        EXCLUSIVE_LOCKS_REQUIRED(cs_spentCache);
+
+    void ThreadWrite();
+    bool Enqueue(std::unique_ptr<CDBBatch> batch, const std::optional<std::pair<uint256, unsigned int>>& timestamp = std::nullopt,
+        const std::map<AddressId, CAddressSummary>& mapSummaries = {});
+    //! Add the summaries of the addresses changed by connecting (or with
+    //! fErase, disconnecting) a block to the batch.
+    void UpdateAddressSummaries(CDBBatch& batch, const std::vector<CAddressIndexDbEntry> &vect, bool fErase,
+        std::map<AddressId, CAddressSummary>& mapSummaries) const;
+    //! Wait until every batch queued before the call has been written.
+    bool WaitForWrites() const;
+
+    CInsightIndexDB(const CInsightIndexDB&) = delete;
+    CInsightIndexDB& operator=(const CInsightIndexDB&) = delete;
+
+public:
+    CInsightIndexDB(size_t nCacheSize, bool fMemory = false, bool fWipe = false, const CDBOptions& dbOptions = CDBOptions());
+    //! Completes all queued writes before returning.
+    ~CInsightIndexDB();
+
     bool UpdateAddressUnspentIndex(const std::vector<CAddressUnspentDbEntry> &vect);
     bool ReadAddressUnspentIndex(uint160 addressHash, int type, std::vector<CAddressUnspentDbEntry> &vect);
     bool WriteAddressIndex(const std::vector<CAddressIndexDbEntry> &vect);
     bool EraseAddressIndex(const std::vector<CAddressIndexDbEntry> &vect);
     bool ReadAddressIndex(uint160 addressHash, int type, std::vector<CAddressIndexDbEntry> &addressIndex, int start = 0, int end = 0);
+    /**
+     * Read the entries of several addresses between the given heights at
+     * once, merged in the order of the transactions in the chain, starting
+     * after pAfter if it is set. At most nLimit entries are read, if it is
+     * not zero; fMore is set if there are more.
+     */
+    bool ReadAddressIndexMerged(const std::vector<std::pair<uint160, int>>& addresses, int start, int end,
+        const CAddressIndexKey* pAfter, size_t nLimit, std::vector<CAddressIndexDbEntry> &addressIndex, bool& fMore);
+    //! Read the summary of an address. Returns false if the summaries have
+    //! not been built.
+    bool ReadAddressSummary(uint160 addressHash, int type, CAddressSummary &summary) const;
+    //! Compute the summary of every address from the address index, unless
+    //! that was done before.
+    bool BuildAddressSummaries();
     bool ReadSpentIndex(CSpentIndexKey &key, CSpentIndexValue &value) const;
+    /**
+     * Read the spent index entries of several outputs at once, adding those
+     * of the spent outputs to values. The outputs of each transaction are
+     * read in one sweep of an iterator, and recently read entries come from
+     * memory.
+     */
+    bool ReadSpentIndex(const std::vector<CSpentIndexKey> &keys, CSpentIndexMap &values) const;
     bool UpdateSpentIndex(const std::vector<CSpentIndexDbEntry> &vect);
-    bool WriteTimestampIndex(const CTimestampIndexKey &timestampIndex);
+    CCacheStats GetSpentIndexCacheStats() const;
+    //! Write both timestamp index entries of a block.
+    bool WriteTimestampIndex(const CTimestampIndexKey &timestampIndex,
+            const CTimestampBlockIndexKey &blockhashIndex, const CTimestampBlockIndexValue &logicalts);
+    //! Read the blocks with logical timestamps in [low, high), after the
+    //! entry pAfter if it is not null, and at most nLimit of them if it is
+    //! not 0. fMore is set if there are more.
     bool ReadTimestampIndex(unsigned int high, unsigned int low,
-            const bool fActiveOnly, std::vector<std::pair<uint256, unsigned int> > &vect);
-    bool WriteTimestampBlockIndex(const CTimestampBlockIndexKey &blockhashIndex,
-            const CTimestampBlockIndexValue &logicalts);
+            const bool fActiveOnly, const CTimestampIndexKey* pAfter, size_t nLimit,
+            std::vector<std::pair<uint256, unsigned int> > &vect, bool& fMore);
     bool ReadTimestampBlockIndex(const uint256 &hash, unsigned int &logicalTS) const;
-    // END insightexplorer
 
-    bool WriteFlag(const std::string &name, bool fValue);
-    bool ReadFlag(const std::string &name, bool &fValue) const;
-    bool LoadBlockIndexGuts(
-        std::function<CBlockIndex*(const uint256&)> insertBlockIndex,
-        const CChainParams& chainParams);
+    //! Wait for the queued writes and flush them to disk.
+    bool Sync();
+
+    //! Move the indexes written by earlier versions into this database.
+    bool MigrateFrom(CBlockTreeDB& blocktree);
 };
+// END insightexplorer
 
 #endif // BITCOIN_TXDB_H
@@ -0,0 +1,343 @@
+// Copyright (c) 2026 The Zcash developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or https://www.opensource.org/licenses/mit-license.php .
+
+#include "txlocationindex.h"
+
+#include "chain.h"
+#include "chainparams.h"
+#include "hash.h"
+#include "init.h"
+#include "main.h"
+#include "primitives/block.h"
+#include "primitives/transaction_view.h"
+#include "random.h"
+#include "streams.h"
+#include "util/system.h"
+#include "util/time.h"
+
+#include <algorithm>
+#include <limits>
+#include <map>
+
+#include <boost/scoped_ptr.hpp>
+
+CTxLocationIndex* ptxlocationindex = NULL;
+
+namespace {
+
+static const char DB_TX_LOCATION = 'l';
+static const char DB_BEST_BLOCK = 'B';
+
+//! Write the entries collected by the sync thread once they take this many bytes.
+static const size_t SYNC_BATCH_SIZE = 16 << 20;
+
+/** The key of the entry for the transactions of one block whose txids start
+ *  with the same 8 bytes. The height is big-endian, so that the entries of
+ *  a prefix are adjacent. */
+struct CTxLocationKey
+{
+    char chType;
+    uint64_t nPrefix;
+    uint32_t nHeight;
+
+    CTxLocationKey() : chType(0), nPrefix(0), nHeight(0) {}
+    CTxLocationKey(uint64_t nPrefixIn, uint32_t nHeightIn) : chType(DB_TX_LOCATION), nPrefix(nPrefixIn), nHeight(nHeightIn) {}
+
+    template<typename Stream>
+    void Serialize(Stream& s) const {
+        ser_writedata8(s, chType);
+        ser_writedata64(s, nPrefix);
+        ser_writedata32be(s, nHeight);
+    }
+
+    template<typename Stream>
+    void Unserialize(Stream& s) {
+        chType = ser_readdata8(s);
+        nPrefix = ser_readdata64(s);
+        nHeight = ser_readdata32be(s);
+    }
+};
+
+}
+
+CTxLocationIndex::CTxLocationIndex(size_t nCacheSize, bool fMemory, bool fWipe, const CDBOptions& dbOptions) :
+    db(GetDataDir() / "indexes" / "txlocation", nCacheSize, fMemory, fWipe, dbOptions),
+    k0(GetRand(std::numeric_limits<uint64_t>::max())),
+    k1(GetRand(std::numeric_limits<uint64_t>::max()))
+{
+}
+
+CTxLocationIndex::~CTxLocationIndex()
+{
+    Stop();
+}
+
+void CTxLocationIndex::Init()
+{
+    AssertLockHeld(cs_main);
+    uint256 hashBest;
+    if (db.Read(DB_BEST_BLOCK, hashBest)) {
+        BlockMap::const_iterator it = mapBlockIndex.find(hashBest);
+        if (it != mapBlockIndex.end()) {
+            pindexBest = it->second;
+        }
+    }
+    syncThread = std::thread(&CTxLocationIndex::ThreadSync, this);
+}
+
+uint64_t CTxLocationIndex::FilterHash(uint64_t nPrefix) const
+{
+    // Salted, so that txids cannot be ground to fill one bucket.
+    return CSipHasher(k0, k1).Write(nPrefix).Finalize();
+}
+
+void CTxLocationIndex::WriteBlock(CDBBatch& batch, const CBlock& block, int nHeight, std::vector<uint64_t>& vFilterHashes) const
+{
+    std::map<uint64_t, std::vector<uint32_t>> mapOffsets;
+    uint32_t nTxOffset = GetSizeOfCompactSize(block.vtx.size());
+    for (const CTransaction& tx : block.vtx) {
+        mapOffsets[tx.GetHash().GetCheapHash()].push_back(nTxOffset);
+        nTxOffset += ::GetSerializeSize(tx, SER_DISK, CLIENT_VERSION);
+    }
+    WriteOffsets(batch, mapOffsets, nHeight, vFilterHashes);
+}
+
+void CTxLocationIndex::WriteBlock(CDBBatch& batch, const std::vector<CTransactionView>& vtx, int nHeight, std::vector<uint64_t>& vFilterHashes) const
+{
+    std::map<uint64_t, std::vector<uint32_t>> mapOffsets;
+    uint32_t nTxOffset = GetSizeOfCompactSize(vtx.size());
+    for (const CTransactionView& tx : vtx) {
+        mapOffsets[tx.GetHash().GetCheapHash()].push_back(nTxOffset);
+        nTxOffset += tx.GetSerializeSize();
+    }
+    WriteOffsets(batch, mapOffsets, nHeight, vFilterHashes);
+}
+
+void CTxLocationIndex::WriteOffsets(CDBBatch& batch, const std::map<uint64_t, std::vector<uint32_t>>& mapOffsets, int nHeight, std::vector<uint64_t>& vFilterHashes) const
+{
+    for (const auto& entry : mapOffsets) {
+        // Overwrites the entry of a block that was at this height before a
+        // reorg, which can no longer match.
+        batch.Write(CTxLocationKey(entry.first, nHeight), entry.second);
+        vFilterHashes.push_back(FilterHash(entry.first));
+    }
+}
+
+void CTxLocationIndex::AddToFilter(const std::vector<uint64_t>& vFilterHashes)
+{
+    LOCK(cs_filter);
+    if (!filter) {
+        return;
+    }
+    for (uint64_t hash : vFilterHashes) {
+        // A prefix that was indexed at another height, or a reconnected
+        // block, is already covered.
+        if (filter->contains(hash)) {
+            continue;
+        }
+        if (!filter->insert(hash) || filter->full()) {
+            LogPrintf("%s: transaction location filter is full, it will be rebuilt at the next start\n", __func__);
+            filter.reset();
+            return;
+        }
+    }
+}
+
+bool CTxLocationIndex::LoadFilter(size_t nCapacity)
+{
+    int64_t nStart = GetTimeMillis();
+    std::unique_ptr<CuckooFilter::filter> newFilter(new CuckooFilter::filter(nCapacity));
+    boost::scoped_ptr<CDBIterator> pcursor(db.NewIterator());
+    pcursor->Seek(CTxLocationKey(0, 0));
+    CTxLocationKey key;
+    uint64_t nLastPrefix = 0;
+    bool fFirst = true;
+    while (pcursor->Valid() && pcursor->GetKey(key) && key.chType == DB_TX_LOCATION) {
+        if (fStopSync || ShutdownRequested()) {
+            return false;
+        }
+        // The entries of a prefix are adjacent.
+        if (fFirst || key.nPrefix != nLastPrefix) {
+            if (!newFilter->insert(FilterHash(key.nPrefix)) || newFilter->full()) {
+                LogPrintf("%s: transaction location filter is full, lookups will read the database\n", __func__);
+                return true;
+            }
+            nLastPrefix = key.nPrefix;
+            fFirst = false;
+        }
+        pcursor->Next();
+    }
+    LogPrintf("Loaded %u txid prefixes into the transaction location filter (%.1f MiB) in %dms\n",
+        newFilter->size(), newFilter->DynamicMemoryUsage() * (1.0 / (1 << 20)), GetTimeMillis() - nStart);
+    LOCK(cs_filter);
+    filter = std::move(newFilter);
+    return true;
+}
+
+void CTxLocationIndex::ThreadSync()
+{
+    RenameThread("zc-txlocation");
+    const CMessageHeader::MessageStartChars& messageStart = Params().MessageStart();
+    try {
+        const CBlockIndex* pindex;
+        size_t nCapacity;
+        {
+            LOCK(cs_main);
+            pindex = pindexBest;
+            // Leave room for the transactions of the coming blocks.
+            uint64_t nChainTx = chainActive.Tip() == NULL ? 0 : chainActive.Tip()->nChainTx;
+            nCapacity = std::max<size_t>(nChainTx + nChainTx / 2, 1 << 16);
+        }
+        if (!LoadFilter(nCapacity)) {
+            return;
+        }
+
+        CDBBatch batch(db);
+        std::vector<uint64_t> vFilterHashes;
+        int nBlocks = 0;
+        int64_t nStart = GetTimeMillis();
+
+        while (true) {
+            if (fStopSync || ShutdownRequested()) {
+                if (pindex != NULL) {
+                    batch.Write(DB_BEST_BLOCK, pindex->GetBlockHash());
+                }
+                db.WriteBatch(batch);
+                return;
+            }
+
+            const CBlockIndex* pindexNext;
+            {
+                LOCK(cs_main);
+                if (pindex != NULL && !chainActive.Contains(pindex)) {
+                    pindex = chainActive.FindFork(pindex);
+                }
+                if (pindex == chainActive.Tip()) {
+                    if (pindex != NULL) {
+                        batch.Write(DB_BEST_BLOCK, pindex->GetBlockHash());
+                    }
+                    if (!db.WriteBatch(batch)) {
+                        LogPrintf("%s: failed to write transaction locations\n", __func__);
+                        return;
+                    }
+                    AddToFilter(vFilterHashes);
+                    pindexBest = pindex;
+                    fSynced = true;
+                    LogPrintf("Indexed transaction locations of %d blocks in %dms\n", nBlocks, GetTimeMillis() - nStart);
+                    return;
+                }
+                pindexNext = pindex == NULL ? chainActive.Genesis() : chainActive.Next(pindex);
+                if (!(pindexNext->nStatus & BLOCK_HAVE_DATA)) {
+                    LogPrintf("%s: data of block %s is not available, stopped indexing transaction locations\n",
+                        __func__, pindexNext->GetBlockHash().ToString());
+                    return;
+                }
+            }
+
+            // Only the txids and sizes of the transactions are needed, so
+            // their shielded components are not parsed. The block files hold
+            // the serialization of each transaction, from which its txid is
+            // computed.
+            std::vector<uint8_t> vBlock;
+            if (!ReadRawBlockFromDisk(vBlock, pindexNext, messageStart)) {
+                LogPrintf("%s: failed to read block %s, stopped indexing transaction locations\n",
+                    __func__, pindexNext->GetBlockHash().ToString());
+                return;
+            }
+            SpanReader reader(SER_DISK, CLIENT_VERSION, vBlock.data(), vBlock.size());
+            CBlockHeader header;
+            reader >> header;
+            if (header.GetHash() != pindexNext->GetBlockHash()) {
+                LogPrintf("%s: block %s on disk does not match its index entry, stopped indexing transaction locations\n",
+                    __func__, pindexNext->GetBlockHash().ToString());
+                return;
+            }
+            std::vector<CTransactionView> vtx;
+            for (uint64_t nTx = ReadCompactSize(reader); nTx > 0; nTx--) {
+                vtx.emplace_back(reader);
+            }
+            WriteBlock(batch, vtx, pindexNext->nHeight, vFilterHashes);
+            pindex = pindexNext;
+            nBlocks++;
+
+            if (batch.SizeEstimate() > SYNC_BATCH_SIZE) {
+                batch.Write(DB_BEST_BLOCK, pindex->GetBlockHash());
+                if (!db.WriteBatch(batch)) {
+                    LogPrintf("%s: failed to write transaction locations\n", __func__);
+                    return;
+                }
+                batch.Clear();
+                // Only what is in the database may be left out of the filter.
+                AddToFilter(vFilterHashes);
+                vFilterHashes.clear();
+                LogPrint("txlocation", "Indexed transaction locations up to height %d\n", pindex->nHeight);
+            }
+        }
+    } catch (const std::exception& e) {
+        LogPrintf("%s: %s\n", __func__, e.what());
+    }
+}
+
+void CTxLocationIndex::BlockConnected(const CBlock& block, const CBlockIndex* pindex)
+{
+    AssertLockHeld(cs_main);
+    // Until the sync thread has caught up, it indexes connected blocks itself.
+    if (!fSynced) {
+        return;
+    }
+    CDBBatch batch(db);
+    std::vector<uint64_t> vFilterHashes;
+    WriteBlock(batch, block, pindex->nHeight, vFilterHashes);
+    batch.Write(DB_BEST_BLOCK, pindex->GetBlockHash());
+    if (!db.WriteBatch(batch)) {
+        LogPrintf("%s: failed to write transaction locations of block %s\n", __func__, pindex->GetBlockHash().ToString());
+        return;
+    }
+    AddToFilter(vFilterHashes);
+    pindexBest = pindex;
+}
+
+void CTxLocationIndex::Stop()
+{
+    fStopSync = true;
+    if (syncThread.joinable()) {
+        syncThread.join();
+    }
+}
+
+void CTxLocationIndex::FindTransactions(const std::vector<uint256>& txids, std::vector<std::vector<CTxLocation>>& locations) const
+{
+    locations.assign(txids.size(), std::vector<CTxLocation>());
+
+    // Only the prefixes that the filter may hold are looked up, in key order.
+    std::vector<std::pair<uint64_t, size_t>> vPrefixes;
+    {
+        LOCK(cs_filter);
+        for (size_t i = 0; i < txids.size(); i++) {
+            uint64_t nPrefix = txids[i].GetCheapHash();
+            if (!filter || filter->contains(FilterHash(nPrefix))) {
+                vPrefixes.emplace_back(nPrefix, i);
+            }
+        }
+    }
+    if (vPrefixes.empty()) {
+        return;
+    }
+    std::sort(vPrefixes.begin(), vPrefixes.end());
+
+    boost::scoped_ptr<CDBIterator> pcursor(const_cast<CDBWrapper&>(db).NewIterator());
+    for (const auto& entry : vPrefixes) {
+        pcursor->Seek(CTxLocationKey(entry.first, 0));
+        CTxLocationKey key;
+        while (pcursor->Valid() && pcursor->GetKey(key) && key.chType == DB_TX_LOCATION && key.nPrefix == entry.first) {
+            std::vector<uint32_t> vOffsets;
+            if (pcursor->GetValue(vOffsets)) {
+                for (uint32_t nTxOffset : vOffsets) {
+                    locations[entry.second].emplace_back(key.nHeight, nTxOffset);
+                }
+            }
+            pcursor->Next();
+        }
+    }
+}
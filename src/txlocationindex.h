@@ -0,0 +1,112 @@
+// Copyright (c) 2026 The Zcash developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or https://www.opensource.org/licenses/mit-license.php .
+
+#ifndef ZCASH_TXLOCATIONINDEX_H
+#define ZCASH_TXLOCATIONINDEX_H
+
+#include "cuckoofilter.h"
+#include "dbwrapper.h"
+#include "serialize.h"
+#include "sync.h"
+#include "uint256.h"
+
+#include <atomic>
+#include <map>
+#include <memory>
+#include <stdint.h>
+#include <thread>
+#include <vector>
+
+class CBlock;
+class CBlockIndex;
+class CTransactionView;
+
+//! -txlocationindex default
+static const bool DEFAULT_TXLOCATIONINDEX = false;
+//! Maximum cache of the transaction location database, in MiB
+static const int64_t MAX_TX_LOCATION_DB_CACHE = 256;
+
+/** Where a transaction may be: the height of its block and its offset in the
+ *  serialization of the block, counted from the end of the header. */
+struct CTxLocation
+{
+    int nHeight;
+    uint32_t nTxOffset;
+
+    CTxLocation(int nHeightIn, uint32_t nTxOffsetIn) : nHeight(nHeightIn), nTxOffset(nTxOffsetIn) {}
+};
+
+/**
+ * A compact replacement for -txindex: finds the blocks of the active chain
+ * that hold a transaction, in its own database under indexes/txlocation.
+ *
+ * Each entry is keyed by the first 8 bytes of a txid and the height of its
+ * block, and holds the offsets of the transactions of that block that share
+ * the prefix. Entries are not removed when a block is disconnected, so
+ * lookups give candidate locations: the caller reads the transaction from
+ * the block of the active chain at that height and checks its txid. A
+ * cuckoo filter of the prefixes answers most lookups of unknown txids
+ * without reading the database.
+ *
+ * Like CBlockFilterIndex, blocks connected while the index is behind the
+ * active chain are indexed by a background thread, and once it has caught
+ * up, blocks are indexed as they are connected.
+ *
+ * BlockConnected() and Init() must be called with cs_main held.
+ * FindTransactions() may be called without it.
+ */
+class CTxLocationIndex
+{
+private:
+    CDBWrapper db;
+
+    //! The last block of the active chain that is indexed.
+    const CBlockIndex* pindexBest = nullptr;
+    //! Whether the background thread has caught up with the active chain.
+    std::atomic<bool> fSynced{false};
+
+    mutable Mutex cs_filter;
+    //! Fingerprints of the stored txid prefixes, once it has been loaded.
+    std::unique_ptr<CuckooFilter::filter> filter;
+    const uint64_t k0, k1;
+
+    std::thread syncThread;
+    std::atomic<bool> fStopSync{false};
+
+    uint64_t FilterHash(uint64_t nPrefix) const;
+    void ThreadSync();
+    bool LoadFilter(size_t nCapacity);
+    void WriteBlock(CDBBatch& batch, const CBlock& block, int nHeight, std::vector<uint64_t>& vFilterHashes) const;
+    void WriteBlock(CDBBatch& batch, const std::vector<CTransactionView>& vtx, int nHeight, std::vector<uint64_t>& vFilterHashes) const;
+    void WriteOffsets(CDBBatch& batch, const std::map<uint64_t, std::vector<uint32_t>>& mapOffsets, int nHeight, std::vector<uint64_t>& vFilterHashes) const;
+    void AddToFilter(const std::vector<uint64_t>& vFilterHashes);
+
+    CTxLocationIndex(const CTxLocationIndex&) = delete;
+    CTxLocationIndex& operator=(const CTxLocationIndex&) = delete;
+
+public:
+    CTxLocationIndex(size_t nCacheSize, bool fMemory = false, bool fWipe = false, const CDBOptions& dbOptions = CDBOptions());
+    ~CTxLocationIndex();
+
+    //! Load the best indexed block and start catching up with the active
+    //! chain in the background.
+    void Init();
+
+    void BlockConnected(const CBlock& block, const CBlockIndex* pindex);
+
+    //! Stop catching up with the active chain, if that is in progress.
+    void Stop();
+
+    bool IsSynced() const { return fSynced; }
+
+    //! Find the candidate locations of each of the given transactions, in
+    //! the order of their txids.
+    void FindTransactions(const std::vector<uint256>& txids, std::vector<std::vector<CTxLocation>>& locations) const;
+};
+
+/** The transaction location index, or NULL if it is not enabled. Kept up to
+ *  date by ConnectTip. */
+extern CTxLocationIndex* ptxlocationindex;
+
+#endif // ZCASH_TXLOCATIONINDEX_H
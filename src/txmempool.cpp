@@ -21,25 +21,33 @@
 
 #include <rust/metrics.h>
 
+#include <algorithm>
 #include <optional>
 
 using namespace std;
 
-CTxMemPoolEntry::CTxMemPoolEntry(const CTransaction& _tx, const CAmount& _nFee,
+CTxMemPoolEntry::CTxMemPoolEntry(const CTransactionRef& _tx, const CAmount& _nFee,
                                  int64_t _nTime, unsigned int _nHeight,
                                  bool poolHasNoInputsOf,
                                  bool _spendsCoinbase, unsigned int _sigOps, uint32_t _nBranchId):
-    tx(std::make_shared<CTransaction>(_tx)), nFee(_nFee), nTime(_nTime), nHeight(_nHeight),
+    tx(_tx), nFee(_nFee), nTime(_nTime), nHeight(_nHeight),
     hadNoDependencies(poolHasNoInputsOf),
     spendsCoinbase(_spendsCoinbase), sigOpCount(_sigOps), nBranchId(_nBranchId)
 {
-    nTxSize = ::GetSerializeSize(_tx, SER_NETWORK, PROTOCOL_VERSION);
+    nTxSize = ::GetSerializeSize(*tx, SER_NETWORK, PROTOCOL_VERSION);
     nUsageSize = RecursiveDynamicUsage(*tx) + memusage::DynamicUsage(tx);
 
     nCountWithDescendants = 1;
     nSizeWithDescendants = nTxSize;
     nModFeesWithDescendants = nFee;
 
+    nConventionalFee = tx->GetConventionalFee();
+    nCountWithAncestors = 1;
+    nSizeWithAncestors = nTxSize;
+    nModFeesWithAncestors = nFee;
+    nSigOpCountWithAncestors = sigOpCount;
+    nConventionalFeeWithAncestors = nConventionalFee;
+
     feeDelta = 0;
 }
 
@@ -51,6 +59,7 @@ CTxMemPoolEntry::CTxMemPoolEntry(const CTxMemPoolEntry& other)
 void CTxMemPoolEntry::UpdateFeeDelta(int64_t newFeeDelta)
 {
     nModFeesWithDescendants += newFeeDelta - feeDelta;
+    nModFeesWithAncestors += newFeeDelta - feeDelta;
     feeDelta = newFeeDelta;
 }
 
@@ -114,6 +123,7 @@ bool CTxMemPool::UpdateForDescendants(txiter updateIt, int maxDescendantsToVisit
         }
     }
     mapTx.modify(updateIt, update_descendant_state(modifySize, modifyFee, modifyCount));
+    UpdateDescendantsOf(true, updateIt, setAllDescendants, setExclude);
     return true;
 }
 
@@ -146,10 +156,13 @@ void CTxMemPool::UpdateTransactionsFromBlock(const std::vector<uint256> &vHashes
         if (it == mapTx.end()) {
             continue;
         }
-        std::map<COutPoint, CInPoint>::iterator iter = mapNextTx.lower_bound(COutPoint(hash, 0));
         // First calculate the children, and update setMemPoolChildren to
         // include them, and update their setMemPoolParents to include this tx.
-        for (; iter != mapNextTx.end() && iter->first.hash == hash; ++iter) {
+        for (uint32_t n = 0; n < it->GetTx().vout.size(); n++) {
+            auto iter = mapNextTx.find(COutPoint(hash, n));
+            if (iter == mapNextTx.end()) {
+                continue;
+            }
             const uint256 &childHash = iter->second.ptx->GetHash();
             txiter childIter = mapTx.find(childHash);
             assert(childIter != mapTx.end());
@@ -163,6 +176,11 @@ void CTxMemPool::UpdateTransactionsFromBlock(const std::vector<uint256> &vHashes
         if (!UpdateForDescendants(it, 100, mapMemPoolDescendantsToUpdate, setAlreadyIncluded)) {
             // Mark as dirty if we can't do the calculation.
             mapTx.modify(it, set_dirty());
+            // The ancestor state of the descendants is not allowed to be
+            // dirty, so update it without a limit.
+            setEntries setDescendants;
+            CalculateDescendants(it, setDescendants);
+            UpdateDescendantsOf(true, it, setDescendants, setAlreadyIncluded);
         }
     }
 }
@@ -244,6 +262,36 @@ void CTxMemPool::UpdateAncestorsOf(bool add, txiter it, setEntries &setAncestors
     }
 }
 
+void CTxMemPool::UpdateEntryForAncestors(txiter it, const setEntries &setAncestors)
+{
+    int64_t updateCount = setAncestors.size();
+    int64_t updateSize = 0;
+    CAmount updateFee = 0;
+    int updateSigOps = 0;
+    CAmount updateConventionalFee = 0;
+    for (txiter ancestorIt : setAncestors) {
+        updateSize += ancestorIt->GetTxSize();
+        updateFee += ancestorIt->GetModifiedFee();
+        updateSigOps += ancestorIt->GetSigOpCount();
+        updateConventionalFee += ancestorIt->GetConventionalFee();
+    }
+    mapTx.modify(it, update_ancestor_state(updateSize, updateFee, updateCount, updateSigOps, updateConventionalFee));
+}
+
+void CTxMemPool::UpdateDescendantsOf(bool add, txiter it, const setEntries &setDescendants, const std::set<uint256> &setExclude)
+{
+    const int64_t updateCount = (add ? 1 : -1);
+    const int64_t updateSize = updateCount * it->GetTxSize();
+    const CAmount updateFee = updateCount * it->GetModifiedFee();
+    const int updateSigOps = updateCount * (int) it->GetSigOpCount();
+    const CAmount updateConventionalFee = updateCount * it->GetConventionalFee();
+    for (txiter descendantIt : setDescendants) {
+        if (descendantIt != it && !setExclude.count(descendantIt->GetTx().GetHash())) {
+            mapTx.modify(descendantIt, update_ancestor_state(updateSize, updateFee, updateCount, updateSigOps, updateConventionalFee));
+        }
+    }
+}
+
 void CTxMemPool::UpdateChildrenForRemoval(txiter it)
 {
     const setEntries &setMemPoolChildren = GetMemPoolChildren(it);
@@ -252,8 +300,21 @@ void CTxMemPool::UpdateChildrenForRemoval(txiter it)
     }
 }
 
-void CTxMemPool::UpdateForRemoveFromMempool(const setEntries &entriesToRemove)
+void CTxMemPool::UpdateForRemoveFromMempool(const setEntries &entriesToRemove, bool updateDescendants)
 {
+    if (updateDescendants) {
+        // Update the ancestor state of the descendants that stay in the
+        // mempool, while the child links needed to find them still exist.
+        const std::set<uint256> setNoExclude;
+        for (txiter removeIt : entriesToRemove) {
+            setEntries setDescendants;
+            CalculateDescendants(removeIt, setDescendants);
+            for (txiter descendantIt : entriesToRemove) {
+                setDescendants.erase(descendantIt);
+            }
+            UpdateDescendantsOf(false, removeIt, setDescendants, setNoExclude);
+        }
+    }
     // For each entry, walk back all ancestors and decrement size associated with this
     // transaction
     const uint64_t nNoLimit = std::numeric_limits<uint64_t>::max();
@@ -306,20 +367,19 @@ size_t CTxMemPoolEntry::GetUnpaidActionCount() const
     if (tx->IsCoinBase()) {
         return 0;
     } else {
-        return std::max(
-            int64_t {0},
-            (int64_t) std::max(GRACE_ACTIONS, tx->GetLogicalActionCount()) - (GetModifiedFee() / MARGINAL_FEE));
+        return CalculateUnpaidActionCount(GetModifiedFee(), nConventionalFee);
     }
 }
 
 // Return a fixed-point representation of the entry's weight ratio, where 1 is represented by WEIGHT_RATIO_SCALE.
 int128_t CTxMemPoolEntry::GetWeightRatio() const
 {
-    // ensure that the result will always be nonzero
-    static_assert(WEIGHT_RATIO_SCALE > MAX_MONEY);
-    return std::min(
-        (int128_t {WEIGHT_RATIO_SCALE} * std::max(CAmount {1}, GetModifiedFee())) / tx->GetConventionalFee(),
-        int128_t {WEIGHT_RATIO_SCALE} * WEIGHT_RATIO_CAP);
+    return CalculateWeightRatio(GetModifiedFee(), nConventionalFee);
+}
+
+int128_t CTxMemPoolEntry::GetWeightRatioWithAncestors() const
+{
+    return CalculateWeightRatio(nModFeesWithAncestors, nConventionalFeeWithAncestors);
 }
 
 void CTxMemPoolEntry::UpdateState(int64_t modifySize, CAmount modifyFee, int64_t modifyCount)
@@ -333,6 +393,32 @@ void CTxMemPoolEntry::UpdateState(int64_t modifySize, CAmount modifyFee, int64_t
     }
 }
 
+void CTxMemPoolEntry::UpdateAncestorState(int64_t modifySize, CAmount modifyFee, int64_t modifyCount, int modifySigOps, CAmount modifyConventionalFee)
+{
+    nSizeWithAncestors += modifySize;
+    assert(int64_t(nSizeWithAncestors) > 0);
+    nModFeesWithAncestors += modifyFee;
+    nCountWithAncestors += modifyCount;
+    assert(int64_t(nCountWithAncestors) > 0);
+    nSigOpCountWithAncestors += modifySigOps;
+    assert(int(nSigOpCountWithAncestors) >= 0);
+    nConventionalFeeWithAncestors += modifyConventionalFee;
+    assert(nConventionalFeeWithAncestors > 0);
+}
+
+std::string RemovalReasonToString(MemPoolRemovalReason reason)
+{
+    switch (reason) {
+        case MemPoolRemovalReason::EXPIRY: return "expiry";
+        case MemPoolRemovalReason::SIZELIMIT: return "sizelimit";
+        case MemPoolRemovalReason::REORG: return "reorg";
+        case MemPoolRemovalReason::BLOCK: return "block";
+        case MemPoolRemovalReason::CONFLICT: return "conflict";
+        case MemPoolRemovalReason::UNKNOWN: return "unknown";
+    }
+    assert(false);
+}
+
 CTxMemPool::CTxMemPool(const CFeeRate& _minReasonableRelayFee) :
     nTransactionsUpdated(0)
 {
@@ -356,12 +442,11 @@ void CTxMemPool::pruneSpent(const uint256 &hashTx, CCoins &coins)
 {
     LOCK(cs);
 
-    std::map<COutPoint, CInPoint>::iterator it = mapNextTx.lower_bound(COutPoint(hashTx, 0));
-
-    // iterate over all COutPoints in mapNextTx whose hash equals the provided hashTx
-    while (it != mapNextTx.end() && it->first.hash == hashTx) {
-        coins.Spend(it->first.n); // and remove those outputs from coins
-        it++;
+    // look up each output of the provided hashTx in mapNextTx
+    for (uint32_t n = 0; n < coins.vout.size(); n++) {
+        if (mapNextTx.count(COutPoint(hashTx, n))) {
+            coins.Spend(n); // and remove those outputs from coins
+        }
     }
 }
 
@@ -427,6 +512,7 @@ bool CTxMemPool::addUnchecked(const uint256& hash, const CTxMemPoolEntry &entry,
         }
     }
     UpdateAncestorsOf(true, newit, setAncestors);
+    UpdateEntryForAncestors(newit, setAncestors);
 
     for (const JSDescription &joinsplit : tx.vJoinSplit) {
         for (const uint256 &nf : joinsplit.nullifiers) {
@@ -434,7 +520,7 @@ bool CTxMemPool::addUnchecked(const uint256& hash, const CTxMemPoolEntry &entry,
         }
     }
     for (const auto& spendDescription : tx.GetSaplingSpends()) {
-        mapSaplingNullifiers[spendDescription.nullifier()] = &tx;
+        mapSaplingNullifiers[uint256::FromRawBytes(spendDescription.nullifier())] = &tx;
     }
     for (const uint256 &orchardNullifier : tx.GetOrchardBundle().GetNullifiers()) {
         mapOrchardNullifiers[orchardNullifier] = &tx;
@@ -442,18 +528,34 @@ bool CTxMemPool::addUnchecked(const uint256& hash, const CTxMemPoolEntry &entry,
 
     nTransactionsUpdated++;
     totalTxSize += entry.GetTxSize();
+    if (nCheckSample != 0)
+        setCheckTouched.insert(hash);
 
+    NotifyEntryAdded(tx, ++nMempoolSequence);
     return true;
 }
 
 // START insightexplorer
+SaltedAddressHasher::SaltedAddressHasher() : k0(GetRand(std::numeric_limits<uint64_t>::max())), k1(GetRand(std::numeric_limits<uint64_t>::max())) {}
+
 void CTxMemPool::addAddressIndex(const CTxMemPoolEntry &entry, const CCoinsViewCache &view)
 {
     LOCK(cs);
     const CTransaction& tx = entry.GetTx();
-    std::vector<CMempoolAddressDeltaKey> inserted;
-
     uint256 txhash = tx.GetHash();
+    if (mapAddressInserted.count(txhash))
+        return;
+    std::vector<CMempoolAddress> inserted;
+
+    auto addDelta = [&](const CMempoolAddressDeltaKey& key, const CMempoolAddressDelta& delta) {
+        CMempoolAddress address(key.type, key.addressBytes);
+        auto& deltas = mapAddress[address];
+        cachedAddressDeltaUsage -= memusage::DynamicUsage(deltas);
+        deltas.emplace_back(key, delta);
+        cachedAddressDeltaUsage += memusage::DynamicUsage(deltas);
+        inserted.push_back(address);
+    };
+
     for (unsigned int j = 0; j < tx.vin.size(); j++) {
         const CTxIn input = tx.vin[j];
         const CTxOut &prevout = view.GetOutputFor(input);
@@ -461,9 +563,7 @@ void CTxMemPool::addAddressIndex(const CTxMemPoolEntry &entry, const CCoinsViewC
         if (type == CScript::UNKNOWN)
             continue;
         CMempoolAddressDeltaKey key(type, prevout.scriptPubKey.AddressHash(), txhash, j, 1);
-        CMempoolAddressDelta delta(entry.GetTime(), prevout.nValue * -1, input.prevout.hash, input.prevout.n);
-        mapAddress.insert(make_pair(key, delta));
-        inserted.push_back(key);
+        addDelta(key, CMempoolAddressDelta(entry.GetTime(), prevout.nValue * -1, input.prevout.hash, input.prevout.n));
     }
 
     for (unsigned int j = 0; j < tx.vout.size(); j++) {
@@ -472,8 +572,7 @@ void CTxMemPool::addAddressIndex(const CTxMemPoolEntry &entry, const CCoinsViewC
         if (type == CScript::UNKNOWN)
             continue;
         CMempoolAddressDeltaKey key(type, out.scriptPubKey.AddressHash(), txhash, j, 0);
-        mapAddress.insert(make_pair(key, CMempoolAddressDelta(entry.GetTime(), out.nValue)));
-        inserted.push_back(key);
+        addDelta(key, CMempoolAddressDelta(entry.GetTime(), out.nValue));
     }
 
     mapAddressInserted.insert(make_pair(txhash, inserted));
@@ -485,25 +584,58 @@ void CTxMemPool::getAddressIndex(
 {
     LOCK(cs);
     for (const auto& it : addresses) {
-        auto ait = mapAddress.lower_bound(CMempoolAddressDeltaKey(it.second, it.first));
-        while (ait != mapAddress.end() && (*ait).first.addressBytes == it.first && (*ait).first.type == it.second) {
-            results.push_back(*ait);
-            ait++;
-        }
+        auto ait = mapAddress.find(CMempoolAddress(it.second, it.first));
+        if (ait == mapAddress.end())
+            continue;
+        size_t nStart = results.size();
+        results.insert(results.end(), ait->second.begin(), ait->second.end());
+        // The deltas of an address are kept in the order they were added;
+        // return them in key order, as the ordered index used to.
+        std::sort(results.begin() + nStart, results.end(),
+            [](const std::pair<CMempoolAddressDeltaKey, CMempoolAddressDelta>& a,
+               const std::pair<CMempoolAddressDeltaKey, CMempoolAddressDelta>& b) {
+                return CMempoolAddressDeltaKeyCompare()(a.first, b.first);
+            });
     }
 }
 
-void CTxMemPool::removeAddressIndex(const uint256& txhash)
+/**
+ * Remove the address deltas of the given transactions. Each address they
+ * have deltas for is compacted once, however many of them it has deltas of,
+ * so that removing the transactions of a block that pay the same address
+ * many times does not rewrite its deltas for each of them.
+ */
+void CTxMemPool::removeAddressIndex(const std::vector<uint256>& txhashes)
 {
     LOCK(cs);
-    auto it = mapAddressInserted.find(txhash);
+    std::set<uint256> setRemoved;
+    std::set<CMempoolAddress> setAddresses;
+    for (const uint256& txhash : txhashes) {
+        auto it = mapAddressInserted.find(txhash);
+        if (it != mapAddressInserted.end()) {
+            setRemoved.insert(txhash);
+            setAddresses.insert(it->second.begin(), it->second.end());
+            mapAddressInserted.erase(it);
+        }
+    }
 
-    if (it != mapAddressInserted.end()) {
-        std::vector<CMempoolAddressDeltaKey> keys = it->second;
-        for (const auto& mit : keys) {
-            mapAddress.erase(mit);
+    for (const CMempoolAddress& address : setAddresses) {
+        auto it = mapAddress.find(address);
+        if (it == mapAddress.end())
+            continue;
+        auto& deltas = it->second;
+        cachedAddressDeltaUsage -= memusage::DynamicUsage(deltas);
+        deltas.erase(std::remove_if(deltas.begin(), deltas.end(),
+            [&](const std::pair<CMempoolAddressDeltaKey, CMempoolAddressDelta>& delta) {
+                return setRemoved.count(delta.first.txhash) > 0;
+            }), deltas.end());
+        if (deltas.empty()) {
+            mapAddress.erase(it);
+            continue;
         }
-        mapAddressInserted.erase(it);
+        if (deltas.capacity() > 4 * deltas.size())
+            deltas.shrink_to_fit();
+        cachedAddressDeltaUsage += memusage::DynamicUsage(deltas);
     }
 }
 
@@ -530,7 +662,7 @@ void CTxMemPool::addSpentIndex(const CTxMemPoolEntry &entry, const CCoinsViewCac
 bool CTxMemPool::getSpentIndex(const CSpentIndexKey &key, CSpentIndexValue &value)
 {
     LOCK(cs);
-    std::map<CSpentIndexKey, CSpentIndexValue, CSpentIndexKeyCompare>::iterator it = mapSpent.find(key);
+    auto it = mapSpent.find(key);
     if (it != mapSpent.end()) {
         value = it->second;
         return true;
@@ -553,10 +685,21 @@ void CTxMemPool::removeSpentIndex(const uint256 txhash)
 }
 // END insightexplorer
 
-void CTxMemPool::removeUnchecked(txiter it)
+void CTxMemPool::removeUnchecked(txiter it, MemPoolRemovalReason reason)
 {
     const uint256 hash = it->GetTx().GetHash();
+    NotifyEntryRemoved(it->GetTx(), reason, ++nMempoolSequence);
     mapRecentlyAddedTx.erase(hash);
+    if (nCheckSample != 0) {
+        setCheckTouched.erase(hash);
+        txlinksMap::const_iterator linksiter = mapLinks.find(it);
+        if (linksiter != mapLinks.end()) {
+            for (txiter parentIt : linksiter->second.parents)
+                setCheckTouched.insert(parentIt->GetTx().GetHash());
+            for (txiter childIt : linksiter->second.children)
+                setCheckTouched.insert(childIt->GetTx().GetHash());
+        }
+    }
     for (const CTxIn& txin : it->GetTx().vin)
         mapNextTx.erase(txin.prevout);
     for (const JSDescription& joinsplit : it->GetTx().vJoinSplit) {
@@ -565,7 +708,7 @@ void CTxMemPool::removeUnchecked(txiter it)
         }
     }
     for (const auto& spendDescription : it->GetTx().GetSaplingSpends()) {
-        mapSaplingNullifiers.erase(spendDescription.nullifier());
+        mapSaplingNullifiers.erase(uint256::FromRawBytes(spendDescription.nullifier()));
     }
     for (const uint256 &orchardNullifier : it->GetTx().GetOrchardBundle().GetNullifiers()) {
         mapOrchardNullifiers.erase(orchardNullifier);
@@ -578,9 +721,7 @@ void CTxMemPool::removeUnchecked(txiter it)
     mapTx.erase(it);
     nTransactionsUpdated++;
 
-    // insightexplorer
-    if (fAddressIndex)
-        removeAddressIndex(hash);
+    // insightexplorer; the address index is updated by RemoveStaged
     if (fSpentIndex)
         removeSpentIndex(hash);
 }
@@ -614,7 +755,7 @@ void CTxMemPool::CalculateDescendants(txiter entryit, setEntries &setDescendants
     }
 }
 
-void CTxMemPool::remove(const CTransaction &origTx, std::list<CTransaction>& removed, bool fRecursive)
+void CTxMemPool::remove(const CTransaction &origTx, std::list<CTransactionRef>& removed, bool fRecursive, MemPoolRemovalReason reason)
 {
     // Remove transaction from memory pool
     {
@@ -629,7 +770,7 @@ void CTxMemPool::remove(const CTransaction &origTx, std::list<CTransaction>& rem
             // happen during chain re-orgs if origTx isn't re-accepted into
             // the mempool for any reason.
             for (unsigned int i = 0; i < origTx.vout.size(); i++) {
-                std::map<COutPoint, CInPoint>::iterator it = mapNextTx.find(COutPoint(origTx.GetHash(), i));
+                auto it = mapNextTx.find(COutPoint(origTx.GetHash(), i));
                 if (it == mapNextTx.end())
                     continue;
                 txiter nextit = mapTx.find(it->second.ptx->GetHash());
@@ -646,12 +787,10 @@ void CTxMemPool::remove(const CTransaction &origTx, std::list<CTransaction>& rem
             setAllRemoves.swap(txToRemove);
         }
         for (txiter it : setAllRemoves) {
-            removed.push_back(it->GetTx());
-        }
-        RemoveStaged(setAllRemoves);
-        for (CTransaction tx : removed) {
-            limitSet->remove(tx.GetHash());
+            removed.push_back(it->GetSharedTx());
+            limitSet->remove(it->GetTx().GetHash());
         }
+        RemoveStaged(setAllRemoves, !fRecursive, reason);
     }
 }
 
@@ -659,11 +798,11 @@ void CTxMemPool::removeForReorg(const CCoinsViewCache *pcoins, unsigned int nMem
 {
     // Remove transactions spending a coinbase which are now immature and no-longer-final transactions
     LOCK(cs);
-    list<CTransaction> transactionsToRemove;
+    list<CTransactionRef> transactionsToRemove;
     for (indexed_transaction_set::const_iterator it = mapTx.begin(); it != mapTx.end(); it++) {
         const CTransaction& tx = it->GetTx();
         if (!CheckFinalTx(tx, flags)) {
-            transactionsToRemove.push_back(tx);
+            transactionsToRemove.push_back(it->GetSharedTx());
         } else if (it->GetSpendsCoinbase()) {
             for (const CTxIn& txin : tx.vin) {
                 indexed_transaction_set::const_iterator it2 = mapTx.find(txin.prevout.hash);
@@ -672,15 +811,15 @@ void CTxMemPool::removeForReorg(const CCoinsViewCache *pcoins, unsigned int nMem
                 const CCoins *coins = pcoins->AccessCoins(txin.prevout.hash);
 		if (nCheckFrequency != 0) assert(coins);
                 if (!coins || (coins->IsCoinBase() && ((signed long)nMemPoolHeight) - coins->nHeight < COINBASE_MATURITY)) {
-                    transactionsToRemove.push_back(tx);
+                    transactionsToRemove.push_back(it->GetSharedTx());
                     break;
                 }
             }
         }
     }
-    for (const CTransaction& tx : transactionsToRemove) {
-        list<CTransaction> removed;
-        remove(tx, removed, true);
+    for (const CTransactionRef& ptx : transactionsToRemove) {
+        list<CTransactionRef> removed;
+        remove(*ptx, removed, true, MemPoolRemovalReason::REORG);
     }
 }
 
@@ -692,15 +831,15 @@ void CTxMemPool::removeWithAnchor(const uint256 &invalidRoot, ShieldedType type)
     // from that root -- almost as though they were spending coinbases
     // which are no longer valid to spend due to coinbase maturity.
     LOCK(cs);
-    list<CTransaction> transactionsToRemove;
+    setEntries toRemove;
 
-    for (indexed_transaction_set::const_iterator it = mapTx.begin(); it != mapTx.end(); it++) {
+    for (txiter it = mapTx.begin(); it != mapTx.end(); it++) {
         const CTransaction& tx = it->GetTx();
         switch (type) {
             case SPROUT:
                 for (const JSDescription& joinsplit : tx.vJoinSplit) {
                     if (joinsplit.anchor == invalidRoot) {
-                        transactionsToRemove.push_back(tx);
+                        toRemove.insert(it);
                         break;
                     }
                 }
@@ -708,7 +847,7 @@ void CTxMemPool::removeWithAnchor(const uint256 &invalidRoot, ShieldedType type)
             case SAPLING:
                 for (const auto& spendDescription : tx.GetSaplingSpends()) {
                     if (uint256::FromRawBytes(spendDescription.anchor()) == invalidRoot) {
-                        transactionsToRemove.push_back(tx);
+                        toRemove.insert(it);
                         break;
                     }
                 }
@@ -717,7 +856,7 @@ void CTxMemPool::removeWithAnchor(const uint256 &invalidRoot, ShieldedType type)
             {
                 auto anchor = tx.GetOrchardBundle().GetAnchor();
                 if (anchor == invalidRoot) {
-                    transactionsToRemove.push_back(tx);
+                    toRemove.insert(it);
                 }
                 break;
             }
@@ -727,103 +866,133 @@ void CTxMemPool::removeWithAnchor(const uint256 &invalidRoot, ShieldedType type)
         }
     }
 
-    for (const CTransaction& tx : transactionsToRemove) {
-        list<CTransaction> removed;
-        remove(tx, removed, true);
-    }
+    list<CTransactionRef> removed;
+    RemoveRecursive(toRemove, removed, MemPoolRemovalReason::REORG);
 }
 
-void CTxMemPool::removeConflicts(const CTransaction &tx, std::list<CTransaction>& removed)
+void CTxMemPool::CalculateConflicts(const CTransaction &tx, const std::set<uint256> &setExclude, setEntries &setConflicts) const
 {
-    // Remove transactions which depend on inputs of tx, recursively
-    list<CTransaction> result;
-    LOCK(cs);
+    AssertLockHeld(cs);
+    auto addConflict = [&](const CTransaction& txConflict) {
+        uint256 hash = txConflict.GetHash();
+        if (!setExclude.count(hash)) {
+            txiter it = mapTx.find(hash);
+            assert(it != mapTx.end());
+            setConflicts.insert(it);
+        }
+    };
     for (const CTxIn &txin : tx.vin) {
-        std::map<COutPoint, CInPoint>::iterator it = mapNextTx.find(txin.prevout);
+        auto it = mapNextTx.find(txin.prevout);
         if (it != mapNextTx.end()) {
-            const CTransaction &txConflict = *it->second.ptx;
-            if (txConflict != tx)
-            {
-                remove(txConflict, removed, true);
-            }
+            addConflict(*it->second.ptx);
         }
     }
 
     for (const JSDescription &joinsplit : tx.vJoinSplit) {
         for (const uint256 &nf : joinsplit.nullifiers) {
-            std::map<uint256, const CTransaction*>::iterator it = mapSproutNullifiers.find(nf);
+            auto it = mapSproutNullifiers.find(nf);
             if (it != mapSproutNullifiers.end()) {
-                const CTransaction &txConflict = *it->second;
-                if (txConflict != tx) {
-                    remove(txConflict, removed, true);
-                }
+                addConflict(*it->second);
             }
         }
     }
     for (const auto& spendDescription : tx.GetSaplingSpends()) {
-        auto it = mapSaplingNullifiers.find(spendDescription.nullifier());
+        auto it = mapSaplingNullifiers.find(uint256::FromRawBytes(spendDescription.nullifier()));
         if (it != mapSaplingNullifiers.end()) {
-            const CTransaction &txConflict = *it->second;
-            if (txConflict != tx) {
-                remove(txConflict, removed, true);
-            }
+            addConflict(*it->second);
         }
     }
     for (const uint256 &orchardNullifier : tx.GetOrchardBundle().GetNullifiers()) {
-        std::map<uint256, const CTransaction*>::iterator it = mapOrchardNullifiers.find(orchardNullifier);
+        auto it = mapOrchardNullifiers.find(orchardNullifier);
         if (it != mapOrchardNullifiers.end()) {
-            const CTransaction &txConflict = *it->second;
-            if (txConflict != tx) {
-                remove(txConflict, removed, true);
-            }
+            addConflict(*it->second);
         }
     }
 }
 
+void CTxMemPool::RemoveRecursive(const setEntries &toRemove, std::list<CTransactionRef>& removed, MemPoolRemovalReason reason)
+{
+    AssertLockHeld(cs);
+    setEntries setAllRemoves;
+    for (txiter it : toRemove) {
+        CalculateDescendants(it, setAllRemoves);
+    }
+    for (txiter it : setAllRemoves) {
+        removed.push_back(it->GetSharedTx());
+        limitSet->remove(it->GetTx().GetHash());
+    }
+    RemoveStaged(setAllRemoves, false, reason);
+}
+
+void CTxMemPool::removeConflicts(const CTransaction &tx, std::list<CTransactionRef>& removed)
+{
+    // Remove transactions which depend on inputs of tx, recursively
+    LOCK(cs);
+    setEntries setConflicts;
+    CalculateConflicts(tx, {tx.GetHash()}, setConflicts);
+    RemoveRecursive(setConflicts, removed, MemPoolRemovalReason::CONFLICT);
+}
+
 std::vector<uint256> CTxMemPool::removeExpired(unsigned int nBlockHeight)
 {
-    // Remove expired txs from the mempool
+    // Remove expired txs from the mempool. They are the transactions with an
+    // expiry height in [1, nBlockHeight), which are found from the expiry
+    // height index without looking at the rest of the mempool.
     LOCK(cs);
-    list<CTransaction> transactionsToRemove;
-    for (indexed_transaction_set::const_iterator it = mapTx.begin(); it != mapTx.end(); it++)
-    {
-        const CTransaction& tx = it->GetTx();
-        if (IsExpiredTx(tx, nBlockHeight)) {
-            transactionsToRemove.push_back(tx);
-        }
-    }
+    const auto& index = mapTx.get<expiry_height>();
+    auto itBegin = index.lower_bound(1);
+    auto itEnd = index.lower_bound(std::max(nBlockHeight, 1u));
+    setEntries setExpired;
     std::vector<uint256> ids;
-    for (const CTransaction& tx : transactionsToRemove) {
-        list<CTransaction> removed;
-        remove(tx, removed, true);
-        ids.push_back(tx.GetHash());
-        LogPrint("mempool", "Removing expired txid: %s\n", tx.GetHash().ToString());
+    for (auto it = itBegin; it != itEnd; ++it) {
+        assert(IsExpiredTx(it->GetTx(), nBlockHeight));
+        setExpired.insert(mapTx.project<0>(it));
+        ids.push_back(it->GetTx().GetHash());
+        LogPrint("mempool", "Removing expired txid: %s\n", it->GetTx().GetHash().ToString());
     }
+    list<CTransactionRef> removed;
+    RemoveRecursive(setExpired, removed, MemPoolRemovalReason::EXPIRY);
     return ids;
 }
 
 /**
- * Called when a block is connected. Removes from mempool.
+ * Called when a block is connected. Removes the transactions of the block
+ * from the mempool, and then everything that conflicts with them, each in a
+ * single pass.
  */
 void CTxMemPool::removeForBlock(const std::vector<CTransaction>& vtx, unsigned int nBlockHeight,
-                                std::list<CTransaction>& conflicts)
+                                std::list<CTransactionRef>& conflicts)
 {
     LOCK(cs);
-    std::vector<CTxMemPoolEntry> entries;
+    std::set<uint256> setBlockTxids;
+    setEntries setBlockEntries;
     for (const CTransaction& tx : vtx)
     {
         uint256 hash = tx.GetHash();
+        setBlockTxids.insert(hash);
 
-        indexed_transaction_set::iterator i = mapTx.find(hash);
+        txiter i = mapTx.find(hash);
         if (i != mapTx.end())
-            entries.push_back(*i);
+            setBlockEntries.insert(i);
     }
-    for (const CTransaction& tx : vtx)
-    {
-        std::list<CTransaction> dummy;
-        remove(tx, dummy, false);
-        removeConflicts(tx, conflicts);
-        ClearPrioritisation(tx.GetHash());
+    // The in-mempool parents of a transaction in a valid block are also in
+    // the block, so this leaves only descendants behind, whose ancestor
+    // state is updated.
+    for (txiter it : setBlockEntries) {
+        limitSet->remove(it->GetTx().GetHash());
+    }
+    RemoveStaged(setBlockEntries, true, MemPoolRemovalReason::BLOCK);
+
+    // What is left in the mempool that spends an input or a nullifier of the
+    // block conflicts with it.
+    setEntries setConflicts;
+    for (const CTransaction& tx : vtx) {
+        CalculateConflicts(tx, setBlockTxids, setConflicts);
+    }
+    RemoveRecursive(setConflicts, conflicts, MemPoolRemovalReason::CONFLICT);
+
+    for (const uint256& hash : setBlockTxids) {
+        mapDeltas.erase(hash);
     }
 }
 
@@ -834,18 +1003,17 @@ void CTxMemPool::removeForBlock(const std::vector<CTransaction>& vtx, unsigned i
 void CTxMemPool::removeWithoutBranchId(uint32_t nMemPoolBranchId)
 {
     LOCK(cs);
-    std::list<CTransaction> transactionsToRemove;
+    std::list<CTransactionRef> transactionsToRemove;
 
     for (indexed_transaction_set::const_iterator it = mapTx.begin(); it != mapTx.end(); it++) {
-        const CTransaction& tx = it->GetTx();
         if (it->GetValidatedBranchId() != nMemPoolBranchId) {
-            transactionsToRemove.push_back(tx);
+            transactionsToRemove.push_back(it->GetSharedTx());
         }
     }
 
-    for (const CTransaction& tx : transactionsToRemove) {
-        std::list<CTransaction> removed;
-        remove(tx, removed, true);
+    for (const CTransactionRef& ptx : transactionsToRemove) {
+        std::list<CTransactionRef> removed;
+        remove(*ptx, removed, true, MemPoolRemovalReason::REORG);
     }
 }
 
@@ -854,6 +1022,7 @@ void CTxMemPool::_clear()
     mapLinks.clear();
     mapTx.clear();
     mapNextTx.clear();
+    setCheckTouched.clear();
     totalTxSize = 0;
     cachedInnerUsage = 0;
     ++nTransactionsUpdated;
@@ -865,13 +1034,168 @@ void CTxMemPool::clear()
     _clear();
 }
 
-void CTxMemPool::check(const CCoinsViewCache *pcoins) const
+bool CTxMemPool::checkEntry(txiter it, const CCoinsViewCache *pcoins) const
 {
-    if (nCheckFrequency == 0)
-        return;
+    unsigned int i = 0;
+    const CTransaction& tx = it->GetTx();
+    assert(mapLinks.count(it));
+    bool fDependsWait = false;
+    setEntries setParentCheck;
+    for (const CTxIn &txin : tx.vin) {
+        // Check that every mempool transaction's inputs refer to available coins, or other mempool tx's.
+        indexed_transaction_set::const_iterator it2 = mapTx.find(txin.prevout.hash);
+        if (it2 != mapTx.end()) {
+            const CTransaction& tx2 = it2->GetTx();
+            assert(tx2.vout.size() > txin.prevout.n && !tx2.vout[txin.prevout.n].IsNull());
+            fDependsWait = true;
+            setParentCheck.insert(it2);
+        } else {
+            const CCoins* coins = pcoins->AccessCoins(txin.prevout.hash);
+            assert(coins && coins->IsAvailable(txin.prevout.n));
+        }
+        // Check whether its inputs are marked in mapNextTx.
+        auto it3 = mapNextTx.find(txin.prevout);
+        assert(it3 != mapNextTx.end());
+        assert(it3->second.ptx == &tx);
+        assert(it3->second.n == i);
+        i++;
+    }
+    assert(setParentCheck == GetMemPoolParents(it));
+    // Check the ancestor state against the ancestors reachable through mapLinks.
+    setEntries setAncestorsCheck;
+    setEntries stageParents = setParentCheck;
+    while (!stageParents.empty()) {
+        txiter ancestorIt = *stageParents.begin();
+        stageParents.erase(stageParents.begin());
+        if (setAncestorsCheck.insert(ancestorIt).second) {
+            const setEntries &setGrandparents = GetMemPoolParents(ancestorIt);
+            stageParents.insert(setGrandparents.begin(), setGrandparents.end());
+        }
+    }
+    uint64_t nSizeCheck = it->GetTxSize();
+    CAmount nFeesCheck = it->GetModifiedFee();
+    unsigned int nSigOpCheck = it->GetSigOpCount();
+    CAmount nConventionalFeeCheck = it->GetConventionalFee();
+    for (txiter ancestorIt : setAncestorsCheck) {
+        nSizeCheck += ancestorIt->GetTxSize();
+        nFeesCheck += ancestorIt->GetModifiedFee();
+        nSigOpCheck += ancestorIt->GetSigOpCount();
+        nConventionalFeeCheck += ancestorIt->GetConventionalFee();
+    }
+    assert(it->GetCountWithAncestors() == setAncestorsCheck.size() + 1);
+    assert(it->GetSizeWithAncestors() == nSizeCheck);
+    assert(it->GetModFeesWithAncestors() == nFeesCheck);
+    assert(it->GetSigOpCountWithAncestors() == nSigOpCheck);
+    assert(it->GetConventionalFeeWithAncestors() == nConventionalFeeCheck);
+    // Check children against mapNextTx
+    CTxMemPool::setEntries setChildrenCheck;
+    int64_t childSizes = 0;
+    CAmount childModFee = 0;
+    for (uint32_t n = 0; n < tx.vout.size(); n++) {
+        auto iter = mapNextTx.find(COutPoint(tx.GetHash(), n));
+        if (iter == mapNextTx.end()) {
+            continue;
+        }
+        txiter childit = mapTx.find(iter->second.ptx->GetHash());
+        assert(childit != mapTx.end()); // mapNextTx points to in-mempool transactions
+        if (setChildrenCheck.insert(childit).second) {
+            childSizes += childit->GetTxSize();
+            childModFee += childit->GetModifiedFee();
+        }
+    }
+    assert(setChildrenCheck == GetMemPoolChildren(it));
+    // Also check to make sure size is greater than sum with immediate children.
+    // just a sanity check, not definitive that this calc is correct...
+    if (!it->IsDirty()) {
+        assert(it->GetSizeWithDescendants() >= childSizes + it->GetTxSize());
+    } else {
+        assert(it->GetSizeWithDescendants() == it->GetTxSize());
+        assert(it->GetModFeesWithDescendants() == it->GetModifiedFee());
+    }
+
+    // Check that its nullifiers are marked as spent by it.
+    for (const JSDescription &joinsplit : tx.vJoinSplit) {
+        for (const uint256 &nf : joinsplit.nullifiers) {
+            auto nfIt = mapSproutNullifiers.find(nf);
+            assert(nfIt != mapSproutNullifiers.end() && nfIt->second == &tx);
+        }
+    }
+    for (const auto& spendDescription : tx.GetSaplingSpends()) {
+        auto nfIt = mapSaplingNullifiers.find(uint256::FromRawBytes(spendDescription.nullifier()));
+        assert(nfIt != mapSaplingNullifiers.end() && nfIt->second == &tx);
+    }
+    for (const uint256 &orchardNullifier : tx.GetOrchardBundle().GetNullifiers()) {
+        auto nfIt = mapOrchardNullifiers.find(orchardNullifier);
+        assert(nfIt != mapOrchardNullifiers.end() && nfIt->second == &tx);
+    }
+    return fDependsWait;
+}
+
+void CTxMemPool::checkSample(const CCoinsViewCache *pcoins) const
+{
+    AssertLockHeld(cs);
+    const int64_t nStart = GetTimeMicros();
+
+    CCoinsViewCache view(const_cast<CCoinsViewCache*>(pcoins));
+    const int64_t nSpendHeight = GetSpendHeight(view);
+    auto checkWithInputs = [&](txiter it) {
+        const CTransaction& tx = it->GetTx();
+        CValidationState state;
+        // The inputs of transactions that spend other mempool transactions
+        // are only checked with the whole pool.
+        if (!checkEntry(it, pcoins)) {
+            assert(tx.IsCoinBase() ||
+                Consensus::CheckTxInputs(tx, state, view, nSpendHeight, Params().GetConsensus()));
+        }
+        assert(Consensus::CheckTxShieldedInputs(tx, state, view, 0));
+    };
+
+    // The transactions that changed first; those left over are checked next
+    // time.
+    unsigned int nTouched = 0;
+    auto touchedIt = setCheckTouched.begin();
+    while (touchedIt != setCheckTouched.end() && GetTimeMicros() - nStart < MEMPOOL_CHECK_SAMPLE_TIME) {
+        txiter it = mapTx.find(*touchedIt);
+        if (it != mapTx.end()) {
+            checkWithInputs(it);
+            nTouched++;
+        }
+        touchedIt = setCheckTouched.erase(touchedIt);
+    }
 
-    if (GetRand(std::numeric_limits<uint32_t>::max()) >= nCheckFrequency)
+    // Then a random sample, found in one pass over the pool.
+    std::vector<size_t> vPositions;
+    if (!mapTx.empty()) {
+        FastRandomContext rng;
+        for (unsigned int n = 0; n < nCheckSample; n++)
+            vPositions.push_back(rng.randrange(mapTx.size()));
+        std::sort(vPositions.begin(), vPositions.end());
+    }
+    unsigned int nSampled = 0;
+    indexed_transaction_set::const_iterator it = mapTx.begin();
+    size_t nPosition = 0;
+    for (size_t nNext : vPositions) {
+        if (GetTimeMicros() - nStart >= MEMPOOL_CHECK_SAMPLE_TIME)
+            break;
+        std::advance(it, nNext - nPosition);
+        nPosition = nNext;
+        checkWithInputs(it);
+        nSampled++;
+    }
+
+    LogPrint("mempool", "Checked %u changed and %u sampled of %u mempool transactions in %dus\n",
+        nTouched, nSampled, (unsigned int)mapTx.size(), GetTimeMicros() - nStart);
+}
+
+void CTxMemPool::check(const CCoinsViewCache *pcoins) const
+{
+    if (nCheckFrequency == 0 || GetRand(std::numeric_limits<uint32_t>::max()) >= nCheckFrequency) {
+        if (nCheckSample != 0) {
+            LOCK(cs);
+            checkSample(pcoins);
+        }
         return;
+    }
 
     LogPrint("mempool", "Checking mempool with %u transactions and %u inputs\n", (unsigned int)mapTx.size(), (unsigned int)mapNextTx.size());
 
@@ -884,58 +1208,14 @@ void CTxMemPool::check(const CCoinsViewCache *pcoins) const
     LOCK(cs);
     std::list<const CTxMemPoolEntry*> waitingOnDependants;
     for (indexed_transaction_set::const_iterator it = mapTx.begin(); it != mapTx.end(); it++) {
-        unsigned int i = 0;
         checkTotal += it->GetTxSize();
         innerUsage += it->DynamicMemoryUsage();
-        const CTransaction& tx = it->GetTx();
         txlinksMap::const_iterator linksiter = mapLinks.find(it);
         assert(linksiter != mapLinks.end());
         const TxLinks &links = linksiter->second;
         innerUsage += memusage::DynamicUsage(links.parents) + memusage::DynamicUsage(links.children);
-        bool fDependsWait = false;
-        setEntries setParentCheck;
-        for (const CTxIn &txin : tx.vin) {
-            // Check that every mempool transaction's inputs refer to available coins, or other mempool tx's.
-            indexed_transaction_set::const_iterator it2 = mapTx.find(txin.prevout.hash);
-            if (it2 != mapTx.end()) {
-                const CTransaction& tx2 = it2->GetTx();
-                assert(tx2.vout.size() > txin.prevout.n && !tx2.vout[txin.prevout.n].IsNull());
-                fDependsWait = true;
-                setParentCheck.insert(it2);
-            } else {
-                const CCoins* coins = pcoins->AccessCoins(txin.prevout.hash);
-                assert(coins && coins->IsAvailable(txin.prevout.n));
-            }
-            // Check whether its inputs are marked in mapNextTx.
-            std::map<COutPoint, CInPoint>::const_iterator it3 = mapNextTx.find(txin.prevout);
-            assert(it3 != mapNextTx.end());
-            assert(it3->second.ptx == &tx);
-            assert(it3->second.n == i);
-            i++;
-        }
-        assert(setParentCheck == GetMemPoolParents(it));
-        // Check children against mapNextTx
-        CTxMemPool::setEntries setChildrenCheck;
-        std::map<COutPoint, CInPoint>::const_iterator iter = mapNextTx.lower_bound(COutPoint(it->GetTx().GetHash(), 0));
-        int64_t childSizes = 0;
-        CAmount childModFee = 0;
-        for (; iter != mapNextTx.end() && iter->first.hash == it->GetTx().GetHash(); ++iter) {
-            txiter childit = mapTx.find(iter->second.ptx->GetHash());
-            assert(childit != mapTx.end()); // mapNextTx points to in-mempool transactions
-            if (setChildrenCheck.insert(childit).second) {
-                childSizes += childit->GetTxSize();
-                childModFee += childit->GetModifiedFee();
-            }
-        }
-        assert(setChildrenCheck == GetMemPoolChildren(it));
-        // Also check to make sure size is greater than sum with immediate children.
-        // just a sanity check, not definitive that this calc is correct...
-        if (!it->IsDirty()) {
-            assert(it->GetSizeWithDescendants() >= childSizes + it->GetTxSize());
-        } else {
-            assert(it->GetSizeWithDescendants() == it->GetTxSize());
-            assert(it->GetModFeesWithDescendants() == it->GetModifiedFee());
-        }
+        bool fDependsWait = checkEntry(it, pcoins);
+        const CTransaction& tx = it->GetTx();
 
         if (fDependsWait)
             waitingOnDependants.push_back(&(*it));
@@ -966,7 +1246,7 @@ void CTxMemPool::check(const CCoinsViewCache *pcoins) const
             stepsSinceLastRemove = 0;
         }
     }
-    for (std::map<COutPoint, CInPoint>::const_iterator it = mapNextTx.begin(); it != mapNextTx.end(); it++) {
+    for (auto it = mapNextTx.begin(); it != mapNextTx.end(); it++) {
         uint256 hash = it->second.ptx->GetHash();
         indexed_transaction_set::const_iterator it2 = mapTx.find(hash);
         const CTransaction& tx = it2->GetTx();
@@ -984,8 +1264,7 @@ void CTxMemPool::check(const CCoinsViewCache *pcoins) const
     assert(innerUsage == cachedInnerUsage);
 }
 
-template<typename T>
-void CTxMemPool::checkNullifiers(const std::map<T, const CTransaction*>& mapToUse) const
+void CTxMemPool::checkNullifiers(const CMemPoolNullifierMap& mapToUse) const
 {
     for (const auto& entry : mapToUse) {
         uint256 hash = entry.second->GetHash();
@@ -1053,6 +1332,14 @@ void CTxMemPool::queryHashes(std::vector<uint256>& vtxid)
     }
 }
 
+TxMempoolInfo CTxMemPool::GetInfo(indexed_transaction_set::const_iterator it) const
+{
+    size_t nUnpaidActionCount = it->GetTx().IsCoinBase() ? 0 :
+        CalculateUnpaidActionCount(it->GetFee(), it->GetConventionalFee());
+    return TxMempoolInfo{it->GetSharedTx(), it->GetTime(), CFeeRate(it->GetFee(), it->GetTxSize()),
+                         it->GetFee(), it->GetTxSize(), nUnpaidActionCount};
+}
+
 std::vector<TxMempoolInfo> CTxMemPool::infoAll() const
 {
     LOCK(cs);
@@ -1061,13 +1348,13 @@ std::vector<TxMempoolInfo> CTxMemPool::infoAll() const
     std::vector<TxMempoolInfo> ret;
     ret.reserve(mapTx.size());
     for (auto it : iters) {
-        ret.push_back(TxMempoolInfo{it->GetSharedTx(), it->GetTime(), CFeeRate(it->GetFee(), it->GetTxSize())});
+        ret.push_back(GetInfo(it));
     }
 
     return ret;
 }
 
-std::shared_ptr<const CTransaction> CTxMemPool::get(const uint256& hash) const
+CTransactionRef CTxMemPool::get(const uint256& hash) const
 {
     LOCK(cs);
     indexed_transaction_set::const_iterator i = mapTx.find(hash);
@@ -1076,13 +1363,31 @@ std::shared_ptr<const CTransaction> CTxMemPool::get(const uint256& hash) const
     return i->GetSharedTx();
 }
 
+std::shared_ptr<PrecomputedTransactionData> CTxMemPool::getPrecomputedData(const CTransaction& tx) const
+{
+    LOCK(cs);
+    indexed_transaction_set::const_iterator i = mapTx.find(tx.GetHash());
+    if (i == mapTx.end() || i->GetTx().GetWTxId() != tx.GetWTxId())
+        return nullptr;
+    return i->GetPrecomputedData();
+}
+
+bool CTxMemPool::isValidated(const CTransaction& tx, uint32_t consensusBranchId) const
+{
+    LOCK(cs);
+    indexed_transaction_set::const_iterator i = mapTx.find(tx.GetHash());
+    return i != mapTx.end() &&
+        i->GetTx().GetWTxId() == tx.GetWTxId() &&
+        i->GetValidatedBranchId() == consensusBranchId;
+}
+
 TxMempoolInfo CTxMemPool::info(const uint256& hash) const
 {
     LOCK(cs);
     indexed_transaction_set::const_iterator i = mapTx.find(hash);
     if (i == mapTx.end())
         return TxMempoolInfo();
-    return TxMempoolInfo{i->GetSharedTx(), i->GetTime(), CFeeRate(i->GetFee(), i->GetTxSize())};
+    return GetInfo(i);
 }
 
 void CTxMemPool::PrioritiseTransaction(const uint256 hash, const std::string strHash, const CAmount& nFeeDelta)
@@ -1102,6 +1407,13 @@ void CTxMemPool::PrioritiseTransaction(const uint256 hash, const std::string str
             BOOST_FOREACH(txiter ancestorIt, setAncestors) {
                 mapTx.modify(ancestorIt, update_descendant_state(0, nFeeDelta, 0));
             }
+            // ... and all descendants' modified fees with ancestors
+            setEntries setDescendants;
+            CalculateDescendants(it, setDescendants);
+            setDescendants.erase(it);
+            for (txiter descendantIt : setDescendants) {
+                mapTx.modify(descendantIt, update_ancestor_state(0, nFeeDelta, 0, 0, 0));
+            }
         }
     }
     LogPrintf("PrioritiseTransaction: %s feerate += %s\n", strHash, FormatMoney(nFeeDelta));
@@ -1137,7 +1449,7 @@ bool CTxMemPool::nullifierExists(const uint256& nullifier, ShieldedType type) co
         case SPROUT:
             return mapSproutNullifiers.count(nullifier);
         case SAPLING:
-            return mapSaplingNullifiers.count(nullifier.GetRawBytes());
+            return mapSaplingNullifiers.count(nullifier);
         case ORCHARD:
             return mapOrchardNullifiers.count(nullifier);
         default:
@@ -1180,11 +1492,24 @@ bool CCoinsViewMemPool::GetNullifier(const uint256 &nf, ShieldedType type) const
     return mempool.nullifierExists(nf, type) || base->GetNullifier(nf, type);
 }
 
+void CCoinsViewMemPool::GetNullifiers(const std::set<uint256> &nullifiers, ShieldedType type, std::set<uint256> &spent) const
+{
+    std::set<uint256> notInMempool;
+    for (const uint256 &nf : nullifiers) {
+        if (mempool.nullifierExists(nf, type)) {
+            spent.insert(nf);
+        } else {
+            notInMempool.insert(nf);
+        }
+    }
+    base->GetNullifiers(notInMempool, type, spent);
+}
+
 bool CCoinsViewMemPool::GetCoins(const uint256 &txid, CCoins &coins) const {
     // If an entry in the mempool exists, always return that one, as it's guaranteed to never
     // conflict with the underlying cache, and it cannot have pruned entries (as it contains full)
     // transactions. First checking the underlying cache risks returning a pruned entry instead.
-    shared_ptr<const CTransaction> ptx = mempool.get(txid);
+    CTransactionRef ptx = mempool.get(txid);
     if (ptx) {
         coins = CCoins(*ptx, MEMPOOL_HEIGHT);
         return true;
@@ -1201,9 +1526,9 @@ size_t CTxMemPool::DynamicMemoryUsage() const {
 
     size_t total = 0;
 
-    // Estimate the overhead of mapTx to be 9 pointers + an allocation, as no exact formula for
+    // Estimate the overhead of mapTx to be 12 pointers + an allocation, as no exact formula for
     // boost::multi_index_contained is implemented.
-    total += memusage::MallocUsage(sizeof(CTxMemPoolEntry) + 9 * sizeof(void*)) * mapTx.size();
+    total += memusage::MallocUsage(sizeof(CTxMemPoolEntry) + 12 * sizeof(void*)) * mapTx.size();
 
     // Three metadata maps inherited from Bitcoin Core
     total += memusage::DynamicUsage(mapNextTx) + memusage::DynamicUsage(mapDeltas) + memusage::DynamicUsage(mapLinks);
@@ -1219,12 +1544,15 @@ size_t CTxMemPool::DynamicMemoryUsage() const {
              memusage::DynamicUsage(mapSaplingNullifiers) +
              memusage::DynamicUsage(mapOrchardNullifiers);
 
+    // The nodes of mapNextTx and the nullifier maps
+    total += memusage::DynamicUsage(indexMemoryResource);
+
     // DoS mitigation
     total += memusage::DynamicUsage(recentlyEvicted) + memusage::DynamicUsage(limitSet);
 
     // Insight-related structures
     size_t insight = 0;
-    insight += memusage::DynamicUsage(mapAddress);
+    insight += memusage::DynamicUsage(mapAddress) + cachedAddressDeltaUsage;
     insight += memusage::DynamicUsage(mapAddressInserted);
     insight += memusage::DynamicUsage(mapSpent);
     insight += memusage::DynamicUsage(mapSpentInserted);
@@ -1326,17 +1654,24 @@ void CTxMemPool::EnsureSizeLimit() {
     while ((maybeDropTxId = limitSet->maybeDropRandom()).has_value()) {
         uint256 txId = maybeDropTxId.value();
         recentlyEvicted->add(txId);
-        std::list<CTransaction> removed;
-        remove(mapTx.find(txId)->GetTx(), removed, true);
+        std::list<CTransactionRef> removed;
+        remove(mapTx.find(txId)->GetTx(), removed, true, MemPoolRemovalReason::SIZELIMIT);
     }
 }
 
-void CTxMemPool::RemoveStaged(setEntries &stage) {
+void CTxMemPool::RemoveStaged(setEntries &stage, bool updateDescendants, MemPoolRemovalReason reason) {
     AssertLockHeld(cs);
-    UpdateForRemoveFromMempool(stage);
+    UpdateForRemoveFromMempool(stage, updateDescendants);
+    std::vector<uint256> vRemoved;
     for (const txiter& it : stage) {
-        removeUnchecked(it);
+        // insightexplorer
+        if (fAddressIndex)
+            vRemoved.push_back(it->GetTx().GetHash());
+        removeUnchecked(it, reason);
     }
+    // insightexplorer
+    if (fAddressIndex)
+        removeAddressIndex(vRemoved);
 }
 
 bool CTxMemPool::addUnchecked(const uint256&hash, const CTxMemPoolEntry &entry)
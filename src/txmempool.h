@@ -10,6 +10,7 @@
 #include <list>
 #include <memory>
 #include <set>
+#include <unordered_map>
 
 #include "int128.h"
 #include "amount.h"
@@ -28,23 +29,30 @@
 #include "boost/multi_index_container.hpp"
 #include "boost/multi_index/ordered_index.hpp"
 #include "boost/multi_index/hashed_index.hpp"
+#include "boost/signals2/signal.hpp"
 
 class CAutoFile;
 
 /** Fake height value used in CCoins to signify they are only in the memory pool (since 0.8) */
 static const unsigned int MEMPOOL_HEIGHT = 0x7FFFFFFF;
+/** Longest time a sampled mempool check takes, in microseconds */
+static const int64_t MEMPOOL_CHECK_SAMPLE_TIME = 10000;
 
 class CTxMemPool;
 
+struct PrecomputedTransactionData;
+
 /** \class CTxMemPoolEntry
  *
  * CTxMemPoolEntry stores data about the corresponding transaction, as well
  * as data about all in-mempool transactions that depend on the transaction
- * ("descendant" transactions).
+ * ("descendant" transactions), and all in-mempool transactions that the
+ * transaction depends on ("ancestor" transactions).
  *
  * When a new entry is added to the mempool, we update the descendant state
  * (nCountWithDescendants, nSizeWithDescendants, and nModFeesWithDescendants) for
- * all ancestors of the newly added transaction.
+ * all ancestors of the newly added transaction, and set its ancestor state
+ * from the entries of those ancestors.
  *
  * If updating the descendant state is skipped, we can mark the entry as
  * "dirty", and set nSizeWithDescendants/nModFeesWithDescendants to equal nTxSize/
@@ -56,7 +64,7 @@ class CTxMemPool;
 class CTxMemPoolEntry
 {
 private:
-    std::shared_ptr<const CTransaction> tx;
+    CTransactionRef tx;
     CAmount nFee;              //!< Cached to avoid expensive parent-transaction lookups
     size_t nTxSize;            //!< ... and avoid recomputing tx size
     size_t nUsageSize;         //!< ... and total memory usage
@@ -67,6 +75,8 @@ private:
     unsigned int sigOpCount;   //!< Legacy sig ops plus P2SH sig op count
     int64_t feeDelta;          //!< Used for determining the priority of the transaction for mining in a block
     uint32_t nBranchId;        //!< Branch ID this transaction is known to commit to, cached for efficiency
+    CAmount nConventionalFee;  //!< ZIP 317 conventional fee, cached to avoid recomputing the logical actions
+    std::shared_ptr<PrecomputedTransactionData> txdata; //!< Signature hash data computed when the transaction was accepted
 
     // Information about descendants of this transaction that are in the
     // mempool; if we remove this transaction we must remove all of these
@@ -77,15 +87,28 @@ private:
     uint64_t nSizeWithDescendants;   //! ... and size
     CAmount nModFeesWithDescendants; //! ... and total fees (all including us)
 
+    // Analogous statistics for ancestor transactions. These are always kept
+    // up to date, and are used to select packages of transactions for blocks.
+    uint64_t nCountWithAncestors;
+    uint64_t nSizeWithAncestors;
+    CAmount nModFeesWithAncestors;
+    unsigned int nSigOpCountWithAncestors;
+    CAmount nConventionalFeeWithAncestors;
+
 public:
-    CTxMemPoolEntry(const CTransaction& _tx, const CAmount& _nFee,
+    CTxMemPoolEntry(const CTransactionRef& _tx, const CAmount& _nFee,
                     int64_t _nTime, unsigned int _nHeight,
                     bool poolHasNoInputsOf, bool spendsCoinbase,
                     unsigned int nSigOps, uint32_t nBranchId);
+    CTxMemPoolEntry(const CTransaction& _tx, const CAmount& _nFee,
+                    int64_t _nTime, unsigned int _nHeight,
+                    bool poolHasNoInputsOf, bool spendsCoinbase,
+                    unsigned int nSigOps, uint32_t nBranchId) :
+        CTxMemPoolEntry(MakeTransactionRef(_tx), _nFee, _nTime, _nHeight, poolHasNoInputsOf, spendsCoinbase, nSigOps, nBranchId) {}
     CTxMemPoolEntry(const CTxMemPoolEntry& other);
 
     const CTransaction& GetTx() const { return *this->tx; }
-    std::shared_ptr<const CTransaction> GetSharedTx() const { return this->tx; }
+    CTransactionRef GetSharedTx() const { return this->tx; }
     const CAmount& GetFee() const { return nFee; }
 
     // Return the number of unpaid actions calculated according to ZIP 317.
@@ -96,6 +119,8 @@ public:
     // to ZIP 317, where 1 is represented by WEIGHT_RATIO_SCALE.
     int128_t GetWeightRatio() const;
 
+    const CAmount& GetConventionalFee() const { return nConventionalFee; }
+
     size_t GetTxSize() const { return nTxSize; }
     int64_t GetTime() const { return nTime; }
     unsigned int GetHeight() const { return nHeight; }
@@ -106,8 +131,10 @@ public:
 
     // Adjusts the descendant state, if this entry is not dirty.
     void UpdateState(int64_t modifySize, CAmount modifyFee, int64_t modifyCount);
+    // Adjusts the ancestor state.
+    void UpdateAncestorState(int64_t modifySize, CAmount modifyFee, int64_t modifyCount, int modifySigOps, CAmount modifyConventionalFee);
     // Updates the fee delta used for mining priority score, and the
-    // modified fees with descendants.
+    // modified fees with descendants and ancestors.
     void UpdateFeeDelta(int64_t feeDelta);
 
     /** We can set the entry to be dirty if doing the full calculation of in-
@@ -121,8 +148,21 @@ public:
     uint64_t GetSizeWithDescendants() const { return nSizeWithDescendants; }
     CAmount GetModFeesWithDescendants() const { return nModFeesWithDescendants; }
 
+    uint64_t GetCountWithAncestors() const { return nCountWithAncestors; }
+    uint64_t GetSizeWithAncestors() const { return nSizeWithAncestors; }
+    CAmount GetModFeesWithAncestors() const { return nModFeesWithAncestors; }
+    unsigned int GetSigOpCountWithAncestors() const { return nSigOpCountWithAncestors; }
+    CAmount GetConventionalFeeWithAncestors() const { return nConventionalFeeWithAncestors; }
+
+    // Return the weight ratio of this transaction together with all of its
+    // in-mempool ancestors, as for GetWeightRatio.
+    int128_t GetWeightRatioWithAncestors() const;
+
     bool GetSpendsCoinbase() const { return spendsCoinbase; }
     uint32_t GetValidatedBranchId() const { return nBranchId; }
+
+    void SetPrecomputedData(std::shared_ptr<PrecomputedTransactionData> txdataIn) { txdata = txdataIn; }
+    std::shared_ptr<PrecomputedTransactionData> GetPrecomputedData() const { return txdata; }
 };
 
 // Helpers for modifying CTxMemPool::mapTx, which is a boost multi_index.
@@ -141,6 +181,23 @@ struct update_descendant_state
         int64_t modifyCount;
 };
 
+struct update_ancestor_state
+{
+    update_ancestor_state(int64_t _modifySize, CAmount _modifyFee, int64_t _modifyCount, int _modifySigOps, CAmount _modifyConventionalFee) :
+        modifySize(_modifySize), modifyFee(_modifyFee), modifyCount(_modifyCount), modifySigOps(_modifySigOps), modifyConventionalFee(_modifyConventionalFee)
+    {}
+
+    void operator() (CTxMemPoolEntry &e)
+        { e.UpdateAncestorState(modifySize, modifyFee, modifyCount, modifySigOps, modifyConventionalFee); }
+
+    private:
+        int64_t modifySize;
+        CAmount modifyFee;
+        int64_t modifyCount;
+        int modifySigOps;
+        CAmount modifyConventionalFee;
+};
+
 struct set_dirty
 {
     void operator() (CTxMemPoolEntry &e)
@@ -167,6 +224,16 @@ struct mempoolentry_txid
     }
 };
 
+// extracts a TxMemPoolEntry's transaction expiry height
+struct mempoolentry_expiry_height
+{
+    typedef uint32_t result_type;
+    result_type operator() (const CTxMemPoolEntry &entry) const
+    {
+        return entry.GetTx().nExpiryHeight;
+    }
+};
+
 /** \class CompareTxMemPoolEntryByDescendantScore
  *
  *  Sort an entry by max(score/size of entry's tx, score/size with all descendants).
@@ -234,6 +301,7 @@ public:
 // Multi_index tag names
 struct descendant_score {};
 struct mining_score {};
+struct expiry_height {};
 
 /** An inpoint - a combination of a transaction and an index n into its vin */
 class CInPoint
@@ -255,13 +323,91 @@ public:
 struct TxMempoolInfo
 {
     /** The transaction itself */
-    std::shared_ptr<const CTransaction> tx;
+    CTransactionRef tx;
 
     /** Time the transaction entered the mempool. */
     int64_t nTime;
 
     /** Feerate of the transaction. */
     CFeeRate feeRate;
+
+    /** Fee of the transaction, not including any prioritisation. */
+    CAmount nFee;
+
+    /** Serialized size of the transaction. */
+    size_t nTxSize;
+
+    /** Unpaid actions of the transaction, given its unprioritised fee. */
+    size_t nUnpaidActionCount;
+};
+
+/** Why a transaction left the mempool. */
+enum class MemPoolRemovalReason {
+    UNKNOWN,   //!< Manually removed or unknown reason
+    EXPIRY,    //!< Expired at the height of a new block
+    SIZELIMIT, //!< Evicted to keep the mempool within its cost limit
+    REORG,     //!< Made invalid or immature by a reorg or a network upgrade
+    BLOCK,     //!< Included in a connected block
+    CONFLICT,  //!< Conflicted with a transaction in a connected block
+};
+
+std::string RemovalReasonToString(MemPoolRemovalReason reason);
+
+/**
+ * Largest node allocated by the mempool's spend and nullifier indexes: an
+ * entry of mapNextTx, plus the next pointer and cached hash that
+ * std::unordered_map keeps in each node, with room to spare for other
+ * standard libraries.
+ */
+static constexpr size_t MEMPOOL_INDEX_POOL_BLOCK_SIZE =
+    sizeof(std::pair<const COutPoint, CInPoint>) + sizeof(void*) * 4;
+static_assert(MEMPOOL_INDEX_POOL_BLOCK_SIZE % alignof(void*) == 0,
+    "MEMPOOL_INDEX_POOL_BLOCK_SIZE must be a multiple of the pool alignment");
+
+/**
+ * The indexes that are updated for every input and shielded spend of every
+ * transaction entering or leaving the mempool are hashed, and their nodes
+ * are carved out of a pool shared by all of them.
+ */
+template<typename K, typename V, typename Hasher>
+using CMemPoolIndexMap = std::unordered_map<
+    K, V, Hasher, std::equal_to<K>,
+    PoolAllocator<std::pair<const K, V>, MEMPOOL_INDEX_POOL_BLOCK_SIZE, alignof(void*)>>;
+
+typedef CMemPoolIndexMap<COutPoint, CInPoint, SaltedOutpointHasher> CMemPoolSpendMap;
+typedef CMemPoolIndexMap<uint256, const CTransaction*, SaltedTxidHasher> CMemPoolNullifierMap;
+typedef CMemPoolSpendMap::allocator_type::ResourceType CMemPoolIndexMemoryResource;
+static_assert(std::is_same<CMemPoolNullifierMap::allocator_type::ResourceType, CMemPoolIndexMemoryResource>::value,
+    "the mempool's spend and nullifier indexes must be able to share a pool");
+
+// insightexplorer
+class SaltedSpentIndexKeyHasher
+{
+private:
+    SaltedOutpointHasher hasher;
+
+public:
+    size_t operator()(const CSpentIndexKey& key) const {
+        return hasher(COutPoint(key.txid, key.outputIndex));
+    }
+};
+
+// insightexplorer
+/** An address of the mempool address index: its type and hash. */
+typedef std::pair<int, uint160> CMempoolAddress;
+
+class SaltedAddressHasher
+{
+private:
+    /** Salt */
+    const uint64_t k0, k1;
+
+public:
+    SaltedAddressHasher();
+
+    size_t operator()(const CMempoolAddress& address) const {
+        return CSipHasher(k0, k1).Write(address.first).Write(address.second.begin(), address.second.size()).Finalize();
+    }
 };
 
 /**
@@ -288,7 +434,8 @@ struct TxMempoolInfo
  * In order for the feerate sort to remain correct, we must update transactions
  * in the mempool when new descendants arrive.  To facilitate this, we track
  * the set of in-mempool direct parents and direct children in mapLinks.  Within
- * each CTxMemPoolEntry, we track the size and fees of all descendants.
+ * each CTxMemPoolEntry, we track the size and fees of all descendants, and of
+ * all ancestors.
  *
  * Usually when a new transaction is added to the mempool, it has no in-mempool
  * children (because any such children would be an orphan).  So in
@@ -296,11 +443,14 @@ struct TxMempoolInfo
  * - update a new entry's setMemPoolParents to include all in-mempool parents
  * - update the new entry's direct parents to include the new tx as a child
  * - update all ancestors of the transaction to include the new tx's size/fee
+ * - set the ancestor state of the new entry from the entries of its ancestors
  *
  * When a transaction is removed from the mempool, we must:
  * - update all in-mempool parents to not track the tx in setMemPoolChildren
  * - update all ancestors to not include the tx's size/fees in descendant state
  * - update all in-mempool children to not include it as a parent
+ * - if its descendants stay in the mempool (because the tx was mined), update
+ *   them to not include the tx's size/fees in ancestor state
  *
  * These happen in UpdateForRemoveFromMempool().  (Note that when removing a
  * transaction along with its descendants, we must calculate that set of
@@ -344,6 +494,10 @@ class CTxMemPool
 {
 private:
     uint32_t nCheckFrequency; //!< Value n means that n times in 2^32 we check.
+    unsigned int nCheckSample = 0; //!< Number of random entries checked when the whole pool isn't.
+    //! Transactions added, or next to a transaction removed, since the last
+    //! check, if nCheckSample is set.
+    mutable std::set<uint256> setCheckTouched;
     unsigned int nTransactionsUpdated;
 
     uint64_t totalTxSize = 0;  //!< sum of all mempool tx' byte sizes
@@ -352,15 +506,20 @@ private:
     std::map<uint256, const CTransaction*> mapRecentlyAddedTx;
     uint64_t nRecentlyAddedSequence = 0;
     uint64_t nNotifiedSequence = 0;
+    //! Incremented whenever a transaction enters or leaves the mempool.
+    uint64_t nMempoolSequence = 0;
 
-    std::map<uint256, const CTransaction*> mapSproutNullifiers;
-    std::map<libzcash::nullifier_t, const CTransaction*> mapSaplingNullifiers;
-    std::map<uint256, const CTransaction*> mapOrchardNullifiers;
+    //! Pool from which the nodes of mapNextTx and the nullifier maps are
+    //! allocated. Declared before them, so that it outlives them.
+    CMemPoolIndexMemoryResource indexMemoryResource{};
+
+    CMemPoolNullifierMap mapSproutNullifiers{0, SaltedTxidHasher(), std::equal_to<uint256>(), &indexMemoryResource};
+    CMemPoolNullifierMap mapSaplingNullifiers{0, SaltedTxidHasher(), std::equal_to<uint256>(), &indexMemoryResource};
+    CMemPoolNullifierMap mapOrchardNullifiers{0, SaltedTxidHasher(), std::equal_to<uint256>(), &indexMemoryResource};
     RecentlyEvictedList* recentlyEvicted = new RecentlyEvictedList(GetNodeClock(), DEFAULT_MEMPOOL_EVICTION_MEMORY_MINUTES * 60);
     MempoolLimitTxSet* limitSet = new MempoolLimitTxSet(DEFAULT_MEMPOOL_TOTAL_COST_LIMIT);
 
-    template<typename T>
-    void checkNullifiers(const std::map<T, const CTransaction*>& mapToUse) const;
+    void checkNullifiers(const CMemPoolNullifierMap& mapToUse) const;
 
     CFeeRate minReasonableRelayFee;
 
@@ -381,6 +540,11 @@ public:
                 boost::multi_index::tag<mining_score>,
                 boost::multi_index::identity<CTxMemPoolEntry>,
                 CompareTxMemPoolEntryByScore
+            >,
+            // sorted by expiry height (0 for transactions that never expire)
+            boost::multi_index::ordered_non_unique<
+                boost::multi_index::tag<expiry_height>,
+                mempoolentry_expiry_height
             >
         >
     > indexed_transaction_set;
@@ -430,9 +594,8 @@ public:
         }
     };
     typedef std::set<txiter, CompareIteratorByHash> setEntries;
-    typedef std::deque<txiter> queueEntries;
     // Type of a set of candidate transactions to be added to a block template.
-    typedef WeightedMap<uint256, txiter, int128_t, GetRandInt128> weightedCandidates;
+    typedef WeightedMap<uint256, txiter, int128_t, GetRandInt128, SaltedTxidHasher> weightedCandidates;
 
     const setEntries & GetMemPoolParents(txiter entry) const;
     const setEntries & GetMemPoolChildren(txiter entry) const;
@@ -450,16 +613,30 @@ private:
     void UpdateParent(txiter entry, txiter parent, bool add);
     void UpdateChild(txiter entry, txiter child, bool add);
 
+    /** Check the links, spends, ancestor and descendant state and nullifiers
+     *  of one entry, and that its inputs outside the mempool are available in
+     *  pcoins. Returns whether it spends other mempool transactions. */
+    bool checkEntry(txiter it, const CCoinsViewCache *pcoins) const;
+    /** Check the entries in setCheckTouched and nCheckSample random entries,
+     *  for at most MEMPOOL_CHECK_SAMPLE_TIME microseconds. */
+    void checkSample(const CCoinsViewCache *pcoins) const;
+
     // insightexplorer
-    std::map<CMempoolAddressDeltaKey, CMempoolAddressDelta, CMempoolAddressDeltaKeyCompare> mapAddress;
-    std::map<uint256, std::vector<CMempoolAddressDeltaKey> > mapAddressInserted;
-    std::map<CSpentIndexKey, CSpentIndexValue, CSpentIndexKeyCompare> mapSpent;
-    std::map<uint256, std::vector<CSpentIndexKey>> mapSpentInserted;
+    //! The address deltas of the mempool transactions, by address, each in
+    //! the order the transactions were added.
+    boost::unordered_map<CMempoolAddress, std::vector<std::pair<CMempoolAddressDeltaKey, CMempoolAddressDelta>>, SaltedAddressHasher> mapAddress;
+    //! The addresses each transaction has deltas for in mapAddress.
+    boost::unordered_map<uint256, std::vector<CMempoolAddress>, SaltedTxidHasher> mapAddressInserted;
+    //! The memory used by the delta vectors of mapAddress.
+    size_t cachedAddressDeltaUsage = 0;
+    boost::unordered_map<CSpentIndexKey, CSpentIndexValue, SaltedSpentIndexKeyHasher> mapSpent;
+    boost::unordered_map<uint256, std::vector<CSpentIndexKey>, SaltedTxidHasher> mapSpentInserted;
 
     std::vector<indexed_transaction_set::const_iterator> GetSortedDepthAndScore() const;
+    TxMempoolInfo GetInfo(indexed_transaction_set::const_iterator it) const;
 
 public:
-    std::map<COutPoint, CInPoint> mapNextTx;
+    CMemPoolSpendMap mapNextTx{0, SaltedOutpointHasher(), std::equal_to<COutPoint>(), &indexMemoryResource};
     std::map<uint256, CAmount> mapDeltas;
 
     /** Create a new CTxMemPool.
@@ -475,9 +652,15 @@ public:
      * consistent (does not contain two transactions that spend the same inputs,
      * all inputs are in the mapNextTx array). If sanity-checking is turned off,
      * check does nothing.
+     *
+     * When the whole pool is not checked and a sample size is set, the
+     * transactions that changed since the last check and a random sample of
+     * the others are checked instead, within a time budget, so that checks
+     * can be left on in production.
      */
     void check(const CCoinsViewCache *pcoins) const;
     void setSanityCheck(double dFrequency = 1.0) { nCheckFrequency = static_cast<uint32_t>(dFrequency * 4294967295.0); }
+    void setSampleCheck(unsigned int nSample) { nCheckSample = nSample; }
 
     // addUnchecked must updated state for all ancestors of a given transaction,
     // to track size/count of descendant transactions.  First version of
@@ -490,20 +673,21 @@ public:
     void addAddressIndex(const CTxMemPoolEntry &entry, const CCoinsViewCache &view);
     void getAddressIndex(const std::vector<std::pair<uint160, int>>& addresses,
                          std::vector<std::pair<CMempoolAddressDeltaKey, CMempoolAddressDelta>>& results);
-    void removeAddressIndex(const uint256& txhash);
+    void removeAddressIndex(const std::vector<uint256>& txhashes);
 
     void addSpentIndex(const CTxMemPoolEntry &entry, const CCoinsViewCache &view);
     bool getSpentIndex(const CSpentIndexKey &key, CSpentIndexValue &value);
     void removeSpentIndex(const uint256 txhash);
     // END insightexplorer
 
-    void remove(const CTransaction &tx, std::list<CTransaction>& removed, bool fRecursive = false);
+    void remove(const CTransaction &tx, std::list<CTransactionRef>& removed, bool fRecursive = false,
+                MemPoolRemovalReason reason = MemPoolRemovalReason::UNKNOWN);
     void removeWithAnchor(const uint256 &invalidRoot, ShieldedType type);
     void removeForReorg(const CCoinsViewCache *pcoins, unsigned int nMemPoolHeight, int flags);
-    void removeConflicts(const CTransaction &tx, std::list<CTransaction>& removed);
+    void removeConflicts(const CTransaction &tx, std::list<CTransactionRef>& removed);
     std::vector<uint256> removeExpired(unsigned int nBlockHeight);
     void removeForBlock(const std::vector<CTransaction>& vtx, unsigned int nBlockHeight,
-                        std::list<CTransaction>& conflicts);
+                        std::list<CTransactionRef>& conflicts);
     void removeWithoutBranchId(uint32_t nMemPoolBranchId);
     void clear();
     void _clear(); // unlocked
@@ -526,8 +710,9 @@ public:
 public:
     /** Remove a set of transactions from the mempool.
      *  If a transaction is in this set, then all in-mempool descendants must
-     *  also be in the set.*/
-    void RemoveStaged(setEntries &stage);
+     *  also be in the set, unless updateDescendants is true, in which case
+     *  the descendants that stay behind have their ancestor state updated. */
+    void RemoveStaged(setEntries &stage, bool updateDescendants, MemPoolRemovalReason reason);
 
     /** When adding transactions from a disconnected block back to the mempool,
      *  new mempool entries may have children in the mempool (which is generally
@@ -552,8 +737,25 @@ public:
      */
     bool CalculateMemPoolAncestors(const CTxMemPoolEntry &entry, setEntries &setAncestors, uint64_t limitAncestorCount, uint64_t limitAncestorSize, uint64_t limitDescendantCount, uint64_t limitDescendantSize, std::string &errString, bool fSearchForParents = true);
 
+    /** Populate setDescendants with all in-mempool descendants of hash.
+     *  Assumes that setDescendants includes all in-mempool descendants of anything
+     *  already in it.  */
+    void CalculateDescendants(txiter it, setEntries &setDescendants);
+
     bool nullifierExists(const uint256& nullifier, ShieldedType type) const;
 
+    //! Signalled with cs held when a transaction enters or leaves the mempool,
+    //! along with the mempool sequence number after the change.
+    boost::signals2::signal<void (const CTransaction &, uint64_t nMempoolSequence)> NotifyEntryAdded;
+    boost::signals2::signal<void (const CTransaction &, MemPoolRemovalReason, uint64_t nMempoolSequence)> NotifyEntryRemoved;
+
+    //! The number of times a transaction has entered or left the mempool.
+    uint64_t GetSequence() const
+    {
+        LOCK(cs);
+        return nMempoolSequence;
+    }
+
     std::pair<std::vector<CTransaction>, uint64_t> DrainRecentlyAdded();
     void SetNotifiedSequence(uint64_t recentlyAddedSequence);
     bool IsFullyNotified();
@@ -576,7 +778,21 @@ public:
         return (mapTx.count(hash) != 0);
     }
 
-    std::shared_ptr<const CTransaction> get(const uint256& hash) const;
+    CTransactionRef get(const uint256& hash) const;
+    /**
+     * Return the signature hash data precomputed when the given transaction
+     * was accepted, so that it can be reused when the transaction is
+     * connected in a block. Returns nullptr unless the mempool holds exactly
+     * this transaction, including its authorizing data.
+     */
+    std::shared_ptr<PrecomputedTransactionData> getPrecomputedData(const CTransaction& tx) const;
+    /**
+     * Return true if the mempool holds exactly this transaction, including
+     * its authorizing data, and accepted it under the given consensus branch
+     * ID. Its scripts, proofs and signatures are then known to be valid for
+     * a block in the same epoch.
+     */
+    bool isValidated(const CTransaction& tx, uint32_t consensusBranchId) const;
     TxMempoolInfo info(const uint256& hash) const;
     std::vector<TxMempoolInfo> infoAll() const;
 
@@ -618,14 +834,23 @@ private:
             const std::set<uint256> &setExclude);
     /** Update ancestors of hash to add/remove it as a descendant transaction. */
     void UpdateAncestorsOf(bool add, txiter hash, setEntries &setAncestors);
-    /** For each transaction being removed, update ancestors and any direct children. */
-    void UpdateForRemoveFromMempool(const setEntries &entriesToRemove);
+    /** Set the ancestor state of a new entry from the entries of its ancestors. */
+    void UpdateEntryForAncestors(txiter it, const setEntries &setAncestors);
+    /** Update the ancestor state of the given descendants of it to add or
+     *  remove it as an ancestor, skipping it and those in setExclude. */
+    void UpdateDescendantsOf(bool add, txiter it, const setEntries &setDescendants, const std::set<uint256> &setExclude);
+    /** For each transaction being removed, update ancestors and any direct children.
+     *  If updateDescendants is true, also update the ancestor state of the
+     *  in-mempool descendants, which must not be removed. */
+    void UpdateForRemoveFromMempool(const setEntries &entriesToRemove, bool updateDescendants);
     /** Sever link between specified transaction and direct children. */
     void UpdateChildrenForRemoval(txiter entry);
-    /** Populate setDescendants with all in-mempool descendants of hash.
-     *  Assumes that setDescendants includes all in-mempool descendants of anything
-     *  already in it.  */
-    void CalculateDescendants(txiter it, setEntries &setDescendants);
+    /** Add the entries that spend an input or a nullifier of tx, other than
+     *  those whose txids are in setExclude, to setConflicts. */
+    void CalculateConflicts(const CTransaction &tx, const std::set<uint256> &setExclude, setEntries &setConflicts) const;
+    /** Remove the entries in toRemove and all of their descendants, adding
+     *  their transactions to removed. */
+    void RemoveRecursive(const setEntries &toRemove, std::list<CTransactionRef>& removed, MemPoolRemovalReason reason);
 
     /** Before calling removeUnchecked for a given transaction,
      *  UpdateForRemoveFromMempool must be called on the entire (dependent) set
@@ -635,7 +860,7 @@ private:
      *  transactions in a chain before we've updated all the state for the
      *  removal.
      */
-    void removeUnchecked(txiter entry);
+    void removeUnchecked(txiter entry, MemPoolRemovalReason reason);
 };
 
 /**
@@ -652,6 +877,7 @@ public:
     ~CCoinsViewMemPool() {}
 
     bool GetNullifier(const uint256 &txid, ShieldedType type) const;
+    void GetNullifiers(const std::set<uint256> &nullifiers, ShieldedType type, std::set<uint256> &spent) const;
     bool GetCoins(const uint256 &txid, CCoins &coins) const;
     bool HaveCoins(const uint256 &txid) const;
 };
@@ -0,0 +1,236 @@
+// Copyright (c) 2026 The Zcash developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or https://www.opensource.org/licenses/mit-license.php .
+
+#include "txreconciliation.h"
+
+#include "crypto/common.h"
+#include "crypto/sha256.h"
+#include "hash.h"
+
+#include <algorithm>
+#include <string>
+
+namespace {
+
+/** The finalizer of MurmurHash3, used to spread short ids over the cells. */
+uint32_t Mix32(uint32_t h)
+{
+    h ^= h >> 16;
+    h *= 0x85ebca6b;
+    h ^= h >> 13;
+    h *= 0xc2b2ae35;
+    h ^= h >> 16;
+    return h;
+}
+
+static const uint32_t SKETCH_SUBTABLE_SEEDS[3] = {0x9e3779b9, 0x7f4a7c15, 0xf39cc060};
+static const uint32_t SKETCH_CHECK_SEED = 0x5bd1e995;
+
+uint32_t CheckSum(uint32_t key)
+{
+    return Mix32(key ^ SKETCH_CHECK_SEED);
+}
+
+} // namespace
+
+size_t CTxSketch::CellsForCapacity(size_t nCapacity)
+{
+    // With three subtables, two cells per id decode all but about one in a
+    // hundred differences; the constant keeps small sketches from failing on
+    // ids that collide in every subtable.
+    return 3 * ((nCapacity * 2 + 30 + 2) / 3);
+}
+
+CTxSketch::CTxSketch(size_t nCells) : cells(nCells - nCells % 3)
+{
+}
+
+size_t CTxSketch::CellIndex(uint32_t key, unsigned int nSubtable) const
+{
+    size_t nSubtableSize = cells.size() / 3;
+    return nSubtable * nSubtableSize + Mix32(key ^ SKETCH_SUBTABLE_SEEDS[nSubtable]) % nSubtableSize;
+}
+
+void CTxSketch::Update(uint32_t key, int32_t delta)
+{
+    if (cells.empty()) return;
+    uint32_t nCheck = CheckSum(key);
+    for (unsigned int i = 0; i < 3; i++) {
+        Cell& cell = cells[CellIndex(key, i)];
+        cell.count += delta;
+        cell.keySum ^= key;
+        cell.checkSum ^= nCheck;
+    }
+}
+
+bool CTxSketch::Subtract(const CTxSketch& other)
+{
+    if (other.cells.size() != cells.size()) return false;
+    for (size_t i = 0; i < cells.size(); i++) {
+        cells[i].count -= other.cells[i].count;
+        cells[i].keySum ^= other.cells[i].keySum;
+        cells[i].checkSum ^= other.cells[i].checkSum;
+    }
+    return true;
+}
+
+bool CTxSketch::Decode(std::vector<uint32_t>& vOnlyHere, std::vector<uint32_t>& vOnlyThere)
+{
+    vOnlyHere.clear();
+    vOnlyThere.clear();
+
+    // Repeatedly peel off cells that hold a single id, which may leave
+    // other cells with a single id. A sketch cannot hold more ids than it
+    // has cells, which also bounds the work on a malicious sketch.
+    bool fProgress = true;
+    while (fProgress) {
+        fProgress = false;
+        for (size_t i = 0; i < cells.size(); i++) {
+            const Cell& cell = cells[i];
+            if ((cell.count != 1 && cell.count != -1) || cell.checkSum != CheckSum(cell.keySum)) {
+                continue;
+            }
+            if (vOnlyHere.size() + vOnlyThere.size() >= cells.size()) {
+                return false;
+            }
+            uint32_t key = cell.keySum;
+            int32_t count = cell.count;
+            (count == 1 ? vOnlyHere : vOnlyThere).push_back(key);
+            Update(key, -count);
+            fProgress = true;
+        }
+    }
+
+    for (const Cell& cell : cells) {
+        if (cell.count != 0 || cell.keySum != 0 || cell.checkSum != 0) {
+            return false;
+        }
+    }
+    return true;
+}
+
+TxReconciliationState::TxReconciliationState(bool fInitiatorIn, bool fFloodIn, uint64_t nLocalSalt, uint64_t nRemoteSalt) :
+    k0(0), k1(0), fInitiator(fInitiatorIn), fFlood(fFloodIn), fRoundInFlight(false), nRoundStart(0), nNextRequest(0)
+{
+    // Both sides derive the same short id keys from the two salts, in
+    // ascending order.
+    static const std::string strTag = "Zcash tx reconciliation salt";
+    unsigned char salts[16];
+    WriteLE64(salts, std::min(nLocalSalt, nRemoteSalt));
+    WriteLE64(salts + 8, std::max(nLocalSalt, nRemoteSalt));
+    uint256 hash;
+    CSHA256()
+        .Write((const unsigned char*)strTag.data(), strTag.size())
+        .Write(salts, sizeof(salts))
+        .Finalize(hash.begin());
+    k0 = hash.GetUint64(0);
+    k1 = hash.GetUint64(1);
+}
+
+uint32_t TxReconciliationState::ShortId(const uint256& txid) const
+{
+    return SipHashUint256(k0, k1, txid) & 0xffffffff;
+}
+
+bool TxReconciliationState::Add(const uint256& txid)
+{
+    if (mapLocalSet.size() >= MAX_RECON_SET_SIZE) {
+        return false;
+    }
+    auto ret = mapLocalSet.emplace(ShortId(txid), txid);
+    return ret.second || ret.first->second == txid;
+}
+
+void TxReconciliationState::Remove(const uint256& txid)
+{
+    auto it = mapLocalSet.find(ShortId(txid));
+    if (it != mapLocalSet.end() && it->second == txid) {
+        mapLocalSet.erase(it);
+    }
+}
+
+size_t TxReconciliationState::StartRound(int64_t nNow)
+{
+    // Whatever was left of an earlier round that never finished is
+    // reconciled again.
+    mapLocalSet.insert(mapSnapshot.begin(), mapSnapshot.end());
+    mapSnapshot.clear();
+    mapSnapshot.swap(mapLocalSet);
+    fRoundInFlight = true;
+    nRoundStart = nNow;
+    return mapSnapshot.size();
+}
+
+CTxSketch TxReconciliationState::SketchSnapshot(size_t nRemoteSize) const
+{
+    // Expect the sets to differ by their difference in size, plus a quarter
+    // of the smaller one for transactions that reached only one side.
+    size_t nLocalSize = mapSnapshot.size();
+    size_t nCapacity = std::max(nLocalSize, nRemoteSize) - std::min(nLocalSize, nRemoteSize) +
+        std::min(nLocalSize, nRemoteSize) / 4 + 1;
+    size_t nCells = CTxSketch::CellsForCapacity(nCapacity);
+    if (nCells > MAX_SKETCH_CELLS) {
+        return CTxSketch();
+    }
+    CTxSketch sketch(nCells);
+    for (const auto& entry : mapSnapshot) {
+        sketch.Add(entry.first);
+    }
+    return sketch;
+}
+
+bool TxReconciliationState::Reconcile(const CTxSketch& remote, std::vector<uint256>& vAnnounce, std::vector<uint32_t>& vRequest) const
+{
+    vAnnounce.clear();
+    vRequest.clear();
+    if (remote.IsEmpty()) {
+        return false;
+    }
+
+    CTxSketch diff(remote.Cells());
+    for (const auto& entry : mapSnapshot) {
+        diff.Add(entry.first);
+    }
+    if (!diff.Subtract(remote)) {
+        return false;
+    }
+    std::vector<uint32_t> vOnlyLocal;
+    if (!diff.Decode(vOnlyLocal, vRequest)) {
+        vRequest.clear();
+        return false;
+    }
+    for (uint32_t shortid : vOnlyLocal) {
+        auto it = mapSnapshot.find(shortid);
+        if (it == mapSnapshot.end()) {
+            // A short id we never added decoded from the sketch: the
+            // difference was too large after all.
+            vAnnounce.clear();
+            vRequest.clear();
+            return false;
+        }
+        vAnnounce.push_back(it->second);
+    }
+    return true;
+}
+
+std::vector<uint256> TxReconciliationState::FinishRound(const std::vector<uint32_t>& vShortIds, bool fAll)
+{
+    std::vector<uint256> vTxid;
+    if (fAll) {
+        vTxid.reserve(mapSnapshot.size());
+        for (const auto& entry : mapSnapshot) {
+            vTxid.push_back(entry.second);
+        }
+    } else {
+        for (uint32_t shortid : vShortIds) {
+            auto it = mapSnapshot.find(shortid);
+            if (it != mapSnapshot.end()) {
+                vTxid.push_back(it->second);
+            }
+        }
+    }
+    mapSnapshot.clear();
+    fRoundInFlight = false;
+    return vTxid;
+}
@@ -0,0 +1,161 @@
+// Copyright (c) 2026 The Zcash developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or https://www.opensource.org/licenses/mit-license.php .
+
+#ifndef BITCOIN_TXRECONCILIATION_H
+#define BITCOIN_TXRECONCILIATION_H
+
+#include "serialize.h"
+#include "uint256.h"
+
+#include <map>
+#include <stdint.h>
+#include <vector>
+
+/** Version of the reconciliation protocol we announce in "sendtxrcncl". */
+static const uint32_t TXRECONCILIATION_PROTOCOL_VERSION = 1;
+/** Default for -txreconciliation. */
+static const bool DEFAULT_TXRECONCILIATION_ENABLE = true;
+/** Average delay between reconciliation rounds with each peer we initiate them with, in seconds. */
+static const unsigned int RECON_REQUEST_INTERVAL = 8;
+/** Time after which a round that got no answer is abandoned, in seconds. */
+static const unsigned int RECON_RESPONSE_TIMEOUT = 60;
+/** Maximum number of transactions waiting in a peer's reconciliation set.
+ *  Transactions beyond it are announced by inv right away. */
+static const size_t MAX_RECON_SET_SIZE = 3000;
+/** Maximum number of outbound reconciling peers we still flood transactions to. */
+static const int MAX_RECON_FLOOD_OUTBOUND_PEERS = 2;
+/** Number of cells in a sketch is at most this; larger differences fall back to inv. */
+static const size_t MAX_SKETCH_CELLS = 3 * 1024;
+
+/** An invertible Bloom lookup table over 32-bit short transaction ids.
+ *
+ *  Each id is added to one cell in each of three equally sized subtables.
+ *  Subtracting the sketch of one set from the sketch of another of the same
+ *  size leaves a sketch of their symmetric difference, which can be decoded
+ *  with high probability as long as it holds no more than about half as
+ *  many ids as cells.
+ */
+class CTxSketch
+{
+public:
+    struct Cell {
+        int32_t count;
+        uint32_t keySum;
+        uint32_t checkSum;
+
+        Cell() : count(0), keySum(0), checkSum(0) {}
+
+        ADD_SERIALIZE_METHODS;
+
+        template <typename Stream, typename Operation>
+        inline void SerializationOp(Stream& s, Operation ser_action) {
+            READWRITE(count);
+            READWRITE(keySum);
+            READWRITE(checkSum);
+        }
+    };
+
+private:
+    std::vector<Cell> cells;
+
+    size_t CellIndex(uint32_t key, unsigned int nSubtable) const;
+    void Update(uint32_t key, int32_t delta);
+
+public:
+    /** Number of cells of a sketch that can decode a difference of up to nCapacity ids. */
+    static size_t CellsForCapacity(size_t nCapacity);
+
+    CTxSketch() {}
+    explicit CTxSketch(size_t nCells);
+
+    size_t Cells() const { return cells.size(); }
+    bool IsEmpty() const { return cells.empty(); }
+
+    void Add(uint32_t key) { Update(key, 1); }
+
+    /** Subtract another sketch with the same number of cells. */
+    bool Subtract(const CTxSketch& other);
+
+    /** Decode a difference sketch: vOnlyHere gets the ids that were added
+     *  to this sketch only, vOnlyThere those of the subtracted one. Returns
+     *  false, leaving the sketch in an undefined state, if it could not be
+     *  decoded completely. */
+    bool Decode(std::vector<uint32_t>& vOnlyHere, std::vector<uint32_t>& vOnlyThere);
+
+    ADD_SERIALIZE_METHODS;
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream& s, Operation ser_action) {
+        READWRITE(cells);
+        if (ser_action.ForRead()) {
+            if (cells.size() > MAX_SKETCH_CELLS || cells.size() % 3 != 0) {
+                throw std::ios_base::failure("invalid sketch size");
+            }
+        }
+    }
+};
+
+/** The reconciliation state we keep for a peer that negotiated it with
+ *  "sendtxrcncl".
+ *
+ *  Transactions we would announce to the peer are collected in a set rather
+ *  than sent by inv. The peer that opened the connection periodically asks
+ *  the other side for a sketch of its set ("reqrecon"), subtracts a sketch of
+ *  its own, announces what the other side lacks and asks for what it lacks
+ *  itself ("reconcildiff"). When the difference is too large to decode, both
+ *  sides announce their whole set by inv instead.
+ */
+class TxReconciliationState
+{
+private:
+    uint64_t k0, k1;
+    //! Transactions to be reconciled in the next round, by short id.
+    std::map<uint32_t, uint256> mapLocalSet;
+    //! Transactions being reconciled in the current round, by short id.
+    std::map<uint32_t, uint256> mapSnapshot;
+
+public:
+    //! Whether we send "reqrecon" to the peer, rather than the other way round.
+    const bool fInitiator;
+    //! Whether transactions are flooded to the peer rather than reconciled.
+    const bool fFlood;
+    //! Whether a round is in progress, and when it was started (in microseconds).
+    bool fRoundInFlight;
+    int64_t nRoundStart;
+    //! When the initiator starts the next round (in microseconds).
+    int64_t nNextRequest;
+
+    TxReconciliationState(bool fInitiatorIn, bool fFloodIn, uint64_t nLocalSalt, uint64_t nRemoteSalt);
+
+    uint32_t ShortId(const uint256& txid) const;
+
+    /** Add a transaction to the set. Returns false if the set is full or
+     *  another transaction has the same short id, in which case the caller
+     *  should announce it by inv. */
+    bool Add(const uint256& txid);
+
+    /** Drop a transaction the peer already knows about. */
+    void Remove(const uint256& txid);
+
+    size_t LocalSetSize() const { return mapLocalSet.size(); }
+
+    /** Start a round: move the set into the snapshot. Returns its size. */
+    size_t StartRound(int64_t nNow);
+
+    /** Sketch the snapshot for a peer whose set holds nRemoteSize
+     *  transactions. The sketch is empty if the expected difference is too
+     *  large for reconciliation to save anything. */
+    CTxSketch SketchSnapshot(size_t nRemoteSize) const;
+
+    /** Reconcile the snapshot with the sketch of the peer. On success,
+     *  vAnnounce gets the transactions the peer lacks and vRequest the short
+     *  ids of those we lack. */
+    bool Reconcile(const CTxSketch& remote, std::vector<uint256>& vAnnounce, std::vector<uint32_t>& vRequest) const;
+
+    /** Finish the round and return the transactions of the snapshot with the
+     *  given short ids, or all of them if fAll. */
+    std::vector<uint256> FinishRound(const std::vector<uint32_t>& vShortIds, bool fAll);
+};
+
+#endif // BITCOIN_TXRECONCILIATION_H
@@ -0,0 +1,97 @@
+// Copyright (c) 2026 The Zcash developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or https://www.opensource.org/licenses/mit-license.php .
+
+#include "txrejectcache.h"
+
+#include "hash.h"
+#include "memusage.h"
+
+#include <algorithm>
+
+CTxRejectCache::CTxRejectCache(size_t nMaxUsage) :
+    nMaxEntries(std::max<size_t>(1, nMaxUsage / EntryUsage()))
+{
+    LOCK(cs);
+    mapRejects.reserve(nMaxEntries);
+    vKeys.reserve(nMaxEntries);
+}
+
+size_t CTxRejectCache::EntryUsage()
+{
+    // A node of the map holds the next pointer, the entry and the cached
+    // hash, and the map has about one bucket pointer per entry.
+    return memusage::MallocUsage(2 * sizeof(void*) + sizeof(std::pair<const uint256, unsigned char>)) +
+        sizeof(void*) + sizeof(uint256);
+}
+
+uint256 CTxRejectCache::Key(const std::vector<unsigned char>& vWideHash)
+{
+    return Hash(vWideHash.begin(), vWideHash.end());
+}
+
+void CTxRejectCache::SetBranchId(uint32_t nBranchIdIn)
+{
+    AssertLockHeld(cs);
+    if (nBranchIdIn == nBranchId) return;
+    stats.nEvictions += mapRejects.size();
+    mapRejects.clear();
+    vKeys.clear();
+    nNext = 0;
+    nBranchId = nBranchIdIn;
+}
+
+void CTxRejectCache::Add(const std::vector<unsigned char>& vWideHash, unsigned char chRejectCode, uint32_t nBranchIdIn)
+{
+    uint256 key = Key(vWideHash);
+
+    LOCK(cs);
+    SetBranchId(nBranchIdIn);
+    if (!mapRejects.emplace(key, chRejectCode).second) return;
+    if (vKeys.size() < nMaxEntries) {
+        vKeys.push_back(key);
+    } else {
+        mapRejects.erase(vKeys[nNext]);
+        vKeys[nNext] = key;
+        nNext = (nNext + 1) % nMaxEntries;
+        stats.nEvictions++;
+    }
+    stats.nInsertions++;
+}
+
+bool CTxRejectCache::Contains(const std::vector<unsigned char>& vWideHash, uint32_t nBranchIdIn)
+{
+    uint256 key = Key(vWideHash);
+
+    LOCK(cs);
+    SetBranchId(nBranchIdIn);
+    if (mapRejects.count(key)) {
+        stats.nHits++;
+        return true;
+    }
+    stats.nMisses++;
+    return false;
+}
+
+std::optional<unsigned char> CTxRejectCache::GetRejectCode(const std::vector<unsigned char>& vWideHash, uint32_t nBranchIdIn) const
+{
+    uint256 key = Key(vWideHash);
+
+    LOCK(cs);
+    if (nBranchIdIn != nBranchId) return std::nullopt;
+    auto it = mapRejects.find(key);
+    if (it == mapRejects.end()) return std::nullopt;
+    return it->second;
+}
+
+CCacheStats CTxRejectCache::GetStats() const
+{
+    LOCK(cs);
+    CCacheStats result = stats;
+    result.nEntries = mapRejects.size();
+    result.nMaxEntries = nMaxEntries;
+    result.nMemoryUsage = memusage::MallocUsage(sizeof(void*) * mapRejects.bucket_count()) +
+        memusage::MallocUsage(sizeof(uint256) * vKeys.capacity()) +
+        mapRejects.size() * memusage::MallocUsage(2 * sizeof(void*) + sizeof(std::pair<const uint256, unsigned char>));
+    return result;
+}
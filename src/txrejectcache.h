@@ -0,0 +1,74 @@
+// Copyright (c) 2026 The Zcash developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or https://www.opensource.org/licenses/mit-license.php .
+
+#ifndef ZCASH_TXREJECTCACHE_H
+#define ZCASH_TXREJECTCACHE_H
+
+#include "cachestats.h"
+#include "coins.h"
+#include "sync.h"
+#include "uint256.h"
+
+#include <optional>
+#include <unordered_map>
+#include <vector>
+
+//! The default memory budget of the cache of invalid transactions, in megabytes.
+static const int64_t DEFAULT_MAX_REJECT_MEMORY = 8;
+
+/**
+ * The transactions that were rejected for reasons that do not depend on the
+ * chain tip or the mempool, such as a proof or signature that does not
+ * verify, with their reject codes. Unlike the filter of recent rejects, it is
+ * not cleared when the tip changes, so that the same invalid transaction is
+ * not downloaded and checked again after each block.
+ *
+ * Signatures and proofs commit to the consensus branch ID, so the cache is
+ * cleared when the branch ID of the next block changes.
+ *
+ * Entries are keyed by a hash of the wtxid, and the oldest are evicted first
+ * once the cache holds as many as fit in its memory budget.
+ */
+class CTxRejectCache
+{
+private:
+    mutable Mutex cs;
+    const size_t nMaxEntries;
+    //! The reject code of each transaction, by the hash of its wtxid.
+    std::unordered_map<uint256, unsigned char, SaltedTxidHasher> mapRejects GUARDED_BY(cs);
+    //! The keys of mapRejects in the order they were added. Once it is full
+    //! it is used as a ring, whose oldest key is at nNext.
+    std::vector<uint256> vKeys GUARDED_BY(cs);
+    size_t nNext GUARDED_BY(cs) = 0;
+    //! The consensus branch ID the transactions were rejected under.
+    uint32_t nBranchId GUARDED_BY(cs) = 0;
+    CCacheStats stats GUARDED_BY(cs);
+
+    static uint256 Key(const std::vector<unsigned char>& vWideHash);
+    void SetBranchId(uint32_t nBranchIdIn) EXCLUSIVE_LOCKS_REQUIRED(cs);
+
+public:
+    explicit CTxRejectCache(size_t nMaxUsage);
+
+    //! The memory one entry uses, which the memory budget is divided by.
+    static size_t EntryUsage();
+
+    /**
+     * Record that the transaction with the given wide hash (its txid and
+     * auth digest) was rejected with the given code under the consensus
+     * branch ID of the next block.
+     */
+    void Add(const std::vector<unsigned char>& vWideHash, unsigned char chRejectCode, uint32_t nBranchIdIn);
+
+    //! Whether the transaction was rejected under this consensus branch ID.
+    bool Contains(const std::vector<unsigned char>& vWideHash, uint32_t nBranchIdIn);
+
+    //! The code the transaction was rejected with, if it was, without
+    //! counting the lookup in the statistics.
+    std::optional<unsigned char> GetRejectCode(const std::vector<unsigned char>& vWideHash, uint32_t nBranchIdIn) const;
+
+    CCacheStats GetStats() const;
+};
+
+#endif // ZCASH_TXREJECTCACHE_H
@@ -0,0 +1,103 @@
+// Copyright (c) 2026 The Zcash developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or https://www.opensource.org/licenses/mit-license.php .
+
+#if defined(HAVE_CONFIG_H)
+#include "config/bitcoin-config.h"
+#endif
+
+#include "util/allocator.h"
+
+#include <stdint.h>
+#include <string>
+
+#if defined(USE_JEMALLOC)
+#include <jemalloc/jemalloc.h>
+#elif (defined(HAVE_DECL_MALLOPT) && HAVE_DECL_MALLOPT) || \
+    (defined(HAVE_DECL_MALLOC_TRIM) && HAVE_DECL_MALLOC_TRIM) || \
+    (defined(HAVE_DECL_MALLINFO2) && HAVE_DECL_MALLINFO2)
+#include <malloc.h>
+#endif
+
+#if defined(USE_JEMALLOC)
+
+const char* GetAllocatorName()
+{
+    return "jemalloc";
+}
+
+bool SetAllocatorArenas(int nArenas)
+{
+    // jemalloc only reads its number of arenas from its configuration at
+    // startup, e.g. MALLOC_CONF=narenas:<n>.
+    return nArenas == DEFAULT_MALLOC_ARENAS;
+}
+
+void PurgeAllocator()
+{
+    std::string name = "arena." + std::to_string(MALLCTL_ARENAS_ALL) + ".purge";
+    mallctl(name.c_str(), nullptr, nullptr, nullptr, 0);
+}
+
+std::optional<AllocatorStats> GetAllocatorStats()
+{
+    // The statistics are only brought up to date when the epoch is advanced.
+    uint64_t epoch = 1;
+    size_t nLen = sizeof(epoch);
+    if (mallctl("epoch", &epoch, &nLen, &epoch, nLen) != 0) {
+        return std::nullopt;
+    }
+    AllocatorStats stats;
+    nLen = sizeof(size_t);
+    if (mallctl("stats.allocated", &stats.nAllocated, &nLen, nullptr, 0) != 0 ||
+        mallctl("stats.resident", &stats.nHeld, &nLen, nullptr, 0) != 0) {
+        return std::nullopt;
+    }
+    return stats;
+}
+
+#else
+
+const char* GetAllocatorName()
+{
+#if defined(__GLIBC__)
+    return "glibc";
+#else
+    return "system";
+#endif
+}
+
+bool SetAllocatorArenas(int nArenas)
+{
+    if (nArenas == DEFAULT_MALLOC_ARENAS) {
+        return true;
+    }
+#if defined(HAVE_DECL_MALLOPT) && HAVE_DECL_MALLOPT && defined(M_ARENA_MAX)
+    return mallopt(M_ARENA_MAX, nArenas) == 1;
+#else
+    return false;
+#endif
+}
+
+void PurgeAllocator()
+{
+#if defined(HAVE_DECL_MALLOC_TRIM) && HAVE_DECL_MALLOC_TRIM
+    malloc_trim(0);
+#endif
+}
+
+std::optional<AllocatorStats> GetAllocatorStats()
+{
+#if defined(HAVE_DECL_MALLINFO2) && HAVE_DECL_MALLINFO2
+    struct mallinfo2 info = mallinfo2();
+    AllocatorStats stats;
+    // Large blocks are mapped separately, outside of the arenas.
+    stats.nAllocated = info.uordblks + info.hblkhd;
+    stats.nHeld = info.arena + info.hblkhd;
+    return stats;
+#else
+    return std::nullopt;
+#endif
+}
+
+#endif
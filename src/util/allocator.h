@@ -0,0 +1,41 @@
+// Copyright (c) 2026 The Zcash developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or https://www.opensource.org/licenses/mit-license.php .
+
+#ifndef ZCASH_UTIL_ALLOCATOR_H
+#define ZCASH_UTIL_ALLOCATOR_H
+
+#include <optional>
+#include <stddef.h>
+
+//! -mallocarenas default: leave the number of arenas to the allocator.
+static const int DEFAULT_MALLOC_ARENAS = 0;
+//! -mallocpurge default
+static const bool DEFAULT_MALLOC_PURGE = true;
+
+/** What the heap allocator reports about the memory it manages. */
+struct AllocatorStats
+{
+    //! Bytes in blocks that are allocated and not yet freed.
+    size_t nAllocated;
+    //! Bytes that the allocator has obtained from the operating system and
+    //! not returned, including those of free blocks.
+    size_t nHeld;
+};
+
+//! The name of the heap allocator that this binary uses.
+const char* GetAllocatorName();
+
+//! Limit the number of arenas that the heap allocator spreads threads over.
+//! Must be called before threads are started. Returns false if the
+//! allocator cannot be configured.
+bool SetAllocatorArenas(int nArenas);
+
+//! Return as much of the free memory held by the heap allocator to the
+//! operating system as it allows.
+void PurgeAllocator();
+
+//! The allocator's statistics, if it is able to report them.
+std::optional<AllocatorStats> GetAllocatorStats();
+
+#endif // ZCASH_UTIL_ALLOCATOR_H
@@ -40,6 +40,7 @@
 
 #include <algorithm>
 #include <fcntl.h>
+#include <sched.h>
 #include <sys/resource.h>
 #include <sys/stat.h>
 
@@ -67,6 +68,9 @@
 #include <boost/algorithm/string/case_conv.hpp> // for to_lower()
 #include <boost/algorithm/string/join.hpp>
 #include <boost/algorithm/string/predicate.hpp> // for startswith() and endswith()
+#include <boost/algorithm/string/classification.hpp>
+#include <boost/algorithm/string/split.hpp>
+#include <boost/algorithm/string/trim.hpp>
 #include <boost/program_options/detail/config_file.hpp>
 #include <boost/program_options/parsers.hpp>
 #include <boost/thread.hpp>
@@ -676,6 +680,53 @@ int GetNumCores()
     return boost::thread::physical_concurrency();
 }
 
+bool ParseCPUList(const std::string& str, std::vector<int>& vCPUs)
+{
+    vCPUs.clear();
+    std::vector<std::string> vRanges;
+    boost::split(vRanges, str, boost::is_any_of(","));
+    for (std::string strRange : vRanges) {
+        boost::trim(strRange);
+        if (strRange.empty())
+            continue;
+        size_t nDash = strRange.find('-');
+        int32_t nFirst, nLast;
+        if (!ParseInt32(strRange.substr(0, nDash), &nFirst) || nFirst < 0)
+            return false;
+        nLast = nFirst;
+        if (nDash != std::string::npos && (!ParseInt32(strRange.substr(nDash + 1), &nLast) || nLast < nFirst))
+            return false;
+        for (int n = nFirst; n <= nLast; n++)
+            vCPUs.push_back(n);
+    }
+    return true;
+}
+
+int BindToNumaNode(int nNode)
+{
+#ifdef __linux__
+    if (nNode < 0)
+        return 0;
+    fs::ifstream file(strprintf("/sys/devices/system/node/node%d/cpulist", nNode));
+    std::string strCPUs;
+    std::vector<int> vCPUs;
+    if (!std::getline(file, strCPUs) || !ParseCPUList(strCPUs, vCPUs) || vCPUs.empty())
+        return 0;
+
+    cpu_set_t cpus;
+    CPU_ZERO(&cpus);
+    for (int nCPU : vCPUs) {
+        if (nCPU < CPU_SETSIZE)
+            CPU_SET(nCPU, &cpus);
+    }
+    if (sched_setaffinity(0, sizeof(cpus), &cpus) != 0)
+        return 0;
+    return CPU_COUNT(&cpus);
+#else
+    return 0;
+#endif
+}
+
 fs::path AbsPathForConfigVal(const fs::path& path, bool net_specific)
 {
     return fs::absolute(path, GetDataDir(net_specific));
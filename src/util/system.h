@@ -195,6 +195,21 @@ std::string HelpMessageOpt(const std::string& option, const std::string& message
  */
 int GetNumCores();
 
+/**
+ * Parse a Linux CPU list such as "0-3,8,10-11" into the CPU numbers it
+ * names. Returns false if it is malformed.
+ */
+bool ParseCPUList(const std::string& str, std::vector<int>& vCPUs);
+
+/**
+ * Restrict the calling thread, and so the threads it starts afterwards, to
+ * the CPUs of a NUMA node. Under the default first-touch policy, the memory
+ * these threads allocate is then placed on that node as well. Returns the
+ * number of CPUs of the node, or 0 if binding is not possible. Only
+ * supported on Linux.
+ */
+int BindToNumaNode(int nNode);
+
 void SetThreadPriority(int nPriority);
 void RenameThread(const char* name);
 
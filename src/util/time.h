@@ -98,6 +98,13 @@ int64_t GetTime();
 int64_t GetTimeMillis();
 int64_t GetTimeMicros();
 
+/**
+ * Returns the CPU time consumed by the calling thread in microseconds, or 0
+ * if the platform cannot measure it. Unlike the functions above this is not
+ * affected by the node clock, so it is only meaningful as a difference.
+ */
+int64_t GetThreadCPUTimeMicros();
+
 void MilliSleep(int64_t n);
 
 std::string DateTimeStrFormat(const char* pszFormat, int64_t nTime);
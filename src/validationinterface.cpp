@@ -7,10 +7,12 @@
 #include "validationinterface.h"
 
 #include "chainparams.h"
+#include "core_memusage.h"
 #include "init.h"
 #include "main.h"
 #include "txmempool.h"
 #include "ui_interface.h"
+#include "util/time.h"
 
 #include <boost/thread.hpp>
 
@@ -24,6 +26,7 @@ using namespace boost::placeholders;
 static CMainSignals g_signals;
 
 static constexpr const char* METRIC_WALLET_SYNCED_HEIGHT = "zcashd.wallet.synced.block.height";
+static constexpr const char* METRIC_WALLET_NOTIFY_SECONDS = "zcashd.wallet.notify.block.seconds";
 
 CMainSignals& GetMainSignals()
 {
@@ -32,6 +35,8 @@ CMainSignals& GetMainSignals()
 
 void RegisterValidationInterface(CValidationInterface* pwalletIn) {
     g_signals.UpdatedBlockTip.connect(boost::bind(&CValidationInterface::UpdatedBlockTip, pwalletIn, _1));
+    g_signals.BlockConnected.connect(boost::bind(&CValidationInterface::BlockConnected, pwalletIn, _1));
+    g_signals.BlockDisconnected.connect(boost::bind(&CValidationInterface::BlockDisconnected, pwalletIn, _1));
     g_signals.GetBatchScanner.connect(boost::bind(&CValidationInterface::GetBatchScanner, pwalletIn));
     g_signals.SyncTransaction.connect(boost::bind(&CValidationInterface::SyncTransaction, pwalletIn, _1, _2, _3));
     g_signals.EraseTransaction.connect(boost::bind(&CValidationInterface::EraseFromWallet, pwalletIn, _1));
@@ -51,6 +56,8 @@ void UnregisterValidationInterface(CValidationInterface* pwalletIn) {
     g_signals.EraseTransaction.disconnect(boost::bind(&CValidationInterface::EraseFromWallet, pwalletIn, _1));
     g_signals.SyncTransaction.disconnect(boost::bind(&CValidationInterface::SyncTransaction, pwalletIn, _1, _2, _3));
     g_signals.GetBatchScanner.disconnect(boost::bind(&CValidationInterface::GetBatchScanner, pwalletIn));
+    g_signals.BlockDisconnected.disconnect(boost::bind(&CValidationInterface::BlockDisconnected, pwalletIn, _1));
+    g_signals.BlockConnected.disconnect(boost::bind(&CValidationInterface::BlockConnected, pwalletIn, _1));
     g_signals.UpdatedBlockTip.disconnect(boost::bind(&CValidationInterface::UpdatedBlockTip, pwalletIn, _1));
 }
 
@@ -63,6 +70,8 @@ void UnregisterAllValidationInterfaces() {
     g_signals.EraseTransaction.disconnect_all_slots();
     g_signals.SyncTransaction.disconnect_all_slots();
     g_signals.GetBatchScanner.disconnect_all_slots();
+    g_signals.BlockDisconnected.disconnect_all_slots();
+    g_signals.BlockConnected.disconnect_all_slots();
     g_signals.UpdatedBlockTip.disconnect_all_slots();
 }
 
@@ -72,11 +81,8 @@ void AddTxToBatches(
     const uint256 &blockTag,
     const int nHeight)
 {
-    CDataStream ssTx(SER_NETWORK, PROTOCOL_VERSION);
-    ssTx << tx;
-    std::vector<unsigned char> txBytes(ssTx.begin(), ssTx.end());
     for (auto& batchScanner : batchScanners) {
-        batchScanner->AddTransaction(tx, txBytes, blockTag, nHeight);
+        batchScanner->AddTransaction(tx, blockTag, nHeight);
     }
 }
 
@@ -101,12 +107,16 @@ void SyncWithWallets(
 struct CachedBlockData {
     CBlockIndex *pindex;
     MerkleFrontiers oldTrees;
-    std::list<CTransaction> txConflicted;
+    std::list<CTransactionRef> txConflicted;
+    // The block, if it was kept after being staged for scanning, and the
+    // memory it uses.
+    std::shared_ptr<const CBlock> pblock;
+    size_t nBlockUsage{0};
 
     CachedBlockData(
         CBlockIndex *pindex,
         MerkleFrontiers oldTrees,
-        std::list<CTransaction> txConflicted):
+        std::list<CTransactionRef> txConflicted):
         pindex(pindex), oldTrees(oldTrees), txConflicted(txConflicted) {}
 };
 
@@ -133,6 +143,9 @@ void ThreadNotifyWallets(CBlockIndex *pindexLastTip)
 
         boost::this_thread::interruption_point();
 
+        auto span = TracingSpan("debug", "bench", "ThreadNotifyWallets");
+        auto spanGuard = span.Enter();
+
         auto chainParams = Params();
 
         //
@@ -315,11 +328,14 @@ void ThreadNotifyWallets(CBlockIndex *pindexLastTip)
         // for example to add new incoming viewing keys.
         auto batchScanners = GetMainSignals().GetBatchScanner();
 
+        // Memory used by the blocks kept in blockStack.
+        size_t nHeldBlocksUsage = 0;
+
         // Closure that will add a block from blockStack to batchScanners.
-        auto batchScanConnectedBlock = [&](const CachedBlockData& blockData) {
-            // Read block from disk.
-            CBlock block;
-            if (!ReadBlockFromDisk(block, blockData.pindex, chainParams.GetConsensus())) {
+        auto batchScanConnectedBlock = [&](CachedBlockData& blockData) {
+            // Read block from disk, unless it was connected recently.
+            std::shared_ptr<const CBlock> pblock;
+            if (!ReadBlockFromDisk(pblock, blockData.pindex, chainParams.GetConsensus())) {
                 LogPrintf(
                         "*** %s: Failed to read block %s while collecting shielded outputs from block connects",
                         __func__, blockData.pindex->GetBlockHash().GetHex());
@@ -329,12 +345,21 @@ void ThreadNotifyWallets(CBlockIndex *pindexLastTip)
                 StartShutdown();
                 return;
             }
+            const CBlock& block = *pblock;
+
+            // Keep the block until it is notified, if there is room.
+            size_t nBlockUsage = RecursiveDynamicUsage(block);
+            if (nHeldBlocksUsage + nBlockUsage <= WALLET_NOTIFY_MAX_HELD_BLOCKS_USAGE) {
+                blockData.pblock = pblock;
+                blockData.nBlockUsage = nBlockUsage;
+                nHeldBlocksUsage += nBlockUsage;
+            }
 
             // Batch transactions that went from mempool to conflicted:
-            for (const CTransaction &tx : blockData.txConflicted) {
+            for (const CTransactionRef &ptx : blockData.txConflicted) {
                 AddTxToBatches(
                     batchScanners,
-                    tx,
+                    *ptx,
                     blockData.pindex->GetBlockHash(),
                     blockData.pindex->nHeight + 1);
             }
@@ -406,7 +431,7 @@ void ThreadNotifyWallets(CBlockIndex *pindexLastTip)
             // We process blockStack in the same order we do below, so batched
             // work can be completed in roughly the order we need it.
             for (; blockStackScanned != blockStack.rend(); ++blockStackScanned) {
-                const auto& blockData = *blockStackScanned;
+                auto& blockData = *blockStackScanned;
                 batchScanConnectedBlock(blockData);
             }
 
@@ -463,7 +488,7 @@ void ThreadNotifyWallets(CBlockIndex *pindexLastTip)
             // again. At this point, we know that blockStackScanned has not been
             // invalidated by mutations to blockStack, and can be dereferenced.
             for (; blockStackScanned != blockStack.rend(); ++blockStackScanned) {
-                const auto& blockData = *blockStackScanned;
+                auto& blockData = *blockStackScanned;
                 batchScanConnectedBlock(blockData);
             }
 
@@ -484,9 +509,12 @@ void ThreadNotifyWallets(CBlockIndex *pindexLastTip)
             )) {
                 auto& blockData = blockStack.back();
 
-                // Read block from disk.
-                CBlock block;
-                if (!ReadBlockFromDisk(block, blockData.pindex, chainParams.GetConsensus())) {
+                // Use the block kept when it was staged, or read it from disk
+                // again, unless it was connected recently.
+                std::shared_ptr<const CBlock> pblock = std::move(blockData.pblock);
+                if (pblock) {
+                    nHeldBlocksUsage -= blockData.nBlockUsage;
+                } else if (!ReadBlockFromDisk(pblock, blockData.pindex, chainParams.GetConsensus())) {
                     LogPrintf(
                             "*** %s: Failed to read block %s while notifying wallets of block connects",
                             __func__, blockData.pindex->GetBlockHash().GetHex());
@@ -496,11 +524,13 @@ void ThreadNotifyWallets(CBlockIndex *pindexLastTip)
                     StartShutdown();
                     return;
                 }
+                const CBlock& block = *pblock;
+                int64_t nTimeNotify = GetTimeMicros();
 
                 // Tell wallet about transactions that went from mempool
                 // to conflicted:
-                for (const CTransaction &tx : blockData.txConflicted) {
-                    SyncWithWallets(batchScanners, tx, NULL, blockData.pindex->nHeight + 1);
+                for (const CTransactionRef &ptx : blockData.txConflicted) {
+                    SyncWithWallets(batchScanners, *ptx, NULL, blockData.pindex->nHeight + 1);
                 }
                 // ... and about transactions that got confirmed:
                 for (const CTransaction &tx : block.vtx) {
@@ -521,6 +551,7 @@ void ThreadNotifyWallets(CBlockIndex *pindexLastTip)
                 // This block is done!
                 pindexLastTip = blockData.pindex;
                 MetricsGauge(METRIC_WALLET_SYNCED_HEIGHT, pindexLastTip->nHeight);
+                MetricsHistogram(METRIC_WALLET_NOTIFY_SECONDS, (GetTimeMicros() - nTimeNotify) * 0.000001);
                 assert(blockStack.rbegin() != blockStackScanned);
                 blockStack.pop_back();
             }
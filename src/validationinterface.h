@@ -21,6 +21,13 @@
  */
 static const size_t WALLET_NOTIFY_MAX_BLOCKS = 1000;
 
+/**
+ * Limit on the memory used by blocks that are kept between being staged for
+ * scanning and being notified, so that they are not read from disk twice.
+ * Blocks beyond this are read again when they are notified.
+ */
+static const size_t WALLET_NOTIFY_MAX_HELD_BLOCKS_USAGE = 128 << 20;
+
 class CBlock;
 class CBlockIndex;
 struct CBlockLocator;
@@ -38,10 +45,12 @@ public:
      * `block_tag` is the hash of the block that triggered this txid being added
      * to the batch, or the all-zeros hash to indicate that no block triggered
      * it (i.e. it was a mempool change).
+     *
+     * Scanners that need the serialized transaction serialize it themselves,
+     * so that transactions with nothing for them to scan are not serialized.
      */
     virtual void AddTransaction(
         const CTransaction &tx,
-        const std::vector<unsigned char> &txBytes,
         const uint256 &blockTag,
         const int nHeight) = 0;
 
@@ -85,6 +94,8 @@ void UnregisterAllValidationInterfaces();
 class CValidationInterface {
 protected:
     virtual void UpdatedBlockTip(const CBlockIndex *pindex) {}
+    virtual void BlockConnected(const CBlockIndex *pindex) {}
+    virtual void BlockDisconnected(const CBlockIndex *pindex) {}
     virtual BatchScanner* GetBatchScanner() { return nullptr; }
     virtual void SyncTransaction(const CTransaction &tx, const CBlock *pblock, const int nHeight) {}
     virtual void EraseFromWallet(const uint256 &hash) {}
@@ -124,6 +135,19 @@ struct aggregate_non_null_values
 struct CMainSignals {
     /** Notifies listeners of updated block chain tip */
     boost::signals2::signal<void (const CBlockIndex *)> UpdatedBlockTip;
+    /**
+     * Notifies listeners, with cs_main held, of a block being connected to
+     * the active chain. It is signalled after the block's transactions and
+     * conflicts have left the mempool, in the same order as the mempool's
+     * NotifyEntryAdded and NotifyEntryRemoved signals.
+     */
+    boost::signals2::signal<void (const CBlockIndex *)> BlockConnected;
+    /**
+     * Notifies listeners, with cs_main held, of a block being disconnected
+     * from the active chain. It is signalled before the block's transactions
+     * are returned to the mempool.
+     */
+    boost::signals2::signal<void (const CBlockIndex *)> BlockDisconnected;
     /**
      * Requests a pointer to the listener's batch scanner for shielded outputs,
      * if it has one.
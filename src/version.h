@@ -10,7 +10,7 @@
  * network protocol versioning
  */
 
-static const int PROTOCOL_VERSION = 170140;
+static const int PROTOCOL_VERSION = 170180;
 
 //! initial proto version, to be increased after version/verack negotiation
 static const int INIT_PROTO_VERSION = 209;
@@ -33,6 +33,19 @@ static const int NO_BLOOM_VERSION = 170004;
 //! - MSG_WTX type defined, which contains two 32-byte hashes.
 static const int CINV_WTX_VERSION = 170014;
 
+//! "feefilter" tells peers to filter invs to you by fee and unpaid actions,
+//! starting with this version
+static const int FEEFILTER_VERSION = 170150;
+
+//! short-id-based block download starts with this version
+static const int SHORT_IDS_BLOCKS_VERSION = 170160;
+
+//! "sendheaders" command and announcing blocks with headers starts with this version
+static const int SENDHEADERS_VERSION = 170170;
+
+//! "sendtxrcncl" and transaction reconciliation start with this version
+static const int TXRECONCILIATION_VERSION = 170180;
+
 //! disconnect from testnet peers older than this proto version
 static const int MIN_TESTNET_PEER_PROTO_VERSION = 170040;
 
@@ -0,0 +1,233 @@
+#include "assert.h"
+#include "asyncrpcoperation_saplingconsolidation.h"
+#include "init.h"
+#include "key_io.h"
+#include "rpc/protocol.h"
+#include "sync.h"
+#include "tinyformat.h"
+#include "transaction_builder.h"
+#include "util/system.h"
+#include "util/moneystr.h"
+#include "wallet.h"
+
+#include <algorithm>
+#include <map>
+#include <optional>
+#include <zip317.h>
+
+const int CONSOLIDATION_EXPIRY_DELTA = 40;
+
+AsyncRPCOperation_saplingconsolidation::AsyncRPCOperation_saplingconsolidation(int targetHeight) :
+    targetHeight_(targetHeight) {}
+
+AsyncRPCOperation_saplingconsolidation::~AsyncRPCOperation_saplingconsolidation() {}
+
+void AsyncRPCOperation_saplingconsolidation::main() {
+    if (isCancelled())
+        return;
+
+    set_state(OperationStatus::EXECUTING);
+    start_execution_clock();
+
+    bool success = false;
+
+    try {
+        success = main_impl();
+    } catch (const UniValue& objError) {
+        int code = find_value(objError, "code").get_int();
+        std::string message = find_value(objError, "message").get_str();
+        set_error_code(code);
+        set_error_message(message);
+    } catch (const runtime_error& e) {
+        set_error_code(-1);
+        set_error_message("runtime error: " + string(e.what()));
+    } catch (const logic_error& e) {
+        set_error_code(-1);
+        set_error_message("logic error: " + string(e.what()));
+    } catch (const exception& e) {
+        set_error_code(-1);
+        set_error_message("general exception: " + string(e.what()));
+    } catch (...) {
+        set_error_code(-2);
+        set_error_message("unknown error");
+    }
+
+    stop_execution_clock();
+
+    if (success) {
+        set_state(OperationStatus::SUCCESS);
+    } else {
+        set_state(OperationStatus::FAILED);
+    }
+
+    std::string s = strprintf("%s: Sapling consolidation transactions created. (status=%s", getId(), getStateAsString());
+    if (success) {
+        s += strprintf(", success)\n");
+    } else {
+        s += strprintf(", error=%s)\n", getErrorMessage());
+    }
+
+    LogPrintf("%s", s);
+}
+
+bool AsyncRPCOperation_saplingconsolidation::main_impl() {
+    LogPrint("zrpcunsafe", "%s: Beginning AsyncRPCOperation_saplingconsolidation.\n", getId());
+    const Consensus::Params& consensusParams = Params().GetConsensus();
+    auto nextActivationHeight = NextActivationHeight(targetHeight_, consensusParams);
+    if (nextActivationHeight && targetHeight_ + CONSOLIDATION_EXPIRY_DELTA >= nextActivationHeight.value()) {
+        LogPrint("zrpcunsafe", "%s: Consolidation txs would be created before a NU activation but may expire after. Skipping this round.\n", getId());
+        setConsolidationResult(0, 0, 0, std::vector<std::string>());
+        return true;
+    }
+
+    // Only notes that are in the tree at the anchor can be spent, so ask for
+    // the same depth as the anchor.
+    std::vector<SproutNoteEntry> sproutEntries;
+    std::vector<SaplingNoteEntry> saplingEntries;
+    std::vector<OrchardNoteMetadata> orchardEntries;
+    {
+        LOCK2(cs_main, pwalletMain->cs_wallet);
+        pwalletMain->GetFilteredNotes(sproutEntries, saplingEntries, orchardEntries, std::nullopt, std::nullopt, nAnchorConfirmations);
+    }
+
+    // Notes are only merged with notes spendable by the same key, so that
+    // the transactions do not link the keys of the wallet to each other.
+    std::map<libzcash::SaplingIncomingViewingKey, std::vector<SaplingNoteEntry>> mapNotesByIvk;
+    for (const SaplingNoteEntry& saplingEntry : saplingEntries) {
+        libzcash::SaplingIncomingViewingKey ivk;
+        if (pwalletMain->GetSaplingIncomingViewingKey(saplingEntry.address, ivk)) {
+            mapNotesByIvk[ivk].push_back(saplingEntry);
+        }
+    }
+
+    int numTxCreated = 0;
+    CAmount amountConsolidated = 0;
+    CAmount feePaid = 0;
+    std::vector<std::string> consolidationTxIds;
+    bool fDone = false;
+    for (auto& [ivk, notes] : mapNotesByIvk) {
+        if (fDone) {
+            break;
+        }
+        if (notes.size() < MIN_CONSOLIDATION_NOTES) {
+            continue;
+        }
+        // The smallest notes are merged first, as they cost the most to
+        // spend relative to their value.
+        std::sort(notes.begin(), notes.end(), [](const SaplingNoteEntry& a, const SaplingNoteEntry& b) {
+            return a.note.value() < b.note.value();
+        });
+
+        libzcash::SaplingExtendedSpendingKey extsk;
+        if (!pwalletMain->GetSaplingExtendedSpendingKey(notes[0].address, extsk)) {
+            continue;
+        }
+        uint256 ovk = extsk.ToXFVK().GetOVKs().first;
+
+        for (size_t nStart = 0; nStart + MIN_CONSOLIDATION_NOTES <= notes.size(); nStart += nConsolidationMaxNotes) {
+            if (isCancelled()) {
+                LogPrint("zrpcunsafe", "%s: Canceled. Stopping.\n", getId());
+                fDone = true;
+                break;
+            }
+            if (numTxCreated >= (int)nConsolidationMaxTxs) {
+                fDone = true;
+                break;
+            }
+
+            std::vector<SaplingNoteEntry> fromNotes(
+                notes.begin() + nStart,
+                notes.begin() + std::min(notes.size(), nStart + nConsolidationMaxNotes));
+            // The outputs are padded to 2, so the fee is set by the spends.
+            CAmount fee = CalculateConventionalFee(std::max(fromNotes.size(), (size_t)2));
+            if (feePaid + fee > nConsolidationFeeBudget) {
+                LogPrint("zrpcunsafe", "%s: Fee budget (%s) reached. Stopping.\n", getId(), FormatMoney(nConsolidationFeeBudget));
+                fDone = true;
+                break;
+            }
+            CAmount fromNoteAmount = 0;
+            std::vector<SaplingOutPoint> vOutPoints;
+            for (const SaplingNoteEntry& saplingEntry : fromNotes) {
+                fromNoteAmount += saplingEntry.note.value();
+                vOutPoints.push_back(saplingEntry.op);
+            }
+            if (fromNoteAmount <= fee) {
+                continue;
+            }
+
+            uint256 saplingAnchor;
+            std::vector<std::optional<SaplingWitness>> vInputWitnesses;
+            if (!pwalletMain->GetSaplingNoteWitnesses(vOutPoints, nAnchorConfirmations, vInputWitnesses, saplingAnchor)) {
+                // This error should not appear once we're nAnchorConfirmations blocks past
+                // Sapling activation.
+                throw JSONRPCError(RPC_WALLET_ERROR, "Insufficient Sapling witnesses.");
+            }
+
+            auto builder = TransactionBuilder(
+                Params(),
+                targetHeight_,
+                std::nullopt,
+                saplingAnchor,
+                pwalletMain);
+            builder.SetExpiryHeight(targetHeight_ + CONSOLIDATION_EXPIRY_DELTA);
+            builder.SetFee(fee);
+            LogPrint("zrpcunsafe", "%s: Beginning creating transaction with %d Sapling spends and output amount=%s\n",
+                getId(), fromNotes.size(), FormatMoney(fromNoteAmount - fee));
+            for (size_t i = 0; i < fromNotes.size(); i++) {
+                if (!vInputWitnesses[i].has_value()) {
+                    throw JSONRPCError(RPC_WALLET_ERROR, "Missing witness for Sapling note");
+                }
+                builder.AddSaplingSpend(extsk, fromNotes[i].note, vInputWitnesses[i].value());
+            }
+            // Send the merged note to the address of the first input.
+            builder.AddSaplingOutput(ovk, fromNotes[0].address, fromNoteAmount - fee, std::nullopt);
+            CTransaction tx = builder.Build().GetTxOrThrow();
+            if (isCancelled()) {
+                LogPrint("zrpcunsafe", "%s: Canceled. Stopping.\n", getId());
+                fDone = true;
+                break;
+            }
+
+            CWalletTx wtx(pwalletMain, tx);
+            CValidationState state;
+            if (!pwalletMain->CommitTransaction(wtx, std::nullopt, state)) {
+                throw JSONRPCError(RPC_WALLET_ERROR, strprintf("The consolidation transaction was rejected! Reason given: %s", state.GetRejectReason()));
+            }
+            LogPrint("zrpcunsafe", "%s: Committed consolidation transaction with txid=%s\n", getId(), tx.GetHash().ToString());
+            ++numTxCreated;
+            amountConsolidated += fromNoteAmount - fee;
+            feePaid += fee;
+            consolidationTxIds.push_back(tx.GetHash().ToString());
+        }
+    }
+
+    LogPrint("zrpcunsafe", "%s: Created %d transactions with total Sapling output amount=%s and fee=%s\n",
+        getId(), numTxCreated, FormatMoney(amountConsolidated), FormatMoney(feePaid));
+    setConsolidationResult(numTxCreated, amountConsolidated, feePaid, consolidationTxIds);
+    return true;
+}
+
+void AsyncRPCOperation_saplingconsolidation::setConsolidationResult(int numTxCreated, const CAmount& amountConsolidated, const CAmount& feePaid, const std::vector<std::string>& consolidationTxIds) {
+    UniValue res(UniValue::VOBJ);
+    res.pushKV("num_tx_created", numTxCreated);
+    res.pushKV("amount_consolidated", FormatMoney(amountConsolidated));
+    res.pushKV("fee", FormatMoney(feePaid));
+    UniValue txIds(UniValue::VARR);
+    for (const std::string& txId : consolidationTxIds) {
+        txIds.push_back(txId);
+    }
+    res.pushKV("consolidation_txids", txIds);
+    set_result(res);
+}
+
+void AsyncRPCOperation_saplingconsolidation::cancel() {
+    set_state(OperationStatus::CANCELLED);
+}
+
+UniValue AsyncRPCOperation_saplingconsolidation::getStatus() const {
+    UniValue v = AsyncRPCOperation::getStatus();
+    UniValue obj = v.get_obj();
+    obj.pushKV("method", "saplingconsolidation");
+    obj.pushKV("target_height", targetHeight_);
+    return obj;
+}
@@ -0,0 +1,42 @@
+#ifndef ZCASH_WALLET_ASYNCRPCOPERATION_SAPLINGCONSOLIDATION_H
+#define ZCASH_WALLET_ASYNCRPCOPERATION_SAPLINGCONSOLIDATION_H
+
+#include "amount.h"
+#include "asyncrpcoperation.h"
+#include "univalue.h"
+#include "zcash/Address.hpp"
+
+/**
+ * Merges the Sapling notes of each spending key into fewer, larger notes,
+ * so that later spends from the wallet need fewer actions. Started by the
+ * wallet in the background (-consolidation); each run is bounded by the
+ * number of notes spent per transaction, the number of transactions and the
+ * total fee it may pay.
+ */
+class AsyncRPCOperation_saplingconsolidation : public AsyncRPCOperation
+{
+public:
+    AsyncRPCOperation_saplingconsolidation(int targetHeight);
+    virtual ~AsyncRPCOperation_saplingconsolidation();
+
+    // We don't want to be copied or moved around
+    AsyncRPCOperation_saplingconsolidation(AsyncRPCOperation_saplingconsolidation const&) = delete;            // Copy construct
+    AsyncRPCOperation_saplingconsolidation(AsyncRPCOperation_saplingconsolidation&&) = delete;                 // Move construct
+    AsyncRPCOperation_saplingconsolidation& operator=(AsyncRPCOperation_saplingconsolidation const&) = delete; // Copy assign
+    AsyncRPCOperation_saplingconsolidation& operator=(AsyncRPCOperation_saplingconsolidation&&) = delete;      // Move assign
+
+    virtual void main();
+
+    virtual void cancel();
+
+    virtual UniValue getStatus() const;
+
+private:
+    int targetHeight_;
+
+    bool main_impl();
+
+    void setConsolidationResult(int numTxCreated, const CAmount& amountConsolidated, const CAmount& feePaid, const std::vector<std::string>& consolidationTxIds);
+};
+
+#endif // ZCASH_WALLET_ASYNCRPCOPERATION_SAPLINGCONSOLIDATION_H
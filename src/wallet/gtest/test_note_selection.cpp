@@ -500,3 +500,43 @@ INSTANTIATE_TEST_SUITE_P(
         std::make_tuple(SET_TSO,    SET_TSO, std::vector({VEC_S, VEC_SO, VEC_TSO}))  // Opportunistic migration, hide sender, opportunistic shielding
     )
 );
+
+TEST(NoteSelectionTest, SelectsFewestNotes)
+{
+    auto makeInputs = [](std::vector<CAmount> values) {
+        SpendableInputs inputs;
+        for (auto value : values) {
+            SaplingOutPoint op;
+            libzcash::SaplingPaymentAddress address;
+            libzcash::SaplingNote note(address, value, libzcash::Zip212Enabled::AfterZip212);
+            inputs.saplingNoteEntries.push_back(SaplingNoteEntry{
+                op, address, note, {}, 100});
+        }
+        return inputs;
+    };
+
+    // A single note is enough, and the smallest one that is enough is
+    // spent. Spending the 6 zatoshi note would leave dust change.
+    auto inputs = makeInputs({3, 100, 6, 50});
+    EXPECT_TRUE(inputs.LimitToAmount(5, 1, SET_S));
+    ASSERT_EQ(inputs.saplingNoteEntries.size(), 1);
+    EXPECT_EQ(inputs.Total(), 50);
+
+    // Two notes are needed. The largest is spent, with the smallest note
+    // that makes up the rest.
+    inputs = makeInputs({3, 100, 6, 50});
+    EXPECT_TRUE(inputs.LimitToAmount(104, 1, SET_S));
+    EXPECT_EQ(inputs.saplingNoteEntries.size(), 2);
+    EXPECT_EQ(inputs.Total(), 106);
+
+    // An exact match leaves no change.
+    inputs = makeInputs({3, 100, 6, 50});
+    EXPECT_TRUE(inputs.LimitToAmount(103, 1, SET_S));
+    EXPECT_EQ(inputs.saplingNoteEntries.size(), 2);
+    EXPECT_EQ(inputs.Total(), 103);
+
+    // All notes are selected if they are not enough.
+    inputs = makeInputs({3, 100, 6, 50});
+    EXPECT_FALSE(inputs.LimitToAmount(200, 1, SET_S));
+    EXPECT_EQ(inputs.saplingNoteEntries.size(), 4);
+}
@@ -4,6 +4,7 @@
 #include "consensus/validation.h"
 #include "gtest/utils.h"
 #include "random.h"
+#include "streams.h"
 #include "transaction_builder.h"
 #include "util/test.h"
 #include "wallet/orchard.h"
@@ -11,6 +12,8 @@
 
 #include <optional>
 
+#include <rust/bridge.h>
+
 using namespace libzcash;
 
 OrchardSpendingKey RandomOrchardSpendingKey() {
@@ -75,6 +78,68 @@ TEST(OrchardWalletTests, TxInvolvesMyNotes) {
     RegtestDeactivateNU5();
 }
 
+TEST(OrchardWalletTests, AddNotesFromBatchScanner) {
+    auto consensusParams = RegtestActivateNU5();
+    OrchardWallet wallet;
+
+    auto sk = RandomOrchardSpendingKey();
+    wallet.AddSpendingKey(sk);
+    auto ivks = wallet.GetIncomingViewingKeys(true);
+    ASSERT_EQ(ivks.size(), 1);
+
+    auto tx = FakeOrchardTx(sk, libzcash::diversifier_index_t(0));
+    auto txNotOurs = FakeOrchardTx(RandomOrchardSpendingKey(), libzcash::diversifier_index_t(0));
+
+    // Trial decrypt both transactions with the wallet's keys in the batch
+    // scanner, as the wallet does for the transactions of a block.
+    std::vector<std::array<uint8_t, 32>> saplingIvks;
+    auto batchScanner = wallet::init_batch_scanner(
+        *Params().RustNetwork(),
+        {saplingIvks.data(), saplingIvks.size()},
+        {ivks.data(), ivks.size()});
+    uint256 blockTag = GetRandHash();
+    for (const auto& scanned : {tx, txNotOurs}) {
+        CDataStream ssTx(SER_NETWORK, PROTOCOL_VERSION);
+        ssTx << scanned;
+        batchScanner->add_transaction(
+            blockTag.GetRawBytes(),
+            {reinterpret_cast<const unsigned char*>(ssTx.data()), ssTx.size()},
+            2);
+    }
+    batchScanner->flush();
+
+    auto hints = [&](const CTransaction& scanned) {
+        std::vector<std::pair<uint32_t, std::array<uint8_t, 64>>> hints;
+        auto results = batchScanner->collect_results(blockTag.GetRawBytes(), scanned.GetHash().GetRawBytes());
+        for (const auto& decrypted : results->get_orchard()) {
+            hints.emplace_back(decrypted.action, decrypted.ivk);
+        }
+        return hints;
+    };
+
+    // Only the note sent to the wallet is found, and adding it with the
+    // batch scanner's hints has the same effect as decrypting it with all of
+    // the wallet's keys.
+    auto txHints = hints(tx);
+    ASSERT_EQ(txHints.size(), 1);
+    EXPECT_EQ(txHints[0].second, ivks[0]);
+    auto txMeta = wallet.AddNotesIfInvolvingMe(tx, txHints);
+    ASSERT_TRUE(txMeta.has_value());
+    EXPECT_EQ(txMeta->GetMyActionIVKs().size(), 1);
+    EXPECT_TRUE(wallet.TxInvolvesMyNotes(tx.GetHash()));
+
+    OrchardWallet walletWithoutHints;
+    walletWithoutHints.AddSpendingKey(sk);
+    EXPECT_EQ(walletWithoutHints.AddNotesIfInvolvingMe(tx), txMeta);
+
+    auto txNotOursHints = hints(txNotOurs);
+    EXPECT_TRUE(txNotOursHints.empty());
+    EXPECT_FALSE(wallet.AddNotesIfInvolvingMe(txNotOurs, txNotOursHints).has_value());
+    EXPECT_FALSE(wallet.TxInvolvesMyNotes(txNotOurs.GetHash()));
+
+    RegtestDeactivateNU5();
+}
+
 // This test is here instead of test_transaction_builder.cpp because it depends
 // on OrchardWallet, which only exists if the wallet is compiled in.
 TEST(TransactionBuilder, OrchardToOrchard) {
@@ -1966,6 +1966,91 @@ TEST(WalletTests, SetBestChainIgnoresTxsWithoutShieldedData) {
     wallet.SetBestChain(walletdb, loc);
 }
 
+TEST(WalletTests, SetBestChainSkipsUnchangedTxs) {
+    SelectParams(CBaseChainParams::REGTEST);
+    TestWallet wallet(Params());
+    LOCK(wallet.cs_wallet);
+
+    MockWalletDB walletdb;
+    CBlockLocator loc;
+    EXPECT_CALL(walletdb, TxnBegin())
+        .WillRepeatedly(Return(true));
+    EXPECT_CALL(walletdb, WriteOrchardWitnesses)
+        .WillRepeatedly(Return(true));
+    EXPECT_CALL(walletdb, WriteWitnessCacheSize(0))
+        .WillRepeatedly(Return(true));
+    EXPECT_CALL(walletdb, WriteBestBlock(loc))
+        .WillRepeatedly(Return(true));
+
+    auto sk = libzcash::SproutSpendingKey::random();
+    wallet.AddSproutSpendingKey(sk);
+    auto wtx = GetValidSproutReceive(sk, 10, true);
+    wtx.SetSproutNoteData(wallet.FindMySproutNotes(wtx));
+    wallet.LoadWalletTx(wtx);
+
+    // A transaction that was not committed is written again.
+    EXPECT_CALL(walletdb, WriteTx(wtx))
+        .WillOnce(Return(true));
+    EXPECT_CALL(walletdb, TxnCommit())
+        .WillOnce(Return(false));
+    wallet.SetBestChain(walletdb, loc);
+
+    EXPECT_CALL(walletdb, WriteTx(wtx))
+        .WillOnce(Return(true));
+    EXPECT_CALL(walletdb, TxnCommit())
+        .WillRepeatedly(Return(true));
+    wallet.SetBestChain(walletdb, loc);
+
+    // Once committed, it is not written while it is unchanged.
+    EXPECT_CALL(walletdb, WriteTx(wtx))
+        .Times(0);
+    wallet.SetBestChain(walletdb, loc);
+
+    // It is written again once it changes.
+    CWalletTx& wtxStored = wallet.mapWallet[wtx.GetHash()];
+    wtxStored.mapSproutNoteData.begin()->second.witnessHeight = 1;
+    EXPECT_CALL(walletdb, WriteTx(wtxStored))
+        .WillOnce(Return(true));
+    wallet.SetBestChain(walletdb, loc);
+}
+
+TEST(WalletTests, EvictAndRestoreTxBody) {
+    SelectParams(CBaseChainParams::REGTEST);
+    TestWallet wallet(Params());
+    LOCK(wallet.cs_wallet);
+
+    auto sk = libzcash::SproutSpendingKey::random();
+    wallet.AddSproutSpendingKey(sk);
+    auto wtx = GetValidSproutReceive(sk, 10, true);
+    wtx.SetSproutNoteData(wallet.FindMySproutNotes(wtx));
+    uint256 hashFull = SerializeHash(wtx, SER_DISK, CLIENT_VERSION);
+
+    // The shielded data is dropped, but the hash and the note data are kept.
+    CWalletTx wtxEvicted = wtx;
+    wtxEvicted.EvictBody();
+    EXPECT_TRUE(wtxEvicted.fBodyEvicted);
+    EXPECT_EQ(wtx.GetHash(), wtxEvicted.GetHash());
+    EXPECT_TRUE(wtxEvicted.vJoinSplit.empty());
+    EXPECT_EQ(wtx.mapSproutNoteData.size(), wtxEvicted.mapSproutNoteData.size());
+    EXPECT_NE(hashFull, SerializeHash(wtxEvicted, SER_DISK, CLIENT_VERSION));
+
+    // Copies of an evicted transaction are evicted too.
+    CWalletTx wtxCopy = wtxEvicted;
+    EXPECT_TRUE(wtxCopy.fBodyEvicted);
+
+    // Without a wallet database, nothing is evicted.
+    wallet.LoadWalletTx(wtx);
+    fEvictTxBodies = true;
+    wallet.EvictTxBodies(1000);
+    fEvictTxBodies = DEFAULT_EVICT_TX_BODIES;
+    EXPECT_FALSE(wallet.mapWallet[wtx.GetHash()].fBodyEvicted);
+
+    wtxEvicted.RestoreBody(wtx);
+    EXPECT_FALSE(wtxEvicted.fBodyEvicted);
+    EXPECT_EQ(wtx.vJoinSplit.size(), wtxEvicted.vJoinSplit.size());
+    EXPECT_EQ(hashFull, SerializeHash(wtxEvicted, SER_DISK, CLIENT_VERSION));
+}
+
 TEST(WalletTests, UpdateSproutNullifierNoteMap) {
     SelectParams(CBaseChainParams::REGTEST);
     TestWallet wallet(Params());
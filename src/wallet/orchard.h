@@ -179,11 +179,11 @@ public:
         outputs.insert({actionIdx, output});
     }
 
-    const std::map<uint32_t, OrchardActionSpend>& GetSpends() {
+    const std::map<uint32_t, OrchardActionSpend>& GetSpends() const {
         return spends;
     }
 
-    const std::map<uint32_t, OrchardActionOutput>& GetOutputs() {
+    const std::map<uint32_t, OrchardActionOutput>& GetOutputs() const {
         return outputs;
     }
 };
@@ -297,6 +297,56 @@ public:
         }
     }
 
+    /**
+     * Like AddNotesIfInvolvingMe, but for a transaction whose actions were
+     * trial decrypted by the batch scanner: only the actions in `hints` are
+     * decrypted, each with the 64-byte incoming viewing key that the batch
+     * scanner found to decrypt it.
+     */
+    std::optional<OrchardWalletTxMeta> AddNotesIfInvolvingMe(
+            const CTransaction& tx,
+            const std::vector<std::pair<uint32_t, std::array<uint8_t, 64>>>& hints) {
+        std::vector<uint32_t> actionIdxs;
+        std::vector<std::array<uint8_t, 64>> ivks;
+        for (const auto& [actionIdx, ivk] : hints) {
+            actionIdxs.push_back(actionIdx);
+            ivks.push_back(ivk);
+        }
+        OrchardWalletTxMeta txMeta;
+        if (orchard_wallet_add_notes_from_bundle_with_hints(
+                inner.get(),
+                tx.GetHash().begin(),
+                tx.GetOrchardBundle().inner->as_ptr(),
+                actionIdxs.data(),
+                reinterpret_cast<const unsigned char (*)[64]>(ivks.data()),
+                hints.size(),
+                &txMeta,
+                PushOrchardActionIVK,
+                PushSpendActionIdx
+                )) {
+            return txMeta;
+        } else {
+            return std::nullopt;
+        }
+    }
+
+    static void PushIvkBytes(void* rec, const unsigned char ivk[64]) {
+        auto& ivks = *reinterpret_cast<std::vector<std::array<uint8_t, 64>>*>(rec);
+        ivks.emplace_back();
+        std::copy(ivk, ivk + 64, ivks.back().begin());
+    }
+
+    /**
+     * Returns the 64-byte encodings of the wallet's incoming viewing keys, for
+     * the batch scanner. If `fRequireSpendingKey` is set, the keys the wallet
+     * cannot spend with are left out.
+     */
+    std::vector<std::array<uint8_t, 64>> GetIncomingViewingKeys(bool fRequireSpendingKey) const {
+        std::vector<std::array<uint8_t, 64>> ivks;
+        orchard_wallet_get_incoming_viewing_keys(inner.get(), fRequireSpendingKey, &ivks, PushIvkBytes);
+        return ivks;
+    }
+
     /**
      * Decrypts a selection of notes from the specified transaction's
      * Orchard bundle with provided incoming viewing keys, and adds those
@@ -328,20 +378,26 @@ public:
      */
     bool AppendNoteCommitments(const int nBlockHeight, const CBlock& block) {
         assert(nBlockHeight >= 0);
-        for (int txidx = 0; txidx < block.vtx.size(); txidx++) {
+        // Most transactions have no Orchard bundle; the bundles of the others
+        // are appended in one call across the FFI.
+        std::vector<RawOrchardBlockBundle> bundles;
+        for (size_t txidx = 0; txidx < block.vtx.size(); txidx++) {
             const CTransaction& tx = block.vtx[txidx];
-            if (!orchard_wallet_append_bundle_commitments(
-                    inner.get(),
-                    (uint32_t) nBlockHeight,
-                    txidx,
-                    tx.GetHash().begin(),
-                    tx.GetOrchardBundle().inner->as_ptr()
-                    )) {
-                return false;
+            if (!tx.GetOrchardBundle().IsPresent()) {
+                continue;
             }
+            RawOrchardBlockBundle bundle;
+            bundle.txIdx = txidx;
+            std::copy(tx.GetHash().begin(), tx.GetHash().end(), bundle.txid);
+            bundle.bundle = tx.GetOrchardBundle().inner->as_ptr();
+            bundles.push_back(bundle);
         }
 
-        return true;
+        return orchard_wallet_append_block_commitments(
+                inner.get(),
+                (uint32_t) nBlockHeight,
+                bundles.data(),
+                bundles.size());
     }
 
     uint256 GetLatestAnchor() const {
@@ -97,7 +97,7 @@ UniValue z_getpaymentdisclosure(const UniValue& params, bool fHelp)
     if (!pwalletMain->mapWallet.count(hash)) {
         throw JSONRPCError(RPC_MISC_ERROR, "Transaction does not belong to the wallet");
     }
-    const CWalletTx& wtx = pwalletMain->mapWallet[hash];
+    const CWalletTx wtx = pwalletMain->GetWalletTxWithBody(pwalletMain->mapWallet[hash]);
 
     // Check if shielded tx
     if (wtx.vJoinSplit.empty()) {
@@ -498,7 +498,7 @@ UniValue dumpprivkey(const UniValue& params, bool fHelp)
             + HelpExampleRpc("dumpprivkey", "\"myaddress\"")
         );
 
-    LOCK2(cs_main, pwalletMain->cs_wallet);
+    LOCK(pwalletMain->cs_wallet);
 
     EnsureWalletIsUnlocked();
 
@@ -917,7 +917,7 @@ UniValue z_exportkey(const UniValue& params, bool fHelp)
             + HelpExampleRpc("z_exportkey", "\"myaddress\"")
         );
 
-    LOCK2(cs_main, pwalletMain->cs_wallet);
+    LOCK(pwalletMain->cs_wallet);
 
     EnsureWalletIsUnlocked();
 
@@ -994,7 +994,7 @@ UniValue z_exportviewingkey(const UniValue& params, bool fHelp)
             + HelpExampleRpc("z_exportviewingkey", "\"myaddress\"")
         );
 
-    LOCK2(cs_main, pwalletMain->cs_wallet);
+    LOCK(pwalletMain->cs_wallet);
 
     EnsureWalletIsUnlocked();
 
@@ -1069,7 +1069,7 @@ UniValue signmessage(const UniValue& params, bool fHelp)
             + HelpExampleRpc("signmessage", "\"t14oHp2v54vfmdgQ3v3SNuQga8JKHTNi2a1\", \"my message\"")
         );
 
-    LOCK2(cs_main, pwalletMain->cs_wallet);
+    LOCK(pwalletMain->cs_wallet);
 
     EnsureWalletIsUnlocked();
 
@@ -1744,42 +1744,36 @@ UniValue listtransactions(const UniValue& params, bool fHelp)
     if (nFrom < 0)
         throw JSONRPCError(RPC_INVALID_PARAMETER, "Negative from");
 
-    UniValue ret(UniValue::VARR);
-
+    // Only the entries that are returned are kept; the first nFrom entries
+    // are dropped as they are listed, so that paging through a large wallet
+    // does not hold every skipped entry in memory.
+    vector<UniValue> arrTmp;
     {
         LOCK2(cs_main, pwalletMain->cs_wallet);
         const CWallet::TxItems & txOrdered = pwalletMain->wtxOrdered;
 
         // iterate backwards until we have nCount items to return:
+        int nSkipped = 0;
         for (CWallet::TxItems::const_reverse_iterator it = txOrdered.rbegin(); it != txOrdered.rend(); ++it)
         {
             CWalletTx *const pwtx = (*it).second;
-            ListTransactions(*pwtx, 0, true, ret, filter, asOfHeight);
-            if ((int)ret.size() >= (nCount+nFrom)) break;
+            UniValue txEntries(UniValue::VARR);
+            ListTransactions(*pwtx, 0, true, txEntries, filter, asOfHeight);
+            for (const UniValue& entry : txEntries.getValues()) {
+                if (nSkipped < nFrom) {
+                    nSkipped++;
+                } else if ((int)arrTmp.size() < nCount) {
+                    arrTmp.push_back(entry);
+                }
+            }
+            if ((int)arrTmp.size() >= nCount) break;
         }
     }
 
-    // ret is newest to oldest
-
-    if (nFrom > (int)ret.size())
-        nFrom = ret.size();
-    if ((nFrom + nCount) > (int)ret.size())
-        nCount = ret.size() - nFrom;
-
-    vector<UniValue> arrTmp = ret.getValues();
-
-    vector<UniValue>::iterator first = arrTmp.begin();
-    std::advance(first, nFrom);
-    vector<UniValue>::iterator last = arrTmp.begin();
-    std::advance(last, nFrom+nCount);
-
-    if (last != arrTmp.end()) arrTmp.erase(last, arrTmp.end());
-    if (first != arrTmp.begin()) arrTmp.erase(arrTmp.begin(), first);
-
+    // arrTmp is newest to oldest
     std::reverse(arrTmp.begin(), arrTmp.end()); // Return oldest to newest
 
-    ret.clear();
-    ret.setArray();
+    UniValue ret(UniValue::VARR);
     ret.push_backV(arrTmp);
 
     return ret;
@@ -1880,7 +1874,7 @@ UniValue listsinceblock(const UniValue& params, bool fHelp)
     UniValue transactions(UniValue::VARR);
 
     for (const std::pair<const uint256, CWalletTx>& pairWtx : pwalletMain->mapWallet) {
-        CWalletTx tx = pairWtx.second;
+        const CWalletTx& tx = pairWtx.second;
 
         if (depth == -1 || tx.GetDepthInMainChain(std::nullopt) < depth) {
             ListTransactions(tx, 0, true, transactions, filter, asOfHeight);
@@ -1979,7 +1973,7 @@ UniValue gettransaction(const UniValue& params, bool fHelp)
     UniValue entry(UniValue::VOBJ);
     if (!pwalletMain->mapWallet.count(hash))
         throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Invalid or non-wallet transaction id");
-    const CWalletTx& wtx = pwalletMain->mapWallet[hash];
+    const CWalletTx wtx = pwalletMain->GetWalletTxWithBody(pwalletMain->mapWallet[hash]);
 
     CAmount nCredit = wtx.GetCredit(asOfHeight, filter);
     CAmount nDebit = wtx.GetDebit(filter);
@@ -2468,7 +2462,7 @@ UniValue listlockunspent(const UniValue& params, bool fHelp)
             + HelpExampleRpc("listlockunspent", "")
         );
 
-    LOCK2(cs_main, pwalletMain->cs_wallet);
+    LOCK(pwalletMain->cs_wallet);
 
     vector<COutPoint> vOutpts;
     pwalletMain->ListLockedCoins(vOutpts);
@@ -3068,6 +3062,21 @@ UniValue zc_benchmark(const UniValue& params, bool fHelp)
             "  }\n"
             "  ...\n"
             "]\n"
+            "\n"
+            "The acceptmempool benchmark takes the optional arguments mix (\"transparent\",\n"
+            "\"sapling\", \"orchard\", \"multiaction\" or, by default, \"mixed\"), txcount\n"
+            "(default 100) and rate in transactions per second (default 0, as fast as\n"
+            "possible). It builds txcount transactions of the mix, then submits them at\n"
+            "that rate to an empty mempool that fits half of them. Each sample also has\n"
+            "\"txpersecond\", \"latencyp50\" and \"latencyp99\", the median and 99th\n"
+            "percentile in seconds from the arrival of a transaction until it was checked,\n"
+            "and the numbers of transactions \"accepted\" and \"evicted\".\n"
+            "\n"
+            "The getbalance, zlistunspent, selectnotes, rescan and walletwitnesses\n"
+            "benchmarks measure the loaded wallet, such as one made by\n"
+            "qa/zcash/create_wallet_scale.py. getbalance takes an optional account\n"
+            "(default 0), and selectnotes an account and an amount (default 1), for which it\n"
+            "selects notes as z_sendmany would, without creating the transaction.\n"
             );
     }
 
@@ -3081,6 +3090,7 @@ UniValue zc_benchmark(const UniValue& params, bool fHelp)
     }
 
     std::vector<double> sample_times;
+    std::vector<MempoolAcceptBenchmark> accept_results;
 
     JSDescription samplejoinsplit;
 
@@ -3131,6 +3141,9 @@ UniValue zc_benchmark(const UniValue& params, bool fHelp)
         } else if (benchmarktype == "trydecryptsaplingnotes") {
             int nKeys = params[2].get_int();
             sample_times.push_back(benchmark_try_decrypt_sapling_notes(nKeys));
+        } else if (benchmarktype == "batchscansaplingnotes") {
+            int nKeys = params[2].get_int();
+            sample_times.push_back(benchmark_batch_scan_sapling_notes(nKeys));
         } else if (benchmarktype == "incnotewitnesses") {
             int nTxs = params[2].get_int();
             sample_times.push_back(benchmark_increment_sprout_note_witnesses(nTxs));
@@ -3165,10 +3178,49 @@ UniValue zc_benchmark(const UniValue& params, bool fHelp)
             sample_times.push_back(benchmark_loadwallet());
         } else if (benchmarktype == "listunspent") {
             sample_times.push_back(benchmark_listunspent());
+        } else if (benchmarktype == "getbalance") {
+            int64_t account = params.size() >= 3 ? params[2].get_int64() : 0;
+            if (account < 0 || account >= ZCASH_LEGACY_ACCOUNT) {
+                throw JSONRPCError(RPC_INVALID_PARAMETER, "Invalid account number");
+            }
+            sample_times.push_back(benchmark_getbalance(account));
+        } else if (benchmarktype == "zlistunspent") {
+            sample_times.push_back(benchmark_z_listunspent());
+        } else if (benchmarktype == "selectnotes") {
+            int64_t account = params.size() >= 3 ? params[2].get_int64() : 0;
+            if (account < 0 || account >= ZCASH_LEGACY_ACCOUNT) {
+                throw JSONRPCError(RPC_INVALID_PARAMETER, "Invalid account number");
+            }
+            CAmount amount = params.size() >= 4 ? AmountFromValue(params[3]) : COIN;
+            sample_times.push_back(benchmark_select_notes(account, amount));
+        } else if (benchmarktype == "rescan") {
+            sample_times.push_back(benchmark_rescan());
+        } else if (benchmarktype == "walletwitnesses") {
+            sample_times.push_back(benchmark_wallet_witness_update());
         } else if (benchmarktype == "createsaplingspend") {
             sample_times.push_back(benchmark_create_sapling_spend());
         } else if (benchmarktype == "createsaplingoutput") {
             sample_times.push_back(benchmark_create_sapling_output());
+        } else if (benchmarktype == "createshieldedtx") {
+            if (Params().GetConsensus().vUpgrades[Consensus::UPGRADE_NU5].nActivationHeight ==
+                Consensus::NetworkUpgrade::NO_ACTIVATION_HEIGHT) {
+                throw JSONRPCError(RPC_TYPE_ERROR, "Benchmark requires NU5 to be activated");
+            }
+            int nSaplingSpends = params.size() >= 3 ? params[2].get_int() : 50;
+            int nOrchardOutputs = params.size() >= 4 ? params[3].get_int() : 1;
+            if (nSaplingSpends < 1 || nOrchardOutputs < 0) {
+                throw JSONRPCError(RPC_TYPE_ERROR, "Invalid number of Sapling spends or Orchard outputs");
+            }
+            sample_times.push_back(benchmark_create_shielded_tx(nSaplingSpends, nOrchardOutputs));
+        } else if (benchmarktype == "acceptmempool") {
+            std::string mix = params.size() >= 3 ? params[2].get_str() : "mixed";
+            int nTxs = params.size() >= 4 ? params[3].get_int() : 100;
+            double nRate = params.size() >= 5 ? params[4].get_real() : 0;
+            if (nTxs < 1 || nRate < 0) {
+                throw JSONRPCError(RPC_TYPE_ERROR, "Invalid transaction count or rate");
+            }
+            accept_results.push_back(benchmark_accept_mempool(mix, nTxs, nRate));
+            sample_times.push_back(accept_results.back().runningTime);
         } else if (benchmarktype == "verifysaplingspend") {
             sample_times.push_back(benchmark_verify_sapling_spend());
         } else if (benchmarktype == "verifysaplingoutput") {
@@ -3179,9 +3231,16 @@ UniValue zc_benchmark(const UniValue& params, bool fHelp)
     }
 
     UniValue results(UniValue::VARR);
-    for (auto time : sample_times) {
+    for (size_t i = 0; i < sample_times.size(); i++) {
         UniValue result(UniValue::VOBJ);
-        result.pushKV("runningtime", time);
+        result.pushKV("runningtime", sample_times[i]);
+        if (i < accept_results.size()) {
+            result.pushKV("txpersecond", accept_results[i].txPerSecond);
+            result.pushKV("latencyp50", accept_results[i].latencyP50);
+            result.pushKV("latencyp99", accept_results[i].latencyP99);
+            result.pushKV("accepted", (uint64_t)accept_results[i].nAccepted);
+            result.pushKV("evicted", (uint64_t)accept_results[i].nEvicted);
+        }
         results.push_back(result);
     }
 
@@ -3532,7 +3591,7 @@ UniValue z_listaddresses(const UniValue& params, bool fHelp)
             + HelpExampleRpc("z_listaddresses", "")
         );
 
-    LOCK2(cs_main, pwalletMain->cs_wallet);
+    LOCK(pwalletMain->cs_wallet);
 
     bool fIncludeWatchonly = false;
     if (params.size() > 0) {
@@ -4297,6 +4356,127 @@ UniValue z_gettotalbalance(const UniValue& params, bool fHelp)
     return result;
 }
 
+/**
+ * Decrypt the Sapling and Orchard notes of a wallet transaction for
+ * z_viewtransaction: the notes it spends and receives with the incoming
+ * viewing keys of the wallet, and the outputs it sent with the outgoing
+ * viewing keys of the wallet and of the notes it spends. Called with
+ * cs_wallet held.
+ */
+static std::shared_ptr<const ShieldedTxNotes> DecryptShieldedTxNotes(const CWalletTx& wtx)
+{
+    auto notes = std::make_shared<ShieldedTxNotes>();
+    const uint256& txid = wtx.GetHash();
+
+    // Collect OutgoingViewingKeys for recovering output information
+    std::set<uint256> ovks;
+    {
+        // Generate the old, pre-UA accounts OVK for recovering t->z outputs.
+        HDSeed seed = pwalletMain->GetHDSeedForRPC();
+        ovks.insert(ovkForShieldingFromTaddr(seed));
+
+        // Generate the OVKs for shielding from the legacy UA account
+        auto legacyKey = pwalletMain->GetLegacyAccountKey().ToAccountPubKey();
+        auto legacyAcctOVKs = legacyKey.GetOVKsForShielding();
+        ovks.insert(legacyAcctOVKs.first);
+        ovks.insert(legacyAcctOVKs.second);
+
+        // Generate the OVKs for shielding for all unified key components
+        for (const auto& [_, ufvkid] : pwalletMain->mapUnifiedAccountKeys) {
+            auto ufvk = pwalletMain->GetUnifiedFullViewingKey(ufvkid);
+            if (ufvk.has_value()) {
+                auto tkey = ufvk.value().GetTransparentKey();
+                if (tkey.has_value()) {
+                    auto tovks = tkey.value().GetOVKsForShielding();
+                    ovks.insert(tovks.first);
+                    ovks.insert(tovks.second);
+                }
+                auto skey = ufvk.value().GetSaplingKey();
+                if (skey.has_value()) {
+                    auto sovks = skey.value().GetOVKs();
+                    ovks.insert(sovks.first);
+                    ovks.insert(sovks.second);
+                }
+                auto okey = ufvk.value().GetOrchardKey();
+                if (okey.has_value()) {
+                    ovks.insert(okey.value().ToExternalOutgoingViewingKey());
+                    ovks.insert(okey.value().ToInternalOutgoingViewingKey());
+                }
+            }
+        }
+    }
+
+    // Sapling spends
+    size_t i = 0;
+    for (const auto& spend : wtx.GetSaplingSpends()) {
+        // Fetch the note that is being spent
+        auto res = pwalletMain->mapSaplingNullifiersToNotes.find(spend.nullifier());
+        if (res == pwalletMain->mapSaplingNullifiersToNotes.end()) {
+            continue;
+        }
+        auto op = res->second;
+        const CWalletTx& wtxPrev = pwalletMain->mapWallet.at(op.hash);
+
+        // We don't need to constrain the note plaintext lead byte
+        // to satisfy the ZIP 212 grace window: if wtx exists in
+        // the wallet, it must have been successfully decrypted. This
+        // means the note plaintext lead byte was valid at the block
+        // height where the note was received.
+        // https://zips.z.cash/zip-0212#changes-to-the-process-of-receiving-sapling-or-orchard-notes
+        auto decrypted = wtxPrev.DecryptSaplingNote(Params(), op).value();
+        auto notePt = decrypted.first;
+        auto pa = decrypted.second;
+
+        // Store the OutgoingViewingKey for recovering outputs
+        libzcash::SaplingExtendedFullViewingKey extfvk;
+        assert(pwalletMain->GetSaplingFullViewingKey(wtxPrev.mapSaplingNoteData.at(op).ivk, extfvk));
+        ovks.insert(extfvk.fvk.ovk);
+
+        notes->vSaplingSpends.push_back({i, op, notePt, pa});
+        i++;
+    }
+
+    // Sapling outputs
+    for (uint32_t i = 0; i < wtx.GetSaplingOutputsCount(); ++i) {
+        auto op = SaplingOutPoint(txid, i);
+
+        SaplingNotePlaintext notePt;
+        SaplingPaymentAddress pa;
+        bool isOutgoing;
+
+        // We don't need to constrain the note plaintext lead byte
+        // to satisfy the ZIP 212 grace window: if wtx exists in
+        // the wallet, it must have been successfully decrypted. This
+        // means the note plaintext lead byte was valid at the block
+        // height where the note was received.
+        // https://zips.z.cash/zip-0212#changes-to-the-process-of-receiving-sapling-or-orchard-notes
+        auto decrypted = wtx.DecryptSaplingNote(Params(), op);
+        if (decrypted) {
+            notePt = decrypted->first;
+            pa = decrypted->second;
+            isOutgoing = false;
+        } else {
+            // Try recovering the output
+            auto recovered = wtx.RecoverSaplingNote(Params(), op, ovks);
+            if (recovered) {
+                notePt = recovered->first;
+                pa = recovered->second;
+                isOutgoing = true;
+            } else {
+                // Unreadable
+                continue;
+            }
+        }
+
+        notes->vSaplingOutputs.push_back({op.n, notePt, pa, isOutgoing});
+    }
+
+    std::vector<uint256> ovksVector(ovks.begin(), ovks.end());
+    notes->orchardActions = wtx.RecoverOrchardActions(ovksVector);
+
+    return notes;
+}
+
 UniValue z_viewtransaction(const UniValue& params, bool fHelp)
 {
     if (!EnsureWalletIsAvailable(fHelp))
@@ -4363,7 +4543,7 @@ UniValue z_viewtransaction(const UniValue& params, bool fHelp)
     UniValue entry(UniValue::VOBJ);
     if (!pwalletMain->mapWallet.count(txid))
         throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Invalid or non-wallet transaction id");
-    const CWalletTx& wtx = pwalletMain->mapWallet[txid];
+    const CWalletTx wtx = pwalletMain->GetWalletTxWithBody(pwalletMain->mapWallet[txid]);
 
     entry.pushKV("txid", txid.GetHex());
 
@@ -4427,74 +4607,18 @@ UniValue z_viewtransaction(const UniValue& params, bool fHelp)
         outputs.push_back(entry);
     }
 
-    // Collect OutgoingViewingKeys for recovering output information
-    std::set<uint256> ovks;
-    {
-        // Generate the old, pre-UA accounts OVK for recovering t->z outputs.
-        HDSeed seed = pwalletMain->GetHDSeedForRPC();
-        ovks.insert(ovkForShieldingFromTaddr(seed));
-
-        // Generate the OVKs for shielding from the legacy UA account
-        auto legacyKey = pwalletMain->GetLegacyAccountKey().ToAccountPubKey();
-        auto legacyAcctOVKs = legacyKey.GetOVKsForShielding();
-        ovks.insert(legacyAcctOVKs.first);
-        ovks.insert(legacyAcctOVKs.second);
-
-        // Generate the OVKs for shielding for all unified key components
-        for (const auto& [_, ufvkid] : pwalletMain->mapUnifiedAccountKeys) {
-            auto ufvk = pwalletMain->GetUnifiedFullViewingKey(ufvkid);
-            if (ufvk.has_value()) {
-                auto tkey = ufvk.value().GetTransparentKey();
-                if (tkey.has_value()) {
-                    auto tovks = tkey.value().GetOVKsForShielding();
-                    ovks.insert(tovks.first);
-                    ovks.insert(tovks.second);
-                }
-                auto skey = ufvk.value().GetSaplingKey();
-                if (skey.has_value()) {
-                    auto sovks = skey.value().GetOVKs();
-                    ovks.insert(sovks.first);
-                    ovks.insert(sovks.second);
-                }
-                auto okey = ufvk.value().GetOrchardKey();
-                if (okey.has_value()) {
-                    ovks.insert(okey.value().ToExternalOutgoingViewingKey());
-                    ovks.insert(okey.value().ToInternalOutgoingViewingKey());
-                }
-            }
-        }
+    auto notes = pwalletMain->GetCachedShieldedTxNotes(txid);
+    if (!notes) {
+        notes = DecryptShieldedTxNotes(wtx);
+        pwalletMain->CacheShieldedTxNotes(txid, notes);
     }
 
     // Sapling spends
-    size_t i = 0;
-    for (const auto& spend : wtx.GetSaplingSpends()) {
-        // Fetch the note that is being spent
-        auto res = pwalletMain->mapSaplingNullifiersToNotes.find(spend.nullifier());
-        if (res == pwalletMain->mapSaplingNullifiersToNotes.end()) {
-            continue;
-        }
-        auto op = res->second;
-        auto wtxPrev = pwalletMain->mapWallet.at(op.hash);
-
-        // We don't need to constrain the note plaintext lead byte
-        // to satisfy the ZIP 212 grace window: if wtx exists in
-        // the wallet, it must have been successfully decrypted. This
-        // means the note plaintext lead byte was valid at the block
-        // height where the note was received.
-        // https://zips.z.cash/zip-0212#changes-to-the-process-of-receiving-sapling-or-orchard-notes
-        auto decrypted = wtxPrev.DecryptSaplingNote(Params(), op).value();
-        auto notePt = decrypted.first;
-        auto pa = decrypted.second;
-
-        // Store the OutgoingViewingKey for recovering outputs
-        libzcash::SaplingExtendedFullViewingKey extfvk;
-        assert(pwalletMain->GetSaplingFullViewingKey(wtxPrev.mapSaplingNoteData.at(op).ivk, extfvk));
-        ovks.insert(extfvk.fvk.ovk);
-
+    for (const auto& spend : notes->vSaplingSpends) {
         // Show the address that was cached at transaction construction as the
         // recipient.
         std::optional<std::string> addrStr;
-        auto addr = pwalletMain->GetPaymentAddressForRecipient(txid, pa);
+        auto addr = pwalletMain->GetPaymentAddressForRecipient(txid, spend.pa);
         if (addr.second != RecipientType::WalletInternalAddress) {
             addrStr = keyIO.EncodePaymentAddress(addr.first);
         }
@@ -4504,54 +4628,23 @@ UniValue z_viewtransaction(const UniValue& params, bool fHelp)
         if (fEnableAddrTypeField) {
             entry.pushKV("type", ADDR_TYPE_SAPLING); //deprecated
         }
-        entry.pushKV("spend", (int)i);
-        entry.pushKV("txidPrev", op.hash.GetHex());
-        entry.pushKV("outputPrev", (int)op.n);
+        entry.pushKV("spend", (int)spend.nSpend);
+        entry.pushKV("txidPrev", spend.opPrev.hash.GetHex());
+        entry.pushKV("outputPrev", (int)spend.opPrev.n);
         if (addrStr.has_value()) {
             entry.pushKV("address", addrStr.value());
         }
-        entry.pushKV("value", ValueFromAmount(notePt.value()));
-        entry.pushKV("valueZat", notePt.value());
+        entry.pushKV("value", ValueFromAmount(spend.notePt.value()));
+        entry.pushKV("valueZat", spend.notePt.value());
         spends.push_back(entry);
-        i++;
     }
 
     // Sapling outputs
-    for (uint32_t i = 0; i < wtx.GetSaplingOutputsCount(); ++i) {
-        auto op = SaplingOutPoint(txid, i);
-
-        SaplingNotePlaintext notePt;
-        SaplingPaymentAddress pa;
-        bool isOutgoing;
-
-        // We don't need to constrain the note plaintext lead byte
-        // to satisfy the ZIP 212 grace window: if wtx exists in
-        // the wallet, it must have been successfully decrypted. This
-        // means the note plaintext lead byte was valid at the block
-        // height where the note was received.
-        // https://zips.z.cash/zip-0212#changes-to-the-process-of-receiving-sapling-or-orchard-notes
-        auto decrypted = wtx.DecryptSaplingNote(Params(), op);
-        if (decrypted) {
-            notePt = decrypted->first;
-            pa = decrypted->second;
-            isOutgoing = false;
-        } else {
-            // Try recovering the output
-            auto recovered = wtx.RecoverSaplingNote(Params(), op, ovks);
-            if (recovered) {
-                notePt = recovered->first;
-                pa = recovered->second;
-                isOutgoing = true;
-            } else {
-                // Unreadable
-                continue;
-            }
-        }
-
+    for (const auto& output : notes->vSaplingOutputs) {
         // Show the address that was cached at transaction construction as the
         // recipient.
         std::optional<std::string> addrStr;
-        auto addr = pwalletMain->GetPaymentAddressForRecipient(txid, pa);
+        auto addr = pwalletMain->GetPaymentAddressForRecipient(txid, output.pa);
         if (addr.second != RecipientType::WalletInternalAddress) {
             addrStr = keyIO.EncodePaymentAddress(addr.first);
         }
@@ -4561,20 +4654,19 @@ UniValue z_viewtransaction(const UniValue& params, bool fHelp)
         if (fEnableAddrTypeField) {
             entry.pushKV("type", ADDR_TYPE_SAPLING); //deprecated
         }
-        entry.pushKV("output", (int)op.n);
-        entry.pushKV("outgoing", isOutgoing);
+        entry.pushKV("output", (int)output.nOutput);
+        entry.pushKV("outgoing", output.fOutgoing);
         entry.pushKV("walletInternal", addr.second == RecipientType::WalletInternalAddress);
         if (addrStr.has_value()) {
             entry.pushKV("address", addrStr.value());
         }
-        entry.pushKV("value", ValueFromAmount(notePt.value()));
-        entry.pushKV("valueZat", notePt.value());
-        AddMemo(entry, notePt.memo());
+        entry.pushKV("value", ValueFromAmount(output.notePt.value()));
+        entry.pushKV("valueZat", output.notePt.value());
+        AddMemo(entry, output.notePt.memo());
         outputs.push_back(entry);
     }
 
-    std::vector<uint256> ovksVector(ovks.begin(), ovks.end());
-    OrchardActions orchardActions = wtx.RecoverOrchardActions(ovksVector);
+    const OrchardActions& orchardActions = notes->orchardActions;
 
     // Orchard spends
     for (auto & pair  : orchardActions.GetSpends()) {
@@ -4690,8 +4782,8 @@ UniValue z_getoperationstatus(const UniValue& params, bool fHelp)
 
 UniValue z_getoperationstatus_IMPL(const UniValue& params, bool fRemoveFinishedOperations=false)
 {
-    LOCK2(cs_main, pwalletMain->cs_wallet);
-
+    // Operations keep their own state, so neither the chain nor the wallet
+    // is locked while it is read.
     std::set<AsyncRPCOperationId> filter;
     if (params.size()==1) {
         UniValue ids = params[0].get_array();
@@ -5179,7 +5271,7 @@ UniValue z_getmigrationstatus(const UniValue& params, bool fHelp) {
     int numFinalizedMigrationTxs = 0;
     uint64_t timeStarted = 0;
     for (const auto& txPair : pwalletMain->mapWallet) {
-        CWalletTx tx = txPair.second;
+        CWalletTx tx = pwalletMain->GetWalletTxWithBody(txPair.second);
         // A given transaction is defined as a migration transaction iff it has:
         // * one or more Sprout JoinSplits with nonzero vpub_new field; and
         // * no Sapling Spends, and;
@@ -5888,8 +5980,6 @@ UniValue z_listoperationids(const UniValue& params, bool fHelp)
             + HelpExampleRpc("z_listoperationids", "")
         );
 
-    LOCK2(cs_main, pwalletMain->cs_wallet);
-
     std::string filter;
     bool useFilter = false;
     if (params.size()==1) {
@@ -30,6 +30,7 @@
 
 #include <array>
 #include <chrono>
+#include <mutex>
 #include <optional>
 #include <thread>
 #include <variant>
@@ -1120,6 +1121,43 @@ BOOST_AUTO_TEST_CASE(rpc_wallet_async_operations_parallel_cancel)
     BOOST_CHECK(ids.size()==0);
 }
 
+// Records the order in which operations are started
+std::mutex gOrderMutex;
+std::vector<int> gOrder;
+
+class OrderOperation : public AsyncRPCOperation {
+public:
+    int n;
+    OrderOperation(int n) : n(n) {}
+    virtual ~OrderOperation() {}
+    virtual void main() {
+        set_state(OperationStatus::EXECUTING);
+        {
+            std::lock_guard<std::mutex> guard(gOrderMutex);
+            gOrder.push_back(n);
+        }
+        set_state(OperationStatus::SUCCESS);
+    }
+};
+
+// This tests that background operations are started after normal ones
+BOOST_AUTO_TEST_CASE(rpc_wallet_async_operations_priority)
+{
+    gOrder.clear();
+
+    std::shared_ptr<AsyncRPCQueue> q = std::make_shared<AsyncRPCQueue>();
+    q->addOperation(std::shared_ptr<AsyncRPCOperation>(new OrderOperation(3)), AsyncRPCPriority::BACKGROUND);
+    q->addOperation(std::shared_ptr<AsyncRPCOperation>(new OrderOperation(1)));
+    q->addOperation(std::shared_ptr<AsyncRPCOperation>(new OrderOperation(4)), AsyncRPCPriority::BACKGROUND);
+    q->addOperation(std::shared_ptr<AsyncRPCOperation>(new OrderOperation(2)), AsyncRPCPriority::NORMAL);
+    BOOST_CHECK(q->getOperationCount() == 4);
+
+    q->addWorker();
+    q->finishAndWait();
+    BOOST_CHECK(q->getOperationCount() == 0);
+    BOOST_CHECK(gOrder == std::vector<int>({1, 2, 3, 4}));
+}
+
 // This tests z_getoperationstatus, z_getoperationresult, z_listoperationids
 BOOST_AUTO_TEST_CASE(rpc_z_getoperations)
 {
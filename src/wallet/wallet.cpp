@@ -32,11 +32,16 @@
 #include "zcash/Note.hpp"
 #include "zip317.h"
 #include "crypter.h"
+#include "wallet/asyncrpcoperation_saplingconsolidation.h"
 #include "wallet/asyncrpcoperation_saplingmigration.h"
 
 #include <algorithm>
 #include <assert.h>
+#include <condition_variable>
+#include <deque>
+#include <memory>
 #include <numeric>
+#include <thread>
 #include <variant>
 
 #include <boost/algorithm/string/replace.hpp>
@@ -50,8 +55,13 @@ CWallet* pwalletMain = NULL;
 CFeeRate payTxFee(DEFAULT_TRANSACTION_FEE);
 bool bSpendZeroConfChange = DEFAULT_SPEND_ZEROCONF_CHANGE;
 bool fPayAtLeastCustomFee = true;
+bool fScanMempoolWatchOnly = DEFAULT_SCAN_MEMPOOL_WATCH_ONLY;
+bool fEvictTxBodies = DEFAULT_EVICT_TX_BODIES;
 unsigned int nAnchorConfirmations = DEFAULT_ANCHOR_CONFIRMATIONS;
 unsigned int nOrchardActionLimit = DEFAULT_ORCHARD_ACTION_LIMIT;
+unsigned int nConsolidationMaxNotes = DEFAULT_CONSOLIDATION_MAX_NOTES;
+unsigned int nConsolidationMaxTxs = DEFAULT_CONSOLIDATION_MAX_TXS;
+CAmount nConsolidationFeeBudget = DEFAULT_CONSOLIDATION_FEE_BUDGET;
 
 const char * DEFAULT_WALLET_DAT = "wallet.dat";
 
@@ -364,6 +374,75 @@ CPubKey CWallet::GenerateNewKey(bool external)
     return pubkey.value();
 }
 
+std::vector<CPubKey> CWallet::GenerateNewKeys(size_t nKeys, bool external, CWalletDB& walletdb)
+{
+    AssertLockHeld(cs_wallet); // mapKeyMetadata
+
+    if (!mnemonicHDChain.has_value()) {
+        throw std::runtime_error(
+                "CWallet::GenerateNewKeys(): Wallet is missing mnemonic seed metadata.");
+    }
+    CHDChain& hdChain = mnemonicHDChain.value();
+
+    const transparent::AccountKey accountKey = this->GetLegacyAccountKey();
+    std::vector<CPubKey> pubkeys;
+    while (pubkeys.size() < nKeys) {
+        // Derive the keys and their public keys on several threads. As in
+        // GenerateNewKey, indices for which derivation fails are skipped.
+        const uint32_t nFirstIndex = hdChain.GetLegacyTKeyCounter(external);
+        const size_t nBatch = nKeys - pubkeys.size();
+        std::vector<std::optional<std::pair<CKey, CPubKey>>> derived(nBatch);
+        const size_t nThreads = std::max<size_t>(1, std::min<size_t>(
+            GetNumCores(), nBatch / MIN_KEYS_PER_DERIVATION_THREAD));
+        auto derive = [&](size_t nThread) {
+            for (size_t i = nThread; i < nBatch; i += nThreads) {
+                auto key = external ?
+                    accountKey.DeriveExternalSpendingKey(nFirstIndex + i) :
+                    accountKey.DeriveInternalSpendingKey(nFirstIndex + i);
+                if (key.has_value()) {
+                    CPubKey pubkey = key.value().GetPubKey();
+                    assert(key.value().VerifyPubKey(pubkey));
+                    derived[i] = std::make_pair(key.value(), pubkey);
+                }
+            }
+        };
+        std::vector<std::thread> threads;
+        for (size_t nThread = 1; nThread < nThreads; nThread++) {
+            threads.emplace_back(derive, nThread);
+        }
+        derive(0);
+        for (std::thread& thread : threads) {
+            thread.join();
+        }
+
+        pwalletdbBatch = &walletdb;
+        try {
+            for (size_t i = 0; i < nBatch; i++) {
+                hdChain.IncrementLegacyTKeyCounter(external);
+                if (derived[i].has_value()) {
+                    pubkeys.push_back(AddTransparentSecretKey(
+                        hdChain.GetSeedFingerprint(),
+                        derived[i].value().first,
+                        derived[i].value().second,
+                        transparent::AccountKey::KeyPath(BIP44CoinType(), ZCASH_LEGACY_ACCOUNT, external, nFirstIndex + i)
+                    ));
+                }
+            }
+        } catch (...) {
+            pwalletdbBatch = NULL;
+            throw;
+        }
+        pwalletdbBatch = NULL;
+    }
+
+    // Update the persisted chain information
+    if (fFileBacked && !walletdb.WriteMnemonicHDChain(hdChain)) {
+        throw std::runtime_error("CWallet::GenerateNewKeys(): Writing HD chain model failed");
+    }
+
+    return pubkeys;
+}
+
 CPubKey CWallet::AddTransparentSecretKey(
         const uint256& seedFingerprint,
         const CKey& secret,
@@ -372,6 +451,15 @@ CPubKey CWallet::AddTransparentSecretKey(
     CPubKey pubkey = secret.GetPubKey();
     assert(secret.VerifyPubKey(pubkey));
 
+    return AddTransparentSecretKey(seedFingerprint, secret, pubkey, keyPath);
+}
+
+CPubKey CWallet::AddTransparentSecretKey(
+        const uint256& seedFingerprint,
+        const CKey& secret,
+        const CPubKey& pubkey,
+        const HDKeyPath& keyPath)
+{
     // Create new metadata
     CKeyMetadata keyMeta(GetTime());
     keyMeta.hdKeypath = keyPath;
@@ -391,6 +479,7 @@ bool CWallet::AddKeyPubKey(
         const CPubKey &pubkey)
 {
     AssertLockHeld(cs_wallet); // mapKeyMetadata
+    AddToScriptPubKeyFilter(pubkey);
     if (!CCryptoKeyStore::AddKeyPubKey(secret, pubkey))
         return false;
 
@@ -407,6 +496,11 @@ bool CWallet::AddKeyPubKey(
         return true;
 
     if (!IsCrypted()) {
+        if (pwalletdbBatch) {
+            return pwalletdbBatch->WriteKey(pubkey,
+                                            secret.GetPrivKey(),
+                                            mapKeyMetadata[pubkey.GetID()]);
+        }
         return CWalletDB(strWalletFile).WriteKey(pubkey,
                                                  secret.GetPrivKey(),
                                                  mapKeyMetadata[pubkey.GetID()]);
@@ -418,7 +512,7 @@ bool CWallet::AddKeyPubKey(
 bool CWallet::AddCryptedKey(const CPubKey &vchPubKey,
                             const vector<unsigned char> &vchCryptedSecret)
 {
-
+    AddToScriptPubKeyFilter(vchPubKey);
     if (!CCryptoKeyStore::AddCryptedKey(vchPubKey, vchCryptedSecret))
         return false;
     if (!fFileBacked)
@@ -429,6 +523,10 @@ bool CWallet::AddCryptedKey(const CPubKey &vchPubKey,
             return pwalletdbEncryption->WriteCryptedKey(vchPubKey,
                                                         vchCryptedSecret,
                                                         mapKeyMetadata[vchPubKey.GetID()]);
+        else if (pwalletdbBatch)
+            return pwalletdbBatch->WriteCryptedKey(vchPubKey,
+                                                   vchCryptedSecret,
+                                                   mapKeyMetadata[vchPubKey.GetID()]);
         else
             return CWalletDB(strWalletFile).WriteCryptedKey(vchPubKey,
                                                             vchCryptedSecret,
@@ -787,15 +885,17 @@ WalletUAGenerationResult CWallet::GenerateUnifiedAddress(
 
             // We do not add the change address for the transparent key, because
             // we do not send transparent change when using unified accounts.
-
-            // Writing this data is handled by `CWalletDB::WriteUnifiedAddressMetadata` below.
-            assert(
-                CCryptoKeyStore::AddTransparentReceiverForUnifiedAddress(
-                    ufvkid, address.second, address.first
-                )
-            );
         }
 
+        // Index the receivers of the address so that they can be mapped back
+        // to the account. Writing this data is handled by
+        // `CWalletDB::WriteUnifiedAddressMetadata` below.
+        assert(
+            CCryptoKeyStore::AddReceiversForUnifiedAddress(
+                ufvkid, address.second, address.first
+            )
+        );
+
         // If the address has a Sapling component, add an association between
         // that address and the Sapling IVK corresponding to the ufvk
         auto hasSapling = receiverTypes.find(ReceiverType::Sapling) != receiverTypes.end();
@@ -1105,7 +1205,7 @@ bool CWallet::LoadCaches()
                                 }
                             }
 
-                            return CCryptoKeyStore::AddTransparentReceiverForUnifiedAddress(
+                            return CCryptoKeyStore::AddReceiversForUnifiedAddress(
                                     ufvkId, addr.second, addr.first);
                         }
                     });
@@ -1183,8 +1283,15 @@ void CWallet::LoadZKeyMetadata(const SproutPaymentAddress &addr, const CKeyMetad
     mapSproutZKeyMetadata[addr] = meta;
 }
 
+bool CWallet::LoadKey(const CKey& key, const CPubKey &pubkey)
+{
+    AddToScriptPubKeyFilter(pubkey);
+    return CCryptoKeyStore::AddKeyPubKey(key, pubkey);
+}
+
 bool CWallet::LoadCryptedKey(const CPubKey &vchPubKey, const std::vector<unsigned char> &vchCryptedSecret)
 {
+    AddToScriptPubKeyFilter(vchPubKey);
     return CCryptoKeyStore::AddCryptedKey(vchPubKey, vchCryptedSecret);
 }
 
@@ -1260,8 +1367,22 @@ bool CWallet::LoadSproutViewingKey(const libzcash::SproutViewingKey &vk)
     return CCryptoKeyStore::AddSproutViewingKey(vk);
 }
 
+void CWallet::AddToScriptPubKeyFilter(const CPubKey& pubkey)
+{
+    LOCK(cs_KeyStore);
+    scriptPubKeyFilter.insert(GetScriptForDestination(pubkey.GetID()));
+    scriptPubKeyFilter.insert(GetScriptForRawPubKey(pubkey));
+}
+
+void CWallet::AddToScriptPubKeyFilter(const CScript& scriptPubKey)
+{
+    LOCK(cs_KeyStore);
+    scriptPubKeyFilter.insert(scriptPubKey);
+}
+
 bool CWallet::AddCScript(const CScript& redeemScript)
 {
+    AddToScriptPubKeyFilter(GetScriptForDestination(CScriptID(redeemScript)));
     if (!CCryptoKeyStore::AddCScript(redeemScript))
         return false;
     if (!fFileBacked)
@@ -1283,11 +1404,13 @@ bool CWallet::LoadCScript(const CScript& redeemScript)
         return true;
     }
 
+    AddToScriptPubKeyFilter(GetScriptForDestination(CScriptID(redeemScript)));
     return CCryptoKeyStore::AddCScript(redeemScript);
 }
 
 bool CWallet::AddWatchOnly(const CScript &dest)
 {
+    AddToScriptPubKeyFilter(dest);
     if (!CCryptoKeyStore::AddWatchOnly(dest))
         return false;
     nTimeFirstKey = 1; // No birthday information for watch-only keys.
@@ -1313,6 +1436,7 @@ bool CWallet::RemoveWatchOnly(const CScript &dest)
 
 bool CWallet::LoadWatchOnly(const CScript &dest)
 {
+    AddToScriptPubKeyFilter(dest);
     return CCryptoKeyStore::AddWatchOnly(dest);
 }
 
@@ -1422,6 +1546,7 @@ void CWallet::ChainTipAdded(const CBlockIndex *pindex,
             loc = chainActive.GetLocator(pindex);
         }
         SetBestChain(loc);
+        EvictTxBodies(pindex->nHeight);
     }
 }
 
@@ -1443,6 +1568,7 @@ void CWallet::ChainTip(const CBlockIndex *pindex,
         if (pblock->GetBlockTime() > GetTime() - std::min(nMaxTipAge, hibernationOld))
         {
             RunSaplingMigration(pindex->nHeight);
+            RunSaplingConsolidation(pindex->nHeight);
         }
     } else {
         DecrementNoteWitnesses(consensus, pindex);
@@ -1487,7 +1613,7 @@ void CWallet::RunSaplingMigration(int blockHeight) {
         auto saplingAnchor = anchorBlockIndex->hashFinalSaplingRoot;
         std::shared_ptr<AsyncRPCOperation> operation(new AsyncRPCOperation_saplingmigration(targetHeight, saplingAnchor));
         saplingMigrationOperationId = operation->getId();
-        q->addOperation(operation);
+        q->addOperation(operation, AsyncRPCPriority::BACKGROUND);
     } else if (blockHeight % 500 == 499) {
         std::shared_ptr<AsyncRPCQueue> q = getAsyncRPCQueue();
         std::shared_ptr<AsyncRPCOperation> lastOperation = q->getOperationForId(saplingMigrationOperationId);
@@ -1506,6 +1632,33 @@ void CWallet::RunSaplingMigration(int blockHeight) {
     }
 }
 
+void CWallet::RunSaplingConsolidation(int blockHeight) {
+    if (!Params().GetConsensus().NetworkUpgradeActive(blockHeight, Consensus::UPGRADE_SAPLING)) {
+        return;
+    }
+    LOCK(cs_wallet);
+    if (!fSaplingConsolidationEnabled || IsLocked()) {
+        return;
+    }
+    if (blockHeight % CONSOLIDATION_INTERVAL != 0) {
+        return;
+    }
+    // Only consolidate while the wallet is otherwise idle, so that the
+    // consolidation transactions neither delay nor spend the notes chosen
+    // by operations the user started.
+    std::shared_ptr<AsyncRPCQueue> q = getAsyncRPCQueue();
+    for (const AsyncRPCOperationId& id : q->getAllOperationIds()) {
+        std::shared_ptr<AsyncRPCOperation> operation = q->getOperationForId(id);
+        if (operation != nullptr && (operation->isReady() || operation->isExecuting())) {
+            LogPrint("zrpcunsafe", "Skipping Sapling consolidation at height %d: operation %s is pending\n", blockHeight, id);
+            return;
+        }
+    }
+    std::shared_ptr<AsyncRPCOperation> operation(new AsyncRPCOperation_saplingconsolidation(blockHeight + 1));
+    saplingConsolidationOperationId = operation->getId();
+    q->addOperation(operation, AsyncRPCPriority::BACKGROUND);
+}
+
 void CWallet::AddPendingSaplingMigrationTx(const CTransaction& tx) {
     LOCK(cs_wallet);
     pendingSaplingMigrationTxs.push_back(tx);
@@ -1517,6 +1670,140 @@ void CWallet::SetBestChain(const CBlockLocator& loc)
     SetBestChainINTERNAL(walletdb, loc);
 }
 
+void CWallet::EvictTxBodies(int nHeight)
+{
+    if (!fEvictTxBodies || !fFileBacked) {
+        return;
+    }
+
+    LOCK2(cs_main, cs_wallet);
+    auto spentLongAgo = [&](const std::optional<int>& spentHeight) {
+        return spentHeight.has_value() && spentHeight.value() + (int)WITNESS_CACHE_SIZE < nHeight;
+    };
+    size_t nEvicted = 0;
+    for (auto& [txid, wtx] : mapWallet) {
+        if (wtx.fBodyEvicted || !wtx.orchardTxMeta.empty()) {
+            continue;
+        }
+        if (wtx.vJoinSplit.empty() &&
+            !wtx.GetSaplingBundle().IsPresent() &&
+            !wtx.GetOrchardBundle().IsPresent()) {
+            continue;
+        }
+        if (wtx.GetDepthInMainChain(std::nullopt) <= (int)WITNESS_CACHE_SIZE) {
+            continue;
+        }
+        bool fAllSpent = true;
+        for (const auto& [jsop, nd] : wtx.mapSproutNoteData) {
+            fAllSpent = fAllSpent && spentLongAgo(nd.spentHeight);
+        }
+        for (const auto& [op, nd] : wtx.mapSaplingNoteData) {
+            fAllSpent = fAllSpent && spentLongAgo(nd.spentHeight);
+        }
+        if (!fAllSpent) {
+            continue;
+        }
+
+        // The shielded data is read back from the wallet database, so the
+        // transaction must have been written as it is. Transactions with
+        // notes are rewritten by SetBestChain, which records what it wrote.
+        bool fHasNotes = !(wtx.mapSproutNoteData.empty() && wtx.mapSaplingNoteData.empty());
+        if (fHasNotes) {
+            auto it = mapBestChainTxHashes.find(txid);
+            if (it == mapBestChainTxHashes.end() ||
+                it->second != SerializeHash(wtx, SER_DISK, CLIENT_VERSION)) {
+                continue;
+            }
+        }
+        wtx.EvictBody();
+        if (fHasNotes) {
+            // Nothing has changed but what is in memory.
+            mapBestChainTxHashes[txid] = SerializeHash(wtx, SER_DISK, CLIENT_VERSION);
+        }
+        nEvicted++;
+    }
+    if (nEvicted > 0) {
+        LogPrint("db", "%s: evicted the bodies of %u transactions\n", __func__, nEvicted);
+    }
+}
+
+CWalletTx CWallet::GetWalletTxWithBody(const CWalletTx& wtx) const
+{
+    CWalletTx wtxFull(wtx);
+    if (!wtx.fBodyEvicted) {
+        return wtxFull;
+    }
+
+    LOCK(cs_wallet);
+    CTransactionRef pbody;
+    for (auto it = listTxBodyCache.begin(); it != listTxBodyCache.end(); ++it) {
+        if ((*it)->GetHash() == wtx.GetHash()) {
+            pbody = *it;
+            listTxBodyCache.splice(listTxBodyCache.begin(), listTxBodyCache, it);
+            break;
+        }
+    }
+    if (!pbody) {
+        CWalletTx wtxStored;
+        if (!CWalletDB(strWalletFile).ReadTx(wtx.GetHash(), wtxStored)) {
+            throw std::runtime_error(strprintf(
+                "%s: cannot read transaction %s from the wallet database",
+                __func__, wtx.GetHash().GetHex()));
+        }
+        pbody = std::make_shared<const CTransaction>(wtxStored);
+        listTxBodyCache.push_front(pbody);
+        if (listTxBodyCache.size() > TX_BODY_CACHE_SIZE) {
+            listTxBodyCache.pop_back();
+        }
+    }
+    wtxFull.RestoreBody(*pbody);
+    return wtxFull;
+}
+
+std::shared_ptr<const ShieldedTxNotes> CWallet::GetCachedShieldedTxNotes(const uint256& txid) const
+{
+    LOCK(cs_wallet);
+    if (nShieldedTxNotesAccounts != mapUnifiedAccountKeys.size()) {
+        // The outgoing viewing keys of the new accounts may recover more
+        // outputs.
+        mapShieldedTxNotes.clear();
+        listShieldedTxNotes.clear();
+        nShieldedTxNotesAccounts = mapUnifiedAccountKeys.size();
+        return nullptr;
+    }
+    auto it = mapShieldedTxNotes.find(txid);
+    if (it == mapShieldedTxNotes.end()) {
+        return nullptr;
+    }
+    listShieldedTxNotes.splice(listShieldedTxNotes.begin(), listShieldedTxNotes, it->second.second);
+    return it->second.first;
+}
+
+void CWallet::CacheShieldedTxNotes(const uint256& txid, std::shared_ptr<const ShieldedTxNotes> notes) const
+{
+    LOCK(cs_wallet);
+    EraseShieldedTxNotes(txid);
+    if (nShieldedTxNotesAccounts != mapUnifiedAccountKeys.size()) {
+        return;
+    }
+    listShieldedTxNotes.push_front(txid);
+    mapShieldedTxNotes.emplace(txid, std::make_pair(std::move(notes), listShieldedTxNotes.begin()));
+    if (listShieldedTxNotes.size() > SHIELDED_TX_NOTES_CACHE_SIZE) {
+        mapShieldedTxNotes.erase(listShieldedTxNotes.back());
+        listShieldedTxNotes.pop_back();
+    }
+}
+
+void CWallet::EraseShieldedTxNotes(const uint256& txid) const
+{
+    AssertLockHeld(cs_wallet);
+    auto it = mapShieldedTxNotes.find(txid);
+    if (it != mapShieldedTxNotes.end()) {
+        listShieldedTxNotes.erase(it->second.second);
+        mapShieldedTxNotes.erase(it);
+    }
+}
+
 std::optional<uint256> CWallet::GetPersistedBestBlock()
 {
     AssertLockHeld(cs_wallet);
@@ -1596,7 +1883,12 @@ bool CWallet::IsNoteSproutChange(
     // - Notes created by consolidation transactions (e.g. using
     //   z_mergetoaddress).
     // - Notes sent from one address to itself.
-    for (const JSDescription & jsd : mapWallet[jsop.hash].vJoinSplit) {
+    const CWalletTx& wtx = mapWallet[jsop.hash];
+    std::optional<CWalletTx> wtxWithBody;
+    if (wtx.fBodyEvicted) {
+        wtxWithBody = GetWalletTxWithBody(wtx);
+    }
+    for (const JSDescription & jsd : (wtxWithBody.has_value() ? wtxWithBody.value() : wtx).vJoinSplit) {
         for (const uint256 & nullifier : jsd.nullifiers) {
             if (nullifierSet.count(std::make_pair(address, nullifier))) {
                 return true;
@@ -1624,7 +1916,12 @@ bool CWallet::IsNoteSaplingChange(
     // - Notes created by consolidation transactions (e.g. using
     //   z_mergetoaddress).
     // - Notes sent from one address to itself.
-    for (const auto& spend : mapWallet[op.hash].GetSaplingSpends()) {
+    const CWalletTx& wtx = mapWallet[op.hash];
+    std::optional<CWalletTx> wtxWithBody;
+    if (wtx.fBodyEvicted) {
+        wtxWithBody = GetWalletTxWithBody(wtx);
+    }
+    for (const auto& spend : (wtxWithBody.has_value() ? wtxWithBody.value() : wtx).GetSaplingSpends()) {
         if (nullifierSet.count(std::make_pair(address, spend.nullifier()))) {
             return true;
         }
@@ -1679,7 +1976,11 @@ set<uint256> CWallet::GetConflicts(const uint256& txid) const
     std::map<uint256, CWalletTx>::const_iterator it = mapWallet.find(txid);
     if (it == mapWallet.end())
         return result;
-    const CWalletTx& wtx = it->second;
+    std::optional<CWalletTx> wtxWithBody;
+    if (it->second.fBodyEvicted) {
+        wtxWithBody = GetWalletTxWithBody(it->second);
+    }
+    const CWalletTx& wtx = wtxWithBody.has_value() ? wtxWithBody.value() : it->second;
 
     std::pair<TxSpends::const_iterator, TxSpends::const_iterator> range;
 
@@ -2250,7 +2551,9 @@ SpendableInputs CWallet::FindSpendableInputs(
     bool selectOrchard{selector.SelectsOrchard()};
 
     SpendableInputs unspent;
-    for (auto const& [wtxid, wtx] : mapWallet) {
+    for (const CWalletTx* pwtx : GetMaybeSpendableTxs(asOfHeight)) {
+        const CWalletTx& wtx = *pwtx;
+        const uint256& wtxid = wtx.GetHash();
         bool isCoinbase = wtx.IsCoinBase();
         auto nDepth = wtx.GetDepthInMainChain(asOfHeight);
 
@@ -2305,6 +2608,7 @@ SpendableInputs CWallet::FindSpendableInputs(
         }
 
         if (selectSprout) {
+            std::optional<CWalletTx> wtxWithBody;
             for (auto const& [jsop, nd] : wtx.mapSproutNoteData) {
                 SproutPaymentAddress pa = nd.address;
 
@@ -2326,19 +2630,24 @@ SpendableInputs CWallet::FindSpendableInputs(
                                 keyIO.EncodePaymentAddress(pa)));
                 }
 
+                if (wtx.fBodyEvicted && !wtxWithBody.has_value()) {
+                    wtxWithBody = GetWalletTxWithBody(wtx);
+                }
+                const CWalletTx& wtxFull = wtxWithBody.has_value() ? wtxWithBody.value() : wtx;
+
                 // determine amount of funds in the note
                 int i = jsop.js; // Index into CTransaction.vJoinSplit
                 auto hSig = ZCJoinSplit::h_sig(
-                    wtx.vJoinSplit[i].randomSeed,
-                    wtx.vJoinSplit[i].nullifiers,
-                    wtx.joinSplitPubKey);
+                    wtxFull.vJoinSplit[i].randomSeed,
+                    wtxFull.vJoinSplit[i].nullifiers,
+                    wtxFull.joinSplitPubKey);
 
                 try {
                     int j = jsop.n; // Index into JSDescription.ciphertexts
                     SproutNotePlaintext plaintext = SproutNotePlaintext::decrypt(
                             decryptor,
-                            wtx.vJoinSplit[i].ciphertexts[j],
-                            wtx.vJoinSplit[i].ephemeralKey,
+                            wtxFull.vJoinSplit[i].ciphertexts[j],
+                            wtxFull.vJoinSplit[i].ephemeralKey,
                             hSig,
                             (unsigned char) j);
 
@@ -2518,6 +2827,82 @@ bool CWallet::IsOrchardSpent(const OrchardOutPoint& outpoint, const std::optiona
     return false;
 }
 
+template<typename T>
+static bool IsSpentDeeplyIn(
+    const std::multimap<T, uint256>& spends,
+    const T& spent,
+    const std::map<uint256, CWalletTx>& mapWallet)
+{
+    auto range = spends.equal_range(spent);
+    for (auto it = range.first; it != range.second; ++it) {
+        auto mit = mapWallet.find(it->second);
+        if (mit != mapWallet.end() && mit->second.GetDepthInMainChain(std::nullopt) > (int) MAX_REORG_LENGTH) {
+            return true;
+        }
+    }
+    return false;
+}
+
+bool CWallet::IsSpentDeeply(const TxSpendMap<COutPoint>& spends, const COutPoint& outpoint) const
+{
+    return IsSpentDeeplyIn(spends, outpoint, mapWallet);
+}
+
+bool CWallet::IsSpentDeeply(const TxSpendMap<uint256>& spends, const uint256& nullifier) const
+{
+    return IsSpentDeeplyIn(spends, nullifier, mapWallet);
+}
+
+std::vector<const CWalletTx*> CWallet::GetMaybeSpendableTxs(const std::optional<int>& asOfHeight) const
+{
+    AssertLockHeld(cs_main);
+    AssertLockHeld(cs_wallet);
+
+    std::vector<const CWalletTx*> vTxs;
+    if (asOfHeight.has_value()) {
+        // Outputs spent since then were unspent as of that height.
+        vTxs.reserve(mapWallet.size());
+        for (const auto& [wtxid, wtx] : mapWallet) {
+            vTxs.push_back(&wtx);
+        }
+        return vTxs;
+    }
+
+    vTxs.reserve(setMaybeSpendable.size());
+    for (auto it = setMaybeSpendable.begin(); it != setMaybeSpendable.end(); ) {
+        auto mit = mapWallet.find(*it);
+        if (mit == mapWallet.end()) {
+            it = setMaybeSpendable.erase(it);
+            continue;
+        }
+        const CWalletTx& wtx = mit->second;
+
+        // A spend that cannot be reorged cannot become conflicted either, so
+        // the outputs and notes it spends are spent for good.
+        bool fSpendable = false;
+        for (unsigned int i = 0; i < wtx.vout.size() && !fSpendable; i++) {
+            fSpendable = IsMine(wtx.vout[i]) != ISMINE_NO &&
+                !IsSpentDeeply(mapTxSpends, COutPoint(wtx.GetHash(), i));
+        }
+        for (const auto& [jsop, nd] : wtx.mapSproutNoteData) {
+            if (fSpendable) break;
+            fSpendable = !nd.nullifier.has_value() || !IsSpentDeeply(mapTxSproutNullifiers, nd.nullifier.value());
+        }
+        for (const auto& [op, nd] : wtx.mapSaplingNoteData) {
+            if (fSpendable) break;
+            fSpendable = !nd.nullifier.has_value() || !IsSpentDeeply(mapTxSaplingNullifiers, nd.nullifier.value());
+        }
+
+        if (fSpendable) {
+            vTxs.push_back(&wtx);
+            ++it;
+        } else {
+            it = setMaybeSpendable.erase(it);
+        }
+    }
+    return vTxs;
+}
+
 void CWallet::AddToTransparentSpends(const COutPoint& outpoint, const uint256& wtxid)
 {
     mapTxSpends.insert(make_pair(outpoint, wtxid));
@@ -2660,6 +3045,16 @@ static void AppendNoteCommitment(NoteData& nd, int indexHeight, int64_t nWitness
     }
 }
 
+template<typename NoteData, typename Tree, typename Hash>
+static void FastForwardWitness(NoteData& nd, int indexHeight, int64_t nWitnessCacheSize, const Tree& tree, const libzcash::MerkleTreeNodes<Hash>& nodes)
+{
+    // See AppendNoteCommitment.
+    if (nd.witnessHeight < indexHeight && nd.witnesses.size() > 0) {
+        assert(nWitnessCacheSize >= (int64_t) nd.witnesses.size());
+        nd.witnesses.front().fast_forward(tree, nodes);
+    }
+}
+
 template<typename NoteData, typename Witness>
 static void WitnessMyNoteIfNecessary(NoteData& nd, int indexHeight, int64_t nWitnessCacheSize, const Witness& witness)
 {
@@ -2716,9 +3111,10 @@ static void UpdateWitnessHeights(NoteDataMap& noteDataMap, int indexHeight, int6
     }
 }
 
-template<typename NoteData, typename OutPoint>
+template<typename NoteData, typename OutPoint, typename Tree, typename Hash>
 static void IncrementNoteWitnesses(std::map<OutPoint, NoteData>& noteDataMap,
-                                   const std::vector<uint256>& noteCommitments,
+                                   const Tree& tree,
+                                   const libzcash::MerkleTreeNodes<Hash>& nodes,
                                    const std::vector<uint256>& nullifiers,
                                    int chainHeight,
                                    int nPrevWitnessCacheSize,
@@ -2737,10 +3133,13 @@ static void IncrementNoteWitnesses(std::map<OutPoint, NoteData>& noteDataMap,
     // which we can append this block's commitments.
     ::CopyPreviousWitnesses(noteDataMap, chainHeight, nPrevWitnessCacheSize);
 
-    // Append new notes commitments.
-    for (const auto& noteComm : noteCommitments) {
+    // Bring the witnesses up to date with the tree as of this block. The
+    // nodes that appending the block's note commitments to the tree computed
+    // are reused, so that the cost does not grow with the number of
+    // commitments in the block times the number of notes in the wallet.
+    if (!nodes.empty()) {
         for (auto& item : noteDataMap) {
-            ::AppendNoteCommitment(item.second, chainHeight, nWitnessCacheSize, noteComm);
+            ::FastForwardWitness(item.second, chainHeight, nWitnessCacheSize, tree, nodes);
         }
     }
 
@@ -2781,12 +3180,17 @@ void CWallet::IncrementNoteWitnesses(
     // This costs us memory (bounded by the block size) in exchange for only needing
     // to loop over mapWallet in a single location (plus some lookups that are
     // sublinear in the size of the wallet).
-    std::vector<uint256> noteCommitmentsSprout;
+    libzcash::MerkleTreeNodes<libzcash::SHA256Compress> nodesSprout;
     std::vector<uint256> nullifiersSprout;
     std::vector<std::pair<CWalletTx*, SproutNoteData*>> inBlockNotesSprout;
-    std::vector<uint256> noteCommitmentsSapling;
+    libzcash::MerkleTreeNodes<libzcash::PedersenHash> nodesSapling;
     std::vector<uint256> nullifiersSapling;
     std::vector<std::pair<CWalletTx*, SaplingNoteData*>> inBlockNotesSapling;
+    // The block's Sapling note commitments are appended to the tree in
+    // batches, split after each note of this wallet so that it can be
+    // witnessed, and the new witnesses are then fast-forwarded like the
+    // existing ones.
+    std::vector<libzcash::PedersenHash> batchSapling;
 
     // 1) Loop over the block txs and gather the note commitments ordered.
     // If the tx is from this wallet, witness it and append the next block note commitments on top.
@@ -2800,8 +3204,7 @@ void CWallet::IncrementNoteWitnesses(
             const JSDescription& jsdesc = tx.vJoinSplit[i];
             for (uint8_t j = 0; j < jsdesc.commitments.size(); j++) {
                 const uint256& note_commitment = jsdesc.commitments[j];
-                frontiers.sprout.append(note_commitment);
-                noteCommitmentsSprout.emplace_back(note_commitment);
+                frontiers.sprout.append(note_commitment, &nodesSprout);
                 nullifiersSprout.emplace_back(jsdesc.nullifiers[j]);
 
                 // Append note commitment to the notes belonging to the wallet found in this block.
@@ -2829,15 +3232,7 @@ void CWallet::IncrementNoteWitnesses(
         }
         uint32_t i = 0;
         for (const auto& output : tx.GetSaplingOutputs()) {
-            const uint256& note_commitment = uint256::FromRawBytes(output.cmu());
-            frontiers.sapling.append(note_commitment);
-            noteCommitmentsSapling.emplace_back(note_commitment);
-
-            // Append note commitment to the notes belonging to the wallet found in this block.
-            // This is done here to append only the notes that occur after the witness.
-            for (auto& item : inBlockNotesSapling) {
-                ::AppendNoteCommitment(*(item.second), chainHeight, nWitnessCacheSize, note_commitment);
-            }
+            batchSapling.push_back(uint256::FromRawBytes(output.cmu()));
 
             // For each note in the transaction that is for this wallet, witness it for the
             // first time and add it to the list of notes we're tracking from this block.
@@ -2845,6 +3240,8 @@ void CWallet::IncrementNoteWitnesses(
                 CWalletTx* wtx = &txInWallet->second;
                 auto ndIt = wtx->mapSaplingNoteData.find({hash, i});
                 if (ndIt != wtx->mapSaplingNoteData.end()) {
+                    frontiers.sapling.append_batch(batchSapling, &nodesSapling);
+                    batchSapling.clear();
                     SaplingNoteData* nd = &ndIt->second;
                     ::WitnessMyNoteIfNecessary(*nd, chainHeight, nWitnessCacheSize, frontiers.sapling.witness());
                     inBlockNotesSapling.emplace_back(std::make_pair(wtx, nd));
@@ -2853,6 +3250,10 @@ void CWallet::IncrementNoteWitnesses(
             i++;
         }
     }
+    frontiers.sapling.append_batch(batchSapling, &nodesSapling);
+    for (auto& item : inBlockNotesSapling) {
+        ::FastForwardWitness(*(item.second), chainHeight, nWitnessCacheSize, frontiers.sapling, nodesSapling);
+    }
 
     // 2) Update witness heights for notes witnessed in this block. This means
     //    that when we run the incrementing logic again over the entire wallet
@@ -2873,14 +3274,16 @@ void CWallet::IncrementNoteWitnesses(
         CWalletTx& wtx = it.second;
         // Sprout
         ::IncrementNoteWitnesses(wtx.mapSproutNoteData,
-                                 noteCommitmentsSprout,
+                                 frontiers.sprout,
+                                 nodesSprout,
                                  nullifiersSprout,
                                  chainHeight,
                                  nPrevWitnessCacheSize,
                                  nWitnessCacheSize);
         // Sapling
         ::IncrementNoteWitnesses(wtx.mapSaplingNoteData,
-                                 noteCommitmentsSapling,
+                                 frontiers.sapling,
+                                 nodesSapling,
                                  nullifiersSapling,
                                  chainHeight,
                                  nPrevWitnessCacheSize,
@@ -2897,6 +3300,16 @@ void CWallet::IncrementNoteWitnesses(
 
         assert(orchardWallet.AppendNoteCommitments(pindex->nHeight, *pblock));
 
+        // The tree keeps the state it had at each checkpoint until it is
+        // garbage collected. Collect it as blocks are added, and not only
+        // before it is written, so that its memory use and the work done
+        // while the wallet is locked to write it do not grow with the number
+        // of blocks since the last write, as they do during a rescan.
+        if (++nOrchardTreeUpdates >= ORCHARD_TREE_GC_INTERVAL) {
+            orchardWallet.GarbageCollect();
+            nOrchardTreeUpdates = 0;
+        }
+
         // This assertion slows scanning for blocks with few shielded transactions by an
         // order of magnitude. It is only intended as a consistency check between the node
         // and wallet computing trees. Commented out until we have figured out what is
@@ -3171,8 +3584,13 @@ void CWallet::MarkDirty()
 {
     {
         LOCK(cs_wallet);
-        for (std::pair<const uint256, CWalletTx>& item : mapWallet)
+        for (std::pair<const uint256, CWalletTx>& item : mapWallet) {
             item.second.MarkDirty();
+            setMaybeSpendable.insert(item.first);
+        }
+        nLegacyBalanceGeneration++;
+        mapShieldedTxNotes.clear();
+        listShieldedTxNotes.clear();
     }
 }
 
@@ -3300,14 +3718,17 @@ void CWallet::UpdateSaplingNullifierNoteMapForBlock(const CBlock *pblock) {
     }
 }
 
-void CWallet::LoadWalletTx(const CWalletTx& wtxIn) {
+void CWallet::LoadWalletTx(CWalletTx wtxIn) {
     uint256 hash = wtxIn.GetHash();
-    mapWallet[hash] = wtxIn;
+    walletTxFilter.insert(hash);
     CWalletTx& wtx = mapWallet[hash];
+    wtx = std::move(wtxIn);
     wtx.BindWallet(this);
     wtxOrdered.insert(make_pair(wtx.nOrderPos, &wtx));
-    UpdateNullifierNoteMapWithTx(mapWallet[hash]);
+    UpdateNullifierNoteMapWithTx(wtx);
     AddToSpends(hash);
+    setMaybeSpendable.insert(hash);
+    nLegacyBalanceGeneration++;
 }
 
 bool CWallet::AddToWallet(const CWalletTx& wtxIn, CWalletDB* pwalletdb)
@@ -3324,6 +3745,7 @@ bool CWallet::AddToWallet(const CWalletTx& wtxIn, CWalletDB* pwalletdb)
         bool fInsertedNew = ret.second;
         if (fInsertedNew)
         {
+            walletTxFilter.insert(hash);
             wtx.nTimeReceived = GetTime();
             wtx.nOrderPos = IncOrderPosNext(pwalletdb);
             wtxOrdered.insert(make_pair(wtx.nOrderPos, &wtx));
@@ -3373,6 +3795,9 @@ bool CWallet::AddToWallet(const CWalletTx& wtxIn, CWalletDB* pwalletdb)
         if (!fInsertedNew)
         {
             // Merge
+            if (wtx.fBodyEvicted && !wtxIn.fBodyEvicted) {
+                wtx.RestoreBody(wtxIn);
+            }
             if (!wtxIn.hashBlock.IsNull() && wtxIn.hashBlock != wtx.hashBlock)
             {
                 wtx.hashBlock = wtxIn.hashBlock;
@@ -3397,12 +3822,17 @@ bool CWallet::AddToWallet(const CWalletTx& wtxIn, CWalletDB* pwalletdb)
         LogPrintf("AddToWallet %s  %s%s\n", wtxIn.GetHash().ToString(), (fInsertedNew ? "new" : ""), (fUpdated ? "update" : ""));
 
         // Write to disk
-        if (fInsertedNew || fUpdated)
+        if (fInsertedNew || fUpdated) {
+            mapBestChainTxHashes.erase(hash);
             if (!pwalletdb->WriteTx(wtx))
                 return false;
+        }
 
         // Break debit/credit balance caches:
         wtx.MarkDirty();
+        setMaybeSpendable.insert(hash);
+        nLegacyBalanceGeneration++;
+        EraseShieldedTxNotes(hash);
 
         // Notify UI of new or updated transaction
         NotifyTransactionChanged(this, hash, fInsertedNew ? CT_NEW : CT_UPDATED);
@@ -3525,6 +3955,10 @@ bool CWallet::AddToWalletIfInvolvingMe(
         auto saplingNoteData = decryptedNotes.saplingNoteDataAndAddressesToAdd.first;
         auto saplingAddressesToAdd = decryptedNotes.saplingNoteDataAndAddressesToAdd.second;
         for (const auto &addressToAdd : saplingAddressesToAdd) {
+            // The mapping may have been added since the notes were decrypted.
+            if (HaveSaplingIncomingViewingKey(addressToAdd.first)) {
+                continue;
+            }
             // Add mapping between address and IVK for easy future lookup.
             if (!AddSaplingPaymentAddress(addressToAdd.second, addressToAdd.first)) {
                 return false;
@@ -3534,7 +3968,11 @@ bool CWallet::AddToWalletIfInvolvingMe(
         // Orchard
         std::optional<OrchardWalletTxMeta> orchardTxMeta;
         if (consensus.NetworkUpgradeActive(nHeight, Consensus::UPGRADE_NU5)) {
-            orchardTxMeta = orchardWallet.AddNotesIfInvolvingMe(tx);
+            if (decryptedNotes.orchardHints.has_value()) {
+                orchardTxMeta = orchardWallet.AddNotesIfInvolvingMe(tx, decryptedNotes.orchardHints.value());
+            } else {
+                orchardTxMeta = orchardWallet.AddNotesIfInvolvingMe(tx);
+            }
         }
 
         if (fExisted || IsMine(tx) || IsFromMe(tx) ||
@@ -3571,64 +4009,113 @@ bool CWallet::AddToWalletIfInvolvingMe(
     }
 }
 
-rust::Box<wallet::BatchScanner> WalletBatchScanner::CreateBatchScanner(CWallet* pwallet) {
-    LOCK(pwallet->cs_KeyStore);
+rust::Box<wallet::BatchScanner> WalletBatchScanner::CreateBatchScanner(CWallet* pwallet, bool fWatchOnly, size_t& nSaplingKeys, bool& fOrchardKeys) {
+    LOCK2(pwallet->cs_wallet, pwallet->cs_KeyStore);
 
     auto network = Params().RustNetwork();
 
     // TODO: Pass the map across the FFI once cxx supports it.
     std::vector<std::array<uint8_t, 32>> ivks;
     for (const auto& it : pwallet->mapSaplingFullViewingKeys) {
+        if (!fWatchOnly && !pwallet->HaveSaplingSpendingKey(it.second)) {
+            continue;
+        }
         SaplingIncomingViewingKey ivk = it.first;
         ivks.push_back(ivk.GetRawBytes());
     }
+    nSaplingKeys = ivks.size();
+
+    auto orchardIvks = pwallet->orchardWallet.GetIncomingViewingKeys(!fWatchOnly);
+    fOrchardKeys = !orchardIvks.empty();
 
     return wallet::init_batch_scanner(
         *network,
-        {ivks.data(), ivks.size()});
+        {ivks.data(), ivks.size()},
+        {orchardIvks.data(), orchardIvks.size()});
 }
 
-bool WalletBatchScanner::AddToWalletIfInvolvingMe(
-    const Consensus::Params& consensus,
-    const CTransaction& tx,
-    const CBlock* pblock,
-    const int nHeight,
-    bool fUpdate)
+wallet::BatchScanner& WalletBatchScanner::GetInner(const uint256& blockTag)
 {
-    AssertLockHeld(pwallet->cs_wallet);
+    if (!blockTag.IsNull() || fScanMempoolWatchOnly) {
+        return *inner;
+    }
+    if (!innerMempool.has_value()) {
+        size_t nMempoolSaplingKeys;
+        bool fMempoolOrchardKeys;
+        innerMempool.emplace(CreateBatchScanner(pwallet, false, nMempoolSaplingKeys, fMempoolOrchardKeys));
+    }
+    return **innerMempool;
+}
 
+void WalletBatchScanner::CollectResults(const CTransaction& tx, const CBlock* pblock)
+{
     auto decryptedNotesForTx = decryptedNotes.find(tx.GetHash());
     if (decryptedNotesForTx == decryptedNotes.end()) {
         throw std::logic_error("Called WalletBatchScanner::AddToWalletIfInvolvingMe with a tx that wasn't passed to AddTransaction");
     }
-    auto decryptedNotes = decryptedNotesForTx->second;
+    bool fSaplingQueued = saplingQueued.erase(tx.GetHash()) > 0;
+    bool fOrchardQueued = orchardQueued.erase(tx.GetHash()) > 0;
+    if (!fSaplingQueued && !fOrchardQueued) {
+        return;
+    }
 
     // Fill in the details about decrypted Sapling notes.
     uint256 blockTag;
     if (pblock) {
         blockTag = pblock->GetHash();
     }
-    auto batchResults = inner->collect_results(blockTag.GetRawBytes(), tx.GetHash().GetRawBytes());
-    for (auto decrypted : batchResults->get_sapling()) {
+    auto batchResults = GetInner(blockTag).collect_results(blockTag.GetRawBytes(), tx.GetHash().GetRawBytes());
+
+    // The Orchard notes are decrypted again with the keys found here when the
+    // transaction is added to the wallet.
+    if (fOrchardQueued) {
+        auto& orchardHints = decryptedNotesForTx->second.orchardHints.emplace();
+        for (const auto& decrypted : batchResults->get_orchard()) {
+            orchardHints.emplace_back(decrypted.action, decrypted.ivk);
+        }
+    }
+    if (!fSaplingQueued) {
+        return;
+    }
+
+    auto saplingResults = batchResults->get_sapling();
+    // Only remember misses that were checked against all of the keys.
+    if (saplingResults.empty() && !pblock && fScanMempoolWatchOnly) {
+        LOCK(pwallet->cs_wallet);
+        pwallet->AddSaplingNotMine(tx.GetHash(), nSaplingKeys);
+    }
+    for (auto decrypted : saplingResults) {
         SaplingIncomingViewingKey ivk(uint256::FromRawBytes(decrypted.ivk));
         libzcash::SaplingPaymentAddress addr(
             decrypted.diversifier,
             uint256::FromRawBytes(decrypted.pk_d));
 
-        decryptedNotes.saplingNoteDataAndAddressesToAdd.first.insert(
+        decryptedNotesForTx->second.saplingNoteDataAndAddressesToAdd.first.insert(
             std::make_pair(
                 SaplingOutPoint(uint256::FromRawBytes(decrypted.txid), decrypted.output),
                 SaplingNoteData(ivk)));
 
         // Only track the recipient -> ivk mappings the wallet doesn't have.
-        if (pwallet->mapSaplingIncomingViewingKeys.count(addr) == 0) {
-            decryptedNotes.saplingNoteDataAndAddressesToAdd.second.insert(
+        if (!pwallet->HaveSaplingIncomingViewingKey(addr)) {
+            decryptedNotesForTx->second.saplingNoteDataAndAddressesToAdd.second.insert(
                 std::make_pair(addr, ivk));
         }
     }
+}
+
+bool WalletBatchScanner::AddToWalletIfInvolvingMe(
+    const Consensus::Params& consensus,
+    const CTransaction& tx,
+    const CBlock* pblock,
+    const int nHeight,
+    bool fUpdate)
+{
+    AssertLockHeld(pwallet->cs_wallet);
+
+    CollectResults(tx, pblock);
 
     return pwallet->AddToWalletIfInvolvingMe(
-        consensus, tx, pblock, nHeight, decryptedNotes, fUpdate);
+        consensus, tx, pblock, nHeight, decryptedNotes.at(tx.GetHash()), fUpdate);
 }
 
 //
@@ -3637,7 +4124,6 @@ bool WalletBatchScanner::AddToWalletIfInvolvingMe(
 
 void WalletBatchScanner::AddTransaction(
     const CTransaction &tx,
-    const std::vector<unsigned char> &txBytes,
     const uint256 &blockTag,
     const int nHeight)
 {
@@ -3645,12 +4131,43 @@ void WalletBatchScanner::AddTransaction(
     decryptedNotes.insert(
         std::make_pair(tx.GetHash(), pwallet->TryDecryptShieldedOutputs(tx)));
 
-    // Queue Sapling outputs for trial decryption.
-    inner->add_transaction(blockTag.GetRawBytes(), {txBytes.data(), txBytes.size()}, nHeight);
+    // Queue Sapling outputs and Orchard actions for trial decryption. The
+    // batch scanner parses the transaction only for its shielded outputs, so
+    // most transactions do not need to be serialized for it. Sapling outputs
+    // that were found not to be ours when the transaction entered the mempool
+    // are skipped when it is mined. With -scanmempoolwatchonly=0, mempool
+    // transactions are only trial decrypted with the keys we can spend with.
+    bool fQueueSapling = tx.GetSaplingOutputsCount() > 0;
+    if (fQueueSapling && !blockTag.IsNull()) {
+        LOCK(pwallet->cs_wallet);
+        if (pwallet->EraseSaplingNotMine(tx.GetHash(), nSaplingKeys)) {
+            fQueueSapling = false;
+        }
+    }
+    bool fQueueOrchard = fOrchardKeys && tx.GetOrchardBundle().GetNumActions() > 0;
+    if (!fQueueSapling && !fQueueOrchard) {
+        return;
+    }
+    if (fQueueSapling) {
+        saplingQueued.insert(tx.GetHash());
+    }
+    if (fQueueOrchard) {
+        orchardQueued.insert(tx.GetHash());
+    }
+
+    CDataStream ssTx(SER_NETWORK, PROTOCOL_VERSION);
+    ssTx << tx;
+    GetInner(blockTag).add_transaction(
+        blockTag.GetRawBytes(),
+        {reinterpret_cast<const unsigned char*>(ssTx.data()), ssTx.size()},
+        nHeight);
 }
 
 void WalletBatchScanner::Flush() {
     inner->flush();
+    if (innerMempool.has_value()) {
+        (*innerMempool)->flush();
+    }
 }
 
 void WalletBatchScanner::SyncTransaction(
@@ -3658,6 +4175,11 @@ void WalletBatchScanner::SyncTransaction(
     const CBlock *pblock,
     const int nHeight)
 {
+    // Wait for trial decryption before taking cs_wallet, so that mempool
+    // transactions being decrypted do not hold up RPC calls. Only applying
+    // the results needs the lock.
+    CollectResults(tx, pblock);
+
     LOCK(pwallet->cs_wallet);
 
     if (!AddToWalletIfInvolvingMe(Params().GetConsensus(), tx, pblock, nHeight, true)) {
@@ -3667,6 +4189,24 @@ void WalletBatchScanner::SyncTransaction(
     pwallet->MarkAffectedTransactionsDirty(tx);
 }
 
+void CWallet::AddSaplingNotMine(const uint256& txid, size_t nKeys)
+{
+    AssertLockHeld(cs_wallet);
+    if (nKeys != nSaplingNotMineKeys || setSaplingNotMine.size() >= MAX_SAPLING_NOT_MINE_TXIDS) {
+        setSaplingNotMine.clear();
+        nSaplingNotMineKeys = nKeys;
+    }
+    setSaplingNotMine.insert(txid);
+}
+
+bool CWallet::EraseSaplingNotMine(const uint256& txid, size_t nKeys)
+{
+    AssertLockHeld(cs_wallet);
+    // Keys are never removed from the wallet, so the same number of keys
+    // means the same keys.
+    return nKeys == nSaplingNotMineKeys && setSaplingNotMine.erase(txid) > 0;
+}
+
 BatchScanner* CWallet::GetBatchScanner()
 {
     LOCK(cs_wallet);
@@ -3714,6 +4254,10 @@ void CWallet::EraseFromWallet(const uint256 &hash)
         return;
     {
         LOCK(cs_wallet);
+        setMaybeSpendable.erase(hash);
+        mapBestChainTxHashes.erase(hash);
+        nLegacyBalanceGeneration++;
+        EraseShieldedTxNotes(hash);
         if (mapWallet.erase(hash))
             CWalletDB(strWalletFile).EraseTx(hash);
     }
@@ -3976,6 +4520,8 @@ isminetype CWallet::IsMine(const CTxIn &txin) const
 {
     {
         LOCK(cs_wallet);
+        if (!walletTxFilter.contains(txin.prevout.hash))
+            return ISMINE_NO;
         map<uint256, CWalletTx>::const_iterator mi = mapWallet.find(txin.prevout.hash);
         if (mi != mapWallet.end())
         {
@@ -3991,6 +4537,8 @@ CAmount CWallet::GetDebit(const CTxIn &txin, const isminefilter& filter) const
 {
     {
         LOCK(cs_wallet);
+        if (!walletTxFilter.contains(txin.prevout.hash))
+            return 0;
         map<uint256, CWalletTx>::const_iterator mi = mapWallet.find(txin.prevout.hash);
         if (mi != mapWallet.end())
         {
@@ -4005,6 +4553,13 @@ CAmount CWallet::GetDebit(const CTxIn &txin, const isminefilter& filter) const
 
 isminetype CWallet::IsMine(const CTxOut& txout) const
 {
+    {
+        // Most outputs are not ours, and are ruled out here without solving
+        // their scripts.
+        LOCK(cs_KeyStore);
+        if (!scriptPubKeyFilter.contains(txout.scriptPubKey))
+            return ISMINE_NO;
+    }
     return ::IsMine(*this, txout.scriptPubKey);
 }
 
@@ -4315,11 +4870,32 @@ void CWalletTx::SetOrchardTxMeta(OrchardWalletTxMeta txMeta)
     orchardTxMeta = txMeta;
 }
 
+void CWalletTx::EvictBody()
+{
+    CMutableTransaction mtx(*this);
+    mtx.vJoinSplit.clear();
+    mtx.saplingBundle = SaplingBundle();
+    mtx.orchardBundle = OrchardBundle();
+    SetContentsKeepingHash(CTransaction(std::move(mtx)));
+    fBodyEvicted = true;
+}
+
+void CWalletTx::RestoreBody(const CTransaction& tx)
+{
+    assert(tx.GetHash() == GetHash());
+    CTransaction::operator=(tx);
+    fBodyEvicted = false;
+}
+
 std::pair<SproutNotePlaintext, SproutPaymentAddress> CWalletTx::DecryptSproutNote(
     JSOutPoint jsop) const
 {
     LOCK(pwallet->cs_wallet);
 
+    if (fBodyEvicted) {
+        return pwallet->GetWalletTxWithBody(*this).DecryptSproutNote(jsop);
+    }
+
     auto nd = this->mapSproutNoteData.at(jsop);
     SproutPaymentAddress pa = nd.address;
 
@@ -4367,6 +4943,9 @@ std::optional<std::pair<
     if (this->mapSaplingNoteData.count(op) == 0) {
         return std::nullopt;
     }
+    if (fBodyEvicted) {
+        return pwallet->GetWalletTxWithBody(*this).DecryptSaplingNote(params, op);
+    }
 
     auto outputs = GetSaplingOutputs();
     auto& output = outputs[op.n];
@@ -4397,6 +4976,10 @@ std::optional<std::pair<
     SaplingNotePlaintext,
     SaplingPaymentAddress>> CWalletTx::RecoverSaplingNote(const CChainParams& params, SaplingOutPoint op, std::set<uint256>& ovks) const
 {
+    if (fBodyEvicted) {
+        return pwallet->GetWalletTxWithBody(*this).RecoverSaplingNote(params, op, ovks);
+    }
+
     auto outputs = GetSaplingOutputs();
     auto& output = outputs[op.n];
 
@@ -4428,6 +5011,9 @@ std::optional<std::pair<
 
 OrchardActions CWalletTx::RecoverOrchardActions(const std::vector<uint256>& ovks) const
 {
+    if (fBodyEvicted) {
+        return pwallet->GetWalletTxWithBody(*this).RecoverOrchardActions(ovks);
+    }
     return pwallet->orchardWallet.GetTxActions(*this, ovks);
 }
 
@@ -4442,6 +5028,11 @@ int64_t CWalletTx::GetTxTime() const
 void CWalletTx::GetAmounts(std::list<COutputEntry>& listReceived,
                            std::list<COutputEntry>& listSent, CAmount& nFee, const isminefilter& filter) const
 {
+    if (fBodyEvicted) {
+        pwallet->GetWalletTxWithBody(*this).GetAmounts(listReceived, listSent, nFee, filter);
+        return;
+    }
+
     nFee = 0;
     listReceived.clear();
     listSent.clear();
@@ -4616,10 +5207,123 @@ void CWallet::WitnessNoteCommitment(std::vector<uint256> commitments,
     }
 }
 
+namespace {
+
+//! How many blocks a rescan reads ahead of the block it adds to the wallet.
+static const size_t RESCAN_READAHEAD = 32;
+//! How many of those are queued for trial decryption at once.
+static const size_t RESCAN_DECRYPT_AHEAD = 16;
+//! The most threads a rescan reads blocks with.
+static const int MAX_RESCAN_READ_THREADS = 4;
+
+/**
+ * Reads and checks blocks for a rescan on a few threads of their own, so
+ * that the rescan does not wait for each block to be read, and for its
+ * Equihash solution to be checked, before decrypting it.
+ */
+class CRescanBlockReader
+{
+public:
+    struct Job
+    {
+        const CBlockIndex* pindex;
+        CDiskBlockPos pos;
+        uint256 hash;
+        bool fDone = false;
+        bool fOk = false;
+        CBlock block;
+    };
+
+private:
+    const Consensus::Params& consensus;
+    Mutex cs;
+    std::condition_variable cond;
+    std::deque<std::shared_ptr<Job>> queue;
+    bool fStop = false;
+    std::vector<std::thread> threads;
+
+    void ThreadRead()
+    {
+        RenameThread("zc-rescanread");
+        while (true) {
+            std::shared_ptr<Job> job;
+            {
+                WAIT_LOCK(cs, lock);
+                cond.wait(lock, [this] { return fStop || !queue.empty(); });
+                if (fStop) {
+                    return;
+                }
+                job = queue.front();
+                queue.pop_front();
+            }
+            CBlock block;
+            bool fOk = ReadBlockFromDisk(block, job->pos, consensus) && block.GetHash() == job->hash;
+            {
+                LOCK(cs);
+                job->fDone = true;
+                job->fOk = fOk;
+                job->block = std::move(block);
+            }
+            cond.notify_all();
+        }
+    }
+
+public:
+    CRescanBlockReader(const Consensus::Params& consensusIn, int nThreads) : consensus(consensusIn)
+    {
+        for (int i = 0; i < nThreads; i++) {
+            threads.emplace_back(&CRescanBlockReader::ThreadRead, this);
+        }
+    }
+
+    ~CRescanBlockReader()
+    {
+        {
+            LOCK(cs);
+            fStop = true;
+        }
+        cond.notify_all();
+        for (std::thread& thread : threads) {
+            thread.join();
+        }
+    }
+
+    //! Start reading the block of pindex. Requires cs_main.
+    std::shared_ptr<Job> Read(const CBlockIndex* pindex)
+    {
+        std::shared_ptr<Job> job = std::make_shared<Job>();
+        job->pindex = pindex;
+        job->pos = pindex->GetBlockPos();
+        job->hash = pindex->GetBlockHash();
+        {
+            LOCK(cs);
+            queue.push_back(job);
+        }
+        cond.notify_one();
+        return job;
+    }
+
+    //! Wait until the block of job has been read. Returns false if it could
+    //! not be.
+    bool Wait(const std::shared_ptr<Job>& job)
+    {
+        WAIT_LOCK(cs, lock);
+        cond.wait(lock, [&job] { return job->fDone; });
+        return job->fOk;
+    }
+};
+
+}
+
 /**
  * Scan the block chain (starting in pindexStart) for transactions
  * from or to us. If fUpdate is true, found transactions that already
  * exist in the wallet will be updated.
+ *
+ * Blocks are read ahead on a few threads, and the shielded outputs of the
+ * next RESCAN_DECRYPT_AHEAD blocks are trial-decrypted on the batch
+ * scanner's thread pool while earlier blocks are added to the wallet, which
+ * is still done in order.
  */
 std::optional<int> CWallet::ScanForWalletTransactions(
         CBlockIndex* pindexStart,
@@ -4693,6 +5397,13 @@ std::optional<int> CWallet::ScanForWalletTransactions(
         // Create a rescan-specific batch scanner for the wallet.
         auto batchScanner = WalletBatchScanner(this);
 
+        CRescanBlockReader reader(consensus, std::max(1, std::min(GetNumCores() / 2, MAX_RESCAN_READ_THREADS)));
+        // Blocks being read, oldest first; the first nQueued of them have been
+        // queued for trial decryption.
+        std::deque<std::shared_ptr<CRescanBlockReader::Job>> vReading;
+        size_t nQueued = 0;
+        const CBlockIndex* pindexNextRead = pindex;
+
         ShowProgress(_("Rescanning..."), 0); // show rescan progress in GUI as dialog or on splashscreen, if -rescan on startup
         double dProgressStart = Checkpoints::GuessVerificationProgress(chainParams.Checkpoints(), pindex, false);
         double dProgressTip = Checkpoints::GuessVerificationProgress(chainParams.Checkpoints(), chainActive.Tip(), false);
@@ -4704,18 +5415,30 @@ std::optional<int> CWallet::ScanForWalletTransactions(
             if (pindex->nHeight % 100 == 0 && dProgressTip - dProgressStart > 0.0)
                 ShowProgress(_("Rescanning..."), std::max(1, std::min(99, (int)((Checkpoints::GuessVerificationProgress(chainParams.Checkpoints(), pindex, false) - dProgressStart) / (dProgressTip - dProgressStart) * 100))));
 
-            CBlock block;
-            if (!ReadBlockFromDisk(block, pindex, consensus)) {
-                throw std::runtime_error(
-                    strprintf("Can't read block %d from disk (%s)", pindex->nHeight, pindex->GetBlockHash().GetHex()));
+            while (pindexNextRead && vReading.size() < RESCAN_READAHEAD) {
+                vReading.push_back(reader.Read(pindexNextRead));
+                pindexNextRead = chainActive.Next(pindexNextRead);
             }
-            for (CTransaction& tx : block.vtx) {
-                CDataStream ssTx(SER_NETWORK, PROTOCOL_VERSION);
-                ssTx << tx;
-                std::vector<unsigned char> txBytes(ssTx.begin(), ssTx.end());
-                batchScanner.AddTransaction(tx, txBytes, pindex->GetBlockHash(), pindex->nHeight);
+            while (nQueued < vReading.size() && nQueued < RESCAN_DECRYPT_AHEAD) {
+                const std::shared_ptr<CRescanBlockReader::Job>& job = vReading[nQueued];
+                const CBlockIndex* pindexJob = job->pindex;
+                if (!reader.Wait(job)) {
+                    throw std::runtime_error(
+                        strprintf("Can't read block %d from disk (%s)", pindexJob->nHeight, pindexJob->GetBlockHash().GetHex()));
+                }
+                for (CTransaction& tx : job->block.vtx) {
+                    batchScanner.AddTransaction(tx, pindexJob->GetBlockHash(), pindexJob->nHeight);
+                }
+                // Start decrypting the outputs of the block, without waiting
+                // for them.
+                batchScanner.Flush();
+                nQueued++;
             }
-            batchScanner.Flush();
+
+            assert(vReading.front()->pindex == pindex);
+            CBlock block = std::move(vReading.front()->block);
+            vReading.pop_front();
+            nQueued--;
             for (CTransaction& tx : block.vtx)
             {
                 if (batchScanner.AddToWalletIfInvolvingMe(consensus, tx, &block, pindex->nHeight, fUpdate)) {
@@ -4750,11 +5473,15 @@ std::optional<int> CWallet::ScanForWalletTransactions(
         }
 
         // After rescanning, persist Sapling & Orchard note data that might have changed,
-        // e.g. nullifiers. Do not flush the wallet here for performance reasons.
+        // e.g. nullifiers. Do not flush the wallet here for performance reasons,
+        // and write all of it in one database transaction rather than one per
+        // wallet transaction.
         CWalletDB walletdb(strWalletFile, "r+", false);
+        bool fBatch = walletdb.TxnBegin();
         for (auto hash : myTxHashes) {
             CWalletTx wtx = mapWallet[hash];
             if (!wtx.mapSaplingNoteData.empty() || !wtx.orchardTxMeta.empty()) {
+                mapBestChainTxHashes.erase(hash);
                 if (!walletdb.WriteTx(wtx)) {
                     LogPrintf(
                             "Rescanning... WriteToDisk failed to update Sapling/Orchard note data for tx: %s\n",
@@ -4762,6 +5489,9 @@ std::optional<int> CWallet::ScanForWalletTransactions(
                 }
             }
         }
+        if (fBatch && !walletdb.TxnCommit()) {
+            LogPrintf("Rescanning... failed to commit updated Sapling/Orchard note data\n");
+        }
 
         ShowProgress(_("Rescanning..."), 100); // hide progress dialog in GUI
     }
@@ -4974,6 +5704,9 @@ bool CWalletTx::IsFromMe(const isminefilter& filter) const
     if (GetDebit(filter) > 0) {
         return true;
     }
+    if (fBodyEvicted) {
+        return pwallet->GetWalletTxWithBody(*this).IsFromMe(filter);
+    }
     for (const JSDescription& jsdesc : vJoinSplit) {
         for (const uint256& nullifier : jsdesc.nullifiers) {
             if (pwallet->IsSproutNullifierFromMe(nullifier)) {
@@ -5087,9 +5820,9 @@ CAmount CWallet::GetBalance(const std::optional<int>& asOfHeight, const isminefi
     CAmount nTotal = 0;
     {
         LOCK2(cs_main, cs_wallet);
-        for (const auto& entry : mapWallet)
+        // Transactions whose outputs are all spent add nothing.
+        for (const CWalletTx* pcoin : GetMaybeSpendableTxs(asOfHeight))
         {
-            const CWalletTx* pcoin = &entry.second;
             if (pcoin->IsTrusted(asOfHeight) && pcoin->GetDepthInMainChain(asOfHeight) >= min_depth) {
                 nTotal += pcoin->GetAvailableCredit(asOfHeight, true, filter);
             }
@@ -5104,9 +5837,8 @@ CAmount CWallet::GetUnconfirmedTransparentBalance() const
     CAmount nTotal = 0;
     {
         LOCK2(cs_main, cs_wallet);
-        for (const auto& entry : mapWallet)
+        for (const CWalletTx* pcoin : GetMaybeSpendableTxs(std::nullopt))
         {
-            const CWalletTx* pcoin = &entry.second;
             if (!CheckFinalTx(*pcoin) || (!pcoin->IsTrusted(std::nullopt) && pcoin->GetDepthInMainChain(std::nullopt) == 0))
                 nTotal += pcoin->GetAvailableCredit(std::nullopt);
         }
@@ -5119,9 +5851,9 @@ CAmount CWallet::GetImmatureBalance(const std::optional<int>& asOfHeight) const
     CAmount nTotal = 0;
     {
         LOCK2(cs_main, cs_wallet);
-        for (const auto& entry : mapWallet)
+        // Immature coinbase outputs cannot have been spent.
+        for (const CWalletTx* pcoin : GetMaybeSpendableTxs(asOfHeight))
         {
-            const CWalletTx* pcoin = &entry.second;
             nTotal += pcoin->GetImmatureCredit(asOfHeight);
         }
     }
@@ -5138,11 +5870,26 @@ CAmount CWallet::GetLegacyBalance(const isminefilter& filter, int minDepth) cons
 {
     LOCK2(cs_main, cs_wallet);
 
+    // Time-locked transactions can become final without a new block, so
+    // balances that left out a non-final transaction are not cached.
+    const auto key = std::make_pair(filter, minDepth);
+    auto it = mapLegacyBalanceCache.find(key);
+    if (it != mapLegacyBalanceCache.end() &&
+        it->second.pindexTip == chainActive.Tip() &&
+        it->second.nGeneration == nLegacyBalanceGeneration) {
+        return it->second.nBalance;
+    }
+
     CAmount balance = 0;
+    bool fCacheable = true;
     for (const auto& entry : mapWallet) {
         const CWalletTx& wtx = entry.second;
         const int depth = wtx.GetDepthInMainChain(std::nullopt);
-        if (depth < 0 || !CheckFinalTx(wtx) || wtx.GetBlocksToMaturity(std::nullopt) > 0) {
+        if (depth < 0 || wtx.GetBlocksToMaturity(std::nullopt) > 0) {
+            continue;
+        }
+        if (!CheckFinalTx(wtx)) {
+            fCacheable = false;
             continue;
         }
 
@@ -5164,6 +5911,11 @@ CAmount CWallet::GetLegacyBalance(const isminefilter& filter, int minDepth) cons
         }
     }
 
+    if (fCacheable) {
+        mapLegacyBalanceCache[key] = {chainActive.Tip(), nLegacyBalanceGeneration, balance};
+    } else if (it != mapLegacyBalanceCache.end()) {
+        mapLegacyBalanceCache.erase(it);
+    }
     return balance;
 }
 
@@ -5185,7 +5937,9 @@ void CWallet::AvailableCoins(vector<COutput>& vCoins,
     vCoins.clear();
 
     {
-        for (const auto& [wtxid, pcoin] : mapWallet) {
+        for (const CWalletTx* pwtx : GetMaybeSpendableTxs(asOfHeight)) {
+            const CWalletTx& pcoin = *pwtx;
+            const uint256& wtxid = pcoin.GetHash();
             if (!CheckFinalTx(pcoin))
                 continue;
 
@@ -5941,6 +6695,7 @@ bool CWallet::SetAddressBook(const CTxDestination& address, const string& strNam
         mapAddressBook[address].name = strName;
         if (!strPurpose.empty()) /* update purpose only if requested */
             mapAddressBook[address].purpose = strPurpose;
+        nLegacyBalanceGeneration++;
     }
     NotifyAddressBookChanged(this, address, strName, ::IsMine(*this, address) != ISMINE_NO,
                              strPurpose, (fUpdated ? CT_UPDATED : CT_NEW) );
@@ -5968,6 +6723,7 @@ bool CWallet::DelAddressBook(const CTxDestination& address)
             }
         }
         mapAddressBook.erase(address);
+        nLegacyBalanceGeneration++;
     }
 
     NotifyAddressBookChanged(this, address, "", ::IsMine(*this, address) != ISMINE_NO, "", CT_DELETED);
@@ -6007,12 +6763,16 @@ bool CWallet::NewKeyPool()
             return false;
 
         int64_t nKeys = max(GetArg("-keypool", DEFAULT_KEYPOOL_SIZE), (int64_t)0);
-        for (int i = 0; i < nKeys; i++)
+        bool fBatch = walletdb.TxnBegin();
+        int64_t nIndex = 1;
+        for (const CPubKey& pubkey : GenerateNewKeys(nKeys, false, walletdb))
         {
-            int64_t nIndex = i+1;
-            walletdb.WritePool(nIndex, CKeyPool(GenerateNewKey(false)));
+            walletdb.WritePool(nIndex, CKeyPool(pubkey));
             setKeyPool.insert(nIndex);
+            nIndex++;
         }
+        if (fBatch && !walletdb.TxnCommit())
+            throw runtime_error("NewKeyPool(): committing generated keys failed");
         LogPrintf("CWallet::NewKeyPool wrote %d new keys\n", nKeys);
     }
     return true;
@@ -6035,16 +6795,26 @@ bool CWallet::TopUpKeyPool(unsigned int kpSize)
         else
             nTargetSize = max(GetArg("-keypool", DEFAULT_KEYPOOL_SIZE), (int64_t) 0);
 
-        while (setKeyPool.size() < (nTargetSize + 1))
+        if (setKeyPool.size() >= (nTargetSize + 1))
+            return true;
+
+        // Derive the missing keys together, and write them, their pool
+        // entries and the HD chain in one database transaction rather than
+        // several for each key.
+        int64_t nEnd = 1;
+        if (!setKeyPool.empty())
+            nEnd = *(--setKeyPool.end()) + 1;
+        bool fBatch = walletdb.TxnBegin();
+        for (const CPubKey& pubkey : GenerateNewKeys(nTargetSize + 1 - setKeyPool.size(), false, walletdb))
         {
-            int64_t nEnd = 1;
-            if (!setKeyPool.empty())
-                nEnd = *(--setKeyPool.end()) + 1;
-            if (!walletdb.WritePool(nEnd, CKeyPool(GenerateNewKey(false))))
+            if (!walletdb.WritePool(nEnd, CKeyPool(pubkey)))
                 throw runtime_error("TopUpKeyPool(): writing generated key failed");
             setKeyPool.insert(nEnd);
-            LogPrintf("keypool added key %d, size=%u\n", nEnd, setKeyPool.size());
+            nEnd++;
         }
+        if (fBatch && !walletdb.TxnCommit())
+            throw runtime_error("TopUpKeyPool(): committing generated keys failed");
+        LogPrintf("keypool added keys up to %d, size=%u\n", nEnd - 1, setKeyPool.size());
     }
     return true;
 }
@@ -6546,6 +7316,11 @@ bool CWallet::GetDestData(const CTxDestination &dest, const std::string &key, st
 std::string CWallet::GetWalletHelpString(bool showDebug)
 {
     std::string strUsage = HelpMessageGroup(_("Wallet options:"));
+    strUsage += HelpMessageOpt("-consolidation", _("Periodically merge the Sapling notes of each spending key into fewer notes while the wallet is idle"));
+    strUsage += HelpMessageOpt("-consolidationfeebudget=<amt>", strprintf(_("Maximum total fee (in %s) paid by the transactions of one consolidation run (default: %s)"),
+                                                                   CURRENCY_UNIT, FormatMoney(DEFAULT_CONSOLIDATION_FEE_BUDGET)));
+    strUsage += HelpMessageOpt("-consolidationmaxnotes=<n>", strprintf(_("Maximum number of notes spent by a consolidation transaction (default: %u)"), DEFAULT_CONSOLIDATION_MAX_NOTES));
+    strUsage += HelpMessageOpt("-consolidationmaxtxs=<n>", strprintf(_("Maximum number of transactions created by one consolidation run (default: %u)"), DEFAULT_CONSOLIDATION_MAX_TXS));
     strUsage += HelpMessageOpt("-disablewallet", _("Do not load the wallet and disable wallet RPC calls"));
     strUsage += HelpMessageOpt("-keypool=<n>", strprintf(_("Set key pool size to <n> (default: %u)"), DEFAULT_KEYPOOL_SIZE));
     strUsage += HelpMessageOpt("-migration", _("Enable the Sprout to Sapling migration"));
@@ -6557,11 +7332,13 @@ std::string CWallet::GetWalletHelpString(bool showDebug)
                                                             CURRENCY_UNIT));
     strUsage += HelpMessageOpt("-rescan", _("Rescan the block chain for missing wallet transactions on startup"));
     strUsage += HelpMessageOpt("-salvagewallet", _("Attempt to recover private keys from a corrupt wallet on startup (implies -rescan)"));
+    strUsage += HelpMessageOpt("-scanmempoolwatchonly", strprintf(_("Look for notes to watch-only Sapling viewing keys in mempool transactions; if disabled, they are found once the transaction is mined (default: %u)"), DEFAULT_SCAN_MEMPOOL_WATCH_ONLY));
     strUsage += HelpMessageOpt("-spendzeroconfchange", strprintf(_("Spend unconfirmed change when sending transactions (default: %u)"), DEFAULT_SPEND_ZEROCONF_CHANGE));
     strUsage += HelpMessageOpt("-txexpirydelta", strprintf(_("Set the number of blocks after which a transaction that has not been mined will become invalid (min: %u, default: %u (pre-Blossom) or %u (post-Blossom))"), TX_EXPIRING_SOON_THRESHOLD + 1, DEFAULT_PRE_BLOSSOM_TX_EXPIRY_DELTA, DEFAULT_POST_BLOSSOM_TX_EXPIRY_DELTA));
     strUsage += HelpMessageOpt("-upgradewallet", _("Upgrade wallet to latest format on startup"));
     strUsage += HelpMessageOpt("-wallet=<file>", _("Specify wallet file absolute path or a path relative to the data directory") + " " + strprintf(_("(default: %s)"), DEFAULT_WALLET_DAT));
     strUsage += HelpMessageOpt("-walletbroadcast", _("Make the wallet broadcast transactions") + " " + strprintf(_("(default: %u)"), DEFAULT_WALLETBROADCAST));
+    strUsage += HelpMessageOpt("-walletevicttxbodies", strprintf(_("Keep the shielded data of old wallet transactions whose notes are all spent only in the wallet file, and read it from there when needed (default: %u)"), DEFAULT_EVICT_TX_BODIES));
     strUsage += HelpMessageOpt("-walletnotify=<cmd>", _("Execute command when a wallet transaction changes (%s in cmd is replaced by TxID)"));
     strUsage += HelpMessageOpt("-zapwallettxes=<mode>", _("Delete all wallet transactions and only recover those parts of the blockchain through -rescan on startup") +
                                " " + _("(1 = keep tx meta data e.g. account owner and payment request information, 2 = drop tx meta data)"));
@@ -6660,6 +7437,7 @@ bool CWallet::InitLoadWallet(const CChainParams& params, bool clearWitnessCaches
 
     // Set sapling migration status
     walletInstance->fSaplingMigrationEnabled = GetBoolArg("-migration", false);
+    walletInstance->fSaplingConsolidationEnabled = GetBoolArg("-consolidation", false);
 
     if (fFirstRun)
     {
@@ -6820,6 +7598,8 @@ bool CWallet::ParameterInteraction(const CChainParams& params)
         expiryDeltaArg = expiryDelta;
     }
     bSpendZeroConfChange = GetBoolArg("-spendzeroconfchange", DEFAULT_SPEND_ZEROCONF_CHANGE);
+    fScanMempoolWatchOnly = GetBoolArg("-scanmempoolwatchonly", DEFAULT_SCAN_MEMPOOL_WATCH_ONLY);
+    fEvictTxBodies = GetBoolArg("-walletevicttxbodies", DEFAULT_EVICT_TX_BODIES);
 
     if (GetBoolArg("-sendfreetransactions", false)) {
         return UIError(_("The argument -sendfreetransactions is no longer supported."));
@@ -6851,6 +7631,26 @@ bool CWallet::ParameterInteraction(const CChainParams& params)
         }
         nOrchardActionLimit = limit;
     }
+    if (mapArgs.count("-consolidationmaxnotes")) {
+        int64_t maxNotes = atoi64(mapArgs["-consolidationmaxnotes"]);
+        if (maxNotes < (int64_t)MIN_CONSOLIDATION_NOTES) {
+            return UIError(strprintf(_("Invalid value for -consolidationmaxnotes='%u' (must be least %u)"), maxNotes, MIN_CONSOLIDATION_NOTES));
+        }
+        nConsolidationMaxNotes = maxNotes;
+    }
+    if (mapArgs.count("-consolidationmaxtxs")) {
+        int64_t maxTxs = atoi64(mapArgs["-consolidationmaxtxs"]);
+        if (maxTxs < 1) {
+            return UIError(strprintf(_("Invalid value for -consolidationmaxtxs='%u' (must be least 1)"), maxTxs));
+        }
+        nConsolidationMaxTxs = maxTxs;
+    }
+    if (mapArgs.count("-consolidationfeebudget")) {
+        CAmount nFeeBudget = 0;
+        if (!ParseMoney(mapArgs["-consolidationfeebudget"], nFeeBudget))
+            return UIError(AmountErrMsg("consolidationfeebudget", mapArgs["-consolidationfeebudget"]));
+        nConsolidationFeeBudget = nFeeBudget;
+    }
 
     return true;
 }
@@ -7022,8 +7822,17 @@ void CWallet::GetFilteredNotes(
     LOCK2(cs_main, cs_wallet);
 
     KeyIO keyIO(Params());
-    for (auto & p : mapWallet) {
-        CWalletTx wtx = p.second;
+    std::vector<const CWalletTx*> vTxs;
+    if (ignoreSpent) {
+        vTxs = GetMaybeSpendableTxs(asOfHeight);
+    } else {
+        vTxs.reserve(mapWallet.size());
+        for (const auto& [wtxid, wtx] : mapWallet) {
+            vTxs.push_back(&wtx);
+        }
+    }
+    for (const CWalletTx* pwtx : vTxs) {
+        const CWalletTx& wtx = *pwtx;
 
         // Filter the transactions before checking for notes
         if (!CheckFinalTx(wtx) ||
@@ -7037,6 +7846,7 @@ void CWallet::GetFilteredNotes(
             continue;
         }
 
+        std::optional<CWalletTx> wtxWithBody;
         for (auto & pair : wtx.mapSproutNoteData) {
             JSOutPoint jsop = pair.first;
             SproutNoteData nd = pair.second;
@@ -7072,16 +7882,21 @@ void CWallet::GetFilteredNotes(
                 throw std::runtime_error(strprintf("Could not find note decryptor for payment address %s", keyIO.EncodePaymentAddress(pa)));
             }
 
+            if (wtx.fBodyEvicted && !wtxWithBody.has_value()) {
+                wtxWithBody = GetWalletTxWithBody(wtx);
+            }
+            const CWalletTx& wtxFull = wtxWithBody.has_value() ? wtxWithBody.value() : wtx;
+
             // determine amount of funds in the note
             auto hSig = ZCJoinSplit::h_sig(
-                wtx.vJoinSplit[i].randomSeed,
-                wtx.vJoinSplit[i].nullifiers,
-                wtx.joinSplitPubKey);
+                wtxFull.vJoinSplit[i].randomSeed,
+                wtxFull.vJoinSplit[i].nullifiers,
+                wtxFull.joinSplitPubKey);
             try {
                 SproutNotePlaintext plaintext = SproutNotePlaintext::decrypt(
                         decryptor,
-                        wtx.vJoinSplit[i].ciphertexts[j],
-                        wtx.vJoinSplit[i].ephemeralKey,
+                        wtxFull.vJoinSplit[i].ciphertexts[j],
+                        wtxFull.vJoinSplit[i].ephemeralKey,
                         hSig,
                         (unsigned char) j);
 
@@ -7825,6 +8640,50 @@ void SpendableInputs::LimitTransparentUtxos(size_t maxUtxoCount)
     }
 }
 
+/**
+ * Select as few of `entries` as are needed for `wouldSuffice` to hold, adding
+ * their values to `totalSelected`, and discard the others. Notes are taken
+ * largest first, which minimizes the number of spends, but the last one is
+ * the smallest that suffices, so that large notes are kept for later and
+ * small ones are used up. If even all of the entries do not suffice, they
+ * are all selected.
+ */
+template<typename Entry, typename Value, typename WouldSuffice>
+static void SelectFewest(
+    std::vector<Entry>& entries,
+    CAmount& totalSelected,
+    Value value,
+    WouldSuffice wouldSuffice)
+{
+    if (wouldSuffice(0)) {
+        entries.clear();
+        return;
+    }
+    std::sort(entries.begin(), entries.end(),
+        [&](const Entry& i, const Entry& j) -> bool {
+            return value(i) > value(j);
+        });
+    CAmount prefix{0};
+    for (size_t i = 0; i < entries.size(); i++) {
+        if (!wouldSuffice(prefix + value(entries[i]))) {
+            prefix += value(entries[i]);
+            continue;
+        }
+        // The smallest of the remaining entries that suffices. Change below
+        // the dust threshold does not, so larger entries are not always
+        // sufficient when smaller ones are.
+        size_t j = entries.size() - 1;
+        while (!wouldSuffice(prefix + value(entries[j]))) {
+            j--;
+        }
+        std::swap(entries[i], entries[j]);
+        totalSelected += prefix + value(entries[i]);
+        entries.erase(entries.begin() + i + 1, entries.end());
+        return;
+    }
+    totalSelected += prefix;
+}
+
 bool SpendableInputs::LimitToAmount(
     const CAmount amountRequired,
     const CAmount dustThreshold,
@@ -7852,16 +8711,9 @@ bool SpendableInputs::LimitToAmount(
     } else {
         // Select Sprout notes for spending first - if possible, we want users to
         // spend any notes that they still have in the Sprout pool.
-        std::sort(sproutNoteEntries.begin(), sproutNoteEntries.end(),
-            [](SproutNoteEntry i, SproutNoteEntry j) -> bool {
-                return i.note.value() > j.note.value();
-            });
-        auto sproutIt = sproutNoteEntries.begin();
-        while (sproutIt != sproutNoteEntries.end() && !haveSufficientFunds()) {
-            totalSelected += sproutIt->note.value();
-            ++sproutIt;
-        }
-        sproutNoteEntries.erase(sproutIt, sproutNoteEntries.end());
+        SelectFewest(sproutNoteEntries, totalSelected,
+            [](const SproutNoteEntry& entry) { return CAmount(entry.note.value()); },
+            wouldSuffice);
     }
 
     // Check what input pools we have available.
@@ -8029,52 +8881,35 @@ bool SpendableInputs::LimitToAmount(
         switch (pool) {
             case OutputPool::Transparent:
             {
-                std::sort(utxos.begin(), utxos.end(),
-                    [](COutput i, COutput j) -> bool {
-                        return i.Value() > j.Value();
-                    });
                 if (opportunisticShielding) {
                     // Select all transparent coins.
+                    std::sort(utxos.begin(), utxos.end(),
+                        [](COutput i, COutput j) -> bool {
+                            return i.Value() > j.Value();
+                        });
                     totalSelected += availableTransparent;
                 } else {
                     // Only select as many as we need.
-                    auto utxoIt = utxos.begin();
-                    while (utxoIt != utxos.end() && !haveSufficientFunds()) {
-                        totalSelected += utxoIt->Value();
-                        ++utxoIt;
-                    }
-                    utxos.erase(utxoIt, utxos.end());
+                    SelectFewest(utxos, totalSelected,
+                        [](const COutput& utxo) { return utxo.Value(); },
+                        wouldSuffice);
                 }
                 break;
             }
 
             case OutputPool::Sapling:
             {
-                std::sort(saplingNoteEntries.begin(), saplingNoteEntries.end(),
-                    [](SaplingNoteEntry i, SaplingNoteEntry j) -> bool {
-                        return i.note.value() > j.note.value();
-                    });
-                auto saplingIt = saplingNoteEntries.begin();
-                while (saplingIt != saplingNoteEntries.end() && !haveSufficientFunds()) {
-                    totalSelected += saplingIt->note.value();
-                    ++saplingIt;
-                }
-                saplingNoteEntries.erase(saplingIt, saplingNoteEntries.end());
+                SelectFewest(saplingNoteEntries, totalSelected,
+                    [](const SaplingNoteEntry& entry) { return CAmount(entry.note.value()); },
+                    wouldSuffice);
                 break;
             }
 
             case OutputPool::Orchard:
             {
-                std::sort(orchardNoteMetadata.begin(), orchardNoteMetadata.end(),
-                    [](OrchardNoteMetadata i, OrchardNoteMetadata j) -> bool {
-                        return i.GetNoteValue() > j.GetNoteValue();
-                    });
-                auto orchardIt = orchardNoteMetadata.begin();
-                while (orchardIt != orchardNoteMetadata.end() && !haveSufficientFunds()) {
-                    totalSelected += orchardIt->GetNoteValue();
-                    ++orchardIt;
-                }
-                orchardNoteMetadata.erase(orchardIt, orchardNoteMetadata.end());
+                SelectFewest(orchardNoteMetadata, totalSelected,
+                    [](const OrchardNoteMetadata& entry) { return entry.GetNoteValue(); },
+                    wouldSuffice);
                 break;
             }
         }
@@ -9,7 +9,10 @@
 
 #include "amount.h"
 #include "asyncrpcoperation.h"
+#include "bloom.h"
+#include "clientversion.h"
 #include "coins.h"
+#include "hash.h"
 #include "key.h"
 #include "keystore.h"
 #include "main.h"
@@ -33,7 +36,9 @@
 #include "base58.h"
 
 #include <algorithm>
+#include <list>
 #include <map>
+#include <memory>
 #include <optional>
 #include <set>
 #include <stdexcept>
@@ -54,10 +59,16 @@ extern CWallet* pwalletMain;
 extern CFeeRate payTxFee;
 extern bool bSpendZeroConfChange;
 extern bool fPayAtLeastCustomFee;
+extern bool fScanMempoolWatchOnly;
+extern bool fEvictTxBodies;
 extern unsigned int nAnchorConfirmations;
 // The maximum number of Orchard actions permitted within a single transaction.
 // This can be overridden with the -orchardactionlimit config option
 extern unsigned int nOrchardActionLimit;
+// Limits on each background consolidation run (-consolidation).
+extern unsigned int nConsolidationMaxNotes;
+extern unsigned int nConsolidationMaxTxs;
+extern CAmount nConsolidationFeeBudget;
 
 static const unsigned int DEFAULT_KEYPOOL_SIZE = 100;
 //! -paytxfee default
@@ -66,12 +77,43 @@ static const CAmount DEFAULT_TRANSACTION_FEE = 0;
 static const CAmount MIN_CHANGE = CENT;
 //! Default for -spendzeroconfchange
 static const bool DEFAULT_SPEND_ZEROCONF_CHANGE = true;
+//! Default for -scanmempoolwatchonly
+static const bool DEFAULT_SCAN_MEMPOOL_WATCH_ONLY = true;
+//! Default for -walletevicttxbodies
+static const bool DEFAULT_EVICT_TX_BODIES = false;
+//! Number of evicted transaction bodies kept in memory after they are read
+//! back from the wallet database.
+static const size_t TX_BODY_CACHE_SIZE = 100;
+//! Number of wallet transactions whose decrypted shielded notes are kept for
+//! z_viewtransaction.
+static const size_t SHIELDED_TX_NOTES_CACHE_SIZE = 1000;
+//! -consolidationmaxnotes default
+static const unsigned int DEFAULT_CONSOLIDATION_MAX_NOTES = 50;
+//! -consolidationmaxtxs default
+static const unsigned int DEFAULT_CONSOLIDATION_MAX_TXS = 5;
+//! -consolidationfeebudget default
+static const CAmount DEFAULT_CONSOLIDATION_FEE_BUDGET = CENT;
+//! Number of blocks between consolidation runs
+static const int CONSOLIDATION_INTERVAL = 10;
+//! Minimum number of notes a key must have for them to be consolidated
+static const size_t MIN_CONSOLIDATION_NOTES = 10;
 static const bool DEFAULT_WALLETBROADCAST = true;
 //! Size of witness cache
 //  Should be large enough that we can expect not to reorg beyond our cache
 //  unless there is some exceptional network disruption.
 static const unsigned int WITNESS_CACHE_SIZE = MAX_REORG_LENGTH + 1;
 
+//! Number of blocks after which the parts of the Orchard note commitment
+//! tree that are no longer needed are pruned, between writes of the tree.
+static const int ORCHARD_TREE_GC_INTERVAL = 100;
+
+//! Maximum number of mempool transactions remembered as having no Sapling
+//! outputs for the wallet.
+static const size_t MAX_SAPLING_NOT_MINE_TXIDS = 50000;
+
+//! Minimum number of keys each thread derives when keys are derived in bulk.
+static const size_t MIN_KEYS_PER_DERIVATION_THREAD = 64;
+
 //! Amount of entropy used in generation of the mnemonic seed, in bytes.
 static const size_t WALLET_MNEMONIC_ENTROPY_LENGTH = 32;
 //! -anchorconfirmations default
@@ -522,6 +564,9 @@ public:
     mutable CAmount nImmatureWatchCreditCached;
     mutable CAmount nAvailableWatchCreditCached;
     mutable CAmount nChangeCached;
+    //! Whether the shielded data of this transaction has been dropped from
+    //! memory. See CWallet::EvictTxBodies.
+    bool fBodyEvicted;
 
     CWalletTx()
     {
@@ -572,6 +617,7 @@ public:
         nAvailableWatchCreditCached = 0;
         nImmatureWatchCreditCached = 0;
         nChangeCached = 0;
+        fBodyEvicted = false;
         nOrderPos = -1;
     }
 
@@ -648,6 +694,13 @@ public:
     void SetSaplingNoteData(const mapSaplingNoteData_t& noteData);
     void SetOrchardTxMeta(OrchardWalletTxMeta actionData);
 
+    //! Drop the Sprout, Sapling and Orchard data of this transaction, keeping
+    //! its hash. The transaction must have been written to the wallet
+    //! database, from where CWallet::GetWalletTxWithBody reads it back.
+    void EvictBody();
+    //! Put back the data dropped by EvictBody, from a copy of this transaction.
+    void RestoreBody(const CTransaction& tx);
+
     std::pair<libzcash::SproutNotePlaintext, libzcash::SproutPaymentAddress> DecryptSproutNote(
         JSOutPoint jsop) const;
     /**
@@ -702,6 +755,36 @@ public:
     std::set<uint256> GetConflicts() const;
 };
 
+/**
+ * The Sapling and Orchard notes of a wallet transaction that could be
+ * decrypted with the incoming viewing keys of the wallet or recovered with
+ * its outgoing viewing keys, as z_viewtransaction shows them.
+ */
+struct ShieldedTxNotes
+{
+    struct SaplingSpend
+    {
+        //! The index of the spend within the Sapling bundle.
+        size_t nSpend;
+        SaplingOutPoint opPrev;
+        libzcash::SaplingNotePlaintext notePt;
+        libzcash::SaplingPaymentAddress pa;
+    };
+
+    struct SaplingOutput
+    {
+        uint32_t nOutput;
+        libzcash::SaplingNotePlaintext notePt;
+        libzcash::SaplingPaymentAddress pa;
+        //! Whether it was recovered with an outgoing viewing key.
+        bool fOutgoing;
+    };
+
+    std::vector<SaplingSpend> vSaplingSpends;
+    std::vector<SaplingOutput> vSaplingOutputs;
+    OrchardActions orchardActions;
+};
+
 class NoteFilter {
 private:
     std::set<libzcash::SproutPaymentAddress> sproutAddresses;
@@ -1164,17 +1247,47 @@ typedef struct WalletDecryptedNotes {
      * attempt to overwrite an existing entry and fail.
      */
     std::pair<mapSaplingNoteData_t, SaplingIncomingViewingKeyMap> saplingNoteDataAndAddressesToAdd;
+    /**
+     * If the Orchard actions were trial decrypted by the batch scanner, the
+     * index of each action it decrypted, with the raw incoming viewing key
+     * that decrypts it. Otherwise the actions are trial decrypted with all of
+     * the wallet's keys when the transaction is added.
+     */
+    std::optional<std::vector<std::pair<uint32_t, std::array<uint8_t, 64>>>> orchardHints;
 } WalletDecryptedNotes;
 
 class WalletBatchScanner : public BatchScanner {
 private:
     CWallet* pwallet;
+    //! The number of Sapling keys the batch scanner was created with. Set by
+    //! CreateBatchScanner, so it must be declared before inner.
+    size_t nSaplingKeys;
+    //! Whether the batch scanner was created with any Orchard keys. Set by
+    //! CreateBatchScanner, so it must be declared before inner.
+    bool fOrchardKeys;
     rust::Box<wallet::BatchScanner> inner;
+    //! With -scanmempoolwatchonly=0, a batch scanner for mempool transactions
+    //! that leaves out watch-only keys, created when first needed.
+    std::optional<rust::Box<wallet::BatchScanner>> innerMempool;
     std::map<uint256, WalletDecryptedNotes> decryptedNotes;
+    //! Transactions whose Sapling outputs were queued for trial decryption,
+    //! and whose results have not been collected yet.
+    std::set<uint256> saplingQueued;
+    //! Likewise for transactions whose Orchard actions were queued.
+    std::set<uint256> orchardQueued;
+
+    static rust::Box<wallet::BatchScanner> CreateBatchScanner(CWallet* pwallet, bool fWatchOnly, size_t& nSaplingKeys, bool& fOrchardKeys);
+
+    WalletBatchScanner(CWallet* pwalletIn) : pwallet(pwalletIn), inner(CreateBatchScanner(pwalletIn, true, nSaplingKeys, fOrchardKeys)) {}
 
-    static rust::Box<wallet::BatchScanner> CreateBatchScanner(CWallet* pwallet);
+    //! The batch scanner for transactions from the given block, or from the
+    //! mempool if blockTag is null.
+    wallet::BatchScanner& GetInner(const uint256& blockTag);
 
-    WalletBatchScanner(CWallet* pwalletIn) : pwallet(pwalletIn), inner(CreateBatchScanner(pwalletIn)) {}
+    //! Wait for the trial decryption of the Sapling outputs and Orchard
+    //! actions of tx, and add the results to decryptedNotes. Does not need
+    //! cs_wallet, so that the lock is not held while decryption finishes.
+    void CollectResults(const CTransaction& tx, const CBlock* pblock);
 
     friend class CWallet;
 
@@ -1194,7 +1307,6 @@ public:
 
     void AddTransaction(
         const CTransaction &tx,
-        const std::vector<unsigned char> &txBytes,
         const uint256 &blockTag,
         const int nHeight);
 
@@ -1230,6 +1342,9 @@ private:
     bool SelectCoins(const CAmount& nTargetValue, std::set<std::pair<const CWalletTx*,unsigned int> >& setCoinsRet, CAmount& nValueRet, bool& fOnlyCoinbaseCoinsRet, bool& fNeedCoinbaseCoinsRet, const CCoinControl *coinControl = NULL) const;
 
     CWalletDB *pwalletdbEncryption;
+    //! While set, new transparent keys are written with this database
+    //! handle, so that keys generated in bulk share one database transaction.
+    CWalletDB *pwalletdbBatch;
 
     //! the current wallet version: clients below this version are not able to load the wallet
     int nWalletVersion;
@@ -1241,8 +1356,41 @@ private:
     int64_t nLastResend;
     int64_t nLastSetChain;
     int nSetChainUpdates;
+    //! Blocks appended to the Orchard note commitment tree since it was last
+    //! garbage collected.
+    int nOrchardTreeUpdates;
     bool fBroadcastTransactions;
 
+    /**
+     * Transactions whose Sapling outputs were trial decrypted outside of a
+     * block, with the nSaplingNotMineKeys Sapling keys the wallet had then,
+     * and found not to be ours. Their outputs are not trial decrypted again
+     * when they are mined, unless keys were added in between.
+     */
+    std::set<uint256> setSaplingNotMine;
+    size_t nSaplingNotMineKeys;
+
+    void AddSaplingNotMine(const uint256& txid, size_t nKeys);
+    bool EraseSaplingNotMine(const uint256& txid, size_t nKeys);
+
+    /**
+     * Every scriptPubKey that IsMine may consider ours: the P2PKH and P2PK
+     * scripts of our keys, the P2SH scripts of our redeem scripts and the
+     * watch-only scripts. Transparent outputs that are not in it are not
+     * ours, and are ruled out without solving their scripts. Guarded by
+     * cs_KeyStore.
+     */
+    CExpandingBloomFilter scriptPubKeyFilter;
+    /**
+     * The txids of mapWallet, so that the inputs of transactions that do not
+     * spend our outputs are ruled out without a mapWallet lookup. Guarded by
+     * cs_wallet.
+     */
+    CExpandingBloomFilter walletTxFilter;
+
+    void AddToScriptPubKeyFilter(const CPubKey& pubkey);
+    void AddToScriptPubKeyFilter(const CScript& scriptPubKey);
+
     /**
      * A map from a protocol-specific transaction output identifier to
      * a txid.
@@ -1268,12 +1416,75 @@ private:
 
     std::vector<CTransaction> pendingSaplingMigrationTxs;
     AsyncRPCOperationId saplingMigrationOperationId;
+    AsyncRPCOperationId saplingConsolidationOperationId;
+
+    /**
+     * The wallet transactions that may still have transparent outputs or
+     * Sprout or Sapling notes that the wallet can spend. AvailableCoins,
+     * FindSpendableInputs and GetFilteredNotes look at these rather than at
+     * all of mapWallet. Transactions are added when they enter the wallet or
+     * are updated, and are dropped, when next looked at, once every output
+     * and note of theirs is spent by a transaction too deep to be reorged.
+     * MarkDirty, which imports of keys and scripts call, adds all of them
+     * back, as outputs may have become the wallet's.
+     */
+    mutable std::set<uint256> setMaybeSpendable;
+
+    /**
+     * The hashes of the serializations of the wallet transactions that
+     * SetBestChain last wrote, by txid, so that it does not write them again
+     * while they are unchanged. Other writes of a transaction remove its
+     * entry.
+     */
+    std::map<uint256, uint256> mapBestChainTxHashes;
+
+    /**
+     * GetLegacyBalance results, by filter and minimum depth, with the chain
+     * tip and the value of nLegacyBalanceGeneration they were computed at.
+     * The generation is bumped whenever a wallet transaction or the address
+     * book changes, and by MarkDirty.
+     */
+    struct CachedLegacyBalance
+    {
+        const CBlockIndex* pindexTip;
+        uint64_t nGeneration;
+        CAmount nBalance;
+    };
+    mutable std::map<std::pair<isminefilter, int>, CachedLegacyBalance> mapLegacyBalanceCache;
+    uint64_t nLegacyBalanceGeneration = 0;
+
+    /**
+     * The bodies of evicted transactions that GetWalletTxWithBody last read
+     * back from the wallet database, most recently used first.
+     */
+    mutable std::list<CTransactionRef> listTxBodyCache;
+
+    /**
+     * The decrypted notes of the wallet transactions that z_viewtransaction
+     * last showed, by txid, with their position in listShieldedTxNotes, which
+     * holds the txids most recently used first. An entry is dropped when its
+     * transaction is updated, and all of them by MarkDirty, which key imports
+     * call, or when a unified account is added, which brings new outgoing
+     * viewing keys.
+     */
+    mutable std::map<uint256, std::pair<std::shared_ptr<const ShieldedTxNotes>, std::list<uint256>::iterator>> mapShieldedTxNotes;
+    mutable std::list<uint256> listShieldedTxNotes;
+    //! The number of unified accounts when mapShieldedTxNotes was filled.
+    mutable size_t nShieldedTxNotesAccounts = 0;
+
+    void EraseShieldedTxNotes(const uint256& txid) const;
 
     void AddToTransparentSpends(const COutPoint& outpoint, const uint256& wtxid);
     void AddToSproutSpends(const uint256& nullifier, const uint256& wtxid);
     void AddToSaplingSpends(const uint256& nullifier, const uint256& wtxid);
     void AddToSpends(const uint256& wtxid);
 
+    bool IsSpentDeeply(const TxSpendMap<COutPoint>& spends, const COutPoint& outpoint) const;
+    bool IsSpentDeeply(const TxSpendMap<uint256>& spends, const uint256& nullifier) const;
+    //! The transactions to look for spendable outputs and notes in, in
+    //! order of txid. If asOfHeight is set, those are all of mapWallet.
+    std::vector<const CWalletTx*> GetMaybeSpendableTxs(const std::optional<int>& asOfHeight) const;
+
 public:
     /*
      * Size of the incremental witness cache for the notes in our wallet.
@@ -1282,6 +1493,7 @@ public:
      */
     int64_t nWitnessCacheSize;
     bool fSaplingMigrationEnabled = false;
+    bool fSaplingConsolidationEnabled = false;
 
     void ClearNoteWitnessCache();
 
@@ -1311,8 +1523,11 @@ protected:
             LogPrintf("SetBestChain(): Couldn't start atomic write\n");
             return;
         }
+        // Held until the write is committed, so that no other write of a
+        // transaction falls between its hash being computed and recorded.
+        LOCK(cs_wallet);
+        std::vector<std::pair<uint256, uint256>> vWritten;
         try {
-            LOCK(cs_wallet);
             for (std::pair<const uint256, CWalletTx>& wtxItem : mapWallet) {
                 auto wtx = wtxItem.second;
                 // We skip transactions for which mapSproutNoteData and mapSaplingNoteData
@@ -1320,6 +1535,15 @@ protected:
                 // (i.e. are purely transparent), as well as shielding and unshielding
                 // transactions in which we only have transparent addresses involved.
                 if (!(wtx.mapSproutNoteData.empty() && wtx.mapSaplingNoteData.empty())) {
+                    // Transactions whose witnesses are no longer updated,
+                    // such as those with only spent notes, are not
+                    // rewritten.
+                    uint256 hashWtx = SerializeHash(wtx, SER_DISK, CLIENT_VERSION);
+                    auto it = mapBestChainTxHashes.find(wtxItem.first);
+                    if (it != mapBestChainTxHashes.end() && it->second == hashWtx) {
+                        continue;
+                    }
+                    vWritten.emplace_back(wtxItem.first, hashWtx);
                     if (!walletdb.WriteTx(wtx)) {
                         LogPrintf("SetBestChain(): Failed to write CWalletTx, aborting atomic write\n");
                         walletdb.TxnAbort();
@@ -1329,6 +1553,7 @@ protected:
             }
             // Add persistence of Orchard incremental witness tree
             orchardWallet.GarbageCollect();
+            nOrchardTreeUpdates = 0;
             if (!walletdb.WriteOrchardWitnesses(orchardWallet)) {
                 LogPrintf("SetBestChain(): Failed to write Orchard witnesses, aborting atomic write\n");
                 walletdb.TxnAbort();
@@ -1356,6 +1581,9 @@ protected:
             LogPrintf("SetBestChain(): Couldn't commit atomic write\n");
             return;
         }
+        for (const auto& [txid, hashWtx] : vWritten) {
+            mapBestChainTxHashes[txid] = hashWtx;
+        }
     }
 
 private:
@@ -1372,6 +1600,12 @@ private:
             const uint256& seedFingerprint,
             const CKey& secret,
             const HDKeyPath& keyPath);
+    /* As above, with the public key of secret already computed and checked. */
+    CPubKey AddTransparentSecretKey(
+            const uint256& seedFingerprint,
+            const CKey& secret,
+            const CPubKey& pubkey,
+            const HDKeyPath& keyPath);
 
     std::map<libzcash::OrchardIncomingViewingKey, CKeyMetadata> mapOrchardZKeyMetadata;
 
@@ -1454,11 +1688,14 @@ public:
         fFileBacked = false;
         nMasterKeyMaxID = 0;
         pwalletdbEncryption = NULL;
+        pwalletdbBatch = NULL;
         nOrderPosNext = 0;
         nNextResend = 0;
         nLastResend = 0;
         nLastSetChain = 0;
         nSetChainUpdates = 0;
+        nOrchardTreeUpdates = 0;
+        nSaplingNotMineKeys = 0;
         nTimeFirstKey = 0;
         fBroadcastTransactions = false;
         nWitnessCacheSize = 0;
@@ -1676,10 +1913,16 @@ public:
      * Generate a new key
      */
     CPubKey GenerateNewKey(bool external);
+    /**
+     * Generate nKeys new keys, deriving them on several threads. The keys
+     * and the updated HD chain are written with walletdb, so that the caller
+     * can write them in a single database transaction.
+     */
+    std::vector<CPubKey> GenerateNewKeys(size_t nKeys, bool external, CWalletDB& walletdb);
     //! Adds a key to the store, and saves it to disk.
     bool AddKeyPubKey(const CKey& key, const CPubKey &pubkey);
     //! Adds a key to the store, without saving it to disk (used by LoadWallet)
-    bool LoadKey(const CKey& key, const CPubKey &pubkey) { return CCryptoKeyStore::AddKeyPubKey(key, pubkey); }
+    bool LoadKey(const CKey& key, const CPubKey &pubkey);
     //! Load metadata (used by LoadWallet)
     void LoadKeyMetadata(const CPubKey &pubkey, const CKeyMetadata &metadata);
 
@@ -1896,7 +2139,7 @@ public:
     void UpdateNullifierNoteMapWithTx(const CWalletTx& wtx);
     void UpdateSaplingNullifierNoteMapWithTx(CWalletTx& wtx);
     void UpdateSaplingNullifierNoteMapForBlock(const CBlock* pblock);
-    void LoadWalletTx(const CWalletTx& wtxIn);
+    void LoadWalletTx(CWalletTx wtxIn);
     bool AddToWallet(const CWalletTx& wtxIn, CWalletDB* pwalletdb);
     BatchScanner* GetBatchScanner();
     bool AddToWalletIfInvolvingMe(
@@ -2060,8 +2303,34 @@ public:
         std::optional<MerkleFrontiers> added);
     void RunSaplingMigration(int blockHeight);
     void AddPendingSaplingMigrationTx(const CTransaction& tx);
+    /**
+     * Start a consolidation of the wallet's Sapling notes every
+     * CONSOLIDATION_INTERVAL blocks, if -consolidation is set and no other
+     * asynchronous operation is queued or running.
+     */
+    void RunSaplingConsolidation(int blockHeight);
     /** Saves witness caches and best block locator to disk. */
     void SetBestChain(const CBlockLocator& loc);
+    /**
+     * Drop from memory the shielded data of the wallet transactions that
+     * are too deep to be reorged away and whose notes were all spent more
+     * than WITNESS_CACHE_SIZE blocks before nHeight, so that their witnesses
+     * are no longer kept. Transactions with Orchard notes are kept whole.
+     * Does nothing unless -walletevicttxbodies is set.
+     */
+    void EvictTxBodies(int nHeight);
+    /**
+     * A copy of wtx with its shielded data, which is read back from the
+     * wallet database if it was evicted from memory. Throws if it cannot be
+     * read.
+     */
+    CWalletTx GetWalletTxWithBody(const CWalletTx& wtx) const;
+    /**
+     * The decrypted shielded notes of the wallet transaction that were cached
+     * by CacheShieldedTxNotes, if they are still valid.
+     */
+    std::shared_ptr<const ShieldedTxNotes> GetCachedShieldedTxNotes(const uint256& txid) const;
+    void CacheShieldedTxNotes(const uint256& txid, std::shared_ptr<const ShieldedTxNotes> notes) const;
     /**
      * Returns the block hash corresponding to the wallet's most recently
      * persisted best block. This is the state to which the wallet will revert
@@ -24,6 +24,7 @@
 #include <boost/thread.hpp>
 #include <atomic>
 #include <string>
+#include <thread>
 
 using namespace std;
 
@@ -64,9 +65,25 @@ bool CWalletDB::ErasePurpose(const string& strPurpose)
 bool CWalletDB::WriteTx(const CWalletTx& wtx)
 {
     nWalletDBUpdateCounter++;
+    if (wtx.fBodyEvicted) {
+        // Keep the shielded data that was written with the transaction before
+        // it was evicted from memory.
+        CWalletTx wtxStored;
+        if (!ReadTx(wtx.GetHash(), wtxStored)) {
+            return false;
+        }
+        CWalletTx wtxFull(wtx);
+        wtxFull.RestoreBody(wtxStored);
+        return Write(std::make_pair(std::string("tx"), wtx.GetHash()), wtxFull);
+    }
     return Write(std::make_pair(std::string("tx"), wtx.GetHash()), wtx);
 }
 
+bool CWalletDB::ReadTx(const uint256& hash, CWalletTx& wtx)
+{
+    return Read(std::make_pair(std::string("tx"), hash), wtx);
+}
+
 bool CWalletDB::EraseTx(uint256 hash)
 {
     nWalletDBUpdateCounter++;
@@ -361,6 +378,102 @@ public:
     }
 };
 
+//! The most threads LoadWallet reads transaction records on.
+static const int MAX_LOAD_WALLET_THREADS = 8;
+
+/**
+ * Deserialize and check the transaction record whose key, after its type,
+ * is in ssKey. Sets fUpgraded if the record was written by a version that
+ * serialized it differently and should be rewritten. This does not touch
+ * the wallet, so that records can be read on several threads.
+ */
+static bool ReadWalletTx(CDataStream& ssKey, CDataStream& ssValue, CWalletTx& wtx, bool& fUpgraded, string& strErr)
+{
+    uint256 hash;
+    ssKey >> hash;
+    ssValue >> wtx;
+    CValidationState state;
+    auto verifier = ProofVerifier::Strict();
+    if (!(
+        CheckTransaction(wtx, state, verifier) &&
+        (wtx.GetHash() == hash) &&
+        state.IsValid())
+    ) {
+        return false;
+    }
+
+    fUpgraded = false;
+    // Undo serialize changes in 31600
+    if (31404 <= wtx.fTimeReceivedIsTxTime && wtx.fTimeReceivedIsTxTime <= 31703)
+    {
+        if (!ssValue.empty())
+        {
+            char fTmp;
+            char fUnused;
+            std::string unused_string;
+            ssValue >> fTmp >> fUnused >> unused_string;
+            strErr = strprintf("LoadWallet() upgrading tx ver=%d %d %s",
+                               wtx.fTimeReceivedIsTxTime, fTmp, hash.ToString());
+            wtx.fTimeReceivedIsTxTime = fTmp;
+        }
+        else
+        {
+            strErr = strprintf("LoadWallet() repairing tx ver=%d %s", wtx.fTimeReceivedIsTxTime, hash.ToString());
+            wtx.fTimeReceivedIsTxTime = 0;
+        }
+        fUpgraded = true;
+    }
+    return true;
+}
+
+namespace {
+
+struct CWalletTxRecord
+{
+    CDataStream ssKey;
+    CDataStream ssValue;
+    CWalletTx wtx;
+    bool fOk = false;
+    bool fUpgraded = false;
+    string strErr;
+
+    CWalletTxRecord(CDataStream&& ssKeyIn, CDataStream&& ssValueIn) :
+        ssKey(std::move(ssKeyIn)), ssValue(std::move(ssValueIn)) {}
+};
+
+//! Read the buffered transaction records, on up to nThreads threads.
+void ReadWalletTxs(std::vector<CWalletTxRecord>& vRecords, int nThreads)
+{
+    std::atomic<size_t> nNext{0};
+    auto read = [&vRecords, &nNext]() {
+        size_t i;
+        while ((i = nNext++) < vRecords.size()) {
+            CWalletTxRecord& record = vRecords[i];
+            try {
+                record.fOk = ReadWalletTx(record.ssKey, record.ssValue, record.wtx, record.fUpgraded, record.strErr);
+            } catch (...) {
+                record.fOk = false;
+            }
+            // Free the serialization.
+            record.ssValue = CDataStream(SER_DISK, CLIENT_VERSION);
+        }
+    };
+
+    std::vector<std::thread> threads;
+    for (int i = 1; i < nThreads && (size_t)i < vRecords.size(); i++) {
+        threads.emplace_back([&read]() {
+            RenameThread("zc-walletload");
+            read();
+        });
+    }
+    read();
+    for (std::thread& thread : threads) {
+        thread.join();
+    }
+}
+
+}
+
 bool
 ReadKeyValue(CWallet* pwallet, CDataStream& ssKey, CDataStream& ssValue,
              CWalletScanState &wss, string& strType, string& strErr)
@@ -386,45 +499,17 @@ ReadKeyValue(CWallet* pwallet, CDataStream& ssKey, CDataStream& ssValue,
         }
         else if (strType == "tx")
         {
-            uint256 hash;
-            ssKey >> hash;
             CWalletTx wtx;
-            ssValue >> wtx;
-            CValidationState state;
-            auto verifier = ProofVerifier::Strict();
-            if (!(
-                CheckTransaction(wtx, state, verifier) &&
-                (wtx.GetHash() == hash) &&
-                state.IsValid())
-            ) {
+            bool fUpgraded;
+            if (!ReadWalletTx(ssKey, ssValue, wtx, fUpgraded, strErr)) {
                 return false;
             }
-
-            // Undo serialize changes in 31600
-            if (31404 <= wtx.fTimeReceivedIsTxTime && wtx.fTimeReceivedIsTxTime <= 31703)
-            {
-                if (!ssValue.empty())
-                {
-                    char fTmp;
-                    char fUnused;
-                    std::string unused_string;
-                    ssValue >> fTmp >> fUnused >> unused_string;
-                    strErr = strprintf("LoadWallet() upgrading tx ver=%d %d %s",
-                                       wtx.fTimeReceivedIsTxTime, fTmp, hash.ToString());
-                    wtx.fTimeReceivedIsTxTime = fTmp;
-                }
-                else
-                {
-                    strErr = strprintf("LoadWallet() repairing tx ver=%d %s", wtx.fTimeReceivedIsTxTime, hash.ToString());
-                    wtx.fTimeReceivedIsTxTime = 0;
-                }
-                wss.vWalletUpgrade.push_back(hash);
-            }
-
+            if (fUpgraded)
+                wss.vWalletUpgrade.push_back(wtx.GetHash());
             if (wtx.nOrderPos == -1)
                 wss.fAnyUnordered = true;
 
-            pwallet->LoadWalletTx(wtx);
+            pwallet->LoadWalletTx(std::move(wtx));
         }
         else if (strType == "watchs")
         {
@@ -944,6 +1029,7 @@ DBErrors CWalletDB::LoadWallet(CWallet* pwallet)
             return DB_CORRUPT;
         }
 
+        std::vector<CWalletTxRecord> vTxRecords;
         while (true)
         {
             // Read next record
@@ -958,6 +1044,24 @@ DBErrors CWalletDB::LoadWallet(CWallet* pwallet)
                 return DB_CORRUPT;
             }
 
+            // Transactions, which can take most of the time the wallet
+            // takes to load, are deserialized and checked in parallel once
+            // all records have been read. Nothing read after them uses
+            // mapWallet.
+            {
+                CDataStream ssType(ssKey);
+                string strType;
+                try {
+                    ssType >> strType;
+                } catch (const std::exception&) {
+                    // ReadKeyValue reports it.
+                }
+                if (strType == "tx") {
+                    vTxRecords.emplace_back(std::move(ssType), std::move(ssValue));
+                    continue;
+                }
+            }
+
             // Try to be tolerant of single corrupt records:
             string strType, strErr;
             if (!ReadKeyValue(pwallet, ssKey, ssValue, wss, strType, strErr))
@@ -984,6 +1088,25 @@ DBErrors CWalletDB::LoadWallet(CWallet* pwallet)
         }
         pcursor->close();
 
+        ReadWalletTxs(vTxRecords, std::max(1, std::min(GetNumCores(), MAX_LOAD_WALLET_THREADS)));
+        for (CWalletTxRecord& record : vTxRecords) {
+            if (!record.strErr.empty())
+                LogPrintf("LoadWallet: %s", record.strErr);
+            if (!record.fOk) {
+                fNoncriticalErrors = true;
+                // Rescan if there is a bad transaction record:
+                LogPrintf("LoadWallet: Malformed transaction data encountered; starting with -rescan.");
+                SoftSetBoolArg("-rescan", true);
+                continue;
+            }
+            if (record.fUpgraded)
+                wss.vWalletUpgrade.push_back(record.wtx.GetHash());
+            if (record.wtx.nOrderPos == -1)
+                wss.fAnyUnordered = true;
+            pwallet->LoadWalletTx(std::move(record.wtx));
+        }
+        vTxRecords.clear();
+
         // Load unified address/account/key caches based on what was loaded
         if (!pwallet->LoadCaches()) {
             // We can be more permissive of certain kinds of failures during
@@ -5,9 +5,12 @@
 #ifndef ZCASH_WEIGHTED_MAP_H
 #define ZCASH_WEIGHTED_MAP_H
 
-#include <map>
+#include <cassert>
+#include <functional>
+#include <limits>
 #include <optional>
-#include <set>
+#include <tuple>
+#include <unordered_map>
 #include <vector>
 
 // A WeightedMap represents a map from keys (of type K) to values (of type V),
@@ -22,12 +25,17 @@
 // weights of the children. This allows for addition, removal, and random
 // selection/dropping in logarithmic time.
 //
+// The tree is stored contiguously in a vector, in the same layout as a binary
+// heap, and keys are found in it through a hash table, so that no operation
+// allocates except when the vector or the hash table grows.
+//
 // random(w) (which will only be called with positive w) must be defined to
 // return a uniform random value between zero inclusive and w exclusive.
 // The type W must be a signed numeric type that supports addition, binary
 // and unary -, and < and <= comparisons, and W() must construct the zero value
 // (these constraints are met for primitive signed integer types).
-template <typename K, typename V, typename W, W random(W)>
+// Hasher is the hash function of keys.
+template <typename K, typename V, typename W, W random(W), typename Hasher = std::hash<K>>
 class WeightedMap
 {
     // W must be a signed numeric type.
@@ -45,8 +53,8 @@ class WeightedMap
     // its weight, and the sum of the weights of all its descendants.
     std::vector<Node> nodes;
 
-    // The following map is to simplify removal.
-    std::map<K, size_t> indexMap;
+    // The index of each key in nodes, to simplify removal.
+    std::unordered_map<K, size_t, Hasher> indexMap;
 
     static inline size_t leftChild(size_t i) { return i*2 + 1; }
     static inline size_t rightChild(size_t i) { return i*2 + 2; }
@@ -84,22 +92,54 @@ private:
         }
     }
 
-    // For a given random weight, this method recursively finds the index of the
-    // correct entry. This is used by WeightedMap::takeRandom().
-    size_t findByWeight(size_t fromIndex, W weightToFind) const
+    // For a given random weight, this method walks down from the root to find
+    // the index of the correct entry. This is used by WeightedMap::takeRandom().
+    size_t findByWeight(W weightToFind) const
     {
-        W leftWeight = getWeightAt(leftChild(fromIndex));
-        // On Left
-        if (weightToFind < leftWeight) {
-            return findByWeight(leftChild(fromIndex), weightToFind);
+        size_t index = 0;
+        while (true) {
+            W leftWeight = getWeightAt(leftChild(index));
+            // On Left
+            if (weightToFind < leftWeight) {
+                index = leftChild(index);
+                continue;
+            }
+            W rightWeight = leftWeight + nodes[index].weight;
+            // Found
+            if (weightToFind < rightWeight) {
+                return index;
+            }
+            // On Right
+            weightToFind -= rightWeight;
+            index = rightChild(index);
         }
-        W rightWeight = getWeightAt(fromIndex) - getWeightAt(rightChild(fromIndex));
-        // Found
-        if (weightToFind < rightWeight) {
-            return fromIndex;
+    }
+
+    // Remove the entry at the given index by moving the last entry into its
+    // place, and return its value.
+    V removeAt(size_t removeIndex)
+    {
+        V removeValue = std::move(nodes[removeIndex].value);
+        indexMap.erase(nodes[removeIndex].key);
+
+        size_t lastIndex = nodes.size()-1;
+        W lastWeight = nodes[lastIndex].weight;
+        W weightDelta = lastWeight - nodes[removeIndex].weight;
+        backPropagate(lastIndex, -lastWeight);
+
+        if (removeIndex < lastIndex) {
+            Node& lastNode = nodes[lastIndex];
+            Node& removeNode = nodes[removeIndex];
+            removeNode.key = std::move(lastNode.key);
+            removeNode.value = std::move(lastNode.value);
+            removeNode.weight = lastWeight;
+            // removeNode.sumOfDescendantWeights should not change here.
+            indexMap[removeNode.key] = removeIndex;
+            backPropagate(removeIndex, weightDelta);
         }
-        // On Right
-        return findByWeight(rightChild(fromIndex), weightToFind - rightWeight);
+
+        nodes.pop_back();
+        return removeValue;
     }
 
 public:
@@ -123,23 +163,29 @@ public:
         return nodes.size();
     }
 
+    // Make room for n entries.
+    void reserve(size_t n)
+    {
+        nodes.reserve(n);
+        indexMap.reserve(n);
+    }
+
     // Return false if the key already exists in the map.
     // Otherwise, add an entry mapping `key` to `value` with the given weight,
     // and return true. The weight must be positive.
     bool add(K key, V value, W weight)
     {
         assert(W() < weight);
-        if (indexMap.count(key) > 0) {
+        size_t index = nodes.size();
+        if (!indexMap.emplace(key, index).second) {
             return false;
         }
-        size_t index = nodes.size();
         nodes.push_back(Node {
             .key = key,
             .value = value,
             .weight = weight,
             .sumOfDescendantWeights = W(),
         });
-        indexMap[key] = index;
         backPropagate(index, weight);
         return true;
     }
@@ -152,27 +198,7 @@ public:
         if (it == indexMap.end()) {
             return std::nullopt;
         }
-
-        size_t removeIndex = it->second;
-        V removeValue = nodes.at(removeIndex).value;
-
-        size_t lastIndex = nodes.size()-1;
-        Node lastNode = nodes.at(lastIndex);
-        W weightDelta = lastNode.weight - nodes.at(removeIndex).weight;
-        backPropagate(lastIndex, -lastNode.weight);
-
-        if (removeIndex < lastIndex) {
-            nodes[removeIndex].key = lastNode.key;
-            nodes[removeIndex].value = lastNode.value;
-            nodes[removeIndex].weight = lastNode.weight;
-            // nodes[removeIndex].sumOfDescendantWeights should not change here.
-            indexMap[lastNode.key] = removeIndex;
-            backPropagate(removeIndex, weightDelta);
-        }
-
-        indexMap.erase(it);
-        nodes.pop_back();
-        return removeValue;
+        return removeAt(it->second);
     }
 
     // If the map is empty, return std::nullopt. Otherwise, pick a random entry
@@ -187,12 +213,12 @@ public:
         assert(W() < totalWeight);
         W randomWeight = random(totalWeight);
         assert(W() <= randomWeight && randomWeight < totalWeight);
-        size_t index = findByWeight(0, randomWeight);
+        size_t index = findByWeight(randomWeight);
         assert(index < nodes.size());
-        const Node& drop = nodes.at(index);
-        auto res = std::make_tuple(drop.key, drop.value, drop.weight); // copy values
-        remove(drop.key);
-        return res;
+        K key = nodes[index].key;
+        W weight = nodes[index].weight;
+        V value = removeAt(index);
+        return std::make_tuple(key, value, weight);
     }
 };
 
@@ -1,3 +1,5 @@
+#include <algorithm>
+#include <cstring>
 #include <stdexcept>
 
 
@@ -22,6 +24,32 @@ PedersenHash PedersenHash::combine(
     ));
 }
 
+std::vector<PedersenHash> PedersenHash::combine_pairs(
+    const std::vector<PedersenHash>& nodes,
+    size_t depth
+)
+{
+    assert(nodes.size() % 2 == 0);
+    std::vector<PedersenHash> ret;
+    if (nodes.empty()) {
+        return ret;
+    }
+
+    std::vector<uint8_t> pairs;
+    pairs.reserve(nodes.size() * 32);
+    for (const PedersenHash& node : nodes) {
+        pairs.insert(pairs.end(), node.begin(), node.end());
+    }
+    auto hashes = sapling::spec::merkle_hash_pairs(depth, {pairs.data(), pairs.size()});
+    assert(hashes.size() == nodes.size() * 16);
+
+    ret.resize(nodes.size() / 2);
+    for (size_t i = 0; i < ret.size(); i++) {
+        std::memcpy(ret[i].begin(), hashes.data() + i * 32, 32);
+    }
+    return ret;
+}
+
 PedersenHash PedersenHash::uncommitted() {
     return uint256::FromRawBytes(sapling::spec::tree_uncommitted());
 }
@@ -427,6 +455,20 @@ SHA256Compress SHA256Compress::combine(
     return res;
 }
 
+std::vector<SHA256Compress> SHA256Compress::combine_pairs(
+    const std::vector<SHA256Compress>& nodes,
+    size_t depth
+)
+{
+    assert(nodes.size() % 2 == 0);
+    std::vector<SHA256Compress> ret;
+    ret.reserve(nodes.size() / 2);
+    for (size_t i = 0; i < nodes.size(); i += 2) {
+        ret.push_back(combine(nodes[i], nodes[i + 1], depth));
+    }
+    return ret;
+}
+
 static const std::array<SHA256Compress, 66> sha256_empty_roots = {
     uint256(std::vector<unsigned char>{
         0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
@@ -941,11 +983,17 @@ std::optional<Hash> IncrementalMerkleTree<Depth, Hash>::complete_subtree_root()
 }
 
 template<size_t Depth, typename Hash>
-void IncrementalMerkleTree<Depth, Hash>::append(Hash obj) {
+void IncrementalMerkleTree<Depth, Hash>::append(Hash obj, MerkleTreeNodes<Hash>* pnodes) {
     if (is_complete(Depth)) {
         throw std::runtime_error("tree is full");
     }
 
+    uint64_t position = 0;
+    if (pnodes) {
+        position = size();
+        pnodes->add(0, position, obj);
+    }
+
     if (!left) {
         // Set the left leaf
         left = obj;
@@ -955,6 +1003,12 @@ void IncrementalMerkleTree<Depth, Hash>::append(Hash obj) {
     } else {
         // Combine the leaves and propagate it up the tree
         std::optional<Hash> combined = Hash::combine(*left, *right, 0);
+        // The index of the combined node at its depth; the leaves are the
+        // two before the one being appended.
+        uint64_t index = (position >> 1) - 1;
+        if (pnodes) {
+            pnodes->add(1, index, *combined);
+        }
 
         // Set the "left" leaf to the object and make the "right" leaf none
         left = obj;
@@ -965,6 +1019,10 @@ void IncrementalMerkleTree<Depth, Hash>::append(Hash obj) {
                 if (parents[i]) {
                     combined = Hash::combine(*parents[i], *combined, i+1);
                     parents[i] = std::nullopt;
+                    index >>= 1;
+                    if (pnodes) {
+                        pnodes->add(i + 2, index, *combined);
+                    }
                 } else {
                     parents[i] = *combined;
                     break;
@@ -977,6 +1035,104 @@ void IncrementalMerkleTree<Depth, Hash>::append(Hash obj) {
     }
 }
 
+template<size_t Depth, typename Hash>
+std::vector<Hash> IncrementalMerkleTree<Depth, Hash>::append_batch(const std::vector<Hash>& leaves, MerkleTreeNodes<Hash>* pnodes) {
+    static_assert(Depth < 64);
+    std::vector<Hash> completedSubtrees;
+    if (leaves.empty()) {
+        return completedSubtrees;
+    }
+
+    const uint64_t oldSize = size();
+    if (leaves.size() > (uint64_t(1) << Depth) - oldSize) {
+        throw std::runtime_error("tree is full");
+    }
+    const uint64_t newSize = oldSize + leaves.size();
+    const uint64_t subtreeSize = uint64_t(1) << TRACKED_SUBTREE_HEIGHT;
+    if (pnodes) {
+        for (size_t i = 0; i < leaves.size(); i++) {
+            pnodes->add(0, oldSize + i, leaves[i]);
+        }
+    }
+
+    // Each level is processed as a list of nodes starting at an even index
+    // (a left child), beginning with any node of the frontier that is still
+    // waiting for its sibling at that level.
+    std::vector<Hash> nodes;
+    nodes.reserve(leaves.size() + 2);
+    // The index of nodes[0] at its depth.
+    uint64_t start = oldSize - (left ? 1 : 0) - (right ? 1 : 0);
+    if (left) {
+        nodes.push_back(*left);
+    }
+    if (right) {
+        nodes.push_back(*right);
+    }
+    nodes.insert(nodes.end(), leaves.begin(), leaves.end());
+
+    // As in append(), the last one or two leaves are kept uncombined.
+    size_t nKeep = (nodes.size() % 2 == 0) ? 2 : 1;
+    left = nodes[nodes.size() - nKeep];
+    right = (nKeep == 2) ? std::optional<Hash>(nodes.back()) : std::nullopt;
+    nodes.resize(nodes.size() - nKeep);
+
+    std::vector<Hash> level = Hash::combine_pairs(nodes, 0);
+    start >>= 1;
+    for (size_t d = 1; !level.empty(); d++) {
+        // `level` holds the nodes at depth d completed by this batch, the
+        // first of which is at index `start`.
+        assert(d < Depth);
+        if (d == TRACKED_SUBTREE_HEIGHT) {
+            completedSubtrees = level;
+        }
+        if (pnodes) {
+            for (size_t i = 0; i < level.size(); i++) {
+                pnodes->add(d, start + i, level[i]);
+            }
+        }
+
+        if (parents.size() < d) {
+            parents.resize(d);
+        }
+        std::optional<Hash>& parent = parents[d - 1];
+
+        nodes.clear();
+        if (parent) {
+            nodes.push_back(*parent);
+            start--;
+        }
+        nodes.insert(nodes.end(), level.begin(), level.end());
+        if (nodes.size() % 2 == 1) {
+            parent = nodes.back();
+            nodes.pop_back();
+        } else {
+            parent = std::nullopt;
+        }
+
+        level = Hash::combine_pairs(nodes, d);
+        start >>= 1;
+    }
+
+    if (Depth <= TRACKED_SUBTREE_HEIGHT) {
+        return std::vector<Hash>();
+    }
+
+    // If the tree was sitting on a subtree boundary, that subtree's root was
+    // already reported after the previous append; it was only combined into
+    // the parents now. Conversely, a subtree completed by the final leaves is
+    // still held in the frontier's left and right leaves.
+    if (oldSize > 0 && oldSize % subtreeSize == 0) {
+        assert(!completedSubtrees.empty());
+        completedSubtrees.erase(completedSubtrees.begin());
+    }
+    if (newSize % subtreeSize == 0) {
+        completedSubtrees.push_back(*complete_subtree_root());
+    }
+    assert(completedSubtrees.size() == (newSize / subtreeSize) - (oldSize / subtreeSize));
+
+    return completedSubtrees;
+}
+
 // This is for allowing the witness to determine if a subtree has filled
 // to a particular depth, or for append() to ensure we're not appending
 // to a full tree.
@@ -1036,6 +1192,22 @@ size_t IncrementalMerkleTree<Depth, Hash>::next_depth(size_t skip) const {
     return d + skip;
 }
 
+// This returns the part of the tree below the given depth: the subtree
+// of that height that the next leaf will be appended to.
+template<size_t Depth, typename Hash>
+IncrementalMerkleTree<Depth, Hash> IncrementalMerkleTree<Depth, Hash>::subtree(size_t depth) const {
+    IncrementalMerkleTree<Depth, Hash> ret;
+    ret.left = left;
+    ret.right = right;
+    // parents[i] holds a node at depth i + 1.
+    size_t nParents = std::min(parents.size(), depth > 0 ? depth - 1 : 0);
+    ret.parents.assign(parents.begin(), parents.begin() + nParents);
+    while (!ret.parents.empty() && !ret.parents.back()) {
+        ret.parents.pop_back();
+    }
+    return ret;
+}
+
 // This calculates the root of the tree.
 template<size_t Depth, typename Hash>
 Hash IncrementalMerkleTree<Depth, Hash>::root(size_t depth,
@@ -1160,6 +1332,48 @@ void IncrementalWitness<Depth, Hash>::append(Hash obj) {
     }
 }
 
+template<size_t Depth, typename Hash>
+void IncrementalWitness<Depth, Hash>::fast_forward(const IncrementalMerkleTree<Depth, Hash>& treeAfter,
+                                                   const MerkleTreeNodes<Hash>& nodes) {
+    const uint64_t witnessed = position();
+    const uint64_t size = treeAfter.size();
+    while (true) {
+        // The witness is waiting for the subtree at this depth that is the
+        // sibling of the witnessed leaf's ancestor, which is a left child.
+        size_t depth = tree.next_depth(filled.size());
+        uint64_t index = (witnessed >> depth) + 1;
+        uint64_t start = index << depth;
+        if (size <= start) {
+            // None of its leaves were appended.
+            return;
+        }
+        if (depth >= Depth) {
+            throw std::runtime_error("tree is full");
+        }
+        cursor_depth = depth;
+
+        uint64_t end = (index + 1) << depth;
+        if (size < end) {
+            // The leaves appended so far are the part of the tree that the
+            // next leaf goes into.
+            cursor = treeAfter.subtree(depth);
+            return;
+        }
+
+        std::optional<Hash> node = nodes.get(depth, index);
+        if (!node && depth > 0 && size == end) {
+            // The tree only combines the last leaves when the next one is
+            // appended, so a subtree they complete is hashed here.
+            node = treeAfter.subtree(depth).root(depth);
+        }
+        if (!node) {
+            throw std::logic_error("IncrementalWitness::fast_forward: missing node");
+        }
+        filled.push_back(*node);
+        cursor = std::nullopt;
+    }
+}
+
 template class IncrementalMerkleTree<INCREMENTAL_MERKLE_TREE_DEPTH, SHA256Compress>;
 template class IncrementalMerkleTree<INCREMENTAL_MERKLE_TREE_DEPTH_TESTING, SHA256Compress>;
 
@@ -3,6 +3,7 @@
 
 #include <array>
 #include <deque>
+#include <map>
 #include <optional>
 
 #include "uint256.h"
@@ -139,6 +140,32 @@ bool operator==(const EmptyMerkleRoots<Depth, Hash>& a,
 template<size_t Depth, typename Hash>
 class IncrementalWitness;
 
+//! The nodes of an IncrementalMerkleTree that were computed while leaves
+//! were appended to it, by depth and index; leaves are the nodes at depth 0.
+//! Recorded by IncrementalMerkleTree::append, so that witnesses into the
+//! tree can be brought up to date without hashing the leaves again.
+template<typename Hash>
+class MerkleTreeNodes {
+public:
+    void add(size_t depth, uint64_t index, const Hash& node) {
+        nodes.emplace(std::make_pair(depth, index), node);
+    }
+
+    std::optional<Hash> get(size_t depth, uint64_t index) const {
+        auto it = nodes.find(std::make_pair(depth, index));
+        if (it == nodes.end()) {
+            return std::nullopt;
+        }
+        return it->second;
+    }
+
+    bool empty() const { return nodes.empty(); }
+    void clear() { nodes.clear(); }
+
+private:
+    std::map<std::pair<size_t, uint64_t>, Hash> nodes;
+};
+
 template<size_t Depth, typename Hash>
 class IncrementalMerkleTree {
 
@@ -172,7 +199,21 @@ public:
     //! this will return nullopt.
     std::optional<Hash> complete_subtree_root() const;
 
-    void append(Hash obj);
+    //! Appends a leaf. If pnodes is not null, the leaf and the nodes that
+    //! are computed along the way are recorded in it.
+    void append(Hash obj, MerkleTreeNodes<Hash>* pnodes = nullptr);
+
+    //! Appends the given leaves in order, leaving the tree in the same
+    //! state as calling append() on each of them would, and returns the
+    //! roots of the 2^TRACKED_SUBTREE_HEIGHT subtrees that they complete
+    //! (the values complete_subtree_root() would have returned along the
+    //! way). The tree is filled in one level at a time, so that all of the
+    //! hashes needed at a level are computed by a single Hash::combine_pairs
+    //! call. If pnodes is not null, the leaves and the nodes computed are
+    //! recorded in it, as append() does. Throws, without modifying the tree,
+    //! if the leaves do not fit.
+    std::vector<Hash> append_batch(const std::vector<Hash>& leaves, MerkleTreeNodes<Hash>* pnodes = nullptr);
+
     Hash root() const {
         return root(Depth, std::deque<Hash>());
     }
@@ -212,6 +253,7 @@ private:
     Hash root(size_t depth, std::deque<Hash> filler_hashes = std::deque<Hash>()) const;
     bool is_complete(size_t depth = Depth) const;
     size_t next_depth(size_t skip) const;
+    IncrementalMerkleTree subtree(size_t depth) const;
     void wfcheck() const;
 };
 
@@ -252,6 +294,13 @@ public:
 
     void append(Hash obj);
 
+    //! Brings the witness up to date with treeAfter, the tree it witnesses
+    //! into after leaves were appended to it, given the nodes recorded while
+    //! appending them. Leaves the witness in the same state as appending each
+    //! of those leaves to it would, without hashing them again.
+    void fast_forward(const IncrementalMerkleTree<Depth, Hash>& treeAfter,
+                      const MerkleTreeNodes<Hash>& nodes);
+
     ADD_SERIALIZE_METHODS;
 
     template <typename Stream, typename Operation>
@@ -296,6 +345,12 @@ public:
         size_t depth
     );
 
+    //! Combines nodes[2i] with nodes[2i+1] for each i.
+    static std::vector<SHA256Compress> combine_pairs(
+        const std::vector<SHA256Compress>& nodes,
+        size_t depth
+    );
+
     static SHA256Compress uncommitted() {
         return SHA256Compress();
     }
@@ -313,6 +368,13 @@ public:
         size_t depth
     );
 
+    //! Combines nodes[2i] with nodes[2i+1] for each i, hashing the pairs
+    //! in parallel.
+    static std::vector<PedersenHash> combine_pairs(
+        const std::vector<PedersenHash>& nodes,
+        size_t depth
+    );
+
     static PedersenHash uncommitted();
     static PedersenHash EmptyRoot(size_t);
 };
@@ -14,6 +14,7 @@
 class OrchardWallet;
 namespace orchard {
     class Builder;
+    class ProvenBundle;
     class UnauthorizedBundle;
 }
 
@@ -287,6 +288,7 @@ private:
     OrchardSpendingKey(OrchardSpendingKeyPtr* ptr) :
         inner(ptr, orchard_spending_key_free) {}
 
+    friend class orchard::ProvenBundle;
     friend class orchard::UnauthorizedBundle;
     friend class ::OrchardWallet;
 public:
@@ -179,16 +179,54 @@ UnifiedAddressGenerationResult ZcashdUnifiedFullViewingKey::Address(
 UnifiedAddressGenerationResult ZcashdUnifiedFullViewingKey::FindAddress(
         const diversifier_index_t& j,
         const std::set<ReceiverType>& receiverTypes) const {
+    auto result = FindAddresses(j, receiverTypes, 1);
+    auto err = std::get_if<UnifiedAddressGenerationError>(&result);
+    if (err != nullptr) {
+        return *err;
+    }
+    return std::get<std::vector<std::pair<UnifiedAddress, diversifier_index_t>>>(result).front();
+}
+
+UnifiedAddressesGenerationResult ZcashdUnifiedFullViewingKey::FindAddresses(
+        const diversifier_index_t& j,
+        const std::set<ReceiverType>& receiverTypes,
+        size_t n) const {
+    std::vector<std::pair<UnifiedAddress, diversifier_index_t>> addrs;
+    bool searchSapling = receiverTypes.count(ReceiverType::Sapling) > 0 && saplingKey.has_value();
     diversifier_index_t j0(j);
-    bool hasTransparent = HasTransparent(receiverTypes);
-    do {
-        auto addr = Address(j0, receiverTypes);
-        if (addr != UnifiedAddressGenerationResult(UnifiedAddressGenerationError::NoAddressForDiversifier)) {
-            return addr;
+    while (addrs.size() < n) {
+        // Most of the indices without a valid Sapling diversifier are skipped
+        // on the Rust side, rather than trying each of them here.
+        std::vector<diversifier_index_t> candidates;
+        if (searchSapling) {
+            try {
+                for (const auto& [saplingAddr, jSapling] : saplingKey.value().FindAddresses(j0, n - addrs.size())) {
+                    candidates.push_back(jSapling);
+                }
+            } catch (const std::runtime_error&) {
+                return UnifiedAddressGenerationError::DiversifierSpaceExhausted;
+            }
+        } else {
+            candidates.push_back(j0);
         }
-    } while (j0.increment());
 
-    return UnifiedAddressGenerationError::DiversifierSpaceExhausted;
+        for (const auto& jCandidate : candidates) {
+            auto addr = Address(jCandidate, receiverTypes);
+            auto addrPair = std::get_if<std::pair<UnifiedAddress, diversifier_index_t>>(&addr);
+            if (addrPair != nullptr) {
+                addrs.push_back(*addrPair);
+            } else if (std::get<UnifiedAddressGenerationError>(addr) != UnifiedAddressGenerationError::NoAddressForDiversifier) {
+                return std::get<UnifiedAddressGenerationError>(addr);
+            }
+        }
+
+        j0 = candidates.back();
+        if (addrs.size() < n && !j0.increment()) {
+            return UnifiedAddressGenerationError::DiversifierSpaceExhausted;
+        }
+    }
+
+    return addrs;
 }
 
 UnifiedAddressGenerationResult ZcashdUnifiedFullViewingKey::FindAddress(
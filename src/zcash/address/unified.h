@@ -51,6 +51,10 @@ typedef std::variant<
     std::pair<UnifiedAddress, diversifier_index_t>,
     UnifiedAddressGenerationError> UnifiedAddressGenerationResult;
 
+typedef std::variant<
+    std::vector<std::pair<UnifiedAddress, diversifier_index_t>>,
+    UnifiedAddressGenerationError> UnifiedAddressesGenerationResult;
+
 /** A recipient address to which a unified address can be resolved */
 typedef std::variant<
     CKeyID,
@@ -217,6 +221,21 @@ public:
             const diversifier_index_t& j,
             const std::set<ReceiverType>& receiverTypes) const;
 
+    /**
+     * Find the `n` smallest diversifier indices >= `j` that generate valid
+     * unified addresses, as `FindAddress` does for one, and return the
+     * addresses in order along with their diversifier indices. If a Sapling
+     * receiver is requested, only the indices that produce a valid Sapling
+     * receiver are tried, and they are found in parallel batches.
+     *
+     * Returns an error, as `FindAddress` would, if fewer than `n` addresses
+     * can be found.
+     */
+    UnifiedAddressesGenerationResult FindAddresses(
+            const diversifier_index_t& j,
+            const std::set<ReceiverType>& receiverTypes,
+            size_t n) const;
+
     /**
      * Find the next available address that contains all supported receiver types.
      */
@@ -79,6 +79,56 @@ std::optional<libzcash::SaplingPaymentAddress>
     }
 }
 
+std::pair<libzcash::SaplingPaymentAddress, diversifier_index_t>
+    SaplingDiversifiableFullViewingKey::FindAddress(diversifier_index_t j) const
+{
+    CDataStream ss_fvk(SER_NETWORK, PROTOCOL_VERSION);
+    ss_fvk << fvk;
+    std::array<unsigned char, 96> fvk_bytes;
+    std::copy(ss_fvk.begin(), ss_fvk.end(), fvk_bytes.begin());
+
+    try {
+        auto found = sapling::zip32::find_address(fvk_bytes, dk.GetRawBytes(), j.GetRawBytes());
+        CDataStream ss_addr(found.addr, SER_NETWORK, PROTOCOL_VERSION);
+        libzcash::SaplingPaymentAddress addr;
+        ss_addr >> addr;
+        return std::make_pair(addr, diversifier_index_t::FromRawBytes(found.j));
+    } catch (rust::Error) {
+        throw std::runtime_error(std::string(__func__) + ": diversifier index overflow.");
+    }
+}
+
+std::vector<std::pair<libzcash::SaplingPaymentAddress, diversifier_index_t>>
+    SaplingDiversifiableFullViewingKey::FindAddresses(diversifier_index_t j, size_t n) const
+{
+    std::vector<std::pair<libzcash::SaplingPaymentAddress, diversifier_index_t>> ret;
+    if (n == 0) {
+        return ret;
+    }
+    // A single address is found faster without the parallel batches.
+    if (n == 1) {
+        ret.push_back(FindAddress(j));
+        return ret;
+    }
+
+    CDataStream ss_fvk(SER_NETWORK, PROTOCOL_VERSION);
+    ss_fvk << fvk;
+    std::array<unsigned char, 96> fvk_bytes;
+    std::copy(ss_fvk.begin(), ss_fvk.end(), fvk_bytes.begin());
+
+    try {
+        for (const auto& found : sapling::zip32::find_addresses(fvk_bytes, dk.GetRawBytes(), j.GetRawBytes(), n)) {
+            CDataStream ss_addr(found.addr, SER_NETWORK, PROTOCOL_VERSION);
+            libzcash::SaplingPaymentAddress addr;
+            ss_addr >> addr;
+            ret.emplace_back(addr, diversifier_index_t::FromRawBytes(found.j));
+        }
+    } catch (rust::Error) {
+        throw std::runtime_error(std::string(__func__) + ": diversifier index overflow.");
+    }
+    return ret;
+}
+
 libzcash::SaplingPaymentAddress SaplingDiversifiableFullViewingKey::DefaultAddress() const
 {
     CDataStream ss_fvk(SER_NETWORK, PROTOCOL_VERSION);
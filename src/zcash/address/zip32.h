@@ -159,15 +159,15 @@ public:
     // Returns the first index starting from j that generates a valid
     // payment address, along with the corresponding address. Throws
     // a runtime error if the diversifier space is exhausted.
-    std::pair<SaplingPaymentAddress, diversifier_index_t> FindAddress(diversifier_index_t j) const {
-        auto addr = Address(j);
-        while (!addr.has_value()) {
-            if (!j.increment())
-                throw std::runtime_error(std::string(__func__) + ": diversifier index overflow.");;
-            addr = Address(j);
-        }
-        return std::make_pair(addr.value(), j);
-    }
+    std::pair<SaplingPaymentAddress, diversifier_index_t> FindAddress(diversifier_index_t j) const;
+
+    // Returns the first n indices starting from j that generate valid
+    // payment addresses, in order, along with the corresponding addresses.
+    // The candidates are tested in parallel batches by a single call into
+    // Rust, so that bulk address generation does not pay for one call per
+    // candidate. Throws a runtime error if the diversifier space is
+    // exhausted first.
+    std::vector<std::pair<SaplingPaymentAddress, diversifier_index_t>> FindAddresses(diversifier_index_t j, size_t n) const;
 
     libzcash::SaplingIncomingViewingKey ToIncomingViewingKey() const {
         return fvk.in_viewing_key();
@@ -5,18 +5,89 @@
 #include "zcash/cache.h"
 #include "util/system.h"
 
+#include <mutex>
+
 namespace libzcash
 {
+static std::mutex cs_bundleCaches;
+static std::vector<std::pair<std::string, const BundleValidityCache*>> vBundleCaches;
+
+BundleValidityCache::Shard& BundleValidityCache::GetShard(const BundleCacheEntry& entry) const
+{
+    // The first byte is the least significant byte of the first hash of the
+    // entry, which barely affects where the entry goes within the shard.
+    return shards[entry[0] % BUNDLE_VALIDITY_CACHE_SHARDS];
+}
+
+size_t BundleValidityCache::setup_bytes(size_t nBytes)
+{
+    size_t nElems = 0;
+    for (Shard& shard : shards) {
+        nElems += shard.cache.setup_bytes(nBytes / BUNDLE_VALIDITY_CACHE_SHARDS);
+    }
+    return nElems;
+}
+
+void BundleValidityCache::insert(BundleCacheEntry entry) const
+{
+    Shard& shard = GetShard(entry);
+    std::unique_lock<std::shared_mutex> lock(shard.cs);
+    shard.cache.insert(entry);
+}
+
+bool BundleValidityCache::contains(const BundleCacheEntry& entry, bool erase) const
+{
+    // Marking an entry for collection is atomic, so erasing only needs the
+    // shared lock.
+    Shard& shard = GetShard(entry);
+    std::shared_lock<std::shared_mutex> lock(shard.cs);
+    return shard.cache.contains(entry, erase);
+}
+
+CCacheStats BundleValidityCache::GetStats() const
+{
+    CCacheStats result;
+    for (Shard& shard : shards) {
+        std::shared_lock<std::shared_mutex> lock(shard.cs);
+        CCacheStats stats = CuckooCacheStats<BundleCacheEntry>(shard.cache);
+        result.nHits += stats.nHits;
+        result.nMisses += stats.nMisses;
+        result.nInsertions += stats.nInsertions;
+        result.nEvictions += stats.nEvictions;
+        result.nEntries += stats.nEntries;
+        result.nMaxEntries += stats.nMaxEntries;
+        result.nMemoryUsage += stats.nMemoryUsage;
+    }
+    return result;
+}
+
+std::vector<BundleCacheEntry> BundleValidityCache::GetEntries() const
+{
+    std::vector<BundleCacheEntry> result;
+    for (Shard& shard : shards) {
+        std::shared_lock<std::shared_mutex> lock(shard.cs);
+        std::vector<BundleCacheEntry> entries = shard.cache.get_elements();
+        result.insert(result.end(), entries.begin(), entries.end());
+    }
+    return result;
+}
+
 std::unique_ptr<BundleValidityCache> NewBundleValidityCache(rust::Str kind, size_t nMaxCacheSize)
 {
     auto cache = std::unique_ptr<BundleValidityCache>(new BundleValidityCache());
     size_t nElems = cache->setup_bytes(nMaxCacheSize);
     LogPrintf("Using %zu MiB out of %zu requested for %s bundle cache, able to store %zu elements\n",
               (nElems * sizeof(BundleCacheEntry)) >> 20, nMaxCacheSize >> 20, kind, nElems);
+    {
+        std::lock_guard<std::mutex> lock(cs_bundleCaches);
+        vBundleCaches.emplace_back(std::string(kind), cache.get());
+    }
     return cache;
 }
-} // namespace libzcash
 
-// Explicit instantiations for libzcash::BundleValidityCache
-template void libzcash::BundleValidityCache::insert(libzcash::BundleCacheEntry e);
-template bool libzcash::BundleValidityCache::contains(const libzcash::BundleCacheEntry& e, const bool erase) const;
+std::vector<std::pair<std::string, const BundleValidityCache*>> GetBundleValidityCaches()
+{
+    std::lock_guard<std::mutex> lock(cs_bundleCaches);
+    return vBundleCaches;
+}
+} // namespace libzcash
@@ -5,11 +5,16 @@
 #ifndef ZCASH_ZCASH_CACHE_H
 #define ZCASH_ZCASH_CACHE_H
 
+#include "cachestats.h"
 #include "cuckoocache.h"
 
 #include <rust/cxx.h>
 
 #include <array>
+#include <shared_mutex>
+#include <string>
+#include <utility>
+#include <vector>
 
 namespace libzcash
 {
@@ -36,9 +41,53 @@ public:
     }
 };
 
-typedef CuckooCache::cache<BundleCacheEntry, BundleCacheHasher> BundleValidityCache;
+//! The number of shards a bundle validity cache is split into.
+static const size_t BUNDLE_VALIDITY_CACHE_SHARDS = 16;
+
+/**
+ * A cache of valid bundles, split into shards by entry. Each shard is a
+ * CuckooCache with its own lock, which lookups share and inserts take
+ * exclusively, so that the threads checking bundles only wait for each other
+ * when they insert into the same shard at the same time.
+ *
+ * The Rust code that owns it only holds shared references to it, so all of
+ * its methods are const and it synchronizes itself.
+ */
+class BundleValidityCache
+{
+private:
+    struct Shard
+    {
+        std::shared_mutex cs;
+        CuckooCache::cache<BundleCacheEntry, BundleCacheHasher> cache;
+    };
+    mutable std::array<Shard, BUNDLE_VALIDITY_CACHE_SHARDS> shards;
+
+    Shard& GetShard(const BundleCacheEntry& entry) const;
+
+public:
+    /**
+     * Split about nBytes between the shards. Returns the number of entries
+     * the cache can hold.
+     */
+    size_t setup_bytes(size_t nBytes);
+
+    void insert(BundleCacheEntry entry) const;
+    bool contains(const BundleCacheEntry& entry, bool erase) const;
+
+    //! The statistics of the shards, added up.
+    CCacheStats GetStats() const;
+    //! The entries of every shard that are not marked for collection.
+    std::vector<BundleCacheEntry> GetEntries() const;
+};
 
 std::unique_ptr<BundleValidityCache> NewBundleValidityCache(rust::Str kind, size_t nMaxCacheSize);
+
+/**
+ * The bundle validity caches that have been created, by kind. They are owned
+ * by the Rust code, which keeps them for the lifetime of the process.
+ */
+std::vector<std::pair<std::string, const BundleValidityCache*>> GetBundleValidityCaches();
 } // namespace libzcash
 
 #endif // ZCASH_ZCASH_CACHE_H
@@ -1,3 +1,6 @@
+#include <algorithm>
+#include <chrono>
+#include <cmath>
 #include <cstdio>
 #include <future>
 #include <map>
@@ -15,6 +18,7 @@
 #include "consensus/upgrades.h"
 #include "consensus/validation.h"
 #include "main.h"
+#include "mempool_limit.h"
 #include "miner.h"
 #include "policy/policy.h"
 #include "pow.h"
@@ -26,7 +30,10 @@
 #include "transaction_builder.h"
 #include "txdb.h"
 #include "util/test.h"
+#include "util/time.h"
 #include "wallet/wallet.h"
+#include "wallet/wallet_tx_builder.h"
+#include "zip317.h"
 
 #include "zcbenchmarks.h"
 
@@ -312,6 +319,33 @@ double benchmark_try_decrypt_sapling_notes(size_t nKeys)
     return timer_stop(tv_start);
 }
 
+// The same check as try_decrypt_sapling_notes, through the batch scanner that
+// the wallet uses for new transactions and blocks.
+double benchmark_batch_scan_sapling_notes(size_t nKeys)
+{
+    auto masterKey = GetTestMasterSaplingSpendingKey();
+
+    CWallet wallet(Params());
+
+    for (int i = 0; i < nKeys; i++) {
+        auto sk = masterKey.Derive(i);
+        wallet.AddSaplingSpendingKey(sk);
+    }
+
+    // Generate a key that has not been added to the wallet
+    auto sk = masterKey.Derive(nKeys);
+    auto tx = GetValidSaplingReceive(Params(), wallet, sk, 10);
+
+    struct timeval tv_start;
+    timer_start(tv_start);
+    auto batchScanner = wallet.GetBatchScanner();
+    batchScanner->AddTransaction(tx, uint256(), 1);
+    batchScanner->Flush();
+    batchScanner->SyncTransaction(tx, nullptr, 1);
+    assert(wallet.mapWallet.empty());
+    return timer_stop(tv_start);
+}
+
 CWalletTx CreateSproutTxWithNoteData(const libzcash::SproutSpendingKey& sk) {
     auto wtx = GetValidSproutReceive(sk, 10, true);
     auto note = GetSproutNote(sk, wtx, 0, 1);
@@ -564,7 +598,8 @@ public:
                     CNullifiersMap &mapOrchardNullifiers,
                     CHistoryCacheMap &historyCacheMap,
                     SubtreeCache &cacheSaplingSubtrees,
-                    SubtreeCache &cacheOrchardSubtrees) {
+                    SubtreeCache &cacheOrchardSubtrees,
+                    bool fErase) {
         return false;
     }
 
@@ -749,6 +784,111 @@ double benchmark_listunspent()
     return timer_stop(tv_start);
 }
 
+extern UniValue getbalance(const UniValue& params, bool fHelp);
+extern UniValue z_getbalanceforaccount(const UniValue& params, bool fHelp);
+extern UniValue z_listunspent(const UniValue& params, bool fHelp);
+
+double benchmark_getbalance(libzcash::AccountId account)
+{
+    UniValue params(UniValue::VARR);
+    UniValue accountParams(UniValue::VARR);
+    accountParams.push_back((int64_t)account);
+
+    struct timeval tv_start;
+    timer_start(tv_start);
+    auto balance = getbalance(params, false);
+    auto accountBalance = z_getbalanceforaccount(accountParams, false);
+    return timer_stop(tv_start);
+}
+
+double benchmark_z_listunspent()
+{
+    // Include the notes of imported viewing keys.
+    UniValue params(UniValue::VARR);
+    params.push_back(1);
+    params.push_back(9999999);
+    params.push_back(true);
+
+    struct timeval tv_start;
+    timer_start(tv_start);
+    auto unspent = z_listunspent(params, false);
+    return timer_stop(tv_start);
+}
+
+double benchmark_select_notes(libzcash::AccountId account, CAmount amount)
+{
+    auto selector = pwalletMain->ZTXOSelectorForAccount(account, true, TransparentCoinbasePolicy::Disallow);
+    if (!selector.has_value()) {
+        throw JSONRPCError(RPC_INVALID_PARAMETER, "Account has not been generated by z_getnewaccount");
+    }
+    auto recipient = libzcash::SaplingSpendingKey::random().default_address();
+    std::vector<Payment> payments = {Payment(recipient, amount, std::nullopt)};
+    WalletTxBuilder builder(Params(), minRelayTxFee);
+
+    // This is the work that z_sendmany does before it creates any proofs.
+    struct timeval tv_start;
+    timer_start(tv_start);
+    auto spendable = builder.FindAllSpendableInputs(*pwalletMain, selector.value(), 1);
+    auto effects = builder.PrepareTransaction(
+            *pwalletMain,
+            selector.value(),
+            spendable,
+            payments,
+            chainActive,
+            TransactionStrategy(PrivacyPolicy::FullPrivacy),
+            std::nullopt,
+            1);
+    auto res = timer_stop(tv_start);
+    if (!effects.has_value()) {
+        throw JSONRPCError(RPC_WALLET_INSUFFICIENT_FUNDS, "Insufficient funds in the account");
+    }
+    return res;
+}
+
+double benchmark_rescan()
+{
+    struct timeval tv_start;
+    timer_start(tv_start);
+    pwalletMain->ScanForWalletTransactions(chainActive.Genesis(), true, false);
+    return timer_stop(tv_start);
+}
+
+double benchmark_wallet_witness_update()
+{
+    const auto& consensus = Params().GetConsensus();
+    CBlockIndex* pindex = chainActive.Tip();
+    if (pindex->pprev == nullptr) {
+        throw JSONRPCError(RPC_MISC_ERROR, "The chain has no blocks to update witnesses with");
+    }
+    CBlock block;
+    if (!ReadBlockFromDisk(block, pindex, consensus)) {
+        throw JSONRPCError(RPC_INTERNAL_ERROR, "Failed to read the tip block");
+    }
+
+    // The commitment trees as of the start of the tip block, which is how
+    // ThreadNotifyWallets finds them.
+    MerkleFrontiers frontiers;
+    assert(pcoinsTip->GetSproutAnchorAt(pindex->hashSproutAnchor, frontiers.sprout));
+    if (consensus.NetworkUpgradeActive(pindex->pprev->nHeight, Consensus::UPGRADE_SAPLING)) {
+        assert(pcoinsTip->GetSaplingAnchorAt(pindex->pprev->hashFinalSaplingRoot, frontiers.sapling));
+    } else {
+        assert(pcoinsTip->GetSaplingAnchorAt(SaplingMerkleTree::empty_root(), frontiers.sapling));
+    }
+    if (consensus.NetworkUpgradeActive(pindex->pprev->nHeight, Consensus::UPGRADE_NU5)) {
+        assert(pcoinsTip->GetOrchardAnchorAt(pindex->pprev->hashFinalOrchardRoot, frontiers.orchard));
+    } else {
+        assert(pcoinsTip->GetOrchardAnchorAt(OrchardMerkleFrontier::empty_root(), frontiers.orchard));
+    }
+
+    // Roll the witnesses of every note in the wallet back to before the tip,
+    // then time bringing them up to date again.
+    pwalletMain->ChainTip(pindex, &block, std::nullopt);
+    struct timeval tv_start;
+    timer_start(tv_start);
+    pwalletMain->ChainTip(pindex, &block, frontiers);
+    return timer_stop(tv_start);
+}
+
 double benchmark_create_sapling_spend()
 {
     auto sk = libzcash::SaplingSpendingKey::random();
@@ -810,6 +950,265 @@ double benchmark_create_sapling_output()
     return t;
 }
 
+// Build a transaction spending nSaplingSpends Sapling notes, with nOrchardOutputs
+// Orchard outputs and Sapling change, as z_sendmany does for payout batches.
+double benchmark_create_shielded_tx(size_t nSaplingSpends, size_t nOrchardOutputs)
+{
+    auto sk = GetTestMasterSaplingSpendingKey();
+    auto pa = sk.ToXFVK().DefaultAddress();
+
+    SaplingMerkleTree tree;
+    std::vector<libzcash::SaplingNote> notes;
+    std::vector<SaplingWitness> witnesses;
+    for (size_t i = 0; i < nSaplingSpends; i++) {
+        libzcash::SaplingNote note(pa, COIN, libzcash::Zip212Enabled::AfterZip212);
+        uint256 cmu = note.cmu().value();
+        tree.append(cmu);
+        for (auto& witness : witnesses) {
+            witness.append(cmu);
+        }
+        witnesses.push_back(tree.witness());
+        notes.push_back(note);
+    }
+
+    RawHDSeed seed(32, 0);
+    auto to = libzcash::OrchardSpendingKey::ForAccount(seed, 133, 0)
+        .ToFullViewingKey()
+        .GetChangeAddress();
+
+    auto nHeight = Params().GetConsensus().vUpgrades[Consensus::UPGRADE_NU5].nActivationHeight;
+    auto builder = TransactionBuilder(Params(), nHeight, OrchardMerkleFrontier::empty_root(), tree.root());
+    for (size_t i = 0; i < nSaplingSpends; i++) {
+        builder.AddSaplingSpend(sk, notes[i], witnesses[i]);
+    }
+    for (size_t i = 0; i < nOrchardOutputs; i++) {
+        builder.AddOrchardOutput(std::nullopt, to, 1000, std::nullopt);
+    }
+    builder.SetFee(10000);
+
+    struct timeval tv_start;
+    timer_start(tv_start);
+
+    auto result = builder.Build();
+
+    double t = timer_stop(tv_start);
+    assert(result.IsTx());
+    return t;
+}
+
+namespace {
+
+enum class BenchmarkTxKind {
+    //! One coin in, two coins out.
+    Transparent,
+    //! One Sapling note in, two Sapling notes out.
+    Sapling,
+    //! One coin in, two Orchard notes out.
+    Orchard,
+    //! MULTI_ACTION_SPENDS Sapling notes in, as many Orchard notes out.
+    MultiAction,
+};
+
+static const size_t MULTI_ACTION_SPENDS = 4;
+
+/**
+ * Build transactions of the given kinds that can be accepted to the mempool
+ * on top of view, adding the coins and the Sapling anchor they spend to view.
+ * Returns each transaction with its fee.
+ */
+std::vector<std::pair<CTransactionRef, CAmount>> BuildBenchmarkTxs(
+    const std::vector<BenchmarkTxKind>& vKinds, int nHeight, CCoinsViewCache& view)
+{
+    const CChainParams& params = Params();
+
+    CBasicKeyStore keystore;
+    CKey key = AddTestCKeyToKeyStore(keystore);
+    CKeyID keyId = key.GetPubKey().GetID();
+    CScript scriptPubKey = GetScriptForDestination(keyId);
+
+    auto sk = GetTestMasterSaplingSpendingKey();
+    auto xfvk = sk.ToXFVK();
+    auto pa = xfvk.DefaultAddress();
+    RawHDSeed seed(32, 0);
+    auto orchardAddr = libzcash::OrchardSpendingKey::ForAccount(seed, 133, 0)
+        .ToFullViewingKey()
+        .GetChangeAddress();
+
+    // All the Sapling notes spent are in one tree, whose root is the anchor.
+    size_t nNotes = 0;
+    for (BenchmarkTxKind kind : vKinds) {
+        if (kind == BenchmarkTxKind::Sapling) {
+            nNotes += 1;
+        } else if (kind == BenchmarkTxKind::MultiAction) {
+            nNotes += MULTI_ACTION_SPENDS;
+        }
+    }
+    SaplingMerkleTree tree;
+    std::vector<libzcash::SaplingNote> notes;
+    std::vector<SaplingWitness> witnesses;
+    for (size_t i = 0; i < nNotes; i++) {
+        libzcash::SaplingNote note(pa, COIN, libzcash::Zip212Enabled::AfterZip212);
+        uint256 cmu = note.cmu().value();
+        tree.append(cmu);
+        for (auto& witness : witnesses) {
+            witness.append(cmu);
+        }
+        witnesses.push_back(tree.witness());
+        notes.push_back(note);
+    }
+    if (nNotes > 0) {
+        view.PushAnchor(tree);
+    }
+
+    std::optional<uint256> orchardAnchor;
+    if (params.GetConsensus().NetworkUpgradeActive(nHeight, Consensus::UPGRADE_NU5)) {
+        orchardAnchor = OrchardMerkleFrontier::empty_root();
+    }
+
+    auto addCoin = [&]() {
+        uint256 txid = GetRandHash();
+        CCoinsModifier coins = view.ModifyNewCoins(txid);
+        coins->fCoinBase = false;
+        coins->nVersion = 1;
+        coins->nHeight = nHeight - 1;
+        coins->vout.assign(1, CTxOut(COIN, scriptPubKey));
+        return COutPoint(txid, 0);
+    };
+
+    std::vector<std::pair<CTransactionRef, CAmount>> vtx;
+    size_t nNote = 0;
+    for (BenchmarkTxKind kind : vKinds) {
+        auto builder = TransactionBuilder(params, nHeight, orchardAnchor, tree.root(), &keystore);
+        CAmount nFee;
+        switch (kind) {
+        case BenchmarkTxKind::Transparent:
+            nFee = CalculateConventionalFee(2);
+            builder.AddTransparentInput(addCoin(), scriptPubKey, COIN);
+            builder.AddTransparentOutput(keyId, COIN / 2);
+            builder.AddTransparentOutput(keyId, COIN - COIN / 2 - nFee);
+            break;
+        case BenchmarkTxKind::Sapling:
+            nFee = CalculateConventionalFee(2);
+            builder.AddSaplingSpend(sk, notes[nNote], witnesses[nNote]);
+            nNote++;
+            builder.AddSaplingOutput(xfvk.fvk.ovk, pa, COIN / 2, std::nullopt);
+            builder.AddSaplingOutput(xfvk.fvk.ovk, pa, COIN - COIN / 2 - nFee, std::nullopt);
+            break;
+        case BenchmarkTxKind::Orchard:
+            // One transparent input and two Orchard actions.
+            nFee = CalculateConventionalFee(3);
+            builder.AddTransparentInput(addCoin(), scriptPubKey, COIN);
+            builder.AddOrchardOutput(std::nullopt, orchardAddr, COIN / 2, std::nullopt);
+            builder.AddOrchardOutput(std::nullopt, orchardAddr, COIN - COIN / 2 - nFee, std::nullopt);
+            break;
+        case BenchmarkTxKind::MultiAction:
+            nFee = CalculateConventionalFee(2 * MULTI_ACTION_SPENDS);
+            for (size_t i = 0; i < MULTI_ACTION_SPENDS; i++) {
+                builder.AddSaplingSpend(sk, notes[nNote], witnesses[nNote]);
+                nNote++;
+                builder.AddOrchardOutput(std::nullopt, orchardAddr, i == 0 ? COIN - nFee : COIN, std::nullopt);
+            }
+            break;
+        }
+        builder.SetFee(nFee);
+        vtx.emplace_back(MakeTransactionRef(builder.Build().GetTxOrThrow()), nFee);
+    }
+    return vtx;
+}
+
+//! The latency below which the given fraction of the sorted latencies are.
+double Percentile(const std::vector<int64_t>& vSorted, double fraction)
+{
+    size_t index = std::min(vSorted.size() - 1, (size_t)std::ceil(fraction * vSorted.size()) - 1);
+    return vSorted[index] * 0.000001;
+}
+
+}
+
+MempoolAcceptBenchmark benchmark_accept_mempool(const std::string& strMix, size_t nTxs, double nRate)
+{
+    AssertLockHeld(cs_main);
+    const Consensus::Params& consensus = Params().GetConsensus();
+    int nHeight = chainActive.Height() + 1;
+
+    std::vector<BenchmarkTxKind> vMix;
+    if (strMix == "transparent") {
+        vMix = {BenchmarkTxKind::Transparent};
+    } else if (strMix == "sapling") {
+        vMix = {BenchmarkTxKind::Sapling};
+    } else if (strMix == "orchard") {
+        vMix = {BenchmarkTxKind::Orchard};
+    } else if (strMix == "multiaction") {
+        vMix = {BenchmarkTxKind::MultiAction};
+    } else if (strMix == "mixed") {
+        vMix = {BenchmarkTxKind::Transparent, BenchmarkTxKind::Sapling, BenchmarkTxKind::Orchard, BenchmarkTxKind::MultiAction};
+    } else {
+        throw JSONRPCError(RPC_INVALID_PARAMETER, "Invalid transaction mix");
+    }
+    bool fNeedsNU5 = strMix != "transparent" && strMix != "sapling";
+    if (!consensus.NetworkUpgradeActive(nHeight, fNeedsNU5 ? Consensus::UPGRADE_NU5 : Consensus::UPGRADE_SAPLING)) {
+        throw JSONRPCError(RPC_TYPE_ERROR, fNeedsNU5 ?
+            "Benchmark requires NU5 to be activated" :
+            "Benchmark requires Sapling to be activated");
+    }
+
+    std::vector<BenchmarkTxKind> vKinds;
+    for (size_t i = 0; i < nTxs; i++) {
+        vKinds.push_back(vMix[i % vMix.size()]);
+    }
+    // The coins and anchor spent are only added to this view, which is
+    // discarded afterwards.
+    CCoinsViewCache view(pcoinsTip);
+    auto vtx = BuildBenchmarkTxs(vKinds, nHeight, view);
+
+    // The mempool holds half of the transactions, so that the others cause
+    // evictions.
+    int64_t nTotalCost = 0;
+    for (const auto& [ptx, nFee] : vtx) {
+        nTotalCost += MempoolCostAndEvictionWeight(*ptx, nFee).first;
+    }
+    CTxMemPool pool(::minRelayTxFee);
+    pool.SetMempoolCostLimit(std::max(nTotalCost / 2, MIN_TX_COST), DEFAULT_MEMPOOL_EVICTION_MEMORY_MINUTES * 60);
+
+    // Transaction i arrives at nStart + i / nRate, and its latency runs from
+    // then until it has been checked, so that it includes the time spent
+    // waiting for the transactions before it.
+    std::vector<int64_t> vLatencies;
+    size_t nAccepted = 0;
+    CCoinsViewCache* pcoinsTipSaved = pcoinsTip;
+    pcoinsTip = &view;
+    int64_t nStart = GetTimeMicros();
+    try {
+        for (size_t i = 0; i < vtx.size(); i++) {
+            int64_t nArrival = nRate > 0 ? nStart + (int64_t)(i * 1000000 / nRate) : GetTimeMicros();
+            int64_t nWait = nArrival - GetTimeMicros();
+            if (nWait > 0) {
+                std::this_thread::sleep_for(std::chrono::microseconds(nWait));
+            }
+            CValidationState state;
+            if (AcceptToMemoryPool(Params(), pool, state, vtx[i].first, true, nullptr)) {
+                nAccepted++;
+            }
+            vLatencies.push_back(GetTimeMicros() - nArrival);
+        }
+    } catch (...) {
+        pcoinsTip = pcoinsTipSaved;
+        throw;
+    }
+    int64_t nElapsed = std::max<int64_t>(GetTimeMicros() - nStart, 1);
+    pcoinsTip = pcoinsTipSaved;
+
+    std::sort(vLatencies.begin(), vLatencies.end());
+    MempoolAcceptBenchmark result;
+    result.runningTime = nElapsed * 0.000001;
+    result.txPerSecond = vtx.size() / result.runningTime;
+    result.latencyP50 = Percentile(vLatencies, 0.5);
+    result.latencyP99 = Percentile(vLatencies, 0.99);
+    result.nAccepted = nAccepted;
+    result.nEvicted = nAccepted - pool.size();
+    return result;
+}
+
 // Verify Sapling spend from testnet
 // txid: abbd823cbd3d4e3b52023599d81a96b74817e95ce5bb58354f979156bd22ecc8
 // position: 0
@@ -3,6 +3,7 @@
 
 #include <sys/time.h>
 #include <stdlib.h>
+#include <string>
 
 extern double benchmark_sleep();
 extern double benchmark_create_joinsplit();
@@ -14,6 +15,7 @@ extern double benchmark_verify_equihash();
 extern double benchmark_large_tx(size_t nInputs);
 extern double benchmark_try_decrypt_sprout_notes(size_t nAddrs);
 extern double benchmark_try_decrypt_sapling_notes(size_t nAddrs);
+extern double benchmark_batch_scan_sapling_notes(size_t nAddrs);
 extern double benchmark_increment_sprout_note_witnesses(size_t nTxs);
 extern double benchmark_increment_sapling_note_witnesses(size_t nTxs);
 extern double benchmark_connectblock_slow();
@@ -22,8 +24,26 @@ extern double benchmark_connectblock_orchard();
 extern double benchmark_sendtoaddress(CAmount amount);
 extern double benchmark_loadwallet();
 extern double benchmark_listunspent();
+extern double benchmark_getbalance(libzcash::AccountId account);
+extern double benchmark_z_listunspent();
+extern double benchmark_select_notes(libzcash::AccountId account, CAmount amount);
+extern double benchmark_rescan();
+extern double benchmark_wallet_witness_update();
 extern double benchmark_create_sapling_spend();
 extern double benchmark_create_sapling_output();
+extern double benchmark_create_shielded_tx(size_t nSaplingSpends, size_t nOrchardOutputs);
+
+struct MempoolAcceptBenchmark {
+    double runningTime;
+    double txPerSecond;
+    //! Median and 99th percentile of the time from the arrival of each
+    //! transaction until it was checked, in seconds.
+    double latencyP50;
+    double latencyP99;
+    size_t nAccepted;
+    size_t nEvicted;
+};
+extern MempoolAcceptBenchmark benchmark_accept_mempool(const std::string& strMix, size_t nTxs, double nRate);
 extern double benchmark_verify_sapling_spend();
 extern double benchmark_verify_sapling_output();
 
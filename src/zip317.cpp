@@ -14,6 +14,20 @@ CAmount CalculateConventionalFee(size_t logicalActionCount) {
     return MARGINAL_FEE * std::max(GRACE_ACTIONS, logicalActionCount);
 }
 
+size_t CalculateUnpaidActionCount(CAmount fee, CAmount conventionalFee) {
+    return std::max(
+        int64_t {0},
+        (conventionalFee / MARGINAL_FEE) - (fee / MARGINAL_FEE));
+}
+
+int128_t CalculateWeightRatio(CAmount fee, CAmount conventionalFee) {
+    // ensure that the result will always be nonzero
+    static_assert(WEIGHT_RATIO_SCALE > MAX_MONEY);
+    return std::min(
+        (int128_t {WEIGHT_RATIO_SCALE} * std::max(CAmount {1}, fee)) / conventionalFee,
+        int128_t {WEIGHT_RATIO_SCALE} * WEIGHT_RATIO_CAP);
+}
+
 template<typename T>
 static size_t GetTxIOFieldSize(const std::vector<T>& txIOs) {
     auto size = GetSerializeSize(txIOs, SER_NETWORK, PROTOCOL_VERSION);
@@ -6,6 +6,7 @@
 #define ZCASH_ZIP317_H
 
 #include "amount.h"
+#include "int128.h"
 #include "primitives/transaction.h"
 
 #include <cstdint>
@@ -33,6 +34,16 @@ static const CAmount MINIMUM_FEE = MARGINAL_FEE * GRACE_ACTIONS;
 /// <https://zips.z.cash/zip-0317#fee-calculation>.
 CAmount CalculateConventionalFee(size_t logicalActionCount);
 
+/// Return the number of unpaid actions of a transaction, or of a package of
+/// transactions, that pays `fee` where `conventionalFee` is due, calculated
+/// according to <https://zips.z.cash/zip-0317#recommended-algorithm-for-block-template-construction>.
+size_t CalculateUnpaidActionCount(CAmount fee, CAmount conventionalFee);
+
+/// Return a fixed-point representation of the weight ratio of a transaction,
+/// or of a package of transactions, that pays `fee` where `conventionalFee`
+/// is due, where 1 is represented by WEIGHT_RATIO_SCALE.
+int128_t CalculateWeightRatio(CAmount fee, CAmount conventionalFee);
+
 /// Return the number of logical actions calculated according to
 /// <https://zips.z.cash/zip-0317#fee-calculation>.
 size_t CalculateLogicalActionCount(
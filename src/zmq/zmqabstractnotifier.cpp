@@ -26,3 +26,27 @@ bool CZMQAbstractNotifier::NotifyTransaction(const CTransaction &/*transaction*/
 {
     return true;
 }
+
+bool CZMQAbstractNotifier::NotifyBlockConnect(const CBlockIndex * /*pindex*/)
+{
+    return true;
+}
+
+bool CZMQAbstractNotifier::NotifyBlockDisconnect(const CBlockIndex * /*pindex*/)
+{
+    return true;
+}
+
+bool CZMQAbstractNotifier::NotifyTransactionAcceptance(const uint256 &/*txid*/, uint64_t /*nMempoolSequence*/)
+{
+    return true;
+}
+
+bool CZMQAbstractNotifier::NotifyTransactionRemoval(const uint256 &/*txid*/, MemPoolRemovalReason /*reason*/, uint64_t /*nMempoolSequence*/)
+{
+    return true;
+}
+
+void CZMQAbstractNotifier::SkipMessage()
+{
+}
@@ -10,13 +10,17 @@
 
 class CBlockIndex;
 class CZMQAbstractNotifier;
+enum class MemPoolRemovalReason;
+
+//! Default number of messages a notifier queues for each subscriber before dropping them
+static const int DEFAULT_ZMQ_SNDHWM = 1000;
 
 typedef CZMQAbstractNotifier* (*CZMQNotifierFactory)();
 
 class CZMQAbstractNotifier
 {
 public:
-    CZMQAbstractNotifier() : psocket(0) { }
+    CZMQAbstractNotifier() : psocket(0), outboundMessageHighWaterMark(DEFAULT_ZMQ_SNDHWM) { }
     virtual ~CZMQAbstractNotifier();
 
     template <typename T>
@@ -29,6 +33,8 @@ public:
     void SetType(const std::string &t) { type = t; }
     std::string GetAddress() const { return address; }
     void SetAddress(const std::string &a) { address = a; }
+    int GetOutboundMessageHighWaterMark() const { return outboundMessageHighWaterMark; }
+    void SetOutboundMessageHighWaterMark(int hwm) { outboundMessageHighWaterMark = hwm; }
 
     virtual bool Initialize(void *pcontext) = 0;
     virtual void Shutdown() = 0;
@@ -36,11 +42,20 @@ public:
     virtual bool NotifyBlock(const CBlockIndex *pindex);
     virtual bool NotifyBlock(const CBlock& pblock);
     virtual bool NotifyTransaction(const CTransaction &transaction);
+    virtual bool NotifyBlockConnect(const CBlockIndex *pindex);
+    virtual bool NotifyBlockDisconnect(const CBlockIndex *pindex);
+    virtual bool NotifyTransactionAcceptance(const uint256 &txid, uint64_t nMempoolSequence);
+    virtual bool NotifyTransactionRemoval(const uint256 &txid, MemPoolRemovalReason reason, uint64_t nMempoolSequence);
+
+    //! Account for notifications that were dropped before they could be
+    //! published, so that subscribers can tell that they missed some.
+    virtual void SkipMessage();
 
 protected:
     void *psocket;
     std::string type;
     std::string address;
+    int outboundMessageHighWaterMark; //! ZMQ_SNDHWM of the socket
 };
 
 #endif // BITCOIN_ZMQ_ZMQABSTRACTNOTIFIER_H
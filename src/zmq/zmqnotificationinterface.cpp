@@ -9,14 +9,17 @@
 #include "version.h"
 #include "main.h"
 #include "streams.h"
+#include "txmempool.h"
 #include "util/system.h"
 
+#include <memory>
+
 void zmqError(const char *str)
 {
     LogPrint("zmq", "zmq: Error: %s, errno=%s\n", str, zmq_strerror(errno));
 }
 
-CZMQNotificationInterface::CZMQNotificationInterface() : pcontext(NULL)
+CZMQNotificationInterface::CZMQNotificationInterface() : pcontext(NULL), fNotifyCheckedBlock(false), fDropping(false), fStop(false)
 {
 }
 
@@ -41,6 +44,7 @@ CZMQNotificationInterface* CZMQNotificationInterface::CreateWithArguments(const
     factories["pubrawblock"] = CZMQAbstractNotifier::Create<CZMQPublishRawBlockNotifier>;
     factories["pubrawtx"] = CZMQAbstractNotifier::Create<CZMQPublishRawTransactionNotifier>;
     factories["pubcheckedblock"] = CZMQAbstractNotifier::Create<CZMQPublishCheckedBlockNotifier>;
+    factories["pubsequence"] = CZMQAbstractNotifier::Create<CZMQPublishSequenceNotifier>;
 
     for (std::map<std::string, CZMQNotifierFactory>::const_iterator i=factories.begin(); i!=factories.end(); ++i)
     {
@@ -52,6 +56,11 @@ CZMQNotificationInterface* CZMQNotificationInterface::CreateWithArguments(const
             CZMQAbstractNotifier *notifier = factory();
             notifier->SetType(i->first);
             notifier->SetAddress(address);
+            std::map<std::string, std::string>::const_iterator hwm = args.find("-zmq" + i->first + "hwm");
+            if (hwm != args.end())
+            {
+                notifier->SetOutboundMessageHighWaterMark(atoi(hwm->second));
+            }
             notifiers.push_back(notifier);
         }
     }
@@ -109,6 +118,25 @@ bool CZMQNotificationInterface::Initialize()
         return false;
     }
 
+    bool fNotifySequence = false;
+    for (CZMQAbstractNotifier *notifier : notifiers)
+    {
+        fNotifyCheckedBlock |= notifier->GetType() == "pubcheckedblock";
+        fNotifySequence |= notifier->GetType() == "pubsequence";
+    }
+
+    publishThread = std::thread(&CZMQNotificationInterface::ThreadPublish, this);
+    // Only the sequence notifier publishes mempool changes.
+    if (fNotifySequence)
+    {
+        connAdded = mempool.NotifyEntryAdded.connect([this](const CTransaction& tx, uint64_t nMempoolSequence) {
+            TransactionAddedToMempool(tx, nMempoolSequence);
+        });
+        connRemoved = mempool.NotifyEntryRemoved.connect([this](const CTransaction& tx, MemPoolRemovalReason reason, uint64_t nMempoolSequence) {
+            TransactionRemovedFromMempool(tx, reason, nMempoolSequence);
+        });
+    }
+
     return true;
 }
 
@@ -116,6 +144,17 @@ bool CZMQNotificationInterface::Initialize()
 void CZMQNotificationInterface::Shutdown()
 {
     LogPrint("zmq", "zmq: Shutdown notification interface\n");
+    connAdded.disconnect();
+    connRemoved.disconnect();
+    if (publishThread.joinable())
+    {
+        {
+            LOCK(cs_queue);
+            fStop = true;
+        }
+        condQueue.notify_all();
+        publishThread.join();
+    }
     if (pcontext)
     {
         for (std::list<CZMQAbstractNotifier*>::iterator i=notifiers.begin(); i!=notifiers.end(); ++i)
@@ -130,57 +169,113 @@ void CZMQNotificationInterface::Shutdown()
     }
 }
 
-void CZMQNotificationInterface::UpdatedBlockTip(const CBlockIndex *pindex)
+void CZMQNotificationInterface::Enqueue(std::function<bool(CZMQAbstractNotifier*)> event)
 {
-    for (std::list<CZMQAbstractNotifier*>::iterator i = notifiers.begin(); i!=notifiers.end(); )
     {
-        CZMQAbstractNotifier *notifier = *i;
-        if (notifier->NotifyBlock(pindex))
+        LOCK(cs_queue);
+        if (queue.size() >= ZMQ_MAX_QUEUED_NOTIFICATIONS)
         {
-            i++;
+            // Publish a gap in place of the dropped notifications.
+            if (!fDropping)
+            {
+                LogPrint("zmq", "zmq: Publishing has fallen behind, dropping notifications\n");
+                fDropping = true;
+                queue.push_back([](CZMQAbstractNotifier *notifier) {
+                    notifier->SkipMessage();
+                    return true;
+                });
+            }
+            return;
         }
-        else
+        fDropping = false;
+        queue.push_back(std::move(event));
+    }
+    condQueue.notify_one();
+}
+
+void CZMQNotificationInterface::ThreadPublish()
+{
+    RenameThread("zc-zmq");
+    while (true) {
+        std::function<bool(CZMQAbstractNotifier*)> event;
         {
-            notifier->Shutdown();
-            i = notifiers.erase(i);
+            WAIT_LOCK(cs_queue, lock);
+            condQueue.wait(lock, [this] { return fStop || !queue.empty(); });
+            if (fStop) {
+                return;
+            }
+            event = std::move(queue.front());
+            queue.pop_front();
+        }
+
+        for (std::list<CZMQAbstractNotifier*>::iterator i = notifiers.begin(); i!=notifiers.end(); )
+        {
+            CZMQAbstractNotifier *notifier = *i;
+            if (event(notifier))
+            {
+                i++;
+            }
+            else
+            {
+                notifier->Shutdown();
+                i = notifiers.erase(i);
+            }
         }
     }
 }
 
+void CZMQNotificationInterface::UpdatedBlockTip(const CBlockIndex *pindex)
+{
+    Enqueue([pindex](CZMQAbstractNotifier *notifier) {
+        return notifier->NotifyBlock(pindex);
+    });
+}
+
+void CZMQNotificationInterface::BlockConnected(const CBlockIndex *pindex)
+{
+    Enqueue([pindex](CZMQAbstractNotifier *notifier) {
+        return notifier->NotifyBlockConnect(pindex);
+    });
+}
+
+void CZMQNotificationInterface::BlockDisconnected(const CBlockIndex *pindex)
+{
+    Enqueue([pindex](CZMQAbstractNotifier *notifier) {
+        return notifier->NotifyBlockDisconnect(pindex);
+    });
+}
+
 void CZMQNotificationInterface::BlockChecked(const CBlock& block, const CValidationState& state)
 {
-    if (state.IsInvalid()) {
+    if (state.IsInvalid() || !fNotifyCheckedBlock) {
         return;
     }
 
-    for (std::list<CZMQAbstractNotifier*>::iterator i = notifiers.begin(); i!=notifiers.end(); )
-    {
-        CZMQAbstractNotifier *notifier = *i;
-        if (notifier->NotifyBlock(block))
-        {
-            i++;
-        }
-        else
-        {
-            notifier->Shutdown();
-            i = notifiers.erase(i);
-        }
-    }
+    std::shared_ptr<const CBlock> pblock = std::make_shared<const CBlock>(block);
+    Enqueue([pblock](CZMQAbstractNotifier *notifier) {
+        return notifier->NotifyBlock(*pblock);
+    });
 }
 
 void CZMQNotificationInterface::SyncTransaction(const CTransaction &tx, const CBlock *pblock, const int nHeight)
 {
-    for (std::list<CZMQAbstractNotifier*>::iterator i = notifiers.begin(); i!=notifiers.end(); )
-    {
-        CZMQAbstractNotifier *notifier = *i;
-        if (notifier->NotifyTransaction(tx))
-        {
-            i++;
-        }
-        else
-        {
-            notifier->Shutdown();
-            i = notifiers.erase(i);
-        }
-    }
+    Enqueue([tx](CZMQAbstractNotifier *notifier) {
+        return notifier->NotifyTransaction(tx);
+    });
+}
+
+void CZMQNotificationInterface::TransactionAddedToMempool(const CTransaction &tx, uint64_t nMempoolSequence)
+{
+    uint256 txid = tx.GetHash();
+    Enqueue([txid, nMempoolSequence](CZMQAbstractNotifier *notifier) {
+        return notifier->NotifyTransactionAcceptance(txid, nMempoolSequence);
+    });
+}
+
+void CZMQNotificationInterface::TransactionRemovedFromMempool(const CTransaction &tx, MemPoolRemovalReason reason, uint64_t nMempoolSequence)
+{
+    uint256 txid = tx.GetHash();
+    Enqueue([txid, reason, nMempoolSequence](CZMQAbstractNotifier *notifier) {
+        return notifier->NotifyTransactionRemoval(txid, reason, nMempoolSequence);
+    });
 }
@@ -8,12 +8,33 @@
 
 #include "validationinterface.h"
 #include "consensus/validation.h"
+#include "sync.h"
+#include <condition_variable>
+#include <deque>
+#include <functional>
 #include <string>
 #include <map>
+#include <thread>
+
+#include <boost/signals2/connection.hpp>
 
 class CBlockIndex;
 class CZMQAbstractNotifier;
+enum class MemPoolRemovalReason;
+
+//! Maximum number of notifications waiting to be published, beyond which
+//! they are dropped
+static const size_t ZMQ_MAX_QUEUED_NOTIFICATIONS = 10000;
 
+/**
+ * Publishes the notifications of the configured notifiers. Events are
+ * queued in the order in which they are signalled, and published from a
+ * thread of its own, so that neither the validation thread nor the wallet
+ * notification thread waits for a block to be read or a message to be sent.
+ * If the publishing thread falls too far behind, notifications are dropped,
+ * and every notifier leaves a gap in its message sequence numbers where they
+ * would have been.
+ */
 class CZMQNotificationInterface : public CValidationInterface
 {
 public:
@@ -28,13 +49,37 @@ protected:
     // CValidationInterface
     void SyncTransaction(const CTransaction &tx, const CBlock *pblock, const int nHeight);
     void UpdatedBlockTip(const CBlockIndex *pindex);
+    void BlockConnected(const CBlockIndex *pindex);
+    void BlockDisconnected(const CBlockIndex *pindex);
     void BlockChecked(const CBlock& block, const CValidationState& state);
 
+    // CTxMemPool
+    void TransactionAddedToMempool(const CTransaction &tx, uint64_t nMempoolSequence);
+    void TransactionRemovedFromMempool(const CTransaction &tx, MemPoolRemovalReason reason, uint64_t nMempoolSequence);
+
 private:
     CZMQNotificationInterface();
 
+    //! Queue an event for the publishing thread.
+    void Enqueue(std::function<bool(CZMQAbstractNotifier*)> event);
+    void ThreadPublish();
+
     void *pcontext;
+    //! Only used by the publishing thread once it has started.
     std::list<CZMQAbstractNotifier*> notifiers;
+    //! Whether a notifier publishes checked blocks, which are copied to be
+    //! queued.
+    bool fNotifyCheckedBlock;
+
+    Mutex cs_queue;
+    std::condition_variable condQueue;
+    std::deque<std::function<bool(CZMQAbstractNotifier*)>> queue;
+    //! Whether the notifications since the last one queued were dropped.
+    bool fDropping;
+    bool fStop;
+    std::thread publishThread;
+    boost::signals2::connection connAdded;
+    boost::signals2::connection connRemoved;
 };
 
 #endif // BITCOIN_ZMQ_ZMQNOTIFICATIONINTERFACE_H
@@ -3,11 +3,15 @@
 // Distributed under the MIT software license, see the accompanying
 // file COPYING or https://www.opensource.org/licenses/mit-license.php .
 
+#include "blockreader.h"
 #include "chainparams.h"
 #include "zmqpublishnotifier.h"
 #include "main.h"
+#include "txmempool.h"
 #include "util/system.h"
 
+#include <optional>
+
 static std::multimap<std::string, CZMQAbstractPublishNotifier*> mapPublishNotifiers;
 
 static const char *MSG_HASHBLOCK = "hashblock";
@@ -15,6 +19,7 @@ static const char *MSG_HASHTX    = "hashtx";
 static const char *MSG_RAWBLOCK  = "rawblock";
 static const char *MSG_RAWTX     = "rawtx";
 static const char *MSG_CHECKEDBLOCK = "checkedblock";
+static const char *MSG_SEQUENCE  = "sequence";
 
 // Internal function to send multipart message
 static int zmq_send_multipart(void *sock, const void* data, size_t size, ...)
@@ -72,7 +77,17 @@ bool CZMQAbstractPublishNotifier::Initialize(void *pcontext)
             return false;
         }
 
-        int rc = zmq_bind(psocket, address.c_str());
+        LogPrint("zmq", "zmq: Outbound message high water mark for %s at %s is %d\n", type, address, outboundMessageHighWaterMark);
+
+        int rc = zmq_setsockopt(psocket, ZMQ_SNDHWM, &outboundMessageHighWaterMark, sizeof(outboundMessageHighWaterMark));
+        if (rc != 0)
+        {
+            zmqError("Failed to set outbound message high water mark");
+            zmq_close(psocket);
+            return false;
+        }
+
+        rc = zmq_bind(psocket, address.c_str());
         if (rc!=0)
         {
             zmqError("Failed to bind address");
@@ -142,6 +157,12 @@ bool CZMQAbstractPublishNotifier::SendMessage(const char *command, const void* d
     return true;
 }
 
+void CZMQAbstractPublishNotifier::SkipMessage()
+{
+    /* leave a gap in the sequence numbers of the messages that are sent */
+    nSequence++;
+}
+
 bool CZMQPublishHashBlockNotifier::NotifyBlock(const CBlockIndex *pindex)
 {
     uint256 hash = pindex->GetBlockHash();
@@ -166,32 +187,35 @@ bool CZMQPublishRawBlockNotifier::NotifyBlock(const CBlockIndex *pindex)
 {
     LogPrint("zmq", "zmq: Publish rawblock %s\n", pindex->GetBlockHash().GetHex());
 
-    const Consensus::Params& consensusParams = Params().GetConsensus();
-    CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
+    // Blocks are stored as they are serialized on the network. A block that
+    // was just connected is still cached along with its serialization, and
+    // any other is read from disk without holding cs_main.
+    std::shared_ptr<const std::vector<uint8_t>> pvRaw = recentBlocks.GetRaw(pindex->GetBlockHash());
+    std::vector<uint8_t> vRawBlock;
+    if (!pvRaw)
     {
-        LOCK(cs_main);
-        CBlock block;
-        if(!ReadBlockFromDisk(block, pindex, consensusParams))
+        CDiskBlockPos pos;
+        {
+            LOCK(cs_main);
+            pos = pindex->GetBlockPos();
+        }
+        if (pos.IsNull() || !ReadRawBlockFromDisk(vRawBlock, pos, Params().MessageStart()))
         {
             zmqError("Can't read block from disk");
             return false;
         }
-
-        ss << block;
     }
+    const std::vector<uint8_t>& vRaw = pvRaw ? *pvRaw : vRawBlock;
 
-    return SendMessage(MSG_RAWBLOCK, &(*ss.begin()), ss.size());
+    return SendMessage(MSG_RAWBLOCK, vRaw.data(), vRaw.size());
 }
 
 bool CZMQPublishCheckedBlockNotifier::NotifyBlock(const CBlock& block)
 {
     LogPrint("zmq", "zmq: Publish checkedblock %s\n", block.GetHash().GetHex());
 
-    CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
-    {
-        LOCK(cs_main);
-        ss << block;
-    }
+    CPublicDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
+    ss << block;
 
     return SendMessage(MSG_CHECKEDBLOCK, &(*ss.begin()), ss.size());
 }
@@ -200,7 +224,51 @@ bool CZMQPublishRawTransactionNotifier::NotifyTransaction(const CTransaction &tr
 {
     uint256 hash = transaction.GetHash();
     LogPrint("zmq", "zmq: Publish rawtx %s\n", hash.GetHex());
-    CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
+    CPublicDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
     ss << transaction;
     return SendMessage(MSG_RAWTX, &(*ss.begin()), ss.size());
 }
+
+// The body of a sequence message is the hash, a label and, for mempool
+// changes, the mempool sequence number (LE 8 bytes) followed by the reason
+// for a removal.
+static bool SendSequenceMessage(CZMQAbstractPublishNotifier& notifier, const uint256& hash, char label, std::optional<uint64_t> nMempoolSequence = std::nullopt, const std::string& strReason = "")
+{
+    std::vector<unsigned char> data(32 + 1);
+    for (unsigned int i = 0; i < 32; i++)
+        data[31 - i] = hash.begin()[i];
+    data[32] = label;
+    if (nMempoolSequence) {
+        unsigned char seq[sizeof(uint64_t)];
+        WriteLE64(&seq[0], *nMempoolSequence);
+        data.insert(data.end(), seq, seq + sizeof(seq));
+    }
+    data.insert(data.end(), strReason.begin(), strReason.end());
+    return notifier.SendMessage(MSG_SEQUENCE, data.data(), data.size());
+}
+
+bool CZMQPublishSequenceNotifier::NotifyBlockConnect(const CBlockIndex *pindex)
+{
+    uint256 hash = pindex->GetBlockHash();
+    LogPrint("zmq", "zmq: Publish sequence block connect %s\n", hash.GetHex());
+    return SendSequenceMessage(*this, hash, 'C');
+}
+
+bool CZMQPublishSequenceNotifier::NotifyBlockDisconnect(const CBlockIndex *pindex)
+{
+    uint256 hash = pindex->GetBlockHash();
+    LogPrint("zmq", "zmq: Publish sequence block disconnect %s\n", hash.GetHex());
+    return SendSequenceMessage(*this, hash, 'D');
+}
+
+bool CZMQPublishSequenceNotifier::NotifyTransactionAcceptance(const uint256 &txid, uint64_t nMempoolSequence)
+{
+    LogPrint("zmq", "zmq: Publish sequence mempool acceptance %s\n", txid.GetHex());
+    return SendSequenceMessage(*this, txid, 'A', nMempoolSequence);
+}
+
+bool CZMQPublishSequenceNotifier::NotifyTransactionRemoval(const uint256 &txid, MemPoolRemovalReason reason, uint64_t nMempoolSequence)
+{
+    LogPrint("zmq", "zmq: Publish sequence mempool removal %s (%s)\n", txid.GetHex(), RemovalReasonToString(reason));
+    return SendSequenceMessage(*this, txid, 'R', nMempoolSequence, RemovalReasonToString(reason));
+}
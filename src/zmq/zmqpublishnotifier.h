@@ -25,6 +25,8 @@ public:
     */
     bool SendMessage(const char *command, const void* data, size_t size);
 
+    void SkipMessage();
+
     bool Initialize(void *pcontext);
     void Shutdown();
 };
@@ -59,4 +61,20 @@ public:
     bool NotifyBlock(const CBlock &block);
 };
 
+/**
+ * Publishes block connects and disconnects and transactions entering and
+ * leaving the mempool, in the order in which they happen. The body of each
+ * message is a hash, a label and, for mempool changes, the mempool sequence
+ * number, which counts up by one with every change, so that subscribers can
+ * tell that they missed one.
+ */
+class CZMQPublishSequenceNotifier : public CZMQAbstractPublishNotifier
+{
+public:
+    bool NotifyBlockConnect(const CBlockIndex *pindex);
+    bool NotifyBlockDisconnect(const CBlockIndex *pindex);
+    bool NotifyTransactionAcceptance(const uint256 &txid, uint64_t nMempoolSequence);
+    bool NotifyTransactionRemoval(const uint256 &txid, MemPoolRemovalReason reason, uint64_t nMempoolSequence);
+};
+
 #endif // BITCOIN_ZMQ_ZMQPUBLISHNOTIFIER_H